@@ -86,6 +86,7 @@ class Film : public TaggedPointer<RGBFilm, GBufferFilm, SpectralFilm> {
     PBRT_CPU_GPU inline Filter GetFilter() const;
     PBRT_CPU_GPU inline const PixelSensor *GetPixelSensor() const;
     std::string GetFilename() const;
+    void SetFilename(const std::string &filename);
 
     using TaggedPointer::TaggedPointer;
 
@@ -95,6 +96,23 @@ class Film : public TaggedPointer<RGBFilm, GBufferFilm, SpectralFilm> {
 
     std::string ToString() const;
 
+    std::string SerializePixels() const;
+    bool DeserializePixels(const std::string &state);
+
+    // For distributed rendering, returns the accumulated values of the pixels
+    // in _bounds_ or adds values that it returned to them; only _RGBFilm_
+    // supports these.
+    std::string SerializePixels(const Bounds2i &bounds) const;
+    bool AddPixels(const Bounds2i &bounds, const std::string &state);
+
+    // Makes splats that the film may have buffered visible in its pixels
+    void FlushSplats();
+
+    // Lets the film buffer the samples that the calling thread adds to the
+    // pixels in _tileBounds_ until EndTile() is called
+    void BeginTile(Bounds2i tileBounds);
+    void EndTile();
+
     PBRT_CPU_GPU inline void ResetPixel(Point2i p);
 };
 
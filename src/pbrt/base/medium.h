@@ -53,7 +53,9 @@ struct MediumProperties;
 // RayMajorantSegment Definition
 struct RayMajorantSegment {
     Float tMin, tMax;
-    SampledSpectrum sigma_maj;
+    // _sigma_min_ is a lower bound on $\sigmat$ over the segment that
+    // transmittance estimators may use as a control variate
+    SampledSpectrum sigma_maj, sigma_min;
     std::string ToString() const;
 };
 
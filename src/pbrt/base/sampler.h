@@ -86,6 +86,11 @@ class Sampler
     */
     PBRT_CPU_GPU inline Point2f GetPixel2D();
 
+    // Fills _u_ with the next _u.size()_ dimensions, giving the same values
+    // as that many calls to Get1D() but with a single dispatch to the
+    // sampler's implementation.
+    PBRT_CPU_GPU inline void GetDimensions(pstd::span<Float> u);
+
     /*
         单个Sampler被多线程并行访问是不安全的
         积分器调用Clone()为每个线程获取一份初始Sampler的拷贝
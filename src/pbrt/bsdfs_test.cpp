@@ -7,10 +7,12 @@
 #include <pbrt/pbrt.h>
 
 #include <pbrt/bsdf.h>
+#include <pbrt/bssrdf.h>
 #include <pbrt/interaction.h>
 #include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/shapes.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/image.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/memory.h>
@@ -20,6 +22,7 @@
 #include <pbrt/util/sampling.h>
 #include <pbrt/util/spectrum.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
@@ -650,6 +653,49 @@ TEST(BSDFEnergyConservation,
 }
 #endif
 
+TEST(CoatedDiffuseBxDF, TabulatedMatchesRandomWalk) {
+    // For smooth coatings, the tabulated BSDF should match the average of
+    // the random walk's stochastic estimates of its value.
+    Float alpha = 0, thickness = 0.01f, eta = 1.5f;
+    const CoatedDiffuseTable *table =
+        CoatedDiffuseTable::Get(eta, alpha, thickness, Allocator());
+    TrowbridgeReitzDistribution distrib(alpha, alpha);
+    for (Float R : {0.2f, 0.9f}) {
+        CoatedDiffuseBxDF randomWalk(DielectricBxDF(eta, distrib),
+                                     DiffuseBxDF(SampledSpectrum(R)), thickness,
+                                     SampledSpectrum(0.f), 0.f, 100, 1);
+        CoatedDiffuseBxDF tabulated(DielectricBxDF(eta, distrib),
+                                    DiffuseBxDF(SampledSpectrum(R)), thickness,
+                                    SampledSpectrum(0.f), 0.f, 100, 1, table);
+        Vector3f wo = Normalize(Vector3f(0.6, 0, 0.8));
+        Vector3f wi = Normalize(Vector3f(-0.3, 0.3, 0.5));
+
+        int seed = Options->seed, n = 10000;
+        double sum = 0;
+        for (int i = 0; i < n; ++i) {
+            // The random walk's estimate depends on the seed
+            Options->seed = i;
+            sum += randomWalk.f(wo, wi, TransportMode::Radiance)[0];
+        }
+        Options->seed = seed;
+        Float f = tabulated.f(wo, wi, TransportMode::Radiance)[0];
+        EXPECT_NEAR(sum / n, f, 0.02f * f) << R;
+
+        // Sampled directions should be consistent with the PDF
+        RNG rng;
+        for (int i = 0; i < 1000; ++i) {
+            pstd::optional<BSDFSample> bs = tabulated.Sample_f(
+                wo, rng.Uniform<Float>(), {rng.Uniform<Float>(), rng.Uniform<Float>()},
+                TransportMode::Radiance);
+            if (!bs || bs->IsSpecular())
+                continue;
+            EXPECT_NEAR(bs->pdf, tabulated.PDF(wo, bs->wi, TransportMode::Radiance),
+                        1e-3f * bs->pdf);
+            EXPECT_EQ(bs->f[0], tabulated.f(wo, bs->wi, TransportMode::Radiance)[0]);
+        }
+    }
+}
+
 // Hair Tests
 #if 0
 TEST(Hair, Reciprocity) {
@@ -818,3 +864,34 @@ TEST(Hair, SamplingConsistency) {
             EXPECT_LT(err, 0.05);
         }
 }
+
+TEST(BSSRDFTable, Cache) {
+    std::vector<std::string> existing = MatchingFilenames("./bssrdf-");
+    Options->bssrdfCacheDirectory = ".";
+
+    // Materials with the same parameters share a table, which is saved to the
+    // cache directory
+    Float g = 0.25f, eta = 1.37f;
+    const BSSRDFTable *table = GetBeamDiffusionBSSRDF(g, eta, Allocator());
+    EXPECT_EQ(table, GetBeamDiffusionBSSRDF(g, eta, Allocator()));
+    EXPECT_NE(table, GetBeamDiffusionBSSRDF(g, 1.5f, Allocator()));
+    std::vector<std::string> written;
+    for (const std::string &fn : MatchingFilenames("./bssrdf-"))
+        if (std::find(existing.begin(), existing.end(), fn) == existing.end())
+            written.push_back(fn);
+    EXPECT_EQ(2, written.size());
+
+    Options->bssrdfCacheDirectory.clear();
+    for (const std::string &fn : written)
+        EXPECT_TRUE(RemoveFile(fn));
+
+    BSSRDFTable expected(table->rhoSamples.size(), table->radiusSamples.size(),
+                         Allocator());
+    ComputeBeamDiffusionBSSRDF(g, eta, &expected);
+    for (size_t i = 0; i < expected.profile.size(); ++i) {
+        EXPECT_EQ(expected.profile[i], table->profile[i]);
+        EXPECT_EQ(expected.profileCDF[i], table->profileCDF[i]);
+    }
+    for (size_t i = 0; i < expected.rhoEff.size(); ++i)
+        EXPECT_EQ(expected.rhoEff[i], table->rhoEff[i]);
+}
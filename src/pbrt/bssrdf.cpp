@@ -5,14 +5,23 @@
 #include <pbrt/bssrdf.h>
 
 #include <pbrt/media.h>
+#include <pbrt/options.h>
 #include <pbrt/shapes.h>
+#include <pbrt/util/containers.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/sampling.h>
+#include <pbrt/util/stats.h>
 
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 
 namespace pbrt {
 
@@ -127,6 +136,119 @@ void ComputeBeamDiffusionBSSRDF(Float g, Float eta, BSSRDFTable *t) {
     });
 }
 
+STAT_COUNTER("BSSRDF/Beam diffusion tables computed", nBeamDiffusionTablesComputed);
+STAT_COUNTER("BSSRDF/Beam diffusion tables read from cache", nBeamDiffusionTablesRead);
+
+// BSSRDFCacheHeader Definition
+struct BSSRDFCacheHeader {
+    char magic[8] = {'p', 'b', 'r', 't', 'b', 's', 's', '1'};
+    Float g, eta;
+    int32_t floatSize = sizeof(Float);
+    int32_t nRhoSamples, nRadiusSamples;
+};
+
+// Returns the arrays of _t_ in the order that they are stored in cache files
+static pstd::array<pstd::vector<Float> *, 5> CachedArrays(BSSRDFTable *t) {
+    return {&t->rhoSamples, &t->radiusSamples, &t->profile, &t->rhoEff, &t->profileCDF};
+}
+
+static bool ReadBSSRDFCache(const std::string &filename, Float g, Float eta,
+                            BSSRDFTable *t) {
+    if (!FileExists(filename))
+        return false;
+    std::string contents = ReadFileContents(filename);
+    // Validate cached table header against the table's parameters
+    BSSRDFCacheHeader header, expected;
+    expected.g = g;
+    expected.eta = eta;
+    expected.nRhoSamples = t->rhoSamples.size();
+    expected.nRadiusSamples = t->radiusSamples.size();
+    size_t nFloats = 0;
+    for (pstd::vector<Float> *v : CachedArrays(t))
+        nFloats += v->size();
+    if (contents.size() != sizeof(header) + nFloats * sizeof(Float)) {
+        Warning("%s: ignoring invalid or stale BSSRDF cache file.", filename);
+        return false;
+    }
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.g != g || header.eta != eta || header.floatSize != expected.floatSize ||
+        header.nRhoSamples != expected.nRhoSamples ||
+        header.nRadiusSamples != expected.nRadiusSamples) {
+        Warning("%s: ignoring invalid or stale BSSRDF cache file.", filename);
+        return false;
+    }
+
+    const char *data = contents.data() + sizeof(header);
+    for (pstd::vector<Float> *v : CachedArrays(t)) {
+        std::memcpy(v->data(), data, v->size() * sizeof(Float));
+        data += v->size() * sizeof(Float);
+    }
+    LOG_VERBOSE("Read BSSRDF table for g %f eta %f from %s", g, eta, filename);
+    return true;
+}
+
+static void WriteBSSRDFCache(const std::string &filename, Float g, Float eta,
+                             BSSRDFTable *t) {
+    BSSRDFCacheHeader header;
+    header.g = g;
+    header.eta = eta;
+    header.nRhoSamples = t->rhoSamples.size();
+    header.nRadiusSamples = t->radiusSamples.size();
+    std::string contents;
+    contents.append((const char *)&header, sizeof(header));
+    for (pstd::vector<Float> *v : CachedArrays(t))
+        contents.append((const char *)v->data(), v->size() * sizeof(Float));
+
+    // Write to a temporary file so that concurrent renders never see partial caches
+    std::string tempFilename = StringPrintf("%s.%p.tmp", filename, t);
+    if (!WriteFileContents(tempFilename, contents) ||
+        std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write BSSRDF cache file.", filename);
+        RemoveFile(tempFilename);
+    } else
+        LOG_VERBOSE("Wrote BSSRDF cache file %s", filename);
+}
+
+const BSSRDFTable *GetBeamDiffusionBSSRDF(Float g, Float eta, Allocator alloc) {
+    // BeamDiffusionTable Definition
+    struct BeamDiffusionTable {
+        bool operator==(const BeamDiffusionTable &t) const {
+            return g == t.g && eta == t.eta;
+        }
+        Float g, eta;
+        const BSSRDFTable *table;
+    };
+    struct TableHash {
+        size_t operator()(const BeamDiffusionTable &t) const { return Hash(t.g, t.eta); }
+    };
+    static InternCache<BeamDiffusionTable, TableHash> *cache =
+        new InternCache<BeamDiffusionTable, TableHash>(alloc);
+
+    auto create = [](Allocator alloc, const BeamDiffusionTable &t) {
+        const int nRhoSamples = 100, nRadiusSamples = 64;
+        BSSRDFTable *table = alloc.new_object<BSSRDFTable>(nRhoSamples, nRadiusSamples,
+                                                            alloc);
+        // Read the table from the cache directory or compute and save it
+        std::string cacheFilename;
+        if (!Options->bssrdfCacheDirectory.empty())
+            cacheFilename = StringPrintf("%s/bssrdf-%016x.bin",
+                                         Options->bssrdfCacheDirectory,
+                                         Hash(t.g, t.eta, nRhoSamples, nRadiusSamples));
+        if (!cacheFilename.empty() && ReadBSSRDFCache(cacheFilename, t.g, t.eta, table))
+            ++nBeamDiffusionTablesRead;
+        else {
+            ++nBeamDiffusionTablesComputed;
+            ComputeBeamDiffusionBSSRDF(t.g, t.eta, table);
+            if (!cacheFilename.empty())
+                WriteBSSRDFCache(cacheFilename, t.g, t.eta, table);
+        }
+        return alloc.new_object<BeamDiffusionTable>(
+            BeamDiffusionTable{t.g, t.eta, table});
+    };
+    return cache->Lookup(BeamDiffusionTable{g, eta, nullptr}, create)->table;
+}
+
 // BSSRDFTable Method Definitions
 BSSRDFTable::BSSRDFTable(int nRhoSamples, int nRadiusSamples, Allocator alloc)
     : rhoSamples(nRhoSamples, alloc),
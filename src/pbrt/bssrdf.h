@@ -70,6 +70,12 @@ Float BeamDiffusionMS(Float sigma_s, Float sigma_a, Float g, Float eta, Float r)
 
 void ComputeBeamDiffusionBSSRDF(Float g, Float eta, BSSRDFTable *t);
 
+// Returns the photon beam diffusion table for the given parameters. Tables
+// are shared by all materials with the same _g_ and _eta_; if a BSSRDF cache
+// directory is specified, they are also read from it and saved to it so that
+// later runs need not recompute them.
+const BSSRDFTable *GetBeamDiffusionBSSRDF(Float g, Float eta, Allocator alloc);
+
 // BSSRDFTable Definition
 struct BSSRDFTable {
     // BSSRDFTable Public Members
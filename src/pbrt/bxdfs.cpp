@@ -11,17 +11,21 @@
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
+#include <pbrt/util/containers.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
 #include <pbrt/util/float.h>
 #include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
+#include <pbrt/util/lowdiscrepancy.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/sampling.h>
 #include <pbrt/util/stats.h>
 
+#include <map>
+#include <mutex>
 #include <unordered_map>
 
 namespace pbrt {
@@ -73,6 +77,166 @@ std::string LayeredBxDF<TopBxDF, BottomBxDF, twoSided>::ToString() const {
         thickness, albedo, g);
 }
 
+// CoatedDiffuseTable Method Definitions
+STAT_COUNTER("BSDF/Coated diffuse tables", nCoatedDiffuseTables);
+
+const CoatedDiffuseTable *CoatedDiffuseTable::Get(Float eta, Float alpha,
+                                                  Float thickness, Allocator alloc) {
+    struct TableHash {
+        size_t operator()(const CoatedDiffuseTable &t) const {
+            return Hash(t.eta, t.alpha, t.thickness);
+        }
+    };
+    static InternCache<CoatedDiffuseTable, TableHash> *cache =
+        new InternCache<CoatedDiffuseTable, TableHash>(alloc);
+
+    auto create = [](Allocator alloc, const CoatedDiffuseTable &t) {
+        CoatedDiffuseTable *table =
+            alloc.new_object<CoatedDiffuseTable>(t.eta, t.alpha, t.thickness);
+        table->Compute();
+        return table;
+    };
+    return cache->Lookup(CoatedDiffuseTable(eta, alpha, std::max(
+                                                    thickness,
+                                                    std::numeric_limits<Float>::min())),
+                         create);
+}
+
+void CoatedDiffuseTable::Compute() {
+    ++nCoatedDiffuseTables;
+    DielectricBxDF interface(eta, TrowbridgeReitzDistribution(alpha, alpha));
+    auto Tr = [&](Vector3f w) { return FastExp(-std::abs(thickness / w.z)); };
+    constexpr int nSamples = 4096;
+
+    // Estimate the fraction of incident light that reaches the base
+    for (int i = 0; i < TableSize; ++i) {
+        Float cosTheta = std::max<Float>(Float(i) / (TableSize - 1), 1e-3f);
+        Vector3f w(SafeSqrt(1 - Sqr(cosTheta)), 0, cosTheta);
+        double sum = 0;
+        for (int j = 0; j < nSamples; ++j) {
+            Point2f u(RadicalInverse(0, j), RadicalInverse(1, j));
+            pstd::optional<BSDFSample> bs =
+                interface.Sample_f(w, RadicalInverse(2, j), u, TransportMode::Importance,
+                                   BxDFReflTransFlags::Transmission);
+            if (bs && bs->pdf > 0 && bs->wi.z != 0)
+                sum += bs->f[0] * AbsCosTheta(bs->wi) / bs->pdf * Tr(bs->wi);
+        }
+        transmittance[i] = std::min<Float>(sum / nSamples, 1);
+    }
+
+    // Estimate the fraction of the base's reflected light that returns to it
+    double sum = 0;
+    int nReflectionSamples = 16 * nSamples;
+    for (int j = 0; j < nReflectionSamples; ++j) {
+        // Sample a cosine-distributed direction leaving the base and reflect it
+        // from the inside of the interface
+        Vector3f w = -SampleCosineHemisphere(
+                         Point2f(RadicalInverse(0, j), RadicalInverse(1, j)));
+        Point2f u(RadicalInverse(2, j), RadicalInverse(3, j));
+        pstd::optional<BSDFSample> bs =
+            interface.Sample_f(w, RadicalInverse(4, j), u, TransportMode::Importance,
+                               BxDFReflTransFlags::Reflection);
+        if (bs && bs->pdf > 0 && bs->wi.z != 0)
+            sum += bs->f[0] * AbsCosTheta(bs->wi) / bs->pdf * Tr(w) * Tr(bs->wi);
+    }
+    internalReflectance = std::min<Float>(sum / nReflectionSamples, 1);
+}
+
+std::string CoatedDiffuseTable::ToString() const {
+    return StringPrintf("[ CoatedDiffuseTable eta: %f alpha: %f thickness: %f "
+                        "transmittance: %s internalReflectance: %f ]",
+                        eta, alpha, thickness,
+                        pstd::span<const Float>(transmittance, TableSize),
+                        internalReflectance);
+}
+
+// CoatedDiffuseBxDF Method Definitions
+PBRT_CPU_GPU SampledSpectrum CoatedDiffuseBxDF::f(Vector3f wo, Vector3f wi,
+                                                  TransportMode mode) const {
+    if (!table)
+        return LayeredBxDF::f(wo, wi, mode);
+    if (wo.z < 0) {
+        wo = -wo;
+        wi = -wi;
+    }
+    if (!SameHemisphere(wo, wi))
+        return SampledSpectrum(0.f);
+
+    // Add the base's contribution, summing the geometric series of its
+    // interreflections with the interface, to the interface's reflection
+    const SampledSpectrum &R = bottom.Reflectance();
+    Float T = table->Transmittance(AbsCosTheta(wo)) *
+              table->Transmittance(AbsCosTheta(wi)) / (Pi * Sqr(top.Eta()));
+    return top.f(wo, wi, mode) +
+           T * SafeDiv(R, SampledSpectrum(1.f) - R * table->InternalReflectance());
+}
+
+PBRT_CPU_GPU pstd::optional<BSDFSample> CoatedDiffuseBxDF::Sample_f(
+    Vector3f wo, Float uc, Point2f u, TransportMode mode,
+    BxDFReflTransFlags sampleFlags) const {
+    if (!table)
+        return LayeredBxDF::Sample_f(wo, uc, u, mode, sampleFlags);
+    if (!(sampleFlags & BxDFReflTransFlags::Reflection))
+        return {};
+    bool flipWi = false;
+    if (wo.z < 0) {
+        wo = -wo;
+        flipWi = true;
+    }
+
+    // Sample either the interface's reflection or the base's diffuse lobe
+    Float pInterface = InterfaceSampleProbability(wo);
+    Vector3f wi;
+    BxDFFlags flags;
+    if (uc < pInterface) {
+        pstd::optional<BSDFSample> bs =
+            top.Sample_f(wo, std::min(uc / pInterface, OneMinusEpsilon), u, mode,
+                         BxDFReflTransFlags::Reflection);
+        if (!bs || bs->pdf == 0 || bs->wi.z == 0)
+            return {};
+        if (bs->IsSpecular()) {
+            // The base doesn't contribute to specular reflection
+            bs->pdf *= pInterface;
+            if (flipWi)
+                bs->wi = -bs->wi;
+            return bs;
+        }
+        wi = bs->wi;
+        flags = BxDFFlags::GlossyReflection;
+    } else {
+        wi = SampleCosineHemisphere(u);
+        flags = BxDFFlags::DiffuseReflection;
+    }
+
+    SampledSpectrum fVal = f(wo, wi, mode);
+    Float pdf = PDF(wo, wi, mode, sampleFlags);
+    if (pdf == 0)
+        return {};
+    if (flipWi)
+        wi = -wi;
+    return BSDFSample(fVal, wi, pdf, flags);
+}
+
+PBRT_CPU_GPU Float CoatedDiffuseBxDF::PDF(Vector3f wo, Vector3f wi, TransportMode mode,
+                                          BxDFReflTransFlags sampleFlags) const {
+    if (!table)
+        return LayeredBxDF::PDF(wo, wi, mode, sampleFlags);
+    if (wo.z < 0) {
+        wo = -wo;
+        wi = -wi;
+    }
+    if (!(sampleFlags & BxDFReflTransFlags::Reflection) || !SameHemisphere(wo, wi))
+        return 0;
+    Float pInterface = InterfaceSampleProbability(wo);
+    return pInterface * top.PDF(wo, wi, mode, BxDFReflTransFlags::Reflection) +
+           (1 - pInterface) * CosineHemispherePDF(AbsCosTheta(wi));
+}
+
+std::string CoatedDiffuseBxDF::ToString() const {
+    return StringPrintf("[ CoatedDiffuseBxDF %s table: %s ]", LayeredBxDF::ToString(),
+                        table ? table->ToString() : std::string("(nullptr)"));
+}
+
 // DielectricBxDF Method Definitions
 PBRT_CPU_GPU pstd::optional<BSDFSample> DielectricBxDF::Sample_f(
     Vector3f wo, Float uc, Point2f u, TransportMode mode,
@@ -875,18 +1039,25 @@ struct MeasuredBxDFData {
           spectra(alloc),
           wavelengths(alloc) {}
 
-    static MeasuredBxDFData *Create(const std::string &filename, Allocator alloc);
+    static MeasuredBxDFData *Create(const std::string &filename, bool halfPrecision,
+                                    Allocator alloc);
 
     std::string ToString() const {
-        return StringPrintf("[ MeasuredBxDFData filename: %s ]", filename);
+        return StringPrintf("[ MeasuredBxDFData filename: %s halfPrecision: %s ]",
+                            filename, halfPrecision);
     }
 
     std::string filename;
+    bool halfPrecision = false;
 };
 
 STAT_MEMORY_COUNTER("Memory/Measured BRDF data", measuredBRDFBytes);
+STAT_COUNTER("Scene/Measured BRDF files loaded", nMeasuredBRDFFiles);
+STAT_COUNTER("Scene/Measured BRDF lookups", nMeasuredBRDFLookups);
 
-MeasuredBxDFData *MeasuredBxDFData::Create(const std::string &filename, Allocator alloc) {
+MeasuredBxDFData *MeasuredBxDFData::Create(const std::string &filename,
+                                           bool halfPrecision, Allocator alloc) {
+    ++nMeasuredBRDFFiles;
     Tensor tf = Tensor(filename);
     auto &theta_i = tf.field("theta_i");
     auto &phi_i = tf.field("phi_i");
@@ -979,6 +1150,17 @@ MeasuredBxDFData *MeasuredBxDFData::Create(const std::string &filename, Allocato
           (const float *)wavelengths.data.get()}},
         false, false);
 
+    if (halfPrecision) {
+        // Store the tables that are only interpolated in half precision; the
+        // warps' CDFs need full precision for sampling
+        brdf->halfPrecision = brdf->spectra.CompactData() && brdf->ndf.CompactData() &&
+                              brdf->sigma.CompactData();
+        if (!brdf->halfPrecision)
+            Warning("%s: BRDF values exceed the range of half floats; some tables "
+                    "will be stored in single precision.",
+                    filename);
+    }
+
     measuredBRDFBytes += sizeof(MeasuredBxDFData) + 4 * brdf->wavelengths.size() +
                          brdf->ndf.BytesUsed() + brdf->sigma.BytesUsed() +
                          brdf->vndf.BytesUsed() + brdf->luminance.BytesUsed() +
@@ -988,11 +1170,17 @@ MeasuredBxDFData *MeasuredBxDFData::Create(const std::string &filename, Allocato
 }
 
 MeasuredBxDFData *MeasuredBxDF::BRDFDataFromFile(const std::string &filename,
-                                                 Allocator alloc) {
-    static std::map<std::string, MeasuredBxDFData *> loadedData;
-    if (loadedData.find(filename) == loadedData.end())
-        loadedData[filename] = MeasuredBxDFData::Create(filename, alloc);
-    return loadedData[filename];
+                                                 bool halfPrecision, Allocator alloc) {
+    // Materials may be created in parallel, so the loaded data is guarded by
+    // a mutex; it is held while a file loads so that each is only read once
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, bool>, MeasuredBxDFData *> loadedData;
+    ++nMeasuredBRDFLookups;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = std::make_pair(filename, halfPrecision);
+    if (loadedData.find(key) == loadedData.end())
+        loadedData[key] = MeasuredBxDFData::Create(filename, halfPrecision, alloc);
+    return loadedData[key];
 }
 
 // MeasuredBxDF Method Definitions
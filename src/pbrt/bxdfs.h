@@ -80,6 +80,9 @@ class DiffuseBxDF {
         return R ? BxDFFlags::DiffuseReflection : BxDFFlags::Unset;
     }
 
+    PBRT_CPU_GPU
+    const SampledSpectrum &Reflectance() const { return R; }
+
   private:
     SampledSpectrum R;
 };
@@ -202,6 +205,9 @@ class DielectricBxDF {
     PBRT_CPU_GPU
     void Regularize() { mfDistrib.Regularize(); }
 
+    PBRT_CPU_GPU
+    Float Eta() const { return eta; }
+
   private:
     // DielectricBxDF Private Members
     Float eta;
@@ -510,7 +516,7 @@ class LayeredBxDF {
             f = nSamples * enterInterface.f(wo, wi, mode);
 
         // Declare _RNG_ for layered BSDF evaluation
-        RNG rng(Hash(GetOptions().seed, wo), Hash(wi));
+        BatchRNG rng(Hash(GetOptions().seed, wo), Hash(wi));
         auto r = [&rng]() {
             return std::min<Float>(rng.Uniform<Float>(), OneMinusEpsilon);
         };
@@ -683,7 +689,7 @@ class LayeredBxDF {
         bool specularPath = bs->IsSpecular();
 
         // Declare _RNG_ for layered BSDF sampling
-        RNG rng(Hash(GetOptions().seed, wo), Hash(uc, u));
+        BatchRNG rng(Hash(GetOptions().seed, wo), Hash(uc, u));
         auto r = [&rng]() {
             return std::min<Float>(rng.Uniform<Float>(), OneMinusEpsilon);
         };
@@ -788,7 +794,7 @@ class LayeredBxDF {
         }
 
         // Declare _RNG_ for layered PDF evaluation
-        RNG rng(Hash(GetOptions().seed, wi), Hash(wo));
+        BatchRNG rng(Hash(GetOptions().seed, wi), Hash(wo));
         auto r = [&rng]() {
             return std::min<Float>(rng.Uniform<Float>(), OneMinusEpsilon);
         };
@@ -885,8 +891,8 @@ class LayeredBxDF {
         return Lerp(0.9f, 1 / (4 * Pi), pdfSum / nSamples);
     }
 
-  private:
-    // LayeredBxDF Private Methods
+  protected:
+    // LayeredBxDF Protected Methods
     PBRT_CPU_GPU
     static Float Tr(Float dz, Vector3f w) {
         if (std::abs(dz) <= std::numeric_limits<Float>::min())
@@ -894,7 +900,7 @@ class LayeredBxDF {
         return FastExp(-std::abs(dz / w.z));
     }
 
-    // LayeredBxDF Private Members
+    // LayeredBxDF Protected Members
     TopBxDF top;
     BottomBxDF bottom;
     Float thickness, g;
@@ -902,13 +908,105 @@ class LayeredBxDF {
     int maxDepth, nSamples;
 };
 
+// CoatedDiffuseTable Definition
+// Terms of a closed-form evaluation of CoatedDiffuseBxDF for coatings whose
+// medium doesn't scatter light. In that case the layer's BSDF is the
+// interface's reflection plus light that is transmitted into the layer and
+// diffusely reflected by the base, possibly many times, before it leaves.
+// The table stores the fraction of light arriving from outside that reaches
+// the base (equal, by reciprocity, to the fraction of light leaving the base
+// that exits toward that direction) and the fraction of the base's reflected
+// light that the interface returns to it; neither depends on the base's
+// reflectance, so a table can be shared by all coatings with the same
+// interface and thickness.
+class CoatedDiffuseTable {
+  public:
+    // CoatedDiffuseTable Public Methods
+    CoatedDiffuseTable(Float eta, Float alpha, Float thickness)
+        : eta(eta), alpha(alpha), thickness(thickness) {}
+
+    // Returns the table for the given interface and thickness, computing it
+    // the first time that it is requested.
+    static const CoatedDiffuseTable *Get(Float eta, Float alpha, Float thickness,
+                                         Allocator alloc);
+
+    PBRT_CPU_GPU
+    Float Transmittance(Float cosTheta) const {
+        Float x = Clamp(cosTheta, 0, 1) * (TableSize - 1);
+        int i = std::min<int>(x, TableSize - 2);
+        return Lerp(x - i, transmittance[i], transmittance[i + 1]);
+    }
+
+    PBRT_CPU_GPU
+    Float InternalReflectance() const { return internalReflectance; }
+
+    bool operator==(const CoatedDiffuseTable &t) const {
+        return eta == t.eta && alpha == t.alpha && thickness == t.thickness;
+    }
+
+    std::string ToString() const;
+
+    // CoatedDiffuseTable Public Members
+    Float eta, alpha, thickness;
+
+  private:
+    // CoatedDiffuseTable Private Methods
+    void Compute();
+
+    // CoatedDiffuseTable Private Members
+    static constexpr int TableSize = 64;
+    Float transmittance[TableSize];
+    Float internalReflectance = 0;
+};
+
 // CoatedDiffuseBxDF Definition
 class CoatedDiffuseBxDF : public LayeredBxDF<DielectricBxDF, DiffuseBxDF, true> {
   public:
     // CoatedDiffuseBxDF Public Methods
     using LayeredBxDF::LayeredBxDF;
+    PBRT_CPU_GPU
+    CoatedDiffuseBxDF(DielectricBxDF top, DiffuseBxDF bottom, Float thickness,
+                      const SampledSpectrum &albedo, Float g, int maxDepth, int nSamples,
+                      const CoatedDiffuseTable *table)
+        : LayeredBxDF(top, bottom, thickness, albedo, g, maxDepth, nSamples),
+          table(table) {}
+
     PBRT_CPU_GPU
     static constexpr const char *Name() { return "CoatedDiffuseBxDF"; }
+
+    std::string ToString() const;
+
+    PBRT_CPU_GPU
+    void Regularize() {
+        // The table no longer matches the interface once it is regularized
+        table = nullptr;
+        LayeredBxDF::Regularize();
+    }
+
+    PBRT_CPU_GPU
+    SampledSpectrum f(Vector3f wo, Vector3f wi, TransportMode mode) const;
+
+    PBRT_CPU_GPU
+    pstd::optional<BSDFSample> Sample_f(
+        Vector3f wo, Float uc, Point2f u, TransportMode mode,
+        BxDFReflTransFlags sampleFlags = BxDFReflTransFlags::All) const;
+
+    PBRT_CPU_GPU
+    Float PDF(Vector3f wo, Vector3f wi, TransportMode mode,
+              BxDFReflTransFlags sampleFlags = BxDFReflTransFlags::All) const;
+
+  private:
+    // CoatedDiffuseBxDF Private Methods
+    PBRT_CPU_GPU
+    Float InterfaceSampleProbability(Vector3f wo) const {
+        // Sample the interface in proportion to the light it reflects
+        Float T = table->Transmittance(AbsCosTheta(wo));
+        Float reflected = 1 - T, base = T * bottom.Reflectance().Average();
+        return reflected + base > 0 ? reflected / (reflected + base) : 0.5f;
+    }
+
+    // CoatedDiffuseBxDF Private Members
+    const CoatedDiffuseTable *table = nullptr;
 };
 
 // CoatedConductorBxDF Definition
@@ -1030,8 +1128,12 @@ class MeasuredBxDF {
     MeasuredBxDF(const MeasuredBxDFData *brdf, const SampledWavelengths &lambda)
         : brdf(brdf), lambda(lambda) {}
 
+    // Returns the BRDF data stored in _filename_, which is only loaded once
+    // and then shared by all of the materials that use it. If _halfPrecision_
+    // is true, the tables that are only interpolated are stored as half
+    // floats.
     static MeasuredBxDFData *BRDFDataFromFile(const std::string &filename,
-                                              Allocator alloc);
+                                              bool halfPrecision, Allocator alloc);
 
     PBRT_CPU_GPU
     SampledSpectrum f(Vector3f wo, Vector3f wi, TransportMode mode) const;
@@ -0,0 +1,80 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/bxdfs.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
+#include <pbrt/util/scattering.h>
+#include <pbrt/util/spectrum.h>
+
+#include <vector>
+
+using namespace pbrt;
+
+enum class BenchBxDF { Diffuse, Conductor, RoughConductor, Dielectric, RoughDielectric };
+
+static BxDF CreateBxDF(BenchBxDF type) {
+    SampledSpectrum eta(0.2f), k(3.9f);
+    TrowbridgeReitzDistribution smooth(0, 0), rough(0.3f, 0.2f);
+    switch (type) {
+    case BenchBxDF::Diffuse:
+        return new DiffuseBxDF(SampledSpectrum(0.5f));
+    case BenchBxDF::Conductor:
+        return new ConductorBxDF(smooth, eta, k);
+    case BenchBxDF::RoughConductor:
+        return new ConductorBxDF(rough, eta, k);
+    case BenchBxDF::Dielectric:
+        return new DielectricBxDF(1.5f, smooth);
+    default:
+        return new DielectricBxDF(1.5f, rough);
+    }
+}
+
+// Returns random directions in the upper hemisphere of the shading frame.
+static std::vector<Vector3f> Directions(int n, RNG &rng) {
+    std::vector<Vector3f> w;
+    for (int i = 0; i < n; ++i)
+        w.push_back(
+            SampleUniformHemisphere({rng.Uniform<Float>(), rng.Uniform<Float>()}));
+    return w;
+}
+
+static void BxDF_f(benchmark::State &state, BenchBxDF type) {
+    BxDF bxdf = CreateBxDF(type);
+    RNG rng;
+    std::vector<Vector3f> wo = Directions(1024, rng), wi = Directions(1024, rng);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bxdf.f(wo[i], wi[i], TransportMode::Radiance));
+        i = (i + 1) % wo.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BxDF_Sample_f(benchmark::State &state, BenchBxDF type) {
+    BxDF bxdf = CreateBxDF(type);
+    RNG rng;
+    std::vector<Vector3f> wo = Directions(1024, rng);
+    size_t i = 0;
+    for (auto _ : state) {
+        Point2f u(rng.Uniform<Float>(), rng.Uniform<Float>());
+        benchmark::DoNotOptimize(
+            bxdf.Sample_f(wo[i], rng.Uniform<Float>(), u, TransportMode::Radiance));
+        i = (i + 1) % wo.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_CAPTURE(BxDF_f, Diffuse, BenchBxDF::Diffuse);
+BENCHMARK_CAPTURE(BxDF_f, RoughConductor, BenchBxDF::RoughConductor);
+BENCHMARK_CAPTURE(BxDF_f, RoughDielectric, BenchBxDF::RoughDielectric);
+BENCHMARK_CAPTURE(BxDF_Sample_f, Diffuse, BenchBxDF::Diffuse);
+BENCHMARK_CAPTURE(BxDF_Sample_f, Conductor, BenchBxDF::Conductor);
+BENCHMARK_CAPTURE(BxDF_Sample_f, RoughConductor, BenchBxDF::RoughConductor);
+BENCHMARK_CAPTURE(BxDF_Sample_f, Dielectric, BenchBxDF::Dielectric);
+BENCHMARK_CAPTURE(BxDF_Sample_f, RoughDielectric, BenchBxDF::RoughDielectric);
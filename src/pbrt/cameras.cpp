@@ -67,6 +67,16 @@ CameraTransform::CameraTransform(const AnimatedTransform &worldFromCamera) {
                                          worldFromCamera.endTime);
 }
 
+CameraTransform::CameraTransform(const AnimatedTransform &worldFromCamera,
+                                 const Transform &worldFromRender)
+    : worldFromRender(worldFromRender) {
+    Transform renderFromWorld = Inverse(worldFromRender);
+    Transform rfc[2] = {renderFromWorld * worldFromCamera.startTransform,
+                        renderFromWorld * worldFromCamera.endTransform};
+    renderFromCamera = AnimatedTransform(rfc[0], worldFromCamera.startTime, rfc[1],
+                                         worldFromCamera.endTime);
+}
+
 std::string CameraTransform::ToString() const {
     return StringPrintf("[ CameraTransform renderFromCamera: %s worldFromRender: %s ]",
                         renderFromCamera, worldFromRender);
@@ -720,11 +730,12 @@ std::string SphericalCamera::ToString() const {
 RealisticCamera::RealisticCamera(CameraBaseParameters baseParameters,
                                  std::vector<Float> &lensParameters, Float focusDistance,
                                  Float setApertureDiameter, Image apertureImage,
-                                 Allocator alloc)
+                                 int lensTableResolution, Allocator alloc)
     : CameraBase(baseParameters),
       elementInterfaces(alloc),
       exitPupilBounds(alloc),
-      apertureImage(std::move(apertureImage)) {
+      apertureImage(std::move(apertureImage)),
+      lensTable(alloc) {
     // Compute film's physical extent
     Float aspect = (Float)film.FullResolution().y / (Float)film.FullResolution().x;
     Float diagonal = film.Diagonal();
@@ -767,6 +778,9 @@ RealisticCamera::RealisticCamera(CameraBaseParameters baseParameters,
         exitPupilBounds[i] = BoundExitPupil(r0, r1);
     });
 
+    if (lensTableResolution > 0)
+        InitLensTable(lensTableResolution);
+
     // Compute minimum differentials for _RealisticCamera_
     FindMinimumDifferentials(this);
 }
@@ -941,6 +955,98 @@ PBRT_CPU_GPU pstd::optional<ExitPupilSample> RealisticCamera::SampleExitPupil(Po
     return ExitPupilSample{pPupil, pdf};
 }
 
+void RealisticCamera::InitLensTable(int n) {
+    // Find bounds of the exit pupil over the whole film
+    for (const Bounds2f &b : exitPupilBounds)
+        if (!b.IsDegenerate())
+            lensTablePupilBounds = Union(lensTablePupilBounds, b);
+    if (lensTablePupilBounds.IsDegenerate())
+        return;
+
+    // Trace rays through the lens system at the table's grid points
+    lensTable.resize(size_t(n) * n * n);
+    ParallelFor(0, n, [&](int ir) {
+        Point3f pFilm(Float(ir) / (n - 1) * film.Diagonal() / 2, 0, 0);
+        for (int iu = 0; iu < n; ++iu)
+            for (int iv = 0; iv < n; ++iv) {
+                Point2f pLens = lensTablePupilBounds.Lerp(
+                    Point2f(Float(iu) / (n - 1), Float(iv) / (n - 1)));
+                Point3f pRear(pLens.x, pLens.y, LensRearZ());
+                Ray rOut;
+                LensTableEntry &entry = lensTable[(size_t(ir) * n + iu) * n + iv];
+                entry.vignetted =
+                    TraceLensesFromFilm(Ray(pFilm, pRear - pFilm), &rOut) == 0;
+                if (!entry.vignetted) {
+                    entry.o = rOut.o;
+                    entry.d = rOut.d;
+                }
+            }
+    });
+    lensTableResolution = n;
+    LOG_VERBOSE("Initialized %d^3 lens table over exit pupil bounds %s", n,
+                lensTablePupilBounds);
+}
+
+PBRT_CPU_GPU bool RealisticCamera::LookupLensTable(const Ray &rFilm, Ray *rOut,
+                                                   Float *weight) const {
+    if (lensTable.empty())
+        return false;
+    // Find film radius and the rear element point rotated to the film's $+x$ axis
+    Point3f pRear = rFilm.o + rFilm.d;
+    Float r = std::sqrt(Sqr(rFilm.o.x) + Sqr(rFilm.o.y));
+    Float sinTheta = (r != 0) ? rFilm.o.y / r : 0;
+    Float cosTheta = (r != 0) ? rFilm.o.x / r : 1;
+    Point2f pLens(cosTheta * pRear.x + sinTheta * pRear.y,
+                  -sinTheta * pRear.x + cosTheta * pRear.y);
+
+    // Find the table cell that holds the ray
+    int n = lensTableResolution;
+    Vector2f uv = lensTablePupilBounds.Offset(pLens);
+    Float c[3] = {r / (film.Diagonal() / 2) * (n - 1), uv.x * (n - 1), uv.y * (n - 1)};
+    int c0[3];
+    Float dc[3];
+    for (int i = 0; i < 3; ++i) {
+        if (!(c[i] >= 0 && c[i] <= n - 1))
+            return false;
+        c0[i] = std::min<int>(c[i], n - 2);
+        dc[i] = c[i] - c0[i];
+    }
+
+    // Interpolate the cell's rays if none of them are vignetted
+    Vector3f o, d;
+    int nVignetted = 0;
+    for (int corner = 0; corner < 8; ++corner) {
+        int ir = c0[0] + (corner & 1), iu = c0[1] + ((corner >> 1) & 1);
+        int iv = c0[2] + (corner >> 2);
+        const LensTableEntry &entry = lensTable[(size_t(ir) * n + iu) * n + iv];
+        if (entry.vignetted) {
+            ++nVignetted;
+            continue;
+        }
+        Float w = ((corner & 1) ? dc[0] : 1 - dc[0]) *
+                  (((corner >> 1) & 1) ? dc[1] : 1 - dc[1]) *
+                  ((corner >> 2) ? dc[2] : 1 - dc[2]);
+        o += w * Vector3f(entry.o);
+        d += w * entry.d;
+    }
+    if (nVignetted == 8) {
+        *weight = 0;
+        return true;
+    }
+    // Rays in cells that are partially vignetted are traced through the lenses
+    if (nVignetted > 0)
+        return false;
+
+    // Rotate the interpolated ray back to the film point's angle
+    *rOut = Ray(Point3f(cosTheta * o.x - sinTheta * o.y, sinTheta * o.x + cosTheta * o.y,
+                        o.z),
+                Vector3f(cosTheta * d.x - sinTheta * d.y, sinTheta * d.x + cosTheta * d.y,
+                         d.z),
+                rFilm.time);
+    *weight = 1;
+    return true;
+}
+
 PBRT_CPU_GPU pstd::optional<CameraRay> RealisticCamera::GenerateRay(CameraSample sample,
                                                        SampledWavelengths &lambda) const {
     // Find point on film, _pFilm_, corresponding to _sample.pFilm_
@@ -956,7 +1062,9 @@ PBRT_CPU_GPU pstd::optional<CameraRay> RealisticCamera::GenerateRay(CameraSample
         return {};
     Ray rFilm(pFilm, eps->pPupil - pFilm);
     Ray ray;
-    Float weight = TraceLensesFromFilm(rFilm, &ray);
+    Float weight;
+    if (!LookupLensTable(rFilm, &ray, &weight))
+        weight = TraceLensesFromFilm(rFilm, &ray);
     if (weight == 0)
         return {};
 
@@ -1312,8 +1420,10 @@ void RealisticCamera::TestExitPupilBounds() const {
 
 std::string RealisticCamera::ToString() const {
     return StringPrintf(
-        "[ RealisticCamera %s elementInterfaces: %s exitPupilBounds: %s ]",
-        CameraBase::ToString(), elementInterfaces, exitPupilBounds);
+        "[ RealisticCamera %s elementInterfaces: %s exitPupilBounds: %s "
+        "lensTableResolution: %d lensTablePupilBounds: %s ]",
+        CameraBase::ToString(), elementInterfaces, exitPupilBounds, lensTableResolution,
+        lensTablePupilBounds);
 }
 
 RealisticCamera *RealisticCamera::Create(const ParameterDictionary &parameters,
@@ -1327,6 +1437,12 @@ RealisticCamera *RealisticCamera::Create(const ParameterDictionary &parameters,
     std::string lensFile = ResolveFilename(parameters.GetOneString("lensfile", ""));
     Float apertureDiameter = parameters.GetOneFloat("aperturediameter", 1.0);
     Float focusDistance = parameters.GetOneFloat("focusdistance", 10.0);
+    int lensTableResolution = parameters.GetOneInt("lenstableresolution", 0);
+    if (lensTableResolution == 1 || lensTableResolution < 0) {
+        Error(loc, "%d: \"lenstableresolution\" must be 0 or at least 2.",
+              lensTableResolution);
+        return nullptr;
+    }
 
     if (lensFile.empty()) {
         Error(loc, "No lens description file supplied!");
@@ -1460,9 +1576,16 @@ RealisticCamera *RealisticCamera::Create(const ParameterDictionary &parameters,
         }
     }
 
+    // The lens table relies on the lens system being rotationally symmetric
+    if (lensTableResolution > 0 && apertureImage) {
+        Warning(loc, "\"lenstableresolution\" is ignored with an aperture image.");
+        lensTableResolution = 0;
+    }
+
     return alloc.new_object<RealisticCamera>(cameraBaseParameters, lensParameters,
                                              focusDistance, apertureDiameter,
-                                             std::move(apertureImage), alloc);
+                                             std::move(apertureImage),
+                                             lensTableResolution, alloc);
 }
 
 }  // namespace pbrt
@@ -35,6 +35,10 @@ class CameraTransform {
     // CameraTransform Public Methods
     CameraTransform() = default;
     explicit CameraTransform(const AnimatedTransform &worldFromCamera);
+    // Uses the given rendering space rather than choosing one for the camera,
+    // so that several cameras can share one.
+    CameraTransform(const AnimatedTransform &worldFromCamera,
+                    const Transform &worldFromRender);
 
     PBRT_CPU_GPU
     Point3f RenderFromCamera(Point3f p, Float time) const {
@@ -181,32 +185,14 @@ class CameraBase {
     PBRT_CPU_GPU
     void Approximate_dp_dxy(Point3f p, Normal3f n, Float time, int samplesPerPixel,
                             Vector3f *dpdx, Vector3f *dpdy) const {
-        // Compute tangent plane equation for ray differential intersections
-        Point3f pCamera = CameraFromRender(p, time);
-        Transform DownZFromCamera =
-            RotateFromTo(Normalize(Vector3f(pCamera)), Vector3f(0, 0, 1));
-        Point3f pDownZ = DownZFromCamera(pCamera);
-        Normal3f nDownZ = DownZFromCamera(CameraFromRender(n, time));
-        Float d = nDownZ.z * pDownZ.z;
-
-        // Find intersection points for approximated camera differential rays
-        Ray xRay(Point3f(0, 0, 0) + minPosDifferentialX,
-                 Vector3f(0, 0, 1) + minDirDifferentialX);
-        Float tx = -(Dot(nDownZ, Vector3f(xRay.o)) - d) / Dot(nDownZ, xRay.d);
-        Ray yRay(Point3f(0, 0, 0) + minPosDifferentialY,
-                 Vector3f(0, 0, 1) + minDirDifferentialY);
-        Float ty = -(Dot(nDownZ, Vector3f(yRay.o)) - d) / Dot(nDownZ, yRay.d);
-        Point3f px = xRay(tx), py = yRay(ty);
-
-        // Estimate $\dpdx$ and $\dpdy$ in tangent plane at intersection point
-        Float sppScale =
-            GetOptions().disablePixelJitter
-                ? 1
-                : std::max<Float>(.125, 1 / std::sqrt((Float)samplesPerPixel));
-        *dpdx =
-            sppScale * RenderFromCamera(DownZFromCamera.ApplyInverse(px - pDownZ), time);
-        *dpdy =
-            sppScale * RenderFromCamera(DownZFromCamera.ApplyInverse(py - pDownZ), time);
+        // Only interpolate the camera transformation if it's animated
+        const AnimatedTransform &renderFromCamera = cameraTransform.RenderFromCamera();
+        if (renderFromCamera.IsAnimated())
+            Approximate_dp_dxy(renderFromCamera.Interpolate(time), p, n, samplesPerPixel,
+                               dpdx, dpdy);
+        else
+            Approximate_dp_dxy(renderFromCamera.startTransform, p, n, samplesPerPixel,
+                               dpdx, dpdy);
     }
 
   protected:
@@ -279,6 +265,41 @@ class CameraBase {
     }
 
     void FindMinimumDifferentials(Camera camera);
+
+    PBRT_CPU_GPU
+    void Approximate_dp_dxy(const Transform &renderFromCamera, Point3f p, Normal3f n,
+                            int samplesPerPixel, Vector3f *dpdx, Vector3f *dpdy) const {
+        // Compute tangent plane equation for ray differential intersections
+        // The rotation to $+z$ is applied as a $3\times 3$ matrix; its inverse is
+        // its transpose and it transforms normals like vectors.
+        Point3f pCamera = renderFromCamera.ApplyInverse(p);
+        SquareMatrix<3> downZFromCamera =
+            RotateFromToMatrix(Normalize(Vector3f(pCamera)), Vector3f(0, 0, 1));
+        Point3f pDownZ = Mul<Point3f>(downZFromCamera, pCamera);
+        Normal3f nDownZ =
+            Mul<Normal3f>(downZFromCamera, renderFromCamera.ApplyInverse(n));
+        Float d = nDownZ.z * pDownZ.z;
+
+        // Find intersection points for approximated camera differential rays
+        Ray xRay(Point3f(0, 0, 0) + minPosDifferentialX,
+                 Vector3f(0, 0, 1) + minDirDifferentialX);
+        Float tx = -(Dot(nDownZ, Vector3f(xRay.o)) - d) / Dot(nDownZ, xRay.d);
+        Ray yRay(Point3f(0, 0, 0) + minPosDifferentialY,
+                 Vector3f(0, 0, 1) + minDirDifferentialY);
+        Float ty = -(Dot(nDownZ, Vector3f(yRay.o)) - d) / Dot(nDownZ, yRay.d);
+        Point3f px = xRay(tx), py = yRay(ty);
+
+        // Estimate $\dpdx$ and $\dpdy$ in tangent plane at intersection point
+        Float sppScale =
+            GetOptions().disablePixelJitter
+                ? 1
+                : std::max<Float>(.125, 1 / std::sqrt((Float)samplesPerPixel));
+        SquareMatrix<3> cameraFromDownZ = Transpose(downZFromCamera);
+        *dpdx = sppScale *
+                renderFromCamera(Mul<Vector3f>(cameraFromDownZ, Vector3f(px - pDownZ)));
+        *dpdy = sppScale *
+                renderFromCamera(Mul<Vector3f>(cameraFromDownZ, Vector3f(py - pDownZ)));
+    }
 };
 
 // ProjectiveCamera Definition
@@ -524,7 +545,8 @@ class RealisticCamera : public CameraBase {
     // RealisticCamera Public Methods
     RealisticCamera(CameraBaseParameters baseParameters,
                     std::vector<Float> &lensParameters, Float focusDistance,
-                    Float apertureDiameter, Image apertureImage, Allocator alloc);
+                    Float apertureDiameter, Image apertureImage, int lensTableResolution,
+                    Allocator alloc);
 
     static RealisticCamera *Create(const ParameterDictionary &parameters,
                                    const CameraTransform &cameraTransform, Film film,
@@ -572,6 +594,14 @@ class RealisticCamera : public CameraBase {
         std::string ToString() const;
     };
 
+    // Ray leaving the lens system for a point on the film's $+x$ axis and a point
+    // on the rear element, in camera space
+    struct LensTableEntry {
+        Point3f o;
+        Vector3f d;
+        bool vignetted;
+    };
+
     // RealisticCamera Private Methods
     PBRT_CPU_GPU
     Float LensRearZ() const { return elementInterfaces.back().thickness; }
@@ -633,11 +663,18 @@ class RealisticCamera : public CameraBase {
 
     void TestExitPupilBounds() const;
 
+    void InitLensTable(int resolution);
+    PBRT_CPU_GPU
+    bool LookupLensTable(const Ray &rFilm, Ray *rOut, Float *weight) const;
+
     // RealisticCamera Private Members
     Bounds2f physicalExtent;
     pstd::vector<LensElementInterface> elementInterfaces;
     Image apertureImage;
     pstd::vector<Bounds2f> exitPupilBounds;
+    int lensTableResolution = 0;
+    Bounds2f lensTablePupilBounds;
+    pstd::vector<LensTableEntry> lensTable;
 };
 
 PBRT_CPU_GPU inline pstd::optional<CameraRay> Camera::GenerateRay(CameraSample sample,
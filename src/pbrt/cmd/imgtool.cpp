@@ -4,6 +4,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/film.h>
 #include <pbrt/filters.h>
 #include <pbrt/options.h>
 #ifdef PBRT_BUILD_GPU_RENDERER
@@ -21,6 +22,7 @@
 #include <pbrt/util/image.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/mipmap.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/progressreporter.h>
@@ -36,10 +38,12 @@ extern "C" {
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
 #include <map>
 #include <string>
 
@@ -57,7 +61,8 @@ static std::map<std::string, CommandUsage> commandUsage = {
     {"assemble",
      {"assemble [options] <filenames...>",
       "Assemble multiple images representing cropped regions of a larger\n"
-      "    image into a single composite image.",
+      "    image into a single composite image. EXR output is written in\n"
+      "    bands, so the full image is never held in memory.",
       std::string(R"(
     --outfile <name>   Output image filename.
 )")}},
@@ -78,9 +83,11 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --sort             Sort output by pixel luminance.
 )")}},
     {"bloom",
-     {"bloom [options] <filename>",
-      "Apply a bloom effect to the specified image where pixels that are\n"
-      "    brighter than a threshold are blurred and added to nearby pixels.",
+     {"bloom [options] <filenames...>",
+      "Apply a bloom effect to the specified images where pixels that are\n"
+      "    brighter than a threshold are blurred and added to nearby pixels.\n"
+      "    With multiple images, \"%s\" in --outfile is replaced with each\n"
+      "    one's filename, without its directory or extension.",
       std::string(R"(
     --iterations <n>   Number of filtering iterations used to generate the bloom
                        image. Default: 5
@@ -93,9 +100,11 @@ static std::map<std::string, CommandUsage> commandUsage = {
                        Default: 15
 )")}},
     {"convert",
-     {"convert [options] <filename>",
+     {"convert [options] <filenames...>",
       "Convert an image, possibly going from one format to another.\n"
-      "    A variety of image processing operations can be performed as well.",
+      "    A variety of image processing operations can be performed as well.\n"
+      "    With multiple images, \"%s\" in --outfile is replaced with each\n"
+      "    one's filename, without its directory or extension.",
       std::string(R"(
     --aces-filmic      Apply the ACES filmic s-curve to map values to [0,1].
     --bw               Convert to black and white (average channels)
@@ -205,6 +214,30 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --outfile <name>   Filename to store environment map in.
     --turbidity <t>    Atmospheric turbidity (range 1.7-10). Default: 3
     --resolution <r>   Resolution of generated environment map. Default: 2048
+)")}},
+    {"maketx",
+     {"maketx [options] <filename>",
+      "Generate the MIP map for an image texture and store it in a tiled\n"
+      "    MIP map file that pbrt maps into memory when it renders, rather\n"
+      "    than filtering the image when the scene is loaded.",
+      std::string(R"(
+    --encoding <name>  Color encoding of 8-bit images: "linear", "sRGB", or
+                       "gamma <value>". Default: sRGB for PNGs, otherwise linear.
+    --outfile <name>   Filename of the tiled MIP map. It must have the ".mip"
+                       extension.
+    --wrap <mode>      Wrap mode used when filtering the image; it should match
+                       the "wrap" parameter of textures that use the MIP map.
+                       (Options: "repeat", "clamp", "black", "octahedralsphere")
+                       Default: repeat.
+)")}},
+    {"mergefilm",
+     {"mergefilm [options] <filenames...>",
+      "Add the raw film sums that pbrt writes with --sample-range for\n"
+      "    disjoint ranges of samples and write the image of all of them.",
+      std::string(R"(
+    --outfile <name>   Output image filename.
+    --outfilm <name>   Also write the merged sums to the given film file, so
+                       that it can be merged further.
 )")}},
     {"splitn",
      {"splitn [options] <filenames>",
@@ -228,8 +261,11 @@ static std::map<std::string, CommandUsage> commandUsage = {
     --outfile <name>   Filename to store final image in.
 )")}},
     {"whitebalance",
-     {"whitebalance [options] <filename>",
-      "Apply white balancing to the specified image.", std::string(R"(
+     {"whitebalance [options] <filenames...>",
+      "Apply white balancing to the specified images. With multiple images,\n"
+      "    \"%s\" in --outfile is replaced with each one's filename, without\n"
+      "    its directory or extension.",
+      std::string(R"(
     --illuminant <n>   Apply white balance for the given standard illuminant
                        (e.g. D65, D50, A, F1, F2, ...)
     --outfile <name>   Filename to store result image.
@@ -323,6 +359,82 @@ static bool checkImageCompatibility(std::string fn1, const Image &im1,
     return true;
 }
 
+// Calls _func_ with each row of _image_, converted to floats with each
+// pixel's channels stored together, and then writes the row back. Rows are
+// processed in parallel.
+static void ProcessRows(Image &image, std::function<void(int, pstd::span<float>)> func) {
+    Point2i res = image.Resolution();
+    ParallelFor(0, res.y, [&](int64_t y0, int64_t y1) {
+        std::vector<float> row(res.x * image.NChannels());
+        for (int y = y0; y < y1; ++y) {
+            Bounds2i extent({0, y}, {res.x, y + 1});
+            image.CopyRectOut(extent, pstd::MakeSpan(row));
+            func(y, pstd::MakeSpan(row));
+            image.CopyRectIn(extent, pstd::MakeConstSpan(row));
+        }
+    });
+}
+
+// Like ProcessRows(), but for reading _image_'s rows only.
+static void ReadRows(const Image &image,
+                     std::function<void(int, pstd::span<const float>)> func) {
+    Point2i res = image.Resolution();
+    ParallelFor(0, res.y, [&](int64_t y0, int64_t y1) {
+        std::vector<float> row(res.x * image.NChannels());
+        for (int y = y0; y < y1; ++y) {
+            image.CopyRectOut(Bounds2i({0, y}, {res.x, y + 1}), pstd::MakeSpan(row));
+            func(y, pstd::MakeConstSpan(row));
+        }
+    });
+}
+
+// Multiplies the RGB channels given by _rgbDesc_ of each pixel by _m_.
+static void TransformRGB(Image &image, const ImageChannelDesc &rgbDesc,
+                         const SquareMatrix<3> &m) {
+    int nc = image.NChannels();
+    int r = rgbDesc.offset[0], g = rgbDesc.offset[1], b = rgbDesc.offset[2];
+    float mf[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            mf[i][j] = m[i][j];
+    ProcessRows(image, [&](int, pstd::span<float> row) {
+        // A simple loop over the row, which the compiler can vectorize
+        for (size_t i = 0; i < row.size(); i += nc) {
+            float pr = row[i + r], pg = row[i + g], pb = row[i + b];
+            row[i + r] = mf[0][0] * pr + mf[0][1] * pg + mf[0][2] * pb;
+            row[i + g] = mf[1][0] * pr + mf[1][1] * pg + mf[1][2] * pb;
+            row[i + b] = mf[2][0] * pr + mf[2][1] * pg + mf[2][2] * pb;
+        }
+    });
+}
+
+// Calls _process_ with each of _inFiles_ and its output filename, working on
+// multiple files at once. With more than one input file, "%s" in _outFile_
+// is replaced with each input's filename, without its directory or extension.
+// Returns 1 if processing any of the files failed.
+static int ProcessFiles(
+    const char *cmd, const std::vector<std::string> &inFiles, const std::string &outFile,
+    std::function<int(const std::string &, const std::string &)> process) {
+    size_t pattern = outFile.find("%s");
+    if (inFiles.size() > 1 && pattern == std::string::npos)
+        usage(cmd, "--outfile must include \"%%s\" when given multiple images");
+
+    std::atomic<int> nFailed{0};
+    ParallelFor(0, inFiles.size(), [&](int64_t i) {
+        std::string out = outFile;
+        if (inFiles.size() > 1) {
+            std::string base = inFiles[i];
+            size_t slash = base.find_last_of("/\\");
+            if (slash != std::string::npos)
+                base = base.substr(slash + 1);
+            out.replace(pattern, 2, RemoveExtension(base));
+        }
+        if (process(inFiles[i], out) != 0)
+            ++nFailed;
+    });
+    return nFailed > 0 ? 1 : 0;
+}
+
 int makesky(std::vector<std::string> args) {
     std::string outfile;
     Float albedo = 0.5;
@@ -441,20 +553,26 @@ int assemble(std::vector<std::string> args) {
 
     if (outfile.empty())
         usage("assemble", "--outfile not provided for \"assemble\"");
-
-    Image fullImage;
-    std::vector<bool> seenPixel;
-    int seenMultiple = 0;
-    Bounds2i fullBounds;
-    const RGBColorSpace *colorSpace = nullptr;
-    for (const std::string &file : infiles) {
+    for (const std::string &file : infiles)
         if (!HasExtension(file, "exr"))
             usage("assemble", "only EXR images include the image bounding boxes that "
                               "\"assemble\" needs.");
 
-        ImageAndMetadata im = Image::Read(file);
-        Image &image = im.image;
-        ImageMetadata &metadata = im.metadata;
+    // Only read the headers of the images up front; their pixels are read
+    // as the output is written, so that neither all of the inputs nor the
+    // full image need to be in memory at once.
+    std::vector<std::unique_ptr<EXRReader>> allReaders(infiles.size());
+    ParallelFor(0, infiles.size(), [&](int64_t i) {
+        allReaders[i] = std::make_unique<EXRReader>(infiles[i]);
+    });
+
+    std::vector<EXRReader *> readers;
+    Point2i fullResolution;
+    Bounds2i fullBounds;
+    const RGBColorSpace *colorSpace = nullptr;
+    for (const auto &reader : allReaders) {
+        const std::string &file = reader->Filename();
+        const ImageMetadata &metadata = reader->Metadata();
 
         if (!metadata.fullResolution) {
             Error("%s: doesn't have full resolution in image metadata. Skipping.", file);
@@ -465,22 +583,20 @@ int assemble(std::vector<std::string> args) {
             continue;
         }
 
-        if (fullImage.Resolution() == Point2i(0, 0)) {
+        if (readers.empty()) {
             // First image read.
-            fullImage = Image(image.Format(), *metadata.fullResolution,
-                              image.ChannelNames(), image.Encoding());
+            fullResolution = *metadata.fullResolution;
             colorSpace = metadata.GetColorSpace();
-            seenPixel.resize(fullImage.Resolution().x * fullImage.Resolution().y);
-            fullBounds = Bounds2i({0, 0}, fullImage.Resolution());
+            fullBounds = Bounds2i({0, 0}, fullResolution);
         } else {
             // Make sure that this image's info is compatible with the
             // first image's.
-            if (*metadata.fullResolution != fullImage.Resolution()) {
+            if (*metadata.fullResolution != fullResolution) {
                 Warning("%s: full resolution (%d, %d) in EXR file doesn't match the full "
                         "resolution of first EXR file (%d, %d). "
                         "Ignoring this file.",
                         file, metadata.fullResolution->x, metadata.fullResolution->y,
-                        fullImage.Resolution().x, fullImage.Resolution().y);
+                        fullResolution.x, fullResolution.y);
                 continue;
             }
             if (Union(*metadata.pixelBounds, fullBounds) != fullBounds) {
@@ -492,9 +608,10 @@ int assemble(std::vector<std::string> args) {
                         fullBounds.pMax.x, fullBounds.pMax.y);
                 continue;
             }
-            if (fullImage.NChannels() != image.NChannels()) {
+            if (readers[0]->ChannelNames().size() != reader->ChannelNames().size()) {
                 Warning("%s: %d channel image; expecting %d channels.", file,
-                        image.NChannels(), fullImage.NChannels());
+                        reader->ChannelNames().size(),
+                        readers[0]->ChannelNames().size());
                 continue;
             }
             const RGBColorSpace *cs = metadata.GetColorSpace();
@@ -505,38 +622,149 @@ int assemble(std::vector<std::string> args) {
                 continue;
             }
         }
+        readers.push_back(reader.get());
+    }
+    if (readers.empty()) {
+        Error("%s: no usable images to assemble.", outfile);
+        return 1;
+    }
 
-        // Copy pixels.
-        for (int y = 0; y < image.Resolution().y; ++y)
-            for (int x = 0; x < image.Resolution().x; ++x) {
-                Point2i fullp{x + metadata.pixelBounds->pMin.x,
-                              y + metadata.pixelBounds->pMin.y};
-                CHECK(InsideExclusive(fullp, fullBounds));
-                size_t fullOffset = fullp.x + fullp.y * fullImage.Resolution().x;
-                if (seenPixel[fullOffset])
-                    ++seenMultiple;
-                seenPixel[fullOffset] = true;
-                for (int c = 0; c < fullImage.NChannels(); ++c)
-                    fullImage.SetChannel(fullp, c, image.GetChannel({x, y}, c));
+    PixelFormat format = readers[0]->Format();
+    const std::vector<std::string> &channelNames = readers[0]->ChannelNames();
+    int nc = channelNames.size();
+
+    int64_t seenMultiple = 0, unseenPixels = 0;
+    // Fills _band_ with the rows of the full image starting at _yStart_.
+    auto fillBand = [&](Image &band, int yStart) {
+        int yEnd = std::min(yStart + band.Resolution().y, fullResolution.y);
+        int width = fullResolution.x;
+
+        // Read the overlapping rows of each image that covers the band in
+        // parallel; they are copied into the band afterward, in the order
+        // the images were given, so that later ones take precedence where
+        // they overlap.
+        std::vector<EXRReader *> overlapping;
+        for (EXRReader *reader : readers) {
+            Bounds2i b = *reader->Metadata().pixelBounds;
+            if (b.pMin.y < yEnd && b.pMax.y > yStart)
+                overlapping.push_back(reader);
+        }
+        std::vector<Image> pieces(overlapping.size());
+        ParallelFor(0, overlapping.size(), [&](int64_t i) {
+            Bounds2i b = *overlapping[i]->Metadata().pixelBounds;
+            pieces[i] = overlapping[i]->ReadRows(std::max(yStart, b.pMin.y),
+                                                 std::min(yEnd, b.pMax.y));
+        });
+
+        std::vector<float> bandPixels(size_t(width) * (yEnd - yStart) * nc, 0.f);
+        std::vector<uint8_t> coverage(size_t(width) * (yEnd - yStart), 0);
+        for (size_t i = 0; i < overlapping.size(); ++i) {
+            Bounds2i b = *overlapping[i]->Metadata().pixelBounds;
+            int y0 = std::max(yStart, b.pMin.y);
+            Point2i res = pieces[i].Resolution();
+            std::vector<float> row(res.x * nc);
+            for (int y = 0; y < res.y; ++y) {
+                pieces[i].CopyRectOut(Bounds2i({0, y}, {res.x, y + 1}),
+                                      pstd::MakeSpan(row));
+                size_t offset = size_t(y0 + y - yStart) * width + b.pMin.x;
+                std::copy(row.begin(), row.end(), &bandPixels[offset * nc]);
+                for (int x = 0; x < res.x; ++x) {
+                    if (coverage[offset + x])
+                        ++seenMultiple;
+                    coverage[offset + x] = 1;
+                }
             }
-    }
+            // Free each image's rows as soon as they have been copied.
+            pieces[i] = Image();
+        }
+        unseenPixels += std::count(coverage.begin(), coverage.end(), 0);
+
+        band.CopyRectIn(Bounds2i({0, 0}, {width, yEnd - yStart}),
+                        pstd::MakeConstSpan(bandPixels));
+    };
+
+    ImageMetadata outMetadata;
+    outMetadata.colorSpace = colorSpace;
 
-    int unseenPixels = 0;
-    for (int y = 0; y < fullImage.Resolution().y; ++y)
-        for (int x = 0; x < fullImage.Resolution().x; ++x)
-            if (!seenPixel[y * fullImage.Resolution().x + x])
-                ++unseenPixels;
+    bool success;
+    if (HasExtension(outfile, "exr"))
+        success = Image::WriteEXRBands(outfile, format, fullResolution, channelNames,
+                                       outMetadata, fillBand);
+    else {
+        // Other formats are written all at once, so the full image is
+        // needed.
+        Image fullImage(format, fullResolution, channelNames);
+        fillBand(fullImage, 0);
+        success = fullImage.Write(outfile, outMetadata);
+    }
 
     if (seenMultiple > 0)
         Warning("%s: %d pixels present in multiple images.", outfile, seenMultiple);
     if (unseenPixels > 0)
         Warning("%s: %d pixels not present in any images.", outfile, unseenPixels);
 
-    ImageMetadata outMetadata;
-    outMetadata.colorSpace = colorSpace;
+    return success ? 0 : 1;
+}
+
+int mergefilm(std::vector<std::string> args) {
+    if (args.empty())
+        usage("mergefilm", "no filenames provided to \"mergefilm\"?");
+    std::string outfile, outfilm;
+    std::vector<std::string> infiles;
+
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        auto onError = [](const std::string &err) {
+            usage("mergefilm", "%s", err.c_str());
+        };
+        if (ParseArg(&iter, args.end(), "outfile", &outfile, onError) ||
+            ParseArg(&iter, args.end(), "outfilm", &outfilm, onError))
+            ;  // success
+        else if ((*iter)[0] == '-')
+            usage("mergefilm", "%s: unknown command flag", iter->c_str());
+        else
+            infiles.push_back(*iter);
+    }
 
-    fullImage.Write(outfile, outMetadata);
+    if (infiles.empty())
+        usage("mergefilm", "no film files provided to \"mergefilm\"");
+    if (outfile.empty())
+        usage("mergefilm", "--outfile not provided for \"mergefilm\"");
 
+    // Add up the sums of all of the films
+    pstd::optional<RGBFilmDump> merged;
+    for (const std::string &file : infiles) {
+        pstd::optional<RGBFilmDump> dump = RGBFilmDump::Read(file);
+        if (!dump)
+            return 1;
+        if (!merged)
+            merged = std::move(dump);
+        else if (!merged->Merge(*dump)) {
+            Error("%s: film doesn't match the first one's or includes samples that "
+                  "an earlier one does.",
+                  file);
+            return 1;
+        }
+    }
+
+    // Warn about samples that none of the films include
+    std::vector<std::pair<int, int>> ranges = merged->sampleRanges;
+    std::sort(ranges.begin(), ranges.end());
+    int sampleEnd = 0;
+    for (const std::pair<int, int> &range : ranges) {
+        if (range.first > sampleEnd)
+            Warning("No film includes samples %d through %d.", sampleEnd,
+                    range.first - 1);
+        sampleEnd = range.second;
+    }
+
+    if (!outfilm.empty() && !merged->Write(outfilm)) {
+        Error("%s: unable to write film.", outfilm);
+        return 1;
+    }
+    ImageMetadata metadata;
+    Image image = merged->GetImage(&metadata);
+    if (!image.Write(outfile, metadata))
+        return 1;
     return 0;
 }
 
@@ -871,16 +1099,22 @@ int average(std::vector<std::string> args) {
             return;
         }
 
-        for (int y = 0; y < avg.Resolution().y; ++y)
-            for (int x = 0; x < avg.Resolution().x; ++x)
-                for (int c = 0; c < avg.NChannels(); ++c) {
-                    Float v = im.GetChannel({x, y}, c) / filenames.size();
-                    if (std::isnan(v))
-                        LOG_FATAL("NAN Pixel at %s in %s", Point2f(x, y), filenames[i]);
-                    if (std::isinf(v))
-                        v = 0;
-                    avg.SetChannel({x, y}, c, avg.GetChannel({x, y}, c) + v);
-                }
+        // Files are already processed in parallel, so rows are accumulated
+        // serially, converting each one all at once.
+        int nc = avg.NChannels(), width = avg.Resolution().x;
+        std::vector<float> row(width * nc);
+        for (int y = 0; y < avg.Resolution().y; ++y) {
+            im.CopyRectOut(Bounds2i({0, y}, {width, y + 1}), pstd::MakeSpan(row));
+            float *avgRow = (float *)avg.RawPointer({0, y});
+            for (int j = 0; j < width * nc; ++j) {
+                Float v = row[j] / filenames.size();
+                if (std::isnan(v))
+                    LOG_FATAL("NAN Pixel at %s in %s", Point2f(j / nc, y), filenames[i]);
+                if (std::isinf(v))
+                    v = 0;
+                avgRow[j] += v;
+            }
+        }
     });
 
     if (failed)
@@ -894,14 +1128,15 @@ int average(std::vector<std::string> args) {
             // First valid one
             avgImage = im;
         } else {
-            for (int y = 0; y < avgImage.Resolution().y; ++y)
-                for (int x = 0; x < avgImage.Resolution().x; ++x)
-                    for (int c = 0; c < avgImage.NChannels(); ++c) {
-                        Float v = im.GetChannel({x, y}, c);
-                        if (!std::isinf(v))
-                            avgImage.SetChannel({x, y}, c,
-                                                avgImage.GetChannel({x, y}, c) + v);
-                    }
+            size_t n = size_t(avgImage.Resolution().x) * avgImage.Resolution().y *
+                       avgImage.NChannels();
+            const float *src = (const float *)im.RawPointer({0, 0});
+            float *dst = (float *)avgImage.RawPointer({0, 0});
+            ParallelFor(0, n, [&](int64_t start, int64_t end) {
+                for (int64_t j = start; j < end; ++j)
+                    if (!std::isinf(src[j]))
+                        dst[j] += src[j];
+            });
         }
     });
 
@@ -968,6 +1203,10 @@ int error(std::vector<std::string> args) {
     };
 
     crop(referenceImage);
+    Point2i res = referenceImage.Resolution();
+    int nc = referenceImage.NChannels();
+    std::vector<float> refPixels(size_t(res.x) * res.y * nc);
+    referenceImage.CopyRectOut(Bounds2i({0, 0}, res), pstd::MakeSpan(refPixels));
 
     // Compute error and error image
     using MultiChannelVarianceEstimator = std::vector<VarianceEstimator<double>>;
@@ -999,16 +1238,19 @@ int error(std::vector<std::string> args) {
             error = im.MRSE(im.AllChannelsDesc(), referenceImage, &diffImage);
         sumErrors.Get() += error.Average();
 
-        for (int y = 0; y < im.Resolution().y; ++y)
-            for (int x = 0; x < im.Resolution().x; ++x) {
+        std::vector<float> pixels(refPixels.size());
+        im.CopyRectOut(Bounds2i({0, 0}, res), pstd::MakeSpan(pixels));
+        bool relative = metric == "MRSE";
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x) {
                 MultiChannelVarianceEstimator &pixelVariance = pixelVariances.Get()(x, y);
-                for (int c = 0; c < im.NChannels(); ++c)
-                    if (metric == "MRSE")
-                        pixelVariance[c].Add(
-                            im.GetChannel({x, y}, c) /
-                            (0.01f + referenceImage.GetChannel({x, y}, c)));
+                size_t offset = (size_t(y) * res.x + x) * nc;
+                for (int c = 0; c < nc; ++c)
+                    if (relative)
+                        pixelVariance[c].Add(pixels[offset + c] /
+                                             (0.01f + refPixels[offset + c]));
                     else
-                        pixelVariance[c].Add(im.GetChannel({x, y}, c));
+                        pixelVariance[c].Add(pixels[offset + c]);
             }
     });
 
@@ -1029,22 +1271,22 @@ int error(std::vector<std::string> args) {
         mcve.resize(referenceImage.NChannels());
 
     pixelVariances.ForAll([&](const auto &pixVar) {
-        for (int y = 0; y < referenceImage.Resolution().y; ++y)
-            for (int x = 0; x < referenceImage.Resolution().x; ++x)
-                for (int c = 0; c < referenceImage.NChannels(); ++c)
+        ParallelFor(0, res.y, [&](int64_t y) {
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c)
                     pixelVariance(x, y)[c].Merge(pixVar(x, y)[c]);
+        });
     });
 
-    Image errorImage(PixelFormat::Float,
-                     {referenceImage.Resolution().x, referenceImage.Resolution().y},
-                     {metric});
-    for (int y = 0; y < referenceImage.Resolution().y; ++y)
-        for (int x = 0; x < referenceImage.Resolution().x; ++x) {
+    Image errorImage(PixelFormat::Float, res, {metric});
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
             Float varSum = 0;
-            for (int c = 0; c < referenceImage.NChannels(); ++c)
+            for (int c = 0; c < nc; ++c)
                 varSum += pixelVariance(x, y)[c].Variance();
-            errorImage.SetChannel({x, y}, 0, varSum / referenceImage.NChannels());
+            errorImage.SetChannel(Point2i(x, y), 0, varSum / nc);
         }
+    });
 
     // MSE is the average over all of the pixels
     double error = sumError / (filenames.size() - 1);
@@ -1135,19 +1377,20 @@ int diff(std::vector<std::string> args) {
         return 1;
 
     // Clamp Infs
-    int nClamped = 0, nRefClamped = 0;
-    for (int y = 0; y < image.Resolution().y; ++y)
-        for (int x = 0; x < image.Resolution().x; ++x)
-            for (int c = 0; c < image.NChannels(); ++c) {
-                if (std::isinf(image.GetChannel({x, y}, c))) {
-                    ++nClamped;
-                    image.SetChannel({x, y}, c, 0);
+    auto clampInfs = [](Image &image) {
+        std::atomic<int> nClamped{0};
+        ProcessRows(image, [&](int, pstd::span<float> row) {
+            int n = 0;
+            for (float &v : row)
+                if (std::isinf(v)) {
+                    ++n;
+                    v = 0;
                 }
-                if (std::isinf(refImage.GetChannel({x, y}, c))) {
-                    ++nRefClamped;
-                    refImage.SetChannel({x, y}, c, 0);
-                }
-            }
+            nClamped += n;
+        });
+        return int(nClamped);
+    };
+    int nClamped = clampInfs(image), nRefClamped = clampInfs(refImage);
     if (nClamped > 0)
         Warning("%s: clamped %d infinite pixel values.", imageFile, nClamped);
     if (nRefClamped > 0)
@@ -1179,13 +1422,12 @@ int diff(std::vector<std::string> args) {
         refImage = refImage.ConvertToFormat(PixelFormat::Float);
 
         // Clamp to [0,1]...
-        for (int y = 0; y < image.Resolution().y; ++y)
-            for (int x = 0; x < image.Resolution().x; ++x)
-                for (int c = 0; c < image.NChannels(); ++c) {
-                    image.SetChannel({x, y}, c, Clamp(image.GetChannel({x, y}, c), 0, 1));
-                    refImage.SetChannel({x, y}, c,
-                                        Clamp(refImage.GetChannel({x, y}, c), 0, 1));
-                }
+        auto saturate = [](int, pstd::span<float> row) {
+            for (float &v : row)
+                v = Clamp(v, 0, 1);
+        };
+        ProcessRows(image, saturate);
+        ProcessRows(refImage, saturate);
 
         ComputeFLIPError((float *)image.RawPointer({0, 0}),
                          (float *)refImage.RawPointer({0, 0}),
@@ -1533,7 +1775,8 @@ int info(std::vector<std::string> args) {
 }
 
 int bloom(std::vector<std::string> args) {
-    std::string inFile, outFile;
+    std::vector<std::string> inFiles;
+    std::string outFile;
     Float level = Infinity;
     int width = 15;
     Float scale = .3;
@@ -1551,8 +1794,8 @@ int bloom(std::vector<std::string> args) {
             ParseArg(&iter, args.end(), "iterations", &iterations, onError) ||
             ParseArg(&iter, args.end(), "scale", &scale, onError)) {
             // success
-        } else if (inFile.empty() && (*iter)[0] != '-') {
-            inFile = *iter;
+        } else if ((*iter)[0] != '-') {
+            inFiles.push_back(*iter);
         } else {
             onError(StringPrintf("argument %s invalid", *iter));
         }
@@ -1560,75 +1803,72 @@ int bloom(std::vector<std::string> args) {
 
     if (outFile.empty())
         usage("bloom", "--outfile must be specified");
-    if (inFile.empty())
+    if (inFiles.empty())
         usage("bloom", "input filename must be specified");
 
-    ImageAndMetadata imRead = Image::Read(inFile);
-    Image &image = imRead.image;
-
-    std::vector<Image> blurred;
-
-    // First, threshold the source image
-    int nSurvivors = 0;
-    Point2i res = image.Resolution();
-    int nc = image.NChannels();
-    Image thresholdedImage(PixelFormat::Float, image.Resolution(), image.ChannelNames());
-    for (int y = 0; y < res.y; ++y) {
-        for (int x = 0; x < res.x; ++x) {
-            bool overThreshold = false;
-            for (int c = 0; c < nc; ++c)
-                if (image.GetChannel({x, y}, c) > level)
-                    overThreshold = true;
-            if (overThreshold) {
-                ++nSurvivors;
-                for (int c = 0; c < nc; ++c)
-                    thresholdedImage.SetChannel({x, y}, c, image.GetChannel({x, y}, c));
-            } else
-                for (int c = 0; c < nc; ++c)
-                    thresholdedImage.SetChannel({x, y}, c, 0.f);
-        }
-    }
-    if (nSurvivors == 0) {
-        Warning("No pixels were above bloom threshold %f", level);
-        return 1;
-    }
-    blurred.push_back(std::move(thresholdedImage));
-
     if ((width % 2) == 0) {
         ++width;
         Warning("Bloom width must be an odd value. Rounding up to %d.", width);
     }
     int radius = width / 2;
 
-    // Blur thresholded image.
-    Float sigma = radius / 2.;  // TODO: make a parameter
+    return ProcessFiles("bloom", inFiles, outFile, [&](const std::string &inFile,
+                                                       const std::string &outFile) {
+        ImageAndMetadata imRead = Image::Read(inFile);
+        Image &image = imRead.image;
+
+        std::vector<Image> blurred;
+
+        // First, threshold the source image
+        std::atomic<int> nSurvivors{0};
+        int nc = image.NChannels();
+        Image thresholdedImage = image.ConvertToFormat(PixelFormat::Float);
+        ProcessRows(thresholdedImage, [&](int, pstd::span<float> row) {
+            int n = 0;
+            for (size_t i = 0; i < row.size(); i += nc) {
+                bool overThreshold = false;
+                for (int c = 0; c < nc; ++c)
+                    overThreshold |= row[i + c] > level;
+                if (overThreshold)
+                    ++n;
+                else
+                    for (int c = 0; c < nc; ++c)
+                        row[i + c] = 0.f;
+            }
+            nSurvivors += n;
+        });
+        if (nSurvivors == 0) {
+            Warning("%s: no pixels were above bloom threshold %f", inFile, level);
+            return 1;
+        }
+        blurred.push_back(std::move(thresholdedImage));
 
-    for (int iter = 0; iter < iterations; ++iter) {
-        Image blur =
-            blurred.back().GaussianFilter(image.AllChannelsDesc(), radius, sigma);
-        blurred.push_back(blur);
-    }
+        // Blur thresholded image.
+        Float sigma = radius / 2.;  // TODO: make a parameter
 
-    // Finally, add all of the blurred images, scaled, to the original.
-    for (int y = 0; y < res.y; ++y) {
-        for (int x = 0; x < res.x; ++x) {
-            for (int c = 0; c < nc; ++c) {
-                Float blurredSum = 0.f;
-                // Skip the thresholded image, since it's already
-                // present in the original; just add pixels from the
-                // blurred ones.
-                for (size_t j = 1; j < blurred.size(); ++j)
-                    blurredSum += blurred[j].GetChannel({x, y}, c);
-                image.SetChannel(
-                    {x, y}, c,
-                    image.GetChannel({x, y}, c) + (scale / iterations) * blurredSum);
-            }
+        for (int iter = 0; iter < iterations; ++iter) {
+            Image blur =
+                blurred.back().GaussianFilter(image.AllChannelsDesc(), radius, sigma);
+            blurred.push_back(blur);
         }
-    }
 
-    image.Write(outFile, imRead.metadata);
+        // Finally, add all of the blurred images, scaled, to the original.
+        Point2i res = image.Resolution();
+        ProcessRows(image, [&](int y, pstd::span<float> row) {
+            // Skip the thresholded image, since it's already present in the
+            // original; just add pixels from the blurred ones. They are
+            // all in float format, so their rows can be read in place.
+            for (size_t j = 1; j < blurred.size(); ++j) {
+                const float *blurredRow = (const float *)blurred[j].RawPointer({0, y});
+                for (int i = 0; i < res.x * nc; ++i)
+                    row[i] += (scale / iterations) * blurredRow[i];
+            }
+        });
+
+        image.Write(outFile, imRead.metadata);
 
-    return 0;
+        return 0;
+    });
 }
 
 int convert(std::vector<std::string> args) {
@@ -1642,9 +1882,10 @@ int convert(std::vector<std::string> args) {
     bool preserveColors = false;
     bool bw = false;
     bool fp16 = false;
-    std::string inFile, outFile;
+    std::vector<std::string> inFiles;
+    std::string outFile;
     std::string colorspace;
-    std::string channelNames;
+    std::string channels;
     std::array<int, 4> cropWindow = {-1, 0, -1, 0};
     Float clamp = Infinity;
 
@@ -1656,7 +1897,7 @@ int convert(std::vector<std::string> args) {
 
         if (ParseArg(&iter, args.end(), "acesfilmic", &acesFilmic, onError) ||
             ParseArg(&iter, args.end(), "bw", &bw, onError) ||
-            ParseArg(&iter, args.end(), "channels", &channelNames, onError) ||
+            ParseArg(&iter, args.end(), "channels", &channels, onError) ||
             ParseArg(&iter, args.end(), "clamp", &clamp, onError) ||
             ParseArg(&iter, args.end(), "colorspace", &colorspace, onError) ||
             ParseArg(&iter, args.end(), "crop", pstd::MakeSpan(cropWindow), onError) ||
@@ -1671,8 +1912,8 @@ int convert(std::vector<std::string> args) {
             ParseArg(&iter, args.end(), "scale", &scale, onError) ||
             ParseArg(&iter, args.end(), "tonemap", &tonemap, onError)) {
             // success
-        } else if ((*iter)[0] != '-' && inFile.empty()) {
-            inFile = *iter;
+        } else if ((*iter)[0] != '-') {
+            inFiles.push_back(*iter);
         } else
             usage("convert", "%s: unknown command flag", iter->c_str());
     }
@@ -1685,301 +1926,311 @@ int convert(std::vector<std::string> args) {
         usage("convert", "--scale value must be non-zero");
     if (outFile.empty())
         usage("convert", "--outfile filename must be specified");
-    if (inFile.empty())
+    if (inFiles.empty())
         usage("convert", "input filename not specified");
 
-    ImageAndMetadata imRead = Image::Read(inFile);
-    Image image = std::move(imRead.image);
-    ImageMetadata metadata = std::move(imRead.metadata);
-
-    ImageMetadata outMetadata;
-    // These are the only entries it makes sense to copy along (so far).
-    outMetadata.colorSpace = metadata.colorSpace;
-    outMetadata.cameraFromWorld = metadata.cameraFromWorld;
-    outMetadata.NDCFromWorld = metadata.NDCFromWorld;
-    outMetadata.pixelBounds = metadata.pixelBounds;
-    outMetadata.fullResolution = metadata.fullResolution;
-
-    if (channelNames.empty()) {
-        // If the input image has AOVs and the target image is a regular
-        // format, then just grab R,G,B...
-        bool hasAOVs = false;
-        for (const std::string &name : image.ChannelNames())
-            if (name != "R" && name != "G" && name != "B" && name != "A") {
-                hasAOVs = true;
-                break;
-            }
-
-        if (hasAOVs && !HasExtension(outFile, "exr")) {
-            Warning("%s: image has non-RGBA channels but converting to an image format "
-                    "that can't store them. Converting RGB only.",
-                    inFile);
-            channelNames = "R,G,B";
-        }
-    }
-
-    if (!channelNames.empty()) {
-        std::vector<std::string> splitChannelNames = SplitString(channelNames, ',');
-        ImageChannelDesc desc = image.GetChannelDesc(splitChannelNames);
-        if (!desc) {
-            Error("%s: image doesn't have channels \"%s\".", inFile, channelNames);
+    const RGBColorSpace *destColorSpace = nullptr;
+    if (!colorspace.empty()) {
+        destColorSpace = RGBColorSpace::GetNamed(colorspace);
+        if (!destColorSpace) {
+            Error("%s: color space unknown.", colorspace);
             return 1;
         }
-        image = image.SelectChannels(desc);
     }
 
-    Point2i res = image.Resolution();
-    int nc = image.NChannels();
-
-    // Crop
     // If last 2 are negative, they're taken as deltas
     if (cropWindow[1] < 0)
         cropWindow[1] = cropWindow[0] - cropWindow[1];
     if (cropWindow[3] < 0)
         cropWindow[3] = cropWindow[2] - cropWindow[3];
-    if (cropWindow[0] >= 0 && cropWindow[2] >= 0) {
-        Bounds2i cropBounds({cropWindow[0], cropWindow[2]},
-                            {cropWindow[1], cropWindow[3]});
-
-        Point2i fullRes =
-            metadata.fullResolution ? *metadata.fullResolution : image.Resolution();
-
-        if (metadata.pixelBounds && !Inside(cropBounds, *metadata.pixelBounds)) {
-            Error("%s: crop window bounds (%d,%d)-(%d,%d) are not inside "
-                  "image's pixel bounds (%d,%d)-(%d,%d).",
-                  inFile, cropBounds.pMin.x, cropBounds.pMin.y, cropBounds.pMax.x,
-                  cropBounds.pMax.y, metadata.pixelBounds->pMin.x,
-                  metadata.pixelBounds->pMin.y, metadata.pixelBounds->pMax.x,
-                  metadata.pixelBounds->pMax.y);
-            return 1;
-        } else if (!Inside(cropBounds, Bounds2i(Point2i(0, 0), fullRes))) {
-            Error("%s: crop window bounds (%d,%d)-(%d,%d) are not inside "
-                  "image's resolution (%d,%d).",
-                  inFile, cropBounds.pMin.x, cropBounds.pMin.y, cropBounds.pMax.x,
-                  cropBounds.pMax.y, fullRes.x, fullRes.y);
-            return 1;
-        }
 
-        outMetadata.fullResolution = fullRes;
-        outMetadata.pixelBounds = cropBounds;
+    return ProcessFiles("convert", inFiles, outFile, [&](const std::string &inFile,
+                                                         const std::string &outFile) {
+        ImageAndMetadata imRead = Image::Read(inFile);
+        Image image = std::move(imRead.image);
+        ImageMetadata metadata = std::move(imRead.metadata);
+
+        ImageMetadata outMetadata;
+        // These are the only entries it makes sense to copy along (so far).
+        outMetadata.colorSpace = metadata.colorSpace;
+        outMetadata.cameraFromWorld = metadata.cameraFromWorld;
+        outMetadata.NDCFromWorld = metadata.NDCFromWorld;
+        outMetadata.pixelBounds = metadata.pixelBounds;
+        outMetadata.fullResolution = metadata.fullResolution;
+
+        std::string channelNames = channels;
+        if (channelNames.empty()) {
+            // If the input image has AOVs and the target image is a regular
+            // format, then just grab R,G,B...
+            bool hasAOVs = false;
+            for (const std::string &name : image.ChannelNames())
+                if (name != "R" && name != "G" && name != "B" && name != "A") {
+                    hasAOVs = true;
+                    break;
+                }
+
+            if (hasAOVs && !HasExtension(outFile, "exr")) {
+                Warning("%s: image has non-RGBA channels but converting to an image "
+                        "format that can't store them. Converting RGB only.",
+                        inFile);
+                channelNames = "R,G,B";
+            }
+        }
 
-        // Adjust crop bounds for call to Crop()
-        if (metadata.pixelBounds) {
-            cropBounds.pMin = Point2i(cropBounds.pMin - metadata.pixelBounds->pMin);
-            cropBounds.pMax = Point2i(cropBounds.pMax - metadata.pixelBounds->pMin);
+        if (!channelNames.empty()) {
+            std::vector<std::string> splitChannelNames = SplitString(channelNames, ',');
+            ImageChannelDesc desc = image.GetChannelDesc(splitChannelNames);
+            if (!desc) {
+                Error("%s: image doesn't have channels \"%s\".", inFile, channelNames);
+                return 1;
+            }
+            image = image.SelectChannels(desc);
         }
-        image = image.Crop(cropBounds);
 
-        res = image.Resolution();
-    }
+        Point2i res = image.Resolution();
+        int nc = image.NChannels();
+
+        // Crop
+        if (cropWindow[0] >= 0 && cropWindow[2] >= 0) {
+            Bounds2i cropBounds({cropWindow[0], cropWindow[2]},
+                                {cropWindow[1], cropWindow[3]});
+
+            Point2i fullRes =
+                metadata.fullResolution ? *metadata.fullResolution : image.Resolution();
+
+            if (metadata.pixelBounds && !Inside(cropBounds, *metadata.pixelBounds)) {
+                Error("%s: crop window bounds (%d,%d)-(%d,%d) are not inside "
+                      "image's pixel bounds (%d,%d)-(%d,%d).",
+                      inFile, cropBounds.pMin.x, cropBounds.pMin.y, cropBounds.pMax.x,
+                      cropBounds.pMax.y, metadata.pixelBounds->pMin.x,
+                      metadata.pixelBounds->pMin.y, metadata.pixelBounds->pMax.x,
+                      metadata.pixelBounds->pMax.y);
+                return 1;
+            } else if (!Inside(cropBounds, Bounds2i(Point2i(0, 0), fullRes))) {
+                Error("%s: crop window bounds (%d,%d)-(%d,%d) are not inside "
+                      "image's resolution (%d,%d).",
+                      inFile, cropBounds.pMin.x, cropBounds.pMin.y, cropBounds.pMax.x,
+                      cropBounds.pMax.y, fullRes.x, fullRes.y);
+                return 1;
+            }
 
-    // Count how many of the following operations modify pixel values
-    // rather than copying existing ones.  (Takes heavy advantage of
-    // implicit bool->int conversions.)
-    int nModifyingOps = (!colorspace.empty() + (scale != 1) + (gamma != 1) + tonemap +
-                         preserveColors + acesFilmic);
-    // Convert to a 32-bit format for maximum accuracy if we're applying
-    // multiple operations to the pixel values.
-    if (nModifyingOps > 1 && !Is32Bit(image.Format()))
-        image = image.ConvertToFormat(PixelFormat::Float);
+            outMetadata.fullResolution = fullRes;
+            outMetadata.pixelBounds = cropBounds;
 
-    if (clamp < Infinity) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                Float maxValue = 0;
-                for (int c = 0; c < nc; ++c)
-                    maxValue = std::max(maxValue, image.GetChannel({x, y}, c));
-                if (maxValue > clamp) {
-                    Float scale = clamp / maxValue;
-                    for (int c = 0; c < nc; ++c)
-                        image.SetChannel({x, y}, c, scale * image.GetChannel({x, y}, c));
-                }
+            // Adjust crop bounds for call to Crop()
+            if (metadata.pixelBounds) {
+                cropBounds.pMin = Point2i(cropBounds.pMin - metadata.pixelBounds->pMin);
+                cropBounds.pMax = Point2i(cropBounds.pMax - metadata.pixelBounds->pMin);
             }
-    }
+            image = image.Crop(cropBounds);
 
-    if (!colorspace.empty()) {
-        const RGBColorSpace *dest = RGBColorSpace::GetNamed(colorspace);
-        if (!dest) {
-            Error("%s: color space unknown.", colorspace);
-            return 1;
+            res = image.Resolution();
         }
-        ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
-        if (!rgbDesc) {
-            Error("%s: doesn't have R, G, B channels.", inFile);
-            return 1;
+
+        // Count how many of the following operations modify pixel values
+        // rather than copying existing ones.  (Takes heavy advantage of
+        // implicit bool->int conversions.)
+        int nModifyingOps = (!colorspace.empty() + (scale != 1) + (gamma != 1) +
+                             tonemap + preserveColors + acesFilmic);
+        // Convert to a 32-bit format for maximum accuracy if we're applying
+        // multiple operations to the pixel values.
+        if (nModifyingOps > 1 && !Is32Bit(image.Format()))
+            image = image.ConvertToFormat(PixelFormat::Float);
+
+        // The per-pixel operations below work on whole rows of float
+        // values at a time; ProcessRows() handles them in parallel.
+        if (clamp < Infinity) {
+            ProcessRows(image, [&](int, pstd::span<float> row) {
+                for (size_t i = 0; i < row.size(); i += nc) {
+                    Float maxValue = 0;
+                    for (int c = 0; c < nc; ++c)
+                        maxValue = std::max<Float>(maxValue, row[i + c]);
+                    if (maxValue > clamp) {
+                        Float scale = clamp / maxValue;
+                        for (int c = 0; c < nc; ++c)
+                            row[i + c] *= scale;
+                    }
+                }
+            });
         }
 
-        const RGBColorSpace *srcColorSpace = metadata.GetColorSpace();
-        SquareMatrix<3> m = ConvertRGBColorSpace(*srcColorSpace, *dest);
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                ImageChannelValues channels = image.GetChannels({x, y}, rgbDesc);
-                RGB rgb = Mul<RGB>(m, channels);
-                image.SetChannels({x, y}, rgbDesc, {rgb.r, rgb.g, rgb.b});
+        if (destColorSpace) {
+            ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
+            if (!rgbDesc) {
+                Error("%s: doesn't have R, G, B channels.", inFile);
+                return 1;
             }
-        outMetadata.colorSpace = dest;
-    }
 
-    if (bw) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                Float sum = 0;
-                for (int c = 0; c < nc; ++c)
-                    sum += image.GetChannel({x, y}, c);
-                sum /= nc;
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel({x, y}, c, sum);
-            }
-    }
+            const RGBColorSpace *srcColorSpace = metadata.GetColorSpace();
+            TransformRGB(image, rgbDesc,
+                         ConvertRGBColorSpace(*srcColorSpace, *destColorSpace));
+            outMetadata.colorSpace = destColorSpace;
+        }
 
-    if (despikeLimit < Infinity) {
-        Image filteredImg = image;
-        int despikeCount = 0;
-        std::vector<ImageChannelValues> neighbors;
-        for (int i = 0; i < 9; ++i)
-            neighbors.push_back(ImageChannelValues(image.NChannels()));
+        if (bw) {
+            ProcessRows(image, [&](int, pstd::span<float> row) {
+                for (size_t i = 0; i < row.size(); i += nc) {
+                    Float sum = 0;
+                    for (int c = 0; c < nc; ++c)
+                        sum += row[i + c];
+                    sum /= nc;
+                    for (int c = 0; c < nc; ++c)
+                        row[i + c] = sum;
+                }
+            });
+        }
 
-        for (int y = 0; y < res.y; ++y) {
-            for (int x = 0; x < res.x; ++x) {
-                if (image.GetChannels({x, y}).Average() < despikeLimit)
-                    continue;
+        if (despikeLimit < Infinity) {
+            Image filteredImg = image;
+            int despikeCount = 0;
+            std::vector<ImageChannelValues> neighbors;
+            for (int i = 0; i < 9; ++i)
+                neighbors.push_back(ImageChannelValues(image.NChannels()));
 
-                // Copy all of the valid neighbor pixels into neighbors[].
-                ++despikeCount;
-                int validNeighbors = 0;
-                for (int dy = -1; dy <= 1; ++dy) {
-                    if (y + dy < 0 || y + dy >= res.y)
+            for (int y = 0; y < res.y; ++y) {
+                for (int x = 0; x < res.x; ++x) {
+                    if (image.GetChannels({x, y}).Average() < despikeLimit)
                         continue;
-                    for (int dx = -1; dx <= 1; ++dx) {
-                        if (x + dx < 0 || x + dx > res.x)
+
+                    // Copy all of the valid neighbor pixels into neighbors[].
+                    ++despikeCount;
+                    int validNeighbors = 0;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        if (y + dy < 0 || y + dy >= res.y)
                             continue;
-                        neighbors[validNeighbors++] = image.GetChannels({x + dx, y + dy});
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            if (x + dx < 0 || x + dx > res.x)
+                                continue;
+                            neighbors[validNeighbors++] =
+                                image.GetChannels({x + dx, y + dy});
+                        }
                     }
-                }
 
-                // Find the median of the neighbors, sorted by average value.
-                int mid = validNeighbors / 2;
-                std::nth_element(
-                    &neighbors[0], &neighbors[mid], &neighbors[validNeighbors],
-                    [](const ImageChannelValues &a, const ImageChannelValues &b) -> bool {
-                        return a.Average() < b.Average();
-                    });
-                filteredImg.SetChannels({x, y}, neighbors[mid]);
+                    // Find the median of the neighbors, sorted by average value.
+                    int mid = validNeighbors / 2;
+                    std::nth_element(&neighbors[0], &neighbors[mid],
+                                     &neighbors[validNeighbors],
+                                     [](const ImageChannelValues &a,
+                                        const ImageChannelValues &b) -> bool {
+                                         return a.Average() < b.Average();
+                                     });
+                    filteredImg.SetChannels({x, y}, neighbors[mid]);
+                }
             }
+            pstd::swap(image, filteredImg);
+            fprintf(stderr, "%s: despiked %d pixels\n", inFile.c_str(), despikeCount);
         }
-        pstd::swap(image, filteredImg);
-        fprintf(stderr, "%s: despiked %d pixels\n", inFile.c_str(), despikeCount);
-    }
 
-    if (scale != 1) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x)
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel({x, y}, c, scale * image.GetChannel({x, y}, c));
-    }
-
-    if (gamma != 1) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x)
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel(
-                        {x, y}, c,
-                        std::pow(std::max<Float>(0, image.GetChannel({x, y}, c)), gamma));
-    }
+        if (scale != 1) {
+            ProcessRows(image, [&](int, pstd::span<float> row) {
+                for (float &v : row)
+                    v *= scale;
+            });
+        }
 
-    if (tonemap) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                Float lum = image.GetChannels({x, y}).Average();
-                // Reinhard et al. photographic tone mapping operator.
-                Float scale = (1 + lum / (maxY * maxY)) / (1 + lum);
-                for (int c = 0; c < nc; ++c)
-                    image.SetChannel({x, y}, c, scale * image.GetChannel({x, y}, c));
-            }
-    }
+        if (gamma != 1) {
+            ProcessRows(image, [&](int, pstd::span<float> row) {
+                for (float &v : row)
+                    v = std::pow(std::max<Float>(0, v), gamma);
+            });
+        }
 
-    if (preserveColors) {
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                Float m = image.GetChannel({x, y}, 0);
-                for (int c = 1; c < nc; ++c)
-                    m = std::max(m, image.GetChannel({x, y}, c));
-                if (m > 1) {
+        if (tonemap) {
+            ProcessRows(image, [&](int, pstd::span<float> row) {
+                for (size_t i = 0; i < row.size(); i += nc) {
+                    Float lum = 0;
                     for (int c = 0; c < nc; ++c)
-                        image.SetChannel({x, y}, c, image.GetChannel({x, y}, c) / m);
+                        lum += row[i + c];
+                    lum /= nc;
+                    // Reinhard et al. photographic tone mapping operator.
+                    Float scale = (1 + lum / (maxY * maxY)) / (1 + lum);
+                    for (int c = 0; c < nc; ++c)
+                        row[i + c] *= scale;
                 }
-            }
-    }
+            });
+        }
 
-    if (acesFilmic) {
-        // Approximation via
-        // https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
-        auto ACESFilm = [](Float x) -> Float {
-            if (x <= 0)
-                return 0;
-            Float a = 2.51f;
-            Float b = 0.03f;
-            Float c = 2.43f;
-            Float d = 0.59f;
-            Float e = 0.14f;
-            return Clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0, 1);
-        };
+        if (preserveColors) {
+            ProcessRows(image, [&](int, pstd::span<float> row) {
+                for (size_t i = 0; i < row.size(); i += nc) {
+                    Float m = row[i];
+                    for (int c = 1; c < nc; ++c)
+                        m = std::max<Float>(m, row[i + c]);
+                    if (m > 1) {
+                        for (int c = 0; c < nc; ++c)
+                            row[i + c] /= m;
+                    }
+                }
+            });
+        }
 
-        for (int y = 0; y < res.y; ++y)
-            for (int x = 0; x < res.x; ++x) {
-                for (int c = 0; c < nc; ++c) {
-                    Float v = image.GetChannel({x, y}, c);
+        if (acesFilmic) {
+            // Approximation via
+            // https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
+            auto ACESFilm = [](Float x) -> Float {
+                if (x <= 0)
+                    return 0;
+                Float a = 2.51f;
+                Float b = 0.03f;
+                Float c = 2.43f;
+                Float d = 0.59f;
+                Float e = 0.14f;
+                return Clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0, 1);
+            };
+
+            ProcessRows(image, [&](int, pstd::span<float> row) {
+                for (float &v : row)
                     v = ACESFilm(v);
-                    image.SetChannel({x, y}, c, v);
+            });
+        }
+
+        if (repeat > 1) {
+            Image scaledImage(image.Format(), Point2i(res.x * repeat, res.y * repeat),
+                              image.ChannelNames(), image.Encoding());
+            for (int y = 0; y < repeat * res.y; ++y) {
+                int yy = y / repeat;
+                for (int x = 0; x < repeat * res.x; ++x) {
+                    int xx = x / repeat;
+                    for (int c = 0; c < nc; ++c)
+                        scaledImage.SetChannel({x, y}, c, image.GetChannel({xx, yy}, c));
                 }
             }
-    }
-
-    if (repeat > 1) {
-        Image scaledImage(image.Format(), Point2i(res.x * repeat, res.y * repeat),
-                          image.ChannelNames(), image.Encoding());
-        for (int y = 0; y < repeat * res.y; ++y) {
-            int yy = y / repeat;
-            for (int x = 0; x < repeat * res.x; ++x) {
-                int xx = x / repeat;
-                for (int c = 0; c < nc; ++c)
-                    scaledImage.SetChannel({x, y}, c, image.GetChannel({xx, yy}, c));
+            image = std::move(scaledImage);
+            res = image.Resolution();
+
+            if (outMetadata.fullResolution)
+                *outMetadata.fullResolution *= repeat;
+            if (outMetadata.pixelBounds) {
+                outMetadata.pixelBounds->pMin *= repeat;
+                outMetadata.pixelBounds->pMax *= repeat;
             }
         }
-        image = std::move(scaledImage);
-        res = image.Resolution();
-
-        if (outMetadata.fullResolution)
-            *outMetadata.fullResolution *= repeat;
-        if (outMetadata.pixelBounds) {
-            outMetadata.pixelBounds->pMin *= repeat;
-            outMetadata.pixelBounds->pMax *= repeat;
-        }
-    }
 
-    if (flipy) {
-        image.FlipY();
-        if (outMetadata.pixelBounds && outMetadata.fullResolution) {
-            // Flip the pixel bounds in the metadata as well
-            int by[2] = {
-                outMetadata.fullResolution->y - 1 - outMetadata.pixelBounds->pMax.y,
-                outMetadata.fullResolution->y - 1 - outMetadata.pixelBounds->pMin.y};
-            outMetadata.pixelBounds->pMin.y = by[0];
-            outMetadata.pixelBounds->pMax.y = by[1];
+        if (flipy) {
+            image.FlipY();
+            if (outMetadata.pixelBounds && outMetadata.fullResolution) {
+                // Flip the pixel bounds in the metadata as well
+                int by[2] = {
+                    outMetadata.fullResolution->y - 1 - outMetadata.pixelBounds->pMax.y,
+                    outMetadata.fullResolution->y - 1 - outMetadata.pixelBounds->pMin.y};
+                outMetadata.pixelBounds->pMin.y = by[0];
+                outMetadata.pixelBounds->pMax.y = by[1];
+            }
         }
-    }
 
-    if (fp16)
-        image = image.ConvertToFormat(PixelFormat::Half);
+        if (fp16)
+            image = image.ConvertToFormat(PixelFormat::Half);
 
-    if (!image.Write(outFile, outMetadata))
-        return 1;
+        if (!image.Write(outFile, outMetadata))
+            return 1;
 
-    return 0;
+        return 0;
+    });
 }
 
 int whitebalance(std::vector<std::string> args) {
-    std::string inFile, outFile;
+    std::vector<std::string> inFiles;
+    std::string outFile;
     Float temperature = 0;
     std::array<Float, 2> xy = {Float(0), Float(0)};
     std::string illuminant;
@@ -1995,8 +2246,8 @@ int whitebalance(std::vector<std::string> args) {
             ParseArg(&iter, args.end(), "illuminant", &illuminant, onError) ||
             ParseArg(&iter, args.end(), "temperature", &temperature, onError)) {
             // success
-        } else if (inFile.empty() && (*iter)[0] != '-') {
-            inFile = *iter;
+        } else if ((*iter)[0] != '-') {
+            inFiles.push_back(*iter);
         } else {
             onError(StringPrintf("argument %s invalid", *iter));
         }
@@ -2004,7 +2255,7 @@ int whitebalance(std::vector<std::string> args) {
 
     if (outFile.empty())
         usage("whitebalance", "--outfile must be specified");
-    if (inFile.empty())
+    if (inFiles.empty())
         usage("whitebalance", "input filename must be specified");
 
     if ((!illuminant.empty() + (temperature > 0) + (xy[0] != 0)) > 1)
@@ -2014,17 +2265,7 @@ int whitebalance(std::vector<std::string> args) {
         usage("whitebalance",
               "must provide one of --illuminant, --primaries, or --temperature");
 
-    ImageAndMetadata imRead = Image::Read(inFile);
-    Image &image = imRead.image;
-
-    ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
-    if (!rgbDesc) {
-        Error("%s: doesn't have R, G, B channels.", inFile);
-        return 1;
-    }
-
-    const RGBColorSpace *colorSpace = imRead.metadata.GetColorSpace();
-    Point2f srcWhite, targetWhite = colorSpace->w;
+    Point2f srcWhite;
     if (!illuminant.empty()) {
         std::string name = "stdillum-" + illuminant;
         Spectrum illum = GetNamedSpectrum(name);
@@ -2041,20 +2282,30 @@ int whitebalance(std::vector<std::string> args) {
     } else
         srcWhite = Point2f(xy[0], xy[1]);
 
-    SquareMatrix<3> ccMatrix = colorSpace->RGBFromXYZ *
-                               WhiteBalance(srcWhite, targetWhite) *
-                               colorSpace->XYZFromRGB;
-
-    for (int y = 0; y < image.Resolution().y; ++y)
-        for (int x = 0; x < image.Resolution().x; ++x) {
-            ImageChannelValues channels = image.GetChannels({x, y}, rgbDesc);
-            RGB rgb = Mul<RGB>(ccMatrix, channels);
-            image.SetChannels({x, y}, rgbDesc, {rgb.r, rgb.g, rgb.b});
-        }
-
-    image.Write(outFile, imRead.metadata);
-
-    return 0;
+    return ProcessFiles("whitebalance", inFiles, outFile,
+                        [&](const std::string &inFile, const std::string &outFile) {
+                            ImageAndMetadata imRead = Image::Read(inFile);
+                            Image &image = imRead.image;
+
+                            ImageChannelDesc rgbDesc =
+                                image.GetChannelDesc({"R", "G", "B"});
+                            if (!rgbDesc) {
+                                Error("%s: doesn't have R, G, B channels.", inFile);
+                                return 1;
+                            }
+
+                            const RGBColorSpace *colorSpace =
+                                imRead.metadata.GetColorSpace();
+                            SquareMatrix<3> ccMatrix =
+                                colorSpace->RGBFromXYZ *
+                                WhiteBalance(srcWhite, colorSpace->w) *
+                                colorSpace->XYZFromRGB;
+                            TransformRGB(image, rgbDesc, ccMatrix);
+
+                            image.Write(outFile, imRead.metadata);
+
+                            return 0;
+                        });
 }
 
 int makeemitters(std::vector<std::string> args) {
@@ -2220,6 +2471,50 @@ int makeequiarea(std::vector<std::string> args) {
     return 0;
 }
 
+int maketx(std::vector<std::string> args) {
+    std::string inFilename, outFilename, encodingName, wrapName = "repeat";
+
+    auto onError = [](const std::string &err) {
+        usage("maketx", "%s", err.c_str());
+        exit(1);
+    };
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        if (ParseArg(&iter, args.end(), "encoding", &encodingName, onError) ||
+            ParseArg(&iter, args.end(), "outfile", &outFilename, onError) ||
+            ParseArg(&iter, args.end(), "wrap", &wrapName, onError)) {
+            // success
+        } else if ((*iter)[0] == '-')
+            usage("maketx", "%s: unknown command flag", iter->c_str());
+        else if (inFilename.empty()) {
+            inFilename = *iter;
+        } else
+            usage("maketx", "multiple input filenames provided.");
+    }
+    if (inFilename.empty())
+        usage("maketx", "input image filename must be provided.");
+    if (outFilename.empty())
+        usage("maketx", "output filename must be provided.");
+    if (!HasExtension(outFilename, "mip"))
+        usage("maketx", "%s: output filename must have the \".mip\" extension.",
+              outFilename.c_str());
+
+    pstd::optional<WrapMode> wrapMode = ParseWrapMode(wrapName.c_str());
+    if (!wrapMode)
+        usage("maketx", "%s: wrap mode unknown", wrapName.c_str());
+    if (encodingName.empty())
+        encodingName = HasExtension(inFilename, "png") ? "sRGB" : "linear";
+    ColorEncoding encoding = ColorEncoding::Get(encodingName, Allocator());
+
+    MIPMap *mipmap = MIPMap::CreateFromFile(inFilename, MIPMapFilterOptions(),
+                                            *wrapMode, encoding, Allocator());
+    if (!mipmap->WriteTiled(outFilename))
+        return 1;
+    printf("%s: wrote %d MIP map levels, starting at %d x %d.\n", outFilename.c_str(),
+           mipmap->Levels(), mipmap->LevelResolution(0).x,
+           mipmap->LevelResolution(0).y);
+    return 0;
+}
+
 #ifdef PBRT_BUILD_GPU_RENDERER
 int denoise_optix(std::vector<std::string> args) {
     std::string inFilename, outFilename;
@@ -2380,6 +2675,10 @@ int main(int argc, char *argv[]) {
         return makeemitters(args);
     else if (cmd == "makesky")
         return makesky(args);
+    else if (cmd == "maketx")
+        return maketx(args);
+    else if (cmd == "mergefilm")
+        return mergefilm(args);
     else if (cmd == "whitebalance")
         return whitebalance(args);
     else if (cmd == "scalenormalmap")
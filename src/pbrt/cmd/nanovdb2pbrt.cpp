@@ -7,6 +7,7 @@
 
 #include <pbrt/media.h>
 #include <pbrt/util/args.h>
+#include <pbrt/util/file.h>
 
 #include <nanovdb/NanoVDB.h>
 #define NANOVDB_USE_ZIP 1
@@ -14,7 +15,11 @@
 #include <nanovdb/util/GridHandle.h>
 #include <nanovdb/util/SampleFromVoxels.h>
 
+#include <zlib.h>
+
+#include <algorithm>
 #include <stdio.h>
+#include <string>
 #include <vector>
 
 using namespace pbrt;
@@ -43,6 +48,38 @@ static nanovdb::GridHandle<Buffer> readGrid(const std::string &filename,
     return grid;
 }
 
+// Writes the grid's samples to a grid medium sample file, compressing it if
+// _filename_ has a ".gz" extension.
+static bool writeGridFile(const std::string &filename, const std::vector<Float> &values,
+                          int nx, int ny, int nz) {
+    std::string contents(GridMediumFileMagic);
+    for (int32_t v : {nx, ny, nz})
+        for (int i = 0; i < 4; ++i)
+            contents.push_back(char((uint32_t(v) >> (8 * i)) & 0xff));
+    for (Float v : values) {
+        float f = v;
+        contents.append((const char *)&f, sizeof(float));
+    }
+
+    if (!HasExtension(filename, ".gz"))
+        return WriteFileContents(filename, contents);
+    gzFile gz = gzopen(filename.c_str(), "wb");
+    if (!gz) {
+        fprintf(stderr, "%s: unable to open file\n", filename.c_str());
+        return false;
+    }
+    // gzwrite() takes 32-bit sizes, so large grids are written in pieces
+    for (size_t offset = 0; offset < contents.size(); offset += 1 << 30) {
+        unsigned int n = std::min<size_t>(contents.size() - offset, 1 << 30);
+        if (gzwrite(gz, contents.data() + offset, n) != int(n)) {
+            fprintf(stderr, "%s: error writing file\n", filename.c_str());
+            gzclose(gz);
+            return false;
+        }
+    }
+    return gzclose(gz) == Z_OK;
+}
+
 static void usage(const std::string &msg = {}) {
     if (!msg.empty())
         fprintf(stderr, "nanovdb2pbrt: %s\n\n", msg.c_str());
@@ -52,6 +89,10 @@ static void usage(const std::string &msg = {}) {
 
 Options:
   --grid <name>        Name of grid to extract. Default: "density"
+  --outfile <name>     Write the grid's samples to a binary file that is
+                       referenced by the printed parameters, rather than
+                       printing them. The file is compressed if <name>
+                       ends in ".gz".
 )");
     exit(msg.empty() ? 0 : 1);
 }
@@ -66,6 +107,7 @@ int main(int argc, char *argv[]) {
 
     std::string filename;
     std::string grid = "density";
+    std::string outFilename;
     int downsample = 0;
     for (auto iter = args.begin(); iter != args.end(); ++iter) {
         if ((*iter)[0] != '-') {
@@ -76,7 +118,8 @@ int main(int argc, char *argv[]) {
                 exit(1);
             }
         } else if (ParseArg(&iter, args.end(), "downsample", &downsample, onError) ||
-                   ParseArg(&iter, args.end(), "grid", &grid, onError)) {
+                   ParseArg(&iter, args.end(), "grid", &grid, onError) ||
+                   ParseArg(&iter, args.end(), "outfile", &outFilename, onError)) {
             // success
         } else {
             usage();
@@ -114,6 +157,13 @@ int main(int argc, char *argv[]) {
     printf("\t\"point3 p0\" [ %f %f %f ] \"point3 p1\" [ %f %f %f ]\n",
            bounds.pMin.x, bounds.pMin.y, bounds.pMin.z,
            bounds.pMax.x, bounds.pMax.y, bounds.pMax.z);
+    if (!outFilename.empty()) {
+        if (!writeGridFile(outFilename, values, 1 + x1 - x0, 1 + y1 - y0, 1 + z1 - z0))
+            return 1;
+        printf("\t\"string %sfile\" \"%s\"\n", grid.c_str(), outFilename.c_str());
+        return 0;
+    }
+
     printf("\t\"float %s\" [\n", grid.c_str());
     for (int i = 0; i < values.size(); ++i) {
         Float d = values[i];
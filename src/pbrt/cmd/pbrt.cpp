@@ -14,17 +14,28 @@
 #include <pbrt/util/args.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/image.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/spectrum.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/util/string.h>
 #include <pbrt/wavefront/wavefront.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#if defined(PBRT_BUILD_GPU_RENDERER) && !defined(PBRT_IS_WINDOWS)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace pbrt;
 
 static void usage(const std::string &msg = {}) {
@@ -35,48 +46,186 @@ static void usage(const std::string &msg = {}) {
             R"(usage: pbrt [<options>] <filename.pbrt...>
 
 Rendering options:
+  --adaptive-error <e>          Stop sampling pixels once their estimated relative
+                                error is below <e>. (Default: 0, disabled)
+  --bench <filename>            Render at a fixed sample count (16 unless --spp is
+                                given) and write the time spent parsing, creating
+                                the scene, building the BVH, and rendering, the
+                                camera and total rays per second, and the peak
+                                memory use to the given JSON file.
+  --block-textures              Store image texture MIP map levels in 4x4 blocks of
+                                texels rather than scanlines, so that filtering
+                                touches fewer cache lines and pages.
+  --bssrdf-cache <dir>          Save subsurface scattering tables to the given
+                                directory and reuse them in later runs.
+  --bvh-cache <dir>             Save BVHs to the given directory and reuse them in
+                                later runs if the scene's geometry is unchanged.
+  --checkpoint <filename>       Periodically save the state of the render to the
+                                given file so that it can be continued with --resume.
+  --checkpoint-interval <s>     Seconds between checkpoints. (Default: 300)
+  --compress-textures           Store image texture MIP maps block-compressed in
+                                memory, using 4-8x less memory at some loss of
+                                quality.
+  --coordinator <port>          Render the image with workers started with --worker,
+                                handing out tiles and sample ranges to them as they
+                                become idle and writing the merged image.
+  --cpus <list>                 Only run rendering threads on the given CPUs,
+                                e.g. "0-7,16-23".
   --cropwindow <x0,x1,y0,y1>    Specify an image crop window w.r.t. [0,1]^2.
   --debugstart <values>         Inform the Integrator where to start rendering for
                                 faster debugging. (<values> are Integrator-specific
                                 and come from error message text.)
+  --denoise-stop <e>            With a "gbuffer" film, denoise the image after each
+                                wave of samples and stop once successive denoised
+                                images differ by less than <e>. (Default: 0, disabled)
   --disable-image-textures      Always return the average value of image textures.
   --disable-pixel-jitter        Always sample pixels at their centers.
   --disable-texture-filtering   Point-sample all textures.
   --disable-wavelength-jitter   Always sample the same %d wavelengths of light.
   --displacement-edge-scale <s> Scale target triangle edge length by given value.
                                 (Default: 1)
+  --display-bandwidth <MB/s>    Limit the rate at which image updates are sent to
+                                --display-server. (Default: 0, unlimited)
   --display-server <addr:port>  Connect to display server at given address and port
                                 to display the image as it's being rendered.
   --force-diffuse               Convert all materials to be diffuse.)
+  --frames <pattern>            After rendering the scene, render the frames of an
+                                animation given by the files that <pattern> names
+                                with a printf-style frame number, from 1 until a
+                                file is missing, e.g. "frame%%04d.pbrt". Each frame
+                                may change the camera, the shapes of objects
+                                (keeping their triangles), and the object instances;
+                                the rest of the scene is reused.
   --fullscreen                  Render fullscreen. Only supported with --interactive.)"
 #ifdef PBRT_BUILD_GPU_RENDERER
             R"(
   --gpu                         Use the GPU for rendering. (Default: disabled)
-  --gpu-device <index>          Use specified GPU for rendering.)"
+  --gpu-device <index>          Use specified GPU for rendering.
+  --gpu-devices <i0,i1,...>     Split the image into bands that are rendered in
+                                parallel using the specified GPUs. Requires
+                                --outfile.
+  --gpu-denoise-display         Run the OptiX denoiser on the image sent to
+                                --display-server, overlapped with rendering.
+  --gpu-graphs                  Capture each pass's GPU kernel launches into a CUDA
+                                graph that is launched as a whole.
+  --gpu-host-geometry           Keep mesh vertex data in host memory, where the GPU
+                                reads it on demand, leaving device memory for the
+                                acceleration structures.
+  --gpu-persistent-threads      Process work queues with only as many GPU threads as
+                                can be resident, each handling multiple items.
+  --gpu-texture-max-res <n>     Don't upload image texture MIP levels larger than
+                                n texels in either dimension to the GPU.)"
 #endif
             R"(
   --help                        Print this help text.
+  --huge-pages                  Back large allocations such as BVH nodes, meshes, and
+                                film pixels with huge pages to reduce TLB misses.
   --interactive                 Enable interactive rendering mode.
+  --lazy-shapes                 Only keep non-emissive shapes in memory while rays
+                                are intersecting them.
+  --lazy-shape-memory <MB>      Memory budget for --lazy-shapes geometry and displaced
+                                mesh patches; least recently used shapes are freed
+                                beyond it.
+                                (Default: 0, unlimited)
+  --memory-budget <MB>          Evict lazily-created shapes and --texture-cache tiles
+                                when the memory allocated for the scene exceeds the
+                                given amount. (Default: 0, unlimited)
+  --metrics <filename>          Periodically rewrite the given file with the render's
+                                progress, estimated time remaining, rays per second,
+                                and memory use, as JSON or, if its name ends in
+                                ".prom", in the Prometheus text format.
+  --metrics-interval <s>        Seconds between --metrics updates. (Default: 5)
   --mse-reference-image         Filename for reference image to use for MSE computation.
   --mse-reference-out           File to write MSE error vs spp results.
   --nthreads <num>              Use specified number of threads for rendering.
+  --no-smt                      Only run rendering threads on the first hardware
+                                thread of each core.
+  --numa                        Pin threads to NUMA nodes and interleave large
+                                read-mostly allocations across all nodes.
   --outfile <filename>          Write the final image to the given filename.
+  --overlap-waves               Start rendering tiles of the next wave of samples while
+                                the last ones of the current wave finish, unless
+                                something must be done between waves, such as
+                                writing an image or computing the MSE.
+  --perf-counters               With --stats, report sampled hardware counters (IPC,
+                                cache and branch misses) for ray intersection,
+                                shading, texture filtering, and film updates.
+                                (Linux only)
+  --pin-threads                 Pin each rendering thread to a single CPU.
   --pixel <x,y>                 Render just the specified pixel.
   --pixelbounds <x0,x1,y0,y1>   Specify an image crop window w.r.t. pixel coordinates.
   --pixelmaterial <x,y>         Print information about the material visible in the
                                 center of the pixel's extent.
   --pixelstats                  Record per-pixel statistics and write additional images
-                                with their values.
+                                with their values, including a multi-channel
+                                heatmaps EXR of BVH, shading and texture costs.
+  --profile-load <filename>     Write the time and memory used by each phase of scene
+                                loading to the given JSON file and a Chrome trace to
+                                <filename>-trace.json.
+  --profile-render <filename>   Write the wavefront integrator's ray statistics and,
+                                with --gpu, its per-kernel timings to the given
+                                JSON file.
+  --ptex-cache <MB>             Maximum memory used by the Ptex texture cache.
+                                (Default: 4096)
+  --ptex-max-files <n>          Maximum number of Ptex texture files to keep open.
+                                (Default: 100)
   --quick                       Automatically reduce a number of quality settings
                                 to render more quickly.
   --quiet                       Suppress all text output other than error messages.
   --render-coord-sys <name>     Coordinate system to use for the scene when rendering,
                                 where name is "camera", "cameraworld", or "world".
+  --reserve-cores <num>         Leave the given number of CPUs free for I/O and
+                                display threads.
+  --resume                      Continue the render saved in the --checkpoint file,
+                                if it exists.
+  --sample-map                  Write the number of samples taken in each pixel and
+                                the time spent on them to <film filename>-samples.exr
+                                after each wave of samples.
+  --sample-range <a,b>          Only take samples a through b-1 of each pixel, and
+                                also write the film's raw sums to <film
+                                filename>.film for "imgtool mergefilm".
+  --scene-cache <dir>           Save BVHs, light BVHs, image texture MIP maps,
+                                subsurface scattering tables, and RGB to spectrum
+                                tables for non-built-in color spaces to the given
+                                directory and map or read them in later runs, such as on
+                                distributed workers, if their inputs are unchanged.
+  --scratch-buffer <KB>         Preallocate and prefault the given amount of scratch
+                                memory for each rendering thread. (Default: 0,
+                                grow as needed)
   --seed <n>                    Set random number generator seed. Default: 0.
-  --stats                       Print various statistics after rendering completes.
+  --stats                       Print various statistics after rendering completes,
+                                including a sampling profile of the time spent in
+                                intersection, shading, texture filtering, light
+                                sampling, film updates, and medium sampling.
   --spp <n>                     Override number of pixel samples specified in scene
                                 description file.
+  --texture-cache <MB>          Keep image texture MIP maps on disk and load their
+                                tiles on demand into a cache of the given size.
+                                (Default: 0, disabled)
+  --tile-affinity               Start each thread on the same region of the image in
+                                every wave of samples.
+  --tile-order <order>          Order in which image tiles are rendered, where <order>
+                                is "hilbert", "morton", or "scanline".
+                                (Default: "hilbert")
+  --time-limit <s>              Size waves of samples from the measured sampling
+                                rate and stop at the last one that finishes within
+                                the given number of seconds. (Default: 0, unlimited)
+  --trace <filename>            Write a Chrome trace of each thread's parallel loop
+                                chunks, image tiles, sample waves, file I/O, and
+                                scene construction to the given file, for viewing
+                                in Perfetto or chrome://tracing.
+  --watch                       In interactive mode, watch the scene files and reload
+                                materials and lights when they change.
   --wavefront                   Use wavefront volumetric path integrator.
+  --worker <host:port>          Render the tiles and sample ranges assigned by the
+                                --coordinator at the given address until the image
+                                is finished. The scene and its options must match
+                                the coordinator's.
+  --write-dispatch-types <filename>
+                                Write the types that TaggedPointers dispatched to,
+                                most frequent first, for use as the
+                                PBRT_DISPATCH_TYPES_HEADER of a later build.
+                                (Requires a PBRT_RECORD_DISPATCH build; CPU only)
   --write-partial-images        Periodically write the current image to disk, rather
                                 than waiting for the end of rendering. Default: disabled.
 
@@ -92,6 +241,10 @@ Logging options:
 Reformatting options:
   --format                      Print a reformatted version of the input file(s) to
                                 standard output. Does not render an image.
+  --tobinary <filename>         Write the input file(s) to a binary scene file that
+                                can be rendered without parsing text. Relative
+                                paths are preserved, so it should be written to the
+                                input's directory. Does not render an image.
   --toply                       Print a reformatted version of the input file(s) to
                                 standard output and convert all triangle meshes to
                                 PLY files. Does not render an image.
@@ -101,6 +254,137 @@ Reformatting options:
     exit(msg.empty() ? 0 : 1);
 }
 
+#ifdef PBRT_BUILD_GPU_RENDERER
+// Renders the image by running a pbrt process for each of the given GPUs that
+// renders a band of scanlines and then assembles the bands into the final
+// image. Each process has its own copy of the scene, so rendering scales with
+// the number of GPUs as long as the bands take similar time to render.
+static int RenderMultiGPU(const std::vector<std::string> &args,
+                          const std::vector<int> &devices, PBRTOptions options) {
+#ifdef PBRT_IS_WINDOWS
+    ErrorExit("--gpu-devices is not supported on Windows.");
+#else
+    if (!options.useGPU)
+        ErrorExit("--gpu-devices can only be used with --gpu.");
+    if (options.imageFile.empty())
+        ErrorExit("--gpu-devices requires that the image filename be given with "
+                  "--outfile.");
+    if (options.interactive || !options.checkpointFile.empty() || options.resume)
+        ErrorExit("--gpu-devices can't be used with --interactive, --checkpoint, or "
+                  "--resume.");
+
+    // Remove arguments that are set separately for each process
+    std::vector<std::string> baseArgs;
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        auto onError = [](const std::string &err) { ErrorExit("%s", err); };
+        std::string value;
+        if ((*iter)[0] == '-' &&
+            (ParseArg(&iter, args.end(), "gpu-devices", &value, onError) ||
+             ParseArg(&iter, args.end(), "gpu-device", &value, onError) ||
+             ParseArg(&iter, args.end(), "outfile", &value, onError) ||
+             ParseArg(&iter, args.end(), "cropwindow", &value, onError) ||
+             ParseArg(&iter, args.end(), "pixelbounds", &value, onError) ||
+             ParseArg(&iter, args.end(), "pixel", &value, onError)))
+            continue;
+        baseArgs.push_back(*iter);
+    }
+
+    // Launch a process for each GPU to render a band of the image
+    int nBands = devices.size();
+    std::vector<std::string> bandFiles;
+    std::vector<pid_t> pids;
+    for (int i = 0; i < nBands; ++i) {
+        std::vector<std::string> bandArgs = baseArgs;
+        if (options.pixelBounds) {
+            Bounds2i b = *options.pixelBounds;
+            int y0 = b.pMin.y + (b.pMax.y - b.pMin.y) * i / nBands;
+            int y1 = b.pMin.y + (b.pMax.y - b.pMin.y) * (i + 1) / nBands;
+            bandArgs.push_back("--pixelbounds");
+            bandArgs.push_back(
+                StringPrintf("%d,%d,%d,%d", b.pMin.x, b.pMax.x, y0, y1));
+        } else {
+            // Adjacent bands are given the same boundary values, so the film
+            // rounds them to the same scanline
+            Bounds2f c = options.cropWindow ? *options.cropWindow
+                                            : Bounds2f(Point2f(0, 0), Point2f(1, 1));
+            Float y0 = Lerp(Float(i) / nBands, c.pMin.y, c.pMax.y);
+            Float y1 = Lerp(Float(i + 1) / nBands, c.pMin.y, c.pMax.y);
+            bandArgs.push_back("--cropwindow");
+            bandArgs.push_back(
+                StringPrintf("%f,%f,%f,%f", c.pMin.x, c.pMax.x, y0, y1));
+        }
+        bandFiles.push_back(
+            StringPrintf("%s.gpu%d.exr", RemoveExtension(options.imageFile), i));
+        bandArgs.insert(bandArgs.end(), {"--gpu-device", std::to_string(devices[i]),
+                                         "--outfile", bandFiles.back()});
+        // Only report progress for the first band
+        if (i > 0 && !options.quiet)
+            bandArgs.push_back("--quiet");
+
+        std::vector<char *> argv = {const_cast<char *>("pbrt")};
+        for (std::string &arg : bandArgs)
+            argv.push_back(arg.data());
+        argv.push_back(nullptr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        } else if (pid < 0)
+            ErrorExit("Unable to launch rendering process: %s", ErrorString());
+        pids.push_back(pid);
+    }
+
+    // Wait for all of the bands to finish rendering
+    bool failed = false;
+    for (pid_t pid : pids) {
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0)
+            failed = true;
+    }
+    if (failed)
+        ErrorExit("Rendering failed on one or more GPUs.");
+
+    // Assemble the bands into the final image
+    options.useGPU = false;
+    InitPBRT(options);
+    std::vector<ImageAndMetadata> bands;
+    Bounds2i bounds;
+    for (const std::string &file : bandFiles) {
+        bands.push_back(Image::Read(file));
+        if (!bands.back().metadata.pixelBounds)
+            ErrorExit("%s: image doesn't have pixel bounds.", file);
+        bounds = Union(bounds, *bands.back().metadata.pixelBounds);
+    }
+    const Image &first = bands[0].image;
+    Image image(first.Format(), Point2i(bounds.Diagonal()), first.ChannelNames(),
+                first.Encoding());
+    ImageMetadata metadata = bands[0].metadata;
+    for (const ImageAndMetadata &band : bands) {
+        Bounds2i b = *band.metadata.pixelBounds;
+        std::vector<float> values(b.Area() * band.image.NChannels());
+        band.image.CopyRectOut(Bounds2i(Point2i(0, 0), band.image.Resolution()),
+                               values);
+        image.CopyRectIn(Bounds2i(Point2i(b.pMin - bounds.pMin),
+                                  Point2i(b.pMax - bounds.pMin)),
+                         values);
+        if (band.metadata.renderTimeSeconds)
+            metadata.renderTimeSeconds = std::max(metadata.renderTimeSeconds.value_or(0),
+                                                  *band.metadata.renderTimeSeconds);
+    }
+    metadata.pixelBounds = bounds;
+    metadata.MSE.reset();
+    if (!image.Write(options.imageFile, metadata))
+        ErrorExit("%s: unable to write image.", options.imageFile);
+    for (const std::string &file : bandFiles)
+        RemoveFile(file);
+
+    CleanupPBRT();
+    return 0;
+#endif  // PBRT_IS_WINDOWS
+}
+#endif  // PBRT_BUILD_GPU_RENDERER
+
 // main program
 int main(int argc, char *argv[]) {
     // Convert command-line arguments to vector of strings
@@ -115,6 +399,7 @@ int main(int argc, char *argv[]) {
     std::string logLevel = "error";
     std::string renderCoordSys = "cameraworld";
     bool format = false, toPly = false;
+    std::string toBinary, gpuDevices;
 
     // Process command-line arguments
     for (auto iter = args.begin(); iter != args.end(); ++iter) {
@@ -128,7 +413,7 @@ int main(int argc, char *argv[]) {
             exit(1);
         };
 
-        std::string cropWindow, pixelBounds, pixel, pixelMaterial;
+        std::string cropWindow, pixelBounds, pixel, pixelMaterial, sampleRange;
         if (ParseArg(&iter, args.end(), "cropwindow", &cropWindow, onError)) {
             std::vector<Float> c = SplitStringToFloats(cropWindow, ',');
             if (c.size() != 4) {
@@ -159,11 +444,33 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
             options.pixelMaterial = Point2i(p[0], p[1]);
+        } else if (ParseArg(&iter, args.end(), "sample-range", &sampleRange, onError)) {
+            std::vector<int> s = SplitStringToInts(sampleRange, ',');
+            if (s.size() != 2 || s[0] < 0 || s[0] >= s[1]) {
+                usage("Expected two values a,b with 0 <= a < b after --sample-range");
+                return 1;
+            }
+            options.sampleRange = Point2i(s[0], s[1]);
         } else if (
 #ifdef PBRT_BUILD_GPU_RENDERER
             ParseArg(&iter, args.end(), "gpu", &options.useGPU, onError) ||
             ParseArg(&iter, args.end(), "gpu-device", &options.gpuDevice, onError) ||
+            ParseArg(&iter, args.end(), "gpu-devices", &gpuDevices, onError) ||
+            ParseArg(&iter, args.end(), "gpu-denoise-display",
+                     &options.gpuDenoiseDisplay, onError) ||
+            ParseArg(&iter, args.end(), "gpu-graphs", &options.gpuGraphs, onError) ||
+            ParseArg(&iter, args.end(), "gpu-host-geometry", &options.gpuHostGeometry,
+                     onError) ||
+            ParseArg(&iter, args.end(), "gpu-persistent-threads",
+                     &options.gpuPersistentThreads, onError) ||
+            ParseArg(&iter, args.end(), "gpu-texture-max-res",
+                     &options.gpuTextureMaxResolution, onError) ||
 #endif
+            ParseArg(&iter, args.end(), "bench", &options.benchmarkFile, onError) ||
+            ParseArg(&iter, args.end(), "bssrdf-cache", &options.bssrdfCacheDirectory,
+                     onError) ||
+            ParseArg(&iter, args.end(), "bvh-cache", &options.bvhCacheDirectory,
+                     onError) ||
             ParseArg(&iter, args.end(), "debugstart", &options.debugStart, onError) ||
             ParseArg(&iter, args.end(), "disable-image-textures",
                      &options.disableImageTextures, onError) ||
@@ -173,18 +480,71 @@ int main(int argc, char *argv[]) {
                      &options.disableTextureFiltering, onError) ||
             ParseArg(&iter, args.end(), "disable-wavelength-jitter",
                      &options.disableWavelengthJitter, onError) ||
+            ParseArg(&iter, args.end(), "adaptive-error", &options.adaptiveError,
+                     onError) ||
+            ParseArg(&iter, args.end(), "time-limit", &options.timeLimit, onError) ||
+            ParseArg(&iter, args.end(), "trace", &options.traceFile, onError) ||
+            ParseArg(&iter, args.end(), "write-dispatch-types",
+                     &options.dispatchTypesFile, onError) ||
+            ParseArg(&iter, args.end(), "metrics", &options.metricsFile, onError) ||
+            ParseArg(&iter, args.end(), "coordinator", &options.coordinatorPort,
+                     onError) ||
+            ParseArg(&iter, args.end(), "worker", &options.coordinatorAddress,
+                     onError) ||
+            ParseArg(&iter, args.end(), "metrics-interval", &options.metricsInterval,
+                     onError) ||
+            ParseArg(&iter, args.end(), "denoise-stop", &options.denoiseStop, onError) ||
+            ParseArg(&iter, args.end(), "sample-map", &options.writeSampleMap, onError) ||
+            ParseArg(&iter, args.end(), "checkpoint", &options.checkpointFile, onError) ||
+            ParseArg(&iter, args.end(), "checkpoint-interval",
+                     &options.checkpointInterval, onError) ||
+            ParseArg(&iter, args.end(), "resume", &options.resume, onError) ||
             ParseArg(&iter, args.end(), "displacement-edge-scale",
                      &options.displacementEdgeScale, onError) ||
+            ParseArg(&iter, args.end(), "display-bandwidth", &options.displayBandwidth,
+                     onError) ||
             ParseArg(&iter, args.end(), "display-server", &options.displayServer,
                      onError) ||
             ParseArg(&iter, args.end(), "force-diffuse", &options.forceDiffuse,
                      onError) ||
             ParseArg(&iter, args.end(), "format", &format, onError) ||
+            ParseArg(&iter, args.end(), "frames", &options.framePattern, onError) ||
             ParseArg(&iter, args.end(), "log-level", &logLevel, onError) ||
             ParseArg(&iter, args.end(), "log-utilization", &options.logUtilization,
                      onError) ||
             ParseArg(&iter, args.end(), "log-file", &options.logFile, onError) ||
             ParseArg(&iter, args.end(), "interactive", &options.interactive, onError) ||
+            ParseArg(&iter, args.end(), "watch", &options.watchScene, onError) ||
+            ParseArg(&iter, args.end(), "lazy-shapes", &options.lazyShapes, onError) ||
+            ParseArg(&iter, args.end(), "numa", &options.numa, onError) ||
+            ParseArg(&iter, args.end(), "perf-counters", &options.perfCounters,
+                     onError) ||
+            ParseArg(&iter, args.end(), "huge-pages", &options.hugePages, onError) ||
+            ParseArg(&iter, args.end(), "scratch-buffer", &options.scratchBufferKB,
+                     onError) ||
+            ParseArg(&iter, args.end(), "pin-threads", &options.pinThreads, onError) ||
+            ParseArg(&iter, args.end(), "no-smt", &options.skipSMTSiblings, onError) ||
+            ParseArg(&iter, args.end(), "cpus", &options.cpus, onError) ||
+            ParseArg(&iter, args.end(), "tile-order", &options.tileOrder, onError) ||
+            ParseArg(&iter, args.end(), "tile-affinity", &options.tileAffinity,
+                     onError) ||
+            ParseArg(&iter, args.end(), "overlap-waves", &options.overlapWaves,
+                     onError) ||
+            ParseArg(&iter, args.end(), "reserve-cores", &options.reservedCores,
+                     onError) ||
+            ParseArg(&iter, args.end(), "lazy-shape-memory", &options.lazyShapeMemoryMB,
+                     onError) ||
+            ParseArg(&iter, args.end(), "memory-budget", &options.memoryBudgetMB,
+                     onError) ||
+            ParseArg(&iter, args.end(), "texture-cache", &options.textureCacheMB,
+                     onError) ||
+            ParseArg(&iter, args.end(), "ptex-cache", &options.ptexCacheMB, onError) ||
+            ParseArg(&iter, args.end(), "ptex-max-files", &options.ptexMaxFiles,
+                     onError) ||
+            ParseArg(&iter, args.end(), "compress-textures", &options.compressTextures,
+                     onError) ||
+            ParseArg(&iter, args.end(), "block-textures", &options.blockTextures,
+                     onError) ||
             ParseArg(&iter, args.end(), "fullscreen", &options.fullscreen, onError) ||
             ParseArg(&iter, args.end(), "mse-reference-image", &options.mseReferenceImage,
                      onError) ||
@@ -194,12 +554,19 @@ int main(int argc, char *argv[]) {
             ParseArg(&iter, args.end(), "outfile", &options.imageFile, onError) ||
             ParseArg(&iter, args.end(), "pixelstats", &options.recordPixelStatistics,
                      onError) ||
+            ParseArg(&iter, args.end(), "profile-load", &options.loadProfileFile,
+                     onError) ||
+            ParseArg(&iter, args.end(), "profile-render", &options.renderProfileFile,
+                     onError) ||
             ParseArg(&iter, args.end(), "quick", &options.quickRender, onError) ||
             ParseArg(&iter, args.end(), "quiet", &options.quiet, onError) ||
             ParseArg(&iter, args.end(), "render-coord-sys", &renderCoordSys, onError) ||
+            ParseArg(&iter, args.end(), "scene-cache", &options.sceneCacheDirectory,
+                     onError) ||
             ParseArg(&iter, args.end(), "seed", &options.seed, onError) ||
             ParseArg(&iter, args.end(), "spp", &options.pixelSamples, onError) ||
             ParseArg(&iter, args.end(), "stats", &options.printStatistics, onError) ||
+            ParseArg(&iter, args.end(), "tobinary", &toBinary, onError) ||
             ParseArg(&iter, args.end(), "toply", &toPly, onError) ||
             ParseArg(&iter, args.end(), "wavefront", &options.wavefront, onError) ||
             ParseArg(&iter, args.end(), "write-partial-images",
@@ -216,7 +583,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Print welcome banner
-    if (!options.quiet && !format && !toPly && !options.upgrade) {
+    if (!options.quiet && !format && !toPly && !options.upgrade && toBinary.empty()) {
         printf("pbrt version 4 (built %s at %s)\n", __DATE__, __TIME__);
 #ifdef PBRT_DEBUG_BUILD
         LOG_VERBOSE("Running debug build");
@@ -239,6 +606,10 @@ int main(int argc, char *argv[]) {
     else
         ErrorExit("%s: unknown rendering coordinate system.", renderCoordSys);
 
+    if (options.tileOrder != "hilbert" && options.tileOrder != "morton" &&
+        options.tileOrder != "scanline")
+        ErrorExit("%s: unknown tile order.", options.tileOrder);
+
     if (!options.mseReferenceImage.empty() && options.mseReferenceOutput.empty())
         ErrorExit("Must provide MSE reference output filename via "
                   "--mse-reference-out");
@@ -266,18 +637,91 @@ int main(int argc, char *argv[]) {
         ErrorExit("The --fullscreen option is only supported in interactive mode");
     }
 
+    if (options.watchScene && !options.interactive)
+        ErrorExit("The --watch option is only supported in interactive mode");
+
+    if (!options.framePattern.empty()) {
+        if (options.framePattern.find('%') == std::string::npos)
+            ErrorExit("%s: --frames pattern must include a frame number conversion "
+                      "such as \"%%04d\".",
+                      options.framePattern);
+        if (options.interactive || options.wavefront || options.useGPU)
+            ErrorExit("The --frames option is only supported by the CPU renderer.");
+        if (!options.coordinatorPort.empty() || !options.coordinatorAddress.empty())
+            ErrorExit("The --frames option can't be used with distributed rendering.");
+    }
+
+    if (!options.dispatchTypesFile.empty()) {
+#ifndef PBRT_RECORD_DISPATCH
+        ErrorExit("The --write-dispatch-types option requires pbrt to be built with "
+                  "PBRT_RECORD_DISPATCH enabled.");
+#endif
+        if (options.useGPU)
+            ErrorExit("The --write-dispatch-types option is not supported with --gpu.");
+    }
+
     if (options.interactive && options.quickRender) {
         ErrorExit("The --quick option is not supported in interactive mode");
     }
 
+    if (!options.benchmarkFile.empty()) {
+        if (options.interactive)
+            ErrorExit("The --bench option is not supported in interactive mode");
+        if (!options.pixelSamples)
+            options.pixelSamples = 16;
+    }
+
+    if (options.sampleRange && !options.checkpointFile.empty())
+        ErrorExit("The --sample-range and --checkpoint options can't be combined.");
+
+    if (!options.coordinatorPort.empty() || !options.coordinatorAddress.empty()) {
+        if (!options.coordinatorPort.empty() && !options.coordinatorAddress.empty())
+            ErrorExit("Only one of --coordinator and --worker may be specified.");
+        if (options.sampleRange)
+            ErrorExit("--sample-range can't be used with distributed rendering.");
+        if (options.interactive || options.wavefront || options.useGPU)
+            ErrorExit("Distributed rendering is only supported by the CPU renderer.");
+    }
+
+    if (options.metricsInterval <= 0)
+        ErrorExit("--metrics-interval must be positive.");
+    if (options.displayBandwidth < 0)
+        ErrorExit("--display-bandwidth must not be negative.");
+
+    if (!options.sceneCacheDirectory.empty()) {
+        // The scene cache also holds BVHs and subsurface scattering tables
+        if (options.bvhCacheDirectory.empty())
+            options.bvhCacheDirectory = options.sceneCacheDirectory;
+        if (options.bssrdfCacheDirectory.empty())
+            options.bssrdfCacheDirectory = options.sceneCacheDirectory;
+    }
+
     options.logLevel = LogLevelFromString(logLevel);
 
+#ifdef PBRT_BUILD_GPU_RENDERER
+    if (!gpuDevices.empty()) {
+        if (format || toPly || options.upgrade || !toBinary.empty())
+            ErrorExit("--gpu-devices can only be used when rendering.");
+        std::vector<int> devices = SplitStringToInts(gpuDevices, ',');
+        if (devices.empty())
+            ErrorExit("%s: invalid list of GPU devices.", gpuDevices);
+        if (devices.size() > 1)
+            return RenderMultiGPU(args, devices, options);
+        options.gpuDevice = devices[0];
+    }
+#endif  // PBRT_BUILD_GPU_RENDERER
+
     // Initialize pbrt
     // 处理命令行的参数
     // 初始化pbrt
     InitPBRT(options);
 
-    if (format || toPly || options.upgrade) {
+    if (!toBinary.empty()) {
+        if (format || toPly || options.upgrade)
+            ErrorExit("--tobinary can't be used with --format, --toply, or --upgrade.");
+        BinaryParserTarget binaryTarget(toBinary);
+        ParseFiles(&binaryTarget, filenames);
+    } else if (format || toPly || options.upgrade) {
         FormattingParserTarget formattingTarget(toPly, options.upgrade);
         ParseFiles(&formattingTarget, filenames);
     } else {
@@ -285,7 +729,10 @@ int main(int argc, char *argv[]) {
         // 处理提供的场景描述文件
         BasicScene scene;
         BasicSceneBuilder builder(&scene);
+        Timer parseTimer;
         ParseFiles(&builder, filenames);
+        StatsReportBenchmarkPhase(BenchmarkPhase::Parse, parseTimer.ElapsedSeconds());
+        scene.filenames = filenames;
 
         // Render the scene
         // 渲染该场景
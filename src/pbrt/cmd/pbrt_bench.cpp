@@ -0,0 +1,72 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/options.h>
+#include <pbrt/util/args.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/print.h>
+
+#include <benchmark/benchmark.h>
+#include <string>
+
+using namespace pbrt;
+
+void usage(const std::string &msg = "") {
+    if (!msg.empty())
+        fprintf(stderr, "pbrt_bench: %s\n\n", msg.c_str());
+
+    fprintf(stderr, R"(pbrt_bench arguments:
+  --log-level <level>         Log messages at or above this level, where <level>
+                              is "verbose", "error", or "fatal". Default: "error".
+  --nthreads <num>            Use specified number of threads for rendering.
+
+Google Benchmark's arguments (e.g., --benchmark_filter=<regexp>,
+--benchmark_format=json, and --benchmark_repetitions=<n>) are also accepted.
+)");
+
+    exit(msg.empty() ? 0 : 1);
+}
+
+int main(int argc, char **argv) {
+    PBRTOptions opt;
+    opt.quiet = true;
+    std::string logLevel = "error";
+
+    // Let Google Benchmark remove the arguments that it handles first
+    benchmark::Initialize(&argc, argv);
+    argv[argc] = nullptr;
+    std::vector<std::string> args = GetCommandLineArguments(argv);
+
+    // Process command-line arguments
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        auto onError = [](const std::string &err) {
+            usage(err);
+            exit(1);
+        };
+
+        if (ParseArg(&iter, args.end(), "log-level", &logLevel, onError) ||
+            ParseArg(&iter, args.end(), "nthreads", &opt.nThreads, onError)) {
+            // success
+        } else if (*iter == "--help" || *iter == "-help" || *iter == "-h") {
+            usage();
+            return 0;
+        } else {
+            usage(StringPrintf("argument \"%s\" unknown", *iter));
+            return 1;
+        }
+    }
+
+    opt.logLevel = LogLevelFromString(logLevel);
+
+    InitPBRT(opt);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    CleanupPBRT();
+
+    return 0;
+}
@@ -7,12 +7,15 @@
 #include <pbrt/util/args.h>
 #include <pbrt/util/file.h>
 #include <pbrt/util/image.h>
+#include <pbrt/util/math.h>
 #include <pbrt/util/mesh.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/string.h>
 #include <pbrt/util/transform.h>
 #include <pbrt/util/vecmath.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <array>
 #include <cstdarg>
 #include <map>
@@ -35,6 +38,8 @@ displace: Apply displacement mapping to a mesh.
 
 info: Print general information about the mesh.
 
+optimize: Reorder the mesh's faces and vertices for locality.
+
 split: Split the mesh into multiple PLY files.
 
 "plytool help <command>" provides detailed information about <command>.
@@ -77,6 +82,16 @@ options:
                     (Default: 1)
   --image <name>    Filename for image used to define displacements.
   --outfile <name>  Filename name for emitted PLY file.
+)");
+        } else if (cmd == "optimize") {
+            printf(R"(usage: plytool optimize [options] <filename>
+
+Sorts triangles along a Morton curve and renumbers vertices in the order
+they are first used so that nearby triangles' vertices are nearby in
+memory. Quads are split into triangles and unused vertices are removed.
+
+options:
+  --outfile <name>  Filename name for emitted PLY file.
 )");
         } else if (cmd == "split") {
             printf(R"(usage: plytool split [options] <filename>
@@ -300,6 +315,106 @@ int split(std::vector<std::string> args) {
     return 0;
 }
 
+// Returns the number of misses per triangle in a 32kB direct-mapped cache of
+// vertex positions when the triangles' vertices are fetched in order; it
+// approximates the locality of the vertex fetches in triangle intersection
+// tests, which are mostly made for nearby triangles one after another.
+static double VertexFetchMisses(pstd::span<const int> triIndices) {
+    constexpr int lineBytes = 64, nLines = 512;
+    std::vector<int64_t> lines(nLines, -1);
+    int64_t misses = 0;
+    for (int v : triIndices) {
+        int64_t line = int64_t(v) * sizeof(Point3f) / lineBytes;
+        if (lines[line % nLines] != line) {
+            lines[line % nLines] = line;
+            ++misses;
+        }
+    }
+    return triIndices.empty() ? 0. : double(misses) / (triIndices.size() / 3);
+}
+
+int optimize(std::vector<std::string> args) {
+    std::string inPLY, outPLY;
+    for (auto iter = args.begin(); iter != args.end(); ++iter) {
+        auto onError = [](const std::string &err) {
+            usage("%s", err.c_str());
+            exit(1);
+        };
+        if (ParseArg(&iter, args.end(), "outfile", &outPLY, onError))
+            ;  // yaay
+        else if (inPLY.empty())
+            inPLY = *iter;
+        else
+            usage("unexpected argument \"%s\"", iter->c_str());
+    }
+
+    if (inPLY.empty())
+        usage("must specify source PLY filename.");
+    if (outPLY.empty())
+        usage("must specify output PLY filename.");
+
+    TriQuadMesh mesh = TriQuadMesh::ReadPLY(inPLY);
+
+    if (!mesh.quadIndices.empty() && !mesh.faceIndices.empty()) {
+        fprintf(stderr,
+                "%s: sorry, mesh has quad faces and faceIndices, which are not "
+                "currently supported together by plytool.\n",
+                inPLY.c_str());
+        return 1;
+    }
+    mesh.ConvertToOnlyTriangles();
+    int nTriangles = mesh.triIndices.size() / 3;
+
+    // Sort the triangles by the Morton codes of their centroids
+    auto centroid = [&](int t) {
+        const int *v = &mesh.triIndices[3 * t];
+        return (mesh.p[v[0]] + mesh.p[v[1]] + mesh.p[v[2]]) / 3;
+    };
+    Bounds3f centroidBounds;
+    for (int t = 0; t < nTriangles; ++t)
+        centroidBounds = Union(centroidBounds, centroid(t));
+    std::vector<std::pair<uint32_t, int>> mortonTriangles(nTriangles);
+    ParallelFor(0, nTriangles, [&](int64_t t) {
+        constexpr int mortonScale = 1 << 10;
+        Vector3f offset = centroidBounds.Offset(centroid(t)) * mortonScale;
+        mortonTriangles[t] = {EncodeMorton3(offset.x, offset.y, offset.z), int(t)};
+    });
+    std::sort(mortonTriangles.begin(), mortonTriangles.end());
+
+    // Renumber the vertices in the order in which the sorted triangles use them
+    TriQuadMesh optimized;
+    std::vector<int> vertexRemap(mesh.p.size(), -1);
+    optimized.triIndices.reserve(mesh.triIndices.size());
+    for (const auto &mt : mortonTriangles) {
+        int t = mt.second;
+        for (int i = 0; i < 3; ++i) {
+            int v = mesh.triIndices[3 * t + i];
+            if (vertexRemap[v] == -1) {
+                vertexRemap[v] = int(optimized.p.size());
+                optimized.p.push_back(mesh.p[v]);
+                if (!mesh.n.empty())
+                    optimized.n.push_back(mesh.n[v]);
+                if (!mesh.uv.empty())
+                    optimized.uv.push_back(mesh.uv[v]);
+            }
+            optimized.triIndices.push_back(vertexRemap[v]);
+        }
+        if (!mesh.faceIndices.empty())
+            optimized.faceIndices.push_back(mesh.faceIndices[t]);
+    }
+
+    Printf("%s: %d triangles, %d of %d vertices used.\n", inPLY, nTriangles,
+           optimized.p.size(), mesh.p.size());
+    Printf("Vertex cache misses per triangle: %.3f before, %.3f after.\n",
+           VertexFetchMisses(mesh.triIndices), VertexFetchMisses(optimized.triIndices));
+
+    if (!WritePLY(outPLY, optimized.triIndices, {}, optimized.p, optimized.n,
+                  optimized.uv, optimized.faceIndices))
+        return 1;
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     InitPBRT(PBRTOptions());
 
@@ -322,6 +437,8 @@ int main(int argc, char *argv[]) {
         ret = displace(args);
     else if (cmd == "info")
         ret = info(args);
+    else if (cmd == "optimize")
+        ret = optimize(args);
     else if (cmd == "split")
         ret = split(args);
     else
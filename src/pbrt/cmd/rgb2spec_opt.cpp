@@ -822,60 +822,60 @@ int main(int argc, char **argv) {
     size_t bufsize = 3 * 3 * res * res * res;
     float *out = new float[bufsize];
 
-    for (int l = 0; l < 3; ++l) {
-        ParallelFor(0, res, [&](size_t j) {
-            const double y = j / double(res - 1);
-            fflush(stdout);
-            for (int i = 0; i < res; ++i) {
-                const double x = i / double(res - 1);
-                double coeffs[3], rgb[3];
-                memset(coeffs, 0, sizeof(double) * 3);
+    // Each (l, j, i) column of the table is optimized independently, warm
+    // starting each Gauss-Newton solve from its neighbor along k; run all of
+    // them in a single parallel loop so that there's enough work to keep all
+    // of the threads busy.
+    ParallelFor(0, 3 * res * res, [&](int64_t index) {
+        const int l = index / (res * res), j = (index / res) % res, i = index % res;
+        const double y = j / double(res - 1);
+        const double x = i / double(res - 1);
+        double coeffs[3], rgb[3];
+        memset(coeffs, 0, sizeof(double) * 3);
 
-                int start = res / 5;
+        int start = res / 5;
 
-                for (int k = start; k < res; ++k) {
-                    double b = (double)scale[k];
+        for (int k = start; k < res; ++k) {
+            double b = (double)scale[k];
 
-                    rgb[l] = b;
-                    rgb[(l + 1) % 3] = x * b;
-                    rgb[(l + 2) % 3] = y * b;
+            rgb[l] = b;
+            rgb[(l + 1) % 3] = x * b;
+            rgb[(l + 2) % 3] = y * b;
 
-                    gauss_newton(rgb, coeffs);
+            gauss_newton(rgb, coeffs);
 
-                    double c0 = 360.0, c1 = 1.0 / (830.0 - 360.0);
-                    double A = coeffs[0], B = coeffs[1], C = coeffs[2];
+            double c0 = 360.0, c1 = 1.0 / (830.0 - 360.0);
+            double A = coeffs[0], B = coeffs[1], C = coeffs[2];
 
-                    int idx = ((l * res + k) * res + j) * res + i;
+            int idx = ((l * res + k) * res + j) * res + i;
 
-                    out[3 * idx + 0] = float(A * (sqr(c1)));
-                    out[3 * idx + 1] = float(B * c1 - 2 * A * c0 * (sqr(c1)));
-                    out[3 * idx + 2] = float(C - B * c0 * c1 + A * (sqr(c0 * c1)));
-                    // out[3*idx + 2] = resid;
-                }
+            out[3 * idx + 0] = float(A * (sqr(c1)));
+            out[3 * idx + 1] = float(B * c1 - 2 * A * c0 * (sqr(c1)));
+            out[3 * idx + 2] = float(C - B * c0 * c1 + A * (sqr(c0 * c1)));
+            // out[3*idx + 2] = resid;
+        }
 
-                memset(coeffs, 0, sizeof(double) * 3);
-                for (int k = start; k >= 0; --k) {
-                    double b = (double)scale[k];
+        memset(coeffs, 0, sizeof(double) * 3);
+        for (int k = start; k >= 0; --k) {
+            double b = (double)scale[k];
 
-                    rgb[l] = b;
-                    rgb[(l + 1) % 3] = x * b;
-                    rgb[(l + 2) % 3] = y * b;
+            rgb[l] = b;
+            rgb[(l + 1) % 3] = x * b;
+            rgb[(l + 2) % 3] = y * b;
 
-                    gauss_newton(rgb, coeffs);
+            gauss_newton(rgb, coeffs);
 
-                    double c0 = 360.0, c1 = 1.0 / (830.0 - 360.0);
-                    double A = coeffs[0], B = coeffs[1], C = coeffs[2];
+            double c0 = 360.0, c1 = 1.0 / (830.0 - 360.0);
+            double A = coeffs[0], B = coeffs[1], C = coeffs[2];
 
-                    int idx = ((l * res + k) * res + j) * res + i;
+            int idx = ((l * res + k) * res + j) * res + i;
 
-                    out[3 * idx + 0] = float(A * (sqr(c1)));
-                    out[3 * idx + 1] = float(B * c1 - 2 * A * c0 * (sqr(c1)));
-                    out[3 * idx + 2] = float(C - B * c0 * c1 + A * (sqr(c0 * c1)));
-                    // out[3*idx + 2] = resid;
-                }
-            }
-        });
-    }
+            out[3 * idx + 0] = float(A * (sqr(c1)));
+            out[3 * idx + 1] = float(B * c1 - 2 * A * c0 * (sqr(c1)));
+            out[3 * idx + 2] = float(C - B * c0 * c1 + A * (sqr(c0 * c1)));
+            // out[3*idx + 2] = resid;
+        }
+    });
 
     FILE *f = fopen(argv[2], "w");
     if (f == nullptr)
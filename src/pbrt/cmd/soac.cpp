@@ -3,6 +3,17 @@
 // SPDX: Apache-2.0
 
 /*
+Layout options:
+- "packed" before a member's type stores the member as an array of its type
+  rather than as an SOA of its own, so each element's components are
+  adjacent: "packed Point3f p;"
+- "half" before a Float member's type stores it at half precision; it is
+  converted to and from Float when elements are read and written.
+- "aosoa(N)" after an SOA's type name stores all of its members in one
+  allocation as blocks of N elements, each holding the N values of each
+  member in turn: "soa Foo aosoa(32) { ... };". All of the members of such
+  a type must be flat, pointers, or packed.
+
 TODO:
 - how to do float4, fancy packing tricks?
   flat int:32;
@@ -18,6 +29,7 @@ TODO:
 #include <assert.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <fstream>
 #include <functional>
@@ -73,6 +85,10 @@ struct Member {
     std::string type;
     bool isConst = false;
     int numPointers = 0;
+    // "packed" members are stored as arrays of their type rather than as
+    // SOAs of their own, and "half" Float members are stored at half
+    // precision.
+    bool isPacked = false, isHalf = false;
 
     std::string GetType() const {
         std::string s;
@@ -92,6 +108,9 @@ struct SOA {
     std::string type;
     std::string templateType;
     std::vector<Member> members;
+    // If non-empty, members are stored in one allocation as blocks of this
+    // many elements (AoSoA), each block holding each member's values in turn.
+    std::string aosoaBlockSize;
 };
 
 int main(int argc, char *argv[]) {
@@ -167,6 +186,17 @@ int main(int argc, char *argv[]) {
             } else
                 ungetc();
         }
+        if (isdigit(s[0])) {
+            while (!eof()) {
+                char c = getc();
+                if (!isdigit(c)) {
+                    ungetc();
+                    break;
+                }
+                s += c;
+            }
+            return OptionalString(s);
+        }
         if (!isalpha(s[0]) && s[0] != '_')
             return OptionalString(s);
 
@@ -238,11 +268,21 @@ int main(int argc, char *argv[]) {
                 if (!isalpha(soa.templateType[0]))
                     error("%s: invalid type identifier.\n", soa.templateType.c_str());
                 expect(">");
-                expect("{");
+                tok = getToken(false);
             } else if (tok == ";") {
                 externSOA.insert(soa.type);
                 continue;
-            } else if (tok != "{")
+            }
+            if (tok == "aosoa") {
+                expect("(");
+                soa.aosoaBlockSize = (std::string)getToken(false);
+                if (!isdigit(soa.aosoaBlockSize[0]) ||
+                    atoi(soa.aosoaBlockSize.c_str()) == 0)
+                    error("%s: invalid AoSoA block size.\n", soa.aosoaBlockSize.c_str());
+                expect(")");
+                tok = getToken(false);
+            }
+            if (tok != "{")
                 error("Syntax error: expected \"{\".\n");
 
             while (true) {
@@ -251,6 +291,13 @@ int main(int argc, char *argv[]) {
                     break;
 
                 Member member;
+                while (tok == "packed" || tok == "half") {
+                    if (tok == "packed")
+                        member.isPacked = true;
+                    else
+                        member.isHalf = true;
+                    tok = getToken(false);
+                }
                 member.type = (std::string)tok;
                 // Hacks to parse things like const Foo *
                 if (member.type == "const") {
@@ -272,6 +319,14 @@ int main(int argc, char *argv[]) {
                     flatTypes.find(member.type) == flatTypes.end() &&
                     !soaTypeExists(member.type))
                     error("%s: undefined type\n", member.type.c_str());
+                if (member.isHalf && (member.type != "Float" || member.numPointers > 0))
+                    error("%s: only Float members can be stored at half precision.\n",
+                          member.type.c_str());
+                if (!soa.aosoaBlockSize.empty() && !isFlatType(member.type) &&
+                    member.numPointers == 0 && !member.isPacked)
+                    error("%s: members of AoSoA types must be flat, pointers, or "
+                          "packed.\n",
+                          member.type.c_str());
 
                 while (true) {
                     std::string memberName = tok;
@@ -305,6 +360,24 @@ int main(int argc, char *argv[]) {
             error("%s: invalid token", tok.c_str());
     }
 
+    // Members that are stored directly in arrays rather than in SOAs of
+    // their own
+    auto isScalar = [&](const Member &member) {
+        return isFlatType(member.type) || member.numPointers > 0 || member.isPacked ||
+               member.isHalf;
+    };
+    auto storageType = [&](const Member &member) {
+        return member.isHalf ? std::string("Half") : member.GetType();
+    };
+    // Returns the expressions to read a member's value from its storage and
+    // to convert a value to store
+    auto load = [&](const Member &member, std::string expr) {
+        return member.isHalf ? "Float(" + expr + ")" : expr;
+    };
+    auto store = [&](const Member &member, std::string expr) {
+        return member.isHalf ? "Half(" + expr + ")" : expr;
+    };
+
     // And now emit them...
     printf("// SOA definitions automatically generated by soac\n");
     printf("// DO NOT EDIT THIS FILE MANUALLY\n\n");
@@ -316,31 +389,72 @@ int main(int argc, char *argv[]) {
         else
             printf("template <> struct SOA<%s> {\n", soa.type.c_str());
 
+        bool aosoa = !soa.aosoaBlockSize.empty();
+        auto aosoaArrayType = [&](const Member &member) {
+            return "AoSoAArray<" + storageType(member) + ", " + soa.aosoaBlockSize + ">";
+        };
+
         // Constructor
         printf("    SOA() = default;\n");
         printf("    SOA(int n, Allocator alloc) : nAlloc(n) {\n");
-        for (const auto &member : soa.members) {
-            for (int i = 0; i < member.names.size(); ++i) {
-                std::string name = member.names[i];
-                if (!member.arraySizes[i].empty()) {
-                    printf("        for (int i = 0; i < %s; ++i)\n",
-                           member.arraySizes[i].c_str());
-                    if (isFlatType(member.type) || member.numPointers > 0)
-                        printf(
-                            "            this->%s[i] = alloc.allocate_object<%s>(n);\n",
-                            name.c_str(), member.GetType().c_str());
-                    else {
-                        assert(member.isConst == false && member.numPointers == 0);
-                        printf("        this->%s[i] = SOA<%s>(n, alloc);\n", name.c_str(),
-                               member.type.c_str());
+        if (aosoa) {
+            // Lay out the members' values in a block and then allocate the blocks
+            printf("        AoSoALayout layout(%s);\n", soa.aosoaBlockSize.c_str());
+            for (const auto &member : soa.members)
+                for (int i = 0; i < member.names.size(); ++i) {
+                    std::string name = member.names[i];
+                    if (!member.arraySizes[i].empty()) {
+                        printf("        int %sOffset[%s];\n", name.c_str(),
+                               member.arraySizes[i].c_str());
+                        printf("        for (int i = 0; i < %s; ++i)\n",
+                               member.arraySizes[i].c_str());
+                        printf("            %sOffset[i] = layout.Add<%s>();\n",
+                               name.c_str(), storageType(member).c_str());
+                    } else
+                        printf("        int %sOffset = layout.Add<%s>();\n", name.c_str(),
+                               storageType(member).c_str());
+                }
+            printf("        char *blocks = layout.Allocate(n, alloc);\n");
+            for (const auto &member : soa.members)
+                for (int i = 0; i < member.names.size(); ++i) {
+                    std::string name = member.names[i];
+                    if (!member.arraySizes[i].empty()) {
+                        printf("        for (int i = 0; i < %s; ++i)\n",
+                               member.arraySizes[i].c_str());
+                        printf("            this->%s[i] = %s(blocks, %sOffset[i], "
+                               "layout.BlockBytes());\n",
+                               name.c_str(), aosoaArrayType(member).c_str(),
+                               name.c_str());
+                    } else
+                        printf("        this->%s = %s(blocks, %sOffset, "
+                               "layout.BlockBytes());\n",
+                               name.c_str(), aosoaArrayType(member).c_str(),
+                               name.c_str());
+                }
+        } else {
+            for (const auto &member : soa.members) {
+                for (int i = 0; i < member.names.size(); ++i) {
+                    std::string name = member.names[i];
+                    if (!member.arraySizes[i].empty()) {
+                        printf("        for (int i = 0; i < %s; ++i)\n",
+                               member.arraySizes[i].c_str());
+                        if (isScalar(member))
+                            printf("            this->%s[i] = "
+                                   "alloc.allocate_object<%s>(n);\n",
+                                   name.c_str(), storageType(member).c_str());
+                        else {
+                            assert(member.isConst == false && member.numPointers == 0);
+                            printf("        this->%s[i] = SOA<%s>(n, alloc);\n",
+                                   name.c_str(), member.type.c_str());
+                        }
+                    } else {
+                        if (isScalar(member))
+                            printf("        this->%s = alloc.allocate_object<%s>(n);\n",
+                                   name.c_str(), storageType(member).c_str());
+                        else
+                            printf("        this->%s = SOA<%s>(n, alloc);\n",
+                                   name.c_str(), member.type.c_str());
                     }
-                } else {
-                    if (isFlatType(member.type) || member.numPointers > 0)
-                        printf("        this->%s = alloc.allocate_object<%s>(n);\n",
-                               name.c_str(), member.GetType().c_str());
-                    else
-                        printf("        this->%s = SOA<%s>(n, alloc);\n", name.c_str(),
-                               member.type.c_str());
                 }
             }
         }
@@ -381,11 +495,11 @@ int main(int argc, char *argv[]) {
                 if (!member.arraySizes[i].empty()) {
                     printf("            for (int c = 0; c < %s; ++c)\n",
                            member.arraySizes[i].c_str());
-                    printf("                r.%s[c] = soa->%s[c][i];\n", name.c_str(),
-                           name.c_str());
+                    printf("                r.%s[c] = %s;\n", name.c_str(),
+                           load(member, "soa->" + name + "[c][i]").c_str());
                 } else
-                    printf("            r.%s = soa->%s[i];\n", name.c_str(),
-                           name.c_str());
+                    printf("            r.%s = %s;\n", name.c_str(),
+                           load(member, "soa->" + name + "[i]").c_str());
             }
         printf("            return r;\n");
         printf("        }\n");
@@ -402,11 +516,11 @@ int main(int argc, char *argv[]) {
                 if (!member.arraySizes[i].empty()) {
                     printf("            for (int c = 0; c < %s; ++c)\n",
                            member.arraySizes[i].c_str());
-                    printf("                soa->%s[c][i] = a.%s[c];\n", name.c_str(),
-                           name.c_str());
+                    printf("                soa->%s[c][i] = %s;\n", name.c_str(),
+                           store(member, "a." + name + "[c]").c_str());
                 } else
-                    printf("            soa->%s[i] = a.%s;\n", name.c_str(),
-                           name.c_str());
+                    printf("            soa->%s[i] = %s;\n", name.c_str(),
+                           store(member, "a." + name).c_str());
             }
         printf("        }\n\n");
         printf("        SOA *soa;\n");
@@ -435,10 +549,11 @@ int main(int argc, char *argv[]) {
                 if (!member.arraySizes[i].empty()) {
                     printf("        for (int c = 0; c < %s; ++c)\n",
                            member.arraySizes[i].c_str());
-                    printf("            r.%s[c] = this->%s[c][i];\n", name.c_str(),
-                           name.c_str());
+                    printf("            r.%s[c] = %s;\n", name.c_str(),
+                           load(member, "this->" + name + "[c][i]").c_str());
                 } else
-                    printf("        r.%s = this->%s[i];\n", name.c_str(), name.c_str());
+                    printf("        r.%s = %s;\n", name.c_str(),
+                           load(member, "this->" + name + "[i]").c_str());
             }
         printf("        return r;\n");
         printf("    }\n");
@@ -449,18 +564,25 @@ int main(int argc, char *argv[]) {
         for (const auto &member : soa.members) {
             for (int i = 0; i < member.names.size(); ++i) {
                 std::string name = member.names[i];
-                if (!member.arraySizes[i].empty()) {
-                    if (isFlatType(member.type) || member.numPointers > 0)
+                if (aosoa) {
+                    if (!member.arraySizes[i].empty())
+                        printf("    %s %s[%s];\n", aosoaArrayType(member).c_str(),
+                               name.c_str(), member.arraySizes[i].c_str());
+                    else
+                        printf("    %s %s;\n", aosoaArrayType(member).c_str(),
+                               name.c_str());
+                } else if (!member.arraySizes[i].empty()) {
+                    if (isScalar(member))
                         printf("    %s * /*PBRT_RESTRICT*/ %s[%s];\n",
-                               member.GetType().c_str(), name.c_str(),
+                               storageType(member).c_str(), name.c_str(),
                                member.arraySizes[i].c_str());
                     else
                         printf("    SOA<%s> %s[%s];\n", member.type.c_str(), name.c_str(),
                                member.arraySizes[i].c_str());
                 } else {
-                    if (isFlatType(member.type) || member.numPointers > 0)
-                        printf("    %s * PBRT_RESTRICT %s;\n", member.GetType().c_str(),
-                               name.c_str());
+                    if (isScalar(member))
+                        printf("    %s * PBRT_RESTRICT %s;\n",
+                               storageType(member).c_str(), name.c_str());
                     else
                         printf("    SOA<%s> %s;\n", member.type.c_str(), name.c_str());
                 }
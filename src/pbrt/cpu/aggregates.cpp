@@ -5,18 +5,27 @@
 #include <pbrt/cpu/aggregates.h>
 
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/shapes.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
 #include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace pbrt {
 
@@ -25,6 +34,42 @@ STAT_RATIO("BVH/Primitives per leaf node", totalPrimitives, totalLeafNodes);
 STAT_COUNTER("BVH/Interior nodes", interiorNodes);
 STAT_COUNTER("BVH/Leaf nodes", leafNodes);
 STAT_PIXEL_COUNTER("BVH/Nodes visited", bvhNodesVisited);
+STAT_PIXEL_COUNTER("BVH/Primitives tested", bvhPrimitivesTested);
+STAT_COUNTER("BVH/Build time: primitive bounds (ms)", bvhBoundsTimeMS);
+STAT_COUNTER("BVH/Build time: tree construction (ms)", bvhBuildTimeMS);
+STAT_COUNTER("BVH/Build time: flattening (ms)", bvhFlattenTimeMS);
+STAT_COUNTER("BVH/SBVH spatial splits", sbvhSpatialSplits);
+STAT_COUNTER("BVH/SBVH duplicated references", sbvhDuplicatedReferences);
+STAT_COUNTER("BVH/Cache hits", bvhCacheHits);
+STAT_COUNTER("BVH/Cache misses", bvhCacheMisses);
+STAT_COUNTER("BVH/Refits", bvhRefits);
+STAT_COUNTER("BVH/Triangle blocks", bvhTriangleBlocks);
+STAT_COUNTER("BVH/Bilinear patch blocks", bvhPatchBlocks);
+STAT_COUNTER("BVH/Refit time (ms)", bvhRefitTimeMS);
+STAT_INT_DISTRIBUTION("BVH/Rays per packet", bvhRaysPerPacket);
+STAT_PERCENT("BVH/Shadow rays occluded by cached occluder", bvhOccluderCacheHits,
+             bvhOccluderCacheTests);
+
+// Primitive counts above which BVH construction uses multiple threads
+static constexpr size_t bvhParallelBinningThreshold = 64 * 1024;
+static constexpr size_t bvhParallelSubtreeThreshold = 4 * 1024;
+// Tree depth up to which BVH refitting processes subtrees in parallel
+static constexpr int bvhRefitParallelDepth = 6;
+
+// Node arrays are allocated from the default memory resource so that they
+// are backed by huge pages when it is a _HugePageMemoryResource_.
+template <typename Node>
+static Node *AllocateNodes(size_t n) {
+    Node *nodes = Allocator().allocate_object<Node>(n);
+    std::uninitialized_default_construct_n(nodes, n);
+    return nodes;
+}
+
+template <typename Node>
+static void FreeNodes(Node *nodes, size_t n) {
+    if (nodes)
+        Allocator().deallocate_object(nodes, n);
+}
 
 // MortonPrimitive Definition
 struct MortonPrimitive {
@@ -98,6 +143,68 @@ struct BVHPrimitive {
     Point3f Centroid() const { return .5f * bounds.pMin + .5f * bounds.pMax; }
 };
 
+// Computes the bounds of _bvhPrimitives_ and of their centroids, processing
+// large primitive ranges in parallel.
+static void ComputeBVHBounds(pstd::span<const BVHPrimitive> bvhPrimitives,
+                             Bounds3f *bounds, Bounds3f *centroidBounds) {
+    if (bvhPrimitives.size() < bvhParallelBinningThreshold) {
+        for (const auto &prim : bvhPrimitives) {
+            *bounds = Union(*bounds, prim.bounds);
+            *centroidBounds = Union(*centroidBounds, prim.Centroid());
+        }
+        return;
+    }
+
+    std::mutex mutex;
+    ParallelFor(0, bvhPrimitives.size(), [&](int64_t start, int64_t end) {
+        Bounds3f b, cb;
+        for (int64_t i = start; i < end; ++i) {
+            b = Union(b, bvhPrimitives[i].bounds);
+            cb = Union(cb, bvhPrimitives[i].Centroid());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        *bounds = Union(*bounds, b);
+        *centroidBounds = Union(*centroidBounds, cb);
+    });
+}
+
+// Accumulates _bvhPrimitives_ into SAH _buckets_ along _dim_ according to
+// their centroids, processing large primitive ranges in parallel.
+template <int nBuckets>
+static void BinBVHPrimitives(pstd::span<const BVHPrimitive> bvhPrimitives,
+                             const Bounds3f &centroidBounds, int dim,
+                             BVHSplitBucket buckets[nBuckets]) {
+    auto binRange = [&](size_t start, size_t end, BVHSplitBucket b[nBuckets]) {
+        for (size_t i = start; i < end; ++i) {
+            const BVHPrimitive &prim = bvhPrimitives[i];
+            int bucket = nBuckets * centroidBounds.Offset(prim.Centroid())[dim];
+            if (bucket == nBuckets)
+                bucket = nBuckets - 1;
+            DCHECK_GE(bucket, 0);
+            DCHECK_LT(bucket, nBuckets);
+            b[bucket].count++;
+            b[bucket].bounds = Union(b[bucket].bounds, prim.bounds);
+        }
+    };
+
+    if (bvhPrimitives.size() < bvhParallelBinningThreshold) {
+        binRange(0, bvhPrimitives.size(), buckets);
+        return;
+    }
+
+    // Bin chunks of primitives in parallel and merge the per-chunk buckets
+    std::mutex mutex;
+    ParallelFor(0, bvhPrimitives.size(), [&](int64_t start, int64_t end) {
+        BVHSplitBucket chunkBuckets[nBuckets];
+        binRange(start, end, chunkBuckets);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < nBuckets; ++i) {
+            buckets[i].count += chunkBuckets[i].count;
+            buckets[i].bounds = Union(buckets[i].bounds, chunkBuckets[i].bounds);
+        }
+    });
+}
+
 // BVHBuildNode Definition
 struct BVHBuildNode {
     // BVHBuildNode Public Methods
@@ -132,22 +239,116 @@ struct alignas(32) LinearBVHNode {
         int primitivesOffset;   // leaf
         int secondChildOffset;  // interior
     };
-    uint16_t nPrimitives;  // 0 -> interior node
-    uint8_t axis;          // interior node: xyz
+    uint16_t nPrimitives;       // 0 -> interior node
+    uint8_t axis;               // interior node: xyz
+    uint8_t shadowSecondFirst;  // interior node: second child has larger area
 };
 
+// Returns the vertices of _prim_ if it is a triangle, which allows SBVH
+// spatial splits to clip primitives more tightly than their bounds.
+static pstd::optional<pstd::array<Point3f, 3>> GetTriangleVertices(Primitive prim) {
+    Shape shape = nullptr;
+    if (const GeometricPrimitive *gp = prim.CastOrNullptr<GeometricPrimitive>())
+        shape = gp->GetShape();
+    else if (const SimplePrimitive *sp = prim.CastOrNullptr<SimplePrimitive>())
+        shape = sp->GetShape();
+    else if (const MeshTrianglePrimitive *mtp =
+                 prim.CastOrNullptr<MeshTrianglePrimitive>())
+        return mtp->GetTriangle()->Vertices();
+    if (const Triangle *tri = shape.CastOrNullptr<Triangle>())
+        return tri->Vertices();
+    return {};
+}
+
+// Returns the bounds of the part of _prim_ with bounds _primBounds_ that lies
+// inside the slab $[lo, hi]$ along _axis_.
+static Bounds3f ClipPrimitiveBounds(Primitive prim, const Bounds3f &primBounds, int axis,
+                                    Float lo, Float hi) {
+    Bounds3f clip = primBounds;
+    clip.pMin[axis] = std::max(clip.pMin[axis], lo);
+    clip.pMax[axis] = std::min(clip.pMax[axis], hi);
+    pstd::optional<pstd::array<Point3f, 3>> p = GetTriangleVertices(prim);
+    if (!p || clip.IsDegenerate())
+        return clip;
+
+    // Compute bounds of the triangle's vertices and edge crossings inside the slab
+    Bounds3f b;
+    for (int i = 0; i < 3; ++i) {
+        Point3f p0 = (*p)[i], p1 = (*p)[(i + 1) % 3];
+        if (p0[axis] >= lo && p0[axis] <= hi)
+            b = Union(b, p0);
+        for (Float plane : {lo, hi})
+            if ((p0[axis] < plane && p1[axis] > plane) ||
+                (p0[axis] > plane && p1[axis] < plane)) {
+                Float t = (plane - p0[axis]) / (p1[axis] - p0[axis]);
+                Point3f pc = p0 + t * (p1 - p0);
+                pc[axis] = plane;
+                b = Union(b, pc);
+            }
+    }
+    if (b.IsDegenerate())
+        return b;
+
+    // Conservatively pad clipped bounds for error in computed edge crossings
+    for (int c = 0; c < 3; ++c)
+        if (c != axis) {
+            Float err = gamma(3) * std::max(std::abs(b.pMin[c]), std::abs(b.pMax[c]));
+            b.pMin[c] -= err;
+            b.pMax[c] += err;
+        }
+    return Intersect(b, clip);
+}
+
 // BVHAggregate Method Definitions
 BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
-                           SplitMethod splitMethod)
+                           SplitMethod splitMethod, Float spatialSplitBudget,
+                           bool anyHitShadowRays, bool triangleBlocks,
+                           bool patchBlocks, pstd::span<const Bounds3f> primitiveBounds)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)),
       primitives(std::move(prims)),
-      splitMethod(splitMethod) {
+      splitMethod(splitMethod),
+      spatialSplitBudget(spatialSplitBudget),
+      anyHitShadowRays(anyHitShadowRays),
+      triangleBlocks(triangleBlocks),
+      patchBlocks(patchBlocks) {
     CHECK(!primitives.empty());
+    CHECK(primitiveBounds.empty() || primitiveBounds.size() == primitives.size());
+    ScopedMemoryCategory memoryCategory(MemoryCategory::BVH);
     // Build BVH from _primitives_
     // Initialize _bvhPrimitives_ array for primitives
+    Timer timer;
     std::vector<BVHPrimitive> bvhPrimitives(primitives.size());
-    for (size_t i = 0; i < primitives.size(); ++i)
-        bvhPrimitives[i] = BVHPrimitive(i, primitives[i].Bounds());
+    ParallelFor(0, primitives.size(), [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i)
+            bvhPrimitives[i] = BVHPrimitive(
+                i, primitiveBounds.empty() ? primitives[i].Bounds() : primitiveBounds[i]);
+    });
+    bvhBoundsTimeMS += int64_t(1000 * timer.ElapsedSeconds());
+
+    // Look for a cached BVH built from primitives with the same bounds
+    std::string cacheFilename;
+    uint64_t cacheKey = 0;
+    if (!Options->bvhCacheDirectory.empty()) {
+        // Compute cache key from primitive bounds and build parameters
+        uint64_t paramsHash = Hash(this->maxPrimsInNode, splitMethod, spatialSplitBudget);
+        cacheKey = HashBuffer(bvhPrimitives.data(),
+                              bvhPrimitives.size() * sizeof(BVHPrimitive), paramsHash);
+        if (splitMethod == SplitMethod::SBVH)
+            // Spatial splits also depend on triangle vertex positions
+            for (Primitive prim : primitives)
+                if (pstd::optional<pstd::array<Point3f, 3>> p = GetTriangleVertices(prim))
+                    cacheKey = HashBuffer(p->data(), sizeof(*p), cacheKey);
+
+        cacheFilename = StringPrintf("%s/bvh-%016x.bin", Options->bvhCacheDirectory,
+                                     cacheKey);
+        if (readCache(cacheFilename, cacheKey)) {
+            ++bvhCacheHits;
+            if (triangleBlocks || patchBlocks)
+                buildPrimitiveBlocks();
+            return;
+        }
+        ++bvhCacheMisses;
+    }
 
     // Build BVH for primitives using _bvhPrimitives_
     // Declare _Allocator_s used for BVH construction
@@ -164,9 +365,25 @@ BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
     std::vector<Primitive> orderedPrims(primitives.size());
     BVHBuildNode *root;
     // Build BVH according to selected _splitMethod_
+    timer = Timer();
     std::atomic<int> totalNodes{0};
     if (splitMethod == SplitMethod::HLBVH) {
         root = buildHLBVH(alloc, bvhPrimitives, &totalNodes, orderedPrims);
+    } else if (splitMethod == SplitMethod::SBVH) {
+        // Allow spatial splits to add up to _spatialSplitBudget_ more references
+        int64_t maxReferences =
+            primitives.size() * (1 + std::max<Float>(0, spatialSplitBudget));
+        std::atomic<int64_t> referenceBudget{maxReferences - int64_t(primitives.size())};
+        orderedPrims.resize(maxReferences);
+        Bounds3f bounds, centroidBounds;
+        ComputeBVHBounds(bvhPrimitives, &bounds, &centroidBounds);
+
+        std::atomic<int> orderedPrimsOffset{0};
+        root = buildSBVH(threadAllocators, std::move(bvhPrimitives), bounds.SurfaceArea(),
+                         &totalNodes, &orderedPrimsOffset, orderedPrims,
+                         &referenceBudget);
+        orderedPrims.resize(orderedPrimsOffset);
+        orderedPrims.shrink_to_fit();
     } else {
         std::atomic<int> orderedPrimsOffset{0};
         root = buildRecursive(threadAllocators, pstd::span<BVHPrimitive>(bvhPrimitives),
@@ -174,6 +391,7 @@ BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
         CHECK_EQ(orderedPrimsOffset.load(), orderedPrims.size());
     }
     primitives.swap(orderedPrims);
+    bvhBuildTimeMS += int64_t(1000 * timer.ElapsedSeconds());
 
     // Convert BVH into compact representation in _nodes_ array
     bvhPrimitives.resize(0);
@@ -183,10 +401,184 @@ BVHAggregate::BVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
                 float(totalNodes.load() * sizeof(LinearBVHNode)) / (1024.f * 1024.f));
     treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
                  primitives.size() * sizeof(primitives[0]);
-    nodes = new LinearBVHNode[totalNodes];
+    timer = Timer();
+    nodes = AllocateNodes<LinearBVHNode>(totalNodes);
+    NumaInterleave(nodes, totalNodes * sizeof(LinearBVHNode));
     int offset = 0;
     flattenBVH(root, &offset);
     CHECK_EQ(totalNodes.load(), offset);
+    bvhFlattenTimeMS += int64_t(1000 * timer.ElapsedSeconds());
+
+    nNodes = totalNodes;
+    builtSAHCost = SAHCost();
+
+    if (!cacheFilename.empty())
+        writeCache(cacheFilename, cacheKey, totalNodes, orderedPrims);
+    if (triangleBlocks || patchBlocks)
+        buildPrimitiveBlocks();
+}
+
+BVHAggregate::~BVHAggregate() {
+    FreeNodes(nodes, nNodes);
+}
+
+size_t BVHAggregate::MemoryBytes() const {
+    return nNodes * sizeof(LinearBVHNode) + primitives.capacity() * sizeof(Primitive);
+}
+
+// Appends _prims_ to _blockedPrims_ grouped into _Block_s of up to _Block::Width_
+// primitives and returns the number of blocks created.
+template <typename Block>
+static int AddPrimitiveBlocks(const std::vector<Primitive> &prims,
+                              std::vector<Primitive> *blockedPrims) {
+    int nBlocks = 0;
+    for (size_t i = 0; i < prims.size(); i += Block::Width) {
+        size_t n = std::min<size_t>(Block::Width, prims.size() - i);
+        if (n == 1)
+            blockedPrims->push_back(prims[i]);
+        else {
+            blockedPrims->push_back(new Block(pstd::span<const Primitive>(&prims[i], n)));
+            ++nBlocks;
+        }
+    }
+    return nBlocks;
+}
+
+void BVHAggregate::buildPrimitiveBlocks() {
+    // Replace the triangles and bilinear patches in each leaf node with blocks
+    std::vector<Primitive> blockedPrims;
+    blockedPrims.reserve(primitives.size());
+    std::vector<Primitive> triangles, patches;
+    for (int i = 0; i < nNodes; ++i) {
+        LinearBVHNode &node = nodes[i];
+        if (node.nPrimitives == 0)
+            continue;
+        int offset = blockedPrims.size();
+        triangles.clear();
+        patches.clear();
+        for (int j = 0; j < node.nPrimitives; ++j) {
+            Primitive prim = primitives[node.primitivesOffset + j];
+            if (triangleBlocks && TriangleBlockPrimitive::IsTriangle(prim))
+                triangles.push_back(prim);
+            else if (patchBlocks && BilinearPatchBlockPrimitive::IsBilinearPatch(prim))
+                patches.push_back(prim);
+            else
+                blockedPrims.push_back(prim);
+        }
+        bvhTriangleBlocks +=
+            AddPrimitiveBlocks<TriangleBlockPrimitive>(triangles, &blockedPrims);
+        bvhPatchBlocks +=
+            AddPrimitiveBlocks<BilinearPatchBlockPrimitive>(patches, &blockedPrims);
+        node.primitivesOffset = offset;
+        node.nPrimitives = blockedPrims.size() - offset;
+    }
+
+    treeBytes -= primitives.size() * sizeof(primitives[0]);
+    primitives = std::move(blockedPrims);
+    primitives.shrink_to_fit();
+    treeBytes += primitives.size() * sizeof(primitives[0]);
+    builtSAHCost = SAHCost();
+}
+
+// BVHCacheHeader Definition
+struct BVHCacheHeader {
+    char magic[8] = {'p', 'b', 'r', 't', 'b', 'v', 'h', '2'};
+    uint64_t key;
+    int64_t nodeSize = sizeof(LinearBVHNode);
+    int64_t nNodes, nPrimitives, nOrderedPrimitives;
+};
+
+bool BVHAggregate::readCache(const std::string &filename, uint64_t key) {
+    if (!FileExists(filename))
+        return false;
+    std::string contents = ReadFileContents(filename);
+    // Validate cached BVH header against current primitives
+    BVHCacheHeader header, expected;
+    if (contents.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, contents.data(), sizeof(header));
+    size_t nodesBytes = header.nNodes * sizeof(LinearBVHNode);
+    size_t indicesBytes = header.nOrderedPrimitives * sizeof(int32_t);
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.key != key || header.nodeSize != expected.nodeSize ||
+        header.nPrimitives != int64_t(primitives.size()) || header.nNodes <= 0 ||
+        header.nOrderedPrimitives <= 0 ||
+        contents.size() != sizeof(header) + nodesBytes + indicesBytes) {
+        Warning("%s: ignoring invalid or stale BVH cache file.", filename);
+        return false;
+    }
+
+    // Reorder _primitives_ using cached primitive indices
+    const char *indicesStart = contents.data() + sizeof(header) + nodesBytes;
+    std::vector<Primitive> orderedPrims(header.nOrderedPrimitives);
+    for (size_t i = 0; i < orderedPrims.size(); ++i) {
+        int32_t index;
+        std::memcpy(&index, indicesStart + i * sizeof(int32_t), sizeof(index));
+        if (index < 0 || index >= int(primitives.size())) {
+            Warning("%s: invalid primitive index in BVH cache file.", filename);
+            return false;
+        }
+        orderedPrims[i] = primitives[index];
+    }
+
+    // Copy cached nodes and check that their offsets are in range
+    LinearBVHNode *cachedNodes = AllocateNodes<LinearBVHNode>(header.nNodes);
+    std::memcpy(cachedNodes, contents.data() + sizeof(header), nodesBytes);
+    for (int64_t i = 0; i < header.nNodes; ++i) {
+        const LinearBVHNode &node = cachedNodes[i];
+        bool valid = node.nPrimitives > 0
+                         ? (node.primitivesOffset >= 0 &&
+                            node.primitivesOffset + node.nPrimitives <=
+                                header.nOrderedPrimitives)
+                         : (node.axis < 3 && node.secondChildOffset > i &&
+                            node.secondChildOffset < header.nNodes);
+        if (!valid) {
+            Warning("%s: invalid node in BVH cache file.", filename);
+            FreeNodes(cachedNodes, header.nNodes);
+            return false;
+        }
+    }
+
+    primitives = std::move(orderedPrims);
+    nodes = cachedNodes;
+    nNodes = header.nNodes;
+    NumaInterleave(nodes, nNodes * sizeof(LinearBVHNode));
+    builtSAHCost = SAHCost();
+    treeBytes += header.nNodes * sizeof(LinearBVHNode) + sizeof(*this) +
+                 primitives.size() * sizeof(primitives[0]);
+    LOG_VERBOSE("Read BVH with %d nodes for %d primitives from %s", header.nNodes,
+                primitives.size(), filename);
+    return true;
+}
+
+void BVHAggregate::writeCache(const std::string &filename, uint64_t key, int nNodes,
+                              const std::vector<Primitive> &unorderedPrims) const {
+    // Find indices of ordered primitives in the original primitive array
+    std::unordered_map<const void *, int32_t> primIndex;
+    for (size_t i = 0; i < unorderedPrims.size(); ++i)
+        primIndex[unorderedPrims[i].ptr()] = i;
+    std::vector<int32_t> indices(primitives.size());
+    for (size_t i = 0; i < primitives.size(); ++i)
+        indices[i] = primIndex[primitives[i].ptr()];
+
+    BVHCacheHeader header;
+    header.key = key;
+    header.nNodes = nNodes;
+    header.nPrimitives = unorderedPrims.size();
+    header.nOrderedPrimitives = primitives.size();
+    std::string contents;
+    contents.append((const char *)&header, sizeof(header));
+    contents.append((const char *)nodes, nNodes * sizeof(LinearBVHNode));
+    contents.append((const char *)indices.data(), indices.size() * sizeof(int32_t));
+
+    // Write to a temporary file so that concurrent renders never see partial caches
+    std::string tempFilename = StringPrintf("%s.%p.tmp", filename, this);
+    if (!WriteFileContents(tempFilename, contents) ||
+        std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write BVH cache file.", filename);
+        RemoveFile(tempFilename);
+    } else
+        LOG_VERBOSE("Wrote BVH cache file %s", filename);
 }
 
 BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocators,
@@ -199,10 +591,9 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
     BVHBuildNode *node = alloc.new_object<BVHBuildNode>();
     // Initialize _BVHBuildNode_ for primitive range
     ++*totalNodes;
-    // Compute bounds of all primitives in BVH node
-    Bounds3f bounds;
-    for (const auto &prim : bvhPrimitives)
-        bounds = Union(bounds, prim.bounds);
+    // Compute bounds of all primitives and their centroids in BVH node
+    Bounds3f bounds, centroidBounds;
+    ComputeBVHBounds(bvhPrimitives, &bounds, &centroidBounds);
 
     if (bounds.SurfaceArea() == 0 || bvhPrimitives.size() == 1) {
         // Create leaf _BVHBuildNode_
@@ -215,10 +606,7 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
         return node;
 
     } else {
-        // Compute bound of primitive centroids and choose split dimension _dim_
-        Bounds3f centroidBounds;
-        for (const auto &prim : bvhPrimitives)
-            centroidBounds = Union(centroidBounds, prim.Centroid());
+        // Choose split dimension _dim_ using bounds of primitive centroids
         int dim = centroidBounds.MaxDimension();
 
         // Partition primitives into two sets and build children
@@ -279,15 +667,8 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
                     BVHSplitBucket buckets[nBuckets];
 
                     // Initialize _BVHSplitBucket_ for SAH partition buckets
-                    for (const auto &prim : bvhPrimitives) {
-                        int b = nBuckets * centroidBounds.Offset(prim.Centroid())[dim];
-                        if (b == nBuckets)
-                            b = nBuckets - 1;
-                        DCHECK_GE(b, 0);
-                        DCHECK_LT(b, nBuckets);
-                        buckets[b].count++;
-                        buckets[b].bounds = Union(buckets[b].bounds, prim.bounds);
-                    }
+                    BinBVHPrimitives<nBuckets>(bvhPrimitives, centroidBounds, dim,
+                                               buckets);
 
                     // Compute costs for splitting after each bucket
                     constexpr int nSplits = nBuckets - 1;
@@ -356,7 +737,7 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
 
             BVHBuildNode *children[2];
             // Recursively build BVHs for _children_
-            if (bvhPrimitives.size() > 128 * 1024) {
+            if (bvhPrimitives.size() > bvhParallelSubtreeThreshold) {
                 // Recursively build child BVHs in parallel
                 ParallelFor(0, 2, [&](int i) {
                     if (i == 0)
@@ -386,6 +767,210 @@ BVHBuildNode *BVHAggregate::buildRecursive(ThreadLocal<Allocator> &threadAllocat
     return node;
 }
 
+BVHBuildNode *BVHAggregate::buildSBVH(ThreadLocal<Allocator> &threadAllocators,
+                                      std::vector<BVHPrimitive> bvhPrimitives,
+                                      Float rootArea, std::atomic<int> *totalNodes,
+                                      std::atomic<int> *orderedPrimsOffset,
+                                      std::vector<Primitive> &orderedPrims,
+                                      std::atomic<int64_t> *referenceBudget) {
+    DCHECK_NE(bvhPrimitives.size(), 0);
+    Allocator alloc = threadAllocators.Get();
+    BVHBuildNode *node = alloc.new_object<BVHBuildNode>();
+    ++*totalNodes;
+    // Compute bounds of all primitive references and their centroids in SBVH node
+    Bounds3f bounds, centroidBounds;
+    ComputeBVHBounds(bvhPrimitives, &bounds, &centroidBounds);
+
+    auto createLeaf = [&]() {
+        int firstPrimOffset = orderedPrimsOffset->fetch_add(bvhPrimitives.size());
+        CHECK_LE(firstPrimOffset + bvhPrimitives.size(), orderedPrims.size());
+        for (size_t i = 0; i < bvhPrimitives.size(); ++i)
+            orderedPrims[firstPrimOffset + i] =
+                primitives[bvhPrimitives[i].primitiveIndex];
+        node->InitLeaf(firstPrimOffset, bvhPrimitives.size(), bounds);
+        return node;
+    };
+    int dim = centroidBounds.MaxDimension();
+    if (bounds.SurfaceArea() == 0 || bvhPrimitives.size() == 1 ||
+        centroidBounds.pMax[dim] == centroidBounds.pMin[dim])
+        return createLeaf();
+
+    // Find best object split using SAH buckets along _dim_
+    constexpr int nBuckets = 12;
+    BVHSplitBucket buckets[nBuckets];
+    BinBVHPrimitives<nBuckets>(bvhPrimitives, centroidBounds, dim, buckets);
+    int objectSplitBucket = -1;
+    Float objectCost = Infinity;
+    Bounds3f objectOverlap;
+    for (int i = 0; i < nBuckets - 1; ++i) {
+        Bounds3f b0, b1;
+        int count0 = 0, count1 = 0;
+        for (int j = 0; j <= i; ++j) {
+            b0 = Union(b0, buckets[j].bounds);
+            count0 += buckets[j].count;
+        }
+        for (int j = i + 1; j < nBuckets; ++j) {
+            b1 = Union(b1, buckets[j].bounds);
+            count1 += buckets[j].count;
+        }
+        Float cost = count0 * b0.SurfaceArea() + count1 * b1.SurfaceArea();
+        if (cost < objectCost) {
+            objectCost = cost;
+            objectSplitBucket = i;
+            objectOverlap = pbrt::Intersect(b0, b1);
+        }
+    }
+
+    // Find best spatial split if the object split's children overlap significantly
+    constexpr int nSpatialBins = 16;
+    constexpr Float minOverlapFraction = 1e-5f;
+    int spatialDim = bounds.MaxDimension(), spatialSplitBin = -1;
+    Float spatialCost = Infinity;
+    Float binWidth = (bounds.pMax[spatialDim] - bounds.pMin[spatialDim]) / nSpatialBins;
+    auto binPlane = [&](int b) {
+        return b == nSpatialBins ? bounds.pMax[spatialDim]
+                                 : bounds.pMin[spatialDim] + b * binWidth;
+    };
+    auto bin = [&](Float v) {
+        return Clamp(int((v - bounds.pMin[spatialDim]) / binWidth), 0, nSpatialBins - 1);
+    };
+    if (!objectOverlap.IsDegenerate() &&
+        objectOverlap.SurfaceArea() > minOverlapFraction * rootArea &&
+        referenceBudget->load() > 0 && binWidth > 0) {
+        // Clip primitive references into spatial bins
+        struct SpatialBin {
+            int entries = 0, exits = 0;
+            Bounds3f bounds;
+        };
+        SpatialBin bins[nSpatialBins];
+        for (const BVHPrimitive &ref : bvhPrimitives) {
+            int b0 = bin(ref.bounds.pMin[spatialDim]);
+            int b1 = bin(ref.bounds.pMax[spatialDim]);
+            Primitive prim = primitives[ref.primitiveIndex];
+            for (int b = b0; b <= b1; ++b) {
+                Bounds3f clipped = ClipPrimitiveBounds(prim, ref.bounds, spatialDim,
+                                                       binPlane(b), binPlane(b + 1));
+                if (!clipped.IsDegenerate())
+                    bins[b].bounds = Union(bins[b].bounds, clipped);
+            }
+            ++bins[b0].entries;
+            ++bins[b1].exits;
+        }
+
+        // Compute costs for splitting at each bin boundary
+        Bounds3f boundsAbove[nSpatialBins];
+        int countAbove[nSpatialBins];
+        Bounds3f b;
+        int count = 0;
+        for (int i = nSpatialBins - 1; i > 0; --i) {
+            b = Union(b, bins[i].bounds);
+            count += bins[i].exits;
+            boundsAbove[i] = b;
+            countAbove[i] = count;
+        }
+        b = Bounds3f();
+        count = 0;
+        for (int i = 0; i < nSpatialBins - 1; ++i) {
+            b = Union(b, bins[i].bounds);
+            count += bins[i].entries;
+            if (count == 0 || countAbove[i + 1] == 0)
+                continue;
+            Float cost = count * b.SurfaceArea() +
+                         countAbove[i + 1] * boundsAbove[i + 1].SurfaceArea();
+            if (cost < spatialCost) {
+                spatialCost = cost;
+                spatialSplitBin = i;
+            }
+        }
+    }
+
+    // Create leaf if neither split is better than intersecting all primitives
+    Float leafCost = bvhPrimitives.size();
+    Float splitCost =
+        1.f / 2.f + std::min(objectCost, spatialCost) / bounds.SurfaceArea();
+    if (bvhPrimitives.size() <= maxPrimsInNode && leafCost <= splitCost)
+        return createLeaf();
+
+    std::vector<BVHPrimitive> left, right;
+    int splitAxis = dim;
+    if (spatialCost < objectCost) {
+        // Partition primitive references using spatial split
+        Float plane = binPlane(spatialSplitBin + 1);
+        size_t nStraddling = 0;
+        for (const BVHPrimitive &ref : bvhPrimitives)
+            nStraddling += (ref.bounds.pMin[spatialDim] < plane &&
+                            ref.bounds.pMax[spatialDim] > plane);
+        // Split straddling references only if the duplication budget allows
+        bool duplicate =
+            referenceBudget->fetch_sub(nStraddling) >= int64_t(nStraddling);
+        if (!duplicate)
+            *referenceBudget += nStraddling;
+        else {
+            ++sbvhSpatialSplits;
+            splitAxis = spatialDim;
+        }
+
+        for (const BVHPrimitive &ref : bvhPrimitives) {
+            if (ref.bounds.pMax[spatialDim] <= plane)
+                left.push_back(ref);
+            else if (ref.bounds.pMin[spatialDim] >= plane)
+                right.push_back(ref);
+            else if (!duplicate) {
+                if (ref.Centroid()[spatialDim] < plane)
+                    left.push_back(ref);
+                else
+                    right.push_back(ref);
+            } else {
+                Primitive prim = primitives[ref.primitiveIndex];
+                Bounds3f b0 = ClipPrimitiveBounds(prim, ref.bounds, spatialDim,
+                                                  ref.bounds.pMin[spatialDim], plane);
+                Bounds3f b1 = ClipPrimitiveBounds(prim, ref.bounds, spatialDim, plane,
+                                                  ref.bounds.pMax[spatialDim]);
+                if (!b0.IsDegenerate())
+                    left.push_back(BVHPrimitive(ref.primitiveIndex, b0));
+                if (!b1.IsDegenerate())
+                    right.push_back(BVHPrimitive(ref.primitiveIndex, b1));
+                if (!b0.IsDegenerate() && !b1.IsDegenerate())
+                    ++sbvhDuplicatedReferences;
+                else
+                    ++*referenceBudget;
+            }
+        }
+    }
+
+    if (left.empty() || right.empty()) {
+        // Partition primitive references using object split
+        left.clear();
+        right.clear();
+        splitAxis = dim;
+        for (const BVHPrimitive &ref : bvhPrimitives) {
+            int b = nBuckets * centroidBounds.Offset(ref.Centroid())[dim];
+            if (b == nBuckets)
+                b = nBuckets - 1;
+            (b <= objectSplitBucket ? left : right).push_back(ref);
+        }
+        if (left.empty() || right.empty())
+            return createLeaf();
+    }
+    // Free this node's references before building its children
+    bvhPrimitives = std::vector<BVHPrimitive>();
+
+    BVHBuildNode *children[2];
+    auto buildChild = [&](int i) {
+        children[i] = buildSBVH(threadAllocators, std::move(i == 0 ? left : right),
+                                rootArea, totalNodes, orderedPrimsOffset, orderedPrims,
+                                referenceBudget);
+    };
+    if (left.size() + right.size() > bvhParallelSubtreeThreshold)
+        ParallelFor(0, 2, buildChild);
+    else {
+        buildChild(0);
+        buildChild(1);
+    }
+    node->InitInterior(splitAxis, children[0], children[1]);
+    return node;
+}
+
 BVHBuildNode *BVHAggregate::buildHLBVH(Allocator alloc,
                                        const std::vector<BVHPrimitive> &bvhPrimitives,
                                        std::atomic<int> *totalNodes,
@@ -515,6 +1100,8 @@ int BVHAggregate::flattenBVH(BVHBuildNode *node, int *offset) {
         // Create interior flattened BVH node
         linearNode->axis = node->splitAxis;
         linearNode->nPrimitives = 0;
+        linearNode->shadowSecondFirst = node->children[1]->bounds.SurfaceArea() >
+                                        node->children[0]->bounds.SurfaceArea();
         flattenBVH(node->children[0], offset);
         linearNode->secondChildOffset = flattenBVH(node->children[1], offset);
     }
@@ -526,11 +1113,107 @@ Bounds3f BVHAggregate::Bounds() const {
     return nodes[0].bounds;
 }
 
+Float BVHAggregate::SAHCost() const {
+    // Sum node costs weighted by the probability of a ray visiting each node
+    Float rootArea = nodes[0].bounds.SurfaceArea();
+    if (rootArea == 0)
+        return 0;
+    Float cost = 0;
+    for (int i = 0; i < nNodes; ++i) {
+        Float area = nodes[i].bounds.IsEmpty() ? 0 : nodes[i].bounds.SurfaceArea();
+        cost += area / rootArea *
+                (nodes[i].nPrimitives > 0 ? Float(nodes[i].nPrimitives) : 0.5f);
+    }
+    return cost;
+}
+
+bool BVHAggregate::Refit(Float maxCostRatio) {
+    Timer timer;
+    refitRecursive(0, 0);
+    ++bvhRefits;
+    bvhRefitTimeMS += int64_t(1000 * timer.ElapsedSeconds());
+
+    if (maxCostRatio <= 0 || SAHCost() <= maxCostRatio * builtSAHCost)
+        return false;
+    // Rebuild BVH whose quality has degraded too far through refitting
+    LOG_VERBOSE("Rebuilding BVH with SAH cost %f (%f when built)", SAHCost(),
+                builtSAHCost);
+    std::vector<Primitive> prims;
+    prims.reserve(primitives.size());
+    std::unordered_set<const void *> seen;
+    auto addPrimitive = [&](Primitive prim) {
+        // Skip references duplicated by SBVH spatial splits
+        if (seen.insert(prim.ptr()).second)
+            prims.push_back(prim);
+    };
+    for (Primitive prim : primitives) {
+        if (const TriangleBlockPrimitive *block =
+                prim.CastOrNullptr<TriangleBlockPrimitive>())
+            for (Primitive tri : block->Triangles())
+                addPrimitive(tri);
+        else if (const BilinearPatchBlockPrimitive *block =
+                     prim.CastOrNullptr<BilinearPatchBlockPrimitive>())
+            for (Primitive blp : block->Patches())
+                addPrimitive(blp);
+        else
+            addPrimitive(prim);
+    }
+    BVHAggregate rebuilt(std::move(prims), maxPrimsInNode, splitMethod,
+                         spatialSplitBudget, anyHitShadowRays, triangleBlocks,
+                         patchBlocks);
+
+    treeBytes -= nNodes * sizeof(LinearBVHNode) + sizeof(*this) +
+                 primitives.size() * sizeof(primitives[0]);
+    FreeNodes(nodes, nNodes);
+    nodes = rebuilt.nodes;
+    rebuilt.nodes = nullptr;
+    nNodes = rebuilt.nNodes;
+    primitives = std::move(rebuilt.primitives);
+    builtSAHCost = rebuilt.builtSAHCost;
+    return true;
+}
+
+Bounds3f BVHAggregate::refitRecursive(int nodeIndex, int depth) {
+    LinearBVHNode *node = &nodes[nodeIndex];
+    if (node->nPrimitives > 0) {
+        // Compute leaf node bounds from its primitives
+        Bounds3f bounds;
+        for (int i = 0; i < node->nPrimitives; ++i) {
+            Primitive prim = primitives[node->primitivesOffset + i];
+            if (TriangleBlockPrimitive *block =
+                    prim.CastOrNullptr<TriangleBlockPrimitive>())
+                block->UpdateVertices();
+            else if (BilinearPatchBlockPrimitive *block =
+                         prim.CastOrNullptr<BilinearPatchBlockPrimitive>())
+                block->UpdateVertices();
+            bounds = Union(bounds, prim.Bounds());
+        }
+        node->bounds = bounds;
+    } else {
+        // Refit interior node's children, in parallel near the root of large BVHs
+        Bounds3f childBounds[2];
+        int childIndex[2] = {nodeIndex + 1, node->secondChildOffset};
+        auto refitChild = [&](int i) {
+            childBounds[i] = refitRecursive(childIndex[i], depth + 1);
+        };
+        if (depth < bvhRefitParallelDepth && size_t(nNodes) > bvhParallelSubtreeThreshold)
+            ParallelFor(0, 2, refitChild);
+        else {
+            refitChild(0);
+            refitChild(1);
+        }
+        node->bounds = Union(childBounds[0], childBounds[1]);
+        node->shadowSecondFirst =
+            childBounds[1].SurfaceArea() > childBounds[0].SurfaceArea();
+    }
+    return node->bounds;
+}
+
 pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
                                                           Float tMax) const {
     if (!nodes)
         return {};
-    pstd::optional<ShapeIntersection> si;
+    DeferredIntersection isect;
     Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
     int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
     // Follow ray through BVH nodes to find primitive intersections
@@ -544,14 +1227,12 @@ pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
         if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
             if (node->nPrimitives > 0) {
                 // Intersect ray with primitives in leaf BVH node
+                bvhPrimitivesTested += node->nPrimitives;
                 for (int i = 0; i < node->nPrimitives; ++i) {
                     // Check for intersection with primitive in BVH node
-                    pstd::optional<ShapeIntersection> primSi =
-                        primitives[node->primitivesOffset + i].Intersect(ray, tMax);
-                    if (primSi) {
-                        si = primSi;
-                        tMax = si->tHit;
-                    }
+                    if (pstd::optional<Float> tHit = isect.Intersect(
+                            primitives[node->primitivesOffset + i], ray, tMax))
+                        tMax = *tHit;
                 }
                 if (toVisitOffset == 0)
                     break;
@@ -575,12 +1256,31 @@ pstd::optional<ShapeIntersection> BVHAggregate::Intersect(const Ray &ray,
     }
 
     bvhNodesVisited += nodesVisited;
-    return si;
+    return isect.Resolve(ray);
 }
 
+// BVHOccluderCache Definition
+// Records the primitive that most recently occluded a shadow ray traced by
+// this thread, which is likely to occlude the next one as well.
+struct BVHOccluderCache {
+    const BVHAggregate *bvh = nullptr;
+    int primitiveIndex = -1;
+};
+
+static thread_local BVHOccluderCache bvhOccluderCache;
+
 bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
     if (!nodes)
         return false;
+    if (anyHitShadowRays && bvhOccluderCache.bvh == this &&
+        bvhOccluderCache.primitiveIndex < int(primitives.size())) {
+        // Test ray against the last occluder before traversing the BVH
+        ++bvhOccluderCacheTests;
+        if (primitives[bvhOccluderCache.primitiveIndex].IntersectP(ray, tMax)) {
+            ++bvhOccluderCacheHits;
+            return true;
+        }
+    }
     Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
     int dirIsNeg[3] = {static_cast<int>(invDir.x < 0), static_cast<int>(invDir.y < 0),
                        static_cast<int>(invDir.z < 0)};
@@ -595,7 +1295,10 @@ bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
             // Process BVH node _node_ for traversal
             if (node->nPrimitives > 0) {
                 for (int i = 0; i < node->nPrimitives; ++i) {
+                    ++bvhPrimitivesTested;
                     if (primitives[node->primitivesOffset + i].IntersectP(ray, tMax)) {
+                        if (anyHitShadowRays)
+                            bvhOccluderCache = {this, node->primitivesOffset + i};
                         bvhNodesVisited += nodesVisited;
                         return true;
                     }
@@ -604,7 +1307,11 @@ bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
                     break;
                 currentNodeIndex = nodesToVisit[--toVisitOffset];
             } else {
-                if (dirIsNeg[node->axis] != 0) {
+                // Visit the larger child first for any-hit traversal, since it is
+                // more likely to contain an occluder
+                bool secondFirst = anyHitShadowRays ? node->shadowSecondFirst
+                                                    : dirIsNeg[node->axis] != 0;
+                if (secondFirst) {
                     /// second child first
                     nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
                     currentNodeIndex = node->secondChildOffset;
@@ -623,6 +1330,161 @@ bool BVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
     return false;
 }
 
+// BVHRayPacket Definition
+struct BVHRayPacket {
+    static constexpr int MaxSize = BVHAggregate::MaxPacketSize;
+    // BVHRayPacket Public Methods
+    BVHRayPacket(int n, const Ray *rays, const Float *rayTMax) : n(n) {
+        DCHECK_LE(n, MaxSize);
+        for (int i = 0; i < n; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                o[c][i] = rays[i].o[c];
+                invDir[c][i] = 1 / rays[i].d[c];
+            }
+            tMax[i] = rayTMax[i];
+        }
+    }
+
+    // Sets _hit_ for the rays that overlap _b_ and returns true if any do.
+    // As with _IntersectChildren()_, the loop is written so that the compiler
+    // can evaluate it using SIMD instructions.
+    bool IntersectBounds(const Bounds3f &b, bool hit[]) const {
+        const Float farScale = 1 + 2 * gamma(3);
+        int anyHit = 0;
+        for (int i = 0; i < n; ++i) {
+            Float t0 = 0, t1 = tMax[i];
+            for (int c = 0; c < 3; ++c) {
+                bool neg = invDir[c][i] < 0;
+                Float tNear = ((neg ? b.pMax[c] : b.pMin[c]) - o[c][i]) * invDir[c][i];
+                Float tFar =
+                    ((neg ? b.pMin[c] : b.pMax[c]) - o[c][i]) * invDir[c][i] * farScale;
+                // Comparisons are written so that NaN slab values are ignored
+                t0 = tNear > t0 ? tNear : t0;
+                t1 = tFar < t1 ? tFar : t1;
+            }
+            hit[i] = t0 <= t1;
+            anyHit |= int(hit[i]);
+        }
+        return anyHit;
+    }
+
+    // Rays are stored in SoA layout; finished shadow rays have a negative _tMax_.
+    int n;
+    Float o[3][MaxSize], invDir[3][MaxSize];
+    Float tMax[MaxSize];
+};
+
+void BVHAggregate::IntersectPacket(int nRays, const Ray *rays, Float *tMax,
+                                   pstd::optional<ShapeIntersection> *si) const {
+    if (nRays == 0 || !nodes)
+        return;
+    bvhRaysPerPacket << nRays;
+    BVHRayPacket packet(nRays, rays, tMax);
+    // Use the first ray's direction to choose the order to visit children
+    int dirIsNeg[3] = {int(rays[0].d.x < 0), int(rays[0].d.y < 0),
+                       int(rays[0].d.z < 0)};
+    int nodesToVisit[64];
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesVisited = 0;
+    bool hit[MaxPacketSize];
+    while (true) {
+        ++nodesVisited;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (packet.IntersectBounds(node->bounds, hit)) {
+            if (node->nPrimitives > 0) {
+                // Intersect overlapping rays with primitives in leaf node
+                for (int r = 0; r < nRays; ++r) {
+                    if (!hit[r])
+                        continue;
+                    bvhPrimitivesTested += node->nPrimitives;
+                    for (int i = 0; i < node->nPrimitives; ++i) {
+                        pstd::optional<ShapeIntersection> primSi =
+                            primitives[node->primitivesOffset + i].Intersect(
+                                rays[r], packet.tMax[r]);
+                        if (primSi) {
+                            si[r] = primSi;
+                            packet.tMax[r] = primSi->tHit;
+                        }
+                    }
+                }
+                if (toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            } else {
+                // Put far BVH node on _nodesToVisit_ stack, advance to near node
+                if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        } else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    for (int r = 0; r < nRays; ++r)
+        tMax[r] = packet.tMax[r];
+    bvhNodesVisited += nodesVisited;
+}
+
+void BVHAggregate::IntersectPPacket(int nRays, const Ray *rays, const Float *tMax,
+                                    bool *hit) const {
+    for (int r = 0; r < nRays; ++r)
+        hit[r] = false;
+    if (nRays == 0 || !nodes)
+        return;
+    bvhRaysPerPacket << nRays;
+    BVHRayPacket packet(nRays, rays, tMax);
+    int dirIsNeg[3] = {int(rays[0].d.x < 0), int(rays[0].d.y < 0),
+                       int(rays[0].d.z < 0)};
+    int nodesToVisit[64];
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesVisited = 0, nActive = nRays;
+    bool overlaps[MaxPacketSize];
+    while (true) {
+        ++nodesVisited;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (packet.IntersectBounds(node->bounds, overlaps)) {
+            if (node->nPrimitives > 0) {
+                for (int r = 0; r < nRays; ++r) {
+                    if (!overlaps[r])
+                        continue;
+                    bvhPrimitivesTested += node->nPrimitives;
+                    for (int i = 0; i < node->nPrimitives; ++i)
+                        if (primitives[node->primitivesOffset + i].IntersectP(rays[r],
+                                                                              tMax[r])) {
+                            // Retire occluded ray so it fails all later bounds tests
+                            hit[r] = true;
+                            packet.tMax[r] = -1;
+                            --nActive;
+                            break;
+                        }
+                }
+                if (nActive == 0 || toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            } else {
+                if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        } else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    bvhNodesVisited += nodesVisited;
+}
+
 BVHBuildNode *BVHAggregate::buildUpperSAH(Allocator alloc,
                                           std::vector<BVHBuildNode *> &treeletRoots,
                                           int start, int end,
@@ -722,25 +1584,604 @@ BVHBuildNode *BVHAggregate::buildUpperSAH(Allocator alloc,
     return node;
 }
 
-BVHAggregate *BVHAggregate::Create(std::vector<Primitive> prims,
-                                   const ParameterDictionary &parameters) {
+static BVHAggregate::SplitMethod GetBVHSplitMethod(
+    const ParameterDictionary &parameters) {
     std::string splitMethodName = parameters.GetOneString("splitmethod", "sah");
-    BVHAggregate::SplitMethod splitMethod;
     if (splitMethodName == "sah")
-        splitMethod = BVHAggregate::SplitMethod::SAH;
+        return BVHAggregate::SplitMethod::SAH;
     else if (splitMethodName == "hlbvh")
-        splitMethod = BVHAggregate::SplitMethod::HLBVH;
+        return BVHAggregate::SplitMethod::HLBVH;
     else if (splitMethodName == "middle")
-        splitMethod = BVHAggregate::SplitMethod::Middle;
+        return BVHAggregate::SplitMethod::Middle;
     else if (splitMethodName == "equal")
-        splitMethod = BVHAggregate::SplitMethod::EqualCounts;
-    else {
-        Warning(R"(BVH split method "%s" unknown.  Using "sah".)", splitMethodName);
-        splitMethod = BVHAggregate::SplitMethod::SAH;
+        return BVHAggregate::SplitMethod::EqualCounts;
+    else if (splitMethodName == "sbvh")
+        return BVHAggregate::SplitMethod::SBVH;
+
+    Warning(R"(BVH split method "%s" unknown.  Using "sah".)", splitMethodName);
+    return BVHAggregate::SplitMethod::SAH;
+}
+
+BVHAggregate *BVHAggregate::Create(std::vector<Primitive> prims,
+                                   const ParameterDictionary &parameters) {
+    BVHAggregate::SplitMethod splitMethod = GetBVHSplitMethod(parameters);
+    int maxPrimsInNode = parameters.GetOneInt("maxnodeprims", 4);
+    Float spatialSplitBudget = parameters.GetOneFloat("sbvhbudget", 0.25f);
+    std::string shadowTraversal = parameters.GetOneString("shadowtraversal", "anyhit");
+    if (shadowTraversal != "anyhit" && shadowTraversal != "ordered")
+        Warning(R"(BVH shadow traversal "%s" unknown.  Using "anyhit".)",
+                shadowTraversal);
+    bool triangleBlocks = parameters.GetOneBool("triangleblocks", false);
+    bool patchBlocks = parameters.GetOneBool("patchblocks", false);
+    return new BVHAggregate(std::move(prims), maxPrimsInNode, splitMethod,
+                            spatialSplitBudget, shadowTraversal != "ordered",
+                            triangleBlocks, patchBlocks);
+}
+
+STAT_COUNTER("BVH/Wide BVH nodes", wideNodes);
+STAT_COUNTER("BVH/Quantized wide BVH nodes", quantizedWideNodes);
+STAT_PIXEL_COUNTER("BVH/Wide nodes visited", wideNodesVisited);
+
+// WideBVHNode Definition
+struct alignas(64) WideBVHNode {
+    static constexpr int Width = WideBVHAggregate::Width;
+
+    // WideBVHNode Public Methods
+    WideBVHNode() {
+        for (int i = 0; i < Width; ++i) {
+            // Initialize empty child slot that no ray can intersect
+            for (int c = 0; c < 3; ++c) {
+                bounds[0][c][i] = Infinity;
+                bounds[1][c][i] = -Infinity;
+            }
+            childOffset[i] = -1;
+            nPrimitives[i] = 0;
+        }
+    }
+
+    void SetChild(int i, const Bounds3f &b, int offset, int nPrims) {
+        for (int c = 0; c < 3; ++c) {
+            bounds[0][c][i] = b.pMin[c];
+            bounds[1][c][i] = b.pMax[c];
+        }
+        childOffset[i] = offset;
+        nPrimitives[i] = nPrims;
+    }
+
+    // Children's bounds are stored in SoA layout, indexed by [min/max][axis][child],
+    // so that all of a node's slab tests can be evaluated together.
+    Float bounds[2][3][Width];
+    int childOffset[Width];       // leaf: first primitive, interior: node index
+    uint16_t nPrimitives[Width];  // 0 -> interior child
+};
+
+// QuantizedWideBVHNode Definition
+struct alignas(64) QuantizedWideBVHNode {
+    static constexpr int Width = WideBVHAggregate::Width;
+
+    // QuantizedWideBVHNode Public Methods
+    QuantizedWideBVHNode() = default;
+    QuantizedWideBVHNode(const WideBVHNode &node) {
+        // Find node bounds and power-of-two quantization scale for each axis
+        for (int c = 0; c < 3; ++c) {
+            Float lo = Infinity, hi = -Infinity;
+            for (int i = 0; i < Width; ++i)
+                if (node.childOffset[i] >= 0) {
+                    lo = std::min(lo, node.bounds[0][c][i]);
+                    hi = std::max(hi, node.bounds[1][c][i]);
+                }
+            origin[c] = lo;
+            scale[c] = hi > lo ? std::exp2(std::ceil(std::log2((hi - lo) / 255))) : 1;
+            while (dequantize(c, 255) < hi)
+                scale[c] *= 2;
+        }
+
+        // Quantize child bounds conservatively, so that they contain the originals
+        for (int i = 0; i < Width; ++i) {
+            childOffset[i] = node.childOffset[i];
+            nPrimitives[i] = node.nPrimitives[i];
+            for (int c = 0; c < 3; ++c) {
+                if (node.childOffset[i] < 0) {
+                    qBounds[0][c][i] = qBounds[1][c][i] = 0;
+                    continue;
+                }
+                Float lo = node.bounds[0][c][i], hi = node.bounds[1][c][i];
+                int qlo = Clamp(int(std::floor((lo - origin[c]) / scale[c])), 0, 255);
+                while (qlo > 0 && dequantize(c, qlo) > lo)
+                    --qlo;
+                int qhi = Clamp(int(std::ceil((hi - origin[c]) / scale[c])), 0, 255);
+                while (qhi < 255 && dequantize(c, qhi) < hi)
+                    ++qhi;
+                qBounds[0][c][i] = qlo;
+                qBounds[1][c][i] = qhi;
+            }
+        }
+    }
+
+    // Quantized values are exactly representable multiples of the power-of-two
+    // scale, so dequantization is rounded just once and is reproducible.
+    Float dequantize(int c, int q) const { return origin[c] + q * scale[c]; }
+
+    void Decode(WideBVHNode *node) const {
+        for (int b = 0; b < 2; ++b)
+            for (int c = 0; c < 3; ++c)
+                for (int i = 0; i < Width; ++i)
+                    node->bounds[b][c][i] =
+                        childOffset[i] < 0 ? (b == 0 ? Infinity : -Infinity)
+                                           : dequantize(c, qBounds[b][c][i]);
+        for (int i = 0; i < Width; ++i) {
+            node->childOffset[i] = childOffset[i];
+            node->nPrimitives[i] = nPrimitives[i];
+        }
+    }
+
+    // Children's bounds are stored as 8-bit offsets from _origin_ in units of
+    // _scale_, using the same [min/max][axis][child] layout as _WideBVHNode_.
+    Float origin[3], scale[3];
+    uint8_t qBounds[2][3][Width];
+    int childOffset[Width];
+    uint16_t nPrimitives[Width];
+};
+
+// Returns the wide BVH node at _offset_, decoding it into _decoded_ if the BVH
+// uses quantized nodes.
+static inline const WideBVHNode &GetWideBVHNode(
+    const WideBVHNode *nodes, const QuantizedWideBVHNode *quantizedNodes, int offset,
+    WideBVHNode *decoded) {
+    if (!quantizedNodes)
+        return nodes[offset];
+    quantizedNodes[offset].Decode(decoded);
+    return *decoded;
+}
+
+// WideBVHToVisit Definition
+struct WideBVHToVisit {
+    int offset;
+    int nPrimitives;
+    Float tMin;
+};
+
+// Returns a bitmask of the children of _node_ that the ray overlaps and
+// the parametric distance to each of them.  The loop has no dependencies
+// between iterations so that the compiler can evaluate it using SIMD
+// instructions.
+static inline int IntersectChildren(const WideBVHNode &node, Point3f o, Vector3f invDir,
+                                    const int dirIsNeg[3], Float raytMax,
+                                    Float tNear[]) {
+    constexpr int Width = WideBVHNode::Width;
+    const Float *nearX = node.bounds[dirIsNeg[0]][0];
+    const Float *farX = node.bounds[1 - dirIsNeg[0]][0];
+    const Float *nearY = node.bounds[dirIsNeg[1]][1];
+    const Float *farY = node.bounds[1 - dirIsNeg[1]][1];
+    const Float *nearZ = node.bounds[dirIsNeg[2]][2];
+    const Float *farZ = node.bounds[1 - dirIsNeg[2]][2];
+    // Scale factor to ensure robust ray--bounds intersection
+    const Float farScale = 1 + 2 * gamma(3);
+
+    int hitMask = 0;
+    for (int i = 0; i < Width; ++i) {
+        Float t0 = 0, t1 = raytMax;
+        Float txMin = (nearX[i] - o.x) * invDir.x;
+        Float txMax = (farX[i] - o.x) * invDir.x * farScale;
+        Float tyMin = (nearY[i] - o.y) * invDir.y;
+        Float tyMax = (farY[i] - o.y) * invDir.y * farScale;
+        Float tzMin = (nearZ[i] - o.z) * invDir.z;
+        Float tzMax = (farZ[i] - o.z) * invDir.z * farScale;
+        // Comparisons are written so that NaN slab values are ignored
+        t0 = txMin > t0 ? txMin : t0;
+        t0 = tyMin > t0 ? tyMin : t0;
+        t0 = tzMin > t0 ? tzMin : t0;
+        t1 = txMax < t1 ? txMax : t1;
+        t1 = tyMax < t1 ? tyMax : t1;
+        t1 = tzMax < t1 ? tzMax : t1;
+        tNear[i] = t0;
+        hitMask |= int(t0 <= t1) << i;
+    }
+    return hitMask;
+}
+
+// WideBVHAggregate Method Definitions
+WideBVHAggregate::WideBVHAggregate(std::vector<Primitive> prims, int maxPrimsInNode,
+                                   BVHAggregate::SplitMethod splitMethod,
+                                   Float spatialSplitBudget, bool quantize) {
+    // Build binary BVH and collapse it into _Width_-wide nodes
+    BVHAggregate bvh(std::move(prims), maxPrimsInNode, splitMethod, spatialSplitBudget);
+    bounds = bvh.Bounds();
+    std::vector<WideBVHNode> wideNodeVector;
+    if (bvh.nodes[0].nPrimitives > 0) {
+        // Create single-child wide node for the leaf at the binary BVH root
+        wideNodeVector.push_back(WideBVHNode());
+        wideNodeVector[0].SetChild(0, bvh.nodes[0].bounds, bvh.nodes[0].primitivesOffset,
+                                   bvh.nodes[0].nPrimitives);
+    } else
+        collapse(bvh.nodes, 0, wideNodeVector);
+    wideNodes += wideNodeVector.size();
+
+    // Release binary BVH nodes, which are no longer needed
+    int nBinaryLeaves = 0;
+    for (const WideBVHNode &node : wideNodeVector)
+        for (int i = 0; i < Width; ++i)
+            nBinaryLeaves += (node.nPrimitives[i] > 0);
+    treeBytes -= int64_t(2 * nBinaryLeaves - 1) * sizeof(LinearBVHNode) + sizeof(bvh);
+    FreeNodes(bvh.nodes, bvh.nNodes);
+    bvh.nodes = nullptr;
+    primitives = std::move(bvh.primitives);
+
+    // Quantization requires finite bounds to compute each node's scale
+    bool finiteBounds = true;
+    for (int c = 0; c < 3; ++c)
+        finiteBounds &= IsFinite(bounds.pMin[c]) && IsFinite(bounds.pMax[c]);
+    if (quantize && !finiteBounds) {
+        Warning("Wide BVH has infinite bounds; not quantizing its nodes.");
+        quantize = false;
+    }
+    size_t nodeSize = quantize ? sizeof(QuantizedWideBVHNode) : sizeof(WideBVHNode);
+    treeBytes += wideNodeVector.size() * nodeSize + sizeof(*this);
+    LOG_VERBOSE("Wide BVH created with %d %snodes for %d primitives (%.2f MB)",
+                (int)wideNodeVector.size(), quantize ? "quantized " : "",
+                (int)primitives.size(),
+                float(wideNodeVector.size() * nodeSize) / (1024.f * 1024.f));
+    if (quantize) {
+        quantizedWideNodes += wideNodeVector.size();
+        quantizedNodes = AllocateNodes<QuantizedWideBVHNode>(wideNodeVector.size());
+        ParallelFor(0, wideNodeVector.size(), [&](int64_t start, int64_t end) {
+            for (int64_t i = start; i < end; ++i)
+                quantizedNodes[i] = QuantizedWideBVHNode(wideNodeVector[i]);
+        });
+    } else {
+        nodes = AllocateNodes<WideBVHNode>(wideNodeVector.size());
+        NumaInterleave(nodes, wideNodeVector.size() * sizeof(WideBVHNode));
+        std::copy(wideNodeVector.begin(), wideNodeVector.end(), nodes);
+    }
+}
+
+int WideBVHAggregate::collapse(const LinearBVHNode *binaryNodes, int binaryNodeIndex,
+                               std::vector<WideBVHNode> &wideNodes) {
+    DCHECK_EQ(binaryNodes[binaryNodeIndex].nPrimitives, 0);
+    int wideNodeIndex = wideNodes.size();
+    wideNodes.push_back(WideBVHNode());
+
+    // Gather up to _Width_ descendants of binary node as children of wide node
+    int children[Width];
+    int nChildren = 0;
+    children[nChildren++] = binaryNodeIndex + 1;
+    children[nChildren++] = binaryNodes[binaryNodeIndex].secondChildOffset;
+    while (nChildren < Width) {
+        // Open the interior child with the largest surface area
+        int openChild = -1;
+        Float maxArea = -1;
+        for (int i = 0; i < nChildren; ++i) {
+            const LinearBVHNode &child = binaryNodes[children[i]];
+            if (child.nPrimitives == 0 && child.bounds.SurfaceArea() > maxArea) {
+                openChild = i;
+                maxArea = child.bounds.SurfaceArea();
+            }
+        }
+        if (openChild == -1)
+            break;
+
+        int index = children[openChild];
+        children[openChild] = index + 1;
+        children[nChildren++] = binaryNodes[index].secondChildOffset;
+    }
+
+    // Initialize wide node's children, recursively collapsing interior ones
+    for (int i = 0; i < nChildren; ++i) {
+        const LinearBVHNode &child = binaryNodes[children[i]];
+        if (child.nPrimitives > 0)
+            wideNodes[wideNodeIndex].SetChild(i, child.bounds, child.primitivesOffset,
+                                              child.nPrimitives);
+        else {
+            int childIndex = collapse(binaryNodes, children[i], wideNodes);
+            wideNodes[wideNodeIndex].SetChild(i, child.bounds, childIndex, 0);
+        }
+    }
+    return wideNodeIndex;
+}
+
+pstd::optional<ShapeIntersection> WideBVHAggregate::Intersect(const Ray &ray,
+                                                              Float tMax) const {
+    if (!nodes && !quantizedNodes)
+        return {};
+    DeferredIntersection isect;
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
+    // Follow ray through wide BVH nodes to find primitive intersections
+    constexpr int maxToVisit = 64 * (Width - 1) + 1;
+    WideBVHToVisit toVisit[maxToVisit];
+    int toVisitOffset = 0;
+    toVisit[toVisitOffset++] = WideBVHToVisit{0, 0, 0};
+    int nodesVisited = 0;
+    WideBVHNode decoded;
+    while (toVisitOffset > 0) {
+        WideBVHToVisit entry = toVisit[--toVisitOffset];
+        // Skip entries that are farther away than the closest hit found so far
+        if (entry.tMin > tMax)
+            continue;
+
+        if (entry.nPrimitives > 0) {
+            // Intersect ray with primitives in wide BVH leaf
+            bvhPrimitivesTested += entry.nPrimitives;
+            for (int i = 0; i < entry.nPrimitives; ++i)
+                if (pstd::optional<Float> tHit =
+                        isect.Intersect(primitives[entry.offset + i], ray, tMax))
+                    tMax = *tHit;
+            continue;
+        }
+
+        // Test ray against all children of wide BVH node
+        ++nodesVisited;
+        const WideBVHNode &node =
+            GetWideBVHNode(nodes, quantizedNodes, entry.offset, &decoded);
+        Float tNear[Width];
+        int hitMask = IntersectChildren(node, ray.o, invDir, dirIsNeg, tMax, tNear);
+
+        // Sort intersected children by decreasing distance
+        int hitChildren[Width];
+        int nHit = 0;
+        for (int i = 0; i < Width; ++i) {
+            if (!(hitMask & (1 << i)))
+                continue;
+            int j = nHit++;
+            while (j > 0 && tNear[hitChildren[j - 1]] < tNear[i]) {
+                hitChildren[j] = hitChildren[j - 1];
+                --j;
+            }
+            hitChildren[j] = i;
+        }
+
+        // Push children so that the closest one is visited next
+        for (int j = 0; j < nHit; ++j) {
+            int i = hitChildren[j];
+            DCHECK_LT(toVisitOffset, maxToVisit);
+            toVisit[toVisitOffset++] =
+                WideBVHToVisit{node.childOffset[i], node.nPrimitives[i], tNear[i]};
+        }
+    }
+
+    wideNodesVisited += nodesVisited;
+    return isect.Resolve(ray);
+}
+
+bool WideBVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
+    if (!nodes && !quantizedNodes)
+        return false;
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
+    constexpr int maxToVisit = 64 * (Width - 1) + 1;
+    WideBVHToVisit toVisit[maxToVisit];
+    int toVisitOffset = 0;
+    toVisit[toVisitOffset++] = WideBVHToVisit{0, 0, 0};
+    int nodesVisited = 0;
+    WideBVHNode decoded;
+    while (toVisitOffset > 0) {
+        WideBVHToVisit entry = toVisit[--toVisitOffset];
+        if (entry.nPrimitives > 0) {
+            bvhPrimitivesTested += entry.nPrimitives;
+            for (int i = 0; i < entry.nPrimitives; ++i)
+                if (primitives[entry.offset + i].IntersectP(ray, tMax)) {
+                    wideNodesVisited += nodesVisited;
+                    return true;
+                }
+            continue;
+        }
+
+        // Push all intersected children; their order doesn't matter for shadow rays
+        ++nodesVisited;
+        const WideBVHNode &node =
+            GetWideBVHNode(nodes, quantizedNodes, entry.offset, &decoded);
+        Float tNear[Width];
+        int hitMask = IntersectChildren(node, ray.o, invDir, dirIsNeg, tMax, tNear);
+        for (int i = 0; i < Width; ++i)
+            if (hitMask & (1 << i)) {
+                DCHECK_LT(toVisitOffset, maxToVisit);
+                toVisit[toVisitOffset++] =
+                    WideBVHToVisit{node.childOffset[i], node.nPrimitives[i], tNear[i]};
+            }
     }
+    wideNodesVisited += nodesVisited;
+    return false;
+}
 
+WideBVHAggregate *WideBVHAggregate::Create(std::vector<Primitive> prims,
+                                           const ParameterDictionary &parameters) {
+    BVHAggregate::SplitMethod splitMethod = GetBVHSplitMethod(parameters);
     int maxPrimsInNode = parameters.GetOneInt("maxnodeprims", 4);
-    return new BVHAggregate(std::move(prims), maxPrimsInNode, splitMethod);
+    Float spatialSplitBudget = parameters.GetOneFloat("sbvhbudget", 0.25f);
+    bool quantize = parameters.GetOneBool("quantize", false);
+    return new WideBVHAggregate(std::move(prims), maxPrimsInNode, splitMethod,
+                                spatialSplitBudget, quantize);
+}
+
+STAT_MEMORY_COUNTER("Memory/Instance BVH", instanceBVHBytes);
+STAT_COUNTER("Scene/Instances in instance BVHs", instanceBVHInstances);
+
+// InstanceBVHAggregate Method Definitions
+InstanceBVHAggregate::InstanceBVHAggregate(std::vector<Primitive> protos,
+                                           std::vector<Instance> insts)
+    : prototypes(std::move(protos)) {
+    CHECK(!insts.empty());
+    // Build BVH over temporary _TransformedPrimitive_s for the instances
+    std::vector<TransformedPrimitive> proxies;
+    proxies.reserve(insts.size());
+    for (const Instance &inst : insts) {
+        CHECK_LT(inst.prototype, prototypes.size());
+        proxies.push_back(
+            TransformedPrimitive(prototypes[inst.prototype], inst.renderFromInstance));
+    }
+    // The proxies are freed after construction, so don't report their memory
+    primitiveMemory -= proxies.size() * sizeof(TransformedPrimitive);
+    std::vector<Primitive> proxyPrims(proxies.size());
+    for (size_t i = 0; i < proxies.size(); ++i)
+        proxyPrims[i] = &proxies[i];
+    BVHAggregate bvh(std::move(proxyPrims));
+
+    // Take BVH nodes and order instance records to match BVH leaves
+    instances.resize(insts.size());
+    for (size_t i = 0; i < bvh.primitives.size(); ++i)
+        instances[i] = insts[bvh.primitives[i].Cast<TransformedPrimitive>() -
+                             proxies.data()];
+    nodes = bvh.nodes;
+    nNodes = bvh.nNodes;
+    bvh.nodes = nullptr;
+    treeBytes -= sizeof(bvh) + bvh.primitives.size() * sizeof(Primitive);
+    instanceBVHBytes += sizeof(*this) + instances.size() * sizeof(Instance) +
+                        prototypes.size() * sizeof(Primitive);
+    instanceBVHInstances += instances.size();
+}
+
+InstanceBVHAggregate::~InstanceBVHAggregate() {
+    FreeNodes(nodes, nNodes);
+}
+
+Bounds3f InstanceBVHAggregate::Bounds() const {
+    CHECK(nodes);
+    return nodes[0].bounds;
+}
+
+pstd::optional<ShapeIntersection> InstanceBVHAggregate::Intersect(const Ray &ray,
+                                                                  Float tMax) const {
+    pstd::optional<ShapeIntersection> si;
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesToVisit[64];
+    int nodesVisited = 0;
+    while (true) {
+        ++nodesVisited;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
+            if (node->nPrimitives > 0) {
+                // Intersect ray with instances in leaf BVH node
+                for (int i = 0; i < node->nPrimitives; ++i) {
+                    const Instance &inst = instances[node->primitivesOffset + i];
+                    // Transform ray to instance space and intersect prototype
+                    Float instanceTMax = tMax;
+                    Ray instanceRay =
+                        inst.renderFromInstance->ApplyInverse(ray, &instanceTMax);
+                    pstd::optional<ShapeIntersection> instanceSi =
+                        prototypes[inst.prototype].Intersect(instanceRay, instanceTMax);
+                    if (instanceSi) {
+                        instanceSi->intr = (*inst.renderFromInstance)(instanceSi->intr);
+                        si = instanceSi;
+                        tMax = si->tHit;
+                    }
+                }
+                if (toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            } else {
+                // Put far BVH node on _nodesToVisit_ stack, advance to near node
+                if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        } else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    bvhNodesVisited += nodesVisited;
+    return si;
+}
+
+bool InstanceBVHAggregate::IntersectP(const Ray &ray, Float tMax) const {
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {int(invDir.x < 0), int(invDir.y < 0), int(invDir.z < 0)};
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesToVisit[64];
+    int nodesVisited = 0;
+    while (true) {
+        ++nodesVisited;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
+            if (node->nPrimitives > 0) {
+                for (int i = 0; i < node->nPrimitives; ++i) {
+                    const Instance &inst = instances[node->primitivesOffset + i];
+                    Float instanceTMax = tMax;
+                    Ray instanceRay =
+                        inst.renderFromInstance->ApplyInverse(ray, &instanceTMax);
+                    if (prototypes[inst.prototype].IntersectP(instanceRay,
+                                                              instanceTMax)) {
+                        bvhNodesVisited += nodesVisited;
+                        return true;
+                    }
+                }
+                if (toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            } else {
+                if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        } else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    bvhNodesVisited += nodesVisited;
+    return false;
+}
+
+// MotionSegmentAggregate Method Definitions
+MotionSegmentAggregate::MotionSegmentAggregate(std::vector<Primitive> animatedPrimitives,
+                                               int nSegments) {
+    CHECK(!animatedPrimitives.empty());
+    // Find the time range of the primitives' animation
+    startTime = Infinity;
+    endTime = -Infinity;
+    for (Primitive prim : animatedPrimitives) {
+        CHECK(prim.Is<AnimatedPrimitive>());
+        const AnimatedTransform &renderFromPrimitive =
+            prim.Cast<AnimatedPrimitive>()->RenderFromPrimitive();
+        startTime = std::min(startTime, renderFromPrimitive.startTime);
+        endTime = std::max(endTime, renderFromPrimitive.endTime);
+    }
+    if (!(endTime > startTime))
+        nSegments = 1;
+
+    // Build a BVH using each segment's motion bounds
+    std::vector<Bounds3f> primBounds(animatedPrimitives.size());
+    for (int segment = 0; segment < nSegments; ++segment) {
+        // The first and last segments also cover times outside the range, where
+        // the primitives don't move
+        Float time0 = segment == 0 ? -Infinity
+                                   : Lerp(Float(segment) / nSegments, startTime, endTime);
+        Float time1 = segment == nSegments - 1
+                          ? Infinity
+                          : Lerp(Float(segment + 1) / nSegments, startTime, endTime);
+        ParallelFor(0, animatedPrimitives.size(), [&](int64_t i) {
+            primBounds[i] =
+                animatedPrimitives[i].Cast<AnimatedPrimitive>()->Bounds(time0, time1);
+        });
+        BVHAggregate *bvh =
+            new BVHAggregate(animatedPrimitives, 1, BVHAggregate::SplitMethod::SAH, 0,
+                             true, false, false, primBounds);
+        segments.push_back(bvh);
+        bounds = Union(bounds, bvh->Bounds());
+    }
+    LOG_VERBOSE("Created %d motion segment BVHs for %d animated primitives over [%f, %f]",
+                nSegments, animatedPrimitives.size(), startTime, endTime);
+}
+
+pstd::optional<ShapeIntersection> MotionSegmentAggregate::Intersect(const Ray &ray,
+                                                                    Float tMax) const {
+    return Segment(ray.time).Intersect(ray, tMax);
+}
+
+bool MotionSegmentAggregate::IntersectP(const Ray &ray, Float tMax) const {
+    return Segment(ray.time).IntersectP(ray, tMax);
 }
 
 // KdNodeToVisit Definition
@@ -765,6 +2206,15 @@ struct alignas(8) KdTreeNode {
     bool IsLeaf() const { return (flags & 3) == 3; }
     int AboveChild() const { return flags >> 2; }
 
+    // Offsets the node's references to other nodes and to primitive indices
+    // when its subtree is appended to a larger node array.
+    void Relocate(int nodeOffset, int primitiveIndicesOffsetBase) {
+        if (!IsLeaf())
+            flags += uint32_t(nodeOffset) << 2;
+        else if (nPrimitives() > 1)
+            primitiveIndicesOffset += primitiveIndicesOffsetBase;
+    }
+
     union {
         Float split;                 // Interior
         int onePrimitiveIndex;       // Leaf
@@ -793,6 +2243,10 @@ struct BoundEdge {
 };
 
 STAT_PIXEL_COUNTER("Kd-Tree/Nodes visited", kdNodesVisited);
+STAT_COUNTER("Kd-Tree/Build time (ms)", kdBuildTimeMS);
+
+// Primitive count above which kd-tree construction builds subtrees in parallel
+static constexpr size_t kdParallelSubtreeThreshold = 16 * 1024;
 
 // KdTreeAggregate Method Definitions
 KdTreeAggregate::KdTreeAggregate(std::vector<Primitive> p, int isectCost,
@@ -804,7 +2258,7 @@ KdTreeAggregate::KdTreeAggregate(std::vector<Primitive> p, int isectCost,
       emptyBonus(emptyBonus),
       primitives(std::move(p)) {
     // Build kd-tree aggregate
-    nextFreeNode = nAllocedNodes = 0;
+    Timer timer;
     if (maxDepth <= 0)
         maxDepth = std::round(8 + 1.3f * Log2Int(int64_t(primitives.size())));
     // Compute bounds for kd-tree construction
@@ -830,8 +2284,12 @@ KdTreeAggregate::KdTreeAggregate(std::vector<Primitive> p, int isectCost,
         primNums[i] = i;
 
     // Start recursive construction of kd-tree
-    buildTree(0, bounds, primBounds, primNums, maxDepth, edges, pstd::span<int>(prims0),
-              pstd::span<int>(prims1), 0);
+    std::vector<KdTreeNode> treeNodes;
+    buildTree(&treeNodes, &primitiveIndices, bounds, primBounds, primNums, maxDepth,
+              edges, pstd::span<int>(prims0), pstd::span<int>(prims1), 0);
+    nodes = AllocateNodes<KdTreeNode>(treeNodes.size());
+    std::copy(treeNodes.begin(), treeNodes.end(), nodes);
+    kdBuildTimeMS += int64_t(1000 * timer.ElapsedSeconds());
 }
 
 void KdTreeNode::InitLeaf(pstd::span<const int> primNums,
@@ -849,28 +2307,20 @@ void KdTreeNode::InitLeaf(pstd::span<const int> primNums,
     }
 }
 
-void KdTreeAggregate::buildTree(int nodeNum, const Bounds3f &nodeBounds,
+void KdTreeAggregate::buildTree(std::vector<KdTreeNode> *treeNodes,
+                                std::vector<int> *treePrimitiveIndices,
+                                const Bounds3f &nodeBounds,
                                 const std::vector<Bounds3f> &allPrimBounds,
                                 pstd::span<const int> primNums, int depth,
                                 std::vector<BoundEdge> edges[3], pstd::span<int> prims0,
-                                pstd::span<int> prims1, int badRefines) {
-    CHECK_EQ(nodeNum, nextFreeNode);
-    // Get next free node from _nodes_ array
-    if (nextFreeNode == nAllocedNodes) {
-        int nNewAllocNodes = std::max(2 * nAllocedNodes, 512);
-        KdTreeNode *n = new KdTreeNode[nNewAllocNodes];
-        if (nAllocedNodes > 0) {
-            std::memcpy(n, nodes, nAllocedNodes * sizeof(KdTreeNode));
-            delete[] nodes;
-        }
-        nodes = n;
-        nAllocedNodes = nNewAllocNodes;
-    }
-    ++nextFreeNode;
+                                pstd::span<int> prims1, int badRefines) const {
+    // Get next free node from _treeNodes_ array
+    int nodeNum = treeNodes->size();
+    treeNodes->push_back(KdTreeNode());
 
     // Initialize leaf node if termination criteria met
     if (primNums.size() <= maxPrims || depth == 0) {
-        nodes[nodeNum].InitLeaf(primNums, &primitiveIndices);
+        (*treeNodes)[nodeNum].InitLeaf(primNums, treePrimitiveIndices);
         return;
     }
 
@@ -945,7 +2395,7 @@ retrySplit:
         ++badRefines;
     if ((bestCost > 4 * leafCost && nPrimitives < 16) || bestAxis == -1 ||
         badRefines == 3) {
-        nodes[nodeNum].InitLeaf(primNums, &primitiveIndices);
+        (*treeNodes)[nodeNum].InitLeaf(primNums, treePrimitiveIndices);
         return;
     }
 
@@ -962,12 +2412,50 @@ retrySplit:
     Float tSplit = edges[bestAxis][bestOffset].t;
     Bounds3f bounds0 = nodeBounds, bounds1 = nodeBounds;
     bounds0.pMax[bestAxis] = bounds1.pMin[bestAxis] = tSplit;
-    buildTree(nodeNum + 1, bounds0, allPrimBounds, prims0.subspan(0, n0), depth - 1,
-              edges, prims0, prims1.subspan(n1), badRefines);
-    int aboveChild = nextFreeNode;
-    nodes[nodeNum].InitInterior(bestAxis, aboveChild, tSplit);
-    buildTree(aboveChild, bounds1, allPrimBounds, prims1.subspan(0, n1), depth - 1, edges,
-              prims0, prims1.subspan(n1), badRefines);
+    if (nPrimitives > kdParallelSubtreeThreshold) {
+        // Build children's subtrees in parallel with their own working memory
+        std::vector<int> childPrimNums[2] = {
+            std::vector<int>(prims0.begin(), prims0.begin() + n0),
+            std::vector<int>(prims1.begin(), prims1.begin() + n1)};
+        std::vector<KdTreeNode> childNodes[2];
+        std::vector<int> childPrimitiveIndices[2];
+        ParallelFor(0, 2, [&](int c) {
+            size_t n = childPrimNums[c].size();
+            std::vector<BoundEdge> childEdges[3];
+            for (int i = 0; i < 3; ++i)
+                childEdges[i].resize(2 * n);
+            std::vector<int> childPrims0(n), childPrims1(depth * n);
+            buildTree(&childNodes[c], &childPrimitiveIndices[c],
+                      c == 0 ? bounds0 : bounds1, allPrimBounds, childPrimNums[c],
+                      depth - 1, childEdges, pstd::span<int>(childPrims0),
+                      pstd::span<int>(childPrims1), badRefines);
+        });
+
+        // Append children's subtrees after the interior node
+        for (int c = 0; c < 2; ++c) {
+            int nodeOffset = treeNodes->size();
+            int indicesOffset = treePrimitiveIndices->size();
+            for (KdTreeNode &node : childNodes[c]) {
+                node.Relocate(nodeOffset, indicesOffset);
+                treeNodes->push_back(node);
+            }
+            treePrimitiveIndices->insert(treePrimitiveIndices->end(),
+                                         childPrimitiveIndices[c].begin(),
+                                         childPrimitiveIndices[c].end());
+        }
+        int aboveChild = nodeNum + 1 + childNodes[0].size();
+        (*treeNodes)[nodeNum].InitInterior(bestAxis, aboveChild, tSplit);
+        return;
+    }
+
+    buildTree(treeNodes, treePrimitiveIndices, bounds0, allPrimBounds,
+              prims0.subspan(0, n0), depth - 1, edges, prims0, prims1.subspan(n1),
+              badRefines);
+    int aboveChild = treeNodes->size();
+    (*treeNodes)[nodeNum].InitInterior(bestAxis, aboveChild, tSplit);
+    buildTree(treeNodes, treePrimitiveIndices, bounds1, allPrimBounds,
+              prims1.subspan(0, n1), depth - 1, edges, prims0, prims1.subspan(n1),
+              badRefines);
 }
 
 pstd::optional<ShapeIntersection> KdTreeAggregate::Intersect(const Ray &ray,
@@ -1162,9 +2650,13 @@ KdTreeAggregate *KdTreeAggregate::Create(std::vector<Primitive> prims,
 
 Primitive CreateAccelerator(const std::string &name, std::vector<Primitive> prims,
                             const ParameterDictionary &parameters) {
+    LoadProfileScope _("Create accelerator", name);
+    ScopedMemoryCategory memoryCategory(MemoryCategory::BVH);
     Primitive accel = nullptr;
     if (name == "bvh")
         accel = BVHAggregate::Create(std::move(prims), parameters);
+    else if (name == "bvh8")
+        accel = WideBVHAggregate::Create(std::move(prims), parameters);
     else if (name == "kdtree")
         accel = KdTreeAggregate::Create(std::move(prims), parameters);
     else
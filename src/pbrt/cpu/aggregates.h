@@ -12,6 +12,7 @@
 
 #include <atomic>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace pbrt {
@@ -23,16 +24,25 @@ struct BVHBuildNode;
 struct BVHPrimitive;
 struct LinearBVHNode;
 struct MortonPrimitive;
+struct WideBVHNode;
+struct QuantizedWideBVHNode;
 
 // BVHAggregate Definition
 class BVHAggregate {
   public:
     // BVHAggregate Public Types
-    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts };
+    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts, SBVH };
 
     // BVHAggregate Public Methods
+    // If _primitiveBounds_ is given, the BVH is built using those bounds in
+    // place of the primitives' own; they must contain the primitives' geometry
+    // for all of the rays that traverse it.
     BVHAggregate(std::vector<Primitive> p, int maxPrimsInNode = 1,
-                 SplitMethod splitMethod = SplitMethod::SAH);
+                 SplitMethod splitMethod = SplitMethod::SAH,
+                 Float spatialSplitBudget = 0.25f, bool anyHitShadowRays = true,
+                 bool triangleBlocks = false, bool patchBlocks = false,
+                 pstd::span<const Bounds3f> primitiveBounds = {});
+    ~BVHAggregate();
 
     static BVHAggregate *Create(std::vector<Primitive> prims,
                                 const ParameterDictionary &parameters);
@@ -41,6 +51,25 @@ class BVHAggregate {
     pstd::optional<ShapeIntersection> Intersect(const Ray &ray, Float tMax) const;
     bool IntersectP(const Ray &ray, Float tMax) const;
 
+    // Traces up to _MaxPacketSize_ rays through the BVH together, testing each
+    // node's bounds against all of them at once. _tMax_ is updated for rays
+    // that hit primitives. Tracing is most efficient for coherent rays.
+    static constexpr int MaxPacketSize = 32;
+    void IntersectPacket(int nRays, const Ray *rays, Float *tMax,
+                         pstd::optional<ShapeIntersection> *si) const;
+    void IntersectPPacket(int nRays, const Ray *rays, const Float *tMax,
+                          bool *hit) const;
+
+    // Recomputes node bounds after primitives have moved but the BVH's
+    // topology is still valid; the BVH must not be traversed concurrently.
+    // Returns true if the BVH was instead rebuilt because its SAH cost grew
+    // by more than a factor of _maxCostRatio_ (if positive).
+    bool Refit(Float maxCostRatio = 0);
+    Float SAHCost() const;
+
+    // Returns the number of bytes used by the BVH's nodes and primitive array.
+    size_t MemoryBytes() const;
+
   private:
     // BVHAggregate Private Methods
     BVHBuildNode *buildRecursive(ThreadLocal<Allocator> &threadAllocators,
@@ -48,6 +77,12 @@ class BVHAggregate {
                                  std::atomic<int> *totalNodes,
                                  std::atomic<int> *orderedPrimsOffset,
                                  std::vector<Primitive> &orderedPrims);
+    BVHBuildNode *buildSBVH(ThreadLocal<Allocator> &threadAllocators,
+                            std::vector<BVHPrimitive> bvhPrimitives, Float rootArea,
+                            std::atomic<int> *totalNodes,
+                            std::atomic<int> *orderedPrimsOffset,
+                            std::vector<Primitive> &orderedPrims,
+                            std::atomic<int64_t> *referenceBudget);
     BVHBuildNode *buildHLBVH(Allocator alloc,
                              const std::vector<BVHPrimitive> &primitiveInfo,
                              std::atomic<int> *totalNodes,
@@ -61,12 +96,111 @@ class BVHAggregate {
                                 std::vector<BVHBuildNode *> &treeletRoots, int start,
                                 int end, std::atomic<int> *totalNodes) const;
     int flattenBVH(BVHBuildNode *node, int *offset);
+    Bounds3f refitRecursive(int nodeIndex, int depth);
+    void buildPrimitiveBlocks();
+    bool readCache(const std::string &filename, uint64_t key);
+    void writeCache(const std::string &filename, uint64_t key, int nNodes,
+                    const std::vector<Primitive> &unorderedPrims) const;
+
+    friend class WideBVHAggregate;
+    friend class InstanceBVHAggregate;
 
     // BVHAggregate Private Members
     int maxPrimsInNode;
     std::vector<Primitive> primitives;
     SplitMethod splitMethod;
+    Float spatialSplitBudget;
+    bool anyHitShadowRays;
+    bool triangleBlocks, patchBlocks;
     LinearBVHNode *nodes = nullptr;
+    int nNodes = 0;
+    Float builtSAHCost = 0;
+};
+
+// WideBVHAggregate Definition
+class WideBVHAggregate {
+  public:
+    // WideBVHAggregate Public Constants
+    static constexpr int Width = 8;
+
+    // WideBVHAggregate Public Methods
+    WideBVHAggregate(
+        std::vector<Primitive> p, int maxPrimsInNode = 1,
+        BVHAggregate::SplitMethod splitMethod = BVHAggregate::SplitMethod::SAH,
+        Float spatialSplitBudget = 0.25f, bool quantize = false);
+
+    static WideBVHAggregate *Create(std::vector<Primitive> prims,
+                                    const ParameterDictionary &parameters);
+
+    Bounds3f Bounds() const { return bounds; }
+    pstd::optional<ShapeIntersection> Intersect(const Ray &ray, Float tMax) const;
+    bool IntersectP(const Ray &ray, Float tMax) const;
+
+  private:
+    // WideBVHAggregate Private Methods
+    int collapse(const LinearBVHNode *binaryNodes, int binaryNodeIndex,
+                 std::vector<WideBVHNode> &wideNodes);
+
+    // WideBVHAggregate Private Members
+    std::vector<Primitive> primitives;
+    Bounds3f bounds;
+    WideBVHNode *nodes = nullptr;
+    QuantizedWideBVHNode *quantizedNodes = nullptr;
+};
+
+// InstanceBVHAggregate Definition
+class InstanceBVHAggregate {
+  public:
+    // InstanceBVHAggregate::Instance Definition
+    struct Instance {
+        const Transform *renderFromInstance;
+        uint32_t prototype;
+    };
+
+    // InstanceBVHAggregate Public Methods
+    InstanceBVHAggregate(std::vector<Primitive> prototypes,
+                         std::vector<Instance> instances);
+    ~InstanceBVHAggregate();
+
+    Bounds3f Bounds() const;
+    pstd::optional<ShapeIntersection> Intersect(const Ray &ray, Float tMax) const;
+    bool IntersectP(const Ray &ray, Float tMax) const;
+
+  private:
+    // InstanceBVHAggregate Private Members
+    std::vector<Primitive> prototypes;
+    std::vector<Instance> instances;
+    LinearBVHNode *nodes = nullptr;
+    int nNodes = 0;
+};
+
+// MotionSegmentAggregate Definition
+// Divides the time range of a set of _AnimatedPrimitive_s into segments and
+// builds a BVH for each one using the primitives' motion bounds over just
+// that segment, so that rays are tested against bounds that are no looser
+// than the motion during their segment.
+class MotionSegmentAggregate {
+  public:
+    // MotionSegmentAggregate Public Methods
+    MotionSegmentAggregate(std::vector<Primitive> animatedPrimitives, int nSegments);
+
+    Bounds3f Bounds() const { return bounds; }
+    pstd::optional<ShapeIntersection> Intersect(const Ray &ray, Float tMax) const;
+    bool IntersectP(const Ray &ray, Float tMax) const;
+
+  private:
+    // MotionSegmentAggregate Private Methods
+    Primitive Segment(Float time) const {
+        if (segments.size() == 1)
+            return segments[0];
+        int segment = (time - startTime) / (endTime - startTime) * segments.size();
+        return segments[Clamp(segment, 0, int(segments.size()) - 1)];
+    }
+
+    // MotionSegmentAggregate Private Members
+    Float startTime, endTime;
+    std::vector<Primitive> segments;
+    Bounds3f bounds;
 };
 
 struct KdTreeNode;
@@ -88,11 +222,12 @@ class KdTreeAggregate {
 
   private:
     // KdTreeAggregate Private Methods
-    void buildTree(int nodeNum, const Bounds3f &bounds,
+    void buildTree(std::vector<KdTreeNode> *treeNodes,
+                   std::vector<int> *treePrimitiveIndices, const Bounds3f &bounds,
                    const std::vector<Bounds3f> &primBounds,
                    pstd::span<const int> primNums, int depth,
                    std::vector<BoundEdge> edges[3], pstd::span<int> prims0,
-                   pstd::span<int> prims1, int badRefines);
+                   pstd::span<int> prims1, int badRefines) const;
 
     // KdTreeAggregate Private Members
     int isectCost, traversalCost, maxPrims;
@@ -100,7 +235,6 @@ class KdTreeAggregate {
     std::vector<Primitive> primitives;
     std::vector<int> primitiveIndices;
     KdTreeNode *nodes;
-    int nAllocedNodes, nextFreeNode;
     Bounds3f bounds;
 };
 
@@ -0,0 +1,116 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/aggregates.h>
+#include <pbrt/cpu/primitive.h>
+#include <pbrt/shapes.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/mesh.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace pbrt;
+
+// The benchmark scenes are generated procedurally so that the results don't
+// depend on external files: a random triangle soup with both small and long,
+// thin triangles, and a height field tessellated into a regular grid, which
+// is closer to the coherent geometry of typical scenes.
+enum class BenchScene { Soup, Terrain };
+
+static std::vector<Primitive> ScenePrimitives(BenchScene scene) {
+    static Transform identity;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    RNG rng;
+    if (scene == BenchScene::Soup) {
+        for (int i = 0; i < 100000; ++i) {
+            Point3f center(Lerp(rng.Uniform<Float>(), -10, 10),
+                           Lerp(rng.Uniform<Float>(), -10, 10),
+                           Lerp(rng.Uniform<Float>(), -10, 10));
+            Float size = (i % 4 == 0) ? 2 : 0.1;
+            for (int v = 0; v < 3; ++v) {
+                Vector3f d =
+                    SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+                p.push_back(center + size * d);
+                indices.push_back(3 * i + v);
+            }
+        }
+    } else {
+        int n = 256;
+        for (int y = 0; y <= n; ++y)
+            for (int x = 0; x <= n; ++x) {
+                Float u = Lerp(Float(x) / n, -10, 10), v = Lerp(Float(y) / n, -10, 10);
+                p.push_back(Point3f(u, v, std::sin(u) * std::cos(0.7f * v)));
+            }
+        for (int y = 0; y < n; ++y)
+            for (int x = 0; x < n; ++x) {
+                int v00 = y * (n + 1) + x, v10 = v00 + 1;
+                int v01 = v00 + n + 1, v11 = v01 + 1;
+                indices.insert(indices.end(), {v00, v10, v11, v00, v11, v01});
+            }
+    }
+
+    TriangleMesh *mesh =
+        new TriangleMesh(identity, false, indices, p, {}, {}, {}, {}, Allocator());
+    std::vector<Primitive> prims;
+    for (Shape tri : Triangle::CreateTriangles(mesh, Allocator()))
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+    return prims;
+}
+
+// Returns rays from points around the scene toward random points inside it,
+// so that most of them hit something.
+static std::vector<Ray> SceneRays(int n) {
+    RNG rng(1);
+    std::vector<Ray> rays;
+    for (int i = 0; i < n; ++i) {
+        Vector3f d = SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+        Point3f o = Point3f(0, 0, 0) + 15 * d;
+        Point3f target(Lerp(rng.Uniform<Float>(), -5, 5),
+                       Lerp(rng.Uniform<Float>(), -5, 5), 0);
+        rays.push_back(Ray(o, Normalize(target - o)));
+    }
+    return rays;
+}
+
+static BVHAggregate *SceneBVH(BenchScene scene) {
+    static BVHAggregate *bvh[2];
+    if (!bvh[int(scene)])
+        bvh[int(scene)] = new BVHAggregate(ScenePrimitives(scene));
+    return bvh[int(scene)];
+}
+
+static void BVH_Intersect(benchmark::State &state, BenchScene scene) {
+    BVHAggregate *bvh = SceneBVH(scene);
+    std::vector<Ray> rays = SceneRays(4096);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bvh->Intersect(rays[i], Infinity));
+        i = (i + 1) % rays.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BVH_IntersectP(benchmark::State &state, BenchScene scene) {
+    BVHAggregate *bvh = SceneBVH(scene);
+    std::vector<Ray> rays = SceneRays(4096);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bvh->IntersectP(rays[i], Infinity));
+        i = (i + 1) % rays.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_CAPTURE(BVH_Intersect, Soup, BenchScene::Soup);
+BENCHMARK_CAPTURE(BVH_Intersect, Terrain, BenchScene::Terrain);
+BENCHMARK_CAPTURE(BVH_IntersectP, Soup, BenchScene::Soup);
+BENCHMARK_CAPTURE(BVH_IntersectP, Terrain, BenchScene::Terrain);
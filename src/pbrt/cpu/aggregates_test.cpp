@@ -0,0 +1,401 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/aggregates.h>
+#include <pbrt/cpu/primitive.h>
+#include <pbrt/interaction.h>
+#include <pbrt/materials.h>
+#include <pbrt/options.h>
+#include <pbrt/shapes.h>
+#include <pbrt/textures.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/mesh.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
+#include <pbrt/util/spectrum.h>
+#include <pbrt/util/transform.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace pbrt;
+
+// Returns primitives for a random triangle soup that includes both small
+// triangles and long, thin ones, optionally returning their mesh in _meshOut_.
+static std::vector<Primitive> RandomTriangles(int nTriangles, RNG &rng,
+                                              TriangleMesh **meshOut = nullptr) {
+    static Transform identity;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    for (int i = 0; i < nTriangles; ++i) {
+        Point3f center(Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10));
+        Float size = (i % 4 == 0) ? 8 : 0.5;
+        for (int v = 0; v < 3; ++v) {
+            Vector3f d =
+                SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+            p.push_back(center + size * d);
+            indices.push_back(3 * i + v);
+        }
+    }
+
+    TriangleMesh *mesh =
+        new TriangleMesh(identity, false, indices, p, {}, {}, {}, {}, Allocator());
+    if (meshOut)
+        *meshOut = mesh;
+    pstd::vector<Shape> tris = Triangle::CreateTriangles(mesh, Allocator());
+    std::vector<Primitive> prims;
+    for (Shape tri : tris)
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+    return prims;
+}
+
+static std::vector<Primitive> RandomBilinearPatches(int nPatches, RNG &rng) {
+    static Transform identity;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    for (int i = 0; i < nPatches; ++i) {
+        Point3f center(Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10));
+        Float size = (i % 4 == 0) ? 8 : 0.5;
+        for (int v = 0; v < 4; ++v) {
+            Vector3f d =
+                SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+            p.push_back(center + size * d);
+            indices.push_back(4 * i + v);
+        }
+    }
+
+    BilinearPatchMesh *mesh = new BilinearPatchMesh(identity, false, indices, p, {}, {},
+                                                    {}, nullptr, Allocator());
+    pstd::vector<Shape> blps = BilinearPatch::CreatePatches(mesh, Allocator());
+    std::vector<Primitive> prims;
+    for (Shape blp : blps)
+        prims.push_back(new SimplePrimitive(blp, nullptr));
+    return prims;
+}
+
+// Traces random rays against _accel_ and compares the results to brute-force
+// intersection tests against all of _prims_. Rays are given random times in
+// $[0,1]$ if _randomTimes_ is true.
+static void CheckAggregate(Primitive accel, const std::vector<Primitive> &prims,
+                           RNG &rng, bool randomTimes = false) {
+    for (int i = 0; i < 1000; ++i) {
+        Point3f o(Lerp(rng.Uniform<Float>(), -15, 15),
+                  Lerp(rng.Uniform<Float>(), -15, 15),
+                  Lerp(rng.Uniform<Float>(), -15, 15));
+        Vector3f d = SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+        Ray ray(o, d, randomTimes ? rng.Uniform<Float>() : 0);
+        Float tMax = (i & 1) ? Infinity : 10 * rng.Uniform<Float>();
+
+        Float tClosest = tMax;
+        pstd::optional<ShapeIntersection> closest;
+        for (const Primitive &prim : prims)
+            if (pstd::optional<ShapeIntersection> si = prim.Intersect(ray, tClosest)) {
+                tClosest = si->tHit;
+                closest = si;
+            }
+        bool anyHit = closest.has_value();
+
+        pstd::optional<ShapeIntersection> si = accel.Intersect(ray, tMax);
+        EXPECT_EQ(anyHit, (bool)si);
+        if (anyHit && si) {
+            EXPECT_EQ(tClosest, si->tHit);
+            // The interaction must be the closest hit's, however it was computed
+            if (tClosest == si->tHit) {
+                EXPECT_EQ(closest->intr.p(), si->intr.p());
+                EXPECT_EQ(closest->intr.uv, si->intr.uv);
+            }
+        }
+        EXPECT_EQ(anyHit, accel.IntersectP(ray, tMax));
+    }
+}
+
+TEST(BVHAggregate, BruteForce) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng);
+    Primitive bvh = new BVHAggregate(prims, 4);
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(WideBVHAggregate, BruteForce) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng);
+    Primitive bvh = new WideBVHAggregate(prims, 4);
+    EXPECT_EQ(Primitive(new BVHAggregate(prims, 4)).Bounds(), bvh.Bounds());
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(WideBVHAggregate, SinglePrimitive) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(1, rng);
+    Primitive bvh = new WideBVHAggregate(prims);
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(BVHAggregate, SBVHBruteForce) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng);
+    Primitive bvh = new BVHAggregate(prims, 4, BVHAggregate::SplitMethod::SBVH);
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(BVHAggregate, Cache) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng);
+    std::vector<std::string> existing = MatchingFilenames("./bvh-");
+    Options->bvhCacheDirectory = ".";
+
+    // The first BVH writes the cache file and the second one reads it
+    Primitive built = new BVHAggregate(prims, 4);
+    std::vector<std::string> written;
+    for (const std::string &fn : MatchingFilenames("./bvh-"))
+        if (std::find(existing.begin(), existing.end(), fn) == existing.end())
+            written.push_back(fn);
+    EXPECT_EQ(1, written.size());
+    Primitive cached = new BVHAggregate(prims, 4);
+
+    Options->bvhCacheDirectory.clear();
+    for (const std::string &fn : written)
+        EXPECT_TRUE(RemoveFile(fn));
+
+    EXPECT_EQ(built.Bounds(), cached.Bounds());
+    CheckAggregate(cached, prims, rng);
+}
+
+TEST(MotionSegmentAggregate, BruteForce) {
+    RNG rng;
+    std::vector<Primitive> animatedPrims;
+    for (Primitive prim : RandomTriangles(500, rng)) {
+        // Move and rotate each triangle over the shutter interval
+        Vector3f delta(Lerp(rng.Uniform<Float>(), -4, 4),
+                       Lerp(rng.Uniform<Float>(), -4, 4),
+                       Lerp(rng.Uniform<Float>(), -4, 4));
+        Vector3f axis = SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+        AnimatedTransform renderFromPrimitive(
+            Transform(), 0, Translate(delta) * Rotate(120 * rng.Uniform<Float>(), axis),
+            1);
+        animatedPrims.push_back(new AnimatedPrimitive(prim, renderFromPrimitive));
+    }
+
+    for (int nSegments : {1, 4, 16}) {
+        Primitive accel = new MotionSegmentAggregate(animatedPrims, nSegments);
+        CheckAggregate(accel, animatedPrims, rng, true);
+    }
+}
+
+TEST(BVHAggregate, Refit) {
+    // Use a distinct seed so that the mesh's vertex buffer isn't shared with
+    // other tests' meshes via BufferCache.
+    RNG rng(7);
+    TriangleMesh *mesh;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng, &mesh);
+    BVHAggregate *bvh = new BVHAggregate(prims, 4);
+
+    // Move all of the triangles' vertices and refit the BVH
+    Point3f *p = const_cast<Point3f *>(mesh->p);
+    for (int i = 0; i < mesh->nVertices; ++i)
+        p[i] = Point3f(2 * p[i].y, p[i].z + 1, -p[i].x);
+    EXPECT_FALSE(bvh->Refit());
+    CheckAggregate(bvh, prims, rng);
+
+    // Scattering the vertices should degrade the BVH enough to trigger a rebuild
+    for (int i = 0; i < mesh->nVertices; ++i)
+        p[i] = Point3f(Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10),
+                       Lerp(rng.Uniform<Float>(), -10, 10));
+    EXPECT_TRUE(bvh->Refit(1.5f));
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(WideBVHAggregate, Quantized) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng);
+    Primitive bvh = new WideBVHAggregate(prims, 4, BVHAggregate::SplitMethod::SAH,
+                                         0.25f, true /* quantize */);
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(BVHAggregate, Packets) {
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng);
+    BVHAggregate *bvh = new BVHAggregate(prims, 4);
+
+    for (int p = 0; p < 100; ++p) {
+        // Generate a packet of rays with nearby origins and a random count
+        int n = 1 + rng.Uniform<int>(BVHAggregate::MaxPacketSize);
+        Point3f o(Lerp(rng.Uniform<Float>(), -15, 15),
+                  Lerp(rng.Uniform<Float>(), -15, 15),
+                  Lerp(rng.Uniform<Float>(), -15, 15));
+        Ray rays[BVHAggregate::MaxPacketSize];
+        Float tMax[BVHAggregate::MaxPacketSize];
+        for (int i = 0; i < n; ++i) {
+            Vector3f d =
+                SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+            rays[i] = Ray(o + Vector3f(rng.Uniform<Float>(), 0, 0), d);
+            tMax[i] = (i & 1) ? Infinity : 10 * rng.Uniform<Float>();
+        }
+
+        bool hit[BVHAggregate::MaxPacketSize];
+        bvh->IntersectPPacket(n, rays, tMax, hit);
+        pstd::optional<ShapeIntersection> si[BVHAggregate::MaxPacketSize];
+        std::vector<Float> tOriginal(tMax, tMax + n);
+        bvh->IntersectPacket(n, rays, tMax, si);
+
+        for (int i = 0; i < n; ++i) {
+            pstd::optional<ShapeIntersection> expected =
+                bvh->Intersect(rays[i], tOriginal[i]);
+            EXPECT_EQ((bool)expected, (bool)si[i]);
+            EXPECT_EQ((bool)expected, hit[i]);
+            if (expected && si[i]) {
+                EXPECT_EQ(expected->tHit, si[i]->tHit);
+                EXPECT_EQ(expected->tHit, tMax[i]);
+            }
+        }
+    }
+}
+
+TEST(BVHAggregate, TriangleBlocks) {
+    RNG rng(11);
+    TriangleMesh *mesh;
+    std::vector<Primitive> prims = RandomTriangles(2000, rng, &mesh);
+    BVHAggregate *bvh = new BVHAggregate(prims, 4, BVHAggregate::SplitMethod::SAH,
+                                         0.25f, true, true /* triangleBlocks */);
+    CheckAggregate(bvh, prims, rng);
+
+    // Blocks must pick up vertex positions that change before a refit
+    Point3f *p = const_cast<Point3f *>(mesh->p);
+    for (int i = 0; i < mesh->nVertices; ++i)
+        p[i] = Point3f(-p[i].z, 2 * p[i].x, p[i].y);
+    bvh->Refit();
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(MeshTrianglePrimitive, BruteForce) {
+    RNG rng(17);
+    TriangleMesh *mesh;
+    RandomTriangles(2000, rng, &mesh);
+    static ConstantSpectrum cs(0.5);
+    Material material =
+        new DiffuseMaterial(new SpectrumConstantTexture(&cs), nullptr, nullptr);
+    pstd::vector<Shape> tris = Triangle::CreateTriangles(mesh, Allocator());
+    std::vector<Primitive> prims = MeshTrianglePrimitive::CreatePrimitives(
+        pstd::span<const Shape>(tris), material, MediumInterface(), Allocator());
+    ASSERT_EQ(tris.size(), prims.size());
+
+    for (bool triangleBlocks : {false, true}) {
+        BVHAggregate *bvh = new BVHAggregate(prims, 4, BVHAggregate::SplitMethod::SAH,
+                                             0.25f, true, triangleBlocks);
+        CheckAggregate(bvh, prims, rng);
+
+        // Intersections must have the mesh's material
+        for (int i = 0; i < 100; ++i) {
+            Vector3f d =
+                SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+            pstd::optional<ShapeIntersection> si =
+                bvh->Intersect(Ray(Point3f(), d), Infinity);
+            if (si) {
+                EXPECT_EQ(material, si->intr.material);
+            }
+        }
+    }
+}
+
+TEST(BVHAggregate, PatchBlocks) {
+    RNG rng(13);
+    std::vector<Primitive> prims = RandomBilinearPatches(2000, rng);
+    std::vector<Primitive> tris = RandomTriangles(500, rng);
+    prims.insert(prims.end(), tris.begin(), tris.end());
+    BVHAggregate *bvh =
+        new BVHAggregate(prims, 4, BVHAggregate::SplitMethod::SAH, 0.25f, true,
+                         true /* triangleBlocks */, true /* patchBlocks */);
+    CheckAggregate(bvh, prims, rng);
+}
+
+TEST(KdTreeAggregate, BruteForce) {
+    // Use enough primitives that subtrees near the root are built in parallel
+    RNG rng;
+    std::vector<Primitive> prims = RandomTriangles(40000, rng);
+    Primitive kdtree = new KdTreeAggregate(prims);
+    CheckAggregate(kdtree, prims, rng);
+}
+
+TEST(InstanceBVHAggregate, BruteForce) {
+    RNG rng;
+    std::vector<Primitive> prototypes;
+    for (int i = 0; i < 3; ++i)
+        prototypes.push_back(new BVHAggregate(RandomTriangles(50, rng)));
+
+    // Compare against the equivalent _TransformedPrimitive_s
+    int nInstances = 200;
+    std::vector<Transform> *transforms = new std::vector<Transform>;
+    transforms->reserve(nInstances);
+    std::vector<InstanceBVHAggregate::Instance> instances;
+    std::vector<Primitive> transformedPrims;
+    for (int i = 0; i < nInstances; ++i) {
+        Vector3f delta(Lerp(rng.Uniform<Float>(), -20, 20),
+                       Lerp(rng.Uniform<Float>(), -20, 20),
+                       Lerp(rng.Uniform<Float>(), -20, 20));
+        Float scale = Lerp(rng.Uniform<Float>(), 0.1, 0.5);
+        transforms->push_back(Translate(delta) * RotateY(360 * rng.Uniform<Float>()) *
+                              Scale(scale, scale, scale));
+        uint32_t prototype = rng.Uniform<uint32_t>(prototypes.size());
+        instances.push_back({&transforms->back(), prototype});
+        transformedPrims.push_back(
+            new TransformedPrimitive(prototypes[prototype], &transforms->back()));
+    }
+
+    Primitive accel = new InstanceBVHAggregate(prototypes, instances);
+    CheckAggregate(accel, transformedPrims, rng);
+}
+
+TEST(LazyPrimitive, Eviction) {
+    // With a tiny memory budget, the two lazy primitives' geometry is
+    // repeatedly evicted and re-created as rays alternate between them.
+    LazyPrimitive::SetMemoryBudget(1);
+    std::vector<Primitive> prims, lazyPrims;
+    for (int seed : {3, 4}) {
+        RNG rng(seed);
+        std::vector<Primitive> tris = RandomTriangles(500, rng);
+        prims.insert(prims.end(), tris.begin(), tris.end());
+        lazyPrims.push_back(new LazyPrimitive([seed](Allocator alloc) {
+            RNG rng(seed);
+            return RandomTriangles(500, rng);
+        }));
+        EXPECT_EQ(Primitive(new BVHAggregate(tris)).Bounds(), lazyPrims.back().Bounds());
+    }
+
+    RNG rng;
+    CheckAggregate(new BVHAggregate(lazyPrims), prims, rng);
+    LazyPrimitive::SetMemoryBudget(0);
+}
+
+TEST(LazyPrimitive, KnownBounds) {
+    // Geometry with known bounds isn't created until a ray reaches it.
+    RNG rng(5);
+    std::vector<Primitive> tris = RandomTriangles(500, rng);
+    Bounds3f bounds = Primitive(new BVHAggregate(tris)).Bounds();
+    std::atomic<int> nCreated{0};
+    Primitive lazy = new LazyPrimitive(
+        [&nCreated](Allocator alloc) {
+            ++nCreated;
+            RNG rng(5);
+            return RandomTriangles(500, rng);
+        },
+        bounds);
+    EXPECT_EQ(bounds, lazy.Bounds());
+    EXPECT_EQ(0, nCreated);
+
+    CheckAggregate(lazy, tris, rng);
+    EXPECT_EQ(1, nCreated);
+}
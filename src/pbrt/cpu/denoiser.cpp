@@ -0,0 +1,177 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/cpu/denoiser.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/color.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
+#include <pbrt/util/vecmath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace pbrt {
+
+STAT_COUNTER("Denoiser/Images denoised", nImagesDenoised);
+
+// FeatureDenoiser Method Definitions
+bool FeatureDenoiser::HasFeatures(const Image &image) {
+    return image.GetChannelDesc({"R", "G", "B"}) &&
+           image.GetChannelDesc({"Albedo.R", "Albedo.G", "Albedo.B"}) &&
+           image.GetChannelDesc({"Ns.X", "Ns.Y", "Ns.Z"}) &&
+           image.GetChannelDesc({"P.Z"}) && image.GetChannelDesc({"dzdx", "dzdy"}) &&
+           image.GetChannelDesc({"Variance.R", "Variance.G", "Variance.B"});
+}
+
+Image FeatureDenoiser::Denoise(const Image &image, int samplesPerPixel) const {
+    CHECK(HasFeatures(image));
+    ++nImagesDenoised;
+    Point2i res = image.Resolution();
+    ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
+    ImageChannelDesc albedoDesc =
+        image.GetChannelDesc({"Albedo.R", "Albedo.G", "Albedo.B"});
+    ImageChannelDesc nsDesc = image.GetChannelDesc({"Ns.X", "Ns.Y", "Ns.Z"});
+    ImageChannelDesc zDesc = image.GetChannelDesc({"P.Z", "dzdx", "dzdy"});
+    ImageChannelDesc varianceDesc =
+        image.GetChannelDesc({"Variance.R", "Variance.G", "Variance.B"});
+
+    // Gather the filter's inputs, dividing albedo out of the color
+    struct Feature {
+        RGB albedo;
+        Normal3f n;
+        Float z, dzdx, dzdy;
+        bool surface;
+    };
+    std::vector<Feature> features(res.x * res.y);
+    std::vector<RGB> irradiance(res.x * res.y), filtered(res.x * res.y);
+    std::vector<Float> variance(res.x * res.y), filteredVariance(res.x * res.y);
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
+            Point2i p(x, y);
+            int i = y * res.x + x;
+            ImageChannelValues rgb = image.GetChannels(p, rgbDesc);
+            ImageChannelValues albedo = image.GetChannels(p, albedoDesc);
+            ImageChannelValues ns = image.GetChannels(p, nsDesc);
+            ImageChannelValues z = image.GetChannels(p, zDesc);
+            ImageChannelValues var = image.GetChannels(p, varianceDesc);
+
+            Feature &f = features[i];
+            f.n = Normal3f(ns[0], ns[1], ns[2]);
+            f.surface = LengthSquared(f.n) > 0;
+            if (f.surface)
+                f.n = Normalize(f.n);
+            f.z = z[0];
+            f.dzdx = z[1];
+            f.dzdy = z[2];
+
+            // Pixels that did not see a surface, or a channel without any
+            // reflection, keep their color as is
+            Float varianceSum = 0;
+            for (int c = 0; c < 3; ++c) {
+                f.albedo[c] = albedo[c] > 1e-3f ? albedo[c] : 1;
+                irradiance[i][c] = rgb[c] / f.albedo[c];
+                varianceSum += var[c] / Sqr(f.albedo[c]);
+            }
+            // Variance of the pixel's estimate of the illumination's average
+            variance[i] = varianceSum / (9 * std::max(1, samplesPerPixel));
+        }
+    });
+
+    // Apply the a-trous filter, doubling the spacing of its taps each iteration
+    const Float kernel[3] = {3.f / 8, 1.f / 4, 1.f / 16};
+    const Float sigmaDepth = 1, sigmaNormal = 128, sigmaLuminance = 4;
+    for (int iter = 0; iter < iterations; ++iter) {
+        int step = 1 << iter;
+        ParallelFor(0, res.y, [&](int64_t y) {
+            for (int x = 0; x < res.x; ++x) {
+                int i = y * res.x + x;
+                const Feature &fp = features[i];
+                if (!fp.surface) {
+                    filtered[i] = irradiance[i];
+                    filteredVariance[i] = variance[i];
+                    continue;
+                }
+                Float lp = irradiance[i].Average();
+                Float lumScale = sigmaLuminance * SafeSqrt(variance[i]) + 1e-6f;
+
+                RGB sum(0, 0, 0);
+                Float weightSum = 0, varianceSum = 0;
+                for (int dy = -2; dy <= 2; ++dy)
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        int xq = x + step * dx, yq = y + step * dy;
+                        if (xq < 0 || xq >= res.x || yq < 0 || yq >= res.y)
+                            continue;
+                        int q = yq * res.x + xq;
+                        const Feature &fq = features[q];
+                        if (!fq.surface)
+                            continue;
+
+                        // Weight the tap by how similar its depth, normal and
+                        // illumination are to the center pixel's
+                        Float depthScale = sigmaDepth * step *
+                                               (std::abs(dx) * fp.dzdx +
+                                                std::abs(dy) * fp.dzdy) +
+                                           1e-3f * std::abs(fp.z);
+                        Float wz = std::abs(fp.z - fq.z) / std::max<Float>(depthScale,
+                                                                            1e-6f);
+                        Float wn = std::pow(std::max<Float>(0, Dot(fp.n, fq.n)),
+                                            sigmaNormal);
+                        Float wl = std::abs(lp - irradiance[q].Average()) / lumScale;
+                        Float w =
+                            kernel[std::abs(dx)] * kernel[std::abs(dy)] * wn *
+                            FastExp(-wz - wl);
+
+                        sum += w * irradiance[q];
+                        weightSum += w;
+                        varianceSum += Sqr(w) * variance[q];
+                    }
+                // The center tap always has a positive weight
+                filtered[i] = sum / weightSum;
+                filteredVariance[i] = varianceSum / Sqr(weightSum);
+            }
+        });
+        std::swap(irradiance, filtered);
+        std::swap(variance, filteredVariance);
+    }
+
+    // Multiply albedo back in to find the denoised image
+    Image result(PixelFormat::Float, res, {"R", "G", "B"});
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
+            int i = y * res.x + x;
+            RGB rgb = irradiance[i] * features[i].albedo;
+            for (int c = 0; c < 3; ++c)
+                result.SetChannel({x, int(y)}, c, rgb[c]);
+        }
+    });
+    return result;
+}
+
+std::string FeatureDenoiser::ToString() const {
+    return StringPrintf("[ FeatureDenoiser iterations: %d ]", iterations);
+}
+
+Float RelativeMSE(const Image &a, const Image &b) {
+    CHECK(a.Resolution() == b.Resolution());
+    ImageChannelDesc aDesc = a.GetChannelDesc({"R", "G", "B"});
+    ImageChannelDesc bDesc = b.GetChannelDesc({"R", "G", "B"});
+    CHECK(aDesc && bDesc);
+    Point2i res = a.Resolution();
+    double sum = 0;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            ImageChannelValues va = a.GetChannels({x, y}, aDesc);
+            ImageChannelValues vb = b.GetChannels({x, y}, bDesc);
+            for (int c = 0; c < 3; ++c)
+                sum += Sqr(va[c] - vb[c]) / (Sqr(vb[c]) + 1e-2f);
+        }
+    return sum / (3 * std::max(1, res.x * res.y));
+}
+
+}  // namespace pbrt
@@ -0,0 +1,50 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_CPU_DENOISER_H
+#define PBRT_CPU_DENOISER_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/image.h>
+
+#include <string>
+
+namespace pbrt {
+
+// FeatureDenoiser Definition
+// Denoises images written by the GBufferFilm with an edge-avoiding a-trous
+// wavelet filter, following "Spatiotemporal Variance-Guided Filtering"
+// (Schied et al. 2017). It takes the same inputs as OIDN's ray tracing
+// filter--the noisy color along with the first hit's albedo and shading
+// normal--plus the first hit's depth and the color's variance. The
+// illumination is filtered with albedo divided out, so that texture detail
+// isn't blurred.
+class FeatureDenoiser {
+  public:
+    // FeatureDenoiser Public Methods
+    FeatureDenoiser(int iterations = 5) : iterations(iterations) {}
+
+    // Returns whether _image_ has the channels that Denoise() uses.
+    static bool HasFeatures(const Image &image);
+
+    // Returns an RGB image holding the denoised color of _image_, which was
+    // rendered with _samplesPerPixel_ samples in each pixel.
+    Image Denoise(const Image &image, int samplesPerPixel) const;
+
+    std::string ToString() const;
+
+  private:
+    // FeatureDenoiser Private Members
+    int iterations;
+};
+
+// Returns the relative mean squared difference between the RGB images _a_ and
+// _b_, which is used to detect when successive denoised estimates of an image
+// have converged.
+Float RelativeMSE(const Image &a, const Image &b);
+
+}  // namespace pbrt
+
+#endif  // PBRT_CPU_DENOISER_H
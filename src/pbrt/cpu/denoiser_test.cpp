@@ -0,0 +1,64 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/denoiser.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/rng.h>
+
+using namespace pbrt;
+
+// Returns an image with the channels that the GBufferFilm writes for a plane
+// facing the camera whose left and right halves have normals _nLeft_ and
+// _nRight_; the color is _left_ or _right_ plus uniform noise of the given
+// amplitude.
+static Image GBufferImage(Float left, Float right, Normal3f nLeft, Normal3f nRight,
+                          Float noise, RNG &rng) {
+    Point2i res(32, 32);
+    Image image(PixelFormat::Float, res,
+                {"R", "G", "B", "Albedo.R", "Albedo.G", "Albedo.B", "P.Z", "dzdx",
+                 "dzdy", "Ns.X", "Ns.Y", "Ns.Z", "Variance.R", "Variance.G",
+                 "Variance.B"});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            bool isLeft = x < res.x / 2;
+            Float v = (isLeft ? left : right) + noise * (rng.Uniform<Float>() - 0.5f);
+            Normal3f n = isLeft ? nLeft : nRight;
+            Float var = Sqr(noise) / 12;
+            image.SetChannels({x, y}, {v, v, v, 1, 1, 1, 1, 0, 0, n.x, n.y, n.z, var,
+                                       var, var});
+        }
+    return image;
+}
+
+TEST(FeatureDenoiser, ReducesNoise) {
+    RNG rng;
+    Image image = GBufferImage(0.5, 0.5, Normal3f(0, 0, 1), Normal3f(0, 0, 1), 0.2, rng);
+    ASSERT_TRUE(FeatureDenoiser::HasFeatures(image));
+    Image denoised = FeatureDenoiser().Denoise(image, 1);
+
+    Image reference(PixelFormat::Float, image.Resolution(), {"R", "G", "B"});
+    Image noisy(PixelFormat::Float, image.Resolution(), {"R", "G", "B"});
+    for (int y = 0; y < 32; ++y)
+        for (int x = 0; x < 32; ++x)
+            for (int c = 0; c < 3; ++c) {
+                reference.SetChannel({x, y}, c, 0.5f);
+                noisy.SetChannel({x, y}, c, image.GetChannel({x, y}, c));
+            }
+    EXPECT_LT(RelativeMSE(denoised, reference), 0.25f * RelativeMSE(noisy, reference));
+    EXPECT_EQ(0, RelativeMSE(reference, reference));
+}
+
+TEST(FeatureDenoiser, PreservesNormalEdges) {
+    RNG rng;
+    Image image = GBufferImage(1, 0, Normal3f(0, 0, 1), Normal3f(1, 0, 0), 0, rng);
+    Image denoised = FeatureDenoiser().Denoise(image, 1);
+    for (int y = 0; y < 32; ++y) {
+        EXPECT_FLOAT_EQ(1, denoised.GetChannel({15, y}, 0));
+        EXPECT_FLOAT_EQ(0, denoised.GetChannel({16, y}, 0));
+    }
+}
@@ -0,0 +1,437 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/cpu/distributed.h>
+
+#include <pbrt/cameras.h>
+#include <pbrt/film.h>
+#include <pbrt/options.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/stats.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef PBRT_IS_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Ws2tcpip.h>
+#include <winsock2.h>
+#undef NOMINMAX
+using socket_t = SOCKET;
+#else
+using socket_t = int;
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define SOCKET_ERROR (-1)
+#define INVALID_SOCKET (-1)
+#endif
+
+namespace pbrt {
+
+STAT_COUNTER("Distributed/Tiles rendered by workers", nDistributedTiles);
+STAT_COUNTER("Distributed/Tiles reassigned after worker failures", nReassignedTiles);
+
+// As with the display server protocol, each message starts with its length
+// in bytes, including the length itself, followed by a one-byte directive
+// and the directive's values. Values are sent in the host's byte order, so
+// all of the machines must have the same endianness.
+enum DistributedDirective : uint8_t {
+    // Worker to coordinator: pixel bounds, samples per pixel and seed
+    Hello = 0,
+    // Coordinator to worker: the reason the worker's render doesn't match
+    Reject = 1,
+    // Coordinator to worker: tile bounds and sample range to render
+    RenderTile = 2,
+    // Worker to coordinator: tile bounds, sample range, and the pixel sums
+    TileResult = 3,
+    // Coordinator to worker: all of the image's samples have been rendered
+    Finished = 4,
+};
+
+// Distributed Rendering Local Functions
+static int closeSocket(socket_t socket) {
+#ifdef PBRT_IS_WINDOWS
+    return closesocket(socket);
+#else
+    return close(socket);
+#endif
+}
+
+static void initSockets() {
+#ifdef PBRT_IS_WINDOWS
+    WSADATA wsaData;
+    int err = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (err != NO_ERROR)
+        ErrorExit("Unable to initialize WinSock: %s", ErrorString(err));
+#else
+    // Failed sends are handled where they happen
+    signal(SIGPIPE, SIG_IGN);
+#endif
+}
+
+static void cleanupSockets() {
+#ifdef PBRT_IS_WINDOWS
+    WSACleanup();
+#endif
+}
+
+template <typename T>
+static void append(std::string *message, T value) {
+    message->append((const char *)&value, sizeof(T));
+}
+
+template <typename T>
+static bool extract(const std::string &message, size_t *offset, T *value) {
+    if (*offset + sizeof(T) > message.size())
+        return false;
+    std::memcpy(value, message.data() + *offset, sizeof(T));
+    *offset += sizeof(T);
+    return true;
+}
+
+static void appendBounds(std::string *message, const Bounds2i &b) {
+    for (int v : {b.pMin.x, b.pMin.y, b.pMax.x, b.pMax.y})
+        append<int32_t>(message, v);
+}
+
+static bool extractBounds(const std::string &message, size_t *offset, Bounds2i *b) {
+    int32_t v[4];
+    for (int i = 0; i < 4; ++i)
+        if (!extract(message, offset, &v[i]))
+            return false;
+    *b = Bounds2i(Point2i(v[0], v[1]), Point2i(v[2], v[3]));
+    return true;
+}
+
+static bool sendMessage(socket_t socket, DistributedDirective directive,
+                        const std::string &values) {
+    std::string message;
+    append<int32_t>(&message, sizeof(int32_t) + 1 + values.size());
+    append<uint8_t>(&message, directive);
+    message += values;
+
+    size_t offset = 0;
+    while (offset < message.size()) {
+        int bytesSent = send(socket, message.data() + offset,
+                             int(message.size() - offset), 0 /* flags */);
+        if (bytesSent <= 0) {
+            LOG_VERBOSE("send() failed: %s", ErrorString());
+            return false;
+        }
+        offset += bytesSent;
+    }
+    return true;
+}
+
+static bool receiveBytes(socket_t socket, char *ptr, size_t size) {
+    while (size > 0) {
+        int bytesReceived = recv(socket, ptr, int(size), 0 /* flags */);
+        if (bytesReceived <= 0) {
+            if (bytesReceived < 0)
+                LOG_VERBOSE("recv() failed: %s", ErrorString());
+            return false;
+        }
+        ptr += bytesReceived;
+        size -= bytesReceived;
+    }
+    return true;
+}
+
+static bool receiveMessage(socket_t socket, DistributedDirective *directive,
+                           std::string *values) {
+    int32_t size;
+    uint8_t d;
+    if (!receiveBytes(socket, (char *)&size, sizeof(size)) ||
+        size < int32_t(sizeof(size) + 1) || !receiveBytes(socket, (char *)&d, 1))
+        return false;
+    *directive = DistributedDirective(d);
+    values->resize(size - sizeof(size) - 1);
+    return receiveBytes(socket, values->data(), values->size());
+}
+
+// DistributedWorkItem Definition
+struct DistributedWorkItem {
+    Bounds2i tileBounds;
+    int sampleStart, sampleEnd;
+};
+
+// Distributed Rendering Function Definitions
+void RunDistributedCoordinator(const std::string &port, Camera camera, int spp) {
+    initSockets();
+    Film film = camera.GetFilm();
+    Bounds2i pixelBounds = film.PixelBounds();
+
+    // Split the image into tiles and the tiles' samples into ranges of at
+    // most 64; the tiles are handed out in scanline order for each range so
+    // that the early ranges give a preview of the whole image.
+    constexpr int tileSize = 128, maxSamplesPerItem = 64;
+    std::deque<DistributedWorkItem> pendingItems;
+    for (int sampleStart = 0; sampleStart < spp; sampleStart += maxSamplesPerItem)
+        for (int y = pixelBounds.pMin.y; y < pixelBounds.pMax.y; y += tileSize)
+            for (int x = pixelBounds.pMin.x; x < pixelBounds.pMax.x; x += tileSize) {
+                Point2i pMax = Min(Point2i(x + tileSize, y + tileSize), pixelBounds.pMax);
+                int sampleEnd = std::min(spp, sampleStart + maxSamplesPerItem);
+                pendingItems.push_back(
+                    {Bounds2i(Point2i(x, y), pMax), sampleStart, sampleEnd});
+            }
+
+    // Listen for workers
+    struct addrinfo hints = {}, *addrinfo;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (int err = getaddrinfo(nullptr, port.c_str(), &hints, &addrinfo); err)
+        ErrorExit("%s: %s", port, gai_strerror(err));
+    socket_t listenSocket =
+        socket(addrinfo->ai_family, addrinfo->ai_socktype, addrinfo->ai_protocol);
+    if (listenSocket == INVALID_SOCKET)
+        ErrorExit("socket() failed: %s", ErrorString());
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse,
+               sizeof(reuse));
+    if (bind(listenSocket, addrinfo->ai_addr, addrinfo->ai_addrlen) == SOCKET_ERROR ||
+        listen(listenSocket, 64) == SOCKET_ERROR)
+        ErrorExit("Unable to listen on port %s: %s", port, ErrorString());
+    freeaddrinfo(addrinfo);
+    LOG_VERBOSE("Waiting for workers on port %s", port);
+
+    // _mutex_ protects the work queue and the film's pixels
+    std::mutex mutex;
+    std::condition_variable itemsChanged;
+    size_t nRemainingItems = pendingItems.size();
+    // The statistics are counted here, since the workers' threads don't
+    // report their own
+    int64_t nTilesReceived = 0, nTilesReassigned = 0;
+    ProgressReporter progress(int64_t(spp) * pixelBounds.Area(), "Rendering",
+                              Options->quiet);
+    MetricsProgressScope metricsProgress(progress);
+
+    // Serve each worker on its own thread, giving it one work item at a time
+    auto serveWorker = [&](socket_t workerSocket) {
+        DistributedDirective directive;
+        std::string values;
+        int32_t workerBounds[4], workerSpp, workerSeed;
+        size_t offset = 0;
+        if (!receiveMessage(workerSocket, &directive, &values) || directive != Hello ||
+            !extract(values, &offset, &workerBounds[0]) ||
+            !extract(values, &offset, &workerBounds[1]) ||
+            !extract(values, &offset, &workerBounds[2]) ||
+            !extract(values, &offset, &workerBounds[3]) ||
+            !extract(values, &offset, &workerSpp) ||
+            !extract(values, &offset, &workerSeed)) {
+            Warning("Ignoring connection that didn't identify itself as a worker.");
+            closeSocket(workerSocket);
+            return;
+        }
+        Bounds2i bounds(Point2i(workerBounds[0], workerBounds[1]),
+                        Point2i(workerBounds[2], workerBounds[3]));
+        if (bounds != pixelBounds || workerSpp != spp || workerSeed != Options->seed) {
+            std::string reason = StringPrintf(
+                "Worker's pixel bounds %s, %d spp and seed %d don't match the "
+                "coordinator's %s, %d spp and seed %d.",
+                bounds, workerSpp, workerSeed, pixelBounds, spp, Options->seed);
+            Warning("Rejecting worker: %s", reason);
+            sendMessage(workerSocket, Reject, reason);
+            closeSocket(workerSocket);
+            return;
+        }
+
+        while (true) {
+            DistributedWorkItem item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // Wait for work, which may be returned to the queue if
+                // another worker fails, or for the image to be finished
+                itemsChanged.wait(lock, [&]() {
+                    return !pendingItems.empty() || nRemainingItems == 0;
+                });
+                if (nRemainingItems == 0)
+                    break;
+                item = pendingItems.front();
+                pendingItems.pop_front();
+            }
+
+            std::string request;
+            appendBounds(&request, item.tileBounds);
+            append<int32_t>(&request, item.sampleStart);
+            append<int32_t>(&request, item.sampleEnd);
+            Bounds2i resultBounds;
+            int32_t sampleStart, sampleEnd;
+            offset = 0;
+            bool succeeded =
+                sendMessage(workerSocket, RenderTile, request) &&
+                receiveMessage(workerSocket, &directive, &values) &&
+                directive == TileResult &&
+                extractBounds(values, &offset, &resultBounds) &&
+                extract(values, &offset, &sampleStart) &&
+                extract(values, &offset, &sampleEnd) &&
+                resultBounds == item.tileBounds && sampleStart == item.sampleStart &&
+                sampleEnd == item.sampleEnd;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (succeeded)
+                succeeded = film.AddPixels(item.tileBounds, values.substr(offset));
+            if (!succeeded) {
+                // Give the tile to another worker
+                Warning("Lost connection to a worker; reassigning tile %s.",
+                        item.tileBounds);
+                ++nTilesReassigned;
+                pendingItems.push_front(item);
+                itemsChanged.notify_one();
+                closeSocket(workerSocket);
+                return;
+            }
+            ++nTilesReceived;
+            progress.Update(int64_t(item.sampleEnd - item.sampleStart) *
+                            item.tileBounds.Area());
+            if (--nRemainingItems == 0)
+                itemsChanged.notify_all();
+        }
+        sendMessage(workerSocket, Finished, {});
+        closeSocket(workerSocket);
+    };
+
+    // Accept workers until the image is finished, checking periodically
+    // whether it is
+    std::vector<std::thread> workerThreads;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (nRemainingItems == 0)
+                break;
+        }
+        fd_set readSockets;
+        FD_ZERO(&readSockets);
+        FD_SET(listenSocket, &readSockets);
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 250000;
+        if (select(int(listenSocket) + 1, &readSockets, nullptr, nullptr, &timeout) <= 0)
+            continue;
+        socket_t workerSocket = accept(listenSocket, nullptr, nullptr);
+        if (workerSocket == INVALID_SOCKET) {
+            LOG_VERBOSE("accept() failed: %s", ErrorString());
+            continue;
+        }
+        LOG_VERBOSE("Accepted worker %d", int(workerThreads.size()));
+        workerThreads.push_back(std::thread(serveWorker, workerSocket));
+    }
+    closeSocket(listenSocket);
+    for (std::thread &thread : workerThreads)
+        thread.join();
+    cleanupSockets();
+    progress.Done();
+    nDistributedTiles += nTilesReceived;
+    nReassignedTiles += nTilesReassigned;
+
+    ImageMetadata metadata;
+    metadata.renderTimeSeconds = progress.ElapsedSeconds();
+    metadata.samplesPerPixel = spp;
+    camera.InitMetadata(&metadata);
+    film.WriteImage(metadata, 1.0f / spp);
+}
+
+void RunDistributedWorker(
+    const std::string &address, Film film, int spp,
+    std::function<void(Bounds2i tileBounds, int sampleStart, int sampleEnd)>
+        renderTile) {
+    size_t split = address.find_last_of(':');
+    if (split == std::string::npos)
+        ErrorExit("Expected \"host:port\" for coordinator address. Given \"%s\".",
+                  address);
+    std::string host = address.substr(0, split), port = address.substr(split + 1);
+
+    // Connect to the coordinator, allowing a minute for it to start
+    initSockets();
+    socket_t coordinatorSocket = INVALID_SOCKET;
+    for (int attempt = 0; attempt < 60 && coordinatorSocket == INVALID_SOCKET;
+         ++attempt) {
+        if (attempt > 0)
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        struct addrinfo hints = {}, *addrinfo;
+        hints.ai_family = PF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &addrinfo); err)
+            ErrorExit("%s: %s", address, gai_strerror(err));
+        for (struct addrinfo *ptr = addrinfo; ptr; ptr = ptr->ai_next) {
+            coordinatorSocket =
+                socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+            if (coordinatorSocket == INVALID_SOCKET)
+                continue;
+            if (connect(coordinatorSocket, ptr->ai_addr, ptr->ai_addrlen) !=
+                SOCKET_ERROR)
+                break;  // success
+            closeSocket(coordinatorSocket);
+            coordinatorSocket = INVALID_SOCKET;
+        }
+        freeaddrinfo(addrinfo);
+    }
+    if (coordinatorSocket == INVALID_SOCKET)
+        ErrorExit("%s: unable to connect to coordinator.", address);
+    LOG_VERBOSE("Connected to coordinator at %s", address);
+
+    std::string hello;
+    appendBounds(&hello, film.PixelBounds());
+    append<int32_t>(&hello, spp);
+    append<int32_t>(&hello, Options->seed);
+    if (!sendMessage(coordinatorSocket, Hello, hello))
+        ErrorExit("%s: lost connection to coordinator.", address);
+
+    while (true) {
+        DistributedDirective directive;
+        std::string values;
+        if (!receiveMessage(coordinatorSocket, &directive, &values))
+            ErrorExit("%s: lost connection to coordinator.", address);
+        if (directive == Finished)
+            break;
+        if (directive == Reject)
+            ErrorExit("%s: coordinator rejected worker: %s", address, values);
+
+        Bounds2i tileBounds;
+        int32_t sampleStart, sampleEnd;
+        size_t offset = 0;
+        if (directive != RenderTile || !extractBounds(values, &offset, &tileBounds) ||
+            !extract(values, &offset, &sampleStart) ||
+            !extract(values, &offset, &sampleEnd) ||
+            !Inside(tileBounds, film.PixelBounds()) || sampleStart < 0 ||
+            sampleStart >= sampleEnd || sampleEnd > spp)
+            ErrorExit("%s: unexpected message from coordinator.", address);
+
+        // Render the tile's samples starting from cleared pixels, so that
+        // the coordinator receives just this range's contribution
+        for (Point2i p : tileBounds)
+            film.ResetPixel(p);
+        renderTile(tileBounds, sampleStart, sampleEnd);
+        ++nDistributedTiles;
+
+        std::string result;
+        appendBounds(&result, tileBounds);
+        append<int32_t>(&result, sampleStart);
+        append<int32_t>(&result, sampleEnd);
+        result += film.SerializePixels(tileBounds);
+        if (!sendMessage(coordinatorSocket, TileResult, result))
+            ErrorExit("%s: lost connection to coordinator.", address);
+    }
+    closeSocket(coordinatorSocket);
+    cleanupSockets();
+    LOG_VERBOSE("Coordinator reports that the image is finished");
+}
+
+}  // namespace pbrt
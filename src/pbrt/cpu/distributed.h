@@ -0,0 +1,40 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_CPU_DISTRIBUTED_H
+#define PBRT_CPU_DISTRIBUTED_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/base/camera.h>
+#include <pbrt/util/vecmath.h>
+
+#include <functional>
+#include <string>
+
+namespace pbrt {
+
+// Distributed rendering splits the image into tiles and each tile's samples
+// into ranges; a coordinator hands these out over TCP to workers as they
+// become idle and adds the film pixel sums that the workers send back to
+// its own film. Since the samplers are deterministic, the result matches
+// rendering the image in a single process up to floating-point round-off.
+// Both the coordinator and the workers parse the scene; only the
+// coordinator writes the image.
+
+// Accepts workers on _port_ and returns once all of the image's samples have
+// been rendered and written to the camera's film.
+void RunDistributedCoordinator(const std::string &port, Camera camera, int spp);
+
+// Connects to the coordinator at _address_ ("host:port") and calls
+// _renderTile_ to render each tile and range of sample indices that it is
+// assigned until the image is finished.
+void RunDistributedWorker(
+    const std::string &address, Film film, int spp,
+    std::function<void(Bounds2i tileBounds, int sampleStart, int sampleEnd)>
+        renderTile);
+
+}  // namespace pbrt
+
+#endif  // PBRT_CPU_DISTRIBUTED_H
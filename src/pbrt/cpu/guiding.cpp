@@ -0,0 +1,302 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/cpu/guiding.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace pbrt {
+
+STAT_COUNTER("Path guiding/Training iterations", nGuidingIterations);
+STAT_PERCENT("Path guiding/Directions sampled from the guide", nGuideSamples,
+             nGuidedBSDFSamples);
+
+// DirectionalQuadtree Method Definitions
+void DirectionalQuadtree::Record(Vector3f w, Float value) {
+    // Add _value_ to the quadrant containing _w_ at each level of the tree
+    Point2f p = EqualAreaSphereToSquare(w);
+    int nodeIndex = 0;
+    while (true) {
+        int x = p.x >= 0.5f, y = p.y >= 0.5f, q = x + 2 * y;
+        Node &node = nodes[nodeIndex];
+        node.sum[q].Add(value);
+        if (!node.child[q])
+            return;
+        nodeIndex = node.child[q];
+        p = Point2f(2 * p.x - x, 2 * p.y - y);
+    }
+}
+
+Float DirectionalQuadtree::Total() const {
+    return nodes[0].Total();
+}
+
+Vector3f DirectionalQuadtree::Sample(Point2f u, Float *pdf) const {
+    Point2f pMin(0, 0);
+    Float size = 1, squarePDF = 1;
+    int nodeIndex = 0;
+    while (true) {
+        // Choose the quadrant's column using _u[0]_ and its row using _u[1]_
+        const Node &node = nodes[nodeIndex];
+        Float sum[4] = {node.sum[0], node.sum[1], node.sum[2], node.sum[3]};
+        Float total = sum[0] + sum[1] + sum[2] + sum[3];
+        DCHECK_GT(total, 0);
+        Float pLeft = (sum[0] + sum[2]) / total;
+        int x = u[0] >= pLeft;
+        u[0] = x ? (u[0] - pLeft) / (1 - pLeft) : u[0] / pLeft;
+        Float pLower = sum[x] / (sum[x] + sum[x + 2]);
+        int y = u[1] >= pLower;
+        u[1] = y ? (u[1] - pLower) / (1 - pLower) : u[1] / pLower;
+        u = Point2f(std::min(u[0], OneMinusEpsilon), std::min(u[1], OneMinusEpsilon));
+
+        // Descend into the chosen quadrant
+        int q = x + 2 * y;
+        squarePDF *= 4 * sum[q] / total;
+        size /= 2;
+        pMin += Vector2f(x * size, y * size);
+        if (!node.child[q]) {
+            *pdf = squarePDF * Inv4Pi;
+            return EqualAreaSquareToSphere(pMin + size * Vector2f(u));
+        }
+        nodeIndex = node.child[q];
+    }
+}
+
+Float DirectionalQuadtree::PDF(Vector3f w) const {
+    Point2f p = EqualAreaSphereToSquare(w);
+    Float squarePDF = 1;
+    int nodeIndex = 0;
+    while (true) {
+        int x = p.x >= 0.5f, y = p.y >= 0.5f, q = x + 2 * y;
+        const Node &node = nodes[nodeIndex];
+        Float total = node.Total();
+        if (total <= 0 || node.sum[q] <= 0)
+            return 0;
+        squarePDF *= 4 * node.sum[q] / total;
+        if (!node.child[q])
+            return squarePDF * Inv4Pi;
+        nodeIndex = node.child[q];
+        p = Point2f(2 * p.x - x, 2 * p.y - y);
+    }
+}
+
+DirectionalQuadtree DirectionalQuadtree::Refined(Float splitFraction,
+                                                 int maxDepth) const {
+    DirectionalQuadtree tree;
+    Float total = Total();
+    if (total <= 0) {
+        // Keep the current structure if nothing was recorded
+        tree.nodes = nodes;
+        for (Node &node : tree.nodes)
+            for (int q = 0; q < 4; ++q)
+                node.sum[q] = 0;
+        return tree;
+    }
+
+    // Subdivide quadrants with enough energy, assuming that the energy of
+    // quadrants that this tree didn't subdivide is uniformly distributed
+    struct BuildItem {
+        int nodeIndex, oldNodeIndex, depth;
+        Float energy;
+    };
+    std::vector<BuildItem> stack = {{0, 0, 1, total}};
+    while (!stack.empty()) {
+        BuildItem item = stack.back();
+        stack.pop_back();
+        for (int q = 0; q < 4; ++q) {
+            Float energy = item.oldNodeIndex >= 0 ? Float(nodes[item.oldNodeIndex].sum[q])
+                                                  : item.energy / 4;
+            if (item.depth >= maxDepth || energy <= splitFraction * total)
+                continue;
+            int childIndex = tree.nodes.size();
+            tree.nodes.push_back(Node());
+            tree.nodes[item.nodeIndex].child[q] = childIndex;
+            int oldChild = item.oldNodeIndex >= 0 ? nodes[item.oldNodeIndex].child[q] : 0;
+            stack.push_back(
+                {childIndex, oldChild ? oldChild : -1, item.depth + 1, energy});
+        }
+    }
+    return tree;
+}
+
+std::string DirectionalQuadtree::ToString() const {
+    return StringPrintf("[ DirectionalQuadtree nodes: %d total: %f ]", nodes.size(),
+                        Total());
+}
+
+// PathGuide Method Definitions
+PathGuide::PathGuide(Bounds3f b, int trainingSamples) : trainingSamples(trainingSamples) {
+    // Make the bounds a cube so that spatial subdivisions stay well-shaped
+    Point3f center = (b.pMin + b.pMax) / 2;
+    Float halfExtent = 0.5f * MaxComponentValue(b.Diagonal()) * 1.001f;
+    Vector3f h(halfExtent, halfExtent, halfExtent);
+    bounds = Bounds3f(center - h, center + h);
+
+    nodes.push_back(SpatialNode());
+    nodes[0].leaf = 0;
+    leaves.push_back(std::make_unique<Leaf>());
+    training = trainingSamples > 0;
+}
+
+int PathGuide::LeafIndex(Point3f p) const {
+    Bounds3f b = bounds;
+    int nodeIndex = 0;
+    while (nodes[nodeIndex].child) {
+        const SpatialNode &node = nodes[nodeIndex];
+        Float mid = (b.pMin[node.axis] + b.pMax[node.axis]) / 2;
+        if (p[node.axis] < mid) {
+            b.pMax[node.axis] = mid;
+            nodeIndex = node.child;
+        } else {
+            b.pMin[node.axis] = mid;
+            nodeIndex = node.child + 1;
+        }
+    }
+    return nodes[nodeIndex].leaf;
+}
+
+const DirectionalQuadtree *PathGuide::Lookup(Point3f p) const {
+    const DirectionalQuadtree &tree = leaves[LeafIndex(p)]->sampling;
+    return tree.Total() > 0 ? &tree : nullptr;
+}
+
+void PathGuide::RecordPath(pstd::span<const PathGuideVertex> vertices,
+                           SampledSpectrum L) {
+    for (const PathGuideVertex &v : vertices) {
+        // Record the radiance that arrived at _v_ from direction _wi_, divided
+        // by its sampling density so that each cell estimates its incident flux
+        SampledSpectrum Li = ClampZero(SafeDiv(L - v.L, v.beta));
+        Float value = Li.Average() / v.pdf;
+        if (IsNaN(value) || IsInf(value))
+            continue;
+        Leaf &leaf = *leaves[LeafIndex(v.p)];
+        leaf.recording.Record(v.wi, value);
+        leaf.nSamples.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void PathGuide::Subdivide(int nodeIndex, int64_t maxSamples) {
+    Leaf &leaf = *leaves[nodes[nodeIndex].leaf];
+    int64_t nSamples = leaf.nSamples;
+    if (nSamples <= maxSamples)
+        return;
+
+    // Split the node in half; both children start out with its trees and half
+    // of its samples
+    int childIndex = nodes.size();
+    for (int i = 0; i < 2; ++i) {
+        SpatialNode child;
+        child.axis = (nodes[nodeIndex].axis + 1) % 3;
+        if (i == 0)
+            child.leaf = nodes[nodeIndex].leaf;
+        else {
+            child.leaf = leaves.size();
+            leaves.push_back(std::make_unique<Leaf>());
+            leaves.back()->sampling = leaf.sampling;
+            leaves.back()->recording = leaf.recording;
+            leaves.back()->nSamples = nSamples / 2;
+        }
+        nodes.push_back(child);
+    }
+    leaf.nSamples = nSamples / 2;
+    nodes[nodeIndex].child = childIndex;
+    nodes[nodeIndex].leaf = -1;
+
+    Subdivide(childIndex, maxSamples);
+    Subdivide(childIndex + 1, maxSamples);
+}
+
+void PathGuide::FinishedWave(int waveSamples) {
+    if (!training)
+        return;
+    ++nGuidingIterations;
+    ++iteration;
+    samplesTrained += waveSamples;
+
+    // Subdivide regions of space where many samples were recorded; as in the
+    // paper, the threshold grows with the square root of the iteration's
+    // sample count
+    int64_t maxSamples = 12000 * std::sqrt(Float(waveSamples));
+    int nNodes = nodes.size();
+    for (int i = 0; i < nNodes; ++i)
+        if (!nodes[i].child)
+            Subdivide(i, maxSamples);
+
+    // Sample the radiance recorded this iteration from now on and refine the
+    // recording trees to follow it
+    ParallelFor(0, leaves.size(), [&](int64_t i) {
+        Leaf &leaf = *leaves[i];
+        if (leaf.recording.Total() > 0) {
+            leaf.sampling = leaf.recording;
+            leaf.recording = leaf.sampling.Refined(0.01f, 20);
+        }
+        leaf.nSamples = 0;
+    });
+
+    training = samplesTrained < trainingSamples;
+    LOG_VERBOSE("Path guide iteration %d: %d spatial leaves, training %s", iteration,
+                leaves.size(), training);
+}
+
+std::string PathGuide::ToString() const {
+    return StringPrintf("[ PathGuide bounds: %s spatialNodes: %d leaves: %d "
+                        "trainingSamples: %d samplesTrained: %d iteration: %d "
+                        "training: %s ]",
+                        bounds, nodes.size(), leaves.size(), trainingSamples,
+                        samplesTrained, iteration, training);
+}
+
+// GuidedBSDF Method Definitions
+pstd::optional<BSDFSample> GuidedBSDF::Sample_f(Vector3f wo, Float u, Point2f u2) const {
+    if (!guide)
+        return bsdf->Sample_f(wo, u, u2);
+    ++nGuidedBSDFSamples;
+    const Float alpha = BSDFSamplingFraction;
+    if (u < alpha) {
+        // Sample the BSDF and find the mixture's density for its direction
+        pstd::optional<BSDFSample> bs =
+            bsdf->Sample_f(wo, std::min(u / alpha, OneMinusEpsilon), u2);
+        if (!bs)
+            return {};
+        if (bs->IsSpecular()) {
+            bs->pdf *= alpha;
+            return bs;
+        }
+        Float bsdfPDF = bs->pdfIsProportional ? bsdf->PDF(wo, bs->wi) : bs->pdf;
+        bs->pdf = alpha * bsdfPDF + (1 - alpha) * guide->PDF(bs->wi);
+        bs->pdfIsProportional = false;
+        if (bs->pdf == 0)
+            return {};
+        return bs;
+    }
+
+    // Sample the guide's distribution and evaluate the BSDF for it
+    ++nGuideSamples;
+    Float guidePDF;
+    Vector3f wi = guide->Sample(u2, &guidePDF);
+    SampledSpectrum f = bsdf->f(wo, wi);
+    if (!f || guidePDF == 0)
+        return {};
+    Float pdf = alpha * bsdf->PDF(wo, wi) + (1 - alpha) * guidePDF;
+    bool reflect = bsdf->RenderToLocal(wo).z * bsdf->RenderToLocal(wi).z > 0;
+    return BSDFSample(f, wi, pdf,
+                      reflect ? BxDFFlags::GlossyReflection
+                              : BxDFFlags::GlossyTransmission);
+}
+
+Float GuidedBSDF::PDF(Vector3f wo, Vector3f wi) const {
+    Float bsdfPDF = bsdf->PDF(wo, wi);
+    if (!guide)
+        return bsdfPDF;
+    return BSDFSamplingFraction * bsdfPDF + (1 - BSDFSamplingFraction) * guide->PDF(wi);
+}
+
+}  // namespace pbrt
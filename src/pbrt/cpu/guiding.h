@@ -0,0 +1,158 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_CPU_GUIDING_H
+#define PBRT_CPU_GUIDING_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/bsdf.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/spectrum.h>
+#include <pbrt/util/vecmath.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pbrt {
+
+// DirectionalQuadtree Definition
+// A piecewise-constant distribution over the sphere of directions, stored as a
+// quadtree over the equal-area square parameterization of the sphere. Values
+// recorded into its cells are accumulated atomically, so that rendering
+// threads can record into the same tree.
+class DirectionalQuadtree {
+  public:
+    // DirectionalQuadtree Public Methods
+    DirectionalQuadtree() : nodes(1) {}
+
+    void Record(Vector3f w, Float value);
+    Float Total() const;
+
+    Vector3f Sample(Point2f u, Float *pdf) const;
+    Float PDF(Vector3f w) const;
+
+    // Returns a tree with no recorded values in which the cells holding more
+    // than _splitFraction_ of this tree's total are subdivided.
+    DirectionalQuadtree Refined(Float splitFraction, int maxDepth) const;
+
+    size_t NumNodes() const { return nodes.size(); }
+    std::string ToString() const;
+
+  private:
+    // DirectionalQuadtree::Node Definition
+    // Each node splits its square into four quadrants, indexed by x + 2y; a
+    // zero child index means that the quadrant isn't subdivided further.
+    struct Node {
+        Node() = default;
+        Node(const Node &n) { *this = n; }
+        Node &operator=(const Node &n) {
+            for (int i = 0; i < 4; ++i) {
+                sum[i] = Float(n.sum[i]);
+                child[i] = n.child[i];
+            }
+            return *this;
+        }
+
+        Float Total() const { return sum[0] + sum[1] + sum[2] + sum[3]; }
+
+        AtomicFloat sum[4];
+        int child[4] = {0, 0, 0, 0};
+    };
+
+    // DirectionalQuadtree Private Members
+    std::vector<Node> nodes;
+};
+
+// PathGuideVertex Definition
+// A path vertex at which the incident radiance found by the rest of the path
+// is recorded: _L_ is the path's radiance estimate and _beta_ its throughput
+// just after the vertex's direction _wi_ was sampled with density _pdf_.
+struct PathGuideVertex {
+    Point3f p;
+    Vector3f wi;
+    Float pdf;
+    SampledSpectrum beta, L;
+};
+
+// PathGuide Definition
+// Learns the distribution of incident radiance in the scene while it is
+// rendered, following "Practical Path Guiding for Efficient Light-Transport
+// Simulation" (Müller et al. 2017). A binary tree subdivides the scene's bounds;
+// each of its leaves holds a quadtree that is sampled and one that records
+// the radiance found by paths during the current training iteration. Each
+// wave of samples is one iteration, until the training budget is used up.
+class PathGuide {
+  public:
+    // PathGuide Public Methods
+    PathGuide(Bounds3f bounds, int trainingSamples);
+
+    static constexpr int MaxRecordedVertices = 16;
+
+    bool Training() const { return training; }
+
+    // Returns the distribution to sample at _p_, or nullptr if there isn't one yet
+    const DirectionalQuadtree *Lookup(Point3f p) const;
+
+    // Records the radiance that the rest of the path carried to each vertex
+    void RecordPath(pstd::span<const PathGuideVertex> vertices, SampledSpectrum L);
+
+    // Ends a training iteration, refining the trees from the recorded
+    // radiance; called between waves of _waveSamples_ samples per pixel.
+    void FinishedWave(int waveSamples);
+
+    std::string ToString() const;
+
+  private:
+    // PathGuide Private Types
+    struct SpatialNode {
+        // Index of the first of the node's two children, or zero for a leaf
+        int child = 0;
+        int axis = 0;
+        int leaf = -1;
+    };
+    struct Leaf {
+        DirectionalQuadtree sampling, recording;
+        std::atomic<int64_t> nSamples{0};
+    };
+
+    // PathGuide Private Methods
+    int LeafIndex(Point3f p) const;
+    void Subdivide(int nodeIndex, int64_t maxSamples);
+
+    // PathGuide Private Members
+    Bounds3f bounds;
+    std::vector<SpatialNode> nodes;
+    std::vector<std::unique_ptr<Leaf>> leaves;
+    int trainingSamples, samplesTrained = 0, iteration = 0;
+    bool training = true;
+};
+
+// GuidedBSDF Definition
+// Samples directions from a BSDF and a guiding distribution using one-sample
+// MIS, with the BSDF chosen with probability _BSDFSamplingFraction_. Specular
+// components can only be sampled by the BSDF.
+class GuidedBSDF {
+  public:
+    // GuidedBSDF Public Methods
+    GuidedBSDF(const BSDF *bsdf, const DirectionalQuadtree *guide)
+        : bsdf(bsdf), guide(IsNonSpecular(bsdf->Flags()) ? guide : nullptr) {}
+
+    static constexpr Float BSDFSamplingFraction = 0.5f;
+
+    pstd::optional<BSDFSample> Sample_f(Vector3f wo, Float u, Point2f u2) const;
+    Float PDF(Vector3f wo, Vector3f wi) const;
+
+  private:
+    // GuidedBSDF Private Members
+    const BSDF *bsdf;
+    const DirectionalQuadtree *guide;
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_CPU_GUIDING_H
@@ -0,0 +1,87 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/guiding.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
+
+using namespace pbrt;
+
+// Returns a tree trained over a few iterations on radiance that mostly
+// arrives from a small cone around +z.
+static DirectionalQuadtree TrainedQuadtree(RNG &rng) {
+    DirectionalQuadtree tree;
+    for (int iter = 0; iter < 5; ++iter) {
+        if (iter > 0)
+            tree = tree.Refined(0.01f, 20);
+        for (int i = 0; i < 10000; ++i) {
+            Point2f u(rng.Uniform<Float>(), rng.Uniform<Float>());
+            Vector3f w = SampleUniformSphere(u);
+            tree.Record(w, w.z > 0.95f ? 100 : 1);
+        }
+    }
+    return tree;
+}
+
+TEST(DirectionalQuadtree, PDFIntegratesToOne) {
+    RNG rng;
+    DirectionalQuadtree tree = TrainedQuadtree(rng);
+    EXPECT_GT(tree.NumNodes(), 1);
+
+    double sum = 0;
+    int n = 200000;
+    for (int i = 0; i < n; ++i) {
+        Point2f u(rng.Uniform<Float>(), rng.Uniform<Float>());
+        Vector3f w = SampleUniformSphere(u);
+        sum += tree.PDF(w) / UniformSpherePDF();
+    }
+    EXPECT_NEAR(1, sum / n, 0.03);
+}
+
+TEST(DirectionalQuadtree, SampleMatchesPDF) {
+    RNG rng;
+    DirectionalQuadtree tree = TrainedQuadtree(rng);
+
+    int nNearPole = 0, n = 10000;
+    for (int i = 0; i < n; ++i) {
+        Float pdf;
+        Vector3f w = tree.Sample({rng.Uniform<Float>(), rng.Uniform<Float>()}, &pdf);
+        EXPECT_NEAR(1, Length(w), 1e-4);
+        EXPECT_GT(pdf, 0);
+        EXPECT_NEAR(pdf, tree.PDF(w), 1e-3 * pdf);
+        if (w.z > 0.95f)
+            ++nNearPole;
+    }
+    // The cone around +z covers 2.5% of the sphere but most of the radiance
+    EXPECT_GT(nNearPole, n / 2);
+}
+
+TEST(PathGuide, Training) {
+    PathGuide guide(Bounds3f(Point3f(-1, -1, -1), Point3f(1, 1, 1)), 2);
+    EXPECT_TRUE(guide.Training());
+    EXPECT_EQ(nullptr, guide.Lookup(Point3f(0.5, 0.5, 0.5)));
+
+    // Record many paths at a single point whose radiance arrives from +z
+    RNG rng;
+    for (int wave = 0; wave < 2; ++wave) {
+        for (int i = 0; i < 100000; ++i) {
+            Point2f u(rng.Uniform<Float>(), rng.Uniform<Float>());
+            PathGuideVertex v{Point3f(0.5, 0.5, 0.5), SampleUniformSphere(u),
+                              UniformSpherePDF(), SampledSpectrum(1.f),
+                              SampledSpectrum(0.f)};
+            guide.RecordPath({v}, SampledSpectrum(v.wi.z > 0.95f ? 10.f : 0.f));
+        }
+        guide.FinishedWave(1);
+    }
+    EXPECT_FALSE(guide.Training());
+
+    const DirectionalQuadtree *tree = guide.Lookup(Point3f(0.5, 0.5, 0.5));
+    ASSERT_NE(nullptr, tree);
+    EXPECT_GT(tree->PDF(Vector3f(0, 0, 1)), 4 * UniformSpherePDF());
+    EXPECT_EQ(0, tree->PDF(Vector3f(0, 0, -1)));
+}
@@ -4,6 +4,9 @@
 
 #include <pbrt/cpu/integrators.h>
 
+#include <pbrt/cpu/aggregates.h>
+#include <pbrt/cpu/denoiser.h>
+#include <pbrt/cpu/distributed.h>
 #include <pbrt/bsdf.h>
 #include <pbrt/bssrdf.h>
 #include <pbrt/cameras.h>
@@ -45,6 +48,11 @@
 namespace pbrt {
 
 STAT_COUNTER("Integrator/Camera rays traced", nCameraRays);
+STAT_INT_DISTRIBUTION("Memory/Scratch buffer high-water mark per thread (bytes)",
+                      scratchHighWaterMark);
+STAT_COUNTER("Memory/Scratch buffer overflows", scratchOverflows);
+STAT_PERCENT("Integrator/Pixel samples skipped by adaptive sampling",
+             adaptiveSamplesSkipped, adaptiveSamplesTotal);
 
 // RandomWalkIntegrator Method Definitions
 std::unique_ptr<RandomWalkIntegrator> RandomWalkIntegrator::Create(
@@ -62,6 +70,132 @@ std::string RandomWalkIntegrator::ToString() const {
 // Integrator Method Definitions
 Integrator::~Integrator() {}
 
+// AdaptivePixel Definition
+// Error estimate for a pixel sampled with --adaptive-error, computed from the
+// spread of the mean luminance of each wave of its samples.
+struct AdaptivePixel {
+    // Sums over waves of each wave's sample count k times its mean
+    // luminance m, and of k m^2
+    double kmSum = 0, kmmSum = 0;
+    int nSamples = 0, nWaves = 0, nConvergedWaves = 0;
+    bool converged = false;
+};
+
+// PixelSampleCount Definition
+// The number of samples taken in a pixel so far and the time spent on them.
+struct PixelSampleCount {
+    int nSamples = 0;
+    float seconds = 0;
+};
+
+// Returns an image with each pixel's sample count and the time spent
+// rendering it, in milliseconds.
+static Image SampleCountImage(const Array2D<PixelSampleCount> &sampleCounts,
+                              Bounds2i pixelBounds) {
+    Image image(PixelFormat::Float, Point2i(pixelBounds.Diagonal()),
+                {"SampleCount", "Time"});
+    for (Point2i p : pixelBounds) {
+        const PixelSampleCount &count = sampleCounts[p];
+        image.SetChannel(Point2i(p - pixelBounds.pMin), 0, count.nSamples);
+        image.SetChannel(Point2i(p - pixelBounds.pMin), 1, 1000 * count.seconds);
+    }
+    return image;
+}
+
+// Relative error is measured with respect to at least this luminance so
+// that dark pixels can converge.
+static constexpr Float AdaptiveMinLuminance = 1e-2f;
+
+// Updates the error estimates of the pixels that took samples
+// [waveStart, waveEnd) and returns how many pixels still need more.
+static int64_t UpdateAdaptivePixels(Array2D<AdaptivePixel> &adaptivePixels, Film film,
+                                    int waveStart, int waveEnd, Float targetError) {
+    Bounds2i pixelBounds = film.PixelBounds();
+    std::atomic<int64_t> nActive{0};
+    ParallelFor(pixelBounds.pMin.y, pixelBounds.pMax.y, [&](int64_t y) {
+        int64_t rowActive = 0;
+        for (int x = pixelBounds.pMin.x; x < pixelBounds.pMax.x; ++x) {
+            AdaptivePixel &pixel = adaptivePixels[{x, int(y)}];
+            if (pixel.converged)
+                continue;
+            // Recover this wave's mean from the film's running estimate;
+            // splats are excluded since they don't depend on the pixel's
+            // samples.
+            int k = waveEnd - waveStart;
+            Float mean = film.GetPixelRGB({x, int(y)}, 0.f).Average();
+            double total = double(mean) * (pixel.nSamples + k);
+            double waveMean = (total - pixel.kmSum) / k;
+            pixel.kmSum = total;
+            pixel.kmmSum += k * Sqr(waveMean);
+            pixel.nSamples += k;
+            ++pixel.nWaves;
+
+            // Require a few waves and two consecutive ones below the target
+            // error to guard against underestimating it
+            if (pixel.nWaves >= 4) {
+                double variance =
+                    std::max(0., pixel.kmmSum - Sqr(pixel.kmSum) / pixel.nSamples) /
+                    (pixel.nWaves - 1);
+                double relError = std::sqrt(variance / pixel.nSamples) /
+                                  std::max<Float>(std::abs(mean), AdaptiveMinLuminance);
+                pixel.nConvergedWaves =
+                    relError < targetError ? pixel.nConvergedWaves + 1 : 0;
+                pixel.converged = pixel.nConvergedWaves >= 2;
+            }
+            rowActive += !pixel.converged;
+        }
+        nActive += rowActive;
+    });
+    return nActive;
+}
+
+// RenderCheckpointHeader Definition
+// Stored at the start of --checkpoint files, followed by the film's pixel state
+// and then, for adaptive renders, the _AdaptivePixel_ array.
+struct RenderCheckpointHeader {
+    char magic[8] = {'p', 'b', 'r', 't', 'c', 'k', 'p', '1'};
+    int32_t pixelBounds[4];
+    int32_t samplesPerPixel, seed;
+    int32_t waveStart, waveEnd, nextWaveSize;
+    int32_t adaptive;
+    int64_t filmBytes, adaptiveBytes;
+};
+
+// Restores the film, wave, and adaptive sampling state saved in a checkpoint
+// file, returning false if it doesn't match the current render.
+static bool ReadRenderCheckpoint(const std::string &filename, Film film,
+                                 const Bounds2i &pixelBounds, int spp,
+                                 RenderCheckpointHeader *header,
+                                 Array2D<AdaptivePixel> *adaptivePixels) {
+    std::string contents = ReadFileContents(filename);
+    RenderCheckpointHeader expected;
+    if (contents.size() < sizeof(*header))
+        return false;
+    std::memcpy(header, contents.data(), sizeof(*header));
+    size_t adaptiveBytes =
+        adaptivePixels ? adaptivePixels->size() * sizeof(AdaptivePixel) : 0;
+    if (std::memcmp(header->magic, expected.magic, sizeof(header->magic)) != 0 ||
+        header->pixelBounds[0] != pixelBounds.pMin.x ||
+        header->pixelBounds[1] != pixelBounds.pMin.y ||
+        header->pixelBounds[2] != pixelBounds.pMax.x ||
+        header->pixelBounds[3] != pixelBounds.pMax.y ||
+        header->samplesPerPixel != spp || header->seed != Options->seed ||
+        header->adaptive != (adaptivePixels != nullptr) ||
+        header->adaptiveBytes != int64_t(adaptiveBytes) || header->filmBytes < 0 ||
+        header->waveStart < 0 || header->waveStart > header->waveEnd ||
+        header->waveEnd > spp ||
+        contents.size() != sizeof(*header) + header->filmBytes + adaptiveBytes)
+        return false;
+
+    const char *filmStart = contents.data() + sizeof(*header);
+    if (!film.DeserializePixels(std::string(filmStart, header->filmBytes)))
+        return false;
+    if (adaptivePixels)
+        std::memcpy((void *)adaptivePixels->begin(), filmStart + header->filmBytes,
+                    adaptiveBytes);
+    return true;
+}
+
 // ImageTileIntegrator Method Definitions
 void ImageTileIntegrator::Render() {
     // Handle debugStart, if set
@@ -105,7 +239,15 @@ void ImageTileIntegrator::Render() {
     // 由于这个类不是线程安全的，利用ThreadLocal模板类，为每个线程创建单独的一个ScratchBuffer
     // 这个类的构造器根据lambda函数，根据ThreadLocal管理的对象的类型，来返回新的实例
     // 之后ThreadLocal会负责维护和管理每个线程的这些对象。
-    ThreadLocal<ScratchBuffer> scratchBuffers([]() { return ScratchBuffer(); });
+    // With --scratch-buffer, each thread's buffer is allocated and prefaulted
+    // up front by the thread that uses it so that rendering doesn't
+    // allocate memory or take page faults for it.
+    int scratchBytes = Options->scratchBufferKB * 1024;
+    ThreadLocal<ScratchBuffer> scratchBuffers([scratchBytes]() {
+        return scratchBytes > 0 ? ScratchBuffer(scratchBytes, true) : ScratchBuffer();
+    });
+    if (scratchBytes > 0)
+        ForEachThread([&]() { scratchBuffers.Get(); });
     // 由于每个线程不能使用同一个采样点，也需要用ThreadLocal来管理每个线程的Sampler对象
     // Sampler提供了Clone()函数来根据它的类型来创建新的实例
     // Sampler一开始是通过构造器提供的，后续是通过samplerPrototype拷贝的
@@ -113,14 +255,55 @@ void ImageTileIntegrator::Render() {
     Bounds2i pixelBounds = camera.GetFilm().PixelBounds();
     // 像素点采样的数量
     int spp = samplerPrototype.SamplesPerPixel();
+    // With distributed rendering, either hand out the image's tiles to
+    // workers or render the ones that the coordinator assigns
+    if (!Options->coordinatorPort.empty()) {
+        RunDistributedCoordinator(Options->coordinatorPort, camera, spp);
+        return;
+    }
+    if (!Options->coordinatorAddress.empty()) {
+        RunDistributedWorker(Options->coordinatorAddress, camera.GetFilm(), spp,
+                             [&](Bounds2i bounds, int sampleStart, int sampleEnd) {
+            ParallelFor2D(bounds, [&](Bounds2i tileBounds) {
+                ScratchBuffer &scratchBuffer = scratchBuffers.Get();
+                Sampler &sampler = samplers.Get();
+                camera.GetFilm().BeginTile(tileBounds);
+                for (Point2i pPixel : tileBounds) {
+                    threadPixel = pPixel;
+                    for (int sampleIndex = sampleStart; sampleIndex < sampleEnd;
+                         ++sampleIndex) {
+                        threadSampleIndex = sampleIndex;
+                        sampler.StartPixelSample(pPixel, sampleIndex);
+                        EvaluatePixelSample(pPixel, sampleIndex, sampler, scratchBuffer);
+                        scratchBuffer.Reset();
+                    }
+                }
+                camera.GetFilm().EndTile();
+            });
+            camera.GetFilm().FlushSplats();
+        });
+        return;
+    }
+
+    // With --sample-range, only take the given range of each pixel's samples
+    int sampleStart = 0, sampleEnd = spp;
+    if (Options->sampleRange) {
+        sampleStart = Options->sampleRange->x;
+        sampleEnd = Options->sampleRange->y;
+        if (sampleEnd > spp)
+            ErrorExit("--sample-range %d,%d extends past the %d samples per pixel.",
+                      sampleStart, sampleEnd, spp);
+    }
+
     // ProgressReporter用于提示用户渲染进展，第一个参数就是处理的任务的总数
     // 这里，任务的总数就是每个像素点的采样个数，乘以总的像素点个数
     // 这里有必要使用64位精度的数字来计算，因为对于高精度图像，每个像素点会有很多采样点，计算以后精度不够
-    ProgressReporter progress(int64_t(spp) * pixelBounds.Area(), "Rendering",
-                              Options->quiet);
+    ProgressReporter progress(int64_t(sampleEnd - sampleStart) * pixelBounds.Area(),
+                              "Rendering", Options->quiet);
+    MetricsProgressScope metricsProgress(progress);
     // 当前轮取的采样点个数起止用waveStart和waveEnd表示
     // 下一轮要取得采样点总数用nextWaveSize表示
-    int waveStart = 0, waveEnd = 1, nextWaveSize = 1;
+    int waveStart = sampleStart, waveEnd = sampleStart + 1, nextWaveSize = 1;
 
     if (Options->recordPixelStatistics)
         StatsEnablePixelStats(pixelBounds,
@@ -156,6 +339,9 @@ void ImageTileIntegrator::Render() {
             ErrorExit("%s: %s", Options->mseReferenceOutput, ErrorString());
     }
 
+    // Keep track of where samples and time are spent
+    Array2D<PixelSampleCount> sampleCounts(pixelBounds);
+
     // Connect to display server if needed
     if (!Options->displayServer.empty()) {
         Film film = camera.GetFilm();
@@ -164,19 +350,146 @@ void ImageTileIntegrator::Render() {
                        [&](Bounds2i b, pstd::span<pstd::span<float>> displayValue) {
                            int index = 0;
                            for (Point2i p : b) {
-                               RGB rgb = film.GetPixelRGB(pixelBounds.pMin + p,
-                                                          2.f / (waveStart + waveEnd));
+                               RGB rgb = film.GetPixelRGB(
+                                   pixelBounds.pMin + p,
+                                   2.f / (waveStart + waveEnd - 2 * sampleStart));
                                for (int c = 0; c < 3; ++c)
                                    displayValue[c][index] = rgb[c];
                                ++index;
                            }
                        });
+        DisplayDynamic(film.GetFilename() + " samples", Point2i(pixelBounds.Diagonal()),
+                       {"SampleCount", "Time"},
+                       [&](Bounds2i b, pstd::span<pstd::span<float>> displayValue) {
+                           int index = 0;
+                           for (Point2i p : b) {
+                               const PixelSampleCount &count =
+                                   sampleCounts[pixelBounds.pMin + p];
+                               displayValue[0][index] = count.nSamples;
+                               displayValue[1][index] = 1000 * count.seconds;
+                               ++index;
+                           }
+                       });
+    }
+
+    // Set up adaptive sampling and the time budget, if enabled
+    bool adaptive = Options->adaptiveError > 0;
+    Array2D<AdaptivePixel> adaptivePixels;
+    if (adaptive)
+        adaptivePixels = Array2D<AdaptivePixel>(pixelBounds);
+    int64_t nActivePixels = pixelBounds.Area();
+
+    // Set up denoising of the image after each wave, if the render should stop
+    // once the denoised image has converged
+    bool denoiseStop = false;
+    FeatureDenoiser denoiser;
+    pstd::optional<Image> denoised;
+    if (Options->denoiseStop > 0) {
+        if (camera.GetFilm().Is<GBufferFilm>())
+            denoiseStop = true;
+        else
+            Warning("--denoise-stop requires the \"gbuffer\" film. Ignoring.");
+    }
+
+    // Continue from a checkpoint of an earlier run of this render, if requested
+    const std::string &checkpointFile = Options->checkpointFile;
+    if (Options->resume && !checkpointFile.empty()) {
+        RenderCheckpointHeader header;
+        if (!FileExists(checkpointFile))
+            Warning("%s: checkpoint file not found. Starting render from scratch.",
+                    checkpointFile);
+        else if (!ReadRenderCheckpoint(checkpointFile, camera.GetFilm(), pixelBounds,
+                                       spp, &header,
+                                       adaptive ? &adaptivePixels : nullptr)) {
+            Warning("%s: checkpoint doesn't match the current render. Starting "
+                    "render from scratch.",
+                    checkpointFile);
+        } else {
+            waveStart = header.waveStart;
+            waveEnd = header.waveEnd;
+            nextWaveSize = header.nextWaveSize;
+            if (adaptive)
+                nActivePixels = std::count_if(
+                    adaptivePixels.begin(), adaptivePixels.end(),
+                    [](const AdaptivePixel &pixel) { return !pixel.converged; });
+            progress.Update(int64_t(waveStart) * pixelBounds.Area());
+            LOG_VERBOSE("Resuming render from %s at spp = %d", checkpointFile,
+                        waveStart);
+        }
     }
+    AsyncJob<bool> *checkpointJob = nullptr;
+    AsyncJob<bool> *partialImageJob = nullptr;
+    double lastCheckpointSeconds = progress.ElapsedSeconds();
+
+    double waveStartSeconds = progress.ElapsedSeconds();
+    bool finished = false;
+
+    // Renders the samples _[tileWaveStart, tileWaveEnd)_ of the pixels in
+    // _tileBounds_
+    auto renderTile = [&](Bounds2i tileBounds, int tileWaveStart, int tileWaveEnd) {
+        // Render image tile given by _tileBounds_
+        // 根据图块边界tileBounds渲染图块
+        TraceScope traceTile("Render", "Tile");
+        if (traceEnabled)
+            traceTile.SetArgs(StringPrintf("\"tile\": \"%s\", \"waveStart\": %d",
+                                           tileBounds, tileWaveStart));
+        // 先请求线程对应的ScratchBuffer和Sampler
+        ScratchBuffer &scratchBuffer = scratchBuffers.Get();
+        Sampler &sampler = samplers.Get();
+        camera.GetFilm().BeginTile(tileBounds);
+        PBRT_DBG("Starting image tile (%d,%d)-(%d,%d) waveStart %d, waveEnd %d\n",
+                 tileBounds.pMin.x, tileBounds.pMin.y, tileBounds.pMax.x,
+                 tileBounds.pMax.y, tileWaveStart, tileWaveEnd);
+        // 根据图块边界遍历每个像素pPixel
+        for (Point2i pPixel : tileBounds) {
+            if (adaptive) {
+                adaptiveSamplesTotal += tileWaveEnd - tileWaveStart;
+                if (adaptivePixels[pPixel].converged) {
+                    adaptiveSamplesSkipped += tileWaveEnd - tileWaveStart;
+                    continue;
+                }
+            }
+            // <<每个像素点根据采样点来渲染>>
+            StatsReportPixelStart(pPixel);
+            threadPixel = pPixel;
+            Timer pixelTimer;
+            // Render samples in pixel _pPixel_
+            for (int sampleIndex = tileWaveStart; sampleIndex < tileWaveEnd;
+                 ++sampleIndex) {
+                threadSampleIndex = sampleIndex;
+                // 为像素点生成采样点，同时设置一些内部的状态
+                sampler.StartPixelSample(pPixel, sampleIndex);
+					// 负责确定特定采样点的值，然后会通过调用ScratchBuffer::Reset()来释放这部分临时内存
+                EvaluatePixelSample(pPixel, sampleIndex, sampler, scratchBuffer);
+                scratchBuffer.Reset();
+            }
+            PixelSampleCount &count = sampleCounts[pPixel];
+            count.nSamples += tileWaveEnd - tileWaveStart;
+            count.seconds += pixelTimer.ElapsedSeconds();
+            // 把处理进度通知到ProgressReporter
+            StatsReportPixelEnd(pPixel);
+        }
+        camera.GetFilm().EndTile();
+        PBRT_DBG("Finished image tile (%d,%d)-(%d,%d)\n", tileBounds.pMin.x,
+                 tileBounds.pMin.y, tileBounds.pMax.x, tileBounds.pMax.y);
+        progress.Update((tileWaveEnd - tileWaveStart) * tileBounds.Area());
+    };
+
+    // With --overlap-waves, all of the waves are rendered in a single parallel
+    // loop unless something has to be done between them
+    bool overlapWaves = Options->overlapWaves && !adaptive && Options->timeLimit == 0 &&
+                        !denoiseStop && !referenceImage && !Options->writePartialImages &&
+                        !Options->writeSampleMap && checkpointFile.empty() &&
+                        !NeedsWaveBarriers();
 
     // Render image in waves
     // 分轮次渲染图像
     // 只要当前轮的采样点开始没到采样总数
-    while (waveStart < spp) {
+    while (!finished) {
+        TraceScope traceWave("Render", "Wave");
+        if (traceEnabled)
+            traceWave.SetArgs(StringPrintf("\"waveStart\": %d, \"waveEnd\": %d",
+                                           waveStart, waveEnd));
         // Render current wave's image tiles in parallel
         // 并行地渲染当前轮数的图块
         // 这个函数并行地循环整个图块，并行相关的功能函数参考B.6.A
@@ -185,80 +498,216 @@ void ImageTileIntegrator::Render() {
         // 所以如果把图块一对一分给处理器，很可能某些处理器处理完后就会空闲，其他处理器还在忙碌
         // 2. 图块太多也会影响处理效率，在并行线程请求任务时，会有微小的固定性能开销，图块越多，这个开销消耗的时间越多
         // 因此，这个函数选取的图块大小综合考虑要处理的区域和系统的处理器数量
-        ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
-            // Render image tile given by _tileBounds_
-            // 根据图块边界tileBounds渲染图块
-            // 先请求线程对应的ScratchBuffer和Sampler
-            ScratchBuffer &scratchBuffer = scratchBuffers.Get();
-            Sampler &sampler = samplers.Get();
-            PBRT_DBG("Starting image tile (%d,%d)-(%d,%d) waveStart %d, waveEnd %d\n",
-                     tileBounds.pMin.x, tileBounds.pMin.y, tileBounds.pMax.x,
-                     tileBounds.pMax.y, waveStart, waveEnd);
-            // 根据图块边界遍历每个像素pPixel
-            for (Point2i pPixel : tileBounds) {
-                // <<每个像素点根据采样点来渲染>>
-                StatsReportPixelStart(pPixel);
-                threadPixel = pPixel;
-                // Render samples in pixel _pPixel_
-                for (int sampleIndex = waveStart; sampleIndex < waveEnd; ++sampleIndex) {
-                    threadSampleIndex = sampleIndex;
-                    // 为像素点生成采样点，同时设置一些内部的状态
-                    sampler.StartPixelSample(pPixel, sampleIndex);
-					// 负责确定特定采样点的值，然后会通过调用ScratchBuffer::Reset()来释放这部分临时内存
-                    EvaluatePixelSample(pPixel, sampleIndex, sampler, scratchBuffer);
-                    scratchBuffer.Reset();
-                }
-                // 把处理进度通知到ProgressReporter
-                StatsReportPixelEnd(pPixel);
+        if (overlapWaves) {
+            // Start each wave's tiles as threads become free rather than
+            // waiting for all of the previous wave's tiles to finish
+            std::vector<int> waveBounds = {waveStart, waveEnd};
+            while (waveBounds.back() < sampleEnd) {
+                waveBounds.push_back(
+                    std::min(sampleEnd, waveBounds.back() + nextWaveSize));
+                nextWaveSize = std::min(2 * nextWaveSize, 64);
             }
-            PBRT_DBG("Finished image tile (%d,%d)-(%d,%d)\n", tileBounds.pMin.x,
-                     tileBounds.pMin.y, tileBounds.pMax.x, tileBounds.pMax.y);
-            progress.Update((waveEnd - waveStart) * tileBounds.Area());
-        });
+            ParallelFor2DWaves(pixelBounds, waveBounds.size() - 1,
+                               [&](Bounds2i tileBounds, int wave) {
+                                   renderTile(tileBounds, waveBounds[wave],
+                                              waveBounds[wave + 1]);
+                               });
+            waveEnd = sampleEnd;
+        } else
+            ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
+                renderTile(tileBounds, waveStart, waveEnd);
+            });
+        camera.GetFilm().FlushSplats();
+
+        int64_t nPrevActivePixels = nActivePixels;
+        if (adaptive)
+            nActivePixels = UpdateAdaptivePixels(adaptivePixels, camera.GetFilm(),
+                                                 waveStart, waveEnd,
+                                                 Options->adaptiveError);
+        FinishedWave(waveStart, waveEnd);
+        int prevWaveSize = waveEnd - waveStart;
 
         // Update start and end wave
         // 把每轮的开始和结束，包括下一轮的数量都更新
         waveStart = waveEnd;
-        waveEnd = std::min(spp, waveEnd + nextWaveSize);
+        waveEnd = std::min(sampleEnd, waveEnd + nextWaveSize);
         if (!referenceImage)
             nextWaveSize = std::min(2 * nextWaveSize, 64);
-        if (waveStart == spp)
+
+        // Stop early if all pixels have converged; with a time limit, shrink
+        // the next wave to what the measured sampling rate says will finish
+        // in the remaining time, stopping if not even one sample will.
+        finished = waveStart == sampleEnd || nActivePixels == 0;
+        if (!finished && Options->timeLimit > 0) {
+            double elapsed = progress.ElapsedSeconds();
+            double secondsPerSample =
+                (elapsed - waveStartSeconds) / (double(prevWaveSize) * nPrevActivePixels);
+            double waveSampleSeconds = secondsPerSample * nActivePixels;
+            if (waveSampleSeconds > 0) {
+                double remaining = std::max(0., Options->timeLimit - elapsed);
+                int maxWaveSize = std::min<double>(spp, remaining / waveSampleSeconds);
+                waveEnd = std::min(waveEnd, waveStart + maxWaveSize);
+            }
+            finished = waveEnd == waveStart;
+            waveStartSeconds = elapsed;
+        }
+        if (denoiseStop) {
+            // Denoise the current image and stop if it's close enough to the
+            // previous wave's
+            ImageMetadata filmMetadata;
+            Image filmImage = camera.GetFilm().GetImage(&filmMetadata,
+                                                        1.f / (waveStart - sampleStart));
+            Image image = denoiser.Denoise(filmImage, waveStart - sampleStart);
+            if (denoised && !finished) {
+                Float difference = RelativeMSE(image, *denoised);
+                LOG_VERBOSE("Denoised image at spp = %d has relative MSE %f with respect "
+                            "to the previous one", waveStart, difference);
+                finished = difference < Options->denoiseStop;
+            }
+            denoised = std::move(image);
+        }
+        if (finished) {
+            if (waveStart < sampleEnd)
+                LOG_VERBOSE("Stopping after %d of %d samples per pixel (%d pixels "
+                            "still active)", waveStart - sampleStart,
+                            sampleEnd - sampleStart, nActivePixels);
             progress.Done();
+        }
+
+        // Save a checkpoint at this wave boundary if enough time has passed;
+        // the film is copied here but written to disk on an I/O thread.
+        if (!checkpointFile.empty() && !finished &&
+            progress.ElapsedSeconds() - lastCheckpointSeconds >=
+                Options->checkpointInterval &&
+            (!checkpointJob || checkpointJob->IsReady())) {
+            if (checkpointJob && !checkpointJob->GetResult())
+                Warning("%s: unable to write checkpoint file.", checkpointFile);
+            RenderCheckpointHeader header;
+            header.pixelBounds[0] = pixelBounds.pMin.x;
+            header.pixelBounds[1] = pixelBounds.pMin.y;
+            header.pixelBounds[2] = pixelBounds.pMax.x;
+            header.pixelBounds[3] = pixelBounds.pMax.y;
+            header.samplesPerPixel = spp;
+            header.seed = Options->seed;
+            header.waveStart = waveStart;
+            header.waveEnd = waveEnd;
+            header.nextWaveSize = nextWaveSize;
+            header.adaptive = adaptive;
+            std::string filmState = camera.GetFilm().SerializePixels();
+            header.filmBytes = filmState.size();
+            header.adaptiveBytes =
+                adaptive ? adaptivePixels.size() * sizeof(AdaptivePixel) : 0;
+            std::string contents((const char *)&header, sizeof(header));
+            contents += filmState;
+            if (adaptive)
+                contents.append((const char *)adaptivePixels.begin(),
+                                header.adaptiveBytes);
+            checkpointJob = WriteFileContentsAsync(checkpointFile, std::move(contents));
+            lastCheckpointSeconds = progress.ElapsedSeconds();
+            LOG_VERBOSE("Started writing checkpoint with spp = %d", waveStart);
+        }
 
         // Optionally write current image to disk
         // 若用户在命令行写了"-write-partial-images",那么处理中的图片会在下一轮处理完之前，写到硬盘里
-        if (waveStart == spp || Options->writePartialImages || referenceImage) {
+        if (finished || Options->writePartialImages || referenceImage) {
             LOG_VERBOSE("Writing image with spp = %d", waveStart);
             ImageMetadata metadata;
             metadata.renderTimeSeconds = progress.ElapsedSeconds();
-            metadata.samplesPerPixel = waveStart;
+            metadata.samplesPerPixel = waveStart - sampleStart;
             if (referenceImage) {
                 ImageMetadata filmMetadata;
-                Image filmImage =
-                    camera.GetFilm().GetImage(&filmMetadata, 1.f / waveStart);
+                Image filmImage = camera.GetFilm().GetImage(
+                    &filmMetadata, 1.f / (waveStart - sampleStart));
                 ImageChannelValues mse =
                     filmImage.MSE(filmImage.AllChannelsDesc(), *referenceImage);
                 fprintf(mseOutFile, "%d, %.9g\n", waveStart, mse.Average());
                 metadata.MSE = mse.Average();
                 fflush(mseOutFile);
             }
-            if (waveStart == spp || Options->writePartialImages) {
+            if (finished) {
+                // Don't let an earlier partial image overwrite the final one
+                if (partialImageJob)
+                    partialImageJob->Wait();
+                camera.InitMetadata(&metadata);
+                camera.GetFilm().WriteImage(metadata, 1.0f / (waveStart - sampleStart));
+                // Also write the raw sums so that the range can be merged
+                // with others using imgtool mergefilm
+                if (Options->sampleRange) {
+                    std::string filename =
+                        RemoveExtension(camera.GetFilm().GetFilename()) + ".film";
+                    RGBFilmDump dump = camera.GetFilm().Cast<RGBFilm>()->GetDump(
+                        sampleStart, waveStart);
+                    if (!dump.Write(filename))
+                        Warning("%s: unable to write film dump.", filename);
+                }
+            } else if (Options->writePartialImages &&
+                       (!partialImageJob || partialImageJob->IsReady())) {
+                // Take a snapshot of the image and encode and write it on an
+                // I/O thread so that rendering continues in the meantime; if
+                // the previous one hasn't been written yet, skip this one.
                 camera.InitMetadata(&metadata);
-                camera.GetFilm().WriteImage(metadata, 1.0f / waveStart);
+                auto image = std::make_shared<Image>(camera.GetFilm().GetImage(
+                    &metadata, 1.0f / (waveStart - sampleStart)));
+                std::string filename = camera.GetFilm().GetFilename();
+                partialImageJob = RunIOAsync([image, metadata, filename]() {
+                    return image->Write(filename, metadata);
+                });
+            }
+            if (finished && denoised) {
+                // Also write the final denoised image next to the film's
+                ImageMetadata denoisedMetadata = metadata;
+                denoisedMetadata.pixelBounds = pixelBounds;
+                denoisedMetadata.fullResolution = camera.GetFilm().FullResolution();
+                std::string filename =
+                    RemoveExtension(camera.GetFilm().GetFilename()) + "-denoised.exr";
+                LOG_VERBOSE("Writing denoised image to %s", filename);
+                if (!denoised->Write(filename, denoisedMetadata))
+                    Warning("%s: unable to write denoised image.", filename);
             }
         }
+
+        // Write the sample counts after every wave so that they can be
+        // followed while the image renders
+        if (Options->writeSampleMap) {
+            ImageMetadata metadata;
+            metadata.renderTimeSeconds = progress.ElapsedSeconds();
+            metadata.samplesPerPixel = waveStart - sampleStart;
+            metadata.pixelBounds = pixelBounds;
+            metadata.fullResolution = camera.GetFilm().FullResolution();
+            std::string filename =
+                RemoveExtension(camera.GetFilm().GetFilename()) + "-samples.exr";
+            if (!SampleCountImage(sampleCounts, pixelBounds).Write(filename, metadata))
+                Warning("%s: unable to write sample counts.", filename);
+        }
+    }
+
+    // The finished image supersedes any checkpoint of the render
+    if (checkpointJob) {
+        checkpointJob->Wait();
+        RemoveFile(checkpointFile);
     }
 
     if (mseOutFile)
         fclose(mseOutFile);
     DisconnectFromDisplayServer();
+    // Report how much scratch memory each thread needed, which can be used
+    // to choose a size for --scratch-buffer
+    scratchBuffers.ForAll([](ScratchBuffer &buffer) {
+        scratchHighWaterMark << buffer.HighWaterMark();
+        scratchOverflows += buffer.Overflows();
+    });
     LOG_VERBOSE("Rendering finished");
 }
 
 // RayIntegrator Method Definitions
 // 派生类必须实现如何确定特定采样点的值
+// The pixel whose sample the current thread is evaluating, for integrators
+// whose _Li()_ method needs per-pixel state
+static thread_local Point2i currentPixel;
+
 void RayIntegrator::EvaluatePixelSample(Point2i pPixel, int sampleIndex, Sampler sampler,
                                         ScratchBuffer &scratchBuffer) {
+    currentPixel = pPixel;
     // Sample wavelengths for the ray
     // <<为光线采样波长>>
     // 取lu作为采样因子，后续让胶片给出要采样的一组波长
@@ -348,6 +797,8 @@ void RayIntegrator::EvaluatePixelSample(Point2i pPixel, int sampleIndex, Sampler
     // <<为图片添加相机光对其的光贡献>>
     // 在到达光源的辐射量已知后，调用addSample()来更新对应像素点，为采样加上辐射量的权重
     // 关于如何在胶片中进行采样，详见5.4和8.8
+    PerfCounterScope _(PerfRegion::FilmUpdate);
+    ProfilerScope profile(ProfilePhase::FilmUpdate);
     camera.GetFilm().AddSample(pPixel, L, lambda, &visibleSurface,
                                cameraSample.filterWeight);
 }
@@ -360,7 +811,11 @@ STAT_COUNTER("Intersections/Shadow ray intersection tests", nShadowTests);
 pstd::optional<ShapeIntersection> Integrator::Intersect(const Ray &ray,
                                                         Float tMax) const {
     ++nIntersectionTests;
+    if (metricsEnabled)
+        StatsCountMetricsRays(1);
     DCHECK_NE(ray.d, Vector3f(0, 0, 0));
+    PerfCounterScope _(PerfRegion::BVHTraversal);
+    ProfilerScope profile(ProfilePhase::Intersection);
     if (aggregate)
         return aggregate.Intersect(ray, tMax);
     else
@@ -369,13 +824,38 @@ pstd::optional<ShapeIntersection> Integrator::Intersect(const Ray &ray,
 
 bool Integrator::IntersectP(const Ray &ray, Float tMax) const {
     ++nShadowTests;
+    if (metricsEnabled)
+        StatsCountMetricsRays(1);
     DCHECK_NE(ray.d, Vector3f(0, 0, 0));
+    PerfCounterScope _(PerfRegion::BVHTraversal);
+    ProfilerScope profile(ProfilePhase::Intersection);
     if (aggregate)
         return aggregate.IntersectP(ray, tMax);
     else
         return false;
 }
 
+void Integrator::IntersectP(int nRays, const Ray *rays, const Float *tMax,
+                            bool *hit) const {
+    nShadowTests += nRays;
+    if (metricsEnabled)
+        StatsCountMetricsRays(nRays);
+    PerfCounterScope _(PerfRegion::BVHTraversal);
+    ProfilerScope profile(ProfilePhase::Intersection);
+    if (const BVHAggregate *bvh = aggregate.CastOrNullptr<BVHAggregate>()) {
+        // Trace the rays in packets of up to _BVHAggregate::MaxPacketSize_
+        for (int start = 0; start < nRays; start += BVHAggregate::MaxPacketSize) {
+            int n = std::min(BVHAggregate::MaxPacketSize, nRays - start);
+            bvh->IntersectPPacket(n, rays + start, tMax + start, hit + start);
+        }
+        return;
+    }
+    for (int i = 0; i < nRays; ++i) {
+        DCHECK_NE(rays[i].d, Vector3f(0, 0, 0));
+        hit[i] = aggregate && aggregate.IntersectP(rays[i], tMax[i]);
+    }
+}
+
 SampledSpectrum Integrator::Tr(const Interaction &p0, const Interaction &p1,
                                const SampledWavelengths &lambda) const {
     RNG rng(Hash(p0.p()), Hash(p1.p()));
@@ -688,15 +1168,62 @@ std::unique_ptr<LightPathIntegrator> LightPathIntegrator::Create(
 STAT_PERCENT("Integrator/Zero-radiance paths", zeroRadiancePaths, totalPaths);
 STAT_PERCENT("Integrator/Regularized BSDFs", regularizedBSDFs, totalBSDFs);
 STAT_INT_DISTRIBUTION("Integrator/Path length", pathLength);
+STAT_PERCENT("Integrator/Paths terminated by ADRRS", adrrsTerminated, adrrsVertices);
+STAT_COUNTER("Integrator/Paths split by ADRRS", adrrsSplit);
 
 // PathIntegrator Method Definitions
 PathIntegrator::PathIntegrator(int maxDepth, Camera camera, Sampler sampler,
                                Primitive aggregate, std::vector<Light> lights,
-                               const std::string &lightSampleStrategy, bool regularize)
+                               const std::string &lightSampleStrategy, bool regularize,
+                               Float guidingTraining, bool adrrs, int lightCandidates,
+                               Float lightCacheTraining)
     : RayIntegrator(camera, sampler, aggregate, lights),
       maxDepth(maxDepth),
       lightSampler(LightSampler::Create(lightSampleStrategy, lights, Allocator())),
-      regularize(regularize) {}
+      regularize(regularize),
+      adrrs(adrrs),
+      lightCandidates(lightCandidates) {
+    if (guidingTraining > 0 && aggregate)
+        pathGuide = std::make_unique<PathGuide>(
+            aggregate.Bounds(),
+            std::max(1, int(guidingTraining * sampler.SamplesPerPixel())));
+    if (lightCacheTraining > 0 && aggregate) {
+        // The light selection cache learns weights for the light BVH's clusters
+        if (const BVHLightSampler *bvh = lightSampler.CastOrNullptr<BVHLightSampler>())
+            lightCache = std::make_unique<LightSelectionCache>(
+                bvh, aggregate.Bounds(),
+                std::max(1, int(lightCacheTraining * sampler.SamplesPerPixel())));
+        else
+            Warning("Light selection cache requires the \"bvh\" or \"bvh4\" light "
+                    "sampler. Ignoring \"lightcache\".");
+    }
+}
+
+void PathIntegrator::FinishedWave(int waveStart, int waveEnd) {
+    if (pathGuide)
+        pathGuide->FinishedWave(waveEnd - waveStart);
+    if (lightCache)
+        lightCache->FinishedWave(waveEnd - waveStart);
+    if (!adrrs)
+        return;
+
+    // Update the pixel and image luminance estimates used for ADRRS
+    Film film = camera.GetFilm();
+    Bounds2i pixelBounds = film.PixelBounds();
+    if (pixelEstimates.XSize() == 0)
+        pixelEstimates = Array2D<Float>(pixelBounds);
+    AtomicDouble sum(0);
+    ParallelFor(pixelBounds.pMin.y, pixelBounds.pMax.y, [&](int64_t y) {
+        double rowSum = 0;
+        for (int x = pixelBounds.pMin.x; x < pixelBounds.pMax.x; ++x) {
+            Float I = std::max<Float>(0, film.GetPixelRGB({x, int(y)}).Average());
+            pixelEstimates[{x, int(y)}] = I;
+            rowSum += I;
+        }
+        sum.Add(rowSum);
+    });
+    imageEstimate = sum / pixelBounds.Area();
+}
 
 SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lambda,
                                    Sampler sampler, ScratchBuffer &scratchBuffer,
@@ -708,6 +1235,41 @@ SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lamb
     Float p_b, etaScale = 1;
     bool specularBounce = false, anyNonSpecularBounces = false;
     LightSampleContext prevIntrCtx;
+    // Vertices at which to record the path's radiance into the path guide
+    bool recordGuide = pathGuide && pathGuide->Training();
+    PathGuideVertex guideVertices[PathGuide::MaxRecordedVertices];
+    int nGuideVertices = 0;
+    // Branches of the path left to trace after it is split by ADRRS
+    struct PendingPath {
+        RayDifferential ray;
+        SampledSpectrum beta;
+        Float p_b, etaScale;
+        int depth;
+        bool specularBounce, anyNonSpecularBounces;
+        LightSampleContext prevIntrCtx;
+    };
+    constexpr int MaxPendingPaths = 16, MaxSplit = 4;
+    PendingPath pendingPaths[MaxPendingPaths];
+    int nPendingPaths = 0;
+    auto startPendingPath = [&]() {
+        if (nPendingPaths == 0)
+            return false;
+        const PendingPath &path = pendingPaths[--nPendingPaths];
+        ray = path.ray;
+        beta = path.beta;
+        p_b = path.p_b;
+        etaScale = path.etaScale;
+        depth = path.depth;
+        specularBounce = path.specularBounce;
+        anyNonSpecularBounces = path.anyNonSpecularBounces;
+        prevIntrCtx = path.prevIntrCtx;
+        return true;
+    };
+    // Find the luminance that paths at this pixel are expected to contribute,
+    // or zero if there isn't an estimate yet
+    Float I = 0;
+    if (adrrs && imageEstimate > 0)
+        I = std::max(pixelEstimates[currentPixel], 0.01f * imageEstimate);
 
     // Sample path from camera and accumulate radiance estimate
     while (true) {
@@ -722,7 +1284,7 @@ SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lamb
                     L += beta * Le;
                 else {
                     // Compute MIS weight for infinite light
-                    Float p_l = lightSampler.PMF(prevIntrCtx, light) *
+                    Float p_l = LightPMF(prevIntrCtx, light) *
                                 light.PDF_Li(prevIntrCtx, ray.d, true);
                     Float w_b = PowerHeuristic(1, p_b, 1, p_l);
 
@@ -730,6 +1292,8 @@ SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lamb
                 }
             }
 
+            if (startPendingPath())
+                continue;
             break;
         }
         // Incorporate emission from surface hit by ray
@@ -740,7 +1304,7 @@ SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lamb
             else {
                 // Compute MIS weight for area light
                 Light areaLight(si->intr.areaLight);
-                Float p_l = lightSampler.PMF(prevIntrCtx, areaLight) *
+                Float p_l = LightPMF(prevIntrCtx, areaLight) *
                             areaLight.PDF_Li(prevIntrCtx, ray.d, true);
                 Float w_l = PowerHeuristic(1, p_b, 1, p_l);
 
@@ -790,28 +1354,90 @@ SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lamb
         ++totalBSDFs;
 
         // End path if maximum depth reached
-        if (depth++ == maxDepth)
+        if (depth++ == maxDepth) {
+            if (startPendingPath())
+                continue;
             break;
+        }
+
+        // Find the path guide's distribution of incident radiance, if any
+        const DirectionalQuadtree *guide = nullptr;
+        if (pathGuide && IsNonSpecular(bsdf.Flags()))
+            guide = pathGuide->Lookup(isect.p());
+        GuidedBSDF guidedBSDF(&bsdf, guide);
 
         // Sample direct illumination from the light sources
         if (IsNonSpecular(bsdf.Flags())) {
             ++totalPaths;
-            SampledSpectrum Ld = SampleLd(isect, &bsdf, lambda, sampler);
+            SampledSpectrum Ld = SampleLd(isect, &bsdf, lambda, sampler, guide);
             if (!Ld)
                 ++zeroRadiancePaths;
             L += beta * Ld;
         }
 
-        // Sample BSDF to get new path direction
+        // Possibly terminate or split the path with ADRRS
         Vector3f wo = -ray.d;
+        if (I > 0) {
+            // Compare the path's expected contribution to the pixel's estimate
+            // inside a weight window; lacking a local estimate of the radiance
+            // leaving the vertex, the image's mean luminance stands in for it
+            ++adrrsVertices;
+            Float ratio = (beta * etaScale).Average() * imageEstimate / I;
+            constexpr Float windowLow = 2.f / (1 + 5), windowHigh = 5 * windowLow;
+            if (ratio < windowLow) {
+                if (sampler.Get1D() >= ratio) {
+                    ++adrrsTerminated;
+                    if (startPendingPath())
+                        continue;
+                    break;
+                }
+                beta /= ratio;
+            } else if (ratio > windowHigh && !recordGuide) {
+                // Queue additional branches that start with independent samples
+                // of the BSDF; the recorded guide vertices assume a single
+                // path, so paths aren't split while training the guide
+                int nBranches = std::min({int(std::ceil(ratio)), MaxSplit,
+                                          MaxPendingPaths - nPendingPaths + 1});
+                if (nBranches > 1)
+                    ++adrrsSplit;
+                for (int i = 1; i < nBranches; ++i) {
+                    pstd::optional<BSDFSample> bs =
+                        guidedBSDF.Sample_f(wo, sampler.Get1D(), sampler.Get2D());
+                    if (!bs)
+                        continue;
+                    PendingPath &path = pendingPaths[nPendingPaths++];
+                    path.beta = beta * bs->f * AbsDot(bs->wi, isect.shading.n) /
+                                (bs->pdf * nBranches);
+                    path.p_b = bs->pdfIsProportional ? guidedBSDF.PDF(wo, bs->wi)
+                                                     : bs->pdf;
+                    path.etaScale =
+                        bs->IsTransmission() ? etaScale * Sqr(bs->eta) : etaScale;
+                    path.depth = depth;
+                    path.specularBounce = bs->IsSpecular();
+                    path.anyNonSpecularBounces =
+                        anyNonSpecularBounces || !bs->IsSpecular();
+                    path.prevIntrCtx = si->intr;
+                    path.ray = isect.SpawnRay(ray, bsdf, bs->wi, bs->flags, bs->eta);
+                }
+                beta /= nBranches;
+            }
+        }
+
+        // Sample BSDF to get new path direction
         Float u = sampler.Get1D();
-        pstd::optional<BSDFSample> bs = bsdf.Sample_f(wo, u, sampler.Get2D());
-        if (!bs)
+        pstd::optional<BSDFSample> bs = guidedBSDF.Sample_f(wo, u, sampler.Get2D());
+        if (!bs) {
+            if (startPendingPath())
+                continue;
             break;
+        }
         // Update path state variables after surface scattering
         beta *= bs->f * AbsDot(bs->wi, isect.shading.n) / bs->pdf;
-        p_b = bs->pdfIsProportional ? bsdf.PDF(wo, bs->wi) : bs->pdf;
+        p_b = bs->pdfIsProportional ? guidedBSDF.PDF(wo, bs->wi) : bs->pdf;
         DCHECK(!IsInf(beta.y(lambda)));
+        if (recordGuide && !bs->IsSpecular() &&
+            nGuideVertices < PathGuide::MaxRecordedVertices)
+            guideVertices[nGuideVertices++] = {isect.p(), bs->wi, p_b, beta, L};
         specularBounce = bs->IsSpecular();
         anyNonSpecularBounces |= !bs->IsSpecular();
         if (bs->IsTransmission())
@@ -820,23 +1446,29 @@ SampledSpectrum PathIntegrator::Li(RayDifferential ray, SampledWavelengths &lamb
 
         ray = isect.SpawnRay(ray, bsdf, bs->wi, bs->flags, bs->eta);
 
-        // Possibly terminate the path with Russian roulette
+        // Possibly terminate the path with Russian roulette, unless ADRRS does
         SampledSpectrum rrBeta = beta * etaScale;
-        if (rrBeta.MaxComponentValue() < 1 && depth > 1) {
+        if (I == 0 && rrBeta.MaxComponentValue() < 1 && depth > 1) {
             Float q = std::max<Float>(0, 1 - rrBeta.MaxComponentValue());
-            if (sampler.Get1D() < q)
+            if (sampler.Get1D() < q) {
+                if (startPendingPath())
+                    continue;
                 break;
+            }
             beta /= 1 - q;
             DCHECK(!IsInf(beta.y(lambda)));
         }
     }
+    if (nGuideVertices > 0)
+        pathGuide->RecordPath(pstd::MakeConstSpan(guideVertices, nGuideVertices), L);
     pathLength << depth;
     return L;
 }
 
 SampledSpectrum PathIntegrator::SampleLd(const SurfaceInteraction &intr, const BSDF *bsdf,
-                                         SampledWavelengths &lambda,
-                                         Sampler sampler) const {
+                                         SampledWavelengths &lambda, Sampler sampler,
+                                         const DirectionalQuadtree *guide) const {
+    ProfilerScope _(ProfilePhase::LightSampling);
     // Initialize _LightSampleContext_ for light sampling
     LightSampleContext ctx(intr);
     // Try to nudge the light sampling position to correct side of the surface
@@ -846,9 +1478,12 @@ SampledSpectrum PathIntegrator::SampleLd(const SurfaceInteraction &intr, const B
     else if (IsTransmissive(flags) && !IsReflective(flags))
         ctx.pi = intr.OffsetRayOrigin(-intr.wo);
 
+    if (lightCandidates > 1)
+        return SampleLdResampled(intr, bsdf, ctx, lambda, sampler, guide);
+
     // Choose a light source for the direct lighting calculation
     Float u = sampler.Get1D();
-    pstd::optional<SampledLight> sampledLight = lightSampler.Sample(ctx, u);
+    pstd::optional<SampledLight> sampledLight = SampleLight(ctx, u);
     Point2f uLight = sampler.Get2D();
     if (!sampledLight)
         return {};
@@ -863,7 +1498,12 @@ SampledSpectrum PathIntegrator::SampleLd(const SurfaceInteraction &intr, const B
     // Evaluate BSDF for light sample and check light visibility
     Vector3f wo = intr.wo, wi = ls->wi;
     SampledSpectrum f = bsdf->f(wo, wi) * AbsDot(wi, intr.shading.n);
-    if (!f || !Unoccluded(intr, ls->pLight))
+    if (!f)
+        return {};
+    bool unoccluded = Unoccluded(intr, ls->pLight);
+    if (lightCache && lightCache->Training())
+        lightCache->Record(ctx, light, unoccluded);
+    if (!unoccluded)
         return {};
 
     // Return light's contribution to reflected radiance
@@ -871,15 +1511,74 @@ SampledSpectrum PathIntegrator::SampleLd(const SurfaceInteraction &intr, const B
     if (IsDeltaLight(light.Type()))
         return ls->L * f / p_l;
     else {
-        Float p_b = bsdf->PDF(wo, wi);
+        Float p_b = GuidedBSDF(bsdf, guide).PDF(wo, wi);
         Float w_l = PowerHeuristic(1, p_l, 1, p_b);
         return w_l * ls->L * f / p_l;
     }
 }
 
+SampledSpectrum PathIntegrator::SampleLdResampled(
+    const SurfaceInteraction &intr, const BSDF *bsdf, const LightSampleContext &ctx,
+    SampledWavelengths &lambda, Sampler sampler, const DirectionalQuadtree *guide) const {
+    // Each candidate's resampling weight is the average of its unshadowed
+    // single-sample estimate, which is proportional to its contribution divided
+    // by the light sampling PDF; the selected candidate's estimate is then
+    // scaled to account for the resampling.
+    struct LightCandidate {
+        SampledSpectrum Ld;
+        Interaction pLight;
+        Light light;
+    };
+    uint64_t seed = MixBits(FloatToBits(sampler.Get1D()));
+    WeightedReservoirSampler<LightCandidate> candidateSampler(seed);
+
+    Vector3f wo = intr.wo;
+    for (int i = 0; i < lightCandidates; ++i) {
+        // Sample a light and a point on it for the $i$th candidate
+        Float u = sampler.Get1D();
+        pstd::optional<SampledLight> sampledLight = SampleLight(ctx, u);
+        Point2f uLight = sampler.Get2D();
+        if (!sampledLight)
+            continue;
+        Light light = sampledLight->light;
+        pstd::optional<LightLiSample> ls = light.SampleLi(ctx, uLight, lambda, true);
+        if (!ls || !ls->L || ls->pdf == 0)
+            continue;
+        Vector3f wi = ls->wi;
+        SampledSpectrum f = bsdf->f(wo, wi) * AbsDot(wi, intr.shading.n);
+        if (!f)
+            continue;
+
+        // Compute candidate's unshadowed estimate and add it to the reservoir
+        Float p_l = sampledLight->p * ls->pdf;
+        Float w_l = 1;
+        if (!IsDeltaLight(light.Type()))
+            w_l = PowerHeuristic(1, p_l, 1, GuidedBSDF(bsdf, guide).PDF(wo, wi));
+        SampledSpectrum Ld = w_l * ls->L * f / p_l;
+        if (Float weight = Ld.Average(); weight > 0)
+            candidateSampler.Add(LightCandidate{Ld, ls->pLight, light}, weight);
+    }
+
+    // Trace shadow ray to the chosen candidate
+    if (!candidateSampler.HasSample())
+        return {};
+    const LightCandidate &candidate = candidateSampler.GetSample();
+    bool unoccluded = Unoccluded(intr, candidate.pLight);
+    if (lightCache && lightCache->Training())
+        lightCache->Record(ctx, candidate.light, unoccluded);
+    if (!unoccluded)
+        return {};
+    return candidate.Ld / (lightCandidates * candidateSampler.SampleProbability());
+}
+
 std::string PathIntegrator::ToString() const {
-    return StringPrintf("[ PathIntegrator maxDepth: %d lightSampler: %s regularize: %s ]",
-                        maxDepth, lightSampler, regularize);
+    return StringPrintf("[ PathIntegrator maxDepth: %d lightSampler: %s regularize: %s "
+                        "pathGuide: %s adrrs: %s imageEstimate: %f lightCandidates: %d "
+                        "lightCache: %s ]",
+                        maxDepth, lightSampler, regularize,
+                        pathGuide ? pathGuide->ToString() : std::string("(nullptr)"),
+                        adrrs, imageEstimate, lightCandidates,
+                        lightCache ? lightCache->ToString() : std::string("(nullptr)"));
 }
 
 std::unique_ptr<PathIntegrator> PathIntegrator::Create(
@@ -888,8 +1587,24 @@ std::unique_ptr<PathIntegrator> PathIntegrator::Create(
     int maxDepth = parameters.GetOneInt("maxdepth", 5);
     std::string lightStrategy = parameters.GetOneString("lightsampler", "bvh");
     bool regularize = parameters.GetOneBool("regularize", false);
+    Float guidingTraining = parameters.GetOneBool("guiding", false)
+                                ? parameters.GetOneFloat("guidingtraining", 0.25f)
+                                : 0;
+    std::string rrStrategy = parameters.GetOneString("rrstrategy", "throughput");
+    if (rrStrategy != "throughput" && rrStrategy != "adrrs")
+        ErrorExit(loc, "%s: unknown \"rrstrategy\". Must be \"throughput\" or "
+                       "\"adrrs\".",
+                  rrStrategy);
+    int lightCandidates = parameters.GetOneInt("lightcandidates", 1);
+    if (lightCandidates < 1)
+        ErrorExit(loc, "%d: \"lightcandidates\" must be at least one.", lightCandidates);
+    Float lightCacheTraining = parameters.GetOneBool("lightcache", false)
+                                   ? parameters.GetOneFloat("lightcachetraining", 0.25f)
+                                   : 0;
     return std::make_unique<PathIntegrator>(maxDepth, camera, sampler, aggregate, lights,
-                                            lightStrategy, regularize);
+                                            lightStrategy, regularize, guidingTraining,
+                                            rrStrategy == "adrrs", lightCandidates,
+                                            lightCacheTraining);
 }
 
 // SimpleVolPathIntegrator Method Definitions
@@ -921,14 +1636,16 @@ SampledSpectrum SimpleVolPathIntegrator::Li(RayDifferential ray,
         bool scattered = false, terminated = false;
         if (ray.medium) {
             // Initialize _RNG_ for sampling the majorant transmittance
-            uint64_t hash0 = Hash(sampler.Get1D());
-            uint64_t hash1 = Hash(sampler.Get1D());
+            Float uMedium[4];
+            sampler.GetDimensions(uMedium);
+            uint64_t hash0 = Hash(uMedium[0]);
+            uint64_t hash1 = Hash(uMedium[1]);
             RNG rng(hash0, hash1);
 
             // Sample medium using delta tracking
             Float tMax = si ? si->tHit : Infinity;
-            Float u = sampler.Get1D();
-            Float uMode = sampler.Get1D();
+            Float u = uMedium[2];
+            Float uMode = uMedium[3];
             SampleT_maj(ray, tMax, u, rng, lambda,
                         [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
                             SampledSpectrum T_maj) {
@@ -1023,6 +1740,20 @@ STAT_COUNTER("Integrator/Volume interactions", volumeInteractions);
 STAT_COUNTER("Integrator/Surface interactions", surfaceInteractions);
 
 // VolPathIntegrator Method Definitions
+VolPathIntegrator::VolPathIntegrator(int maxDepth, Camera camera, Sampler sampler,
+                                     Primitive aggregate, std::vector<Light> lights,
+                                     const std::string &lightSampleStrategy,
+                                     bool regularize, Float guidingTraining)
+    : RayIntegrator(camera, sampler, aggregate, lights),
+      maxDepth(maxDepth),
+      lightSampler(LightSampler::Create(lightSampleStrategy, lights, Allocator())),
+      regularize(regularize) {
+    if (guidingTraining > 0 && aggregate)
+        pathGuide = std::make_unique<PathGuide>(
+            aggregate.Bounds(),
+            std::max(1, int(guidingTraining * sampler.SamplesPerPixel())));
+}
+
 SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &lambda,
                                       Sampler sampler, ScratchBuffer &scratchBuffer,
                                       VisibleSurface *visibleSurf) const {
@@ -1033,6 +1764,10 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
     Float etaScale = 1;
 
     LightSampleContext prevIntrContext;
+    // Surface vertices at which to record the path's radiance into the path guide
+    bool recordGuide = pathGuide && pathGuide->Training();
+    PathGuideVertex guideVertices[PathGuide::MaxRecordedVertices];
+    int nGuideVertices = 0;
 
     while (true) {
         // Sample segment of volumetric scattering path
@@ -1045,12 +1780,15 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
             bool scattered = false, terminated = false;
             Float tMax = si ? si->tHit : Infinity;
             // Initialize _RNG_ for sampling the majorant transmittance
-            uint64_t hash0 = Hash(sampler.Get1D());
-            uint64_t hash1 = Hash(sampler.Get1D());
+            Float uMedium[3];
+            sampler.GetDimensions(uMedium);
+            uint64_t hash0 = Hash(uMedium[0]);
+            uint64_t hash1 = Hash(uMedium[1]);
             RNG rng(hash0, hash1);
 
+            ProfilerScope _(ProfilePhase::MediumSampling);
             SampledSpectrum T_maj = SampleT_maj(
-                ray, tMax, sampler.Get1D(), rng, lambda,
+                ray, tMax, uMedium[2], rng, lambda,
                 [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
                     SampledSpectrum T_maj) {
                     // Handle medium scattering event for ray
@@ -1141,7 +1879,7 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
                 });
             // Handle terminated, scattered, and unscattered medium rays
             if (terminated || !beta || !r_u)
-                return L;
+                break;
             if (scattered)
                 continue;
 
@@ -1217,7 +1955,7 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
 
         // Terminate path if maximum depth reached
         if (depth++ >= maxDepth)
-            return L;
+            break;
 
         ++surfaceInteractions;
         // Possibly regularize the BSDF
@@ -1226,9 +1964,15 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
             bsdf.Regularize();
         }
 
+        // Find the path guide's distribution of incident radiance, if any
+        const DirectionalQuadtree *guide = nullptr;
+        if (pathGuide && IsNonSpecular(bsdf.Flags()))
+            guide = pathGuide->Lookup(isect.p());
+        GuidedBSDF guidedBSDF(&bsdf, guide);
+
         // Sample illumination from lights to find attenuated path contribution
         if (IsNonSpecular(bsdf.Flags())) {
-            L += SampleLd(isect, &bsdf, lambda, sampler, beta, r_u);
+            L += SampleLd(isect, &bsdf, lambda, sampler, beta, r_u, guide);
             DCHECK(IsInf(L.y(lambda)) == false);
         }
         prevIntrContext = LightSampleContext(isect);
@@ -1236,15 +1980,17 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
         // Sample BSDF to get new volumetric path direction
         Vector3f wo = isect.wo;
         Float u = sampler.Get1D();
-        pstd::optional<BSDFSample> bs = bsdf.Sample_f(wo, u, sampler.Get2D());
+        pstd::optional<BSDFSample> bs = guidedBSDF.Sample_f(wo, u, sampler.Get2D());
         if (!bs)
             break;
         // Update _beta_ and rescaled path probabilities for BSDF scattering
         beta *= bs->f * AbsDot(bs->wi, isect.shading.n) / bs->pdf;
-        if (bs->pdfIsProportional)
-            r_l = r_u / bsdf.PDF(wo, bs->wi);
-        else
-            r_l = r_u / bs->pdf;
+        Float scatterPDF = bs->pdfIsProportional ? guidedBSDF.PDF(wo, bs->wi) : bs->pdf;
+        r_l = r_u / scatterPDF;
+        if (recordGuide && !bs->IsSpecular() &&
+            nGuideVertices < PathGuide::MaxRecordedVertices)
+            guideVertices[nGuideVertices++] = {isect.p(), bs->wi, scatterPDF,
+                                               beta / r_u.Average(), L};
 
         PBRT_DBG("%s\n", StringPrintf("Sampled BSDF, f = %s, pdf = %f -> beta = %s",
                                       bs->f, bs->pdf, beta)
@@ -1269,7 +2015,8 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
 
             // Sample random intersection along BSSRDF probe segment
             uint64_t seed = MixBits(FloatToBits(sampler.Get1D()));
-            WeightedReservoirSampler<SubsurfaceInteraction> interactionSampler(seed);
+            WeightedReservoirSampler<SubsurfaceInteraction, BatchRNG> interactionSampler(
+                seed);
             // Intersect BSSRDF sampling ray against the scene geometry
             Interaction base(probeSeg->p0, ray.time, Medium());
             while (true) {
@@ -1340,13 +2087,16 @@ SampledSpectrum VolPathIntegrator::Li(RayDifferential ray, SampledWavelengths &l
             beta /= 1 - q;
         }
     }
+    if (nGuideVertices > 0)
+        pathGuide->RecordPath(pstd::MakeConstSpan(guideVertices, nGuideVertices), L);
     return L;
 }
 
 SampledSpectrum VolPathIntegrator::SampleLd(const Interaction &intr, const BSDF *bsdf,
                                             SampledWavelengths &lambda, Sampler sampler,
-                                            SampledSpectrum beta,
-                                            SampledSpectrum r_p) const {
+                                            SampledSpectrum beta, SampledSpectrum r_p,
+                                            const DirectionalQuadtree *guide) const {
+    ProfilerScope _(ProfilePhase::LightSampling);
     // Estimate light-sampled direct illumination at _intr_
     // Initialize _LightSampleContext_ for volumetric light sampling
     LightSampleContext ctx;
@@ -1384,7 +2134,7 @@ SampledSpectrum VolPathIntegrator::SampleLd(const Interaction &intr, const BSDF
     if (bsdf) {
         // Update _f_hat_ and _scatterPDF_ accounting for the BSDF
         f_hat = bsdf->f(wo, wi) * AbsDot(wi, intr.AsSurface().shading.n);
-        scatterPDF = bsdf->PDF(wo, wi);
+        scatterPDF = GuidedBSDF(bsdf, guide).PDF(wo, wi);
 
     } else {
         // Update _f_hat_ and _scatterPDF_ accounting for the phase function
@@ -1412,38 +2162,41 @@ SampledSpectrum VolPathIntegrator::SampleLd(const Interaction &intr, const BSDF
         if (lightRay.medium) {
             Float tMax = si ? si->tHit : (1 - ShadowEpsilon);
             Float u = rng.Uniform<Float>();
-            SampledSpectrum T_maj =
-                SampleT_maj(lightRay, tMax, u, rng, lambda,
-                            [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
-                                SampledSpectrum T_maj) {
-                                // Update ray transmittance estimate at sampled point
-                                // Update _T_ray_ and PDFs using ratio-tracking estimator
-                                SampledSpectrum sigma_n =
-                                    ClampZero(sigma_maj - mp.sigma_a - mp.sigma_s);
-                                Float pdf = T_maj[0] * sigma_maj[0];
-                                T_ray *= T_maj * sigma_n / pdf;
-                                r_l *= T_maj * sigma_maj / pdf;
-                                r_u *= T_maj * sigma_n / pdf;
-
-                                // Possibly terminate transmittance computation using
-                                // Russian roulette
-                                SampledSpectrum Tr = T_ray / (r_l + r_u).Average();
-                                if (Tr.MaxComponentValue() < 0.05f) {
-                                    Float q = 0.75f;
-                                    if (rng.Uniform<Float>() < q)
-                                        T_ray = SampledSpectrum(0.);
-                                    else
-                                        T_ray /= 1 - q;
-                                }
+            SampledSpectrum T_rmaj;
+            ProfilerScope _(ProfilePhase::MediumSampling);
+            SampledSpectrum T_maj = SampleResidualT_maj(
+                lightRay, tMax, u, rng, lambda, &T_rmaj,
+                [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
+                    SampledSpectrum sigma_rmaj, SampledSpectrum T_maj,
+                    SampledSpectrum T_rmaj) {
+                    // Update ray transmittance estimate at sampled point
+                    // Update _T_ray_ and PDFs using residual ratio-tracking estimator
+                    SampledSpectrum sigma_n =
+                        ClampZero(sigma_maj - mp.sigma_a - mp.sigma_s);
+                    Float pdf = T_rmaj[0] * sigma_rmaj[0];
+                    T_ray *= T_maj * sigma_n / pdf;
+                    r_l *= T_rmaj * sigma_rmaj / pdf;
+                    r_u *= T_maj * sigma_n / pdf;
+
+                    // Possibly terminate transmittance computation using Russian
+                    // roulette
+                    SampledSpectrum Tr = T_ray / (r_l + r_u).Average();
+                    if (Tr.MaxComponentValue() < 0.05f) {
+                        Float q = 0.75f;
+                        if (rng.Uniform<Float>() < q)
+                            T_ray = SampledSpectrum(0.);
+                        else
+                            T_ray /= 1 - q;
+                    }
 
-                                if (!T_ray)
-                                    return false;
-                                return true;
-                            });
+                    if (!T_ray)
+                        return false;
+                    return true;
+                });
             // Update transmittance estimate for final segment
-            T_ray *= T_maj / T_maj[0];
-            r_l *= T_maj / T_maj[0];
-            r_u *= T_maj / T_maj[0];
+            T_ray *= T_maj / T_rmaj[0];
+            r_l *= T_rmaj / T_rmaj[0];
+            r_u *= T_maj / T_rmaj[0];
         }
 
         // Generate next ray segment or return final transmittance
@@ -1464,8 +2217,10 @@ SampledSpectrum VolPathIntegrator::SampleLd(const Interaction &intr, const BSDF
 
 std::string VolPathIntegrator::ToString() const {
     return StringPrintf(
-        "[ VolPathIntegrator maxDepth: %d lightSampler: %s regularize: %s ]", maxDepth,
-        lightSampler, regularize);
+        "[ VolPathIntegrator maxDepth: %d lightSampler: %s regularize: %s "
+        "pathGuide: %s ]",
+        maxDepth, lightSampler, regularize,
+        pathGuide ? pathGuide->ToString() : std::string("(nullptr)"));
 }
 
 std::unique_ptr<VolPathIntegrator> VolPathIntegrator::Create(
@@ -1474,17 +2229,22 @@ std::unique_ptr<VolPathIntegrator> VolPathIntegrator::Create(
     int maxDepth = parameters.GetOneInt("maxdepth", 5);
     std::string lightStrategy = parameters.GetOneString("lightsampler", "bvh");
     bool regularize = parameters.GetOneBool("regularize", false);
+    Float guidingTraining = parameters.GetOneBool("guiding", false)
+                                ? parameters.GetOneFloat("guidingtraining", 0.25f)
+                                : 0;
     return std::make_unique<VolPathIntegrator>(maxDepth, camera, sampler, aggregate,
-                                               lights, lightStrategy, regularize);
+                                               lights, lightStrategy, regularize,
+                                               guidingTraining);
 }
 
 // AOIntegrator Method Definitions
-AOIntegrator::AOIntegrator(bool cosSample, Float maxDist, Camera camera, Sampler sampler,
-                           Primitive aggregate, std::vector<Light> lights,
-                           Spectrum illuminant)
+AOIntegrator::AOIntegrator(bool cosSample, Float maxDist, int nSamples, Camera camera,
+                           Sampler sampler, Primitive aggregate,
+                           std::vector<Light> lights, Spectrum illuminant)
     : RayIntegrator(camera, sampler, aggregate, lights),
       cosSample(cosSample),
       maxDist(maxDist),
+      nSamples(nSamples),
       illuminant(illuminant),
       illumScale(1.f / SpectrumToPhotometric(illuminant)) {}
 
@@ -1506,36 +2266,50 @@ retry:
         // Compute coordinate frame based on true geometry, not shading
         // geometry.
         Normal3f n = FaceForward(isect.n, -ray.d);
-
-        Vector3f wi;
-        Float pdf;
-        Point2f u = sampler.Get2D();
-        if (cosSample) {
-            wi = SampleCosineHemisphere(u);
-            pdf = CosineHemispherePDF(std::abs(wi.z));
-        } else {
-            wi = SampleUniformHemisphere(u);
-            pdf = UniformHemispherePDF();
-        }
-        if (pdf == 0)
-            return SampledSpectrum(0.);
-
         Frame f = Frame::FromZ(n);
-        wi = f.FromLocal(wi);
 
-        // Divide by pi so that fully visible is one.
-        Ray r = isect.SpawnRay(wi);
-        if (!IntersectP(r, maxDist)) {
-            return illumScale * illuminant.Sample(lambda) *
-                   Dot(wi, n) / (Pi * pdf);
+        // Sample all of the AO rays so that they can be traced together
+        Ray *rays = scratchBuffer.Alloc<Ray[]>(nSamples);
+        Float *tMax = scratchBuffer.Alloc<Float[]>(nSamples);
+        Float *weight = scratchBuffer.Alloc<Float[]>(nSamples);
+        bool *hit = scratchBuffer.Alloc<bool[]>(nSamples);
+        int nRays = 0;
+        for (int i = 0; i < nSamples; ++i) {
+            Vector3f wi;
+            Float pdf;
+            Point2f u = sampler.Get2D();
+            if (cosSample) {
+                wi = SampleCosineHemisphere(u);
+                pdf = CosineHemispherePDF(std::abs(wi.z));
+            } else {
+                wi = SampleUniformHemisphere(u);
+                pdf = UniformHemispherePDF();
+            }
+            if (pdf == 0)
+                continue;
+
+            wi = f.FromLocal(wi);
+            rays[nRays] = isect.SpawnRay(wi);
+            tMax[nRays] = maxDist;
+            // Divide by pi so that fully visible is one.
+            weight[nRays] = Dot(wi, n) / (Pi * pdf);
+            ++nRays;
         }
+
+        IntersectP(nRays, rays, tMax, hit);
+        Float visible = 0;
+        for (int i = 0; i < nRays; ++i)
+            if (!hit[i])
+                visible += weight[i];
+        return illumScale * illuminant.Sample(lambda) * visible / nSamples;
     }
     return SampledSpectrum(0.);
 }
 
 std::string AOIntegrator::ToString() const {
-    return StringPrintf("[ AOIntegrator cosSample: %s maxDist: %f illuminant: %s ]",
-                        cosSample, maxDist, illuminant);
+    return StringPrintf(
+        "[ AOIntegrator cosSample: %s maxDist: %f nSamples: %d illuminant: %s ]",
+        cosSample, maxDist, nSamples, illuminant);
 }
 
 std::unique_ptr<AOIntegrator> AOIntegrator::Create(const ParameterDictionary &parameters,
@@ -1545,8 +2319,269 @@ std::unique_ptr<AOIntegrator> AOIntegrator::Create(const ParameterDictionary &pa
                                                    const FileLoc *loc) {
     bool cosSample = parameters.GetOneBool("cossample", true);
     Float maxDist = parameters.GetOneFloat("maxdistance", Infinity);
-    return std::make_unique<AOIntegrator>(cosSample, maxDist, camera, sampler, aggregate,
-                                          lights, illuminant);
+    int nSamples = parameters.GetOneInt("nsamples", 1);
+    if (nSamples < 1)
+        ErrorExit(loc, "%d: \"nsamples\" must be at least one.", nSamples);
+    return std::make_unique<AOIntegrator>(cosSample, maxDist, nSamples, camera, sampler,
+                                          aggregate, lights, illuminant);
+}
+
+// RadianceCacheIntegrator Method Definitions
+STAT_PERCENT("Integrator/Paths terminated in radiance cache", cacheTerminatedPaths,
+             cacheLookups);
+STAT_COUNTER("Integrator/Radiance cache lookups without a free entry", cacheOverflows);
+STAT_MEMORY_COUNTER("Memory/Radiance cache", radianceCacheBytes);
+
+RadianceCacheIntegrator::RadianceCacheIntegrator(int maxDepth, Float cellSize,
+                                                 int minSamples, int cacheSize,
+                                                 Camera camera, Sampler sampler,
+                                                 Primitive aggregate,
+                                                 std::vector<Light> lights,
+                                                 const RGBColorSpace *colorSpace,
+                                                 const std::string &lightSampleStrategy)
+    : RayIntegrator(camera, sampler, aggregate, lights),
+      maxDepth(maxDepth),
+      cellSize(cellSize),
+      minSamples(minSamples),
+      cacheSize(cacheSize),
+      lightSampler(LightSampler::Create(lightSampleStrategy, lights, Allocator())),
+      colorSpace(colorSpace),
+      cache(new CacheEntry[cacheSize]) {
+    // Size the cache's cells relative to the scene if no size was given
+    if (this->cellSize <= 0)
+        this->cellSize = aggregate ? Length(aggregate.Bounds().Diagonal()) / 256 : 1;
+    radianceCacheBytes += cacheSize * sizeof(CacheEntry);
+}
+
+RadianceCacheIntegrator::CacheEntry *RadianceCacheIntegrator::FindCacheEntry(
+    Point3f p, Normal3f n) const {
+    // Hash the grid cell containing _p_ along with the dominant axis of _n_, so
+    // that the two sides of thin surfaces and nearby corners don't share entries
+    Point3i cell(pstd::floor(p.x / cellSize), pstd::floor(p.y / cellSize),
+                 pstd::floor(p.z / cellSize));
+    int axis = MaxComponentIndex(Abs(n));
+    int direction = 2 * axis + (n[axis] < 0);
+    uint64_t key = Hash(cell, direction) | 1;
+
+    // Find the cell's entry with linear probing, claiming an unused one if needed
+    constexpr int maxProbes = 16;
+    for (int i = 0; i < maxProbes; ++i) {
+        CacheEntry &entry = cache[(key + i) % cacheSize];
+        uint64_t entryKey = entry.key.load(std::memory_order_relaxed);
+        if (entryKey == 0 && entry.key.compare_exchange_strong(entryKey, key))
+            return &entry;
+        if (entryKey == key)
+            return &entry;
+    }
+    ++cacheOverflows;
+    return nullptr;
+}
+
+SampledSpectrum RadianceCacheIntegrator::Li(RayDifferential ray,
+                                            SampledWavelengths &lambda, Sampler sampler,
+                                            ScratchBuffer &scratchBuffer,
+                                            VisibleSurface *visibleSurf) const {
+    // Declare local variables for _RadianceCacheIntegrator::Li()_
+    SampledSpectrum L(0.f), beta(1.f);
+    int depth = 0;
+    Float p_b, etaScale = 1;
+    bool specularBounce = false;
+    LightSampleContext prevIntrCtx;
+    // Cache entry to record the path's irradiance estimate into, if any; the
+    // estimate is the radiance found after _recordL_ divided by _recordBeta_
+    CacheEntry *recordEntry = nullptr;
+    SampledSpectrum recordL, recordBeta;
+
+    while (true) {
+        // Trace ray and find closest path vertex and its BSDF
+        pstd::optional<ShapeIntersection> si = Intersect(ray);
+        if (!si) {
+            // Incorporate emission from infinite lights for escaped ray
+            for (const auto &light : infiniteLights) {
+                SampledSpectrum Le = light.Le(ray, lambda);
+                if (depth == 0 || specularBounce)
+                    L += beta * Le;
+                else {
+                    Float p_l = lightSampler.PMF(prevIntrCtx, light) *
+                                light.PDF_Li(prevIntrCtx, ray.d, true);
+                    L += beta * PowerHeuristic(1, p_b, 1, p_l) * Le;
+                }
+            }
+            break;
+        }
+        // Incorporate emission from surface hit by ray
+        SampledSpectrum Le = si->intr.Le(-ray.d, lambda);
+        if (Le) {
+            if (depth == 0 || specularBounce)
+                L += beta * Le;
+            else {
+                Light areaLight(si->intr.areaLight);
+                Float p_l = lightSampler.PMF(prevIntrCtx, areaLight) *
+                            areaLight.PDF_Li(prevIntrCtx, ray.d, true);
+                L += beta * PowerHeuristic(1, p_b, 1, p_l) * Le;
+            }
+        }
+
+        SurfaceInteraction &isect = si->intr;
+        // Get BSDF and skip over medium boundaries
+        BSDF bsdf = isect.GetBSDF(ray, lambda, camera, scratchBuffer, sampler);
+        if (!bsdf) {
+            specularBounce = true;
+            isect.SkipIntersection(&ray, si->tHit);
+            continue;
+        }
+
+        // Initialize _visibleSurf_ at first intersection
+        if (depth == 0 && visibleSurf) {
+            // Estimate the BSDF's albedo with a few uniform samples; the
+            // denoiser only needs a rough value
+            constexpr int nRhoSamples = 4;
+            const Float ucRho[nRhoSamples] = {0.125, 0.375, 0.625, 0.875};
+            const Point2f uRho[nRhoSamples] = {
+                Point2f(0.125, 0.625), Point2f(0.375, 0.125), Point2f(0.625, 0.875),
+                Point2f(0.875, 0.375)};
+            SampledSpectrum albedo = bsdf.rho(isect.wo, ucRho, uRho);
+            *visibleSurf = VisibleSurface(isect, albedo, lambda);
+        }
+
+        // End path if maximum depth reached
+        if (depth++ == maxDepth)
+            break;
+
+        // Sample direct illumination from the light sources
+        BxDFFlags flags = bsdf.Flags();
+        if (IsNonSpecular(flags))
+            L += beta * SampleLd(isect, &bsdf, lambda, sampler);
+
+        // Find the radiance cache entry at diffuse vertices after the first
+        CacheEntry *entry = nullptr;
+        if (depth > 1 && IsDiffuse(flags) && !IsGlossy(flags) && !IsSpecular(flags) &&
+            !IsTransmissive(flags)) {
+            ++cacheLookups;
+            Point2f uj = sampler.Get2D();
+            Vector3f jitter =
+                cellSize * Vector3f(uj[0] - 0.5f, uj[1] - 0.5f, sampler.Get1D() - 0.5f);
+            entry = FindCacheEntry(isect.p() + jitter, isect.shading.n);
+            // Terminate the path using the cached irradiance if the entry is ready
+            int nSamples = entry ? entry->nSamples.load(std::memory_order_relaxed) : 0;
+            if (nSamples >= minSamples) {
+                ++cacheTerminatedPaths;
+                RGB E(entry->irradiance[0] / nSamples, entry->irradiance[1] / nSamples,
+                      entry->irradiance[2] / nSamples);
+                SampledSpectrum Ei =
+                    RGBIlluminantSpectrum(*colorSpace, ClampZero(E)).Sample(lambda);
+                // The BSDF is Lambertian, so evaluating it for any direction in
+                // the hemisphere around _wo_ gives its constant value
+                Vector3f wn = FaceForward(Vector3f(isect.shading.n), isect.wo);
+                L += beta * bsdf.f(isect.wo, wn) * Ei;
+                break;
+            }
+        }
+
+        // Sample BSDF to get new path direction
+        Vector3f wo = -ray.d;
+        Float u = sampler.Get1D();
+        pstd::optional<BSDFSample> bs = bsdf.Sample_f(wo, u, sampler.Get2D());
+        if (!bs)
+            break;
+        // Record the path into the first cache entry that isn't ready yet
+        if (entry && !recordEntry && !bs->pdfIsProportional) {
+            recordEntry = entry;
+            recordL = L;
+            recordBeta = beta * bs->f;
+        }
+        // Update path state variables after surface scattering
+        beta *= bs->f * AbsDot(bs->wi, isect.shading.n) / bs->pdf;
+        p_b = bs->pdfIsProportional ? bsdf.PDF(wo, bs->wi) : bs->pdf;
+        specularBounce = bs->IsSpecular();
+        if (bs->IsTransmission())
+            etaScale *= Sqr(bs->eta);
+        prevIntrCtx = si->intr;
+        ray = isect.SpawnRay(ray, bsdf, bs->wi, bs->flags, bs->eta);
+
+        // Possibly terminate the path with Russian roulette
+        SampledSpectrum rrBeta = beta * etaScale;
+        if (rrBeta.MaxComponentValue() < 1 && depth > 1) {
+            Float q = std::max<Float>(0, 1 - rrBeta.MaxComponentValue());
+            if (sampler.Get1D() < q)
+                break;
+            beta /= 1 - q;
+        }
+    }
+
+    if (recordEntry) {
+        // Add the path's estimate of irradiance at the recorded vertex to its entry
+        SampledSpectrum E = SafeDiv(L - recordL, recordBeta);
+        RGB rgb = colorSpace->ToRGB(E.ToXYZ(lambda));
+        if (!IsNaN(rgb.Average()) && !IsInf(rgb.Average())) {
+            for (int c = 0; c < 3; ++c)
+                recordEntry->irradiance[c].Add(rgb[c]);
+            recordEntry->nSamples.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return L;
+}
+
+SampledSpectrum RadianceCacheIntegrator::SampleLd(const SurfaceInteraction &intr,
+                                                  const BSDF *bsdf,
+                                                  SampledWavelengths &lambda,
+                                                  Sampler sampler) const {
+    // Initialize _LightSampleContext_ for light sampling
+    LightSampleContext ctx(intr);
+    BxDFFlags flags = bsdf->Flags();
+    if (IsReflective(flags) && !IsTransmissive(flags))
+        ctx.pi = intr.OffsetRayOrigin(intr.wo);
+    else if (IsTransmissive(flags) && !IsReflective(flags))
+        ctx.pi = intr.OffsetRayOrigin(-intr.wo);
+
+    // Choose a light source and sample a point on it
+    Float u = sampler.Get1D();
+    pstd::optional<SampledLight> sampledLight = lightSampler.Sample(ctx, u);
+    Point2f uLight = sampler.Get2D();
+    if (!sampledLight)
+        return {};
+    Light light = sampledLight->light;
+    pstd::optional<LightLiSample> ls = light.SampleLi(ctx, uLight, lambda, true);
+    if (!ls || !ls->L || ls->pdf == 0)
+        return {};
+
+    // Evaluate BSDF for light sample and check light visibility
+    Vector3f wo = intr.wo, wi = ls->wi;
+    SampledSpectrum f = bsdf->f(wo, wi) * AbsDot(wi, intr.shading.n);
+    if (!f || !Unoccluded(intr, ls->pLight))
+        return {};
+
+    // Return light's contribution to reflected radiance
+    Float p_l = sampledLight->p * ls->pdf;
+    if (IsDeltaLight(light.Type()))
+        return ls->L * f / p_l;
+    Float w_l = PowerHeuristic(1, p_l, 1, bsdf->PDF(wo, wi));
+    return w_l * ls->L * f / p_l;
+}
+
+std::string RadianceCacheIntegrator::ToString() const {
+    return StringPrintf("[ RadianceCacheIntegrator maxDepth: %d cellSize: %f "
+                        "minSamples: %d cacheSize: %d lightSampler: %s ]",
+                        maxDepth, cellSize, minSamples, cacheSize, lightSampler);
+}
+
+std::unique_ptr<RadianceCacheIntegrator> RadianceCacheIntegrator::Create(
+    const ParameterDictionary &parameters, const RGBColorSpace *colorSpace,
+    Camera camera, Sampler sampler, Primitive aggregate, std::vector<Light> lights,
+    const FileLoc *loc) {
+    int maxDepth = parameters.GetOneInt("maxdepth", 5);
+    Float cellSize = parameters.GetOneFloat("cellsize", 0.f);
+    int minSamples = parameters.GetOneInt("minsamples", 16);
+    int cacheSize = parameters.GetOneInt("cachesize", 1 << 20);
+    std::string lightStrategy = parameters.GetOneString("lightsampler", "bvh");
+    if (minSamples < 1)
+        ErrorExit(loc, "\"minsamples\" must be at least one.");
+    if (cacheSize < 1)
+        ErrorExit(loc, "\"cachesize\" must be positive.");
+    return std::make_unique<RadianceCacheIntegrator>(maxDepth, cellSize, minSamples,
+                                                     cacheSize, camera, sampler,
+                                                     aggregate, lights, colorSpace,
+                                                     lightStrategy);
 }
 
 // BDPT Utility Function Declarations
@@ -2288,6 +3323,48 @@ Float InfiniteLightDensity(const std::vector<Light> &infiniteLights,
 }
 
 // BDPT Method Definitions
+STAT_PERCENT("Integrator/BDPT connection strategies skipped", bdptStrategiesSkipped,
+             bdptStrategies);
+
+// BDPTIntegrator Method Definitions
+BDPTIntegrator::BDPTIntegrator(Camera camera, Sampler sampler, Primitive aggregate,
+                               std::vector<Light> lights, int maxDepth,
+                               bool visualizeStrategies, bool visualizeWeights,
+                               bool regularize, Float minStrategyWeight)
+    : RayIntegrator(camera, sampler, aggregate, lights),
+      maxDepth(maxDepth),
+      regularize(regularize),
+      lightSampler(new PowerLightSampler(lights, Allocator())),
+      visualizeStrategies(visualizeStrategies),
+      visualizeWeights(visualizeWeights),
+      minStrategyWeight(minStrategyWeight),
+      strategyWeightSums([maxDepth]() {
+          return std::vector<double>(2 * BufferIndex(maxDepth + 2, 0) + 2);
+      }),
+      strategyWeightTotals(2 * BufferIndex(maxDepth + 2, 0) + 2) {}
+
+void BDPTIntegrator::FinishedWave(int waveStart, int waveEnd) {
+    if (minStrategyWeight == 0)
+        return;
+    // Gather the MIS weights that each strategy's connections had so far
+    strategyWeightSums.ForAll([&](std::vector<double> &sums) {
+        for (size_t i = 0; i < sums.size(); ++i) {
+            strategyWeightTotals[i] += sums[i];
+            sums[i] = 0;
+        }
+    });
+
+    // Evaluate strategies with low average weights with a probability
+    // proportional to it; a lower bound ensures that they are still sampled
+    // often enough to notice if they become more important
+    strategyProbabilities.resize(strategyWeightTotals.size() / 2);
+    for (size_t i = 0; i < strategyProbabilities.size(); ++i) {
+        double sum = strategyWeightTotals[2 * i], count = strategyWeightTotals[2 * i + 1];
+        Float p = count > 0 ? Float(sum / count) / minStrategyWeight : 1;
+        strategyProbabilities[i] = Clamp(p, 0.1f, 1);
+    }
+}
+
 void BDPTIntegrator::Render() {
     // Allocate buffers for debug visualization
     if (visualizeStrategies || visualizeWeights) {
@@ -2331,27 +3408,54 @@ SampledSpectrum BDPTIntegrator::Li(RayDifferential ray, SampledWavelengths &lamb
                                    Sampler sampler, ScratchBuffer &scratchBuffer,
                                    VisibleSurface *) const {
     // Trace the camera and light subpaths
-    Vertex *cameraVertices = scratchBuffer.Alloc<Vertex[]>(maxDepth + 2);
+    // The vertex arrays are left uninitialized: subpath generation assigns each
+    // vertex before it is used, and constructing all _maxDepth_ + 2 of them
+    // would touch far more memory than most paths need.
+    Vertex *cameraVertices =
+        (Vertex *)scratchBuffer.Alloc((maxDepth + 2) * sizeof(Vertex), alignof(Vertex));
     int nCamera = GenerateCameraSubpath(*this, ray, lambda, sampler, scratchBuffer,
                                         maxDepth + 2, camera, cameraVertices, regularize);
-    Vertex *lightVertices = scratchBuffer.Alloc<Vertex[]>(maxDepth + 1);
+    Vertex *lightVertices =
+        (Vertex *)scratchBuffer.Alloc((maxDepth + 1) * sizeof(Vertex), alignof(Vertex));
     int nLight = GenerateLightSubpath(*this, lambda, sampler, camera, scratchBuffer,
                                       maxDepth + 1, cameraVertices[0].time(),
                                       lightSampler, lightVertices, regularize);
 
     SampledSpectrum L(0.f);
+    // Prepare to skip connection strategies with low MIS weights
+    std::vector<double> *weightSums =
+        minStrategyWeight > 0 ? &strategyWeightSums.Get() : nullptr;
+    RNG rng(Hash(ray.o), Hash(ray.d));
+
     // Execute all BDPT connection strategies
     for (int t = 1; t <= nCamera; ++t) {
         for (int s = 0; s <= nLight; ++s) {
             int depth = t + s - 2;
             if ((s == 1 && t == 1) || depth < 0 || depth > maxDepth)
                 continue;
+            // Possibly skip the $(s, t)$ strategy, using an RNG rather than
+            // the sampler so that the sampler's dimensions stay consistent
+            ++bdptStrategies;
+            Float p = strategyProbabilities.empty()
+                          ? 1
+                          : strategyProbabilities[BufferIndex(s, t)];
+            if (p < 1 && rng.Uniform<Float>() >= p) {
+                ++bdptStrategiesSkipped;
+                continue;
+            }
+
             // Execute the $(s, t)$ connection strategy and update _L_
             pstd::optional<Point2f> pFilmNew;
             Float misWeight = 0.f;
             SampledSpectrum Lpath =
                 ConnectBDPT(*this, lambda, lightVertices, cameraVertices, s, t,
                             lightSampler, camera, sampler, &pFilmNew, &misWeight);
+            if (weightSums && Lpath) {
+                (*weightSums)[2 * BufferIndex(s, t)] += misWeight;
+                (*weightSums)[2 * BufferIndex(s, t) + 1] += 1;
+            }
+            if (p < 1)
+                Lpath /= p;
             PBRT_DBG("%s\n",
                      StringPrintf("Connect bdpt s: %d, t: %d, Lpath: %s, misWeight: %f\n",
                                   s, t, Lpath, misWeight)
@@ -2519,9 +3623,10 @@ SampledSpectrum ConnectBDPT(const Integrator &integrator, SampledWavelengths &la
 
 std::string BDPTIntegrator::ToString() const {
     return StringPrintf("[ BDPTIntegrator maxDepth: %d visualizeStrategies: %s "
-                        "visualizeWeights: %s regularize: %s lightSampler: %s ]",
+                        "visualizeWeights: %s regularize: %s lightSampler: %s "
+                        "minStrategyWeight: %f ]",
                         maxDepth, visualizeStrategies, visualizeWeights, regularize,
-                        lightSampler);
+                        lightSampler, minStrategyWeight);
 }
 
 std::unique_ptr<BDPTIntegrator> BDPTIntegrator::Create(
@@ -2541,9 +3646,13 @@ std::unique_ptr<BDPTIntegrator> BDPTIntegrator::Create(
     }
 
     bool regularize = parameters.GetOneBool("regularize", false);
+    Float minStrategyWeight = parameters.GetOneFloat("minstrategyweight", 0.f);
+    if (minStrategyWeight < 0 || minStrategyWeight > 1)
+        ErrorExit(loc, "%f: \"minstrategyweight\" must be between zero and one.",
+                  minStrategyWeight);
     return std::make_unique<BDPTIntegrator>(camera, sampler, aggregate, lights, maxDepth,
                                             visualizeStrategies, visualizeWeights,
-                                            regularize);
+                                            regularize, minStrategyWeight);
 }
 
 STAT_PERCENT("Integrator/Acceptance rate", acceptedMutations, totalMutations);
@@ -2689,7 +3798,10 @@ void MLTIntegrator::Render() {
               std::accumulate(bootstrapWeights.begin(), bootstrapWeights.end(), 0.);
 
     // Set up connection to display server, if enabled
-    std::atomic<int> finishedChains(0);
+    Film film = camera.GetFilm();
+    int64_t nTotalMutations =
+        (int64_t)film.SampleBounds().Area() * (int64_t)mutationsPerPixel;
+    std::atomic<int64_t> finishedMutations(0);
     if (!Options->displayServer.empty()) {
         DisplayDynamic(
             camera.GetFilm().GetFilename(),
@@ -2700,8 +3812,8 @@ void MLTIntegrator::Render() {
                 int index = 0;
                 for (Point2i p : bounds) {
                     Float finishedPixelMutations =
-                        Float(finishedChains.load(std::memory_order_relaxed)) /
-                        Float(nChains) * mutationsPerPixel;
+                        Float(finishedMutations.load(std::memory_order_relaxed)) /
+                        Float(nTotalMutations) * mutationsPerPixel;
                     Float scale = b / std::max<Float>(1, finishedPixelMutations);
                     RGB rgb = film.GetPixelRGB(pixelBounds.pMin + p, scale);
                     for (int c = 0; c < 3; ++c)
@@ -2711,22 +3823,47 @@ void MLTIntegrator::Render() {
             });
     }
 
-    // Follow _nChains_ Markov chains to render image
-    Film film = camera.GetFilm();
-    int64_t nTotalMutations =
-        (int64_t)film.SampleBounds().Area() * (int64_t)mutationsPerPixel;
-    ProgressReporter progressRender(nChains, "Rendering", Options->quiet);
-    // Run _nChains_ Markov chains in parallel
-    ParallelFor(0, nChains, [&](int i) {
-        ScratchBuffer &scratchBuffer = threadScratchBuffers.Get();
+    // Divide the _nChains_ Markov chains into segments that each start from a
+    // bootstrap sample, restarting chains every _reseedInterval_ mutations
+    struct ChainSegment {
+        int64_t nMutations;
+        int bootstrapIndex;
+        RNG rng;
+    };
+    std::vector<ChainSegment> segments;
+    for (int i = 0; i < nChains; ++i) {
         // Compute number of mutations to apply in current Markov chain
         int64_t nChainMutations =
             std::min((i + 1) * nTotalMutations / nChains, nTotalMutations) -
             i * nTotalMutations / nChains;
-
-        // Select initial state from the set of bootstrap samples
-        RNG rng(i);
-        int bootstrapIndex = bootstrapTable.Sample(rng.Uniform<Float>());
+        int64_t segmentLength = reseedInterval > 0 ? reseedInterval : nChainMutations;
+        for (int64_t start = 0; start < nChainMutations; start += segmentLength) {
+            // Select initial state from the set of bootstrap samples
+            RNG rng(reseedInterval > 0 ? segments.size() : i);
+            int bootstrapIndex = bootstrapTable.Sample(rng.Uniform<Float>());
+            segments.push_back({std::min(segmentLength, nChainMutations - start),
+                                bootstrapIndex, rng});
+        }
+    }
+    // Start the segments that are expected to take longest first, so that
+    // the last ones that run are short; the cost of a mutation grows with
+    // its path depth
+    auto cost = [&](const ChainSegment &seg) {
+        return seg.nMutations * (seg.bootstrapIndex % (maxDepth + 1) + 2);
+    };
+    std::stable_sort(segments.begin(), segments.end(),
+                     [&](const ChainSegment &a, const ChainSegment &b) {
+                         return cost(a) > cost(b);
+                     });
+
+    // Run the chain segments in parallel
+    ProgressReporter progressRender(nTotalMutations, "Rendering", Options->quiet);
+    ParallelFor(0, segments.size(), [&](int64_t segmentIndex) {
+        ScratchBuffer &scratchBuffer = threadScratchBuffers.Get();
+        ChainSegment &segment = segments[segmentIndex];
+        int64_t nChainMutations = segment.nMutations;
+        int bootstrapIndex = segment.bootstrapIndex;
+        RNG &rng = segment.rng;
         int depth = bootstrapIndex % (maxDepth + 1);
         threadDepth = depth;
 
@@ -2776,8 +3913,8 @@ void MLTIntegrator::Render() {
             StatsReportPixelEnd(Point2i(pCurrent));
         }
 
-        ++finishedChains;
-        progressRender.Update(1);
+        finishedMutations += nChainMutations;
+        progressRender.Update(nChainMutations);
     });
 
     progressRender.Done();
@@ -2793,9 +3930,10 @@ void MLTIntegrator::Render() {
 std::string MLTIntegrator::ToString() const {
     return StringPrintf("[ MLTIntegrator camera: %s maxDepth: %d nBootstrap: %d "
                         "nChains: %d mutationsPerPixel: %d sigma: %f "
-                        "largeStepProbability: %f lightSampler: %s regularize: %s ]",
+                        "largeStepProbability: %f lightSampler: %s regularize: %s "
+                        "reseedInterval: %d ]",
                         camera, maxDepth, nBootstrap, nChains, mutationsPerPixel, sigma,
-                        largeStepProbability, lightSampler, regularize);
+                        largeStepProbability, lightSampler, regularize, reseedInterval);
 }
 
 std::unique_ptr<MLTIntegrator> MLTIntegrator::Create(
@@ -2817,9 +3955,13 @@ std::unique_ptr<MLTIntegrator> MLTIntegrator::Create(
         nBootstrap = std::max(1, nBootstrap / 16);
     }
     bool regularize = parameters.GetOneBool("regularize", false);
+    int64_t reseedInterval = parameters.GetOneInt("reseedinterval", 0);
+    if (reseedInterval < 0)
+        ErrorExit(loc, "%d: \"reseedinterval\" must not be negative.", reseedInterval);
     return std::make_unique<MLTIntegrator>(camera, aggregate, lights, maxDepth,
                                            nBootstrap, nChains, mutationsPerPixel, sigma,
-                                           largeStepProbability, regularize);
+                                           largeStepProbability, regularize,
+                                           reseedInterval);
 }
 
 STAT_RATIO("Stochastic Progressive Photon Mapping/Visible points checked per photon "
@@ -2862,10 +4004,59 @@ struct SPPMPixel {
     Float n = 0;
 };
 
-// SPPMPixelListNode Definition
-struct SPPMPixelListNode {
+// SPPMGridEntry Definition
+// A visible point in one of the cells of the SPPM grid. The entries of each
+// cell are stored contiguously so that photons can check them without
+// touching the pixels that they don't contribute to.
+struct SPPMGridEntry {
+    Point3f p;
+    Float radiusSquared;
     SPPMPixel *pixel;
-    SPPMPixelListNode *next;
+};
+
+// SPPMPhotonAccumulator Definition
+// Per-thread cache of photon contributions to visible points. Pixels that
+// receive many photons would otherwise see heavy contention on their atomic
+// sums; here, contributions are added to a pixel only when its entry is
+// evicted or when the photon pass ends.
+class SPPMPhotonAccumulator {
+  public:
+    // SPPMPhotonAccumulator Public Methods
+    void Add(SPPMPixel *pixel, const RGB &Phi) {
+        Entry &entry = entries[MixBits(uint64_t(pixel)) % entries.size()];
+        if (entry.pixel != pixel) {
+            Flush(entry);
+            entry.pixel = pixel;
+        }
+        entry.Phi += Phi;
+        ++entry.m;
+    }
+
+    void FlushAll() {
+        for (Entry &entry : entries)
+            Flush(entry);
+    }
+
+  private:
+    // SPPMPhotonAccumulator Private Types
+    struct Entry {
+        SPPMPixel *pixel = nullptr;
+        RGB Phi;
+        int m = 0;
+    };
+
+    // SPPMPhotonAccumulator Private Methods
+    static void Flush(Entry &entry) {
+        if (!entry.pixel)
+            return;
+        for (int i = 0; i < 3; ++i)
+            entry.pixel->Phi_i[i].Add(entry.Phi[i]);
+        entry.pixel->m.fetch_add(entry.m, std::memory_order_relaxed);
+        entry = Entry();
+    }
+
+    // SPPMPhotonAccumulator Private Members
+    std::vector<Entry> entries = std::vector<Entry>(4096);
 };
 
 // SPPM Utility Functions
@@ -2915,6 +4106,11 @@ void SPPMIntegrator::Render() {
     pstd::vector<DigitPermutation> *digitPermutations(
         ComputeRadicalInversePermutations(digitPermutationsSeed));
 
+    // Allocate per-thread photon accumulators and storage for the SPPM grid
+    ThreadLocal<SPPMPhotonAccumulator> photonAccumulators;
+    std::vector<SPPMGridEntry> gridEntries;
+    std::vector<int> gridCellStart;
+
     for (int iter = 0; iter < nIterations; ++iter) {
         // Connect to display server for SPPM if requested
         if (iter == 0 && !Options->displayServer.empty()) {
@@ -3068,10 +4264,7 @@ void SPPMIntegrator::Render() {
         });
         progress.Update();
         // Create grid of all SPPM visible points
-        // Allocate grid for SPPM visible points
         int hashSize = NextPrime(nPixels);
-        std::vector<std::atomic<SPPMPixelListNode *>> grid(hashSize);
-
         // Compute grid bounds for SPPM visible points
         Bounds3f gridBounds;
         Float maxRadius = 0;
@@ -3091,39 +4284,56 @@ void SPPMIntegrator::Render() {
         for (int i = 0; i < 3; ++i)
             gridRes[i] = std::max<int>(baseGridRes * diag[i] / maxDiag, 1);
 
-        // Add visible points to SPPM grid
+        // Calls _func_ with the hashed index of each grid cell that a pixel's
+        // visible point overlaps
+        auto forEachCell = [&](const SPPMPixel &pixel, auto func) {
+            Float r = pixel.radius;
+            Point3i pMin, pMax;
+            ToGrid(pixel.vp.p - Vector3f(r, r, r), gridBounds, gridRes, &pMin);
+            ToGrid(pixel.vp.p + Vector3f(r, r, r), gridBounds, gridRes, &pMax);
+            for (int z = pMin.z; z <= pMax.z; ++z)
+                for (int y = pMin.y; y <= pMax.y; ++y)
+                    for (int x = pMin.x; x <= pMax.x; ++x)
+                        func(int(Hash(Point3i(x, y, z)) % hashSize));
+            return (1 + pMax.x - pMin.x) * (1 + pMax.y - pMin.y) * (1 + pMax.z - pMin.z);
+        };
+
+        // Add visible points to SPPM grid using a parallel counting sort
+        // Count the visible points that overlap each grid cell
+        std::vector<std::atomic<int>> cellCounts(hashSize);
+        ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
+            for (Point2i pPixel : tileBounds) {
+                const SPPMPixel &pixel = pixels[pPixel];
+                if (pixel.vp.beta)
+                    gridCellsPerVisiblePoint << forEachCell(pixel, [&](int h) {
+                        cellCounts[h].fetch_add(1, std::memory_order_relaxed);
+                    });
+            }
+        });
+
+        // Find the start of each cell's entries and reset the counts to them
+        gridCellStart.resize(hashSize + 1);
+        int64_t nEntries = 0;
+        for (int h = 0; h < hashSize; ++h) {
+            gridCellStart[h] = nEntries;
+            nEntries += cellCounts[h].load(std::memory_order_relaxed);
+            cellCounts[h].store(gridCellStart[h], std::memory_order_relaxed);
+        }
+        CHECK_LE(nEntries, std::numeric_limits<int>::max());
+        gridCellStart[hashSize] = nEntries;
+
+        // Store each visible point in the entries of the cells that it overlaps
+        gridEntries.resize(nEntries);
         ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
-            ScratchBuffer &scratchBuffer = threadScratchBuffers.Get();
             for (Point2i pPixel : tileBounds) {
                 SPPMPixel &pixel = pixels[pPixel];
-                if (pixel.vp.beta) {
-                    // Add pixel's visible point to applicable grid cells
-                    // Find grid cell bounds for pixel's visible point, _pMin_ and _pMax_
-                    Float r = pixel.radius;
-                    Point3i pMin, pMax;
-                    ToGrid(pixel.vp.p - Vector3f(r, r, r), gridBounds, gridRes, &pMin);
-                    ToGrid(pixel.vp.p + Vector3f(r, r, r), gridBounds, gridRes, &pMax);
-
-                    for (int z = pMin.z; z <= pMax.z; ++z)
-                        for (int y = pMin.y; y <= pMax.y; ++y)
-                            for (int x = pMin.x; x <= pMax.x; ++x) {
-                                // Add visible point to grid cell $(x, y, z)$
-                                int h = Hash(Point3i(x, y, z)) % hashSize;
-                                CHECK_GE(h, 0);
-                                SPPMPixelListNode *node =
-                                    scratchBuffer.Alloc<SPPMPixelListNode>();
-                                node->pixel = &pixel;
-
-                                // Atomically add _node_ to the start of _grid[h]_'s
-                                // linked list
-                                node->next = grid[h];
-                                while (!grid[h].compare_exchange_weak(node->next, node))
-                                    ;
-                            }
-                    gridCellsPerVisiblePoint << (1 + pMax.x - pMin.x) *
-                                                    (1 + pMax.y - pMin.y) *
-                                                    (1 + pMax.z - pMin.z);
-                }
+                if (!pixel.vp.beta)
+                    continue;
+                SPPMGridEntry entry{pixel.vp.p, Sqr(pixel.radius), &pixel};
+                forEachCell(pixel, [&](int h) {
+                    int index = cellCounts[h].fetch_add(1, std::memory_order_relaxed);
+                    gridEntries[index] = entry;
+                });
             }
         });
 
@@ -3136,6 +4346,7 @@ void SPPMIntegrator::Render() {
             // Follow photon paths for photon index range _start_ - _end_
             ScratchBuffer &scratchBuffer = photonShootScratchBuffers.Get();
             Sampler sampler = threadSamplers.Get();
+            SPPMPhotonAccumulator &accumulator = photonAccumulators.Get();
             for (int64_t photonIndex = start; photonIndex < end; ++photonIndex) {
                 // Follow photon path for _photonIndex_
                 // Define sampling lambda functions for photon shooting
@@ -3199,16 +4410,15 @@ void SPPMIntegrator::Render() {
                         Point3i photonGridIndex;
                         if (ToGrid(isect.p(), gridBounds, gridRes, &photonGridIndex)) {
                             int h = Hash(photonGridIndex) % hashSize;
-                            CHECK_GE(h, 0);
-                            // Add photon contribution to visible points in _grid[h]_
-                            for (SPPMPixelListNode *node =
-                                     grid[h].load(std::memory_order_relaxed);
-                                 node; node = node->next) {
+                            // Add photon contribution to visible points in cell _h_
+                            for (int i = gridCellStart[h]; i < gridCellStart[h + 1];
+                                 ++i) {
                                 ++visiblePointsChecked;
-                                SPPMPixel &pixel = *node->pixel;
-                                if (DistanceSquared(pixel.vp.p, isect.p()) >
-                                    Sqr(pixel.radius))
+                                const SPPMGridEntry &entry = gridEntries[i];
+                                if (DistanceSquared(entry.p, isect.p()) >
+                                    entry.radiusSquared)
                                     continue;
+                                SPPMPixel &pixel = *entry.pixel;
                                 // Update _pixel_ $\Phi$ and $m$ for nearby photon
                                 Vector3f wi = -photonRay.d;
                                 SampledSpectrum Phi =
@@ -3219,10 +4429,7 @@ void SPPMIntegrator::Render() {
                                     photonLambda.TerminateSecondary();
                                 RGB Phi_i =
                                     film.ToOutputRGB(pixel.vp.beta * Phi, photonLambda);
-                                for (int i = 0; i < 3; ++i)
-                                    pixel.Phi_i[i].Add(Phi_i[i]);
-
-                                ++pixel.m;
+                                accumulator.Add(&pixel, Phi_i);
                             }
                         }
                     }
@@ -3258,6 +4465,10 @@ void SPPMIntegrator::Render() {
                 scratchBuffer.Reset();
             }
         });
+        // Add the remaining per-thread photon contributions to their pixels
+        photonAccumulators.ForAll(
+            [](SPPMPhotonAccumulator &accumulator) { accumulator.FlushAll(); });
+
         // Reset _threadScratchBuffers_ after tracing photons
         threadScratchBuffers.ForAll([](ScratchBuffer &buffer) { buffer.Reset(); });
 
@@ -3755,6 +4966,9 @@ std::unique_ptr<Integrator> Integrator::Create(
     else if (name == "sppm")
         integrator = SPPMIntegrator::Create(parameters, colorSpace, camera, sampler,
                                             aggregate, lights, loc);
+    else if (name == "radiancecache")
+        integrator = RadianceCacheIntegrator::Create(parameters, colorSpace, camera,
+                                                     sampler, aggregate, lights, loc);
     else
         ErrorExit(loc, "%s: integrator type unknown.", name);
 
@@ -11,17 +11,22 @@
 #include <pbrt/base/sampler.h>
 #include <pbrt/bsdf.h>
 #include <pbrt/cameras.h>
+#include <pbrt/cpu/guiding.h>
+#include <pbrt/cpu/lightcache.h>
 #include <pbrt/cpu/primitive.h>
 #include <pbrt/film.h>
 #include <pbrt/interaction.h>
 #include <pbrt/lights.h>
 #include <pbrt/lightsamplers.h>
+#include <pbrt/util/containers.h>
 #include <pbrt/util/lowdiscrepancy.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/rng.h>
 #include <pbrt/util/sampling.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <ostream>
@@ -58,6 +63,10 @@ class Integrator {
     // P后缀说明这个函数只是用于判断是否intersetc(相交)的，不需要找最近的交点或者返回其他额外的信息
     // 一般来讲效率更高，比如可以用到阴影射线的相交判断上    
     bool IntersectP(const Ray &ray, Float tMax = Infinity) const;
+    // Sets _hit[i]_ to whether _rays[i]_ is occluded before _tMax[i]_. Rays are
+    // traced together as packets when the aggregate is a _BVHAggregate_, which
+    // is most effective for coherent rays such as those from a single point.
+    void IntersectP(int nRays, const Ray *rays, const Float *tMax, bool *hit) const;
 
      
     bool Unoccluded(const Interaction &p0, const Interaction &p1) const {
@@ -111,6 +120,14 @@ class ImageTileIntegrator : public Integrator {
     virtual void EvaluatePixelSample(Point2i pPixel, int sampleIndex, Sampler sampler,
                                      ScratchBuffer &scratchBuffer) = 0;
 
+    // Called by Render() after the samples _[waveStart, waveEnd)_ of all
+    // pixels have been taken, before the next wave starts.
+    virtual void FinishedWave(int waveStart, int waveEnd) {}
+
+    // Returns true if FinishedWave() must be called after each wave, which
+    // prevents --overlap-waves from overlapping successive waves.
+    virtual bool NeedsWaveBarriers() const { return false; }
+
   protected:
     // ImageTileIntegrator Protected Members
     // 定义观察到的试图和透镜相关的参数(位置，朝向，焦点，视场等)
@@ -271,12 +288,17 @@ class PathIntegrator : public RayIntegrator {
     PathIntegrator(int maxDepth, Camera camera, Sampler sampler, Primitive aggregate,
                    std::vector<Light> lights,
                    const std::string &lightSampleStrategy = "bvh",
-                   bool regularize = false);
+                   bool regularize = false, Float guidingTraining = 0,
+                   bool adrrs = false, int lightCandidates = 1,
+                   Float lightCacheTraining = 0);
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda, Sampler sampler,
                        ScratchBuffer &scratchBuffer,
                        VisibleSurface *visibleSurface) const;
 
+    void FinishedWave(int waveStart, int waveEnd);
+    bool NeedsWaveBarriers() const { return pathGuide || lightCache || adrrs; }
+
     static std::unique_ptr<PathIntegrator> Create(const ParameterDictionary &parameters,
                                                   Camera camera, Sampler sampler,
                                                   Primitive aggregate,
@@ -288,12 +310,38 @@ class PathIntegrator : public RayIntegrator {
   private:
     // PathIntegrator Private Methods
     SampledSpectrum SampleLd(const SurfaceInteraction &intr, const BSDF *bsdf,
-                             SampledWavelengths &lambda, Sampler sampler) const;
+                             SampledWavelengths &lambda, Sampler sampler,
+                             const DirectionalQuadtree *guide = nullptr) const;
+    SampledSpectrum SampleLdResampled(const SurfaceInteraction &intr, const BSDF *bsdf,
+                                      const LightSampleContext &ctx,
+                                      SampledWavelengths &lambda, Sampler sampler,
+                                      const DirectionalQuadtree *guide) const;
+    pstd::optional<SampledLight> SampleLight(const LightSampleContext &ctx,
+                                             Float u) const {
+        return lightCache ? lightCache->Sample(ctx, u) : lightSampler.Sample(ctx, u);
+    }
+    Float LightPMF(const LightSampleContext &ctx, Light light) const {
+        return lightCache ? lightCache->PMF(ctx, light) : lightSampler.PMF(ctx, light);
+    }
 
     // PathIntegrator Private Members
     int maxDepth;
     LightSampler lightSampler;
     bool regularize;
+    std::unique_ptr<PathGuide> pathGuide;
+    // Learns which of the light BVH's clusters are visible from each region of
+    // the scene and shifts light sampling toward them
+    std::unique_ptr<LightSelectionCache> lightCache;
+    // Efficiency-aware Russian roulette and splitting ("Adjoint-Driven Russian
+    // Roulette and Splitting", Vorba and Křivánek 2016) compares each path's
+    // expected contribution to these luminance estimates from earlier waves.
+    bool adrrs;
+    Array2D<Float> pixelEstimates;
+    Float imageEstimate = 0;
+    // With more than one light candidate, _SampleLd()_ uses resampled importance
+    // sampling, tracing a shadow ray to just one of the candidate light samples,
+    // chosen according to its unshadowed contribution.
+    int lightCandidates;
 };
 
 // SimpleVolPathIntegrator Definition
@@ -325,16 +373,18 @@ class VolPathIntegrator : public RayIntegrator {
     VolPathIntegrator(int maxDepth, Camera camera, Sampler sampler, Primitive aggregate,
                       std::vector<Light> lights,
                       const std::string &lightSampleStrategy = "bvh",
-                      bool regularize = false)
-        : RayIntegrator(camera, sampler, aggregate, lights),
-          maxDepth(maxDepth),
-          lightSampler(LightSampler::Create(lightSampleStrategy, lights, Allocator())),
-          regularize(regularize) {}
+                      bool regularize = false, Float guidingTraining = 0);
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda, Sampler sampler,
                        ScratchBuffer &scratchBuffer,
                        VisibleSurface *visibleSurface) const;
 
+    void FinishedWave(int waveStart, int waveEnd) {
+        if (pathGuide)
+            pathGuide->FinishedWave(waveEnd - waveStart);
+    }
+    bool NeedsWaveBarriers() const { return pathGuide != nullptr; }
+
     static std::unique_ptr<VolPathIntegrator> Create(
         const ParameterDictionary &parameters, Camera camera, Sampler sampler,
         Primitive aggregate, std::vector<Light> lights, const FileLoc *loc);
@@ -345,20 +395,23 @@ class VolPathIntegrator : public RayIntegrator {
     // VolPathIntegrator Private Methods
     SampledSpectrum SampleLd(const Interaction &intr, const BSDF *bsdf,
                              SampledWavelengths &lambda, Sampler sampler,
-                             SampledSpectrum beta, SampledSpectrum inv_w_u) const;
+                             SampledSpectrum beta, SampledSpectrum inv_w_u,
+                             const DirectionalQuadtree *guide = nullptr) const;
 
     // VolPathIntegrator Private Members
     int maxDepth;
     LightSampler lightSampler;
     bool regularize;
+    std::unique_ptr<PathGuide> pathGuide;
 };
 
 // AOIntegrator Definition
 class AOIntegrator : public RayIntegrator {
   public:
     // AOIntegrator Public Methods
-    AOIntegrator(bool cosSample, Float maxDist, Camera camera, Sampler sampler,
-                 Primitive aggregate, std::vector<Light> lights, Spectrum illuminant);
+    AOIntegrator(bool cosSample, Float maxDist, int nSamples, Camera camera,
+                 Sampler sampler, Primitive aggregate, std::vector<Light> lights,
+                 Spectrum illuminant);
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda, Sampler sampler,
                        ScratchBuffer &scratchBuffer,
@@ -375,10 +428,59 @@ class AOIntegrator : public RayIntegrator {
   private:
     bool cosSample;
     Float maxDist;
+    int nSamples;
     Spectrum illuminant;
     Float illumScale;
 };
 
+// RadianceCacheIntegrator Definition
+// A path tracer for fast previews that caches indirect irradiance in a
+// world-space hash grid: at diffuse vertices after the first bounce, paths are
+// terminated using the cached irradiance once the vertex's cell has collected
+// enough samples; until then, they continue and record their estimate into it.
+// Lookups are jittered by up to half a cell to hide the grid's structure.
+class RadianceCacheIntegrator : public RayIntegrator {
+  public:
+    // RadianceCacheIntegrator Public Methods
+    RadianceCacheIntegrator(int maxDepth, Float cellSize, int minSamples, int cacheSize,
+                            Camera camera, Sampler sampler, Primitive aggregate,
+                            std::vector<Light> lights, const RGBColorSpace *colorSpace,
+                            const std::string &lightSampleStrategy = "bvh");
+
+    SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda, Sampler sampler,
+                       ScratchBuffer &scratchBuffer,
+                       VisibleSurface *visibleSurface) const;
+
+    static std::unique_ptr<RadianceCacheIntegrator> Create(
+        const ParameterDictionary &parameters, const RGBColorSpace *colorSpace,
+        Camera camera, Sampler sampler, Primitive aggregate, std::vector<Light> lights,
+        const FileLoc *loc);
+
+    std::string ToString() const;
+
+  private:
+    // RadianceCacheIntegrator Private Types
+    struct CacheEntry {
+        // Zero for an unused entry
+        std::atomic<uint64_t> key{0};
+        AtomicFloat irradiance[3];
+        std::atomic<int> nSamples{0};
+    };
+
+    // RadianceCacheIntegrator Private Methods
+    SampledSpectrum SampleLd(const SurfaceInteraction &intr, const BSDF *bsdf,
+                             SampledWavelengths &lambda, Sampler sampler) const;
+    CacheEntry *FindCacheEntry(Point3f p, Normal3f n) const;
+
+    // RadianceCacheIntegrator Private Members
+    int maxDepth;
+    Float cellSize;
+    int minSamples, cacheSize;
+    LightSampler lightSampler;
+    const RGBColorSpace *colorSpace;
+    std::unique_ptr<CacheEntry[]> cache;
+};
+
 // LightPathIntegrator Definition
 class LightPathIntegrator : public ImageTileIntegrator {
   public:
@@ -408,18 +510,16 @@ class BDPTIntegrator : public RayIntegrator {
     // BDPTIntegrator Public Methods
     BDPTIntegrator(Camera camera, Sampler sampler, Primitive aggregate,
                    std::vector<Light> lights, int maxDepth, bool visualizeStrategies,
-                   bool visualizeWeights, bool regularize = false)
-        : RayIntegrator(camera, sampler, aggregate, lights),
-          maxDepth(maxDepth),
-          regularize(regularize),
-          lightSampler(new PowerLightSampler(lights, Allocator())),
-          visualizeStrategies(visualizeStrategies),
-          visualizeWeights(visualizeWeights) {}
+                   bool visualizeWeights, bool regularize = false,
+                   Float minStrategyWeight = 0);
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda, Sampler sampler,
                        ScratchBuffer &scratchBuffer,
                        VisibleSurface *visibleSurface) const;
 
+    void FinishedWave(int waveStart, int waveEnd);
+    bool NeedsWaveBarriers() const { return minStrategyWeight > 0; }
+
     static std::unique_ptr<BDPTIntegrator> Create(const ParameterDictionary &parameters,
                                                   Camera camera, Sampler sampler,
                                                   Primitive aggregate,
@@ -437,6 +537,13 @@ class BDPTIntegrator : public RayIntegrator {
     LightSampler lightSampler;
     bool visualizeStrategies, visualizeWeights;
     mutable std::vector<Film> weightFilms;
+    // Connection strategies whose average MIS weight in earlier waves is below
+    // _minStrategyWeight_ are only evaluated with the given probabilities.
+    Float minStrategyWeight;
+    std::vector<Float> strategyProbabilities;
+    // Per-thread sums of each strategy's MIS weights and their counts
+    mutable ThreadLocal<std::vector<double>> strategyWeightSums;
+    std::vector<double> strategyWeightTotals;
 };
 
 // MLTIntegrator Definition
@@ -447,7 +554,8 @@ class MLTIntegrator : public Integrator {
     // MLTIntegrator Public Methods
     MLTIntegrator(Camera camera, Primitive aggregate, std::vector<Light> lights,
                   int maxDepth, int nBootstrap, int nChains, int mutationsPerPixel,
-                  Float sigma, Float largeStepProbability, bool regularize)
+                  Float sigma, Float largeStepProbability, bool regularize,
+                  int64_t reseedInterval = 0)
         : Integrator(aggregate, lights),
           lightSampler(new PowerLightSampler(lights, Allocator())),
           camera(camera),
@@ -457,7 +565,8 @@ class MLTIntegrator : public Integrator {
           mutationsPerPixel(mutationsPerPixel),
           sigma(sigma),
           largeStepProbability(largeStepProbability),
-          regularize(regularize) {}
+          regularize(regularize),
+          reseedInterval(reseedInterval) {}
 
     void Render();
 
@@ -491,6 +600,9 @@ class MLTIntegrator : public Integrator {
     int mutationsPerPixel;
     Float sigma, largeStepProbability;
     int nChains;
+    // If nonzero, chains restart from a new bootstrap sample after this many
+    // mutations
+    int64_t reseedInterval;
 };
 
 // SPPMIntegrator Definition
@@ -0,0 +1,198 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/cpu/lightcache.h>
+
+#include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/sampling.h>
+#include <pbrt/util/stats.h>
+
+#include <algorithm>
+
+namespace pbrt {
+
+STAT_COUNTER("Light selection cache/Training iterations", nLightCacheIterations);
+STAT_PERCENT("Light selection cache/Unoccluded training shadow rays",
+             nLightCacheUnoccluded, nLightCacheShadowRays);
+STAT_COUNTER("Light selection cache/Records without a free entry", lightCacheOverflows);
+STAT_MEMORY_COUNTER("Memory/Light selection cache", lightCacheBytes);
+
+// Fraction of the cluster sampling probability that is given by the
+// visibility-weighted distribution; the rest keeps the BVH's, which bounds
+// the variance when a cell's estimates are poor.
+static constexpr Float LearnedFraction = 0.5f;
+
+// LightSelectionCache Method Definitions
+LightSelectionCache::LightSelectionCache(const BVHLightSampler *lightSampler,
+                                         Bounds3f bounds, int trainingSamples,
+                                         int cacheSize)
+    : lightSampler(lightSampler),
+      cellSize(Length(bounds.Diagonal()) / 64),
+      cacheSize(cacheSize),
+      cache(new CacheEntry[cacheSize]),
+      trainingSamples(trainingSamples) {
+    CHECK(lightSampler);
+    if (!(cellSize > 0))
+        cellSize = 1;
+    lightCacheBytes += cacheSize * sizeof(CacheEntry);
+}
+
+uint64_t LightSelectionCache::CellKey(const LightSampleContext &ctx) const {
+    // Hash the grid cell containing the reference point along with the
+    // dominant axis of its normal, so that the two sides of thin surfaces
+    // don't share an entry
+    Point3f p = ctx.p();
+    Point3i cell(pstd::floor(p.x / cellSize), pstd::floor(p.y / cellSize),
+                 pstd::floor(p.z / cellSize));
+    int axis = MaxComponentIndex(Abs(ctx.n));
+    int direction = 2 * axis + (ctx.n[axis] < 0);
+    return Hash(cell, direction) | 1;
+}
+
+const LightSelectionCache::CacheEntry *LightSelectionCache::LookupEntry(
+    const LightSampleContext &ctx) const {
+    uint64_t key = CellKey(ctx);
+    constexpr int maxProbes = 16;
+    for (int i = 0; i < maxProbes; ++i) {
+        const CacheEntry &entry = cache[(key + i) % cacheSize];
+        uint64_t entryKey = entry.key.load(std::memory_order_relaxed);
+        if (entryKey == key)
+            // Entries claimed during the current wave aren't used until it ends
+            return entry.nWaves > 0 ? &entry : nullptr;
+        if (entryKey == 0)
+            return nullptr;
+    }
+    return nullptr;
+}
+
+LightSelectionCache::CacheEntry *LightSelectionCache::FindOrAddEntry(
+    const LightSampleContext &ctx) {
+    // Find the cell's entry with linear probing, claiming an unused one if needed
+    uint64_t key = CellKey(ctx);
+    constexpr int maxProbes = 16;
+    for (int i = 0; i < maxProbes; ++i) {
+        CacheEntry &entry = cache[(key + i) % cacheSize];
+        uint64_t entryKey = entry.key.load(std::memory_order_relaxed);
+        if (entryKey == 0 && entry.key.compare_exchange_strong(entryKey, key))
+            return &entry;
+        if (entryKey == key)
+            return &entry;
+    }
+    ++lightCacheOverflows;
+    return nullptr;
+}
+
+bool LightSelectionCache::ClusterPMFs(const LightSampleContext &ctx,
+                                      const CacheEntry &entry, Float bvhPMF[MaxClusters],
+                                      Float pmf[MaxClusters],
+                                      int clusterNodes[MaxClusters]) const {
+    lightSampler->ClusterPMFs(ctx, bvhPMF, clusterNodes);
+    Float visibleSum = 0;
+    for (int i = 0; i < MaxClusters; ++i)
+        visibleSum += bvhPMF[i] * entry.visibility[i];
+    if (visibleSum == 0)
+        return false;
+
+    for (int i = 0; i < MaxClusters; ++i)
+        pmf[i] = bvhPMF[i] * ((1 - LearnedFraction) +
+                              LearnedFraction * entry.visibility[i] / visibleSum);
+    return true;
+}
+
+pstd::optional<SampledLight> LightSelectionCache::Sample(const LightSampleContext &ctx,
+                                                         Float u) const {
+    // Use the BVH's probabilities for infinite lights and cells without estimates
+    Float pInfinite = lightSampler->PInfinite();
+    const CacheEntry *entry = LookupEntry(ctx);
+    if (!entry || u < pInfinite)
+        return lightSampler->Sample(ctx, u);
+    Float bvhPMF[MaxClusters], pmf[MaxClusters];
+    int clusterNodes[MaxClusters];
+    if (!ClusterPMFs(ctx, *entry, bvhPMF, pmf, clusterNodes))
+        return lightSampler->Sample(ctx, u);
+
+    // Sample a cluster and then a light within it
+    u = std::min<Float>((u - pInfinite) / (1 - pInfinite), OneMinusEpsilon);
+    Float clusterPMF;
+    int cluster = SampleDiscrete(pstd::span<const Float>(pmf, MaxClusters), u,
+                                 &clusterPMF, &u);
+    if (cluster < 0)
+        return {};
+    DCHECK_GE(clusterNodes[cluster], 0);
+    return lightSampler->SampleSubtree(ctx, clusterNodes[cluster], u,
+                                       (1 - pInfinite) * clusterPMF);
+}
+
+Float LightSelectionCache::PMF(const LightSampleContext &ctx, Light light) const {
+    Float bvhLightPMF = lightSampler->PMF(ctx, light);
+    int cluster = lightSampler->ClusterIndex(light);
+    const CacheEntry *entry = cluster >= 0 ? LookupEntry(ctx) : nullptr;
+    if (!entry || bvhLightPMF == 0)
+        return bvhLightPMF;
+    Float bvhPMF[MaxClusters], pmf[MaxClusters];
+    int clusterNodes[MaxClusters];
+    if (!ClusterPMFs(ctx, *entry, bvhPMF, pmf, clusterNodes) || bvhPMF[cluster] == 0)
+        return bvhLightPMF;
+
+    // Rescale the BVH's probability for the light's cluster to the learned one
+    return bvhLightPMF * pmf[cluster] / bvhPMF[cluster];
+}
+
+void LightSelectionCache::Record(const LightSampleContext &ctx, Light light,
+                                 bool unoccluded) {
+    int cluster = lightSampler->ClusterIndex(light);
+    if (!training || cluster < 0)
+        return;
+    CacheEntry *entry = FindOrAddEntry(ctx);
+    if (!entry)
+        return;
+    entry->nShadowRays[cluster].fetch_add(1, std::memory_order_relaxed);
+    ++nLightCacheShadowRays;
+    if (unoccluded) {
+        entry->nUnoccluded[cluster].fetch_add(1, std::memory_order_relaxed);
+        ++nLightCacheUnoccluded;
+    }
+}
+
+void LightSelectionCache::FinishedWave(int waveSamples) {
+    if (!training)
+        return;
+    ++nLightCacheIterations;
+    samplesTrained += waveSamples;
+
+    // Estimate each used entry's cluster visibilities, starting from an
+    // even prior so that clusters that have few shadow rays aren't ruled out
+    std::atomic<int> nEntries{0};
+    ParallelFor(0, cacheSize, [&](int64_t start, int64_t end) {
+        int n = 0;
+        for (int64_t i = start; i < end; ++i) {
+            CacheEntry &entry = cache[i];
+            if (entry.key.load(std::memory_order_relaxed) == 0)
+                continue;
+            for (int c = 0; c < MaxClusters; ++c)
+                entry.visibility[c] = Float(entry.nUnoccluded[c] + 1) /
+                                      Float(entry.nShadowRays[c] + 2);
+            ++entry.nWaves;
+            ++n;
+        }
+        nEntries += n;
+    });
+
+    training = samplesTrained < trainingSamples;
+    LOG_VERBOSE("Light selection cache: %d entries after %d samples, training %s",
+                int(nEntries), samplesTrained, training);
+}
+
+std::string LightSelectionCache::ToString() const {
+    return StringPrintf("[ LightSelectionCache cellSize: %f cacheSize: %d "
+                        "trainingSamples: %d samplesTrained: %d training: %s ]",
+                        cellSize, cacheSize, trainingSamples, samplesTrained, training);
+}
+
+}  // namespace pbrt
@@ -0,0 +1,84 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_CPU_LIGHTCACHE_H
+#define PBRT_CPU_LIGHTCACHE_H
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/base/light.h>
+#include <pbrt/lightsamplers.h>
+#include <pbrt/util/pstd.h>
+#include <pbrt/util/vecmath.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace pbrt {
+
+// LightSelectionCache Definition
+// Learns how often shadow rays to each of a _BVHLightSampler_'s clusters of
+// lights are unoccluded, per cell of a world-space hash grid, and uses those
+// estimates to choose lights: clusters are sampled from a mixture of the
+// BVH's importance-based probabilities and those probabilities scaled by the
+// estimated visibility. Shadow rays are recorded during the training waves;
+// the probabilities used for sampling only change between waves, so that
+// they are the same when a light is sampled and when its PMF is evaluated
+// for MIS.
+class LightSelectionCache {
+  public:
+    // LightSelectionCache Public Methods
+    LightSelectionCache(const BVHLightSampler *lightSampler, Bounds3f bounds,
+                        int trainingSamples, int cacheSize = 1 << 16);
+
+    bool Training() const { return training; }
+
+    pstd::optional<SampledLight> Sample(const LightSampleContext &ctx, Float u) const;
+    Float PMF(const LightSampleContext &ctx, Light light) const;
+
+    // Records whether the shadow ray traced to _light_ from _ctx_ was unoccluded
+    void Record(const LightSampleContext &ctx, Light light, bool unoccluded);
+
+    // Updates the sampling probabilities from the shadow rays recorded so far;
+    // called between waves of _waveSamples_ samples per pixel.
+    void FinishedWave(int waveSamples);
+
+    std::string ToString() const;
+
+  private:
+    // LightSelectionCache Private Types
+    static constexpr int MaxClusters = BVHLightSampler::MaxClusters;
+    struct CacheEntry {
+        // Zero for an unused entry
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint32_t> nShadowRays[MaxClusters] = {};
+        std::atomic<uint32_t> nUnoccluded[MaxClusters] = {};
+        // Estimated visibility of each cluster, valid once _nWaves_ is nonzero
+        Float visibility[MaxClusters];
+        int nWaves = 0;
+    };
+
+    // LightSelectionCache Private Methods
+    uint64_t CellKey(const LightSampleContext &ctx) const;
+    const CacheEntry *LookupEntry(const LightSampleContext &ctx) const;
+    CacheEntry *FindOrAddEntry(const LightSampleContext &ctx);
+    // Computes the probabilities of sampling each cluster at the reference
+    // point, returning false if _entry_ can't improve on the BVH's
+    bool ClusterPMFs(const LightSampleContext &ctx, const CacheEntry &entry,
+                     Float bvhPMF[MaxClusters], Float pmf[MaxClusters],
+                     int clusterNodes[MaxClusters]) const;
+
+    // LightSelectionCache Private Members
+    const BVHLightSampler *lightSampler;
+    Float cellSize;
+    int cacheSize;
+    std::unique_ptr<CacheEntry[]> cache;
+    int trainingSamples, samplesTrained = 0;
+    bool training = true;
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_CPU_LIGHTCACHE_H
@@ -0,0 +1,78 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/lightcache.h>
+#include <pbrt/lights.h>
+#include <pbrt/lightsamplers.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/spectrum.h>
+#include <pbrt/util/transform.h>
+
+#include <unordered_map>
+#include <vector>
+
+using namespace pbrt;
+
+TEST(LightSelectionCache, LearnsVisibility) {
+    RNG rng;
+    std::vector<Light> lights;
+    std::unordered_map<Light, Point3f> lightPositions;
+    ConstantSpectrum one(1.f);
+    for (int i = 0; i < 33; ++i) {
+        Vector3f p{Lerp(rng.Uniform<Float>(), -5, 5), Lerp(rng.Uniform<Float>(), -5, 5),
+                   Lerp(rng.Uniform<Float>(), -5, 5)};
+        lights.push_back(new PointLight(Translate(p), MediumInterface(), &one, 1.f));
+        lightPositions[lights.back()] = Point3f(p);
+    }
+
+    for (int maxChildren : {2, 4}) {
+        BVHLightSampler bvh(lights, Allocator(), maxChildren);
+        Bounds3f bounds(Point3f(-5, -5, -5), Point3f(5, 5, 5));
+        LightSelectionCache cache(&bvh, bounds, 1);
+        LightSampleContext ctx(Point3fi(Point3f(0.5, -1, 2)), Normal3f(0, 0, 1),
+                               Normal3f(0, 0, 1));
+
+        // Before training, the cache must match the BVH
+        for (Light light : lights)
+            EXPECT_EQ(bvh.PMF(ctx, light), cache.PMF(ctx, light));
+
+        // Record shadow rays that are only unoccluded for lights with $x>0$
+        for (int i = 0; i < 10000; ++i) {
+            pstd::optional<SampledLight> sampledLight =
+                cache.Sample(ctx, rng.Uniform<Float>());
+            ASSERT_TRUE(sampledLight.has_value());
+            cache.Record(ctx, sampledLight->light,
+                         lightPositions[sampledLight->light].x > 0);
+        }
+        cache.FinishedWave(1);
+        EXPECT_FALSE(cache.Training());
+
+        // The learned PMF must sum to one and give more probability to visible lights
+        double pmfSum = 0, visibleBVH = 0, visibleCache = 0;
+        for (Light light : lights) {
+            Float pmf = cache.PMF(ctx, light);
+            pmfSum += pmf;
+            if (lightPositions[light].x > 0) {
+                visibleBVH += bvh.PMF(ctx, light);
+                visibleCache += pmf;
+            }
+        }
+        EXPECT_NEAR(1, pmfSum, 1e-4) << maxChildren;
+        EXPECT_GT(visibleCache, visibleBVH) << maxChildren;
+
+        // Sampled lights' probabilities must match their PMFs
+        for (int i = 0; i < 1000; ++i) {
+            pstd::optional<SampledLight> sampledLight =
+                cache.Sample(ctx, rng.Uniform<Float>());
+            ASSERT_TRUE(sampledLight.has_value());
+            Float pmf = cache.PMF(ctx, sampledLight->light);
+            EXPECT_NEAR(pmf, sampledLight->p, 1e-5f * pmf);
+        }
+    }
+}
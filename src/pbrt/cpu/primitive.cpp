@@ -10,10 +10,15 @@
 #include <pbrt/shapes.h>
 #include <pbrt/textures.h>
 #include <pbrt/util/check.h>
+#include <pbrt/util/buffercache.h>
 #include <pbrt/util/log.h>
+#include <pbrt/util/memory.h>
 #include <pbrt/util/taggedptr.h>
 #include <pbrt/util/vecmath.h>
 
+#include <algorithm>
+#include <mutex>
+
 namespace pbrt {
 
 Bounds3f Primitive::Bounds() const {
@@ -31,7 +36,95 @@ bool Primitive::IntersectP(const Ray &r, Float tMax) const {
     return DispatchCPU(isectp);
 }
 
+// DeferredIntersection Method Definitions
+STAT_PERCENT("Intersections/Deferred triangle hits resolved", nDeferredHitsResolved,
+             nDeferredHits);
+
+pstd::optional<Float> DeferredIntersection::Intersect(Primitive prim, const Ray &r,
+                                                      Float tMax) {
+    // Find the triangle that _prim_ intersects directly, if its hits can be deferred
+    const Triangle *tri = nullptr;
+    if (const GeometricPrimitive *gp = prim.CastOrNullptr<GeometricPrimitive>()) {
+        if (!gp->alpha)
+            tri = gp->shape.CastOrNullptr<Triangle>();
+    } else if (const SimplePrimitive *sp = prim.CastOrNullptr<SimplePrimitive>())
+        tri = sp->shape.CastOrNullptr<Triangle>();
+    else if (const MeshTrianglePrimitive *mtp =
+                 prim.CastOrNullptr<MeshTrianglePrimitive>())
+        tri = mtp->GetTriangle();
+    else if (const TriangleBlockPrimitive *block =
+                 prim.CastOrNullptr<TriangleBlockPrimitive>())
+        return block->Intersect(r, tMax, this);
+
+    if (tri) {
+        // Record the triangle's barycentrics without computing its interaction
+        pstd::optional<TriangleIntersection> ti = tri->IntersectBarycentrics(r, tMax);
+        if (!ti)
+            return {};
+        ++nDeferredHits;
+        primitive = prim;
+        triangle = tri;
+        triIsect = *ti;
+        return ti->t;
+    }
+
+    // Record the full intersection with other primitives
+    pstd::optional<ShapeIntersection> primSi = prim.Intersect(r, tMax);
+    if (!primSi)
+        return {};
+    triangle = nullptr;
+    si = std::move(primSi);
+    return si->tHit;
+}
+
+pstd::optional<ShapeIntersection> DeferredIntersection::Resolve(const Ray &r) {
+    if (!triangle)
+        return std::move(si);
+    // Compute the _SurfaceInteraction_ for the closest triangle hit
+    ++nDeferredHitsResolved;
+    SurfaceInteraction intr =
+        triangle->InteractionFromIntersection(triIsect, r.time, -r.d);
+    if (const GeometricPrimitive *gp = primitive.CastOrNullptr<GeometricPrimitive>())
+        intr.SetIntersectionProperties(gp->material, gp->areaLight, &gp->mediumInterface,
+                                       r.medium);
+    else if (const MeshTrianglePrimitive *mtp =
+                 primitive.CastOrNullptr<MeshTrianglePrimitive>()) {
+        const MeshTrianglePrimitive::MeshAttributes &attrib = mtp->Attributes();
+        intr.SetIntersectionProperties(attrib.material, nullptr, &attrib.mediumInterface,
+                                       r.medium);
+    } else
+        intr.SetIntersectionProperties(primitive.Cast<SimplePrimitive>()->material,
+                                       nullptr, nullptr, r.medium);
+    return ShapeIntersection{intr, triIsect.t};
+}
+
 // GeometricPrimitive Method Definitions
+STAT_PERCENT("Geometry/Alpha-tested triangles without alpha tests",
+             nUntestedAlphaTriangles, nAlphaTriangles);
+
+// Largest number of texels that are examined to bound an image alpha
+// texture's values over a triangle
+static constexpr int64_t MaxAlphaRangeTexels = 4096;
+
+// Returns bounds on _alpha_'s values over _tri_, if they can be found cheaply.
+static pstd::optional<Interval> TriangleAlphaRange(FloatTexture alpha,
+                                                   const Triangle *tri) {
+    // Alpha is evaluated at intersections before their differentials are
+    // computed, so lookups aren't filtered.
+    if (const FloatConstantTexture *ct = alpha.CastOrNullptr<FloatConstantTexture>())
+        return Interval(ct->Evaluate(TextureEvalContext()));
+    const FloatImageTexture *image = alpha.CastOrNullptr<FloatImageTexture>();
+    if (!image)
+        return {};
+    // $(u,v)$ is interpolated linearly, so the vertices' coordinates bound it
+    Bounds2f uvBounds;
+    for (int i = 0; i < 3; ++i) {
+        TriangleIntersection ti{Float(i == 0), Float(i == 1), Float(i == 2), 0};
+        uvBounds = Union(uvBounds, tri->InteractionFromIntersection(ti, 0, {0, 0, 1}).uv);
+    }
+    return image->ValueRange(uvBounds, MaxAlphaRangeTexels);
+}
+
 GeometricPrimitive::GeometricPrimitive(Shape shape, Material material, Light areaLight,
                                        const MediumInterface &mediumInterface,
                                        FloatTexture alpha)
@@ -41,6 +134,20 @@ GeometricPrimitive::GeometricPrimitive(Shape shape, Material material, Light are
       mediumInterface(mediumInterface),
       alpha(alpha) {
     primitiveMemory += sizeof(*this);
+    // Skip alpha tests for triangles that the alpha texture doesn't vary over
+    const Triangle *tri = shape.CastOrNullptr<Triangle>();
+    if (alpha && tri) {
+        ++nAlphaTriangles;
+        if (pstd::optional<Interval> range = TriangleAlphaRange(alpha, tri)) {
+            if (range->LowerBound() >= 1) {
+                ++nUntestedAlphaTriangles;
+                this->alpha = nullptr;
+            } else if (range->UpperBound() <= 0) {
+                ++nUntestedAlphaTriangles;
+                transparent = true;
+            }
+        }
+    }
 }
 
 Bounds3f GeometricPrimitive::Bounds() const {
@@ -49,6 +156,8 @@ Bounds3f GeometricPrimitive::Bounds() const {
 
 pstd::optional<ShapeIntersection> GeometricPrimitive::Intersect(const Ray &r,
                                                                 Float tMax) const {
+    if (transparent)
+        return {};
     pstd::optional<ShapeIntersection> si = shape.Intersect(r, tMax);
     if (!si)
         return {};
@@ -77,6 +186,8 @@ pstd::optional<ShapeIntersection> GeometricPrimitive::Intersect(const Ray &r,
 }
 
 bool GeometricPrimitive::IntersectP(const Ray &r, Float tMax) const {
+    if (transparent)
+        return false;
     if (alpha)
         return Intersect(r, tMax).has_value();
     else
@@ -108,6 +219,506 @@ pstd::optional<ShapeIntersection> SimplePrimitive::Intersect(const Ray &r,
     return si;
 }
 
+// MeshTrianglePrimitive Method Definitions
+STAT_COUNTER("Geometry/Mesh triangle primitives", nMeshTrianglePrimitives);
+
+std::vector<MeshTrianglePrimitive::MeshAttributes>
+    *MeshTrianglePrimitive::meshAttributes = new std::vector<MeshAttributes>;
+static std::mutex meshAttributesMutex;
+
+std::vector<Primitive> MeshTrianglePrimitive::CreatePrimitives(
+    pstd::span<const Shape> triangles, Material material,
+    const MediumInterface &mediumInterface, Allocator alloc) {
+    std::vector<Primitive> prims;
+    if (triangles.empty())
+        return prims;
+    // Record the attributes that the mesh's triangles share
+    int meshIndex = triangles[0].Cast<Triangle>()->MeshIndex();
+    {
+        std::lock_guard<std::mutex> lock(meshAttributesMutex);
+        if (meshIndex >= int(meshAttributes->size()))
+            meshAttributes->resize(meshIndex + 1);
+        (*meshAttributes)[meshIndex] = MeshAttributes{material, mediumInterface};
+    }
+
+    // Allocate and initialize primitives for the triangles
+    MeshTrianglePrimitive *mtp =
+        alloc.allocate_object<MeshTrianglePrimitive>(triangles.size());
+    prims.reserve(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const Triangle *tri = triangles[i].Cast<Triangle>();
+        CHECK_EQ(tri->MeshIndex(), meshIndex);
+        alloc.construct(&mtp[i], *tri);
+        prims.push_back(&mtp[i]);
+    }
+    nMeshTrianglePrimitives += triangles.size();
+    primitiveMemory += triangles.size() * sizeof(MeshTrianglePrimitive);
+    return prims;
+}
+
+pstd::optional<ShapeIntersection> MeshTrianglePrimitive::Intersect(const Ray &r,
+                                                                   Float tMax) const {
+    pstd::optional<ShapeIntersection> si = triangle.Intersect(r, tMax);
+    if (!si)
+        return {};
+    const MeshAttributes &attrib = Attributes();
+    si->intr.SetIntersectionProperties(attrib.material, nullptr, &attrib.mediumInterface,
+                                       r.medium);
+    return si;
+}
+
+// TriangleBlockPrimitive Method Definitions
+STAT_COUNTER("Intersections/Triangle block tests", nTriangleBlockTests);
+STAT_PERCENT("Intersections/Triangle block candidates rejected", nBlockCandidatesRejected,
+             nBlockCandidates);
+
+// Returns the _Shape_ that _prim_ intersects directly, if any.
+static Shape GetDirectShape(Primitive prim) {
+    if (const GeometricPrimitive *gp = prim.CastOrNullptr<GeometricPrimitive>())
+        return gp->GetShape();
+    else if (const SimplePrimitive *sp = prim.CastOrNullptr<SimplePrimitive>())
+        return sp->GetShape();
+    else if (const MeshTrianglePrimitive *mtp =
+                 prim.CastOrNullptr<MeshTrianglePrimitive>())
+        return mtp->GetTriangle();
+    return nullptr;
+}
+
+// Returns the _Triangle_ that _prim_ intersects directly, if any.
+static const Triangle *GetTriangle(Primitive prim) {
+    return GetDirectShape(prim).CastOrNullptr<Triangle>();
+}
+
+bool TriangleBlockPrimitive::IsTriangle(Primitive prim) {
+    return GetTriangle(prim) != nullptr;
+}
+
+TriangleBlockPrimitive::TriangleBlockPrimitive(pstd::span<const Primitive> tris)
+    : nTriangles(tris.size()) {
+    CHECK(nTriangles > 0 && nTriangles <= Width);
+    for (int i = 0; i < nTriangles; ++i) {
+        CHECK(IsTriangle(tris[i]));
+        triangles[i] = tris[i];
+    }
+    UpdateVertices();
+    primitiveMemory += sizeof(*this);
+}
+
+void TriangleBlockPrimitive::UpdateVertices() {
+    for (int i = 0; i < Width; ++i) {
+        // Initialize empty lanes with degenerate triangles that no ray can hit
+        pstd::array<Point3f, 3> v = {Point3f(), Point3f(), Point3f()};
+        if (i < nTriangles)
+            v = GetTriangle(triangles[i])->Vertices();
+        for (int j = 0; j < 3; ++j)
+            for (int c = 0; c < 3; ++c)
+                p[j][c][i] = v[j][c];
+        degenerate[i] = LengthSquared(Cross(v[2] - v[0], v[1] - v[0])) == 0;
+    }
+}
+
+Bounds3f TriangleBlockPrimitive::Bounds() const {
+    Bounds3f bounds;
+    for (int i = 0; i < nTriangles; ++i)
+        bounds = Union(bounds, triangles[i].Bounds());
+    return bounds;
+}
+
+int TriangleBlockPrimitive::intersectLanes(const Ray &r, Float tMax,
+                                           Float tHit[Width]) const {
+    ++nTriangleBlockTests;
+    // Compute permutation and shear shared by all lanes; see _IntersectTriangle()_
+    int kz = MaxComponentIndex(Abs(r.d));
+    int kx = kz + 1;
+    if (kx == 3)
+        kx = 0;
+    int ky = kx + 1;
+    if (ky == 3)
+        ky = 0;
+    Vector3f d = Permute(r.d, {kx, ky, kz});
+    Float Sx = -d.x / d.z;
+    Float Sy = -d.y / d.z;
+    Float Sz = 1 / d.z;
+
+    // Transform all lanes' vertices to ray coordinate space
+    Float xt[3][Width], yt[3][Width], zt[3][Width];
+    for (int v = 0; v < 3; ++v)
+        for (int i = 0; i < Width; ++i) {
+            zt[v][i] = p[v][kz][i] - r.o[kz];
+            xt[v][i] = (p[v][kx][i] - r.o[kx]) + Sx * zt[v][i];
+            yt[v][i] = (p[v][ky][i] - r.o[ky]) + Sy * zt[v][i];
+        }
+
+    // Compute edge function coefficients for all lanes
+    Float e[3][Width];
+    bool anyZeroEdge = false;
+    for (int v = 0; v < 3; ++v) {
+        int a = (v + 1) % 3, b = (v + 2) % 3;
+        for (int i = 0; i < Width; ++i) {
+            e[v][i] = DifferenceOfProducts(xt[a][i], yt[b][i], yt[a][i], xt[b][i]);
+            anyZeroEdge |= (e[v][i] == 0);
+        }
+    }
+    if (sizeof(Float) == sizeof(float) && anyZeroEdge)
+        // Fall back to double-precision edge functions for lanes at triangle edges
+        for (int i = 0; i < Width; ++i) {
+            if (e[0][i] != 0 && e[1][i] != 0 && e[2][i] != 0)
+                continue;
+            for (int v = 0; v < 3; ++v) {
+                int a = (v + 1) % 3, b = (v + 2) % 3;
+                e[v][i] = (float)((double)yt[b][i] * (double)xt[a][i] -
+                                  (double)xt[b][i] * (double)yt[a][i]);
+            }
+        }
+
+    // Perform edge, determinant, and $t$ range and error bound tests for all lanes
+    bool hit[Width];
+    for (int i = 0; i < Width; ++i) {
+        Float e0 = e[0][i], e1 = e[1][i], e2 = e[2][i];
+        bool edgeMiss = (e0 < 0 || e1 < 0 || e2 < 0) & (e0 > 0 || e1 > 0 || e2 > 0);
+        Float det = e0 + e1 + e2;
+        Float z0 = zt[0][i] * Sz, z1 = zt[1][i] * Sz, z2 = zt[2][i] * Sz;
+        Float tScaled = e0 * z0 + e1 * z1 + e2 * z2;
+        bool rangeMiss = ((det < 0) & ((tScaled >= 0) | (tScaled < tMax * det))) |
+                         ((det > 0) & ((tScaled <= 0) | (tScaled > tMax * det)));
+
+        Float invDet = 1 / det;
+        Float t = tScaled * invDet;
+        Float maxZt = std::max(std::abs(z0), std::max(std::abs(z1), std::abs(z2)));
+        Float maxXt = std::max(std::abs(xt[0][i]),
+                               std::max(std::abs(xt[1][i]), std::abs(xt[2][i])));
+        Float maxYt = std::max(std::abs(yt[0][i]),
+                               std::max(std::abs(yt[1][i]), std::abs(yt[2][i])));
+        Float deltaZ = gamma(3) * maxZt;
+        Float deltaX = gamma(5) * (maxXt + maxZt);
+        Float deltaY = gamma(5) * (maxYt + maxZt);
+        Float deltaE = 2 * (gamma(2) * maxXt * maxYt + deltaY * maxXt + deltaX * maxYt);
+        Float maxE = std::max(std::abs(e0), std::max(std::abs(e1), std::abs(e2)));
+        Float deltaT = 3 * (gamma(3) * maxE * maxZt + deltaE * maxZt + deltaZ * maxE) *
+                       std::abs(invDet);
+
+        hit[i] = !degenerate[i] & !edgeMiss & (det != 0) & !rangeMiss & (t > deltaT);
+        tHit[i] = t;
+    }
+
+    int mask = 0;
+    for (int i = 0; i < Width; ++i)
+        mask |= int(hit[i]) << i;
+    return mask;
+}
+
+pstd::optional<ShapeIntersection> TriangleBlockPrimitive::Intersect(const Ray &r,
+                                                                    Float tMax) const {
+    DeferredIntersection isect;
+    if (!Intersect(r, tMax, &isect))
+        return {};
+    return isect.Resolve(r);
+}
+
+pstd::optional<Float> TriangleBlockPrimitive::Intersect(
+    const Ray &r, Float tMax, DeferredIntersection *isect) const {
+    Float tHit[Width];
+    int mask = intersectLanes(r, tMax, tHit);
+    // Confirm candidate lanes with their primitive's own intersection test
+    while (mask) {
+        // Find closest remaining candidate, preferring later lanes in case of ties
+        // to match the results of testing the triangles in order
+        int lane = -1;
+        for (int i = 0; i < nTriangles; ++i)
+            if ((mask & (1 << i)) && (lane == -1 || tHit[i] <= tHit[lane]))
+                lane = i;
+        mask &= ~(1 << lane);
+
+        ++nBlockCandidates;
+        if (pstd::optional<Float> t = isect->Intersect(triangles[lane], r, tMax))
+            return t;
+        ++nBlockCandidatesRejected;
+    }
+    return {};
+}
+
+bool TriangleBlockPrimitive::IntersectP(const Ray &r, Float tMax) const {
+    Float tHit[Width];
+    int mask = intersectLanes(r, tMax, tHit);
+    for (int i = 0; i < nTriangles; ++i)
+        if (mask & (1 << i)) {
+            ++nBlockCandidates;
+            if (triangles[i].IntersectP(r, tMax))
+                return true;
+            ++nBlockCandidatesRejected;
+        }
+    return false;
+}
+
+// BilinearPatchBlockPrimitive Method Definitions
+STAT_COUNTER("Intersections/Bilinear patch block tests", nBilinearPatchBlockTests);
+
+// Returns the _BilinearPatch_ that _prim_ intersects directly, if any.
+static const BilinearPatch *GetBilinearPatch(Primitive prim) {
+    return GetDirectShape(prim).CastOrNullptr<BilinearPatch>();
+}
+
+bool BilinearPatchBlockPrimitive::IsBilinearPatch(Primitive prim) {
+    return GetBilinearPatch(prim) != nullptr;
+}
+
+BilinearPatchBlockPrimitive::BilinearPatchBlockPrimitive(
+    pstd::span<const Primitive> blps)
+    : nPatches(blps.size()) {
+    CHECK(nPatches > 0 && nPatches <= Width);
+    for (int i = 0; i < nPatches; ++i) {
+        CHECK(IsBilinearPatch(blps[i]));
+        patches[i] = blps[i];
+    }
+    UpdateVertices();
+    primitiveMemory += sizeof(*this);
+}
+
+void BilinearPatchBlockPrimitive::UpdateVertices() {
+    for (int i = 0; i < Width; ++i) {
+        // Initialize empty lanes with all-zero patches, which no ray can hit
+        pstd::array<Point3f, 4> v = {Point3f(), Point3f(), Point3f(), Point3f()};
+        if (i < nPatches)
+            v = GetBilinearPatch(patches[i])->Vertices();
+        for (int j = 0; j < 4; ++j)
+            for (int c = 0; c < 3; ++c)
+                p[j][c][i] = v[j][c];
+        // Precompute ray-independent terms for _IntersectBilinearPatch()_
+        Vector3f nv = Cross(v[1] - v[0], v[2] - v[3]);
+        for (int c = 0; c < 3; ++c)
+            n[c][i] = nv[c];
+        pMax[i] = MaxComponentValue(Abs(v[0])) + MaxComponentValue(Abs(v[1])) +
+                  MaxComponentValue(Abs(v[2])) + MaxComponentValue(Abs(v[3]));
+    }
+}
+
+Bounds3f BilinearPatchBlockPrimitive::Bounds() const {
+    Bounds3f bounds;
+    for (int i = 0; i < nPatches; ++i)
+        bounds = Union(bounds, patches[i].Bounds());
+    return bounds;
+}
+
+int BilinearPatchBlockPrimitive::intersectLanes(const Ray &r, Float tMax,
+                                                Float tHit[Width]) const {
+    ++nBilinearPatchBlockTests;
+    // Find lanes whose $u$ quadratic has a root in $[0,1]$
+    bool candidate[Width];
+    for (int i = 0; i < Width; ++i) {
+        // Compute quadratic coefficients as in _IntersectBilinearPatch()_
+        Point3f p00(p[0][0][i], p[0][1][i], p[0][2][i]);
+        Point3f p10(p[1][0][i], p[1][1][i], p[1][2][i]);
+        Point3f p01(p[2][0][i], p[2][1][i], p[2][2][i]);
+        Point3f p11(p[3][0][i], p[3][1][i], p[3][2][i]);
+        Float a = Dot(Vector3f(n[0][i], n[1][i], n[2][i]), r.d);
+        Float c = Dot(Cross(p00 - r.o, r.d), p01 - p00);
+        Float b = Dot(Cross(p10 - r.o, r.d), p11 - p10) - (a + c);
+
+        Float u1, u2;
+        candidate[i] = Quadratic(a, b, c, &u1, &u2) &&
+                       ((0 <= u1 && u1 <= 1) || (0 <= u2 && u2 <= 1));
+    }
+
+    // Compute $t$ for candidate lanes
+    int mask = 0;
+    for (int i = 0; i < nPatches; ++i) {
+        if (!candidate[i])
+            continue;
+        Point3f p00(p[0][0][i], p[0][1][i], p[0][2][i]);
+        Point3f p10(p[1][0][i], p[1][1][i], p[1][2][i]);
+        Point3f p01(p[2][0][i], p[2][1][i], p[2][2][i]);
+        Point3f p11(p[3][0][i], p[3][1][i], p[3][2][i]);
+        pstd::optional<BilinearIntersection> bi =
+            IntersectBilinearPatch(r, tMax, p00, p10, p01, p11,
+                                   Vector3f(n[0][i], n[1][i], n[2][i]), pMax[i]);
+        if (bi) {
+            mask |= 1 << i;
+            tHit[i] = bi->t;
+        }
+    }
+    return mask;
+}
+
+pstd::optional<ShapeIntersection> BilinearPatchBlockPrimitive::Intersect(
+    const Ray &r, Float tMax) const {
+    Float tHit[Width];
+    int mask = intersectLanes(r, tMax, tHit);
+    // Confirm candidate lanes with their primitive's own intersection test
+    while (mask) {
+        // Find closest remaining candidate, preferring later lanes in case of ties
+        // to match the results of testing the patches in order
+        int lane = -1;
+        for (int i = 0; i < nPatches; ++i)
+            if ((mask & (1 << i)) && (lane == -1 || tHit[i] <= tHit[lane]))
+                lane = i;
+        mask &= ~(1 << lane);
+
+        ++nBlockCandidates;
+        if (pstd::optional<ShapeIntersection> si = patches[lane].Intersect(r, tMax))
+            return si;
+        ++nBlockCandidatesRejected;
+    }
+    return {};
+}
+
+bool BilinearPatchBlockPrimitive::IntersectP(const Ray &r, Float tMax) const {
+    Float tHit[Width];
+    int mask = intersectLanes(r, tMax, tHit);
+    for (int i = 0; i < nPatches; ++i)
+        if (mask & (1 << i)) {
+            ++nBlockCandidates;
+            if (patches[i].IntersectP(r, tMax))
+                return true;
+            ++nBlockCandidatesRejected;
+        }
+    return false;
+}
+
+// LazyPrimitive Method Definitions
+STAT_COUNTER("Geometry/Lazy primitives", nLazyPrimitives);
+STAT_COUNTER("Geometry/Lazy primitive geometry loads", nLazyGeometryLoads);
+STAT_COUNTER("Geometry/Lazy primitive geometry evictions", nLazyGeometryEvictions);
+
+// LazyPrimitive::Geometry Definition
+struct LazyPrimitive::Geometry {
+    Geometry() : arena(&memory) {}
+    ~Geometry() { delete bvh; }
+
+    // All of the geometry's shapes and primitives are allocated from _arena_
+    TrackedMemoryResource memory;
+    pstd::pmr::monotonic_buffer_resource arena;
+    BVHAggregate *bvh = nullptr;
+    Primitive primitive;
+    size_t bytes = 0;
+};
+
+// LazyGeometryCache Definition
+class LazyGeometryCache {
+  public:
+    // LazyGeometryCache Public Methods
+    static void SetBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = bytes;
+    }
+
+    static uint64_t Tick() { return tick.load(std::memory_order_relaxed); }
+
+    static void Add(const LazyPrimitive *prim, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++tick;
+        resident.push_back({prim, bytes});
+        totalBytes += bytes;
+        // Evict least recently used geometry other than _prim_'s to meet the
+        // budget and to bring the process's allocations back under the
+        // overall memory budget
+        size_t overage = MemoryBudgetOverage();
+        while (((budget > 0 && totalBytes > budget) || overage > 0) &&
+               resident.size() > 1) {
+            auto lru = std::min_element(
+                resident.begin(), resident.end() - 1,
+                [](const Entry &a, const Entry &b) {
+                    return a.prim->lastUsed.load(std::memory_order_relaxed) <
+                           b.prim->lastUsed.load(std::memory_order_relaxed);
+                });
+            // Rays that are still traversing the evicted geometry hold references
+            // to it, so it is only freed after they finish
+            std::atomic_store(&lru->prim->geometry,
+                              std::shared_ptr<const LazyPrimitive::Geometry>());
+            totalBytes -= lru->bytes;
+            overage -= std::min(overage, lru->bytes);
+            resident.erase(lru);
+            ++nLazyGeometryEvictions;
+        }
+    }
+
+  private:
+    // LazyGeometryCache Private Members
+    struct Entry {
+        const LazyPrimitive *prim;
+        size_t bytes;
+    };
+    static std::mutex mutex;
+    static std::vector<Entry> resident;
+    static size_t totalBytes, budget;
+    static std::atomic<uint64_t> tick;
+};
+
+std::mutex LazyGeometryCache::mutex;
+std::vector<LazyGeometryCache::Entry> LazyGeometryCache::resident;
+size_t LazyGeometryCache::totalBytes, LazyGeometryCache::budget;
+std::atomic<uint64_t> LazyGeometryCache::tick;
+
+LazyPrimitive::LazyPrimitive(CreateFunction c) : create(std::move(c)) {
+    // Create geometry to find _bounds_; it stays resident until evicted
+    std::shared_ptr<const Geometry> g = createGeometry();
+    if (g->primitive)
+        bounds = g->primitive.Bounds();
+    geometry = g;
+    LazyGeometryCache::Add(this, g->bytes);
+    ++nLazyPrimitives;
+    primitiveMemory += sizeof(*this);
+}
+
+LazyPrimitive::LazyPrimitive(CreateFunction c, const Bounds3f &bounds)
+    : create(std::move(c)), bounds(bounds) {
+    ++nLazyPrimitives;
+    primitiveMemory += sizeof(*this);
+}
+
+void LazyPrimitive::SetMemoryBudget(size_t bytes) {
+    LazyGeometryCache::SetBudget(bytes);
+}
+
+std::shared_ptr<const LazyPrimitive::Geometry> LazyPrimitive::createGeometry() const {
+    std::shared_ptr<Geometry> g = std::make_shared<Geometry>();
+    std::vector<Primitive> prims;
+    {
+        // Keep the geometry's buffers out of the shared buffer caches
+        BufferCacheBypass bypass;
+        prims = create(Allocator(&g->arena));
+    }
+    ++nLazyGeometryLoads;
+
+    if (prims.size() == 1)
+        g->primitive = prims[0];
+    else if (!prims.empty()) {
+        g->bvh = new BVHAggregate(std::move(prims), 4);
+        g->primitive = g->bvh;
+    }
+    g->bytes = g->memory.CurrentAllocatedBytes() + (g->bvh ? g->bvh->MemoryBytes() : 0);
+    return g;
+}
+
+std::shared_ptr<const LazyPrimitive::Geometry> LazyPrimitive::getGeometry() const {
+    uint64_t tick = LazyGeometryCache::Tick();
+    if (lastUsed.load(std::memory_order_relaxed) != tick)
+        lastUsed.store(tick, std::memory_order_relaxed);
+    if (std::shared_ptr<const Geometry> g = std::atomic_load(&geometry))
+        return g;
+
+    // Re-create evicted geometry, making sure that only one thread does so
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::shared_ptr<const Geometry> g = std::atomic_load(&geometry))
+        return g;
+    std::shared_ptr<const Geometry> g = createGeometry();
+    std::atomic_store(&geometry, g);
+    LazyGeometryCache::Add(this, g->bytes);
+    return g;
+}
+
+pstd::optional<ShapeIntersection> LazyPrimitive::Intersect(const Ray &r,
+                                                           Float tMax) const {
+    std::shared_ptr<const Geometry> g = getGeometry();
+    if (!g->primitive)
+        return {};
+    return g->primitive.Intersect(r, tMax);
+}
+
+bool LazyPrimitive::IntersectP(const Ray &r, Float tMax) const {
+    std::shared_ptr<const Geometry> g = getGeometry();
+    return g->primitive && g->primitive.IntersectP(r, tMax);
+}
+
 // TransformedPrimitive Method Definitions
 pstd::optional<ShapeIntersection> TransformedPrimitive::Intersect(const Ray &r,
                                                                   Float tMax) const {
@@ -12,11 +12,17 @@
 #include <pbrt/base/medium.h>
 #include <pbrt/base/shape.h>
 #include <pbrt/base/texture.h>
+#include <pbrt/shapes.h>
+#include <pbrt/util/pstd.h>
 #include <pbrt/util/stats.h>
 #include <pbrt/util/taggedptr.h>
 #include <pbrt/util/transform.h>
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace pbrt {
 
@@ -24,15 +30,25 @@ STAT_MEMORY_COUNTER("Memory/Primitives", primitiveMemory);
 
 class SimplePrimitive;
 class GeometricPrimitive;
+class MeshTrianglePrimitive;
 class TransformedPrimitive;
 class AnimatedPrimitive;
 class BVHAggregate;
+class WideBVHAggregate;
 class KdTreeAggregate;
+class InstanceBVHAggregate;
+class TriangleBlockPrimitive;
+class BilinearPatchBlockPrimitive;
+class LazyPrimitive;
+class MotionSegmentAggregate;
 
 // Primitive Definition
 class Primitive
-    : public TaggedPointer<SimplePrimitive, GeometricPrimitive, TransformedPrimitive,
-                           AnimatedPrimitive, BVHAggregate, KdTreeAggregate> {
+    : public TaggedPointer<SimplePrimitive, GeometricPrimitive, MeshTrianglePrimitive,
+                           TransformedPrimitive, AnimatedPrimitive, BVHAggregate,
+                           WideBVHAggregate, KdTreeAggregate, InstanceBVHAggregate,
+                           TriangleBlockPrimitive, BilinearPatchBlockPrimitive,
+                           LazyPrimitive, MotionSegmentAggregate> {
   public:
     // Primitive Interface
     using TaggedPointer::TaggedPointer;
@@ -44,6 +60,31 @@ class Primitive
     bool IntersectP(const Ray &r, Float tMax = Infinity) const;
 };
 
+// DeferredIntersection Definition
+// Tracks the closest intersection found while testing a ray against a series of
+// primitives. Hits with triangles that aren't alpha tested only record their
+// barycentrics, so that the _SurfaceInteraction_ is computed just once, for the
+// closest hit, when Resolve() is called; other primitives' hits are recorded
+// in full.
+class DeferredIntersection {
+  public:
+    // DeferredIntersection Public Methods
+    // Returns the hit's parametric distance if _prim_ is intersected before _tMax_.
+    pstd::optional<Float> Intersect(Primitive prim, const Ray &r, Float tMax);
+
+    // Returns the closest intersection for the ray passed to Intersect().
+    pstd::optional<ShapeIntersection> Resolve(const Ray &r);
+
+  private:
+    // DeferredIntersection Private Members
+    // The triangle's _GeometricPrimitive_, _SimplePrimitive_, or
+    // _MeshTrianglePrimitive_, if the hit is deferred
+    Primitive primitive;
+    const Triangle *triangle = nullptr;
+    TriangleIntersection triIsect;
+    pstd::optional<ShapeIntersection> si;
+};
+
 // GeometricPrimitive Definition
 class GeometricPrimitive {
   public:
@@ -55,13 +96,19 @@ class GeometricPrimitive {
     pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
     bool IntersectP(const Ray &r, Float tMax) const;
 
+    Shape GetShape() const { return shape; }
+
   private:
+    friend class DeferredIntersection;
     // GeometricPrimitive Private Members
     Shape shape;
     Material material;
     Light areaLight;
     MediumInterface mediumInterface;
+    // _alpha_ is cleared for triangles that it is opaque across, and
+    // _transparent_ is set for those that it cuts out entirely.
     FloatTexture alpha;
+    bool transparent = false;
 };
 
 // SimplePrimitive Definition
@@ -73,12 +120,170 @@ class SimplePrimitive {
     bool IntersectP(const Ray &r, Float tMax) const;
     SimplePrimitive(Shape shape, Material material);
 
+    Shape GetShape() const { return shape; }
+
   private:
+    friend class DeferredIntersection;
     // SimplePrimitive Private Members
     Shape shape;
     Material material;
 };
 
+// MeshTrianglePrimitive Definition
+// A triangle of a mesh whose triangles all have the same material and medium
+// interface and have neither an area light nor an alpha texture. Those are
+// stored once for the mesh, indexed by its mesh index, so that each triangle's
+// primitive is just its _Triangle_.
+class MeshTrianglePrimitive {
+  public:
+    // MeshTrianglePrimitive Public Types
+    struct MeshAttributes {
+        Material material;
+        MediumInterface mediumInterface;
+    };
+
+    // MeshTrianglePrimitive Public Methods
+    // Returns primitives for _triangles_, which must all be _Triangle_s from
+    // the same mesh, allocating them together using _alloc_.
+    static std::vector<Primitive> CreatePrimitives(pstd::span<const Shape> triangles,
+                                                   Material material,
+                                                   const MediumInterface &mediumInterface,
+                                                   Allocator alloc);
+
+    MeshTrianglePrimitive(const Triangle &triangle) : triangle(triangle) {}
+
+    Bounds3f Bounds() const { return triangle.Bounds(); }
+    pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
+    bool IntersectP(const Ray &r, Float tMax) const {
+        return triangle.IntersectP(r, tMax);
+    }
+
+    const Triangle *GetTriangle() const { return &triangle; }
+    const MeshAttributes &Attributes() const {
+        return (*meshAttributes)[triangle.MeshIndex()];
+    }
+
+  private:
+    // MeshTrianglePrimitive Private Members
+    Triangle triangle;
+    static std::vector<MeshAttributes> *meshAttributes;
+};
+
+// TriangleBlockPrimitive Definition
+class TriangleBlockPrimitive {
+  public:
+    // TriangleBlockPrimitive Public Constants
+    static constexpr int Width = 4;
+
+    // TriangleBlockPrimitive Public Methods
+    TriangleBlockPrimitive(pstd::span<const Primitive> triangles);
+
+    static bool IsTriangle(Primitive prim);
+
+    Bounds3f Bounds() const;
+    pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
+    pstd::optional<Float> Intersect(const Ray &r, Float tMax,
+                                    DeferredIntersection *isect) const;
+    bool IntersectP(const Ray &r, Float tMax) const;
+
+    // Reloads the triangles' vertices after their mesh's positions have changed.
+    void UpdateVertices();
+
+    pstd::span<const Primitive> Triangles() const {
+        return pstd::span<const Primitive>(triangles, nTriangles);
+    }
+
+  private:
+    // TriangleBlockPrimitive Private Methods
+    int intersectLanes(const Ray &r, Float tMax, Float tHit[Width]) const;
+
+    // TriangleBlockPrimitive Private Members
+    // Vertex positions are stored in SoA layout, indexed by [vertex][axis][lane],
+    // so that the watertight ray-triangle test can run for all lanes at once.
+    Float p[3][3][Width];
+    bool degenerate[Width];
+    Primitive triangles[Width];
+    int nTriangles;
+};
+
+// BilinearPatchBlockPrimitive Definition
+class BilinearPatchBlockPrimitive {
+  public:
+    // BilinearPatchBlockPrimitive Public Constants
+    static constexpr int Width = 4;
+
+    // BilinearPatchBlockPrimitive Public Methods
+    BilinearPatchBlockPrimitive(pstd::span<const Primitive> patches);
+
+    static bool IsBilinearPatch(Primitive prim);
+
+    Bounds3f Bounds() const;
+    pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
+    bool IntersectP(const Ray &r, Float tMax) const;
+
+    // Reloads the patches' vertices after their mesh's positions have changed.
+    void UpdateVertices();
+
+    pstd::span<const Primitive> Patches() const {
+        return pstd::span<const Primitive>(patches, nPatches);
+    }
+
+  private:
+    // BilinearPatchBlockPrimitive Private Methods
+    int intersectLanes(const Ray &r, Float tMax, Float tHit[Width]) const;
+
+    // BilinearPatchBlockPrimitive Private Members
+    // Vertex positions are stored in SoA layout, indexed by [vertex][axis][lane],
+    // along with each patch's ray-independent intersection terms, so that
+    // traversal doesn't need to go through the mesh's vertex indices.
+    Float p[4][3][Width];
+    Float n[3][Width];
+    Float pMax[Width];
+    Primitive patches[Width];
+    int nPatches;
+};
+
+// LazyPrimitive Definition
+// Stands in for the primitives returned by a creation function, which are
+// only kept in memory while their BVH is in use. They are created once up
+// front to find their bounds and are then re-created on demand after being
+// evicted to stay within the budget given to _SetMemoryBudget()_.
+class LazyPrimitive {
+  public:
+    // LazyPrimitive Public Types
+    using CreateFunction = std::function<std::vector<Primitive>(Allocator)>;
+
+    // LazyPrimitive Public Methods
+    LazyPrimitive(CreateFunction create);
+    // Defers creating the geometry until a ray first reaches _bounds_, which
+    // must bound everything that _create_ returns.
+    LazyPrimitive(CreateFunction create, const Bounds3f &bounds);
+
+    // Sets the approximate number of bytes that all _LazyPrimitive_s' geometry
+    // may use; zero means that geometry is never evicted.
+    static void SetMemoryBudget(size_t bytes);
+
+    Bounds3f Bounds() const { return bounds; }
+    pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
+    bool IntersectP(const Ray &r, Float tMax) const;
+
+  private:
+    // LazyPrimitive Private Types
+    struct Geometry;
+    friend class LazyGeometryCache;
+
+    // LazyPrimitive Private Methods
+    std::shared_ptr<const Geometry> getGeometry() const;
+    std::shared_ptr<const Geometry> createGeometry() const;
+
+    // LazyPrimitive Private Members
+    CreateFunction create;
+    Bounds3f bounds;
+    mutable std::mutex mutex;
+    mutable std::shared_ptr<const Geometry> geometry;
+    mutable std::atomic<uint64_t> lastUsed{0};
+};
+
 // TransformedPrimitive Definition
 class TransformedPrimitive {
   public:
@@ -107,10 +312,17 @@ class AnimatedPrimitive {
         return renderFromPrimitive.MotionBounds(primitive.Bounds());
     }
 
+    // Returns bounds of the primitive's motion between _time0_ and _time1_
+    Bounds3f Bounds(Float time0, Float time1) const {
+        return renderFromPrimitive.MotionBounds(primitive.Bounds(), time0, time1);
+    }
+
     AnimatedPrimitive(Primitive primitive, const AnimatedTransform &renderFromPrimitive);
     pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
     bool IntersectP(const Ray &r, Float tMax) const;
 
+    const AnimatedTransform &RenderFromPrimitive() const { return renderFromPrimitive; }
+
   private:
     // AnimatedPrimitive Private Members
     Primitive primitive;
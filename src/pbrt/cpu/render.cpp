@@ -12,18 +12,23 @@
 #include <pbrt/lights.h>
 #include <pbrt/materials.h>
 #include <pbrt/media.h>
+#include <pbrt/parser.h>
 #include <pbrt/samplers.h>
 #include <pbrt/scene.h>
 #include <pbrt/shapes.h>
 #include <pbrt/textures.h>
 #include <pbrt/util/colorspace.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/parallel.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/stats.h>
 
 namespace pbrt {
 
 void RenderCPU(BasicScene &parsedScene) {
     Allocator alloc;
     ThreadLocal<Allocator> threadAllocators([]() { return Allocator(); });
+    Timer sceneTimer;
 
     // Create media first (so have them for the camera...)
     std::map<std::string, Medium> media = parsedScene.CreateMedia();
@@ -44,8 +49,11 @@ void RenderCPU(BasicScene &parsedScene) {
     parsedScene.CreateMaterials(textures, &namedMaterials, &materials);
     LOG_VERBOSE("Finished materials");
 
+    Timer aggregateTimer;
     Primitive accel = parsedScene.CreateAggregate(textures, shapeIndexToAreaLights, media,
                                                   namedMaterials, materials);
+    StatsReportBenchmarkPhase(BenchmarkPhase::AggregateBuild,
+                              aggregateTimer.ElapsedSeconds());
 
     Camera camera = parsedScene.GetCamera();
     Film film = camera.GetFilm();
@@ -88,6 +96,22 @@ void RenderCPU(BasicScene &parsedScene) {
                 "other than R, G, B will be zero.",
                 parsedScene.integrator.name);
 
+    if (Options->sampleRange && !film.Is<RGBFilm>())
+        ErrorExit("--sample-range requires the \"rgb\" film.");
+
+    if (!Options->coordinatorPort.empty() || !Options->coordinatorAddress.empty()) {
+        // Only the film's sums for each tile are merged
+        const std::string &name = parsedScene.integrator.name;
+        if (!film.Is<RGBFilm>())
+            ErrorExit("Distributed rendering requires the \"rgb\" film.");
+        if (name == "bdpt" || name == "lightpath" || name == "mlt" || name == "sppm" ||
+            name == "function")
+            ErrorExit("The \"%s\" integrator doesn't support distributed rendering.",
+                      name);
+        if (parsedScene.NumViews() > 0)
+            ErrorExit("Distributed rendering doesn't support multiple cameras.");
+    }
+
     bool haveSubsurface = false;
     for (pbrt::Material mtl : materials)
         haveSubsurface |= mtl && mtl.HasSubsurfaceScattering();
@@ -101,6 +125,7 @@ void RenderCPU(BasicScene &parsedScene) {
                 parsedScene.integrator.name);
 
     LOG_VERBOSE("Memory used after scene creation: %d", GetCurrentRSS());
+    StatsReportBenchmarkPhase(BenchmarkPhase::SceneCreation, sceneTimer.ElapsedSeconds());
 
     if (Options->pixelMaterial) {
         SampledWavelengths lambda = SampledWavelengths::SampleUniform(0.5f);
@@ -156,8 +181,47 @@ void RenderCPU(BasicScene &parsedScene) {
     }
 
     // Render!
+    Timer renderTimer;
     integrator->Render();
 
+    // Render the scene's additional views, reusing its aggregate, lights,
+    // and textures along with the sampler
+    for (int view = 0; view < parsedScene.NumViews(); ++view) {
+        integrator.reset();
+        Camera viewCamera = parsedScene.CreateViewCamera(view);
+        integrator = parsedScene.CreateIntegrator(viewCamera, sampler, accel, lights);
+        if (!Options->quiet)
+            Printf("Rendering camera %d of %d to \"%s\"\n", view + 2,
+                   parsedScene.NumViews() + 1, viewCamera.GetFilm().GetFilename());
+        integrator->Render();
+        integrator.reset();
+        parsedScene.ReleaseViewCamera(viewCamera);
+    }
+
+    // Render the frames of the animation, if any. Each one's integrator
+    // creates its light sampler for the frame's geometry.
+    for (int frame = 1; !Options->framePattern.empty(); ++frame) {
+        std::string filename = StringPrintf(Options->framePattern.c_str(), frame);
+        if (!FileExists(filename))
+            break;
+        BasicScene frameScene;
+        BasicSceneBuilder builder(&frameScene,
+                                  camera.GetCameraTransform().RenderFromWorld());
+        ParseFiles(&builder, pstd::span<const std::string>(&filename, 1));
+
+        integrator.reset();
+        accel = parsedScene.ApplyFrame(frameScene, textures);
+        Camera frameCamera = parsedScene.CreateFrameCamera(frameScene, frame);
+        integrator = parsedScene.CreateIntegrator(frameCamera, sampler, accel, lights);
+        if (!Options->quiet)
+            Printf("Rendering frame %d from \"%s\" to \"%s\"\n", frame, filename,
+                   frameCamera.GetFilm().GetFilename());
+        integrator->Render();
+        integrator.reset();
+        parsedScene.ReleaseViewCamera(frameCamera);
+    }
+    StatsReportBenchmarkPhase(BenchmarkPhase::Render, renderTimer.ElapsedSeconds());
+
     LOG_VERBOSE("Memory used after rendering: %s", GetCurrentRSS());
 
     PtexTextureBase::ReportStats();
@@ -62,6 +62,46 @@ std::string Film::GetFilename() const {
     return DispatchCPU(get);
 }
 
+void Film::SetFilename(const std::string &filename) {
+    auto set = [&](auto ptr) { ptr->SetFilename(filename); };
+    DispatchCPU(set);
+}
+
+std::string Film::SerializePixels() const {
+    auto serialize = [&](auto ptr) { return ptr->SerializePixels(); };
+    return DispatchCPU(serialize);
+}
+
+bool Film::DeserializePixels(const std::string &state) {
+    auto deserialize = [&](auto ptr) { return ptr->DeserializePixels(state); };
+    return DispatchCPU(deserialize);
+}
+
+std::string Film::SerializePixels(const Bounds2i &bounds) const {
+    CHECK(Is<RGBFilm>());
+    return Cast<RGBFilm>()->SerializePixels(bounds);
+}
+
+bool Film::AddPixels(const Bounds2i &bounds, const std::string &state) {
+    CHECK(Is<RGBFilm>());
+    return Cast<RGBFilm>()->AddPixels(bounds, state);
+}
+
+void Film::FlushSplats() {
+    auto flush = [&](auto ptr) { return ptr->FlushSplats(); };
+    return DispatchCPU(flush);
+}
+
+void Film::BeginTile(Bounds2i tileBounds) {
+    auto begin = [&](auto ptr) { return ptr->BeginTile(tileBounds); };
+    return DispatchCPU(begin);
+}
+
+void Film::EndTile() {
+    auto end = [&](auto ptr) { return ptr->EndTile(); };
+    return DispatchCPU(end);
+}
+
 // FilmBaseParameters Method Definitions
 FilmBaseParameters::FilmBaseParameters(const ParameterDictionary &parameters,
                                        Filter filter, const PixelSensor *sensor,
@@ -256,6 +296,18 @@ PixelSensor *PixelSensor::CreateDefault(Allocator alloc) {
     return Create(ParameterDictionary(), RGBColorSpace::sRGB, 1.0, nullptr, alloc);
 }
 
+pstd::vector<Float> PixelSensor::ResponseTable(const SquareMatrix<3> &m,
+                                               Allocator alloc) const {
+    pstd::vector<Float> table(4 * (Lambda_max - Lambda_min + 1), alloc);
+    for (int lambda = Lambda_min; lambda <= Lambda_max; ++lambda) {
+        RGB rgb = m * RGB(r_bar(lambda), g_bar(lambda), b_bar(lambda));
+        for (int c = 0; c < 3; ++c)
+            table[4 * (lambda - Lambda_min) + c] =
+                imagingRatio * rgb[c] / NSpectrumSamples;
+    }
+    return table;
+}
+
 // Swatch reflectances are taken from Danny Pascale's Macbeth chart measurements
 // BabelColor ColorChecker data: Copyright (c) 2004-2012 Danny Pascale
 // (www.babelcolor.com); used by permission.
@@ -479,6 +531,8 @@ Spectrum PixelSensor::swatchReflectances[nSwatchReflectances]{
         false, Allocator())};
 
 STAT_MEMORY_COUNTER("Memory/Film pixels", filmPixelMemory);
+STAT_MEMORY_COUNTER("Memory/GBufferFilm compact auxiliary channel savings",
+                    gBufferMemorySaved);
 
 // RGBFilm Method Definitions
 RGBFilm::RGBFilm(FilmBaseParameters p, const RGBColorSpace *colorSpace,
@@ -487,15 +541,79 @@ RGBFilm::RGBFilm(FilmBaseParameters p, const RGBColorSpace *colorSpace,
       pixels(p.pixelBounds, alloc),
       colorSpace(colorSpace),
       maxComponentValue(maxComponentValue),
-      writeFP16(writeFP16) {
+      writeFP16(writeFP16),
+      outputRGBResponse(alloc),
+      splatCaches(new ThreadLocal<SplatTileCache>) {
+    static std::atomic<uint64_t> nextSplatCachesId{1};
+    splatCachesId = nextSplatCachesId++;
     filterIntegral = filter.Integral();
     CHECK(!pixelBounds.IsEmpty());
     CHECK(colorSpace);
     filmPixelMemory += pixelBounds.Area() * sizeof(Pixel);
+    NumaInterleave(pixels.begin(), pixelBounds.Area() * sizeof(Pixel));
     // Compute _outputRGBFromSensorRGB_ matrix
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
+    outputRGBResponse = sensor->ResponseTable(outputRGBFromSensorRGB, alloc);
 }
 
+// RGBFilm::SplatTileCache Definition
+// Per-thread buffer of the splats in a few tiles of the film. A tile's splats
+// are added to the film's pixels when another tile takes its slot or when the
+// film's splats are flushed, so that threads rarely contend for the pixels'
+// atomics. Tiles are mapped to slots by their position modulo an 8x8 grid of
+// tiles, so nearby splats never evict each other.
+struct RGBFilm::SplatTileCache {
+    // RGBFilm::SplatTileCache Public Methods
+    void Add(Vector2i offset, const RGB &rgb, Array2D<Pixel> &pixels, Point2i pMin) {
+        Point2i tileIndex(offset.x / TileSize, offset.y / TileSize);
+        Tile &tile = tiles[tileIndex.x % 8 + 8 * (tileIndex.y % 8)];
+        if (!tile.used || tile.index != tileIndex) {
+            Flush(tile, pixels, pMin);
+            tile.index = tileIndex;
+            tile.used = true;
+        }
+        double *splat = tile.rgb[(offset.y % TileSize) * TileSize + offset.x % TileSize];
+        for (int c = 0; c < 3; ++c)
+            splat[c] += rgb[c];
+    }
+
+    void FlushAll(Array2D<Pixel> &pixels, Point2i pMin) {
+        for (Tile &tile : tiles)
+            Flush(tile, pixels, pMin);
+    }
+
+  private:
+    // RGBFilm::SplatTileCache Private Types
+    static constexpr int TileSize = 16;
+    struct Tile {
+        Point2i index;
+        bool used = false;
+        double rgb[TileSize * TileSize][3] = {};
+    };
+
+    // RGBFilm::SplatTileCache Private Methods
+    static void Flush(Tile &tile, Array2D<Pixel> &pixels, Point2i pMin) {
+        if (!tile.used)
+            return;
+        // Only pixels inside the film have nonzero splats
+        for (int i = 0; i < TileSize * TileSize; ++i) {
+            double *splat = tile.rgb[i];
+            if (splat[0] == 0 && splat[1] == 0 && splat[2] == 0)
+                continue;
+            Point2i p = pMin + TileSize * Vector2i(tile.index) +
+                        Vector2i(i % TileSize, i / TileSize);
+            for (int c = 0; c < 3; ++c) {
+                pixels[p].rgbSplat[c].Add(splat[c]);
+                splat[c] = 0;
+            }
+        }
+        tile.used = false;
+    }
+
+    // RGBFilm::SplatTileCache Private Members
+    std::vector<Tile> tiles = std::vector<Tile>(64);
+};
+
 PBRT_CPU_GPU void RGBFilm::AddSplat(Point2f p, SampledSpectrum L, const SampledWavelengths &lambda) {
     CHECK(!L.HasNaNs());
     // Convert sample radiance to _PixelSensor_ RGB
@@ -513,49 +631,125 @@ PBRT_CPU_GPU void RGBFilm::AddSplat(Point2f p, SampledSpectrum L, const SampledW
                          Point2i(Floor(pDiscrete + radius)) + Vector2i(1, 1));
     splatBounds = Intersect(splatBounds, pixelBounds);
 
+#ifndef PBRT_IS_GPU_CODE
+    // Find this thread's splat cache, avoiding the lock in ThreadLocal::Get()
+    // when the thread last splatted into this film
+    thread_local uint64_t threadCachesId = 0;
+    thread_local SplatTileCache *threadCache = nullptr;
+    if (threadCachesId != splatCachesId) {
+        threadCache = &splatCaches->Get();
+        threadCachesId = splatCachesId;
+    }
+    SplatTileCache &cache = *threadCache;
+#endif
     for (Point2i pi : splatBounds) {
         // Evaluate filter at _pi_ and add splat contribution
         Float wt = filter.Evaluate(Point2f(p - pi - Vector2f(0.5, 0.5)));
         if (wt != 0) {
+#ifdef PBRT_IS_GPU_CODE
             Pixel &pixel = pixels[pi];
             for (int i = 0; i < 3; ++i)
                 pixel.rgbSplat[i].Add(wt * rgb[i]);
+#else
+            cache.Add(pi - pixelBounds.pMin, wt * rgb, pixels, pixelBounds.pMin);
+#endif
         }
     }
 }
 
+void RGBFilm::FlushSplats() {
+    splatCaches->ForAll(
+        [&](SplatTileCache &cache) { cache.FlushAll(pixels, pixelBounds.pMin); });
+}
+
+thread_local RGBFilm::SampleTile *RGBFilm::threadSampleTile = nullptr;
+
+void RGBFilm::BeginTile(Bounds2i tileBounds) {
+    CHECK(!threadSampleTile);
+    thread_local SampleTile tile;
+    tile.film = this;
+    tile.bounds = Intersect(tileBounds, pixelBounds);
+    tile.width = tile.bounds.pMax.x - tile.bounds.pMin.x;
+    tile.pixels.assign(tile.bounds.Area(), SampleTile::Pixel{});
+    threadSampleTile = &tile;
+}
+
+void RGBFilm::EndTile() {
+    SampleTile *tile = threadSampleTile;
+    CHECK(tile && tile->film == this);
+    // Only this thread adds samples to the tile's pixels
+    for (Point2i p : tile->bounds) {
+        Vector2i offset = p - tile->bounds.pMin;
+        const SampleTile::Pixel &tilePixel =
+            tile->pixels[offset.y * tile->width + offset.x];
+        Pixel &pixel = pixels[p];
+        for (int c = 0; c < 3; ++c)
+            pixel.rgbSum[c] += tilePixel.rgbSum[c];
+        pixel.weightSum += tilePixel.weightSum;
+    }
+    threadSampleTile = nullptr;
+}
+
 void RGBFilm::WriteImage(ImageMetadata metadata, Float splatScale) {
-    Image image = GetImage(&metadata, splatScale);
-    LOG_VERBOSE("Writing image %s with bounds %s", filename, pixelBounds);
-    image.Write(filename, metadata);
+    if (!HasExtension(filename, "exr")) {
+        Image image = GetImage(&metadata, splatScale);
+        LOG_VERBOSE("Writing image %s with bounds %s", filename, pixelBounds);
+        image.Write(filename, metadata);
+        return;
+    }
+
+    // Convert and write the image one band of scanlines at a time so that
+    // large images don't need memory for a copy of the film
+    FlushSplats();
+    LOG_VERBOSE("Writing image %s with bounds %s in bands", filename, pixelBounds);
+    metadata.pixelBounds = pixelBounds;
+    metadata.fullResolution = fullResolution;
+    metadata.colorSpace = colorSpace;
+    int nClamped = 0;
+    Image::WriteEXRBands(filename, writeFP16 ? PixelFormat::Half : PixelFormat::Float,
+                         Point2i(pixelBounds.Diagonal()), {"R", "G", "B"}, metadata,
+                         [&](Image &band, int yStart) {
+                             nClamped += GetImageRows(&band, yStart, splatScale);
+                         });
+    if (nClamped > 0)
+        Warning("%d pixel values clamped to maximum fp16 value.", nClamped);
+}
+
+int RGBFilm::GetImageRows(Image *image, int yStart, Float splatScale) const {
+    int nRows = std::min(image->Resolution().y, pixelBounds.pMax.y - pixelBounds.pMin.y -
+                                                    yStart);
+    std::atomic<int> nClamped{0};
+    ParallelFor(0, nRows, [&](int64_t y) {
+        for (int x = 0; x < image->Resolution().x; ++x) {
+            Point2i p = pixelBounds.pMin + Vector2i(x, yStart + y);
+            RGB rgb = GetPixelRGB(p, splatScale);
+
+            if (writeFP16 && std::max({rgb.r, rgb.g, rgb.b}) > 65504) {
+                if (rgb.r > 65504)
+                    rgb.r = 65504;
+                if (rgb.g > 65504)
+                    rgb.g = 65504;
+                if (rgb.b > 65504)
+                    rgb.b = 65504;
+                ++nClamped;
+            }
+
+            image->SetChannels({x, int(y)}, {rgb[0], rgb[1], rgb[2]});
+        }
+    });
+    return nClamped;
 }
 
 Image RGBFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
+    FlushSplats();
     // Convert image to RGB and compute final pixel values
     LOG_VERBOSE("Converting image to RGB and computing final weighted pixel values");
     PixelFormat format = writeFP16 ? PixelFormat::Half : PixelFormat::Float;
     Image image(format, Point2i(pixelBounds.Diagonal()), {"R", "G", "B"});
 
-    std::atomic<int> nClamped{0};
-    ParallelFor2D(pixelBounds, [&](Point2i p) {
-        RGB rgb = GetPixelRGB(p, splatScale);
-
-        if (writeFP16 && std::max({rgb.r, rgb.g, rgb.b}) > 65504) {
-            if (rgb.r > 65504)
-                rgb.r = 65504;
-            if (rgb.g > 65504)
-                rgb.g = 65504;
-            if (rgb.b > 65504)
-                rgb.b = 65504;
-            ++nClamped;
-        }
-
-        Point2i pOffset(p.x - pixelBounds.pMin.x, p.y - pixelBounds.pMin.y);
-        image.SetChannels(pOffset, {rgb[0], rgb[1], rgb[2]});
-    });
-
-    if (nClamped.load() > 0)
-        Warning("%d pixel values clamped to maximum fp16 value.", nClamped.load());
+    int nClamped = GetImageRows(&image, 0, splatScale);
+    if (nClamped > 0)
+        Warning("%d pixel values clamped to maximum fp16 value.", nClamped);
 
     metadata->pixelBounds = pixelBounds;
     metadata->fullResolution = fullResolution;
@@ -564,6 +758,69 @@ Image RGBFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
     return image;
 }
 
+std::string RGBFilm::SerializePixels() const {
+    // Pixels are trivially copyable apart from their atomic splats, which
+    // aren't being updated when this is called; buffered splats must have
+    // been flushed already.
+    return std::string((const char *)pixels.begin(), pixels.size() * sizeof(Pixel));
+}
+
+bool RGBFilm::DeserializePixels(const std::string &state) {
+    if (state.size() != pixels.size() * sizeof(Pixel))
+        return false;
+    std::memcpy((void *)pixels.begin(), state.data(), state.size());
+    return true;
+}
+
+std::string RGBFilm::SerializePixels(const Bounds2i &bounds) const {
+    // Each pixel is sent as its seven sums, in full precision so that adding
+    // them to another film's pixels is exact
+    std::string state;
+    state.reserve(bounds.Area() * 7 * sizeof(double));
+    for (Point2i p : bounds) {
+        const Pixel &pixel = pixels[p];
+        double values[7] = {pixel.rgbSum[0],   pixel.rgbSum[1],   pixel.rgbSum[2],
+                            pixel.weightSum,   pixel.rgbSplat[0], pixel.rgbSplat[1],
+                            pixel.rgbSplat[2]};
+        state.append((const char *)values, sizeof(values));
+    }
+    return state;
+}
+
+bool RGBFilm::AddPixels(const Bounds2i &bounds, const std::string &state) {
+    if (!Inside(bounds, pixelBounds) ||
+        state.size() != bounds.Area() * 7 * sizeof(double))
+        return false;
+    const char *ptr = state.data();
+    for (Point2i p : bounds) {
+        double values[7];
+        std::memcpy(values, ptr, sizeof(values));
+        ptr += sizeof(values);
+        Pixel &pixel = pixels[p];
+        for (int c = 0; c < 3; ++c) {
+            pixel.rgbSum[c] += values[c];
+            pixel.rgbSplat[c].Add(values[4 + c]);
+        }
+        pixel.weightSum += values[3];
+    }
+    return true;
+}
+
+RGBFilmDump RGBFilm::GetDump(int sampleStart, int sampleEnd) {
+    FlushSplats();
+    RGBFilmDump dump;
+    dump.pixelBounds = pixelBounds;
+    dump.fullResolution = fullResolution;
+    dump.sampleRanges.push_back(std::make_pair(sampleStart, sampleEnd));
+    dump.filterIntegral = filterIntegral;
+    dump.outputRGBFromSensorRGB = outputRGBFromSensorRGB;
+    dump.colorSpace = colorSpace;
+    std::string state = SerializePixels(pixelBounds);
+    dump.pixels.resize(state.size() / sizeof(double));
+    std::memcpy(dump.pixels.data(), state.data(), state.size());
+    return dump;
+}
+
 std::string RGBFilm::ToString() const {
     return StringPrintf(
         "[ RGBFilm %s colorSpace: %s maxComponentValue: %f writeFP16: %s ]",
@@ -584,6 +841,140 @@ RGBFilm *RGBFilm::Create(const ParameterDictionary &parameters, Float exposureTi
                                      writeFP16, alloc);
 }
 
+// RGBFilmDumpHeader Definition
+// Stored at the start of film dump files, followed by the sample ranges as
+// pairs of 32-bit integers and then the pixels' sums.
+struct RGBFilmDumpHeader {
+    char magic[8] = {'p', 'b', 'r', 't', 'f', 'l', 'm', '1'};
+    int32_t pixelBounds[4], fullResolution[2];
+    int32_t nSampleRanges;
+    float filterIntegral;
+    float outputRGBFromSensorRGB[9];
+    // The output color space's primaries and white point
+    float primaries[8];
+};
+
+// RGBFilmDump Method Definitions
+bool RGBFilmDump::Write(const std::string &filename) const {
+    RGBFilmDumpHeader header;
+    for (int i = 0; i < 2; ++i) {
+        header.pixelBounds[i] = pixelBounds.pMin[i];
+        header.pixelBounds[2 + i] = pixelBounds.pMax[i];
+        header.fullResolution[i] = fullResolution[i];
+    }
+    header.nSampleRanges = sampleRanges.size();
+    header.filterIntegral = filterIntegral;
+    for (int i = 0; i < 9; ++i)
+        header.outputRGBFromSensorRGB[i] = outputRGBFromSensorRGB[i / 3][i % 3];
+    Point2f primaries[4] = {colorSpace->r, colorSpace->g, colorSpace->b, colorSpace->w};
+    for (int i = 0; i < 4; ++i) {
+        header.primaries[2 * i] = primaries[i].x;
+        header.primaries[2 * i + 1] = primaries[i].y;
+    }
+
+    std::string contents((const char *)&header, sizeof(header));
+    for (const std::pair<int, int> &range : sampleRanges)
+        for (int32_t v : {range.first, range.second})
+            contents.append((const char *)&v, sizeof(v));
+    contents.append((const char *)pixels.data(), pixels.size() * sizeof(double));
+    return WriteFileContents(filename, contents);
+}
+
+pstd::optional<RGBFilmDump> RGBFilmDump::Read(const std::string &filename) {
+    std::string contents = ReadFileContents(filename);
+    RGBFilmDumpHeader header, expected;
+    if (contents.size() < sizeof(header)) {
+        Error("%s: file is too small to be a film dump.", filename);
+        return {};
+    }
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+        Error("%s: not a film dump.", filename);
+        return {};
+    }
+
+    RGBFilmDump dump;
+    dump.pixelBounds =
+        Bounds2i(Point2i(header.pixelBounds[0], header.pixelBounds[1]),
+                 Point2i(header.pixelBounds[2], header.pixelBounds[3]));
+    dump.fullResolution = Point2i(header.fullResolution[0], header.fullResolution[1]);
+    size_t rangeBytes = size_t(std::max(0, header.nSampleRanges)) * 2 * sizeof(int32_t);
+    size_t pixelBytes = size_t(dump.pixelBounds.Area()) * 7 * sizeof(double);
+    if (dump.pixelBounds.IsEmpty() ||
+        contents.size() != sizeof(header) + rangeBytes + pixelBytes) {
+        Error("%s: film dump is corrupt.", filename);
+        return {};
+    }
+    const char *ptr = contents.data() + sizeof(header);
+    for (int i = 0; i < header.nSampleRanges; ++i) {
+        int32_t range[2];
+        std::memcpy(range, ptr, sizeof(range));
+        ptr += sizeof(range);
+        dump.sampleRanges.push_back(std::make_pair(range[0], range[1]));
+    }
+    dump.filterIntegral = header.filterIntegral;
+    for (int i = 0; i < 9; ++i)
+        dump.outputRGBFromSensorRGB[i / 3][i % 3] = header.outputRGBFromSensorRGB[i];
+    const float *p = header.primaries;
+    dump.colorSpace = RGBColorSpace::Create(Point2f(p[0], p[1]), Point2f(p[2], p[3]),
+                                            Point2f(p[4], p[5]), Point2f(p[6], p[7]), {});
+    if (!dump.colorSpace) {
+        Error("%s: film dump has an unknown color space.", filename);
+        return {};
+    }
+    dump.pixels.resize(pixelBytes / sizeof(double));
+    std::memcpy(dump.pixels.data(), ptr, pixelBytes);
+    return dump;
+}
+
+bool RGBFilmDump::Merge(const RGBFilmDump &dump) {
+    if (dump.pixelBounds != pixelBounds || dump.fullResolution != fullResolution ||
+        dump.filterIntegral != filterIntegral ||
+        dump.outputRGBFromSensorRGB != outputRGBFromSensorRGB ||
+        *dump.colorSpace != *colorSpace || dump.pixels.size() != pixels.size())
+        return false;
+    for (const std::pair<int, int> &a : dump.sampleRanges)
+        for (const std::pair<int, int> &b : sampleRanges)
+            if (a.first < b.second && b.first < a.second)
+                return false;
+
+    sampleRanges.insert(sampleRanges.end(), dump.sampleRanges.begin(),
+                        dump.sampleRanges.end());
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] += dump.pixels[i];
+    return true;
+}
+
+int RGBFilmDump::SampleCount() const {
+    int count = 0;
+    for (const std::pair<int, int> &range : sampleRanges)
+        count += range.second - range.first;
+    return count;
+}
+
+Image RGBFilmDump::GetImage(ImageMetadata *metadata) const {
+    // Compute final pixel values as RGBFilm::GetPixelRGB() does
+    Image image(PixelFormat::Float, Point2i(pixelBounds.Diagonal()), {"R", "G", "B"});
+    Float splatScale = 1.f / std::max(1, SampleCount());
+    for (int y = 0; y < image.Resolution().y; ++y)
+        for (int x = 0; x < image.Resolution().x; ++x) {
+            const double *sums = &pixels[7 * (y * image.Resolution().x + x)];
+            RGB rgb(sums[0], sums[1], sums[2]);
+            if (sums[3] != 0)
+                rgb /= sums[3];
+            for (int c = 0; c < 3; ++c)
+                rgb[c] += splatScale * sums[4 + c] / filterIntegral;
+            rgb = outputRGBFromSensorRGB * rgb;
+            image.SetChannels({x, y}, {rgb[0], rgb[1], rgb[2]});
+        }
+
+    metadata->pixelBounds = pixelBounds;
+    metadata->fullResolution = fullResolution;
+    metadata->colorSpace = colorSpace;
+    metadata->samplesPerPixel = SampleCount();
+    return image;
+}
+
 // GBufferFilm Method Definitions
 PBRT_CPU_GPU void GBufferFilm::AddSample(Point2i pFilm, SampledSpectrum L,
                             const SampledWavelengths &lambda,
@@ -595,44 +986,79 @@ PBRT_CPU_GPU void GBufferFilm::AddSample(Point2i pFilm, SampledSpectrum L,
 
     Pixel &p = pixels[pFilm];
     if (visibleSurface && *visibleSurface) {
+        Float prevGBufferWeightSum = p.gBufferWeightSum;
         p.gBufferWeightSum += weight;
 
-        // Update variance estimates.
-        for (int c = 0; c < 3; ++c)
-            p.rgbVariance[c].Add(rgb[c]);
-
+        // Transform the visible surface's geometry to the output space
+        Point3f pOut;
+        Normal3f n, ns;
+        Float dzdx, dzdy;
+        Float time = visibleSurface->time;
         if (applyInverse) {
-            p.pSum += weight * outputFromRender.ApplyInverse(visibleSurface->p,
-                                                             visibleSurface->time);
-            p.nSum += weight * outputFromRender.ApplyInverse(visibleSurface->n,
-                                                             visibleSurface->time);
-            p.nsSum += weight * outputFromRender.ApplyInverse(visibleSurface->ns,
-                                                              visibleSurface->time);
-            p.dzdxSum +=
-                weight *
-                outputFromRender.ApplyInverse(visibleSurface->dpdx, visibleSurface->time)
-                    .z;
-            p.dzdySum +=
-                weight *
-                outputFromRender.ApplyInverse(visibleSurface->dpdy, visibleSurface->time)
-                    .z;
+            pOut = outputFromRender.ApplyInverse(visibleSurface->p, time);
+            n = outputFromRender.ApplyInverse(visibleSurface->n, time);
+            ns = outputFromRender.ApplyInverse(visibleSurface->ns, time);
+            dzdx = outputFromRender.ApplyInverse(visibleSurface->dpdx, time).z;
+            dzdy = outputFromRender.ApplyInverse(visibleSurface->dpdy, time).z;
         } else {
-            p.pSum += weight * outputFromRender(visibleSurface->p, visibleSurface->time);
-            p.nSum += weight * outputFromRender(visibleSurface->n, visibleSurface->time);
-            p.nsSum +=
-                weight * outputFromRender(visibleSurface->ns, visibleSurface->time);
-            p.dzdxSum +=
-                weight * outputFromRender(visibleSurface->dpdx, visibleSurface->time).z;
-            p.dzdySum +=
-                weight * outputFromRender(visibleSurface->dpdy, visibleSurface->time).z;
+            pOut = outputFromRender(visibleSurface->p, time);
+            n = outputFromRender(visibleSurface->n, time);
+            ns = outputFromRender(visibleSurface->ns, time);
+            dzdx = outputFromRender(visibleSurface->dpdx, time).z;
+            dzdy = outputFromRender(visibleSurface->dpdy, time).z;
         }
-        p.uvSum += weight * visibleSurface->uv;
+        Point2f uv = visibleSurface->uv;
 
         SampledSpectrum albedo =
             visibleSurface->albedo * colorSpace->illuminant.Sample(lambda);
         RGB albedoRGB = albedo.ToRGB(lambda, *colorSpace);
-        for (int c = 0; c < 3; ++c)
-            p.rgbAlbedoSum[c] += weight * albedoRGB[c];
+
+        if (auxStorage == AuxStorage::Float) {
+            AuxPixel &aux = auxPixels[pFilm];
+            // Update variance estimates.
+            for (int c = 0; c < 3; ++c)
+                aux.rgbVariance[c].Add(rgb[c]);
+
+            aux.pSum += weight * pOut;
+            aux.nSum += weight * n;
+            aux.nsSum += weight * ns;
+            aux.dzdxSum += weight * dzdx;
+            aux.dzdySum += weight * dzdy;
+            aux.uvSum += weight * uv;
+            for (int c = 0; c < 3; ++c)
+                aux.rgbAlbedoSum[c] += weight * albedoRGB[c];
+        } else {
+            CompactAuxPixel &aux = compactAuxPixels[pFilm];
+            ++aux.nSamples;
+            for (int c = 0; c < 3; ++c) {
+                float delta = rgb[c] - aux.rgbMean[c];
+                aux.rgbMean[c] += delta / aux.nSamples;
+                aux.rgbS[c] += delta * (rgb[c] - aux.rgbMean[c]);
+            }
+
+            // Move the stored values toward the sample's by its share of
+            // the weight, or only record the first sample's
+            Float t = 0;
+            if (prevGBufferWeightSum == 0)
+                t = 1;
+            else if (auxStorage == AuxStorage::Half && p.gBufferWeightSum > 0)
+                t = weight / p.gBufferWeightSum;
+            if (t > 0) {
+                auto update = [t](Half &h, Float v) {
+                    h = Half(Float(h) + t * (v - Float(h)));
+                };
+                for (int i = 0; i < 3; ++i) {
+                    update(aux.p[i], pOut[i]);
+                    update(aux.n[i], n[i]);
+                    update(aux.ns[i], ns[i]);
+                    update(aux.albedo[i], albedoRGB[i]);
+                }
+                update(aux.dzdx, dzdx);
+                update(aux.dzdy, dzdy);
+                update(aux.uv[0], uv[0]);
+                update(aux.uv[1], uv[1]);
+            }
+        }
     }
 
     for (int c = 0; c < 3; ++c)
@@ -642,18 +1068,39 @@ PBRT_CPU_GPU void GBufferFilm::AddSample(Point2i pFilm, SampledSpectrum L,
 
 GBufferFilm::GBufferFilm(FilmBaseParameters p, const AnimatedTransform &outputFromRender,
                          bool applyInverse, const RGBColorSpace *colorSpace,
-                         Float maxComponentValue, bool writeFP16, Allocator alloc)
+                         Float maxComponentValue, bool writeFP16, AuxStorage auxStorage,
+                         Allocator alloc)
     : FilmBase(p),
       outputFromRender(outputFromRender),
       applyInverse(applyInverse),
+      auxStorage(auxStorage),
       pixels(pixelBounds, alloc),
+      auxPixels(alloc),
+      compactAuxPixels(alloc),
       colorSpace(colorSpace),
       maxComponentValue(maxComponentValue),
       writeFP16(writeFP16),
-      filterIntegral(filter.Integral()) {
+      filterIntegral(filter.Integral()),
+      outputRGBResponse(alloc) {
     CHECK(!pixelBounds.IsEmpty());
-    filmPixelMemory += pixelBounds.Area() * sizeof(Pixel);
+    NumaInterleave(pixels.begin(), pixelBounds.Area() * sizeof(Pixel));
+    if (auxStorage == AuxStorage::Float) {
+        auxPixels = Array2D<AuxPixel>(pixelBounds, alloc);
+        NumaInterleave(auxPixels.begin(), pixelBounds.Area() * sizeof(AuxPixel));
+    } else {
+        compactAuxPixels =
+            Array2D<CompactAuxPixel>(pixelBounds, CompactAuxPixel{}, alloc);
+        NumaInterleave(compactAuxPixels.begin(),
+                       pixelBounds.Area() * sizeof(CompactAuxPixel));
+        gBufferMemorySaved +=
+            pixelBounds.Area() * (sizeof(AuxPixel) - sizeof(CompactAuxPixel));
+    }
+    filmPixelMemory += pixelBounds.Area() * BytesPerPixel();
+    LOG_VERBOSE("GBufferFilm uses %d bytes per pixel (%d with full-precision auxiliary "
+                "channels)",
+                BytesPerPixel(), sizeof(Pixel) + sizeof(AuxPixel));
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
+    outputRGBResponse = sensor->ResponseTable(outputRGBFromSensorRGB, alloc);
 }
 
 PBRT_CPU_GPU void GBufferFilm::AddSplat(Point2f p, SampledSpectrum v,
@@ -733,23 +1180,60 @@ Image GBufferFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
     ParallelFor2D(pixelBounds, [&](Point2i p) {
         Pixel &pixel = pixels[p];
         RGB rgb(pixel.rgbSum[0], pixel.rgbSum[1], pixel.rgbSum[2]);
-        RGB albedoRgb(pixel.rgbAlbedoSum[0], pixel.rgbAlbedoSum[1],
-                      pixel.rgbAlbedoSum[2]);
 
         // Normalize pixel with weight sum
         Float weightSum = pixel.weightSum, gBufferWeightSum = pixel.gBufferWeightSum;
-        Point3f pt = pixel.pSum;
-        Point2f uv = pixel.uvSum;
-        Float dzdx = pixel.dzdxSum, dzdy = pixel.dzdySum;
-        if (weightSum != 0) {
+        if (weightSum != 0)
             rgb /= weightSum;
-            albedoRgb /= weightSum;
-        }
-        if (gBufferWeightSum != 0) {
-            pt /= gBufferWeightSum;
-            uv /= gBufferWeightSum;
-            dzdx /= gBufferWeightSum;
-            dzdy /= gBufferWeightSum;
+
+        // Find the auxiliary channels' values
+        RGB albedoRgb, variance, relVariance;
+        Point3f pt;
+        Point2f uv;
+        Float dzdx, dzdy;
+        Normal3f nSum, nsSum;
+        if (auxStorage == AuxStorage::Float) {
+            const AuxPixel &aux = auxPixels[p];
+            albedoRgb =
+                RGB(aux.rgbAlbedoSum[0], aux.rgbAlbedoSum[1], aux.rgbAlbedoSum[2]);
+            if (weightSum != 0)
+                albedoRgb /= weightSum;
+            pt = aux.pSum;
+            uv = aux.uvSum;
+            dzdx = aux.dzdxSum;
+            dzdy = aux.dzdySum;
+            if (gBufferWeightSum != 0) {
+                pt /= gBufferWeightSum;
+                uv /= gBufferWeightSum;
+                dzdx /= gBufferWeightSum;
+                dzdy /= gBufferWeightSum;
+            }
+            nSum = aux.nSum;
+            nsSum = aux.nsSum;
+            for (int c = 0; c < 3; ++c) {
+                variance[c] = aux.rgbVariance[c].Variance();
+                relVariance[c] = aux.rgbVariance[c].RelativeVariance();
+            }
+        } else {
+            // The stored values are averages over the samples that hit a
+            // surface; albedo is scaled by their share of all samples
+            const CompactAuxPixel &aux = compactAuxPixels[p];
+            Float coverage = weightSum != 0 ? gBufferWeightSum / weightSum : 0;
+            for (int i = 0; i < 3; ++i) {
+                albedoRgb[i] = coverage * Float(aux.albedo[i]);
+                pt[i] = Float(aux.p[i]);
+                nSum[i] = Float(aux.n[i]);
+                nsSum[i] = Float(aux.ns[i]);
+            }
+            uv = Point2f(Float(aux.uv[0]), Float(aux.uv[1]));
+            dzdx = Float(aux.dzdx);
+            dzdy = Float(aux.dzdy);
+            for (int c = 0; c < 3; ++c) {
+                variance[c] = aux.nSamples > 1 ? aux.rgbS[c] / (aux.nSamples - 1) : 0;
+                relVariance[c] = (aux.nSamples < 1 || aux.rgbMean[c] == 0)
+                                     ? 0
+                                     : variance[c] / aux.rgbMean[c];
+            }
         }
 
         // Add splat value at pixel
@@ -773,23 +1257,16 @@ Image GBufferFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
         image.SetChannels(pOffset, albedoRgbDesc,
                           {albedoRgb[0], albedoRgb[1], albedoRgb[2]});
 
-        Normal3f n =
-            LengthSquared(pixel.nSum) > 0 ? Normalize(pixel.nSum) : Normal3f(0, 0, 0);
-        Normal3f ns =
-            LengthSquared(pixel.nsSum) > 0 ? Normalize(pixel.nsSum) : Normal3f(0, 0, 0);
+        Normal3f n = LengthSquared(nSum) > 0 ? Normalize(nSum) : Normal3f(0, 0, 0);
+        Normal3f ns = LengthSquared(nsSum) > 0 ? Normalize(nsSum) : Normal3f(0, 0, 0);
         image.SetChannels(pOffset, pDesc, {pt.x, pt.y, pt.z});
         image.SetChannels(pOffset, dzDesc, {std::abs(dzdx), std::abs(dzdy)});
         image.SetChannels(pOffset, nDesc, {n.x, n.y, n.z});
         image.SetChannels(pOffset, nsDesc, {ns.x, ns.y, ns.z});
         image.SetChannels(pOffset, uvDesc, {uv[0], uv[1]});
-        image.SetChannels(
-            pOffset, varianceDesc,
-            {pixel.rgbVariance[0].Variance(), pixel.rgbVariance[1].Variance(),
-             pixel.rgbVariance[2].Variance()});
+        image.SetChannels(pOffset, varianceDesc, {variance[0], variance[1], variance[2]});
         image.SetChannels(pOffset, relVarianceDesc,
-                          {pixel.rgbVariance[0].RelativeVariance(),
-                           pixel.rgbVariance[1].RelativeVariance(),
-                           pixel.rgbVariance[2].RelativeVariance()});
+                          {relVariance[0], relVariance[1], relVariance[2]});
     });
 
     if (nClamped.load() > 0)
@@ -802,11 +1279,40 @@ Image GBufferFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
     return image;
 }
 
+std::string GBufferFilm::SerializePixels() const {
+    // As with RGBFilm, the pixels can be copied directly, followed by the
+    // auxiliary channels.
+    std::string state((const char *)pixels.begin(), pixels.size() * sizeof(Pixel));
+    if (auxStorage == AuxStorage::Float)
+        state.append((const char *)auxPixels.begin(),
+                     auxPixels.size() * sizeof(AuxPixel));
+    else
+        state.append((const char *)compactAuxPixels.begin(),
+                     compactAuxPixels.size() * sizeof(CompactAuxPixel));
+    return state;
+}
+
+bool GBufferFilm::DeserializePixels(const std::string &state) {
+    if (state.size() != pixels.size() * BytesPerPixel())
+        return false;
+    size_t pixelBytes = pixels.size() * sizeof(Pixel);
+    std::memcpy((void *)pixels.begin(), state.data(), pixelBytes);
+    if (auxStorage == AuxStorage::Float)
+        std::memcpy((void *)auxPixels.begin(), state.data() + pixelBytes,
+                    state.size() - pixelBytes);
+    else
+        std::memcpy((void *)compactAuxPixels.begin(), state.data() + pixelBytes,
+                    state.size() - pixelBytes);
+    return true;
+}
+
 std::string GBufferFilm::ToString() const {
+    const char *auxStorageName[] = {"float", "half", "firstsample"};
     return StringPrintf("[ GBufferFilm %s outputFromRender: %s applyInverse: %s "
-                        "colorSpace: %s maxComponentValue: %f writeFP16: %s ]",
+                        "colorSpace: %s maxComponentValue: %f writeFP16: %s "
+                        "auxStorage: %s ]",
                         BaseToString(), outputFromRender, applyInverse, *colorSpace,
-                        maxComponentValue, writeFP16);
+                        maxComponentValue, writeFP16, auxStorageName[int(auxStorage)]);
 }
 
 GBufferFilm *GBufferFilm::Create(const ParameterDictionary &parameters,
@@ -840,15 +1346,30 @@ GBufferFilm *GBufferFilm::Create(const ParameterDictionary &parameters,
                   "or \"world\".)",
                   coordinateSystem);
 
+    std::string auxStorageName = parameters.GetOneString("auxstorage", "float");
+    AuxStorage auxStorage;
+    if (auxStorageName == "float")
+        auxStorage = AuxStorage::Float;
+    else if (auxStorageName == "half")
+        auxStorage = AuxStorage::Half;
+    else if (auxStorageName == "firstsample")
+        auxStorage = AuxStorage::FirstSample;
+    else
+        ErrorExit(loc,
+                  "%s: unknown auxiliary channel storage for GBufferFilm. (Expecting "
+                  "\"float\", \"half\", or \"firstsample\".)",
+                  auxStorageName);
+
     return alloc.new_object<GBufferFilm>(filmBaseParameters, outputFromRender,
                                          applyInverse, colorSpace, maxComponentValue,
-                                         writeFP16, alloc);
+                                         writeFP16, auxStorage, alloc);
 }
 
 // SpectralFilm Method Definitions
 SpectralFilm::SpectralFilm(FilmBaseParameters p, Float lambdaMin, Float lambdaMax,
                            int nBuckets, const RGBColorSpace *colorSpace,
-                           Float maxComponentValue, bool writeFP16, Allocator alloc)
+                           Float maxComponentValue, bool writeFP16,
+                           bool compactBuckets, Allocator alloc)
     : FilmBase(p),
       colorSpace(colorSpace),
       lambdaMin(lambdaMin),
@@ -856,36 +1377,75 @@ SpectralFilm::SpectralFilm(FilmBaseParameters p, Float lambdaMin, Float lambdaMa
       nBuckets(nBuckets),
       maxComponentValue(maxComponentValue),
       writeFP16(writeFP16),
-      pixels(p.pixelBounds, alloc) {
+      pixels(p.pixelBounds, alloc),
+      compactBuckets(compactBuckets) {
     // Compute _outputRGBFromSensorRGB_ matrix
     outputRGBFromSensorRGB = colorSpace->RGBFromXYZ * sensor->XYZFromSensorRGB;
 
     filterIntegral = filter.Integral();
     CHECK(!pixelBounds.IsEmpty());
-    filmPixelMemory +=
-        pixelBounds.Area() * (sizeof(Pixel) + 3 * nBuckets * sizeof(double));
-
-    // Allocate memory for the pixel buffers in big arrays. Note that it's
-    // wasteful (but convenient) to be storing three pointers in each
-    // SpectralFilm::Pixel structure since the addresses could be computed
-    // based on the base pointers and pixel coordinates.
-    int nPixels = pixelBounds.Area();
-    double *bucketWeightBuffer = alloc.allocate_object<double>(2 * nBuckets * nPixels);
-    std::memset(bucketWeightBuffer, 0, 2 * nBuckets * nPixels * sizeof(double));
-    AtomicDouble *splatBuffer = alloc.allocate_object<AtomicDouble>(nBuckets * nPixels);
-    std::memset(splatBuffer, 0, nBuckets * nPixels * sizeof(double));
-
-    for (Point2i p : pixelBounds) {
-        Pixel &pixel = pixels[p];
-        pixel.bucketSums = bucketWeightBuffer;
-        bucketWeightBuffer += nBuckets;
-        pixel.weightSums = bucketWeightBuffer;
-        bucketWeightBuffer += nBuckets;
-        pixel.bucketSplats = splatBuffer;
-        splatBuffer += nBuckets;
+    size_t bucketBytes = compactBuckets ? sizeof(float) : sizeof(double);
+    filmPixelMemory += pixelBounds.Area() * (sizeof(Pixel) + 3 * nBuckets * bucketBytes);
+
+    // Allocate memory for the buckets in big arrays that are indexed using
+    // BucketOffset(), rather than storing pointers to them in each Pixel.
+    size_t nEntries = size_t(nBuckets) * pixelBounds.Area();
+    NumaInterleave(pixels.begin(), pixelBounds.Area() * sizeof(Pixel));
+    if (compactBuckets) {
+        float *buffer = alloc.allocate_object<float>(2 * nEntries);
+        std::memset(buffer, 0, 2 * nEntries * sizeof(float));
+        compactBucketSums = buffer;
+        compactWeightSums = buffer + nEntries;
+        compactBucketSplats = alloc.allocate_object<AtomicFloat>(nEntries);
+        std::memset((void *)compactBucketSplats, 0, nEntries * sizeof(AtomicFloat));
+        NumaInterleave(buffer, 2 * nEntries * sizeof(float));
+        NumaInterleave(compactBucketSplats, nEntries * sizeof(AtomicFloat));
+    } else {
+        double *buffer = alloc.allocate_object<double>(2 * nEntries);
+        std::memset(buffer, 0, 2 * nEntries * sizeof(double));
+        bucketSums = buffer;
+        weightSums = buffer + nEntries;
+        bucketSplats = alloc.allocate_object<AtomicDouble>(nEntries);
+        std::memset((void *)bucketSplats, 0, nEntries * sizeof(AtomicDouble));
+        NumaInterleave(buffer, 2 * nEntries * sizeof(double));
+        NumaInterleave(bucketSplats, nEntries * sizeof(AtomicDouble));
     }
 }
 
+thread_local SpectralFilm::BucketTile *SpectralFilm::threadBucketTile = nullptr;
+
+void SpectralFilm::BeginTile(Bounds2i tileBounds) {
+    // Full-precision buckets can be updated in place
+    if (!compactBuckets)
+        return;
+    CHECK(!threadBucketTile);
+    thread_local BucketTile tile;
+    tile.film = this;
+    tile.bounds = Intersect(tileBounds, pixelBounds);
+    tile.width = tile.bounds.pMax.x - tile.bounds.pMin.x;
+    tile.sums.assign(2 * nBuckets * size_t(tile.bounds.Area()), 0.);
+    threadBucketTile = &tile;
+}
+
+void SpectralFilm::EndTile() {
+    if (!compactBuckets)
+        return;
+    BucketTile *tile = threadBucketTile;
+    CHECK(tile && tile->film == this);
+    // Only this thread adds samples to the tile's pixels
+    for (Point2i p : tile->bounds) {
+        Vector2i offset = p - tile->bounds.pMin;
+        const double *sums =
+            &tile->sums[2 * nBuckets * (offset.y * tile->width + offset.x)];
+        size_t pixelOffset = BucketOffset(p);
+        for (int b = 0; b < nBuckets; ++b) {
+            compactBucketSums[pixelOffset + b] += sums[b];
+            compactWeightSums[pixelOffset + b] += sums[nBuckets + b];
+        }
+    }
+    threadBucketTile = nullptr;
+}
+
 PBRT_CPU_GPU RGB SpectralFilm::GetPixelRGB(Point2i p, Float splatScale) const {
     // Note: this is effectively the same as RGBFilm::GetPixelRGB
 
@@ -944,9 +1504,13 @@ PBRT_CPU_GPU void SpectralFilm::AddSplat(Point2f p, SampledSpectrum L,
             for (int i = 0; i < 3; ++i)
                 pixel.rgbSplat[i].Add(wt * rgb[i]);
 
+            size_t offset = BucketOffset(pi);
             for (int i = 0; i < NSpectrumSamples; ++i) {
-                int b = LambdaToBucket(lambda[i]);
-                pixel.bucketSplats[b].Add(wt * L[i]);
+                size_t b = offset + LambdaToBucket(lambda[i]);
+                if (compactBuckets)
+                    compactBucketSplats[b].Add(wt * L[i]);
+                else
+                    bucketSplats[b].Add(wt * L[i]);
             }
         }
     }
@@ -979,8 +1543,6 @@ Image SpectralFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
 
     std::atomic<int> nClamped{0};
     ParallelFor2D(pixelBounds, [&](Point2i p) {
-        Pixel &pixel = pixels[p];
-
         RGB rgb = GetPixelRGB(p, splatScale);
 
         // Clamp to max representable fp16 to avoid Infs
@@ -998,11 +1560,21 @@ Image SpectralFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
 
         // Set spectral channels. Hardcoded assuming that they come
         // immediately after RGB, as is currently specified above.
+        size_t offset = BucketOffset(p);
         for (int i = 0; i < nBuckets; ++i) {
+            double bucketSum, weightSum, splat;
+            if (compactBuckets) {
+                bucketSum = compactBucketSums[offset + i];
+                weightSum = compactWeightSums[offset + i];
+                splat = compactBucketSplats[offset + i];
+            } else {
+                bucketSum = bucketSums[offset + i];
+                weightSum = weightSums[offset + i];
+                splat = bucketSplats[offset + i];
+            }
             Float c = 0;
-            if (pixel.weightSums[i] > 0) {
-                c = pixel.bucketSums[i] / pixel.weightSums[i] +
-                    splatScale * pixel.bucketSplats[i] / filterIntegral;
+            if (weightSum > 0) {
+                c = bucketSum / weightSum + splatScale * splat / filterIntegral;
                 if (writeFP16 && c > 65504) {
                     c = 65504;
                     ++nClamped;
@@ -1027,11 +1599,65 @@ Image SpectralFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
     return image;
 }
 
+std::string SpectralFilm::SerializePixels() const {
+    // Each pixel's RGB values are followed by all of the pixels' buckets,
+    // which are stored in the same precision as in the film.
+    std::string state;
+    auto append = [&](const void *ptr, size_t size) {
+        state.append((const char *)ptr, size);
+    };
+    for (const Pixel &pixel : pixels) {
+        append(pixel.rgbSum, sizeof(pixel.rgbSum));
+        append(&pixel.rgbWeightSum, sizeof(pixel.rgbWeightSum));
+        append(pixel.rgbSplat, sizeof(pixel.rgbSplat));
+    }
+    size_t nEntries = size_t(nBuckets) * pixels.size();
+    if (compactBuckets) {
+        append(compactBucketSums, 2 * nEntries * sizeof(float));
+        append(compactBucketSplats, nEntries * sizeof(AtomicFloat));
+    } else {
+        append(bucketSums, 2 * nEntries * sizeof(double));
+        append(bucketSplats, nEntries * sizeof(AtomicDouble));
+    }
+    return state;
+}
+
+bool SpectralFilm::DeserializePixels(const std::string &state) {
+    size_t nEntries = size_t(nBuckets) * pixels.size();
+    size_t bucketBytes = compactBuckets
+                             ? nEntries * (2 * sizeof(float) + sizeof(AtomicFloat))
+                             : nEntries * (2 * sizeof(double) + sizeof(AtomicDouble));
+    size_t pixelBytes = sizeof(Pixel::rgbSum) + sizeof(Pixel::rgbWeightSum) +
+                        sizeof(Pixel::rgbSplat);
+    if (state.size() != pixels.size() * pixelBytes + bucketBytes)
+        return false;
+
+    const char *ptr = state.data();
+    auto extract = [&](void *dst, size_t size) {
+        std::memcpy(dst, ptr, size);
+        ptr += size;
+    };
+    for (Pixel &pixel : pixels) {
+        extract(pixel.rgbSum, sizeof(pixel.rgbSum));
+        extract(&pixel.rgbWeightSum, sizeof(pixel.rgbWeightSum));
+        extract((void *)pixel.rgbSplat, sizeof(pixel.rgbSplat));
+    }
+    // The sums and weight sums are allocated together
+    if (compactBuckets) {
+        extract(compactBucketSums, 2 * nEntries * sizeof(float));
+        extract((void *)compactBucketSplats, nEntries * sizeof(AtomicFloat));
+    } else {
+        extract(bucketSums, 2 * nEntries * sizeof(double));
+        extract((void *)bucketSplats, nEntries * sizeof(AtomicDouble));
+    }
+    return true;
+}
+
 std::string SpectralFilm::ToString() const {
     return StringPrintf("[ SpectralFilm %s lambdaMin: %f lambdaMax: %f nBuckets: %d "
-                        "writeFP16: %s maxComponentValue: %f ]",
+                        "writeFP16: %s maxComponentValue: %f compactBuckets: %s ]",
                         BaseToString(), lambdaMin, lambdaMax, nBuckets, writeFP16,
-                        maxComponentValue);
+                        maxComponentValue, compactBuckets);
 }
 
 SpectralFilm *SpectralFilm::Create(const ParameterDictionary &parameters,
@@ -1052,9 +1678,19 @@ SpectralFilm *SpectralFilm::Create(const ParameterDictionary &parameters,
     Float lambdaMax = parameters.GetOneFloat("lambdamax", Lambda_max);
     Float maxComponentValue = parameters.GetOneFloat("maxcomponentvalue", Infinity);
 
+    // Single-precision buckets halve the film's spectral storage; samples
+    // are still accumulated in double precision within each tile.
+    std::string bucketStorage = parameters.GetOneString("bucketstorage", "double");
+    if (bucketStorage != "double" && bucketStorage != "float")
+        ErrorExit(loc,
+                  "%s: unknown bucket storage for SpectralFilm. (Expecting \"double\" "
+                  "or \"float\".)",
+                  bucketStorage);
+    bool compactBuckets = bucketStorage == "float";
+
     return alloc.new_object<SpectralFilm>(filmBaseParameters, lambdaMin, lambdaMax,
                                           nBuckets, colorSpace, maxComponentValue,
-                                          writeFP16, alloc);
+                                          writeFP16, compactBuckets, alloc);
 }
 
 Film Film::Create(const std::string &name, const ParameterDictionary &parameters,
@@ -52,7 +52,11 @@ class PixelSensor {
 
     PixelSensor(Spectrum r, Spectrum g, Spectrum b, const RGBColorSpace *outputColorSpace,
                 Spectrum sensorIllum, Float imagingRatio, Allocator alloc)
-        : r_bar(r, alloc), g_bar(g, alloc), b_bar(b, alloc), imagingRatio(imagingRatio) {
+        : r_bar(r, alloc),
+          g_bar(g, alloc),
+          b_bar(b, alloc),
+          imagingRatio(imagingRatio),
+          response(ResponseTable(SquareMatrix<3>(), alloc)) {
         // Compute XYZ from camera RGB matrix
         // Compute _rgbCamera_ values for training swatches
         Float rgbCamera[nSwatchReflectances][3];
@@ -91,7 +95,8 @@ class PixelSensor {
         : r_bar(&Spectra::X(), alloc),
           g_bar(&Spectra::Y(), alloc),
           b_bar(&Spectra::Z(), alloc),
-          imagingRatio(imagingRatio) {
+          imagingRatio(imagingRatio),
+          response(ResponseTable(SquareMatrix<3>(), alloc)) {
         // Compute white balancing matrix for XYZ _PixelSensor_
         if (sensorIllum) {
             Point2f sourceWhite = SpectrumToXYZ(sensorIllum).xy();
@@ -103,10 +108,32 @@ class PixelSensor {
     PBRT_CPU_GPU
     RGB ToSensorRGB(SampledSpectrum L, const SampledWavelengths &lambda) const {
         // 蒙特卡洛求三原色
+        return EvaluateResponse(response, L, lambda);
+    }
+
+    // Returns a table of _m_ times the sensor's RGB response at each
+    // wavelength in [Lambda_min, Lambda_max], with the imaging ratio and the
+    // 1/NSpectrumSamples Monte Carlo factor folded in. Entries for each
+    // wavelength are padded to four values so that EvaluateResponse() can
+    // accumulate them with vector instructions.
+    pstd::vector<Float> ResponseTable(const SquareMatrix<3> &m, Allocator alloc) const;
+
+    // Returns the RGB estimate of _L_ for the response in _table_, which was
+    // returned by ResponseTable().
+    PBRT_CPU_GPU
+    static RGB EvaluateResponse(const pstd::vector<Float> &table, SampledSpectrum L,
+                                const SampledWavelengths &lambda) {
         L = SafeDiv(L, lambda.PDF());
-        return imagingRatio * RGB((r_bar.Sample(lambda) * L).Average(),
-                                  (g_bar.Sample(lambda) * L).Average(),
-                                  (b_bar.Sample(lambda) * L).Average());
+        Float rgb[4] = {0, 0, 0, 0};
+        for (int i = 0; i < NSpectrumSamples; ++i) {
+            int offset = std::lround(lambda[i]) - Lambda_min;
+            if (offset < 0 || offset > Lambda_max - Lambda_min)
+                continue;
+            const Float *entry = &table[4 * offset];
+            for (int c = 0; c < 4; ++c)
+                rgb[c] += L[i] * entry[c];
+        }
+        return RGB(rgb[0], rgb[1], rgb[2]);
     }
 
     // PixelSensor Public Members
@@ -121,6 +148,7 @@ class PixelSensor {
     // PixelSensor Private Members
     DenselySampledSpectrum r_bar, g_bar, b_bar;
     Float imagingRatio;
+    pstd::vector<Float> response;
     static constexpr int nSwatchReflectances = 24;
     static Spectrum swatchReflectances[nSwatchReflectances];
 };
@@ -234,6 +262,7 @@ class FilmBase {
     PBRT_CPU_GPU
     const PixelSensor *GetPixelSensor() const { return sensor; }
     std::string GetFilename() const { return filename; }
+    void SetFilename(const std::string &f) { filename = f; }
 
     PBRT_CPU_GPU
     SampledWavelengths SampleWavelengths(Float u) const {
@@ -255,6 +284,34 @@ class FilmBase {
     std::string filename;
 };
 
+// RGBFilmDump Definition
+// The raw pixel sums of an _RGBFilm_ for one or more ranges of sample
+// indices, as written with --sample-range, along with what's needed to
+// convert them to an image. Adding the sums of dumps of disjoint sample
+// ranges gives the film of all of their samples.
+struct RGBFilmDump {
+    // RGBFilmDump Public Methods
+    bool Write(const std::string &filename) const;
+    static pstd::optional<RGBFilmDump> Read(const std::string &filename);
+
+    // Adds _dump_'s sums to these, returning false if it is of a different
+    // film or any of its samples are already included
+    bool Merge(const RGBFilmDump &dump);
+
+    int SampleCount() const;
+    Image GetImage(ImageMetadata *metadata) const;
+
+    // RGBFilmDump Public Members
+    Bounds2i pixelBounds;
+    Point2i fullResolution;
+    std::vector<std::pair<int, int>> sampleRanges;
+    Float filterIntegral;
+    SquareMatrix<3> outputRGBFromSensorRGB;
+    const RGBColorSpace *colorSpace;
+    // Each pixel's RGB sums, weight sum, and RGB splat sums
+    std::vector<double> pixels;
+};
+
 // RGBFilm Definition
 class RGBFilm : public FilmBase {
   public:
@@ -275,6 +332,19 @@ class RGBFilm : public FilmBase {
             rgb *= maxComponentValue / m;
 
         DCHECK(InsideExclusive(pFilm, pixelBounds));
+#ifndef PBRT_IS_GPU_CODE
+        // Accumulate the sample in this thread's tile buffer if it is
+        // rendering a tile of this film that includes _pFilm_
+        if (SampleTile *tile = threadSampleTile;
+            tile && tile->film == this && InsideExclusive(pFilm, tile->bounds)) {
+            Vector2i offset = pFilm - tile->bounds.pMin;
+            SampleTile::Pixel &pixel = tile->pixels[offset.y * tile->width + offset.x];
+            for (int c = 0; c < 3; ++c)
+                pixel.rgbSum[c] += weight * rgb[c];
+            pixel.weightSum += weight;
+            return;
+        }
+#endif
         // Update pixel values with filtered sample contribution
         Pixel &pixel = pixels[pFilm];
         for (int c = 0; c < 3; ++c)
@@ -317,10 +387,29 @@ class RGBFilm : public FilmBase {
 
     std::string ToString() const;
 
+    // Returns the film's accumulated pixel values, for checkpointing, or
+    // restores them; the latter returns false if they don't match the film.
+    std::string SerializePixels() const;
+    bool DeserializePixels(const std::string &state);
+
+    std::string SerializePixels(const Bounds2i &bounds) const;
+    bool AddPixels(const Bounds2i &bounds, const std::string &state);
+
+    RGBFilmDump GetDump(int sampleStart, int sampleEnd);
+
+    // Adds the splats that rendering threads have buffered to the pixels; it
+    // must not be called concurrently with AddSplat().
+    void FlushSplats();
+
+    // Between these calls, samples that the calling thread adds to pixels
+    // inside _tileBounds_ are accumulated in a thread-private buffer; they
+    // are added to the film's pixels by EndTile().
+    void BeginTile(Bounds2i tileBounds);
+    void EndTile();
+
     PBRT_CPU_GPU
     RGB ToOutputRGB(SampledSpectrum L, const SampledWavelengths &lambda) const {
-        RGB sensorRGB = sensor->ToSensorRGB(L, lambda);
-        return outputRGBFromSensorRGB * sensorRGB;
+        return PixelSensor::EvaluateResponse(outputRGBResponse, L, lambda);
     }
 
     PBRT_CPU_GPU void ResetPixel(Point2i p) { memset(&pixels[p], 0, sizeof(Pixel)); }
@@ -333,6 +422,29 @@ class RGBFilm : public FilmBase {
         double weightSum = 0.;
         AtomicDouble rgbSplat[3];
     };
+    struct SplatTileCache;
+
+    // RGBFilm Private Methods
+    // Sets _image_'s pixels to the final values of the film's rows starting at
+    // _yStart_, returning how many pixels had to be clamped.
+    int GetImageRows(Image *image, int yStart, Float splatScale) const;
+
+    // RGBFilm::SampleTile Definition
+    // A tile's samples are only added by the thread rendering it, and with
+    // many fewer of them than are accumulated in the film's pixels, so the
+    // buffer uses single precision and keeps each pixel in 16 bytes. This
+    // also keeps rendering threads from writing to the cache lines that
+    // neighboring tiles' pixels share.
+    struct SampleTile {
+        struct Pixel {
+            float rgbSum[3];
+            float weightSum;
+        };
+        const RGBFilm *film = nullptr;
+        Bounds2i bounds;
+        int width = 0;
+        std::vector<Pixel> pixels;
+    };
 
     // RGBFilm Private Members
     const RGBColorSpace *colorSpace;
@@ -340,17 +452,33 @@ class RGBFilm : public FilmBase {
     bool writeFP16;
     Float filterIntegral;
     SquareMatrix<3> outputRGBFromSensorRGB;
+    // The sensor's response with _outputRGBFromSensorRGB_ folded in
+    pstd::vector<Float> outputRGBResponse;
     Array2D<Pixel> pixels;
+    ThreadLocal<SplatTileCache> *splatCaches;
+#ifndef PBRT_IS_GPU_CODE
+    static thread_local SampleTile *threadSampleTile;
+#endif
+    // Unique identifier for _splatCaches_, so that threads can remember
+    // which cache they last used
+    uint64_t splatCachesId;
 };
 
 // GBufferFilm Definition
 class GBufferFilm : public FilmBase {
   public:
     // GBufferFilm Public Methods
+    // GBufferFilm::AuxStorage Definition
+    // How the auxiliary channels--everything but the pixel's color--are
+    // stored: as full-precision sums; as running averages in half precision;
+    // or as the first sample's values in half precision. Both of the latter
+    // also track the color's variance in single precision.
+    enum class AuxStorage { Float, Half, FirstSample };
+
     GBufferFilm(FilmBaseParameters p, const AnimatedTransform &outputFromRender,
                 bool applyInverse, const RGBColorSpace *colorSpace,
                 Float maxComponentValue = Infinity, bool writeFP16 = true,
-                Allocator alloc = {});
+                AuxStorage auxStorage = AuxStorage::Float, Allocator alloc = {});
 
     static GBufferFilm *Create(const ParameterDictionary &parameters, Float exposureTime,
                                const CameraTransform &cameraTransform, Filter filter,
@@ -366,8 +494,7 @@ class GBufferFilm : public FilmBase {
 
     PBRT_CPU_GPU
     RGB ToOutputRGB(SampledSpectrum L, const SampledWavelengths &lambda) const {
-        RGB cameraRGB = sensor->ToSensorRGB(L, lambda);
-        return outputRGBFromSensorRGB * cameraRGB;
+        return PixelSensor::EvaluateResponse(outputRGBResponse, L, lambda);
     }
 
     PBRT_CPU_GPU
@@ -395,9 +522,31 @@ class GBufferFilm : public FilmBase {
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
 
+    // Returns the number of bytes of storage used for each pixel
+    size_t BytesPerPixel() const {
+        size_t auxBytes = auxStorage == AuxStorage::Float ? sizeof(AuxPixel)
+                                                          : sizeof(CompactAuxPixel);
+        return sizeof(Pixel) + auxBytes;
+    }
+
     std::string ToString() const;
 
-    PBRT_CPU_GPU void ResetPixel(Point2i p) { memset(&pixels[p], 0, sizeof(Pixel)); }
+    // Returns the film's accumulated pixel values, for checkpointing, or
+    // restores them; the latter returns false if they don't match the film.
+    std::string SerializePixels() const;
+    bool DeserializePixels(const std::string &state);
+
+    void FlushSplats() {}
+    void BeginTile(Bounds2i tileBounds) {}
+    void EndTile() {}
+
+    PBRT_CPU_GPU void ResetPixel(Point2i p) {
+        memset(&pixels[p], 0, sizeof(Pixel));
+        if (auxStorage == AuxStorage::Float)
+            memset(&auxPixels[p], 0, sizeof(AuxPixel));
+        else
+            memset(&compactAuxPixels[p], 0, sizeof(CompactAuxPixel));
+    }
 
   private:
     // GBufferFilm::Pixel Definition
@@ -406,6 +555,10 @@ class GBufferFilm : public FilmBase {
         double rgbSum[3] = {0., 0., 0.};
         double weightSum = 0., gBufferWeightSum = 0.;
         AtomicDouble rgbSplat[3];
+    };
+
+    // GBufferFilm::AuxPixel Definition
+    struct AuxPixel {
         Point3f pSum;
         Float dzdxSum = 0, dzdySum = 0;
         Normal3f nSum, nsSum;
@@ -414,15 +567,29 @@ class GBufferFilm : public FilmBase {
         VarianceEstimator<Float> rgbVariance[3];
     };
 
+    // GBufferFilm::CompactAuxPixel Definition
+    struct CompactAuxPixel {
+        Half p[3], dzdx, dzdy, n[3], ns[3], uv[2], albedo[3];
+        // The color's running mean and sum of squared differences from it,
+        // as in _VarianceEstimator_ but with a count shared by all channels
+        float rgbMean[3], rgbS[3];
+        uint32_t nSamples;
+    };
+
     // GBufferFilm Private Members
     AnimatedTransform outputFromRender;
     bool applyInverse;
+    AuxStorage auxStorage;
     Array2D<Pixel> pixels;
+    Array2D<AuxPixel> auxPixels;
+    Array2D<CompactAuxPixel> compactAuxPixels;
     const RGBColorSpace *colorSpace;
     Float maxComponentValue;
     bool writeFP16;
     Float filterIntegral;
     SquareMatrix<3> outputRGBFromSensorRGB;
+    // The sensor's response with _outputRGBFromSensorRGB_ folded in
+    pstd::vector<Float> outputRGBResponse;
 };
 
 // SpectralFilm Definition
@@ -474,11 +641,33 @@ class SpectralFilm : public FilmBase {
         // below.
         L *= weight * CIE_Y_integral;
 
+#ifndef PBRT_IS_GPU_CODE
+        // With compact bucket storage, accumulate in double precision in this
+        // thread's tile buffer if it is rendering a tile that includes _pFilm_
+        if (BucketTile *tile = threadBucketTile;
+            tile && tile->film == this && InsideExclusive(pFilm, tile->bounds)) {
+            Vector2i offset = pFilm - tile->bounds.pMin;
+            double *sums =
+                &tile->sums[2 * nBuckets * (offset.y * tile->width + offset.x)];
+            for (int i = 0; i < NSpectrumSamples; ++i) {
+                int b = LambdaToBucket(lambda[i]);
+                sums[b] += L[i];
+                sums[nBuckets + b] += weight;
+            }
+            return;
+        }
+#endif
         // Accumulate contributions in spectral buckets.
+        size_t offset = BucketOffset(pFilm);
         for (int i = 0; i < NSpectrumSamples; ++i) {
-            int b = LambdaToBucket(lambda[i]);
-            pixel.bucketSums[b] += L[i];
-            pixel.weightSums[b] += weight;
+            size_t b = offset + LambdaToBucket(lambda[i]);
+            if (compactBuckets) {
+                compactBucketSums[b] += L[i];
+                compactWeightSums[b] += weight;
+            } else {
+                bucketSums[b] += L[i];
+                weightSums[b] += weight;
+            }
         }
     }
 
@@ -487,7 +676,8 @@ class SpectralFilm : public FilmBase {
 
     SpectralFilm(FilmBaseParameters p, Float lambdaMin, Float lambdaMax, int nBuckets,
                  const RGBColorSpace *colorSpace, Float maxComponentValue = Infinity,
-                 bool writeFP16 = true, Allocator alloc = {});
+                 bool writeFP16 = true, bool compactBuckets = false,
+                 Allocator alloc = {});
 
     static SpectralFilm *Create(const ParameterDictionary &parameters, Float exposureTime,
                                 Filter filter, const RGBColorSpace *colorSpace,
@@ -505,6 +695,19 @@ class SpectralFilm : public FilmBase {
 
     std::string ToString() const;
 
+    // Returns the film's accumulated pixel values, for checkpointing, or
+    // restores them; the latter returns false if they don't match the film.
+    std::string SerializePixels() const;
+    bool DeserializePixels(const std::string &state);
+
+    void FlushSplats() {}
+
+    // With compact bucket storage, the bucket sums of samples that the
+    // calling thread adds to pixels inside _tileBounds_ are accumulated in
+    // double precision until EndTile() adds them to the film.
+    void BeginTile(Bounds2i tileBounds);
+    void EndTile();
+
     PBRT_CPU_GPU
     RGB ToOutputRGB(SampledSpectrum L, const SampledWavelengths &lambda) const {
         LOG_FATAL("ToOutputRGB() is unimplemented. But that's ok since it's only used "
@@ -518,9 +721,17 @@ class SpectralFilm : public FilmBase {
         pix.rgbSum[0] = pix.rgbSum[1] = pix.rgbSum[2] = 0.;
         pix.rgbWeightSum = 0.;
         pix.rgbSplat[0] = pix.rgbSplat[1] = pix.rgbSplat[2] = 0.;
-        memset(pix.bucketSums, 0, nBuckets * sizeof(double));
-        memset(pix.weightSums, 0, nBuckets * sizeof(double));
-        memset(pix.bucketSplats, 0, nBuckets * sizeof(AtomicDouble));
+        size_t offset = BucketOffset(p);
+        if (compactBuckets) {
+            memset(compactBucketSums + offset, 0, nBuckets * sizeof(float));
+            memset(compactWeightSums + offset, 0, nBuckets * sizeof(float));
+            memset((void *)(compactBucketSplats + offset), 0,
+                   nBuckets * sizeof(AtomicFloat));
+        } else {
+            memset(bucketSums + offset, 0, nBuckets * sizeof(double));
+            memset(weightSums + offset, 0, nBuckets * sizeof(double));
+            memset((void *)(bucketSplats + offset), 0, nBuckets * sizeof(AtomicDouble));
+        }
     }
 
   private:
@@ -531,6 +742,15 @@ class SpectralFilm : public FilmBase {
         return Clamp(bucket, 0, nBuckets - 1);
     }
 
+    // Returns the index of the first of pixel _p_'s buckets in the bucket
+    // arrays
+    PBRT_CPU_GPU
+    size_t BucketOffset(Point2i p) const {
+        Vector2i o = p - pixelBounds.pMin;
+        int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+        return nBuckets * (size_t(o.y) * width + o.x);
+    }
+
     // SpectralFilm::Pixel Definition
     struct Pixel {
         Pixel() = default;
@@ -539,9 +759,17 @@ class SpectralFilm : public FilmBase {
         double rgbSum[3] = {0., 0., 0.};
         double rgbWeightSum = 0.;
         AtomicDouble rgbSplat[3];
-        // The following will all have nBuckets entries.
-        double *bucketSums, *weightSums;
-        AtomicDouble *bucketSplats;
+    };
+
+    // SpectralFilm::BucketTile Definition
+    // Per-thread double-precision buffer of a tile's bucket and weight sums,
+    // _nBuckets_ of each per pixel, so that the film's own sums can be
+    // stored in single precision.
+    struct BucketTile {
+        const SpectralFilm *film = nullptr;
+        Bounds2i bounds;
+        int width = 0;
+        std::vector<double> sums;
     };
 
     // SpectralFilm Private Members
@@ -553,6 +781,16 @@ class SpectralFilm : public FilmBase {
     Float filterIntegral;
     Array2D<Pixel> pixels;
     SquareMatrix<3> outputRGBFromSensorRGB;
+    // Each pixel's bucket sums, weight sums and splats, starting at its
+    // BucketOffset(); only the double- or single-precision ones are allocated
+    bool compactBuckets;
+    double *bucketSums = nullptr, *weightSums = nullptr;
+    AtomicDouble *bucketSplats = nullptr;
+    float *compactBucketSums = nullptr, *compactWeightSums = nullptr;
+    AtomicFloat *compactBucketSplats = nullptr;
+#ifndef PBRT_IS_GPU_CODE
+    static thread_local BucketTile *threadBucketTile;
+#endif
 };
 
 PBRT_CPU_GPU
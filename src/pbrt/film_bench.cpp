@@ -0,0 +1,51 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/film.h>
+#include <pbrt/filters.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/spectrum.h>
+
+#include <vector>
+
+using namespace pbrt;
+
+// Adds random samples in scanline order to a 256x256 film, so that successive
+// samples usually go to the same or neighboring pixels, as they do with
+// pbrt's tiled rendering.
+static void RGBFilm_AddSample(benchmark::State &state) {
+    Point2i res(256, 256);
+    FilmBaseParameters params(res, Bounds2i(Point2i(0, 0), res), new BoxFilter, 1.,
+                              PixelSensor::CreateDefault(), "bench.exr");
+    RGBFilm film(params, RGBColorSpace::sRGB);
+
+    struct Sample {
+        SampledSpectrum L;
+        SampledWavelengths lambda;
+    };
+    RNG rng;
+    std::vector<Sample> samples;
+    for (int i = 0; i < 1024; ++i) {
+        SampledSpectrum L;
+        for (int j = 0; j < NSpectrumSamples; ++j)
+            L[j] = 4 * rng.Uniform<Float>();
+        samples.push_back({L, SampledWavelengths::SampleVisible(rng.Uniform<Float>())});
+    }
+
+    int64_t n = 0;
+    for (auto _ : state) {
+        const Sample &s = samples[n % samples.size()];
+        Point2i pFilm((n / 4) % res.x, (n / (4 * res.x)) % res.y);
+        film.AddSample(pFilm, s.L, s.lambda, nullptr, 1);
+        ++n;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(RGBFilm_AddSample);
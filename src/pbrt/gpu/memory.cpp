@@ -7,6 +7,7 @@
 #include <pbrt/gpu/util.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/log.h>
+#include <pbrt/util/stats.h>
 
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -24,6 +25,22 @@ void CUDAMemoryResource::do_deallocate(void *p, size_t bytes, size_t alignment)
     CUDA_CHECK(cudaFree(p));
 }
 
+STAT_MEMORY_COUNTER("Memory/GPU managed memory preferring device", deviceResidentBytes);
+STAT_MEMORY_COUNTER("Memory/GPU managed memory preferring host", hostResidentBytes);
+
+static thread_local GPUResidency currentResidency = GPUResidency::Default;
+
+// ScopedGPUResidency Method Definitions
+ScopedGPUResidency::ScopedGPUResidency(GPUResidency residency)
+    : prevResidency(currentResidency) {
+    currentResidency = residency;
+}
+
+ScopedGPUResidency::~ScopedGPUResidency() {
+    currentResidency = prevResidency;
+}
+
+// CUDATrackedMemoryResource Method Definitions
 void *CUDATrackedMemoryResource::do_allocate(size_t size, size_t alignment) {
     if (size == 0)
         return nullptr;
@@ -33,7 +50,7 @@ void *CUDATrackedMemoryResource::do_allocate(size_t size, size_t alignment) {
     DCHECK_EQ(0, intptr_t(ptr) % alignment);
 
     std::lock_guard<std::mutex> lock(mutex);
-    allocations[ptr] = size;
+    allocations[ptr] = Allocation{size, currentResidency};
     bytesAllocated += size;
 
     return ptr;
@@ -52,6 +69,32 @@ void CUDATrackedMemoryResource::do_deallocate(void *p, size_t size, size_t align
     bytesAllocated -= size;
 }
 
+// Applies the advice for the given residency class to a range of managed
+// memory and starts moving it to where it belongs.
+static void adviseAndPrefetch(const void *ptr, size_t size, GPUResidency residency,
+                              int deviceIndex) {
+    switch (residency) {
+    case GPUResidency::Device:
+        CUDA_CHECK(cudaMemAdvise(ptr, size, cudaMemAdviseSetPreferredLocation,
+                                 deviceIndex));
+        deviceResidentBytes += size;
+        break;
+    case GPUResidency::Host:
+        CUDA_CHECK(cudaMemAdvise(ptr, size, cudaMemAdviseSetPreferredLocation,
+                                 cudaCpuDeviceId));
+        CUDA_CHECK(cudaMemAdvise(ptr, size, cudaMemAdviseSetAccessedBy, deviceIndex));
+        CUDA_CHECK(cudaMemAdvise(ptr, size, cudaMemAdviseSetReadMostly,
+                                 /* ignored argument */ 0));
+        hostResidentBytes += size;
+        break;
+    case GPUResidency::Default:
+        break;
+    }
+
+    int destination = residency == GPUResidency::Host ? cudaCpuDeviceId : deviceIndex;
+    CUDA_CHECK(cudaMemPrefetchAsync(ptr, size, destination, 0 /* stream */));
+}
+
 void CUDATrackedMemoryResource::PrefetchToGPU() const {
     int deviceIndex;
     CUDA_CHECK(cudaGetDevice(&deviceIndex));
@@ -60,13 +103,26 @@ void CUDATrackedMemoryResource::PrefetchToGPU() const {
 
     LOG_VERBOSE("Prefetching %d allocations to GPU memory", allocations.size());
     size_t bytes = 0;
-    for (auto iter : allocations) {
-        CUDA_CHECK(
-            cudaMemPrefetchAsync(iter.first, iter.second, deviceIndex, 0 /* stream */));
-        bytes += iter.second;
+    for (const auto &iter : allocations) {
+        adviseAndPrefetch(iter.first, iter.second.size, iter.second.residency,
+                          deviceIndex);
+        bytes += iter.second.size;
     }
+    // Apply the overrides for parts of allocations after the allocations'
+    // own advice
+    for (const Range &range : ranges)
+        adviseAndPrefetch(range.ptr, range.size, range.residency, deviceIndex);
     CUDA_CHECK(cudaDeviceSynchronize());
-    LOG_VERBOSE("Done prefetching: %d bytes total", bytes);
+    LOG_VERBOSE("Done prefetching: %d bytes total, %d ranges overridden", bytes,
+                ranges.size());
+}
+
+void CUDATrackedMemoryResource::SetResidency(const void *ptr, size_t size,
+                                             GPUResidency residency) {
+    if (!ptr || size == 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    ranges.push_back(Range{ptr, size, residency});
 }
 
 CUDATrackedMemoryResource CUDATrackedMemoryResource::singleton;
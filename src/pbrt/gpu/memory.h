@@ -17,11 +17,36 @@
 #include <mutex>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace pbrt {
 
 #ifdef PBRT_BUILD_GPU_RENDERER
 
+// GPUResidency Definition
+// Where managed memory should live when the GPU's memory is oversubscribed.
+// _Device_ is for data that is written by every pass, like the wavefront
+// queues, which the driver should avoid evicting. _Host_ is for large data
+// that is only read, which stays in host memory; the GPU keeps read-only
+// copies of the pages it touches, which can be dropped without a write
+// back. _Default_ leaves placement to the driver.
+enum class GPUResidency { Default, Device, Host };
+
+// ScopedGPUResidency Definition
+// Sets the residency class of the allocations that the current thread
+// makes from _CUDATrackedMemoryResource_ while it is in scope.
+class ScopedGPUResidency {
+  public:
+    ScopedGPUResidency(GPUResidency residency);
+    ~ScopedGPUResidency();
+
+    ScopedGPUResidency(const ScopedGPUResidency &) = delete;
+    ScopedGPUResidency &operator=(const ScopedGPUResidency &) = delete;
+
+  private:
+    GPUResidency prevResidency;
+};
+
 class CUDAMemoryResource : public pstd::pmr::memory_resource {
     void *do_allocate(size_t size, size_t alignment);
     void do_deallocate(void *p, size_t bytes, size_t alignment);
@@ -40,7 +65,11 @@ class CUDATrackedMemoryResource : public CUDAMemoryResource {
         return this == &other;
     }
 
+    // Applies the allocations' residency advice and moves each one to where
+    // it should live: host-resident data to the CPU and the rest to the GPU.
     void PrefetchToGPU() const;
+    // Overrides the residency class for part of an allocation.
+    void SetResidency(const void *ptr, size_t size, GPUResidency residency);
     size_t BytesAllocated() const { return bytesAllocated; }
 
     static CUDATrackedMemoryResource singleton;
@@ -48,7 +77,17 @@ class CUDATrackedMemoryResource : public CUDAMemoryResource {
   private:
     mutable std::mutex mutex;
     std::atomic<size_t> bytesAllocated{};
-    std::unordered_map<void *, size_t> allocations;
+    struct Allocation {
+        size_t size;
+        GPUResidency residency;
+    };
+    std::unordered_map<void *, Allocation> allocations;
+    struct Range {
+        const void *ptr;
+        size_t size;
+        GPUResidency residency;
+    };
+    std::vector<Range> ranges;
 };
 
 #endif
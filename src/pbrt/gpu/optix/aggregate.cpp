@@ -4,6 +4,7 @@
 
 #include <pbrt/gpu/optix/aggregate.h>
 
+#include <pbrt/gpu/memory.h>
 #include <pbrt/gpu/optix/optix.h>
 #include <pbrt/gpu/util.h>
 #include <pbrt/lights.h>
@@ -24,6 +25,7 @@
 #include <atomic>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include <optix.h>
 #include <optix_function_table_definition.h>
@@ -102,6 +104,67 @@ static CUdeviceptr CopyToDevice(pstd::span<const T> buffer) {
 }
 
 STAT_MEMORY_COUNTER("Memory/Acceleration structures", gpuBVHBytes);
+STAT_MEMORY_COUNTER("Memory/Acceleration structures before compaction",
+                    gpuBVHUncompactedBytes);
+STAT_COUNTER("Geometry/Acceleration structure builds", nGASBuilds);
+STAT_COUNTER("Geometry/Acceleration structure build buffer allocations",
+             nGASBuildBufferAllocations);
+
+// GASBuildBuffers Definition
+// Scratch memory for a single acceleration structure build. Builds always
+// compact their result into a new allocation, so both the temporary and
+// output buffers can be reused by subsequent builds; a pool of them is
+// shared by the threads that build BVHs in parallel.
+struct GASBuildBuffers {
+    void *temp = nullptr, *output = nullptr;
+    size_t tempBytes = 0, outputBytes = 0;
+    uint64_t *compactedSize = nullptr;
+};
+
+static std::mutex gasBuildBuffersMutex;
+static std::vector<GASBuildBuffers> freeGASBuildBuffers;
+
+static void growBuildBuffer(void **ptr, size_t *bytes, size_t requiredBytes) {
+    if (requiredBytes <= *bytes)
+        return;
+    CUDA_CHECK(cudaFree(*ptr));
+    // Leave some slack so that a sequence of slightly larger builds doesn't
+    // reallocate every time.
+    *bytes = requiredBytes + requiredBytes / 4;
+    CUDA_CHECK(cudaMalloc(ptr, *bytes));
+    ++nGASBuildBufferAllocations;
+}
+
+static GASBuildBuffers acquireGASBuildBuffers(size_t tempBytes, size_t outputBytes) {
+    GASBuildBuffers buffers;
+    {
+        std::lock_guard<std::mutex> lock(gasBuildBuffersMutex);
+        if (!freeGASBuildBuffers.empty()) {
+            buffers = freeGASBuildBuffers.back();
+            freeGASBuildBuffers.pop_back();
+        }
+    }
+    if (!buffers.compactedSize)
+        CUDA_CHECK(cudaMalloc(&buffers.compactedSize, sizeof(uint64_t)));
+    growBuildBuffer(&buffers.temp, &buffers.tempBytes, tempBytes);
+    growBuildBuffer(&buffers.output, &buffers.outputBytes, outputBytes);
+    return buffers;
+}
+
+static void releaseGASBuildBuffers(const GASBuildBuffers &buffers) {
+    std::lock_guard<std::mutex> lock(gasBuildBuffersMutex);
+    freeGASBuildBuffers.push_back(buffers);
+}
+
+static void freeAllGASBuildBuffers() {
+    std::lock_guard<std::mutex> lock(gasBuildBuffersMutex);
+    for (const GASBuildBuffers &buffers : freeGASBuildBuffers) {
+        CUDA_CHECK(cudaFree(buffers.temp));
+        CUDA_CHECK(cudaFree(buffers.output));
+        CUDA_CHECK(cudaFree(buffers.compactedSize));
+    }
+    freeGASBuildBuffers.clear();
+}
 
 OptixTraversableHandle OptiXAggregate::buildOptixBVH(
     OptixDeviceContext optixContext, const std::vector<OptixBuildInput> &buildInputs,
@@ -121,54 +184,40 @@ OptixTraversableHandle OptiXAggregate::buildOptixBVH(
                                              buildInputs.data(), buildInputs.size(),
                                              &blasBufferSizes));
 
-    uint64_t *compactedSizePtr;
-    CUDA_CHECK(cudaMalloc(&compactedSizePtr, sizeof(uint64_t)));
+    // Get buffers from the pool.
+    GASBuildBuffers buffers = acquireGASBuildBuffers(blasBufferSizes.tempSizeInBytes,
+                                                     blasBufferSizes.outputSizeInBytes);
     OptixAccelEmitDesc emitDesc;
     emitDesc.type = OPTIX_PROPERTY_TYPE_COMPACTED_SIZE;
-    emitDesc.result = (CUdeviceptr)compactedSizePtr;
-
-    // Allocate buffers.
-    void *tempBuffer;
-    CUDA_CHECK(cudaMalloc(&tempBuffer, blasBufferSizes.tempSizeInBytes));
-    void *outputBuffer;
-    CUDA_CHECK(cudaMalloc(&outputBuffer, blasBufferSizes.outputSizeInBytes));
+    emitDesc.result = (CUdeviceptr)buffers.compactedSize;
 
     // Build.
     cudaStream_t buildStream = threadCUDAStreams.Get();
     OptixTraversableHandle traversableHandle{0};
     OPTIX_CHECK(optixAccelBuild(
         optixContext, buildStream, &accelOptions, buildInputs.data(), buildInputs.size(),
-        CUdeviceptr(tempBuffer), blasBufferSizes.tempSizeInBytes,
-        CUdeviceptr(outputBuffer), blasBufferSizes.outputSizeInBytes, &traversableHandle,
-        &emitDesc, 1));
-
-    CUDA_CHECK(cudaFree(tempBuffer));
+        CUdeviceptr(buffers.temp), blasBufferSizes.tempSizeInBytes,
+        CUdeviceptr(buffers.output), blasBufferSizes.outputSizeInBytes,
+        &traversableHandle, &emitDesc, 1));
+    ++nGASBuilds;
 
-    CUDA_CHECK(cudaStreamSynchronize(buildStream));
     uint64_t compactedSize;
-    CUDA_CHECK(cudaMemcpyAsync(&compactedSize, compactedSizePtr, sizeof(uint64_t),
+    CUDA_CHECK(cudaMemcpyAsync(&compactedSize, buffers.compactedSize, sizeof(uint64_t),
                                cudaMemcpyDeviceToHost, buildStream));
     CUDA_CHECK(cudaStreamSynchronize(buildStream));
+    gpuBVHUncompactedBytes += blasBufferSizes.outputSizeInBytes;
+    gpuBVHBytes += compactedSize;
+
+    // Compact the acceleration structure, even if that doesn't save space, so
+    // that the output buffer can return to the pool.
+    void *asBuffer;
+    CUDA_CHECK(cudaMalloc(&asBuffer, compactedSize));
+    OPTIX_CHECK(optixAccelCompact(optixContext, buildStream, traversableHandle,
+                                  CUdeviceptr(asBuffer), compactedSize,
+                                  &traversableHandle));
+    CUDA_CHECK(cudaStreamSynchronize(buildStream));
 
-    if (compactedSize >= blasBufferSizes.outputSizeInBytes) {
-        // No need to compact...
-        gpuBVHBytes += blasBufferSizes.outputSizeInBytes;
-    } else {
-        // Compact the acceleration structure
-        gpuBVHBytes += compactedSize;
-
-        void *asBuffer;
-        CUDA_CHECK(cudaMalloc(&asBuffer, compactedSize));
-
-        OPTIX_CHECK(optixAccelCompact(optixContext, buildStream, traversableHandle,
-                                      CUdeviceptr(asBuffer), compactedSize,
-                                      &traversableHandle));
-        CUDA_CHECK(cudaStreamSynchronize(buildStream));
-
-        CUDA_CHECK(cudaFree(outputBuffer));
-    }
-
-    CUDA_CHECK(cudaFree(compactedSizePtr));
+    releaseGASBuildBuffers(buffers);
 
     return traversableHandle;
 }
@@ -187,6 +236,26 @@ static Material getMaterial(const ShapeSceneEntity &shape,
     }
 }
 
+static bool hasSubsurfaceScattering(Material material) {
+    if (!material)
+        return false;
+    if (const MixMaterial *mix = material.CastOrNullptr<MixMaterial>())
+        return hasSubsurfaceScattering(mix->GetMaterial(0)) ||
+               hasSubsurfaceScattering(mix->GetMaterial(1));
+    return material.HasSubsurfaceScattering();
+}
+
+static bool inShapeSubset(const ShapeSceneEntity &shape,
+                          OptiXAggregate::ShapeSubset subset,
+                          const std::map<std::string, Material> &namedMaterials,
+                          const std::vector<Material> &materials) {
+    if (subset == OptiXAggregate::ShapeSubset::All)
+        return true;
+    bool subsurface =
+        hasSubsurfaceScattering(getMaterial(shape, namedMaterials, materials));
+    return subsurface == (subset == OptiXAggregate::ShapeSubset::Subsurface);
+}
+
 static FloatTexture getAlphaTexture(
     const ShapeSceneEntity &shape,
     const std::map<std::string, FloatTexture> &floatTextures, Allocator alloc) {
@@ -247,6 +316,62 @@ static MediumInterface *getMediumInterface(const ShapeSceneEntity &shape,
                                              getMedium(shape.outsideMedium));
 }
 
+STAT_MEMORY_COUNTER("Memory/Host-resident mesh buffers", hostResidentMeshBytes);
+
+// Returns true if the GPU can read managed memory that is resident on the
+// host; warns once if it can't, in which case --gpu-host-geometry is ignored.
+static bool hostGeometrySupported() {
+    static bool supported = [] {
+        int deviceIndex, concurrentManagedAccess;
+        CUDA_CHECK(cudaGetDevice(&deviceIndex));
+        CUDA_CHECK(cudaDeviceGetAttribute(&concurrentManagedAccess,
+                                          cudaDevAttrConcurrentManagedAccess,
+                                          deviceIndex));
+        if (!concurrentManagedAccess)
+            Warning("Ignoring --gpu-host-geometry: the GPU does not support "
+                    "concurrent access to managed memory.");
+        return concurrentManagedAccess != 0;
+    }();
+    return supported;
+}
+
+template <typename T>
+static void adviseHostResident(const T *ptr, size_t count) {
+    if (!ptr || count == 0)
+        return;
+    CUDATrackedMemoryResource::singleton.SetResidency(ptr, count * sizeof(T),
+                                                      GPUResidency::Host);
+    hostResidentMeshBytes += count * sizeof(T);
+}
+
+// Keeps a mesh's buffers in host memory; its GAS is built from separate
+// device copies, so only shading and the intersection programs' vertex
+// lookups read them across the bus.
+static void adviseHostResident(const TriangleMesh *mesh) {
+    if (!hostGeometrySupported())
+        return;
+    adviseHostResident(mesh->vertexIndices, 3 * size_t(mesh->nTriangles));
+    adviseHostResident(mesh->vertexIndices16, 3 * size_t(mesh->nTriangles));
+    adviseHostResident(mesh->faceIndices, size_t(mesh->nTriangles));
+    adviseHostResident(mesh->p, size_t(mesh->nVertices));
+    adviseHostResident(mesh->pQuantized, 3 * size_t(mesh->nVertices));
+    adviseHostResident(mesh->n, size_t(mesh->nVertices));
+    adviseHostResident(mesh->nOctahedral, size_t(mesh->nVertices));
+    adviseHostResident(mesh->s, size_t(mesh->nVertices));
+    adviseHostResident(mesh->uv, size_t(mesh->nVertices));
+    adviseHostResident(mesh->uvHalf, 2 * size_t(mesh->nVertices));
+}
+
+static void adviseHostResident(const BilinearPatchMesh *mesh) {
+    if (!mesh || !hostGeometrySupported())
+        return;
+    adviseHostResident(mesh->vertexIndices, 4 * size_t(mesh->nPatches));
+    adviseHostResident(mesh->faceIndices, size_t(mesh->nPatches));
+    adviseHostResident(mesh->p, size_t(mesh->nVertices));
+    adviseHostResident(mesh->n, size_t(mesh->nVertices));
+    adviseHostResident(mesh->uv, size_t(mesh->nVertices));
+}
+
 STAT_COUNTER("Geometry/Triangles added from displacement mapping", displacedTrisDelta);
 
 std::map<int, TriQuadMesh> OptiXAggregate::PreparePLYMeshes(
@@ -346,13 +471,14 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForTriangles(
     const std::vector<Material> &materials, const std::map<std::string, Medium> &media,
     const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
     ThreadLocal<Allocator> &threadAllocators,
-    ThreadLocal<cudaStream_t> &threadCUDAStreams) {
+    ThreadLocal<cudaStream_t> &threadCUDAStreams, ShapeSubset subset) {
     // Count how many of the shapes are triangle meshes
     std::vector<size_t> meshIndexToShapeIndex;
     for (size_t i = 0; i < shapes.size(); ++i) {
         const auto &shape = shapes[i];
-        if (shape.name == "trianglemesh" || shape.name == "plymesh" ||
-            shape.name == "loopsubdiv")
+        if ((shape.name == "trianglemesh" || shape.name == "plymesh" ||
+             shape.name == "loopsubdiv") &&
+            inShapeSubset(shape, subset, namedMaterials, materials))
             meshIndexToShapeIndex.push_back(i);
     }
 
@@ -387,9 +513,10 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForTriangles(
 
             // don't actually use this for now...
             std::string scheme = shape.parameters.GetOneString("scheme", "loop");
+            Float edgeLength = shape.parameters.GetOneFloat("edgelength", 0.f);
 
             mesh = LoopSubdivide(shape.renderFromObject, shape.reverseOrientation,
-                                 nLevels, vertexIndices, P, alloc);
+                                 nLevels, vertexIndices, P, alloc, edgeLength);
             CHECK(mesh != nullptr);
         } else if (shape.name == "plymesh") {
             auto plyIter = plyMeshes.find(shapeIndex);
@@ -538,6 +665,18 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForTriangles(
     bvh.traversableHandle =
         buildOptixBVH(optixContext, optixBuildInputs, threadCUDAStreams);
 
+    // The device copies of the vertices and indices are only needed to build
+    // the GAS; intersection and shading use the meshes' own buffers.
+    for (int meshIndex = 0; meshIndex < nMeshes; ++meshIndex) {
+        CUDA_CHECK(cudaFree((void *)pDeviceDevicePtrs[meshIndex]));
+        const OptixBuildInput &input = optixBuildInputs[meshIndex];
+        CUDA_CHECK(cudaFree((void *)input.triangleArray.indexBuffer));
+    }
+
+    if (Options->gpuHostGeometry)
+        for (const TriangleMesh *mesh : meshes)
+            adviseHostResident(mesh);
+
     return bvh;
 }
 
@@ -769,12 +908,13 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForBLPs(
     const std::vector<Material> &materials, const std::map<std::string, Medium> &media,
     const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
     ThreadLocal<Allocator> &threadAllocators,
-    ThreadLocal<cudaStream_t> &threadCUDAStreams) {
+    ThreadLocal<cudaStream_t> &threadCUDAStreams, ShapeSubset subset) {
     // Count how many BLP meshes there are in shapes
     std::vector<size_t> meshIndexToShapeIndex;
     for (size_t i = 0; i < shapes.size(); ++i) {
         const auto &shape = shapes[i];
-        if (shape.name == "bilinearmesh" || shape.name == "curve")
+        if ((shape.name == "bilinearmesh" || shape.name == "curve") &&
+            inShapeSubset(shape, subset, namedMaterials, materials))
             meshIndexToShapeIndex.push_back(i);
     }
 
@@ -906,6 +1046,10 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForBLPs(
 
     CUDA_CHECK(cudaFree(deviceAABBs));
 
+    if (Options->gpuHostGeometry)
+        for (const BilinearPatchMesh *mesh : meshes)
+            adviseHostResident(mesh);
+
     return bvh;
 }
 
@@ -918,11 +1062,12 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForQuadrics(
     const std::vector<Material> &materials, const std::map<std::string, Medium> &media,
     const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
     ThreadLocal<Allocator> &threadAllocators,
-    ThreadLocal<cudaStream_t> &threadCUDAStreams) {
+    ThreadLocal<cudaStream_t> &threadCUDAStreams, ShapeSubset subset) {
     int nQuadrics = 0;
     for (size_t shapeIndex = 0; shapeIndex < shapes.size(); ++shapeIndex) {
         const auto &s = shapes[shapeIndex];
-        if (s.name == "sphere" || s.name == "cylinder" || s.name == "disk")
+        if ((s.name == "sphere" || s.name == "cylinder" || s.name == "disk") &&
+            inShapeSubset(s, subset, namedMaterials, materials))
             ++nQuadrics;
     }
 
@@ -941,7 +1086,8 @@ OptiXAggregate::BVH OptiXAggregate::buildBVHForQuadrics(
     int quadricIndex = 0;
     for (size_t shapeIndex = 0; shapeIndex < shapes.size(); ++shapeIndex) {
         const auto &s = shapes[shapeIndex];
-        if (s.name != "sphere" && s.name != "cylinder" && s.name != "disk")
+        if ((s.name != "sphere" && s.name != "cylinder" && s.name != "disk") ||
+            !inShapeSubset(s, subset, namedMaterials, materials))
             continue;
 
         pstd::vector<Shape> shapes = Shape::Create(
@@ -1183,7 +1329,7 @@ OptiXAggregate::OptiXAggregate(
     const std::map<std::string, Medium> &media,
     const std::map<std::string, pbrt::Material> &namedMaterials,
     const std::vector<pbrt::Material> &materials)
-    : memoryResource(memoryResource), cudaStream(nullptr) {
+    : memoryResource(memoryResource) {
     CUcontext cudaContext;
     CU_CHECK(cuCtxGetCurrent(&cudaContext));
     CHECK(cudaContext != nullptr);
@@ -1386,37 +1532,58 @@ OptiXAggregate::OptiXAggregate(
         PreparePLYMeshes(scene.shapes, textures.floatTextures);
     LOG_VERBOSE("Finished reading PLY meshes");
 
+    // Shapes with subsurface-scattering materials are put in their own GASes
+    // so that their instances can be given _SubsurfaceVisibilityMask_.
+    bool haveSubsurface = false;
+    for (const auto &shape : scene.shapes)
+        haveSubsurface |=
+            hasSubsurfaceScattering(getMaterial(shape, namedMaterials, materials));
+
     struct GAS {
         BVH bvh;
         int sbtOffset;
+        unsigned int visibilityMask;
     };
-    AsyncJob<GAS> *triJob = RunAsync([&]() {
-        BVH triangleBVH = buildBVHForTriangles(
-            scene.shapes, plyMeshes, optixContext, hitPGTriangle, anyhitPGShadowTriangle,
-            hitPGRandomHitTriangle, textures.floatTextures, namedMaterials, materials,
-            media, shapeIndexToAreaLights, threadAllocators, threadCUDAStreams);
-        int sbtOffset = addHGRecords(triangleBVH);
-        return GAS{triangleBVH, sbtOffset};
-    });
-
-    AsyncJob<GAS> *blpJob = RunAsync([&]() {
-        BVH blpBVH =
-            buildBVHForBLPs(scene.shapes, optixContext, hitPGBilinearPatch,
-                            anyhitPGShadowBilinearPatch, hitPGRandomHitBilinearPatch,
-                            textures.floatTextures, namedMaterials, materials, media,
-                            shapeIndexToAreaLights, threadAllocators, threadCUDAStreams);
-        int bilinearSBTOffset = addHGRecords(blpBVH);
-        return GAS{blpBVH, bilinearSBTOffset};
-    });
-
-    AsyncJob<GAS> *quadricJob = RunAsync([&]() {
-        BVH quadricBVH = buildBVHForQuadrics(
-            scene.shapes, optixContext, hitPGQuadric, anyhitPGShadowQuadric,
-            hitPGRandomHitQuadric, textures.floatTextures, namedMaterials, materials,
-            media, shapeIndexToAreaLights, threadAllocators, threadCUDAStreams);
-        int quadricSBTOffset = addHGRecords(quadricBVH);
-        return GAS{quadricBVH, quadricSBTOffset};
-    });
+    std::vector<AsyncJob<GAS> *> gasJobs;
+    for (ShapeSubset subset :
+         haveSubsurface ? std::vector<ShapeSubset>{ShapeSubset::NoSubsurface,
+                                                   ShapeSubset::Subsurface}
+                        : std::vector<ShapeSubset>{ShapeSubset::All}) {
+        unsigned int visibilityMask =
+            subset == ShapeSubset::Subsurface
+                ? (SurfaceVisibilityMask | SubsurfaceVisibilityMask)
+                : SurfaceVisibilityMask;
+
+        gasJobs.push_back(RunAsync([&, subset, visibilityMask]() {
+            BVH triangleBVH = buildBVHForTriangles(
+                scene.shapes, plyMeshes, optixContext, hitPGTriangle,
+                anyhitPGShadowTriangle, hitPGRandomHitTriangle, textures.floatTextures,
+                namedMaterials, materials, media, shapeIndexToAreaLights,
+                threadAllocators, threadCUDAStreams, subset);
+            int sbtOffset = addHGRecords(triangleBVH);
+            return GAS{triangleBVH, sbtOffset, visibilityMask};
+        }));
+
+        gasJobs.push_back(RunAsync([&, subset, visibilityMask]() {
+            BVH blpBVH = buildBVHForBLPs(
+                scene.shapes, optixContext, hitPGBilinearPatch,
+                anyhitPGShadowBilinearPatch, hitPGRandomHitBilinearPatch,
+                textures.floatTextures, namedMaterials, materials, media,
+                shapeIndexToAreaLights, threadAllocators, threadCUDAStreams, subset);
+            int bilinearSBTOffset = addHGRecords(blpBVH);
+            return GAS{blpBVH, bilinearSBTOffset, visibilityMask};
+        }));
+
+        gasJobs.push_back(RunAsync([&, subset, visibilityMask]() {
+            BVH quadricBVH = buildBVHForQuadrics(
+                scene.shapes, optixContext, hitPGQuadric, anyhitPGShadowQuadric,
+                hitPGRandomHitQuadric, textures.floatTextures, namedMaterials,
+                materials, media, shapeIndexToAreaLights, threadAllocators,
+                threadCUDAStreams, subset);
+            int quadricSBTOffset = addHGRecords(quadricBVH);
+            return GAS{quadricBVH, quadricSBTOffset, visibilityMask};
+        }));
+    }
 
     ///////////////////////////////////////////////////////////////////////////
     // Create IASes for instance definitions
@@ -1425,6 +1592,7 @@ OptiXAggregate::OptiXAggregate(
         OptixTraversableHandle handles[3] = {};
         int sbtOffsets[3] = {-1, -1, -1};
         Bounds3f bounds;
+        unsigned int visibilityMask = SurfaceVisibilityMask;
 
         int NumValidHandles() const {
             return (handles[0] ? 1 : 0) + (handles[1] ? 1 : 0) + (handles[2] ? 1 : 0);
@@ -1450,6 +1618,9 @@ OptiXAggregate::OptiXAggregate(
                     def.second->animatedShapes.size(), def.first);
 
         Instance inst;
+        for (const auto &shape : def.second->shapes)
+            if (hasSubsurfaceScattering(getMaterial(shape, namedMaterials, materials)))
+                inst.visibilityMask |= SubsurfaceVisibilityMask;
 
         std::map<int, TriQuadMesh> meshes =
             PreparePLYMeshes(def.second->shapes, textures.floatTextures);
@@ -1525,21 +1696,21 @@ OptiXAggregate::OptiXAggregate(
     });
 
     std::vector<OptixInstance> iasInstances;
-    iasInstances.reserve(3 + totalOptixInstances);
+    iasInstances.reserve(gasJobs.size() + totalOptixInstances);
 
     // Consume futures for top-level non-instanced geometry acceleration structures.
     OptixInstance gasInstance = {};
     float identity[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
     memcpy(gasInstance.transform, identity, 12 * sizeof(float));
-    gasInstance.visibilityMask = 255;
     gasInstance.flags =
         OPTIX_INSTANCE_FLAG_NONE;  // TODO: OPTIX_INSTANCE_FLAG_DISABLE_ANYHIT
     LOG_VERBOSE("Starting to consume top-level GAS futures");
-    for (AsyncJob<GAS> *job : {triJob, blpJob, quadricJob}) {
+    for (AsyncJob<GAS> *job : gasJobs) {
         GAS gas = job->GetResult();
         if (gas.bvh.traversableHandle) {
             gasInstance.traversableHandle = gas.bvh.traversableHandle;
             gasInstance.sbtOffset = gas.sbtOffset;
+            gasInstance.visibilityMask = gas.visibilityMask;
             iasInstances.push_back(gasInstance);
 
             bounds = Union(bounds, gas.bvh.bounds);
@@ -1596,7 +1767,7 @@ OptiXAggregate::OptiXAggregate(
                 for (int j = 0; j < 3; ++j)
                     for (int k = 0; k < 4; ++k)
                         optixInstance.transform[4 * j + k] = renderFromInstance[j][k];
-                optixInstance.visibilityMask = 255;
+                optixInstance.visibilityMask = in.visibilityMask;
                 optixInstance.sbtOffset = in.sbtOffsets[i];
                 optixInstance.flags = OPTIX_INSTANCE_FLAG_NONE;  // TODO:
                 // OPTIX_INSTANCE_FLAG_DISABLE_ANYHIT
@@ -1627,6 +1798,9 @@ OptiXAggregate::OptiXAggregate(
     CUDA_CHECK(cudaFree((void *)instanceDevicePtr));
     LOG_VERBOSE("Finished building top-level IAS");
 
+    // All of the builds are done, so their pooled scratch memory can go.
+    freeAllGASBuildBuffers();
+
     LOG_VERBOSE("Finished creating shapes and acceleration structures");
 
     if (!scene.animatedShapes.empty())
@@ -1677,7 +1851,7 @@ OptiXAggregate::ParamBufferState &OptiXAggregate::getParamBuffer(
     // Copy to host-side pinned memory
     memcpy(pbs.hostPtr, &params, sizeof(params));
     CUDA_CHECK(cudaMemcpyAsync((void *)pbs.ptr, pbs.hostPtr, sizeof(params),
-                               cudaMemcpyHostToDevice));
+                               cudaMemcpyHostToDevice, GPULaunchStream()));
 
     return pbs;
 }
@@ -1692,7 +1866,7 @@ void OptiXAggregate::IntersectClosest(int maxRays, const RayQueue *rayQueue,
     std::pair<cudaEvent_t, cudaEvent_t> events =
         GetProfilerEvents("Trace closest hit rays");
 
-    cudaEventRecord(events.first);
+    GPURecordEvent(events.first);
 
     if (rootTraversable) {
         RayIntersectParameters params;
@@ -1714,10 +1888,10 @@ void OptiXAggregate::IntersectClosest(int maxRays, const RayQueue *rayQueue,
         nvtxRangePush("OptiXAggregate::IntersectClosest");
 #endif
 
-        OPTIX_CHECK(optixLaunch(optixPipeline, cudaStream, pbs.ptr,
+        OPTIX_CHECK(optixLaunch(optixPipeline, GPULaunchStream(), pbs.ptr,
                                 sizeof(RayIntersectParameters), &intersectSBT, maxRays, 1,
                                 1));
-        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent));
+        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent, GPULaunchStream()));
 
 #ifdef NVTX
         nvtxRangePop();
@@ -1728,14 +1902,14 @@ void OptiXAggregate::IntersectClosest(int maxRays, const RayQueue *rayQueue,
 #endif
     }
 
-    cudaEventRecord(events.second);
+    GPURecordEvent(events.second);
 };
 
 void OptiXAggregate::IntersectShadow(int maxRays, ShadowRayQueue *shadowRayQueue,
                                      SOA<PixelSampleState> *pixelSampleState) const {
     std::pair<cudaEvent_t, cudaEvent_t> events = GetProfilerEvents("Trace shadow rays");
 
-    cudaEventRecord(events.first);
+    GPURecordEvent(events.first);
 
     if (rootTraversable) {
         RayIntersectParameters params;
@@ -1752,10 +1926,10 @@ void OptiXAggregate::IntersectShadow(int maxRays, ShadowRayQueue *shadowRayQueue
         nvtxRangePush("OptiXAggregate::IntersectShadow");
 #endif
 
-        OPTIX_CHECK(optixLaunch(optixPipeline, cudaStream, pbs.ptr,
+        OPTIX_CHECK(optixLaunch(optixPipeline, GPULaunchStream(), pbs.ptr,
                                 sizeof(RayIntersectParameters), &shadowSBT, maxRays, 1,
                                 1));
-        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent));
+        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent, GPULaunchStream()));
 
 #ifdef NVTX
         nvtxRangePop();
@@ -1766,7 +1940,7 @@ void OptiXAggregate::IntersectShadow(int maxRays, ShadowRayQueue *shadowRayQueue
 #endif
     }
 
-    cudaEventRecord(events.second);
+    GPURecordEvent(events.second);
 }
 
 void OptiXAggregate::IntersectShadowTr(int maxRays, ShadowRayQueue *shadowRayQueue,
@@ -1774,7 +1948,7 @@ void OptiXAggregate::IntersectShadowTr(int maxRays, ShadowRayQueue *shadowRayQue
     std::pair<cudaEvent_t, cudaEvent_t> events =
         GetProfilerEvents("Tracing shadow Tr rays");
 
-    cudaEventRecord(events.first);
+    GPURecordEvent(events.first);
 
     if (rootTraversable) {
         RayIntersectParameters params;
@@ -1791,10 +1965,10 @@ void OptiXAggregate::IntersectShadowTr(int maxRays, ShadowRayQueue *shadowRayQue
         nvtxRangePush("OptiXAggregate::IntersectShadowTr");
 #endif
 
-        OPTIX_CHECK(optixLaunch(optixPipeline, cudaStream, pbs.ptr,
+        OPTIX_CHECK(optixLaunch(optixPipeline, GPULaunchStream(), pbs.ptr,
                                 sizeof(RayIntersectParameters), &shadowTrSBT, maxRays, 1,
                                 1));
-        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent));
+        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent, GPULaunchStream()));
 
 #ifdef NVTX
         nvtxRangePop();
@@ -1805,7 +1979,7 @@ void OptiXAggregate::IntersectShadowTr(int maxRays, ShadowRayQueue *shadowRayQue
 #endif
     }
 
-    cudaEventRecord(events.second);
+    GPURecordEvent(events.second);
 }
 
 void OptiXAggregate::IntersectOneRandom(
@@ -1813,7 +1987,7 @@ void OptiXAggregate::IntersectOneRandom(
     std::pair<cudaEvent_t, cudaEvent_t> events =
         GetProfilerEvents("Tracing subsurface scattering probe rays");
 
-    cudaEventRecord(events.first);
+    GPURecordEvent(events.first);
 
     if (rootTraversable) {
         RayIntersectParameters params;
@@ -1829,10 +2003,10 @@ void OptiXAggregate::IntersectOneRandom(
         nvtxRangePush("OptiXAggregate::IntersectOneRandom");
 #endif
 
-        OPTIX_CHECK(optixLaunch(optixPipeline, cudaStream, pbs.ptr,
+        OPTIX_CHECK(optixLaunch(optixPipeline, GPULaunchStream(), pbs.ptr,
                                 sizeof(RayIntersectParameters), &randomHitSBT, maxRays, 1,
                                 1));
-        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent));
+        CUDA_CHECK(cudaEventRecord(pbs.finishedEvent, GPULaunchStream()));
 
 #ifdef NVTX
         nvtxRangePop();
@@ -1843,7 +2017,7 @@ void OptiXAggregate::IntersectOneRandom(
 #endif
     }
 
-    cudaEventRecord(events.second);
+    GPURecordEvent(events.second);
 }
 
 }  // namespace pbrt
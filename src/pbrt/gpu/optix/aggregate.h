@@ -55,6 +55,10 @@ class OptiXAggregate : public WavefrontAggregate {
     void IntersectOneRandom(int maxRays,
                             SubsurfaceScatterQueue *subsurfaceScatterQueue) const;
 
+    // The shapes that a BVH is built for, according to whether their
+    // materials have subsurface scattering
+    enum class ShapeSubset { All, NoSubsurface, Subsurface };
+
     // WAR: The enclosing parent function ("PreparePLYMeshes") for an
     // extended __device__ lambda cannot have private or protected access
     // within its class, so it's public...
@@ -87,7 +91,8 @@ class OptiXAggregate : public WavefrontAggregate {
         const std::map<std::string, Medium> &media,
         const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
         ThreadLocal<Allocator> &threadAllocators,
-        ThreadLocal<cudaStream_t> &threadCUDAStreams);
+        ThreadLocal<cudaStream_t> &threadCUDAStreams,
+        ShapeSubset subset = ShapeSubset::All);
 
     static BilinearPatchMesh *diceCurveToBLP(const ShapeSceneEntity &shape, int nDiceU,
                                              int nDiceV, Allocator alloc);
@@ -102,7 +107,8 @@ class OptiXAggregate : public WavefrontAggregate {
         const std::map<std::string, Medium> &media,
         const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
         ThreadLocal<Allocator> &threadAllocators,
-        ThreadLocal<cudaStream_t> &threadCUDAStreams);
+        ThreadLocal<cudaStream_t> &threadCUDAStreams,
+        ShapeSubset subset = ShapeSubset::All);
 
     static BVH buildBVHForQuadrics(
         const std::vector<ShapeSceneEntity> &shapes, OptixDeviceContext optixContext,
@@ -114,7 +120,8 @@ class OptiXAggregate : public WavefrontAggregate {
         const std::map<std::string, Medium> &media,
         const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
         ThreadLocal<Allocator> &threadAllocators,
-        ThreadLocal<cudaStream_t> &threadCUDAStreams);
+        ThreadLocal<cudaStream_t> &threadCUDAStreams,
+        ShapeSubset subset = ShapeSubset::All);
 
     int addHGRecords(const BVH &bvh);
 
@@ -134,7 +141,6 @@ class OptiXAggregate : public WavefrontAggregate {
     CUDATrackedMemoryResource *memoryResource;
     std::mutex boundsMutex;
     Bounds3f bounds;
-    CUstream cudaStream;
     OptixDeviceContext optixContext;
     OptixModule optixModule;
     OptixPipeline optixPipeline;
@@ -74,7 +74,8 @@ Denoiser::Denoiser(Vector2i resolution, bool haveAlbedoAndNormal)
     CUDA_CHECK(cudaMalloc(&intensity, sizeof(float)));
 }
 
-void Denoiser::Denoise(RGB *rgb, Normal3f *n, RGB *albedo, RGB *result) {
+void Denoiser::Denoise(RGB *rgb, Normal3f *n, RGB *albedo, RGB *result,
+                       cudaStream_t stream) {
     std::array<OptixImage2D, 3> inputLayers;
     int nLayers = haveAlbedoAndNormal ? 3 : 1;
     for (int i = 0; i < nLayers; ++i) {
@@ -101,7 +102,7 @@ void Denoiser::Denoise(RGB *rgb, Normal3f *n, RGB *albedo, RGB *result) {
     outputImage.data = CUdeviceptr(result);
 
     OPTIX_CHECK(optixDenoiserComputeIntensity(
-        denoiserHandle, 0 /* stream */, &inputLayers[0], CUdeviceptr(intensity),
+        denoiserHandle, stream, &inputLayers[0], CUdeviceptr(intensity),
         CUdeviceptr(scratchBuffer), memorySizes.withoutOverlapScratchSizeInBytes));
 
     OptixDenoiserParams params = {};
@@ -116,7 +117,7 @@ void Denoiser::Denoise(RGB *rgb, Normal3f *n, RGB *albedo, RGB *result) {
     params.blendFactor = 0;  // TODO what should this be??
 
 #if (OPTIX_VERSION >= 70300)
-    OptixDenoiserGuideLayer guideLayer;
+    OptixDenoiserGuideLayer guideLayer = {};
     if (haveAlbedoAndNormal) {
         guideLayer.albedo = inputLayers[1];
         guideLayer.normal = inputLayers[2];
@@ -127,13 +128,13 @@ void Denoiser::Denoise(RGB *rgb, Normal3f *n, RGB *albedo, RGB *result) {
     layers.output = outputImage;
 
     OPTIX_CHECK(optixDenoiserInvoke(
-        denoiserHandle, 0 /* stream */, &params, CUdeviceptr(denoiserState),
+        denoiserHandle, stream, &params, CUdeviceptr(denoiserState),
         memorySizes.stateSizeInBytes, &guideLayer, &layers, 1 /* # layers to denoise */,
         0 /* offset x */, 0 /* offset y */, CUdeviceptr(scratchBuffer),
         memorySizes.withoutOverlapScratchSizeInBytes));
 #else
     OPTIX_CHECK(optixDenoiserInvoke(
-        denoiserHandle, 0 /* stream */, &params, CUdeviceptr(denoiserState),
+        denoiserHandle, stream, &params, CUdeviceptr(denoiserState),
         memorySizes.stateSizeInBytes, inputLayers.data(), nLayers, 0 /* offset x */,
         0 /* offset y */, &outputImage, CUdeviceptr(scratchBuffer),
         memorySizes.withoutOverlapScratchSizeInBytes));
@@ -10,6 +10,7 @@
 #include <pbrt/util/color.h>
 #include <pbrt/util/vecmath.h>
 
+#include <cuda_runtime.h>
 #include <optix.h>
 
 namespace pbrt {
@@ -20,7 +21,9 @@ class Denoiser {
 
     // All pointers should be to GPU memory.
     // |n| and |albedo| should be nullptr iff \haveAlbedoAndNormal| is false.
-    void Denoise(RGB *rgb, Normal3f *n, RGB *albedo, RGB *result);
+    // The work is issued asynchronously on |stream|.
+    void Denoise(RGB *rgb, Normal3f *n, RGB *albedo, RGB *result,
+                 cudaStream_t stream = 0);
 
   private:
     Vector2i resolution;
@@ -59,12 +59,13 @@ static __forceinline__ __device__ T *getPayload() {
 
 template <typename... Args>
 __device__ inline void Trace(OptixTraversableHandle traversable, Ray ray,
-                             Float tMax, OptixRayFlags flags, Args &&... payload) {
+                             Float tMax, unsigned int visibilityMask,
+                             OptixRayFlags flags, Args &&... payload) {
     static constexpr float eps = 1e-7f;
 
     optixTrace(traversable, make_float3(ray.o.x, ray.o.y, ray.o.z),
                make_float3(ray.d.x, ray.d.y, ray.d.z), eps, tMax, ray.time,
-               OptixVisibilityMask(255), flags, 0, /* ray type */
+               OptixVisibilityMask(visibilityMask), flags, 0, /* ray type */
                1,                                  /* number of ray types */
                0,                                  /* missSBTIndex */
                std::forward<Args>(payload)...);
@@ -112,7 +113,8 @@ extern "C" __global__ void __raygen__findClosest() {
         ray.d.y, ray.d.z, tMax);
 
     uint32_t missed = 0;
-    Trace(params.traversable, ray, tMax, OPTIX_RAY_FLAG_NONE, p0, p1, missed);
+    Trace(params.traversable, ray, tMax, AllVisibilityMask, OPTIX_RAY_FLAG_NONE, p0, p1,
+          missed);
 
     if (missed)
         EnqueueWorkAfterMiss(r, params.mediumSampleQueue, params.escapedRayQueue);
@@ -256,7 +258,8 @@ extern "C" __global__ void __raygen__shadow() {
              sr.ray.d.x, sr.ray.d.y, sr.ray.d.z);
 
     uint32_t missed = 0;
-    Trace(params.traversable, sr.ray, sr.tMax, OPTIX_RAY_FLAG_NONE, missed);
+    Trace(params.traversable, sr.ray, sr.tMax, AllVisibilityMask, OPTIX_RAY_FLAG_NONE,
+          missed);
 
     RecordShadowRayResult(sr, &params.pixelSampleState, !missed);
 }
@@ -282,7 +285,8 @@ extern "C" __global__ void __raygen__shadow_Tr() {
 
                            uint32_t missed = 0;
 
-                           Trace(params.traversable, ray, tMax, OPTIX_RAY_FLAG_NONE, p0, p1, missed);
+                           Trace(params.traversable, ray, tMax, AllVisibilityMask,
+                                 OPTIX_RAY_FLAG_NONE, p0, p1, missed);
 
                            return TransmittanceTraceResult{!missed, Point3f(ctx.piHit), ctx.material};
                        },
@@ -498,7 +502,9 @@ extern "C" __global__ void __raygen__randomHit() {
 
     int depth = 0;
     while (LengthSquared(ray.d) > 0 && ++depth < 100) {
-        Trace(params.traversable, ray, 1.f /* tMax */, OPTIX_RAY_FLAG_NONE, ptr0, ptr1);
+        // Only geometry with subsurface-scattering materials can be sampled
+        Trace(params.traversable, ray, 1.f /* tMax */, SubsurfaceVisibilityMask,
+              OPTIX_RAY_FLAG_NONE, ptr0, ptr1);
 
         if (payload.intr) {
             ray = payload.intr->SpawnRayTo(s.p1);
@@ -23,6 +23,13 @@ namespace pbrt {
 class TriangleMesh;
 class BilinearPatchMesh;
 
+// OptiX Visibility Masks
+// All geometry is visible to rays traced with _AllVisibilityMask_. Geometry
+// with subsurface-scattering materials is also in _SubsurfaceVisibilityMask_,
+// which BSSRDF probe rays use so that they skip the rest of the scene.
+constexpr unsigned int SurfaceVisibilityMask = 1, SubsurfaceVisibilityMask = 2;
+constexpr unsigned int AllVisibilityMask = 255;
+
 struct TriangleMeshRecord {
     const TriangleMesh *mesh;
     Material material;
@@ -9,8 +9,11 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
+#include <pbrt/util/string.h>
 
 #include <algorithm>
+#include <string>
 #include <vector>
 
 #ifdef NVTX
@@ -25,6 +28,9 @@
 
 namespace pbrt {
 
+STAT_COUNTER("GPU/Graphs instantiated", graphsInstantiated);
+STAT_COUNTER("GPU/Graph updates", graphUpdates);
+
 void GPUInit() {
     cudaFree(nullptr);
 
@@ -172,7 +178,18 @@ struct ProfilerEvent {
 static std::vector<ProfilerEvent> eventPool;
 static size_t eventPoolOffset = 0;
 
+// Stream that the _GPUGraph_ currently capturing launches records them from
+static cudaStream_t captureStream = nullptr;
+
+cudaStream_t GPULaunchStream() {
+    return captureStream;
+}
+
 std::pair<cudaEvent_t, cudaEvent_t> GetProfilerEvents(const char *description) {
+    // Don't time launches while they're being captured
+    if (captureStream)
+        return {nullptr, nullptr};
+
     if (eventPool.empty())
         eventPool.resize(1024);  // how many? This is probably more than we need...
 
@@ -200,6 +217,64 @@ std::pair<cudaEvent_t, cudaEvent_t> GetProfilerEvents(const char *description) {
     return {pe.start, pe.stop};
 }
 
+// GPUGraph Method Definitions
+GPUGraph::~GPUGraph() {
+    if (exec)
+        CUDA_CHECK(cudaGraphExecDestroy(exec));
+    if (stream)
+        CUDA_CHECK(cudaStreamDestroy(stream));
+}
+
+void GPUGraph::BeginCapture() {
+    CHECK(!captureStream);
+    if (!stream) {
+        // Use a blocking stream so that the graph's work is still ordered with
+        // respect to work on the default stream
+        CUDA_CHECK(cudaStreamCreate(&stream));
+        GPUNameStream(stream, "GRAPH_CAPTURE_STREAM");
+    }
+    CUDA_CHECK(cudaStreamBeginCapture(stream, cudaStreamCaptureModeRelaxed));
+    captureStream = stream;
+}
+
+void GPUGraph::EndCaptureAndLaunch(const char *description) {
+    CHECK(captureStream == stream);
+    cudaGraph_t graph;
+    CUDA_CHECK(cudaStreamEndCapture(stream, &graph));
+    captureStream = nullptr;
+
+    // Update the instantiated graph's parameters if its topology is unchanged
+    if (exec) {
+#if CUDART_VERSION >= 12000
+        cudaGraphExecUpdateResultInfo resultInfo;
+        cudaError_t err = cudaGraphExecUpdate(exec, graph, &resultInfo);
+#else
+        cudaGraphNode_t errorNode;
+        cudaGraphExecUpdateResult result;
+        cudaError_t err = cudaGraphExecUpdate(exec, graph, &errorNode, &result);
+#endif
+        if (err == cudaSuccess)
+            ++graphUpdates;
+        else {
+            // Clear the error and instantiate the new graph from scratch
+            LOG_VERBOSE("[%s]: graph topology changed; reinstantiating", description);
+            (void)cudaGetLastError();
+            CUDA_CHECK(cudaGraphExecDestroy(exec));
+            exec = nullptr;
+        }
+    }
+    if (!exec) {
+        CUDA_CHECK(cudaGraphInstantiateWithFlags(&exec, graph, 0));
+        ++graphsInstantiated;
+    }
+    CUDA_CHECK(cudaGraphDestroy(graph));
+
+    std::pair<cudaEvent_t, cudaEvent_t> events = GetProfilerEvents(description);
+    CUDA_CHECK(cudaEventRecord(events.first, stream));
+    CUDA_CHECK(cudaGraphLaunch(exec, stream));
+    CUDA_CHECK(cudaEventRecord(events.second, stream));
+}
+
 void GPUWait() {
     CUDA_CHECK(cudaDeviceSynchronize());
 }
@@ -208,13 +283,15 @@ void GPUMemset(void *ptr, int byte, size_t bytes) {
     CUDA_CHECK(cudaMemset(ptr, byte, bytes));
 }
 
-void ReportKernelStats() {
+static void drainProfilerEvents() {
     CUDA_CHECK(cudaDeviceSynchronize());
-
-    // Drain active profiler events
     for (size_t i = 0; i < eventPool.size(); ++i)
         if (eventPool[i].active)
             eventPool[i].Sync();
+}
+
+void ReportKernelStats() {
+    drainProfilerEvents();
 
     // Compute total milliseconds over all kernels and launches
     float totalMS = 0;
@@ -245,4 +322,25 @@ void ReportKernelStats() {
     Printf("\n");
 }
 
+std::string KernelStatsJSON() {
+    drainProfilerEvents();
+
+    std::vector<const KernelStats *> sorted(kernelStats.begin(), kernelStats.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const KernelStats *a, const KernelStats *b) {
+                  return a->sumMS > b->sumMS;
+              });
+
+    std::string json = "[";
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const KernelStats *stats = sorted[i];
+        json += StringPrintf(
+            "%s\n    { \"kernel\": %s, \"launches\": %d, \"ms\": %f, "
+            "\"minMS\": %f, \"maxMS\": %f }",
+            i == 0 ? "" : ",", QuoteJSONString(stats->description), stats->numLaunches,
+            stats->sumMS, stats->minMS, stats->maxMS);
+    }
+    return json + "\n  ]";
+}
+
 }  // namespace pbrt
@@ -12,7 +12,9 @@
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/progressreporter.h>
 
+#include <algorithm>
 #include <map>
+#include <string>
 #include <typeindex>
 #include <typeinfo>
 #include <utility>
@@ -50,8 +52,42 @@
 
 namespace pbrt {
 
+// Returns the stream that kernels are launched on: the default stream,
+// unless a _GPUGraph_ is capturing launches.
+cudaStream_t GPULaunchStream();
+
+// Returns a pair of events to record before and after a kernel launch to
+// measure its execution time. Both are null while a _GPUGraph_ is capturing
+// launches, in which case the graph launch is measured instead.
 std::pair<cudaEvent_t, cudaEvent_t> GetProfilerEvents(const char *description);
 
+inline void GPURecordEvent(cudaEvent_t event) {
+    if (event) {
+        CUDA_CHECK(cudaEventRecord(event, GPULaunchStream()));
+    }
+}
+
+// GPUGraph Definition
+// Captures the GPU work launched between _BeginCapture()_ and
+// _EndCaptureAndLaunch()_ into a CUDA graph, which is then launched in one
+// go. The graph is instantiated once; later captures of the same sequence of
+// launches only update the kernels' parameters. No host synchronization with
+// the GPU is allowed while capturing.
+class GPUGraph {
+  public:
+    GPUGraph() = default;
+    GPUGraph(const GPUGraph &) = delete;
+    GPUGraph &operator=(const GPUGraph &) = delete;
+    ~GPUGraph();
+
+    void BeginCapture();
+    void EndCaptureAndLaunch(const char *description);
+
+  private:
+    cudaStream_t stream = nullptr;
+    cudaGraphExec_t exec = nullptr;
+};
+
 template <typename F>
 inline int GetBlockSize(const char *description, F kernel) {
     // Note: this isn't reentrant, but that's fine for our purposes...
@@ -72,6 +108,30 @@ inline int GetBlockSize(const char *description, F kernel) {
     return blockSize;
 }
 
+// Returns the number of blocks of the given size that can be resident on the
+// current device at once for _kernel_.
+template <typename F>
+inline int GetPersistentGridSize(const char *description, F kernel, int blockSize) {
+    static std::map<std::type_index, int> kernelGridSizes;
+
+    std::type_index index = std::type_index(typeid(F));
+
+    auto iter = kernelGridSizes.find(index);
+    if (iter != kernelGridSizes.end())
+        return iter->second;
+
+    int device, nSMs, blocksPerSM;
+    CUDA_CHECK(cudaGetDevice(&device));
+    CUDA_CHECK(cudaDeviceGetAttribute(&nSMs, cudaDevAttrMultiProcessorCount, device));
+    CUDA_CHECK(cudaOccupancyMaxActiveBlocksPerMultiprocessor(&blocksPerSM, kernel,
+                                                             blockSize, 0));
+    int gridSize = std::max(1, nSMs * blocksPerSM);
+    kernelGridSizes[index] = gridSize;
+    LOG_VERBOSE("[%s]: persistent grid size %d", description, gridSize);
+
+    return gridSize;
+}
+
 #ifdef __NVCC__
 template <typename F>
 __global__ void Kernel(F func, int nItems) {
@@ -99,10 +159,52 @@ void GPUParallelFor(const char *description, int nItems, F func) {
 #ifdef PBRT_DEBUG_BUILD
     LOG_VERBOSE("Launching %s", description);
 #endif
-    cudaEventRecord(events.first);
+    GPURecordEvent(events.first);
     int gridSize = (nItems + blockSize - 1) / blockSize;
-    kernel<<<gridSize, blockSize>>>(func, nItems);
-    cudaEventRecord(events.second);
+    kernel<<<gridSize, blockSize, 0, GPULaunchStream()>>>(func, nItems);
+    GPURecordEvent(events.second);
+
+#ifdef PBRT_DEBUG_BUILD
+    CUDA_CHECK(cudaDeviceSynchronize());
+    LOG_VERBOSE("Post-sync %s", description);
+#endif
+#ifdef NVTX
+    nvtxRangePop();
+#endif
+}
+
+template <typename N, typename F>
+__global__ void PersistentKernel(N nItems, F func) {
+    // Loop over the items, strided by the number of threads in the grid
+    int n = nItems();
+    for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < n;
+         i += blockDim.x * gridDim.x)
+        func(i);
+}
+
+// Calls _func_ for each of the _nItems()_ items, evaluated on the GPU, of
+// which there are at most _maxItems_. No more threads are launched than can
+// be resident at once, so the cost of the launch is independent of
+// _maxItems_ when few items are present.
+template <typename N, typename F>
+void GPUPersistentParallelFor(const char *description, int maxItems, N nItems, F func) {
+#ifdef NVTX
+    nvtxRangePush(description);
+#endif
+    auto kernel = &PersistentKernel<N, F>;
+
+    int blockSize = GetBlockSize(description, kernel);
+    int gridSize = std::min((maxItems + blockSize - 1) / blockSize,
+                            GetPersistentGridSize(description, kernel, blockSize));
+    std::pair<cudaEvent_t, cudaEvent_t> events = GetProfilerEvents(description);
+
+#ifdef PBRT_DEBUG_BUILD
+    LOG_VERBOSE("Launching %s", description);
+#endif
+    GPURecordEvent(events.first);
+    if (gridSize > 0)
+        kernel<<<gridSize, blockSize, 0, GPULaunchStream()>>>(nItems, func);
+    GPURecordEvent(events.second);
 
 #ifdef PBRT_DEBUG_BUILD
     CUDA_CHECK(cudaDeviceSynchronize());
@@ -119,6 +221,9 @@ void GPUParallelFor(const char *description, int nItems, F func) {
 void GPUWait();
 
 void ReportKernelStats();
+// Returns the per-kernel timings that ReportKernelStats() prints as a JSON
+// array, most expensive first.
+std::string KernelStatsJSON();
 
 void GPUInit();
 void GPUThreadInit();
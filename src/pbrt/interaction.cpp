@@ -15,6 +15,7 @@
 #include <pbrt/util/math.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/rng.h>
+#include <pbrt/util/stats.h>
 
 #include <cmath>
 
@@ -156,21 +157,30 @@ PBRT_CPU_GPU RayDifferential SurfaceInteraction::SpawnRay(const RayDifferential
     return rd;
 }
 
+STAT_PIXEL_COUNTER("Integrator/Shading evaluations", nShadingEvaluations);
+
 BSDF SurfaceInteraction::GetBSDF(const RayDifferential &ray, SampledWavelengths &lambda,
                                  Camera camera, ScratchBuffer &scratchBuffer,
                                  Sampler sampler) {
+    PerfCounterScope _(PerfRegion::Shading);
+    ProfilerScope profile(ProfilePhase::Shading);
     // Estimate $(u,v)$ and position differentials at intersection point
     ComputeDifferentials(ray, camera, sampler.SamplesPerPixel());
 
+    // Evaluate all of the intersection's textures through a shared cache
+    TextureEvaluationCache textureCache;
+    CachingTextureEvaluator texEval(&textureCache);
+
     // Resolve _MixMaterial_ if necessary
     while (material.Is<MixMaterial>()) {
         MixMaterial *mix = material.Cast<MixMaterial>();
-        material = mix->ChooseMaterial(UniversalTextureEvaluator(), *this);
+        material = mix->ChooseMaterial(texEval, *this);
     }
 
     // Return unset _BSDF_ if surface has a null material
     if (!material)
         return {};
+    ++nShadingEvaluations;
 
     // Evaluate normal or bump map, if present
     FloatTexture displacement = material.GetDisplacement();
@@ -181,15 +191,14 @@ BSDF SurfaceInteraction::GetBSDF(const RayDifferential &ray, SampledWavelengths
         if (normalMap)
             NormalMap(*normalMap, *this, &dpdu, &dpdv);
         else
-            BumpMap(UniversalTextureEvaluator(), displacement, *this, &dpdu, &dpdv);
+            BumpMap(texEval, displacement, *this, &dpdu, &dpdv);
 
         Normal3f ns(Normalize(Cross(dpdu, dpdv)));
         SetShadingGeometry(ns, dpdu, dpdv, shading.dndu, shading.dndv, false);
     }
 
     // Return BSDF for surface interaction
-    BSDF bsdf =
-        material.GetBSDF(UniversalTextureEvaluator(), *this, lambda, scratchBuffer);
+    BSDF bsdf = material.GetBSDF(texEval, *this, lambda, scratchBuffer);
     if (bsdf && GetOptions().forceDiffuse) {
         // Override _bsdf_ with diffuse equivalent
         SampledSpectrum r = bsdf.rho(wo, {sampler.Get1D()}, {sampler.Get2D()});
@@ -201,13 +210,16 @@ BSDF SurfaceInteraction::GetBSDF(const RayDifferential &ray, SampledWavelengths
 BSSRDF SurfaceInteraction::GetBSSRDF(const RayDifferential &ray,
                                      SampledWavelengths &lambda, Camera camera,
                                      ScratchBuffer &scratchBuffer) {
+    TextureEvaluationCache textureCache;
+    CachingTextureEvaluator texEval(&textureCache);
+
     // Resolve _MixMaterial_ if necessary
     while (material.Is<MixMaterial>()) {
         MixMaterial *mix = material.Cast<MixMaterial>();
-        material = mix->ChooseMaterial(UniversalTextureEvaluator(), *this);
+        material = mix->ChooseMaterial(texEval, *this);
     }
 
-    return material.GetBSSRDF(UniversalTextureEvaluator(), *this, lambda, scratchBuffer);
+    return material.GetBSSRDF(texEval, *this, lambda, scratchBuffer);
 }
 
 PBRT_CPU_GPU SampledSpectrum SurfaceInteraction::Le(Vector3f w,
@@ -21,6 +21,7 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
 #include <pbrt/util/float.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
@@ -30,6 +31,8 @@
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <map>
+#include <memory>
 #include <mutex>
 
 namespace pbrt {
@@ -685,7 +688,8 @@ DiffuseAreaLight::DiffuseAreaLight(const Transform &renderFromLight,
                                    const MediumInterface &mediumInterface, Spectrum Le,
                                    Float scale, const Shape shape, FloatTexture alpha,
                                    Image im, const RGBColorSpace *imageColorSpace,
-                                   bool twoSided)
+                                   bool twoSided,
+                                   const PiecewiseConstant2D *emissionDistribution)
     : LightBase(
           [](FloatTexture alpha) {
               // Special case handling for area lights with constant zero-valued alpha
@@ -712,7 +716,8 @@ DiffuseAreaLight::DiffuseAreaLight(const Transform &renderFromLight,
       Lemit(LookupSpectrum(Le)),
       scale(scale),
       image(std::move(im)),
-      imageColorSpace(imageColorSpace) {
+      imageColorSpace(imageColorSpace),
+      emissionDistribution(emissionDistribution) {
     ++numAreaLights;
 
     if (image) {
@@ -736,13 +741,50 @@ DiffuseAreaLight::DiffuseAreaLight(const Transform &renderFromLight,
                 "Proceed at your own risk; your image may have errors.");
 }
 
+PiecewiseConstant2D DiffuseAreaLight::EmissionDistribution(const Image &image,
+                                                          Allocator alloc) {
+    // Take the maximum over each pixel's neighbors, since bilinear interpolation
+    // gives nonzero emission inside dark pixels that are next to bright ones
+    Array2D<Float> average = image.GetSamplingDistribution();
+    Array2D<Float> d(average.XSize(), average.YSize());
+    ParallelFor(0, d.YSize(), [&](int64_t y0, int64_t y1) {
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < d.XSize(); ++x) {
+                Float v = 0;
+                for (int yy = std::max(0, y - 1); yy <= std::min(d.YSize() - 1, y + 1);
+                     ++yy)
+                    for (int xx = std::max(0, x - 1);
+                         xx <= std::min(d.XSize() - 1, x + 1); ++xx)
+                        v = std::max(v, average(xx, yy));
+                d(x, y) = v;
+            }
+    });
+    return PiecewiseConstant2D(d, alloc);
+}
+
 PBRT_CPU_GPU pstd::optional<LightLiSample> DiffuseAreaLight::SampleLi(LightSampleContext ctx,
                                                          Point2f u,
                                                          SampledWavelengths lambda,
                                                          bool allowIncompletePDF) const {
     // Sample point on shape for _DiffuseAreaLight_
-    ShapeSampleContext shapeCtx(ctx.pi, ctx.n, ctx.ns, 0 /* time */);
-    pstd::optional<ShapeSample> ss = shape.Sample(shapeCtx, u);
+    pstd::optional<ShapeSample> ss;
+    if (emissionDistribution) {
+        // Sample the emission image and find the corresponding point on the shape
+        Float stPDF;
+        Point2f st = emissionDistribution->Sample(u, &stPDF);
+        ss = shape.Sample(Point2f(st[0], 1 - st[1]));
+        if (!ss || LengthSquared(ss->intr.p() - ctx.p()) == 0)
+            return {};
+        // Convert to solid angle PDF for the sampled point
+        Vector3f wi = Normalize(ss->intr.p() - ctx.p());
+        ss->pdf = stPDF / area * DistanceSquared(ctx.p(), ss->intr.p()) /
+                  AbsDot(ss->intr.n, wi);
+        if (IsInf(ss->pdf))
+            return {};
+    } else {
+        ShapeSampleContext shapeCtx(ctx.pi, ctx.n, ctx.ns, 0 /* time */);
+        ss = shape.Sample(shapeCtx, u);
+    }
     if (!ss || ss->pdf == 0 || LengthSquared(ss->intr.p() - ctx.p()) == 0)
         return {};
     DCHECK(!IsNaN(ss->pdf));
@@ -763,22 +805,67 @@ PBRT_CPU_GPU pstd::optional<LightLiSample> DiffuseAreaLight::SampleLi(LightSampl
 PBRT_CPU_GPU Float DiffuseAreaLight::PDF_Li(LightSampleContext ctx, Vector3f wi,
                                bool allowIncompletePDF) const {
     ShapeSampleContext shapeCtx(ctx.pi, ctx.n, ctx.ns, 0 /* time */);
-    return shape.PDF(shapeCtx, wi);
+    if (!emissionDistribution)
+        return shape.PDF(shapeCtx, wi);
+
+    // Find the point on the shape along _wi_ and return its emission-based PDF
+    pstd::optional<ShapeIntersection> isect = shape.Intersect(shapeCtx.SpawnRay(wi));
+    if (!isect)
+        return 0;
+    Point2f uv = isect->intr.uv;
+    Float pdf = emissionDistribution->PDF(Point2f(uv[0], 1 - uv[1])) / area *
+                DistanceSquared(ctx.p(), isect->intr.p()) / AbsDot(isect->intr.n, wi);
+    return IsInf(pdf) ? 0 : pdf;
+}
+
+// DiffuseAreaLightImageAverages Definition
+// Caches the most recent average emission and channel value that each thread
+// computed for a light's image. Lights that share an image's pixels, as all
+// of the triangles of an image-textured emissive mesh do, then only need to
+// loop over the image once.
+struct DiffuseAreaLightImageAverages {
+    const void *pixels = nullptr;
+    Point2i resolution;
+    const RGBColorSpace *colorSpace = nullptr;
+    pstd::optional<SampledWavelengths> lambda;
+    SampledSpectrum L;
+    pstd::optional<Float> channelAverage;
+};
+
+static DiffuseAreaLightImageAverages &GetImageAverages(const Image &image,
+                                                       const RGBColorSpace *colorSpace) {
+    static thread_local DiffuseAreaLightImageAverages averages;
+    const void *pixels = image.RawPointer({0, 0});
+    if (pixels != averages.pixels || image.Resolution() != averages.resolution ||
+        colorSpace != averages.colorSpace) {
+        averages = DiffuseAreaLightImageAverages();
+        averages.pixels = pixels;
+        averages.resolution = image.Resolution();
+        averages.colorSpace = colorSpace;
+    }
+    return averages;
 }
 
 SampledSpectrum DiffuseAreaLight::Phi(SampledWavelengths lambda) const {
     SampledSpectrum L(0.f);
     if (image) {
-        // Compute average light image emission
-        for (int y = 0; y < image.Resolution().y; ++y)
-            for (int x = 0; x < image.Resolution().x; ++x) {
-                RGB rgb;
-                for (int c = 0; c < 3; ++c)
-                    rgb[c] = image.GetChannel({x, y}, c);
-                L += RGBIlluminantSpectrum(*imageColorSpace, ClampZero(rgb))
-                         .Sample(lambda);
-            }
-        L *= scale / (image.Resolution().x * image.Resolution().y);
+        DiffuseAreaLightImageAverages &averages =
+            GetImageAverages(image, imageColorSpace);
+        if (!averages.lambda || *averages.lambda != lambda) {
+            // Compute average light image emission
+            SampledSpectrum sum(0.f);
+            for (int y = 0; y < image.Resolution().y; ++y)
+                for (int x = 0; x < image.Resolution().x; ++x) {
+                    RGB rgb;
+                    for (int c = 0; c < 3; ++c)
+                        rgb[c] = image.GetChannel({x, y}, c);
+                    sum += RGBIlluminantSpectrum(*imageColorSpace, ClampZero(rgb))
+                               .Sample(lambda);
+                }
+            averages.lambda = lambda;
+            averages.L = sum / (image.Resolution().x * image.Resolution().y);
+        }
+        L = averages.L * scale;
 
     } else
         L = Lemit->Sample(lambda) * scale;
@@ -789,13 +876,20 @@ pstd::optional<LightBounds> DiffuseAreaLight::Bounds() const {
     // Compute _phi_ for diffuse area light bounds
     Float phi = 0;
     if (image) {
-        // Compute average _DiffuseAreaLight_ image channel value
-        // Assume no distortion in the mapping, FWIW...
-        for (int y = 0; y < image.Resolution().y; ++y)
-            for (int x = 0; x < image.Resolution().x; ++x)
-                for (int c = 0; c < 3; ++c)
-                    phi += image.GetChannel({x, y}, c);
-        phi /= 3 * image.Resolution().x * image.Resolution().y;
+        DiffuseAreaLightImageAverages &averages =
+            GetImageAverages(image, imageColorSpace);
+        if (!averages.channelAverage) {
+            // Compute average _DiffuseAreaLight_ image channel value
+            // Assume no distortion in the mapping, FWIW...
+            Float sum = 0;
+            for (int y = 0; y < image.Resolution().y; ++y)
+                for (int x = 0; x < image.Resolution().x; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        sum += image.GetChannel({x, y}, c);
+            averages.channelAverage = sum / (3 * image.Resolution().x *
+                                             image.Resolution().y);
+        }
+        phi = *averages.channelAverage;
 
     } else
         phi = Lemit->MaxValue();
@@ -865,6 +959,88 @@ std::string DiffuseAreaLight::ToString() const {
                         twoSided ? "true" : "false", area, image);
 }
 
+// DiffuseAreaLightImage Definition
+struct DiffuseAreaLightImage {
+    std::shared_ptr<const Image> image;
+    const RGBColorSpace *colorSpace;
+    Float averageLuminance;
+};
+
+// Returns the R, G, and B channels of the given image. Emissive meshes have a
+// separate light for each triangle, so each image is only read and validated
+// once.
+static DiffuseAreaLightImage ReadDiffuseAreaLightImage(const std::string &filename,
+                                                       const FileLoc *loc) {
+    static std::mutex mutex;
+    static std::map<std::string, DiffuseAreaLightImage> images;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (auto iter = images.find(filename); iter != images.end())
+            return iter->second;
+    }
+
+    ImageAndMetadata im = Image::Read(filename);
+
+    if (im.image.HasAnyInfinitePixels())
+        ErrorExit(
+            loc,
+            "%s: image has infinite pixel values and so is not suitable as a light.",
+            filename);
+    if (im.image.HasAnyNaNPixels())
+        ErrorExit(loc,
+                  "%s: image has not-a-number pixel values and so is not suitable as "
+                  "a light.",
+                  filename);
+
+    ImageChannelDesc channelDesc = im.image.GetChannelDesc({"R", "G", "B"});
+    if (!channelDesc)
+        ErrorExit(loc,
+                  "%s: Image provided to \"diffuse\" area light must have "
+                  "R, G, and B channels.",
+                  filename);
+    DiffuseAreaLightImage rgbImage;
+    rgbImage.image = std::make_shared<const Image>(im.image.SelectChannels(channelDesc));
+    rgbImage.colorSpace = im.metadata.GetColorSpace();
+
+    // Compute the image's average luminance for lights with a specified power
+    const Image &image = *rgbImage.image;
+    RGB lum = rgbImage.colorSpace->LuminanceVector();
+    rgbImage.averageLuminance = 0;
+    // Assume no distortion in the mapping, FWIW...
+    for (int y = 0; y < image.Resolution().y; ++y)
+        for (int x = 0; x < image.Resolution().x; ++x) {
+            for (int c = 0; c < 3; ++c)
+                rgbImage.averageLuminance += image.GetChannel({x, y}, c) * lum[c];
+        }
+    rgbImage.averageLuminance /= image.Resolution().x * image.Resolution().y;
+
+    // Use the first image read if another thread read it concurrently
+    std::lock_guard<std::mutex> lock(mutex);
+    return images.insert({filename, rgbImage}).first->second;
+}
+
+// Returns a distribution over the $(s,t)$ coordinates of the given light image
+// that is proportional to its emission, building it the first time that it is
+// requested for the image.
+static const PiecewiseConstant2D *GetEmissionDistribution(const std::string &filename,
+                                                          const Image &image) {
+    static std::mutex mutex;
+    static std::map<std::string, const PiecewiseConstant2D *> distributions;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (auto iter = distributions.find(filename); iter != distributions.end())
+        return iter->second;
+
+    Allocator alloc =
+#ifdef PBRT_BUILD_GPU_RENDERER
+        Options->useGPU ? Allocator(&CUDATrackedMemoryResource::singleton) :
+#endif
+                        Allocator{};
+    const PiecewiseConstant2D *distrib = alloc.new_object<PiecewiseConstant2D>(
+        DiffuseAreaLight::EmissionDistribution(image, alloc));
+    distributions[filename] = distrib;
+    return distrib;
+}
+
 DiffuseAreaLight *DiffuseAreaLight::Create(const Transform &renderFromLight,
                                            Medium medium,
                                            const ParameterDictionary &parameters,
@@ -874,35 +1050,37 @@ DiffuseAreaLight *DiffuseAreaLight::Create(const Transform &renderFromLight,
     Spectrum L = parameters.GetOneSpectrum("L", nullptr, SpectrumType::Illuminant, alloc);
     Float scale = parameters.GetOneFloat("scale", 1);
     bool twoSided = parameters.GetOneBool("twosided", false);
+    bool sampleEmission = parameters.GetOneBool("sampleemission", false);
 
     std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
     Image image(alloc);
     const RGBColorSpace *imageColorSpace = nullptr;
+    Float imageAverageLuminance = 0;
+    const PiecewiseConstant2D *emissionDistribution = nullptr;
     if (!filename.empty()) {
         if (L)
             ErrorExit(loc, "Both \"L\" and \"filename\" specified for DiffuseAreaLight.");
-        ImageAndMetadata im = Image::Read(filename, alloc);
-
-        if (im.image.HasAnyInfinitePixels())
-            ErrorExit(
-                loc,
-                "%s: image has infinite pixel values and so is not suitable as a light.",
-                filename);
-        if (im.image.HasAnyNaNPixels())
-            ErrorExit(loc,
-                      "%s: image has not-a-number pixel values and so is not suitable as "
-                      "a light.",
-                      filename);
-
-        ImageChannelDesc channelDesc = im.image.GetChannelDesc({"R", "G", "B"});
-        if (!channelDesc)
-            ErrorExit(loc,
-                      "%s: Image provided to \"diffuse\" area light must have "
-                      "R, G, and B channels.",
-                      filename);
-        image = im.image.SelectChannels(channelDesc, alloc);
-
-        imageColorSpace = im.metadata.GetColorSpace();
+        DiffuseAreaLightImage im = ReadDiffuseAreaLightImage(filename, loc);
+        const Image &rgbImage = *im.image;
+        if (!Options->useGPU)
+            // Share the image's pixels with the other lights that use it
+            image = Image(rgbImage.Format(), rgbImage.Resolution(),
+                          rgbImage.ChannelNames(), rgbImage.Encoding(),
+                          rgbImage.RawPointer({0, 0}), im.image);
+        else
+            image = rgbImage.SelectChannels(rgbImage.AllChannelsDesc(), alloc);
+        imageColorSpace = im.colorSpace;
+        imageAverageLuminance = im.averageLuminance;
+
+        // Sample rectangular emitters according to the image's emission if requested
+        if (sampleEmission) {
+            const BilinearPatch *blp = shape.CastOrNullptr<BilinearPatch>();
+            if (blp && blp->IsUniformlyParameterized())
+                emissionDistribution = GetEmissionDistribution(filename, rgbImage);
+            else
+                Warning(loc, "\"sampleemission\" is only supported for rectangular "
+                             "bilinear patches without \"uv\" coordinates.");
+        }
     } else if (!L)
         L = &colorSpace->illuminant;
 
@@ -915,19 +1093,7 @@ DiffuseAreaLight *DiffuseAreaLight::Create(const Transform &renderFromLight,
         // distribution and texture and is used to normalize the emitted
         // radiance such that the user-defined power will be the actual power
         // emitted by the light.
-        Float k_e = 1;
-        if (image) {
-            // Get the appropriate luminance vector from the image colour space
-            RGB lum = imageColorSpace->LuminanceVector();
-            k_e = 0;
-            // Assume no distortion in the mapping, FWIW...
-            for (int y = 0; y < image.Resolution().y; ++y)
-                for (int x = 0; x < image.Resolution().x; ++x) {
-                    for (int c = 0; c < 3; ++c)
-                        k_e += image.GetChannel({x, y}, c) * lum[c];
-                }
-            k_e /= image.Resolution().x * image.Resolution().y;
-        }
+        Float k_e = image ? imageAverageLuminance : 1;
 
         k_e *= (twoSided ? 2 : 1) * shape.Area() * Pi;
 
@@ -937,7 +1103,7 @@ DiffuseAreaLight *DiffuseAreaLight::Create(const Transform &renderFromLight,
 
     return alloc.new_object<DiffuseAreaLight>(renderFromLight, medium, L, scale, shape,
                                               alphaTex, std::move(image), imageColorSpace,
-                                              twoSided);
+                                              twoSided, emissionDistribution);
 }
 
 // UniformInfiniteLight Method Definitions
@@ -1003,16 +1169,54 @@ std::string UniformInfiniteLight::ToString() const {
     return StringPrintf("[ UniformInfiniteLight %s Lemit: %s ]", BaseToString(), Lemit);
 }
 
+// ImageInfiniteLight Method Definitions
+// ImageInfiniteLightDistributions Method Definitions
+STAT_COUNTER("Scene/Image infinite light distributions", nImageInfiniteDistributions);
+
+const ImageInfiniteLightDistributions *ImageInfiniteLightDistributions::Get(
+    const Array2D<Float> &d, Allocator alloc) {
+    struct DistributionsHash {
+        size_t operator()(const ImageInfiniteLightDistributions &d) const {
+            return d.hash;
+        }
+    };
+    static InternCache<ImageInfiniteLightDistributions, DistributionsHash> *cache =
+        new InternCache<ImageInfiniteLightDistributions, DistributionsHash>(alloc);
+
+    auto create = [&d](Allocator alloc, const ImageInfiniteLightDistributions &key) {
+        ++nImageInfiniteDistributions;
+        ImageInfiniteLightDistributions *dists =
+            alloc.new_object<ImageInfiniteLightDistributions>(key.hash, key.resolution,
+                                                              alloc);
+        Bounds2f domain = Bounds2f(Point2f(0, 0), Point2f(1, 1));
+        dists->distribution = PiecewiseConstant2D(d, domain, alloc);
+
+        // Initialize compensated PDF for image infinite area light
+        Array2D<Float> dc = d;
+        Float average = std::accumulate(dc.begin(), dc.end(), 0.) / dc.size();
+        for (Float &v : dc)
+            v = std::max<Float>(v - average, 0);
+        if (std::all_of(dc.begin(), dc.end(), [](Float v) { return v == 0; }))
+            std::fill(dc.begin(), dc.end(), Float(1));
+        dists->compensatedDistribution = PiecewiseConstant2D(dc, domain, alloc);
+        imageBytes += dists->distribution.BytesUsed() +
+                      dists->compensatedDistribution.BytesUsed();
+        return dists;
+    };
+    uint64_t hash = HashBuffer(d.begin(), d.size() * sizeof(Float));
+    return cache->Lookup(
+        ImageInfiniteLightDistributions(hash, Point2i(d.XSize(), d.YSize())), create);
+}
+
 // ImageInfiniteLight Method Definitions
 ImageInfiniteLight::ImageInfiniteLight(Transform renderFromLight, Image im,
                                        const RGBColorSpace *imageColorSpace, Float scale,
-                                       std::string filename, Allocator alloc)
+                                       std::string filename, int samplingResolution,
+                                       Allocator alloc)
     : LightBase(LightType::Infinite, renderFromLight, MediumInterface()),
       image(std::move(im)),
       imageColorSpace(imageColorSpace),
-      scale(scale),
-      distribution(alloc),
-      compensatedDistribution(alloc) {
+      scale(scale) {
     // ImageInfiniteLight constructor implementation
     // Initialize sampling PDFs for image infinite area light
     ImageChannelDesc channelDesc = image.GetChannelDesc({"R", "G", "B"});
@@ -1026,17 +1230,14 @@ ImageInfiniteLight::ImageInfiniteLight(Transform renderFromLight, Image im,
         ErrorExit("%s: image resolution (%d, %d) is non-square. It's unlikely "
                   "this is an equal area environment map.",
                   filename, image.Resolution().x, image.Resolution().y);
-    Array2D<Float> d = image.GetSamplingDistribution();
-    Bounds2f domain = Bounds2f(Point2f(0, 0), Point2f(1, 1));
-    distribution = PiecewiseConstant2D(d, domain, alloc);
-
-    // Initialize compensated PDF for image infinite area light
-    Float average = std::accumulate(d.begin(), d.end(), 0.) / d.size();
-    for (Float &v : d)
-        v = std::max<Float>(v - average, 0);
-    if (std::all_of(d.begin(), d.end(), [](Float v) { return v == 0; }))
-        std::fill(d.begin(), d.end(), Float(1));
-    compensatedDistribution = PiecewiseConstant2D(d, domain, alloc);
+    int res = std::min(image.Resolution().x, samplingResolution);
+    Array2D<Float> d = image.GetSamplingDistribution(
+        [](Point2f) { return Float(1); }, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+        Point2i(res, res));
+    const ImageInfiniteLightDistributions *dists =
+        ImageInfiniteLightDistributions::Get(d, alloc);
+    distribution = &dists->distribution;
+    compensatedDistribution = &dists->compensatedDistribution;
 }
 
 PBRT_CPU_GPU Float ImageInfiniteLight::PDF_Li(LightSampleContext ctx, Vector3f w,
@@ -1045,9 +1246,9 @@ PBRT_CPU_GPU Float ImageInfiniteLight::PDF_Li(LightSampleContext ctx, Vector3f w
     Point2f uv = EqualAreaSphereToSquare(wLight);
     Float pdf = 0;
     if (allowIncompletePDF)
-        pdf = compensatedDistribution.PDF(uv);
+        pdf = compensatedDistribution->PDF(uv);
     else
-        pdf = distribution.PDF(uv);
+        pdf = distribution->PDF(uv);
     return pdf / (4 * Pi);
 }
 
@@ -1075,7 +1276,7 @@ PBRT_CPU_GPU pstd::optional<LightLeSample> ImageInfiniteLight::SampleLe(Point2f
                                                            Float time) const {
     // Sample infinite light image and compute ray direction _w_
     Float mapPDF;
-    pstd::optional<Point2f> uv = distribution.Sample(u1, &mapPDF);
+    pstd::optional<Point2f> uv = distribution->Sample(u1, &mapPDF);
     if (!uv)
         return {};
     Vector3f wLight = EqualAreaSquareToSphere(*uv);
@@ -1096,7 +1297,7 @@ PBRT_CPU_GPU pstd::optional<LightLeSample> ImageInfiniteLight::SampleLe(Point2f
 
 PBRT_CPU_GPU void ImageInfiniteLight::PDF_Le(const Ray &ray, Float *pdfPos, Float *pdfDir) const {
     Vector3f wl = -renderFromLight.ApplyInverse(ray.d);
-    Float mapPDF = distribution.PDF(EqualAreaSphereToSquare(wl));
+    Float mapPDF = distribution->PDF(EqualAreaSphereToSquare(wl));
     *pdfDir = mapPDF / (4 * Pi);
     *pdfPos = 1 / (Pi * Sqr(sceneRadius));
 }
@@ -1109,7 +1310,7 @@ std::string ImageInfiniteLight::ToString() const {
 PortalImageInfiniteLight::PortalImageInfiniteLight(
     const Transform &renderFromLight, Image equalAreaImage,
     const RGBColorSpace *imageColorSpace, Float scale, const std::string &filename,
-    std::vector<Point3f> p, Allocator alloc)
+    std::vector<Point3f> p, int samplingResolution, Allocator alloc)
     : LightBase(LightType::Infinite, renderFromLight, MediumInterface()),
       image(alloc),
       imageColorSpace(imageColorSpace),
@@ -1176,7 +1377,9 @@ PortalImageInfiniteLight::PortalImageInfiniteLight(
         (void)RenderFromImage(p, &duv_dw);
         return duv_dw;
     };
-    Array2D<Float> d = image.GetSamplingDistribution(duv_dw);
+    int res = std::min(image.Resolution().x, samplingResolution);
+    Array2D<Float> d = image.GetSamplingDistribution(
+        duv_dw, Bounds2f(Point2f(0, 0), Point2f(1, 1)), Point2i(res, res));
     distribution = WindowedPiecewiseConstant2D(d, alloc);
 }
 
@@ -1532,6 +1735,12 @@ Light Light::Create(const std::string &name, const ParameterDictionary &paramete
         std::vector<Point3f> portal = parameters.GetPoint3fArray("portal");
         std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
         Float E_v = parameters.GetOneFloat("illuminance", -1);
+        // Environment maps' sampling distributions are built at no more than
+        // this resolution
+        int samplingResolution = parameters.GetOneInt("samplingresolution", 4096);
+        if (samplingResolution < 1)
+            ErrorExit(loc, "%d: \"samplingresolution\" must be at least one.",
+                      samplingResolution);
 
         if (L.empty() && filename.empty() && portal.empty()) {
             // Scale the light spectrum to be equivalent to 1 nit
@@ -1655,11 +1864,11 @@ Light Light::Create(const std::string &name, const ParameterDictionary &paramete
 
                 light = alloc.new_object<PortalImageInfiniteLight>(
                     renderFromLight, std::move(image), colorSpace, scale, filename,
-                    portal, alloc);
+                    portal, samplingResolution, alloc);
             } else
-                light = alloc.new_object<ImageInfiniteLight>(renderFromLight,
-                                                             std::move(image), colorSpace,
-                                                             scale, filename, alloc);
+                light = alloc.new_object<ImageInfiniteLight>(
+                    renderFromLight, std::move(image), colorSpace, scale, filename,
+                    samplingResolution, alloc);
         }
     } else
         ErrorExit(loc, "%s: light type unknown.", name);
@@ -412,7 +412,8 @@ class DiffuseAreaLight : public LightBase {
     DiffuseAreaLight(const Transform &renderFromLight,
                      const MediumInterface &mediumInterface, Spectrum Le, Float scale,
                      const Shape shape, FloatTexture alpha, Image image,
-                     const RGBColorSpace *imageColorSpace, bool twoSided);
+                     const RGBColorSpace *imageColorSpace, bool twoSided,
+                     const PiecewiseConstant2D *emissionDistribution = nullptr);
 
     static DiffuseAreaLight *Create(const Transform &renderFromLight, Medium medium,
                                     const ParameterDictionary &parameters,
@@ -420,6 +421,10 @@ class DiffuseAreaLight : public LightBase {
                                     Allocator alloc, const Shape shape,
                                     FloatTexture alpha);
 
+    // Returns a distribution over an emission image's $(s,t)$ coordinates that
+    // covers all of the points where its bilinearly interpolated RGB is nonzero.
+    static PiecewiseConstant2D EmissionDistribution(const Image &image, Allocator alloc);
+
     void Preprocess(const Bounds3f &sceneBounds) {}
 
     SampledSpectrum Phi(SampledWavelengths lambda) const;
@@ -479,6 +484,9 @@ class DiffuseAreaLight : public LightBase {
     Float scale;
     Image image;
     const RGBColorSpace *imageColorSpace;
+    // Distribution over the image's $(s,t)$ for sampling rectangular emitters
+    // according to emission; may be shared with other lights that use the image.
+    const PiecewiseConstant2D *emissionDistribution;
 
     // DiffuseAreaLight Private Methods
     PBRT_CPU_GPU
@@ -542,13 +550,38 @@ class UniformInfiniteLight : public LightBase {
     Float sceneRadius;
 };
 
+// ImageInfiniteLightDistributions Definition
+struct ImageInfiniteLightDistributions {
+    ImageInfiniteLightDistributions(uint64_t hash, Point2i resolution,
+                                    Allocator alloc = {})
+        : hash(hash),
+          resolution(resolution),
+          distribution(alloc),
+          compensatedDistribution(alloc) {}
+
+    // Returns the distributions for the sampling function _d_, building them
+    // the first time that a function with its values is requested so that
+    // lights that share an environment map also share its distributions.
+    static const ImageInfiniteLightDistributions *Get(const Array2D<Float> &d,
+                                                      Allocator alloc);
+
+    bool operator==(const ImageInfiniteLightDistributions &d) const {
+        return hash == d.hash && resolution == d.resolution;
+    }
+
+    // ImageInfiniteLightDistributions Public Members
+    uint64_t hash;
+    Point2i resolution;
+    PiecewiseConstant2D distribution, compensatedDistribution;
+};
+
 // ImageInfiniteLight Definition
 class ImageInfiniteLight : public LightBase {
   public:
     // ImageInfiniteLight Public Methods
     ImageInfiniteLight(Transform renderFromLight, Image image,
                        const RGBColorSpace *imageColorSpace, Float scale,
-                       std::string filename, Allocator alloc);
+                       std::string filename, int samplingResolution, Allocator alloc);
 
     void Preprocess(const Bounds3f &sceneBounds) {
         sceneBounds.BoundingSphere(&sceneCenter, &sceneRadius);
@@ -587,9 +620,9 @@ class ImageInfiniteLight : public LightBase {
         Float mapPDF = 0;
         Point2f uv;
         if (allowIncompletePDF)
-            uv = compensatedDistribution.Sample(u, &mapPDF);
+            uv = compensatedDistribution->Sample(u, &mapPDF);
         else
-            uv = distribution.Sample(u, &mapPDF);
+            uv = distribution->Sample(u, &mapPDF);
         if (mapPDF == 0)
             return {};
 
@@ -625,8 +658,10 @@ class ImageInfiniteLight : public LightBase {
     Float scale;
     Point3f sceneCenter;
     Float sceneRadius;
-    PiecewiseConstant2D distribution;
-    PiecewiseConstant2D compensatedDistribution;
+    // The sampling distributions may be at a lower resolution than _image_
+    // and are shared with other lights that use the same map.
+    const PiecewiseConstant2D *distribution;
+    const PiecewiseConstant2D *compensatedDistribution;
 };
 
 // PortalImageInfiniteLight Definition
@@ -636,7 +671,7 @@ class PortalImageInfiniteLight : public LightBase {
     PortalImageInfiniteLight(const Transform &renderFromLight, Image image,
                              const RGBColorSpace *imageColorSpace, Float scale,
                              const std::string &filename, std::vector<Point3f> portal,
-                             Allocator alloc);
+                             int samplingResolution, Allocator alloc);
 
     void Preprocess(const Bounds3f &sceneBounds) {
         sceneBounds.BoundingSphere(&sceneCenter, &sceneRadius);
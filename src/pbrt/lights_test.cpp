@@ -7,6 +7,7 @@
 #include <pbrt/pbrt.h>
 
 #include <pbrt/lights.h>
+#include <pbrt/shapes.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/image.h>
@@ -172,6 +173,86 @@ TEST(ProjectionLight, Sampling) {
     }
 }
 
+TEST(ImageInfiniteLight, SamplingResolution) {
+    SampledWavelengths lambda = SampledWavelengths::SampleUniform(0.5);
+    Transform id;
+    // Sampling distributions at lower resolutions than the image, including
+    // ones that don't evenly divide it, must still give unbiased estimates
+    for (int samplingResolution : {256, 64, 37}) {
+        ImageInfiniteLight light(id, MakeLightImage({256, 256}), RGBColorSpace::sRGB,
+                                 1.f, "test", samplingResolution, Allocator());
+        light.Preprocess(Bounds3f(Point3f(-1, -1, -1), Point3f(1, 1, 1)));
+
+        int nSamples = 256 * 1024;
+        double uniformSum = 0, pdfSum = 0, sampledSum = 0;
+        LightSampleContext ctx;
+        for (Point2f u : Hammersley2D(nSamples)) {
+            Vector3f w = SampleUniformSphere(u);
+            uniformSum += light.Le(Ray(Point3f(0, 0, 0), w), lambda)[0];
+            pdfSum += light.PDF_Li(ctx, w, false);
+
+            pstd::optional<LightLiSample> ls = light.SampleLi(ctx, u, lambda, false);
+            if (ls)
+                sampledSum += ls->L[0] / ls->pdf;
+        }
+        uniformSum /= nSamples * UniformSpherePDF();
+        pdfSum /= nSamples * UniformSpherePDF();
+        sampledSum /= nSamples;
+        EXPECT_LT(std::abs(pdfSum - 1), 1e-2) << samplingResolution;
+        EXPECT_LT(std::abs(sampledSum - uniformSum), 1e-2 * uniformSum)
+            << "sampling resolution: " << samplingResolution << " uniform: "
+            << uniformSum << ", sampled: " << sampledSum;
+    }
+}
+
+TEST(DiffuseAreaLight, EmissionSampling) {
+    SampledWavelengths lambda = SampledWavelengths::SampleUniform(0.5);
+    Transform id;
+    std::vector<int> indices{0, 1, 2, 3};
+    std::vector<Point3f> p{Point3f(0, 0, 0), Point3f(1, 0, 0), Point3f(0, 1, 0),
+                           Point3f(1, 1, 0)};
+    BilinearPatchMesh mesh(id, false, indices, p, std::vector<Normal3f>(),
+                           std::vector<Point2f>(), std::vector<int>(), nullptr,
+                           Allocator());
+    pstd::vector<Shape> patches = BilinearPatch::CreatePatches(&mesh, Allocator());
+    ASSERT_EQ(1, patches.size());
+
+    Image image = MakeLightImage({256, 256});
+    PiecewiseConstant2D distrib =
+        DiffuseAreaLight::EmissionDistribution(image, Allocator());
+    DiffuseAreaLight uniformLight(id, MediumInterface(), nullptr, 1.f, patches[0],
+                                  nullptr, image, RGBColorSpace::sRGB, true);
+    DiffuseAreaLight emissionLight(id, MediumInterface(), nullptr, 1.f, patches[0],
+                                   nullptr, image, RGBColorSpace::sRGB, true,
+                                   &distrib);
+
+    // Both lights must give the same estimate of the incident radiance, and
+    // the emission-sampled PDFs must match the ones that PDF_Li() returns
+    for (Point3f pRef : {Point3f(.3, .6, .5), Point3f(-1, 2, -1)}) {
+        LightSampleContext ctx(Point3fi(pRef), Normal3f(0, 0, 0), Normal3f(0, 0, 0));
+        int nSamples = 64 * 1024;
+        double uniformSum = 0, emissionSum = 0;
+        for (Point2f u : Hammersley2D(nSamples)) {
+            pstd::optional<LightLiSample> ls =
+                uniformLight.SampleLi(ctx, u, lambda, false);
+            if (ls)
+                uniformSum += ls->L[0] / ls->pdf;
+
+            ls = emissionLight.SampleLi(ctx, u, lambda, false);
+            if (ls) {
+                emissionSum += ls->L[0] / ls->pdf;
+                Float pdf = emissionLight.PDF_Li(ctx, ls->wi, false);
+                EXPECT_LT(std::abs(pdf - ls->pdf), 1e-3 * ls->pdf)
+                    << pdf << " vs " << ls->pdf;
+            }
+        }
+        uniformSum /= nSamples;
+        emissionSum /= nSamples;
+        EXPECT_LT(std::abs(emissionSum - uniformSum), 1e-2 * uniformSum)
+            << "uniform: " << uniformSum << ", emission: " << emissionSum;
+    }
+}
+
 TEST(LightBounds, Basics) {
     LightBounds bounds(Bounds3f(Point3f(0, 0, 0), Point3f(.1, .1, .01)),
                        Vector3f(0, 0, 1), 1.f /* phi */,
@@ -6,18 +6,26 @@
 
 #include <pbrt/interaction.h>
 #include <pbrt/lights.h>
+#include <pbrt/options.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/hash.h>
+#include <pbrt/util/log.h>
 #include <pbrt/util/lowdiscrepancy.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/memory.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/sampling.h>
 #include <pbrt/util/spectrum.h>
+#include <pbrt/util/stats.h>
 
 #include <atomic>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
 #include <numeric>
 #include <vector>
 
@@ -46,18 +54,21 @@ std::string CompactLightBounds::ToString(const Bounds3f &allBounds) const {
 
 LightSampler LightSampler::Create(const std::string &name, pstd::span<const Light> lights,
                                   Allocator alloc) {
+    LoadProfileScope _("Create light sampler", name);
     if (name == "uniform")
         return alloc.new_object<UniformLightSampler>(lights, alloc);
     else if (name == "power")
         return alloc.new_object<PowerLightSampler>(lights, alloc);
     else if (name == "bvh")
-        return alloc.new_object<BVHLightSampler>(lights, alloc);
+        return alloc.new_object<BVHLightSampler>(lights, alloc, 2, Options->useGPU);
+    else if (name == "bvh4")
+        return alloc.new_object<BVHLightSampler>(lights, alloc, 4, Options->useGPU);
     else if (name == "exhaustive")
         return alloc.new_object<ExhaustiveLightSampler>(lights, alloc);
     else {
         Error(R"(Light sample distribution type "%s" unknown. Using "bvh".)",
               name.c_str());
-        return alloc.new_object<BVHLightSampler>(lights, alloc);
+        return alloc.new_object<BVHLightSampler>(lights, alloc, 2, Options->useGPU);
     }
 }
 
@@ -83,13 +94,15 @@ PowerLightSampler::PowerLightSampler(pstd::span<const Light> lights, Allocator a
     for (size_t i = 0; i < lights.size(); ++i)
         lightToIndex.Insert(lights[i], i);
 
-    // Compute lights' power and initialize alias table
-    pstd::vector<Float> lightPower;
+    // Compute lights' power in parallel and initialize alias table
+    pstd::vector<Float> lightPower(lights.size());
     SampledWavelengths lambda = SampledWavelengths::SampleVisible(0.5f);
-    for (const auto &light : lights) {
-        SampledSpectrum phi = SafeDiv(light.Phi(lambda), lambda.PDF());
-        lightPower.push_back(phi.Average());
-    }
+    ParallelFor(0, lights.size(), [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i) {
+            SampledSpectrum phi = SafeDiv(lights[i].Phi(lambda), lambda.PDF());
+            lightPower[i] = phi.Average();
+        }
+    });
     if (std::accumulate(lightPower.begin(), lightPower.end(), 0.f) == 0.f)
         std::fill(lightPower.begin(), lightPower.end(), 1.f);
     aliasTable = AliasTable(lightPower, alloc);
@@ -103,14 +116,91 @@ std::string PowerLightSampler::ToString() const {
 // BVHLightSampler
 
 STAT_MEMORY_COUNTER("Memory/Light BVH", lightBVHBytes);
+STAT_MEMORY_COUNTER("Memory/Light BVH child bounds", lightBVHChildBoundsBytes);
 STAT_INT_DISTRIBUTION("Integrator/Lights sampled per lookup", nLightsSampled);
 
+static constexpr size_t lightBVHParallelBinningThreshold = 64 * 1024;
+static constexpr size_t lightBVHParallelSubtreeThreshold = 4 * 1024;
+
+// Computes the bounds of _bvhLights_ and of their centroids, processing large
+// ranges of lights in parallel.
+static void ComputeLightBVHBounds(pstd::span<const std::pair<int, LightBounds>> bvhLights,
+                                  Bounds3f *bounds, Bounds3f *centroidBounds) {
+    if (bvhLights.size() < lightBVHParallelBinningThreshold) {
+        for (const auto &l : bvhLights) {
+            *bounds = Union(*bounds, l.second.bounds);
+            *centroidBounds = Union(*centroidBounds, l.second.Centroid());
+        }
+        return;
+    }
+
+    std::mutex mutex;
+    ParallelFor(0, bvhLights.size(), [&](int64_t start, int64_t end) {
+        Bounds3f b, cb;
+        for (int64_t i = start; i < end; ++i) {
+            b = Union(b, bvhLights[i].second.bounds);
+            cb = Union(cb, bvhLights[i].second.Centroid());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        *bounds = Union(*bounds, b);
+        *centroidBounds = Union(*centroidBounds, cb);
+    });
+}
+
+// Accumulates _bvhLights_ into the _buckets_ for all three dimensions
+// according to their centroids, with the buckets for dimension _dim_ starting
+// at _buckets[dim * nBuckets]_. Large ranges of lights are binned in
+// fixed-size chunks in parallel; because the _LightBounds_ _Union()_ isn't
+// associative, the chunks are merged in order so that the result doesn't
+// depend on the number of threads.
+template <int nBuckets>
+static void BinLightBVHLights(pstd::span<const std::pair<int, LightBounds>> bvhLights,
+                              const Bounds3f &centroidBounds,
+                              LightBounds buckets[3 * nBuckets]) {
+    auto binRange = [&](size_t start, size_t end, LightBounds *b) {
+        for (size_t i = start; i < end; ++i) {
+            const LightBounds &lb = bvhLights[i].second;
+            Vector3f offset = centroidBounds.Offset(lb.Centroid());
+            for (int dim = 0; dim < 3; ++dim) {
+                int bucket = nBuckets * offset[dim];
+                if (bucket == nBuckets)
+                    bucket = nBuckets - 1;
+                DCHECK_GE(bucket, 0);
+                DCHECK_LT(bucket, nBuckets);
+                b[dim * nBuckets + bucket] = Union(b[dim * nBuckets + bucket], lb);
+            }
+        }
+    };
+
+    if (bvhLights.size() < lightBVHParallelBinningThreshold) {
+        binRange(0, bvhLights.size(), buckets);
+        return;
+    }
+
+    constexpr size_t chunkSize = 16 * 1024;
+    size_t nChunks = (bvhLights.size() + chunkSize - 1) / chunkSize;
+    std::vector<LightBounds> chunkBuckets(nChunks * 3 * nBuckets);
+    ParallelFor(0, nChunks, [&](int64_t chunk) {
+        binRange(chunk * chunkSize, std::min(bvhLights.size(), (chunk + 1) * chunkSize),
+                 &chunkBuckets[chunk * 3 * nBuckets]);
+    });
+    for (size_t chunk = 0; chunk < nChunks; ++chunk)
+        for (int i = 0; i < 3 * nBuckets; ++i)
+            buckets[i] = Union(buckets[i], chunkBuckets[chunk * 3 * nBuckets + i]);
+}
+
 // BVHLightSampler Method Definitions
-BVHLightSampler::BVHLightSampler(pstd::span<const Light> lights, Allocator alloc)
+BVHLightSampler::BVHLightSampler(pstd::span<const Light> lights, Allocator alloc,
+                                 int maxChildren, bool decodeChildBounds)
     : lights(lights.begin(), lights.end(), alloc),
       infiniteLights(alloc),
       nodes(alloc),
+      maxChildren(maxChildren),
+      childBounds(alloc),
       lightToBitTrail(alloc) {
+    if (maxChildren != 2 && maxChildren != MaxLightBVHChildren)
+        ErrorExit("%d: light BVH nodes must have either 2 or %d children.", maxChildren,
+                  MaxLightBVHChildren);
     // Initialize _infiniteLights_ array and light BVH
     std::vector<std::pair<int, LightBounds>> bvhLights;
     for (size_t i = 0; i < lights.size(); ++i) {
@@ -124,68 +214,106 @@ BVHLightSampler::BVHLightSampler(pstd::span<const Light> lights, Allocator alloc
             allLightBounds = Union(allLightBounds, lightBounds->bounds);
         }
     }
-    if (!bvhLights.empty())
-        buildBVH(bvhLights, 0, bvhLights.size(), 0, 0);
+    if (!bvhLights.empty()) {
+        // Look for a cached light BVH built from lights with the same bounds
+        std::string cacheFilename;
+        uint64_t cacheKey = Hash(lights.size(), maxChildren);
+        if (!Options->sceneCacheDirectory.empty()) {
+            for (const auto &l : bvhLights) {
+                const LightBounds &lb = l.second;
+                cacheKey = Hash(cacheKey, l.first, lb.bounds, lb.w, lb.phi,
+                                lb.cosTheta_o, lb.cosTheta_e, lb.twoSided);
+            }
+            cacheFilename = StringPrintf("%s/lightbvh-%016x.bin",
+                                         Options->sceneCacheDirectory, cacheKey);
+        }
+
+        if (cacheFilename.empty() ||
+            !readCache(cacheFilename, cacheKey, bvhLights.size())) {
+            // Build binary light BVH and flatten it into _nodes_
+            std::vector<LightBVHNode> binaryNodes(2 * bvhLights.size() - 1);
+            buildBVH(bvhLights, 0, bvhLights.size(), 0, 0, binaryNodes);
+            nodes.reserve(binaryNodes.size());
+            nodes.push_back(LightBVHNode());
+            flattenBVH(binaryNodes, 0, 0, maxChildren, 0, 0);
+            if (!cacheFilename.empty())
+                writeCache(cacheFilename, cacheKey, bvhLights.size());
+        }
+
+        if (decodeChildBounds) {
+            // Decode interior nodes' child bounds into _childBounds_
+            childBounds.resize(nodes.size() / 2);
+            for (const LightBVHNode &node : nodes) {
+                if (node.isLeaf)
+                    continue;
+                LightBVHChildBounds *b = &childBounds[ChildBoundsIndex(node)];
+                if (maxChildren == 2)
+                    DecodeChildBounds<2>(node, b);
+                else
+                    DecodeChildBounds<MaxLightBVHChildren>(node, b);
+            }
+            lightBVHChildBoundsBytes += childBounds.size() * sizeof(LightBVHChildBounds);
+        }
+    }
     lightBVHBytes += nodes.size() * sizeof(LightBVHNode) +
-                     lightToBitTrail.capacity() * sizeof(uint32_t) +
+                     lightToBitTrail.capacity() * sizeof(uint64_t) +
                      lights.size() * sizeof(Light) +
                      infiniteLights.size() * sizeof(Light);
 }
 
-std::pair<int, LightBounds> BVHLightSampler::buildBVH(
-    std::vector<std::pair<int, LightBounds>> &bvhLights, int start, int end,
-    uint32_t bitTrail, int depth) {
+LightBounds BVHLightSampler::buildBVH(std::vector<std::pair<int, LightBounds>> &bvhLights,
+                                      int start, int end, int nodeIndex, int depth,
+                                      std::vector<LightBVHNode> &binaryNodes) const {
+    // Binary nodes are stored in depth-first order; the subtree for $n$ lights
+    // uses $2n-1$ nodes, which lets both children be built concurrently.
     DCHECK_LT(start, end);
     // Initialize leaf node if only a single light remains
     if (end - start == 1) {
-        int nodeIndex = nodes.size();
         CompactLightBounds cb(bvhLights[start].second, allLightBounds);
-        int lightIndex = bvhLights[start].first;
-        nodes.push_back(LightBVHNode::MakeLeaf(lightIndex, cb));
-        lightToBitTrail.Insert(lights[lightIndex], bitTrail);
-        return {nodeIndex, bvhLights[start].second};
+        binaryNodes[nodeIndex] = LightBVHNode::MakeLeaf(bvhLights[start].first, cb);
+        return bvhLights[start].second;
     }
 
     // Choose split dimension and position using modified SAH
     // Compute bounds and centroid bounds for lights
+    pstd::span<const std::pair<int, LightBounds>> range(&bvhLights[start], end - start);
     Bounds3f bounds, centroidBounds;
-    for (int i = start; i < end; ++i) {
-        const LightBounds &lb = bvhLights[i].second;
-        bounds = Union(bounds, lb.bounds);
-        centroidBounds = Union(centroidBounds, lb.Centroid());
-    }
+    ComputeLightBVHBounds(range, &bounds, &centroidBounds);
+
+    // Compute _LightBounds_ for each bucket along all three dimensions
+    constexpr int nBuckets = 12;
+    LightBounds bucketLightBounds[3 * nBuckets];
+    BinLightBVHLights<nBuckets>(range, centroidBounds, bucketLightBounds);
 
     Float minCost = Infinity;
     int minCostSplitBucket = -1, minCostSplitDim = -1;
-    constexpr int nBuckets = 12;
     for (int dim = 0; dim < 3; ++dim) {
         // Compute minimum cost bucket for splitting along dimension _dim_
         if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim])
             continue;
-        // Compute _LightBounds_ for each bucket
-        LightBounds bucketLightBounds[nBuckets];
-        for (int i = start; i < end; ++i) {
-            Point3f pc = bvhLights[i].second.Centroid();
-            int b = nBuckets * centroidBounds.Offset(pc)[dim];
-            if (b == nBuckets)
-                b = nBuckets - 1;
-            DCHECK_GE(b, 0);
-            DCHECK_LT(b, nBuckets);
-            bucketLightBounds[b] = Union(bucketLightBounds[b], bvhLights[i].second);
-        }
+        const LightBounds *buckets = &bucketLightBounds[dim * nBuckets];
 
         // Compute costs for splitting lights after each bucket
+        // Find _LightBounds_ for lights above each bucket split with a
+        // backward sweep over the buckets
+        LightBounds above[nBuckets - 1];
+        LightBounds b1 = buckets[nBuckets - 1];
+        for (int i = nBuckets - 2; i >= 0; --i) {
+            above[i] = b1;
+            b1 = Union(buckets[i], b1);
+        }
+
         Float cost[nBuckets - 1];
+        LightBounds b0;
         for (int i = 0; i < nBuckets - 1; ++i) {
-            // Find _LightBounds_ for lights below and above bucket split
-            LightBounds b0, b1;
-            for (int j = 0; j <= i; ++j)
-                b0 = Union(b0, bucketLightBounds[j]);
-            for (int j = i + 1; j < nBuckets; ++j)
-                b1 = Union(b1, bucketLightBounds[j]);
-
-            // Compute final light split cost for bucket
-            cost[i] = EvaluateCost(b0, bounds, dim) + EvaluateCost(b1, bounds, dim);
+            // Compute final light split cost for bucket, reusing the previous
+            // one if the bucket is empty and so the split is unchanged
+            if (i > 0 && buckets[i].phi == 0) {
+                cost[i] = cost[i - 1];
+                continue;
+            }
+            b0 = Union(b0, buckets[i]);
+            cost[i] = EvaluateCost(b0, bounds, dim) + EvaluateCost(above[i], bounds, dim);
         }
 
         // Find light split that minimizes SAH metric
@@ -220,21 +348,148 @@ std::pair<int, LightBounds> BVHLightSampler::buildBVH(
         DCHECK(mid > start && mid < end);
     }
 
-    // Allocate interior _LightBVHNode_ and recursively initialize children
-    int nodeIndex = nodes.size();
-    nodes.push_back(LightBVHNode());
+    // Recursively initialize children, in parallel for large subtrees
     CHECK_LT(depth, 64);
-    std::pair<int, LightBounds> child0 =
-        buildBVH(bvhLights, start, mid, bitTrail, depth + 1);
-    DCHECK_EQ(nodeIndex + 1, child0.first);
-    std::pair<int, LightBounds> child1 =
-        buildBVH(bvhLights, mid, end, bitTrail | (1u << depth), depth + 1);
-
-    // Initialize interior node and return node index and bounds
-    LightBounds lb = Union(child0.second, child1.second);
+    int childIndex[2] = {nodeIndex + 1, nodeIndex + 2 * (mid - start)};
+    LightBounds childBounds[2];
+    auto buildChild = [&](int i) {
+        childBounds[i] = buildBVH(bvhLights, i == 0 ? start : mid, i == 0 ? mid : end,
+                                  childIndex[i], depth + 1, binaryNodes);
+    };
+    if (end - start > lightBVHParallelSubtreeThreshold)
+        ParallelFor(0, 2, buildChild);
+    else {
+        buildChild(0);
+        buildChild(1);
+    }
+
+    // Initialize interior node and return its bounds
+    LightBounds lb = Union(childBounds[0], childBounds[1]);
     CompactLightBounds cb(lb, allLightBounds);
-    nodes[nodeIndex] = LightBVHNode::MakeInterior(child1.first, cb);
-    return {nodeIndex, lb};
+    binaryNodes[nodeIndex] = LightBVHNode::MakeInterior(childIndex[1], 2, cb);
+    return lb;
+}
+
+void BVHLightSampler::flattenBVH(const std::vector<LightBVHNode> &binaryNodes,
+                                 int binaryIndex, int nodeIndex, int maxChildren,
+                                 uint64_t bitTrail, int trailBits) {
+    const LightBVHNode &node = binaryNodes[binaryIndex];
+    if (node.isLeaf) {
+        nodes[nodeIndex] = node;
+        lightToBitTrail.Insert(lights[node.childOrLightIndex], bitTrail);
+        return;
+    }
+
+    // Find node's children, collapsing interior children into it for wide trees
+    int children[MaxLightBVHChildren], nChildren = 0;
+    for (int c : {binaryIndex + 1, int(node.childOrLightIndex)}) {
+        const LightBVHNode &child = binaryNodes[c];
+        if (maxChildren > 2 && !child.isLeaf) {
+            children[nChildren++] = c + 1;
+            children[nChildren++] = child.childOrLightIndex;
+        } else
+            children[nChildren++] = c;
+    }
+
+    // Allocate contiguous children and recursively flatten them
+    int firstChild = nodes.size();
+    nodes.resize(firstChild + nChildren);
+    nodes[nodeIndex] =
+        LightBVHNode::MakeInterior(firstChild, nChildren, node.lightBounds);
+    int childBits = LightBVHChildBits(nChildren);
+    CHECK_LE(trailBits + childBits, 64);
+    for (int i = 0; i < nChildren; ++i)
+        flattenBVH(binaryNodes, children[i], firstChild + i, maxChildren,
+                   bitTrail | (uint64_t(i) << trailBits), trailBits + childBits);
+}
+
+// LightBVHCacheHeader Definition
+struct LightBVHCacheHeader {
+    char magic[8] = {'p', 'b', 'r', 't', 'l', 'b', 'v', '1'};
+    uint64_t key;
+    int64_t nodeSize = sizeof(LightBVHNode);
+    int64_t nNodes, nBVHLights;
+    Bounds3f allLightBounds;
+};
+
+bool BVHLightSampler::readCache(const std::string &filename, uint64_t key,
+                                int nBVHLights) {
+    if (!FileExists(filename))
+        return false;
+    std::string contents = ReadFileContents(filename);
+    // Validate cached light BVH header against current lights
+    LightBVHCacheHeader header, expected;
+    if (contents.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.key != key || header.nodeSize != expected.nodeSize ||
+        header.nBVHLights != nBVHLights || header.nNodes < 1 ||
+        header.nNodes > 2 * nBVHLights - 1 ||
+        contents.size() != sizeof(header) + header.nNodes * sizeof(LightBVHNode)) {
+        Warning("%s: ignoring invalid or stale light BVH cache file.", filename);
+        return false;
+    }
+
+    // Copy cached nodes and check that their indices are in range
+    nodes.resize(header.nNodes);
+    std::memcpy(nodes.data(), contents.data() + sizeof(header),
+                header.nNodes * sizeof(LightBVHNode));
+    for (int64_t i = 0; i < header.nNodes; ++i) {
+        const LightBVHNode &node = nodes[i];
+        bool valid = node.isLeaf ? node.childOrLightIndex < lights.size()
+                                 : (node.nChildren >= 2 &&
+                                    node.nChildren <= MaxLightBVHChildren &&
+                                    node.childOrLightIndex > i &&
+                                    node.childOrLightIndex + node.nChildren <=
+                                        header.nNodes);
+        if (!valid) {
+            Warning("%s: invalid node in light BVH cache file.", filename);
+            nodes.clear();
+            return false;
+        }
+    }
+
+    allLightBounds = header.allLightBounds;
+    initBitTrails(0, 0, 0);
+    LOG_VERBOSE("Read light BVH with %d nodes for %d lights from %s", header.nNodes,
+                nBVHLights, filename);
+    return true;
+}
+
+void BVHLightSampler::writeCache(const std::string &filename, uint64_t key,
+                                 int nBVHLights) const {
+    LightBVHCacheHeader header;
+    header.key = key;
+    header.nNodes = nodes.size();
+    header.nBVHLights = nBVHLights;
+    header.allLightBounds = allLightBounds;
+    std::string contents;
+    contents.append((const char *)&header, sizeof(header));
+    contents.append((const char *)nodes.data(), nodes.size() * sizeof(LightBVHNode));
+
+    // Write to a temporary file so that concurrent renders never see partial caches
+    std::string tempFilename = StringPrintf("%s.%p.tmp", filename, this);
+    if (!WriteFileContents(tempFilename, contents) ||
+        std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write light BVH cache file.", filename);
+        RemoveFile(tempFilename);
+    } else
+        LOG_VERBOSE("Wrote light BVH cache file %s", filename);
+}
+
+void BVHLightSampler::initBitTrails(int nodeIndex, uint64_t bitTrail, int trailBits) {
+    // Recompute the bit trails that _flattenBVH()_ records for a cached tree
+    const LightBVHNode &node = nodes[nodeIndex];
+    if (node.isLeaf) {
+        lightToBitTrail.Insert(lights[node.childOrLightIndex], bitTrail);
+        return;
+    }
+    int childBits = LightBVHChildBits(node.nChildren);
+    CHECK_LE(trailBits + childBits, 64);
+    for (int i = 0; i < node.nChildren; ++i)
+        initBitTrails(node.childOrLightIndex + i, bitTrail | (uint64_t(i) << trailBits),
+                      trailBits + childBits);
 }
 
 std::string BVHLightSampler::ToString() const {
@@ -243,8 +498,8 @@ std::string BVHLightSampler::ToString() const {
 
 std::string LightBVHNode::ToString() const {
     return StringPrintf(
-        "[ LightBVHNode lightBounds: %s childOrLightIndex: %d isLeaf: %d ]", lightBounds,
-        childOrLightIndex, isLeaf);
+        "[ LightBVHNode lightBounds: %s childOrLightIndex: %d isLeaf: %d nChildren: %d ]",
+        lightBounds, childOrLightIndex, isLeaf, int(nChildren));
 }
 
 // ExhaustiveLightSampler Method Definitions
@@ -126,6 +126,10 @@ class CompactLightBounds {
     PBRT_CPU_GPU
     bool TwoSided() const { return twoSided; }
     PBRT_CPU_GPU
+    Float Phi() const { return phi; }
+    PBRT_CPU_GPU
+    Vector3f W() const { return Vector3f(w); }
+    PBRT_CPU_GPU
     Float CosTheta_o() const { return 2 * (qCosTheta_o / 32767.f) - 1; }
     PBRT_CPU_GPU
     Float CosTheta_e() const { return 2 * (qCosTheta_e / 32767.f) - 1; }
@@ -227,20 +231,25 @@ class CompactLightBounds {
     uint16_t qb[2][3];
 };
 
+static constexpr int MaxLightBVHChildren = 4;
+
 // LightBVHNode Definition
+// Interior nodes store the index of their first child; the rest of their
+// children follow it contiguously in the node array.
 struct alignas(32) LightBVHNode {
     // LightBVHNode Public Methods
     LightBVHNode() = default;
 
     PBRT_CPU_GPU
     static LightBVHNode MakeLeaf(unsigned int lightIndex, const CompactLightBounds &cb) {
-        return LightBVHNode{cb, {lightIndex, 1}};
+        return LightBVHNode{cb, {lightIndex, 1}, 0};
     }
 
     PBRT_CPU_GPU
-    static LightBVHNode MakeInterior(unsigned int child1Index,
+    static LightBVHNode MakeInterior(unsigned int firstChildIndex, int nChildren,
                                      const CompactLightBounds &cb) {
-        return LightBVHNode{cb, {child1Index, 0}};
+        DCHECK(nChildren >= 2 && nChildren <= MaxLightBVHChildren);
+        return LightBVHNode{cb, {firstChildIndex, 0}, uint8_t(nChildren)};
     }
 
     PBRT_CPU_GPU
@@ -254,13 +263,29 @@ struct alignas(32) LightBVHNode {
         unsigned int childOrLightIndex : 31;
         unsigned int isLeaf : 1;
     };
+    uint8_t nChildren;
+};
+
+// LightBVHChildBounds Definition
+// The decoded light bounds of an interior light BVH node's children, in SoA
+// layout; entries past the node's last child repeat its first child.
+struct alignas(16) LightBVHChildBounds {
+    Float pcx[MaxLightBVHChildren], pcy[MaxLightBVHChildren], pcz[MaxLightBVHChildren];
+    Float r2[MaxLightBVHChildren], halfDiagonal[MaxLightBVHChildren];
+    Float wx[MaxLightBVHChildren], wy[MaxLightBVHChildren], wz[MaxLightBVHChildren];
+    Float phi[MaxLightBVHChildren], cosTheta_o[MaxLightBVHChildren];
+    Float cosTheta_e[MaxLightBVHChildren];
+    bool twoSided[MaxLightBVHChildren];
 };
 
 // BVHLightSampler Definition
 class BVHLightSampler {
   public:
     // BVHLightSampler Public Methods
-    BVHLightSampler(pstd::span<const Light> lights, Allocator alloc);
+    // If _decodeChildBounds_ is true, _childBounds_ is initialized, which
+    // is worthwhile on the GPU, where decoding is relatively expensive.
+    BVHLightSampler(pstd::span<const Light> lights, Allocator alloc,
+                    int maxChildren = 2, bool decodeChildBounds = false);
 
     PBRT_CPU_GPU
     pstd::optional<SampledLight> Sample(const LightSampleContext &ctx, Float u) const {
@@ -280,41 +305,123 @@ class BVHLightSampler {
             // Traverse light BVH to sample light
             if (nodes.empty())
                 return {};
-            // Declare common variables for light BVH traversal
-            Point3f p = ctx.p();
-            Normal3f n = ctx.ns;
             u = std::min<Float>((u - pInfinite) / (1 - pInfinite), OneMinusEpsilon);
-            int nodeIndex = 0;
-            Float pmf = 1 - pInfinite;
-
-            while (true) {
-                // Process light BVH node for light sampling
-                LightBVHNode node = nodes[nodeIndex];
-                if (!node.isLeaf) {
-                    // Compute light BVH child node importances
-                    const LightBVHNode *children[2] = {&nodes[nodeIndex + 1],
-                                                       &nodes[node.childOrLightIndex]};
-                    Float ci[2] = {
-                        children[0]->lightBounds.Importance(p, n, allLightBounds),
-                        children[1]->lightBounds.Importance(p, n, allLightBounds)};
-                    if (ci[0] == 0 && ci[1] == 0)
-                        return {};
-
-                    // Randomly sample light BVH child node
-                    Float nodePMF;
-                    int child = SampleDiscrete(ci, u, &nodePMF, &u);
-                    pmf *= nodePMF;
-                    nodeIndex = (child == 0) ? (nodeIndex + 1) : node.childOrLightIndex;
-
-                } else {
-                    // Confirm light has nonzero importance before returning light sample
-                    if (nodeIndex > 0)
-                        DCHECK_GT(node.lightBounds.Importance(p, n, allLightBounds), 0);
-                    if (nodeIndex > 0 ||
-                        node.lightBounds.Importance(p, n, allLightBounds) > 0)
-                        return SampledLight{lights[node.childOrLightIndex], pmf};
+            return SampleSubtree(ctx, 0, u, 1 - pInfinite);
+        }
+    }
+
+    // Returns the probability that _Sample()_ chooses one of the infinite lights
+    PBRT_CPU_GPU
+    Float PInfinite() const {
+        return Float(infiniteLights.size()) /
+               Float(infiniteLights.size() + (nodes.empty() ? 0 : 1));
+    }
+
+    // The BVH's clusters are the nodes that the first _MaxClusterBits_ bits of
+    // the lights' bit trails lead to; a leaf closer to the root than that is a
+    // cluster by itself. A cluster's index is its node's (zero-padded) bit trail.
+    static constexpr int MaxClusterBits = 4;
+    static constexpr int MaxClusters = 1 << MaxClusterBits;
+
+    // Returns the index of the cluster that holds _light_, or -1 for infinite lights
+    PBRT_CPU_GPU
+    int ClusterIndex(Light light) const {
+        const uint64_t *lightBitTrail = lightToBitTrail.Find(light);
+        if (!lightBitTrail)
+            return -1;
+        int nodeIndex = 0, trailBits = 0;
+        while (true) {
+            const LightBVHNode &node = nodes[nodeIndex];
+            int childBits = LightBVHChildBits(node.nChildren);
+            if (node.isLeaf || trailBits + childBits > MaxClusterBits)
+                return *lightBitTrail & ((1u << trailBits) - 1);
+            int child = (*lightBitTrail >> trailBits) & ((1u << childBits) - 1);
+            nodeIndex = node.childOrLightIndex + child;
+            trailBits += childBits;
+        }
+    }
+
+    // Computes the probability of BVH traversal from the root reaching each
+    // cluster at the reference point and returns the clusters' node indices
+    // in _clusterNodes_. Clusters that don't exist have zero probability.
+    PBRT_CPU_GPU
+    void ClusterPMFs(const LightSampleContext &ctx, Float pmf[MaxClusters],
+                     int clusterNodes[MaxClusters]) const {
+        for (int i = 0; i < MaxClusters; ++i) {
+            pmf[i] = 0;
+            clusterNodes[i] = -1;
+        }
+        if (nodes.empty())
+            return;
+        struct ClusterSearch {
+            int nodeIndex, trailBits;
+            uint32_t bitTrail;
+            Float pmf;
+        };
+        ClusterSearch toVisit[MaxClusters];
+        int nToVisit = 0;
+        toVisit[nToVisit++] = ClusterSearch{0, 0, 0, 1};
+        while (nToVisit > 0) {
+            ClusterSearch search = toVisit[--nToVisit];
+            const LightBVHNode &node = nodes[search.nodeIndex];
+            int childBits = LightBVHChildBits(node.nChildren);
+            if (node.isLeaf || search.trailBits + childBits > MaxClusterBits) {
+                // Record cluster's probability, handling a single light at the root
+                if (search.nodeIndex == 0 && node.isLeaf &&
+                    node.lightBounds.Importance(ctx.p(), ctx.ns, allLightBounds) == 0)
+                    return;
+                pmf[search.bitTrail] = search.pmf;
+                clusterNodes[search.bitTrail] = search.nodeIndex;
+                continue;
+            }
+            // Visit node's children with nonzero importance
+            Float ci[MaxLightBVHChildren];
+            ChildImportances(node, ctx.p(), ctx.ns, ci);
+            Float ciSum = ci[0] + ci[1] + ci[2] + ci[3];
+            for (int child = 0; child < node.nChildren; ++child)
+                if (ci[child] > 0)
+                    toVisit[nToVisit++] = ClusterSearch{
+                        int(node.childOrLightIndex) + child,
+                        search.trailBits + childBits,
+                        search.bitTrail | (uint32_t(child) << search.trailBits),
+                        search.pmf * ci[child] / ciSum};
+        }
+    }
+
+    // Samples a light from the subtree rooted at _nodeIndex_, as if traversal
+    // from the root had reached it with probability _pmf_
+    PBRT_CPU_GPU
+    pstd::optional<SampledLight> SampleSubtree(const LightSampleContext &ctx,
+                                               int nodeIndex, Float u, Float pmf) const {
+        // Declare common variables for light BVH traversal
+        Point3f p = ctx.p();
+        Normal3f n = ctx.ns;
+
+        while (true) {
+            // Process light BVH node for light sampling
+            LightBVHNode node = nodes[nodeIndex];
+            if (!node.isLeaf) {
+                // Compute light BVH child node importances
+                Float ci[MaxLightBVHChildren];
+                ChildImportances(node, p, n, ci);
+                if (ci[0] + ci[1] + ci[2] + ci[3] == 0)
                     return {};
-                }
+
+                // Randomly sample light BVH child node
+                Float nodePMF;
+                int child = SampleDiscrete(pstd::span<const Float>(ci, node.nChildren),
+                                           u, &nodePMF, &u);
+                pmf *= nodePMF;
+                nodeIndex = node.childOrLightIndex + child;
+
+            } else {
+                // Confirm light has nonzero importance before returning light sample
+                if (nodeIndex > 0)
+                    DCHECK_GT(node.lightBounds.Importance(p, n, allLightBounds), 0);
+                if (nodeIndex > 0 ||
+                    node.lightBounds.Importance(p, n, allLightBounds) > 0)
+                    return SampledLight{lights[node.childOrLightIndex], pmf};
+                return {};
             }
         }
     }
@@ -322,11 +429,12 @@ class BVHLightSampler {
     PBRT_CPU_GPU
     Float PMF(const LightSampleContext &ctx, Light light) const {
         // Handle infinite _light_ PMF computation
-        if (!lightToBitTrail.HasKey(light))
+        const uint64_t *lightBitTrail = lightToBitTrail.Find(light);
+        if (!lightBitTrail)
             return 1.f / (infiniteLights.size() + (nodes.empty() ? 0 : 1));
 
         // Initialize local variables for BVH traversal for PMF computation
-        uint32_t bitTrail = lightToBitTrail[light];
+        uint64_t bitTrail = *lightBitTrail;
         Point3f p = ctx.p();
         Normal3f n = ctx.ns;
         // Compute infinite light sampling probability _pInfinite_
@@ -344,16 +452,16 @@ class BVHLightSampler {
                 return pmf;
             }
             // Compute child importances and update PMF for current node
-            const LightBVHNode *child0 = &nodes[nodeIndex + 1];
-            const LightBVHNode *child1 = &nodes[node->childOrLightIndex];
-            Float ci[2] = {child0->lightBounds.Importance(p, n, allLightBounds),
-                           child1->lightBounds.Importance(p, n, allLightBounds)};
-            DCHECK_GT(ci[bitTrail & 1], 0);
-            pmf *= ci[bitTrail & 1] / (ci[0] + ci[1]);
+            int childBits = LightBVHChildBits(node->nChildren);
+            int child = bitTrail & ((1u << childBits) - 1);
+            Float ci[MaxLightBVHChildren];
+            ChildImportances(*node, p, n, ci);
+            DCHECK_GT(ci[child], 0);
+            pmf *= ci[child] / (ci[0] + ci[1] + ci[2] + ci[3]);
 
             // Use _bitTrail_ to find next node index and update its value
-            nodeIndex = (bitTrail & 1) ? node->childOrLightIndex : (nodeIndex + 1);
-            bitTrail >>= 1;
+            nodeIndex = node->childOrLightIndex + child;
+            bitTrail >>= childBits;
         }
     }
 
@@ -376,9 +484,130 @@ class BVHLightSampler {
 
   private:
     // BVHLightSampler Private Methods
-    std::pair<int, LightBounds> buildBVH(
-        std::vector<std::pair<int, LightBounds>> &bvhLights, int start, int end,
-        uint32_t bitTrail, int depth);
+    // Returns the number of bits of a light's bit trail that record which of
+    // an interior node's children leads to it.
+    PBRT_CPU_GPU
+    static int LightBVHChildBits(int nChildren) { return nChildren > 2 ? 2 : 1; }
+
+    // Computes the importances of all of an interior node's children at the
+    // reference point, following _CompactLightBounds::Importance()_. The
+    // children's bounds are decoded into per-child arrays so that the
+    // computation runs across all of them at once with SIMD instructions;
+    // entries past the node's last child are set to zero. If _childBounds_
+    // has been initialized, the decoded bounds are loaded from it instead and
+    // the number of children evaluated only depends on the BVH's width, so
+    // that GPU threads sampling lights don't diverge.
+    PBRT_CPU_GPU
+    void ChildImportances(const LightBVHNode &node, Point3f p, Normal3f n,
+                          Float ci[MaxLightBVHChildren]) const {
+        if (!childBounds.empty()) {
+            const LightBVHChildBounds &b = childBounds[ChildBoundsIndex(node)];
+            if (maxChildren == 2) {
+                ChildImportances<2>(b, node.nChildren, p, n, ci);
+                ci[2] = ci[3] = 0;
+            } else
+                ChildImportances<MaxLightBVHChildren>(b, node.nChildren, p, n, ci);
+            return;
+        }
+
+        LightBVHChildBounds b;
+        if (node.nChildren == 2) {
+            DecodeChildBounds<2>(node, &b);
+            ChildImportances<2>(b, 2, p, n, ci);
+            ci[2] = ci[3] = 0;
+        } else {
+            DecodeChildBounds<MaxLightBVHChildren>(node, &b);
+            ChildImportances<MaxLightBVHChildren>(b, node.nChildren, p, n, ci);
+        }
+    }
+
+    // Interior nodes' first children follow the root in groups of at least
+    // two siblings, so halving their indices gives each node a distinct entry.
+    PBRT_CPU_GPU
+    static int ChildBoundsIndex(const LightBVHNode &node) {
+        return (node.childOrLightIndex - 1) / 2;
+    }
+
+    template <int N>
+    PBRT_CPU_GPU void DecodeChildBounds(const LightBVHNode &node,
+                                        LightBVHChildBounds *b) const {
+        for (int i = 0; i < N; ++i) {
+            // Unused entries repeat the first child and are zeroed at the end
+            const CompactLightBounds &cb =
+                nodes[node.childOrLightIndex + (i < node.nChildren ? i : 0)].lightBounds;
+            Bounds3f bounds = cb.Bounds(allLightBounds);
+            Point3f pc = (bounds.pMin + bounds.pMax) / 2;
+            b->pcx[i] = pc.x;
+            b->pcy[i] = pc.y;
+            b->pcz[i] = pc.z;
+            b->r2[i] = DistanceSquared(pc, bounds.pMax);
+            b->halfDiagonal[i] = Length(bounds.Diagonal()) / 2;
+            Vector3f w = cb.W();
+            b->wx[i] = w.x;
+            b->wy[i] = w.y;
+            b->wz[i] = w.z;
+            b->phi[i] = cb.Phi();
+            b->cosTheta_o[i] = cb.CosTheta_o();
+            b->cosTheta_e[i] = cb.CosTheta_e();
+            b->twoSided[i] = cb.TwoSided();
+        }
+    }
+
+    template <int N>
+    PBRT_CPU_GPU static void ChildImportances(const LightBVHChildBounds &b,
+                                              int nChildren, Point3f p, Normal3f n,
+                                              Float ci[N]) {
+        // Compute importances of all children at reference point
+        bool hasNormal = n != Normal3f(0, 0, 0);
+        for (int i = 0; i < N; ++i) {
+            // Compute clamped squared distance and direction to reference point
+            Float dx = p.x - b.pcx[i], dy = p.y - b.pcy[i], dz = p.z - b.pcz[i];
+            Float dist2 = Sqr(dx) + Sqr(dy) + Sqr(dz);
+            Float d2 = std::max(dist2, b.halfDiagonal[i]);
+            Float invDist = 1 / std::sqrt(dist2);
+            Float wix = dx * invDist, wiy = dy * invDist, wiz = dz * invDist;
+
+            // Compute sine and cosine of angle to vector _w_, $\theta_\roman{w}$
+            Float cosTheta_w = b.wx[i] * wix + b.wy[i] * wiy + b.wz[i] * wiz;
+            cosTheta_w = b.twoSided[i] ? std::abs(cosTheta_w) : cosTheta_w;
+            Float sinTheta_w = SafeSqrt(1 - Sqr(cosTheta_w));
+
+            // Compute $\cos\,\theta_\roman{\+b}$ for the bounds' bounding sphere
+            Float cosTheta_b = dist2 < b.r2[i] ? -1 : SafeSqrt(1 - b.r2[i] / dist2);
+            Float sinTheta_b = SafeSqrt(1 - Sqr(cosTheta_b));
+
+            // Compute $\cos\,\theta'$
+            Float sinTheta_o = SafeSqrt(1 - Sqr(b.cosTheta_o[i]));
+            bool inCone = cosTheta_w > b.cosTheta_o[i];
+            Float cosTheta_x =
+                inCone ? 1 : cosTheta_w * b.cosTheta_o[i] + sinTheta_w * sinTheta_o;
+            Float sinTheta_x =
+                inCone ? 0 : sinTheta_w * b.cosTheta_o[i] - cosTheta_w * sinTheta_o;
+            Float cosThetap = cosTheta_x > cosTheta_b
+                                  ? 1
+                                  : cosTheta_x * cosTheta_b + sinTheta_x * sinTheta_b;
+
+            // Account for $\cos\theta_\roman{i}$ in importance at surfaces
+            Float cosTheta_i = std::abs(wix * n.x + wiy * n.y + wiz * n.z);
+            Float sinTheta_i = SafeSqrt(1 - Sqr(cosTheta_i));
+            Float cosThetap_i = cosTheta_i > cosTheta_b
+                                    ? 1
+                                    : cosTheta_i * cosTheta_b + sinTheta_i * sinTheta_b;
+
+            Float importance = b.phi[i] * cosThetap / d2 * (hasNormal ? cosThetap_i : 1);
+            bool valid = i < nChildren && cosThetap > b.cosTheta_e[i];
+            ci[i] = valid ? std::max<Float>(importance, 0) : 0;
+        }
+    }
+
+    LightBounds buildBVH(std::vector<std::pair<int, LightBounds>> &bvhLights, int start,
+                         int end, int nodeIndex, int depth,
+                         std::vector<LightBVHNode> &binaryNodes) const;
+    void flattenBVH(const std::vector<LightBVHNode> &binaryNodes, int binaryIndex,
+                    int nodeIndex, int maxChildren, uint64_t bitTrail, int trailBits);
+    bool readCache(const std::string &filename, uint64_t key, int nBVHLights);
+    void writeCache(const std::string &filename, uint64_t key, int nBVHLights) const;
+    void initBitTrails(int nodeIndex, uint64_t bitTrail, int trailBits);
 
     Float EvaluateCost(const LightBounds &b, const Bounds3f &bounds, int dim) const {
         // Evaluate direction bounds measure for _LightBounds_
@@ -400,7 +629,11 @@ class BVHLightSampler {
     pstd::vector<Light> infiniteLights;
     Bounds3f allLightBounds;
     pstd::vector<LightBVHNode> nodes;
-    HashMap<Light, uint32_t> lightToBitTrail;
+    int maxChildren;
+    // Indexed by _ChildBoundsIndex()_ for interior nodes; only initialized
+    // for BVHs used on the GPU
+    pstd::vector<LightBVHChildBounds> childBounds;
+    HashMap<Light, uint64_t> lightToBitTrail;
 };
 
 // ExhaustiveLightSampler Definition
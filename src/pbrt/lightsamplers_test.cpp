@@ -7,14 +7,18 @@
 #include <pbrt/interaction.h>
 #include <pbrt/lights.h>
 #include <pbrt/lightsamplers.h>
+#include <pbrt/options.h>
 #include <pbrt/shapes.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/rng.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/transform.h>
 #include <pbrt/util/vecmath.h>
 
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
@@ -295,6 +299,136 @@ TEST(BVHLightSampling, PdfMethod) {
     }
 }
 
+TEST(BVHLightSampling, WidePdfMethod) {
+    RNG rng(5251);
+    auto r = [&rng]() { return rng.Uniform<Float>(); };
+
+    std::vector<Light> lights;
+    std::vector<Shape> tris;
+    std::tie(lights, tris) = randomLights(20, Allocator());
+
+    BVHLightSampler distrib(lights, Allocator(), 4);
+    for (int i = 0; i < 100; ++i) {
+        Point3f p{-1 + 3 * r(), -1 + 3 * r(), -1 + 3 * r()};
+        Float u = rng.Uniform<Float>();
+        Interaction intr(Point3fi(p), Normal3f(0, 0, 0), Point2f(0, 0));
+        pstd::optional<SampledLight> sampledLight = distrib.Sample(intr, u);
+        if (sampledLight) {
+            EXPECT_FLOAT_EQ(sampledLight->p, distrib.PMF(intr, sampledLight->light));
+        }
+    }
+}
+
+TEST(BVHLightSampling, Cache) {
+    RNG rng(5251);
+    auto r = [&rng]() { return rng.Uniform<Float>(); };
+
+    std::vector<Light> lights;
+    std::vector<Shape> tris;
+    std::tie(lights, tris) = randomLights(20, Allocator());
+
+    for (int maxChildren : {2, 4}) {
+        std::vector<std::string> existing = MatchingFilenames("./lightbvh-");
+        Options->sceneCacheDirectory = ".";
+
+        // The first light BVH writes the cache file and the second one reads it
+        BVHLightSampler built(lights, Allocator(), maxChildren);
+        std::vector<std::string> written;
+        for (const std::string &fn : MatchingFilenames("./lightbvh-"))
+            if (std::find(existing.begin(), existing.end(), fn) == existing.end())
+                written.push_back(fn);
+        EXPECT_EQ(1, written.size());
+        BVHLightSampler cached(lights, Allocator(), maxChildren);
+
+        Options->sceneCacheDirectory.clear();
+        for (const std::string &fn : written)
+            EXPECT_TRUE(RemoveFile(fn));
+
+        for (int i = 0; i < 100; ++i) {
+            Point3f p{-1 + 3 * r(), -1 + 3 * r(), -1 + 3 * r()};
+            Interaction intr(Point3fi(p), Normal3f(0, 0, 0), Point2f(0, 0));
+            Float u = r();
+            pstd::optional<SampledLight> builtLight = built.Sample(intr, u);
+            pstd::optional<SampledLight> cachedLight = cached.Sample(intr, u);
+            ASSERT_EQ(builtLight.has_value(), cachedLight.has_value());
+            if (builtLight) {
+                EXPECT_TRUE(builtLight->light == cachedLight->light);
+                EXPECT_EQ(builtLight->p, cachedLight->p);
+                EXPECT_EQ(built.PMF(intr, builtLight->light),
+                          cached.PMF(intr, builtLight->light));
+            }
+        }
+    }
+}
+
+TEST(BVHLightSampling, DecodedChildBounds) {
+    RNG rng(5251);
+    auto r = [&rng]() { return rng.Uniform<Float>(); };
+
+    std::vector<Light> lights;
+    std::vector<Shape> tris;
+    std::tie(lights, tris) = randomLights(50, Allocator());
+
+    for (int maxChildren : {2, 4}) {
+        BVHLightSampler compact(lights, Allocator(), maxChildren);
+        BVHLightSampler decoded(lights, Allocator(), maxChildren, true);
+
+        for (int i = 0; i < 100; ++i) {
+            Point3f p{-1 + 3 * r(), -1 + 3 * r(), -1 + 3 * r()};
+            Normal3f n = i & 1 ? Normal3f(SampleUniformSphere({r(), r()}))
+                               : Normal3f(0, 0, 0);
+            Interaction intr(Point3fi(p), n, Point2f(0, 0));
+            Float u = r();
+            pstd::optional<SampledLight> compactLight = compact.Sample(intr, u);
+            pstd::optional<SampledLight> decodedLight = decoded.Sample(intr, u);
+            ASSERT_EQ(compactLight.has_value(), decodedLight.has_value());
+            if (compactLight) {
+                EXPECT_TRUE(compactLight->light == decodedLight->light);
+                EXPECT_EQ(compactLight->p, decodedLight->p);
+                EXPECT_EQ(compact.PMF(intr, compactLight->light),
+                          decoded.PMF(intr, compactLight->light));
+            }
+        }
+    }
+}
+
+// Enough point lights that the BVH's subtrees and bins are built in parallel;
+// the PMFs of all of them should sum to one for both binary and wide trees.
+TEST(BVHLightSampling, ManyLights) {
+    RNG rng(17);
+    std::vector<Light> lights;
+    ConstantSpectrum one(1.f);
+    for (int i = 0; i < 100000; ++i) {
+        Vector3f p{Lerp(rng.Uniform<Float>(), -5, 5), Lerp(rng.Uniform<Float>(), -5, 5),
+                   Lerp(rng.Uniform<Float>(), -5, 5)};
+        lights.push_back(new PointLight(Translate(p), MediumInterface(), &one, 1.f));
+    }
+
+    for (int maxChildren : {2, 4}) {
+        BVHLightSampler distrib(lights, Allocator(), maxChildren);
+        for (int i = 0; i < 2; ++i) {
+            Point3f p{Lerp(rng.Uniform<Float>(), 10, 20),
+                      Lerp(rng.Uniform<Float>(), -20, 20),
+                      Lerp(rng.Uniform<Float>(), -20, 20)};
+            Interaction intr(Point3fi(p), Normal3f(0, 0, 0), Point2f(0, 0));
+            double sumPMF = 0;
+            for (Light light : lights)
+                sumPMF += distrib.PMF(intr, light);
+            EXPECT_LT(std::abs(sumPMF - 1), 1e-3) << maxChildren;
+
+            for (int j = 0; j < 100; ++j) {
+                pstd::optional<SampledLight> sampledLight =
+                    distrib.Sample(intr, rng.Uniform<Float>());
+                ASSERT_TRUE((bool)sampledLight);
+                EXPECT_LT(std::abs(distrib.PMF(intr, sampledLight->light) -
+                                   sampledLight->p) /
+                              sampledLight->p,
+                          1e-4);
+            }
+        }
+    }
+}
+
 TEST(ExhaustiveLightSampling, PdfMethod) {
     RNG rng(5251);
     auto r = [&rng]() { return rng.Uniform<Float>(); };
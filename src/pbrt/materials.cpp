@@ -230,9 +230,10 @@ ConductorMaterial *ConductorMaterial::Create(const TextureParameterDictionary &p
     if (!reflectance) {
         if (!eta)
             eta = alloc.new_object<SpectrumConstantTexture>(
-                GetNamedSpectrum("metal-Cu-eta"));
+                GetDenselySampledNamedSpectrum("metal-Cu-eta"));
         if (!k)
-            k = alloc.new_object<SpectrumConstantTexture>(GetNamedSpectrum("metal-Cu-k"));
+            k = alloc.new_object<SpectrumConstantTexture>(
+                GetDenselySampledNamedSpectrum("metal-Cu-k"));
     }
 
     FloatTexture uRoughness = parameters.GetFloatTextureOrNull("uroughness", alloc);
@@ -279,7 +280,7 @@ PBRT_CPU_GPU CoatedDiffuseBxDF CoatedDiffuseMaterial::GetBxDF(TextureEvaluator t
     Float gg = Clamp(texEval(g, ctx), -1, 1);
 
     return CoatedDiffuseBxDF(DielectricBxDF(sampledEta, distrib), DiffuseBxDF(r), thick,
-                             a, gg, maxDepth, nSamples);
+                             a, gg, maxDepth, nSamples, table);
 }
 
 // Explicit template instantiation
@@ -289,13 +290,18 @@ template PBRT_CPU_GPU CoatedDiffuseBxDF CoatedDiffuseMaterial::GetBxDF(
 template PBRT_CPU_GPU CoatedDiffuseBxDF CoatedDiffuseMaterial::GetBxDF(
     UniversalTextureEvaluator, const MaterialEvalContext &ctx,
     SampledWavelengths &lambda) const;
+template PBRT_CPU_GPU CoatedDiffuseBxDF CoatedDiffuseMaterial::GetBxDF(
+    CachingTextureEvaluator, const MaterialEvalContext &ctx,
+    SampledWavelengths &lambda) const;
 
 std::string CoatedDiffuseMaterial::ToString() const {
     return StringPrintf(
         "[ CoatedDiffuseMaterial displacement: %s normalMap: %s reflectance: %s "
-        "uRoughness: %s vRoughness: %s thickness: %s eta: %s remapRoughness: %s ]",
+        "uRoughness: %s vRoughness: %s thickness: %s eta: %s remapRoughness: %s "
+        "table: %s ]",
         displacement, normalMap ? normalMap->ToString() : std::string("(nullptr)"),
-        reflectance, uRoughness, vRoughness, thickness, eta, remapRoughness);
+        reflectance, uRoughness, vRoughness, thickness, eta, remapRoughness,
+        table ? table->ToString() : std::string("(nullptr)"));
 }
 
 CoatedDiffuseMaterial *CoatedDiffuseMaterial::Create(
@@ -330,6 +336,7 @@ CoatedDiffuseMaterial *CoatedDiffuseMaterial::Create(
     FloatTexture g = parameters.GetFloatTexture("g", 0.f, alloc);
     SpectrumTexture albedo =
         parameters.GetSpectrumTexture("albedo", nullptr, SpectrumType::Albedo, alloc);
+    bool scatteringMedium = bool(albedo);
     if (!albedo)
         albedo = alloc.new_object<SpectrumConstantTexture>(
             alloc.new_object<ConstantSpectrum>(0.f));
@@ -337,9 +344,35 @@ CoatedDiffuseMaterial *CoatedDiffuseMaterial::Create(
     FloatTexture displacement = parameters.GetFloatTextureOrNull("displacement", alloc);
     bool remapRoughness = parameters.GetOneBool("remaproughness", true);
 
+    // Use the tabulated evaluation of the layered BSDF if requested
+    const CoatedDiffuseTable *table = nullptr;
+    if (parameters.GetOneBool("tabulate", false)) {
+        auto constantValue = [](FloatTexture tex) -> pstd::optional<Float> {
+            if (!tex.Is<FloatConstantTexture>())
+                return {};
+            return tex.Cast<FloatConstantTexture>()->Evaluate(TextureEvalContext());
+        };
+        pstd::optional<Float> urough = constantValue(uRoughness),
+                              vrough = constantValue(vRoughness),
+                              thick = constantValue(thickness);
+        if (!urough || !vrough || !thick || *urough != *vrough || scatteringMedium ||
+            !eta.Is<ConstantSpectrum>())
+            Warning(loc, "\"tabulate\" requires constant isotropic roughness and "
+                         "thickness, a constant \"eta\" and no \"albedo\". Using "
+                         "stochastic evaluation instead.");
+        else {
+            Float alpha = remapRoughness
+                              ? TrowbridgeReitzDistribution::RoughnessToAlpha(*urough)
+                              : *urough;
+            Float sampledEta = eta(550);
+            table = CoatedDiffuseTable::Get(sampledEta == 0 ? 1 : sampledEta, alpha,
+                                            *thick, alloc);
+        }
+    }
+
     return alloc.new_object<CoatedDiffuseMaterial>(
         reflectance, uRoughness, vRoughness, thickness, albedo, g, eta, displacement,
-        normalMap, remapRoughness, maxDepth, nSamples);
+        normalMap, remapRoughness, maxDepth, nSamples, table);
 }
 
 template <typename TextureEvaluator>
@@ -397,6 +430,9 @@ template PBRT_CPU_GPU CoatedConductorBxDF CoatedConductorMaterial::GetBxDF(
 template PBRT_CPU_GPU CoatedConductorBxDF CoatedConductorMaterial::GetBxDF(
     UniversalTextureEvaluator, const MaterialEvalContext &ctx,
     SampledWavelengths &lambda) const;
+template PBRT_CPU_GPU CoatedConductorBxDF CoatedConductorMaterial::GetBxDF(
+    CachingTextureEvaluator, const MaterialEvalContext &ctx,
+    SampledWavelengths &lambda) const;
 
 std::string CoatedConductorMaterial::ToString() const {
     return StringPrintf(
@@ -462,9 +498,10 @@ CoatedConductorMaterial *CoatedConductorMaterial::Create(
     if (!reflectance) {
         if (!conductorEta)
             conductorEta = alloc.new_object<SpectrumConstantTexture>(
-                GetNamedSpectrum("metal-Cu-eta"));
+                GetDenselySampledNamedSpectrum("metal-Cu-eta"));
         if (!k)
-            k = alloc.new_object<SpectrumConstantTexture>(GetNamedSpectrum("metal-Cu-k"));
+            k = alloc.new_object<SpectrumConstantTexture>(
+                GetDenselySampledNamedSpectrum("metal-Cu-k"));
     }
 
     int maxDepth = parameters.GetOneInt("maxdepth", 10);
@@ -595,10 +632,11 @@ DiffuseTransmissionMaterial *DiffuseTransmissionMaterial::Create(
                                                          displacement, normalMap, scale);
 }
 
-MeasuredMaterial::MeasuredMaterial(const std::string &filename, FloatTexture displacement,
-                                   Image *normalMap, Allocator alloc)
+MeasuredMaterial::MeasuredMaterial(const std::string &filename, bool halfPrecision,
+                                   FloatTexture displacement, Image *normalMap,
+                                   Allocator alloc)
     : displacement(displacement), normalMap(normalMap) {
-    brdf = MeasuredBxDF::BRDFDataFromFile(filename, alloc);
+    brdf = MeasuredBxDF::BRDFDataFromFile(filename, halfPrecision, alloc);
 }
 
 std::string MeasuredMaterial::ToString() const {
@@ -617,7 +655,14 @@ MeasuredMaterial *MeasuredMaterial::Create(const TextureParameterDictionary &par
     }
     FloatTexture displacement = parameters.GetFloatTextureOrNull("displacement", alloc);
 
-    return alloc.new_object<MeasuredMaterial>(filename, displacement, normalMap, alloc);
+    std::string storage = parameters.GetOneString("storage", "float");
+    if (storage != "float" && storage != "half")
+        ErrorExit(loc, "%s: unknown \"storage\" for measured material. Must be "
+                       "\"float\" or \"half\".",
+                  storage);
+
+    return alloc.new_object<MeasuredMaterial>(filename, storage == "half", displacement,
+                                              normalMap, alloc);
 }
 
 std::string Material::ToString() const {
@@ -560,7 +560,8 @@ class CoatedDiffuseMaterial {
                           FloatTexture vRoughness, FloatTexture thickness,
                           SpectrumTexture albedo, FloatTexture g, Spectrum eta,
                           FloatTexture displacement, Image *normalMap,
-                          bool remapRoughness, int maxDepth, int nSamples)
+                          bool remapRoughness, int maxDepth, int nSamples,
+                          const CoatedDiffuseTable *table = nullptr)
         : displacement(displacement),
           normalMap(normalMap),
           reflectance(reflectance),
@@ -572,7 +573,8 @@ class CoatedDiffuseMaterial {
           eta(eta),
           remapRoughness(remapRoughness),
           maxDepth(maxDepth),
-          nSamples(nSamples) {}
+          nSamples(nSamples),
+          table(table) {}
 
     static const char *Name() { return "CoatedDiffuseMaterial"; }
 
@@ -613,6 +615,7 @@ class CoatedDiffuseMaterial {
     Spectrum eta;
     bool remapRoughness;
     int maxDepth, nSamples;
+    const CoatedDiffuseTable *table;
 };
 
 // CoatedConductorMaterial Definition
@@ -716,9 +719,7 @@ class SubsurfaceMaterial {
           vRoughness(vRoughness),
           eta(eta),
           remapRoughness(remapRoughness),
-          table(100, 64, alloc) {
-        ComputeBeamDiffusionBSSRDF(g, eta, &table);
-    }
+          table(GetBeamDiffusionBSSRDF(g, eta, alloc)) {}
 
     static const char *Name() { return "SubsurfaceMaterial"; }
 
@@ -759,9 +760,9 @@ class SubsurfaceMaterial {
             DCHECK(reflectance && mfp);
             SampledSpectrum mfree = ClampZero(scale * texEval(mfp, ctx, lambda));
             SampledSpectrum r = Clamp(texEval(reflectance, ctx, lambda), 0, 1);
-            SubsurfaceFromDiffuse(table, r, mfree, &sig_a, &sig_s);
+            SubsurfaceFromDiffuse(*table, r, mfree, &sig_a, &sig_s);
         }
-        return TabulatedBSSRDF(ctx.p, ctx.ns, ctx.wo, eta, sig_a, sig_s, &table);
+        return TabulatedBSSRDF(ctx.p, ctx.ns, ctx.wo, eta, sig_a, sig_s, table);
     }
 
     PBRT_CPU_GPU
@@ -786,7 +787,7 @@ class SubsurfaceMaterial {
     Float scale, eta;
     FloatTexture uRoughness, vRoughness;
     bool remapRoughness;
-    BSSRDFTable table;
+    const BSSRDFTable *table;
 };
 
 // DiffuseTransmissionMaterial Definition
@@ -857,8 +858,8 @@ class MeasuredMaterial {
         return MeasuredBxDF(brdf, lambda);
     }
 
-    MeasuredMaterial(const std::string &filename, FloatTexture displacement,
-                     Image *normalMap, Allocator alloc);
+    MeasuredMaterial(const std::string &filename, bool halfPrecision,
+                     FloatTexture displacement, Image *normalMap, Allocator alloc);
 
     static const char *Name() { return "MeasuredMaterial"; }
 
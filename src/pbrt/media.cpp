@@ -5,6 +5,7 @@
 #include <pbrt/media.h>
 
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/samplers.h>
 #include <pbrt/textures.h>
@@ -23,6 +24,16 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
 
 namespace pbrt {
 
@@ -41,8 +52,9 @@ std::string PhaseFunction::ToString() const {
 }
 
 std::string RayMajorantSegment::ToString() const {
-    return StringPrintf("[ RayMajorantSegment tMin: %f tMax: %f sigma_maj: %s ]", tMin,
-                        tMax, sigma_maj);
+    return StringPrintf(
+        "[ RayMajorantSegment tMin: %f tMax: %f sigma_maj: %s sigma_min: %s ]", tMin,
+        tMax, sigma_maj, sigma_min);
 }
 
 std::string RayMajorantIterator::ToString() const {
@@ -56,14 +68,37 @@ std::string HomogeneousMajorantIterator::ToString() const {
 }
 
 std::string DDAMajorantIterator::ToString() const {
+    auto ddaString = [](const GridDDA &dda) {
+        return StringPrintf("[ nextCrossingT: [ %f %f %f ] deltaT: [ %f %f %f ] "
+                            "step: [ %d %d %d ] voxelLimit: [ %d %d %d ] "
+                            "voxel: [ %d %d %d ] ]",
+                            dda.nextCrossingT[0], dda.nextCrossingT[1],
+                            dda.nextCrossingT[2], dda.deltaT[0], dda.deltaT[1],
+                            dda.deltaT[2], dda.step[0], dda.step[1], dda.step[2],
+                            dda.voxelLimit[0], dda.voxelLimit[1], dda.voxelLimit[2],
+                            dda.voxel[0], dda.voxel[1], dda.voxel[2]);
+    };
     return StringPrintf("[ DDAMajorantIterator tMin: %f tMax: %f sigma_t: %s "
-                        "nextCrossingT: [ %f %f %f ] deltaT: [ %f %f %f ] "
-                        "step: [ %d %d %d ] voxelLimit: [ %d %d %d ] voxel: [ %d %d %d ] "
-                        "grid: %p ]",
-                        tMin, tMax, sigma_t, nextCrossingT[0], nextCrossingT[1],
-                        nextCrossingT[2], deltaT[0], deltaT[1], deltaT[2], step[0],
-                        step[1], step[2], voxelLimit[0], voxelLimit[1], voxelLimit[2],
-                        voxel[0], voxel[1], voxel[2], grid);
+                        "coarse: %s fine: %s fineTMax: %f grid: %p ]",
+                        tMin, tMax, sigma_t, ddaString(coarse), ddaString(fine),
+                        fineTMax, grid);
+}
+
+// MajorantGrid Method Definitions
+void MajorantGrid::BuildCoarseLevel() {
+    coarseRes = Point3i((res.x + CoarseFactor - 1) / CoarseFactor,
+                        (res.y + CoarseFactor - 1) / CoarseFactor,
+                        (res.z + CoarseFactor - 1) / CoarseFactor);
+    coarseVoxels.resize(coarseRes.x * coarseRes.y * coarseRes.z);
+    std::fill(coarseVoxels.begin(), coarseVoxels.end(), Float(0));
+    for (int z = 0; z < res.z; ++z)
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x) {
+                Float &v = coarseVoxels[x / CoarseFactor +
+                                        coarseRes.x * (y / CoarseFactor +
+                                                       coarseRes.y * (z / CoarseFactor))];
+                v = std::max(v, Lookup(x, y, z));
+            }
 }
 
 // HenyeyGreenstein Method Definitions
@@ -208,13 +243,49 @@ std::string HomogeneousMedium::ToString() const {
 
 STAT_MEMORY_COUNTER("Memory/Volume grids", volumeGridBytes);
 
+// Returns the resolution of a medium's majorant grid, which may be given by a
+// "majorantres" parameter with either one value for all dimensions or three.
+static Point3i GetMajorantGridResolution(const ParameterDictionary &parameters,
+                                         Point3i defaultRes, const FileLoc *loc) {
+    std::vector<int> res = parameters.GetIntArray("majorantres");
+    if (res.empty())
+        return defaultRes;
+    if (res.size() == 1)
+        res = {res[0], res[0], res[0]};
+    else if (res.size() != 3)
+        ErrorExit(loc, "Must provide one or three \"majorantres\" values.");
+    if (res[0] < 1 || res[1] < 1 || res[2] < 1)
+        ErrorExit(loc, "\"majorantres\" values must be at least one.");
+    return Point3i(res[0], res[1], res[2]);
+}
+
+// Sets each voxel of _grid_ to the minorant and majorant that _voxelRange_
+// returns for it as a pair, processing rows of voxels in parallel, and then
+// builds its coarse level.
+template <typename F>
+static void InitializeMajorantGrid(MajorantGrid *grid, F voxelRange) {
+    Point3i res = grid->res;
+    ParallelFor(0, res.y * res.z, [&](int64_t start, int64_t end) {
+        for (int64_t row = start; row < end; ++row) {
+            int y = row % res.y, z = row / res.y;
+            for (int x = 0; x < res.x; ++x) {
+                std::pair<Float, Float> range = voxelRange(x, y, z);
+                grid->SetMinorant(x, y, z, range.first);
+                grid->Set(x, y, z, range.second);
+            }
+        }
+    });
+    grid->BuildCoarseLevel();
+}
+
 // GridMedium Method Definitions
 GridMedium::GridMedium(const Bounds3f &bounds, const Transform &renderFromMedium,
                        Spectrum sigma_a, Spectrum sigma_s, Float sigmaScale, Float g,
                        SampledGrid<Float> d,
                        pstd::optional<SampledGrid<Float>> temperature,
                        Float temperatureScale, Float temperatureOffset,
-                       Spectrum Le, SampledGrid<Float> LeGrid, Allocator alloc)
+                       Spectrum Le, SampledGrid<Float> LeGrid, Point3i majorantRes,
+                       Allocator alloc)
     : bounds(bounds),
       renderFromMedium(renderFromMedium),
       sigma_a_spec(sigma_a, alloc),
@@ -226,7 +297,7 @@ GridMedium::GridMedium(const Bounds3f &bounds, const Transform &renderFromMedium
       temperatureOffset(temperatureOffset),
       Le_spec(Le, alloc),
       LeScale(std::move(LeGrid)),
-      majorantGrid(bounds, {16, 16, 16}, alloc) {
+      majorantGrid(bounds, majorantRes, alloc) {
     sigma_a_spec.Scale(sigmaScale);
     sigma_s_spec.Scale(sigmaScale);
 
@@ -238,50 +309,143 @@ GridMedium::GridMedium(const Bounds3f &bounds, const Transform &renderFromMedium
     isEmissive = temperatureGrid ? true : (Le_spec.MaxValue() > 0);
 
     // Initialize _majorantGrid_ for _GridMedium_
-    for (int z = 0; z < majorantGrid.res.z; ++z)
-        for (int y = 0; y < majorantGrid.res.y; ++y)
-            for (int x = 0; x < majorantGrid.res.x; ++x) {
-                Bounds3f bounds = majorantGrid.VoxelBounds(x, y, z);
-                majorantGrid.Set(x, y, z, densityGrid.MaxValue(bounds));
+    InitializeMajorantGrid(&majorantGrid, [&](int x, int y, int z) {
+        Bounds3f bounds = majorantGrid.VoxelBounds(x, y, z);
+        return std::make_pair(densityGrid.MinValue(bounds), densityGrid.MaxValue(bounds));
+    });
+}
+
+STAT_COUNTER("Scene/Grid medium sample files read", nGridMediumFiles);
+
+// Calls _f_ with the samples in the grid sample file _filename_ and the
+// grid's resolution; uncompressed files are mapped into memory so that
+// their samples are used in place rather than being copied first.
+template <typename F>
+static void ReadGridMediumFile(const std::string &filename, const FileLoc *loc, F f) {
+    std::string contents;
+    const char *data = nullptr;
+    size_t size = 0;
+    void *mapping = nullptr;
+#ifdef PBRT_HAVE_MMAP
+    if (!HasExtension(filename, ".gz")) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            ErrorExit(loc, "%s: %s", filename, ErrorString());
+        struct stat stat;
+        if (fstat(fd, &stat) != 0)
+            ErrorExit(loc, "%s: %s", filename, ErrorString());
+        size = stat.st_size;
+        if (size > 0) {
+            void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                mapping = ptr;
+                data = (const char *)ptr;
             }
+        }
+        close(fd);
+    }
+#endif
+    if (!mapping) {
+        contents = HasExtension(filename, ".gz") ? ReadDecompressedFileContents(filename)
+                                                 : ReadFileContents(filename);
+        data = contents.data();
+        size = contents.size();
+    }
+
+    // Check the header and that the file holds all of the samples
+    constexpr size_t headerBytes = sizeof(GridMediumFileMagic) - 1 + 3 * sizeof(int32_t);
+    if (size < headerBytes ||
+        memcmp(data, GridMediumFileMagic, sizeof(GridMediumFileMagic) - 1) != 0)
+        ErrorExit(loc, "%s: not a grid medium sample file.", filename);
+    int32_t res[3];
+    for (int i = 0; i < 3; ++i) {
+        const unsigned char *s =
+            (const unsigned char *)data + sizeof(GridMediumFileMagic) - 1 + 4 * i;
+        res[i] = int32_t(uint32_t(s[0]) | (uint32_t(s[1]) << 8) |
+                         (uint32_t(s[2]) << 16) | (uint32_t(s[3]) << 24));
+        if (res[i] <= 0)
+            ErrorExit(loc, "%s: invalid grid resolution.", filename);
+    }
+    size_t nSamples = size_t(res[0]) * res[1] * res[2];
+    if (size != headerBytes + nSamples * sizeof(float))
+        ErrorExit(loc, "%s: expected %d grid samples but file has %d bytes of them.",
+                  filename, nSamples, size - headerBytes);
+
+    const float *samples = (const float *)(data + headerBytes);
+    if constexpr (std::is_same_v<Float, float>)
+        f(pstd::span<const Float>(samples, nSamples), Point3i(res[0], res[1], res[2]));
+    else {
+        std::vector<Float> values(samples, samples + nSamples);
+        f(pstd::span<const Float>(values), Point3i(res[0], res[1], res[2]));
+    }
+    ++nGridMediumFiles;
+
+#ifdef PBRT_HAVE_MMAP
+    if (mapping && munmap(mapping, size) != 0)
+        Error("munmap: %s", ErrorString());
+#endif
 }
 
 GridMedium *GridMedium::Create(const ParameterDictionary &parameters,
                                const Transform &renderFromMedium, const FileLoc *loc,
                                Allocator alloc) {
+    // Samples are either given directly or in files written by nanovdb2pbrt
     std::vector<Float> density = parameters.GetFloatArray("density");
     std::vector<Float> temperature = parameters.GetFloatArray("temperature");
+    std::string densityFile = ResolveFilename(parameters.GetOneString("densityfile", ""));
+    std::string temperatureFile =
+        ResolveFilename(parameters.GetOneString("temperaturefile", ""));
+    if (!density.empty() && !densityFile.empty())
+        ErrorExit(loc, "Both \"density\" and \"densityfile\" values were provided.");
+    if (!temperature.empty() && !temperatureFile.empty())
+        ErrorExit(loc,
+                  "Both \"temperature\" and \"temperaturefile\" values were provided.");
 
-    size_t nDensity;
-    if (density.empty())
+    if (density.empty() && densityFile.empty())
         ErrorExit(loc, "No \"density\" value provided for grid medium.");
-    nDensity = density.size();
 
-    if (!temperature.empty())
-        if (nDensity != temperature.size())
+    if (!density.empty() && !temperature.empty())
+        if (density.size() != temperature.size())
             ErrorExit(loc,
                       "Different number of samples (%d vs %d) provided for "
                       "\"density\" and \"temperature\".",
-                      nDensity, temperature.size());
+                      density.size(), temperature.size());
 
     int nx = parameters.GetOneInt("nx", 1);
     int ny = parameters.GetOneInt("ny", 1);
     int nz = parameters.GetOneInt("nz", 1);
-    if (nDensity != nx * ny * nz)
-        ErrorExit(loc, "Grid medium has %d density values; expected nx*ny*nz = %d",
-                  nDensity, nx * ny * nz);
+    auto createGrid = [&](const std::vector<Float> &values, const std::string &filename,
+                          const char *name) {
+        if (filename.empty()) {
+            if (values.size() != nx * ny * nz)
+                ErrorExit(loc, "Grid medium has %d %s values; expected nx*ny*nz = %d",
+                          values.size(), name, nx * ny * nz);
+            return SampledGrid<Float>(values, nx, ny, nz, alloc);
+        }
+        SampledGrid<Float> grid(alloc);
+        ReadGridMediumFile(filename, loc,
+                           [&](pstd::span<const Float> samples, Point3i res) {
+                               if (res != Point3i(nx, ny, nz))
+                                   ErrorExit(loc,
+                                             "%s: grid resolution %d x %d x %d doesn't "
+                                             "match nx, ny, nz = %d x %d x %d.",
+                                             filename, res.x, res.y, res.z, nx, ny, nz);
+                               grid = SampledGrid<Float>(samples, nx, ny, nz, alloc);
+                           });
+        return grid;
+    };
 
     // Create Density Grid
-    SampledGrid<Float> densityGrid = SampledGrid<Float>(density, nx, ny, nz, alloc);
+    SampledGrid<Float> densityGrid = createGrid(density, densityFile, "density");
 
     pstd::optional<SampledGrid<Float>> temperatureGrid;
-    if (temperature.size())
-        temperatureGrid = SampledGrid<Float>(temperature, nx, ny, nz, alloc);
+    if (!temperature.empty() || !temperatureFile.empty())
+        temperatureGrid = createGrid(temperature, temperatureFile, "temperature");
 
     Spectrum Le =
         parameters.GetOneSpectrum("Le", nullptr, SpectrumType::Illuminant, alloc);
 
-    if (Le && !temperature.empty())
+    if (Le && temperatureGrid)
         ErrorExit(loc, "Both \"Le\" and \"temperature\" values were provided.");
 
     Float LeNorm = 1;
@@ -322,11 +486,12 @@ GridMedium *GridMedium::Create(const ParameterDictionary &parameters,
     Float temperatureOffset = parameters.GetOneFloat("temperatureoffset",
                                                      parameters.GetOneFloat("temperaturecutoff", 0.f));
     Float temperatureScale = parameters.GetOneFloat("temperaturescale", 1.f);
+    Point3i majorantRes = GetMajorantGridResolution(parameters, {16, 16, 16}, loc);
 
     return alloc.new_object<GridMedium>(
         Bounds3f(p0, p1), renderFromMedium, sigma_a, sigma_s, sigmaScale, g,
         std::move(densityGrid), std::move(temperatureGrid), temperatureScale,
-        temperatureOffset, Le, std::move(LeGrid), alloc);
+        temperatureOffset, Le, std::move(LeGrid), majorantRes, alloc);
 }
 
 std::string GridMedium::ToString() const {
@@ -342,14 +507,14 @@ RGBGridMedium::RGBGridMedium(const Bounds3f &bounds, const Transform &renderFrom
                              pstd::optional<SampledGrid<RGBUnboundedSpectrum>> rgbS,
                              Float sigmaScale,
                              pstd::optional<SampledGrid<RGBIlluminantSpectrum>> rgbLe,
-                             Float LeScale, Allocator alloc)
+                             Float LeScale, Point3i majorantRes, Allocator alloc)
     : bounds(bounds),
       renderFromMedium(renderFromMedium),
       phase(g),
       sigma_aGrid(std::move(rgbA)),
       sigma_sGrid(std::move(rgbS)),
       sigmaScale(sigmaScale),
-      majorantGrid(bounds, {16, 16, 16}, alloc),
+      majorantGrid(bounds, majorantRes, alloc),
       LeGrid(std::move(rgbLe)),
       LeScale(LeScale) {
     if (LeGrid)
@@ -362,19 +527,16 @@ RGBGridMedium::RGBGridMedium(const Bounds3f &bounds, const Transform &renderFrom
         volumeGridBytes += LeGrid->BytesAllocated();
 
     // Initialize _majorantGrid_ for _RGBGridMedium_
-    for (int z = 0; z < majorantGrid.res.z; ++z)
-        for (int y = 0; y < majorantGrid.res.y; ++y)
-            for (int x = 0; x < majorantGrid.res.x; ++x) {
-                Bounds3f bounds = majorantGrid.VoxelBounds(x, y, z);
-                // Initialize _majorantGrid_ voxel for RGB $\sigmaa$ and $\sigmas$
-                auto max = [] PBRT_CPU_GPU(RGBUnboundedSpectrum s) {
-                    return s.MaxValue();
-                };
-                Float maxSigma_t =
-                    (sigma_aGrid ? sigma_aGrid->MaxValue(bounds, max) : 1) +
-                    (sigma_sGrid ? sigma_sGrid->MaxValue(bounds, max) : 1);
-                majorantGrid.Set(x, y, z, sigmaScale * maxSigma_t);
-            }
+    InitializeMajorantGrid(&majorantGrid, [&](int x, int y, int z) {
+        Bounds3f bounds = majorantGrid.VoxelBounds(x, y, z);
+        // Compute majorant for RGB $\sigmaa$ and $\sigmas$ in voxel
+        auto max = [] PBRT_CPU_GPU(RGBUnboundedSpectrum s) { return s.MaxValue(); };
+        Float maxSigma_t = (sigma_aGrid ? sigma_aGrid->MaxValue(bounds, max) : 1) +
+                           (sigma_sGrid ? sigma_sGrid->MaxValue(bounds, max) : 1);
+        // Bounding RGB spectra from below is not worth the trouble, so use zero
+        // minorants
+        return std::make_pair(Float(0), sigmaScale * maxSigma_t);
+    });
 }
 
 RGBGridMedium *RGBGridMedium::Create(const ParameterDictionary &parameters,
@@ -446,10 +608,12 @@ RGBGridMedium *RGBGridMedium::Create(const ParameterDictionary &parameters,
     Float LeScale = parameters.GetOneFloat("Lescale", 1.f);
     Float g = parameters.GetOneFloat("g", 0.f);
     Float sigmaScale = parameters.GetOneFloat("scale", 1.f);
+    Point3i majorantRes = GetMajorantGridResolution(parameters, {16, 16, 16}, loc);
 
-    return alloc.new_object<RGBGridMedium>(Bounds3f(p0, p1), renderFromMedium, g,
-                                           std::move(sigma_aGrid), std::move(sigma_sGrid),
-                                           sigmaScale, std::move(LeGrid), LeScale, alloc);
+    return alloc.new_object<RGBGridMedium>(
+        Bounds3f(p0, p1), renderFromMedium, g, std::move(sigma_aGrid),
+        std::move(sigma_sGrid), sigmaScale, std::move(LeGrid), LeScale, majorantRes,
+        alloc);
 }
 
 std::string RGBGridMedium::ToString() const {
@@ -483,18 +647,108 @@ CloudMedium *CloudMedium::Create(const ParameterDictionary &parameters,
                                          alloc);
 }
 
+// NanoVDBBuffer Method Definitions
+void NanoVDBBuffer::Unmap(void *mapping, size_t mappingBytes) {
+#ifdef PBRT_HAVE_MMAP
+    if (munmap(mapping, mappingBytes) != 0)
+        Error("munmap: %s", ErrorString());
+#else
+    LOG_FATAL("NanoVDBBuffer with a mapping but no mmap support");
+#endif
+}
+
+STAT_COUNTER("Scene/Memory-mapped NanoVDB grids", nMappedNanoVDBGrids);
+
+// Returns a handle to the grid _gridName_ in _filename_ that accesses it
+// directly from the memory-mapped file, so that only the parts of the grid
+// that are accessed are read from disk and the operating system can evict
+// them when memory is needed. An empty handle is returned if the grid isn't
+// in the file or can't be used in place.
+static nanovdb::GridHandle<NanoVDBBuffer> mapGrid(const std::string &filename,
+                                                  const std::string &gridName,
+                                                  const FileLoc *loc) {
+#ifdef PBRT_HAVE_MMAP
+    // Find the offset and size of the grid's data in the file
+    std::ifstream is(filename, std::ios::in | std::ios::binary);
+    if (!is)
+        ErrorExit(loc, "%s: %s", filename, ErrorString());
+    nanovdb::io::Segment seg;
+    int64_t gridOffset = -1;
+    uint64_t gridSize = 0;
+    while (gridOffset == -1 && seg.read(is)) {
+        // Grids' data follows the segment's header and metadata
+        int64_t offset = is.tellg();
+        for (const nanovdb::io::GridMetaData &meta : seg.meta) {
+            if (meta.gridName == gridName) {
+                if (seg.header.codec != nanovdb::io::Codec::NONE) {
+                    Warning(loc,
+                            "%s: \"%s\" grid is compressed and so can't be used "
+                            "out of core.",
+                            filename, gridName);
+                    return {};
+                }
+                gridOffset = offset;
+                gridSize = meta.gridSize;
+                break;
+            }
+            offset += meta.fileSize;
+        }
+        is.seekg(offset);
+    }
+    if (gridOffset == -1)
+        return {};
+    if (gridOffset % NANOVDB_DATA_ALIGNMENT != 0) {
+        Warning(loc,
+                "%s: \"%s\" grid isn't aligned in the file and so can't be used out "
+                "of core.",
+                filename, gridName);
+        return {};
+    }
+
+    // Map the file and return a handle for the grid's data in it
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        ErrorExit(loc, "%s: %s", filename, ErrorString());
+    struct stat stat;
+    if (fstat(fd, &stat) != 0)
+        ErrorExit(loc, "%s: %s", filename, ErrorString());
+    size_t len = stat.st_size;
+    if (gridOffset + gridSize > len)
+        ErrorExit(loc, "%s: file is truncated.", filename);
+    void *ptr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    if (ptr == MAP_FAILED)
+        ErrorExit(loc, "%s: %s", filename, ErrorString());
+    if (close(fd) != 0)
+        ErrorExit(loc, "%s: %s", filename, ErrorString());
+    // Rays access voxels incoherently, so read-ahead is mostly wasted
+    madvise(ptr, len, MADV_RANDOM);
+
+    ++nMappedNanoVDBGrids;
+    return nanovdb::GridHandle<NanoVDBBuffer>(NanoVDBBuffer::FromMapping(
+        (uint8_t *)ptr + gridOffset, gridSize, ptr, len));
+#else
+    Warning(loc, "%s: memory-mapped files aren't supported on this system.", filename);
+    return {};
+#endif
+}
+
 // NanoVDBMedium Method Definitions
 template <typename Buffer>
 static nanovdb::GridHandle<Buffer> readGrid(const std::string &filename,
                                             const std::string &gridName,
-                                            const FileLoc *loc, Allocator alloc) {
-    NanoVDBBuffer buf(alloc);
+                                            const FileLoc *loc, bool outOfCore,
+                                            Allocator alloc) {
     nanovdb::GridHandle<Buffer> grid;
-    try {
-        grid =
-            nanovdb::io::readGrid<Buffer>(filename, gridName, 0 /* not verbose */, buf);
-    } catch (const std::exception &e) {
-        ErrorExit("nanovdb: %s: %s", filename, e.what());
+    if (outOfCore)
+        grid = mapGrid(filename, gridName, loc);
+    if (!grid) {
+        NanoVDBBuffer buf(alloc);
+        try {
+            grid = nanovdb::io::readGrid<Buffer>(filename, gridName, 0 /* not verbose */,
+                                                 buf);
+        } catch (const std::exception &e) {
+            ErrorExit("nanovdb: %s: %s", filename, e.what());
+        }
     }
 
     if (grid) {
@@ -513,12 +767,12 @@ NanoVDBMedium::NanoVDBMedium(const Transform &renderFromMedium, Spectrum sigma_a
                              nanovdb::GridHandle<NanoVDBBuffer> dg,
                              nanovdb::GridHandle<NanoVDBBuffer> tg, Float LeScale,
                              Float temperatureOffset, Float temperatureScale,
-                             Allocator alloc)
+                             Point3i majorantRes, Allocator alloc)
     : renderFromMedium(renderFromMedium),
       sigma_a_spec(sigma_a, alloc),
       sigma_s_spec(sigma_s, alloc),
       phase(g),
-      majorantGrid(Bounds3f(), {64, 64, 64}, alloc),
+      majorantGrid(Bounds3f(), majorantRes, alloc),
       densityGrid(std::move(dg)),
       temperatureGrid(std::move(tg)),
       LeScale(LeScale),
@@ -557,14 +811,7 @@ NanoVDBMedium::NanoVDBMedium(const Transform &renderFromMedium, Spectrum sigma_a
 #else
     LOG_VERBOSE("Starting nanovdb grid GetMaxDensityGrid()");
 
-    int gridSize = majorantGrid.res.x * majorantGrid.res.y * majorantGrid.res.z;
-    ParallelFor(0, gridSize, [&](size_t index) {
-        // Indices into majorantGrid
-        int x = index % majorantGrid.res.x;
-        int y = (index / majorantGrid.res.x) % majorantGrid.res.y;
-        int z = index / (majorantGrid.res.x * majorantGrid.res.y);
-        CHECK_EQ(index, x + majorantGrid.res.x * (y + majorantGrid.res.y * z));
-
+    InitializeMajorantGrid(&majorantGrid, [&](int x, int y, int z) {
         // World (aka medium) space bounds of this max grid cell
         Bounds3f wb(bounds.Lerp(Point3f(Float(x) / majorantGrid.res.x,
                                         Float(y) / majorantGrid.res.y,
@@ -589,6 +836,11 @@ NanoVDBMedium::NanoVDBMedium(const Transform &renderFromMedium, Spectrum sigma_a
         int ny1 = std::min(int(i1[1] + delta), bbox.max()[1]);
         int nz0 = std::max(int(i0[2] - delta), bbox.min()[2]);
         int nz1 = std::min(int(i1[2] + delta), bbox.max()[2]);
+        // Density is zero outside of the index bounding box, so the minorant
+        // is zero for cells that the clamping above cut off
+        bool clipped = nx0 != int(i0[0] - delta) || nx1 != int(i1[0] + delta) ||
+                       ny0 != int(i0[1] - delta) || ny1 != int(i1[1] + delta) ||
+                       nz0 != int(i0[2] - delta) || nz1 != int(i1[2] + delta);
 
         // FIXME: While the following is properly conservative, it can lead
         // to voxels with majorants that are much higher than any actual
@@ -601,18 +853,20 @@ NanoVDBMedium::NanoVDBMedium(const Transform &renderFromMedium, Spectrum sigma_a
         // boundary samples.  The impact of these majorants is not
         // insignificant; they cause a roughly 10% slowdown in practice
         // due to excess null scattering in such voxels.
-        float maxValue = 0;
+        float maxValue = 0, minValue = clipped ? 0 : Infinity;
         auto accessor = densityFloatGrid->getAccessor();
         // Apparently nanovdb integer bounding boxes are inclusive on
         // the upper end...
         for (int nz = nz0; nz <= nz1; ++nz)
             for (int ny = ny0; ny <= ny1; ++ny)
-                for (int nx = nx0; nx <= nx1; ++nx)
-                    maxValue = std::max(maxValue, accessor.getValue({nx, ny, nz}));
-
-        // Only write into maxGrid once when we're done to minimize
-        // cache thrashing..
-        majorantGrid.Set(x, y, z, maxValue);
+                for (int nx = nx0; nx <= nx1; ++nx) {
+                    float value = accessor.getValue({nx, ny, nz});
+                    maxValue = std::max(maxValue, value);
+                    minValue = std::min(minValue, value);
+                }
+        if (minValue == Infinity)
+            minValue = 0;
+        return std::make_pair(Float(std::max(0.f, minValue)), Float(maxValue));
     });
 
     LOG_VERBOSE("Finished nanovdb grid GetMaxDensityGrid()");
@@ -632,16 +886,26 @@ NanoVDBMedium *NanoVDBMedium::Create(const ParameterDictionary &parameters,
     if (filename.empty())
         ErrorExit(loc, "Must supply \"filename\" to \"nanovdb\" medium.");
 
+    // Access the grids directly from the file rather than reading them into memory
+    // if requested; this isn't possible with the GPU, which can't access
+    // memory-mapped files
+    bool outOfCore = parameters.GetOneBool("outofcore", false);
+    if (outOfCore && Options->useGPU) {
+        Warning(loc, "\"outofcore\" is not supported with the GPU renderer.");
+        outOfCore = false;
+    }
+
     nanovdb::GridHandle<NanoVDBBuffer> densityGrid;
     std::string gridname = parameters.GetOneString("gridname", "density");
-    densityGrid = readGrid<NanoVDBBuffer>(filename, gridname, loc, alloc);
+    densityGrid = readGrid<NanoVDBBuffer>(filename, gridname, loc, outOfCore, alloc);
     if (!densityGrid)
         ErrorExit(loc, "%s: didn't find \"density\" grid.", filename);
 
     nanovdb::GridHandle<NanoVDBBuffer> temperatureGrid;
     std::string temperaturename =
         parameters.GetOneString("temperaturename", "temperature");
-    temperatureGrid = readGrid<NanoVDBBuffer>(filename, temperaturename, loc, alloc);
+    temperatureGrid =
+        readGrid<NanoVDBBuffer>(filename, temperaturename, loc, outOfCore, alloc);
 
     Float LeScale = parameters.GetOneFloat("Lescale", 1.f);
     Float temperatureOffset = parameters.GetOneFloat("temperatureoffset",
@@ -658,10 +922,12 @@ NanoVDBMedium *NanoVDBMedium::Create(const ParameterDictionary &parameters,
     if (!sigma_s)
         sigma_s = alloc.new_object<ConstantSpectrum>(1.f);
     Float sigmaScale = parameters.GetOneFloat("scale", 1.f);
+    Point3i majorantRes = GetMajorantGridResolution(parameters, {64, 64, 64}, loc);
 
     return alloc.new_object<NanoVDBMedium>(
         renderFromMedium, sigma_a, sigma_s, sigmaScale, g, std::move(densityGrid),
-        std::move(temperatureGrid), LeScale, temperatureOffset, temperatureScale, alloc);
+        std::move(temperatureGrid), LeScale, temperatureOffset, temperatureScale,
+        majorantRes, alloc);
 }
 
 Medium Medium::Create(const std::string &name, const ParameterDictionary &parameters,
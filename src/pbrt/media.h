@@ -83,8 +83,9 @@ class HomogeneousMajorantIterator {
     PBRT_CPU_GPU
     HomogeneousMajorantIterator() : called(true) {}
     PBRT_CPU_GPU
-    HomogeneousMajorantIterator(Float tMin, Float tMax, SampledSpectrum sigma_maj)
-        : seg{tMin, tMax, sigma_maj}, called(false) {}
+    HomogeneousMajorantIterator(Float tMin, Float tMax, SampledSpectrum sigma_maj,
+                                SampledSpectrum sigma_min = SampledSpectrum(0.f))
+        : seg{tMin, tMax, sigma_maj, sigma_min}, called(false) {}
 
     PBRT_CPU_GPU
     pstd::optional<RayMajorantSegment> Next() {
@@ -106,7 +107,11 @@ struct MajorantGrid {
     // MajorantGrid Public Methods
     MajorantGrid() = default;
     MajorantGrid(Bounds3f bounds, Point3i res, Allocator alloc)
-        : bounds(bounds), voxels(res.x * res.y * res.z, alloc), res(res) {}
+        : bounds(bounds),
+          voxels(res.x * res.y * res.z, alloc),
+          minVoxels(res.x * res.y * res.z, alloc),
+          res(res),
+          coarseVoxels(alloc) {}
 
     PBRT_CPU_GPU
     Float Lookup(int x, int y, int z) const {
@@ -119,6 +124,18 @@ struct MajorantGrid {
         voxels[x + res.x * (y + res.y * z)] = v;
     }
 
+    // The minorant of each voxel is a lower bound on the density inside it
+    PBRT_CPU_GPU
+    Float MinorantLookup(int x, int y, int z) const {
+        DCHECK(x >= 0 && x < res.x && y >= 0 && y < res.y && z >= 0 && z < res.z);
+        return minVoxels[x + res.x * (y + res.y * z)];
+    }
+    PBRT_CPU_GPU
+    void SetMinorant(int x, int y, int z, Float v) {
+        DCHECK(x >= 0 && x < res.x && y >= 0 && y < res.y && z >= 0 && z < res.z);
+        minVoxels[x + res.x * (y + res.y * z)] = v;
+    }
+
     PBRT_CPU_GPU
     Bounds3f VoxelBounds(int x, int y, int z) const {
         Point3f p0(Float(x) / res.x, Float(y) / res.y, Float(z) / res.z);
@@ -126,10 +143,30 @@ struct MajorantGrid {
         return Bounds3f(p0, p1);
     }
 
+    // Computes the coarse level of the grid from its voxels, which must all
+    // have been set. Rays traverse the coarse level first, skipping over
+    // coarse voxels with zero majorants, and only step through the voxels
+    // of the others.
+    void BuildCoarseLevel();
+
+    PBRT_CPU_GPU
+    bool HasCoarseLevel() const { return !coarseVoxels.empty(); }
+
+    PBRT_CPU_GPU
+    Float CoarseLookup(int x, int y, int z) const {
+        DCHECK(x >= 0 && x < coarseRes.x && y >= 0 && y < coarseRes.y && z >= 0 &&
+               z < coarseRes.z);
+        return coarseVoxels[x + coarseRes.x * (y + coarseRes.y * z)];
+    }
+
     // MajorantGrid Public Members
     Bounds3f bounds;
-    pstd::vector<Float> voxels;
+    pstd::vector<Float> voxels, minVoxels;
     Point3i res;
+    // Each coarse voxel covers up to _CoarseFactor_ voxels along each axis
+    static constexpr int CoarseFactor = 4;
+    pstd::vector<Float> coarseVoxels;
+    Point3i coarseRes;
 };
 
 // DDAMajorantIterator Definition
@@ -140,37 +177,25 @@ class DDAMajorantIterator {
     PBRT_CPU_GPU
     DDAMajorantIterator(Ray ray, Float tMin, Float tMax, const MajorantGrid *grid,
                         SampledSpectrum sigma_t)
-        : tMin(tMin), tMax(tMax), grid(grid), sigma_t(sigma_t) {
+        : sigma_t(sigma_t), tMin(tMin), tMax(tMax), grid(grid) {
         // Set up 3D DDA for ray through the majorant grid
         Vector3f diag = grid->bounds.Diagonal();
-        Ray rayGrid(Point3f(grid->bounds.Offset(ray.o)),
-                    Vector3f(ray.d.x / diag.x, ray.d.y / diag.y, ray.d.z / diag.z));
-        Point3f gridIntersect = rayGrid(tMin);
-        for (int axis = 0; axis < 3; ++axis) {
-            // Initialize ray stepping parameters for _axis_
-            // Compute current voxel for axis and handle negative zero direction
-            voxel[axis] =
-                Clamp(gridIntersect[axis] * grid->res[axis], 0, grid->res[axis] - 1);
-            deltaT[axis] = 1 / (std::abs(rayGrid.d[axis]) * grid->res[axis]);
+        rayGrid = Ray(Point3f(grid->bounds.Offset(ray.o)),
+                      Vector3f(ray.d.x / diag.x, ray.d.y / diag.y, ray.d.z / diag.z));
+        // Handle negative zero direction
+        for (int axis = 0; axis < 3; ++axis)
             if (rayGrid.d[axis] == -0.f)
                 rayGrid.d[axis] = 0.f;
 
-            if (rayGrid.d[axis] >= 0) {
-                // Handle ray with positive direction for voxel stepping
-                Float nextVoxelPos = Float(voxel[axis] + 1) / grid->res[axis];
-                nextCrossingT[axis] =
-                    tMin + (nextVoxelPos - gridIntersect[axis]) / rayGrid.d[axis];
-                step[axis] = 1;
-                voxelLimit[axis] = grid->res[axis];
-
-            } else {
-                // Handle ray with negative direction for voxel stepping
-                Float nextVoxelPos = Float(voxel[axis]) / grid->res[axis];
-                nextCrossingT[axis] =
-                    tMin + (nextVoxelPos - gridIntersect[axis]) / rayGrid.d[axis];
-                step[axis] = -1;
-                voxelLimit[axis] = -1;
-            }
+        if (grid->HasCoarseLevel())
+            // Start at the coarse level; voxels' DDA is set up in each coarse voxel
+            coarse.Initialize(rayGrid, tMin, grid->res, MajorantGrid::CoarseFactor,
+                              Point3i(0, 0, 0), grid->coarseRes - Vector3i(1, 1, 1));
+        else {
+            // Step through all of the voxels along the ray
+            fine.Initialize(rayGrid, tMin, grid->res, 1, Point3i(0, 0, 0),
+                            grid->res - Vector3i(1, 1, 1));
+            fineTMax = tMax;
         }
     }
 
@@ -178,39 +203,113 @@ class DDAMajorantIterator {
     pstd::optional<RayMajorantSegment> Next() {
         if (tMin >= tMax)
             return {};
+        while (tMin >= fineTMax) {
+            // Find next coarse voxel along the ray with a nonzero majorant
+            if (tMin >= tMax)
+                return {};
+            int stepAxis = coarse.StepAxis();
+            Float tCoarseExit = std::min(tMax, coarse.nextCrossingT[stepAxis]);
+            Point3i v(coarse.voxel[0], coarse.voxel[1], coarse.voxel[2]);
+            if (!coarse.Advance(stepAxis))
+                tMax = tCoarseExit;
+            if (grid->CoarseLookup(v.x, v.y, v.z) == 0) {
+                tMin = tCoarseExit;
+                continue;
+            }
+
+            // Set up DDA through the voxels in the coarse voxel
+            int f = MajorantGrid::CoarseFactor;
+            Point3i v0(v.x * f, v.y * f, v.z * f);
+            Point3i v1(std::min(v0.x + f, grid->res.x), std::min(v0.y + f, grid->res.y),
+                       std::min(v0.z + f, grid->res.z));
+            fine.Initialize(rayGrid, tMin, grid->res, 1, v0, v1 - Vector3i(1, 1, 1));
+            fineTMax = tCoarseExit;
+        }
+
         // Find _stepAxis_ for stepping to next voxel and exit point _tVoxelExit_
-        int bits = ((nextCrossingT[0] < nextCrossingT[1]) << 2) +
-                   ((nextCrossingT[0] < nextCrossingT[2]) << 1) +
-                   ((nextCrossingT[1] < nextCrossingT[2]));
-        const int cmpToAxis[8] = {2, 1, 2, 1, 2, 2, 0, 0};
-        int stepAxis = cmpToAxis[bits];
-        Float tVoxelExit = std::min(tMax, nextCrossingT[stepAxis]);
+        int stepAxis = fine.StepAxis();
+        Float tVoxelExit = std::min(fineTMax, fine.nextCrossingT[stepAxis]);
 
-        // Get _maxDensity_ for current voxel and initialize _RayMajorantSegment_, _seg_
-        SampledSpectrum sigma_maj = sigma_t * grid->Lookup(voxel[0], voxel[1], voxel[2]);
-        RayMajorantSegment seg{tMin, tVoxelExit, sigma_maj};
+        // Get density bounds for current voxel and initialize _RayMajorantSegment_, _seg_
+        int x = fine.voxel[0], y = fine.voxel[1], z = fine.voxel[2];
+        SampledSpectrum sigma_maj = sigma_t * grid->Lookup(x, y, z);
+        SampledSpectrum sigma_min = sigma_t * grid->MinorantLookup(x, y, z);
+        RayMajorantSegment seg{tMin, tVoxelExit, sigma_maj, sigma_min};
 
         // Advance to next voxel in maximum density grid
         tMin = tVoxelExit;
-        if (nextCrossingT[stepAxis] > tMax)
-            tMin = tMax;
-        voxel[stepAxis] += step[stepAxis];
-        if (voxel[stepAxis] == voxelLimit[stepAxis])
-            tMin = tMax;
-        nextCrossingT[stepAxis] += deltaT[stepAxis];
-
+        if (!fine.Advance(stepAxis))
+            tMin = fineTMax;
         return seg;
     }
 
     std::string ToString() const;
 
   private:
+    // DDAMajorantIterator::GridDDA Definition
+    // State for stepping through a range of voxels at one level of the grid;
+    // the level's voxels are _cellSize_ of the grid's voxels wide.
+    struct GridDDA {
+        PBRT_CPU_GPU
+        void Initialize(const Ray &rayGrid, Float tMin, Point3i res, int cellSize,
+                        Point3i voxelMin, Point3i voxelMax) {
+            Point3f gridIntersect = rayGrid(tMin);
+            for (int axis = 0; axis < 3; ++axis) {
+                // Initialize ray stepping parameters for _axis_
+                voxel[axis] = Clamp(gridIntersect[axis] * res[axis] / cellSize,
+                                    voxelMin[axis], voxelMax[axis]);
+                deltaT[axis] = cellSize / (std::abs(rayGrid.d[axis]) * res[axis]);
+                if (rayGrid.d[axis] >= 0) {
+                    // Handle ray with positive direction for voxel stepping
+                    Float nextVoxelPos = Float((voxel[axis] + 1) * cellSize) / res[axis];
+                    nextCrossingT[axis] =
+                        tMin + (nextVoxelPos - gridIntersect[axis]) / rayGrid.d[axis];
+                    step[axis] = 1;
+                    voxelLimit[axis] = voxelMax[axis] + 1;
+
+                } else {
+                    // Handle ray with negative direction for voxel stepping
+                    Float nextVoxelPos = Float(voxel[axis] * cellSize) / res[axis];
+                    nextCrossingT[axis] =
+                        tMin + (nextVoxelPos - gridIntersect[axis]) / rayGrid.d[axis];
+                    step[axis] = -1;
+                    voxelLimit[axis] = voxelMin[axis] - 1;
+                }
+            }
+        }
+
+        // Returns the axis along which the ray leaves the current voxel
+        PBRT_CPU_GPU
+        int StepAxis() const {
+            int bits = ((nextCrossingT[0] < nextCrossingT[1]) << 2) +
+                       ((nextCrossingT[0] < nextCrossingT[2]) << 1) +
+                       ((nextCrossingT[1] < nextCrossingT[2]));
+            const int cmpToAxis[8] = {2, 1, 2, 1, 2, 2, 0, 0};
+            return cmpToAxis[bits];
+        }
+
+        // Steps to the next voxel along _stepAxis_, returning false if it is
+        // past the end of the range of voxels
+        PBRT_CPU_GPU
+        bool Advance(int stepAxis) {
+            voxel[stepAxis] += step[stepAxis];
+            nextCrossingT[stepAxis] += deltaT[stepAxis];
+            return voxel[stepAxis] != voxelLimit[stepAxis];
+        }
+
+        Float nextCrossingT[3], deltaT[3];
+        int step[3], voxelLimit[3], voxel[3];
+    };
+
     // DDAMajorantIterator Private Members
     SampledSpectrum sigma_t;
     Float tMin = Infinity, tMax = -Infinity;
     const MajorantGrid *grid;
-    Float nextCrossingT[3], deltaT[3];
-    int step[3], voxelLimit[3], voxel[3];
+    Ray rayGrid;
+    // Segments are generated from _fine_ for $t$ up to _fineTMax_; past it,
+    // _coarse_ finds the next coarse voxel to step through
+    GridDDA coarse, fine;
+    Float fineTMax = -Infinity;
 };
 
 // HomogeneousMedium Definition
@@ -231,6 +330,8 @@ class HomogeneousMedium {
         Le_spec.Scale(LeScale);
     }
 
+    static const char *Name() { return "HomogeneousMedium"; }
+
     static HomogeneousMedium *Create(const ParameterDictionary &parameters,
                                      const FileLoc *loc, Allocator alloc);
 
@@ -250,7 +351,8 @@ class HomogeneousMedium {
                                           const SampledWavelengths &lambda) const {
         SampledSpectrum sigma_a = sigma_a_spec.Sample(lambda);
         SampledSpectrum sigma_s = sigma_s_spec.Sample(lambda);
-        return HomogeneousMajorantIterator(0, tMax, sigma_a + sigma_s);
+        // The medium's $\sigmat$ is both its majorant and its minorant
+        return HomogeneousMajorantIterator(0, tMax, sigma_a + sigma_s, sigma_a + sigma_s);
     }
 
     std::string ToString() const;
@@ -261,6 +363,12 @@ class HomogeneousMedium {
     HGPhaseFunction phase;
 };
 
+// Grid medium sample files, as written by nanovdb2pbrt, start with
+// _GridMediumFileMagic_ and then the grid's x, y, and z resolutions as 32-bit
+// integers, followed by its samples as 32-bit floats with x varying fastest,
+// all little-endian. Files with a ".gz" extension are gzip-compressed.
+inline constexpr char GridMediumFileMagic[] = "pbrtgrid";
+
 // GridMedium Definition
 class GridMedium {
   public:
@@ -272,7 +380,10 @@ class GridMedium {
                Spectrum sigma_a, Spectrum sigma_s, Float sigmaScale, Float g,
                SampledGrid<Float> density, pstd::optional<SampledGrid<Float>> temperature,
                Float temperatureScale, Float temperatureOffset,
-               Spectrum Le, SampledGrid<Float> LeScale, Allocator alloc);
+               Spectrum Le, SampledGrid<Float> LeScale, Point3i majorantRes,
+               Allocator alloc);
+
+    static const char *Name() { return "GridMedium"; }
 
     static GridMedium *Create(const ParameterDictionary &parameters,
                               const Transform &renderFromMedium, const FileLoc *loc,
@@ -362,7 +473,9 @@ class RGBGridMedium {
                   pstd::optional<SampledGrid<RGBUnboundedSpectrum>> sigma_a,
                   pstd::optional<SampledGrid<RGBUnboundedSpectrum>> sigma_s,
                   Float sigmaScale, pstd::optional<SampledGrid<RGBIlluminantSpectrum>> Le,
-                  Float LeScale, Allocator alloc);
+                  Float LeScale, Point3i majorantRes, Allocator alloc);
+
+    static const char *Name() { return "RGBGridMedium"; }
 
     static RGBGridMedium *Create(const ParameterDictionary &parameters,
                                  const Transform &renderFromMedium, const FileLoc *loc,
@@ -433,6 +546,8 @@ class CloudMedium {
     using MajorantIterator = HomogeneousMajorantIterator;
 
     // CloudMedium Public Methods
+    static const char *Name() { return "CloudMedium"; }
+
     static CloudMedium *Create(const ParameterDictionary &parameters,
                                const Transform &renderFromMedium, const FileLoc *loc,
                                Allocator alloc);
@@ -484,7 +599,13 @@ class CloudMedium {
         SampledSpectrum sigma_a = sigma_a_spec.Sample(lambda);
         SampledSpectrum sigma_s = sigma_s_spec.Sample(lambda);
         SampledSpectrum sigma_t = sigma_a + sigma_s;
-        return HomogeneousMajorantIterator(tMin, tMax, sigma_t);
+        // The low-altitude term of Density() bounds it from below and is
+        // monotonic along the ray, so its minimum is at an endpoint
+        auto minDensity = [](Point3f p) {
+            return std::min<Float>(1, 2 * std::max<Float>(0, 0.5f - p.y));
+        };
+        Float dMin = std::min(minDensity(ray(tMin)), minDensity(ray(tMax)));
+        return HomogeneousMajorantIterator(tMin, tMax, sigma_t, dMin * sigma_t);
     }
 
   private:
@@ -502,12 +623,19 @@ class CloudMedium {
             }
         }
         // Sum scales of noise to approximate cloud density
+        Point3f pOctave[5];
+        Float noise[5];
+        Float lambda = 1.f;
+        for (int i = 0; i < 5; ++i) {
+            pOctave[i] = lambda * pp;
+            lambda *= 1.99f;
+        }
+        Noise(pOctave, noise);
         Float d = 0;
-        Float omega = 0.5f, lambda = 1.f;
+        Float omega = 0.5f;
         for (int i = 0; i < 5; ++i) {
-            d += omega * Noise(lambda * pp);
+            d += omega * noise[i];
             omega *= 0.5f;
-            lambda *= 1.99f;
         }
 
         // Model decrease in density with altitude and return final cloud density
@@ -543,9 +671,13 @@ class NanoVDBBuffer {
     NanoVDBBuffer(NanoVDBBuffer &&other) noexcept
         : alloc(std::move(other.alloc)),
           bytesAllocated(other.bytesAllocated),
-          ptr(other.ptr) {
+          ptr(other.ptr),
+          mapping(other.mapping),
+          mappingBytes(other.mappingBytes) {
         other.bytesAllocated = 0;
         other.ptr = nullptr;
+        other.mapping = nullptr;
+        other.mappingBytes = 0;
     }
     NanoVDBBuffer &operator=(const NanoVDBBuffer &) = delete;
     NanoVDBBuffer &operator=(NanoVDBBuffer &&other) noexcept {
@@ -556,8 +688,12 @@ class NanoVDBBuffer {
         new (&alloc) Allocator(other.alloc.resource());
         bytesAllocated = other.bytesAllocated;
         ptr = other.ptr;
+        mapping = other.mapping;
+        mappingBytes = other.mappingBytes;
         other.bytesAllocated = 0;
         other.ptr = nullptr;
+        other.mapping = nullptr;
+        other.mappingBytes = 0;
         return *this;
     }
     ~NanoVDBBuffer() { clear(); }
@@ -579,27 +715,52 @@ class NanoVDBBuffer {
     bool empty() const { return size() == 0; }
 
     void clear() {
-        alloc.deallocate_bytes(ptr, bytesAllocated, 128);
+        if (mapping)
+            Unmap(mapping, mappingBytes);
+        else
+            alloc.deallocate_bytes(ptr, bytesAllocated, 128);
         bytesAllocated = 0;
         ptr = nullptr;
+        mapping = nullptr;
+        mappingBytes = 0;
     }
 
     static NanoVDBBuffer create(uint64_t size, const NanoVDBBuffer *context = nullptr) {
         return NanoVDBBuffer(size, context ? context->GetAllocator() : Allocator());
     }
 
+    // Returns a buffer for the _size_ bytes at _ptr_, which are in the
+    // _mappingBytes_ of a memory-mapped file that start at _mapping_; the
+    // file is unmapped when the buffer is cleared.
+    static NanoVDBBuffer FromMapping(uint8_t *ptr, uint64_t size, void *mapping,
+                                     size_t mappingBytes) {
+        NanoVDBBuffer buffer;
+        buffer.bytesAllocated = size;
+        buffer.ptr = ptr;
+        buffer.mapping = mapping;
+        buffer.mappingBytes = mappingBytes;
+        return buffer;
+    }
+    bool IsMapped() const { return mapping != nullptr; }
+
     Allocator GetAllocator() const { return alloc; }
 
   private:
+    static void Unmap(void *mapping, size_t mappingBytes);
+
     Allocator alloc;
     size_t bytesAllocated = 0;
     uint8_t *ptr = nullptr;
+    void *mapping = nullptr;
+    size_t mappingBytes = 0;
 };
 
 class NanoVDBMedium {
   public:
     using MajorantIterator = DDAMajorantIterator;
     // NanoVDBMedium Public Methods
+    static const char *Name() { return "NanoVDBMedium"; }
+
     static NanoVDBMedium *Create(const ParameterDictionary &parameters,
                                  const Transform &renderFromMedium, const FileLoc *loc,
                                  Allocator alloc);
@@ -609,7 +770,8 @@ class NanoVDBMedium {
     NanoVDBMedium(const Transform &renderFromMedium, Spectrum sigma_a, Spectrum sigma_s,
                   Float sigmaScale, Float g, nanovdb::GridHandle<NanoVDBBuffer> dg,
                   nanovdb::GridHandle<NanoVDBBuffer> tg, Float LeScale,
-                  Float temperatureOffset, Float temperatureScale, Allocator alloc);
+                  Float temperatureOffset, Float temperatureScale, Point3i majorantRes,
+                  Allocator alloc);
 
     PBRT_CPU_GPU
     bool IsEmissive() const { return temperatureFloatGrid && LeScale > 0; }
@@ -799,6 +961,94 @@ PBRT_CPU_GPU SampledSpectrum SampleT_maj(Ray ray, Float tMax, Float u, RNG &rng,
     return SampledSpectrum(1.f);
 }
 
+// Residual tracking splits each majorant segment's $\sigmamaj$ into the
+// segment's minorant, a homogeneous control variate whose transmittance is
+// found analytically, and a residual majorant $\sigmamaj - \sigma_\roman{min}$
+// that is used to sample points along the ray. In addition to the point and
+// its medium properties, _callback_ is given the full and residual majorants
+// as well as the full and residual majorant transmittances since the
+// previous point; the residual ones are returned in _T_rmaj_ at the end.
+template <typename F>
+PBRT_CPU_GPU SampledSpectrum SampleResidualT_maj(Ray ray, Float tMax, Float u, RNG &rng,
+                                                 const SampledWavelengths &lambda,
+                                                 SampledSpectrum *T_rmaj, F callback) {
+    auto sample = [&](auto medium) {
+        using M = typename std::remove_reference_t<decltype(*medium)>;
+        return SampleResidualT_maj<M>(ray, tMax, u, rng, lambda, T_rmaj, callback);
+    };
+    return ray.medium.Dispatch(sample);
+}
+
+template <typename ConcreteMedium, typename F>
+PBRT_CPU_GPU SampledSpectrum SampleResidualT_maj(Ray ray, Float tMax, Float u, RNG &rng,
+                                                 const SampledWavelengths &lambda,
+                                                 SampledSpectrum *T_rmaj, F callback) {
+    // Normalize ray direction and update _tMax_ accordingly
+    tMax *= Length(ray.d);
+    ray.d = Normalize(ray.d);
+
+    // Initialize _MajorantIterator_ for ray majorant sampling
+    ConcreteMedium *medium = ray.medium.Cast<ConcreteMedium>();
+    typename ConcreteMedium::MajorantIterator iter = medium->SampleRay(ray, tMax, lambda);
+
+    // Generate residual majorant samples until termination
+    SampledSpectrum T_maj(1.f);
+    *T_rmaj = SampledSpectrum(1.f);
+    bool done = false;
+    while (!done) {
+        // Get next majorant segment from iterator and find its residual majorant
+        pstd::optional<RayMajorantSegment> seg = iter.Next();
+        if (!seg)
+            return T_maj;
+        SampledSpectrum sigma_rmaj = ClampZero(seg->sigma_maj - seg->sigma_min);
+
+        // Handle zero-valued residual majorant for current segment
+        if (sigma_rmaj[0] == 0) {
+            Float dt = seg->tMax - seg->tMin;
+            // Handle infinite _dt_ for ray majorant segment
+            if (IsInf(dt))
+                dt = std::numeric_limits<Float>::max();
+
+            T_maj *= FastExp(-dt * seg->sigma_maj);
+            *T_rmaj *= FastExp(-dt * sigma_rmaj);
+            continue;
+        }
+
+        // Generate samples along current majorant segment
+        Float tMin = seg->tMin;
+        while (true) {
+            // Try to generate sample along current majorant segment
+            Float t = tMin + SampleExponential(u, sigma_rmaj[0]);
+            u = rng.Uniform<Float>();
+            if (t < seg->tMax) {
+                // Call callback function for sample within segment
+                T_maj *= FastExp(-(t - tMin) * seg->sigma_maj);
+                *T_rmaj *= FastExp(-(t - tMin) * sigma_rmaj);
+                MediumProperties mp = medium->SamplePoint(ray(t), lambda);
+                if (!callback(ray(t), mp, seg->sigma_maj, sigma_rmaj, T_maj, *T_rmaj)) {
+                    done = true;
+                    break;
+                }
+                T_maj = *T_rmaj = SampledSpectrum(1.f);
+                tMin = t;
+
+            } else {
+                // Handle sample past end of majorant segment
+                Float dt = seg->tMax - tMin;
+                // Handle infinite _dt_ for ray majorant segment
+                if (IsInf(dt))
+                    dt = std::numeric_limits<Float>::max();
+
+                T_maj *= FastExp(-dt * seg->sigma_maj);
+                *T_rmaj *= FastExp(-dt * sigma_rmaj);
+                break;
+            }
+        }
+    }
+    *T_rmaj = SampledSpectrum(1.f);
+    return SampledSpectrum(1.f);
+}
+
 }  // namespace pbrt
 
 #endif  // PBRT_MEDIA_H
@@ -96,3 +96,121 @@ TEST(HenyeyGreenstein, g) {
         EXPECT_NEAR(g, gEst, .01);
     }
 }
+
+TEST(DDAMajorantIterator, CoarseLevel) {
+    // Grid with clusters of nonzero majorants in otherwise empty space and a
+    // resolution that isn't a multiple of the coarse level's
+    RNG rng;
+    Bounds3f bounds(Point3f(-1, 0, 2), Point3f(3, 1, 4));
+    MajorantGrid grid(bounds, {13, 9, 22}, Allocator());
+    for (int z = 0; z < grid.res.z; ++z)
+        for (int y = 0; y < grid.res.y; ++y)
+            for (int x = 0; x < grid.res.x; ++x)
+                grid.Set(x, y, z, rng.Uniform<Float>() < .05f ? rng.Uniform<Float>() : 0);
+    MajorantGrid coarseGrid = grid;
+    coarseGrid.BuildCoarseLevel();
+    ASSERT_TRUE(coarseGrid.HasCoarseLevel());
+    EXPECT_FALSE(grid.HasCoarseLevel());
+
+    // Rays should see the same nonzero majorants with and without the coarse level
+    for (int i = 0; i < 10000; ++i) {
+        Point3f o = bounds.Lerp(Point3f(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                                        rng.Uniform<Float>()));
+        Vector3f d = SampleUniformSphere(Point2f(rng.Uniform<Float>(),
+                                                 rng.Uniform<Float>()));
+        Ray ray(o - 10 * d, d);
+        Float tMin, tMax;
+        ASSERT_TRUE(bounds.IntersectP(ray.o, ray.d, Infinity, &tMin, &tMax));
+
+        auto opticalDepth = [&](const MajorantGrid *g, int *nSegments) {
+            DDAMajorantIterator iter(ray, tMin, tMax, g, SampledSpectrum(1.f));
+            Float depth = 0, tPrev = tMin;
+            *nSegments = 0;
+            while (pstd::optional<RayMajorantSegment> seg = iter.Next()) {
+                EXPECT_GE(seg->tMin, tPrev);
+                EXPECT_GE(seg->tMax, seg->tMin);
+                tPrev = seg->tMax;
+                depth += (seg->tMax - seg->tMin) * seg->sigma_maj[0];
+                ++*nSegments;
+            }
+            EXPECT_LE(tPrev, tMax);
+            return depth;
+        };
+        int nFlat, nCoarse;
+        Float flat = opticalDepth(&grid, &nFlat);
+        Float coarse = opticalDepth(&coarseGrid, &nCoarse);
+        EXPECT_LT(std::abs(flat - coarse), 1e-4f * std::max<Float>(1, flat)) << i;
+        EXPECT_LE(nCoarse, nFlat);
+    }
+}
+
+TEST(GridMedium, ResidualTransmittance) {
+    // Medium with a smoothly-varying density that is bounded away from zero
+    RNG rng;
+    int n = 8;
+    std::vector<Float> density(n * n * n);
+    for (Float &d : density)
+        d = 1 + rng.Uniform<Float>();
+    ConstantSpectrum sigma_a(0.5f), sigma_s(1.f), Le(0.f);
+    Bounds3f bounds(Point3f(0, 0, 0), Point3f(1, 1, 1));
+    GridMedium medium(bounds, Transform(), &sigma_a, &sigma_s, 1, 0,
+                      SampledGrid<Float>(density, n, n, n, Allocator()), {}, 1, 0, &Le,
+                      SampledGrid<Float>({Float(1)}, 1, 1, 1, Allocator()),
+                      Point3i(4, 4, 4), Allocator());
+
+    SampledWavelengths lambda = SampledWavelengths::SampleUniform(0.5f);
+    for (int i = 0; i < 10; ++i) {
+        Point3f p0(-.5f, rng.Uniform<Float>(), rng.Uniform<Float>());
+        Point3f p1(1.5f, rng.Uniform<Float>(), rng.Uniform<Float>());
+        Ray ray(p0, p1 - p0, 0, &medium);
+
+        // Compute reference transmittance along the ray using quadrature
+        int nSteps = 4096;
+        Float tau = 0;
+        for (int j = 0; j < nSteps; ++j) {
+            MediumProperties mp = medium.SamplePoint(ray((j + 0.5f) / nSteps), lambda);
+            tau += (mp.sigma_a[0] + mp.sigma_s[0]) * Length(ray.d) / nSteps;
+        }
+        Float T = std::exp(-tau);
+
+        // Compare ratio tracking and residual ratio tracking estimates
+        int nEstimates = 4000;
+        Float ratioSum = 0, ratioSqr = 0, residualSum = 0, residualSqr = 0;
+        for (int j = 0; j < nEstimates; ++j) {
+            Float Tr = 1;
+            SampledSpectrum T_maj = SampleT_maj(
+                ray, 1.f, rng.Uniform<Float>(), rng, lambda,
+                [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
+                    SampledSpectrum T_maj) {
+                    Tr *= 1 - (mp.sigma_a[0] + mp.sigma_s[0]) / sigma_maj[0];
+                    return true;
+                });
+            ratioSum += Tr;
+            ratioSqr += Sqr(Tr);
+
+            Tr = 1;
+            SampledSpectrum T_rmaj;
+            T_maj = SampleResidualT_maj(
+                ray, 1.f, rng.Uniform<Float>(), rng, lambda, &T_rmaj,
+                [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
+                    SampledSpectrum sigma_rmaj, SampledSpectrum T_maj,
+                    SampledSpectrum T_rmaj) {
+                    Float sigma_n = sigma_maj[0] - mp.sigma_a[0] - mp.sigma_s[0];
+                    EXPECT_GE(sigma_n, -1e-5f);
+                    EXPECT_LE(sigma_n, sigma_rmaj[0] + 1e-5f);
+                    Tr *= T_maj[0] * sigma_n / (T_rmaj[0] * sigma_rmaj[0]);
+                    return true;
+                });
+            Tr *= T_maj[0] / T_rmaj[0];
+            residualSum += Tr;
+            residualSqr += Sqr(Tr);
+        }
+        Float ratioMean = ratioSum / nEstimates;
+        Float residualMean = residualSum / nEstimates;
+        EXPECT_LT(std::abs(ratioMean - T), 0.02f) << i << " " << T;
+        EXPECT_LT(std::abs(residualMean - T), 0.02f) << i << " " << T;
+        EXPECT_LT(residualSqr / nEstimates - Sqr(residualMean),
+                  ratioSqr / nEstimates - Sqr(ratioMean))
+            << i;
+    }
+}
@@ -39,16 +39,47 @@ std::string PBRTOptions::ToString() const {
         "forceDiffuse: %s useGPU: %s wavefront: %s interactive: %s fullscreen %s "
         "renderingSpace: %s nThreads: %s logLevel: %s logFile: %s logUtilization: %s "
         "writePartialImages: %s recordPixelStatistics: %s "
-        "printStatistics: %s pixelSamples: %s gpuDevice: %s quickRender: %s upgrade: %s "
-        "imageFile: %s mseReferenceImage: %s mseReferenceOutput: %s debugStart: %s "
-        "displayServer: %s cropWindow: %s pixelBounds: %s pixelMaterial: %s "
-        "displacementEdgeScale: %f ]",
+        "printStatistics: %s pixelSamples: %s gpuDevice: %s gpuPersistentThreads: %s "
+        "gpuDenoiseDisplay: %s gpuGraphs: %s gpuHostGeometry: %s "
+        "gpuTextureMaxResolution: %d quickRender: %s upgrade: %s imageFile: %s "
+        "mseReferenceImage: %s mseReferenceOutput: %s "
+        "debugStart: %s displayServer: %s displayBandwidth: %f bvhCacheDirectory: %s "
+        "bssrdfCacheDirectory: %s "
+        "sceneCacheDirectory: %s loadProfileFile: %s renderProfileFile: %s "
+        "benchmarkFile: %s traceFile: %s dispatchTypesFile: %s "
+        "metricsFile: %s metricsInterval: %f coordinatorPort: %s coordinatorAddress: %s "
+        "watchScene: %s framePattern: %s "
+        "lazyShapes: %s lazyShapeMemoryMB: %d memoryBudgetMB: %d textureCacheMB: %d "
+        "ptexCacheMB: %d "
+        "ptexMaxFiles: %d "
+        "compressTextures: %s blockTextures: %s numa: %s perfCounters: %s hugePages: %s "
+        "scratchBufferKB: %d "
+        "pinThreads: %s skipSMTSiblings: %s cpus: %s "
+        "reservedCores: %d tileOrder: %s tileAffinity: %s overlapWaves: %s "
+        "adaptiveError: %f "
+        "timeLimit: %f denoiseStop: %f writeSampleMap: %s checkpointFile: %s "
+        "checkpointInterval: %f resume: %s "
+        "cropWindow: %s pixelBounds: %s "
+        "pixelMaterial: %s sampleRange: %s displacementEdgeScale: %f ]",
         seed, quiet, disablePixelJitter, disableWavelengthJitter, disableTextureFiltering,
         disableImageTextures, forceDiffuse, useGPU, wavefront, interactive, fullscreen,
         renderingSpace, nThreads, logLevel, logFile, logUtilization, writePartialImages,
-        recordPixelStatistics, printStatistics, pixelSamples, gpuDevice, quickRender, upgrade,
-        imageFile, mseReferenceImage, mseReferenceOutput, debugStart, displayServer, cropWindow,
-        pixelBounds, pixelMaterial, displacementEdgeScale);
+        recordPixelStatistics, printStatistics, pixelSamples, gpuDevice,
+        gpuPersistentThreads, gpuDenoiseDisplay, gpuGraphs, gpuHostGeometry,
+        gpuTextureMaxResolution, quickRender, upgrade, imageFile, mseReferenceImage,
+        mseReferenceOutput, debugStart, displayServer, displayBandwidth,
+        bvhCacheDirectory, bssrdfCacheDirectory, sceneCacheDirectory, loadProfileFile,
+        renderProfileFile, benchmarkFile, traceFile, dispatchTypesFile, metricsFile,
+        metricsInterval, coordinatorPort, coordinatorAddress, watchScene, framePattern,
+        lazyShapes, lazyShapeMemoryMB, memoryBudgetMB, textureCacheMB, ptexCacheMB,
+        ptexMaxFiles,
+        compressTextures, blockTextures, numa,
+        perfCounters, hugePages, scratchBufferKB, pinThreads, skipSMTSiblings, cpus,
+        reservedCores,
+        tileOrder, tileAffinity, overlapWaves, adaptiveError, timeLimit, denoiseStop,
+        writeSampleMap,
+        checkpointFile, checkpointInterval, resume, cropWindow, pixelBounds,
+        pixelMaterial, sampleRange, displacementEdgeScale);
 }
 
 }  // namespace pbrt
@@ -44,15 +44,59 @@ struct PBRTOptions : BasicPBRTOptions {
     bool printStatistics = false;
     pstd::optional<int> pixelSamples;
     pstd::optional<int> gpuDevice;
+    bool gpuPersistentThreads = false;
+    bool gpuDenoiseDisplay = false;
+    bool gpuGraphs = false;
+    bool gpuHostGeometry = false;
+    int gpuTextureMaxResolution = 0;
     bool quickRender = false;
     bool upgrade = false;
     std::string imageFile;
     std::string mseReferenceImage, mseReferenceOutput;
     std::string debugStart;
     std::string displayServer;
+    Float displayBandwidth = 0;
+    std::string bvhCacheDirectory;
+    std::string bssrdfCacheDirectory;
+    std::string sceneCacheDirectory;
+    std::string loadProfileFile;
+    std::string renderProfileFile;
+    std::string benchmarkFile;
+    std::string traceFile;
+    std::string dispatchTypesFile;
+    std::string metricsFile;
+    std::string coordinatorPort, coordinatorAddress;
+    Float metricsInterval = 5;
+    bool watchScene = false;
+    std::string framePattern;
+    bool lazyShapes = false;
+    bool numa = false;
+    bool perfCounters = false;
+    bool hugePages = false;
+    int scratchBufferKB = 0;
+    Float adaptiveError = 0, timeLimit = 0;
+    Float denoiseStop = 0;
+    bool writeSampleMap = false;
+    std::string checkpointFile;
+    Float checkpointInterval = 300;
+    bool resume = false;
+    bool pinThreads = false, skipSMTSiblings = false;
+    std::string cpus;
+    int reservedCores = 0;
+    std::string tileOrder = "hilbert";
+    bool tileAffinity = false;
+    bool overlapWaves = false;
+    int lazyShapeMemoryMB = 0;
+    int memoryBudgetMB = 0;
+    int textureCacheMB = 0;
+    int ptexCacheMB = 4096, ptexMaxFiles = 100;
+    bool compressTextures = false;
+    bool blockTextures = false;
     pstd::optional<Bounds2f> cropWindow;
     pstd::optional<Bounds2i> pixelBounds;
     pstd::optional<Point2i> pixelMaterial;
+    // The range [x, y) of sample indices to take in each pixel
+    pstd::optional<Point2i> sampleRange;
     Float displacementEdgeScale = 1;
 
     std::string ToString() const;
@@ -15,7 +15,10 @@
 #include <pbrt/util/print.h>
 #include <pbrt/util/spectrum.h>
 
+#include <pbrt/util/stats.h>
+
 #include <algorithm>
+#include <mutex>
 #include <utility>
 
 namespace pbrt {
@@ -208,8 +211,10 @@ typename ParameterTypeTraits<PT>::ReturnType ParameterDictionary::lookupSingle(
     typename ParameterTypeTraits<PT>::ReturnType defaultValue) const {
     // Search _params_ for parameter _name_
     using traits = ParameterTypeTraits<PT>;
+    // Parameter types are interned, so they can be compared by pointer
+    static const InternedString typeName = InternString(traits::typeName);
     for (const ParsedParameter *p : params) {
-        if (p->name != name || p->type != traits::typeName)
+        if (p->type != typeName || p->name != name)
             continue;
         // Extract parameter values from _p_
         const auto &values = traits::GetValues(*p);
@@ -312,11 +317,11 @@ static std::vector<ReturnType> returnArray(const ValuesType &values,
 template <typename ReturnType, typename G, typename C>
 std::vector<ReturnType> ParameterDictionary::lookupArray(const std::string &name,
                                                          ParameterType type,
-                                                         const char *typeName,
+                                                         InternedString typeName,
                                                          int nPerItem, G getValues,
                                                          C convert) const {
     for (const ParsedParameter *p : params)
-        if (p->name == name && p->type == typeName)
+        if (p->type == typeName && p->name == name)
             return returnArray<ReturnType>(getValues(*p), *p, nPerItem, convert);
 
     return {};
@@ -326,8 +331,9 @@ template <ParameterType PT>
 std::vector<typename ParameterTypeTraits<PT>::ReturnType>
 ParameterDictionary::lookupArray(const std::string &name) const {
     using traits = ParameterTypeTraits<PT>;
+    static const InternedString typeName = InternString(traits::typeName);
     return lookupArray<typename traits::ReturnType>(
-        name, PT, traits::typeName, traits::nPerItem, traits::GetValues, traits::Convert);
+        name, PT, typeName, traits::nPerItem, traits::GetValues, traits::Convert);
 }
 
 std::vector<Float> ParameterDictionary::GetFloatArray(const std::string &name) const {
@@ -365,11 +371,24 @@ std::vector<Normal3f> ParameterDictionary::GetNormal3fArray(
     return lookupArray<ParameterType::Normal3f>(name);
 }
 
+STAT_MEMORY_COUNTER("Memory/Densely sampled spectra", denseSpectrumBytes);
+
+// Spectra given as samples are converted to densely-sampled ones, since
+// they are often evaluated in the shading code and a table lookup is much
+// cheaper than _PiecewiseLinearSpectrum_'s binary search.
+static Spectrum denselySample(Spectrum s, Allocator alloc) {
+    denseSpectrumBytes +=
+        sizeof(DenselySampledSpectrum) + (Lambda_max - Lambda_min + 1) * sizeof(Float);
+    return alloc.new_object<DenselySampledSpectrum>(s, alloc);
+}
+
+static std::mutex cachedSpectraMutex;
 static std::map<std::string, Spectrum> cachedSpectra;
 
 // TODO: move this functionality (but not the caching?) to a Spectrum method.
 static Spectrum readSpectrumFromFile(const std::string &filename, Allocator alloc) {
     std::string fn = ResolveFilename(filename);
+    std::lock_guard<std::mutex> lock(cachedSpectraMutex);
     if (cachedSpectra.find(fn) != cachedSpectra.end())
         return cachedSpectra[fn];
 
@@ -377,8 +396,9 @@ static Spectrum readSpectrumFromFile(const std::string &filename, Allocator allo
     if (!pls)
         return nullptr;
 
-    cachedSpectra[fn] = *pls;
-    return *pls;
+    Spectrum s = denselySample(*pls, alloc);
+    cachedSpectra[fn] = s;
+    return s;
 }
 
 std::vector<Spectrum> ParameterDictionary::extractSpectrumArray(
@@ -435,13 +455,14 @@ std::vector<Spectrum> ParameterDictionary::extractSpectrumArray(
                     lambda[i] = v[2 * i];
                     value[i] = v[2 * i + 1];
                 }
-                return alloc.new_object<PiecewiseLinearSpectrum>(lambda, value, alloc);
+                PiecewiseLinearSpectrum pls(lambda, value);
+                return denselySample(&pls, alloc);
             });
     } else if (param.type == "spectrum" && !param.strings.empty())
         return returnArray<Spectrum>(
             param.strings, param, 1,
             [param, &alloc](const std::string *s, const FileLoc *loc) -> Spectrum {
-                Spectrum spd = GetNamedSpectrum(*s);
+                Spectrum spd = GetDenselySampledNamedSpectrum(*s);
                 if (spd)
                     return spd;
 
@@ -474,8 +495,9 @@ std::vector<std::string> ParameterDictionary::GetStringArray(
 }
 
 std::string ParameterDictionary::GetTexture(const std::string &name) const {
+    static const InternedString textureType = InternString("texture");
     for (const ParsedParameter *p : params) {
-        if (p->name != name || p->type != "texture")
+        if (p->type != textureType || p->name != name)
             continue;
 
         if (p->strings.empty())
@@ -491,8 +513,9 @@ std::string ParameterDictionary::GetTexture(const std::string &name) const {
 }
 
 std::vector<RGB> ParameterDictionary::GetRGBArray(const std::string &name) const {
+    static const InternedString rgbType = InternString("rgb");
     for (const ParsedParameter *p : params) {
-        if (p->name == name && p->type == "rgb") {
+        if (p->type == rgbType && p->name == name) {
             if (p->floats.size() % 3)
                 ErrorExit(&p->loc, "Number of values given for \"rgb\" parameter %d "
                                    "\"name\" isn't a multiple of 3.");
@@ -510,8 +533,9 @@ std::vector<RGB> ParameterDictionary::GetRGBArray(const std::string &name) const
 }
 
 pstd::optional<RGB> ParameterDictionary::GetOneRGB(const std::string &name) const {
+    static const InternedString rgbType = InternString("rgb");
     for (const ParsedParameter *p : params) {
-        if (p->name == name && p->type == "rgb") {
+        if (p->type == rgbType && p->name == name) {
             if (p->floats.size() < 3)
                 ErrorExit(&p->loc, "Insufficient values for \"rgb\" parameter \"%s\".",
                           p->name);
@@ -593,7 +617,7 @@ void ParameterDictionary::RenameParameter(const std::string &before,
                                           const std::string &after) {
     for (ParsedParameter *p : params)
         if (p->name == before)
-            p->name = after;
+            p->name = InternString(after);
 }
 
 void ParameterDictionary::RenameUsedTextures(
@@ -611,7 +635,7 @@ void ParameterDictionary::RenameUsedTextures(
 
 void ParameterDictionary::ReportUnused() const {
     // type / name
-    InlinedVector<std::pair<const std::string *, const std::string *>, 16> seen;
+    InlinedVector<std::pair<InternedString, InternedString>, 16> seen;
 
     for (const ParsedParameter *p : params) {
         if (p->mayBeUnused)
@@ -619,15 +643,15 @@ void ParameterDictionary::ReportUnused() const {
 
         bool haveSeen =
             std::find_if(seen.begin(), seen.end(),
-                         [&p](std::pair<const std::string *, const std::string *> p2) {
-                             return *p2.first == p->type && *p2.second == p->name;
+                         [&p](std::pair<InternedString, InternedString> p2) {
+                             return p2.first == p->type && p2.second == p->name;
                          }) != seen.end();
         if (p->lookedUp) {
             // A parameter may be used when creating an initial Material, say,
             // but then an override from a Shape may shadow it such that its
             // name is already in the seen array.
             if (!haveSeen)
-                seen.push_back(std::make_pair(&p->type, &p->name));
+                seen.push_back(std::make_pair(p->type, p->name));
         } else if (haveSeen) {
             // It's shadowed by another parameter; that's fine.
         } else
@@ -13,6 +13,7 @@
 #include <pbrt/util/memory.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/spectrum.h>
+#include <pbrt/util/string.h>
 #include <pbrt/util/vecmath.h>
 
 #include <limits>
@@ -37,7 +38,7 @@ class ParsedParameter {
     std::string ToString() const;
 
     // ParsedParameter Public Members
-    std::string type, name;
+    InternedString type, name;
     FileLoc loc;
     pstd::vector<Float> floats;
     pstd::vector<int> ints;
@@ -183,8 +184,8 @@ class ParameterDictionary {
 
     template <typename ReturnType, typename G, typename C>
     std::vector<ReturnType> lookupArray(const std::string &name, ParameterType type,
-                                        const char *typeName, int nPerItem, G getValues,
-                                        C convert) const;
+                                        InternedString typeName, int nPerItem,
+                                        G getValues, C convert) const;
 
     std::vector<Spectrum> extractSpectrumArray(const ParsedParameter &param,
                                                SpectrumType spectrumType,
@@ -66,7 +66,8 @@ void ParsedParameter::AddBool(bool v) {
 
 std::string ParsedParameter::ToString() const {
     std::string str;
-    str += std::string("\"") + type + " " + name + std::string("\" [ ");
+    str += std::string("\"") + type.ToString() + " " + name.ToString() +
+           std::string("\" [ ");
     if (!floats.empty())
         for (Float d : floats)
             str += StringPrintf("%f ", d);
@@ -130,6 +131,7 @@ static double_conversion::StringToDoubleConverter floatParser(
 std::unique_ptr<Tokenizer> Tokenizer::CreateFromFile(
     const std::string &filename,
     std::function<void(const char *, const FileLoc *)> errorCallback) {
+    LoadProfileScope _("Read scene file", filename);
     if (filename == "-") {
         // Handle stdin by slurping everything into a string.
         std::string str;
@@ -365,6 +367,48 @@ static int parseInt(const Token &t) {
     return negate ? -value : value;
 }
 
+// Returns true and sets _*value_ if _str_ is a plain decimal number whose
+// digits and power of ten are both exactly representable as Floats, in
+// which case the quotient is correctly rounded.
+static bool parseExactDecimal(std::string_view str, double *value) {
+    bool negate = str[0] == '-';
+    uint64_t mantissa = 0;
+    int nDigits = 0, nFractionDigits = 0;
+    bool seenPoint = false;
+    for (size_t i = negate ? 1 : 0; i < str.size(); ++i) {
+        if (str[i] >= '0' && str[i] <= '9') {
+            if (++nDigits > 19)
+                return false;
+            mantissa = 10 * mantissa + (str[i] - '0');
+            nFractionDigits += seenPoint;
+        } else if (str[i] == '.' && !seenPoint)
+            seenPoint = true;
+        else
+            return false;
+    }
+    if (nDigits == 0)
+        return false;
+
+    if constexpr (sizeof(Float) == sizeof(float)) {
+        static constexpr float powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                           1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+        if (mantissa > (1u << 24) || size_t(nFractionDigits) >= PBRT_ARRAYSIZE(powers))
+            return false;
+        float v = float(mantissa) / powers[nFractionDigits];
+        *value = negate ? -v : v;
+    } else {
+        static constexpr double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                            1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                            1e18, 1e19, 1e20, 1e21, 1e22};
+        if (mantissa > (1ull << 53) || size_t(nFractionDigits) >= PBRT_ARRAYSIZE(powers))
+            return false;
+        double v = double(mantissa) / powers[nFractionDigits];
+        *value = negate ? -v : v;
+    }
+    return true;
+}
+
 static double parseFloat(const Token &t) {
     // Fast path for a single digit
     if (t.token.size() == 1) {
@@ -373,6 +417,11 @@ static double parseFloat(const Token &t) {
         return t.token[0] - '0';
     }
 
+    // Fast path for short decimal values
+    double val;
+    if (parseExactDecimal(t.token, &val))
+        return val;
+
     // Copy to a buffer so we can NUL-terminate it, as strto[idf]() expect.
     char buf[64];
     char *bufp = buf;
@@ -397,7 +446,6 @@ static double parseFloat(const Token &t) {
     };
 
     int length = 0;
-    double val;
     if (isInteger(t.token)) {
         char *endptr;
         val = double(strtol(bufp, &endptr, 10));
@@ -413,6 +461,39 @@ static double parseFloat(const Token &t) {
     return val;
 }
 
+bool Tokenizer::ReadNumbers(pstd::vector<Float> *floats, pstd::vector<int> *ints) {
+    while (true) {
+        const char *tokenStart = pos;
+        FileLoc startLoc = loc;
+
+        int ch = getChar();
+        if (ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r')
+            continue;
+        if (ch == ']')
+            return true;
+        if (ch == EOF || ch == '"' || ch == '[' || ch == '#' || ch == 't' || ch == 'f') {
+            // Leave strings, Booleans, comments, and errors to Next()
+            pos = tokenStart;
+            loc = startLoc;
+            return false;
+        }
+
+        // Scan to the end of the number, as in Next()
+        while ((ch = getChar()) != EOF) {
+            if (ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r' || ch == '"' ||
+                ch == '[' || ch == ']') {
+                ungetChar();
+                break;
+            }
+        }
+        Token t({tokenStart, size_t(pos - tokenStart)}, startLoc);
+        if (ints)
+            ints->push_back(parseInt(t));
+        else
+            floats->push_back(parseFloat(t));
+    }
+}
+
 inline bool isQuotedString(std::string_view str) {
     return str.size() >= 2 && str[0] == '"' && str.back() == '"';
 }
@@ -430,9 +511,9 @@ static std::string_view dequoteString(const Token &t) {
 constexpr int TokenOptional = 0;
 constexpr int TokenRequired = 1;
 
-template <typename Next, typename Unget>
+template <typename Next, typename Unget, typename ReadNumbers>
 static ParsedParameterVector parseParameters(
-    Next nextToken, Unget ungetToken, bool formatting,
+    Next nextToken, Unget ungetToken, ReadNumbers readNumbers, bool formatting,
     const std::function<void(const Token &token, const char *)> &errorCallback) {
     ParsedParameterVector parameterVector;
 
@@ -469,15 +550,15 @@ static ParsedParameterVector parseParameters(
 
         // Find end of type declaration
         auto typeEnd = skipToSpace(typeBegin);
-        param->type.assign(typeBegin, typeEnd);
+        param->type = InternString(std::string_view(&*typeBegin, typeEnd - typeBegin));
 
         if (formatting) {  // close enough: upgrade...
             if (param->type == "point")
-                param->type = "point3";
+                param->type = InternString("point3");
             if (param->type == "vector")
-                param->type = "vector3";
+                param->type = InternString("vector3");
             if (param->type == "color")
-                param->type = "rgb";
+                param->type = InternString("rgb");
         }
 
         auto nameBegin = skipSpace(typeEnd);
@@ -486,7 +567,7 @@ static ParsedParameterVector parseParameters(
                       std::string(decl.begin(), decl.end()));
 
         auto nameEnd = skipToSpace(nameBegin);
-        param->name.assign(nameBegin, nameEnd);
+        param->name = InternString(std::string_view(&*nameBegin, nameEnd - nameBegin));
 
         enum ValType { Unknown, String, Bool, Float, Int } valType = Unknown;
 
@@ -572,6 +653,11 @@ static ParsedParameterVector parseParameters(
                 if (val.token == "]")
                     break;
                 addVal(val);
+                // Once the values are known to be numeric, try to decode the
+                // rest of the array in bulk
+                if ((valType == Float || valType == Int) &&
+                    readNumbers(param, valType == Int))
+                    break;
             }
         } else {
             addVal(val);
@@ -598,6 +684,9 @@ static ParsedParameterVector parseParameters(
     return parameterVector;
 }
 
+void parseBinary(ParserTarget *target, std::unique_ptr<BinarySceneReader> r);
+static void parseFile(ParserTarget *target, const std::string &filename);
+
 void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
     FormattingParserTarget *formattingTarget =
         dynamic_cast<FormattingParserTarget *>(target);
@@ -607,6 +696,13 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
 
     std::vector<std::pair<AsyncJob<int> *, BasicSceneBuilder *>> imports;
 
+    // When included files are parsed in parallel, the directives from each
+    // one and from the text that follows it are recorded and then passed
+    // along to _sceneTarget_ in order once everything has been parsed.
+    ParserTarget *sceneTarget = target;
+    std::vector<std::pair<AsyncJob<BinaryParserTarget *> *, BinaryParserTarget *>>
+        includes;
+
     LOG_VERBOSE("Started parsing %s",
                 std::string(t->loc.filename.begin(), t->loc.filename.end()));
     std::vector<std::unique_ptr<Tokenizer>> fileStack;
@@ -660,6 +756,15 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
         ungetToken = t;
     };
 
+    // readNumbers lets parseParameters() decode numeric arrays directly
+    // from the current file's contents.
+    auto readNumbers = [&](ParsedParameter *param, bool isInt) {
+        if (ungetToken.has_value() || fileStack.empty())
+            return false;
+        return fileStack.back()->ReadNumbers(&param->floats,
+                                             isInt ? &param->ints : nullptr);
+    };
+
     // Helper function for pbrt API entrypoints that take a single string
     // parameter and a ParameterVector (e.g. pbrtShape()).
     auto basicParamListEntrypoint =
@@ -669,12 +774,13 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
             Token t = *nextToken(TokenRequired);
             std::string_view dequoted = dequoteString(t);
             std::string n = toString(dequoted);
-            ParsedParameterVector parameterVector = parseParameters(
-                nextToken, unget, formatting, [&](const Token &t, const char *msg) {
-                    std::string token = toString(t.token);
-                    std::string str = StringPrintf("%s: %s", token, msg);
-                    parseError(str.c_str(), &t.loc);
-                });
+            ParsedParameterVector parameterVector =
+                parseParameters(nextToken, unget, readNumbers, formatting,
+                                [&](const Token &t, const char *msg) {
+                                    std::string token = toString(t.token);
+                                    std::string str = StringPrintf("%s: %s", token, msg);
+                                    parseError(str.c_str(), &t.loc);
+                                });
             (target->*apiFunc)(n, std::move(parameterVector), loc);
         };
 
@@ -759,13 +865,29 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
                            filename);
                 else {
                     filename = ResolveFilename(filename);
-                    std::unique_ptr<Tokenizer> tinc =
-                        Tokenizer::CreateFromFile(filename, parseError);
-                    if (tinc) {
-                        LOG_VERBOSE("Started parsing %s",
-                                    std::string(tinc->loc.filename.begin(),
-                                                tinc->loc.filename.end()));
-                        fileStack.push_back(std::move(tinc));
+                    if (RunningThreads() > 1) {
+                        // Parse the included file asynchronously and record
+                        // subsequent directives until it has been replayed
+                        auto job = [](std::string filename) {
+                            BinaryParserTarget *recorder = new BinaryParserTarget;
+                            parseFile(recorder, filename);
+                            return recorder;
+                        };
+                        includes.push_back({RunAsync(job, filename), nullptr});
+                        BinaryParserTarget *recorder = new BinaryParserTarget;
+                        includes.push_back({nullptr, recorder});
+                        target = recorder;
+                    } else if (IsBinarySceneFile(filename))
+                        parseBinary(target, BinarySceneReader::CreateFromFile(filename));
+                    else {
+                        std::unique_ptr<Tokenizer> tinc =
+                            Tokenizer::CreateFromFile(filename, parseError);
+                        if (tinc) {
+                            LOG_VERBOSE("Started parsing %s",
+                                        std::string(tinc->loc.filename.begin(),
+                                                    tinc->loc.filename.end()));
+                            fileStack.push_back(std::move(tinc));
+                        }
                     }
                 }
             } else if (tok->token == "Import") {
@@ -775,6 +897,9 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
                     Printf("%sImport \"%s\"\n",
                            dynamic_cast<FormattingParserTarget *>(target)->indent(),
                            filename);
+                else if (BinaryParserTarget *binaryTarget =
+                             dynamic_cast<BinaryParserTarget *>(target))
+                    binaryTarget->Import(filename, tok->loc);
                 else {
                     BasicSceneBuilder *builder =
                         dynamic_cast<BasicSceneBuilder *>(target);
@@ -789,18 +914,12 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
                     BasicSceneBuilder *importBuilder = builder->CopyForImport();
 
                     if (RunningThreads() == 1) {
-                        std::unique_ptr<Tokenizer> timport =
-                            Tokenizer::CreateFromFile(filename, parseError);
-                        if (timport)
-                            parse(importBuilder, std::move(timport));
+                        parseFile(importBuilder, filename);
                         builder->MergeImported(importBuilder);
                     } else {
                         auto job = [=](std::string filename) {
                             Timer timer;
-                            std::unique_ptr<Tokenizer> timport =
-                                Tokenizer::CreateFromFile(filename, parseError);
-                            if (timport)
-                                parse(importBuilder, std::move(timport));
+                            parseFile(importBuilder, filename);
                             LOG_VERBOSE("Elapsed time to parse \"%s\": %.2fs", filename,
                                         timer.ElapsedSeconds());
                             return 0;
@@ -960,12 +1079,14 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
                 Token t = *nextToken(TokenRequired);
                 std::string_view dequoted = dequoteString(t);
                 std::string texName = toString(dequoted);
-                ParsedParameterVector params = parseParameters(
-                    nextToken, unget, formatting, [&](const Token &t, const char *msg) {
-                        std::string token = toString(t.token);
-                        std::string str = StringPrintf("%s: %s", token, msg);
-                        parseError(str.c_str(), &t.loc);
-                    });
+                ParsedParameterVector params =
+                    parseParameters(nextToken, unget, readNumbers, formatting,
+                                    [&](const Token &t, const char *msg) {
+                                        std::string token = toString(t.token);
+                                        std::string str =
+                                            StringPrintf("%s: %s", token, msg);
+                                        parseError(str.c_str(), &t.loc);
+                                    });
 
                 target->Texture(name, type, texName, std::move(params), tok->loc);
             } else
@@ -989,33 +1110,51 @@ void parse(ParserTarget *target, std::unique_ptr<Tokenizer> t) {
     for (auto &import : imports) {
         import.first->Wait();
 
-        BasicSceneBuilder *builder = dynamic_cast<BasicSceneBuilder *>(target);
+        BasicSceneBuilder *builder = dynamic_cast<BasicSceneBuilder *>(sceneTarget);
         CHECK(builder);
         builder->MergeImported(import.second);
         // HACK: let import.second leak so that its TransformCache isn't deallocated...
     }
+
+    // Replay directives recorded for parallel parsing of included files
+    for (auto &include : includes) {
+        BinaryParserTarget *recorder =
+            include.first ? include.first->GetResult() : include.second;
+        recorder->EndOfFiles();
+        parseBinary(sceneTarget, BinarySceneReader::CreateFromString(
+                                     "<include>", recorder->TakeContents()));
+        delete recorder;
+    }
 }
 
-void ParseFiles(ParserTarget *target, pstd::span<const std::string> filenames) {
+// Parses _filename_, which may be either a text or a binary scene file.
+static void parseFile(ParserTarget *target, const std::string &filename) {
+    LoadProfileScope _("Parse file", filename);
+    if (IsBinarySceneFile(filename)) {
+        parseBinary(target, BinarySceneReader::CreateFromFile(filename));
+        return;
+    }
+
     auto tokError = [](const char *msg, const FileLoc *loc) {
         ErrorExit(loc, "%s", msg);
     };
+    std::unique_ptr<Tokenizer> t = Tokenizer::CreateFromFile(filename, tokError);
+    if (t)
+        parse(target, std::move(t));
+}
 
+void ParseFiles(ParserTarget *target, pstd::span<const std::string> filenames) {
+    LoadProfileScope _("Parse files");
     // Process scene description
     if (filenames.empty()) {
         // Parse scene from standard input
-        std::unique_ptr<Tokenizer> t = Tokenizer::CreateFromFile("-", tokError);
-        if (t)
-            parse(target, std::move(t));
+        parseFile(target, "-");
     } else {
         // Parse scene from input files
         for (const std::string &fn : filenames) {
             if (fn != "-")
                 SetSearchDirectory(fn);
-
-            std::unique_ptr<Tokenizer> t = Tokenizer::CreateFromFile(fn, tokError);
-            if (t)
-                parse(target, std::move(t));
+            parseFile(target, fn);
         }
     }
 
@@ -1315,9 +1454,9 @@ void FormattingParserTarget::Texture(const std::string &name, const std::string
         if (type == "float") {
             for (ParsedParameter *p : params) {
                 if (p->name == "tex1")
-                    p->name = "tex";
+                    p->name = InternString("tex");
                 if (p->name == "tex2")
-                    p->name = "scale";
+                    p->name = InternString("scale");
             }
         } else {
             // more subtle: rename one of them as float, but need one of them
@@ -1353,8 +1492,8 @@ void FormattingParserTarget::Texture(const std::string &name, const std::string
                     }
 
                     foundRGB = true;
-                    p->type = "float";
-                    p->name = "scale";
+                    p->type = InternString("float");
+                    p->name = InternString("scale");
                     p->floats.resize(1);
                 } else {
                     if (foundTexture) {
@@ -1366,7 +1505,7 @@ void FormattingParserTarget::Texture(const std::string &name, const std::string
                             name);
                         return;
                     }
-                    p->name = "tex";
+                    p->name = InternString("tex");
                     foundTexture = true;
                 }
             }
@@ -1933,4 +2072,710 @@ void FormattingParserTarget::ObjectInstance(const std::string &name, FileLoc loc
 
 void FormattingParserTarget::EndOfFiles() {}
 
+///////////////////////////////////////////////////////////////////////////
+// Binary Scene Files
+
+// Binary scene files start with these 8 bytes, followed by the format
+// version and sizeof(Float) as 32-bit values. The rest of the file is a
+// sequence of directives, each an 8-bit BinarySceneOp followed by its
+// location and arguments. Strings are stored as a 32-bit length and their
+// characters; parameter values are stored as raw arrays.
+static constexpr char binarySceneMagic[8] = {'P', 'B', 'R', 'T', 'B', 'I', 'N', '\0'};
+static constexpr uint32_t binarySceneVersion = 1;
+
+// BinarySceneOp Definition
+enum class BinarySceneOp : uint8_t {
+    DefineFile,
+    Option,
+    Identity,
+    Translate,
+    Rotate,
+    Scale,
+    LookAt,
+    ConcatTransform,
+    Transform,
+    CoordinateSystem,
+    CoordSysTransform,
+    ActiveTransformAll,
+    ActiveTransformEndTime,
+    ActiveTransformStartTime,
+    TransformTimes,
+    ColorSpace,
+    PixelFilter,
+    Film,
+    Sampler,
+    Accelerator,
+    Integrator,
+    Camera,
+    MakeNamedMedium,
+    MediumInterface,
+    WorldBegin,
+    AttributeBegin,
+    AttributeEnd,
+    Attribute,
+    Texture,
+    Material,
+    MakeNamedMaterial,
+    NamedMaterial,
+    LightSource,
+    AreaLightSource,
+    Shape,
+    ReverseOrientation,
+    ObjectBegin,
+    ObjectEnd,
+    ObjectInstance,
+    Import
+};
+
+STAT_MEMORY_COUNTER("Memory/Binary scene files read", binarySceneBytes);
+
+bool IsBinarySceneFile(const std::string &filename) {
+    if (filename == "-" || HasExtension(filename, ".gz"))
+        return false;
+    FILE *f = FOpenRead(filename);
+    if (!f)
+        return false;
+    char magic[sizeof(binarySceneMagic)];
+    bool isBinary = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                    memcmp(magic, binarySceneMagic, sizeof(magic)) == 0;
+    fclose(f);
+    return isBinary;
+}
+
+// BinaryParserTarget Method Definitions
+BinaryParserTarget::BinaryParserTarget(const std::string &filename)
+    : filename(filename) {
+    file = FOpenWrite(filename);
+    if (!file)
+        ErrorExit("%s: %s", filename, ErrorString());
+    writeHeader();
+}
+
+BinaryParserTarget::~BinaryParserTarget() {
+    if (file)
+        fclose(file);
+    if (errorExit)
+        ErrorExit("Fatal errors during scene updating.");
+}
+
+void BinaryParserTarget::writeHeader() {
+    buffer.append(binarySceneMagic, sizeof(binarySceneMagic));
+    uint32_t header[2] = {binarySceneVersion, sizeof(Float)};
+    buffer.append((const char *)header, sizeof(header));
+}
+
+void BinaryParserTarget::writeBytes(const void *ptr, size_t size) {
+    buffer.append((const char *)ptr, size);
+    if (file && buffer.size() > 1024 * 1024)
+        flush();
+}
+
+void BinaryParserTarget::flush() {
+    if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+        ErrorExit("%s: %s", filename, ErrorString());
+    buffer.clear();
+}
+
+void BinaryParserTarget::writeString(const std::string &str) {
+    write<uint32_t>(str.size());
+    writeBytes(str.data(), str.size());
+}
+
+void BinaryParserTarget::writeOp(BinarySceneOp op, const FileLoc &loc) {
+    // Add the location's file to the file table if it's not already there
+    std::string locFilename(loc.filename.begin(), loc.filename.end());
+    auto iter = fileIndices.find(locFilename);
+    if (iter == fileIndices.end()) {
+        write(BinarySceneOp::DefineFile);
+        writeString(locFilename);
+        iter = fileIndices.insert({locFilename, uint32_t(fileIndices.size())}).first;
+    }
+
+    write(op);
+    write<uint32_t>(iter->second);
+    write<int32_t>(loc.line);
+    write<int32_t>(loc.column);
+}
+
+void BinaryParserTarget::writeParameters(ParsedParameterVector &params) {
+    write<uint32_t>(params.size());
+    for (ParsedParameter *p : params) {
+        writeString(p->type);
+        writeString(p->name);
+        write<int32_t>(p->loc.line);
+        write<int32_t>(p->loc.column);
+        write<uint8_t>(p->mayBeUnused);
+        write<uint32_t>(p->floats.size());
+        writeBytes(p->floats.data(), p->floats.size() * sizeof(Float));
+        write<uint32_t>(p->ints.size());
+        writeBytes(p->ints.data(), p->ints.size() * sizeof(int));
+        write<uint32_t>(p->bools.size());
+        writeBytes(p->bools.data(), p->bools.size());
+        write<uint32_t>(p->strings.size());
+        for (const std::string &s : p->strings)
+            writeString(s);
+        delete p;
+    }
+    params.clear();
+}
+
+void BinaryParserTarget::Option(const std::string &name, const std::string &value,
+                                FileLoc loc) {
+    writeOp(BinarySceneOp::Option, loc);
+    writeString(name);
+    writeString(value);
+}
+
+void BinaryParserTarget::Identity(FileLoc loc) {
+    writeOp(BinarySceneOp::Identity, loc);
+}
+
+void BinaryParserTarget::Translate(Float dx, Float dy, Float dz, FileLoc loc) {
+    writeOp(BinarySceneOp::Translate, loc);
+    for (Float v : {dx, dy, dz})
+        write(v);
+}
+
+void BinaryParserTarget::Rotate(Float angle, Float ax, Float ay, Float az, FileLoc loc) {
+    writeOp(BinarySceneOp::Rotate, loc);
+    for (Float v : {angle, ax, ay, az})
+        write(v);
+}
+
+void BinaryParserTarget::Scale(Float sx, Float sy, Float sz, FileLoc loc) {
+    writeOp(BinarySceneOp::Scale, loc);
+    for (Float v : {sx, sy, sz})
+        write(v);
+}
+
+void BinaryParserTarget::LookAt(Float ex, Float ey, Float ez, Float lx, Float ly,
+                                Float lz, Float ux, Float uy, Float uz, FileLoc loc) {
+    writeOp(BinarySceneOp::LookAt, loc);
+    for (Float v : {ex, ey, ez, lx, ly, lz, ux, uy, uz})
+        write(v);
+}
+
+void BinaryParserTarget::ConcatTransform(Float transform[16], FileLoc loc) {
+    writeOp(BinarySceneOp::ConcatTransform, loc);
+    writeBytes(transform, 16 * sizeof(Float));
+}
+
+void BinaryParserTarget::Transform(Float transform[16], FileLoc loc) {
+    writeOp(BinarySceneOp::Transform, loc);
+    writeBytes(transform, 16 * sizeof(Float));
+}
+
+void BinaryParserTarget::CoordinateSystem(const std::string &name, FileLoc loc) {
+    writeOp(BinarySceneOp::CoordinateSystem, loc);
+    writeString(name);
+}
+
+void BinaryParserTarget::CoordSysTransform(const std::string &name, FileLoc loc) {
+    writeOp(BinarySceneOp::CoordSysTransform, loc);
+    writeString(name);
+}
+
+void BinaryParserTarget::ActiveTransformAll(FileLoc loc) {
+    writeOp(BinarySceneOp::ActiveTransformAll, loc);
+}
+
+void BinaryParserTarget::ActiveTransformEndTime(FileLoc loc) {
+    writeOp(BinarySceneOp::ActiveTransformEndTime, loc);
+}
+
+void BinaryParserTarget::ActiveTransformStartTime(FileLoc loc) {
+    writeOp(BinarySceneOp::ActiveTransformStartTime, loc);
+}
+
+void BinaryParserTarget::TransformTimes(Float start, Float end, FileLoc loc) {
+    writeOp(BinarySceneOp::TransformTimes, loc);
+    write(start);
+    write(end);
+}
+
+void BinaryParserTarget::ColorSpace(const std::string &n, FileLoc loc) {
+    writeOp(BinarySceneOp::ColorSpace, loc);
+    writeString(n);
+}
+
+void BinaryParserTarget::PixelFilter(const std::string &name,
+                                     ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::PixelFilter, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Film(const std::string &type, ParsedParameterVector params,
+                              FileLoc loc) {
+    writeOp(BinarySceneOp::Film, loc);
+    writeString(type);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Sampler(const std::string &name, ParsedParameterVector params,
+                                 FileLoc loc) {
+    writeOp(BinarySceneOp::Sampler, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Accelerator(const std::string &name,
+                                     ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::Accelerator, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Integrator(const std::string &name,
+                                    ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::Integrator, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Camera(const std::string &name, ParsedParameterVector params,
+                                FileLoc loc) {
+    writeOp(BinarySceneOp::Camera, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::MakeNamedMedium(const std::string &name,
+                                         ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::MakeNamedMedium, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::MediumInterface(const std::string &insideName,
+                                         const std::string &outsideName, FileLoc loc) {
+    writeOp(BinarySceneOp::MediumInterface, loc);
+    writeString(insideName);
+    writeString(outsideName);
+}
+
+void BinaryParserTarget::WorldBegin(FileLoc loc) {
+    writeOp(BinarySceneOp::WorldBegin, loc);
+}
+
+void BinaryParserTarget::AttributeBegin(FileLoc loc) {
+    writeOp(BinarySceneOp::AttributeBegin, loc);
+}
+
+void BinaryParserTarget::AttributeEnd(FileLoc loc) {
+    writeOp(BinarySceneOp::AttributeEnd, loc);
+}
+
+void BinaryParserTarget::Attribute(const std::string &target,
+                                   ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::Attribute, loc);
+    writeString(target);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Texture(const std::string &name, const std::string &type,
+                                 const std::string &texname,
+                                 ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::Texture, loc);
+    writeString(name);
+    writeString(type);
+    writeString(texname);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Material(const std::string &name, ParsedParameterVector params,
+                                  FileLoc loc) {
+    writeOp(BinarySceneOp::Material, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::MakeNamedMaterial(const std::string &name,
+                                           ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::MakeNamedMaterial, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::NamedMaterial(const std::string &name, FileLoc loc) {
+    writeOp(BinarySceneOp::NamedMaterial, loc);
+    writeString(name);
+}
+
+void BinaryParserTarget::LightSource(const std::string &name,
+                                     ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::LightSource, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::AreaLightSource(const std::string &name,
+                                         ParsedParameterVector params, FileLoc loc) {
+    writeOp(BinarySceneOp::AreaLightSource, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::Shape(const std::string &name, ParsedParameterVector params,
+                               FileLoc loc) {
+    writeOp(BinarySceneOp::Shape, loc);
+    writeString(name);
+    writeParameters(params);
+}
+
+void BinaryParserTarget::ReverseOrientation(FileLoc loc) {
+    writeOp(BinarySceneOp::ReverseOrientation, loc);
+}
+
+void BinaryParserTarget::ObjectBegin(const std::string &name, FileLoc loc) {
+    writeOp(BinarySceneOp::ObjectBegin, loc);
+    writeString(name);
+}
+
+void BinaryParserTarget::ObjectEnd(FileLoc loc) {
+    writeOp(BinarySceneOp::ObjectEnd, loc);
+}
+
+void BinaryParserTarget::ObjectInstance(const std::string &name, FileLoc loc) {
+    writeOp(BinarySceneOp::ObjectInstance, loc);
+    writeString(name);
+}
+
+void BinaryParserTarget::Import(const std::string &filename, FileLoc loc) {
+    writeOp(BinarySceneOp::Import, loc);
+    writeString(filename);
+}
+
+void BinaryParserTarget::EndOfFiles() {
+    if (!file)
+        return;
+    flush();
+    if (fclose(file) != 0)
+        ErrorExit("%s: %s", filename, ErrorString());
+    file = nullptr;
+}
+
+// BinarySceneReader Method Definitions
+BinarySceneReader::BinarySceneReader(std::string name, std::string str)
+    : name(std::move(name)), contents(std::move(str)) {
+    pos = contents.data();
+    end = pos + contents.size();
+    readHeader();
+}
+
+#ifdef PBRT_HAVE_MMAP
+BinarySceneReader::BinarySceneReader(std::string name, void *ptr, size_t len)
+    : name(std::move(name)), unmapPtr(ptr), unmapLength(len) {
+    pos = (const char *)ptr;
+    end = pos + len;
+    binarySceneBytes += len;
+    readHeader();
+}
+#endif
+
+BinarySceneReader::~BinarySceneReader() {
+#ifdef PBRT_HAVE_MMAP
+    if (unmapPtr && unmapLength > 0)
+        if (munmap(unmapPtr, unmapLength) != 0)
+            Error("munmap: %s", ErrorString());
+#endif
+}
+
+std::unique_ptr<BinarySceneReader> BinarySceneReader::CreateFromFile(
+    const std::string &filename) {
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        ErrorExit("%s: %s", filename, ErrorString());
+    struct stat stat;
+    if (fstat(fd, &stat) != 0)
+        ErrorExit("%s: %s", filename, ErrorString());
+    size_t len = stat.st_size;
+    void *ptr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    if (ptr == MAP_FAILED)
+        ErrorExit("%s: %s", filename, ErrorString());
+    if (close(fd) != 0)
+        ErrorExit("%s: %s", filename, ErrorString());
+    return std::make_unique<BinarySceneReader>(filename, ptr, len);
+#else
+    std::string contents = ReadFileContents(filename);
+    binarySceneBytes += contents.size();
+    return std::make_unique<BinarySceneReader>(filename, std::move(contents));
+#endif
+}
+
+std::unique_ptr<BinarySceneReader> BinarySceneReader::CreateFromString(
+    std::string name, std::string contents) {
+    return std::make_unique<BinarySceneReader>(std::move(name), std::move(contents));
+}
+
+void BinarySceneReader::readHeader() {
+    char magic[sizeof(binarySceneMagic)];
+    ReadBytes(magic, sizeof(magic));
+    if (memcmp(magic, binarySceneMagic, sizeof(magic)) != 0)
+        ErrorExit("%s: not a binary pbrt scene file.", name);
+    if (uint32_t version = Read<uint32_t>(); version != binarySceneVersion)
+        ErrorExit("%s: binary scene file version %d is not supported.", name, version);
+    if (uint32_t floatSize = Read<uint32_t>(); floatSize != sizeof(Float))
+        ErrorExit("%s: binary scene file was written with %d-byte Floats but "
+                  "pbrt was built with %d-byte Floats.",
+                  name, floatSize, int(sizeof(Float)));
+}
+
+void BinarySceneReader::ReadBytes(void *ptr, size_t size) {
+    if (size > size_t(end - pos))
+        ErrorExit("%s: premature end of binary scene file.", name);
+    if (size > 0)
+        memcpy(ptr, pos, size);
+    pos += size;
+}
+
+std::string BinarySceneReader::ReadString() {
+    uint32_t size = Read<uint32_t>();
+    if (size > size_t(end - pos))
+        ErrorExit("%s: premature end of binary scene file.", name);
+    std::string str(pos, size);
+    pos += size;
+    return str;
+}
+
+void BinarySceneReader::DefineFile(std::string filename) {
+    filenames.push_back(*new std::string(std::move(filename)));
+}
+
+FileLoc BinarySceneReader::ReadLoc() {
+    uint32_t fileIndex = Read<uint32_t>();
+    if (fileIndex >= filenames.size())
+        ErrorExit("%s: invalid file index in binary scene file.", name);
+    FileLoc loc(filenames[fileIndex]);
+    loc.line = Read<int32_t>();
+    loc.column = Read<int32_t>();
+    return loc;
+}
+
+ParsedParameterVector BinarySceneReader::ReadParameters(const FileLoc &loc) {
+    ParsedParameterVector params;
+    uint32_t count = Read<uint32_t>();
+    for (uint32_t i = 0; i < count; ++i) {
+        ParsedParameter *p = new ParsedParameter(loc);
+        p->type = InternString(ReadString());
+        p->name = InternString(ReadString());
+        p->loc.line = Read<int32_t>();
+        p->loc.column = Read<int32_t>();
+        p->mayBeUnused = Read<uint8_t>();
+        readArray(&p->floats);
+        readArray(&p->ints);
+        readArray(&p->bools);
+        p->strings.resize(Read<uint32_t>());
+        for (std::string &str : p->strings)
+            str = ReadString();
+        params.push_back(p);
+    }
+    return params;
+}
+
+void parseBinary(ParserTarget *target, std::unique_ptr<BinarySceneReader> r) {
+    LOG_VERBOSE("Started parsing binary scene %s", r->name);
+    std::vector<std::pair<AsyncJob<int> *, BasicSceneBuilder *>> imports;
+
+    while (!r->AtEnd()) {
+        BinarySceneOp op = r->Read<BinarySceneOp>();
+        if (op == BinarySceneOp::DefineFile) {
+            r->DefineFile(r->ReadString());
+            continue;
+        }
+
+        FileLoc loc = r->ReadLoc();
+        auto readFloats = [&](Float *v, int n) { r->ReadBytes(v, n * sizeof(Float)); };
+        auto paramListEntrypoint =
+            [&](void (ParserTarget::*apiFunc)(const std::string &, ParsedParameterVector,
+                                              FileLoc)) {
+                std::string name = r->ReadString();
+                (target->*apiFunc)(name, r->ReadParameters(loc), loc);
+            };
+
+        switch (op) {
+        case BinarySceneOp::Option: {
+            std::string name = r->ReadString();
+            target->Option(name, r->ReadString(), loc);
+            break;
+        }
+        case BinarySceneOp::Identity:
+            target->Identity(loc);
+            break;
+        case BinarySceneOp::Translate: {
+            Float v[3];
+            readFloats(v, 3);
+            target->Translate(v[0], v[1], v[2], loc);
+            break;
+        }
+        case BinarySceneOp::Rotate: {
+            Float v[4];
+            readFloats(v, 4);
+            target->Rotate(v[0], v[1], v[2], v[3], loc);
+            break;
+        }
+        case BinarySceneOp::Scale: {
+            Float v[3];
+            readFloats(v, 3);
+            target->Scale(v[0], v[1], v[2], loc);
+            break;
+        }
+        case BinarySceneOp::LookAt: {
+            Float v[9];
+            readFloats(v, 9);
+            target->LookAt(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], loc);
+            break;
+        }
+        case BinarySceneOp::ConcatTransform: {
+            Float m[16];
+            readFloats(m, 16);
+            target->ConcatTransform(m, loc);
+            break;
+        }
+        case BinarySceneOp::Transform: {
+            Float m[16];
+            readFloats(m, 16);
+            target->Transform(m, loc);
+            break;
+        }
+        case BinarySceneOp::CoordinateSystem:
+            target->CoordinateSystem(r->ReadString(), loc);
+            break;
+        case BinarySceneOp::CoordSysTransform:
+            target->CoordSysTransform(r->ReadString(), loc);
+            break;
+        case BinarySceneOp::ActiveTransformAll:
+            target->ActiveTransformAll(loc);
+            break;
+        case BinarySceneOp::ActiveTransformEndTime:
+            target->ActiveTransformEndTime(loc);
+            break;
+        case BinarySceneOp::ActiveTransformStartTime:
+            target->ActiveTransformStartTime(loc);
+            break;
+        case BinarySceneOp::TransformTimes: {
+            Float v[2];
+            readFloats(v, 2);
+            target->TransformTimes(v[0], v[1], loc);
+            break;
+        }
+        case BinarySceneOp::ColorSpace:
+            target->ColorSpace(r->ReadString(), loc);
+            break;
+        case BinarySceneOp::PixelFilter:
+            paramListEntrypoint(&ParserTarget::PixelFilter);
+            break;
+        case BinarySceneOp::Film:
+            paramListEntrypoint(&ParserTarget::Film);
+            break;
+        case BinarySceneOp::Sampler:
+            paramListEntrypoint(&ParserTarget::Sampler);
+            break;
+        case BinarySceneOp::Accelerator:
+            paramListEntrypoint(&ParserTarget::Accelerator);
+            break;
+        case BinarySceneOp::Integrator:
+            paramListEntrypoint(&ParserTarget::Integrator);
+            break;
+        case BinarySceneOp::Camera:
+            paramListEntrypoint(&ParserTarget::Camera);
+            break;
+        case BinarySceneOp::MakeNamedMedium:
+            paramListEntrypoint(&ParserTarget::MakeNamedMedium);
+            break;
+        case BinarySceneOp::MediumInterface: {
+            std::string insideName = r->ReadString();
+            target->MediumInterface(insideName, r->ReadString(), loc);
+            break;
+        }
+        case BinarySceneOp::WorldBegin:
+            target->WorldBegin(loc);
+            break;
+        case BinarySceneOp::AttributeBegin:
+            target->AttributeBegin(loc);
+            break;
+        case BinarySceneOp::AttributeEnd:
+            target->AttributeEnd(loc);
+            break;
+        case BinarySceneOp::Attribute:
+            paramListEntrypoint(&ParserTarget::Attribute);
+            break;
+        case BinarySceneOp::Texture: {
+            std::string name = r->ReadString();
+            std::string type = r->ReadString();
+            std::string texName = r->ReadString();
+            target->Texture(name, type, texName, r->ReadParameters(loc), loc);
+            break;
+        }
+        case BinarySceneOp::Material:
+            paramListEntrypoint(&ParserTarget::Material);
+            break;
+        case BinarySceneOp::MakeNamedMaterial:
+            paramListEntrypoint(&ParserTarget::MakeNamedMaterial);
+            break;
+        case BinarySceneOp::NamedMaterial:
+            target->NamedMaterial(r->ReadString(), loc);
+            break;
+        case BinarySceneOp::LightSource:
+            paramListEntrypoint(&ParserTarget::LightSource);
+            break;
+        case BinarySceneOp::AreaLightSource:
+            paramListEntrypoint(&ParserTarget::AreaLightSource);
+            break;
+        case BinarySceneOp::Shape:
+            paramListEntrypoint(&ParserTarget::Shape);
+            break;
+        case BinarySceneOp::ReverseOrientation:
+            target->ReverseOrientation(loc);
+            break;
+        case BinarySceneOp::ObjectBegin:
+            target->ObjectBegin(r->ReadString(), loc);
+            break;
+        case BinarySceneOp::ObjectEnd:
+            target->ObjectEnd(loc);
+            break;
+        case BinarySceneOp::ObjectInstance:
+            target->ObjectInstance(r->ReadString(), loc);
+            break;
+        case BinarySceneOp::Import: {
+            std::string importFilename = r->ReadString();
+            if (BinaryParserTarget *binaryTarget =
+                    dynamic_cast<BinaryParserTarget *>(target)) {
+                binaryTarget->Import(importFilename, loc);
+                break;
+            }
+            BasicSceneBuilder *builder = dynamic_cast<BasicSceneBuilder *>(target);
+            CHECK(builder);
+            if (builder->currentBlock != BasicSceneBuilder::BlockState::WorldBlock)
+                ErrorExit(&loc, "Import statement only allowed inside world "
+                                "definition block.");
+
+            importFilename = ResolveFilename(importFilename);
+            BasicSceneBuilder *importBuilder = builder->CopyForImport();
+            if (RunningThreads() == 1) {
+                parseFile(importBuilder, importFilename);
+                builder->MergeImported(importBuilder);
+            } else {
+                auto job = [=](std::string filename) {
+                    parseFile(importBuilder, filename);
+                    return 0;
+                };
+                imports.push_back({RunAsync(job, importFilename), importBuilder});
+            }
+            break;
+        }
+        default:
+            ErrorExit(&loc, "%d: unknown directive in binary scene file.", int(op));
+        }
+    }
+
+    for (auto &import : imports) {
+        import.first->Wait();
+        BasicSceneBuilder *builder = dynamic_cast<BasicSceneBuilder *>(target);
+        builder->MergeImported(import.second);
+    }
+    LOG_VERBOSE("Finished parsing binary scene %s", r->name);
+}
+
 }  // namespace pbrt
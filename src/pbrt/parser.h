@@ -13,6 +13,7 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/pstd.h>
 
+#include <cstdio>
 #include <functional>
 #include <map>
 #include <memory>
@@ -141,6 +142,12 @@ class Tokenizer {
 
     pstd::optional<Token> Next();
 
+    // Decodes numeric values directly from the input, appending them to
+    // _floats_ or, if _ints_ is non-null, to _ints_. Returns true after
+    // consuming the closing ']' of an array; returns false if it reaches
+    // anything other than a number, leaving it for _Next()_.
+    bool ReadNumbers(pstd::vector<Float> *floats, pstd::vector<int> *ints);
+
     // Just for parse().
     // TODO? Have a method to set this?
     FileLoc loc;
@@ -271,6 +278,146 @@ class FormattingParserTarget : public ParserTarget {
     std::map<std::string, std::string> definedObjectInstances;
 };
 
+enum class BinarySceneOp : uint8_t;
+
+// BinaryParserTarget Definition
+// Writes the scene description to a binary file that holds the directive
+// stream along with raw parameter values; ParseFiles() reads such files
+// directly from memory without tokenizing or parsing numbers.
+class BinaryParserTarget : public ParserTarget {
+  public:
+    BinaryParserTarget(const std::string &filename);
+    // Records the directives in memory; they are available from
+    // _TakeContents()_ after _EndOfFiles()_ has been called.
+    BinaryParserTarget() { writeHeader(); }
+    ~BinaryParserTarget();
+
+    std::string TakeContents() { return std::move(buffer); }
+
+    void Option(const std::string &name, const std::string &value, FileLoc loc);
+    void Identity(FileLoc loc);
+    void Translate(Float dx, Float dy, Float dz, FileLoc loc);
+    void Rotate(Float angle, Float ax, Float ay, Float az, FileLoc loc);
+    void Scale(Float sx, Float sy, Float sz, FileLoc loc);
+    void LookAt(Float ex, Float ey, Float ez, Float lx, Float ly, Float lz, Float ux,
+                Float uy, Float uz, FileLoc loc);
+    void ConcatTransform(Float transform[16], FileLoc loc);
+    void Transform(Float transform[16], FileLoc loc);
+    void CoordinateSystem(const std::string &, FileLoc loc);
+    void CoordSysTransform(const std::string &, FileLoc loc);
+    void ActiveTransformAll(FileLoc loc);
+    void ActiveTransformEndTime(FileLoc loc);
+    void ActiveTransformStartTime(FileLoc loc);
+    void TransformTimes(Float start, Float end, FileLoc loc);
+    void ColorSpace(const std::string &n, FileLoc loc);
+    void PixelFilter(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Film(const std::string &type, ParsedParameterVector params, FileLoc loc);
+    void Sampler(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Accelerator(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Integrator(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Camera(const std::string &, ParsedParameterVector params, FileLoc loc);
+    void MakeNamedMedium(const std::string &name, ParsedParameterVector params,
+                         FileLoc loc);
+    void MediumInterface(const std::string &insideName, const std::string &outsideName,
+                         FileLoc loc);
+    void WorldBegin(FileLoc loc);
+    void AttributeBegin(FileLoc loc);
+    void AttributeEnd(FileLoc loc);
+    void Attribute(const std::string &target, ParsedParameterVector params, FileLoc loc);
+    void Texture(const std::string &name, const std::string &type,
+                 const std::string &texname, ParsedParameterVector params, FileLoc loc);
+    void Material(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void MakeNamedMaterial(const std::string &name, ParsedParameterVector params,
+                           FileLoc loc);
+    void NamedMaterial(const std::string &name, FileLoc loc);
+    void LightSource(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void AreaLightSource(const std::string &name, ParsedParameterVector params,
+                         FileLoc loc);
+    void Shape(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void ReverseOrientation(FileLoc loc);
+    void ObjectBegin(const std::string &name, FileLoc loc);
+    void ObjectEnd(FileLoc loc);
+    void ObjectInstance(const std::string &name, FileLoc loc);
+    // Imported files are recorded rather than inlined so that they are still
+    // parsed in parallel when the binary file is read.
+    void Import(const std::string &filename, FileLoc loc);
+
+    void EndOfFiles();
+
+  private:
+    void writeBytes(const void *ptr, size_t size);
+    template <typename T>
+    void write(T value) {
+        writeBytes(&value, sizeof(T));
+    }
+    void writeString(const std::string &str);
+    void writeOp(BinarySceneOp op, const FileLoc &loc);
+    void writeParameters(ParsedParameterVector &params);
+
+    void writeHeader();
+    void flush();
+
+    std::string filename;
+    FILE *file = nullptr;
+    std::string buffer;
+    std::map<std::string, uint32_t> fileIndices;
+};
+
+// Returns true if _filename_ was written by _BinaryParserTarget_.
+bool IsBinarySceneFile(const std::string &filename);
+
+// BinarySceneReader Definition
+class BinarySceneReader {
+  public:
+    // BinarySceneReader Public Methods
+    BinarySceneReader(std::string name, std::string contents);
+#ifdef PBRT_HAVE_MMAP
+    BinarySceneReader(std::string name, void *ptr, size_t len);
+#endif
+    ~BinarySceneReader();
+
+    static std::unique_ptr<BinarySceneReader> CreateFromFile(const std::string &filename);
+    static std::unique_ptr<BinarySceneReader> CreateFromString(std::string name,
+                                                               std::string contents);
+
+    bool AtEnd() const { return pos == end; }
+    void ReadBytes(void *ptr, size_t size);
+    template <typename T>
+    T Read() {
+        T value;
+        ReadBytes(&value, sizeof(T));
+        return value;
+    }
+    std::string ReadString();
+
+    // Adds a filename to the table used by _ReadLoc()_.
+    void DefineFile(std::string filename);
+    FileLoc ReadLoc();
+    ParsedParameterVector ReadParameters(const FileLoc &loc);
+
+    std::string name;
+
+  private:
+    // BinarySceneReader Private Methods
+    void readHeader();
+    template <typename T>
+    void readArray(pstd::vector<T> *v) {
+        v->resize(Read<uint32_t>());
+        ReadBytes(v->data(), v->size() * sizeof(T));
+    }
+
+    // BinarySceneReader Private Members
+    // As with the Tokenizer, these strings are leaked so that FileLocs remain
+    // valid after the reader has been destroyed.
+    std::vector<std::string_view> filenames;
+#ifdef PBRT_HAVE_MMAP
+    void *unmapPtr = nullptr;
+    size_t unmapLength = 0;
+#endif
+    std::string contents;
+    const char *pos, *end;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_PARSER_H
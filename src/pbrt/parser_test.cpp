@@ -6,6 +6,7 @@
 
 #include <pbrt/parser.h>
 #include <pbrt/pbrt.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/pstd.h>
 
 #include <fstream>
@@ -144,3 +145,91 @@ Integrator "deep" "float density" [ 2 2.66612 -5e-51]
 
     EXPECT_EQ(0, remove(filename.c_str()));
 }
+
+TEST(Parser, BinaryRoundTrip) {
+    std::string includeFilename = inTestDir("include.pbrt");
+    std::ofstream incOut(includeFilename);
+    incOut << R"(
+Material "conductor"
+Shape "sphere" "float radius" 2.5
+)";
+    incOut.close();
+    ASSERT_TRUE(incOut.good());
+
+    std::string filename = inTestDir("test.pbrt");
+    std::ofstream out(filename);
+    out << R"(
+LookAt 0 0 5  0 0 0  0 1 0 # comment
+Camera "perspective" "float fov" 45
+WorldBegin
+AttributeBegin
+  Material "diffuse" "rgb reflectance" [ .5 .5 .8 ]
+  Translate 1 2 3
+  Shape "trianglemesh" "point3 P" [ 0 0 0 1 0 0 1 1 0 ] "integer indices" [ 0 1 2 ]
+    "bool flip" false "string alpha" "tex"
+AttributeEnd
+Include "include.pbrt"
+Shape "disk"
+Import "other.pbrt"
+)";
+    out.close();
+    ASSERT_TRUE(out.good());
+    EXPECT_FALSE(IsBinarySceneFile(filename));
+
+    // Converting the text file and then the binary file should give identical
+    // results, since the directives, parameters, and locations are preserved.
+    std::string binary0 = inTestDir("test0.pbrb"), binary1 = inTestDir("test1.pbrb");
+    {
+        BinaryParserTarget target(binary0);
+        ParseFiles(&target, {&filename, 1});
+    }
+    EXPECT_TRUE(IsBinarySceneFile(binary0));
+    {
+        BinaryParserTarget target(binary1);
+        ParseFiles(&target, {&binary0, 1});
+    }
+    std::string contents0 = ReadFileContents(binary0);
+    EXPECT_FALSE(contents0.empty());
+    EXPECT_EQ(contents0, ReadFileContents(binary1));
+
+    EXPECT_EQ(0, remove(includeFilename.c_str()));
+    EXPECT_EQ(0, remove(filename.c_str()));
+    EXPECT_EQ(0, remove(binary0.c_str()));
+    EXPECT_EQ(0, remove(binary1.c_str()));
+}
+
+TEST(Parser, TokenizerReadNumbers) {
+    auto err = [](const char *err, const FileLoc *) {
+        EXPECT_TRUE(false) << "Unexpected error: " << err;
+    };
+    std::vector<std::string> values = {"0.1", "2.5",      "-3",       "123.456",
+                                       "1e-3", ".75",     "-0.0",     "7.",
+                                       "16777217", "0.333333", "3.14159265358979"};
+    std::string str;
+    for (const std::string &v : values)
+        str += v + "\n ";
+    str += "] next";
+
+    auto t = Tokenizer::CreateFromString(str, err);
+    pstd::vector<Float> floats;
+    EXPECT_TRUE(t->ReadNumbers(&floats, nullptr));
+    ASSERT_EQ(values.size(), floats.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        const char *v = values[i].c_str();
+        Float expected = sizeof(Float) == sizeof(float) ? std::strtof(v, nullptr)
+                                                        : std::strtod(v, nullptr);
+        EXPECT_EQ(expected, floats[i]) << values[i];
+    }
+    EXPECT_TRUE(std::signbit(floats[6]));
+    checkTokens(t.get(), {"next"});
+
+    // Integers, stopping at a comment and then at a string.
+    t = Tokenizer::CreateFromString("1 -2 30 # comment\n 4 \"five\" ]", err);
+    pstd::vector<int> ints;
+    EXPECT_FALSE(t->ReadNumbers(&floats, &ints));
+    ASSERT_EQ(3, ints.size());
+    EXPECT_EQ(1, ints[0]);
+    EXPECT_EQ(-2, ints[1]);
+    EXPECT_EQ(30, ints[2]);
+    checkTokens(t.get(), {"# comment", "4", "\"five\"", "]"});
+}
@@ -19,10 +19,10 @@
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/stats.h>
-
-#include <ImfThreading.h>
+#include <pbrt/util/taggedptr.h>
 
 #include <stdlib.h>
 
@@ -57,11 +57,10 @@ static LONG WINAPI handleExceptions(PEXCEPTION_POINTERS info) {
 
 // API Function Definitions
 void InitPBRT(const PBRTOptions &opt) {
+    Timer startupTimer;
     Options = new PBRTOptions(opt);
     // API Initialization
 
-    Imf::setGlobalThreadCount(opt.nThreads ? opt.nThreads : AvailableCores());
-
 #if defined(PBRT_IS_WINDOWS)
     SetUnhandledExceptionFilter(handleExceptions);
 #if defined(PBRT_BUILD_GPU_RENDERER)
@@ -86,9 +85,50 @@ void InitPBRT(const PBRTOptions &opt) {
     InitLogging(opt.logLevel, opt.logFile, opt.logUtilization, Options->useGPU);
 
     // General \pbrt Initialization
-    int nThreads = Options->nThreads != 0 ? Options->nThreads : AvailableCores();
-    ParallelInit(nThreads);  // Threads must be launched before the
-                             // profiler is initialized.
+    ThreadPlacement placement;
+    placement.numa = Options->numa;
+    placement.pinThreads = Options->pinThreads;
+    placement.skipSMTSiblings = Options->skipSMTSiblings;
+    placement.cpus = Options->cpus;
+    placement.reservedCores = Options->reservedCores;
+    ParallelInit(Options->nThreads, placement);  // Threads must be launched before
+                                                 // the profiler is initialized.
+    SetTileScheduling(Options->tileOrder == "scanline" ? TileOrder::Scanline
+                      : Options->tileOrder == "morton" ? TileOrder::Morton
+                                                       : TileOrder::Hilbert,
+                      Options->tileAffinity);
+
+    // Install the huge page memory resource before the load profiler's
+    // tracking resource so that the profile reports huge page use.
+    if (Options->hugePages && !Options->useGPU)
+        pstd::pmr::set_default_resource(
+            new HugePageMemoryResource(pstd::pmr::get_default_resource()));
+    // Track allocations by subsystem for the statistics and the memory budget
+    if (Options->printStatistics || Options->memoryBudgetMB > 0)
+        EnableMemoryTracking();
+    SetMemoryBudget(size_t(Options->memoryBudgetMB) << 20);
+    if (!Options->loadProfileFile.empty())
+        StatsEnableLoadProfile();
+    if (!Options->traceFile.empty())
+        StatsEnableTrace();
+    if (!Options->metricsFile.empty()) {
+        std::function<size_t()> trackedBytes;
+#ifdef PBRT_BUILD_GPU_RENDERER
+        if (Options->useGPU)
+            trackedBytes = []() {
+                return CUDATrackedMemoryResource::singleton.BytesAllocated();
+            };
+#endif  // PBRT_BUILD_GPU_RENDERER
+        StatsEnableMetrics(Options->metricsFile, Options->metricsInterval,
+                           trackedBytes);
+    }
+    if (Options->printStatistics)
+        EnableParallelLoopStatistics();
+    if (Options->printStatistics && !Options->useGPU && !StatsEnableProfiler())
+        LOG_VERBOSE("The sampling profiler isn't available on this system.");
+    if (Options->perfCounters && !StatsEnablePerfCounters())
+        Warning("Hardware performance counters are unavailable. (On Linux, check "
+                "/proc/sys/kernel/perf_event_paranoid.)");
 
     if (Options->useGPU) {
 #ifdef PBRT_BUILD_GPU_RENDERER
@@ -129,12 +169,28 @@ void InitPBRT(const PBRTOptions &opt) {
     }
 
     if (!Options->displayServer.empty())
-        ConnectToDisplayServer(Options->displayServer);
+        ConnectToDisplayServer(Options->displayServer, Options->displayBandwidth);
+
+    StatsReportBenchmarkPhase(BenchmarkPhase::Startup, startupTimer.ElapsedSeconds());
 }
 
 void CleanupPBRT() {
+    if (!Options->metricsFile.empty())
+        StatsStopMetrics();
+    StatsStopProfiler();
     ForEachThread(ReportThreadStats);
 
+    if (!Options->loadProfileFile.empty())
+        StatsWriteLoadProfile(Options->loadProfileFile);
+    if (!Options->benchmarkFile.empty())
+        StatsWriteBenchmark(Options->benchmarkFile, *Options->pixelSamples);
+    if (!Options->traceFile.empty())
+        StatsWriteTrace(Options->traceFile);
+#ifdef PBRT_RECORD_DISPATCH
+    if (!Options->dispatchTypesFile.empty())
+        WriteDispatchTypes(Options->dispatchTypesFile);
+#endif  // PBRT_RECORD_DISPATCH
+
     if (Options->recordPixelStatistics)
         StatsWritePixelImages();
 
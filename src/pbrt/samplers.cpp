@@ -133,7 +133,11 @@ PaddedSobolSampler *PaddedSobolSampler::Create(const ParameterDictionary &parame
 
 // ZSobolSampler Method Definitions
 Sampler ZSobolSampler::Clone(Allocator alloc) {
-    return alloc.new_object<ZSobolSampler>(*this);
+    ZSobolSampler *sampler = alloc.new_object<ZSobolSampler>(*this);
+    // Clones are used by a single thread, so they can cache pixel digits
+    sampler->prefixCache = alloc.new_object<PrefixCache>();
+    sampler->prefixCache->owner = sampler;
+    return sampler;
 }
 
 std::string ZSobolSampler::ToString() const {
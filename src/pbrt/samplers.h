@@ -86,6 +86,32 @@ class HaltonSampler {
         return {SampleDimension(dim), SampleDimension(dim + 1)};
     }
 
+    PBRT_CPU_GPU
+    void GetDimensions(pstd::span<Float> u) {
+        // Choose the randomization once for all of the dimensions
+        auto generate = [&](auto sample) {
+            for (Float &v : u) {
+                if (dimension >= PrimeTableSize)
+                    dimension = 2;
+                v = sample(dimension++);
+            }
+        };
+        if (randomize == RandomizeStrategy::None)
+            generate([&](int dim) { return RadicalInverse(dim, haltonIndex); });
+        else if (randomize == RandomizeStrategy::PermuteDigits)
+            generate([&](int dim) {
+                return ScrambledRadicalInverse(dim, haltonIndex,
+                                               (*digitPermutations)[dim]);
+            });
+        else {
+            DCHECK_EQ(randomize, RandomizeStrategy::Owen);
+            generate([&](int dim) {
+                return OwenScrambledRadicalInverse(dim, haltonIndex,
+                                                   MixBits(1 + (dim << 4)));
+            });
+        }
+    }
+
     PBRT_CPU_GPU
     Point2f GetPixel2D() {
         return {RadicalInverse(0, haltonIndex >> baseExponents[0]),
@@ -251,7 +277,14 @@ class ZSobolSampler {
     PBRT_CPU_GPU
     void StartPixelSample(Point2i p, int index, int dim) {
         dimension = dim;
-        mortonIndex = (EncodeMorton2(p.x, p.y) << log2SamplesPerPixel) | index;
+        uint64_t pixelIndex = EncodeMorton2(p.x, p.y);
+        mortonIndex = (pixelIndex << log2SamplesPerPixel) | index;
+        // Forget the cached permuted pixel digits when moving to a new pixel
+        if (prefixCache && prefixCache->owner == this &&
+            prefixCache->pixelIndex != pixelIndex) {
+            prefixCache->pixelIndex = pixelIndex;
+            prefixCache->validDimensions = 0;
+        }
     }
 
     PBRT_CPU_GPU
@@ -278,22 +311,41 @@ class ZSobolSampler {
         uint64_t bits = Hash(dimension, seed);
         uint32_t sampleHash[2] = {uint32_t(bits), uint32_t(bits >> 32)};
         if (randomize == RandomizeStrategy::None)
-            return {SobolSample(sampleIndex, 0, NoRandomizer()),
-                    SobolSample(sampleIndex, 1, NoRandomizer())};
+            return SobolSample2D(sampleIndex, NoRandomizer(), NoRandomizer());
         else if (randomize == RandomizeStrategy::PermuteDigits)
-            return {SobolSample(sampleIndex, 0, BinaryPermuteScrambler(sampleHash[0])),
-                    SobolSample(sampleIndex, 1, BinaryPermuteScrambler(sampleHash[1]))};
+            return SobolSample2D(sampleIndex, BinaryPermuteScrambler(sampleHash[0]),
+                                 BinaryPermuteScrambler(sampleHash[1]));
         else if (randomize == RandomizeStrategy::FastOwen)
-            return {SobolSample(sampleIndex, 0, FastOwenScrambler(sampleHash[0])),
-                    SobolSample(sampleIndex, 1, FastOwenScrambler(sampleHash[1]))};
+            return SobolSample2D(sampleIndex, FastOwenScrambler(sampleHash[0]),
+                                 FastOwenScrambler(sampleHash[1]));
         else
-            return {SobolSample(sampleIndex, 0, OwenScrambler(sampleHash[0])),
-                    SobolSample(sampleIndex, 1, OwenScrambler(sampleHash[1]))};
+            return SobolSample2D(sampleIndex, OwenScrambler(sampleHash[0]),
+                                 OwenScrambler(sampleHash[1]));
     }
 
     PBRT_CPU_GPU
     Point2f GetPixel2D() { return Get2D(); }
 
+    PBRT_CPU_GPU
+    void GetDimensions(pstd::span<Float> u) {
+        // Choose the randomization once for all of the dimensions
+        auto generate = [&](auto randomizer) {
+            for (Float &v : u) {
+                uint64_t sampleIndex = GetSampleIndex();
+                ++dimension;
+                v = SobolSample(sampleIndex, 0, randomizer(Hash(dimension, seed)));
+            }
+        };
+        if (randomize == RandomizeStrategy::None)
+            generate([](uint32_t) { return NoRandomizer(); });
+        else if (randomize == RandomizeStrategy::PermuteDigits)
+            generate([](uint32_t hash) { return BinaryPermuteScrambler(hash); });
+        else if (randomize == RandomizeStrategy::FastOwen)
+            generate([](uint32_t hash) { return FastOwenScrambler(hash); });
+        else
+            generate([](uint32_t hash) { return OwenScrambler(hash); });
+    }
+
     Sampler Clone(Allocator alloc);
     std::string ToString() const;
 
@@ -329,21 +381,41 @@ class ZSobolSampler {
 
         };
 
-        uint64_t sampleIndex = 0;
-        // Apply random permutations to full base-4 digits
+        // Permute the base-4 digits in [_firstDigit_, _endDigit_)
         bool pow2Samples = log2SamplesPerPixel & 1;
+        auto permuteDigits = [&](int firstDigit, int endDigit) {
+            uint64_t index = 0;
+            for (int i = endDigit - 1; i >= firstDigit; --i) {
+                // Randomly permute $i$th base-4 digit in _mortonIndex_
+                int digitShift = 2 * i - (pow2Samples ? 1 : 0);
+                int digit = (mortonIndex >> digitShift) & 3;
+                // Choose permutation _p_ to use for _digit_
+                uint64_t higherDigits = mortonIndex >> (digitShift + 2);
+                int p = (MixBits(higherDigits ^ (0x55555555u * dimension)) >> 24) % 24;
+
+                digit = permutations[p][digit];
+                index |= uint64_t(digit) << digitShift;
+            }
+            return index;
+        };
+
+        // Apply random permutations to full base-4 digits
         int lastDigit = pow2Samples ? 1 : 0;
-        for (int i = nBase4Digits - 1; i >= lastDigit; --i) {
-            // Randomly permute $i$th base-4 digit in _mortonIndex_
-            int digitShift = 2 * i - (pow2Samples ? 1 : 0);
-            int digit = (mortonIndex >> digitShift) & 3;
-            // Choose permutation _p_ to use for _digit_
-            uint64_t higherDigits = mortonIndex >> (digitShift + 2);
-            int p = (MixBits(higherDigits ^ (0x55555555u * dimension)) >> 24) % 24;
-
-            digit = permutations[p][digit];
-            sampleIndex |= uint64_t(digit) << digitShift;
-        }
+        // Digits at and above _pixelDigit_ and the digits used to choose
+        // their permutations come from the pixel's Morton index alone
+        int pixelDigit = (log2SamplesPerPixel + 1) / 2;
+        uint64_t sampleIndex = permuteDigits(lastDigit, pixelDigit);
+        if (prefixCache && prefixCache->owner == this &&
+            dimension < PrefixCache::maxDimensions) {
+            // Permute the pixel's digits once for each dimension
+            uint64_t bit = uint64_t(1) << dimension;
+            if (!(prefixCache->validDimensions & bit)) {
+                prefixCache->prefix[dimension] = permuteDigits(pixelDigit, nBase4Digits);
+                prefixCache->validDimensions |= bit;
+            }
+            sampleIndex |= prefixCache->prefix[dimension];
+        } else
+            sampleIndex |= permuteDigits(pixelDigit, nBase4Digits);
 
         // Handle power-of-2 (but not 4) sample count
         if (pow2Samples) {
@@ -356,11 +428,25 @@ class ZSobolSampler {
     }
 
   private:
+    // ZSobolSampler::PrefixCache Definition
+    // The permuted pixel digits of the sample index for the pixel that a
+    // sampler returned by Clone() is generating samples for, for each of the
+    // first _maxDimensions_ dimensions. Only the sampler that allocated the
+    // cache uses it, so that copies of that sampler don't share it.
+    struct PrefixCache {
+        static constexpr int maxDimensions = 64;
+        const ZSobolSampler *owner;
+        uint64_t pixelIndex = ~uint64_t(0);
+        uint64_t validDimensions = 0;
+        uint64_t prefix[maxDimensions];
+    };
+
     // ZSobolSampler Private Members
     RandomizeStrategy randomize;
     int seed, log2SamplesPerPixel, nBase4Digits;
     uint64_t mortonIndex;
     int dimension;
+    PrefixCache *prefixCache = nullptr;
 };
 
 // PMJ02BNSampler Definition
@@ -479,7 +565,7 @@ class IndependentSampler {
   private:
     // IndependentSampler Private Members
     int samplesPerPixel, seed;
-    RNG rng;
+    BatchRNG rng;
 };
 
 // SobolSampler Definition
@@ -799,13 +885,34 @@ PBRT_CPU_GPU inline Point2f Sampler::GetPixel2D() {
     return Dispatch(get);
 }
 
+// Samplers that can generate many dimensions more efficiently than with
+// successive Get1D() calls provide a GetDimensions() method.
+template <typename S, typename = void>
+struct SamplerHasGetDimensions : std::false_type {};
+template <typename S>
+struct SamplerHasGetDimensions<
+    S, decltype(std::declval<S &>().GetDimensions(pstd::span<Float>()))>
+    : std::true_type {};
+
+PBRT_CPU_GPU inline void Sampler::GetDimensions(pstd::span<Float> u) {
+    auto get = [&](auto ptr) {
+        using S = std::remove_pointer_t<decltype(ptr)>;
+        if constexpr (SamplerHasGetDimensions<S>::value)
+            ptr->GetDimensions(u);
+        else
+            for (Float &v : u)
+                v = ptr->Get1D();
+    };
+    return Dispatch(get);
+}
+
 // Sampler Inline Functions
 /*
     给出相机的采样点需要的信息
     注意，这里的pPixel位置是基于屏幕空间坐标，x,y是每个像素点的左下角位置
 */
 template <typename S>
-inline PBRT_CPU_GPU CameraSample GetCameraSample(S sampler, Point2i pPixel,
+inline PBRT_CPU_GPU CameraSample GetCameraSample(S &sampler, Point2i pPixel,
                                                  Filter filter) {
     // 滤波器半径内的偏移量
     FilterSample fs = filter.Sample(sampler.GetPixel2D());
@@ -830,6 +937,14 @@ inline PBRT_CPU_GPU CameraSample GetCameraSample(S sampler, Point2i pPixel,
     return cs;
 }
 
+// Generates all of a camera sample's dimensions with a single dispatch to the
+// concrete sampler
+inline PBRT_CPU_GPU CameraSample GetCameraSample(Sampler sampler, Point2i pPixel,
+                                                 Filter filter) {
+    auto get = [&](auto ptr) { return GetCameraSample(*ptr, pPixel, filter); };
+    return sampler.Dispatch(get);
+}
+
 }  // namespace pbrt
 
 #endif  // PBRT_SAMPLERS_H
@@ -0,0 +1,65 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/samplers.h>
+
+using namespace pbrt;
+
+enum class BenchSampler {
+    Halton,
+    Independent,
+    PaddedSobol,
+    ZSobol,
+    PMJ02BN,
+    Stratified,
+    Sobol
+};
+
+static Sampler CreateSampler(BenchSampler type) {
+    constexpr int spp = 64;
+    Point2i resolution(256, 256);
+    switch (type) {
+    case BenchSampler::Halton:
+        return new HaltonSampler(spp, resolution);
+    case BenchSampler::Independent:
+        return new IndependentSampler(spp);
+    case BenchSampler::PaddedSobol:
+        return new PaddedSobolSampler(spp, RandomizeStrategy::FastOwen);
+    case BenchSampler::ZSobol:
+        return new ZSobolSampler(spp, resolution, RandomizeStrategy::FastOwen);
+    case BenchSampler::PMJ02BN:
+        return new PMJ02BNSampler(spp);
+    case BenchSampler::Stratified:
+        return new StratifiedSampler(8, 8, true);
+    default:
+        return new SobolSampler(spp, resolution, RandomizeStrategy::FastOwen);
+    }
+}
+
+// Measures the cost of a pixel sample's first eight 2D sample dimensions,
+// including the call to StartPixelSample() that precedes them.
+static void Sampler_Get2D(benchmark::State &state, BenchSampler type) {
+    Sampler sampler = CreateSampler(type);
+    int64_t n = 0;
+    for (auto _ : state) {
+        Point2i pPixel(n & 255, (n >> 8) & 255);
+        sampler.StartPixelSample(pPixel, (n >> 16) % sampler.SamplesPerPixel());
+        for (int i = 0; i < 8; ++i)
+            benchmark::DoNotOptimize(sampler.Get2D());
+        ++n;
+    }
+    state.SetItemsProcessed(8 * state.iterations());
+}
+
+BENCHMARK_CAPTURE(Sampler_Get2D, Halton, BenchSampler::Halton);
+BENCHMARK_CAPTURE(Sampler_Get2D, Independent, BenchSampler::Independent);
+BENCHMARK_CAPTURE(Sampler_Get2D, PaddedSobol, BenchSampler::PaddedSobol);
+BENCHMARK_CAPTURE(Sampler_Get2D, ZSobol, BenchSampler::ZSobol);
+BENCHMARK_CAPTURE(Sampler_Get2D, PMJ02BN, BenchSampler::PMJ02BN);
+BENCHMARK_CAPTURE(Sampler_Get2D, Stratified, BenchSampler::Stratified);
+BENCHMARK_CAPTURE(Sampler_Get2D, Sobol, BenchSampler::Sobol);
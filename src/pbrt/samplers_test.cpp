@@ -194,3 +194,56 @@ TEST(ZSobolSampler, ValidIndices) {
         }
     }
 }
+
+TEST(ZSobolSampler, ClonesMatch) {
+    // Clones cache the permuted pixel digits of their sample indices; make
+    // sure that doesn't change the samples they return.
+    Point2i res(37, 20);
+    for (int logSamples = 0; logSamples <= 5; ++logSamples) {
+        int spp = 1 << logSamples;
+        for (RandomizeStrategy rand :
+             {RandomizeStrategy::PermuteDigits, RandomizeStrategy::FastOwen}) {
+            ZSobolSampler sampler(spp, res, rand);
+            Sampler clone = sampler.Clone(Allocator());
+            for (Point2i p : Bounds2i(Point2i(0, 0), res))
+                for (int i = 0; i < spp; ++i) {
+                    sampler.StartPixelSample(p, i, 0);
+                    clone.StartPixelSample(p, i);
+                    for (int d = 0; d < 40; ++d) {
+                        EXPECT_EQ(sampler.Get1D(), clone.Get1D());
+                        EXPECT_EQ(sampler.Get2D(), clone.Get2D());
+                    }
+                }
+        }
+    }
+}
+
+TEST(Sampler, GetDimensions) {
+    // GetDimensions() should return the same values as successive calls to
+    // Get1D().
+    int spp = 16;
+    Point2i resolution(10, 11);
+    std::vector<Sampler> samplers = {
+        new HaltonSampler(spp, resolution),
+        new IndependentSampler(spp),
+        new PaddedSobolSampler(spp, RandomizeStrategy::FastOwen),
+        new ZSobolSampler(spp, resolution, RandomizeStrategy::None),
+        new ZSobolSampler(spp, resolution, RandomizeStrategy::PermuteDigits),
+        new ZSobolSampler(spp, resolution, RandomizeStrategy::FastOwen),
+        new ZSobolSampler(spp, resolution, RandomizeStrategy::Owen),
+        new PMJ02BNSampler(spp),
+        new SobolSampler(spp, resolution, RandomizeStrategy::FastOwen)};
+    for (Sampler &sampler : samplers)
+        for (int s = 0; s < spp; ++s) {
+            sampler.StartPixelSample({3, 7}, s, 2);
+            Float u[10];
+            for (Float &v : u)
+                v = sampler.Get1D();
+
+            sampler.StartPixelSample({3, 7}, s, 2);
+            Float batch[10];
+            sampler.GetDimensions(batch);
+            for (int i = 0; i < 10; ++i)
+                EXPECT_EQ(u[i], batch[i]) << sampler.ToString();
+        }
+}
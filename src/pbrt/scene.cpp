@@ -14,6 +14,7 @@
 #include <pbrt/paramdict.h>
 #include <pbrt/shapes.h>
 #include <pbrt/util/args.h>
+#include <pbrt/util/buffercache.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
@@ -22,17 +23,19 @@
 #include <pbrt/util/mesh.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/spectrum.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/util/string.h>
 #include <pbrt/util/transform.h>
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <mutex>
 
 namespace pbrt {
 
-InternCache<std::string> SceneEntity::internedStrings(Allocator{});
-
 template <typename T, typename U>
 static std::string ToString(const std::map<T, U> &m) {
     std::string s = "[ ";
@@ -76,8 +79,27 @@ BasicSceneBuilder::GraphicsState::GraphicsState() {
         return;                                                    \
     } else /* swallow trailing semicolon */
 
+#define VERIFY_NOT_FRAME(func)                                                  \
+    if (isFrame) {                                                              \
+        Warning(&loc,                                                           \
+                "\"%s\" is ignored in a frame of an animation, which can only " \
+                "change cameras, object definitions, and object instances.",    \
+                func);                                                          \
+        return;                                                                 \
+    } else /* swallow trailing semicolon */
+
 STAT_COUNTER("Scene/Object instances created", nObjectInstancesCreated);
 STAT_COUNTER("Scene/Object instances used", nObjectInstancesUsed);
+STAT_COUNTER("Scene/Instance prototype primitives", nPrototypePrimitives);
+STAT_COUNTER("Scene/Instanced primitives if flattened", nFlattenedInstancePrimitives);
+STAT_COUNTER("Scene/Unused object definitions skipped", nUnusedObjectDefinitions);
+STAT_COUNTER("Scene/Empty object instances skipped", nEmptyObjectInstances);
+STAT_COUNTER("Scene/Object instances culled", nCulledObjectInstances);
+STAT_COUNTER("Scene/Shapes culled", nCulledShapes);
+STAT_COUNTER("Scene/Displaced mesh patches culled", nCulledPatches);
+STAT_COUNTER("Scene/Creation time: textures (ms)", textureCreationTimeMS);
+STAT_COUNTER("Scene/Creation time: materials (ms)", materialCreationTimeMS);
+STAT_COUNTER("Scene/Creation time: lights (ms)", lightCreationTimeMS);
 
 // BasicSceneBuilder Method Definitions
 BasicSceneBuilder::BasicSceneBuilder(BasicScene *scene)
@@ -89,19 +111,28 @@ BasicSceneBuilder::BasicSceneBuilder(BasicScene *scene)
 #endif
 {
     // Set scene defaults
-    camera.name = SceneEntity::internedStrings.Lookup("perspective");
-    sampler.name = SceneEntity::internedStrings.Lookup("zsobol");
-    filter.name = SceneEntity::internedStrings.Lookup("gaussian");
-    integrator.name = SceneEntity::internedStrings.Lookup("volpath");
-    accelerator.name = SceneEntity::internedStrings.Lookup("bvh");
+    camera.name = InternString("perspective");
+    sampler.name = InternString("zsobol");
+    filter.name = InternString("gaussian");
+    integrator.name = InternString("volpath");
+    accelerator.name = InternString("bvh");
 
-    film.name = SceneEntity::internedStrings.Lookup("rgb");
+    film.name = InternString("rgb");
     film.parameters = ParameterDictionary({}, RGBColorSpace::sRGB);
 
     ParameterDictionary dict({}, RGBColorSpace::sRGB);
     currentMaterialIndex = scene->AddMaterial(SceneEntity("diffuse", dict, {}));
 }
 
+BasicSceneBuilder::BasicSceneBuilder(BasicScene *scene,
+                                     const class Transform &renderFromWorld)
+    : BasicSceneBuilder(scene) {
+    isFrame = true;
+    this->renderFromWorld = renderFromWorld;
+    // The frame's cameras are views in the animation's rendering space
+    cameraSpecified = true;
+}
+
 void BasicSceneBuilder::ReverseOrientation(FileLoc loc) {
     VERIFY_WORLD("ReverseOrientation");
     graphicsState.reverseOrientation = !graphicsState.reverseOrientation;
@@ -144,15 +175,26 @@ void BasicSceneBuilder::Camera(const std::string &name, ParsedParameterVector pa
 
     TransformSet cameraFromWorld = graphicsState.ctm;
     TransformSet worldFromCamera = Inverse(graphicsState.ctm);
-    namedCoordinateSystems["camera"] = Inverse(cameraFromWorld);
+    AnimatedTransform worldFromCameraAnim(
+        worldFromCamera[0], graphicsState.transformStartTime, worldFromCamera[1],
+        graphicsState.transformEndTime);
+
+    if (cameraSpecified) {
+        // Add an additional view that shares the first camera's rendering space
+        CameraTransform cameraTransform(worldFromCameraAnim, Inverse(renderFromWorld));
+        cameraViews.push_back(CameraSceneEntity(name, std::move(dict), loc,
+                                                cameraTransform,
+                                                graphicsState.currentOutsideMedium));
+        return;
+    }
 
-    CameraTransform cameraTransform(
-        AnimatedTransform(worldFromCamera[0], graphicsState.transformStartTime,
-                          worldFromCamera[1], graphicsState.transformEndTime));
+    namedCoordinateSystems["camera"] = Inverse(cameraFromWorld);
+    CameraTransform cameraTransform(worldFromCameraAnim);
     renderFromWorld = cameraTransform.RenderFromWorld();
 
     camera = CameraSceneEntity(name, std::move(dict), loc, cameraTransform,
                                graphicsState.currentOutsideMedium);
+    cameraSpecified = true;
 }
 
 void BasicSceneBuilder::AttributeBegin(FileLoc loc) {
@@ -229,12 +271,17 @@ void BasicSceneBuilder::WorldBegin(FileLoc loc) {
     graphicsState.activeTransformBits = AllTransformsBits;
     namedCoordinateSystems["world"] = graphicsState.ctm;
 
-    // Pass pre-_WorldBegin_ entities to _scene_
-    scene->SetOptions(filter, film, camera, sampler, integrator, accelerator);
+    // Pass pre-_WorldBegin_ entities to _scene_; frames only have cameras
+    if (isFrame)
+        scene->SetFrameCameras(std::move(cameraViews));
+    else
+        scene->SetOptions(filter, film, camera, std::move(cameraViews), sampler,
+                          integrator, accelerator);
 }
 
 void BasicSceneBuilder::MakeNamedMedium(const std::string &origName,
                                         ParsedParameterVector params, FileLoc loc) {
+    VERIFY_NOT_FRAME("MakeNamedMedium");
     std::string name = NormalizeUTF8(origName);
     // Issue error if medium _name_ is multiply defined
     if (mediumNames.find(name) != mediumNames.end()) {
@@ -252,6 +299,7 @@ void BasicSceneBuilder::MakeNamedMedium(const std::string &origName,
 void BasicSceneBuilder::LightSource(const std::string &name, ParsedParameterVector params,
                                     FileLoc loc) {
     VERIFY_WORLD("LightSource");
+    VERIFY_NOT_FRAME("LightSource");
     ParameterDictionary dict(std::move(params), graphicsState.lightAttributes,
                              graphicsState.colorSpace);
     scene->AddLight(LightSceneEntity(name, std::move(dict), loc, RenderFromObject(),
@@ -261,6 +309,10 @@ void BasicSceneBuilder::LightSource(const std::string &name, ParsedParameterVect
 void BasicSceneBuilder::Shape(const std::string &name, ParsedParameterVector params,
                               FileLoc loc) {
     VERIFY_WORLD("Shape");
+    // Frames may only change the shapes of object definitions
+    if (!activeInstanceDefinition) {
+        VERIFY_NOT_FRAME("Shape");
+    }
 
     ParameterDictionary dict(std::move(params), graphicsState.shapeAttributes,
                              graphicsState.colorSpace);
@@ -289,8 +341,7 @@ void BasicSceneBuilder::Shape(const std::string &name, ParsedParameterVector par
         else
             scene->AddAnimatedShape(std::move(entity));
     } else {
-        const class Transform *renderFromObject =
-            transformCache.Lookup(RenderFromObject(0));
+        const class Transform *renderFromObject = RenderFromObject(0);
         const class Transform *objectFromRender =
             transformCache.Lookup(Inverse(*renderFromObject));
 
@@ -376,8 +427,10 @@ void BasicSceneBuilder::ObjectInstance(const std::string &origName, FileLoc loc)
 
     if (CTMIsAnimated()) {
         AnimatedTransform animatedRenderFromInstance(
-            RenderFromObject(0) * worldFromRender, graphicsState.transformStartTime,
-            RenderFromObject(1) * worldFromRender, graphicsState.transformEndTime);
+            renderFromWorld * graphicsState.ctm[0] * worldFromRender,
+            graphicsState.transformStartTime,
+            renderFromWorld * graphicsState.ctm[1] * worldFromRender,
+            graphicsState.transformEndTime);
 
         // For very small changes, animatedRenderFromInstance may have both
         // xforms equal even if CTMIsAnimated() has returned true. Fall
@@ -390,7 +443,8 @@ void BasicSceneBuilder::ObjectInstance(const std::string &origName, FileLoc loc)
     }
 
     const class Transform *renderFromInstance =
-        transformCache.Lookup(RenderFromObject(0) * worldFromRender);
+        LookupTransform(renderFromWorld.GetMatrix() * graphicsState.ctm[0].GetMatrix() *
+                        worldFromRender.GetMatrix());
     instanceUses.push_back(InstanceSceneEntity(name, loc, renderFromInstance));
 }
 
@@ -418,6 +472,7 @@ void BasicSceneBuilder::EndOfFiles() {
 BasicSceneBuilder *BasicSceneBuilder::CopyForImport() {
     BasicSceneBuilder *importBuilder = new BasicSceneBuilder(scene);
     importBuilder->renderFromWorld = renderFromWorld;
+    importBuilder->isFrame = isFrame;
     importBuilder->graphicsState = graphicsState;
     importBuilder->currentBlock = currentBlock;
     if (activeInstanceDefinition) {
@@ -664,6 +719,7 @@ void BasicSceneBuilder::Texture(const std::string &origName, const std::string &
                                 FileLoc loc) {
     std::string name = NormalizeUTF8(origName);
     VERIFY_WORLD("Texture");
+    VERIFY_NOT_FRAME("Texture");
 
     ParameterDictionary dict(std::move(params), graphicsState.textureAttributes,
                              graphicsState.colorSpace);
@@ -693,6 +749,7 @@ void BasicSceneBuilder::Texture(const std::string &origName, const std::string &
 void BasicSceneBuilder::Material(const std::string &name, ParsedParameterVector params,
                                  FileLoc loc) {
     VERIFY_WORLD("Material");
+    VERIFY_NOT_FRAME("Material");
 
     ParameterDictionary dict(std::move(params), graphicsState.materialAttributes,
                              graphicsState.colorSpace);
@@ -706,6 +763,7 @@ void BasicSceneBuilder::MakeNamedMaterial(const std::string &origName,
                                           ParsedParameterVector params, FileLoc loc) {
     std::string name = NormalizeUTF8(origName);
     VERIFY_WORLD("MakeNamedMaterial");
+    VERIFY_NOT_FRAME("MakeNamedMaterial");
 
     ParameterDictionary dict(std::move(params), graphicsState.materialAttributes,
                              graphicsState.colorSpace);
@@ -729,6 +787,7 @@ void BasicSceneBuilder::NamedMaterial(const std::string &origName, FileLoc loc)
 void BasicSceneBuilder::AreaLightSource(const std::string &name,
                                         ParsedParameterVector params, FileLoc loc) {
     VERIFY_WORLD("AreaLightSource");
+    VERIFY_NOT_FRAME("AreaLightSource");
     graphicsState.areaLightName = name;
     graphicsState.areaLightParams = ParameterDictionary(
         std::move(params), graphicsState.lightAttributes, graphicsState.colorSpace);
@@ -737,31 +796,22 @@ void BasicSceneBuilder::AreaLightSource(const std::string &name,
 
 // BasicScene Method Definitions
 void BasicScene::SetOptions(SceneEntity filter, SceneEntity film,
-                            CameraSceneEntity camera, SceneEntity sampler,
+                            CameraSceneEntity camera,
+                            std::vector<CameraSceneEntity> views, SceneEntity sampler,
                             SceneEntity integ, SceneEntity accel) {
     // Store information for specified integrator and accelerator
     filmColorSpace = film.parameters.ColorSpace();
     integrator = integ;
     accelerator = accel;
+    filmEntity = film;
+    this->views = std::move(views);
+    frameCamera = camera;
 
     // Immediately create filter and film
     LOG_VERBOSE("Starting to create filter and film");
     Allocator alloc = threadAllocators.Get();
-    Filter filt = Filter::Create(filter.name, filter.parameters, &filter.loc, alloc);
-
-    // It's a little ugly to poke into the camera's parameters here, but we
-    // have this circular dependency that Camera::Create() expects a
-    // Film, yet now the film needs to know the exposure time from
-    // the camera....
-    Float exposureTime = camera.parameters.GetOneFloat("shutterclose", 1.f) -
-                         camera.parameters.GetOneFloat("shutteropen", 0.f);
-    if (exposureTime <= 0)
-        ErrorExit(&camera.loc,
-                  "The specified camera shutter times imply that the shutter "
-                  "does not open.  A black image will result.");
-
-    this->film = Film::Create(film.name, film.parameters, exposureTime,
-                              camera.cameraTransform, filt, &film.loc, alloc);
+    filmFilter = Filter::Create(filter.name, filter.parameters, &filter.loc, alloc);
+    this->film = CreateFilm(camera, alloc);
     LOG_VERBOSE("Finished creating filter and film");
 
     // Enqueue asynchronous job to create sampler
@@ -786,9 +836,89 @@ void BasicScene::SetOptions(SceneEntity filter, SceneEntity film,
     });
 }
 
+Film BasicScene::CreateFilm(const CameraSceneEntity &camera, Allocator alloc) const {
+    // It's a little ugly to poke into the camera's parameters here, but we
+    // have this circular dependency that Camera::Create() expects a
+    // Film, yet now the film needs to know the exposure time from
+    // the camera....
+    Float exposureTime = camera.parameters.GetOneFloat("shutterclose", 1.f) -
+                         camera.parameters.GetOneFloat("shutteropen", 0.f);
+    if (exposureTime <= 0)
+        ErrorExit(&camera.loc,
+                  "The specified camera shutter times imply that the shutter "
+                  "does not open.  A black image will result.");
+
+    ScopedMemoryCategory memoryCategory(MemoryCategory::Film);
+    return Film::Create(filmEntity.name, filmEntity.parameters, exposureTime,
+                        camera.cameraTransform, filmFilter, &filmEntity.loc, alloc);
+}
+
+Camera BasicScene::CreateViewCamera(int view) {
+    CHECK(view >= 0 && view < views.size());
+    const CameraSceneEntity &camera = views[view];
+    LOG_VERBOSE("Starting to create camera %d", view + 2);
+    // Write the view's image to the given file or to the first film's with
+    // the camera's number appended
+    std::string filename = camera.parameters.GetOneString("filename", "");
+    if (filename.empty())
+        filename = FilmFilenameWithSuffix(StringPrintf("_%d", view + 2));
+    Camera c = CreateCameraAndFilm(camera, filename);
+    LOG_VERBOSE("Finished creating camera %d", view + 2);
+    return c;
+}
+
+void BasicScene::SetFrameCameras(std::vector<CameraSceneEntity> cameras) {
+    views = std::move(cameras);
+}
+
+Camera BasicScene::CreateFrameCamera(const BasicScene &frame, int frameNumber) {
+    // Frames without a camera use the previous frame's
+    std::string filename;
+    if (!frame.views.empty()) {
+        if (frame.views.size() > 1)
+            Warning(&frame.views[1].loc, "Only the first camera of each frame of an "
+                                         "animation is rendered.");
+        frameCamera = frame.views[0];
+        filename = frameCamera.parameters.GetOneString("filename", "");
+    }
+    // Write the frame's image to the given file or to the first film's with
+    // the frame number appended
+    if (filename.empty())
+        filename = FilmFilenameWithSuffix(StringPrintf("_%04d", frameNumber));
+    return CreateCameraAndFilm(frameCamera, filename);
+}
+
+std::string BasicScene::FilmFilenameWithSuffix(const std::string &suffix) const {
+    std::string filename = film.GetFilename();
+    std::string stem = RemoveExtension(filename);
+    return stem + suffix + filename.substr(stem.size());
+}
+
+Camera BasicScene::CreateCameraAndFilm(const CameraSceneEntity &camera,
+                                       const std::string &filename) {
+    // Allocate the camera's film so that its pixels can be freed afterward,
+    // which the scene's allocators don't do
+    Allocator alloc;
+    Film cameraFilm = CreateFilm(camera, alloc);
+    cameraFilm.SetFilename(filename);
+
+    Medium cameraMedium = GetMedium(camera.medium, &camera.loc);
+    return Camera::Create(camera.name, camera.parameters, cameraMedium,
+                          camera.cameraTransform, cameraFilm, &camera.loc, alloc);
+}
+
+void BasicScene::ReleaseViewCamera(Camera camera) {
+    Film viewFilm = camera.GetFilm();
+    auto freeObject = [](auto ptr) { Allocator().delete_object(ptr); };
+    viewFilm.DispatchCPU(freeObject);
+    camera.DispatchCPU(freeObject);
+}
+
 void BasicScene::AddMedium(MediumSceneEntity medium) {
     // Define _create_ lambda function for _Medium_ creation
     auto create = [medium, this]() {
+        LoadProfileScope _("Create medium", (const std::string &)medium.name);
+        ScopedMemoryCategory memoryCategory(MemoryCategory::Media);
         std::string type = medium.parameters.GetOneString("type", "");
         // Check for missing medium ``type'' or animated medium transform
         if (type.empty())
@@ -833,6 +963,8 @@ Medium BasicScene::GetMedium(const std::string &name, const FileLoc *loc) {
 }
 
 std::map<std::string, Medium> BasicScene::CreateMedia() {
+    LoadProfileScope _("Create media");
+    ScopedMemoryCategory memoryCategory(MemoryCategory::Media);
     mediaMutex.lock();
     if (!mediumJobs.empty()) {
         // Consume results for asynchronously-created _Medium_ objects
@@ -883,6 +1015,14 @@ int BasicScene::AddMaterial(SceneEntity material) {
     return int(materials.size() - 1);
 }
 
+// Starts reading an image file on an I/O thread if Image::Read() will use
+// its prefetched contents; returns the job to wait for, if there is one.
+static AsyncJobBase *PrefetchImage(const std::string &filename) {
+    if (!Image::ReadsFileContents(filename))
+        return nullptr;
+    return PrefetchFileContents(filename);
+}
+
 void BasicScene::startLoadingNormalMaps(const ParameterDictionary &parameters) {
     std::string filename = ResolveFilename(parameters.GetOneString("normalmap", ""));
     if (filename.empty())
@@ -906,7 +1046,7 @@ void BasicScene::startLoadingNormalMaps(const ParameterDictionary &parameters) {
 
         return normalMap;
     };
-    normalMapJobs[filename] = RunAsync(create, filename);
+    normalMapJobs[filename] = RunAsyncAfter({PrefetchImage(filename)}, create, filename);
 }
 
 void BasicScene::AddFloatTexture(std::string name, TextureSceneEntity texture) {
@@ -928,7 +1068,8 @@ void BasicScene::AddFloatTexture(std::string name, TextureSceneEntity texture) {
         ++nMissingTextures;
         return;
     }
-    if (!FileExists(filename)) {
+    // UDIM textures check for their tiles when they are created
+    if (!IsUDIMFilename(filename) && !FileExists(filename)) {
         Error(&texture.loc, "%s: file not found.", filename);
         ++nMissingTextures;
         return;
@@ -942,6 +1083,8 @@ void BasicScene::AddFloatTexture(std::string name, TextureSceneEntity texture) {
     loadingTextureFilenames.insert(filename);
 
     auto create = [=](TextureSceneEntity texture) {
+        LoadProfileScope _("Create texture", name);
+        ScopedMemoryCategory memoryCategory(MemoryCategory::Textures);
         Allocator alloc = threadAllocators.Get();
 
         pbrt::Transform renderFromTexture = texture.renderFromObject.startTransform;
@@ -951,7 +1094,13 @@ void BasicScene::AddFloatTexture(std::string name, TextureSceneEntity texture) {
         return FloatTexture::Create(texture.name, renderFromTexture, texDict,
                                     &texture.loc, alloc, Options->useGPU);
     };
-    floatTextureJobs[name] = RunAsync(create, texture);
+    // Image maps are decoded once their files have been read so that
+    // threads in the thread pool don't wait on file I/O.
+    AsyncJobBase *readJob =
+        (texture.name == "imagemap" && !IsUDIMFilename(filename))
+            ? PrefetchImage(filename)
+            : nullptr;
+    floatTextureJobs[name] = RunAsyncAfter({readJob}, create, texture);
 }
 
 void BasicScene::AddSpectrumTexture(std::string name, TextureSceneEntity texture) {
@@ -970,7 +1119,8 @@ void BasicScene::AddSpectrumTexture(std::string name, TextureSceneEntity texture
         ++nMissingTextures;
         return;
     }
-    if (!FileExists(filename)) {
+    // UDIM textures check for their tiles when they are created
+    if (!IsUDIMFilename(filename) && !FileExists(filename)) {
         Error(&texture.loc, "%s: file not found.", filename);
         ++nMissingTextures;
         return;
@@ -986,6 +1136,8 @@ void BasicScene::AddSpectrumTexture(std::string name, TextureSceneEntity texture
     asyncSpectrumTextures.push_back(std::make_pair(name, texture));
 
     auto create = [=](TextureSceneEntity texture) {
+        LoadProfileScope _("Create texture", name);
+        ScopedMemoryCategory memoryCategory(MemoryCategory::Textures);
         Allocator alloc = threadAllocators.Get();
 
         pbrt::Transform renderFromTexture = texture.renderFromObject.startTransform;
@@ -997,24 +1149,68 @@ void BasicScene::AddSpectrumTexture(std::string name, TextureSceneEntity texture
                                        SpectrumType::Albedo, &texture.loc, alloc,
                                        Options->useGPU);
     };
-    spectrumTextureJobs[name] = RunAsync(create, texture);
+    AsyncJobBase *readJob =
+        (texture.name == "imagemap" && !IsUDIMFilename(filename))
+            ? PrefetchImage(filename)
+            : nullptr;
+    spectrumTextureJobs[name] = RunAsyncAfter({readJob}, create, texture);
 }
 
 void BasicScene::AddLight(LightSceneEntity light) {
-    Medium lightMedium = GetMedium(light.medium, &light.loc);
+    // Find the light's medium, or the job that is creating it
+    Medium lightMedium = nullptr;
+    AsyncJob<Medium> *mediumJob = nullptr;
+    if (!light.medium.empty()) {
+        std::lock_guard<std::mutex> lock(mediaMutex);
+        if (auto iter = mediaMap.find(light.medium); iter != mediaMap.end())
+            lightMedium = iter->second;
+        else if (auto jobIter = mediumJobs.find(light.medium);
+                 jobIter != mediumJobs.end())
+            mediumJob = jobIter->second;
+        else
+            ErrorExit(&light.loc, "%s: medium is not defined.", light.medium);
+    }
+
     std::lock_guard<std::mutex> lock(lightMutex);
 
     if (light.renderFromObject.IsAnimated())
         Warning(&light.loc,
                 "Animated lights aren't supported. Using the start transform.");
 
-    auto create = [this, light, lightMedium]() {
+    auto create = [this, light, lightMedium, mediumJob]() {
+        LoadProfileScope _("Create light", &light.loc);
+        ScopedMemoryCategory memoryCategory(MemoryCategory::Lights);
+        Medium medium = mediumJob ? mediumJob->GetResult() : lightMedium;
         return Light::Create(light.name, light.parameters,
                              light.renderFromObject.startTransform,
-                             GetCamera().GetCameraTransform(), lightMedium, &light.loc,
+                             GetCamera().GetCameraTransform(), medium, &light.loc,
                              threadAllocators.Get());
     };
-    lightJobs.push_back(RunAsync(create));
+    // Start creating the light once the camera and medium are available so
+    // that neither the parser nor a worker thread waits for them
+    lightJobs.push_back(RunAsyncAfter({cameraJob, mediumJob}, create));
+    lightFilenames.insert(std::string(light.loc.filename));
+}
+
+std::set<std::string> BasicScene::MaterialAndLightFilenames() {
+    std::set<std::string> filenames;
+    {
+        std::lock_guard<std::mutex> lock(materialMutex);
+        for (const auto &mtl : namedMaterials)
+            filenames.insert(std::string(mtl.second.loc.filename));
+        for (const auto &mtl : materials)
+            filenames.insert(std::string(mtl.loc.filename));
+    }
+    {
+        std::lock_guard<std::mutex> lock(textureMutex);
+        for (const auto *textures :
+             {&serialFloatTextures, &serialSpectrumTextures, &asyncSpectrumTextures})
+            for (const auto &tex : *textures)
+                filenames.insert(std::string(tex.second.loc.filename));
+    }
+    std::lock_guard<std::mutex> lock(lightMutex);
+    filenames.insert(lightFilenames.begin(), lightFilenames.end());
+    return filenames;
 }
 
 int BasicScene::AddAreaLight(SceneEntity light) {
@@ -1107,9 +1303,40 @@ void BasicScene::Done() {
 #endif
 }
 
+// Groups entities [0, n) into levels whose entities can be created in
+// parallel once all previous levels have been created. An entity's level is
+// one more than that of the earlier entities with names that its parameters
+// refer to; _isReference_ selects the parameters that hold such names.
+template <typename Entity, typename F>
+static std::vector<std::vector<int>> DependencyLevels(
+    const std::vector<std::pair<std::string, Entity>> &entities, F isReference) {
+    std::map<std::string, int> nameToIndex;
+    for (int i = 0; i < int(entities.size()); ++i)
+        nameToIndex[entities[i].first] = i;
+
+    std::vector<int> level(entities.size(), 0);
+    std::vector<std::vector<int>> levels;
+    for (int i = 0; i < int(entities.size()); ++i) {
+        for (const ParsedParameter *p :
+             entities[i].second.parameters.GetParameterVector()) {
+            if (!isReference(*p))
+                continue;
+            for (const std::string &name : p->strings)
+                if (auto iter = nameToIndex.find(name);
+                    iter != nameToIndex.end() && iter->second < i)
+                    level[i] = std::max(level[i], level[iter->second] + 1);
+        }
+        if (level[i] == int(levels.size()))
+            levels.push_back({});
+        levels[level[i]].push_back(i);
+    }
+    return levels;
+}
+
 void BasicScene::CreateMaterials(const NamedTextures &textures,
                                  std::map<std::string, pbrt::Material> *namedMaterialsOut,
                                  std::vector<pbrt::Material> *materialsOut) {
+    LoadProfileScope _("Create materials");
     LOG_VERBOSE("Starting to consume %d normal map futures", normalMapJobs.size());
     std::lock_guard<std::mutex> lock(materialMutex);
     for (auto &job : normalMapJobs) {
@@ -1119,58 +1346,66 @@ void BasicScene::CreateMaterials(const NamedTextures &textures,
     normalMapJobs.clear();
     LOG_VERBOSE("Finished consuming normal map futures");
 
+    Timer timer;
+    auto getNormalMap = [this](const ParameterDictionary &parameters) -> Image * {
+        std::string fn = ResolveFilename(parameters.GetOneString("normalmap", ""));
+        if (fn.empty())
+            return nullptr;
+        auto iter = normalMaps.find(fn);
+        CHECK(iter != normalMaps.end());
+        return iter->second;
+    };
+
     // Named materials
     for (const auto &nm : namedMaterials) {
-        const std::string &name = nm.first;
-        const SceneEntity &mtl = nm.second;
-        Allocator alloc = threadAllocators.Get();
-
-        if (namedMaterialsOut->find(name) != namedMaterialsOut->end()) {
-            ErrorExit(&mtl.loc, "%s: trying to redefine named material.", name);
-            continue;
-        }
-
-        std::string type = mtl.parameters.GetOneString("type", "");
-        if (type.empty()) {
-            ErrorExit(&mtl.loc,
+        if (namedMaterialsOut->find(nm.first) != namedMaterialsOut->end())
+            ErrorExit(&nm.second.loc, "%s: trying to redefine named material.",
+                      nm.first);
+        if (nm.second.parameters.GetOneString("type", "").empty())
+            ErrorExit(&nm.second.loc,
                       "%s: \"string type\" not provided in named material's parameters.",
-                      name);
-            continue;
-        }
-
-        std::string fn =
-            ResolveFilename(nm.second.parameters.GetOneString("normalmap", ""));
-        Image *normalMap = nullptr;
-        if (!fn.empty()) {
-            CHECK(normalMaps.find(fn) != normalMaps.end());
-            normalMap = normalMaps[fn];
-        }
+                      nm.first);
+    }
 
-        TextureParameterDictionary texDict(&mtl.parameters, &textures);
-        class Material m = Material::Create(type, texDict, normalMap, *namedMaterialsOut,
-                                            &mtl.loc, alloc);
-        (*namedMaterialsOut)[name] = m;
+    // Create named materials in parallel after the ones that they mix
+    std::vector<class Material> namedMtls(namedMaterials.size());
+    auto isMaterialReference = [](const ParsedParameter &p) {
+        return p.type == "string" && p.name == "materials";
+    };
+    for (const std::vector<int> &level :
+         DependencyLevels(namedMaterials, isMaterialReference)) {
+        ParallelFor(0, level.size(), [&](int64_t i) {
+            const SceneEntity &mtl = namedMaterials[level[i]].second;
+            LoadProfileScope _("Create material", namedMaterials[level[i]].first);
+            Allocator alloc = threadAllocators.Get();
+            std::string type = mtl.parameters.GetOneString("type", "");
+            TextureParameterDictionary texDict(&mtl.parameters, &textures);
+            namedMtls[level[i]] =
+                Material::Create(type, texDict, getNormalMap(mtl.parameters),
+                                 *namedMaterialsOut, &mtl.loc, alloc);
+        });
+        for (int i : level)
+            (*namedMaterialsOut)[namedMaterials[i].first] = namedMtls[i];
     }
 
     // Regular materials
-    materialsOut->reserve(materials.size());
-    for (const auto &mtl : materials) {
+    materialsOut->resize(materials.size());
+    ParallelFor(0, materials.size(), [&](int64_t i) {
+        const SceneEntity &mtl = materials[i];
+        LoadProfileScope _("Create material", &mtl.loc);
         Allocator alloc = threadAllocators.Get();
-        std::string fn = ResolveFilename(mtl.parameters.GetOneString("normalmap", ""));
-        Image *normalMap = nullptr;
-        if (!fn.empty()) {
-            CHECK(normalMaps.find(fn) != normalMaps.end());
-            normalMap = normalMaps[fn];
-        }
-
         TextureParameterDictionary texDict(&mtl.parameters, &textures);
-        class Material m = Material::Create(mtl.name, texDict, normalMap,
-                                            *namedMaterialsOut, &mtl.loc, alloc);
-        materialsOut->push_back(m);
-    }
+        (*materialsOut)[i] =
+            Material::Create(mtl.name, texDict, getNormalMap(mtl.parameters),
+                             *namedMaterialsOut, &mtl.loc, alloc);
+    });
+
+    materialCreationTimeMS += int64_t(1000 * timer.ElapsedSeconds());
 }
 
 NamedTextures BasicScene::CreateTextures() {
+    LoadProfileScope _("Create textures");
+    ScopedMemoryCategory memoryCategory(MemoryCategory::Textures);
     NamedTextures textures;
 
     if (nMissingTextures > 0)
@@ -1192,61 +1427,88 @@ NamedTextures BasicScene::CreateTextures() {
     LOG_VERBOSE("Finished consuming texture futures");
 
     LOG_VERBOSE("Starting to create remaining textures");
-    Allocator alloc = threadAllocators.Get();
+    Timer timer;
     // Create the other SpectrumTypes for the spectrum textures.
-    for (const auto &tex : asyncSpectrumTextures) {
-        pbrt::Transform renderFromTexture = tex.second.renderFromObject.startTransform;
+    std::vector<SpectrumTexture> unboundedTextures(asyncSpectrumTextures.size());
+    std::vector<SpectrumTexture> illuminantTextures(asyncSpectrumTextures.size());
+    ParallelFor(0, asyncSpectrumTextures.size(), [&](int64_t i) {
+        const TextureSceneEntity &tex = asyncSpectrumTextures[i].second;
+        LoadProfileScope _("Create texture", asyncSpectrumTextures[i].first);
+        Allocator alloc = threadAllocators.Get();
+        pbrt::Transform renderFromTexture = tex.renderFromObject.startTransform;
         // These are all image textures, so nullptr is fine for the
         // textures, as earlier.
-        TextureParameterDictionary texDict(&tex.second.parameters, nullptr);
+        TextureParameterDictionary texDict(&tex.parameters, nullptr);
 
         // These should be fast since they should hit the texture cache
-        SpectrumTexture unboundedTex = SpectrumTexture::Create(
-            tex.second.name, renderFromTexture, texDict, SpectrumType::Unbounded,
-            &tex.second.loc, alloc, Options->useGPU);
-        SpectrumTexture illumTex = SpectrumTexture::Create(
-            tex.second.name, renderFromTexture, texDict, SpectrumType::Illuminant,
-            &tex.second.loc, alloc, Options->useGPU);
-
-        textures.unboundedSpectrumTextures[tex.first] = unboundedTex;
-        textures.illuminantSpectrumTextures[tex.first] = illumTex;
+        unboundedTextures[i] = SpectrumTexture::Create(
+            tex.name, renderFromTexture, texDict, SpectrumType::Unbounded, &tex.loc,
+            alloc, Options->useGPU);
+        illuminantTextures[i] = SpectrumTexture::Create(
+            tex.name, renderFromTexture, texDict, SpectrumType::Illuminant, &tex.loc,
+            alloc, Options->useGPU);
+    });
+    for (size_t i = 0; i < asyncSpectrumTextures.size(); ++i) {
+        const std::string &name = asyncSpectrumTextures[i].first;
+        textures.unboundedSpectrumTextures[name] = unboundedTextures[i];
+        textures.illuminantSpectrumTextures[name] = illuminantTextures[i];
     }
 
-    // And do the rest serially
-    for (auto &tex : serialFloatTextures) {
-        Allocator alloc = threadAllocators.Get();
-
-        pbrt::Transform renderFromTexture = tex.second.renderFromObject.startTransform;
-        TextureParameterDictionary texDict(&tex.second.parameters, &textures);
-        FloatTexture t = FloatTexture::Create(tex.second.name, renderFromTexture, texDict,
-                                              &tex.second.loc, alloc, Options->useGPU);
-        textures.floatTextures[tex.first] = t;
+    // Create the rest in parallel after the textures that they refer to
+    auto isTextureReference = [](const ParsedParameter &p) {
+        return p.type == "texture";
+    };
+    std::vector<FloatTexture> floatTextures(serialFloatTextures.size());
+    for (const std::vector<int> &level :
+         DependencyLevels(serialFloatTextures, isTextureReference)) {
+        ParallelFor(0, level.size(), [&](int64_t i) {
+            const TextureSceneEntity &tex = serialFloatTextures[level[i]].second;
+            LoadProfileScope _("Create texture", serialFloatTextures[level[i]].first);
+            Allocator alloc = threadAllocators.Get();
+            pbrt::Transform renderFromTexture = tex.renderFromObject.startTransform;
+            TextureParameterDictionary texDict(&tex.parameters, &textures);
+            floatTextures[level[i]] = FloatTexture::Create(
+                tex.name, renderFromTexture, texDict, &tex.loc, alloc, Options->useGPU);
+        });
+        for (int i : level)
+            textures.floatTextures[serialFloatTextures[i].first] = floatTextures[i];
     }
 
-    for (auto &tex : serialSpectrumTextures) {
-        Allocator alloc = threadAllocators.Get();
-
-        if (tex.second.renderFromObject.IsAnimated())
-            Warning(&tex.second.loc, "Animated world to texture transform not supported. "
-                                     "Using start transform.");
-
-        pbrt::Transform renderFromTexture = tex.second.renderFromObject.startTransform;
-        TextureParameterDictionary texDict(&tex.second.parameters, &textures);
-        SpectrumTexture albedoTex = SpectrumTexture::Create(
-            tex.second.name, renderFromTexture, texDict, SpectrumType::Albedo,
-            &tex.second.loc, alloc, Options->useGPU);
-        SpectrumTexture unboundedTex = SpectrumTexture::Create(
-            tex.second.name, renderFromTexture, texDict, SpectrumType::Unbounded,
-            &tex.second.loc, alloc, Options->useGPU);
-        SpectrumTexture illumTex = SpectrumTexture::Create(
-            tex.second.name, renderFromTexture, texDict, SpectrumType::Illuminant,
-            &tex.second.loc, alloc, Options->useGPU);
-
-        textures.albedoSpectrumTextures[tex.first] = albedoTex;
-        textures.unboundedSpectrumTextures[tex.first] = unboundedTex;
-        textures.illuminantSpectrumTextures[tex.first] = illumTex;
+    std::vector<SpectrumTexture> albedoTextures(serialSpectrumTextures.size());
+    unboundedTextures.assign(serialSpectrumTextures.size(), nullptr);
+    illuminantTextures.assign(serialSpectrumTextures.size(), nullptr);
+    for (const std::vector<int> &level :
+         DependencyLevels(serialSpectrumTextures, isTextureReference)) {
+        ParallelFor(0, level.size(), [&](int64_t i) {
+            const TextureSceneEntity &tex = serialSpectrumTextures[level[i]].second;
+            LoadProfileScope _("Create texture", serialSpectrumTextures[level[i]].first);
+            Allocator alloc = threadAllocators.Get();
+
+            if (tex.renderFromObject.IsAnimated())
+                Warning(&tex.loc, "Animated world to texture transform not supported. "
+                                  "Using start transform.");
+
+            pbrt::Transform renderFromTexture = tex.renderFromObject.startTransform;
+            TextureParameterDictionary texDict(&tex.parameters, &textures);
+            albedoTextures[level[i]] = SpectrumTexture::Create(
+                tex.name, renderFromTexture, texDict, SpectrumType::Albedo, &tex.loc,
+                alloc, Options->useGPU);
+            unboundedTextures[level[i]] = SpectrumTexture::Create(
+                tex.name, renderFromTexture, texDict, SpectrumType::Unbounded, &tex.loc,
+                alloc, Options->useGPU);
+            illuminantTextures[level[i]] = SpectrumTexture::Create(
+                tex.name, renderFromTexture, texDict, SpectrumType::Illuminant, &tex.loc,
+                alloc, Options->useGPU);
+        });
+        for (int i : level) {
+            const std::string &name = serialSpectrumTextures[i].first;
+            textures.albedoSpectrumTextures[name] = albedoTextures[i];
+            textures.unboundedSpectrumTextures[name] = unboundedTextures[i];
+            textures.illuminantSpectrumTextures[name] = illuminantTextures[i];
+        }
     }
 
+    textureCreationTimeMS += int64_t(1000 * timer.ElapsedSeconds());
     LOG_VERBOSE("Done creating textures");
     return textures;
 }
@@ -1254,6 +1516,8 @@ NamedTextures BasicScene::CreateTextures() {
 std::vector<Light> BasicScene::CreateLights(
     const NamedTextures &textures,
     std::map<int, pstd::vector<Light> *> *shapeIndexToAreaLights) {
+    LoadProfileScope _("Create lights");
+    ScopedMemoryCategory memoryCategory(MemoryCategory::Lights);
     auto findMedium = [this](const std::string &s, const FileLoc *loc) -> Medium {
         if (s.empty())
             return nullptr;
@@ -1264,10 +1528,8 @@ std::vector<Light> BasicScene::CreateLights(
         return iter->second;
     };
 
-    Allocator alloc = threadAllocators.Get();
-
     auto getAlphaTexture = [&](const ParameterDictionary &parameters,
-                               const FileLoc *loc) -> FloatTexture {
+                               const FileLoc *loc, Allocator alloc) -> FloatTexture {
         std::string alphaTexName = parameters.GetTexture("alpha");
         if (!alphaTexName.empty()) {
             if (auto iter = textures.floatTextures.find(alphaTexName);
@@ -1287,13 +1549,18 @@ std::vector<Light> BasicScene::CreateLights(
     };
 
     LOG_VERBOSE("Starting area lights");
-    std::vector<Light> lights;
+    Timer timer;
     // Area Lights
-    for (size_t i = 0; i < shapes.size(); ++i) {
-        const auto &sh = shapes[i];
-
-        if (sh.lightIndex == -1)
-            continue;
+    std::vector<int> emissiveShapes;
+    for (size_t i = 0; i < shapes.size(); ++i)
+        if (shapes[i].lightIndex != -1)
+            emissiveShapes.push_back(i);
+
+    std::vector<pstd::vector<Light> *> areaLightsForShape(emissiveShapes.size(), nullptr);
+    ParallelFor(0, emissiveShapes.size(), [&](int64_t index) {
+        const auto &sh = shapes[emissiveShapes[index]];
+        LoadProfileScope _("Create area light", &sh.loc);
+        Allocator alloc = threadAllocators.Get();
 
         std::string materialName;
         if (!sh.materialName.empty()) {
@@ -1311,14 +1578,14 @@ std::vector<Light> BasicScene::CreateLights(
         if (materialName == "interface" || materialName == "none" || materialName == "") {
             Warning(&sh.loc, "Ignoring area light specification for shape "
                              "with \"interface\" material.");
-            continue;
+            return;
         }
 
         pstd::vector<pbrt::Shape> shapeObjects = Shape::Create(
             sh.name, sh.renderFromObject, sh.objectFromRender, sh.reverseOrientation,
             sh.parameters, textures.floatTextures, &sh.loc, alloc);
 
-        FloatTexture alphaTex = getAlphaTexture(sh.parameters, &sh.loc);
+        FloatTexture alphaTex = getAlphaTexture(sh.parameters, &sh.loc, alloc);
 
         pbrt::MediumInterface mi(findMedium(sh.insideMedium, &sh.loc),
                                  findMedium(sh.outsideMedium, &sh.loc));
@@ -1329,15 +1596,21 @@ std::vector<Light> BasicScene::CreateLights(
             Light area = Light::CreateArea(
                 areaLightEntity.name, areaLightEntity.parameters, *sh.renderFromObject,
                 mi, ps, alphaTex, &areaLightEntity.loc, alloc);
-            if (area) {
-                lights.push_back(area);
+            if (area)
                 shapeLights->push_back(area);
-            }
         }
 
-        (*shapeIndexToAreaLights)[i] = shapeLights;
-    }
+        areaLightsForShape[index] = shapeLights;
+    });
 
+    std::vector<Light> lights;
+    for (size_t i = 0; i < emissiveShapes.size(); ++i) {
+        if (!areaLightsForShape[i])
+            continue;
+        lights.insert(lights.end(), areaLightsForShape[i]->begin(),
+                      areaLightsForShape[i]->end());
+        (*shapeIndexToAreaLights)[emissiveShapes[i]] = areaLightsForShape[i];
+    }
     LOG_VERBOSE("Finished area lights");
 
     LOG_VERBOSE("Starting to consume non-area light futures");
@@ -1346,15 +1619,101 @@ std::vector<Light> BasicScene::CreateLights(
         lights.push_back(job->GetResult());
     LOG_VERBOSE("Finished consuming non-area light futures");
 
+    lightCreationTimeMS += int64_t(1000 * timer.ElapsedSeconds());
     return lights;
 }
 
+// BVHs of objects whose meshes change between frames are rebuilt if refitting
+// them increases their SAH cost by more than this factor.
+static constexpr Float MaxRefitCostRatio = 2;
+
+// BasicScene::FrameSequence Definition
+// The parts of the scene's aggregate that ApplyFrame() updates for the frames
+// of an animation: the BVHs and meshes of the instance definitions and their
+// uses. Each frame's aggregate is a BVH over the accelerator for the scene's
+// shapes, which doesn't change, and the frame's instances.
+struct BasicScene::FrameSequence {
+    // FrameSequence::Object Definition
+    struct Object {
+        void AddUse(const InstanceSceneEntity &inst) {
+            if (inst.renderFromInstance)
+                renderFromInstance.push_back(*inst.renderFromInstance);
+            else
+                animatedRenderFromInstance.push_back(*inst.renderFromInstanceAnim);
+        }
+        void ClearUses() {
+            renderFromInstance.clear();
+            animatedRenderFromInstance.clear();
+        }
+
+        Primitive prototype;
+        // Triangle mesh that each of the object's shapes was created from, or -1
+        std::vector<int> meshIndices;
+        // Memory for the meshes that have replaced the original ones
+        std::vector<std::unique_ptr<pstd::pmr::monotonic_buffer_resource>> frameMemory;
+        std::vector<Transform> renderFromInstance;
+        std::vector<AnimatedTransform> animatedRenderFromInstance;
+    };
+
+    Primitive CreateAggregate() {
+        // Create primitives for the objects' current instances
+        std::vector<Primitive> prototypes;
+        std::vector<InstanceBVHAggregate::Instance> staticInstances;
+        for (const auto &obj : objects) {
+            const Object &object = obj.second;
+            if (!object.prototype)
+                continue;
+            if (!object.renderFromInstance.empty()) {
+                uint32_t prototypeIndex = prototypes.size();
+                prototypes.push_back(object.prototype);
+                for (const Transform &renderFromInstance : object.renderFromInstance)
+                    staticInstances.push_back({&renderFromInstance, prototypeIndex});
+            }
+            for (const AnimatedTransform &t : object.animatedRenderFromInstance)
+                instancePrimitives.push_back(new AnimatedPrimitive(object.prototype, t));
+        }
+        if (!staticInstances.empty())
+            instancePrimitives.push_back(new InstanceBVHAggregate(
+                std::move(prototypes), std::move(staticInstances)));
+
+        std::vector<Primitive> primitives = instancePrimitives;
+        if (shapesAggregate)
+            primitives.push_back(shapesAggregate);
+        if (primitives.empty())
+            return nullptr;
+        if (primitives.size() == 1)
+            return primitives[0];
+        aggregate = new BVHAggregate(std::move(primitives));
+        return aggregate;
+    }
+
+    void FreeAggregate() {
+        delete aggregate;
+        aggregate = nullptr;
+        for (Primitive prim : instancePrimitives) {
+            if (prim.Is<InstanceBVHAggregate>())
+                delete prim.Cast<InstanceBVHAggregate>();
+            else
+                delete prim.Cast<AnimatedPrimitive>();
+        }
+        instancePrimitives.clear();
+    }
+
+    std::map<InternedString, Object> objects;
+    Primitive shapesAggregate;
+    // The current frame's primitives for instances and its aggregate
+    std::vector<Primitive> instancePrimitives;
+    BVHAggregate *aggregate = nullptr;
+};
+
 Primitive BasicScene::CreateAggregate(
     const NamedTextures &textures,
     const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
     const std::map<std::string, Medium> &media,
     const std::map<std::string, pbrt::Material> &namedMaterials,
     const std::vector<pbrt::Material> &materials) {
+    LoadProfileScope _("Create aggregate");
+    ScopedMemoryCategory memoryCategory(MemoryCategory::Geometry);
     Allocator alloc;
     auto findMedium = [&media](const std::string &s, const FileLoc *loc) -> Medium {
         if (s.empty())
@@ -1384,27 +1743,102 @@ Primitive BasicScene::CreateAggregate(
     };
 
     // Non-animated shapes
+    std::shared_ptr<const std::map<std::string, FloatTexture>> lazyFloatTextures;
+    if (Options->lazyShapes) {
+        // Lazily-created shapes may need textures for displacement after
+        // _textures_ is no longer available
+        lazyFloatTextures = std::make_shared<const std::map<std::string, FloatTexture>>(
+            textures.floatTextures);
+    }
+    // The budget also covers displaced mesh patches, which are always lazy
+    LazyPrimitive::SetMemoryBudget(size_t(Options->lazyShapeMemoryMB) << 20);
+
+    // Find the culling volumes given by the accelerator's "cullbounds"
+    // parameter as pairs of world-space corners; geometry that doesn't overlap
+    // any of them is left out of the scene.
+    std::vector<Bounds3f> cullVolumes;
+    std::vector<Float> cullBounds = accelerator.parameters.GetFloatArray("cullbounds");
+    if (cullBounds.size() % 6 != 0)
+        ErrorExit(&accelerator.loc, "\"cullbounds\" must have a multiple of six values.");
+    if (!cullBounds.empty()) {
+        Transform renderFromWorld = GetCamera().GetCameraTransform().RenderFromWorld();
+        for (size_t i = 0; i < cullBounds.size(); i += 6) {
+            Point3f p0(cullBounds[i], cullBounds[i + 1], cullBounds[i + 2]);
+            Point3f p1(cullBounds[i + 3], cullBounds[i + 4], cullBounds[i + 5]);
+            cullVolumes.push_back(renderFromWorld(Bounds3f(p0, p1)));
+        }
+    }
+    auto culled = [&](const Bounds3f &bounds) {
+        return !cullVolumes.empty() &&
+               std::none_of(cullVolumes.begin(), cullVolumes.end(),
+                            [&](const Bounds3f &v) { return Overlaps(v, bounds); });
+    };
+
+    // If _meshIndices_ is provided, it returns the index of the triangle mesh
+    // that each shape was created from, or -1 for other shapes. If _cull_ is
+    // true, shapes outside of the culling volumes are skipped; shapes with area
+    // lights are always kept, since their lights have already been created.
     auto CreatePrimitivesForShapes =
-        [&](std::vector<ShapeSceneEntity> &shapes) -> std::vector<Primitive> {
+        [&](std::vector<ShapeSceneEntity> &shapes, bool allowLazy, bool cull,
+            std::vector<int> *meshIndices = nullptr) -> std::vector<Primitive> {
+        cull = cull && !cullVolumes.empty();
+        // Shapes that aren't emissive may be created lazily
+        std::vector<bool> lazy(shapes.size());
+        for (size_t i = 0; i < shapes.size(); ++i)
+            lazy[i] = allowLazy && Options->lazyShapes && shapes[i].lightIndex == -1;
+
         // Parallelize Shape::Create calls, which will in turn
         // parallelize PLY file loading, etc...
         pstd::vector<pstd::vector<pbrt::Shape>> shapeVectors(shapes.size());
+        std::vector<std::vector<DisplacedMeshPatch>> patchVectors(shapes.size());
+        std::vector<Bounds3f> shapeBounds(cull ? shapes.size() : 0);
         ParallelFor(0, shapes.size(), [&](int64_t i) {
             const auto &sh = shapes[i];
+            // Displaced meshes are split into patches that are each
+            // displaced when first hit
+            if (sh.lightIndex == -1) {
+                patchVectors[i] = CreateDisplacedMeshPatches(
+                    sh.name, sh.renderFromObject, sh.reverseOrientation, sh.parameters,
+                    textures.floatTextures, &sh.loc);
+                if (!patchVectors[i].empty())
+                    return;
+            }
+            if (lazy[i])
+                return;
             shapeVectors[i] = Shape::Create(
                 sh.name, sh.renderFromObject, sh.objectFromRender, sh.reverseOrientation,
                 sh.parameters, textures.floatTextures, &sh.loc, alloc);
+            if (cull)
+                for (pbrt::Shape shape : shapeVectors[i])
+                    shapeBounds[i] = Union(shapeBounds[i], shape.Bounds());
         });
 
         std::vector<Primitive> primitives;
+        std::vector<std::shared_ptr<ShapeSceneEntity>> lazyEntities;
+        std::vector<LazyPrimitive::CreateFunction> lazyCreateFunctions;
+        if (meshIndices)
+            meshIndices->assign(shapes.size(), -1);
         for (size_t i = 0; i < shapes.size(); ++i) {
             auto &sh = shapes[i];
             pstd::vector<pbrt::Shape> &shapes = shapeVectors[i];
-            if (shapes.empty())
+            std::vector<DisplacedMeshPatch> &patches = patchVectors[i];
+            if (meshIndices && !shapes.empty() &&
+                std::all_of(shapes.begin(), shapes.end(),
+                            [](pbrt::Shape s) { return s.Is<Triangle>(); }))
+                (*meshIndices)[i] = shapes[0].Cast<Triangle>()->MeshIndex();
+            if (shapes.empty() && patches.empty() && !lazy[i])
+                continue;
+            if (cull && !shapes.empty() && sh.lightIndex == -1 &&
+                culled(shapeBounds[i])) {
+                ++nCulledShapes;
+                sh.parameters.FreeParameters();
+                sh = ShapeSceneEntity();
                 continue;
+            }
 
             FloatTexture alphaTex = getAlphaTexture(sh.parameters, &sh.loc);
-            sh.parameters.ReportUnused();  // do now so can grab alpha...
+            if (!lazy[i] || !patches.empty())
+                sh.parameters.ReportUnused();  // do now so can grab alpha...
 
             pbrt::Material mtl = nullptr;
             if (!sh.materialName.empty()) {
@@ -1420,7 +1854,73 @@ Primitive BasicScene::CreateAggregate(
             pbrt::MediumInterface mi(findMedium(sh.insideMedium, &sh.loc),
                                      findMedium(sh.outsideMedium, &sh.loc));
 
+            auto createLazyPrimitives = [=](const pstd::vector<pbrt::Shape> &shapes,
+                                            Allocator alloc) {
+                std::vector<Primitive> primitives;
+                for (pbrt::Shape shape : shapes) {
+                    if (!mi.IsMediumTransition() && !alphaTex)
+                        primitives.push_back(
+                            alloc.new_object<SimplePrimitive>(shape, mtl));
+                    else
+                        primitives.push_back(alloc.new_object<GeometricPrimitive>(
+                            shape, mtl, nullptr, mi, alphaTex));
+                }
+                return primitives;
+            };
+
+            if (!patches.empty()) {
+                // The patches' bounds are known, so their geometry is only
+                // created once a ray reaches them
+                for (DisplacedMeshPatch &patch : patches) {
+                    if (cull && culled(patch.bounds)) {
+                        ++nCulledPatches;
+                        continue;
+                    }
+                    auto create = std::move(patch.create);
+                    primitives.push_back(new LazyPrimitive(
+                        [=](Allocator alloc) {
+                            return createLazyPrimitives(create(alloc), alloc);
+                        },
+                        patch.bounds));
+                }
+                patches = std::vector<DisplacedMeshPatch>();
+                sh.parameters.FreeParameters();
+                sh = ShapeSceneEntity();
+                continue;
+            }
+
+            if (lazy[i]) {
+                // Keep the shape's description around to create it on demand
+                auto entity = std::make_shared<ShapeSceneEntity>(std::move(sh));
+                lazyEntities.push_back(entity);
+                auto floatTextures = lazyFloatTextures;
+                lazyCreateFunctions.push_back([=](Allocator alloc) {
+                    return createLazyPrimitives(
+                        Shape::Create(entity->name, entity->renderFromObject,
+                                      entity->objectFromRender,
+                                      entity->reverseOrientation, entity->parameters,
+                                      *floatTextures, &entity->loc, alloc),
+                        alloc);
+                });
+                sh = ShapeSceneEntity();
+                continue;
+            }
+
             auto iter = shapeIndexToAreaLights.find(i);
+            bool hasAreaLights =
+                sh.lightIndex != -1 && iter != shapeIndexToAreaLights.end();
+            if (!hasAreaLights && !alphaTex &&
+                std::all_of(shapes.begin(), shapes.end(),
+                            [](pbrt::Shape s) { return s.Is<Triangle>(); })) {
+                // The mesh's triangles share all of their primitives' attributes
+                std::vector<Primitive> meshPrims =
+                    MeshTrianglePrimitive::CreatePrimitives(
+                        pstd::span<const pbrt::Shape>(shapes), mtl, mi, alloc);
+                primitives.insert(primitives.end(), meshPrims.begin(), meshPrims.end());
+                sh.parameters.FreeParameters();
+                sh = ShapeSceneEntity();
+                continue;
+            }
             for (size_t j = 0; j < shapes.size(); ++j) {
                 // Possibly create area light for shape
                 Light area = nullptr;
@@ -1438,15 +1938,27 @@ Primitive BasicScene::CreateAggregate(
             sh.parameters.FreeParameters();
             sh = ShapeSceneEntity();
         }
+
+        // Create lazy primitives, which creates each one's shapes once to find
+        // its bounds
+        std::vector<LazyPrimitive *> lazyPrimitives(lazyCreateFunctions.size());
+        ParallelFor(0, lazyCreateFunctions.size(), [&](int64_t i) {
+            lazyPrimitives[i] = new LazyPrimitive(std::move(lazyCreateFunctions[i]));
+        });
+        for (size_t i = 0; i < lazyPrimitives.size(); ++i) {
+            lazyEntities[i]->parameters.ReportUnused();
+            // Skip shapes that turned out to be empty or are culled
+            Bounds3f bounds = lazyPrimitives[i]->Bounds();
+            if (bounds.IsDegenerate())
+                continue;
+            if (cull && culled(bounds))
+                ++nCulledShapes;
+            else
+                primitives.push_back(lazyPrimitives[i]);
+        }
         return primitives;
     };
 
-    LOG_VERBOSE("Starting shapes");
-    std::vector<Primitive> primitives = CreatePrimitivesForShapes(shapes);
-
-    shapes.clear();
-    shapes.shrink_to_fit();
-
     // Animated shapes
     auto CreatePrimitivesForAnimatedShapes =
         [&](std::vector<AnimatedShapeSceneEntity> &shapes) -> std::vector<Primitive> {
@@ -1509,34 +2021,68 @@ Primitive BasicScene::CreateAggregate(
         }
         return primitives;
     };
-    std::vector<Primitive> animatedPrimitives =
-        CreatePrimitivesForAnimatedShapes(animatedShapes);
-    primitives.insert(primitives.end(), animatedPrimitives.begin(),
-                      animatedPrimitives.end());
 
-    animatedShapes.clear();
-    animatedShapes.shrink_to_fit();
-    LOG_VERBOSE("Finished shapes");
+    // Create the scene's shapes asynchronously so that their creation
+    // overlaps with that of the instance definitions
+    AsyncJob<std::vector<Primitive>> *shapesJob = RunAsync([&]() {
+        LOG_VERBOSE("Starting shapes");
+        std::vector<Primitive> primitives = CreatePrimitivesForShapes(shapes, true, true);
+        shapes.clear();
+        shapes.shrink_to_fit();
+
+        std::vector<Primitive> animatedPrimitives =
+            CreatePrimitivesForAnimatedShapes(animatedShapes);
+        for (Primitive prim : animatedPrimitives) {
+            if (culled(prim.Bounds()))
+                ++nCulledShapes;
+            else
+                primitives.push_back(prim);
+        }
+        animatedShapes.clear();
+        animatedShapes.shrink_to_fit();
+        LOG_VERBOSE("Finished shapes");
+        return primitives;
+    });
+
+    // Keep what's needed to update the aggregate for the frames of an animation
+    if (!Options->framePattern.empty())
+        sequence = new FrameSequence;
 
     // Instance definitions
     LOG_VERBOSE("Starting instances");
     std::map<InternedString, Primitive> instanceDefinitions;
+    std::map<InternedString, size_t> instancePrimitiveCounts;
     std::mutex instanceDefinitionsMutex;
     std::vector<std::map<InternedString, InstanceDefinitionSceneEntity *>::iterator>
         instanceDefinitionIterators;
+    // Objects that are never instanced aren't created, unless the frames of an
+    // animation may instance them later
+    std::set<InternedString> usedObjects;
+    for (const auto &inst : instances)
+        usedObjects.insert(inst.name);
     for (auto iter = this->instanceDefinitions.begin();
-         iter != this->instanceDefinitions.end(); ++iter)
+         iter != this->instanceDefinitions.end(); ++iter) {
+        if (!sequence && usedObjects.find(iter->first) == usedObjects.end()) {
+            ++nUnusedObjectDefinitions;
+            delete iter->second;
+            iter->second = nullptr;
+            continue;
+        }
         instanceDefinitionIterators.push_back(iter);
+    }
     ParallelFor(0, instanceDefinitionIterators.size(), [&](int64_t i) {
         auto &inst = *instanceDefinitionIterators[i];
 
-        std::vector<Primitive> instancePrimitives =
-            CreatePrimitivesForShapes(inst.second->shapes);
+        std::vector<int> meshIndices;
+        std::vector<Primitive> instancePrimitives = CreatePrimitivesForShapes(
+            inst.second->shapes, false, false, sequence ? &meshIndices : nullptr);
         std::vector<Primitive> movingInstancePrimitives =
             CreatePrimitivesForAnimatedShapes(inst.second->animatedShapes);
         instancePrimitives.insert(instancePrimitives.end(),
                                   movingInstancePrimitives.begin(),
                                   movingInstancePrimitives.end());
+        size_t nPrimitives = instancePrimitives.size();
+        nPrototypePrimitives += nPrimitives;
 
         if (instancePrimitives.size() > 1) {
             Primitive bvh = new BVHAggregate(std::move(instancePrimitives));
@@ -1545,41 +2091,103 @@ Primitive BasicScene::CreateAggregate(
         }
 
         std::lock_guard<std::mutex> lock(instanceDefinitionsMutex);
+        instancePrimitiveCounts[inst.first] = nPrimitives;
         if (instancePrimitives.empty())
             instanceDefinitions[inst.first] = nullptr;
         else
             instanceDefinitions[inst.first] = instancePrimitives[0];
+        if (sequence) {
+            FrameSequence::Object &object = sequence->objects[inst.first];
+            object.prototype = instanceDefinitions[inst.first];
+            object.meshIndices = std::move(meshIndices);
+            object.frameMemory.resize(object.meshIndices.size());
+        }
 
         delete inst.second;
         inst.second = nullptr;
     });
 
     this->instanceDefinitions.clear();
+    std::vector<Primitive> primitives = shapesJob->GetResult();
 
     // Instances
+    // Static instances are stored as compact records in an _InstanceBVHAggregate_
+    std::vector<Primitive> prototypes;
+    std::map<InternedString, uint32_t> prototypeIndices;
+    std::vector<InstanceBVHAggregate::Instance> staticInstances;
     for (const auto &inst : instances) {
         auto iter = instanceDefinitions.find(inst.name);
         if (iter == instanceDefinitions.end())
             ErrorExit(&inst.loc, "%s: object instance not defined", inst.name);
 
-        if (!iter->second)
+        if (!iter->second) {
             // empty instance
+            ++nEmptyObjectInstances;
+            delete inst.renderFromInstanceAnim;
             continue;
+        }
+        // Skip instances outside of the culling volumes; the uses of an
+        // animation's objects are replaced for each frame, so they are kept
+        if (!sequence && !cullVolumes.empty()) {
+            Bounds3f bounds = inst.renderFromInstance
+                                  ? (*inst.renderFromInstance)(iter->second.Bounds())
+                                  : inst.renderFromInstanceAnim->MotionBounds(
+                                        iter->second.Bounds());
+            if (culled(bounds)) {
+                ++nCulledObjectInstances;
+                delete inst.renderFromInstanceAnim;
+                continue;
+            }
+        }
 
-        if (inst.renderFromInstance)
-            primitives.push_back(
-                new TransformedPrimitive(iter->second, inst.renderFromInstance));
-        else {
+        nFlattenedInstancePrimitives += instancePrimitiveCounts[inst.name];
+        if (sequence) {
+            // Instances are added to the aggregate for each frame
+            sequence->objects[inst.name].AddUse(inst);
+            delete inst.renderFromInstanceAnim;
+            continue;
+        }
+        if (inst.renderFromInstance) {
+            auto protoIter = prototypeIndices.find(inst.name);
+            if (protoIter == prototypeIndices.end()) {
+                protoIter = prototypeIndices.insert({inst.name, prototypes.size()}).first;
+                prototypes.push_back(iter->second);
+            }
+            staticInstances.push_back({inst.renderFromInstance, protoIter->second});
+        } else {
             primitives.push_back(
                 new AnimatedPrimitive(iter->second, *inst.renderFromInstanceAnim));
             delete inst.renderFromInstanceAnim;
         }
     }
 
+    if (!staticInstances.empty())
+        primitives.push_back(new InstanceBVHAggregate(std::move(prototypes),
+                                                      std::move(staticInstances)));
+
     instances.clear();
     instances.shrink_to_fit();
     LOG_VERBOSE("Finished instances");
 
+    // Give animated primitives their own BVHs for segments of time if requested
+    int motionSegments = accelerator.parameters.GetOneInt("motionsegments", 1);
+    if (motionSegments < 1)
+        ErrorExit(&accelerator.loc, "%d: \"motionsegments\" must be at least 1.",
+                  motionSegments);
+    if (motionSegments > 1) {
+        std::vector<Primitive> animatedPrimitives;
+        auto isAnimated = [](Primitive prim) { return prim.Is<AnimatedPrimitive>(); };
+        std::copy_if(primitives.begin(), primitives.end(),
+                     std::back_inserter(animatedPrimitives), isAnimated);
+        if (!animatedPrimitives.empty()) {
+            primitives.erase(
+                std::remove_if(primitives.begin(), primitives.end(), isAnimated),
+                primitives.end());
+            primitives.push_back(new MotionSegmentAggregate(std::move(animatedPrimitives),
+                                                            motionSegments));
+        }
+    }
+
     // Accelerator
     Primitive aggregate = nullptr;
     LOG_VERBOSE("Starting top-level accelerator");
@@ -1587,7 +2195,94 @@ Primitive BasicScene::CreateAggregate(
         aggregate = CreateAccelerator(accelerator.name, std::move(primitives),
                                       accelerator.parameters);
     LOG_VERBOSE("Finished top-level accelerator");
+    if (sequence) {
+        // The shapes' accelerator is reused for all of the frames
+        sequence->shapesAggregate = aggregate;
+        return sequence->CreateAggregate();
+    }
     return aggregate;
 }
 
+Primitive BasicScene::ApplyFrame(BasicScene &frame, const NamedTextures &textures) {
+    CHECK(sequence);
+    // Nothing may still be using the previous frame's aggregate
+    sequence->FreeAggregate();
+
+    // Update the shapes of objects that the frame redefines
+    for (auto &def : frame.instanceDefinitions) {
+        InstanceDefinitionSceneEntity *entity = def.second;
+        auto iter = sequence->objects.find(def.first);
+        if (iter == sequence->objects.end()) {
+            Warning(&entity->loc, "%s: object isn't defined in the animation's scene.",
+                    def.first);
+            delete entity;
+            continue;
+        }
+        FrameSequence::Object &object = iter->second;
+        if (entity->shapes.size() != object.meshIndices.size() ||
+            !entity->animatedShapes.empty()) {
+            Warning(&entity->loc,
+                    "%s: object doesn't have the same shapes as in the animation's "
+                    "scene. Ignoring it.",
+                    def.first);
+            delete entity;
+            continue;
+        }
+
+        // Create the frame's meshes and replace the object's meshes with them
+        std::atomic<int> nReplaced{0};
+        ParallelFor(0, entity->shapes.size(), [&](int64_t i) {
+            const ShapeSceneEntity &sh = entity->shapes[i];
+            if (object.meshIndices[i] == -1) {
+                Warning(&sh.loc, "Only the triangle meshes of objects may change "
+                                 "between frames. Ignoring shape.");
+                return;
+            }
+            // Allocate the mesh from its own memory, so that it is freed when
+            // it is replaced in turn
+            auto memory = std::make_unique<pstd::pmr::monotonic_buffer_resource>();
+            pstd::vector<pbrt::Shape> shapes;
+            {
+                BufferCacheBypass bypass;
+                shapes = Shape::Create(sh.name, sh.renderFromObject, sh.objectFromRender,
+                                       sh.reverseOrientation, sh.parameters,
+                                       textures.floatTextures, &sh.loc,
+                                       Allocator(memory.get()));
+            }
+            bool isMesh = !shapes.empty() &&
+                          std::all_of(shapes.begin(), shapes.end(),
+                                      [](pbrt::Shape s) { return s.Is<Triangle>(); });
+            if (isMesh &&
+                Triangle::ReplaceMesh(object.meshIndices[i],
+                                      shapes[0].Cast<Triangle>()->MeshIndex())) {
+                object.frameMemory[i] = std::move(memory);
+                ++nReplaced;
+            } else
+                Warning(&sh.loc, "Shape doesn't have the same triangles as in the "
+                                 "animation's scene. Ignoring it.");
+        });
+        delete entity;
+
+        // Update the bounds of the object's BVH for its new vertices
+        if (nReplaced > 0 && object.prototype.Is<BVHAggregate>())
+            object.prototype.Cast<BVHAggregate>()->Refit(MaxRefitCostRatio);
+    }
+    frame.instanceDefinitions.clear();
+
+    // Replace the uses of each object that the frame instances
+    std::set<InternedString> instancedObjects;
+    for (const InstanceSceneEntity &inst : frame.instances) {
+        auto iter = sequence->objects.find(inst.name);
+        if (iter == sequence->objects.end())
+            ErrorExit(&inst.loc, "%s: object instance not defined", inst.name);
+        if (instancedObjects.insert(inst.name).second)
+            iter->second.ClearUses();
+        iter->second.AddUse(inst);
+        delete inst.renderFromInstanceAnim;
+    }
+    frame.instances.clear();
+
+    return sequence->CreateAggregate();
+}
+
 }  // namespace pbrt
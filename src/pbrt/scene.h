@@ -36,7 +36,7 @@ struct SceneEntity {
     // SceneEntity Public Methods
     SceneEntity() = default;
     SceneEntity(const std::string &name, ParameterDictionary parameters, FileLoc loc)
-        : name(internedStrings.Lookup(name)), parameters(parameters), loc(loc) {}
+        : name(InternString(name)), parameters(parameters), loc(loc) {}
 
     std::string ToString() const {
         return StringPrintf("[ SceneEntity name: %s parameters: %s loc: %s ]", name,
@@ -47,7 +47,6 @@ struct SceneEntity {
     InternedString name;
     FileLoc loc;
     ParameterDictionary parameters;
-    static InternCache<std::string> internedStrings;
 };
 
 struct TransformedSceneEntity : public SceneEntity {
@@ -159,7 +158,7 @@ struct AnimatedShapeSceneEntity : public TransformedSceneEntity {
 struct InstanceDefinitionSceneEntity {
     InstanceDefinitionSceneEntity() = default;
     InstanceDefinitionSceneEntity(const std::string &name, FileLoc loc)
-        : name(SceneEntity::internedStrings.Lookup(name)), loc(loc) {}
+        : name(InternString(name)), loc(loc) {}
 
     std::string ToString() const {
         return StringPrintf("[ InstanceDefinitionSceneEntity name: %s loc: %s "
@@ -196,14 +195,14 @@ struct InstanceSceneEntity {
     InstanceSceneEntity() = default;
     InstanceSceneEntity(const std::string &n, FileLoc loc,
                         const AnimatedTransform &renderFromInstanceAnim)
-        : name(SceneEntity::internedStrings.Lookup(n)),
+        : name(InternString(n)),
           loc(loc),
           renderFromInstanceAnim(new AnimatedTransform(renderFromInstanceAnim)) {
         CHECK(this->renderFromInstanceAnim->IsAnimated());
     }
     InstanceSceneEntity(const std::string &n, FileLoc loc,
                         const Transform *renderFromInstance)
-        : name(SceneEntity::internedStrings.Lookup(n)),
+        : name(InternString(n)),
           loc(loc),
           renderFromInstance(renderFromInstance) {}
 
@@ -263,7 +262,8 @@ class BasicScene {
     BasicScene();
 
     void SetOptions(SceneEntity filter, SceneEntity film, CameraSceneEntity camera,
-                    SceneEntity sampler, SceneEntity integrator, SceneEntity accelerator);
+                    std::vector<CameraSceneEntity> views, SceneEntity sampler,
+                    SceneEntity integrator, SceneEntity accelerator);
 
     void AddNamedMaterial(std::string name, SceneEntity material);
     int AddMaterial(SceneEntity material);
@@ -291,6 +291,23 @@ class BasicScene {
         return camera;
     }
 
+    // Cameras after the first are additional views of the scene that are
+    // each rendered to their own film once the first camera's is done.
+    int NumViews() const { return int(views.size()); }
+    // Creates the camera for the given additional view, along with its film;
+    // ReleaseViewCamera() frees both once the view has been rendered.
+    Camera CreateViewCamera(int view);
+    void ReleaseViewCamera(Camera camera);
+
+    // Each frame of an animation (see --frames) is parsed into its own scene
+    // using a frame's BasicSceneBuilder, after this scene's aggregate has been
+    // created. ApplyFrame() then updates the instances and object meshes and
+    // returns the frame's aggregate, freeing the previous frame's.
+    // CreateFrameCamera() creates its camera like CreateViewCamera() does.
+    void SetFrameCameras(std::vector<CameraSceneEntity> cameras);
+    Primitive ApplyFrame(BasicScene &frame, const NamedTextures &textures);
+    Camera CreateFrameCamera(const BasicScene &frame, int frameNumber);
+
     Sampler GetSampler() {
         samplerJobMutex.lock();
         while (!sampler) {
@@ -326,7 +343,13 @@ class BasicScene {
 
     NamedTextures CreateTextures();
 
+    // Returns the scene description files that define materials, textures,
+    // and lights other than area lights.
+    std::set<std::string> MaterialAndLightFilenames();
+
     // BasicScene Public Members
+    // Top-level scene description files; only used to reload the scene.
+    std::vector<std::string> filenames;
     SceneEntity integrator, accelerator;
     const RGBColorSpace *filmColorSpace;
     std::vector<ShapeSceneEntity> shapes;
@@ -337,6 +360,10 @@ class BasicScene {
   private:
     // BasicScene Private Methods
     Medium GetMedium(const std::string &name, const FileLoc *loc);
+    Film CreateFilm(const CameraSceneEntity &camera, Allocator alloc) const;
+    std::string FilmFilenameWithSuffix(const std::string &suffix) const;
+    Camera CreateCameraAndFilm(const CameraSceneEntity &camera,
+                               const std::string &filename);
 
     void startLoadingNormalMaps(const ParameterDictionary &parameters);
 
@@ -345,6 +372,13 @@ class BasicScene {
     mutable ThreadLocal<Allocator> threadAllocators;
     Camera camera;
     Film film;
+    SceneEntity filmEntity;
+    Filter filmFilter;
+    std::vector<CameraSceneEntity> views;
+    // Camera of the most recent frame of an animation
+    CameraSceneEntity frameCamera;
+    struct FrameSequence;
+    FrameSequence *sequence = nullptr;
     std::mutex cameraJobMutex;
     AsyncJob<Camera> *cameraJob = nullptr;
     std::mutex samplerJobMutex;
@@ -361,6 +395,7 @@ class BasicScene {
 
     std::mutex lightMutex;
     std::vector<AsyncJob<Light> *> lightJobs;
+    std::set<std::string> lightFilenames;
 
     std::mutex areaLightMutex;
     std::vector<SceneEntity> areaLights;
@@ -383,6 +418,9 @@ class BasicSceneBuilder : public ParserTarget {
   public:
     // BasicSceneBuilder Public Methods
     BasicSceneBuilder(BasicScene *scene);
+    // Creates a builder for a frame of an animation whose scene was built
+    // with the given rendering space; see BasicScene::ApplyFrame().
+    BasicSceneBuilder(BasicScene *scene, const class Transform &renderFromWorld);
     void Option(const std::string &name, const std::string &value, FileLoc loc);
     void Identity(FileLoc loc);
     void Translate(Float dx, Float dy, Float dz, FileLoc loc);
@@ -471,14 +509,25 @@ class BasicSceneBuilder : public ParserTarget {
     };
 
     friend void parse(ParserTarget *scene, std::unique_ptr<Tokenizer> t);
+    friend void parseBinary(ParserTarget *target, std::unique_ptr<BinarySceneReader> r);
     // BasicSceneBuilder Private Methods
-    class Transform RenderFromObject(int index) const {
-        return pbrt::Transform((renderFromWorld * graphicsState.ctm[index]).GetMatrix());
+    const class Transform *LookupTransform(const SquareMatrix<4> &m) {
+        // The cache only hashes and compares matrices, so the inverse is only
+        // computed when _m_ is inserted for the first time
+        return transformCache.Lookup(
+            pbrt::Transform(m, m), [](Allocator alloc, const class Transform &t) {
+                return alloc.new_object<class Transform>(t.GetMatrix());
+            });
+    }
+
+    const class Transform *RenderFromObject(int index) {
+        return LookupTransform(renderFromWorld.GetMatrix() *
+                               graphicsState.ctm[index].GetMatrix());
     }
 
-    AnimatedTransform RenderFromObject() const {
-        return {RenderFromObject(0), graphicsState.transformStartTime,
-                RenderFromObject(1), graphicsState.transformEndTime};
+    AnimatedTransform RenderFromObject() {
+        return {*RenderFromObject(0), graphicsState.transformStartTime,
+                *RenderFromObject(1), graphicsState.transformEndTime};
     }
 
     bool CTMIsAnimated() const { return graphicsState.ctm.IsAnimated(); }
@@ -517,6 +566,9 @@ class BasicSceneBuilder : public ParserTarget {
     SceneEntity sampler;
     SceneEntity film, integrator, filter, accelerator;
     CameraSceneEntity camera;
+    bool cameraSpecified = false;
+    std::vector<CameraSceneEntity> cameraViews;
+    bool isFrame = false;
 };
 
 }  // namespace pbrt
@@ -26,6 +26,10 @@
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 namespace pbrt {
 
@@ -269,12 +273,26 @@ PBRT_CPU_GPU pstd::optional<TriangleIntersection> IntersectTriangle(const Ray &r
 }
 
 // Triangle Method Definitions
-pstd::vector<Shape> Triangle::CreateTriangles(const TriangleMesh *mesh, Allocator alloc) {
-    static std::mutex allMeshesLock;
-    allMeshesLock.lock();
+static std::mutex allMeshesLock;
+
+int Triangle::ReserveMeshIndex() {
+    std::lock_guard<std::mutex> lock(allMeshesLock);
     CHECK_LT(allMeshes->size(), 1 << 31);
-    int meshIndex = int(allMeshes->size());
-    allMeshes->push_back(mesh);
+    allMeshes->push_back(nullptr);
+    return int(allMeshes->size()) - 1;
+}
+
+pstd::vector<Shape> Triangle::CreateTriangles(const TriangleMesh *mesh, Allocator alloc,
+                                              int meshIndex) {
+    allMeshesLock.lock();
+    if (meshIndex == -1) {
+        CHECK_LT(allMeshes->size(), 1 << 31);
+        meshIndex = int(allMeshes->size());
+        allMeshes->push_back(mesh);
+    } else
+        // Rays still traversing an evicted version of the mesh see this one
+        // instead, which is identical since it was created the same way.
+        (*allMeshes)[meshIndex] = mesh;
     allMeshesLock.unlock();
 
     pstd::vector<Shape> tris(mesh->nTriangles, alloc);
@@ -287,11 +305,25 @@ pstd::vector<Shape> Triangle::CreateTriangles(const TriangleMesh *mesh, Allocato
     return tris;
 }
 
+bool Triangle::ReplaceMesh(int meshIndex, int newMeshIndex) {
+    std::lock_guard<std::mutex> lock(allMeshesLock);
+    const TriangleMesh *mesh = (*allMeshes)[meshIndex];
+    const TriangleMesh *newMesh = (*allMeshes)[newMeshIndex];
+    if (mesh->nTriangles != newMesh->nTriangles || mesh->nVertices != newMesh->nVertices)
+        return false;
+    for (int i = 0; i < mesh->nTriangles; ++i)
+        if (mesh->TriangleVertexIndices(i) != newMesh->TriangleVertexIndices(i))
+            return false;
+    (*allMeshes)[meshIndex] = newMesh;
+    (*allMeshes)[newMeshIndex] = nullptr;
+    return true;
+}
+
 PBRT_CPU_GPU Bounds3f Triangle::Bounds() const {
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
-    Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+    pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+    Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
     return Union(Bounds3f(p0, p1), p2);
 }
@@ -299,13 +331,13 @@ PBRT_CPU_GPU Bounds3f Triangle::Bounds() const {
 PBRT_CPU_GPU DirectionCone Triangle::NormalBounds() const {
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
-    Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+    pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+    Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
     Normal3f n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
     // Ensure correct orientation of geometric normal for normal bounds
-    if (mesh->n) {
-        Normal3f ns(mesh->n[v[0]] + mesh->n[v[1]] + mesh->n[v[2]]);
+    if (mesh->HasNormals()) {
+        Normal3f ns(mesh->N(v[0]) + mesh->N(v[1]) + mesh->N(v[2]));
         n = FaceForward(n, ns);
     } else if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
         n *= -1;
@@ -314,24 +346,30 @@ PBRT_CPU_GPU DirectionCone Triangle::NormalBounds() const {
 }
 
 PBRT_CPU_GPU pstd::optional<ShapeIntersection> Triangle::Intersect(const Ray &ray, Float tMax) const {
+    pstd::optional<TriangleIntersection> triIsect = IntersectBarycentrics(ray, tMax);
+    if (!triIsect)
+        return {};
+    SurfaceInteraction intr = InteractionFromIntersection(*triIsect, ray.time, -ray.d);
+    return ShapeIntersection{intr, triIsect->t};
+}
+
+PBRT_CPU_GPU pstd::optional<TriangleIntersection> Triangle::IntersectBarycentrics(
+    const Ray &ray, Float tMax) const {
 #ifndef PBRT_IS_GPU_CODE
     ++nTriTests;
 #endif
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
-    Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+    pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+    Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
     pstd::optional<TriangleIntersection> triIsect =
         IntersectTriangle(ray, tMax, p0, p1, p2);
-    if (!triIsect)
-        return {};
-    SurfaceInteraction intr =
-        InteractionFromIntersection(mesh, triIndex, *triIsect, ray.time, -ray.d);
 #ifndef PBRT_IS_GPU_CODE
-    ++nTriHits;
+    if (triIsect)
+        ++nTriHits;
 #endif
-    return ShapeIntersection{intr, triIsect->t};
+    return triIsect;
 }
 
 PBRT_CPU_GPU bool Triangle::IntersectP(const Ray &ray, Float tMax) const {
@@ -340,8 +378,8 @@ PBRT_CPU_GPU bool Triangle::IntersectP(const Ray &ray, Float tMax) const {
 #endif
     // Get triangle vertices in _p0_, _p1_, and _p2_
     const TriangleMesh *mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
-    Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+    pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+    Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
     pstd::optional<TriangleIntersection> isect = IntersectTriangle(ray, tMax, p0, p1, p2);
     if (isect) {
@@ -356,15 +394,32 @@ PBRT_CPU_GPU bool Triangle::IntersectP(const Ray &ray, Float tMax) const {
 std::string Triangle::ToString() const {
     // Get triangle vertices in _p0_, _p1_, and _p2_
     auto mesh = GetMesh();
-    const int *v = &mesh->vertexIndices[3 * triIndex];
-    const Point3f &p0 = mesh->p[v[0]];
-    const Point3f &p1 = mesh->p[v[1]];
-    const Point3f &p2 = mesh->p[v[2]];
+    pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+    Point3f p0 = mesh->P(v[0]);
+    Point3f p1 = mesh->P(v[1]);
+    Point3f p2 = mesh->P(v[2]);
 
     return StringPrintf("[ Triangle meshIndex: %d triIndex: %d -> p [ %s %s %s ] ]",
                         meshIndex, triIndex, p0, p1, p2);
 }
 
+// Returns the compact storage mode requested for a triangle mesh, if any.
+static TriangleMeshStorage GetTriangleMeshStorage(const ParameterDictionary &parameters,
+                                                  const FileLoc *loc) {
+    std::string storage = parameters.GetOneString("storage", "full");
+    if (storage == "full")
+        return TriangleMeshStorage::Full;
+    // GPU acceleration structures are built from full-precision buffers
+    if (Options->useGPU)
+        return TriangleMeshStorage::Full;
+    if (storage == "compact")
+        return TriangleMeshStorage::Compact;
+    if (storage == "quantized")
+        return TriangleMeshStorage::Quantized;
+    Warning(loc, R"(Triangle mesh storage "%s" unknown.  Using "full".)", storage);
+    return TriangleMeshStorage::Full;
+}
+
 TriangleMesh *Triangle::CreateMesh(const Transform *renderFromObject,
                                    bool reverseOrientation,
                                    const ParameterDictionary &parameters,
@@ -434,7 +489,8 @@ TriangleMesh *Triangle::CreateMesh(const Transform *renderFromObject,
 
     return alloc.new_object<TriangleMesh>(
         *renderFromObject, reverseOrientation, std::move(vi), std::move(P), std::move(S),
-        std::move(N), std::move(uvs), std::move(faceIndices), alloc);
+        std::move(N), std::move(uvs), std::move(faceIndices), alloc,
+        GetTriangleMeshStorage(parameters, loc));
 }
 
 STAT_MEMORY_COUNTER("Memory/Curves", curveBytes);
@@ -457,71 +513,118 @@ std::string ToString(CurveType type) {
 }
 
 // CurveCommon Method Definitions
-CurveCommon::CurveCommon(pstd::span<const Point3f> c, Float width0, Float width1,
+CurveCommon::CurveCommon(pstd::span<const Point3f> c, pstd::span<const Float> w,
                          CurveType type, pstd::span<const Normal3f> norm,
                          const Transform *renderFromObject,
-                         const Transform *objectFromRender, bool reverseOrientation)
+                         const Transform *objectFromRender, bool reverseOrientation,
+                         Allocator alloc)
     : type(type),
+      nSegments(int(w.size()) - 1),
       renderFromObject(renderFromObject),
       objectFromRender(objectFromRender),
       reverseOrientation(reverseOrientation),
       transformSwapsHandedness(renderFromObject->SwapsHandedness()) {
-    width[0] = width0;
-    width[1] = width1;
-    CHECK_EQ(c.size(), 4);
-    for (int i = 0; i < 4; ++i)
-        cpObj[i] = c[i];
-    if (norm.size() == 2) {
-        n[0] = Normalize(norm[0]);
-        n[1] = Normalize(norm[1]);
-        normalAngle = AngleBetween(n[0], n[1]);
-        invSinNormalAngle = 1 / std::sin(normalAngle);
+    CHECK_GE(nSegments, 1);
+    CHECK_EQ(c.size(), 4 * nSegments);
+    // Store control points once where consecutive segments share endpoints
+    bool shareEndpoints = true;
+    for (int i = 1; i < nSegments; ++i)
+        if (c[4 * i] != c[4 * i - 1])
+            shareEndpoints = false;
+    if (shareEndpoints) {
+        cpStride = 3;
+        std::vector<Point3f> cpShared;
+        cpShared.reserve(3 * nSegments + 1);
+        for (int i = 0; i < nSegments; ++i)
+            cpShared.insert(cpShared.end(), &c[4 * i], &c[4 * i + 3]);
+        cpShared.push_back(c.back());
+        cpObj = point3BufferCache->LookupOrAdd(cpShared, alloc);
+    } else {
+        cpStride = 4;
+        cpObj = point3BufferCache->LookupOrAdd(c, alloc);
+    }
+
+    // Store widths in half precision if they are represented accurately
+    std::vector<uint16_t> wHalf(w.size());
+    bool useHalf = true;
+    for (size_t i = 0; i < w.size(); ++i) {
+        Half h(float(w[i]));
+        useHalf &= std::abs(float(h) - w[i]) <= 1e-3f * std::abs(w[i]);
+        wHalf[i] = h.Bits();
+    }
+    if (useHalf)
+        widthHalf = uint16BufferCache->LookupOrAdd(wHalf, alloc);
+    else {
+        Float *wp = alloc.allocate_object<Float>(w.size());
+        std::copy(w.begin(), w.end(), wp);
+        width = wp;
+    }
+
+    if (!norm.empty()) {
+        // Initialize ribbon normals and the angles between them
+        CHECK_EQ(norm.size(), nSegments + 1);
+        std::vector<Normal3f> nn(norm.size());
+        for (size_t i = 0; i < norm.size(); ++i)
+            nn[i] = Normalize(norm[i]);
+        n = normal3BufferCache->LookupOrAdd(nn, alloc);
+        Float *angles = alloc.allocate_object<Float>(2 * nSegments);
+        for (int i = 0; i < nSegments; ++i) {
+            angles[2 * i] = AngleBetween(nn[i], nn[i + 1]);
+            angles[2 * i + 1] = 1 / std::sin(angles[2 * i]);
+        }
+        normalAngles = angles;
+        curveBytes += 2 * nSegments * sizeof(Float);
     }
-    ++nCurves;
+    nCurves += nSegments;
+    curveBytes += sizeof(CurveCommon) + (useHalf ? 0 : w.size() * sizeof(Float));
 }
 
 std::string CurveCommon::ToString() const {
     return StringPrintf(
-        "[ CurveCommon type: %s cpObj: %s width: %s n: %s normalAngle: %f "
-        "invSinNormalAngle: %f renderFromObject: %s "
-        "objectFromRender: %s "
+        "[ CurveCommon type: %s nSegments: %d cpStride: %d cpObj: %s "
+        "widthHalf: %s renderFromObject: %s objectFromRender: %s "
         "reverseOrientation: %s transformSwapsHandedness: %s ]",
-        type, pstd::MakeSpan(cpObj), pstd::MakeSpan(width), pstd::MakeSpan(n),
-        normalAngle, invSinNormalAngle, *renderFromObject, *objectFromRender,
-        reverseOrientation, transformSwapsHandedness);
+        type, nSegments, cpStride,
+        pstd::MakeConstSpan(cpObj, cpStride * (nSegments - 1) + 4), widthHalf != nullptr,
+        *renderFromObject, *objectFromRender, reverseOrientation,
+        transformSwapsHandedness);
 }
 
 pstd::vector<Shape> CreateCurve(const Transform *renderFromObject,
                                 const Transform *objectFromRender,
                                 bool reverseOrientation, pstd::span<const Point3f> c,
-                                Float w0, Float w1, CurveType type,
+                                pstd::span<const Float> w, CurveType type,
                                 pstd::span<const Normal3f> norm, int splitDepth,
                                 Allocator alloc) {
-    CurveCommon *common = alloc.new_object<CurveCommon>(
-        c, w0, w1, type, norm, renderFromObject, objectFromRender, reverseOrientation);
-
-    const int nSegments = 1 << splitDepth;
-    pstd::vector<Shape> segments(nSegments, alloc);
-    Curve *curves = alloc.allocate_object<Curve>(nSegments);
-    for (int i = 0; i < nSegments; ++i) {
-        Float uMin = i / (Float)nSegments;
-        Float uMax = (i + 1) / (Float)nSegments;
-        alloc.construct(&curves[i], common, uMin, uMax);
-        segments[i] = &curves[i];
-        ++nSplitCurves;
-    }
+    CurveCommon *common =
+        alloc.new_object<CurveCommon>(c, w, type, norm, renderFromObject,
+                                      objectFromRender, reverseOrientation, alloc);
+
+    // Split each of the curve's segments into _2^splitDepth_ _Curve_s
+    const int nSplits = 1 << splitDepth;
+    const int nCurveShapes = common->nSegments * nSplits;
+    pstd::vector<Shape> segments(nCurveShapes, alloc);
+    Curve *curves = alloc.allocate_object<Curve>(nCurveShapes);
+    for (int seg = 0; seg < common->nSegments; ++seg)
+        for (int i = 0; i < nSplits; ++i) {
+            Float uMin = i / (Float)nSplits;
+            Float uMax = (i + 1) / (Float)nSplits;
+            Curve *curve = &curves[seg * nSplits + i];
+            alloc.construct(curve, common, seg, uMin, uMax);
+            segments[seg * nSplits + i] = curve;
+            ++nSplitCurves;
+        }
 
-    curveBytes += sizeof(CurveCommon) + nSegments * sizeof(Curve);
+    curveBytes += nCurveShapes * sizeof(Curve);
     return segments;
 }
 
 // Curve Method Definitions
 PBRT_CPU_GPU Bounds3f Curve::Bounds() const {
-    pstd::span<const Point3f> cpSpan(common->cpObj);
-    Bounds3f objBounds = BoundCubicBezier(cpSpan, uMin, uMax);
+    Float uMin = UMin(), uMax = UMax();
+    Bounds3f objBounds = BoundCubicBezier(common->ControlPoints(segment), uMin, uMax);
     // Expand _objBounds_ by maximum curve width over $u$ range
-    Float width[2] = {Lerp(uMin, common->width[0], common->width[1]),
-                      Lerp(uMax, common->width[0], common->width[1])};
+    Float width[2] = {common->Width(segment, uMin), common->Width(segment, uMax)};
     objBounds = Expand(objBounds, std::max(width[0], width[1]) * 0.5f);
 
     return (*common->renderFromObject)(objBounds);
@@ -529,9 +632,9 @@ PBRT_CPU_GPU Bounds3f Curve::Bounds() const {
 
 PBRT_CPU_GPU Float Curve::Area() const {
     pstd::array<Point3f, 4> cpObj =
-        CubicBezierControlPoints(pstd::MakeConstSpan(common->cpObj), uMin, uMax);
-    Float width0 = Lerp(uMin, common->width[0], common->width[1]);
-    Float width1 = Lerp(uMax, common->width[0], common->width[1]);
+        CubicBezierControlPoints(common->ControlPoints(segment), UMin(), UMax());
+    Float width0 = common->Width(segment, UMin());
+    Float width1 = common->Width(segment, UMax());
     Float avgWidth = (width0 + width1) * 0.5f;
     Float approxLength = 0.f;
     for (int i = 0; i < 3; ++i)
@@ -558,8 +661,9 @@ bool Curve::IntersectRay(const Ray &r, Float tMax,
     Ray ray = (*common->objectFromRender)(r);
 
     // Get object-space control points for curve segment, _cpObj_
+    Float uMin = UMin(), uMax = UMax();
     pstd::array<Point3f, 4> cpObj =
-        CubicBezierControlPoints(pstd::span<const Point3f>(common->cpObj), uMin, uMax);
+        CubicBezierControlPoints(common->ControlPoints(segment), uMin, uMax);
 
     // Project curve control points to plane perpendicular to ray
     Vector3f dx = Cross(ray.d, cpObj[3] - cpObj[0]);
@@ -567,13 +671,18 @@ bool Curve::IntersectRay(const Ray &r, Float tMax,
         Vector3f dy;
         CoordinateSystem(ray.d, &dx, &dy);
     }
-    Transform rayFromObject = LookAt(ray.o, ray.o + ray.d, dx);
+    // Find ray-space frame directly rather than inverting a _LookAt()_ matrix
+    Vector3f dir = Normalize(ray.d);
+    Frame rayFrame = Frame::FromXZ(Normalize(Cross(Normalize(dx), dir)), dir);
+    auto rayFromObject = [&](Point3f p) {
+        return Point3f(rayFrame.ToLocal(p - ray.o));
+    };
     pstd::array<Point3f, 4> cp = {rayFromObject(cpObj[0]), rayFromObject(cpObj[1]),
                                   rayFromObject(cpObj[2]), rayFromObject(cpObj[3])};
 
     // Test ray against bound of projected control points
-    Float maxWidth = std::max(Lerp(uMin, common->width[0], common->width[1]),
-                              Lerp(uMax, common->width[0], common->width[1]));
+    Float maxWidth =
+        std::max(common->Width(segment, uMin), common->Width(segment, uMax));
     Bounds3f curveBounds = Union(Bounds3f(cp[0], cp[1]), Bounds3f(cp[2], cp[3]));
     curveBounds = Expand(curveBounds, 0.5f * maxWidth);
     Bounds3f rayBounds(Point3f(0, 0, 0), Point3f(0, 0, Length(ray.d) * tMax));
@@ -589,7 +698,7 @@ bool Curve::IntersectRay(const Ray &r, Float tMax,
                          std::abs(cp[i].z - 2 * cp[i + 1].z + cp[i + 2].z)));
     int maxDepth = 0;
     if (L0 > 0) {
-        Float eps = std::max(common->width[0], common->width[1]) * .05f;  // width / 20
+        Float eps = common->MaxWidth(segment) * .05f;  // width / 20
         // Compute log base 4 by dividing log2 in half.
         int r0 = Log2Int(1.41421356237f * 6.f * L0 / (8.f * eps)) / 2;
         maxDepth = Clamp(r0, 0, 10);
@@ -597,13 +706,12 @@ bool Curve::IntersectRay(const Ray &r, Float tMax,
 
     // Recursively test for ray--curve intersection
     pstd::span<const Point3f> cpSpan(cp);
-    return RecursiveIntersect(ray, tMax, cpSpan, Inverse(rayFromObject), uMin, uMax,
-                              maxDepth, si);
+    return RecursiveIntersect(ray, tMax, cpSpan, rayFrame, uMin, uMax, maxDepth, si);
 }
 
 bool Curve::RecursiveIntersect(const Ray &ray, Float tMax, pstd::span<const Point3f> cp,
-                               const Transform &objectFromRay, Float u0, Float u1,
-                               int depth, pstd::optional<ShapeIntersection> *si) const {
+                               const Frame &rayFrame, Float u0, Float u1, int depth,
+                               pstd::optional<ShapeIntersection> *si) const {
     Float rayLength = Length(ray.d);
     if (depth > 0) {
         // Split curve segment into subsegments and test for intersection
@@ -611,20 +719,19 @@ bool Curve::RecursiveIntersect(const Ray &ray, Float tMax, pstd::span<const Poin
         Float u[3] = {u0, (u0 + u1) / 2, u1};
         for (int seg = 0; seg < 2; ++seg) {
             // Check ray against curve segment's bounding box
-            Float maxWidth =
-                std::max(Lerp(u[seg], common->width[0], common->width[1]),
-                         Lerp(u[seg + 1], common->width[0], common->width[1]));
+            Float maxWidth = std::max(common->Width(segment, u[seg]),
+                                      common->Width(segment, u[seg + 1]));
             pstd::span<const Point3f> cps = pstd::MakeConstSpan(&cpSplit[3 * seg], 4);
             Bounds3f curveBounds =
                 Union(Bounds3f(cps[0], cps[1]), Bounds3f(cps[2], cps[3]));
             curveBounds = Expand(curveBounds, 0.5f * maxWidth);
-            Bounds3f rayBounds(Point3f(0, 0, 0), Point3f(0, 0, Length(ray.d) * tMax));
+            Bounds3f rayBounds(Point3f(0, 0, 0), Point3f(0, 0, rayLength * tMax));
             if (!Overlaps(rayBounds, curveBounds))
                 continue;
 
             // Recursively test ray-segment intersection
-            bool hit = RecursiveIntersect(ray, tMax, cps, objectFromRay, u[seg],
-                                          u[seg + 1], depth - 1, si);
+            bool hit = RecursiveIntersect(ray, tMax, cps, rayFrame, u[seg], u[seg + 1],
+                                          depth - 1, si);
             if (hit && !si)
                 return true;
         }
@@ -652,19 +759,11 @@ bool Curve::RecursiveIntersect(const Ray &ray, Float tMax, pstd::span<const Poin
 
         // Compute $u$ coordinate of curve intersection point and _hitWidth_
         Float u = Clamp(Lerp(w, u0, u1), u0, u1);
-        Float hitWidth = Lerp(u, common->width[0], common->width[1]);
+        Float hitWidth = common->Width(segment, u);
         Normal3f nHit;
         if (common->type == CurveType::Ribbon) {
             // Scale _hitWidth_ based on ribbon orientation
-            if (common->normalAngle == 0)
-                nHit = common->n[0];
-            else {
-                Float sin0 =
-                    std::sin((1 - u) * common->normalAngle) * common->invSinNormalAngle;
-                Float sin1 =
-                    std::sin(u * common->normalAngle) * common->invSinNormalAngle;
-                nHit = sin0 * common->n[0] + sin1 * common->n[1];
-            }
+            nHit = common->RibbonNormal(segment, u);
             hitWidth *= AbsDot(nHit, ray.d) / rayLength;
         }
 
@@ -696,13 +795,13 @@ bool Curve::RecursiveIntersect(const Ray &ray, Float tMax, pstd::span<const Poin
 
             // Compute $\dpdu$ and $\dpdv$ for curve intersection
             Vector3f dpdu, dpdv;
-            EvaluateCubicBezier(pstd::MakeConstSpan(common->cpObj), u, &dpdu);
+            EvaluateCubicBezier(common->ControlPoints(segment), u, &dpdu);
             CHECK_NE(Vector3f(0, 0, 0), dpdu);
             if (common->type == CurveType::Ribbon)
                 dpdv = Normalize(Cross(nHit, dpdu)) * hitWidth;
             else {
                 // Compute curve $\dpdv$ for flat and cylinder curves
-                Vector3f dpduPlane = objectFromRay.ApplyInverse(dpdu);
+                Vector3f dpduPlane = rayFrame.ToLocal(dpdu);
                 Vector3f dpdvPlane =
                     Normalize(Vector3f(-dpduPlane.y, dpduPlane.x, 0)) * hitWidth;
                 if (common->type == CurveType::Cylinder) {
@@ -711,7 +810,7 @@ bool Curve::RecursiveIntersect(const Ray &ray, Float tMax, pstd::span<const Poin
                     Transform rot = Rotate(-theta, dpduPlane);
                     dpdvPlane = rot(dpdvPlane);
                 }
-                dpdv = objectFromRay(dpdvPlane);
+                dpdv = rayFrame.FromLocal(dpdvPlane);
             }
 
             // Compute error bounds for curve intersection
@@ -755,7 +854,8 @@ PBRT_CPU_GPU Float Curve::PDF(const ShapeSampleContext &ctx, Vector3f wi) const
 }
 
 std::string Curve::ToString() const {
-    return StringPrintf("[ Curve common: %s uMin: %f uMax: %f ]", *common, uMin, uMax);
+    return StringPrintf("[ Curve common: %s segment: %d uMin: %f uMax: %f ]", *common,
+                        segment, UMin(), UMax());
 }
 
 pstd::vector<Shape> Curve::Create(const Transform *renderFromObject,
@@ -843,6 +943,10 @@ pstd::vector<Shape> Curve::Create(const Transform *renderFromObject,
     // This is kind of a hack, but since we dice curves on the GPU we
     // really don't want to have them split here.
     int sd = Options->useGPU ? 0 : parameters.GetOneInt("splitdepth", 3);
+    if (sd < 0 || sd > 15) {
+        Warning(loc, "\"splitdepth\" %d must be between 0 and 15. Clamping.", sd);
+        sd = Clamp(sd, 0, 15);
+    }
 
     if (type == CurveType::Ribbon && n.empty()) {
         Error(loc, "Must provide normals \"N\" at curve endpoints with ribbon "
@@ -850,7 +954,13 @@ pstd::vector<Shape> Curve::Create(const Transform *renderFromObject,
         return {};
     }
 
-    pstd::vector<Shape> curves(alloc);
+    // Cubic Bezier control points and endpoint widths for all segments
+    std::vector<Point3f> cpBezier;
+    cpBezier.reserve(4 * nSegments);
+    std::vector<Float> widths(nSegments + 1);
+    for (int i = 0; i <= nSegments; ++i)
+        widths[i] = Lerp(Float(i) / Float(nSegments), width0, width1);
+
     // Pointer to the first control point for the current segment. This is
     // updated after each loop iteration depending on the current basis.
     int cpOffset = 0;
@@ -886,17 +996,11 @@ pstd::vector<Shape> Curve::Create(const Transform *renderFromObject,
             ++cpOffset;
         }
 
-        pstd::span<const Normal3f> nspan;
-        if (!n.empty())
-            nspan = pstd::MakeSpan(&n[seg], 2);
-        auto c =
-            CreateCurve(renderFromObject, objectFromRender, reverseOrientation,
-                        segCpBezier, Lerp(Float(seg) / Float(nSegments), width0, width1),
-                        Lerp(Float(seg + 1) / Float(nSegments), width0, width1), type,
-                        nspan, sd, alloc);
-        curves.insert(curves.end(), c.begin(), c.end());
+        cpBezier.insert(cpBezier.end(), segCpBezier.begin(), segCpBezier.end());
     }
-    return curves;
+
+    return CreateCurve(renderFromObject, objectFromRender, reverseOrientation, cpBezier,
+                       widths, type, n, sd, alloc);
 }
 
 STAT_PIXEL_RATIO("Intersections/Ray-bilinear patch intersection tests", nBLPHits,
@@ -1378,6 +1482,138 @@ STAT_COUNTER("Geometry/Cylinders", nCylinders);
 STAT_COUNTER("Geometry/Disks", nDisks);
 STAT_COUNTER("Geometry/Triangles added from displacement mapping", displacedTrisDelta);
 
+STAT_COUNTER("Geometry/Displaced mesh patches", nDisplacedPatches);
+STAT_COUNTER("Geometry/Displaced mesh patch refinements", nDisplacedPatchRefinements);
+
+std::vector<DisplacedMeshPatch> CreateDisplacedMeshPatches(
+    const std::string &name, const Transform *renderFromObject, bool reverseOrientation,
+    const ParameterDictionary &parameters,
+    const std::map<std::string, FloatTexture> &floatTextures, const FileLoc *loc) {
+    if (name != "plymesh")
+        return {};
+    Float displacementBound = parameters.GetOneFloat("displacementbound", 0.f);
+    std::string displacementTexName = parameters.GetTexture("displacement");
+    if (displacementBound <= 0 || displacementTexName.empty())
+        return {};
+
+    auto iter = floatTextures.find(displacementTexName);
+    if (iter == floatTextures.end())
+        ErrorExit(loc, "%s: no such texture defined.", displacementTexName);
+    FloatTexture displacement = iter->second;
+    Float edgeLength = parameters.GetOneFloat("edgelength", 1.f);
+    edgeLength *= Options->displacementEdgeScale;
+    int patchSize = std::max(1, parameters.GetOneInt("patchsize", 64));
+    TriangleMeshStorage storage = GetTriangleMeshStorage(parameters, loc);
+
+    // Read the base mesh, which all of its patches share
+    std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
+    auto base = std::make_shared<TriQuadMesh>(TriQuadMesh::ReadPLY(filename));
+    base->ConvertToOnlyTriangles();
+    if (base->uv.empty())
+        ErrorExit(loc, "Vertex uvs are currently required by Displace(). Sorry.\n");
+    // Normals are computed over the whole mesh so that vertices on patch
+    // boundaries are displaced the same way by both patches; they are made
+    // unit length so that _displacementBound_ bounds the offsets.
+    if (base->n.empty())
+        base->ComputeNormals();
+    for (Normal3f &n : base->n)
+        if (LengthSquared(n) > 0)
+            n = Normalize(n);
+    int nTriangles = base->triIndices.size() / 3;
+    if (nTriangles == 0)
+        return {};
+
+    // Sort triangles along a Morton curve so that each patch is compact
+    Bounds3f meshBounds;
+    for (Point3f p : base->p)
+        meshBounds = Union(meshBounds, p);
+    std::vector<std::pair<uint32_t, int>> mortonTris(nTriangles);
+    ParallelFor(0, nTriangles, [&](int64_t i) {
+        const int *v = &base->triIndices[3 * i];
+        Point3f pc = (base->p[v[0]] + base->p[v[1]] + base->p[v[2]]) / 3;
+        constexpr int mortonScale = 1 << 10;
+        Vector3f offset = meshBounds.Offset(pc) * (mortonScale - 1);
+        mortonTris[i] = {EncodeMorton3(offset.x, offset.y, offset.z), int(i)};
+    });
+    std::sort(mortonTris.begin(), mortonTris.end());
+
+    std::vector<DisplacedMeshPatch> patches;
+    for (int start = 0; start < nTriangles; start += patchSize) {
+        // Find the patch's triangles and their displaced bounds
+        int end = std::min(nTriangles, start + patchSize);
+        auto tris = std::make_shared<std::vector<int>>();
+        Bounds3f bounds;
+        for (int i = start; i < end; ++i) {
+            int t = mortonTris[i].second;
+            tris->push_back(t);
+            for (int j = 0; j < 3; ++j)
+                bounds = Union(bounds, base->p[base->triIndices[3 * t + j]]);
+        }
+        Bounds3f objectBounds = Expand(bounds, displacementBound);
+
+        int meshIndex = Triangle::ReserveMeshIndex();
+        FileLoc patchLoc = *loc;
+        DisplacedMeshPatch patch;
+        patch.bounds = (*renderFromObject)(objectBounds);
+        patch.create = [=](Allocator alloc) {
+            // Copy the patch's triangles into their own mesh
+            TriQuadMesh mesh;
+            std::unordered_map<int, int> vertexMap;
+            for (int t : *tris)
+                for (int j = 0; j < 3; ++j) {
+                    int v = base->triIndices[3 * t + j];
+                    auto [iter, inserted] = vertexMap.insert({v, int(mesh.p.size())});
+                    if (inserted) {
+                        mesh.p.push_back(base->p[v]);
+                        mesh.n.push_back(base->n[v]);
+                        mesh.uv.push_back(base->uv[v]);
+                    }
+                    mesh.triIndices.push_back(iter->second);
+                }
+
+            // Refine and displace the patch
+            // This may run while rendering, so the vertices are displaced
+            // serially rather than with a nested ParallelFor.
+            mesh = mesh.Displace(
+                [&](Point3f v0, Point3f v1) {
+                    return Distance((*renderFromObject)(v0), (*renderFromObject)(v1));
+                },
+                edgeLength,
+                [&](Point3f *p, const Normal3f *n, const Point2f *uv, int nVertices) {
+                    for (int i = 0; i < nVertices; ++i) {
+                        TextureEvalContext ctx;
+                        ctx.p = p[i];
+                        ctx.uv = uv[i];
+                        Float d = UniversalTextureEvaluator()(displacement, ctx);
+                        p[i] += Vector3f(d * n[i]);
+                    }
+                },
+                &patchLoc);
+            ++nDisplacedPatchRefinements;
+            for (Point3f p : mesh.p)
+                if (!Inside(p, objectBounds)) {
+                    static std::atomic<bool> warned{false};
+                    if (!warned.exchange(true))
+                        Warning(&patchLoc,
+                                "Displacement exceeds \"displacementbound\" %f; "
+                                "geometry will be clipped.",
+                                displacementBound);
+                    break;
+                }
+
+            // Displace() doesn't carry face indices through refinement
+            TriangleMesh *triMesh = alloc.new_object<TriangleMesh>(
+                *renderFromObject, reverseOrientation, std::move(mesh.triIndices),
+                std::move(mesh.p), std::vector<Vector3f>(), std::move(mesh.n),
+                std::move(mesh.uv), std::vector<int>(), alloc, storage);
+            return Triangle::CreateTriangles(triMesh, alloc, meshIndex);
+        };
+        patches.push_back(std::move(patch));
+    }
+    nDisplacedPatches += patches.size();
+    return patches;
+}
+
 pstd::vector<Shape> Shape::Create(
     const std::string &name, const Transform *renderFromObject,
     const Transform *objectFromRender, bool reverseOrientation,
@@ -1454,19 +1690,29 @@ pstd::vector<Shape> Shape::Create(
             displacedTrisDelta += plyMesh.triIndices.size() / 3 - origTriCount;
         }
 
+        // The vertex data is moved into the last mesh that uses it
+        bool hasQuads = !plyMesh.quadIndices.empty();
         if (!plyMesh.triIndices.empty()) {
-            TriangleMesh *mesh = alloc.new_object<TriangleMesh>(
-                *renderFromObject, reverseOrientation, plyMesh.triIndices, plyMesh.p,
-                std::vector<Vector3f>(), plyMesh.n, plyMesh.uv, plyMesh.faceIndices,
-                alloc);
+            TriangleMesh *mesh;
+            if (hasQuads)
+                mesh = alloc.new_object<TriangleMesh>(
+                    *renderFromObject, reverseOrientation, std::move(plyMesh.triIndices),
+                    plyMesh.p, std::vector<Vector3f>(), plyMesh.n, plyMesh.uv,
+                    plyMesh.faceIndices, alloc, GetTriangleMeshStorage(parameters, loc));
+            else
+                mesh = alloc.new_object<TriangleMesh>(
+                    *renderFromObject, reverseOrientation, std::move(plyMesh.triIndices),
+                    std::move(plyMesh.p), std::vector<Vector3f>(), std::move(plyMesh.n),
+                    std::move(plyMesh.uv), std::move(plyMesh.faceIndices), alloc,
+                    GetTriangleMeshStorage(parameters, loc));
             shapes = Triangle::CreateTriangles(mesh, alloc);
         }
 
-        if (!plyMesh.quadIndices.empty()) {
+        if (hasQuads) {
             BilinearPatchMesh *mesh = alloc.new_object<BilinearPatchMesh>(
-                *renderFromObject, reverseOrientation, plyMesh.quadIndices, plyMesh.p,
-                plyMesh.n, plyMesh.uv, plyMesh.faceIndices, nullptr /* image dist */,
-                alloc);
+                *renderFromObject, reverseOrientation, std::move(plyMesh.quadIndices),
+                std::move(plyMesh.p), std::move(plyMesh.n), std::move(plyMesh.uv),
+                std::move(plyMesh.faceIndices), nullptr /* image dist */, alloc);
             pstd::vector<Shape> quadMesh = BilinearPatch::CreatePatches(mesh, alloc);
             shapes.insert(shapes.end(), quadMesh.begin(), quadMesh.end());
         }
@@ -1483,9 +1729,10 @@ pstd::vector<Shape> Shape::Create(
 
         // don't actually use this for now...
         std::string scheme = parameters.GetOneString("scheme", "loop");
+        Float edgeLength = parameters.GetOneFloat("edgelength", 0.f);
 
         TriangleMesh *mesh = LoopSubdivide(renderFromObject, reverseOrientation, nLevels,
-                                           vertexIndices, P, alloc);
+                                           vertexIndices, P, alloc, edgeLength);
 
         shapes = Triangle::CreateTriangles(mesh, alloc);
     } else
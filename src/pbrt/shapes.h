@@ -18,6 +18,7 @@
 #include <pbrt/util/vecmath.h>
 
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <memory>
 #include <vector>
@@ -104,6 +105,75 @@ struct QuadricIntersection {
     Float phi;
 };
 
+// FastQuadricResult Definition
+enum class FastQuadricResult { NoRoots, Roots, Uncertain };
+
+// Finds the parametric distances $t_0 \le t_1$ at which the ray $o + t\,d$ is
+// _radius_ from the origin, considering only the first _N_ coordinates, using
+// float arithmetic and conservative bounds on its error rather than
+// _Interval_ arithmetic. _Uncertain_ is returned if the discriminant's sign
+// or whether either root is in $(0, t_{max})$ can't be decided that way.
+template <int N>
+PBRT_CPU_GPU inline FastQuadricResult FastQuadricRoots(Point3fi oi, Vector3fi di,
+                                                       Float radius, Float tMax,
+                                                       Interval *t0, Interval *t1) {
+    Point3f o(oi);
+    Vector3f d(di), oError = oi.Error(), dError = di.Error();
+    Float oo = 0, od = 0, dd = 0, eo = 0, ed = 0;
+    for (int i = 0; i < N; ++i) {
+        oo += Sqr(o[i]);
+        od += o[i] * d[i];
+        dd += Sqr(d[i]);
+        eo += Sqr(oError[i]);
+        ed += Sqr(dError[i]);
+    }
+    if (dd == 0)
+        return FastQuadricResult::Uncertain;
+    Float oLength = std::sqrt(oo), dLength = std::sqrt(dd);
+    eo = std::sqrt(eo);
+    ed = std::sqrt(ed);
+
+    // Compute the ray's closest approach to the origin, _tMid_, and its error
+    Float tMid = -od / dd;
+    Float tMidError = (eo * dLength + oLength * ed + gamma(N) * oLength * dLength) / dd +
+                      std::abs(tMid) * (2 * ed / dLength + gamma(N + 1));
+
+    // Compute the distance from the origin at _tMid_ and its error
+    Float ll = 0;
+    for (int i = 0; i < N; ++i)
+        ll += Sqr(o[i] + tMid * d[i]);
+    Float length = std::sqrt(ll);
+    Float lengthError = eo + tMidError * dLength + std::abs(tMid) * ed +
+                        gamma(N + 3) * (oLength + std::abs(tMid) * dLength);
+
+    // Decide the sign of the scaled discriminant $r^2 - \ell^2$
+    Float h2 = (radius - length) * (radius + length);
+    Float h2Error = (2 * length + lengthError) * lengthError +
+                    gamma(3) * Sqr(radius + length);
+    if (h2 + h2Error < 0)
+        return FastQuadricResult::NoRoots;
+    if (h2 - h2Error <= 0)
+        return FastQuadricResult::Uncertain;
+
+    // Compute the roots' half-separation _h_ and the roots' error, doubled to
+    // cover the terms that the bounds above neglect
+    Float sqrtH2 = std::sqrt(h2);
+    Float h = sqrtH2 / dLength;
+    Float tError = 2 * (tMidError + h2Error / (sqrtH2 * dLength) +
+                        h * (ed / dLength + gamma(N + 2)) +
+                        gamma(1) * (std::abs(tMid) + h));
+    Float tLow = tMid - h, tHigh = tMid + h;
+    auto straddles = [&](Float t, Float v) {
+        return t - tError <= v && t + tError >= v;
+    };
+    if (straddles(tLow, 0) || straddles(tHigh, 0) || straddles(tLow, tMax) ||
+        straddles(tHigh, tMax))
+        return FastQuadricResult::Uncertain;
+    *t0 = Interval(tLow - tError, tLow + tError);
+    *t1 = Interval(tHigh - tError, tHigh + tError);
+    return FastQuadricResult::Roots;
+}
+
 // Sphere Definition
 class Sphere {
   public:
@@ -154,28 +224,33 @@ class Sphere {
 
         // Solve quadratic equation to compute sphere _t0_ and _t1_
         Interval t0, t1;
-        // Compute sphere quadratic coefficients
-        Interval a = Sqr(di.x) + Sqr(di.y) + Sqr(di.z);
-        Interval b = 2 * (di.x * oi.x + di.y * oi.y + di.z * oi.z);
-        Interval c = Sqr(oi.x) + Sqr(oi.y) + Sqr(oi.z) - Sqr(Interval(radius));
-
-        // Compute sphere quadratic discriminant _discrim_
-        Vector3fi v(oi - b / (2 * a) * di);
-        Interval length = Length(v);
-        Interval discrim =
-            4 * a * (Interval(radius) + length) * (Interval(radius) - length);
-        if (discrim.LowerBound() < 0)
+        FastQuadricResult roots = FastQuadricRoots<3>(oi, di, radius, tMax, &t0, &t1);
+        if (roots == FastQuadricResult::NoRoots)
             return {};
+        if (roots == FastQuadricResult::Uncertain) {
+            // Compute sphere quadratic coefficients
+            Interval a = Sqr(di.x) + Sqr(di.y) + Sqr(di.z);
+            Interval b = 2 * (di.x * oi.x + di.y * oi.y + di.z * oi.z);
+            Interval c = Sqr(oi.x) + Sqr(oi.y) + Sqr(oi.z) - Sqr(Interval(radius));
+
+            // Compute sphere quadratic discriminant _discrim_
+            Vector3fi v(oi - b / (2 * a) * di);
+            Interval length = Length(v);
+            Interval discrim =
+                4 * a * (Interval(radius) + length) * (Interval(radius) - length);
+            if (discrim.LowerBound() < 0)
+                return {};
 
-        // Compute quadratic $t$ values
-        Interval rootDiscrim = Sqrt(discrim);
-        Interval q;
-        if ((Float)b < 0)
-            q = -.5f * (b - rootDiscrim);
-        else
-            q = -.5f * (b + rootDiscrim);
-        t0 = q / a;
-        t1 = c / q;
+            // Compute quadratic $t$ values
+            Interval rootDiscrim = Sqrt(discrim);
+            Interval q;
+            if ((Float)b < 0)
+                q = -.5f * (b - rootDiscrim);
+            else
+                q = -.5f * (b + rootDiscrim);
+            t0 = q / a;
+            t1 = c / q;
+        }
         // Swap quadratic $t$ values so that _t0_ is the lesser
         if (t0.LowerBound() > t1.LowerBound())
             pstd::swap(t0, t1);
@@ -614,29 +689,34 @@ class Cylinder {
 
         // Solve quadratic equation to find cylinder _t0_ and _t1_ values
         Interval t0, t1;
-        // Compute cylinder quadratic coefficients
-        Interval a = Sqr(di.x) + Sqr(di.y);
-        Interval b = 2 * (di.x * oi.x + di.y * oi.y);
-        Interval c = Sqr(oi.x) + Sqr(oi.y) - Sqr(Interval(radius));
-
-        // Compute cylinder quadratic discriminant _discrim_
-        Interval f = b / (2 * a);
-        Interval vx = oi.x - f * di.x, vy = oi.y - f * di.y;
-        Interval length = Sqrt(Sqr(vx) + Sqr(vy));
-        Interval discrim =
-            4 * a * (Interval(radius) + length) * (Interval(radius) - length);
-        if (discrim.LowerBound() < 0)
+        FastQuadricResult roots = FastQuadricRoots<2>(oi, di, radius, tMax, &t0, &t1);
+        if (roots == FastQuadricResult::NoRoots)
             return {};
+        if (roots == FastQuadricResult::Uncertain) {
+            // Compute cylinder quadratic coefficients
+            Interval a = Sqr(di.x) + Sqr(di.y);
+            Interval b = 2 * (di.x * oi.x + di.y * oi.y);
+            Interval c = Sqr(oi.x) + Sqr(oi.y) - Sqr(Interval(radius));
+
+            // Compute cylinder quadratic discriminant _discrim_
+            Interval f = b / (2 * a);
+            Interval vx = oi.x - f * di.x, vy = oi.y - f * di.y;
+            Interval length = Sqrt(Sqr(vx) + Sqr(vy));
+            Interval discrim =
+                4 * a * (Interval(radius) + length) * (Interval(radius) - length);
+            if (discrim.LowerBound() < 0)
+                return {};
 
-        // Compute quadratic $t$ values
-        Interval rootDiscrim = Sqrt(discrim);
-        Interval q;
-        if ((Float)b < 0)
-            q = -.5f * (b - rootDiscrim);
-        else
-            q = -.5f * (b + rootDiscrim);
-        t0 = q / a;
-        t1 = c / q;
+            // Compute quadratic $t$ values
+            Interval rootDiscrim = Sqrt(discrim);
+            Interval q;
+            if ((Float)b < 0)
+                q = -.5f * (b - rootDiscrim);
+            else
+                q = -.5f * (b + rootDiscrim);
+            t0 = q / a;
+            t1 = c / q;
+        }
         // Swap quadratic $t$ values so that _t0_ is the lesser
         if (t0.LowerBound() > t1.LowerBound())
             pstd::swap(t0, t1);
@@ -834,13 +914,23 @@ pstd::optional<TriangleIntersection> IntersectTriangle(const Ray &ray, Float tMa
 class Triangle {
   public:
     // Triangle Public Methods
-    static pstd::vector<Shape> CreateTriangles(const TriangleMesh *mesh, Allocator alloc);
+    static pstd::vector<Shape> CreateTriangles(const TriangleMesh *mesh, Allocator alloc,
+                                               int meshIndex = -1);
+    // Returns an index for CreateTriangles() to store a mesh at, so that a
+    // mesh that is re-created while rendering replaces its earlier versions.
+    static int ReserveMeshIndex();
+    // Makes the triangles of the mesh at _meshIndex_ use the vertices of the
+    // one at _newMeshIndex_, which replaces it; returns false without doing
+    // so if the two meshes don't have the same triangles.
+    static bool ReplaceMesh(int meshIndex, int newMeshIndex);
 
     Triangle() = default;
     Triangle(int meshIndex, int triIndex) : meshIndex(meshIndex), triIndex(triIndex) {}
 
     static void Init(Allocator alloc);
 
+    int MeshIndex() const { return meshIndex; }
+
     PBRT_CPU_GPU
     Bounds3f Bounds() const;
 
@@ -850,16 +940,34 @@ class Triangle {
     PBRT_CPU_GPU
     bool IntersectP(const Ray &ray, Float tMax = Infinity) const;
 
+    // Finds the ray's intersection without computing its _SurfaceInteraction_,
+    // which InteractionFromIntersection() then computes if it is needed.
+    PBRT_CPU_GPU
+    pstd::optional<TriangleIntersection> IntersectBarycentrics(
+        const Ray &ray, Float tMax = Infinity) const;
+    PBRT_CPU_GPU
+    SurfaceInteraction InteractionFromIntersection(TriangleIntersection ti, Float time,
+                                                   Vector3f wo) const {
+        return InteractionFromIntersection(GetMesh(), triIndex, ti, time, wo);
+    }
+
     PBRT_CPU_GPU
     Float Area() const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
-        Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+        pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+        Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
         return 0.5f * Length(Cross(p1 - p0, p2 - p0));
     }
 
+    PBRT_CPU_GPU
+    pstd::array<Point3f, 3> Vertices() const {
+        const TriangleMesh *mesh = GetMesh();
+        pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+        return {mesh->P(v[0]), mesh->P(v[1]), mesh->P(v[2])};
+    }
+
     PBRT_CPU_GPU
     DirectionCone NormalBounds() const;
 
@@ -874,8 +982,8 @@ class Triangle {
     Float SolidAngle(Point3f p) const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
-        Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+        pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+        Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
         return SphericalTriangleArea(Normalize(p0 - p), Normalize(p1 - p),
                                      Normalize(p2 - p));
@@ -886,15 +994,15 @@ class Triangle {
                                                           int triIndex,
                                                           TriangleIntersection ti,
                                                           Float time, Vector3f wo) {
-        const int *v = &mesh->vertexIndices[3 * triIndex];
-        Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+        pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+        Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
         // Compute triangle partial derivatives
         // Compute deltas and matrix determinant for triangle partial derivatives
         // Get triangle texture coordinates in _uv_ array
         pstd::array<Point2f, 3> uv =
-            mesh->uv
+            mesh->HasUVs()
                 ? pstd::array<Point2f, 3>(
-                      {mesh->uv[v[0]], mesh->uv[v[1]], mesh->uv[v[2]]})
+                      {mesh->UV(v[0]), mesh->UV(v[1]), mesh->UV(v[2])})
                 : pstd::array<Point2f, 3>({Point2f(0, 0), Point2f(1, 0), Point2f(1, 1)});
 
         Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
@@ -938,13 +1046,13 @@ class Triangle {
         if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
             isect.n = isect.shading.n = -isect.n;
 
-        if (mesh->n || mesh->s) {
+        if (mesh->HasNormals() || mesh->s) {
             // Initialize _Triangle_ shading geometry
             // Compute shading normal _ns_ for triangle
             Normal3f ns;
-            if (mesh->n) {
+            if (mesh->HasNormals()) {
                 ns =
-                    ti.b0 * mesh->n[v[0]] + ti.b1 * mesh->n[v[1]] + ti.b2 * mesh->n[v[2]];
+                    ti.b0 * mesh->N(v[0]) + ti.b1 * mesh->N(v[1]) + ti.b2 * mesh->N(v[2]);
                 ns = LengthSquared(ns) > 0 ? Normalize(ns) : isect.n;
             } else
                 ns = isect.n;
@@ -968,12 +1076,12 @@ class Triangle {
 
             // Compute $\dndu$ and $\dndv$ for triangle shading geometry
             Normal3f dndu, dndv;
-            if (mesh->n) {
+            if (mesh->HasNormals()) {
                 // Compute deltas for triangle partial derivatives of normal
                 Vector2f duv02 = uv[0] - uv[2];
                 Vector2f duv12 = uv[1] - uv[2];
-                Normal3f dn1 = mesh->n[v[0]] - mesh->n[v[2]];
-                Normal3f dn2 = mesh->n[v[1]] - mesh->n[v[2]];
+                Normal3f dn1 = mesh->N(v[0]) - mesh->N(v[2]);
+                Normal3f dn2 = mesh->N(v[1]) - mesh->N(v[2]);
 
                 Float determinant =
                     DifferenceOfProducts(duv02[0], duv12[1], duv02[1], duv12[0]);
@@ -985,8 +1093,8 @@ class Triangle {
                     // (rather than giving up) so that ray differentials for
                     // rays reflected from triangles with degenerate
                     // parameterizations are still reasonable.
-                    Vector3f dn = Cross(Vector3f(mesh->n[v[2]] - mesh->n[v[0]]),
-                                        Vector3f(mesh->n[v[1]] - mesh->n[v[0]]));
+                    Vector3f dn = Cross(Vector3f(mesh->N(v[2]) - mesh->N(v[0])),
+                                        Vector3f(mesh->N(v[1]) - mesh->N(v[0])));
 
                     if (LengthSquared(dn) == 0)
                         dndu = dndv = Normal3f(0, 0, 0);
@@ -1014,8 +1122,8 @@ class Triangle {
     pstd::optional<ShapeSample> Sample(Point2f u) const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
-        Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+        pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+        Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
         // Sample point on triangle uniformly by area
         pstd::array<Float, 3> b = SampleUniformTriangle(u);
@@ -1023,9 +1131,9 @@ class Triangle {
 
         // Compute surface normal for sampled point on triangle
         Normal3f n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
-        if (mesh->n) {
-            Normal3f ns(b[0] * mesh->n[v[0]] + b[1] * mesh->n[v[1]] +
-                        (1 - b[0] - b[1]) * mesh->n[v[2]]);
+        if (mesh->HasNormals()) {
+            Normal3f ns(b[0] * mesh->N(v[0]) + b[1] * mesh->N(v[1]) +
+                        (1 - b[0] - b[1]) * mesh->N(v[2]));
             n = FaceForward(n, ns);
         } else if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
             n *= -1;
@@ -1033,9 +1141,9 @@ class Triangle {
         // Compute $(u,v)$ for sampled point on triangle
         // Get triangle texture coordinates in _uv_ array
         pstd::array<Point2f, 3> uv =
-            mesh->uv
+            mesh->HasUVs()
                 ? pstd::array<Point2f, 3>(
-                      {mesh->uv[v[0]], mesh->uv[v[1]], mesh->uv[v[2]]})
+                      {mesh->UV(v[0]), mesh->UV(v[1]), mesh->UV(v[2])})
                 : pstd::array<Point2f, 3>({Point2f(0, 0), Point2f(1, 0), Point2f(1, 1)});
 
         Point2f uvSample = b[0] * uv[0] + b[1] * uv[1] + b[2] * uv[2];
@@ -1054,8 +1162,8 @@ class Triangle {
     pstd::optional<ShapeSample> Sample(const ShapeSampleContext &ctx, Point2f u) const {
         // Get triangle vertices in _p0_, _p1_, and _p2_
         const TriangleMesh *mesh = GetMesh();
-        const int *v = &mesh->vertexIndices[3 * triIndex];
-        Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+        pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+        Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
         // Use uniform area sampling for numerically unstable cases
         Float solidAngle = SolidAngle(ctx.p());
@@ -1110,9 +1218,9 @@ class Triangle {
         Point3f p = b[0] * p0 + b[1] * p1 + b[2] * p2;
         // Compute surface normal for sampled point on triangle
         Normal3f n = Normalize(Normal3f(Cross(p1 - p0, p2 - p0)));
-        if (mesh->n) {
-            Normal3f ns(b[0] * mesh->n[v[0]] + b[1] * mesh->n[v[1]] +
-                        (1 - b[0] - b[1]) * mesh->n[v[2]]);
+        if (mesh->HasNormals()) {
+            Normal3f ns(b[0] * mesh->N(v[0]) + b[1] * mesh->N(v[1]) +
+                        (1 - b[0] - b[1]) * mesh->N(v[2]));
             n = FaceForward(n, ns);
         } else if (mesh->reverseOrientation ^ mesh->transformSwapsHandedness)
             n *= -1;
@@ -1120,9 +1228,9 @@ class Triangle {
         // Compute $(u,v)$ for sampled point on triangle
         // Get triangle texture coordinates in _uv_ array
         pstd::array<Point2f, 3> uv =
-            mesh->uv
+            mesh->HasUVs()
                 ? pstd::array<Point2f, 3>(
-                      {mesh->uv[v[0]], mesh->uv[v[1]], mesh->uv[v[2]]})
+                      {mesh->UV(v[0]), mesh->UV(v[1]), mesh->UV(v[2])})
                 : pstd::array<Point2f, 3>({Point2f(0, 0), Point2f(1, 0), Point2f(1, 1)});
 
         Point2f uvSample = b[0] * uv[0] + b[1] * uv[1] + b[2] * uv[2];
@@ -1155,8 +1263,8 @@ class Triangle {
         if (ctx.ns != Normal3f(0, 0, 0)) {
             // Get triangle vertices in _p0_, _p1_, and _p2_
             const TriangleMesh *mesh = GetMesh();
-            const int *v = &mesh->vertexIndices[3 * triIndex];
-            Point3f p0 = mesh->p[v[0]], p1 = mesh->p[v[1]], p2 = mesh->p[v[2]];
+            pstd::array<int, 3> v = mesh->TriangleVertexIndices(triIndex);
+            Point3f p0 = mesh->P(v[0]), p1 = mesh->P(v[1]), p2 = mesh->P(v[2]);
 
             Point2f u = InvertSphericalTriangleSample({p0, p1, p2}, ctx.p(), wi);
             // Compute $\cos\theta$-based weights _w_ at sample domain corners
@@ -1192,6 +1300,22 @@ class Triangle {
     static constexpr Float MaxSphericalSampleArea = 6.22;
 };
 
+// DisplacedMeshPatch Definition
+// A group of nearby triangles of a displaced mesh that are only refined and
+// displaced when _create_ is called. _bounds_ is conservative, in rendering
+// space.
+struct DisplacedMeshPatch {
+    Bounds3f bounds;
+    std::function<pstd::vector<Shape>(Allocator)> create;
+};
+
+// Returns patches for a "plymesh" with a "displacement" texture and a positive
+// "displacementbound"; otherwise the shape is created by Shape::Create().
+std::vector<DisplacedMeshPatch> CreateDisplacedMeshPatches(
+    const std::string &name, const Transform *renderFromObject, bool reverseOrientation,
+    const ParameterDictionary &parameters,
+    const std::map<std::string, FloatTexture> &floatTextures, const FileLoc *loc);
+
 // CurveType Definition
 enum class CurveType { Flat, Cylinder, Ribbon };
 
@@ -1200,20 +1324,60 @@ std::string ToString(CurveType type);
 // CurveCommon Definition
 struct CurveCommon {
     // CurveCommon Public Methods
-    CurveCommon(pstd::span<const Point3f> c, Float w0, Float w1, CurveType type,
+    CurveCommon(pstd::span<const Point3f> c, pstd::span<const Float> w, CurveType type,
                 pstd::span<const Normal3f> norm, const Transform *renderFromObject,
-                const Transform *objectFromRender, bool reverseOrientation);
+                const Transform *objectFromRender, bool reverseOrientation,
+                Allocator alloc);
+
+    PBRT_CPU_GPU
+    pstd::span<const Point3f> ControlPoints(int segment) const {
+        return pstd::MakeConstSpan(cpObj + cpStride * segment, 4);
+    }
+
+    PBRT_CPU_GPU
+    Float Width(int segment, Float u) const {
+        return Lerp(u, EndpointWidth(segment), EndpointWidth(segment + 1));
+    }
+
+    PBRT_CPU_GPU
+    Float MaxWidth(int segment) const {
+        return std::max(EndpointWidth(segment), EndpointWidth(segment + 1));
+    }
+
+    PBRT_CPU_GPU
+    Normal3f RibbonNormal(int segment, Float u) const {
+        Float normalAngle = normalAngles[2 * segment];
+        if (normalAngle == 0)
+            return n[segment];
+        Float invSinNormalAngle = normalAngles[2 * segment + 1];
+        Float sin0 = std::sin((1 - u) * normalAngle) * invSinNormalAngle;
+        Float sin1 = std::sin(u * normalAngle) * invSinNormalAngle;
+        return sin0 * n[segment] + sin1 * n[segment + 1];
+    }
 
     std::string ToString() const;
 
     // CurveCommon Public Members
     CurveType type;
-    Point3f cpObj[4];
-    Float width[2];
-    Normal3f n[2];
-    Float normalAngle, invSinNormalAngle;
+    int nSegments, cpStride;
+    // Cubic Bezier control points, shared by all of a curve's segments;
+    // segment _i_ uses the four starting at _cpObj[cpStride * i]_
+    const Point3f *cpObj;
+    // Widths and ribbon normals at segment endpoints
+    const uint16_t *widthHalf = nullptr;
+    const Float *width = nullptr;
+    const Normal3f *n = nullptr;
+    // Angle between each ribbon segment's normals and its inverse sine
+    const Float *normalAngles = nullptr;
     const Transform *renderFromObject, *objectFromRender;
     bool reverseOrientation, transformSwapsHandedness;
+
+  private:
+    // CurveCommon Private Methods
+    PBRT_CPU_GPU
+    Float EndpointWidth(int i) const {
+        return widthHalf ? Float(float(Half::FromBits(widthHalf[i]))) : width[i];
+    }
 };
 
 // Curve Definition
@@ -1245,8 +1409,14 @@ class Curve {
 
     std::string ToString() const;
 
-    Curve(const CurveCommon *common, Float uMin, Float uMax)
-        : common(common), uMin(uMin), uMax(uMax) {}
+    Curve(const CurveCommon *common, int segment, Float uMin, Float uMax)
+        : common(common),
+          segment(segment),
+          uMinFixed(uMin * UFixedScale),
+          uMaxFixed(uMax * UFixedScale) {
+        DCHECK_EQ(UMin(), uMin);
+        DCHECK_EQ(UMax(), uMax);
+    }
 
     PBRT_CPU_GPU
     DirectionCone NormalBounds() const { return DirectionCone::EntireSphere(); }
@@ -1256,12 +1426,21 @@ class Curve {
     bool IntersectRay(const Ray &r, Float tMax,
                       pstd::optional<ShapeIntersection> *si) const;
     bool RecursiveIntersect(const Ray &r, Float tMax, pstd::span<const Point3f> cp,
-                            const Transform &ObjectFromRay, Float u0, Float u1, int depth,
+                            const Frame &rayFrame, Float u0, Float u1, int depth,
                             pstd::optional<ShapeIntersection> *si) const;
 
+    PBRT_CPU_GPU
+    Float UMin() const { return uMinFixed / UFixedScale; }
+    PBRT_CPU_GPU
+    Float UMax() const { return uMaxFixed / UFixedScale; }
+
     // Curve Private Members
+    // Segment $u$ ranges are stored as fixed-point values; this is exact for
+    // the power-of-two subdivisions made by _Curve::Create()_
+    static constexpr Float UFixedScale = 32768;
     const CurveCommon *common;
-    Float uMin, uMax;
+    uint32_t segment;
+    uint16_t uMinFixed, uMaxFixed;
 };
 
 // BilinearPatch Declarations
@@ -1277,10 +1456,14 @@ struct BilinearIntersection {
 };
 
 // Bilinear Patch Inline Functions
+// This variant takes the ray-independent terms _n_, which must equal
+// Cross(p10 - p00, p01 - p11), and _pMax_, the sum of the vertices' maximum
+// absolute coordinates, so that they can be precomputed.
 PBRT_CPU_GPU inline pstd::optional<BilinearIntersection> IntersectBilinearPatch(
-    const Ray &ray, Float tMax, Point3f p00, Point3f p10, Point3f p01, Point3f p11) {
+    const Ray &ray, Float tMax, Point3f p00, Point3f p10, Point3f p01, Point3f p11,
+    Vector3f n, Float pMax) {
     // Find quadratic coefficients for distance from ray to $u$ iso-lines
-    Float a = Dot(Cross(p10 - p00, p01 - p11), ray.d);
+    Float a = Dot(n, ray.d);
     Float c = Dot(Cross(p00 - ray.o, ray.d), p01 - p00);
     Float b = Dot(Cross(p10 - ray.o, ray.d), p11 - p10) - (a + c);
 
@@ -1290,10 +1473,8 @@ PBRT_CPU_GPU inline pstd::optional<BilinearIntersection> IntersectBilinearPatch(
         return {};
 
     // Find epsilon _eps_ to ensure that candidate $t$ is greater than zero
-    Float eps =
-        gamma(10) * (MaxComponentValue(Abs(ray.o)) + MaxComponentValue(Abs(ray.d)) +
-                     MaxComponentValue(Abs(p00)) + MaxComponentValue(Abs(p10)) +
-                     MaxComponentValue(Abs(p01)) + MaxComponentValue(Abs(p11)));
+    Float eps = gamma(10) *
+                (MaxComponentValue(Abs(ray.o)) + MaxComponentValue(Abs(ray.d)) + pMax);
 
     // Compute $v$ and $t$ for the first $u$ intersection
     Float t = tMax, u, v;
@@ -1347,6 +1528,14 @@ PBRT_CPU_GPU inline pstd::optional<BilinearIntersection> IntersectBilinearPatch(
     return BilinearIntersection{{u, v}, t};
 }
 
+PBRT_CPU_GPU inline pstd::optional<BilinearIntersection> IntersectBilinearPatch(
+    const Ray &ray, Float tMax, Point3f p00, Point3f p10, Point3f p01, Point3f p11) {
+    return IntersectBilinearPatch(
+        ray, tMax, p00, p10, p01, p11, Cross(p10 - p00, p01 - p11),
+        MaxComponentValue(Abs(p00)) + MaxComponentValue(Abs(p10)) +
+            MaxComponentValue(Abs(p01)) + MaxComponentValue(Abs(p11)));
+}
+
 // BilinearPatch Definition
 class BilinearPatch {
   public:
@@ -1393,6 +1582,14 @@ class BilinearPatch {
     PBRT_CPU_GPU
     Float Area() const { return area; }
 
+    // Returns the patch's vertices in the order $p_{00}$, $p_{10}$, $p_{01}$, $p_{11}$.
+    PBRT_CPU_GPU
+    pstd::array<Point3f, 4> Vertices() const {
+        const BilinearPatchMesh *mesh = GetMesh();
+        const int *v = &mesh->vertexIndices[4 * blpIndex];
+        return {mesh->p[v[0]], mesh->p[v[1]], mesh->p[v[2]], mesh->p[v[3]]};
+    }
+
     PBRT_CPU_GPU
     static SurfaceInteraction InteractionFromIntersection(const BilinearPatchMesh *mesh,
                                                           int blpIndex, Point2f uv,
@@ -1497,6 +1694,13 @@ class BilinearPatch {
         return isect;
     }
 
+    // Returns true if Sample() maps its sample directly to the patch's $(u,v)$
+    // coordinates, which are also its texture coordinates, with a constant PDF.
+    bool IsUniformlyParameterized() const {
+        const BilinearPatchMesh *mesh = GetMesh();
+        return IsRectangle(mesh) && !mesh->imageDistribution && !mesh->uv;
+    }
+
   private:
     // BilinearPatch Private Methods
     PBRT_CPU_GPU
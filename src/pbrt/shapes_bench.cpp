@@ -0,0 +1,47 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/shapes.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
+
+#include <vector>
+
+using namespace pbrt;
+
+// Intersects rays from around the unit cube with random triangles inside it;
+// about half of the tests find an intersection.
+static void IntersectTriangle(benchmark::State &state) {
+    struct Test {
+        Ray ray;
+        Point3f p[3];
+    };
+    RNG rng;
+    std::vector<Test> tests(1024);
+    for (Test &t : tests) {
+        for (int v = 0; v < 3; ++v)
+            t.p[v] = Point3f(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                             rng.Uniform<Float>());
+        Point3f o = Point3f(0.5, 0.5, 0.5) +
+                    2 * SampleUniformSphere({rng.Uniform<Float>(), rng.Uniform<Float>()});
+        Point3f target(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        t.ray = Ray(o, target - o);
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const Test &t = tests[i];
+        benchmark::DoNotOptimize(
+            pbrt::IntersectTriangle(t.ray, Infinity, t.p[0], t.p[1], t.p[2]));
+        i = (i + 1) % tests.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(IntersectTriangle);
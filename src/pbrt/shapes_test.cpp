@@ -8,6 +8,7 @@
 
 #include <pbrt/interaction.h>
 #include <pbrt/shapes.h>
+#include <pbrt/util/loopsubdiv.h>
 #include <pbrt/util/lowdiscrepancy.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
@@ -16,6 +17,7 @@
 
 #include <cmath>
 #include <functional>
+#include <map>
 
 using namespace pbrt;
 
@@ -354,6 +356,44 @@ TEST(FullSphere, Reintersect) {
     });
 }
 
+TEST(Sphere, FastQuadricRoots) {
+    RNG rng;
+    int nRoots = 0;
+    for (int i = 0; i < 100000; ++i) {
+        Float radius = pExp(rng, 2);
+        Point3f o(pUnif(rng) * radius, pUnif(rng) * radius, pUnif(rng) * radius);
+        Vector3f d(pUnif(rng, 1), pUnif(rng, 1), pUnif(rng, 1));
+        d *= pExp(rng, 2);
+        Point3fi oi(o, gamma(3) * Abs(Vector3f(o)));
+        Vector3fi di(d, gamma(3) * Abs(d));
+        Float tMax = (i & 1) ? Infinity : 30 * rng.Uniform<Float>();
+
+        // Compute the roots in double precision
+        double a = 0, b = 0, c = -Sqr(double(radius));
+        for (int j = 0; j < 3; ++j) {
+            a += Sqr(double(d[j]));
+            b += 2 * double(o[j]) * d[j];
+            c += Sqr(double(o[j]));
+        }
+        double discrim = Sqr(b) - 4 * a * c;
+
+        Interval t0, t1;
+        FastQuadricResult result = FastQuadricRoots<3>(oi, di, radius, tMax, &t0, &t1);
+        if (result == FastQuadricResult::NoRoots)
+            EXPECT_LT(discrim, 1e-5 * (Sqr(b) + 4 * a * std::abs(c)));
+        else if (result == FastQuadricResult::Roots) {
+            // The float roots' bounds must contain the exact roots
+            ++nRoots;
+            ASSERT_GE(discrim, 0);
+            double q = -.5 * (b < 0 ? b - std::sqrt(discrim) : b + std::sqrt(discrim));
+            double r0 = std::min(q / a, c / q), r1 = std::max(q / a, c / q);
+            EXPECT_TRUE(r0 >= t0.LowerBound() && r0 <= t0.UpperBound()) << r0 << t0;
+            EXPECT_TRUE(r1 >= t1.LowerBound() && r1 <= t1.UpperBound()) << r1 << t1;
+        }
+    }
+    EXPECT_GT(nRoots, 100);
+}
+
 TEST(ParialSphere, Normal) {
     for (int i = 0; i < 100; ++i) {
         RNG rng(i);
@@ -448,6 +488,157 @@ TEST(Triangle, BadCases) {
     EXPECT_FALSE(tris[0].Intersect(ray).has_value());
 }
 
+TEST(Triangle, ReplaceMesh) {
+    Transform identity;
+    std::vector<int> indices{0, 1, 2, 0, 2, 3};
+    std::vector<Point3f> p{Point3f(0, 0, 0), Point3f(1, 0, 0), Point3f(1, 1, 0),
+                           Point3f(0, 1, 0)};
+    TriangleMesh mesh(identity, false, indices, p, {}, {}, {}, {}, Allocator());
+    pstd::vector<Shape> tris = Triangle::CreateTriangles(&mesh, Allocator());
+
+    // A mesh with moved vertices replaces the original for its triangles
+    std::vector<Point3f> moved = p;
+    for (Point3f &pt : moved)
+        pt.z += 2;
+    TriangleMesh movedMesh(identity, false, indices, moved, {}, {}, {}, {}, Allocator());
+    pstd::vector<Shape> movedTris = Triangle::CreateTriangles(&movedMesh, Allocator());
+    int meshIndex = tris[0].Cast<Triangle>()->MeshIndex();
+    EXPECT_TRUE(
+        Triangle::ReplaceMesh(meshIndex, movedTris[0].Cast<Triangle>()->MeshIndex()));
+    for (Shape tri : tris) {
+        EXPECT_EQ(2, tri.Bounds().pMin.z);
+        EXPECT_EQ(2, tri.Bounds().pMax.z);
+    }
+
+    // Meshes with different triangles aren't replaced
+    std::vector<int> flipped{0, 2, 1, 0, 3, 2};
+    TriangleMesh flippedMesh(identity, false, flipped, p, {}, {}, {}, {}, Allocator());
+    pstd::vector<Shape> flippedTris =
+        Triangle::CreateTriangles(&flippedMesh, Allocator());
+    EXPECT_FALSE(
+        Triangle::ReplaceMesh(meshIndex, flippedTris[0].Cast<Triangle>()->MeshIndex()));
+    EXPECT_EQ(2, tris[0].Bounds().pMin.z);
+}
+
+TEST(Triangle, CompactStorage) {
+    // Create a bumpy grid mesh with normals and uvs
+    Transform identity;
+    int res = 16;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    std::vector<Normal3f> n;
+    std::vector<Point2f> uv;
+    RNG rng;
+    for (int y = 0; y <= res; ++y)
+        for (int x = 0; x <= res; ++x) {
+            p.push_back(Point3f(x, y, 0.25f * rng.Uniform<Float>()));
+            n.push_back(Normalize(Normal3f(pUnif(rng, 0.2), pUnif(rng, 0.2), 1)));
+            uv.push_back(Point2f(Float(x) / res, Float(y) / res));
+        }
+    for (int y = 0; y < res; ++y)
+        for (int x = 0; x < res; ++x) {
+            int v = y * (res + 1) + x;
+            for (int i : {v, v + 1, v + res + 2, v, v + res + 2, v + res + 1})
+                indices.push_back(i);
+        }
+
+    TriangleMesh full(identity, false, indices, p, {}, n, uv, {}, Allocator());
+    for (TriangleMeshStorage storage :
+         {TriangleMeshStorage::Compact, TriangleMeshStorage::Quantized}) {
+        TriangleMesh compact(identity, false, indices, p, {}, n, uv, {}, Allocator(),
+                             storage);
+        EXPECT_TRUE(compact.vertexIndices16 != nullptr);
+        EXPECT_EQ(storage == TriangleMeshStorage::Quantized, compact.p == nullptr);
+
+        pstd::vector<Shape> fullTris = Triangle::CreateTriangles(&full, Allocator());
+        pstd::vector<Shape> compactTris =
+            Triangle::CreateTriangles(&compact, Allocator());
+        for (int i = 0; i < full.nVertices; ++i) {
+            EXPECT_LT(Distance(full.P(i), compact.P(i)), 1e-3f);
+            EXPECT_GT(Dot(full.N(i), compact.N(i)), 0.9999f);
+            EXPECT_LT(Distance(full.UV(i), compact.UV(i)), 1e-3f);
+        }
+
+        // Compare intersections with random rays shot down at the grid
+        for (int i = 0; i < 1000; ++i) {
+            Point3f o(Lerp(rng.Uniform<Float>(), 0.5, res - 0.5),
+                      Lerp(rng.Uniform<Float>(), 0.5, res - 0.5), 10);
+            Ray ray(o, Vector3f(0, 0, -1));
+            pstd::optional<ShapeIntersection> fullSi, compactSi;
+            for (size_t t = 0; t < fullTris.size(); ++t) {
+                if (!fullSi)
+                    fullSi = fullTris[t].Intersect(ray);
+                if (!compactSi)
+                    compactSi = compactTris[t].Intersect(ray);
+            }
+            ASSERT_TRUE(fullSi.has_value() && compactSi.has_value());
+            EXPECT_LT(std::abs(fullSi->tHit - compactSi->tHit), 1e-3f);
+            EXPECT_LT(Distance(fullSi->intr.uv, compactSi->intr.uv), 1e-3f);
+            EXPECT_GT(Dot(fullSi->intr.shading.n, compactSi->intr.shading.n), 0.999f);
+        }
+    }
+}
+
+TEST(Curve, SharedStorage) {
+    // Two straight segments along $x$ that share their middle control point
+    Transform identity;
+    std::vector<Point3f> cp = {Point3f(0, 0, 0),     Point3f(1. / 3, 0, 0),
+                               Point3f(2. / 3, 0, 0), Point3f(1, 0, 0),
+                               Point3f(1, 0, 0),     Point3f(4. / 3, 0, 0),
+                               Point3f(5. / 3, 0, 0), Point3f(2, 0, 0)};
+    std::vector<Float> width = {0.1f, 0.2f, 0.3f};
+    CurveCommon common(cp, width, CurveType::Flat, {}, &identity, &identity, false,
+                       Allocator());
+    EXPECT_EQ(2, common.nSegments);
+    EXPECT_EQ(3, common.cpStride);
+    EXPECT_TRUE(common.widthHalf != nullptr);
+    EXPECT_NEAR(0.25f, common.Width(1, 0.5f), 1e-3f);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_EQ(cp[4 + i], common.ControlPoints(1)[i]);
+
+    // Intersect the second half of the second segment from above
+    Curve curve(&common, 1, 0.5f, 1);
+    Shape shape(&curve);
+    pstd::optional<ShapeIntersection> si =
+        shape.Intersect(Ray(Point3f(1.75f, 0, 5), Vector3f(0, 0, -1)));
+    ASSERT_TRUE(si.has_value());
+    EXPECT_NEAR(5, si->tHit, 1e-3f);
+    EXPECT_NEAR(0.75f, si->intr.uv[0], 1e-3f);
+
+    // Rays outside the segment's $u$ range or width should miss
+    EXPECT_FALSE(shape.Intersect(Ray(Point3f(1.25f, 0, 5), Vector3f(0, 0, -1))));
+    EXPECT_FALSE(shape.Intersect(Ray(Point3f(1.75f, 0.2f, 5), Vector3f(0, 0, -1))));
+}
+
+TEST(LoopSubdiv, Tetrahedron) {
+    Transform identity;
+    std::vector<Point3f> p = {Point3f(0, 0, 0), Point3f(1, 0, 0), Point3f(0, 1, 0),
+                              Point3f(0, 0, 1)};
+    std::vector<int> indices = {0, 2, 1, 0, 1, 3, 1, 2, 3, 0, 3, 2};
+
+    TriangleMesh *mesh = LoopSubdivide(&identity, false, 2, indices, p, Allocator());
+    // Each level quadruples the faces and adds a vertex per edge.
+    EXPECT_EQ(64, mesh->nTriangles);
+    EXPECT_EQ(34, mesh->nVertices);
+
+    // The refined mesh is still closed: every edge has exactly two faces,
+    // traversed in opposite directions.
+    std::map<std::pair<int, int>, int> edges;
+    for (int i = 0; i < mesh->nTriangles; ++i)
+        for (int j = 0; j < 3; ++j) {
+            int v0 = mesh->vertexIndices[3 * i + j];
+            int v1 = mesh->vertexIndices[3 * i + (j + 1) % 3];
+            EXPECT_EQ(0, edges[std::make_pair(v0, v1)]++);
+        }
+    for (const auto &e : edges)
+        EXPECT_EQ(1, edges[std::make_pair(e.first.second, e.first.first)]);
+
+    // All edges are already shorter than the limit; no refinement happens.
+    mesh = LoopSubdivide(&identity, false, 2, indices, p, Allocator(), 2.f);
+    EXPECT_EQ(4, mesh->nTriangles);
+    EXPECT_EQ(4, mesh->nVertices);
+}
+
 TEST(BilinearPatch, Offset) {
     RNG rng;
     for (int i = 0; i < 100; ++i) {
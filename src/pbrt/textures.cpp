@@ -8,17 +8,22 @@
 #include <pbrt/gpu/util.h>
 #endif  // PBRT_BUILD_GPU_RENDERER
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
 #include <pbrt/util/float.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/splines.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstring>
 #include <mutex>
 
 #include <Ptexture.h>
@@ -357,16 +362,37 @@ SampledSpectrum SpectrumImageTexture::Evaluate(TextureEvalContext ctx,
     assert(!"Should not be called in GPU code");
     return SampledSpectrum(0);
 #else
+    if (constantSpectrum)
+        return constantSpectrum.Sample(lambda);
+
     // Apply texture mapping and flip $t$ coordinate for image texture lookup
     TexCoord2D c = mapping.Map(ctx);
+    const MIPMap *mip = GetMIPMap(&c);
+    if (!mip)
+        return SampledSpectrum(0);
     c.st[1] = 1 - c.st[1];
 
+    if (coefficientMIPMaps.coefficients) {
+        // Filter precomputed sigmoid polynomial coefficients and return spectrum
+        RGB coeffs = coefficientMIPMaps.coefficients->Filter<RGB>(
+            c.st, {c.dsdx, c.dtdx}, {c.dsdy, c.dtdy});
+        RGBSigmoidPolynomial rsp(coeffs.r, coeffs.g, coeffs.b);
+        SampledSpectrum s = rsp.Sample(lambda);
+        if (spectrumType == SpectrumType::Albedo)
+            return s;
+        s *= std::max<Float>(0, coefficientMIPMaps.scales->Filter<Float>(
+                                    c.st, {c.dsdx, c.dtdx}, {c.dsdy, c.dtdy}));
+        if (spectrumType == SpectrumType::Illuminant)
+            s *= mip->GetRGBColorSpace()->illuminant.Sample(lambda);
+        return s;
+    }
+
     // Lookup filtered RGB value in _MIPMap_
-    RGB rgb = scale * mipmap->Filter<RGB>(c.st, {c.dsdx, c.dtdx}, {c.dsdy, c.dtdy});
+    RGB rgb = scale * mip->Filter<RGB>(c.st, {c.dsdx, c.dtdx}, {c.dsdy, c.dtdy});
     rgb = ClampZero(invert ? (RGB(1, 1, 1) - rgb) : rgb);
 
     // Return _SampledSpectrum_ for RGB image texture value
-    if (const RGBColorSpace *cs = mipmap->GetRGBColorSpace(); cs) {
+    if (const RGBColorSpace *cs = mip->GetRGBColorSpace(); cs) {
         if (spectrumType == SpectrumType::Unbounded)
             return RGBUnboundedSpectrum(*cs, rgb).Sample(lambda);
         else if (spectrumType == SpectrumType::Albedo)
@@ -383,14 +409,40 @@ SampledSpectrum SpectrumImageTexture::Evaluate(TextureEvalContext ctx,
 
 std::string SpectrumImageTexture::ToString() const {
     return StringPrintf("[ SpectrumImageTexture filename: %s mapping: %s scale: %f "
-                        "invert: %s mipmap: %s ]",
-                        filename, mapping, scale, invert, *mipmap);
+                        "invert: %s precomputeSpectra: %s mipmap: %s ]",
+                        filename, mapping, scale, invert, precomputeSpectra,
+                        mipmap ? mipmap->ToString() : std::string("(UDIM tiles)"));
+}
+
+pstd::optional<Interval> FloatImageTexture::ValueRange(Bounds2f uvBounds,
+                                                       int64_t maxTexels) const {
+    const UVMapping *uvMapping = mapping.CastOrNullptr<UVMapping>();
+    if (!uvMapping || IsUDIM())
+        return {};
+    if (!mipmap)
+        return Interval(0);
+    // Find the range of the texels' values, flipping $t$ as Evaluate() does
+    Bounds2f st = uvMapping->Map(uvBounds);
+    st = Bounds2f(Point2f(st.pMin[0], 1 - st.pMin[1]),
+                  Point2f(st.pMax[0], 1 - st.pMax[1]));
+    pstd::optional<Interval> range = mipmap->TexelRange(st, maxTexels);
+    if (!range)
+        return {};
+
+    // Apply the texture's scale and inversion to the texels' range
+    Float v0 = scale * range->LowerBound(), v1 = scale * range->UpperBound();
+    if (invert) {
+        v0 = std::max<Float>(0, 1 - v0);
+        v1 = std::max<Float>(0, 1 - v1);
+    }
+    return Interval(v0, v1);
 }
 
 std::string FloatImageTexture::ToString() const {
     return StringPrintf(
         "[ FloatImageTexture filename: %s mapping: %s scale: %f invert: %s mipmap: %s ]",
-        filename, mapping, scale, invert, *mipmap);
+        filename, mapping, scale, invert,
+        mipmap ? mipmap->ToString() : std::string("(UDIM tiles)"));
 }
 
 std::string TexInfo::ToString() const {
@@ -399,9 +451,112 @@ std::string TexInfo::ToString() const {
         filterOptions, wrapMode, encoding);
 }
 
+// UDIM Function Definitions
+static const char UDIMToken[] = "<UDIM>";
+
+bool IsUDIMFilename(const std::string &filename) {
+    return filename.find(UDIMToken) != std::string::npos;
+}
+
+std::string UDIMTileFilename(const std::string &filename, int tile) {
+    std::string tileFilename = filename;
+    size_t offset = tileFilename.find(UDIMToken);
+    CHECK_NE(offset, std::string::npos);
+    return tileFilename.replace(offset, strlen(UDIMToken), std::to_string(tile));
+}
+
+// ImageTextureBase::UDIMTiles Definition
+struct ImageTextureBase::UDIMTiles {
+    // UDIM tiles are 10 to a row
+    static constexpr int TilesPerRow = 10, MaxTiles = 1000;
+
+    UDIMTiles(const TexInfo &texInfo) : texInfo(texInfo) {
+        for (int i = 0; i < MaxTiles; ++i) {
+            exists[i] = FileExists(UDIMTileFilename(texInfo.filename, 1001 + i));
+            mipmaps[i] = nullptr;
+        }
+    }
+
+    TexInfo texInfo;
+    std::bitset<MaxTiles> exists;
+    // Tiles' MIP maps are created the first time a lookup needs them
+    std::atomic<MIPMap *> mipmaps[MaxTiles];
+    std::mutex mutex;
+};
+
+STAT_PERCENT("Texture/UDIM tiles loaded", nUDIMTilesLoaded, nUDIMTilesFound);
+
+// ImageTextureBase Method Definitions
 std::mutex ImageTextureBase::textureCacheMutex;
 std::map<TexInfo, MIPMap *> ImageTextureBase::textureCache;
 
+void ImageTextureBase::ClearCache() {
+    textureCache.clear();
+    SpectrumImageTexture::ClearCoefficientCache();
+}
+
+ImageTextureBase::ImageTextureBase(TextureMapping2D mapping, std::string filename,
+                                   MIPMapFilterOptions filterOptions, WrapMode wrapMode,
+                                   Float scale, bool invert, ColorEncoding encoding,
+                                   Allocator alloc)
+    : mapping(mapping), filename(filename), scale(scale), invert(invert) {
+    TexInfo texInfo(filename, filterOptions, wrapMode, encoding);
+    if (IsUDIMFilename(filename)) {
+        // Find the UDIM texture's tiles, but don't read them yet
+        udimTiles = alloc.new_object<UDIMTiles>(texInfo);
+        if (udimTiles->exists.none())
+            ErrorExit("%s: no UDIM tiles found.", filename);
+        nUDIMTilesFound += udimTiles->exists.count();
+        return;
+    }
+    mipmap = GetCachedMIPMap(texInfo, alloc);
+}
+
+MIPMap *ImageTextureBase::GetCachedMIPMap(const TexInfo &texInfo, Allocator alloc) {
+    // Get _MIPMap_ from texture cache if present
+    std::unique_lock<std::mutex> lock(textureCacheMutex);
+    if (auto iter = textureCache.find(texInfo); iter != textureCache.end())
+        return iter->second;
+    lock.unlock();
+
+    // Create _MIPMap_ for _filename_ and add to texture cache
+    MIPMap *mipmap = MIPMap::CreateFromFile(texInfo.filename, texInfo.filterOptions,
+                                            texInfo.wrapMode, texInfo.encoding, alloc);
+    lock.lock();
+    // If another texture created the same _MIPMap_ in the meantime, it has been
+    // loaded wastefully; use the one that's already in the cache.
+    if (auto iter = textureCache.find(texInfo); iter != textureCache.end())
+        return iter->second;
+    textureCache[texInfo] = mipmap;
+    return mipmap;
+}
+
+const MIPMap *ImageTextureBase::GetUDIMTile(TexCoord2D *c) const {
+    // Find the UDIM tile for _c_ and make _c_ relative to it
+    int u = pstd::floor(c->st[0]), v = pstd::floor(c->st[1]);
+    int index = u + UDIMTiles::TilesPerRow * v;
+    if (u < 0 || u >= UDIMTiles::TilesPerRow || index < 0 ||
+        index >= UDIMTiles::MaxTiles || !udimTiles->exists[index])
+        return nullptr;
+    c->st[0] -= u;
+    c->st[1] -= v;
+    if (MIPMap *tile = udimTiles->mipmaps[index].load(std::memory_order_acquire))
+        return tile;
+
+    // Create the tile's _MIPMap_ the first time it is used
+    std::lock_guard<std::mutex> lock(udimTiles->mutex);
+    if (MIPMap *tile = udimTiles->mipmaps[index].load(std::memory_order_acquire))
+        return tile;
+    TexInfo tileInfo = udimTiles->texInfo;
+    tileInfo.filename = UDIMTileFilename(tileInfo.filename, 1001 + index);
+    // The texture's allocator may not be safe to use during rendering, so the
+    // default allocator is used instead
+    MIPMap *tile = GetCachedMIPMap(tileInfo, Allocator());
+    udimTiles->mipmaps[index].store(tile, std::memory_order_release);
+    ++nUDIMTilesLoaded;
+    return tile;
+}
+
 FloatImageTexture *FloatImageTexture::Create(const Transform &renderFromTexture,
                                              const TextureParameterDictionary &parameters,
                                              const FileLoc *loc, Allocator alloc) {
@@ -436,6 +591,98 @@ FloatImageTexture *FloatImageTexture::Create(const Transform &renderFromTexture,
                                                scale, invert, encoding, alloc);
 }
 
+void SpectrumImageTexture::InitConstantSpectrum(Allocator alloc) {
+    // UDIM textures' tiles haven't been read yet
+    pstd::optional<RGB> imageRGB;
+    if (mipmap)
+        imageRGB = mipmap->ConstantRGB();
+    if (!imageRGB) {
+        constantSpectrum = nullptr;
+        return;
+    }
+    // Convert the image's color the same way as Evaluate() does
+    RGB rgb = ClampZero(invert ? (RGB(1, 1, 1) - scale * *imageRGB) : scale * *imageRGB);
+    if (const RGBColorSpace *cs = mipmap->GetRGBColorSpace(); cs) {
+        if (spectrumType == SpectrumType::Unbounded)
+            constantSpectrum = alloc.new_object<RGBUnboundedSpectrum>(*cs, rgb);
+        else if (spectrumType == SpectrumType::Albedo)
+            constantSpectrum = alloc.new_object<RGBAlbedoSpectrum>(*cs, Clamp(rgb, 0, 1));
+        else
+            constantSpectrum = alloc.new_object<RGBIlluminantSpectrum>(*cs, rgb);
+    } else
+        constantSpectrum = alloc.new_object<ConstantSpectrum>(rgb[0]);
+}
+
+std::mutex SpectrumImageTexture::coefficientCacheMutex;
+std::map<SpectrumImageTexture::CoefficientKey, SpectrumImageTexture::CoefficientMIPMaps>
+    SpectrumImageTexture::coefficientCache;
+
+void SpectrumImageTexture::InitCoefficientMIPMaps(Allocator alloc) {
+    coefficientMIPMaps = CoefficientMIPMaps();
+    // Coefficients are only precomputed for RGB images with resident texels
+    if (!precomputeSpectra || constantSpectrum || !mipmap)
+        return;
+    const RGBColorSpace *cs = mipmap->GetRGBColorSpace();
+    if (!cs || mipmap->IsPaged() || mipmap->IsCompressed() || mipmap->IsBlocked() ||
+        mipmap->GetLevel(0).NChannels() < 3) {
+        Warning("%s: unable to precompute spectra for image texture that is "
+                "paged, compressed, blocked, or doesn't have RGB channels.",
+                filename);
+        return;
+    }
+    // Fetch the coefficient MIP maps from the cache if present
+    CoefficientKey key(mipmap, scale, invert, spectrumType);
+    std::lock_guard<std::mutex> lock(coefficientCacheMutex);
+    if (auto iter = coefficientCache.find(key); iter != coefficientCache.end()) {
+        coefficientMIPMaps = iter->second;
+        return;
+    }
+
+    // Compute sigmoid polynomial coefficients for the texels of the top level
+    const Image &image = mipmap->GetLevel(0);
+    Point2i res = image.Resolution();
+    bool albedo = spectrumType == SpectrumType::Albedo;
+    Image coeffImage(PixelFormat::Float, res, {"R", "G", "B"}, nullptr, alloc);
+    Image scaleImage = albedo ? Image(alloc)
+                              : Image(PixelFormat::Float, res, {"Y"}, nullptr, alloc);
+    ParallelFor(0, res.y, [&](int64_t y) {
+        for (int x = 0; x < res.x; ++x) {
+            // Convert the texel's color the same way as Evaluate() does
+            Point2i p(x, y);
+            RGB rgb = scale * RGB(image.GetChannel(p, 0), image.GetChannel(p, 1),
+                                  image.GetChannel(p, 2));
+            rgb = ClampZero(invert ? (RGB(1, 1, 1) - rgb) : rgb);
+            RGBSigmoidPolynomial rsp(0, 0, 0);
+            if (albedo) {
+                // Keep albedos away from zero and one, where gray coefficients
+                // are infinite and couldn't be filtered
+                constexpr Float eps = 1e-3f;
+                rsp = cs->ToRGBCoeffs(Clamp(rgb, eps, 1 - eps));
+            } else {
+                // Black texels get the coefficients of a flat spectrum and a
+                // zero scale so that filtering them only scales their neighbors
+                Float m = std::max({rgb.r, rgb.g, rgb.b});
+                if (m > 0)
+                    rsp = cs->ToRGBCoeffs(rgb / (2 * m));
+                scaleImage.SetChannel(p, 0, 2 * m);
+            }
+            pstd::array<Float, 3> c = rsp.Coefficients();
+            for (int i = 0; i < 3; ++i)
+                coeffImage.SetChannel(p, i, c[i]);
+        }
+    });
+
+    // Create MIP maps for the coefficients and add them to the cache
+    WrapMode wrapMode = mipmap->GetWrapMode();
+    const MIPMapFilterOptions &options = mipmap->GetFilterOptions();
+    coefficientMIPMaps.coefficients =
+        alloc.new_object<MIPMap>(std::move(coeffImage), cs, wrapMode, alloc, options);
+    if (!albedo)
+        coefficientMIPMaps.scales =
+            alloc.new_object<MIPMap>(std::move(scaleImage), cs, wrapMode, alloc, options);
+    coefficientCache[key] = coefficientMIPMaps;
+}
+
 SpectrumImageTexture *SpectrumImageTexture::Create(
     const Transform &renderFromTexture, const TextureParameterDictionary &parameters,
     SpectrumType spectrumType, const FileLoc *loc, Allocator alloc) {
@@ -465,10 +712,11 @@ SpectrumImageTexture *SpectrumImageTexture::Create(
     const char *defaultEncoding = HasExtension(filename, "png") ? "sRGB" : "linear";
     std::string encodingString = parameters.GetOneString("encoding", defaultEncoding);
     ColorEncoding encoding = ColorEncoding::Get(encodingString, alloc);
+    bool precomputeSpectra = parameters.GetOneBool("precomputespectra", false);
 
     return alloc.new_object<SpectrumImageTexture>(map, filename, filterOptions, *wrapMode,
                                                   scale, invert, encoding, spectrumType,
-                                                  alloc);
+                                                  alloc, precomputeSpectra);
 }
 
 // MarbleTexture Method Definitions
@@ -586,6 +834,45 @@ STAT_COUNTER("Texture/Ptex block reads", nBlockReads);
 STAT_MEMORY_COUNTER("Memory/Ptex peak memory used", peakMemoryUsed);
 STAT_MEMORY_COUNTER("Memory/GPU Ptex memory used", gpuPtexMemoryUsed);
 STAT_RATIO("Texture/Ptex file cache hits", ptexCacheHits, ptexCacheLookups);
+STAT_COUNTER("Texture/Ptex file reopens", nFileReopens);
+STAT_MEMORY_COUNTER("Memory/Ptex memory used", memoryUsed);
+STAT_PERCENT("Texture/Ptex lookups reusing a thread's filter", nFilterReuses,
+             nFilterLookups);
+
+static std::atomic<int64_t> nextPtexTextureId;
+
+// PtexThreadFilters Definition
+// Each thread holds on to the filters for the Ptex textures it has used most
+// recently, so that most lookups don't need to find the texture in the shared
+// cache, which hashes its filename, or allocate a new filter. The textures
+// can't be evicted from the cache while they are held, so only a few are.
+struct PtexThreadFilters {
+    ~PtexThreadFilters() {
+        for (Entry &entry : entries)
+            entry.Release();
+    }
+
+    struct Entry {
+        void Release() {
+            if (filter) {
+                filter->release();
+                texture->release();
+            }
+            id = -1;
+            texture = nullptr;
+            filter = nullptr;
+        }
+
+        int64_t id = -1;
+        Ptex::PtexTexture *texture = nullptr;
+        Ptex::PtexFilter *filter = nullptr;
+    };
+    static constexpr int NumEntries = 4;
+    Entry entries[NumEntries];
+    int next = 0;
+};
+
+static thread_local PtexThreadFilters ptexThreadFilters;
 
 struct : public PtexErrorHandler {
     void reportError(const char *error) override { Error("%s", error); }
@@ -595,11 +882,11 @@ struct : public PtexErrorHandler {
 
 PtexTextureBase::PtexTextureBase(const std::string &filename, ColorEncoding encoding,
                                  Float scale)
-    : filename(filename), encoding(encoding), scale(scale) {
+    : id(nextPtexTextureId++), filename(filename), encoding(encoding), scale(scale) {
     ptexMutex.lock();
     if (!cache) {
-        int maxFiles = 100;
-        size_t maxMem = 1ull << 32;  // 4GB
+        int maxFiles = Options->ptexMaxFiles;
+        size_t maxMem = size_t(Options->ptexCacheMB) << 20;
         bool premultiply = true;
 
         cache = Ptex::PtexCache::create(maxFiles, maxMem, premultiply, nullptr,
@@ -633,6 +920,8 @@ void PtexTextureBase::ReportStats() {
 
     nFilesAccessed += stats.filesAccessed;
     nBlockReads += stats.blockReads;
+    nFileReopens += stats.fileReopens;
+    memoryUsed = std::max(memoryUsed, int64_t(stats.memUsed));
     peakMemoryUsed = std::max(peakMemoryUsed, int64_t(stats.peakMemUsed));
 }
 
@@ -643,19 +932,35 @@ int PtexTextureBase::SampleTexture(TextureEvalContext ctx, float result[3]) cons
     }
 
     ++nLookups;
-    Ptex::String error;
-    Ptex::PtexTexture *texture = cache->get(filename.c_str(), error);
-    CHECK(texture);
-    // TODO: make the filter an option?
-    Ptex::PtexFilter::Options opts(Ptex::PtexFilter::FilterType::f_bspline);
-    Ptex::PtexFilter *filter = Ptex::PtexFilter::getFilter(texture, opts);
-    int nc = texture->numChannels();
+    // Find the texture's filter among the thread's, replacing the oldest one
+    // if it isn't there
+    ++nFilterLookups;
+    PtexThreadFilters &threadFilters = ptexThreadFilters;
+    PtexThreadFilters::Entry *entry = nullptr;
+    for (PtexThreadFilters::Entry &e : threadFilters.entries)
+        if (e.id == id) {
+            entry = &e;
+            ++nFilterReuses;
+            break;
+        }
+    if (!entry) {
+        entry = &threadFilters.entries[threadFilters.next];
+        threadFilters.next = (threadFilters.next + 1) % PtexThreadFilters::NumEntries;
+        entry->Release();
+
+        Ptex::String error;
+        entry->texture = cache->get(filename.c_str(), error);
+        CHECK(entry->texture);
+        // TODO: make the filter an option?
+        Ptex::PtexFilter::Options opts(Ptex::PtexFilter::FilterType::f_bspline);
+        entry->filter = Ptex::PtexFilter::getFilter(entry->texture, opts);
+        entry->id = id;
+    }
+    int nc = entry->texture->numChannels();
 
     int firstChan = 0;
-    filter->eval(result, firstChan, nc, ctx.faceIndex, ctx.uv[0], ctx.uv[1], ctx.dudx,
-                 ctx.dvdx, ctx.dudy, ctx.dvdy);
-    filter->release();
-    texture->release();
+    entry->filter->eval(result, firstChan, nc, ctx.faceIndex, ctx.uv[0], ctx.uv[1],
+                        ctx.dudx, ctx.dvdx, ctx.dudy, ctx.dvdy);
 
     if (encoding != ColorEncoding::Linear) {
         // It feels a little dirty to convert to 8-bits to run through the
@@ -934,7 +1239,7 @@ SpectrumTexture SpectrumScaledTexture::Create(
                        tex.CastOrNullptr<SpectrumImageTexture>()) {
             SpectrumImageTexture *imageCopy =
                 alloc.new_object<SpectrumImageTexture>(*image);
-            imageCopy->MultiplyScale(cs);
+            imageCopy->MultiplyScale(cs, alloc);
             return imageCopy;
         }
 #if defined(PBRT_BUILD_GPU_RENDERER)
@@ -1003,6 +1308,25 @@ static std::map<std::string, LuminanceTextureCacheItem> lumTextureCache;
 static std::map<std::string, RGBTextureCacheItem> rgbTextureCache;
 
 STAT_MEMORY_COUNTER("Memory/ImageTextures", gpuImageTextureBytes);
+STAT_MEMORY_COUNTER("Memory/ImageTexture MIP levels not uploaded to GPU",
+                    gpuImageTextureSkippedBytes);
+
+// Returns the finest MIP level to upload to the GPU: with
+// --gpu-texture-max-res, levels larger than that in either dimension are
+// skipped. Lookups use normalized texture coordinates, so the remaining
+// levels are filtered as if they were the whole pyramid.
+static int firstGPUMIPLevel(const MIPMap &mipmap, size_t bytesPerTexel) {
+    int firstLevel = 0;
+    if (Options->gpuTextureMaxResolution > 0)
+        while (firstLevel < mipmap.Levels() - 1) {
+            Point2i res = mipmap.GetLevel(firstLevel).Resolution();
+            if (std::max(res.x, res.y) <= Options->gpuTextureMaxResolution)
+                break;
+            gpuImageTextureSkippedBytes += bytesPerTexel * res.x * res.y;
+            ++firstLevel;
+        }
+    return firstLevel;
+}
 
 static cudaMipmappedArray_t createSingleChannelTextureArray(
     const Image &image, const RGBColorSpace *colorSpace, int *nMIPMapLevels) {
@@ -1026,16 +1350,17 @@ static cudaMipmappedArray_t createSingleChannelTextureArray(
 
     MIPMap mipmap(image, colorSpace, WrapMode::Clamp /* TODO */, Allocator(),
                   MIPMapFilterOptions());
-    *nMIPMapLevels = mipmap.Levels();
+    int firstLevel = firstGPUMIPLevel(mipmap, (channelDesc.x + 7) / 8);
+    *nMIPMapLevels = mipmap.Levels() - firstLevel;
 
-    const Image &baseImage = mipmap.GetLevel(0);
+    const Image &baseImage = mipmap.GetLevel(firstLevel);
     cudaExtent extent =
         make_cudaExtent(baseImage.Resolution().x, baseImage.Resolution().y, 0);
-    CUDA_CHECK(cudaMallocMipmappedArray(&mipArray, &channelDesc, extent, mipmap.Levels(),
+    CUDA_CHECK(cudaMallocMipmappedArray(&mipArray, &channelDesc, extent, *nMIPMapLevels,
                                         0 /* flags */));
 
-    for (int level = 0; level < mipmap.Levels(); ++level) {
-        const Image &levelImage = mipmap.GetLevel(level);
+    for (int level = 0; level < *nMIPMapLevels; ++level) {
+        const Image &levelImage = mipmap.GetLevel(firstLevel + level);
         cudaArray_t levelArray;
         CUDA_CHECK(cudaGetMipmappedArrayLevel(&levelArray, mipArray, level));
 
@@ -1096,6 +1421,9 @@ GPUSpectrumImageTexture *GPUSpectrumImageTexture::Create(
     Float scale = parameters.GetOneFloat("scale", 1.f);
     bool invert = parameters.GetOneBool("invert", false);
     std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
+    if (IsUDIMFilename(filename))
+        ErrorExit(loc, "%s: UDIM textures aren't supported with the GPU renderer.",
+                  filename);
 
     const char *defaultEncoding = HasExtension(filename, "png") ? "sRGB" : "linear";
     std::string encodingString = parameters.GetOneString("encoding", defaultEncoding);
@@ -1147,8 +1475,13 @@ GPUSpectrumImageTexture *GPUSpectrumImageTexture::Create(
 
                     MIPMap mipmap(image, colorSpace, WrapMode::Clamp /* TODO */,
                                   Allocator(), MIPMapFilterOptions());
-                    nMIPMapLevels = mipmap.Levels();
-                    const Image &baseImage = mipmap.GetLevel(0);
+                    // Textures are uploaded as four channels
+                    int channelBytes = image.Format() == PixelFormat::U256   ? 1
+                                       : image.Format() == PixelFormat::Half ? 2
+                                                                             : 4;
+                    int firstLevel = firstGPUMIPLevel(mipmap, 4 * channelBytes);
+                    nMIPMapLevels = mipmap.Levels() - firstLevel;
+                    const Image &baseImage = mipmap.GetLevel(firstLevel);
 
                     switch (image.Format()) {
                     case PixelFormat::U256: {
@@ -1158,10 +1491,11 @@ GPUSpectrumImageTexture *GPUSpectrumImageTexture::Create(
                         cudaExtent extent = make_cudaExtent(baseImage.Resolution().x,
                                                             baseImage.Resolution().y, 0);
                         CUDA_CHECK(cudaMallocMipmappedArray(&mipArray, &channelDesc,
-                                                            extent, mipmap.Levels(),
+                                                            extent, nMIPMapLevels,
                                                             0 /* flags */));
-                        for (int level = 0; level < mipmap.Levels(); ++level) {
-                            const Image &levelImage = mipmap.GetLevel(level);
+                        for (int level = 0; level < nMIPMapLevels; ++level) {
+                            const Image &levelImage =
+                                mipmap.GetLevel(firstLevel + level);
                             cudaArray_t levelArray;
                             CUDA_CHECK(
                                 cudaGetMipmappedArrayLevel(&levelArray, mipArray, level));
@@ -1194,11 +1528,12 @@ GPUSpectrumImageTexture *GPUSpectrumImageTexture::Create(
                         cudaExtent extent = make_cudaExtent(baseImage.Resolution().x,
                                                             baseImage.Resolution().y, 0);
                         CUDA_CHECK(cudaMallocMipmappedArray(&mipArray, &channelDesc,
-                                                            extent, mipmap.Levels(),
+                                                            extent, nMIPMapLevels,
                                                             0 /* flags */));
 
-                        for (int level = 0; level < mipmap.Levels(); ++level) {
-                            const Image &levelImage = mipmap.GetLevel(level);
+                        for (int level = 0; level < nMIPMapLevels; ++level) {
+                            const Image &levelImage =
+                                mipmap.GetLevel(firstLevel + level);
                             cudaArray_t levelArray;
                             CUDA_CHECK(
                                 cudaGetMipmappedArrayLevel(&levelArray, mipArray, level));
@@ -1232,11 +1567,12 @@ GPUSpectrumImageTexture *GPUSpectrumImageTexture::Create(
                         cudaExtent extent = make_cudaExtent(baseImage.Resolution().x,
                                                             baseImage.Resolution().y, 0);
                         CUDA_CHECK(cudaMallocMipmappedArray(&mipArray, &channelDesc,
-                                                            extent, mipmap.Levels(),
+                                                            extent, nMIPMapLevels,
                                                             0 /* flags */));
 
-                        for (int level = 0; level < mipmap.Levels(); ++level) {
-                            const Image &levelImage = mipmap.GetLevel(level);
+                        for (int level = 0; level < nMIPMapLevels; ++level) {
+                            const Image &levelImage =
+                                mipmap.GetLevel(firstLevel + level);
                             cudaArray_t levelArray;
                             CUDA_CHECK(
                                 cudaGetMipmappedArrayLevel(&levelArray, mipArray, level));
@@ -1346,6 +1682,9 @@ GPUFloatImageTexture *GPUFloatImageTexture::Create(
     Float scale = parameters.GetOneFloat("scale", 1.f);
     bool invert = parameters.GetOneBool("invert", false);
     std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
+    if (IsUDIMFilename(filename))
+        ErrorExit(loc, "%s: UDIM textures aren't supported with the GPU renderer.",
+                  filename);
 
     const char *defaultEncoding = HasExtension(filename, "png") ? "sRGB" : "linear";
     std::string encodingString = parameters.GetOneString("encoding", defaultEncoding);
@@ -1567,4 +1906,56 @@ SampledSpectrum UniversalTextureEvaluator::operator()(SpectrumTexture tex,
     return tex.Evaluate(ctx, lambda);
 }
 
+// CachingTextureEvaluator Method Definitions
+STAT_PERCENT("Texture/Texture evaluations reused", nReusedTextureEvaluations,
+             nCachedTextureEvaluations);
+
+Float CachingTextureEvaluator::operator()(FloatTexture tex, TextureEvalContext ctx) {
+    // Constant textures are cheaper to evaluate than to look up
+    if (tex.Is<FloatConstantTexture>())
+        return tex.Evaluate(ctx);
+
+    ++nCachedTextureEvaluations;
+    for (const TextureEvaluationCache::FloatEntry &entry : cache->floatEntries)
+        if (entry.tex == tex.ptr() && entry.ctx == ctx) {
+            ++nReusedTextureEvaluations;
+            return entry.value;
+        }
+
+    Float value = tex.Evaluate(ctx);
+    TextureEvaluationCache::FloatEntry &entry =
+        cache->floatEntries[cache->nextFloatEntry];
+    cache->nextFloatEntry =
+        (cache->nextFloatEntry + 1) % TextureEvaluationCache::NumEntries;
+    entry.tex = tex.ptr();
+    entry.ctx = ctx;
+    entry.value = value;
+    return value;
+}
+
+SampledSpectrum CachingTextureEvaluator::operator()(SpectrumTexture tex,
+                                                    TextureEvalContext ctx,
+                                                    SampledWavelengths lambda) {
+    if (tex.Is<SpectrumConstantTexture>())
+        return tex.Evaluate(ctx, lambda);
+
+    ++nCachedTextureEvaluations;
+    for (const TextureEvaluationCache::SpectrumEntry &entry : cache->spectrumEntries)
+        if (entry.tex == tex.ptr() && entry.ctx == ctx && entry.lambda == lambda) {
+            ++nReusedTextureEvaluations;
+            return entry.value;
+        }
+
+    SampledSpectrum value = tex.Evaluate(ctx, lambda);
+    TextureEvaluationCache::SpectrumEntry &entry =
+        cache->spectrumEntries[cache->nextSpectrumEntry];
+    cache->nextSpectrumEntry =
+        (cache->nextSpectrumEntry + 1) % TextureEvaluationCache::NumEntries;
+    entry.tex = tex.ptr();
+    entry.ctx = ctx;
+    entry.lambda = lambda;
+    entry.value = value;
+    return value;
+}
+
 }  // namespace pbrt
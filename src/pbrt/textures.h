@@ -23,6 +23,7 @@
 #include <map>
 #include <mutex>
 #include <string>
+#include <tuple>
 
 namespace pbrt {
 
@@ -58,6 +59,13 @@ struct TextureEvalContext {
           dvdy(dvdy),
           faceIndex(faceIndex) {}
 
+    PBRT_CPU_GPU
+    bool operator==(const TextureEvalContext &ctx) const {
+        return p == ctx.p && dpdx == ctx.dpdx && dpdy == ctx.dpdy && n == ctx.n &&
+               uv == ctx.uv && dudx == ctx.dudx && dudy == ctx.dudy &&
+               dvdx == ctx.dvdx && dvdy == ctx.dvdy && faceIndex == ctx.faceIndex;
+    }
+
     std::string ToString() const;
 
     Point3f p;
@@ -101,6 +109,14 @@ class UVMapping {
         return TexCoord2D{st, dsdx, dsdy, dtdx, dtdy};
     }
 
+    // Returns the bounds of the $(s,t)$ coordinates of points with $(u,v)$
+    // coordinates inside _uv_
+    PBRT_CPU_GPU
+    Bounds2f Map(Bounds2f uv) const {
+        return Bounds2f(Point2f(su * uv.pMin[0] + du, sv * uv.pMin[1] + dv),
+                        Point2f(su * uv.pMax[0] + du, sv * uv.pMax[1] + dv));
+    }
+
   private:
     Float su, sv, du, dv;
 };
@@ -522,50 +538,52 @@ struct TexInfo {
     ColorEncoding encoding;
 };
 
+// UDIM Function Declarations
+// An image texture whose filename includes "<UDIM>" is split into tiles, each
+// stored in the file whose name has the tile's number in place of "<UDIM>".
+// Texture coordinates in $[u,u+1) \times [v,v+1)$ map to tile $1001 + u + 10v$.
+bool IsUDIMFilename(const std::string &filename);
+std::string UDIMTileFilename(const std::string &filename, int tile);
+
 // ImageTextureBase Definition
 class ImageTextureBase {
   public:
     // ImageTextureBase Public Methods
     ImageTextureBase(TextureMapping2D mapping, std::string filename,
                      MIPMapFilterOptions filterOptions, WrapMode wrapMode, Float scale,
-                     bool invert, ColorEncoding encoding, Allocator alloc)
-        : mapping(mapping), filename(filename), scale(scale), invert(invert) {
-        // Get _MIPMap_ from texture cache if present
-        TexInfo texInfo(filename, filterOptions, wrapMode, encoding);
-        std::unique_lock<std::mutex> lock(textureCacheMutex);
-        if (auto iter = textureCache.find(texInfo); iter != textureCache.end()) {
-            mipmap = iter->second;
-            return;
-        }
-        lock.unlock();
-
-        // Create _MIPMap_ for _filename_ and add to texture cache
-        mipmap =
-            MIPMap::CreateFromFile(filename, filterOptions, wrapMode, encoding, alloc);
-        lock.lock();
-        // This is actually ok, but if it hits, it means we've wastefully
-        // loaded this texture. (Note that in that case, should just return
-        // the one that's already in there and not replace it.)
-        CHECK(textureCache.find(texInfo) == textureCache.end());
-        textureCache[texInfo] = mipmap;
-    }
+                     bool invert, ColorEncoding encoding, Allocator alloc);
 
-    static void ClearCache() { textureCache.clear(); }
+    static void ClearCache();
 
     void MultiplyScale(Float s) { scale *= s; }
 
   protected:
+    // ImageTextureBase Protected Methods
+    // Returns the MIP map to filter for the texture coordinates _c_. For UDIM
+    // textures, _c_ is made relative to its tile, and nullptr is returned if
+    // there is no tile there.
+    const MIPMap *GetMIPMap(TexCoord2D *c) const {
+        return udimTiles ? GetUDIMTile(c) : mipmap;
+    }
+    bool IsUDIM() const { return udimTiles != nullptr; }
+
     // ImageTextureBase Protected Members
     TextureMapping2D mapping;
     std::string filename;
     Float scale;
     bool invert;
-    MIPMap *mipmap;
+    MIPMap *mipmap = nullptr;
 
   private:
+    // ImageTextureBase Private Methods
+    static MIPMap *GetCachedMIPMap(const TexInfo &texInfo, Allocator alloc);
+    const MIPMap *GetUDIMTile(TexCoord2D *c) const;
+
     // ImageTextureBase Private Members
     static std::mutex textureCacheMutex;
     static std::map<TexInfo, MIPMap *> textureCache;
+    struct UDIMTiles;
+    UDIMTiles *udimTiles = nullptr;
 };
 
 // FloatImageTexture Definition
@@ -583,14 +601,22 @@ class FloatImageTexture : public ImageTextureBase {
         return 0;
 #else
         TexCoord2D c = mapping.Map(ctx);
+        const MIPMap *mip = GetMIPMap(&c);
+        if (!mip)
+            return 0;
         // Texture coordinates are (0,0) in the lower left corner, but
         // image coordinates are (0,0) in the upper left.
         c.st[1] = 1 - c.st[1];
-        Float v = scale * mipmap->Filter<Float>(c.st, {c.dsdx, c.dtdx}, {c.dsdy, c.dtdy});
+        Float v = scale * mip->Filter<Float>(c.st, {c.dsdx, c.dtdx}, {c.dsdy, c.dtdy});
         return invert ? std::max<Float>(0, 1 - v) : v;
 #endif
     }
 
+    // Returns bounds on the texture's values for lookups without filtering at
+    // $(u,v)$ coordinates inside _uvBounds_, if they can be found by
+    // examining at most _maxTexels_ texels.
+    pstd::optional<Interval> ValueRange(Bounds2f uvBounds, int64_t maxTexels) const;
+
     static FloatImageTexture *Create(const Transform &renderFromTexture,
                                      const TextureParameterDictionary &parameters,
                                      const FileLoc *loc, Allocator alloc);
@@ -605,14 +631,27 @@ class SpectrumImageTexture : public ImageTextureBase {
     SpectrumImageTexture(TextureMapping2D mapping, std::string filename,
                          MIPMapFilterOptions filterOptions, WrapMode wrapMode,
                          Float scale, bool invert, ColorEncoding encoding,
-                         SpectrumType spectrumType, Allocator alloc)
+                         SpectrumType spectrumType, Allocator alloc,
+                         bool precomputeSpectra = false)
         : ImageTextureBase(mapping, filename, filterOptions, wrapMode, scale, invert,
                            encoding, alloc),
-          spectrumType(spectrumType) {}
+          spectrumType(spectrumType),
+          precomputeSpectra(precomputeSpectra) {
+        InitConstantSpectrum(alloc);
+        InitCoefficientMIPMaps(alloc);
+    }
 
     PBRT_CPU_GPU
     SampledSpectrum Evaluate(TextureEvalContext ctx, SampledWavelengths lambda) const;
 
+    void MultiplyScale(Float s, Allocator alloc) {
+        ImageTextureBase::MultiplyScale(s);
+        InitConstantSpectrum(alloc);
+        InitCoefficientMIPMaps(alloc);
+    }
+
+    static void ClearCoefficientCache() { coefficientCache.clear(); }
+
     static SpectrumImageTexture *Create(const Transform &renderFromTexture,
                                         const TextureParameterDictionary &parameters,
                                         SpectrumType spectrumType, const FileLoc *loc,
@@ -621,8 +660,28 @@ class SpectrumImageTexture : public ImageTextureBase {
     std::string ToString() const;
 
   private:
+    // SpectrumImageTexture Private Types
+    struct CoefficientMIPMaps {
+        const MIPMap *coefficients = nullptr, *scales = nullptr;
+    };
+    using CoefficientKey = std::tuple<const MIPMap *, Float, bool, SpectrumType>;
+
+    // SpectrumImageTexture Private Methods
+    void InitConstantSpectrum(Allocator alloc);
+    void InitCoefficientMIPMaps(Allocator alloc);
+
     // SpectrumImageTexture Private Members
     SpectrumType spectrumType;
+    // The texture's spectrum if its image is a single color; the RGB to
+    // spectrum conversion is then done once rather than at every lookup
+    Spectrum constantSpectrum;
+    // With _precomputeSpectra_, each texel's _RGBSigmoidPolynomial_ coefficients
+    // are found when the texture is created and are themselves MIP-filtered;
+    // unbounded and illuminant spectra also filter their scale factors.
+    bool precomputeSpectra;
+    CoefficientMIPMaps coefficientMIPMaps;
+    static std::mutex coefficientCacheMutex;
+    static std::map<CoefficientKey, CoefficientMIPMaps> coefficientCache;
 };
 
 #if defined(PBRT_BUILD_GPU_RENDERER) && defined(__NVCC__)
@@ -932,6 +991,8 @@ class PtexTextureBase {
 
   private:
     bool valid;
+    // Identifies the texture in the per-thread caches of Ptex filters
+    int64_t id;
     std::string filename;
     ColorEncoding encoding;
     Float scale;
@@ -1155,6 +1216,54 @@ class UniversalTextureEvaluator {
                                SampledWavelengths lambda);
 };
 
+// TextureEvaluationCache Definition
+// Holds the values of the most recently evaluated non-constant textures at
+// one intersection. Materials often use a single texture for several
+// parameters (e.g., both roughnesses), and with bump mapping the material
+// is evaluated at the same point as the displacement texture; the cache
+// keeps those lookups from going through the MIPMap more than once.
+struct TextureEvaluationCache {
+    static constexpr int NumEntries = 8;
+    struct FloatEntry {
+        const void *tex = nullptr;
+        TextureEvalContext ctx;
+        Float value;
+    };
+    struct SpectrumEntry {
+        const void *tex = nullptr;
+        TextureEvalContext ctx;
+        SampledWavelengths lambda;
+        SampledSpectrum value;
+    };
+    FloatEntry floatEntries[NumEntries];
+    SpectrumEntry spectrumEntries[NumEntries];
+    int nextFloatEntry = 0, nextSpectrumEntry = 0;
+};
+
+// CachingTextureEvaluator Definition
+// Evaluates any texture, like the _UniversalTextureEvaluator_, but reuses
+// the values recorded in a _TextureEvaluationCache_ when a texture is looked
+// up again with the same context.
+class CachingTextureEvaluator {
+  public:
+    // CachingTextureEvaluator Public Methods
+    CachingTextureEvaluator(TextureEvaluationCache *cache) : cache(cache) {}
+
+    bool CanEvaluate(std::initializer_list<FloatTexture>,
+                     std::initializer_list<SpectrumTexture>) const {
+        return true;
+    }
+
+    Float operator()(FloatTexture tex, TextureEvalContext ctx);
+
+    SampledSpectrum operator()(SpectrumTexture tex, TextureEvalContext ctx,
+                               SampledWavelengths lambda);
+
+  private:
+    // CachingTextureEvaluator Private Members
+    TextureEvaluationCache *cache;
+};
+
 // BasicTextureEvaluator Definition
 class BasicTextureEvaluator {
   public:
@@ -0,0 +1,184 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/blockcompress.h>
+
+#include <pbrt/util/math.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace pbrt {
+
+// Finds the endpoints of the segment along the principal axis of the 16
+// points _p_ that spans their projections onto it.
+static void PrincipalEndpoints(const float p[16][3], float e0[3], float e1[3]) {
+    // Compute the points' mean and covariance matrix
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += p[i][c] / 16;
+    float cov[3][3] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b)
+                cov[a][b] += (p[i][a] - mean[a]) * (p[i][b] - mean[b]);
+
+    // Find the principal axis using power iteration
+    float axis[3] = {1, 1, 1};
+    for (int iter = 0; iter < 8; ++iter) {
+        float next[3] = {0, 0, 0};
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b)
+                next[a] += cov[a][b] * axis[b];
+        float length = std::sqrt(Sqr(next[0]) + Sqr(next[1]) + Sqr(next[2]));
+        if (length == 0)
+            break;
+        for (int c = 0; c < 3; ++c)
+            axis[c] = next[c] / length;
+    }
+
+    // Project the points onto the axis and return the extremes
+    float tMin = 0, tMax = 0;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0;
+        for (int c = 0; c < 3; ++c)
+            t += (p[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + tMin * axis[c];
+        e1[c] = mean[c] + tMax * axis[c];
+    }
+}
+
+// Returns the index of the palette entry closest to _v_.
+template <int N, int M>
+static int ClosestEntry(const int palette[N][M], const int v[M]) {
+    int best = 0, bestError = -1;
+    for (int i = 0; i < N; ++i) {
+        int error = 0;
+        for (int c = 0; c < M; ++c)
+            error += Sqr(palette[i][c] - v[c]);
+        if (bestError == -1 || error < bestError) {
+            best = i;
+            bestError = error;
+        }
+    }
+    return best;
+}
+
+// Block Compression Function Definitions
+void EncodeBC1Block(const uint8_t rgb[16][3], uint8_t block[8]) {
+    // Quantize the principal axis endpoints to 5:6:5
+    float p[16][3], e[2][3];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            p[i][c] = rgb[i][c];
+    PrincipalEndpoints(p, e[0], e[1]);
+    uint16_t endpoint[2];
+    for (int j = 0; j < 2; ++j) {
+        int r = Clamp(int(std::round(e[j][0] * 31 / 255)), 0, 31);
+        int g = Clamp(int(std::round(e[j][1] * 63 / 255)), 0, 63);
+        int b = Clamp(int(std::round(e[j][2] * 31 / 255)), 0, 31);
+        endpoint[j] = (r << 11) | (g << 5) | b;
+    }
+    // The first endpoint must be larger to use the four-color palette
+    if (endpoint[0] < endpoint[1])
+        std::swap(endpoint[0], endpoint[1]);
+    block[0] = endpoint[0] & 0xff;
+    block[1] = endpoint[0] >> 8;
+    block[2] = endpoint[1] & 0xff;
+    block[3] = endpoint[1] >> 8;
+
+    // Choose each texel's palette entry, decoding the palette from the block
+    // so that rounding matches the decoder
+    int palette[4][3];
+    for (int i = 0; i < 4; ++i) {
+        block[4] = i;
+        uint8_t v[3];
+        DecodeBC1Texel(block, 0, v);
+        for (int c = 0; c < 3; ++c)
+            palette[i][c] = v[c];
+    }
+    uint32_t indices = 0;
+    if (endpoint[0] != endpoint[1])
+        for (int i = 0; i < 16; ++i) {
+            int v[3] = {rgb[i][0], rgb[i][1], rgb[i][2]};
+            indices |= uint32_t(ClosestEntry<4, 3>(palette, v)) << (2 * i);
+        }
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+void EncodeBC4Block(const uint8_t v[16], uint8_t block[8]) {
+    // Use the extreme values as endpoints with the eight-value palette
+    uint8_t vMin = *std::min_element(v, v + 16), vMax = *std::max_element(v, v + 16);
+    block[0] = vMax;
+    block[1] = vMin;
+    int palette[8][1];
+    for (int i = 0; i < 8; ++i)
+        palette[i][0] = BC4PaletteValue(vMax, vMin, i);
+
+    uint64_t indices = 0;
+    if (vMax != vMin)
+        for (int i = 0; i < 16; ++i) {
+            int value[1] = {v[i]};
+            indices |= uint64_t(ClosestEntry<8, 1>(palette, value)) << (3 * i);
+        }
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+void EncodeBC6HBlock(const uint16_t rgb[16][3], uint8_t block[16]) {
+    // Find endpoints for the texels' half-float bits, which BC6H interpolates
+    // as integers
+    float p[16][3], e[2][3];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            p[i][c] = rgb[i][c];
+    PrincipalEndpoints(p, e[0], e[1]);
+    // An endpoint _q_ decodes to roughly 31 q + 15.5
+    int q[2][3];
+    for (int j = 0; j < 2; ++j)
+        for (int c = 0; c < 3; ++c)
+            q[j][c] = Clamp(int(std::round((e[j][c] - 15.5f) / 31)), 0, 1023);
+
+    // Choose each texel's palette entry
+    int palette[16][3], index[16];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            palette[i][c] = BC6HInterpolate(q[0][c], q[1][c], i);
+    for (int i = 0; i < 16; ++i) {
+        int v[3] = {rgb[i][0], rgb[i][1], rgb[i][2]};
+        index[i] = ClosestEntry<16, 3>(palette, v);
+    }
+    // The first texel's index must be less than 8; the palette is symmetric,
+    // so swapping the endpoints reverses it
+    if (index[0] >= 8) {
+        std::swap(q[0], q[1]);
+        for (int i = 0; i < 16; ++i)
+            index[i] = 15 - index[i];
+    }
+
+    // Pack the mode, endpoints, and indices into the block
+    uint64_t bits[2] = {0, 0};
+    auto put = [&](int start, int n, uint64_t value) {
+        bits[start >= 64] |= value << (start % 64);
+        if (start < 64 && start + n > 64)
+            bits[1] |= value >> (64 - start);
+    };
+    put(0, 5, 0x03);
+    for (int c = 0; c < 3; ++c) {
+        put(5 + 10 * c, 10, q[0][c]);
+        put(35 + 10 * c, 10, q[1][c]);
+    }
+    put(65, 3, index[0]);
+    for (int i = 1; i < 16; ++i)
+        put(64 + 4 * i, 4, index[i]);
+    std::memcpy(block, bits, sizeof(bits));
+}
+
+}  // namespace pbrt
@@ -0,0 +1,115 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#ifndef PBRT_UTIL_BLOCKCOMPRESS_H
+#define PBRT_UTIL_BLOCKCOMPRESS_H
+
+#include <pbrt/pbrt.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace pbrt {
+
+// Block Compression Declarations
+// These functions encode and decode 4x4 blocks of texels in the BC1, BC4, and
+// BC6H formats that GPUs decode in hardware. BC1 stores 8-bit RGB in 8 bytes,
+// BC4 a single 8-bit channel in 8 bytes, and BC6H unsigned half-float RGB,
+// given by the bits of its _Half_ values, in 16 bytes. Texels are numbered in
+// scanline order within their block. The BC6H encoder only uses mode 11, which
+// stores a single pair of 10-bit endpoints, and the decoder only handles that
+// mode; blocks in other modes decode to black.
+void EncodeBC1Block(const uint8_t rgb[16][3], uint8_t block[8]);
+void EncodeBC4Block(const uint8_t v[16], uint8_t block[8]);
+void EncodeBC6HBlock(const uint16_t rgb[16][3], uint8_t block[16]);
+
+// Block Compression Inline Functions
+PBRT_CPU_GPU inline void DecodeBC1Texel(const uint8_t block[8], int texel,
+                                        uint8_t rgb[3]) {
+    // Find the block's endpoints and the texel's index
+    uint16_t c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    int index = (block[4 + texel / 4] >> (2 * (texel % 4))) & 3;
+
+    // Expand the 5:6:5 endpoints and interpolate between them
+    for (int c = 0; c < 3; ++c) {
+        int shift = c == 0 ? 11 : (c == 1 ? 5 : 0), bits = c == 1 ? 6 : 5;
+        int mask = (1 << bits) - 1;
+        int e0 = (c0 >> shift) & mask, e1 = (c1 >> shift) & mask;
+        e0 = (e0 << (8 - bits)) | (e0 >> (2 * bits - 8));
+        e1 = (e1 << (8 - bits)) | (e1 >> (2 * bits - 8));
+        if (index == 0)
+            rgb[c] = e0;
+        else if (index == 1)
+            rgb[c] = e1;
+        else if (c0 > c1)
+            rgb[c] = index == 2 ? (2 * e0 + e1 + 1) / 3 : (e0 + 2 * e1 + 1) / 3;
+        else
+            rgb[c] = index == 2 ? (e0 + e1 + 1) / 2 : 0;
+    }
+}
+
+PBRT_CPU_GPU inline uint8_t BC4PaletteValue(int v0, int v1, int index) {
+    if (index == 0)
+        return v0;
+    if (index == 1)
+        return v1;
+    if (v0 > v1)
+        return ((8 - index) * v0 + (index - 1) * v1 + 3) / 7;
+    if (index < 6)
+        return ((6 - index) * v0 + (index - 1) * v1 + 2) / 5;
+    return index == 6 ? 0 : 255;
+}
+
+PBRT_CPU_GPU inline uint8_t DecodeBC4Texel(const uint8_t block[8], int texel) {
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= uint64_t(block[2 + i]) << (8 * i);
+    return BC4PaletteValue(block[0], block[1], (indices >> (3 * texel)) & 7);
+}
+
+// Returns _n_ bits of a BC6H block, starting at bit _start_
+PBRT_CPU_GPU inline uint32_t BC6HBits(const uint8_t block[16], int start, int n) {
+    uint64_t half[2];
+    std::memcpy(half, block, sizeof(half));
+    uint64_t bits = start >= 64 ? half[1] >> (start - 64) : half[0] >> start;
+    if (start < 64 && start + n > 64)
+        bits |= half[1] << (64 - start);
+    return uint32_t(bits & ((uint64_t(1) << n) - 1));
+}
+
+// Returns the 16-bit value that BC6H interpolates for a 10-bit endpoint
+PBRT_CPU_GPU inline int BC6HUnquantize(int q) {
+    if (q == 0)
+        return 0;
+    if (q == 1023)
+        return 0xffff;
+    return ((q << 16) + 0x8000) >> 10;
+}
+
+// Returns the bits of the unsigned half-float value that BC6H decodes for the
+// given 10-bit endpoints and 4-bit index
+PBRT_CPU_GPU inline uint16_t BC6HInterpolate(int q0, int q1, int index) {
+    constexpr int weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                 34, 38, 43, 47, 51, 55, 60, 64};
+    int w = weights[index];
+    int v = (BC6HUnquantize(q0) * (64 - w) + BC6HUnquantize(q1) * w + 32) >> 6;
+    return uint16_t((v * 31) >> 6);
+}
+
+PBRT_CPU_GPU inline void DecodeBC6HTexel(const uint8_t block[16], int texel,
+                                         uint16_t rgb[3]) {
+    if (BC6HBits(block, 0, 5) != 0x03) {
+        rgb[0] = rgb[1] = rgb[2] = 0;
+        return;
+    }
+    // The first texel's index has an implicit leading zero bit
+    int index = texel == 0 ? BC6HBits(block, 65, 3) : BC6HBits(block, 64 + 4 * texel, 4);
+    for (int c = 0; c < 3; ++c)
+        rgb[c] = BC6HInterpolate(BC6HBits(block, 5 + 10 * c, 10),
+                                 BC6HBits(block, 35 + 10 * c, 10), index);
+}
+
+}  // namespace pbrt
+
+#endif  // PBRT_UTIL_BLOCKCOMPRESS_H
@@ -0,0 +1,105 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/blockcompress.h>
+#include <pbrt/util/float.h>
+#include <pbrt/util/rng.h>
+
+#include <cmath>
+
+using namespace pbrt;
+
+TEST(BlockCompress, BC1) {
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        // Texels along a gradient with a little noise
+        uint8_t rgb[16][3];
+        int base[3] = {int(rng.Uniform<uint32_t>(200)), int(rng.Uniform<uint32_t>(200)),
+                       int(rng.Uniform<uint32_t>(200))};
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                rgb[i][c] = base[c] + 8 * (i % 4 + i / 4) + rng.Uniform<uint32_t>(4);
+
+        uint8_t block[8];
+        EncodeBC1Block(rgb, block);
+        for (int i = 0; i < 16; ++i) {
+            uint8_t v[3];
+            DecodeBC1Texel(block, i, v);
+            for (int c = 0; c < 3; ++c)
+                EXPECT_LE(std::abs(v[c] - rgb[i][c]), 16) << i << " " << c;
+        }
+    }
+
+    // A constant block is reproduced up to 5:6:5 quantization
+    uint8_t rgb[16][3];
+    for (int i = 0; i < 16; ++i) {
+        rgb[i][0] = 255;
+        rgb[i][1] = 0;
+        rgb[i][2] = 255;
+    }
+    uint8_t block[8];
+    EncodeBC1Block(rgb, block);
+    for (int i = 0; i < 16; ++i) {
+        uint8_t v[3];
+        DecodeBC1Texel(block, i, v);
+        EXPECT_EQ(255, v[0]);
+        EXPECT_EQ(0, v[1]);
+        EXPECT_EQ(255, v[2]);
+    }
+}
+
+TEST(BlockCompress, BC4) {
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        uint8_t v[16];
+        for (int i = 0; i < 16; ++i)
+            v[i] = rng.Uniform<uint32_t>(256);
+        uint8_t vMin = 255, vMax = 0;
+        for (int i = 0; i < 16; ++i) {
+            vMin = std::min(vMin, v[i]);
+            vMax = std::max(vMax, v[i]);
+        }
+
+        uint8_t block[8];
+        EncodeBC4Block(v, block);
+        for (int i = 0; i < 16; ++i) {
+            // The palette's entries are (vMax - vMin) / 7 apart
+            int d = std::abs(DecodeBC4Texel(block, i) - v[i]);
+            EXPECT_LE(d, (vMax - vMin) / 14 + 1) << i;
+            if (v[i] == vMin || v[i] == vMax) {
+                EXPECT_EQ(0, d);
+            }
+        }
+    }
+}
+
+TEST(BlockCompress, BC6H) {
+    RNG rng;
+    for (int iter = 0; iter < 100; ++iter) {
+        // HDR texels along a gradient over a range of magnitudes
+        Float scale = std::pow(2.f, -10 + 20 * rng.Uniform<Float>());
+        Float values[16][3];
+        uint16_t rgb[16][3];
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c) {
+                values[i][c] = scale * (1 + 0.3f * c) * (1 + (i % 4 + i / 4) / 6.f);
+                rgb[i][c] = Half(values[i][c]).Bits();
+            }
+
+        uint8_t block[16];
+        EncodeBC6HBlock(rgb, block);
+        for (int i = 0; i < 16; ++i) {
+            uint16_t h[3];
+            DecodeBC6HTexel(block, i, h);
+            for (int c = 0; c < 3; ++c)
+                EXPECT_LT(std::abs(Float(Half::FromBits(h[c])) - values[i][c]),
+                          0.1f * values[i][c])
+                    << i << " " << c;
+        }
+    }
+}
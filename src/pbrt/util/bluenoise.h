@@ -15,8 +15,15 @@ namespace pbrt {
 static constexpr int BlueNoiseResolution = 128;
 static constexpr int NumBlueNoiseTextures = 48;
 
-extern PBRT_CONST uint16_t
-    BlueNoiseTextures[NumBlueNoiseTextures][BlueNoiseResolution][BlueNoiseResolution];
+// The blue noise textures are stored as 14-bit ranks packed into 32-bit words;
+// an extra word at the end lets lookups always read two words.
+static constexpr int BlueNoiseRankBits = 14;
+static constexpr int NumBlueNoiseRankWords =
+    NumBlueNoiseTextures * BlueNoiseResolution * BlueNoiseResolution *
+        BlueNoiseRankBits / 32 +
+    1;
+
+extern PBRT_CONST uint32_t BlueNoiseRanks[NumBlueNoiseRankWords];
 
 // Blue noise lookup functions
 PBRT_CPU_GPU inline float BlueNoise(int tableIndex, Point2i p);
@@ -26,7 +33,14 @@ inline float BlueNoise(int textureIndex, Point2i p) {
     CHECK(textureIndex >= 0 && p.x >= 0 && p.y >= 0);
     textureIndex %= NumBlueNoiseTextures;
     int x = p.x % BlueNoiseResolution, y = p.y % BlueNoiseResolution;
-    return BlueNoiseTextures[textureIndex][x][y] / 65535.f;
+    // Extract the pixel's rank from the two words that may hold its bits
+    uint32_t bit =
+        ((textureIndex * BlueNoiseResolution + x) * BlueNoiseResolution + y) *
+        BlueNoiseRankBits;
+    uint32_t word = bit / 32, shift = bit % 32;
+    uint64_t bits = BlueNoiseRanks[word] | (uint64_t(BlueNoiseRanks[word + 1]) << 32);
+    uint32_t rank = (bits >> shift) & ((1u << BlueNoiseRankBits) - 1);
+    return (rank << 2) / 65535.f;
 }
 
 }  // namespace pbrt
@@ -8,20 +8,26 @@
 
 namespace pbrt {
 
+thread_local int BufferCacheBypass::depth;
+
 // BufferCache Global Definitions
 BufferCache<int> *intBufferCache;
+BufferCache<uint16_t> *uint16BufferCache;
 BufferCache<Point2f> *point2BufferCache;
 BufferCache<Point3f> *point3BufferCache;
 BufferCache<Vector3f> *vector3BufferCache;
 BufferCache<Normal3f> *normal3BufferCache;
+BufferCache<OctahedralVector> *octahedralBufferCache;
 
 void InitBufferCaches() {
     CHECK(intBufferCache == nullptr);
     intBufferCache = new BufferCache<int>;
+    uint16BufferCache = new BufferCache<uint16_t>;
     point2BufferCache = new BufferCache<Point2f>;
     point3BufferCache = new BufferCache<Point3f>;
     vector3BufferCache = new BufferCache<Vector3f>;
     normal3BufferCache = new BufferCache<Normal3f>;
+    octahedralBufferCache = new BufferCache<OctahedralVector>;
 }
 
 }  // namespace pbrt
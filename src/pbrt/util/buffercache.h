@@ -9,6 +9,7 @@
 
 #include <pbrt/util/check.h>
 #include <pbrt/util/hash.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/stats.h>
@@ -16,59 +17,69 @@
 
 #include <atomic>
 #include <cstring>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Redundant vertex and index buffers", redundantBufferBytes);
 STAT_PERCENT("Geometry/Buffer cache hits", nBufferCacheHits, nBufferCacheLookups);
 
+// BufferCacheBypass Definition
+// While a _BufferCacheBypass_ is in scope, buffers added to _BufferCache_s by
+// the current thread are allocated directly from the provided allocator and
+// not shared, so that they may be freed along with it.
+class BufferCacheBypass {
+  public:
+    BufferCacheBypass() { ++depth; }
+    ~BufferCacheBypass() { --depth; }
+    BufferCacheBypass(const BufferCacheBypass &) = delete;
+    BufferCacheBypass &operator=(const BufferCacheBypass &) = delete;
+
+    static bool Active() { return depth > 0; }
+
+  private:
+    static thread_local int depth;
+};
+
 // BufferCache Definition
 template <typename T>
 class BufferCache {
   public:
     // BufferCache Public Methods
     const T *LookupOrAdd(pstd::span<const T> buf, Allocator alloc) {
-        ++nBufferCacheLookups;
-        // Return pointer to data if _buf_ contents are already in the cache
-        Buffer lookupBuffer(buf.data(), buf.size());
-        int shardIndex = uint32_t(lookupBuffer.hash) >> (32 - logShards);
-        DCHECK(shardIndex >= 0 && shardIndex < nShards);
-        mutex[shardIndex].lock_shared();
-        if (auto iter = cache[shardIndex].find(lookupBuffer);
-            iter != cache[shardIndex].end()) {
-            const T *ptr = iter->ptr;
-            mutex[shardIndex].unlock_shared();
-            DCHECK(std::memcmp(buf.data(), iter->ptr, buf.size() * sizeof(T)) == 0);
-            ++nBufferCacheHits;
-            redundantBufferBytes += buf.size() * sizeof(T);
+        if (BufferCacheBypass::Active()) {
+            T *ptr = alloc.allocate_object<T>(buf.size());
+            std::copy(buf.begin(), buf.end(), ptr);
             return ptr;
         }
+        return lookupOrAdd(buf.data(), buf.size(), nullptr, alloc);
+    }
 
-        // Add _buf_ contents to cache and return pointer to cached copy
-        mutex[shardIndex].unlock_shared();
-        T *ptr = alloc.allocate_object<T>(buf.size());
-        std::copy(buf.begin(), buf.end(), ptr);
-        bytesUsed += buf.size() * sizeof(T);
-        mutex[shardIndex].lock();
-        // Handle the case of another thread adding the buffer first
-        if (auto iter = cache[shardIndex].find(lookupBuffer);
-            iter != cache[shardIndex].end()) {
-            const T *cachePtr = iter->ptr;
-            mutex[shardIndex].unlock();
-            alloc.deallocate_object(ptr, buf.size());
-            ++nBufferCacheHits;
-            redundantBufferBytes += buf.size() * sizeof(T);
-            return cachePtr;
-        }
-
-        cache[shardIndex].insert(Buffer(ptr, buf.size()));
-        mutex[shardIndex].unlock();
+    // Returns storage for a buffer of _size_ elements that the caller can
+    // fill and then pass to LookupOrAdopt(), which avoids the copy that
+    // LookupOrAdd() makes when the data is computed rather than given.
+    T *Allocate(size_t size, Allocator alloc) {
+        T *ptr = alloc.allocate_object<T>(size);
+        if (!BufferCacheBypass::Active())
+            NumaInterleave(ptr, size * sizeof(T));
         return ptr;
     }
 
+    // Takes ownership of _buf_, which must have been returned by Allocate()
+    // with the same allocator, and returns the cached buffer with the same
+    // contents; _buf_ becomes the cached buffer if there isn't one already
+    // and is freed otherwise.
+    const T *LookupOrAdopt(T *buf, size_t size, Allocator alloc) {
+        if (BufferCacheBypass::Active())
+            return buf;
+        return lookupOrAdd(buf, size, buf, alloc);
+    }
+
     size_t BytesUsed() const { return bytesUsed; }
 
   private:
@@ -77,8 +88,10 @@ class BufferCache {
         // BufferCache::Buffer Public Methods
         Buffer() = default;
         Buffer(const T *ptr, size_t size) : ptr(ptr), size(size) {
-            hash = HashBuffer(ptr, size);
+            hash = HashContents(ptr, size);
         }
+        Buffer(const T *ptr, size_t size, size_t hash)
+            : ptr(ptr), size(size), hash(hash) {}
 
         bool operator==(const Buffer &b) const {
             return size == b.size && hash == b.hash &&
@@ -94,20 +107,137 @@ class BufferCache {
         size_t operator()(const Buffer &b) const { return b.hash; }
     };
 
+    // BufferCache::Shard Definition
+    // Buffers are sharded by size. The first buffer of each size is recorded
+    // in _sizes_ without being hashed; it is only hashed and moved to
+    // _buffers_ once a different buffer of the same size is added, so that
+    // large meshes' buffers, which are usually unique, are never hashed. A
+    // null pointer in _sizes_ indicates that all buffers of that size are in
+    // _buffers_.
+    struct Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<size_t, const T *> sizes;
+        std::unordered_set<Buffer, BufferHasher> buffers;
+    };
+
+    // BufferCache Private Methods
+    // Large buffers are hashed in fixed-size chunks, in parallel, and the
+    // chunks' hashes are then hashed together.
+    static size_t HashContents(const T *ptr, size_t size) {
+        size_t nBytes = size * sizeof(T);
+        if (nBytes < 2 * hashChunkBytes)
+            return HashBuffer(ptr, nBytes);
+        const unsigned char *bytes = (const unsigned char *)ptr;
+        std::vector<uint64_t> chunkHashes((nBytes + hashChunkBytes - 1) / hashChunkBytes);
+        auto hashChunk = [&](int64_t i) {
+            size_t offset = i * hashChunkBytes;
+            size_t chunkBytes = std::min(hashChunkBytes, nBytes - offset);
+            chunkHashes[i] = MurmurHash64A(bytes + offset, chunkBytes, i);
+        };
+        if (RunningThreads() > 1)
+            ParallelFor(0, chunkHashes.size(), hashChunk);
+        else
+            for (size_t i = 0; i < chunkHashes.size(); ++i)
+                hashChunk(i);
+        return HashBuffer(chunkHashes.data(), chunkHashes.size() * sizeof(uint64_t),
+                          nBytes);
+    }
+
+    // Returns the cached buffer matching the _size_ elements at _data_. If
+    // _owned_ is non-null, it points to _data_ and is used for the cached
+    // buffer or freed; otherwise _data_ is copied if it isn't in the cache.
+    const T *lookupOrAdd(const T *data, size_t size, T *owned, Allocator alloc) {
+        ++nBufferCacheLookups;
+        Shard &shard = shards[MixBits(size) >> (64 - logShards)];
+        auto copy = [&]() {
+            T *ptr = alloc.allocate_object<T>(size);
+            NumaInterleave(ptr, size * sizeof(T));
+            std::copy(data, data + size, ptr);
+            return ptr;
+        };
+        auto hit = [&](const T *cachePtr) {
+            if (owned)
+                alloc.deallocate_object(owned, size);
+            ++nBufferCacheHits;
+            redundantBufferBytes += size * sizeof(T);
+            return cachePtr;
+        };
+
+        // Compare the buffer to the one of the same size if there's just one,
+        // adding it without hashing if none has its size
+        const T *first = nullptr;
+        bool sizeFound = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            if (auto iter = shard.sizes.find(size); iter != shard.sizes.end()) {
+                sizeFound = true;
+                first = iter->second;
+            }
+        }
+        if (first && std::memcmp(data, first, size * sizeof(T)) == 0)
+            return hit(first);
+        if (!sizeFound) {
+            T *ptr = owned ? owned : copy();
+            std::lock_guard<std::shared_mutex> lock(shard.mutex);
+            if (shard.sizes.insert({size, ptr}).second) {
+                bytesUsed += size * sizeof(T);
+                return ptr;
+            }
+            // Handle the case of another thread adding a buffer of the same
+            // size first; _ptr_ is now owned here either way
+            owned = ptr;
+            data = ptr;
+            first = shard.sizes[size];
+            if (first && std::memcmp(data, first, size * sizeof(T)) == 0)
+                return hit(first);
+        }
+
+        // Hash the buffer, along with the first one of its size if it is still
+        // unhashed, outside of the lock, and look it up
+        Buffer buffer(data, size);
+        size_t firstHash = first ? HashContents(first, size) : 0;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            if (auto iter = shard.buffers.find(buffer); iter != shard.buffers.end()) {
+                DCHECK(std::memcmp(data, iter->ptr, size * sizeof(T)) == 0);
+                return hit(iter->ptr);
+            }
+        }
+
+        // Add the buffer's contents to the cache and return the cached copy
+        T *ptr = owned ? owned : copy();
+        std::lock_guard<std::shared_mutex> lock(shard.mutex);
+        if (const T *&sizeFirst = shard.sizes[size]; sizeFirst) {
+            size_t hash = sizeFirst == first ? firstHash : HashContents(sizeFirst, size);
+            shard.buffers.insert(Buffer(sizeFirst, size, hash));
+            sizeFirst = nullptr;
+        }
+        // Handle the case of another thread adding the buffer first
+        if (auto iter = shard.buffers.find(buffer); iter != shard.buffers.end()) {
+            owned = ptr;
+            return hit(iter->ptr);
+        }
+        shard.buffers.insert(Buffer(ptr, size, buffer.hash));
+        bytesUsed += size * sizeof(T);
+        return ptr;
+    }
+
     // BufferCache Private Members
     static constexpr int logShards = 6;
     static constexpr int nShards = 1 << logShards;
-    std::shared_mutex mutex[nShards];
-    std::unordered_set<Buffer, BufferHasher> cache[nShards];
+    static constexpr size_t hashChunkBytes = 1024 * 1024;
+    Shard shards[nShards];
     std::atomic<size_t> bytesUsed{};
 };
 
 // BufferCache Global Declarations
 extern BufferCache<int> *intBufferCache;
+extern BufferCache<uint16_t> *uint16BufferCache;
 extern BufferCache<Point2f> *point2BufferCache;
 extern BufferCache<Point3f> *point3BufferCache;
 extern BufferCache<Vector3f> *vector3BufferCache;
 extern BufferCache<Normal3f> *normal3BufferCache;
+extern BufferCache<OctahedralVector> *octahedralBufferCache;
 
 void InitBufferCaches();
 
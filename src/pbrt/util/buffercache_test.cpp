@@ -7,6 +7,7 @@
 #include <pbrt/pbrt.h>
 #include <pbrt/util/buffercache.h>
 
+#include <algorithm>
 #include <vector>
 
 using namespace pbrt;
@@ -37,3 +38,52 @@ TEST(BufferCache, Basics) {
 
     EXPECT_EQ(9 * sizeof(int), intBufferCache->BytesUsed() - baseMem);
 }
+
+TEST(BufferCache, Adopt) {
+    Allocator alloc;
+    size_t baseMem = intBufferCache->BytesUsed();
+
+    // A new buffer is cached as it is
+    int *buf = intBufferCache->Allocate(3, alloc);
+    for (int i = 0; i < 3; ++i)
+        buf[i] = 100 * (i + 1);
+    const int *ptr = intBufferCache->LookupOrAdopt(buf, 3, alloc);
+    EXPECT_EQ(buf, ptr);
+    EXPECT_EQ(3 * sizeof(int), intBufferCache->BytesUsed() - baseMem);
+
+    // Buffers with the same contents get the cached one, however they're added
+    int *buf2 = intBufferCache->Allocate(3, alloc);
+    std::copy(ptr, ptr + 3, buf2);
+    EXPECT_EQ(ptr, intBufferCache->LookupOrAdopt(buf2, 3, alloc));
+    std::vector<int> v{100, 200, 300};
+    EXPECT_EQ(ptr, intBufferCache->LookupOrAdd(v, alloc));
+    EXPECT_EQ(3 * sizeof(int), intBufferCache->BytesUsed() - baseMem);
+}
+
+TEST(BufferCache, SameSize) {
+    Allocator alloc;
+    size_t baseMem = intBufferCache->BytesUsed();
+
+    // Distinct buffers of the same size are all cached and found again,
+    // including ones large enough to be hashed in chunks
+    for (size_t size : {7, 3 * 1024 * 1024 + 5}) {
+        std::vector<std::vector<int>> bufs(3, std::vector<int>(size, 12345));
+        for (int i = 0; i < 3; ++i)
+            bufs[i][size / 2] = i;
+
+        std::vector<const int *> ptrs;
+        for (const std::vector<int> &buf : bufs) {
+            ptrs.push_back(intBufferCache->LookupOrAdd(buf, alloc));
+            EXPECT_TRUE(std::equal(buf.begin(), buf.end(), ptrs.back()));
+        }
+        EXPECT_NE(ptrs[0], ptrs[1]);
+        EXPECT_NE(ptrs[0], ptrs[2]);
+        EXPECT_NE(ptrs[1], ptrs[2]);
+        for (int i = 2; i >= 0; --i)
+            EXPECT_EQ(ptrs[i], intBufferCache->LookupOrAdd(bufs[i], alloc));
+        EXPECT_EQ(ptrs[1], intBufferCache->LookupOrAdd(std::vector<int>(bufs[1]), alloc));
+
+        baseMem += 3 * size * sizeof(int);
+        EXPECT_EQ(baseMem, intBufferCache->BytesUsed());
+    }
+}
@@ -172,7 +172,8 @@ std::string RGBToSpectrumTable::ToString() const {
         id = "(Rec2020) ";
     else if (this == RGBToSpectrumTable::ACES2065_1)
         id = "(ACES2065_1) ";
-    CHECK(!id.empty());
+    else
+        id = "(computed) ";
 
     return StringPrintf("[ RGBToSpectrumTable res: %d %s]", res, id);
 }
@@ -213,6 +214,17 @@ std::string ColorEncoding::ToString() const {
     return DispatchCPU(ts);
 }
 
+std::string ColorEncoding::Name() const {
+    if (!ptr())
+        return "";
+    if (*this == Linear)
+        return "linear";
+    if (*this == sRGB)
+        return "sRGB";
+    CHECK(Is<GammaColorEncoding>());
+    return StringPrintf("gamma %f", Cast<GammaColorEncoding>()->Gamma());
+}
+
 ColorEncoding ColorEncoding::Linear;
 ColorEncoding ColorEncoding::sRGB;
 
@@ -342,6 +342,14 @@ class RGBSigmoidPolynomial {
         return s(EvaluatePolynomial(lambda, c2, c1, c0));
     }
 
+    // Evaluates the sigmoid at all of the sampled wavelengths at once; it is
+    // defined in util/spectrum.h.
+    PBRT_CPU_GPU
+    inline SampledSpectrum Sample(const SampledWavelengths &lambda) const;
+
+    PBRT_CPU_GPU
+    pstd::array<Float, 3> Coefficients() const { return {c0, c1, c2}; }
+
     PBRT_CPU_GPU
     Float MaxValue() const {
         Float result = std::max((*this)(360), (*this)(830));
@@ -415,6 +423,8 @@ class ColorEncoding
     PBRT_CPU_GPU inline Float ToFloatLinear(Float v) const;
 
     std::string ToString() const;
+    // 返回Get()能够解析回同一编码的名称; 编码为空时返回空字符串
+    std::string Name() const;
 
     static const ColorEncoding Get(const std::string &name, Allocator alloc);
 
@@ -477,6 +487,8 @@ class GammaColorEncoding {
     PBRT_CPU_GPU
     void FromLinear(pstd::span<const Float> vin, pstd::span<uint8_t> vout) const;
 
+    Float Gamma() const { return gamma; }
+
     std::string ToString() const;
 
   private:
@@ -79,6 +79,20 @@ TEST(RGBColorSpace, StdIllumWhiteACES2065_1) {
 }
 
 #if 0
+TEST(RGBColorSpace, CreateBuiltIn) {
+    EXPECT_EQ(RGBColorSpace::sRGB,
+              RGBColorSpace::Create(Point2f(.64, .33), Point2f(.3, .6), Point2f(.15, .06),
+                                    GetNamedSpectrum("stdillum-D65"), {}));
+    EXPECT_EQ(RGBColorSpace::ACES2065_1,
+              RGBColorSpace::Create(RGBColorSpace::ACES2065_1->r,
+                                    RGBColorSpace::ACES2065_1->g,
+                                    RGBColorSpace::ACES2065_1->b,
+                                    RGBColorSpace::ACES2065_1->w, {}));
+    // No standard illuminant has this whitepoint
+    EXPECT_EQ(nullptr, RGBColorSpace::Create(Point2f(.64, .33), Point2f(.3, .6),
+                                             Point2f(.15, .06), Point2f(.4, .4), {}));
+}
+
 TEST(RGBUnboundedSpectrum, SmallValues) {
     RGB rgb(0.00010678071, 0, 0.000010491596);
     RGBUnboundedSpectrum rs(*RGBColorSpace::sRGB, rgb);
@@ -197,6 +211,32 @@ TEST(RGBAlbedoSpectrum, RoundTripACES) {
     }
 }
 
+TEST(RGBAlbedoSpectrum, RoundTripCreated) {
+    // Adobe RGB (1998)
+    const RGBColorSpace *cs =
+        RGBColorSpace::Create(Point2f(.64, .33), Point2f(.21, .71), Point2f(.15, .06),
+                              GetNamedSpectrum("stdillum-D65"), {});
+    ASSERT_TRUE(cs != nullptr);
+    EXPECT_NE(*cs, *RGBColorSpace::sRGB);
+    EXPECT_EQ(cs, RGBColorSpace::Create(cs->r, cs->g, cs->b, cs->w, {}));
+
+    RNG rng;
+    for (int i = 0; i < 100; ++i) {
+        RGB rgb(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        RGBAlbedoSpectrum rs(*cs, rgb);
+
+        DenselySampledSpectrum rsIllum = DenselySampledSpectrum::SampleFunction(
+            [&](Float lambda) { return rs(lambda) * cs->illuminant(lambda); });
+        XYZ xyz = SpectrumToXYZ(&rsIllum);
+        RGB rgb2 = cs->ToRGB(xyz);
+
+        Float eps = .01;
+        EXPECT_LT(std::abs(rgb.r - rgb2.r), eps) << rgb << " vs " << rgb2;
+        EXPECT_LT(std::abs(rgb.g - rgb2.g), eps) << rgb << " vs " << rgb2;
+        EXPECT_LT(std::abs(rgb.b - rgb2.b), eps) << rgb << " vs " << rgb2;
+    }
+}
+
 TEST(RGBIlluminantSpectrum, RoundTripsRGB) {
     RNG rng;
     const RGBColorSpace &cs = *RGBColorSpace::sRGB;
@@ -8,6 +8,17 @@
 #include <pbrt/gpu/util.h>
 #endif
 #include <pbrt/options.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/print.h>
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
 
 namespace pbrt {
 
@@ -60,19 +71,335 @@ const RGBColorSpace *RGBColorSpace::GetNamed(std::string n) {
         return nullptr;
 }
 
-const RGBColorSpace *RGBColorSpace::Lookup(Point2f r, Point2f g, Point2f b, Point2f w) {
+static bool Matches(const RGBColorSpace *cs, Point2f r, Point2f g, Point2f b, Point2f w) {
     auto closeEnough = [](const Point2f &a, const Point2f &b) {
         return ((a.x == b.x || std::abs((a.x - b.x) / b.x) < 1e-3) &&
                 (a.y == b.y || std::abs((a.y - b.y) / b.y) < 1e-3));
     };
+    return closeEnough(r, cs->r) && closeEnough(g, cs->g) && closeEnough(b, cs->b) &&
+           closeEnough(w, cs->w);
+}
+
+const RGBColorSpace *RGBColorSpace::Lookup(Point2f r, Point2f g, Point2f b, Point2f w) {
     for (const RGBColorSpace *cs : {ACES2065_1, DCI_P3, Rec2020, sRGB}) {
-        if (closeEnough(r, cs->r) && closeEnough(g, cs->g) && closeEnough(b, cs->b) &&
-            closeEnough(w, cs->w))
+        if (Matches(cs, r, g, b, w))
             return cs;
     }
     return nullptr;
 }
 
+// RGBToSpectrumOptimizer Definition
+// Finds the sigmoid polynomial coefficients whose reflectance spectrum
+// matches a given RGB in a color space, using the same Gauss-Newton
+// optimization as cmd/rgb2spec_opt.cpp, which precomputes the tables for the
+// built-in color spaces at build time.
+class RGBToSpectrumOptimizer {
+  public:
+    // RGBToSpectrumOptimizer Public Methods
+    RGBToSpectrumOptimizer(const RGBColorSpace &cs);
+
+    void GaussNewton(const double rgb[3], double coeffs[3], int nIterations = 15) const;
+
+  private:
+    // RGBToSpectrumOptimizer Private Methods
+    void Residual(const double coeffs[3], const double rgb[3], double residual[3]) const;
+    void ToLab(double p[3]) const;
+
+    // RGBToSpectrumOptimizer Private Members
+    // Simpson's 3/8 rule over 5nm segments of the visible range
+    static constexpr int nSamples = (Lambda_max - Lambda_min) / 5 * 3 + 1;
+    double lambda[nSamples], rgbWeights[3][nSamples];
+    double xyzFromRGB[3][3], whitepoint[3] = {0, 0, 0};
+};
+
+// RGBToSpectrumOptimizer Method Definitions
+RGBToSpectrumOptimizer::RGBToSpectrumOptimizer(const RGBColorSpace &cs) {
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            xyzFromRGB[i][j] = cs.XYZFromRGB[i][j];
+
+    // Linearly interpolate the 1nm matching function samples
+    auto interp = [](const DenselySampledSpectrum &s, double lambda) {
+        int l0 = std::min<int>(lambda, Lambda_max - 1);
+        double t = lambda - l0;
+        return (1 - t) * s(l0) + t * s(l0 + 1);
+    };
+
+    double h = double(Lambda_max - Lambda_min) / (nSamples - 1);
+    for (int i = 0; i < nSamples; ++i) {
+        lambda[i] = Lambda_min + i * h;
+        double xyz[3] = {interp(Spectra::X(), lambda[i]), interp(Spectra::Y(), lambda[i]),
+                         interp(Spectra::Z(), lambda[i])};
+        double I = interp(cs.illuminant, lambda[i]);
+
+        double weight = 3.0 / 8.0 * h;
+        if (i == 0 || i == nSamples - 1)
+            ;
+        else if ((i - 1) % 3 == 2)
+            weight *= 2;
+        else
+            weight *= 3;
+
+        for (int k = 0; k < 3; ++k) {
+            rgbWeights[k][i] = 0;
+            for (int j = 0; j < 3; ++j)
+                rgbWeights[k][i] += cs.RGBFromXYZ[k][j] * xyz[j] * I * weight;
+            whitepoint[k] += xyz[k] * I * weight;
+        }
+    }
+
+    // Normalize the illuminant to have unit luminance
+    double scale = 1 / whitepoint[1];
+    for (int k = 0; k < 3; ++k) {
+        whitepoint[k] *= scale;
+        for (int i = 0; i < nSamples; ++i)
+            rgbWeights[k][i] *= scale;
+    }
+}
+
+void RGBToSpectrumOptimizer::ToLab(double p[3]) const {
+    double xyz[3] = {0, 0, 0};
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            xyz[i] += xyzFromRGB[i][j] * p[j];
+
+    auto f = [](double t) {
+        double delta = 6.0 / 29.0;
+        if (t > delta * delta * delta)
+            return std::cbrt(t);
+        return t / (delta * delta * 3.0) + (4.0 / 29.0);
+    };
+    p[0] = 116 * f(xyz[1] / whitepoint[1]) - 16;
+    p[1] = 500 * (f(xyz[0] / whitepoint[0]) - f(xyz[1] / whitepoint[1]));
+    p[2] = 200 * (f(xyz[1] / whitepoint[1]) - f(xyz[2] / whitepoint[2]));
+}
+
+void RGBToSpectrumOptimizer::Residual(const double coeffs[3], const double rgb[3],
+                                      double residual[3]) const {
+    // Integrate the sigmoid polynomial's spectrum against the RGB weights
+    double out[3] = {0, 0, 0};
+    for (int i = 0; i < nSamples; ++i) {
+        double l = (lambda[i] - Lambda_min) / (Lambda_max - Lambda_min);
+        double x = (coeffs[0] * l + coeffs[1]) * l + coeffs[2];
+        double s = 0.5 * x / std::sqrt(1 + x * x) + 0.5;
+        for (int j = 0; j < 3; ++j)
+            out[j] += rgbWeights[j][i] * s;
+    }
+
+    // Compute the difference in CIELAB space
+    ToLab(out);
+    for (int j = 0; j < 3; ++j)
+        residual[j] = rgb[j];
+    ToLab(residual);
+    for (int j = 0; j < 3; ++j)
+        residual[j] -= out[j];
+}
+
+void RGBToSpectrumOptimizer::GaussNewton(const double rgb[3], double coeffs[3],
+                                         int nIterations) const {
+    for (int iter = 0; iter < nIterations; ++iter) {
+        // Evaluate the residual and its Jacobian using central differences
+        double residual[3], J[3][3];
+        Residual(coeffs, rgb, residual);
+        constexpr double eps = 1e-4;
+        for (int i = 0; i < 3; ++i) {
+            double c[3] = {coeffs[0], coeffs[1], coeffs[2]}, r0[3], r1[3];
+            c[i] = coeffs[i] - eps;
+            Residual(c, rgb, r0);
+            c[i] = coeffs[i] + eps;
+            Residual(c, rgb, r1);
+            for (int j = 0; j < 3; ++j)
+                J[j][i] = (r1[j] - r0[j]) / (2 * eps);
+        }
+
+        // Solve $\mathbf{J} \mathbf{x} = \mathbf{r}$ using Cramer's rule
+        auto det3 = [](const double m[3][3]) {
+            return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                   m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                   m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        };
+        double det = det3(J);
+        if (std::abs(det) < 1e-15)
+            return;
+        double x[3];
+        for (int i = 0; i < 3; ++i) {
+            double Ji[3][3];
+            std::memcpy(Ji, J, sizeof(J));
+            for (int j = 0; j < 3; ++j)
+                Ji[j][i] = residual[j];
+            x[i] = det3(Ji) / det;
+        }
+
+        // Update the coefficients, keeping them in a reasonable range
+        double r = 0;
+        for (int j = 0; j < 3; ++j) {
+            coeffs[j] -= x[j];
+            r += residual[j] * residual[j];
+        }
+        double max = std::max({coeffs[0], coeffs[1], coeffs[2]});
+        if (max > 200)
+            for (int j = 0; j < 3; ++j)
+                coeffs[j] *= 200 / max;
+
+        if (r < 1e-6)
+            break;
+    }
+}
+
+// RGBToSpectrumTable Cache Definitions
+struct RGBToSpectrumCacheHeader {
+    char magic[8] = {'p', 'b', 'r', 't', 'r', 'g', 'b', 's'};
+    int32_t res = RGBToSpectrumTable::res;
+    float primaries[8];
+};
+
+static RGBToSpectrumCacheHeader CacheHeader(const RGBColorSpace &cs) {
+    RGBToSpectrumCacheHeader header;
+    Point2f p[4] = {cs.r, cs.g, cs.b, cs.w};
+    for (int i = 0; i < 4; ++i) {
+        header.primaries[2 * i] = p[i].x;
+        header.primaries[2 * i + 1] = p[i].y;
+    }
+    return header;
+}
+
+static bool ReadRGBToSpectrumCache(const std::string &filename, const RGBColorSpace &cs,
+                                   float *zNodes,
+                                   RGBToSpectrumTable::CoefficientArray *coeffs) {
+    if (!FileExists(filename))
+        return false;
+    std::string contents = ReadFileContents(filename);
+    RGBToSpectrumCacheHeader header, expected = CacheHeader(cs);
+    size_t zNodesBytes = RGBToSpectrumTable::res * sizeof(float);
+    if (contents.size() !=
+            sizeof(header) + zNodesBytes + sizeof(RGBToSpectrumTable::CoefficientArray) ||
+        std::memcmp(contents.data(), &expected, sizeof(header)) != 0) {
+        Warning("%s: ignoring invalid or stale RGB to spectrum cache file.", filename);
+        return false;
+    }
+
+    const char *data = contents.data() + sizeof(header);
+    std::memcpy(zNodes, data, zNodesBytes);
+    std::memcpy(coeffs, data + zNodesBytes, sizeof(*coeffs));
+    LOG_VERBOSE("Read RGB to spectrum table from %s", filename);
+    return true;
+}
+
+static void WriteRGBToSpectrumCache(const std::string &filename, const RGBColorSpace &cs,
+                                    const float *zNodes,
+                                    const RGBToSpectrumTable::CoefficientArray *coeffs) {
+    RGBToSpectrumCacheHeader header = CacheHeader(cs);
+    std::string contents;
+    contents.append((const char *)&header, sizeof(header));
+    contents.append((const char *)zNodes, RGBToSpectrumTable::res * sizeof(float));
+    contents.append((const char *)coeffs, sizeof(*coeffs));
+
+    // Write to a temporary file so that concurrent renders never see partial caches
+    std::string tempFilename = StringPrintf("%s.%p.tmp", filename, coeffs);
+    if (!WriteFileContents(tempFilename, contents) ||
+        std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write RGB to spectrum cache file.", filename);
+        RemoveFile(tempFilename);
+    } else
+        LOG_VERBOSE("Wrote RGB to spectrum cache file %s", filename);
+}
+
+static const RGBToSpectrumTable *ComputeRGBToSpectrumTable(const RGBColorSpace &cs,
+                                                           Allocator alloc) {
+    constexpr int res = RGBToSpectrumTable::res;
+    float *zNodes = alloc.allocate_object<float>(res);
+    RGBToSpectrumTable::CoefficientArray *coeffs =
+        (RGBToSpectrumTable::CoefficientArray *)alloc.allocate_bytes(
+            sizeof(RGBToSpectrumTable::CoefficientArray));
+
+    // Read the table from the scene cache if it has already been computed
+    std::string cacheFilename;
+    if (!Options->sceneCacheDirectory.empty()) {
+        uint64_t key =
+            Hash(cs.r, cs.g, cs.b, std::hash<DenselySampledSpectrum>()(cs.illuminant));
+        cacheFilename =
+            StringPrintf("%s/rgbspec-%016x.bin", Options->sceneCacheDirectory, key);
+        if (ReadRGBToSpectrumCache(cacheFilename, cs, zNodes, coeffs))
+            return alloc.new_object<RGBToSpectrumTable>(zNodes, coeffs);
+    }
+
+    Warning("Computing RGB to spectrum table for color space with primaries r %s "
+            "g %s b %s w %s. This may take a while.",
+            cs.r, cs.g, cs.b, cs.w);
+    RGBToSpectrumOptimizer optimizer(cs);
+    for (int k = 0; k < res; ++k) {
+        auto smoothstep = [](double x) { return x * x * (3 - 2 * x); };
+        zNodes[k] = smoothstep(smoothstep(k / double(res - 1)));
+    }
+
+    // Optimize each column of the table, warm starting each solution from its
+    // neighbor's along the brightness dimension
+    ParallelFor(0, 3 * res * res, [&](int64_t index) {
+        int l = index / (res * res), j = (index / res) % res, i = index % res;
+        double x = i / double(res - 1), y = j / double(res - 1);
+        auto optimize = [&](int k, double coeffs3[3]) {
+            double b = zNodes[k], rgb[3];
+            rgb[l] = b;
+            rgb[(l + 1) % 3] = x * b;
+            rgb[(l + 2) % 3] = y * b;
+            optimizer.GaussNewton(rgb, coeffs3);
+
+            // Convert coefficients from normalized to nanometer wavelengths
+            double c0 = Lambda_min, c1 = 1.0 / (Lambda_max - Lambda_min);
+            double A = coeffs3[0], B = coeffs3[1], C = coeffs3[2];
+            float *c = (*coeffs)[l][k][j][i];
+            c[0] = A * Sqr(c1);
+            c[1] = B * c1 - 2 * A * c0 * Sqr(c1);
+            c[2] = C - B * c0 * c1 + A * Sqr(c0 * c1);
+        };
+        int start = res / 5;
+        double c[3] = {0, 0, 0};
+        for (int k = start; k < res; ++k)
+            optimize(k, c);
+        c[0] = c[1] = c[2] = 0;
+        for (int k = start; k >= 0; --k)
+            optimize(k, c);
+    });
+
+    if (!cacheFilename.empty())
+        WriteRGBToSpectrumCache(cacheFilename, cs, zNodes, coeffs);
+    return alloc.new_object<RGBToSpectrumTable>(zNodes, coeffs);
+}
+
+const RGBColorSpace *RGBColorSpace::Create(Point2f r, Point2f g, Point2f b,
+                                           Spectrum illuminant, Allocator alloc) {
+    // Use a built-in or previously created color space if one matches
+    Point2f w = SpectrumToXYZ(illuminant).xy();
+    if (const RGBColorSpace *cs = Lookup(r, g, b, w))
+        return cs;
+    static std::mutex mutex;
+    static std::vector<const RGBColorSpace *> created;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const RGBColorSpace *cs : created)
+        if (Matches(cs, r, g, b, w))
+            return cs;
+
+    RGBColorSpace *cs =
+        alloc.new_object<RGBColorSpace>(r, g, b, illuminant, nullptr, alloc);
+    cs->rgbToSpectrumTable = ComputeRGBToSpectrumTable(*cs, alloc);
+    created.push_back(cs);
+    return cs;
+}
+
+const RGBColorSpace *RGBColorSpace::Create(Point2f r, Point2f g, Point2f b, Point2f w,
+                                           Allocator alloc) {
+    if (const RGBColorSpace *cs = Lookup(r, g, b, w))
+        return cs;
+    // Find a standard illuminant with the given whitepoint
+    for (const char *name : {"stdillum-D65", "stdillum-D50", "illum-acesD60"}) {
+        Spectrum illuminant = GetNamedSpectrum(name);
+        Point2f iw = SpectrumToXYZ(illuminant).xy();
+        if (std::abs(iw.x - w.x) < 1e-3 && std::abs(iw.y - w.y) < 1e-3)
+            return Create(r, g, b, illuminant, alloc);
+    }
+    return nullptr;
+}
+
 const RGBColorSpace *RGBColorSpace::sRGB;
 const RGBColorSpace *RGBColorSpace::DCI_P3;
 const RGBColorSpace *RGBColorSpace::Rec2020;
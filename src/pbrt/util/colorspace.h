@@ -59,6 +59,10 @@ class RGBColorSpace {
 
     static const RGBColorSpace *GetNamed(std::string name);
     static const RGBColorSpace *Lookup(Point2f r, Point2f g, Point2f b, Point2f w);
+    static const RGBColorSpace *Create(Point2f r, Point2f g, Point2f b,
+                                       Spectrum illuminant, Allocator alloc);
+    static const RGBColorSpace *Create(Point2f r, Point2f g, Point2f b, Point2f w,
+                                       Allocator alloc);
 
   private:
     // RGBColorSpace Private Members
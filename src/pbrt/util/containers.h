@@ -8,6 +8,8 @@
 #include <pbrt/pbrt.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/math.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/vecmath.h>
@@ -21,6 +23,7 @@
 #include <string>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 namespace pbrt {
 
@@ -119,6 +122,20 @@ struct MapType<M, TypePack<T, Ts...>> {
     using type = typename Prepend<M<T>, typename MapType<M, TypePack<Ts...>>::type>::type;
 };
 
+template <typename... Ts>
+struct MaxSizeOf;
+template <typename... Ts>
+struct MaxSizeOf<TypePack<Ts...>> {
+    static constexpr size_t value = std::max({sizeof(Ts)...});
+};
+
+template <typename... Ts>
+struct MaxAlignOf;
+template <typename... Ts>
+struct MaxAlignOf<TypePack<Ts...>> {
+    static constexpr size_t value = std::max({alignof(Ts)...});
+};
+
 template <typename Base, typename... Ts>
 inline constexpr bool AllInheritFrom(TypePack<Ts...>);
 
@@ -621,19 +638,25 @@ class InlinedVector {
 };
 
 // HashMap Definition
+// Entries are stored in groups of eight slots, each with a control byte that
+// is either empty or holds seven bits of the key's hash; the control bytes of
+// a group are packed into a single 64-bit word. A lookup probes a sequence of
+// groups, comparing keys only for the slots whose control bytes match the
+// hash, and stops at the first group that has an empty slot. The bytes are
+// matched with integer operations on the whole word rather than with SIMD
+// instructions so that the same table can be searched on the GPU.
 template <typename Key, typename Value, typename Hash = std::hash<Key>,
-          typename Allocator =
-              pstd::pmr::polymorphic_allocator<pstd::optional<std::pair<Key, Value>>>>
+          typename Allocator = pstd::pmr::polymorphic_allocator<std::byte>>
 class HashMap {
   public:
     // HashMap Type Definitions
-    using TableEntry = pstd::optional<std::pair<Key, Value>>;
+    using TableEntry = std::pair<Key, Value>;
 
     class Iterator {
       public:
         PBRT_CPU_GPU
         Iterator &operator++() {
-            while (++ptr < end && !ptr->has_value())
+            while (++index < map->capacity() && !map->IsFull(index))
                 ;
             return *this;
         }
@@ -646,25 +669,25 @@ class HashMap {
         }
 
         PBRT_CPU_GPU
-        bool operator==(const Iterator &iter) const { return ptr == iter.ptr; }
+        bool operator==(const Iterator &iter) const { return index == iter.index; }
         PBRT_CPU_GPU
-        bool operator!=(const Iterator &iter) const { return ptr != iter.ptr; }
+        bool operator!=(const Iterator &iter) const { return index != iter.index; }
 
         PBRT_CPU_GPU
-        std::pair<Key, Value> &operator*() { return ptr->value(); }
+        std::pair<Key, Value> &operator*() { return map->slots[index]; }
         PBRT_CPU_GPU
-        const std::pair<Key, Value> &operator*() const { return ptr->value(); }
+        const std::pair<Key, Value> &operator*() const { return map->slots[index]; }
 
         PBRT_CPU_GPU
-        std::pair<Key, Value> *operator->() { return &ptr->value(); }
+        std::pair<Key, Value> *operator->() { return &map->slots[index]; }
         PBRT_CPU_GPU
-        const std::pair<Key, Value> *operator->() const { return ptr->value(); }
+        const std::pair<Key, Value> *operator->() const { return &map->slots[index]; }
 
       private:
         friend class HashMap;
-        Iterator(TableEntry *ptr, TableEntry *end) : ptr(ptr), end(end) {}
-        TableEntry *ptr;
-        TableEntry *end;
+        Iterator(HashMap *map, size_t index) : map(map), index(index) {}
+        HashMap *map;
+        size_t index;
     };
 
     using iterator = Iterator;
@@ -674,106 +697,216 @@ class HashMap {
     PBRT_CPU_GPU
     size_t size() const { return nStored; }
     PBRT_CPU_GPU
-    size_t capacity() const { return table.size(); }
+    size_t capacity() const { return slots.size(); }
     void Clear() {
-        table.clear();
+        std::fill(control.begin(), control.end(), AllEmpty);
+        std::fill(slots.begin(), slots.end(), TableEntry());
         nStored = 0;
     }
 
-    HashMap(Allocator alloc) : table(8, alloc) {}
+    HashMap(Allocator alloc) : control(1, AllEmpty, alloc), slots(GroupSize, alloc) {}
 
     HashMap(const HashMap &) = delete;
     HashMap &operator=(const HashMap &) = delete;
 
     void Insert(const Key &key, const Value &value) {
-        size_t offset = FindOffset(key);
-        if (table[offset].has_value() == false) {
-            // Grow hash table if it is too full
-            if (3 * ++nStored > capacity()) {
-                Grow();
-                offset = FindOffset(key);
-            }
+        uint64_t hash = MixBits(Hash()(key));
+        if (size_t index = FindIndex(key, hash); index != NotFound) {
+            slots[index].second = value;
+            return;
         }
-        table[offset] = std::make_pair(key, value);
+        // Grow hash table if it is too full
+        if (8 * (nStored + 1) > 7 * capacity())
+            Grow();
+        size_t index = FindEmpty(hash);
+        SetControl(index, H2(hash));
+        slots[index] = std::make_pair(key, value);
+        ++nStored;
     }
 
     PBRT_CPU_GPU
-    bool HasKey(const Key &key) const { return table[FindOffset(key)].has_value(); }
+    bool HasKey(const Key &key) const { return Find(key) != nullptr; }
 
     PBRT_CPU_GPU
     const Value &operator[](const Key &key) const {
-        size_t offset = FindOffset(key);
-        CHECK(table[offset].has_value());
-        return table[offset]->second;
+        const Value *value = Find(key);
+        CHECK(value != nullptr);
+        return *value;
+    }
+
+    // Returns a pointer to the value for _key_, or _nullptr_ if it isn't
+    // present, with a single table lookup.
+    PBRT_CPU_GPU
+    const Value *Find(const Key &key) const {
+        size_t index = FindIndex(key, MixBits(Hash()(key)));
+        return index != NotFound ? &slots[index].second : nullptr;
     }
 
     PBRT_CPU_GPU
     iterator begin() {
-        Iterator iter(table.data(), table.data() + capacity());
-        while (iter.ptr < iter.end && !iter.ptr->has_value())
-            ++iter.ptr;
+        Iterator iter(this, 0);
+        while (iter.index < capacity() && !IsFull(iter.index))
+            ++iter.index;
         return iter;
     }
     PBRT_CPU_GPU
-    iterator end() {
-        return Iterator(table.data() + capacity(), table.data() + capacity());
-    }
+    iterator end() { return Iterator(this, capacity()); }
 
   private:
+    // HashMap Private Constants
+    static constexpr int GroupSize = 8;
+    static constexpr size_t NotFound = ~size_t(0);
+    // Control bytes are 0x80 for empty slots and the key's seven-bit _H2()_
+    // hash for full ones
+    static constexpr uint64_t LowBits = 0x0101010101010101ull;
+    static constexpr uint64_t HighBits = 0x8080808080808080ull;
+    static constexpr uint64_t AllEmpty = HighBits;
+
     // HashMap Private Methods
+    // The upper bits of the hash choose the first group to probe and the
+    // lowest seven are stored in the control byte.
+    PBRT_CPU_GPU
+    static size_t H1(uint64_t hash) { return hash >> 7; }
     PBRT_CPU_GPU
-    size_t FindOffset(const Key &key) const {
-        size_t baseOffset = Hash()(key) & (capacity() - 1);
-        for (int nProbes = 0;; ++nProbes) {
-            // Find offset for _key_ using quadratic probing
-            size_t offset =
-                (baseOffset + nProbes / 2 + nProbes * nProbes / 2) & (capacity() - 1);
-            if (table[offset].has_value() == false || key == table[offset]->first)
-                return offset;
+    static uint64_t H2(uint64_t hash) { return hash & 0x7f; }
+
+    // Returns a word with the high bit set in each byte of _group_ that is
+    // equal to _h2_. Bytes above a match may also have it set spuriously,
+    // which is harmless since the keys are compared.
+    PBRT_CPU_GPU
+    static uint64_t MatchH2(uint64_t group, uint64_t h2) {
+        uint64_t x = group ^ (LowBits * h2);
+        return (x - LowBits) & ~x & HighBits;
+    }
+    PBRT_CPU_GPU
+    static uint64_t MatchEmpty(uint64_t group) { return group & HighBits; }
+
+    PBRT_CPU_GPU
+    static bool IsFull(uint64_t group, int slot) {
+        return ((group >> (8 * slot)) & 0x80) == 0;
+    }
+    PBRT_CPU_GPU
+    bool IsFull(size_t index) const {
+        return IsFull(control[index / GroupSize], index % GroupSize);
+    }
+
+    void SetControl(size_t index, uint64_t h2) {
+        int shift = 8 * (index % GroupSize);
+        uint64_t &group = control[index / GroupSize];
+        group = (group & ~(uint64_t(0xff) << shift)) | (h2 << shift);
+    }
+
+    // Groups are probed using triangular numbers, which visit all of them
+    // since their count is a power of two.
+    PBRT_CPU_GPU
+    size_t FindIndex(const Key &key, uint64_t hash) const {
+        size_t groupMask = control.size() - 1;
+        size_t g = H1(hash) & groupMask;
+        for (size_t nProbes = 1;; ++nProbes) {
+            uint64_t group = control[g];
+            for (uint64_t match = MatchH2(group, H2(hash)); match; match &= match - 1) {
+                size_t index = g * GroupSize + CountTrailingZeros(match) / 8;
+                if (slots[index].first == key)
+                    return index;
+            }
+            // The key isn't present if the group has an empty slot
+            if (MatchEmpty(group))
+                return NotFound;
+            g = (g + nProbes) & groupMask;
+        }
+    }
+
+    size_t FindEmpty(uint64_t hash) const {
+        size_t groupMask = control.size() - 1;
+        size_t g = H1(hash) & groupMask;
+        for (size_t nProbes = 1;; ++nProbes) {
+            if (uint64_t empty = MatchEmpty(control[g]); empty)
+                return g * GroupSize + CountTrailingZeros(empty) / 8;
+            g = (g + nProbes) & groupMask;
         }
     }
 
     void Grow() {
-        size_t currentCapacity = capacity();
-        pstd::vector<TableEntry> newTable(std::max<size_t>(64, 2 * currentCapacity),
-                                          table.get_allocator());
-        size_t newCapacity = newTable.size();
-        for (size_t i = 0; i < currentCapacity; ++i) {
-            // Insert _table[i]_ into _newTable_ if it is set
-            if (!table[i].has_value())
+        pstd::vector<uint64_t> oldControl = std::move(control);
+        pstd::vector<TableEntry> oldSlots = std::move(slots);
+        control = pstd::vector<uint64_t>(2 * oldControl.size(), AllEmpty,
+                                         oldControl.get_allocator());
+        slots = pstd::vector<TableEntry>(2 * oldSlots.size(), oldSlots.get_allocator());
+        for (size_t i = 0; i < oldSlots.size(); ++i) {
+            // Insert _oldSlots[i]_ into the new table if it is set
+            if (!IsFull(oldControl[i / GroupSize], i % GroupSize))
                 continue;
-            size_t baseOffset = Hash()(table[i]->first) & (newCapacity - 1);
-            for (int nProbes = 0;; ++nProbes) {
-                size_t offset = (baseOffset + nProbes / 2 + nProbes * nProbes / 2) &
-                                (newCapacity - 1);
-                if (!newTable[offset]) {
-                    newTable[offset] = std::move(*table[i]);
-                    break;
-                }
-            }
+            uint64_t hash = MixBits(Hash()(oldSlots[i].first));
+            size_t index = FindEmpty(hash);
+            SetControl(index, H2(hash));
+            slots[index] = std::move(oldSlots[i]);
         }
-        table = std::move(newTable);
     }
 
     // HashMap Private Members
-    pstd::vector<TableEntry> table;
+    pstd::vector<uint64_t> control;
+    pstd::vector<TableEntry> slots;
     size_t nStored = 0;
 };
 
 // SampledGrid Definition
+// Samples are stored in bricks of up to 8x8x8 that are each contiguous in
+// memory, so that the eight samples that a lookup interpolates usually come
+// from a single brick; axes with fewer than 32 samples aren't divided, so
+// that thin grids aren't padded. Bricks of numeric samples that are all
+// zero aren't stored; they all share a single zero-valued brick.
 template <typename T>
 class SampledGrid {
   public:
+    // Iterates over the stored samples, in brick order and including padding
     using const_iterator = typename pstd::vector<T>::const_iterator;
     // SampledGrid Public Methods
     SampledGrid() = default;
-    SampledGrid(Allocator alloc) : values(alloc) {}
+    SampledGrid(Allocator alloc) : values(alloc), brickIndex(alloc) {}
     SampledGrid(pstd::span<const T> v, int nx, int ny, int nz, Allocator alloc)
-        : values(v.begin(), v.end(), alloc), nx(nx), ny(ny), nz(nz) {
-        CHECK_EQ(nx * ny * nz, values.size());
+        : values(alloc), brickIndex(alloc), nx(nx), ny(ny), nz(nz) {
+        CHECK_EQ(nx * ny * nz, v.size());
+        // Choose the brick size along each axis
+        auto brickShift = [](int n) { return n >= 64 ? 3 : (n >= 32 ? 2 : 0); };
+        shift = Vector3i(brickShift(nx), brickShift(ny), brickShift(nz));
+        bricksX = (nx + (1 << shift.x) - 1) >> shift.x;
+        bricksY = (ny + (1 << shift.y) - 1) >> shift.y;
+        int bricksZ = (nz + (1 << shift.z) - 1) >> shift.z;
+
+        // Find the bricks that have nonzero samples
+        brickIndex.resize(size_t(bricksX) * bricksY * bricksZ);
+        std::vector<bool> brickIsZero(brickIndex.size(), std::is_arithmetic_v<T>);
+        if constexpr (std::is_arithmetic_v<T>)
+            for (int z = 0; z < nz; ++z)
+                for (int y = 0; y < ny; ++y)
+                    for (int x = 0; x < nx; ++x)
+                        if (v[(size_t(z) * ny + y) * nx + x] != 0)
+                            brickIsZero[Brick(Point3i(x, y, z))] = false;
+        uint32_t nStored = 0;
+        for (size_t i = 0; i < brickIndex.size(); ++i)
+            if (!brickIsZero[i])
+                brickIndex[i] = nStored++;
+        if (nStored < brickIndex.size()) {
+            for (size_t i = 0; i < brickIndex.size(); ++i)
+                if (brickIsZero[i])
+                    brickIndex[i] = nStored;
+            ++nStored;
+        }
+
+        // Copy the samples into their bricks
+        values.resize(size_t(nStored) << (shift.x + shift.y + shift.z));
+        for (int z = 0; z < nz; ++z)
+            for (int y = 0; y < ny; ++y)
+                for (int x = 0; x < nx; ++x) {
+                    Point3i p(x, y, z);
+                    if (!brickIsZero[Brick(p)])
+                        values[Offset(p)] = v[(size_t(z) * ny + y) * nx + x];
+                }
     }
 
-    PBRT_CPU_GPU size_t BytesAllocated() const { return values.size() * sizeof(T); }
+    PBRT_CPU_GPU size_t BytesAllocated() const {
+        return values.size() * sizeof(T) + brickIndex.size() * sizeof(uint32_t);
+    }
     PBRT_CPU_GPU int XSize() const { return nx; }
     PBRT_CPU_GPU int YSize() const { return ny; }
     PBRT_CPU_GPU int ZSize() const { return nz; }
@@ -788,6 +921,17 @@ class SampledGrid {
         Point3i pi = (Point3i)Floor(pSamples);
         Vector3f d = pSamples - (Point3f)pi;
 
+        if (InsideOneBrick(pi)) {
+            // Fetch the eight samples around _p_ from their brick
+            const T *v = &values[Offset(pi)];
+            int dy = 1 << shift.x, dz = 1 << (shift.x + shift.y);
+            auto d00 = Lerp(d.x, convert(v[0]), convert(v[1]));
+            auto d10 = Lerp(d.x, convert(v[dy]), convert(v[dy + 1]));
+            auto d01 = Lerp(d.x, convert(v[dz]), convert(v[dz + 1]));
+            auto d11 = Lerp(d.x, convert(v[dz + dy]), convert(v[dz + dy + 1]));
+            return Lerp(d.z, Lerp(d.y, d00, d10), Lerp(d.y, d01, d11));
+        }
+
         // Return trilinearly interpolated voxel values
         auto d00 =
             Lerp(d.x, Lookup(pi, convert), Lookup(pi + Vector3i(1, 0, 0), convert));
@@ -807,6 +951,17 @@ class SampledGrid {
         Point3i pi = (Point3i)Floor(pSamples);
         Vector3f d = pSamples - (Point3f)pi;
 
+        if (InsideOneBrick(pi)) {
+            // Fetch the eight samples around _p_ from their brick
+            const T *v = &values[Offset(pi)];
+            int dy = 1 << shift.x, dz = 1 << (shift.x + shift.y);
+            auto d00 = Lerp(d.x, v[0], v[1]);
+            auto d10 = Lerp(d.x, v[dy], v[dy + 1]);
+            auto d01 = Lerp(d.x, v[dz], v[dz + 1]);
+            auto d11 = Lerp(d.x, v[dz + dy], v[dz + dy + 1]);
+            return Lerp(d.z, Lerp(d.y, d00, d10), Lerp(d.y, d01, d11));
+        }
+
         // Return trilinearly interpolated voxel values
         auto d00 = Lerp(d.x, Lookup(pi), Lookup(pi + Vector3i(1, 0, 0)));
         auto d10 =
@@ -823,7 +978,7 @@ class SampledGrid {
         Bounds3i sampleBounds(Point3i(0, 0, 0), Point3i(nx, ny, nz));
         if (!InsideExclusive(p, sampleBounds))
             return convert(T{});
-        return convert(values[(p.z * ny + p.y) * nx + p.x]);
+        return convert(values[Offset(p)]);
     }
 
     PBRT_CPU_GPU
@@ -831,7 +986,7 @@ class SampledGrid {
         Bounds3i sampleBounds(Point3i(0, 0, 0), Point3i(nx, ny, nz));
         if (!InsideExclusive(p, sampleBounds))
             return T{};
-        return values[(p.z * ny + p.y) * nx + p.x];
+        return values[Offset(p)];
     }
 
     template <typename F>
@@ -857,15 +1012,69 @@ class SampledGrid {
         return MaxValue(bounds, [](T value) { return value; });
     }
 
+    // Returns a lower bound on the values that Lookup() interpolates inside
+    // _bounds_; samples outside the grid, which Lookup() treats as zero-valued,
+    // are included.
+    template <typename F>
+    Float MinValue(const Bounds3f &bounds, F convert) const {
+        Point3f ps[2] = {Point3f(bounds.pMin.x * nx - .5f, bounds.pMin.y * ny - .5f,
+                                 bounds.pMin.z * nz - .5f),
+                         Point3f(bounds.pMax.x * nx - .5f, bounds.pMax.y * ny - .5f,
+                                 bounds.pMax.z * nz - .5f)};
+        Point3i pi[2] = {Point3i(Floor(ps[0])),
+                         Point3i(Floor(ps[1])) + Vector3i(1, 1, 1)};
+
+        Float minValue = Lookup(Point3i(pi[0]), convert);
+        for (int z = pi[0].z; z <= pi[1].z; ++z)
+            for (int y = pi[0].y; y <= pi[1].y; ++y)
+                for (int x = pi[0].x; x <= pi[1].x; ++x)
+                    minValue = std::min(minValue, Lookup(Point3i(x, y, z), convert));
+
+        return minValue;
+    }
+
+    T MinValue(const Bounds3f &bounds) const {
+        return MinValue(bounds, [](T value) { return value; });
+    }
+
     std::string ToString() const {
         return StringPrintf("[ SampledGrid nx: %d ny: %d nz: %d values: %s ]", nx, ny, nz,
                             values);
     }
 
   private:
+    // SampledGrid Private Methods
+    PBRT_CPU_GPU
+    size_t Brick(Point3i p) const {
+        return (size_t(p.z >> shift.z) * bricksY + (p.y >> shift.y)) * bricksX +
+               (p.x >> shift.x);
+    }
+
+    PBRT_CPU_GPU
+    size_t Offset(Point3i p) const {
+        // Find the sample's stored brick and its index in the brick's samples
+        int mx = (1 << shift.x) - 1, my = (1 << shift.y) - 1, mz = (1 << shift.z) - 1;
+        int index = ((((p.z & mz) << shift.y) | (p.y & my)) << shift.x) | (p.x & mx);
+        return (size_t(brickIndex[Brick(p)]) << (shift.x + shift.y + shift.z)) + index;
+    }
+
+    // Returns whether the samples from _p_ to _p_+(1,1,1) are all inside the
+    // grid and in the same brick
+    PBRT_CPU_GPU
+    bool InsideOneBrick(Point3i p) const {
+        int mx = (1 << shift.x) - 1, my = (1 << shift.y) - 1, mz = (1 << shift.z) - 1;
+        return p.x >= 0 && p.y >= 0 && p.z >= 0 && p.x + 1 < nx && p.y + 1 < ny &&
+               p.z + 1 < nz && (p.x & mx) != mx && (p.y & my) != my && (p.z & mz) != mz;
+    }
+
     // SampledGrid Private Members
     pstd::vector<T> values;
+    // Index of each brick's samples in _values_, in units of bricks
+    pstd::vector<uint32_t> brickIndex;
     int nx, ny, nz;
+    // Base-2 logarithm of the brick size along each axis
+    Vector3i shift;
+    int bricksX, bricksY;
 };
 
 // InternCache Definition
@@ -68,6 +68,10 @@ TEST(HashMap, Basics) {
     EXPECT_EQ(3, map.size());
     EXPECT_GE(map.capacity(), 3);
     EXPECT_EQ("hai", map[10]);
+
+    ASSERT_TRUE(map.Find(42) != nullptr);
+    EXPECT_EQ("test", *map.Find(42));
+    EXPECT_TRUE(map.Find(1240) == nullptr);
 }
 
 TEST(HashMap, Randoms) {
@@ -109,6 +113,32 @@ TEST(HashMap, Randoms) {
     EXPECT_EQ(0, values.size());
 }
 
+TEST(HashMap, SequentialKeysAndClear) {
+    Allocator alloc;
+    HashMap<int, int, std::hash<int>> map(alloc);
+
+    // Sequential keys all have different hashes in their low bits, which
+    // shouldn't keep the table from filling its groups.
+    for (int i = 0; i < 1000; ++i)
+        map.Insert(i, 2 * i);
+    EXPECT_EQ(1000, map.size());
+    EXPECT_LE(map.capacity(), 2048);
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(map.Find(i) != nullptr);
+        EXPECT_EQ(2 * i, *map.Find(i));
+    }
+    EXPECT_FALSE(map.HasKey(1000));
+
+    size_t capacity = map.capacity();
+    map.Clear();
+    EXPECT_EQ(0, map.size());
+    EXPECT_EQ(capacity, map.capacity());
+    EXPECT_FALSE(map.HasKey(1));
+    EXPECT_TRUE(map.begin() == map.end());
+    map.Insert(1, 3);
+    EXPECT_EQ(3, map[1]);
+}
+
 TEST(TypePack, Index) {
     using Pack = TypePack<int, float, double>;
 
@@ -200,3 +230,54 @@ TEST(InternCache, BadHash) {
         EXPECT_EQ(n, cache.size());
     }
 }
+
+TEST(SampledGrid, Bricks) {
+    // Axes with enough samples to be divided into bricks, some that aren't
+    // multiples of the brick size, and ones that are too thin to be divided
+    RNG rng;
+    for (Point3i res : {Point3i(64, 64, 64), Point3i(70, 34, 21), Point3i(40, 3, 1),
+                        Point3i(1, 1, 1)}) {
+        // Make most of the grid zero-valued, so that its bricks are elided
+        std::vector<Float> values(res.x * res.y * res.z, Float(0));
+        for (int z = 0; z < res.z; ++z)
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    if (x < 12 || rng.Uniform<Float>() < 0.001f)
+                        values[(z * res.y + y) * res.x + x] = rng.Uniform<Float>();
+        SampledGrid<Float> grid(values, res.x, res.y, res.z, Allocator());
+        if (res.x == 64)
+            EXPECT_LT(grid.BytesAllocated(), values.size() * sizeof(Float));
+
+        auto lookup = [&](Point3i p) -> Float {
+            if (p.x < 0 || p.y < 0 || p.z < 0 || p.x >= res.x || p.y >= res.y ||
+                p.z >= res.z)
+                return 0;
+            return values[(p.z * res.y + p.y) * res.x + p.x];
+        };
+        for (int z = 0; z < res.z; ++z)
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    EXPECT_EQ(lookup(Point3i(x, y, z)), grid.Lookup(Point3i(x, y, z)));
+        EXPECT_EQ(0, grid.Lookup(Point3i(res.x, 0, 0)));
+        EXPECT_EQ(0, grid.Lookup(Point3i(0, -1, 0)));
+
+        // Trilinear lookups, including ones that span bricks and the grid's edges
+        for (int i = 0; i < 10000; ++i) {
+            Point3f p(Lerp(rng.Uniform<Float>(), -0.1f, 1.1f),
+                      Lerp(rng.Uniform<Float>(), -0.1f, 1.1f),
+                      Lerp(rng.Uniform<Float>(), -0.1f, 1.1f));
+            Point3f pSamples(p.x * res.x - .5f, p.y * res.y - .5f, p.z * res.z - .5f);
+            Point3i pi(pstd::floor(pSamples.x), pstd::floor(pSamples.y),
+                       pstd::floor(pSamples.z));
+            Vector3f d = pSamples - Point3f(pi);
+            Float expected = 0;
+            for (int c = 0; c < 8; ++c) {
+                Vector3i o(c & 1, (c >> 1) & 1, c >> 2);
+                expected += (o.x ? d.x : 1 - d.x) * (o.y ? d.y : 1 - d.y) *
+                            (o.z ? d.z : 1 - d.z) * lookup(pi + o);
+            }
+            EXPECT_NEAR(expected, grid.Lookup(p), 1e-5f);
+            EXPECT_EQ(grid.Lookup(p), grid.Lookup(p, [](Float v) { return v; }));
+        }
+    }
+}
@@ -8,6 +8,7 @@
 #include <pbrt/util/hash.h>
 #include <pbrt/util/image.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/util/string.h>
 
 #include <algorithm>
@@ -228,6 +229,11 @@ constexpr int tileSize = 128;
 
 }  // namespace
 
+STAT_MEMORY_COUNTER("Display/Bytes sent", displayBytesSent);
+STAT_COUNTER("Display/Tile updates sent", nTileUpdatesSent);
+STAT_COUNTER("Display/Tile updates unchanged", nTileUpdatesUnchanged);
+STAT_INT_DISTRIBUTION("Display/Rows sent per tile update", tileUpdateRows);
+
 class DisplayItem {
   public:
     DisplayItem(
@@ -235,7 +241,9 @@ class DisplayItem {
         std::vector<std::string> channelNames,
         std::function<void(Bounds2i b, pstd::span<pstd::span<float>>)> getTileValues);
 
-    bool Display(IPCChannel &channel);
+    // If _byteBudget_ is non-null, tiles are sent until it's used up and the
+    // next call starts from the first tile that wasn't sent.
+    bool Display(IPCChannel &channel, int64_t *byteBudget = nullptr);
 
   private:
     bool SendOpenImage(IPCChannel &channel);
@@ -245,19 +253,22 @@ class DisplayItem {
     Point2i resolution;
     std::function<void(Bounds2i b, pstd::span<pstd::span<float>>)> getTileValues;
     std::vector<std::string> channelNames;
+    int nextTile = 0;
 
     struct ImageChannelBuffer {
-        ImageChannelBuffer(const std::string &channelName, int nTiles,
-                           const std::string &title);
+        ImageChannelBuffer(const std::string &channelName, const std::string &title);
 
+        void ResetRowHashes(Point2i resolution);
         void SetTileBounds(int x, int y, int width, int height);
-        bool SendIfChanged(IPCChannel &channel, int tileIndex);
+        // Returns the number of bytes sent or -1 if sending failed.
+        int64_t SendIfChanged(IPCChannel &channel, int tileIndex);
 
         std::vector<uint8_t> buffer;
         int tileBoundsOffset = 0, channelValuesOffset = 0;
-        std::vector<uint64_t> tileHashes;
+        // Hashes of the rows of each tile that the viewer has, _tileSize_ per tile
+        std::vector<uint64_t> rowHashes;
 
-        int setCount, tileIndex;
+        int x, y, width, height;
     };
     std::vector<ImageChannelBuffer> channelBuffers;
 };
@@ -273,15 +284,11 @@ DisplayItem::DisplayItem(
     title = StringPrintf("%s (%d)", baseTitle, getpid());
 #endif
 
-    int nTiles = ((resolution.x + tileSize - 1) / tileSize) *
-                 ((resolution.y + tileSize - 1) / tileSize);
-
     for (const std::string &channelName : channelNames)
-        channelBuffers.push_back(ImageChannelBuffer(channelName, nTiles, title));
+        channelBuffers.push_back(ImageChannelBuffer(channelName, title));
 }
 
 DisplayItem::ImageChannelBuffer::ImageChannelBuffer(const std::string &channelName,
-                                                    int nTiles,
                                                     const std::string &title) {
     int bufferAlloc = tileSize * tileSize * sizeof(float) + title.size() + 32;
 
@@ -300,53 +307,83 @@ DisplayItem::ImageChannelBuffer::ImageChannelBuffer(const std::string &channelNa
     // TODO: fix this. The problem is that it breaks the whole idea of
     // passing a span<float> to the callback function...
     channelValuesOffset = tileBoundsOffset + 4 * sizeof(int);
-
-    // Zero-initialize the buffer color contents before computing the hash
-    // for a fully-zero tile (which corresponds to the initial state on the
-    // viewer side.)
-    memset(buffer.data() + channelValuesOffset, 0, tileSize * tileSize * sizeof(float));
-    uint64_t zeroHash = HashBuffer(buffer.data() + channelValuesOffset,
-                                   tileSize * tileSize * sizeof(float));
-    tileHashes.assign(nTiles, zeroHash);
 }
 
-void DisplayItem::ImageChannelBuffer::SetTileBounds(int x, int y, int width, int height) {
-    uint8_t *ptr = buffer.data() + tileBoundsOffset;
-
-    Serialize(&ptr, x);
-    Serialize(&ptr, y);
-    Serialize(&ptr, width);
-    Serialize(&ptr, height);
+void DisplayItem::ImageChannelBuffer::ResetRowHashes(Point2i resolution) {
+    // Set the row hashes to those of all-zero rows, which corresponds to the
+    // state of a newly-created image on the viewer side. Only the tiles in
+    // the last column may be narrower than _tileSize_.
+    rowHashes.clear();
+    std::vector<float> zeros(tileSize, 0.f);
+    uint64_t zeroHash = HashBuffer(zeros.data(), tileSize * sizeof(float));
+    int lastWidth = resolution.x - (resolution.x - 1) / tileSize * tileSize;
+    uint64_t lastZeroHash = HashBuffer(zeros.data(), lastWidth * sizeof(float));
+    for (int ty = 0; ty < resolution.y; ty += tileSize)
+        for (int tx = 0; tx < resolution.x; tx += tileSize)
+            rowHashes.insert(rowHashes.end(), tileSize,
+                             tx + tileSize < resolution.x ? zeroHash : lastZeroHash);
+}
 
-    setCount = width * height;
+void DisplayItem::ImageChannelBuffer::SetTileBounds(int x, int y, int width,
+                                                    int height) {
+    this->x = x;
+    this->y = y;
+    this->width = width;
+    this->height = height;
 }
 
-bool DisplayItem::ImageChannelBuffer::SendIfChanged(IPCChannel &ipcChannel,
-                                                    int tileIndex) {
-    int excess = setCount - tileSize * tileSize;
-    if (excess > 0)
-        memset(buffer.data() + channelValuesOffset + setCount * sizeof(float), 0,
-               excess * sizeof(float));
+int64_t DisplayItem::ImageChannelBuffer::SendIfChanged(IPCChannel &ipcChannel,
+                                                       int tileIndex) {
+    // Find the range of rows that differ from what the viewer has
+    uint8_t *values = buffer.data() + channelValuesOffset;
+    uint64_t *tileRowHashes = &rowHashes[tileIndex * tileSize];
+    uint64_t hashes[tileSize];
+    int firstRow = height, lastRow = -1;
+    for (int row = 0; row < height; ++row) {
+        hashes[row] =
+            HashBuffer(values + row * width * sizeof(float), width * sizeof(float));
+        if (hashes[row] != tileRowHashes[row]) {
+            firstRow = std::min(firstRow, row);
+            lastRow = row;
+        }
+    }
+    if (lastRow == -1) {
+        ++nTileUpdatesUnchanged;
+        return 0;
+    }
 
-    uint64_t hash = HashBuffer(buffer.data() + channelValuesOffset,
-                               tileSize * tileSize * sizeof(float));
-    if (hash == tileHashes[tileIndex])
-        return true;
+    // Send the changed rows as a single update for their bounds
+    int nRows = lastRow - firstRow + 1;
+    if (firstRow > 0)
+        memmove(values, values + firstRow * width * sizeof(float),
+                nRows * width * sizeof(float));
+    uint8_t *ptr = buffer.data() + tileBoundsOffset;
+    Serialize(&ptr, x);
+    Serialize(&ptr, y + firstRow);
+    Serialize(&ptr, width);
+    Serialize(&ptr, nRows);
 
-    if (!ipcChannel.Send(pstd::MakeSpan(buffer.data(),
-                                        channelValuesOffset + setCount * sizeof(float))))
-        return false;
+    size_t size = channelValuesOffset + nRows * width * sizeof(float);
+    if (!ipcChannel.Send(pstd::MakeSpan(buffer.data(), size)))
+        return -1;
 
-    tileHashes[tileIndex] = hash;
-    return true;
+    std::copy(hashes + firstRow, hashes + lastRow + 1, tileRowHashes + firstRow);
+    ++nTileUpdatesSent;
+    tileUpdateRows << nRows;
+    displayBytesSent += size;
+    return size;
 }
 
-bool DisplayItem::Display(IPCChannel &ipcChannel) {
+bool DisplayItem::Display(IPCChannel &ipcChannel, int64_t *byteBudget) {
     if (!openedImage) {
         if (!SendOpenImage(ipcChannel))
             // maybe next time
             return false;
         openedImage = true;
+        // The viewer starts over with a black image
+        for (ImageChannelBuffer &channelBuffer : channelBuffers)
+            channelBuffer.ResetRowHashes(resolution);
+        nextTile = 0;
     }
 
     std::vector<pstd::span<float>> displayValues(channelBuffers.size());
@@ -356,27 +393,37 @@ bool DisplayItem::Display(IPCChannel &ipcChannel) {
         displayValues[c] = pstd::MakeSpan(ptr, tileSize * tileSize);
     }
 
-    int tileIndex = 0;
-    for (int y = 0; y < resolution.y; y += tileSize)
-        for (int x = 0; x < resolution.x; x += tileSize, ++tileIndex) {
-            int height = std::min(y + tileSize, resolution.y) - y;
-            int width = std::min(x + tileSize, resolution.x) - x;
-
-            for (int c = 0; c < channelBuffers.size(); ++c)
-                channelBuffers[c].SetTileBounds(x, y, width, height);
-
-            Bounds2i b(Point2i(x, y), Point2i(x + width, y + height));
-            getTileValues(b, pstd::MakeSpan(displayValues));
-
-            // Send the RGB buffers only if they're different than
-            // the last version sent.
-            for (int c = 0; c < channelBuffers.size(); ++c)
-                if (!channelBuffers[c].SendIfChanged(ipcChannel, tileIndex)) {
-                    // Welp. Stop for now...
-                    openedImage = false;
-                    return false;
-                }
+    int nTilesX = (resolution.x + tileSize - 1) / tileSize;
+    int nTiles = nTilesX * ((resolution.y + tileSize - 1) / tileSize);
+    for (int i = 0; i < nTiles; ++i) {
+        if (byteBudget && *byteBudget <= 0)
+            break;
+        int tileIndex = (nextTile + i) % nTiles;
+        int x = (tileIndex % nTilesX) * tileSize, y = (tileIndex / nTilesX) * tileSize;
+        int height = std::min(y + tileSize, resolution.y) - y;
+        int width = std::min(x + tileSize, resolution.x) - x;
+
+        for (int c = 0; c < channelBuffers.size(); ++c)
+            channelBuffers[c].SetTileBounds(x, y, width, height);
+
+        Bounds2i b(Point2i(x, y), Point2i(x + width, y + height));
+        getTileValues(b, pstd::MakeSpan(displayValues));
+
+        // Send the rows of the RGB buffers that are different than the
+        // last version sent.
+        for (int c = 0; c < channelBuffers.size(); ++c) {
+            int64_t bytesSent = channelBuffers[c].SendIfChanged(ipcChannel, tileIndex);
+            if (bytesSent < 0) {
+                // Welp. Stop for now...
+                openedImage = false;
+                return false;
+            }
+            if (byteBudget)
+                *byteBudget -= bytesSent;
         }
+        if (byteBudget && *byteBudget <= 0)
+            nextTile = (tileIndex + 1) % nTiles;
+    }
 
     return true;
 }
@@ -409,13 +456,26 @@ static std::vector<DisplayItem> dynamicItems;
 
 static IPCChannel *channel;
 
-static void updateDynamicItems() {
+static void updateDynamicItems(Float bandwidth) {
+    // With a bandwidth limit, each update may send what the link carried
+    // since the previous one (up to a second's worth, to bound bursts);
+    // overruns are deducted from the next update.
+    int64_t bytesPerSecond = bandwidth * 1000000, byteBudget = 0;
+    auto lastUpdate = std::chrono::steady_clock::now();
+
     while (!exitThread) {
         std::this_thread::sleep_for(std::chrono::milliseconds(250));
 
         std::lock_guard<std::mutex> lock(mutex);
+        if (bytesPerSecond > 0) {
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - lastUpdate).count();
+            byteBudget = std::min<int64_t>(byteBudget + elapsed * bytesPerSecond,
+                                           bytesPerSecond);
+            lastUpdate = now;
+        }
         for (auto &item : dynamicItems)
-            item.Display(*channel);
+            item.Display(*channel, bytesPerSecond > 0 ? &byteBudget : nullptr);
     }
 
     // One last time to get the last bits
@@ -426,13 +486,16 @@ static void updateDynamicItems() {
     dynamicItems.clear();
     delete channel;
     channel = nullptr;
+    // This thread isn't one of the thread pool's, so its statistics need to
+    // be reported explicitly.
+    ReportThreadStats();
 }
 
-void ConnectToDisplayServer(const std::string &host) {
+void ConnectToDisplayServer(const std::string &host, Float bandwidth) {
     CHECK(channel == nullptr);
     channel = new IPCChannel(host);
 
-    updateThread = std::thread(updateDynamicItems);
+    updateThread = std::thread(updateDynamicItems, bandwidth);
 }
 
 void DisconnectFromDisplayServer() {
@@ -20,7 +20,9 @@
 namespace pbrt {
 
 // DisplayServer Function Declarations
-void ConnectToDisplayServer(const std::string &host);
+// If _bandwidth_ (in MB/s) is positive, updates of dynamic images are sent
+// no faster than it allows; tiles that don't fit are sent in later updates.
+void ConnectToDisplayServer(const std::string &host, Float bandwidth = 0);
 void DisconnectFromDisplayServer();
 
 void DisplayStatic(
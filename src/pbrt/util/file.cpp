@@ -7,18 +7,27 @@
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/parallel.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/util/string.h>
 
-#include <libdeflate.h>
+#include <zlib.h>
 
 #include <filesystem/path.h>
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <climits>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #ifndef PBRT_IS_WINDOWS
 #include <dirent.h>
 #include <fcntl.h>
@@ -26,10 +35,16 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
 #endif
 
 namespace pbrt {
 
+STAT_COUNTER("File I/O/Files prefetched", nFilesPrefetched);
+STAT_MEMORY_COUNTER("File I/O/Bytes prefetched", prefetchedFileBytes);
+
 static filesystem::path searchDirectory;
 
 void SetSearchDirectory(std::string filename) {
@@ -113,6 +128,32 @@ bool FileExists(std::string filename) {
     return (bool)ifs;
 }
 
+int64_t FileModificationTime(std::string filename) {
+#ifdef PBRT_IS_WINDOWS
+    struct _stat64 s;
+    if (_wstat64(WStringFromUTF8(filename).c_str(), &s) != 0)
+        return -1;
+#else
+    struct stat s;
+    if (stat(filename.c_str(), &s) != 0)
+        return -1;
+#endif
+    return int64_t(s.st_mtime);
+}
+
+static int64_t FileSize(const std::string &filename) {
+#ifdef PBRT_IS_WINDOWS
+    struct _stat64 s;
+    if (_wstat64(WStringFromUTF8(filename).c_str(), &s) != 0)
+        return -1;
+#else
+    struct stat s;
+    if (stat(filename.c_str(), &s) != 0)
+        return -1;
+#endif
+    return int64_t(s.st_size);
+}
+
 bool RemoveFile(std::string filename) {
 #ifdef PBRT_IS_WINDOWS
     return _wremove(WStringFromUTF8(filename).c_str()) == 0;
@@ -121,7 +162,7 @@ bool RemoveFile(std::string filename) {
 #endif
 }
 
-std::string ReadFileContents(std::string filename) {
+static std::string ReadFileFromStorage(const std::string &filename) {
 #ifdef PBRT_IS_WINDOWS
     std::ifstream ifs(WStringFromUTF8(filename).c_str(), std::ios::binary);
     if (!ifs)
@@ -136,73 +177,251 @@ std::string ReadFileContents(std::string filename) {
     struct stat stat;
     if (fstat(fd, &stat) != 0)
         ErrorExit("%s: %s", filename, ErrorString());
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 
+    // read() may return fewer bytes than were requested (it never returns
+    // more than about 2GB on Linux), so keep going until the end.
     std::string contents(stat.st_size, '\0');
-    if (read(fd, contents.data(), stat.st_size) == -1)
-        ErrorExit("%s: %s", filename, ErrorString());
+    size_t offset = 0;
+    while (offset < contents.size()) {
+        ssize_t n = read(fd, contents.data() + offset, contents.size() - offset);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            ErrorExit("%s: %s", filename, ErrorString());
+        }
+        if (n == 0) {
+            // The file was truncated after fstat().
+            contents.resize(offset);
+            break;
+        }
+        offset += n;
+    }
 
     close(fd);
     return contents;
 #endif
 }
 
-std::string ReadDecompressedFileContents(std::string filename) {
-    std::string compressed = ReadFileContents(filename);
-
-    // Get the size of the uncompressed file: with gzip, it's stored in the
-    // last 4 bytes of the file.  (One nit is that only 4 bytes are used,
-    // so it's actually the uncompressed size mod 2^32.)
-    CHECK_GT(compressed.size(), 4);
-    size_t sizeOffset = compressed.size() - 4;
-
-    // It's stored in little-endian, so manually reconstruct the value to
-    // be sure that it ends up in the right order for the target system.
-    const unsigned char *s = (const unsigned char *)compressed.data() + sizeOffset;
-    size_t size = (uint32_t(s[0]) | (uint32_t(s[1]) << 8) | (uint32_t(s[2]) << 16) |
-                   (uint32_t(s[3]) << 24));
-
-    // A single libdeflate_decompressor * can't be used by multiple threads
-    // concurrently, so make sure to do per-thread allocations of them.
-    static ThreadLocal<libdeflate_decompressor *> decompressors(
-        []() { return libdeflate_alloc_decompressor(); });
-
-    libdeflate_decompressor *d = decompressors.Get();
-    std::string decompressed(size, '\0');
-    int retries = 0;
-    while (true) {
-        size_t actualOut;
-        libdeflate_result result = libdeflate_gzip_decompress(
-            d, compressed.data(), compressed.size(), decompressed.data(),
-            decompressed.size(), &actualOut);
-        switch (result) {
-        case LIBDEFLATE_SUCCESS:
-            CHECK_EQ(actualOut, decompressed.size());
-            LOG_VERBOSE("Decompressed %s from %d to %d bytes", filename,
-                        compressed.size(), decompressed.size());
-            return decompressed;
-
-        case LIBDEFLATE_BAD_DATA:
-            ErrorExit("%s: invalid or corrupt compressed data", filename);
+// File Prefetching Definitions
+// Prefetched contents that haven't yet been consumed by ReadFileContents()
+// are limited to this many bytes so that prefetching a large scene's files
+// doesn't exhaust memory; files beyond that are read when they are needed.
+static constexpr int64_t MaxPrefetchedBytes = int64_t(1) << 30;
+// Having a few reads in flight at once helps with SSDs and network
+// filesystems, both of which handle concurrent requests well.
+static constexpr int NumIOThreads = 4;
+
+// IOThreadPool Definition
+// The I/O threads do nothing but blocking reads, so that the thread pool's
+// threads can keep computing while data is fetched from storage.
+class IOThreadPool {
+  public:
+    // IOThreadPool Public Methods
+    IOThreadPool(int nThreads) {
+        // The threads are detached and the pool is never destroyed; they
+        // sleep until there is work to do.
+        for (int i = 0; i < nThreads; ++i)
+            std::thread(&IOThreadPool::Worker, this).detach();
+    }
 
-        case LIBDEFLATE_INSUFFICIENT_SPACE:
-            // Assume that the decompressed contents are > 4GB and that
-            // thus the size reported in the file didn't tell the whole
-            // story.  Since the stored size is mod 2^32, try increasing
-            // the allocation by that much.
-            decompressed.resize(decompressed.size() + (1ull << 32));
+    void Enqueue(AsyncJobBase *job) {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+        jobCondition.notify_one();
+    }
 
-            // But if we keep going around in circles, then fail eventually
-            // since there is probably some other problem.
-            CHECK_LT(++retries, 10);
-            break;
+  private:
+    // IOThreadPool Private Methods
+    void Worker() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            jobCondition.wait(lock, [this]() { return !jobs.empty(); });
+            AsyncJobBase *job = jobs.front();
+            jobs.pop_front();
+            lock.unlock();
+            // Continuations of the job are started from this thread; they
+            // are enqueued in the thread pool rather than run here.
+            job->DoWork();
+            lock.lock();
+        }
+    }
 
-        default:
-        case LIBDEFLATE_SHORT_OUTPUT:
-            // This should never be returned by libdeflate, since we are
-            // passing a non-null actualOut pointer...
-            LOG_FATAL("Unexpected return value from libdeflate");
+    // IOThreadPool Private Members
+    std::mutex mutex;
+    std::condition_variable jobCondition;
+    std::deque<AsyncJobBase *> jobs;
+};
+
+static IOThreadPool *IOThreads() {
+    static IOThreadPool *ioThreads = new IOThreadPool(NumIOThreads);
+    return ioThreads;
+}
+
+// The contents are held by a shared_ptr so that ReadFileContents() can
+// take them from the job without making a copy.
+using PrefetchJob = AsyncJob<std::shared_ptr<std::string>>;
+
+struct PrefetchedFile {
+    PrefetchJob *job = nullptr;
+    int64_t size = 0;
+};
+
+static std::mutex prefetchMutex;
+static std::map<std::string, PrefetchedFile> prefetchedFiles;
+static int64_t pendingPrefetchBytes = 0;
+
+AsyncJobBase *PrefetchFileContents(std::string filename) {
+    if (RunningThreads() == 1)
+        return nullptr;
+    int64_t size = FileSize(filename);
+    if (size < 0)
+        // Leave it to ReadFileContents() to report the error.
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    if (prefetchedFiles.find(filename) != prefetchedFiles.end() ||
+        pendingPrefetchBytes + size > MaxPrefetchedBytes)
+        return nullptr;
+
+    PrefetchJob *job = new PrefetchJob([filename]() {
+        return std::make_shared<std::string>(ReadFileFromStorage(filename));
+    });
+    prefetchedFiles[filename] = PrefetchedFile{job, size};
+    pendingPrefetchBytes += size;
+    ++nFilesPrefetched;
+    prefetchedFileBytes += size;
+    LOG_VERBOSE("Prefetching %s (%d bytes)", filename, size);
+
+    IOThreads()->Enqueue(job);
+    return job;
+}
+
+AsyncJob<bool> *RunIOAsync(std::function<bool(void)> func) {
+    AsyncJob<bool> *job = new AsyncJob<bool>(std::move(func));
+    if (RunningThreads() == 1)
+        job->DoWork();
+    else
+        IOThreads()->Enqueue(job);
+    return job;
+}
+
+AsyncJob<bool> *WriteFileContentsAsync(std::string filename, std::string contents) {
+    return RunIOAsync([filename, contents]() {
+        // Write a temporary file and then rename it so that an existing
+        // file is replaced all at once.
+        std::string tempFilename = filename + ".tmp";
+        if (!WriteFileContents(tempFilename, contents))
+            return false;
+#ifdef PBRT_IS_WINDOWS
+        _wremove(WStringFromUTF8(filename).c_str());
+        return _wrename(WStringFromUTF8(tempFilename).c_str(),
+                        WStringFromUTF8(filename).c_str()) == 0;
+#else
+        return rename(tempFilename.c_str(), filename.c_str()) == 0;
+#endif
+    });
+}
+
+std::string ReadFileContents(std::string filename) {
+    TraceScope _("I/O", filename);
+    PrefetchedFile prefetched;
+    {
+        std::lock_guard<std::mutex> lock(prefetchMutex);
+        auto iter = prefetchedFiles.find(filename);
+        if (iter != prefetchedFiles.end()) {
+            prefetched = iter->second;
+            prefetchedFiles.erase(iter);
         }
     }
+    if (!prefetched.job)
+        return ReadFileFromStorage(filename);
+
+    // The job isn't deleted, as it may still be referenced by the jobs
+    // that were waiting for it; its (now empty) string is all it holds.
+    std::shared_ptr<std::string> contents = prefetched.job->GetResult();
+    std::string result = std::move(*contents);
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    pendingPrefetchBytes -= prefetched.size;
+    return result;
+}
+
+std::string ReadDecompressedFileContents(std::string filename) {
+    TraceScope _("I/O", filename);
+    // Decompress the file as it is read, so that its compressed contents
+    // are never all in memory along with the decompressed ones.
+    FILE *f = FOpenRead(filename);
+    if (!f)
+        ErrorExit("%s: %s", filename, ErrorString());
+
+    // With gzip, the uncompressed size is stored in the last 4 bytes of
+    // the file, though it's only that of the last member and it's mod
+    // 2^32; it is only used as the initial size of the output buffer.
+    std::string decompressed;
+    unsigned char s[4];
+    if (fseek(f, -4, SEEK_END) == 0 && fread(s, 1, 4, f) == 4)
+        decompressed.resize(uint32_t(s[0]) | (uint32_t(s[1]) << 8) |
+                            (uint32_t(s[2]) << 16) | (uint32_t(s[3]) << 24));
+    if (fseek(f, 0, SEEK_SET) != 0)
+        ErrorExit("%s: %s", filename, ErrorString());
+
+    // Adding 16 to the window size has zlib expect a gzip header.
+    z_stream stream = {};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+        ErrorExit("%s: unable to initialize zlib", filename);
+    std::vector<unsigned char> input(1 << 20);
+    size_t compressedSize = 0, decompressedSize = 0;
+    bool memberEnded = false;
+    while (true) {
+        if (stream.avail_in == 0) {
+            size_t n = fread(input.data(), 1, input.size(), f);
+            if (n == 0) {
+                if (ferror(f))
+                    ErrorExit("%s: %s", filename, ErrorString());
+                break;
+            }
+            stream.next_in = input.data();
+            stream.avail_in = n;
+            compressedSize += n;
+        }
+        if (memberEnded) {
+            // Files may consist of multiple concatenated gzip members, as
+            // written by parallel compressors; anything else that follows
+            // the last one is ignored, as gzip itself does.
+            if (stream.next_in[0] != 0x1f)
+                break;
+            inflateReset(&stream);
+            memberEnded = false;
+        }
+
+        if (decompressedSize == decompressed.size())
+            decompressed.resize(std::max<size_t>(2 * decompressed.size(), 1 << 20));
+        // zlib's counts are 32 bits, so at most 1GB is decompressed per call.
+        uInt outputSize =
+            std::min<size_t>(decompressed.size() - decompressedSize, 1 << 30);
+        stream.next_out = (Bytef *)decompressed.data() + decompressedSize;
+        stream.avail_out = outputSize;
+        int result = inflate(&stream, Z_NO_FLUSH);
+        decompressedSize += outputSize - stream.avail_out;
+        if (result == Z_STREAM_END)
+            memberEnded = true;
+        else if (result != Z_OK && result != Z_BUF_ERROR)
+            ErrorExit("%s: invalid or corrupt compressed data", filename);
+    }
+    inflateEnd(&stream);
+    fclose(f);
+    if (!memberEnded)
+        ErrorExit("%s: unexpected end of compressed data", filename);
+
+    // Shrinking the string doesn't reallocate it, so the excess capacity
+    // from the growth above remains; it's only at most the size of the
+    // contents and is freed along with them.
+    decompressed.resize(decompressedSize);
+    LOG_VERBOSE("Decompressed %s from %d to %d bytes", filename, compressedSize,
+                decompressedSize);
+    return decompressed;
 }
 
 FILE *FOpenRead(std::string filename) {
@@ -278,6 +497,7 @@ std::vector<Float> ReadFloatFile(std::string filename) {
 }
 
 bool WriteFileContents(std::string filename, const std::string &contents) {
+    TraceScope _("I/O", filename);
 #ifdef PBRT_IS_WINDOWS
     std::ofstream out(WStringFromUTF8(filename).c_str(), std::ios::binary);
 #else
@@ -9,19 +9,42 @@
 
 #include <pbrt/util/pstd.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 
 namespace pbrt {
 
+class AsyncJobBase;
+template <typename T>
+class AsyncJob;
+
 // File and Filename Function Declarations
 std::string ReadFileContents(std::string filename);
+// Starts reading the file on a dedicated I/O thread; a later call to
+// ReadFileContents() for it then returns the prefetched contents. The
+// returned job finishes once they are available, so that work that reads
+// the file can be started with RunAsyncAfter() without tying up a thread
+// while waiting on storage. Returns nullptr if the file is already being
+// prefetched, if too much prefetched data has yet to be read, or if there
+// are no other threads to do the reading.
+AsyncJobBase *PrefetchFileContents(std::string filename);
 std::string ReadDecompressedFileContents(std::string filename);
 bool WriteFileContents(std::string filename, const std::string &contents);
+// Writes the file on an I/O thread, first to a temporary file that is then
+// renamed so that a previous version of it is never left partially
+// overwritten. The job's result reports whether writing succeeded.
+AsyncJob<bool> *WriteFileContentsAsync(std::string filename, std::string contents);
+// Runs _func_ on one of the I/O threads (or immediately if there are no
+// other threads), so that the thread pool's threads don't wait on storage.
+AsyncJob<bool> *RunIOAsync(std::function<bool(void)> func);
 
 std::vector<Float> ReadFloatFile(std::string filename);
 
 bool FileExists(std::string filename);
+// Returns the file's last modification time in seconds, or -1 if it can't be
+// determined.
+int64_t FileModificationTime(std::string filename);
 bool RemoveFile(std::string filename);
 
 std::string ResolveFilename(std::string filename);
@@ -7,6 +7,8 @@
 #include <pbrt/pbrt.h>
 #include <pbrt/util/file.h>
 
+#include <zlib.h>
+
 using namespace pbrt;
 
 static std::string inTestDir(const std::string &path) {
@@ -38,6 +40,26 @@ TEST(File, ReadWriteFile) {
     EXPECT_EQ(0, remove(fn.c_str()));
 }
 
+TEST(File, ReadDecompressedMultipleMembers) {
+    // Write a gzip file with two members, as parallel compressors do.
+    std::string fn = inTestDir("members.txt.gz");
+    std::string first(100000, 'a'), second = "this is a test.";
+    for (size_t i = 0; i < first.size(); ++i)
+        first[i] += i % 23;
+    const char *modes[2] = {"wb", "ab"};
+    const std::string *members[2] = {&first, &second};
+    for (int i = 0; i < 2; ++i) {
+        gzFile f = gzopen(fn.c_str(), modes[i]);
+        ASSERT_TRUE(f != nullptr);
+        EXPECT_EQ(int(members[i]->size()),
+                  gzwrite(f, members[i]->data(), members[i]->size()));
+        EXPECT_EQ(Z_OK, gzclose(f));
+    }
+
+    EXPECT_EQ(first + second, ReadDecompressedFileContents(fn));
+    EXPECT_EQ(0, remove(fn.c_str()));
+}
+
 TEST(File, Success) {
     std::string fn = inTestDir("floatfile_good.txt");
     EXPECT_TRUE(WriteFileContents(fn, R"(1
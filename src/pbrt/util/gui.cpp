@@ -74,6 +74,7 @@ void GUI::keyboardCallback(GLFWwindow *window, int key, int scan, int action, in
     doKey(GLFW_KEY_C, 'c');
     doKey(GLFW_KEY_EQUAL, '=');
     doKey(GLFW_KEY_MINUS, '-');
+    doKey(GLFW_KEY_X, 'x');
 
     doKey(GLFW_KEY_LEFT, 'L');
     doKey(GLFW_KEY_RIGHT, 'R');
@@ -175,6 +176,13 @@ bool GUI::processKeys() {
         keysDown.erase(keysDown.find('-'));
         moveScale *= 0.5;
     }
+    if (keysDown.find('x') != keysDown.end()) {
+        keysDown.erase(keysDown.find('x'));
+        if (!regionOfInterest.IsEmpty()) {
+            regionOfInterest = Bounds2i();
+            regionChanged = true;
+        }
+    }
 
     return needsReset;
 }
@@ -186,14 +194,50 @@ static void glfwKeyCallback(GLFWwindow* window, int key, int scan, int action, i
 
 void GUI::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-        pressed = true;
         glfwGetCursorPos(window, &lastX, &lastY);
+        // Shift-dragging selects the region of interest rather than rotating
+        if (mods & GLFW_MOD_SHIFT) {
+            selectingRegion = true;
+            regionStart = cursorPixel(lastX, lastY);
+        } else
+            pressed = true;
     }
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
+        if (selectingRegion) {
+            double x, y;
+            glfwGetCursorPos(window, &x, &y);
+            // A click without dragging clears the region
+            regionOfInterest = Bounds2i(regionStart, cursorPixel(x, y));
+            if (regionOfInterest.IsEmpty())
+                regionOfInterest = Bounds2i();
+            selectingRegion = false;
+            regionChanged = true;
+        }
         pressed = false;
     }
 }
 
+Point2i GUI::cursorPixel(double xpos, double ypos) const {
+    // Map from window coordinates, which may be scaled, to framebuffer pixels
+    int windowWidth, windowHeight;
+    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+    return Point2i(Clamp(int(xpos * resolution.x / windowWidth), 0, resolution.x),
+                   Clamp(int(ypos * resolution.y / windowHeight), 0, resolution.y));
+}
+
+bool GUI::AdvancePreview() {
+    if (previewStride == 1)
+        return false;
+    previewStride = previewStride > 4 ? 4 : 1;
+    return true;
+}
+
+Bounds2i GUI::RegionOfInterest() const {
+    if (regionOfInterest.IsEmpty())
+        return Bounds2i(Point2i(0, 0), Point2i(resolution));
+    return regionOfInterest;
+}
+
 void GUI::Initialize() {
     if (!glfwInit())
         LOG_FATAL("Unable to initialize GLFW");
@@ -331,10 +375,15 @@ DisplayState GUI::RefreshDisplay() {
 
     if (glfwWindowShouldClose(window))
         return DisplayState::EXIT;
-    else if (process())
+    // Start over with a coarse preview if the camera moved
+    bool cameraMoved = process();
+    if (cameraMoved)
+        previewStride = 8;
+    if (cameraMoved || regionChanged) {
+        regionChanged = false;
         return DisplayState::RESET;
-    else
-        return DisplayState::NONE;
+    }
+    return DisplayState::NONE;
 }
 
 }  // namespace pbrt
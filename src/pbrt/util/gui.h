@@ -53,6 +53,16 @@ class GUI {
     Float exposure = 1.f;
     bool printCameraTransform = false;
 
+    // After the camera moves, images are first rendered with a single pixel
+    // sample for each _PreviewStride()_ x _PreviewStride()_ block of pixels;
+    // AdvancePreview() moves to the next finer level, returning false once
+    // every pixel is being sampled. Only the pixels inside
+    // _RegionOfInterest()_, which is selected by dragging the mouse with
+    // shift held down and cleared with the 'x' key, are rendered.
+    int PreviewStride() const { return previewStride; }
+    bool AdvancePreview();
+    Bounds2i RegionOfInterest() const;
+
     void keyboardCallback(GLFWwindow *window, int key, int scan, int action, int mods);
     void cursorPosCallback(GLFWwindow *window, double xpos, double ypos);
     void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods);
@@ -64,6 +74,7 @@ class GUI {
     bool processKeys();
     bool processMouse();
     bool process();
+    Point2i cursorPixel(double xpos, double ypos) const;
 
     std::set<char> keysDown;
     Float moveScale = 1.f;
@@ -76,6 +87,10 @@ class GUI {
     Float yoffset = 0.f;
     double lastX = 0.f;
     double lastY = 0.f;
+    int previewStride = 1;
+    Bounds2i regionOfInterest;
+    bool selectingRegion = false, regionChanged = false;
+    Point2i regionStart;
 
 #ifdef PBRT_BUILD_GPU_RENDERER
     CUDAOutputBuffer<RGB> *cudaFramebuffer = nullptr;
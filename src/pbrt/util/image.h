@@ -18,8 +18,10 @@
 
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <map>
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace pbrt {
@@ -232,6 +234,12 @@ class Image {
     Image(PixelFormat format, Point2i resolution,
           pstd::span<const std::string> channelNames, ColorEncoding encoding = nullptr,
           Allocator alloc = {});
+    // Creates an image that uses the given pixels in place; they must stay
+    // valid as long as _mapping_ is held. They are first copied if the
+    // image's pixels are modified.
+    Image(PixelFormat format, Point2i resolution,
+          pstd::span<const std::string> channelNames, ColorEncoding encoding,
+          const void *pixels, std::shared_ptr<const void> mapping);
 
     PBRT_CPU_GPU
     PixelFormat Format() const { return format; }
@@ -260,14 +268,14 @@ class Image {
         switch (format) {
         case PixelFormat::U256: {  // Return _U256_-encoded pixel channel value
             Float r;
-            encoding.ToLinear({&p8[PixelOffset(p) + c], 1}, {&r, 1});
+            encoding.ToLinear({&Pixels8()[PixelOffset(p) + c], 1}, {&r, 1});
             return r;
         }
         case PixelFormat::Half: {  // Return _Half_-encoded pixel channel value
-            return Float(p16[PixelOffset(p) + c]);
+            return Float(Pixels16()[PixelOffset(p) + c]);
         }
         case PixelFormat::Float: {  // Return _Float_-encoded pixel channel value
-            return p32[PixelOffset(p) + c];
+            return Pixels32()[PixelOffset(p) + c];
         }
         default:
             LOG_FATAL("Unhandled PixelFormat");
@@ -334,16 +342,37 @@ class Image {
     template <typename F>
     Array2D<Float> GetSamplingDistribution(
         F dxdA, const Bounds2f &domain = Bounds2f(Point2f(0, 0), Point2f(1, 1)),
-        Allocator alloc = {});
-    Array2D<Float> GetSamplingDistribution() {
+        Allocator alloc = {}) const {
+        return GetSamplingDistribution(dxdA, domain, resolution, alloc);
+    }
+    // Returns the sampling distribution at the given resolution, which may be
+    // lower than the image's; each entry averages the pixels that it overlaps.
+    template <typename F>
+    Array2D<Float> GetSamplingDistribution(F dxdA, const Bounds2f &domain,
+                                           Point2i distribResolution,
+                                           Allocator alloc = {}) const;
+    Array2D<Float> GetSamplingDistribution() const {
         return GetSamplingDistribution([](Point2f) { return Float(1); });
     }
 
     static ImageAndMetadata Read(std::string filename, Allocator alloc = {},
                                  ColorEncoding encoding = nullptr);
+    // Returns true if Read() gets the file via ReadFileContents(), in which
+    // case PrefetchFileContents() can be used to start reading it early.
+    static bool ReadsFileContents(const std::string &filename);
 
     bool Write(std::string name, const ImageMetadata &metadata = {}) const;
 
+    // Writes an EXR file with the given resolution and channels one band of
+    // scanlines at a time, so that the whole image never needs to be in
+    // memory. _fillBand_ is called with an image for each band, in order,
+    // and must set its pixels to the file's rows starting at _yStart_.
+    static bool WriteEXRBands(const std::string &name, PixelFormat format,
+                              Point2i resolution,
+                              pstd::span<const std::string> channelNames,
+                              const ImageMetadata &metadata,
+                              std::function<void(Image &band, int yStart)> fillBand);
+
     Image ConvertToFormat(PixelFormat format, ColorEncoding encoding = nullptr) const;
 
     // TODO? provide an iterator to iterate over all pixels and channels?
@@ -376,22 +405,29 @@ class Image {
 
     std::vector<std::string> ChannelNames(const ImageChannelDesc &) const;
 
+    // Pixels that are used in place from a mapped file aren't included.
     PBRT_CPU_GPU
     size_t BytesUsed() const { return p8.size() + 2 * p16.size() + 4 * p32.size(); }
+    // Returns true if the image's pixels are in a file mapped into memory.
+    bool IsMapped() const { return mappedPixels != nullptr; }
 
     PBRT_CPU_GPU
     const void *RawPointer(Point2i p) const {
         if (Is8Bit(format))
-            return p8.data() + PixelOffset(p);
+            return Pixels8() + PixelOffset(p);
         if (Is16Bit(format))
-            return p16.data() + PixelOffset(p);
+            return Pixels16() + PixelOffset(p);
         else {
             CHECK(Is32Bit(format));
-            return p32.data() + PixelOffset(p);
+            return Pixels32() + PixelOffset(p);
         }
     }
     PBRT_CPU_GPU
     void *RawPointer(Point2i p) {
+#ifndef PBRT_IS_GPU_CODE
+        if (mappedPixels)
+            CopyMappedPixels();
+#endif
         return const_cast<void *>(((const Image *)this)->RawPointer(p));
     }
 
@@ -403,11 +439,28 @@ class Image {
 
   private:
     // Image Private Methods
+    PBRT_CPU_GPU
+    const uint8_t *Pixels8() const {
+        return mappedPixels ? (const uint8_t *)mappedPixels : p8.data();
+    }
+    PBRT_CPU_GPU
+    const Half *Pixels16() const {
+        return mappedPixels ? (const Half *)mappedPixels : p16.data();
+    }
+    PBRT_CPU_GPU
+    const float *Pixels32() const {
+        return mappedPixels ? (const float *)mappedPixels : p32.data();
+    }
+    // Copies mapped pixels into the image's own storage before they are
+    // modified.
+    void CopyMappedPixels();
+
     static std::vector<ResampleWeight> ResampleWeights(int oldRes, int newRes);
     bool WriteEXR(const std::string &name, const ImageMetadata &metadata) const;
     bool WritePFM(const std::string &name, const ImageMetadata &metadata) const;
     bool WritePNG(const std::string &name, const ImageMetadata &metadata) const;
     bool WriteQOI(const std::string &name, const ImageMetadata &metadata) const;
+    bool WriteRaw(const std::string &name, const ImageMetadata &metadata) const;
 
     std::unique_ptr<uint8_t[]> QuantizePixelsToU256(int *nOutOfGamut) const;
 
@@ -419,6 +472,9 @@ class Image {
     pstd::vector<uint8_t> p8;
     pstd::vector<Half> p16;
     pstd::vector<float> p32;
+    // Set if the pixels are used in place from a mapped file
+    const void *mappedPixels = nullptr;
+    std::shared_ptr<const void> mapping;
 };
 
 // Image Inline Method Definitions
@@ -430,6 +486,10 @@ inline void Image::SetChannel(Point2i p, int c, Float value) {
 #endif
         value = 0;
     }
+#ifndef PBRT_IS_GPU_CODE
+    if (mappedPixels)
+        CopyMappedPixels();
+#endif
 
     switch (format) {
     case PixelFormat::U256:
@@ -448,19 +508,31 @@ inline void Image::SetChannel(Point2i p, int c, Float value) {
 
 template <typename F>
 inline Array2D<Float> Image::GetSamplingDistribution(F dxdA, const Bounds2f &domain,
-                                                     Allocator alloc) {
-    Array2D<Float> dist(resolution[0], resolution[1], alloc);
-    ParallelFor(0, resolution[1], [&](int64_t y0, int64_t y1) {
+                                                     Point2i distribResolution,
+                                                     Allocator alloc) const {
+    Array2D<Float> dist(distribResolution[0], distribResolution[1], alloc);
+    // Returns the range of pixels along dimension _d_ that overlap entry _i_
+    auto pixelRange = [&](int i, int d) {
+        int64_t n = resolution[d], nd = distribResolution[d];
+        return std::make_pair(int(i * n / nd), int(((i + 1) * n + nd - 1) / nd));
+    };
+    ParallelFor(0, distribResolution[1], [&](int64_t y0, int64_t y1) {
         for (int y = y0; y < y1; ++y) {
-            for (int x = 0; x < resolution[0]; ++x) {
+            std::pair<int, int> py = pixelRange(y, 1);
+            for (int x = 0; x < distribResolution[0]; ++x) {
                 // This is noticeably better than MaxValue: discuss / show
                 // example..
-                Float value = GetChannels({x, y}).Average();
+                std::pair<int, int> px = pixelRange(x, 0);
+                Float value = 0;
+                for (int yp = py.first; yp < py.second; ++yp)
+                    for (int xp = px.first; xp < px.second; ++xp)
+                        value += GetChannels({xp, yp}).Average();
+                value /= (py.second - py.first) * (px.second - px.first);
 
                 // Assume Jacobian term is basically constant over the
                 // region.
-                Point2f p = domain.Lerp(
-                    Point2f((x + .5f) / resolution[0], (y + .5f) / resolution[1]));
+                Point2f p = domain.Lerp(Point2f((x + .5f) / distribResolution[0],
+                                                (y + .5f) / distribResolution[1]));
                 dist(x, y) = value * dxdA(p);
             }
         }
@@ -474,6 +546,33 @@ struct ImageAndMetadata {
     ImageMetadata metadata;
 };
 
+// EXRReader Definition
+// Reads an EXR file's header up front and then its pixels a band of rows
+// at a time, for callers that can't hold the whole image in memory.
+class EXRReader {
+  public:
+    // Exits with an error if the file's header can't be read.
+    EXRReader(const std::string &filename);
+    ~EXRReader();
+
+    const std::string &Filename() const { return filename; }
+    const ImageMetadata &Metadata() const { return metadata; }
+    PixelFormat Format() const { return format; }
+    const std::vector<std::string> &ChannelNames() const { return channelNames; }
+
+    // Returns the rows of the file in [yStart, yEnd), given in the same
+    // coordinates as the metadata's pixel bounds, as an image.
+    Image ReadRows(int yStart, int yEnd, Allocator alloc = {});
+
+  private:
+    struct File;
+    std::string filename;
+    std::unique_ptr<File> file;
+    ImageMetadata metadata;
+    PixelFormat format;
+    std::vector<std::string> channelNames;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_IMAGE_H
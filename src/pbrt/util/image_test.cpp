@@ -6,6 +6,7 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/options.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/file.h>
@@ -17,6 +18,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cmath>
 
 using namespace pbrt;
@@ -326,6 +328,44 @@ TEST(Image, PfmIO) {
     EXPECT_TRUE(RemoveFile("test.pfm"));
 }
 
+TEST(Image, RawIO) {
+    Point2i res(16, 49);
+    pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
+
+    for (auto format : {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float}) {
+        Image image(rgbPixels, res, {"R", "G", "B"});
+        image = image.ConvertToFormat(
+            format, format == PixelFormat::U256 ? ColorEncoding::sRGB : nullptr);
+        EXPECT_TRUE(image.Write("test.pimg"));
+        ImageAndMetadata read = Image::Read("test.pimg");
+        EXPECT_EQ(*RGBColorSpace::sRGB, *read.metadata.GetColorSpace());
+
+        EXPECT_TRUE(read.image.IsMapped());
+        EXPECT_EQ(image.Resolution(), read.image.Resolution());
+        EXPECT_EQ(format, read.image.Format());
+        ASSERT_EQ(3, read.image.NChannels());
+        EXPECT_EQ("R", read.image.ChannelNames()[0]);
+        EXPECT_EQ("B", read.image.ChannelNames()[2]);
+
+        for (int y = 0; y < res[1]; ++y)
+            for (int x = 0; x < res[0]; ++x)
+                for (int c = 0; c < 3; ++c)
+                    EXPECT_EQ(image.GetChannel({x, y}, c),
+                              read.image.GetChannel({x, y}, c));
+
+        // Writing a pixel must copy the mapped pixels rather than modify
+        // the file.
+        read.image.SetChannel({0, 0}, 0, 0.25f);
+        EXPECT_FALSE(read.image.IsMapped());
+        EXPECT_EQ(image.GetChannel({1, 0}, 0), read.image.GetChannel({1, 0}, 0));
+
+        ImageAndMetadata reread = Image::Read("test.pimg");
+        EXPECT_EQ(image.GetChannel({0, 0}, 0), reread.image.GetChannel({0, 0}, 0));
+
+        EXPECT_TRUE(RemoveFile("test.pimg"));
+    }
+}
+
 TEST(Image, ExrIO) {
     Point2i res(16, 49);
     pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
@@ -466,6 +506,40 @@ TEST(Image, ExrMetadata) {
     EXPECT_TRUE(RemoveFile(filename.c_str()));
 }
 
+TEST(Image, ExrReadRows) {
+    Point2i res(16, 32);
+    pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
+    Image image(rgbPixels, res, {"R", "G", "B"});
+
+    std::string filename = "rows.exr";
+    ImageMetadata outMetadata;
+    Bounds2i pb(Point2i(2, 10), Point2i(18, 42));
+    outMetadata.pixelBounds = pb;
+    outMetadata.fullResolution = Point2i(100, 50);
+    EXPECT_TRUE(image.Write(filename, outMetadata));
+
+    {
+        EXRReader reader(filename);
+        EXPECT_EQ(PixelFormat::Float, reader.Format());
+        EXPECT_EQ(3, reader.ChannelNames().size());
+        EXPECT_EQ(pb, *reader.Metadata().pixelBounds);
+
+        // Read rows in a few bands, including a partial one at the end.
+        for (int y0 = pb.pMin.y; y0 < pb.pMax.y; y0 += 12) {
+            int y1 = std::min(y0 + 12, pb.pMax.y);
+            Image rows = reader.ReadRows(y0, y1);
+            EXPECT_EQ(Point2i(res.x, y1 - y0), rows.Resolution());
+            for (int y = 0; y < y1 - y0; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        EXPECT_EQ(image.GetChannel({x, y0 - pb.pMin.y + y}, c),
+                                  rows.GetChannel({x, y}, c));
+        }
+    }
+
+    EXPECT_TRUE(RemoveFile(filename.c_str()));
+}
+
 TEST(Image, PngYIO) {
     Point2i res(11, 50);
     pstd::vector<uint8_t> rgbPixels = GetU8Pixels(res, 1);
@@ -732,6 +806,92 @@ TEST(Image, Select) {
         }
 }
 
+TEST(Image, FloatResizeUpConstant) {
+    // Resampling a constant image should give the same constant for all of
+    // the channel counts that have specialized code paths
+    for (int nc : {1, 2, 3, 4}) {
+        std::vector<std::string> names = {"R", "G", "B", "A"};
+        names.resize(nc);
+        Point2i res(7, 5);
+        Image image(PixelFormat::Float, res, names);
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c)
+                    image.SetChannel({x, y}, c, 0.25f * (c + 1));
+
+        for (Point2i newRes : {Point2i(16, 8), Point2i(7, 8), Point2i(16, 5)}) {
+            Image resized = image.FloatResizeUp(newRes, WrapMode::Clamp);
+            ASSERT_EQ(newRes, resized.Resolution());
+            for (int y = 0; y < newRes.y; ++y)
+                for (int x = 0; x < newRes.x; ++x)
+                    for (int c = 0; c < nc; ++c)
+                        EXPECT_NEAR(0.25f * (c + 1), resized.GetChannel({x, y}, c),
+                                    1e-5f)
+                            << nc << " " << newRes << " " << x << " " << y;
+        }
+    }
+}
+
+TEST(Image, GeneratePyramidBoxFilter) {
+    for (int nc : {1, 3, 4, 5}) {
+        std::vector<std::string> names = {"R", "G", "B", "A", "Z"};
+        names.resize(nc);
+        Point2i res(16, 8);
+        RNG rng;
+        Image image(PixelFormat::Float, res, names);
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c)
+                    image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+        pstd::vector<Image> pyramid =
+            Image::GeneratePyramid(image, WrapMode::Clamp, Allocator());
+        ASSERT_EQ(5, pyramid.size());
+        // Each texel of a level should be the average of the corresponding
+        // 2x2 texels of the level below it
+        for (size_t level = 1; level < pyramid.size(); ++level) {
+            const Image &fine = pyramid[level - 1], &coarse = pyramid[level];
+            for (int y = 0; y < coarse.Resolution().y; ++y)
+                for (int x = 0; x < coarse.Resolution().x; ++x)
+                    for (int c = 0; c < nc; ++c) {
+                        int x0 = 2 * x, y0 = 2 * y;
+                        int x1 = std::min(x0 + 1, fine.Resolution().x - 1);
+                        int y1 = std::min(y0 + 1, fine.Resolution().y - 1);
+                        Float avg = (fine.GetChannel({x0, y0}, c) +
+                                     fine.GetChannel({x1, y0}, c) +
+                                     fine.GetChannel({x0, y1}, c) +
+                                     fine.GetChannel({x1, y1}, c)) /
+                                    4;
+                        EXPECT_NEAR(avg, coarse.GetChannel({x, y}, c), 1e-5f)
+                            << nc << " " << level << " " << x << " " << y;
+                    }
+        }
+    }
+}
+
+// Run with --gtest_also_run_disabled_tests to time pyramid generation for a
+// large image that must be resampled to a power-of-two resolution.
+TEST(Image, DISABLED_GeneratePyramidPerformance) {
+    Point2i res(3000, 1500);
+    RNG rng;
+    Image image(PixelFormat::U256, res, {"R", "G", "B"}, ColorEncoding::sRGB);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pstd::vector<Image> pyramid =
+        Image::GeneratePyramid(image, WrapMode::Repeat, Allocator());
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    Float elapsedMS =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() /
+        1000.;
+    fprintf(stderr, "GeneratePyramid: %d levels in %.3f ms\n", int(pyramid.size()),
+            elapsedMS);
+    EXPECT_EQ(Point2i(4096, 2048), pyramid[0].Resolution());
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 static std::string inTestDir(const std::string &path) {
@@ -762,7 +922,7 @@ static void TestRoundTrip(const char *fn) {
             for (int c = 0; c < 3; ++c) {
                 float wrote = image.GetChannel({x, y}, c);
                 float delta = wrote - rgb[c];
-                if (HasExtension(filename, "pfm")) {
+                if (HasExtension(filename, "pfm") || HasExtension(filename, "pimg")) {
                     // Everything should come out exact.
                     EXPECT_EQ(0, delta) << filename << ":(" << x << ", " << y
                                         << ") c = " << c << " wrote " << wrote
@@ -808,6 +968,10 @@ TEST(ImageIO, RoundTripPFM) {
     TestRoundTrip("out.pfm");
 }
 
+TEST(ImageIO, RoundTripRaw) {
+    TestRoundTrip("out.pimg");
+}
+
 TEST(ImageIO, RoundTripPNG) {
     TestRoundTrip("out.png");
 }
@@ -815,3 +979,258 @@ TEST(ImageIO, RoundTripPNG) {
 TEST(ImageIO, RoundTripQOI) {
     TestRoundTrip("out.qoi");
 }
+
+TEST(MIPMap, PagedMatchesResident) {
+    // The pyramid's levels span multiple tiles; the coarser ones are
+    // smaller than a single tile
+    Point2i res(256, 128);
+    Image image(PixelFormat::Half, res, {"R", "G", "B"});
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+    for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black}) {
+        for (FilterFunction filter : {FilterFunction::Point, FilterFunction::Bilinear,
+                                      FilterFunction::Trilinear, FilterFunction::EWA}) {
+            MIPMapFilterOptions options;
+            options.filter = filter;
+            MIPMap resident(image, RGBColorSpace::sRGB, wrapMode, Allocator(), options);
+            // A small cache makes lookups evict and reread tiles
+            Options->textureCacheMB = 1;
+            MIPMap paged(image, RGBColorSpace::sRGB, wrapMode, Allocator(), options);
+            Options->textureCacheMB = 0;
+            EXPECT_FALSE(resident.IsPaged());
+            ASSERT_TRUE(paged.IsPaged());
+            EXPECT_EQ(resident.Levels(), paged.Levels());
+
+            for (int i = 0; i < 1000; ++i) {
+                Point2f st(-0.5f + 2 * rng.Uniform<Float>(),
+                           -0.5f + 2 * rng.Uniform<Float>());
+                Vector2f dst0(0.05f * (rng.Uniform<Float>() - 0.5f),
+                              0.05f * (rng.Uniform<Float>() - 0.5f));
+                Vector2f dst1(0.05f * (rng.Uniform<Float>() - 0.5f),
+                              0.05f * (rng.Uniform<Float>() - 0.5f));
+                EXPECT_EQ(resident.Filter<RGB>(st, dst0, dst1),
+                          paged.Filter<RGB>(st, dst0, dst1));
+                EXPECT_EQ(resident.Filter<Float>(st, dst0, dst1),
+                          paged.Filter<Float>(st, dst0, dst1));
+            }
+        }
+    }
+}
+
+TEST(MIPMap, ResidentLookupsMatchImage) {
+    // Bilinear and point lookups at the finest level must return the same
+    // values as the image's own, for each pixel format and channel count
+    Point2i res(64, 32);
+    RNG rng;
+    for (PixelFormat format : {PixelFormat::U256, PixelFormat::Half, PixelFormat::Float})
+        for (int nc : {1, 3, 4}) {
+            std::vector<std::string> channels = {"R", "G", "B", "A"};
+            if (nc == 1)
+                channels = {"Y"};
+            channels.resize(nc);
+            Image image(format, res, channels,
+                        format == PixelFormat::U256 ? ColorEncoding::sRGB : nullptr);
+            for (int y = 0; y < res.y; ++y)
+                for (int x = 0; x < res.x; ++x)
+                    for (int c = 0; c < nc; ++c)
+                        image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+            for (FilterFunction filter :
+                 {FilterFunction::Point, FilterFunction::Bilinear}) {
+                MIPMapFilterOptions options;
+                options.filter = filter;
+                MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Repeat, Allocator(),
+                              options);
+                for (int i = 0; i < 100; ++i) {
+                    Point2f st(-0.5f + 2 * rng.Uniform<Float>(),
+                               -0.5f + 2 * rng.Uniform<Float>());
+                    Float v[4];
+                    for (int c = 0; c < nc; ++c) {
+                        if (filter == FilterFunction::Bilinear)
+                            v[c] = image.BilerpChannel(st, c, WrapMode::Repeat);
+                        else
+                            v[c] = image.GetChannel(
+                                {int(pstd::round(st[0] * res.x - 0.5f)),
+                                 int(pstd::round(st[1] * res.y - 0.5f))},
+                                c, WrapMode::Repeat);
+                    }
+
+                    RGB rgb = mipmap.Filter<RGB>(st, {}, {});
+                    Float f = mipmap.Filter<Float>(st, {}, {});
+                    if (nc == 1) {
+                        EXPECT_EQ(RGB(v[0], v[0], v[0]), rgb);
+                        EXPECT_EQ(v[0], f);
+                    } else {
+                        EXPECT_EQ(RGB(v[0], v[1], v[2]), rgb);
+                        if (filter == FilterFunction::Point)
+                            EXPECT_EQ(v[0], f);
+                        else
+                            EXPECT_EQ(nc == 3 ? (v[0] + v[1] + v[2]) / 3 : v[3], f);
+                    }
+                }
+            }
+        }
+}
+
+TEST(MIPMap, BlockedMatchesResident) {
+    // The resolution isn't a multiple of the block size
+    Point2i res(250, 130);
+    RNG rng;
+    for (int nc : {1, 4}) {
+        std::vector<std::string> channels = {"R", "G", "B", "A"};
+        if (nc == 1)
+            channels = {"Y"};
+        Image image(PixelFormat::U256, res, channels, ColorEncoding::sRGB);
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c)
+                    image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+        for (WrapMode wrapMode : {WrapMode::Repeat, WrapMode::Clamp, WrapMode::Black})
+            for (FilterFunction filter :
+                 {FilterFunction::Point, FilterFunction::Bilinear,
+                  FilterFunction::Trilinear, FilterFunction::EWA}) {
+                MIPMapFilterOptions options;
+                options.filter = filter;
+                MIPMap resident(image, RGBColorSpace::sRGB, wrapMode, Allocator(),
+                                options);
+                Options->blockTextures = true;
+                MIPMap blocked(image, RGBColorSpace::sRGB, wrapMode, Allocator(),
+                               options);
+                Options->blockTextures = false;
+                EXPECT_FALSE(resident.IsBlocked());
+                ASSERT_TRUE(blocked.IsBlocked());
+
+                for (int i = 0; i < 1000; ++i) {
+                    Point2f st(-0.5f + 2 * rng.Uniform<Float>(),
+                               -0.5f + 2 * rng.Uniform<Float>());
+                    Vector2f dst0(0.05f * (rng.Uniform<Float>() - 0.5f),
+                                  0.05f * (rng.Uniform<Float>() - 0.5f));
+                    Vector2f dst1(0.05f * (rng.Uniform<Float>() - 0.5f),
+                                  0.05f * (rng.Uniform<Float>() - 0.5f));
+                    EXPECT_EQ(resident.Filter<RGB>(st, dst0, dst1),
+                              blocked.Filter<RGB>(st, dst0, dst1));
+                    EXPECT_EQ(resident.Filter<Float>(st, dst0, dst1),
+                              blocked.Filter<Float>(st, dst0, dst1));
+                }
+            }
+    }
+}
+
+TEST(MIPMap, TexelRange) {
+    Point2i res(64, 32);
+    RNG rng;
+    for (int nc : {1, 3, 4}) {
+        std::vector<std::string> channels = {"R", "G", "B", "A"};
+        channels.resize(nc);
+        Image image(PixelFormat::Float, res, channels);
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c)
+                    image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+        for (FilterFunction filter : {FilterFunction::Point, FilterFunction::EWA}) {
+            MIPMapFilterOptions options;
+            options.filter = filter;
+            MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Repeat, Allocator(),
+                          options);
+            EXPECT_FALSE(mipmap.TexelRange(Bounds2f(Point2f(0, 0), Point2f(1, 1)), 100));
+
+            for (int i = 0; i < 100; ++i) {
+                // Lookups without filtering inside the bounds must be in the range
+                Point2f p0(-0.5f + 2 * rng.Uniform<Float>(),
+                           -0.5f + 2 * rng.Uniform<Float>());
+                Bounds2f st(p0, p0 + Vector2f(0.1f * rng.Uniform<Float>(),
+                                              0.1f * rng.Uniform<Float>()));
+                pstd::optional<Interval> range = mipmap.TexelRange(st, 1000);
+                ASSERT_TRUE(range.has_value());
+                for (int j = 0; j < 100; ++j) {
+                    Point2f p = st.Lerp({rng.Uniform<Float>(), rng.Uniform<Float>()});
+                    Float v = mipmap.Filter<Float>(p, {0, 0}, {0, 0});
+                    EXPECT_GE(v, range->LowerBound() - 1e-6f);
+                    EXPECT_LE(v, range->UpperBound() + 1e-6f);
+                }
+            }
+        }
+    }
+}
+
+TEST(MIPMap, TiledFileMatchesResident) {
+    Point2i res(200, 100);
+    Image image(PixelFormat::U256, res, {"R", "G", "B"}, ColorEncoding::sRGB);
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                image.SetChannel({x, y}, c, rng.Uniform<Float>());
+
+    MIPMapFilterOptions options;
+    options.filter = FilterFunction::EWA;
+    MIPMap resident(image, RGBColorSpace::ACES2065_1, WrapMode::Clamp, Allocator(),
+                    options);
+    ASSERT_TRUE(resident.WriteTiled("test.mip"));
+    MIPMap *tiled = MIPMap::CreateFromFile("test.mip", options, WrapMode::Clamp,
+                                           ColorEncoding::Linear, Allocator());
+    EXPECT_EQ(RGBColorSpace::ACES2065_1, tiled->GetRGBColorSpace());
+    ASSERT_EQ(resident.Levels(), tiled->Levels());
+    for (int level = 0; level < resident.Levels(); ++level)
+        EXPECT_EQ(resident.LevelResolution(level), tiled->LevelResolution(level));
+
+    for (int i = 0; i < 1000; ++i) {
+        Point2f st(-0.5f + 2 * rng.Uniform<Float>(), -0.5f + 2 * rng.Uniform<Float>());
+        Vector2f dst0(0.05f * (rng.Uniform<Float>() - 0.5f),
+                      0.05f * (rng.Uniform<Float>() - 0.5f));
+        Vector2f dst1(0.05f * (rng.Uniform<Float>() - 0.5f),
+                      0.05f * (rng.Uniform<Float>() - 0.5f));
+        EXPECT_EQ(resident.Filter<RGB>(st, dst0, dst1),
+                  tiled->Filter<RGB>(st, dst0, dst1));
+    }
+
+    Allocator().delete_object(tiled);
+    EXPECT_TRUE(RemoveFile("test.mip"));
+}
+
+TEST(MIPMap, CompressedApproximatesResident) {
+    // Smoothly varying images, which block compression represents well
+    Point2i res(128, 64);
+    Image u256(PixelFormat::U256, res, {"R", "G", "B"}, ColorEncoding::sRGB);
+    Image half(PixelFormat::Half, res, {"R", "G", "B"});
+    Image single(PixelFormat::U256, res, {"Y"}, ColorEncoding::Linear);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            Float u = Float(x) / res.x, v = Float(y) / res.y;
+            Float rgb[3] = {u, v, 0.5f * (u + v)};
+            for (int c = 0; c < 3; ++c) {
+                u256.SetChannel({x, y}, c, rgb[c]);
+                half.SetChannel({x, y}, c, 100 * rgb[c]);
+            }
+            single.SetChannel({x, y}, 0, u * v);
+        }
+
+    RNG rng;
+    for (const Image &image : {u256, half, single}) {
+        MIPMapFilterOptions options;
+        options.filter = FilterFunction::Bilinear;
+        MIPMap resident(image, RGBColorSpace::sRGB, WrapMode::Clamp, Allocator(),
+                        options);
+        Options->compressTextures = true;
+        MIPMap compressed(image, RGBColorSpace::sRGB, WrapMode::Clamp, Allocator(),
+                          options);
+        Options->compressTextures = false;
+        EXPECT_FALSE(resident.IsCompressed());
+        ASSERT_TRUE(compressed.IsCompressed());
+
+        Float scale = image.Format() == PixelFormat::Half ? 100 : 1;
+        for (int i = 0; i < 1000; ++i) {
+            Point2f st(rng.Uniform<Float>(), rng.Uniform<Float>());
+            RGB r = resident.Filter<RGB>(st, {}, {});
+            RGB c = compressed.Filter<RGB>(st, {}, {});
+            for (int ch = 0; ch < 3; ++ch)
+                EXPECT_LT(std::abs(r[ch] - c[ch]), 0.05f * scale) << st << " " << ch;
+        }
+    }
+}
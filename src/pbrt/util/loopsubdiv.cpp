@@ -8,112 +8,103 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/mesh.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/pstd.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/util/transform.h>
 #include <pbrt/util/vecmath.h>
 
 #include <algorithm>
-#include <map>
-#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace pbrt {
 
-struct SDFace;
-struct SDVertex;
+STAT_COUNTER("Geometry/Loop subdivision levels", nLoopLevels);
+STAT_COUNTER("Geometry/Loop subdivision early stops", nLoopEarlyStops);
 
 // LoopSubdiv Macros
 #define NEXT(i) (((i) + 1) % 3)
 #define PREV(i) (((i) + 2) % 3)
 
 // LoopSubdiv Local Structures
+// Vertices and faces refer to each other by their index in the current level
+// of the mesh; -1 stands for a missing face across a boundary edge.
 struct SDVertex {
-    // SDVertex Constructor
-    SDVertex(const Point3f &p = Point3f(0, 0, 0)) : p(p) {}
-
-    // SDVertex Methods
-    int valence();
-    void oneRing(Point3f *p);
     Point3f p;
-    SDFace *startFace = nullptr;
-    SDVertex *child = nullptr;
+    int startFace = -1;
     bool regular = false, boundary = false;
 };
 
 struct SDFace {
-    // SDFace Constructor
-    SDFace() {
-        for (int i = 0; i < 3; ++i) {
-            v[i] = nullptr;
-            f[i] = nullptr;
-        }
-        for (int i = 0; i < 4; ++i)
-            children[i] = nullptr;
-    }
-
     // SDFace Methods
-    int vnum(SDVertex *vert) const {
+    int vnum(int vert) const {
         for (int i = 0; i < 3; ++i)
             if (v[i] == vert)
                 return i;
         LOG_FATAL("Basic logic error in SDFace::vnum()");
         return -1;
     }
-    SDFace *nextFace(SDVertex *vert) { return f[vnum(vert)]; }
-    SDFace *prevFace(SDVertex *vert) { return f[PREV(vnum(vert))]; }
-    SDVertex *nextVert(SDVertex *vert) { return v[NEXT(vnum(vert))]; }
-    SDVertex *prevVert(SDVertex *vert) { return v[PREV(vnum(vert))]; }
-    SDVertex *otherVert(SDVertex *v0, SDVertex *v1) {
+    int nextFace(int vert) const { return f[vnum(vert)]; }
+    int prevFace(int vert) const { return f[PREV(vnum(vert))]; }
+    int nextVert(int vert) const { return v[NEXT(vnum(vert))]; }
+    int prevVert(int vert) const { return v[PREV(vnum(vert))]; }
+    int otherVert(int v0, int v1) const {
         for (int i = 0; i < 3; ++i)
             if (v[i] != v0 && v[i] != v1)
                 return v[i];
         LOG_FATAL("Basic logic error in SDFace::otherVert()");
-        return nullptr;
+        return -1;
+    }
+    int edgeNum(int v0, int v1) const {
+        for (int i = 0; i < 3; ++i)
+            if ((v[i] == v0 && v[NEXT(i)] == v1) || (v[i] == v1 && v[NEXT(i)] == v0))
+                return i;
+        LOG_FATAL("Basic logic error in SDFace::edgeNum()");
+        return -1;
     }
-    SDVertex *v[3];
-    SDFace *f[3];
-    SDFace *children[4];
+
+    int v[3] = {-1, -1, -1};
+    int f[3] = {-1, -1, -1};
 };
 
-struct SDEdge {
-    // SDEdge Constructor
-    SDEdge(SDVertex *v0 = nullptr, SDVertex *v1 = nullptr) {
-        v[0] = std::min(v0, v1);
-        v[1] = std::max(v0, v1);
-        f[0] = f[1] = nullptr;
-        f0edgeNum = -1;
+// One level of the subdivision mesh
+struct SDMesh {
+    // SDMesh Methods
+    int valence(int vert) const;
+    void oneRing(int vert, Point3f *p) const;
+    Point3f weightOneRing(int vert, Float beta) const;
+    Point3f weightBoundary(int vert, Float beta) const;
+
+    // The face that creates the odd vertex on edge _k_ of face _face_ when
+    // the mesh is refined; every other face sharing the edge reuses it.
+    bool ownsEdge(int face, int k) const {
+        int f2 = faces[face].f[k];
+        return f2 == -1 || f2 > face;
     }
 
-    // SDEdge Comparison Function
-    bool operator<(const SDEdge &e2) const {
-        if (v[0] == e2.v[0])
-            return v[1] < e2.v[1];
-        return v[0] < e2.v[0];
-    }
-    SDVertex *v[2];
-    SDFace *f[2];
-    int f0edgeNum;
+    std::vector<SDVertex> vertices;
+    std::vector<SDFace> faces;
 };
 
-// LoopSubdiv Local Declarations
-static Point3f weightOneRing(SDVertex *vert, Float beta);
-static Point3f weightBoundary(SDVertex *vert, Float beta);
-
 // LoopSubdiv Inline Functions
-inline int SDVertex::valence() {
-    SDFace *f = startFace;
-    if (!boundary) {
+inline int SDMesh::valence(int vert) const {
+    const SDVertex &v = vertices[vert];
+    int f = v.startFace;
+    if (!v.boundary) {
         // Compute valence of interior vertex
         int nf = 1;
-        while ((f = f->nextFace(this)) != startFace)
+        while ((f = faces[f].nextFace(vert)) != v.startFace)
             ++nf;
         return nf;
     } else {
         // Compute valence of boundary vertex
         int nf = 1;
-        while ((f = f->nextFace(this)) != nullptr)
+        while ((f = faces[f].nextFace(vert)) != -1)
             ++nf;
-        f = startFace;
-        while ((f = f->prevFace(this)) != nullptr)
+        f = v.startFace;
+        while ((f = faces[f].prevFace(vert)) != -1)
             ++nf;
         return nf + 1;
     }
@@ -130,211 +121,232 @@ inline Float loopGamma(int valence) {
     return 1.f / (valence + 3.f / (8.f * beta(valence)));
 }
 
+// LoopSubdiv Local Functions
+static SDMesh Refine(const SDMesh &mesh) {
+    const std::vector<SDVertex> &vertices = mesh.vertices;
+    const std::vector<SDFace> &faces = mesh.faces;
+    int nVertices = vertices.size(), nFaces = faces.size();
+
+    // Number the new odd vertices
+    // Even vertices keep their indices; the odd vertices follow them, in the
+    // order of the faces that own their edges.
+    std::vector<int> edgeVertex(3 * nFaces, -1);
+    std::vector<int> faceOffset(nFaces + 1, 0);
+    ParallelFor(0, nFaces, [&](int64_t i) {
+        int n = 0;
+        for (int k = 0; k < 3; ++k)
+            n += mesh.ownsEdge(i, k);
+        faceOffset[i + 1] = n;
+    });
+    faceOffset[0] = nVertices;
+    for (int i = 0; i < nFaces; ++i)
+        faceOffset[i + 1] += faceOffset[i];
+    ParallelFor(0, nFaces, [&](int64_t i) {
+        int offset = faceOffset[i];
+        for (int k = 0; k < 3; ++k)
+            if (mesh.ownsEdge(i, k))
+                edgeVertex[3 * i + k] = offset++;
+    });
+    // Shared edges are resolved in face order so that a neighbor's entry is
+    // always available, even for non-manifold meshes.
+    for (int i = 0; i < nFaces; ++i)
+        for (int k = 0; k < 3; ++k)
+            if (edgeVertex[3 * i + k] == -1) {
+                const SDFace &face = faces[i];
+                int f2 = face.f[k];
+                int k2 = faces[f2].edgeNum(face.v[k], face.v[NEXT(k)]);
+                edgeVertex[3 * i + k] = edgeVertex[3 * f2 + k2];
+            }
+
+    SDMesh child;
+    child.vertices.resize(faceOffset[nFaces]);
+    child.faces.resize(4 * nFaces);
+
+    // Update vertex positions for even vertices
+    ParallelFor(0, nVertices, [&](int64_t i) {
+        const SDVertex &vertex = vertices[i];
+        SDVertex &c = child.vertices[i];
+        c.regular = vertex.regular;
+        c.boundary = vertex.boundary;
+        if (!vertex.boundary) {
+            // Apply one-ring rule for even vertex
+            if (vertex.regular)
+                c.p = mesh.weightOneRing(i, 1.f / 16.f);
+            else
+                c.p = mesh.weightOneRing(i, beta(mesh.valence(i)));
+        } else {
+            // Apply boundary rule for even vertex
+            c.p = mesh.weightBoundary(i, 1.f / 8.f);
+        }
+        // Update even vertex face pointer
+        int vertNum = faces[vertex.startFace].vnum(i);
+        c.startFace = 4 * vertex.startFace + vertNum;
+    });
+
+    ParallelFor(0, nFaces, [&](int64_t i) {
+        const SDFace &face = faces[i];
+        for (int k = 0; k < 3; ++k) {
+            if (!mesh.ownsEdge(i, k))
+                continue;
+            // Compute odd vertex on _k_th edge
+            SDVertex &vert = child.vertices[edgeVertex[3 * i + k]];
+            int v0 = face.v[k], v1 = face.v[NEXT(k)];
+            vert.regular = true;
+            vert.boundary = (face.f[k] == -1);
+            vert.startFace = 4 * i + 3;
+
+            // Apply edge rules to compute new vertex position
+            if (vert.boundary) {
+                vert.p = 0.5f * vertices[v0].p;
+                vert.p += 0.5f * vertices[v1].p;
+            } else {
+                vert.p = 3.f / 8.f * vertices[v0].p;
+                vert.p += 3.f / 8.f * vertices[v1].p;
+                vert.p += 1.f / 8.f * vertices[face.otherVert(v0, v1)].p;
+                vert.p += 1.f / 8.f * vertices[faces[face.f[k]].otherVert(v0, v1)].p;
+            }
+        }
+
+        // Update new mesh topology
+        // The four children of face _i_ are 4i..4i+3, with the middle one last.
+        SDFace *children = &child.faces[4 * i];
+        for (int j = 0; j < 3; ++j) {
+            // Update children _f_ pointers for siblings
+            children[3].f[j] = 4 * i + NEXT(j);
+            children[j].f[NEXT(j)] = 4 * i + 3;
+
+            // Update children _f_ pointers for neighbor children
+            int f2 = face.f[j];
+            children[j].f[j] = f2 != -1 ? 4 * f2 + faces[f2].vnum(face.v[j]) : -1;
+            f2 = face.f[PREV(j)];
+            children[j].f[PREV(j)] =
+                f2 != -1 ? 4 * f2 + faces[f2].vnum(face.v[j]) : -1;
+
+            // Update child vertex pointer to new even vertex
+            children[j].v[j] = face.v[j];
+
+            // Update child vertex pointer to new odd vertex
+            int vert = edgeVertex[3 * i + j];
+            children[j].v[NEXT(j)] = vert;
+            children[NEXT(j)].v[j] = vert;
+            children[3].v[j] = vert;
+        }
+    });
+
+    return child;
+}
+
+static Float MaxEdgeLength(const SDMesh &mesh) {
+    Float maxLength = 0;
+    for (const SDFace &face : mesh.faces)
+        for (int k = 0; k < 3; ++k)
+            maxLength = std::max(maxLength, Distance(mesh.vertices[face.v[k]].p,
+                                                     mesh.vertices[face.v[NEXT(k)]].p));
+    return maxLength;
+}
+
 // LoopSubdiv Function Definitions
 TriangleMesh *LoopSubdivide(const Transform *renderFromObject, bool reverseOrientation,
                             int nLevels, pstd::span<const int> vertexIndices,
-                            pstd::span<const Point3f> p, Allocator alloc) {
-    std::vector<SDVertex *> vertices;
-    std::vector<SDFace *> faces;
+                            pstd::span<const Point3f> p, Allocator alloc,
+                            Float maxEdgeLength) {
+    SDMesh mesh;
     // Allocate _LoopSubdiv_ vertices and faces
-    std::unique_ptr<SDVertex[]> verts = std::make_unique<SDVertex[]>(p.size());
-    for (int i = 0; i < p.size(); ++i) {
-        verts[i] = SDVertex(p[i]);
-        vertices.push_back(&verts[i]);
-    }
+    mesh.vertices.resize(p.size());
+    for (size_t i = 0; i < p.size(); ++i)
+        mesh.vertices[i].p = p[i];
     size_t nFaces = vertexIndices.size() / 3;
-    std::unique_ptr<SDFace[]> fs = std::make_unique<SDFace[]>(nFaces);
-    for (int i = 0; i < nFaces; ++i)
-        faces.push_back(&fs[i]);
+    mesh.faces.resize(nFaces);
 
     // Set face to vertex pointers
     const int *vp = vertexIndices.data();
     for (size_t i = 0; i < nFaces; ++i, vp += 3) {
-        SDFace *f = faces[i];
+        SDFace &f = mesh.faces[i];
         for (int j = 0; j < 3; ++j) {
-            SDVertex *v = vertices[vp[j]];
-            f->v[j] = v;
-            v->startFace = f;
+            if (vp[j] < 0 || vp[j] >= p.size())
+                ErrorExit("LoopSubdivide: vertex index %d out of range [0,%d).", vp[j],
+                          p.size());
+            f.v[j] = vp[j];
+            mesh.vertices[vp[j]].startFace = i;
         }
     }
+    for (size_t i = 0; i < p.size(); ++i)
+        if (mesh.vertices[i].startFace == -1)
+            ErrorExit("LoopSubdivide: vertex %d isn't used by any triangle.", i);
 
     // Set neighbor pointers in _faces_
-    std::set<SDEdge> edges;
+    // Edges are keyed by their vertex indices, smallest first, and map to the
+    // first face seen with the edge and the edge's number in that face.
+    std::unordered_map<uint64_t, std::pair<int, int>> edges;
+    edges.reserve(3 * nFaces / 2);
     for (int i = 0; i < nFaces; ++i) {
-        SDFace *f = faces[i];
+        SDFace &f = mesh.faces[i];
         for (int edgeNum = 0; edgeNum < 3; ++edgeNum) {
             // Update neighbor pointer for _edgeNum_
-            int v0 = edgeNum, v1 = NEXT(edgeNum);
-            SDEdge e(f->v[v0], f->v[v1]);
-            if (edges.find(e) == edges.end()) {
+            uint32_t v0 = f.v[edgeNum], v1 = f.v[NEXT(edgeNum)];
+            uint64_t key = (uint64_t(std::min(v0, v1)) << 32) | std::max(v0, v1);
+            auto iter = edges.find(key);
+            if (iter == edges.end()) {
                 // Handle new edge
-                e.f[0] = f;
-                e.f0edgeNum = edgeNum;
-                edges.insert(e);
+                edges[key] = std::make_pair(i, edgeNum);
             } else {
                 // Handle previously seen edge
-                e = *edges.find(e);
-                e.f[0]->f[e.f0edgeNum] = f;
-                f->f[edgeNum] = e.f[0];
-                edges.erase(e);
+                auto [f0, f0edgeNum] = iter->second;
+                mesh.faces[f0].f[f0edgeNum] = i;
+                f.f[edgeNum] = f0;
+                edges.erase(iter);
             }
         }
     }
 
     // Finish vertex initialization
-    for (size_t i = 0; i < p.size(); ++i) {
-        SDVertex *v = vertices[i];
-        SDFace *f = v->startFace;
+    ParallelFor(0, p.size(), [&](int64_t i) {
+        SDVertex &v = mesh.vertices[i];
+        int f = v.startFace;
         do {
-            f = f->nextFace(v);
-        } while ((f != nullptr) && f != v->startFace);
-        v->boundary = (f == nullptr);
-        if (!v->boundary && v->valence() == 6)
-            v->regular = true;
-        else if (v->boundary && v->valence() == 4)
-            v->regular = true;
+            f = mesh.faces[f].nextFace(i);
+        } while (f != -1 && f != v.startFace);
+        v.boundary = (f == -1);
+        if (!v.boundary && mesh.valence(i) == 6)
+            v.regular = true;
+        else if (v.boundary && mesh.valence(i) == 4)
+            v.regular = true;
         else
-            v->regular = false;
-    }
+            v.regular = false;
+    });
 
     // Refine _LoopSubdiv_ into triangles
-    std::vector<SDFace *> f = faces;
-    std::vector<SDVertex *> v = vertices;
-    pstd::pmr::monotonic_buffer_resource resource;
-    Allocator vertexFaceAllocator(&resource);
-
     for (int i = 0; i < nLevels; ++i) {
-        // Update _f_ and _v_ for next level of subdivision
-        std::vector<SDFace *> newFaces;
-        std::vector<SDVertex *> newVertices;
-
-        // Allocate next level of children in mesh tree
-        for (SDVertex *vertex : v) {
-            vertex->child = vertexFaceAllocator.new_object<SDVertex>();
-            vertex->child->regular = vertex->regular;
-            vertex->child->boundary = vertex->boundary;
-            newVertices.push_back(vertex->child);
-        }
-        for (SDFace *face : f) {
-            for (int k = 0; k < 4; ++k) {
-                face->children[k] = vertexFaceAllocator.new_object<SDFace>();
-                newFaces.push_back(face->children[k]);
-            }
-        }
-
-        // Update vertex positions and create new edge vertices
-
-        // Update vertex positions for even vertices
-        for (SDVertex *vertex : v) {
-            if (!vertex->boundary) {
-                // Apply one-ring rule for even vertex
-                if (vertex->regular)
-                    vertex->child->p = weightOneRing(vertex, 1.f / 16.f);
-                else
-                    vertex->child->p = weightOneRing(vertex, beta(vertex->valence()));
-            } else {
-                // Apply boundary rule for even vertex
-                vertex->child->p = weightBoundary(vertex, 1.f / 8.f);
-            }
-        }
-
-        // Compute new odd edge vertices
-        std::map<SDEdge, SDVertex *> edgeVerts;
-        for (SDFace *face : f) {
-            for (int k = 0; k < 3; ++k) {
-                // Compute odd vertex on _k_th edge
-                SDEdge edge(face->v[k], face->v[NEXT(k)]);
-                SDVertex *vert = edgeVerts[edge];
-                if (vert == nullptr) {
-                    // Create and initialize new odd vertex
-                    vert = vertexFaceAllocator.new_object<SDVertex>();
-                    newVertices.push_back(vert);
-                    vert->regular = true;
-                    vert->boundary = (face->f[k] == nullptr);
-                    vert->startFace = face->children[3];
-
-                    // Apply edge rules to compute new vertex position
-                    if (vert->boundary) {
-                        vert->p = 0.5f * edge.v[0]->p;
-                        vert->p += 0.5f * edge.v[1]->p;
-                    } else {
-                        vert->p = 3.f / 8.f * edge.v[0]->p;
-                        vert->p += 3.f / 8.f * edge.v[1]->p;
-                        vert->p += 1.f / 8.f * face->otherVert(edge.v[0], edge.v[1])->p;
-                        vert->p +=
-                            1.f / 8.f * face->f[k]->otherVert(edge.v[0], edge.v[1])->p;
-                    }
-                    edgeVerts[edge] = vert;
-                }
-            }
-        }
-
-        // Update new mesh topology
-
-        // Update even vertex face pointers
-        for (SDVertex *vertex : v) {
-            int vertNum = vertex->startFace->vnum(vertex);
-            vertex->child->startFace = vertex->startFace->children[vertNum];
-        }
-
-        // Update face neighbor pointers
-        for (SDFace *face : f) {
-            for (int j = 0; j < 3; ++j) {
-                // Update children _f_ pointers for siblings
-                face->children[3]->f[j] = face->children[NEXT(j)];
-                face->children[j]->f[NEXT(j)] = face->children[3];
-
-                // Update children _f_ pointers for neighbor children
-                SDFace *f2 = face->f[j];
-                face->children[j]->f[j] =
-                    f2 != nullptr ? f2->children[f2->vnum(face->v[j])] : nullptr;
-                f2 = face->f[PREV(j)];
-                face->children[j]->f[PREV(j)] =
-                    f2 != nullptr ? f2->children[f2->vnum(face->v[j])] : nullptr;
-            }
+        // Stop early once all edges are short enough
+        if (maxEdgeLength > 0 && MaxEdgeLength(mesh) <= maxEdgeLength) {
+            ++nLoopEarlyStops;
+            break;
         }
-
-        // Update face vertex pointers
-        for (SDFace *face : f) {
-            for (int j = 0; j < 3; ++j) {
-                // Update child vertex pointer to new even vertex
-                face->children[j]->v[j] = face->v[j]->child;
-
-                // Update child vertex pointer to new odd vertex
-                SDVertex *vert = edgeVerts[SDEdge(face->v[j], face->v[NEXT(j)])];
-                face->children[j]->v[NEXT(j)] = vert;
-                face->children[NEXT(j)]->v[j] = vert;
-                face->children[3]->v[j] = vert;
-            }
-        }
-
-        // Prepare for next level of subdivision
-        f = newFaces;
-        v = newVertices;
+        mesh = Refine(mesh);
+        ++nLoopLevels;
     }
 
     // Push vertices to limit surface
-    std::vector<Point3f> pLimit(v.size());
-    for (size_t i = 0; i < v.size(); ++i) {
-        if (v[i]->boundary)
-            pLimit[i] = weightBoundary(v[i], 1.f / 5.f);
+    size_t nVertices = mesh.vertices.size();
+    std::vector<Point3f> pLimit(nVertices);
+    ParallelFor(0, nVertices, [&](int64_t i) {
+        if (mesh.vertices[i].boundary)
+            pLimit[i] = mesh.weightBoundary(i, 1.f / 5.f);
         else
-            pLimit[i] = weightOneRing(v[i], loopGamma(v[i]->valence()));
-    }
-    for (size_t i = 0; i < v.size(); ++i)
-        v[i]->p = pLimit[i];
+            pLimit[i] = mesh.weightOneRing(i, loopGamma(mesh.valence(i)));
+    });
+    for (size_t i = 0; i < nVertices; ++i)
+        mesh.vertices[i].p = pLimit[i];
 
     // Compute vertex tangents on limit surface
-    std::vector<Normal3f> Ns;
-    Ns.reserve(v.size());
-    std::vector<Point3f> pRing(16, Point3f());
-    for (SDVertex *vertex : v) {
+    std::vector<Normal3f> Ns(nVertices);
+    ParallelFor(0, nVertices, [&](int64_t i) {
+        const SDVertex &vertex = mesh.vertices[i];
         Vector3f S(0, 0, 0), T(0, 0, 0);
-        int valence = vertex->valence();
-        if (valence > (int)pRing.size())
-            pRing.resize(valence);
-        vertex->oneRing(&pRing[0]);
-        if (!vertex->boundary) {
+        int valence = mesh.valence(i);
+        InlinedVector<Point3f, 16> pRing(valence);
+        mesh.oneRing(i, pRing.data());
+        if (!vertex.boundary) {
             // Compute tangents of interior face
             for (int j = 0; j < valence; ++j) {
                 S += std::cos(2 * Pi * j / valence) * Vector3f(pRing[j]);
@@ -344,12 +356,12 @@ TriangleMesh *LoopSubdivide(const Transform *renderFromObject, bool reverseOrien
             // Compute tangents of boundary face
             S = pRing[valence - 1] - pRing[0];
             if (valence == 2)
-                T = Vector3f(pRing[0] + pRing[1] - 2 * vertex->p);
+                T = Vector3f(pRing[0] + pRing[1] - 2 * vertex.p);
             else if (valence == 3)
-                T = pRing[1] - vertex->p;
+                T = pRing[1] - vertex.p;
             else if (valence == 4)  // regular
                 T = Vector3f(-1 * pRing[0] + 2 * pRing[1] + 2 * pRing[2] + -1 * pRing[3] +
-                             -2 * vertex->p);
+                             -2 * vertex.p);
             else {
                 Float theta = Pi / float(valence - 1);
                 T = Vector3f(std::sin(theta) * (pRing[0] + pRing[valence - 1]));
@@ -360,70 +372,62 @@ TriangleMesh *LoopSubdivide(const Transform *renderFromObject, bool reverseOrien
                 T = -T;
             }
         }
-        Ns.push_back(Normal3f(Cross(S, T)));
-    }
+        Ns[i] = Normal3f(Cross(S, T));
+    });
 
     // Create triangle mesh from subdivision mesh
-    {
-        size_t ntris = f.size();
-        std::vector<int> verts(3 * ntris);
-        int *vp = verts.data();
-        size_t totVerts = v.size();
-        std::map<SDVertex *, int> usedVerts;
-        for (size_t i = 0; i < totVerts; ++i)
-            usedVerts[v[i]] = i;
-        for (size_t i = 0; i < ntris; ++i) {
-            for (int j = 0; j < 3; ++j) {
-                *vp = usedVerts[f[i]->v[j]];
-                ++vp;
-            }
-        }
-        return alloc.new_object<TriangleMesh>(
-            *renderFromObject, reverseOrientation, verts, pLimit, std::vector<Vector3f>(),
-            Ns, std::vector<Point2f>(), std::vector<int>(), alloc);
-    }
+    std::vector<int> verts(3 * mesh.faces.size());
+    for (size_t i = 0; i < mesh.faces.size(); ++i)
+        for (int j = 0; j < 3; ++j)
+            verts[3 * i + j] = mesh.faces[i].v[j];
+    mesh = SDMesh();
+    return alloc.new_object<TriangleMesh>(
+        *renderFromObject, reverseOrientation, std::move(verts), std::move(pLimit),
+        std::vector<Vector3f>(), std::move(Ns), std::vector<Point2f>(),
+        std::vector<int>(), alloc);
 }
 
-static Point3f weightOneRing(SDVertex *vert, Float beta) {
+Point3f SDMesh::weightOneRing(int vert, Float beta) const {
     // Put _vert_ one-ring in _pRing_
-    int valence = vert->valence();
+    int valence = this->valence(vert);
     InlinedVector<Point3f, 16> pRing(valence);
 
-    vert->oneRing(pRing.data());
-    Point3f p = (1 - valence * beta) * vert->p;
+    oneRing(vert, pRing.data());
+    Point3f p = (1 - valence * beta) * vertices[vert].p;
     for (int i = 0; i < valence; ++i)
         p += beta * pRing[i];
     return p;
 }
 
-void SDVertex::oneRing(Point3f *p) {
-    if (!boundary) {
+void SDMesh::oneRing(int vert, Point3f *p) const {
+    int startFace = vertices[vert].startFace;
+    if (!vertices[vert].boundary) {
         // Get one-ring vertices for interior vertex
-        SDFace *face = startFace;
+        int face = startFace;
         do {
-            *p++ = face->nextVert(this)->p;
-            face = face->nextFace(this);
+            *p++ = vertices[faces[face].nextVert(vert)].p;
+            face = faces[face].nextFace(vert);
         } while (face != startFace);
     } else {
         // Get one-ring vertices for boundary vertex
-        SDFace *face = startFace, *f2;
-        while ((f2 = face->nextFace(this)) != nullptr)
+        int face = startFace, f2;
+        while ((f2 = faces[face].nextFace(vert)) != -1)
             face = f2;
-        *p++ = face->nextVert(this)->p;
+        *p++ = vertices[faces[face].nextVert(vert)].p;
         do {
-            *p++ = face->prevVert(this)->p;
-            face = face->prevFace(this);
-        } while (face != nullptr);
+            *p++ = vertices[faces[face].prevVert(vert)].p;
+            face = faces[face].prevFace(vert);
+        } while (face != -1);
     }
 }
 
-static Point3f weightBoundary(SDVertex *vert, Float beta) {
+Point3f SDMesh::weightBoundary(int vert, Float beta) const {
     // Put _vert_ one-ring in _pRing_
-    int valence = vert->valence();
+    int valence = this->valence(vert);
     InlinedVector<Point3f, 16> pRing(valence);
 
-    vert->oneRing(pRing.data());
-    Point3f p = (1 - 2 * beta) * vert->p;
+    oneRing(vert, pRing.data());
+    Point3f p = (1 - 2 * beta) * vertices[vert].p;
     p += beta * pRing[0];
     p += beta * pRing[valence - 1];
     return p;
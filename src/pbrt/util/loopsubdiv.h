@@ -12,9 +12,12 @@
 namespace pbrt {
 
 // LoopSubdiv Declarations
+// If _maxEdgeLength_ is positive, subdivision stops before _nLevels_ once no
+// edge of the mesh is longer than it (in object space).
 TriangleMesh *LoopSubdivide(const Transform *renderFromObject, bool reverseOrientation,
                             int nLevels, pstd::span<const int> vertexIndices,
-                            pstd::span<const Point3f> p, Allocator alloc);
+                            pstd::span<const Point3f> p, Allocator alloc,
+                            Float maxEdgeLength = 0);
 
 }  // namespace pbrt
 
@@ -84,7 +84,8 @@ struct NoRandomizer {
 
 // Low Discrepancy Inline Functions
 PBRT_CPU_GPU inline Float RadicalInverse(int baseIndex, uint64_t a) {
-    unsigned int base = Primes[baseIndex];
+    PrimeDivisor divisor = PrimeDivisors[baseIndex];
+    unsigned int base = divisor.base;
     // We have to stop once reversedDigits is >= limit since otherwise the
     // next digit of |a| may cause reversedDigits to overflow.
     uint64_t limit = ~0ull / base - base;
@@ -92,7 +93,7 @@ PBRT_CPU_GPU inline Float RadicalInverse(int baseIndex, uint64_t a) {
     uint64_t reversedDigits = 0;
     while (a && reversedDigits < limit) {
         // Extract least significant digit from _a_ and update _reversedDigits_
-        uint64_t next = a / base;
+        uint64_t next = divisor.Divide(a);
         uint64_t digit = a - next * base;
         reversedDigits = reversedDigits * base + digit;
         invBaseM *= invBase;
@@ -114,7 +115,8 @@ PBRT_CPU_GPU inline uint64_t InverseRadicalInverse(uint64_t inverse, int base,
 
 PBRT_CPU_GPU inline Float ScrambledRadicalInverse(int baseIndex, uint64_t a,
                                                   const DigitPermutation &perm) {
-    unsigned int base = Primes[baseIndex];
+    PrimeDivisor divisor = PrimeDivisors[baseIndex];
+    unsigned int base = divisor.base;
     // We have to stop once reversedDigits is >= limit since otherwise the
     // next digit of |a| may cause reversedDigits to overflow.
     uint64_t limit = ~0ull / base - base;
@@ -123,7 +125,7 @@ PBRT_CPU_GPU inline Float ScrambledRadicalInverse(int baseIndex, uint64_t a,
     int digitIndex = 0;
     while (1 - (base - 1) * invBaseM < 1 && reversedDigits < limit) {
         // Permute least significant digit from _a_ and update _reversedDigits_
-        uint64_t next = a / base;
+        uint64_t next = divisor.Divide(a);
         int digitValue = a - next * base;
         reversedDigits = reversedDigits * base + perm.Permute(digitIndex, digitValue);
         invBaseM *= invBase;
@@ -135,7 +137,8 @@ PBRT_CPU_GPU inline Float ScrambledRadicalInverse(int baseIndex, uint64_t a,
 
 PBRT_CPU_GPU inline Float OwenScrambledRadicalInverse(int baseIndex, uint64_t a,
                                                       uint32_t hash) {
-    unsigned int base = Primes[baseIndex];
+    PrimeDivisor divisor = PrimeDivisors[baseIndex];
+    unsigned int base = divisor.base;
     // We have to stop once reversedDigits is >= limit since otherwise the
     // next digit of |a| may cause reversedDigits to overflow.
     uint64_t limit = ~0ull / base - base;
@@ -144,7 +147,7 @@ PBRT_CPU_GPU inline Float OwenScrambledRadicalInverse(int baseIndex, uint64_t a,
     int digitIndex = 0;
     while (1 - invBaseM < 1 && reversedDigits < limit) {
         // Compute Owen-scrambled digit for _digitIndex_
-        uint64_t next = a / base;
+        uint64_t next = divisor.Divide(a);
         int digitValue = a - next * base;
         uint32_t digitHash = MixBits(hash ^ reversedDigits);
         digitValue = PermutationElement(digitValue, base, digitHash);
@@ -179,6 +182,23 @@ PBRT_CPU_GPU inline Float SobolSample(int64_t a, int dimension, R randomizer) {
     return std::min(v * 0x1p-32f, FloatOneMinusEpsilon);
 }
 
+// Returns the first two dimensions of the Sobol\+$'$ sample at _a_, computing
+// both with one pass over the bits of _a_.
+template <typename R>
+PBRT_CPU_GPU inline Point2f SobolSample2D(int64_t a, R randomizer0, R randomizer1) {
+    DCHECK(a >= 0 && a < (1ull << SobolMatrixSize));
+    uint32_t v[2] = {0, 0};
+    for (int i = 0; a != 0; a >>= 1, i++)
+        if (a & 1) {
+            v[0] ^= SobolMatrices32[i];
+            v[1] ^= SobolMatrices32[SobolMatrixSize + i];
+        }
+    v[0] = randomizer0(v[0]);
+    v[1] = randomizer1(v[1]);
+    return {std::min(v[0] * 0x1p-32f, FloatOneMinusEpsilon),
+            std::min(v[1] * 0x1p-32f, FloatOneMinusEpsilon)};
+}
+
 PBRT_CPU_GPU inline Float BlueNoiseSample(Point2i p, int instance) {
     auto HashPerm = [&](uint64_t index) -> int {
         return uint32_t(MixBits(index ^ (0x55555555 * instance)) >> 24) % 24;
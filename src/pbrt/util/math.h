@@ -143,6 +143,29 @@ inline void DecodeMorton2(uint64_t v, uint32_t *x, uint32_t *y) {
     *y = Compact1By1(v >> 1);
 }
 
+// Returns the distance of (x, y) along the Hilbert curve that covers the
+// 2^nBits by 2^nBits grid; consecutive points on the curve are always adjacent.
+PBRT_CPU_GPU
+inline uint64_t EncodeHilbert2(uint32_t x, uint32_t y, int nBits) {
+    uint32_t n = 1u << nBits;
+    uint64_t d = 0;
+    for (uint32_t s = n >> 1; s > 0; s >>= 1) {
+        uint32_t rx = (x & s) != 0, ry = (y & s) != 0;
+        d += uint64_t(s) * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant so that its curve connects to its neighbors'
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            uint32_t t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
 PBRT_CPU_GPU
 inline uint32_t Compact1By2(uint32_t x) {
     x &= 0x09249249;                   // x = ---- 9--8 --7- -6-- 5--4 --3- -2-- 1--0
@@ -436,6 +459,27 @@ inline int Log2Int(uint64_t v) {
 #endif
 }
 
+// Returns the index of the lowest set bit of _v_, which must be nonzero.
+PBRT_CPU_GPU
+inline int CountTrailingZeros(uint64_t v) {
+#ifdef PBRT_IS_GPU_CODE
+    return __ffsll(v) - 1;
+#elif defined(PBRT_HAS_INTRIN_H)
+    unsigned long tz = 0;
+#if defined(_WIN64)
+    _BitScanForward64(&tz, v);
+#else
+    if (!_BitScanForward(&tz, v & 0xffffffff)) {
+        _BitScanForward(&tz, v >> 32);
+        tz += 32;
+    }
+#endif  // _WIN64
+    return tz;
+#else   // PBRT_HAS_INTRIN_H
+    return __builtin_ctzll(v);
+#endif
+}
+
 PBRT_CPU_GPU
 inline int Log2Int(int64_t v) {
     return Log2Int((uint64_t)v);
@@ -93,6 +93,25 @@ TEST(Morton2, Basics) {
     }
 }
 
+TEST(Hilbert2, Basics) {
+    for (int nBits = 1; nBits <= 5; ++nBits) {
+        int n = 1 << nBits;
+        // Each point has a unique index and consecutive points are adjacent
+        std::vector<Point2i> points(n * n, Point2i(-1, -1));
+        for (int y = 0; y < n; ++y)
+            for (int x = 0; x < n; ++x) {
+                uint64_t d = EncodeHilbert2(x, y, nBits);
+                ASSERT_LT(d, points.size());
+                EXPECT_EQ(Point2i(-1, -1), points[d]);
+                points[d] = Point2i(x, y);
+            }
+        for (size_t i = 1; i < points.size(); ++i) {
+            Vector2i delta = points[i] - points[i - 1];
+            EXPECT_EQ(1, std::abs(delta.x) + std::abs(delta.y));
+        }
+    }
+}
+
 TEST(Math, Pow) {
     EXPECT_EQ(Pow<0>(2.f), 1 << 0);
     EXPECT_EQ(Pow<1>(2.f), 1 << 1);
@@ -5,9 +5,11 @@
 #include <pbrt/util/memory.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
 #include <pbrt/util/print.h>
 
 #include <cstdlib>
+#include <cstring>
 #ifdef PBRT_HAVE_MALLOC_H
 #include <malloc.h>  // for both memalign and _aligned_malloc
 #endif
@@ -18,7 +20,11 @@
 #pragma comment(lib, "psapi.lib")
 // clang-format on
 #endif  // PBRT_IS_WINDOWS
+#if defined(PBRT_IS_LINUX) || defined(PBRT_IS_OSX)
+#include <sys/resource.h>
+#endif
 #ifdef PBRT_IS_LINUX
+#include <sys/mman.h>
 #include <unistd.h>
 #include <cstdio>
 #endif  // PBRT_IS_LINUX
@@ -75,4 +81,248 @@ size_t GetCurrentRSS() {
 #endif
 }
 
+// Returns the largest resident set size of the process so far in bytes, or
+// zero if it cannot be determined.
+size_t GetPeakRSS() {
+#ifdef PBRT_IS_WINDOWS
+    PROCESS_MEMORY_COUNTERS info;
+    GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info));
+    return (size_t)info.PeakWorkingSetSize;
+#elif defined(PBRT_IS_LINUX) || defined(PBRT_IS_OSX)
+    struct rusage rusage;
+    if (getrusage(RUSAGE_SELF, &rusage) != 0)
+        return 0;
+#ifdef PBRT_IS_OSX
+    // ru_maxrss is in bytes on OSX and in kilobytes elsewhere.
+    return (size_t)rusage.ru_maxrss;
+#else
+    return (size_t)rusage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+// HugePageMemoryResource Method Definitions
+HugePageMemoryResource::HugePageMemoryResource(pstd::pmr::memory_resource *source,
+                                               size_t minBytes)
+    : source(source), minBytes(std::max<size_t>(minBytes, 1)) {
+#ifdef PBRT_IS_LINUX
+    if (FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r")) {
+        char mode[128] = {};
+        size_t n = fread(mode, 1, sizeof(mode) - 1, f);
+        fclose(f);
+        if (n > 0 && strstr(mode, "[never]"))
+            Warning("Transparent huge pages are disabled on this system; only "
+                    "reserved 1GB pages will be used.");
+    }
+#else
+    Warning("Huge pages are only supported on Linux; using regular allocations.");
+#endif
+}
+
+void *HugePageMemoryResource::do_allocate(size_t size, size_t alignment) {
+#ifdef PBRT_IS_LINUX
+    constexpr size_t HugePageSize = size_t(2) << 20;
+    constexpr size_t GiganticPageSize = size_t(1) << 30;
+    auto roundUp = [](size_t v, size_t multiple) {
+        return (v + multiple - 1) / multiple * multiple;
+    };
+    if (size >= minBytes && alignment <= HugePageSize) {
+        void *ptr = nullptr;
+        size_t mappedBytes = 0;
+#ifdef MAP_HUGE_1GB
+        // Use 1GB pages if at most an eighth of the last one would be wasted;
+        // this only succeeds if the administrator has reserved some.
+        size_t giganticBytes = roundUp(size, GiganticPageSize);
+        if (size >= GiganticPageSize && giganticBytes - size <= size / 8) {
+            void *p = mmap(nullptr, giganticBytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB,
+                           -1, 0);
+            if (p != MAP_FAILED) {
+                ptr = p;
+                mappedBytes = giganticBytes;
+            }
+        }
+#endif
+        if (!ptr) {
+            // Transparent huge pages are only used for 2MB-aligned ranges, so
+            // map an extra page's worth and trim the ends to align the start.
+            size_t bytes = roundUp(size, HugePageSize);
+            char *p = (char *)mmap(nullptr, bytes + HugePageSize, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != (char *)MAP_FAILED) {
+                char *aligned = (char *)roundUp(uintptr_t(p), HugePageSize);
+                if (aligned > p)
+                    munmap(p, aligned - p);
+                munmap(aligned + bytes, p + HugePageSize - aligned);
+                if (madvise(aligned, bytes, MADV_HUGEPAGE) == 0) {
+                    ptr = aligned;
+                    mappedBytes = bytes;
+                } else {
+                    LOG_VERBOSE("madvise(MADV_HUGEPAGE) failed: %s", ErrorString());
+                    munmap(aligned, bytes);
+                }
+            }
+        }
+
+        if (ptr) {
+            std::lock_guard<std::mutex> lock(mutex);
+            mappings[ptr] = mappedBytes;
+            hugePageBytes += size;
+            return ptr;
+        }
+    }
+#endif
+    return source->allocate(size, alignment);
+}
+
+void HugePageMemoryResource::do_deallocate(void *p, size_t bytes, size_t alignment) {
+#ifdef PBRT_IS_LINUX
+    if (bytes >= minBytes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (auto iter = mappings.find(p); iter != mappings.end()) {
+            size_t mappedBytes = iter->second;
+            mappings.erase(iter);
+            lock.unlock();
+            munmap(p, mappedBytes);
+            hugePageBytes -= bytes;
+            return;
+        }
+    }
+#endif
+    source->deallocate(p, bytes, alignment);
+}
+
+// MemoryCategory Function Definitions
+static thread_local MemoryCategory currentMemoryCategory = MemoryCategory::Other;
+
+std::string ToString(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Other:
+        return "Other";
+    case MemoryCategory::Geometry:
+        return "Geometry";
+    case MemoryCategory::BVH:
+        return "BVH";
+    case MemoryCategory::Textures:
+        return "Textures";
+    case MemoryCategory::Film:
+        return "Film";
+    case MemoryCategory::Lights:
+        return "Lights";
+    case MemoryCategory::Media:
+        return "Media";
+    case MemoryCategory::Scratch:
+        return "Scratch";
+    default:
+        LOG_FATAL("Unhandled memory category");
+        return {};
+    }
+}
+
+MemoryCategory CurrentMemoryCategory() {
+    return currentMemoryCategory;
+}
+
+// ScopedMemoryCategory Method Definitions
+ScopedMemoryCategory::ScopedMemoryCategory(MemoryCategory category)
+    : prevCategory(currentMemoryCategory) {
+    currentMemoryCategory = category;
+}
+
+ScopedMemoryCategory::~ScopedMemoryCategory() {
+    currentMemoryCategory = prevCategory;
+}
+
+// TrackedMemoryResource Method Definitions
+void *TrackedMemoryResource::do_allocate(size_t size, size_t alignment) {
+    void *ptr = source->allocate(size, alignment);
+    MemoryCategory category = currentMemoryCategory;
+    add(category, size);
+    if (category != MemoryCategory::Other) {
+        std::lock_guard<std::mutex> lock(mutex);
+        categories[ptr] = category;
+        anyCategorized = true;
+    }
+    return ptr;
+}
+
+void TrackedMemoryResource::do_deallocate(void *p, size_t bytes, size_t alignment) {
+    source->deallocate(p, bytes, alignment);
+    // Only look up the allocation's category if there may be one
+    MemoryCategory category = MemoryCategory::Other;
+    if (anyCategorized.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (auto iter = categories.find(p); iter != categories.end()) {
+            category = iter->second;
+            categories.erase(iter);
+        }
+    }
+    add(category, -int64_t(bytes));
+}
+
+void TrackedMemoryResource::add(MemoryCategory category, int64_t bytes) {
+    auto update = [bytes](std::atomic<uint64_t> &current, std::atomic<uint64_t> &max) {
+        uint64_t currentBytes = current.fetch_add(bytes) + bytes;
+        uint64_t prevMax = max.load(std::memory_order_relaxed);
+        while (bytes > 0 && prevMax < currentBytes &&
+               !max.compare_exchange_weak(prevMax, currentBytes))
+            ;
+    };
+    update(allocatedBytes, maxAllocatedBytes);
+    update(categoryBytes[int(category)], maxCategoryBytes[int(category)]);
+}
+
+// Process-Wide Memory Tracking Definitions
+static std::atomic<TrackedMemoryResource *> trackedMemory;
+static std::atomic<size_t> memoryBudget;
+
+TrackedMemoryResource *EnableMemoryTracking() {
+    static std::once_flag flag;
+    std::call_once(flag, []() {
+        TrackedMemoryResource *memory =
+            new TrackedMemoryResource(pstd::pmr::get_default_resource());
+        pstd::pmr::set_default_resource(memory);
+        trackedMemory = memory;
+    });
+    return trackedMemory;
+}
+
+TrackedMemoryResource *GetTrackedMemory() {
+    return trackedMemory;
+}
+
+void SetMemoryBudget(size_t bytes) {
+    memoryBudget = bytes;
+}
+
+size_t MemoryBudgetOverage() {
+    TrackedMemoryResource *memory = trackedMemory;
+    size_t budget = memoryBudget;
+    if (!memory || budget == 0)
+        return 0;
+    size_t current = memory->CurrentAllocatedBytes();
+    return current > budget ? current - budget : 0;
+}
+
+static StatRegisterer memoryCategoryRegisterer([](StatsAccumulator &accum) {
+    // This is called for every thread but the amounts are process-wide, so
+    // they are only reported once
+    static std::atomic<bool> reported{false};
+    TrackedMemoryResource *memory = trackedMemory;
+    if (!memory || reported.exchange(true))
+        return;
+    for (int i = 0; i < NumMemoryCategories; ++i) {
+        MemoryCategory category = MemoryCategory(i);
+        if (memory->MaxAllocatedBytes(category) == 0)
+            continue;
+        std::string current = "Memory/Tracked allocations: " + ToString(category);
+        std::string peak = "Memory/Peak tracked allocations: " + ToString(category);
+        accum.ReportMemoryCounter(current.c_str(),
+                                  memory->CurrentAllocatedBytes(category));
+        accum.ReportMemoryCounter(peak.c_str(), memory->MaxAllocatedBytes(category));
+    }
+});
+
 }  // namespace pbrt
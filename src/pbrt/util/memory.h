@@ -13,35 +13,103 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstring>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 
 namespace pbrt {
 
 size_t GetCurrentRSS();
+size_t GetPeakRSS();
 
+// MemoryCategory Definition
+// The subsystems that a _TrackedMemoryResource_ attributes allocations to.
+enum class MemoryCategory {
+    Other,
+    Geometry,
+    BVH,
+    Textures,
+    Film,
+    Lights,
+    Media,
+    Scratch
+};
+
+constexpr int NumMemoryCategories = int(MemoryCategory::Scratch) + 1;
+
+std::string ToString(MemoryCategory category);
+
+// Returns the category of the allocations that the current thread makes.
+MemoryCategory CurrentMemoryCategory();
+
+// ScopedMemoryCategory Definition
+// Sets the category of the allocations that the current thread makes while
+// it is in scope. Parallel jobs take the category of the thread that starts
+// them, so that the work they do for it is included.
+class ScopedMemoryCategory {
+  public:
+    ScopedMemoryCategory(MemoryCategory category);
+    ~ScopedMemoryCategory();
+
+    ScopedMemoryCategory(const ScopedMemoryCategory &) = delete;
+    ScopedMemoryCategory &operator=(const ScopedMemoryCategory &) = delete;
+
+  private:
+    MemoryCategory prevCategory;
+};
+
+// HugePageMemoryResource Definition
+// Backs allocations of at least _minBytes_ with huge pages to reduce TLB misses
+// when large read-mostly structures such as BVH nodes, meshes, and film
+// pixels are accessed; smaller ones are passed along to _source_. 1GB pages
+// are used for allocations large enough not to waste much of one when the
+// system has them reserved, and 2MB transparent huge pages otherwise.
+class HugePageMemoryResource : public pstd::pmr::memory_resource {
+  public:
+    // HugePageMemoryResource Public Methods
+    HugePageMemoryResource(
+        pstd::pmr::memory_resource *source = pstd::pmr::get_default_resource(),
+        size_t minBytes = size_t(2) << 20);
+
+    void *do_allocate(size_t size, size_t alignment);
+    void do_deallocate(void *p, size_t bytes, size_t alignment);
+
+    bool do_is_equal(const memory_resource &other) const noexcept {
+        return this == &other;
+    }
+
+    // Returns the number of currently-allocated bytes that are in huge
+    // pages, not including padding up to a whole number of pages.
+    size_t HugePageBytes() const { return hugePageBytes.load(); }
+
+  private:
+    // HugePageMemoryResource Private Members
+    pstd::pmr::memory_resource *source;
+    size_t minBytes;
+    std::mutex mutex;
+    // Size of each huge page mapping, indexed by its starting address
+    std::map<void *, size_t> mappings;
+    std::atomic<uint64_t> hugePageBytes{0};
+};
+
+// Allocations are also tracked for each _MemoryCategory_. Memory that
+// doesn't come from a memory resource, like the texture cache's tiles, can
+// be included via AddExternalBytes().
 class TrackedMemoryResource : public pstd::pmr::memory_resource {
   public:
     TrackedMemoryResource(
         pstd::pmr::memory_resource *source = pstd::pmr::get_default_resource())
-        : source(source) {}
+        : source(source),
+          hugePageSource(dynamic_cast<HugePageMemoryResource *>(source)) {}
 
-    void *do_allocate(size_t size, size_t alignment) {
-        void *ptr = source->allocate(size, alignment);
-        uint64_t currentBytes = allocatedBytes.fetch_add(size) + size;
-        uint64_t prevMax = maxAllocatedBytes.load(std::memory_order_relaxed);
-        while (prevMax < currentBytes &&
-               !maxAllocatedBytes.compare_exchange_weak(prevMax, currentBytes))
-            ;
-        return ptr;
-    }
-    void do_deallocate(void *p, size_t bytes, size_t alignment) {
-        source->deallocate(p, bytes, alignment);
-        allocatedBytes -= bytes;
-    }
+    void *do_allocate(size_t size, size_t alignment);
+    void do_deallocate(void *p, size_t bytes, size_t alignment);
 
     bool do_is_equal(const memory_resource &other) const noexcept {
         return this == &other;
@@ -49,12 +117,51 @@ class TrackedMemoryResource : public pstd::pmr::memory_resource {
 
     size_t CurrentAllocatedBytes() const { return allocatedBytes.load(); }
     size_t MaxAllocatedBytes() const { return maxAllocatedBytes.load(); }
+    size_t CurrentAllocatedBytes(MemoryCategory category) const {
+        return categoryBytes[int(category)].load();
+    }
+    size_t MaxAllocatedBytes(MemoryCategory category) const {
+        return maxCategoryBytes[int(category)].load();
+    }
+
+    // Records _bytes_ (which may be negative) of memory for _category_ that
+    // was allocated or freed without going through this resource.
+    void AddExternalBytes(MemoryCategory category, int64_t bytes) {
+        add(category, bytes);
+    }
+    // Returns the number of bytes allocated from _source_ that are backed by
+    // huge pages; it is zero unless _source_ is a _HugePageMemoryResource_.
+    size_t HugePageBytes() const {
+        return hugePageSource ? hugePageSource->HugePageBytes() : 0;
+    }
 
   private:
+    void add(MemoryCategory category, int64_t bytes);
+
     pstd::pmr::memory_resource *source;
+    HugePageMemoryResource *hugePageSource;
     std::atomic<uint64_t> allocatedBytes{0}, maxAllocatedBytes{0};
+    std::atomic<uint64_t> categoryBytes[NumMemoryCategories] = {};
+    std::atomic<uint64_t> maxCategoryBytes[NumMemoryCategories] = {};
+    // The category of each allocation that isn't in _MemoryCategory::Other_
+    std::mutex mutex;
+    std::unordered_map<void *, MemoryCategory> categories;
+    std::atomic<bool> anyCategorized{false};
 };
 
+// Process-Wide Memory Tracking
+// EnableMemoryTracking() installs a _TrackedMemoryResource_ as the default
+// memory resource the first time it is called and returns it.
+// GetTrackedMemory() returns it, or nullptr if tracking isn't enabled.
+TrackedMemoryResource *EnableMemoryTracking();
+TrackedMemoryResource *GetTrackedMemory();
+
+// With a budget, caches evict their contents when the tracked allocations
+// exceed it. MemoryBudgetOverage() returns by how many bytes they do, or
+// zero if they don't or if there is no budget.
+void SetMemoryBudget(size_t bytes);
+size_t MemoryBudgetOverage();
+
 template <typename T>
 struct AllocationTraits {
     using SingleObject = T *;
@@ -72,8 +179,15 @@ struct AllocationTraits<T[n]> {
 class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
   public:
     // ScratchBuffer Public Methods
-    ScratchBuffer(int size = 256) : allocSize(size) {
+    // If _prefault_ is true, the buffer's pages are touched when it is
+    // allocated so that page faults don't happen while it is in use and so
+    // that its memory is local to the thread that creates it.
+    ScratchBuffer(int size = 256, bool prefault = false)
+        : allocSize(size), prefault(prefault) {
+        ScopedMemoryCategory category(MemoryCategory::Scratch);
         ptr = (char *)Allocator().allocate_bytes(size, align);
+        if (prefault)
+            std::memset(ptr, 0, size);
     }
 
     ScratchBuffer(const ScratchBuffer &) = delete;
@@ -83,9 +197,15 @@ class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
         allocSize = b.allocSize;
         offset = b.offset;
         smallBuffers = std::move(b.smallBuffers);
+        smallBuffersBytes = b.smallBuffersBytes;
+        highWaterMark = b.highWaterMark;
+        nOverflows = b.nOverflows;
+        prefault = b.prefault;
 
         b.ptr = nullptr;
         b.allocSize = b.offset = 0;
+        b.smallBuffersBytes = b.highWaterMark = 0;
+        b.nOverflows = 0;
     }
 
     ~ScratchBuffer() {
@@ -100,6 +220,10 @@ class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
         std::swap(b.allocSize, allocSize);
         std::swap(b.offset, offset);
         std::swap(b.smallBuffers, smallBuffers);
+        std::swap(b.smallBuffersBytes, smallBuffersBytes);
+        std::swap(b.highWaterMark, highWaterMark);
+        std::swap(b.nOverflows, nOverflows);
+        std::swap(b.prefault, prefault);
         return *this;
     }
 
@@ -130,26 +254,58 @@ class alignas(PBRT_L1_CACHE_LINE_SIZE) ScratchBuffer {
     }
 
     void Reset() {
-        for (const auto &buf : smallBuffers)
-            Allocator().deallocate_bytes(buf.first, buf.second, align);
-        smallBuffers.clear();
+        highWaterMark = std::max<size_t>(highWaterMark, smallBuffersBytes + offset);
+        if (!smallBuffers.empty()) {
+            for (const auto &buf : smallBuffers)
+                Allocator().deallocate_bytes(buf.first, buf.second, align);
+            smallBuffers.clear();
+            smallBuffersBytes = 0;
+            // Grow the buffer so that everything allocated since the last
+            // call to Reset() would have fit in it.
+            if (highWaterMark > size_t(allocSize))
+                Resize(RoundUpPow2(int64_t(highWaterMark)));
+        }
         offset = 0;
     }
 
+    // Returns the most memory that has been allocated between calls to
+    // Reset() and how many times the buffer has had to grow to provide it.
+    size_t HighWaterMark() const {
+        return std::max<size_t>(highWaterMark, smallBuffersBytes + offset);
+    }
+    int64_t Overflows() const { return nOverflows; }
+
   private:
     // ScratchBuffer Private Methods
     void Realloc(size_t minSize) {
+        ++nOverflows;
         smallBuffers.push_back(std::make_pair(ptr, allocSize));
+        smallBuffersBytes += offset;
         allocSize = std::max(2 * minSize, allocSize + minSize);
+        ScopedMemoryCategory category(MemoryCategory::Scratch);
         ptr = (char *)Allocator().allocate_bytes(allocSize, align);
+        if (prefault)
+            std::memset(ptr, 0, allocSize);
         offset = 0;
     }
 
+    void Resize(size_t size) {
+        Allocator().deallocate_bytes(ptr, allocSize, align);
+        allocSize = size;
+        ScopedMemoryCategory category(MemoryCategory::Scratch);
+        ptr = (char *)Allocator().allocate_bytes(allocSize, align);
+        if (prefault)
+            std::memset(ptr, 0, allocSize);
+    }
+
     // ScratchBuffer Private Members
     static constexpr int align = PBRT_L1_CACHE_LINE_SIZE;
     char *ptr = nullptr;
     int allocSize = 0, offset = 0;
     std::list<std::pair<char *, size_t>> smallBuffers;
+    size_t smallBuffersBytes = 0, highWaterMark = 0;
+    int64_t nOverflows = 0;
+    bool prefault = false;
 };
 
 }  // namespace pbrt
@@ -7,16 +7,29 @@
 #include <pbrt/util/buffercache.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/log.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
+#include <pbrt/util/string.h>
 #include <pbrt/util/transform.h>
 
 #include <rply/rply.h>
 
+#include <cstring>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
 namespace pbrt {
 
 STAT_RATIO("Geometry/Triangles per mesh", nTris, nTriMeshes);
+STAT_COUNTER("Geometry/Compact triangle meshes", nCompactTriMeshes);
 STAT_MEMORY_COUNTER("Memory/Triangles", triangleBytes);
 
 // TriangleMesh Method Definitions
@@ -24,19 +37,60 @@ TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrient
                            std::vector<int> indices, std::vector<Point3f> p,
                            std::vector<Vector3f> s, std::vector<Normal3f> n,
                            std::vector<Point2f> uv, std::vector<int> faceIndices,
-                           Allocator alloc)
+                           Allocator alloc, TriangleMeshStorage storage)
     : nTriangles(indices.size() / 3), nVertices(p.size()) {
     CHECK_EQ((indices.size() % 3), 0);
+    // Make sure that we don't have too much stuff to be using integers to
+    // index into things.
+    CHECK_LE(p.size(), std::numeric_limits<int>::max());
+    // We could be clever and check indices.size() / 3 if we were careful
+    // to promote to a 64-bit int before multiplying by 3 when we look up
+    // in the indices array...
+    CHECK_LE(indices.size(), std::numeric_limits<int>::max());
     ++nTriMeshes;
     nTris += nTriangles;
     triangleBytes += sizeof(*this);
+    bool compact = storage != TriangleMeshStorage::Full;
+    if (compact)
+        ++nCompactTriMeshes;
+    // Each of the input vectors is freed once its data has been added to
+    // a buffer cache, which limits how much memory large meshes need while
+    // they are created.
     // Initialize mesh _vertexIndices_
-    vertexIndices = intBufferCache->LookupOrAdd(indices, alloc);
+    if (compact && nVertices <= 65536) {
+        uint16_t *indices16 = uint16BufferCache->Allocate(indices.size(), alloc);
+        std::copy(indices.begin(), indices.end(), indices16);
+        vertexIndices16 =
+            uint16BufferCache->LookupOrAdopt(indices16, indices.size(), alloc);
+    } else
+        vertexIndices = intBufferCache->LookupOrAdd(indices, alloc);
+    indices = std::vector<int>();
 
     // Transform mesh vertices to rendering space and initialize mesh _p_
-    for (Point3f &pt : p)
-        pt = renderFromObject(pt);
-    this->p = point3BufferCache->LookupOrAdd(p, alloc);
+    if (storage == TriangleMeshStorage::Quantized) {
+        // Quantize vertex positions to 16 bits within the mesh bounds
+        for (Point3f &pt : p)
+            pt = renderFromObject(pt);
+        Bounds3f bounds;
+        for (const Point3f &pt : p)
+            bounds = Union(bounds, pt);
+        pOrigin = bounds.pMin;
+        pScale = bounds.Diagonal() / 65535;
+        std::vector<uint16_t> q(3 * p.size());
+        for (size_t i = 0; i < p.size(); ++i)
+            for (int c = 0; c < 3; ++c) {
+                Float offset = pScale[c] > 0 ? (p[i][c] - pOrigin[c]) / pScale[c] : 0;
+                q[3 * i + c] = uint16_t(Clamp(std::round(offset), 0, 65535));
+            }
+        pQuantized = uint16BufferCache->LookupOrAdd(q, alloc);
+    } else {
+        // Transform the vertices directly into the buffer that is cached
+        Point3f *pRender = point3BufferCache->Allocate(p.size(), alloc);
+        for (size_t i = 0; i < p.size(); ++i)
+            pRender[i] = renderFromObject(p[i]);
+        this->p = point3BufferCache->LookupOrAdopt(pRender, p.size(), alloc);
+    }
+    p = std::vector<Point3f>();
 
     // Remainder of _TriangleMesh_ constructor
     this->reverseOrientation = reverseOrientation;
@@ -44,45 +98,65 @@ TriangleMesh::TriangleMesh(const Transform &renderFromObject, bool reverseOrient
 
     if (!uv.empty()) {
         CHECK_EQ(nVertices, uv.size());
-        this->uv = point2BufferCache->LookupOrAdd(uv, alloc);
+        if (compact) {
+            std::vector<uint16_t> uv16(2 * uv.size());
+            for (size_t i = 0; i < uv.size(); ++i) {
+                uv16[2 * i] = Half(float(uv[i].x)).Bits();
+                uv16[2 * i + 1] = Half(float(uv[i].y)).Bits();
+            }
+            uvHalf = uint16BufferCache->LookupOrAdd(uv16, alloc);
+        } else
+            this->uv = point2BufferCache->LookupOrAdd(uv, alloc);
+        uv = std::vector<Point2f>();
     }
     if (!n.empty()) {
         CHECK_EQ(nVertices, n.size());
-        for (Normal3f &nn : n) {
+        auto renderNormal = [&](Normal3f nn) {
             nn = renderFromObject(nn);
-            if (reverseOrientation)
-                nn = -nn;
+            return reverseOrientation ? -nn : nn;
+        };
+        if (compact) {
+            // Octahedral encoding normalizes; zero-length normals map to $+z$
+            OctahedralVector *oct = octahedralBufferCache->Allocate(n.size(), alloc);
+            for (size_t i = 0; i < n.size(); ++i) {
+                Normal3f nn = renderNormal(n[i]);
+                oct[i] = OctahedralVector(LengthSquared(nn) > 0 ? Vector3f(nn)
+                                                                : Vector3f(0, 0, 1));
+            }
+            nOctahedral = octahedralBufferCache->LookupOrAdopt(oct, n.size(), alloc);
+        } else {
+            Normal3f *nRender = normal3BufferCache->Allocate(n.size(), alloc);
+            for (size_t i = 0; i < n.size(); ++i)
+                nRender[i] = renderNormal(n[i]);
+            this->n = normal3BufferCache->LookupOrAdopt(nRender, n.size(), alloc);
         }
-        this->n = normal3BufferCache->LookupOrAdd(n, alloc);
+        n = std::vector<Normal3f>();
     }
     if (!s.empty()) {
         CHECK_EQ(nVertices, s.size());
-        for (Vector3f &ss : s)
-            ss = renderFromObject(ss);
-        this->s = vector3BufferCache->LookupOrAdd(s, alloc);
+        Vector3f *sRender = vector3BufferCache->Allocate(s.size(), alloc);
+        for (size_t i = 0; i < s.size(); ++i)
+            sRender[i] = renderFromObject(s[i]);
+        this->s = vector3BufferCache->LookupOrAdopt(sRender, s.size(), alloc);
+        s = std::vector<Vector3f>();
     }
 
     if (!faceIndices.empty()) {
         CHECK_EQ(nTriangles, faceIndices.size());
         this->faceIndices = intBufferCache->LookupOrAdd(faceIndices, alloc);
     }
-
-    // Make sure that we don't have too much stuff to be using integers to
-    // index into things.
-    CHECK_LE(p.size(), std::numeric_limits<int>::max());
-    // We could be clever and check indices.size() / 3 if we were careful
-    // to promote to a 64-bit int before multiplying by 3 when we look up
-    // in the indices array...
-    CHECK_LE(indices.size(), std::numeric_limits<int>::max());
 }
 
 std::string TriangleMesh::ToString() const {
     std::string np = "(nullptr)";
     return StringPrintf(
         "[ TriangleMesh reverseOrientation: %s transformSwapsHandedness: %s "
+        "compactIndices: %s quantizedP: %s octahedralN: %s halfUV: %s "
         "nTriangles: %d nVertices: %d vertexIndices: %s p: %s n: %s "
         "s: %s uv: %s faceIndices: %s ]",
-        reverseOrientation, transformSwapsHandedness, nTriangles, nVertices,
+        reverseOrientation, transformSwapsHandedness, vertexIndices16 != nullptr,
+        pQuantized != nullptr, nOctahedral != nullptr, uvHalf != nullptr, nTriangles,
+        nVertices,
         vertexIndices ? StringPrintf("%s", pstd::MakeSpan(vertexIndices, 3 * nTriangles))
                       : np,
         p ? StringPrintf("%s", pstd::MakeSpan(p, nVertices)) : np,
@@ -100,12 +174,26 @@ bool TriangleMesh::WritePLY(std::string filename) const {
     if (s)
         Warning(R"(%s: PLY mesh will be missing tangent vectors "S".)", filename);
 
-    return pbrt::WritePLY(
-        filename, pstd::span<const int>(vertexIndices, 3 * nTriangles),
-        pstd::span<const int>(), pstd::span<const Point3f>(p, nVertices),
-        pstd::span<const Normal3f>(n, n ? nVertices : 0),
-        pstd::span<const Point2f>(uv, uv ? nVertices : 0),
-        pstd::span<const int>(faceIndices, faceIndices ? nTriangles : 0));
+    // Decode vertex and index buffers that may be stored compactly
+    std::vector<int> indices(3 * nTriangles);
+    for (int i = 0; i < nTriangles; ++i) {
+        pstd::array<int, 3> v = TriangleVertexIndices(i);
+        for (int j = 0; j < 3; ++j)
+            indices[3 * i + j] = v[j];
+    }
+    std::vector<Point3f> P(nVertices);
+    std::vector<Normal3f> N(HasNormals() ? nVertices : 0);
+    std::vector<Point2f> UVs(HasUVs() ? nVertices : 0);
+    for (int i = 0; i < nVertices; ++i) {
+        P[i] = this->P(i);
+        if (HasNormals())
+            N[i] = this->N(i);
+        if (HasUVs())
+            UVs[i] = UV(i);
+    }
+
+    pstd::span<const int> faces(faceIndices, faceIndices ? nTriangles : 0);
+    return pbrt::WritePLY(filename, indices, pstd::span<const int>(), P, N, UVs, faces);
 }
 
 bool WritePLY(std::string filename, pstd::span<const int> triIndices,
@@ -204,9 +292,10 @@ BilinearPatchMesh::BilinearPatchMesh(const Transform &renderFromObject,
     blpBytes += sizeof(*this);
 
     // Transform mesh vertices to rendering space
-    for (Point3f &p : P)
-        p = renderFromObject(p);
-    p = point3BufferCache->LookupOrAdd(P, alloc);
+    Point3f *pRender = point3BufferCache->Allocate(P.size(), alloc);
+    for (size_t i = 0; i < P.size(); ++i)
+        pRender[i] = renderFromObject(P[i]);
+    p = point3BufferCache->LookupOrAdopt(pRender, P.size(), alloc);
 
     // Copy _UV_ and _N_ vertex data, if present
     if (!UV.empty()) {
@@ -215,12 +304,13 @@ BilinearPatchMesh::BilinearPatchMesh(const Transform &renderFromObject,
     }
     if (!N.empty()) {
         CHECK_EQ(nVertices, N.size());
-        for (Normal3f &n : N) {
-            n = renderFromObject(n);
+        Normal3f *nRender = normal3BufferCache->Allocate(N.size(), alloc);
+        for (size_t i = 0; i < N.size(); ++i) {
+            nRender[i] = renderFromObject(N[i]);
             if (reverseOrientation)
-                n = -n;
+                nRender[i] = -nRender[i];
         }
-        n = normal3BufferCache->LookupOrAdd(N, alloc);
+        n = normal3BufferCache->LookupOrAdopt(nRender, N.size(), alloc);
     }
 
     if (!fIndices.empty()) {
@@ -319,8 +409,357 @@ int rply_faceindex_callback(p_ply_argument argument) {
     return 1;
 }
 
+// Binary PLY Reading Definitions
+STAT_COUNTER("Geometry/PLY files read directly from memory", nBinaryPLYFiles);
+
+// PLYType Definition
+enum class PLYType {
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Float32,
+    Float64,
+    Unknown
+};
+
+static PLYType ParsePLYType(const std::string &s) {
+    if (s == "char" || s == "int8")
+        return PLYType::Int8;
+    if (s == "uchar" || s == "uint8")
+        return PLYType::UInt8;
+    if (s == "short" || s == "int16")
+        return PLYType::Int16;
+    if (s == "ushort" || s == "uint16")
+        return PLYType::UInt16;
+    if (s == "int" || s == "int32")
+        return PLYType::Int32;
+    if (s == "uint" || s == "uint32")
+        return PLYType::UInt32;
+    if (s == "float" || s == "float32")
+        return PLYType::Float32;
+    if (s == "double" || s == "float64")
+        return PLYType::Float64;
+    return PLYType::Unknown;
+}
+
+static int PLYTypeSize(PLYType type) {
+    switch (type) {
+    case PLYType::Int8:
+    case PLYType::UInt8:
+        return 1;
+    case PLYType::Int16:
+    case PLYType::UInt16:
+        return 2;
+    case PLYType::Int32:
+    case PLYType::UInt32:
+    case PLYType::Float32:
+        return 4;
+    case PLYType::Float64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+template <typename T>
+static T ReadUnaligned(const char *ptr) {
+    T value;
+    std::memcpy(&value, ptr, sizeof(T));
+    return value;
+}
+
+static double ReadPLYValue(const char *ptr, PLYType type) {
+    switch (type) {
+    case PLYType::Int8:
+        return ReadUnaligned<int8_t>(ptr);
+    case PLYType::UInt8:
+        return ReadUnaligned<uint8_t>(ptr);
+    case PLYType::Int16:
+        return ReadUnaligned<int16_t>(ptr);
+    case PLYType::UInt16:
+        return ReadUnaligned<uint16_t>(ptr);
+    case PLYType::Int32:
+        return ReadUnaligned<int32_t>(ptr);
+    case PLYType::UInt32:
+        return ReadUnaligned<uint32_t>(ptr);
+    case PLYType::Float32:
+        return ReadUnaligned<float>(ptr);
+    default:
+        return ReadUnaligned<double>(ptr);
+    }
+}
+
+// PLYElement Definition
+struct PLYElement {
+    // PLYElement::Property Definition
+    struct Property {
+        std::string name;
+        PLYType type;
+        // Only used for list properties
+        PLYType countType = PLYType::Unknown;
+        int offset = 0;
+    };
+
+    const Property *Find(const char *propName) const {
+        for (const Property &prop : properties)
+            if (prop.name == propName)
+                return &prop;
+        return nullptr;
+    }
+
+    std::string name;
+    size_t count = 0;
+    std::vector<Property> properties;
+    // Size of each instance if there are no list properties, otherwise 0
+    size_t stride = 0;
+};
+
+// Reads binary little-endian PLY file _contents_ into _mesh_, returning false if
+// the file uses a format or layout that should be handled by rply instead.
+static bool ParseBinaryPLY(const std::string &filename, const char *contents, size_t len,
+                           TriQuadMesh *mesh) {
+    uint16_t one = 1;
+    if (*(const uint8_t *)&one != 1)
+        return false;
+
+    // Parse PLY header
+    const char *headerEnd = nullptr;
+    for (size_t i = 0; i + 10 <= len && i < 64 * 1024; ++i)
+        if (std::memcmp(contents + i, "end_header", 10) == 0) {
+            headerEnd = contents + i;
+            break;
+        }
+    if (!headerEnd)
+        return false;
+    const char *data =
+        (const char *)std::memchr(headerEnd, '\n', contents + len - headerEnd);
+    if (!data)
+        return false;
+    ++data;
+    std::vector<std::string> lines =
+        SplitString(std::string_view(contents, headerEnd - contents), '\n');
+    if (lines.empty() || lines[0].compare(0, 3, "ply") != 0)
+        return false;
+
+    std::vector<PLYElement> elements;
+    bool binaryLittleEndian = false;
+    for (const std::string &line : lines) {
+        std::vector<std::string> tokens = SplitStringsFromWhitespace(line);
+        if (tokens.empty() || tokens[0] == "ply" || tokens[0] == "comment" ||
+            tokens[0] == "obj_info")
+            continue;
+        if (tokens[0] == "format") {
+            binaryLittleEndian =
+                tokens.size() >= 2 && tokens[1] == "binary_little_endian";
+        } else if (tokens[0] == "element" && tokens.size() == 3) {
+            elements.push_back(PLYElement());
+            elements.back().name = tokens[1];
+            elements.back().count = std::strtoull(tokens[2].c_str(), nullptr, 10);
+        } else if (tokens[0] == "property" && !elements.empty()) {
+            PLYElement::Property prop;
+            if (tokens.size() == 5 && tokens[1] == "list") {
+                prop.countType = ParsePLYType(tokens[2]);
+                prop.type = ParsePLYType(tokens[3]);
+                prop.name = tokens[4];
+                if (prop.countType == PLYType::Unknown)
+                    return false;
+            } else if (tokens.size() == 3) {
+                prop.type = ParsePLYType(tokens[1]);
+                prop.name = tokens[2];
+            } else
+                return false;
+            if (prop.type == PLYType::Unknown)
+                return false;
+            elements.back().properties.push_back(prop);
+        } else
+            return false;
+    }
+    if (!binaryLittleEndian)
+        return false;
+
+    // Compute property offsets and strides of elements without list properties
+    for (PLYElement &element : elements) {
+        size_t offset = 0;
+        for (PLYElement::Property &prop : element.properties) {
+            if (prop.countType != PLYType::Unknown) {
+                offset = 0;
+                break;
+            }
+            prop.offset = offset;
+            offset += PLYTypeSize(prop.type);
+        }
+        element.stride = offset;
+        // Elements other than faces must have fixed sizes to be skipped over
+        if (element.stride == 0 && element.name != "face")
+            return false;
+    }
+
+    const char *end = contents + len;
+    auto truncated = [&]() {
+        ErrorExit("%s: unable to read the contents of PLY file", filename);
+    };
+    size_t vertexCount = 0, faceCount = 0;
+    for (const PLYElement &element : elements) {
+        if (element.name == "vertex") {
+            // Find vertex attribute properties
+            vertexCount = element.count;
+            const PLYElement::Property *p[3] = {element.Find("x"), element.Find("y"),
+                                                element.Find("z")};
+            if (!p[0] || !p[1] || !p[2])
+                ErrorExit("%s: Vertex coordinate property not found!", filename);
+            const PLYElement::Property *n[3] = {element.Find("nx"), element.Find("ny"),
+                                                element.Find("nz")};
+            bool hasNormals = n[0] && n[1] && n[2];
+            const PLYElement::Property *uv[2] = {nullptr, nullptr};
+            for (const char *names : {"u\0v", "s\0t", "texture_u\0texture_v",
+                                      "texture_s\0texture_t"}) {
+                uv[0] = element.Find(names);
+                uv[1] = element.Find(names + std::strlen(names) + 1);
+                if (uv[0] && uv[1])
+                    break;
+            }
+            bool hasUVs = uv[0] && uv[1];
+
+            // Decode vertices in parallel
+            if (element.count * element.stride > size_t(end - data))
+                truncated();
+            mesh->p.resize(vertexCount);
+            mesh->n.resize(hasNormals ? vertexCount : 0);
+            mesh->uv.resize(hasUVs ? vertexCount : 0);
+            ParallelFor(0, vertexCount, [&](int64_t start, int64_t stop) {
+                for (int64_t i = start; i < stop; ++i) {
+                    const char *v = data + i * element.stride;
+                    auto read = [&](const PLYElement::Property *prop) {
+                        return float(ReadPLYValue(v + prop->offset, prop->type));
+                    };
+                    mesh->p[i] = Point3f(read(p[0]), read(p[1]), read(p[2]));
+                    if (hasNormals)
+                        mesh->n[i] = Normal3f(read(n[0]), read(n[1]), read(n[2]));
+                    if (hasUVs)
+                        mesh->uv[i] = Point2f(read(uv[0]), read(uv[1]));
+                }
+            });
+            data += element.count * element.stride;
+        } else if (element.name == "face") {
+            faceCount = element.count;
+            const PLYElement::Property *indicesProp = element.Find("vertex_indices");
+            if (!indicesProp || indicesProp->countType == PLYType::Unknown)
+                ErrorExit("%s: vertex indices not found in PLY file", filename);
+            const PLYElement::Property *faceIndexProp = element.Find("face_indices");
+            if (faceIndexProp && faceIndexProp->countType != PLYType::Unknown)
+                return false;
+
+            // Read faces, which may have varying sizes
+            mesh->triIndices.reserve(3 * faceCount);
+            if (faceIndexProp)
+                mesh->faceIndices.reserve(faceCount);
+            for (size_t f = 0; f < faceCount; ++f)
+                for (const PLYElement::Property &prop : element.properties) {
+                    int size = PLYTypeSize(prop.type);
+                    if (prop.countType == PLYType::Unknown) {
+                        // Read or skip scalar face property
+                        if (size > end - data)
+                            truncated();
+                        if (&prop == faceIndexProp)
+                            mesh->faceIndices.push_back(
+                                int(ReadPLYValue(data, prop.type)));
+                        data += size;
+                        continue;
+                    }
+
+                    // Read or skip list face property
+                    if (PLYTypeSize(prop.countType) > end - data)
+                        truncated();
+                    int length = int(ReadPLYValue(data, prop.countType));
+                    data += PLYTypeSize(prop.countType);
+                    if (length < 0 || int64_t(length) * size > end - data)
+                        truncated();
+                    if (&prop == indicesProp) {
+                        int face[4];
+                        if (length == 3 || length == 4)
+                            for (int i = 0; i < length; ++i)
+                                face[i] = int(ReadPLYValue(data + i * size, prop.type));
+                        if (length == 3)
+                            mesh->triIndices.insert(mesh->triIndices.end(), face,
+                                                    face + 3);
+                        else if (length == 4)
+                            // Note: modify order since we're specifying it as a blp...
+                            for (int i : {0, 1, 3, 2})
+                                mesh->quadIndices.push_back(face[i]);
+                        else
+                            Warning("plymesh: Ignoring face with %i vertices (only "
+                                    "triangles and quads are supported!)",
+                                    length);
+                    }
+                    data += length * size;
+                }
+        } else {
+            // Skip over unused element
+            if (element.count * element.stride > size_t(end - data))
+                truncated();
+            data += element.count * element.stride;
+        }
+    }
+
+    if (vertexCount == 0 || faceCount == 0)
+        ErrorExit("%s: PLY file is invalid! No face/vertex elements found!", filename);
+    ++nBinaryPLYFiles;
+    return true;
+}
+
+// Reads _filename_ into _mesh_ with _ParseBinaryPLY()_ if possible.
+static bool ReadBinaryPLY(const std::string &filename, TriQuadMesh *mesh) {
+#ifdef PBRT_HAVE_MMAP
+    if (HasExtension(filename, ".gz"))
+        return false;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat stat;
+    if (fstat(fd, &stat) != 0 || stat.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    size_t len = stat.st_size;
+    void *ptr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+
+    bool success = ParseBinaryPLY(filename, (const char *)ptr, len, mesh);
+    munmap(ptr, len);
+    if (!success)
+        *mesh = TriQuadMesh();
+    return success;
+#else
+    return false;
+#endif
+}
+
+// Reports an error if any of the vertex indices in _mesh_ are invalid.
+static void CheckVertexIndices(const TriQuadMesh &mesh) {
+    for (int idx : mesh.triIndices)
+        if (idx < 0 || idx >= mesh.p.size())
+            ErrorExit("plymesh: Vertex index %i is out of bounds! "
+                      "Valid range is [0..%i)",
+                      idx, int(mesh.p.size()));
+    for (int idx : mesh.quadIndices)
+        if (idx < 0 || idx >= mesh.p.size())
+            ErrorExit("plymesh: Vertex index %i is out of bounds! "
+                      "Valid range is [0..%i)",
+                      idx, int(mesh.p.size()));
+}
+
 TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
+    LoadProfileScope _("Read PLY", filename);
     TriQuadMesh mesh;
+    if (ReadBinaryPLY(filename, &mesh)) {
+        CheckVertexIndices(mesh);
+        return mesh;
+    }
 
     p_ply ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
     if (!ply)
@@ -408,17 +847,7 @@ TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
 
     ply_close(ply);
 
-    for (int idx : mesh.triIndices)
-        if (idx < 0 || idx >= mesh.p.size())
-            ErrorExit("plymesh: Vertex index %i is out of bounds! "
-                      "Valid range is [0..%i)",
-                      idx, int(mesh.p.size()));
-    for (int idx : mesh.quadIndices)
-        if (idx < 0 || idx >= mesh.p.size())
-            ErrorExit("plymesh: Vertex index %i is out of bounds! "
-                      "Valid range is [0..%i)",
-                      idx, int(mesh.p.size()));
-
+    CheckVertexIndices(mesh);
     return mesh;
 }
 
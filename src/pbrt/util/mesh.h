@@ -9,6 +9,7 @@
 
 #include <pbrt/util/containers.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/float.h>
 #include <pbrt/util/hash.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/pstd.h>
@@ -20,6 +21,12 @@
 
 namespace pbrt {
 
+// TriangleMeshStorage Definition
+// Compact meshes store 16-bit vertex indices when there are few enough
+// vertices, octahedral-encoded normals, and half-precision uvs; quantized
+// meshes additionally store positions as 16-bit offsets within the mesh bounds.
+enum class TriangleMeshStorage { Full, Compact, Quantized };
+
 // TriangleMesh Definition
 class TriangleMesh {
   public:
@@ -27,7 +34,47 @@ class TriangleMesh {
     TriangleMesh(const Transform &renderFromObject, bool reverseOrientation,
                  std::vector<int> vertexIndices, std::vector<Point3f> p,
                  std::vector<Vector3f> S, std::vector<Normal3f> N,
-                 std::vector<Point2f> uv, std::vector<int> faceIndices, Allocator alloc);
+                 std::vector<Point2f> uv, std::vector<int> faceIndices, Allocator alloc,
+                 TriangleMeshStorage storage = TriangleMeshStorage::Full);
+
+    PBRT_CPU_GPU
+    pstd::array<int, 3> TriangleVertexIndices(int triIndex) const {
+        if (vertexIndices16) {
+            const uint16_t *v = &vertexIndices16[3 * triIndex];
+            return {v[0], v[1], v[2]};
+        }
+        const int *v = &vertexIndices[3 * triIndex];
+        return {v[0], v[1], v[2]};
+    }
+
+    PBRT_CPU_GPU
+    Point3f P(int vertexIndex) const {
+        if (pQuantized) {
+            const uint16_t *q = &pQuantized[3 * vertexIndex];
+            return pOrigin + Vector3f(q[0] * pScale.x, q[1] * pScale.y, q[2] * pScale.z);
+        }
+        return p[vertexIndex];
+    }
+
+    PBRT_CPU_GPU
+    Normal3f N(int vertexIndex) const {
+        if (nOctahedral)
+            return Normal3f(Vector3f(nOctahedral[vertexIndex]));
+        return n[vertexIndex];
+    }
+
+    PBRT_CPU_GPU
+    Point2f UV(int vertexIndex) const {
+        if (uvHalf)
+            return Point2f(float(Half::FromBits(uvHalf[2 * vertexIndex])),
+                           float(Half::FromBits(uvHalf[2 * vertexIndex + 1])));
+        return uv[vertexIndex];
+    }
+
+    PBRT_CPU_GPU
+    bool HasNormals() const { return n || nOctahedral; }
+    PBRT_CPU_GPU
+    bool HasUVs() const { return uv || uvHalf; }
 
     std::string ToString() const;
 
@@ -44,6 +91,13 @@ class TriangleMesh {
     const Point2f *uv = nullptr;
     const int *faceIndices = nullptr;
     bool reverseOrientation, transformSwapsHandedness;
+    // Compact representations that replace the full-precision buffers above
+    const uint16_t *vertexIndices16 = nullptr;
+    const uint16_t *pQuantized = nullptr;
+    Point3f pOrigin;
+    Vector3f pScale;
+    const OctahedralVector *nOctahedral = nullptr;
+    const uint16_t *uvHalf = nullptr;
 };
 
 // BilinearPatchMesh Definition
@@ -0,0 +1,145 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/mesh.h>
+#include <pbrt/util/rng.h>
+
+using namespace pbrt;
+
+static std::string inTestDir(const std::string &path) {
+    return path;
+}
+
+static void CheckMeshesEqual(const TriQuadMesh &a, const TriQuadMesh &b) {
+    EXPECT_EQ(a.p, b.p);
+    EXPECT_EQ(a.n, b.n);
+    EXPECT_EQ(a.uv, b.uv);
+    EXPECT_EQ(a.triIndices, b.triIndices);
+    EXPECT_EQ(a.quadIndices, b.quadIndices);
+    EXPECT_EQ(a.faceIndices, b.faceIndices);
+}
+
+TEST(TriQuadMesh, ReadBinaryPLY) {
+    RNG rng;
+    std::vector<Point3f> p;
+    std::vector<Normal3f> n;
+    std::vector<Point2f> uv;
+    for (int i = 0; i < 1000; ++i) {
+        p.push_back(Point3f(rng.Uniform<Float>(), rng.Uniform<Float>(),
+                            rng.Uniform<Float>()));
+        n.push_back(Normal3f(rng.Uniform<Float>(), rng.Uniform<Float>(), 1));
+        uv.push_back(Point2f(rng.Uniform<Float>(), rng.Uniform<Float>()));
+    }
+    std::vector<int> triIndices, quadIndices, faceIndices;
+    for (int i = 0; i < 300; ++i) {
+        for (int j = 0; j < 3; ++j)
+            triIndices.push_back(rng.Uniform<uint32_t>(p.size()));
+        faceIndices.push_back(i);
+    }
+
+    std::string fn = inTestDir("binary.ply");
+    ASSERT_TRUE(WritePLY(fn, triIndices, {}, p, n, uv, faceIndices));
+    TriQuadMesh mesh = TriQuadMesh::ReadPLY(fn);
+    EXPECT_EQ(0, remove(fn.c_str()));
+    EXPECT_EQ(p, mesh.p);
+    EXPECT_EQ(n, mesh.n);
+    EXPECT_EQ(uv, mesh.uv);
+    EXPECT_EQ(triIndices, mesh.triIndices);
+    EXPECT_TRUE(mesh.quadIndices.empty());
+    EXPECT_EQ(faceIndices, mesh.faceIndices);
+
+    // Quads are reordered when read; neither normals nor uvs are present here.
+    for (int i = 0; i < 4; ++i)
+        quadIndices.push_back(rng.Uniform<uint32_t>(p.size()));
+    ASSERT_TRUE(WritePLY(fn, triIndices, quadIndices, p, {}, {}, {}));
+    mesh = TriQuadMesh::ReadPLY(fn);
+    EXPECT_EQ(0, remove(fn.c_str()));
+    EXPECT_EQ(p, mesh.p);
+    EXPECT_TRUE(mesh.n.empty());
+    EXPECT_TRUE(mesh.uv.empty());
+    EXPECT_EQ(triIndices, mesh.triIndices);
+    std::vector<int> expectedQuad = {quadIndices[0], quadIndices[1], quadIndices[3],
+                                     quadIndices[2]};
+    EXPECT_EQ(expectedQuad, mesh.quadIndices);
+}
+
+TEST(TriQuadMesh, ReadPLYFormatsMatch) {
+    // The same mesh, stored as ASCII and as binary with mixed property types
+    // and an additional element that must be skipped.
+    std::string ascii = R"(ply
+format ascii 1.0
+comment test mesh
+element vertex 4
+property float x
+property float y
+property float z
+property double s
+property double t
+element face 2
+property list uchar int vertex_indices
+property int face_indices
+end_header
+0 0 0 0 0
+1 0 0 1 0
+1 1 0 1 1
+0 1 0.5 0 1
+3 0 1 2 7
+4 0 1 2 3 8
+)";
+    std::string binary = R"(ply
+format binary_little_endian 1.0
+element vertex 4
+property float x
+property float y
+property float z
+property double s
+property double t
+element material 2
+property uchar id
+property short value
+element face 2
+property list uchar ushort vertex_indices
+property uchar face_indices
+end_header
+)";
+    auto append = [&](auto v) { binary.append((const char *)&v, sizeof(v)); };
+    float p[4][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0.5f}};
+    double st[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    for (int i = 0; i < 4; ++i) {
+        for (int c = 0; c < 3; ++c)
+            append(p[i][c]);
+        for (int c = 0; c < 2; ++c)
+            append(st[i][c]);
+    }
+    for (int i = 0; i < 2; ++i) {
+        append(uint8_t(i));
+        append(int16_t(-i));
+    }
+    append(uint8_t(3));
+    for (uint16_t v : {0, 1, 2})
+        append(v);
+    append(uint8_t(7));
+    append(uint8_t(4));
+    for (uint16_t v : {0, 1, 2, 3})
+        append(v);
+    append(uint8_t(8));
+
+    std::string asciiFn = inTestDir("ascii.ply"), binaryFn = inTestDir("binary.ply");
+    ASSERT_TRUE(WriteFileContents(asciiFn, ascii));
+    ASSERT_TRUE(WriteFileContents(binaryFn, binary));
+    TriQuadMesh asciiMesh = TriQuadMesh::ReadPLY(asciiFn);
+    TriQuadMesh binaryMesh = TriQuadMesh::ReadPLY(binaryFn);
+    EXPECT_EQ(0, remove(asciiFn.c_str()));
+    EXPECT_EQ(0, remove(binaryFn.c_str()));
+
+    EXPECT_EQ(4, asciiMesh.p.size());
+    EXPECT_EQ(4, asciiMesh.uv.size());
+    EXPECT_EQ((std::vector<int>{0, 1, 3, 2}), asciiMesh.quadIndices);
+    EXPECT_EQ((std::vector<int>{7, 8}), asciiMesh.faceIndices);
+    CheckMeshesEqual(asciiMesh, binaryMesh);
+}
@@ -5,22 +5,49 @@
 #include <pbrt/util/mipmap.h>
 
 #include <pbrt/options.h>
+#include <pbrt/util/blockcompress.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/memory.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Image maps", imageMapBytes);
+STAT_MEMORY_COUNTER("Memory/Paged image map files", pagedImageMapBytes);
+STAT_MEMORY_COUNTER("Memory/Block-compressed image maps", compressedImageMapBytes);
+STAT_PIXEL_COUNTER("Texture/MIP map lookups", nMIPMapLookups);
+STAT_COUNTER("Texture/MIP map cache hits", nMIPMapCacheHits);
+STAT_COUNTER("Texture/MIP map cache misses", nMIPMapCacheMisses);
+STAT_COUNTER("Texture/Paged MIP map tiles read", nTilesRead);
+STAT_COUNTER("Texture/Paged MIP map tiles evicted", nTilesEvicted);
+STAT_PERCENT("Texture/Paged texel lookups from the thread's tiles", nThreadTileHits,
+             nTileLookups);
 
 ///////////////////////////////////////////////////////////////////////////
 // MIPMap Helper Declarations
@@ -57,6 +84,8 @@ std::string MIPMapFilterOptions::ToString() const {
 */
 // MIPMap EWA Lookup Table Definition
 static constexpr int MIPFilterLUTSize = 128;
+// Number of texels of a scanline that EWA filtering processes at once
+static constexpr int EWASpanSize = 64;
 static PBRT_CONST Float MIPFilterLUT[MIPFilterLUTSize] = {
     // MIPMap EWA Lookup Table Values
     0.864664733f,
@@ -190,43 +219,725 @@ static PBRT_CONST Float MIPFilterLUT[MIPFilterLUTSize] = {
 
 };
 
+// MIPMap::PagedPyramid Definition
+// The levels of a paged MIP map are stored one after another as a sequence of
+// tiles, each padded to _TileSize_ x _TileSize_ texels. The tiles are either
+// in a temporary file, from which they are read into the _TextureTileCache_ as
+// needed, or in a memory-mapped tiled MIP map file.
+struct MIPMap::PagedPyramid {
+    static constexpr int TileSize = 64;
+
+    ~PagedPyramid();
+
+    int64_t InitLayout(const std::vector<Point2i> &levelResolutions);
+    bool WriteTiles(const pstd::vector<Image> &pyramid, FILE *f) const;
+    std::shared_ptr<const std::vector<uint8_t>> ReadTile(int64_t tileIndex) const;
+    Image CopyLevel(const uint8_t *tiles, int level, Point2i resolution,
+                    Allocator alloc) const;
+
+    Float Channel(const uint8_t *texel, int c) const {
+        switch (format) {
+        case PixelFormat::U256: {
+            Float v;
+            encoding.ToLinear({texel + c, 1}, {&v, 1});
+            return v;
+        }
+        case PixelFormat::Half: {
+            uint16_t h;
+            std::memcpy(&h, texel + 2 * c, sizeof(h));
+            return Float(Half::FromBits(h));
+        }
+        default: {
+            float f;
+            std::memcpy(&f, texel + 4 * c, sizeof(f));
+            return f;
+        }
+        }
+    }
+
+    uint64_t id;
+    PixelFormat format;
+    ColorEncoding encoding;
+    std::vector<std::string> channelNames;
+    int texelBytes;
+    size_t tileBytes;
+    // Number of tiles across each level and index of each level's first tile
+    std::vector<int> levelTilesX;
+    std::vector<int64_t> levelFirstTile;
+
+    // Temporary file that tiles are read from
+    FILE *file = nullptr;
+    mutable std::mutex fileMutex;
+    // Tiles of a memory-mapped tiled MIP map file
+    const uint8_t *mappedTiles = nullptr;
+    void *mapping = nullptr;
+    size_t mappingBytes = 0;
+};
+
+MIPMap::PagedPyramid::~PagedPyramid() {
+    if (file)
+        fclose(file);
+#ifdef PBRT_HAVE_MMAP
+    if (mapping)
+        munmap(mapping, mappingBytes);
+#endif
+}
+
+int64_t MIPMap::PagedPyramid::InitLayout(const std::vector<Point2i> &levelResolutions) {
+    static std::atomic<uint64_t> nextId{1};
+    id = nextId++;
+    tileBytes = size_t(Sqr(TileSize)) * texelBytes;
+    int64_t nTiles = 0;
+    for (Point2i res : levelResolutions) {
+        levelTilesX.push_back((res.x + TileSize - 1) / TileSize);
+        levelFirstTile.push_back(nTiles);
+        nTiles += int64_t(levelTilesX.back()) * ((res.y + TileSize - 1) / TileSize);
+    }
+    return nTiles;
+}
+
+bool MIPMap::PagedPyramid::WriteTiles(const pstd::vector<Image> &pyramid,
+                                      FILE *f) const {
+    std::vector<uint8_t> tile(tileBytes);
+    for (size_t level = 0; level < pyramid.size(); ++level) {
+        const Image &image = pyramid[level];
+        Point2i res = image.Resolution();
+        for (int y0 = 0; y0 < res.y; y0 += TileSize)
+            for (int x0 = 0; x0 < res.x; x0 += TileSize) {
+                // Copy the tile's texels, leaving zeros past the level's edges
+                std::fill(tile.begin(), tile.end(), 0);
+                int width = std::min(TileSize, res.x - x0);
+                for (int y = y0; y < std::min(y0 + TileSize, res.y); ++y)
+                    std::memcpy(&tile[(y - y0) * TileSize * texelBytes],
+                                image.RawPointer({x0, y}), width * texelBytes);
+                if (fwrite(tile.data(), 1, tile.size(), f) != tile.size())
+                    return false;
+            }
+    }
+    return true;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> MIPMap::PagedPyramid::ReadTile(
+    int64_t tileIndex) const {
+    std::shared_ptr<std::vector<uint8_t>> tile =
+        std::make_shared<std::vector<uint8_t>>(tileBytes);
+    std::lock_guard<std::mutex> lock(fileMutex);
+    int64_t offset = tileIndex * tileBytes;
+#ifdef PBRT_IS_WINDOWS
+    bool seeked = _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    bool seeked = fseeko(file, offset, SEEK_SET) == 0;
+#endif
+    if (!seeked || fread(tile->data(), 1, tileBytes, file) != tileBytes)
+        ErrorExit("Unable to read MIP map tile from temporary file: %s", ErrorString());
+    ++nTilesRead;
+    return tile;
+}
+
+Image MIPMap::PagedPyramid::CopyLevel(const uint8_t *tiles, int level,
+                                      Point2i resolution, Allocator alloc) const {
+    Image image(format, resolution, channelNames, encoding, alloc);
+    for (int y = 0; y < resolution.y; ++y)
+        for (int x0 = 0; x0 < resolution.x; x0 += TileSize) {
+            int64_t tileIndex = levelFirstTile[level] +
+                                (y / TileSize) * levelTilesX[level] + x0 / TileSize;
+            const uint8_t *row =
+                tiles + tileIndex * tileBytes + (y % TileSize) * TileSize * texelBytes;
+            int width = std::min(TileSize, resolution.x - x0);
+            std::memcpy(image.RawPointer({x0, y}), row, width * texelBytes);
+        }
+    return image;
+}
+
+// TiledMIPMapHeader Definition
+// Tiled MIP map files start with this header, which is stored in the byte
+// order of the machine that wrote it. It is followed by the levels' tiles,
+// laid out as in a _PagedPyramid_, starting at _tilesOffset_.
+struct TiledMIPMapHeader {
+    static constexpr int MaxLevels = 32, MaxChannelName = 16;
+
+    char magic[8];
+    int32_t version;
+    int32_t format, nChannels, wrapMode, nLevels, tileSize;
+    // Chromaticities of the color space's primaries and white point
+    float primaries[8];
+    char encoding[32];
+    char channelNames[4][MaxChannelName];
+    int32_t levelResolutions[MaxLevels][2];
+    int64_t tilesOffset;
+};
+
+static constexpr char TiledMIPMapMagic[8] = "pbrtmip";
+static constexpr int TiledMIPMapVersion = 1;
+
+// TextureTileCache Definition
+// The tiles of all MIP maps that are paged from temporary files share a cache
+// whose size is given by --texture-cache. It is split into shards that have
+// their own locks and least recently used lists, and each thread also holds
+// on to the tiles it used most recently so that most lookups don't need to
+// take a lock.
+class TextureTileCache {
+  public:
+    // TextureTileCache Public Methods
+    // Returns the tile with the given key, calling _load_ to read it if it
+    // isn't in the cache. The tile remains valid until the thread's next
+    // call to Lookup().
+    template <typename F>
+    static const uint8_t *Lookup(uint64_t key, F load);
+
+  private:
+    // TextureTileCache Private Members
+    using TileData = std::shared_ptr<const std::vector<uint8_t>>;
+    static constexpr int NumShards = 64, ThreadTiles = 64;
+    struct Shard {
+        struct Entry {
+            TileData tile;
+            std::list<uint64_t>::iterator lruIter;
+        };
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Entry> tiles;
+        // Keys of the shard's tiles, most recently used first
+        std::list<uint64_t> lru;
+        size_t bytes = 0;
+    };
+    struct ThreadTile {
+        uint64_t key = 0;
+        TileData tile;
+    };
+    static Shard shards[NumShards];
+    static thread_local ThreadTile threadTiles[ThreadTiles];
+};
+
+TextureTileCache::Shard TextureTileCache::shards[NumShards];
+thread_local TextureTileCache::ThreadTile TextureTileCache::threadTiles[ThreadTiles];
+
+template <typename F>
+const uint8_t *TextureTileCache::Lookup(uint64_t key, F load) {
+    // Return the tile if the thread used it recently
+    ++nTileLookups;
+    uint64_t hash = MixBits(key);
+    ThreadTile &threadTile = threadTiles[hash % ThreadTiles];
+    if (threadTile.key == key) {
+        ++nThreadTileHits;
+        return threadTile.tile->data();
+    }
+
+    // Look up the tile in its shard, reading it without holding the lock if
+    // it isn't there
+    Shard &shard = shards[(hash / ThreadTiles) % NumShards];
+    TileData tile;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (auto iter = shard.tiles.find(key); iter != shard.tiles.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second.lruIter);
+            tile = iter->second.tile;
+        }
+    }
+    if (!tile) {
+        TileData loaded = load();
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // Another thread may have read the tile in the meantime
+        auto [iter, inserted] = shard.tiles.try_emplace(key);
+        if (inserted) {
+            iter->second.tile = loaded;
+            iter->second.lruIter = shard.lru.insert(shard.lru.begin(), key);
+            shard.bytes += loaded->size();
+            TrackedMemoryResource *memory = GetTrackedMemory();
+            if (memory)
+                memory->AddExternalBytes(MemoryCategory::Textures, loaded->size());
+
+            // Evict the shard's least recently used tiles to meet its budget
+            // and the overall memory budget; threads that still hold them
+            // keep them alive until they're done
+            size_t budget = (size_t(Options->textureCacheMB) << 20) / NumShards;
+            size_t overage = MemoryBudgetOverage();
+            while ((shard.bytes > budget || overage > 0) && shard.lru.size() > 1) {
+                auto evict = shard.tiles.find(shard.lru.back());
+                size_t tileBytes = evict->second.tile->size();
+                shard.bytes -= tileBytes;
+                overage -= std::min(overage, tileBytes);
+                if (memory)
+                    memory->AddExternalBytes(MemoryCategory::Textures,
+                                             -int64_t(tileBytes));
+                shard.tiles.erase(evict);
+                shard.lru.pop_back();
+                ++nTilesEvicted;
+            }
+        }
+        tile = iter->second.tile;
+    }
+
+    threadTile.key = key;
+    threadTile.tile = std::move(tile);
+    return threadTile.tile->data();
+}
+
+// Returns whether MIP maps should be stored on disk and paged in as needed
+static bool PageMIPMaps() {
+    return Options->textureCacheMB > 0 && !Options->useGPU &&
+           !Options->disableImageTextures && !Options->compressTextures;
+}
+
+// MIPMap::CompressedPyramid Definition
+// The levels of a block-compressed MIP map are stored as rows of 4x4 texel
+// blocks. 8-bit images use BC1 or, if they have a single channel, BC4, with
+// the image's color encoding applied after decoding; others use BC6H.
+struct MIPMap::CompressedPyramid {
+    enum class Format { BC1, BC4, BC6H };
+
+    int BlockBytes() const { return format == Format::BC6H ? 16 : 8; }
+
+    Format format;
+    ColorEncoding encoding;
+    std::vector<pstd::vector<uint8_t>> levels;
+};
+
+// Returns whether MIP maps should be stored block-compressed
+static bool CompressMIPMaps() {
+    return Options->compressTextures && !Options->useGPU &&
+           !Options->disableImageTextures;
+}
+
+// Returns whether resident MIP map levels should be stored in blocks of texels
+static bool BlockMIPMaps() {
+    return Options->blockTextures && !Options->useGPU && !Options->disableImageTextures;
+}
+
 // MIPMap Method Definitions
 MIPMap::MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
                Allocator alloc, const MIPMapFilterOptions &options)
     : colorSpace(colorSpace), wrapMode(wrapMode), options(options) {
     CHECK(colorSpace);
-    pyramid = Image::GeneratePyramid(std::move(image), wrapMode, alloc);
+    // Paged, compressed, and blocked levels are only resident until they
+    // have been written to disk, compressed, or copied into blocks, so they
+    // are allocated in a way that allows freeing them
+    bool page = PageMIPMaps() && (image.Resolution().x > PagedPyramid::TileSize ||
+                                  image.Resolution().y > PagedPyramid::TileSize);
+    bool compress = CompressMIPMaps();
+    bool block = BlockMIPMaps() && !page && !compress;
+    pyramid = Image::GeneratePyramid(std::move(image), wrapMode,
+                                     (page || compress || block) ? Allocator() : alloc);
     if (Options->disableImageTextures) {
         Image top = pyramid.back();
         pyramid.clear();
         pyramid.push_back(top);
     }
-    std::for_each(pyramid.begin(), pyramid.end(),
-                  [](const Image &im) { imageMapBytes += im.BytesUsed(); });
+    nChannels = pyramid[0].NChannels();
+    for (const Image &im : pyramid)
+        levelResolutions.push_back(im.Resolution());
+
+    if (page)
+        Page();
+    else if (compress)
+        Compress(alloc);
+    if (!paged && !compressed) {
+        InitResidentLookups(block, alloc);
+        if (blocked) {
+            imageMapBytes += blockedTexels.size();
+            NumaInterleave(blockedTexels.data(), blockedTexels.size());
+        } else
+            for (const Image &im : pyramid) {
+                imageMapBytes += im.BytesUsed();
+                NumaInterleave(im.RawPointer({0, 0}), im.BytesUsed());
+            }
+    }
+}
+
+MIPMap::MIPMap(const RGBColorSpace *colorSpace, WrapMode wrapMode,
+               const MIPMapFilterOptions &options)
+    : colorSpace(colorSpace), wrapMode(wrapMode), options(options) {}
+
+MIPMap::~MIPMap() = default;
+
+std::unique_ptr<MIPMap::PagedPyramid> MIPMap::TileLayout() const {
+    CHECK(!paged && !compressed);
+    std::unique_ptr<PagedPyramid> p = std::make_unique<PagedPyramid>();
+    p->format = pyramid[0].Format();
+    p->encoding = pyramid[0].Encoding();
+    p->channelNames = pyramid[0].ChannelNames();
+    p->texelBytes = nChannels * TexelBytes(p->format);
+    p->InitLayout(levelResolutions);
+    return p;
+}
+
+void MIPMap::Page() {
+    FILE *file = std::tmpfile();
+    if (!file) {
+        Warning("Unable to create temporary file for MIP map: %s. Keeping it in memory.",
+                ErrorString());
+        return;
+    }
+    std::unique_ptr<PagedPyramid> p = TileLayout();
+    p->file = file;
+    if (!p->WriteTiles(pyramid, file) || fflush(file) != 0) {
+        Warning("Unable to write MIP map to temporary file: %s. Keeping it in memory.",
+                ErrorString());
+        return;
+    }
+
+    for (const Image &im : pyramid)
+        pagedImageMapBytes += im.BytesUsed();
+    paged = std::move(p);
+    pyramid.clear();
+}
+
+void MIPMap::Compress(Allocator alloc) {
+    // Choose the block format for the MIP map's texels
+    using Format = CompressedPyramid::Format;
+    std::unique_ptr<CompressedPyramid> c = std::make_unique<CompressedPyramid>();
+    bool is8Bit = pyramid[0].Format() == PixelFormat::U256;
+    if (nChannels == 2 || (is8Bit && !pyramid[0].Encoding()))
+        return;
+    c->format = is8Bit ? (nChannels == 1 ? Format::BC4 : Format::BC1) : Format::BC6H;
+    c->encoding = pyramid[0].Encoding();
+
+    for (const Image &image : pyramid) {
+        // Compress the level's blocks, replicating its last row and column to
+        // fill blocks that extend past its edges
+        Point2i res = image.Resolution();
+        int blocksX = (res.x + 3) / 4, blocksY = (res.y + 3) / 4;
+        pstd::vector<uint8_t> blocks(size_t(blocksX) * blocksY * c->BlockBytes(), alloc);
+        ParallelFor(0, blocksY, [&](int64_t by) {
+            for (int bx = 0; bx < blocksX; ++bx) {
+                uint8_t *block = &blocks[(by * blocksX + bx) * c->BlockBytes()];
+                uint8_t texels[16][3];
+                uint16_t halfTexels[16][3];
+                for (int i = 0; i < 16; ++i) {
+                    Point2i p(std::min(4 * bx + i % 4, res.x - 1),
+                              std::min(4 * int(by) + i / 4, res.y - 1));
+                    const uint8_t *raw = (const uint8_t *)image.RawPointer(p);
+                    for (int ch = 0; ch < 3; ++ch) {
+                        int channel = std::min(ch, nChannels - 1);
+                        if (is8Bit)
+                            texels[i][ch] = raw[channel];
+                        else {
+                            // BC6H only stores finite nonnegative values
+                            Float v = image.GetChannel(p, channel);
+                            halfTexels[i][ch] =
+                                Half(IsNaN(v) ? 0.f : Clamp(v, 0, 65504)).Bits();
+                        }
+                    }
+                }
+                if (c->format == Format::BC1)
+                    EncodeBC1Block(texels, block);
+                else if (c->format == Format::BC4) {
+                    uint8_t v[16];
+                    for (int i = 0; i < 16; ++i)
+                        v[i] = texels[i][0];
+                    EncodeBC4Block(v, block);
+                } else
+                    EncodeBC6HBlock(halfTexels, block);
+            }
+        });
+        compressedImageMapBytes += blocks.size();
+        NumaInterleave(blocks.data(), blocks.size());
+        c->levels.push_back(std::move(blocks));
+    }
+
+    compressed = std::move(c);
+    pyramid.clear();
+}
+
+bool MIPMap::CompressedTexel(int level, Point2i st, Float rgb[3]) const {
+    // Apply the wrap mode and find the block that holds the texel
+    if (!RemapPixelCoords(&st, levelResolutions[level], wrapMode))
+        return false;
+    int blocksX = (levelResolutions[level].x + 3) / 4;
+    const uint8_t *block = &compressed->levels[level][(size_t(st.y / 4) * blocksX +
+                                                       st.x / 4) *
+                                                      compressed->BlockBytes()];
+    int texel = 4 * (st.y % 4) + st.x % 4;
+
+    // Decode the texel and convert it to linear values
+    switch (compressed->format) {
+    case CompressedPyramid::Format::BC1: {
+        uint8_t v[3];
+        DecodeBC1Texel(block, texel, v);
+        compressed->encoding.ToLinear({v, 3}, {rgb, 3});
+        break;
+    }
+    case CompressedPyramid::Format::BC4: {
+        uint8_t v = DecodeBC4Texel(block, texel);
+        compressed->encoding.ToLinear({&v, 1}, {rgb, 1});
+        rgb[1] = rgb[2] = rgb[0];
+        break;
+    }
+    case CompressedPyramid::Format::BC6H: {
+        uint16_t h[3];
+        DecodeBC6HTexel(block, texel, h);
+        for (int c = 0; c < 3; ++c)
+            rgb[c] = Float(Half::FromBits(h[c]));
+        break;
+    }
+    }
+    return true;
+}
+
+bool MIPMap::WriteTiled(const std::string &filename) const {
+    if (blocked) {
+        Error("%s: MIP maps with blocked levels can't be written as tiled MIP map files.",
+              filename);
+        return false;
+    }
+    std::unique_ptr<PagedPyramid> p = TileLayout();
+    if (Levels() > TiledMIPMapHeader::MaxLevels) {
+        Error("%s: too many MIP map levels for tiled MIP map file.", filename);
+        return false;
+    }
+
+    // Initialize the file's header
+    TiledMIPMapHeader header = {};
+    std::memcpy(header.magic, TiledMIPMapMagic, sizeof(header.magic));
+    header.version = TiledMIPMapVersion;
+    header.format = int32_t(p->format);
+    header.nChannels = nChannels;
+    header.wrapMode = int32_t(wrapMode);
+    header.nLevels = Levels();
+    header.tileSize = PagedPyramid::TileSize;
+    Point2f chromaticities[4] = {colorSpace->r, colorSpace->g, colorSpace->b,
+                                 colorSpace->w};
+    for (int i = 0; i < 4; ++i) {
+        header.primaries[2 * i] = chromaticities[i].x;
+        header.primaries[2 * i + 1] = chromaticities[i].y;
+    }
+    std::string encoding = p->encoding.Name();
+    CHECK_LT(encoding.size(), sizeof(header.encoding));
+    std::memcpy(header.encoding, encoding.data(), encoding.size());
+    for (int c = 0; c < nChannels; ++c) {
+        const std::string &name = p->channelNames[c];
+        if (name.size() >= TiledMIPMapHeader::MaxChannelName) {
+            Error("%s: channel name \"%s\" is too long for tiled MIP map file.",
+                  filename, name);
+            return false;
+        }
+        std::memcpy(header.channelNames[c], name.data(), name.size());
+    }
+    for (int level = 0; level < Levels(); ++level) {
+        header.levelResolutions[level][0] = levelResolutions[level].x;
+        header.levelResolutions[level][1] = levelResolutions[level].y;
+    }
+    // Start the tiles at a page boundary so that each is mapped separately
+    header.tilesOffset = (sizeof(header) + 4095) & ~int64_t(4095);
+
+    // Write the header and the tiles
+    FILE *f = FOpenWrite(filename);
+    if (!f) {
+        Error("%s: unable to open file: %s", filename, ErrorString());
+        return false;
+    }
+    std::vector<uint8_t> padding(header.tilesOffset - sizeof(header));
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                   fwrite(padding.data(), 1, padding.size(), f) == padding.size() &&
+                   p->WriteTiles(pyramid, f);
+    if (fclose(f) != 0)
+        written = false;
+    if (!written)
+        Error("%s: unable to write tiled MIP map: %s", filename, ErrorString());
+    return written;
+}
+
+MIPMap *MIPMap::ReadTiled(const std::string &filename, const MIPMapFilterOptions &options,
+                          WrapMode wrapMode, Allocator alloc) {
+    // Map the file into memory or, if that's not possible, read it
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        ErrorExit("%s: %s", filename, ErrorString());
+    struct stat stat;
+    if (fstat(fd, &stat) == -1)
+        ErrorExit("%s: %s", filename, ErrorString());
+    size_t bytes = stat.st_size;
+    void *mapping = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        ErrorExit("%s: unable to map file: %s", filename, ErrorString());
+    const uint8_t *data = (const uint8_t *)mapping;
+#else
+    std::string contents = ReadFileContents(filename);
+    size_t bytes = contents.size();
+    const uint8_t *data = (const uint8_t *)contents.data();
+#endif
+
+    // Check the file's header
+    TiledMIPMapHeader header;
+    if (bytes < sizeof(header))
+        ErrorExit("%s: file is too small to be a tiled MIP map.", filename);
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, TiledMIPMapMagic, sizeof(header.magic)) != 0)
+        ErrorExit("%s: not a tiled MIP map file.", filename);
+    if (header.version != TiledMIPMapVersion)
+        ErrorExit("%s: tiled MIP map file version %d isn't supported.", filename,
+                  header.version);
+    PixelFormat format = PixelFormat(header.format);
+    if ((format != PixelFormat::U256 && format != PixelFormat::Half &&
+         format != PixelFormat::Float) ||
+        (header.nChannels != 1 && header.nChannels != 3 && header.nChannels != 4) ||
+        header.nLevels < 1 || header.nLevels > TiledMIPMapHeader::MaxLevels ||
+        header.tileSize != PagedPyramid::TileSize)
+        ErrorExit("%s: corrupt tiled MIP map header.", filename);
+    if (WrapMode(header.wrapMode) != wrapMode)
+        Warning("%s: MIP map was generated using the \"%s\" wrap mode but is being "
+                "used with \"%s\".",
+                filename, pbrt::ToString(WrapMode(header.wrapMode)),
+                pbrt::ToString(wrapMode));
+
+    // Find the MIP map's color space and tile layout
+    Point2f chromaticities[4];
+    for (int i = 0; i < 4; ++i)
+        chromaticities[i] = Point2f(header.primaries[2 * i], header.primaries[2 * i + 1]);
+    const RGBColorSpace *colorSpace =
+        RGBColorSpace::Create(chromaticities[0], chromaticities[1], chromaticities[2],
+                              chromaticities[3], alloc);
+    if (!colorSpace) {
+        Warning("%s: unknown color space. Using sRGB.", filename);
+        colorSpace = RGBColorSpace::sRGB;
+    }
+    std::unique_ptr<PagedPyramid> p = std::make_unique<PagedPyramid>();
+    p->format = format;
+    header.encoding[sizeof(header.encoding) - 1] = '\0';
+    if (header.encoding[0])
+        p->encoding = ColorEncoding::Get(header.encoding, alloc);
+    for (int c = 0; c < header.nChannels; ++c)
+        p->channelNames.push_back(std::string(
+            header.channelNames[c],
+            strnlen(header.channelNames[c], TiledMIPMapHeader::MaxChannelName)));
+    p->texelBytes = header.nChannels * TexelBytes(format);
+    std::vector<Point2i> levelResolutions;
+    for (int level = 0; level < header.nLevels; ++level)
+        levelResolutions.push_back(Point2i(header.levelResolutions[level][0],
+                                           header.levelResolutions[level][1]));
+    int64_t nTiles = p->InitLayout(levelResolutions);
+    if (header.tilesOffset < int64_t(sizeof(header)) ||
+        bytes < header.tilesOffset + nTiles * p->tileBytes)
+        ErrorExit("%s: tiled MIP map file is truncated.", filename);
+    const uint8_t *tiles = data + header.tilesOffset;
+
+    // Create the MIP map, keeping only its coarsest level if image textures are
+    // disabled
+    MIPMap *mipmap = alloc.allocate_object<MIPMap>();
+    new (mipmap) MIPMap(colorSpace, wrapMode, options);
+    mipmap->nChannels = header.nChannels;
+    int firstLevel = Options->disableImageTextures ? header.nLevels - 1 : 0;
+#ifdef PBRT_HAVE_MMAP
+    // Texels are read directly from the mapped tiles
+    p->levelTilesX.erase(p->levelTilesX.begin(), p->levelTilesX.begin() + firstLevel);
+    p->levelFirstTile.erase(p->levelFirstTile.begin(),
+                            p->levelFirstTile.begin() + firstLevel);
+    p->mappedTiles = tiles;
+    p->mapping = mapping;
+    p->mappingBytes = bytes;
+    pagedImageMapBytes += bytes;
+    mipmap->levelResolutions.assign(levelResolutions.begin() + firstLevel,
+                                    levelResolutions.end());
+    mipmap->paged = std::move(p);
+#else
+    // Copy the tiles into resident levels
+    mipmap->pyramid = pstd::vector<Image>(alloc);
+    for (int level = firstLevel; level < header.nLevels; ++level) {
+        mipmap->pyramid.push_back(
+            p->CopyLevel(tiles, level, levelResolutions[level], alloc));
+        mipmap->levelResolutions.push_back(levelResolutions[level]);
+        imageMapBytes += mipmap->pyramid.back().BytesUsed();
+    }
+    mipmap->InitResidentLookups(false, alloc);
+#endif
+    return mipmap;
+}
+
+const uint8_t *MIPMap::PagedTexel(int level, Point2i st) const {
+    // Apply the wrap mode and find the tile that holds the texel
+    if (!RemapPixelCoords(&st, levelResolutions[level], wrapMode))
+        return nullptr;
+    constexpr int TileSize = PagedPyramid::TileSize;
+    Point2i tile(st.x / TileSize, st.y / TileSize);
+    int64_t tileIndex =
+        paged->levelFirstTile[level] + tile.y * paged->levelTilesX[level] + tile.x;
+    size_t texelOffset =
+        ((st.y - tile.y * TileSize) * TileSize + st.x - tile.x * TileSize) *
+        paged->texelBytes;
+    if (paged->mappedTiles)
+        return paged->mappedTiles + tileIndex * paged->tileBytes + texelOffset;
+
+    // Tiles are identified by their MIP map's id and their index in its file
+    uint64_t key = (paged->id << 40) | uint64_t(tileIndex);
+    return TextureTileCache::Lookup(key, [&]() { return paged->ReadTile(tileIndex); }) +
+           texelOffset;
+}
+
+Float MIPMap::GetChannel(int level, Point2i st, int c) const {
+    if (compressed) {
+        // Alpha isn't stored in compressed MIP maps
+        Float rgb[3];
+        if (!CompressedTexel(level, st, rgb))
+            return 0;
+        return c < 3 ? rgb[c] : 1;
+    }
+    if (!paged)
+        return pyramid[level].GetChannel(st, c, wrapMode);
+    const uint8_t *texel = PagedTexel(level, st);
+    return texel ? paged->Channel(texel, c) : 0;
+}
+
+Float MIPMap::BilerpChannel(int level, Point2f st, int c) const {
+    if (!paged && !compressed)
+        return pyramid[level].BilerpChannel(st, c, wrapMode);
+    // Interpolate the four texels around _st_ as _Image::BilerpChannel()_ does
+    Point2i res = levelResolutions[level];
+    Float x = st[0] * res.x - 0.5f, y = st[1] * res.y - 0.5f;
+    int xi = pstd::floor(x), yi = pstd::floor(y);
+    Float dx = x - xi, dy = y - yi;
+    pstd::array<Float, 4> v = {GetChannel(level, {xi, yi}, c),
+                               GetChannel(level, {xi + 1, yi}, c),
+                               GetChannel(level, {xi, yi + 1}, c),
+                               GetChannel(level, {xi + 1, yi + 1}, c)};
+    return ((1 - dx) * (1 - dy) * v[0] + dx * (1 - dy) * v[1] + (1 - dx) * dy * v[2] +
+            dx * dy * v[3]);
 }
 
 template <>
 Float MIPMap::Texel(int level, Point2i st) const {
-    DCHECK(level >= 0 && level < pyramid.size());
-    return pyramid[level].GetChannel(st, 0, wrapMode);
+    DCHECK(level >= 0 && level < Levels());
+    if (texelFloat)
+        return (this->*texelFloat)(level, st);
+    return GetChannel(level, st, 0);
 }
 
 template <>
 RGB MIPMap::Texel(int level, Point2i st) const {
-    DCHECK(level >= 0 && level < pyramid.size());
-    if (int nc = pyramid[level].NChannels(); nc == 3 || nc == 4)
+    DCHECK(level >= 0 && level < Levels());
+    if (texelRGB)
+        return (this->*texelRGB)(level, st);
+    if (nChannels == 3 || nChannels == 4) {
+        if (compressed) {
+            // Decode all three channels from the texel's block
+            Float rgb[3];
+            if (!CompressedTexel(level, st, rgb))
+                return RGB(0, 0, 0);
+            return RGB(rgb[0], rgb[1], rgb[2]);
+        }
+        if (paged) {
+            // Decode all three channels from the texel's tile
+            const uint8_t *texel = PagedTexel(level, st);
+            if (!texel)
+                return RGB(0, 0, 0);
+            return RGB(paged->Channel(texel, 0), paged->Channel(texel, 1),
+                       paged->Channel(texel, 2));
+        }
         return RGB(pyramid[level].GetChannel(st, 0, wrapMode),
                    pyramid[level].GetChannel(st, 1, wrapMode),
                    pyramid[level].GetChannel(st, 2, wrapMode));
-    else {
-        CHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].GetChannel(st, 0, wrapMode);
+    } else {
+        CHECK_EQ(1, nChannels);
+        Float v = GetChannel(level, st, 0);
         return RGB(v, v, v);
     }
 }
 
 template <typename T>
 T MIPMap::Filter(Point2f st, Vector2f dst0, Vector2f dst1) const {
+    PerfCounterScope _(PerfRegion::TextureFiltering);
+    ProfilerScope profile(ProfilePhase::TextureFiltering);
+    ++nMIPMapLookups;
     if (options.filter != FilterFunction::EWA) {
         // Handle non-EWA MIP Map filter
         Float width = 2 * std::max({std::abs(dst0[0]), std::abs(dst0[1]),
@@ -285,18 +996,282 @@ T MIPMap::Filter(Point2f st, Vector2f dst0, Vector2f dst1) const {
 
 template <>
 RGB MIPMap::Bilerp(int level, Point2f st) const {
-    DCHECK(level >= 0 && level < pyramid.size());
-    if (int nc = pyramid[level].NChannels(); nc == 3 || nc == 4)
-        return RGB(pyramid[level].BilerpChannel(st, 0, wrapMode),
-                   pyramid[level].BilerpChannel(st, 1, wrapMode),
-                   pyramid[level].BilerpChannel(st, 2, wrapMode));
+    DCHECK(level >= 0 && level < Levels());
+    if (bilerpRGB)
+        return (this->*bilerpRGB)(level, st);
+    if (nChannels == 3 || nChannels == 4)
+        return RGB(BilerpChannel(level, st, 0), BilerpChannel(level, st, 1),
+                   BilerpChannel(level, st, 2));
     else {
-        DCHECK_EQ(1, pyramid[level].NChannels());
-        Float v = pyramid[level].BilerpChannel(st, 0, wrapMode);
+        DCHECK_EQ(1, nChannels);
+        Float v = BilerpChannel(level, st, 0);
+        return RGB(v, v, v);
+    }
+}
+
+void MIPMap::InitResidentLookups(bool block, Allocator alloc) {
+    // Decode all 8-bit values so that lookups needn't call the encoding
+    if (pyramid[0].Format() == PixelFormat::U256) {
+        u256ToLinear.resize(256);
+        for (int v = 0; v < 256; ++v) {
+            uint8_t value = v;
+            pyramid[0].Encoding().ToLinear({&value, 1}, {&u256ToLinear[v], 1});
+        }
+    }
+
+    // Select the texel lookups for the levels' format and channel count
+    switch (pyramid[0].Format()) {
+    case PixelFormat::U256:
+        SetResidentLookups<uint8_t>(block, alloc);
+        break;
+    case PixelFormat::Half:
+        SetResidentLookups<Half>(block, alloc);
+        break;
+    case PixelFormat::Float:
+        SetResidentLookups<float>(block, alloc);
+        break;
+    default:
+        break;
+    }
+}
+
+template <typename Pixel>
+void MIPMap::SetResidentLookups(bool block, Allocator alloc) {
+    if (nChannels != 1 && nChannels != 3 && nChannels != 4)
+        return;
+    if (!block) {
+        for (const Image &image : pyramid)
+            levelTexels.push_back(image.RawPointer({0, 0}));
+        if (nChannels == 1)
+            SetResidentLookups<Pixel, 1, false>();
+        else if (nChannels == 3)
+            SetResidentLookups<Pixel, 3, false>();
+        else
+            SetResidentLookups<Pixel, 4, false>();
+        return;
+    }
+
+    // Copy the levels' texels into blocks and free the levels
+    auto levelBlocks = [](Point2i res) {
+        return int64_t((res.x + BlockSize - 1) / BlockSize) *
+               ((res.y + BlockSize - 1) / BlockSize);
+    };
+    int64_t nBlocks = 0;
+    for (Point2i res : levelResolutions)
+        nBlocks += levelBlocks(res);
+    size_t texelBytes = nChannels * sizeof(Pixel);
+    blockedTexels = pstd::vector<uint8_t>(nBlocks * Sqr(BlockSize) * texelBytes, alloc);
+    size_t offset = 0;
+    for (size_t level = 0; level < pyramid.size(); ++level) {
+        const Image &image = pyramid[level];
+        Point2i res = levelResolutions[level];
+        uint8_t *texels = blockedTexels.data() + offset;
+        ParallelFor(0, res.y, [&](int64_t y) {
+            for (int x = 0; x < res.x; ++x)
+                std::memcpy(texels + BlockedOffset(res, {x, int(y)}) * texelBytes,
+                            image.RawPointer({x, int(y)}), texelBytes);
+        });
+        levelTexels.push_back(texels);
+        offset += levelBlocks(res) * Sqr(BlockSize) * texelBytes;
+    }
+    pyramid.clear();
+    blocked = true;
+
+    if (nChannels == 1)
+        SetResidentLookups<Pixel, 1, true>();
+    else if (nChannels == 3)
+        SetResidentLookups<Pixel, 3, true>();
+    else
+        SetResidentLookups<Pixel, 4, true>();
+}
+
+template <typename Pixel, int NC, bool Blocked>
+void MIPMap::SetResidentLookups() {
+    texelFloat = &MIPMap::ResidentTexelFloat<Pixel, NC, Blocked>;
+    texelRGB = &MIPMap::ResidentTexelRGB<Pixel, NC, Blocked>;
+    bilerpFloat = &MIPMap::ResidentBilerpFloat<Pixel, NC, Blocked>;
+    bilerpRGB = &MIPMap::ResidentBilerpRGB<Pixel, NC, Blocked>;
+}
+
+template <typename Pixel>
+inline Float MIPMap::TexelValue(Pixel v) const {
+    if constexpr (std::is_same_v<Pixel, uint8_t>)
+        return u256ToLinear[v];
+    else
+        return Float(v);
+}
+
+template <typename Pixel, int NC, bool Blocked, int C0, int N>
+pstd::array<Float, N> MIPMap::ResidentTexel(int level, Point2i st) const {
+    // Return the linear values of channels $[C0, C0+N)$ of the texel as
+    // _Image::GetChannel()_ does
+    pstd::array<Float, N> v;
+    Point2i res = levelResolutions[level];
+    if (!RemapPixelCoords(&st, res, wrapMode)) {
+        v.fill(0);
+        return v;
+    }
+    int64_t offset = Blocked ? BlockedOffset(res, st) : int64_t(st.y) * res.x + st.x;
+    const Pixel *texel = (const Pixel *)levelTexels[level] + NC * offset + C0;
+    for (int c = 0; c < N; ++c)
+        v[c] = TexelValue(texel[c]);
+    return v;
+}
+
+template <typename Pixel, int NC, bool Blocked, int C0, int N>
+pstd::array<Float, N> MIPMap::ResidentBilerp(int level, Point2f st) const {
+    // Interpolate the four texels around _st_ as _Image::BilerpChannel()_ does
+    Point2i res = levelResolutions[level];
+    Float x = st[0] * res.x - 0.5f, y = st[1] * res.y - 0.5f;
+    int xi = pstd::floor(x), yi = pstd::floor(y);
+    Float dx = x - xi, dy = y - yi;
+    pstd::array<Float, N> v00 = ResidentTexel<Pixel, NC, Blocked, C0, N>(level, {xi, yi});
+    pstd::array<Float, N> v10 =
+        ResidentTexel<Pixel, NC, Blocked, C0, N>(level, {xi + 1, yi});
+    pstd::array<Float, N> v01 =
+        ResidentTexel<Pixel, NC, Blocked, C0, N>(level, {xi, yi + 1});
+    pstd::array<Float, N> v11 =
+        ResidentTexel<Pixel, NC, Blocked, C0, N>(level, {xi + 1, yi + 1});
+    pstd::array<Float, N> v;
+    for (int c = 0; c < N; ++c)
+        v[c] = ((1 - dx) * (1 - dy) * v00[c] + dx * (1 - dy) * v10[c] +
+                (1 - dx) * dy * v01[c] + dx * dy * v11[c]);
+    return v;
+}
+
+template <typename Pixel, int NC, bool Blocked>
+Float MIPMap::ResidentTexelFloat(int level, Point2i st) const {
+    return ResidentTexel<Pixel, NC, Blocked, 0, 1>(level, st)[0];
+}
+
+template <typename Pixel, int NC, bool Blocked>
+RGB MIPMap::ResidentTexelRGB(int level, Point2i st) const {
+    if constexpr (NC == 1) {
+        Float v = ResidentTexel<Pixel, 1, Blocked, 0, 1>(level, st)[0];
+        return RGB(v, v, v);
+    } else {
+        pstd::array<Float, 3> v = ResidentTexel<Pixel, NC, Blocked, 0, 3>(level, st);
+        return RGB(v[0], v[1], v[2]);
+    }
+}
+
+template <typename Pixel, int NC, bool Blocked>
+Float MIPMap::ResidentBilerpFloat(int level, Point2f st) const {
+    // Match _Bilerp<Float>()_: the average of RGB and the alpha of RGBA texels
+    if constexpr (NC == 1)
+        return ResidentBilerp<Pixel, 1, Blocked, 0, 1>(level, st)[0];
+    else if constexpr (NC == 3) {
+        pstd::array<Float, 3> v = ResidentBilerp<Pixel, 3, Blocked, 0, 3>(level, st);
+        return (v[0] + v[1] + v[2]) / 3;
+    } else
+        return ResidentBilerp<Pixel, 4, Blocked, 3, 1>(level, st)[0];
+}
+
+template <typename Pixel, int NC, bool Blocked>
+RGB MIPMap::ResidentBilerpRGB(int level, Point2f st) const {
+    if constexpr (NC == 1) {
+        Float v = ResidentBilerp<Pixel, 1, Blocked, 0, 1>(level, st)[0];
         return RGB(v, v, v);
+    } else {
+        pstd::array<Float, 3> v = ResidentBilerp<Pixel, NC, Blocked, 0, 3>(level, st);
+        return RGB(v[0], v[1], v[2]);
     }
 }
 
+// Adds the weighted sums of the first _nSum_ channels of the texels of a
+// scanline at the given _x_ coordinates to _sums_, using _convert_ to find
+// linear values; negative coordinates are skipped.
+template <typename Texel, typename Convert>
+static void AccumulateSpan(const Texel *row, int nc, const int *x, int n,
+                           const Float *weights, int nSum, Convert convert,
+                           Float sums[3]) {
+    if (nSum == 1) {
+        for (int i = 0; i < n; ++i)
+            if (x[i] >= 0)
+                sums[0] += weights[i] * convert(row[x[i] * nc]);
+    } else
+        for (int i = 0; i < n; ++i)
+            if (x[i] >= 0) {
+                const Texel *texel = row + x[i] * nc;
+                sums[0] += weights[i] * convert(texel[0]);
+                sums[1] += weights[i] * convert(texel[1]);
+                sums[2] += weights[i] * convert(texel[2]);
+            }
+}
+
+template <typename T>
+T MIPMap::WeightedTexelSum(int level, Point2i st, int n, const Float *weights) const {
+    // Sum a single channel for _Float_ lookups and for one-channel images
+    int nSum = (std::is_same_v<T, Float> || nChannels == 1) ? 1 : 3;
+    Float sums[3] = {0, 0, 0};
+    int x[EWASpanSize];
+    Point2i res = levelResolutions[level];
+    if (paged || compressed || blocked || wrapMode == WrapMode::OctahedralSphere) {
+        // Look up the span's texels individually, since their storage isn't
+        // a scanline or the wrap mode couples their coordinates
+        Float texels[3 * EWASpanSize];
+        for (int i = 0; i < n; ++i) {
+            x[i] = i;
+            if (nSum == 1)
+                texels[i] = Texel<Float>(level, {st.x + i, st.y});
+            else {
+                RGB rgb = Texel<RGB>(level, {st.x + i, st.y});
+                for (int c = 0; c < 3; ++c)
+                    texels[3 * i + c] = rgb[c];
+            }
+        }
+        AccumulateSpan(texels, nSum, x, n, weights, nSum, [](Float v) { return v; },
+                       sums);
+
+    } else {
+        // Apply the wrap mode to the span's scanline and texels separately
+        Point2i row(0, st.y);
+        if (!RemapPixelCoords(&row, res, wrapMode))
+            return T{};
+        if (wrapMode == WrapMode::Repeat)
+            for (int i = 0, s = Mod(st.x, res.x); i < n; ++i) {
+                x[i] = s;
+                if (++s == res.x)
+                    s = 0;
+            }
+        else if (wrapMode == WrapMode::Clamp)
+            for (int i = 0; i < n; ++i)
+                x[i] = Clamp(st.x + i, 0, res.x - 1);
+        else
+            for (int i = 0; i < n; ++i)
+                x[i] = (st.x + i >= 0 && st.x + i < res.x) ? st.x + i : -1;
+
+        // Read the texels directly from the level's scanline
+        const Image &image = pyramid[level];
+        const void *texels = image.RawPointer(row);
+        switch (image.Format()) {
+        case PixelFormat::U256: {
+            const Float *toLinear = u256ToLinear.data();
+            AccumulateSpan((const uint8_t *)texels, nChannels, x, n, weights, nSum,
+                           [=](uint8_t v) { return toLinear[v]; }, sums);
+            break;
+        }
+        case PixelFormat::Half:
+            AccumulateSpan((const Half *)texels, nChannels, x, n, weights, nSum,
+                           [](Half v) { return Float(v); }, sums);
+            break;
+        case PixelFormat::Float:
+            AccumulateSpan((const float *)texels, nChannels, x, n, weights, nSum,
+                           [](float v) { return v; }, sums);
+            break;
+        default:
+            LOG_FATAL("Unhandled PixelFormat");
+        }
+    }
+
+    if constexpr (std::is_same_v<T, Float>)
+        return sums[0];
+    else if (nSum == 1)
+        return RGB(sums[0], sums[0], sums[0]);
+    else
+        return RGB(sums[0], sums[1], sums[2]);
+}
+
 template <typename T>
 T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     if (level >= Levels())
@@ -333,16 +1308,31 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     Float sumWts = 0;
     for (int it = t0; it <= t1; ++it) {
         Float tt = it - st[1];
-        for (int is = s0; is <= s1; ++is) {
-            Float ss = is - st[0];
-            // Compute squared radius and filter texel if it is inside the ellipse
-            Float r2 = A * Sqr(ss) + B * ss * tt + C * Sqr(tt);
-            if (r2 < 1) {
+        // Find the scanline's span of texels inside the ellipse; texels that
+        // round-off error misplaces are at its edge, where the weight is zero
+        Float b = B * tt, c = C * Sqr(tt) - 1;
+        Float discrim = Sqr(b) - 4 * A * c;
+        if (discrim <= 0)
+            continue;
+        Float rootDiscrim = std::sqrt(discrim);
+        int is0 = std::max<int>(s0, pstd::ceil(st[0] + (-b - rootDiscrim) / (2 * A)));
+        int is1 = std::min<int>(s1, pstd::floor(st[0] + (-b + rootDiscrim) / (2 * A)));
+
+        for (int is = is0; is <= is1; is += EWASpanSize) {
+            // Compute squared radii and filter weights for the span's texels
+            int n = std::min(EWASpanSize, is1 - is + 1);
+            Float weights[EWASpanSize];
+            for (int i = 0; i < n; ++i) {
+                // The table's last entry is zero, so texels outside the
+                // ellipse get zero weight
+                Float ss = is + i - st[0];
+                Float r2 = (A * ss + b) * ss + C * Sqr(tt);
                 int index = std::min<int>(r2 * MIPFilterLUTSize, MIPFilterLUTSize - 1);
-                Float weight = MIPFilterLUT[index];
-                sum += weight * Texel<T>(level, {is, it});
-                sumWts += weight;
+                weights[i] = MIPFilterLUT[index];
+                sumWts += weights[i];
             }
+            // Filter the span's texels
+            sum += WeightedTexelSum<T>(level, {is, it}, n, weights);
         }
     }
     return sum / sumWts;
@@ -351,7 +1341,33 @@ T MIPMap::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
 MIPMap *MIPMap::CreateFromFile(const std::string &filename,
                                const MIPMapFilterOptions &options, WrapMode wrapMode,
                                ColorEncoding encoding, Allocator alloc) {
-    ImageAndMetadata imageAndMetadata = Image::Read(filename, alloc, encoding);
+    if (HasExtension(filename, "mip"))
+        return ReadTiled(filename, options, wrapMode, alloc);
+
+    // Look for a tiled MIP map of the image in the scene cache
+    std::string cacheFilename;
+    if (!Options->sceneCacheDirectory.empty() && !Options->useGPU && !CompressMIPMaps() &&
+        FileExists(filename)) {
+        std::string contents = ReadFileContents(filename);
+        uint64_t key = HashBuffer(contents.data(), contents.size(),
+                                  Hash(TiledMIPMapVersion, wrapMode));
+        std::string encodingName = encoding.Name();
+        key = HashBuffer(encodingName.data(), encodingName.size(), key);
+        cacheFilename =
+            StringPrintf("%s/mip-%016x.mip", Options->sceneCacheDirectory, key);
+        if (FileExists(cacheFilename)) {
+            ++nMIPMapCacheHits;
+            return ReadTiled(cacheFilename, options, wrapMode, alloc);
+        }
+        ++nMIPMapCacheMisses;
+    }
+
+    // Images that will be paged, compressed, or blocked are freed once they're
+    // on disk, compressed, or copied, so they can't come from _alloc_, which
+    // may never release memory
+    Allocator imageAlloc =
+        (PageMIPMaps() || CompressMIPMaps() || BlockMIPMaps()) ? Allocator() : alloc;
+    ImageAndMetadata imageAndMetadata = Image::Read(filename, imageAlloc, encoding);
 
     Image &image = imageAndMetadata.image;
     if (image.NChannels() != 1) {
@@ -366,18 +1382,37 @@ MIPMap *MIPMap::CreateFromFile(const std::string &filename,
                     if (image.GetChannels({x, y}, rgbaDesc)[3] != 1)
                         allOne = false;
             if (allOne)
-                image = image.SelectChannels(rgbDesc, alloc);
+                image = image.SelectChannels(rgbDesc, imageAlloc);
             else
-                image = image.SelectChannels(rgbaDesc, alloc);
+                image = image.SelectChannels(rgbaDesc, imageAlloc);
         } else {
             if (rgbDesc)
-                image = image.SelectChannels(rgbDesc, alloc);
+                image = image.SelectChannels(rgbDesc, imageAlloc);
             else
                 ErrorExit("%s: image doesn't have R, G, and B channels", filename);
         }
     }
 
     const RGBColorSpace *colorSpace = imageAndMetadata.metadata.GetColorSpace();
+    if (!cacheFilename.empty()) {
+        // Write the image's pyramid to the scene cache and map it from there
+        MIPMap mipmap(colorSpace, wrapMode, options);
+        mipmap.pyramid = Image::GeneratePyramid(std::move(image), wrapMode, Allocator());
+        mipmap.nChannels = mipmap.pyramid[0].NChannels();
+        for (const Image &im : mipmap.pyramid)
+            mipmap.levelResolutions.push_back(im.Resolution());
+        // Write to a temporary file so that concurrent renders never see
+        // partial caches
+        std::string tempFilename = StringPrintf("%s.%p.tmp", cacheFilename, &mipmap);
+        if (mipmap.WriteTiled(tempFilename) &&
+            std::rename(tempFilename.c_str(), cacheFilename.c_str()) == 0) {
+            LOG_VERBOSE("Wrote MIP map cache file %s for %s", cacheFilename, filename);
+            return ReadTiled(cacheFilename, options, wrapMode, alloc);
+        }
+        Warning("%s: unable to write MIP map cache file.", cacheFilename);
+        RemoveFile(tempFilename);
+        image = std::move(mipmap.pyramid[0]);
+    }
     return alloc.new_object<MIPMap>(std::move(image), colorSpace, wrapMode, alloc,
                                     options);
 }
@@ -394,24 +1429,75 @@ T MIPMap::Bilerp(int level, Point2f st) const {
 
 template <>
 Float MIPMap::Bilerp(int level, Point2f st) const {
-    CHECK(level >= 0 && level < pyramid.size());
-    switch (pyramid[level].NChannels()) {
+    CHECK(level >= 0 && level < Levels());
+    if (bilerpFloat)
+        return (this->*bilerpFloat)(level, st);
+    switch (nChannels) {
     case 1:
-        return pyramid[level].BilerpChannel(st, 0, wrapMode);
+        return BilerpChannel(level, st, 0);
     case 3:
-        return pyramid[level].Bilerp(st, wrapMode).Average();
+        return (BilerpChannel(level, st, 0) + BilerpChannel(level, st, 1) +
+                BilerpChannel(level, st, 2)) /
+               3;
     case 4:
         // Return alpha
-        return pyramid[level].BilerpChannel(st, 3, wrapMode);
+        return BilerpChannel(level, st, 3);
     default:
-        LOG_FATAL("Unexpected number of image channels: %d", pyramid[level].NChannels());
+        LOG_FATAL("Unexpected number of image channels: %d", nChannels);
     }
 }
 
+pstd::optional<RGB> MIPMap::ConstantRGB() const {
+    // Lookups outside the image return black with the black wrap mode
+    if (wrapMode == WrapMode::Black)
+        return {};
+    Point2i res = levelResolutions[0];
+    RGB rgb = Texel<RGB>(0, {0, 0});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            if (Texel<RGB>(0, {x, y}) != rgb)
+                return {};
+    return rgb;
+}
+
+pstd::optional<Interval> MIPMap::TexelRange(Bounds2f st, int64_t maxTexels) const {
+    // Find the level 0 texels that bilinear and point lookups inside _st_ use
+    Point2i res = levelResolutions[0];
+    Float nx = (st.pMax.x - st.pMin.x) * res.x + 2;
+    Float ny = (st.pMax.y - st.pMin.y) * res.y + 2;
+    if (!(nx * ny <= maxTexels))
+        return {};
+    Point2i p0(pstd::floor(st.pMin.x * res.x - 0.5f),
+               pstd::floor(st.pMin.y * res.y - 0.5f));
+    Point2i p1(pstd::floor(st.pMax.x * res.x - 0.5f) + 1,
+               pstd::floor(st.pMax.y * res.y - 0.5f) + 1);
+
+    // Bound the texels' values both as _Texel()_ and _Bilerp()_ compute them
+    Float low = Infinity, high = -Infinity;
+    auto include = [&](Float v) {
+        low = std::min(low, v);
+        high = std::max(high, v);
+    };
+    for (int y = p0.y; y <= p1.y; ++y)
+        for (int x = p0.x; x <= p1.x; ++x) {
+            Point2i sti(x, y);
+            include(GetChannel(0, sti, 0));
+            if (nChannels == 3)
+                include((GetChannel(0, sti, 0) + GetChannel(0, sti, 1) +
+                         GetChannel(0, sti, 2)) /
+                        3);
+            else if (nChannels == 4)
+                include(GetChannel(0, sti, 3));
+        }
+    return Interval(low, high);
+}
+
 std::string MIPMap::ToString() const {
-    return StringPrintf("[ MIPMap pyramid: %s colorSpace: %s wrapMode: %s "
+    return StringPrintf("[ MIPMap pyramid: %s levelResolutions: %s paged: %s "
+                        "compressed: %s blocked: %s colorSpace: %s wrapMode: %s "
                         "options: %s ]",
-                        pyramid, colorSpace->ToString(), wrapMode, options);
+                        pyramid, levelResolutions, IsPaged(), IsCompressed(), blocked,
+                        colorSpace->ToString(), wrapMode, options);
 }
 
 // Explicit template instantiation..
@@ -51,37 +51,131 @@ class MIPMap {
     // MIPMap Public Methods
     MIPMap(Image image, const RGBColorSpace *colorSpace, WrapMode wrapMode,
            Allocator alloc, const MIPMapFilterOptions &options);
+    ~MIPMap();
     static MIPMap *CreateFromFile(const std::string &filename,
                                   const MIPMapFilterOptions &options, WrapMode wrapMode,
                                   ColorEncoding encoding, Allocator alloc);
 
+    // Writes the MIP map's levels to a tiled MIP map file, which
+    // CreateFromFile() maps into memory rather than generating the pyramid
+    // again when its name has the ".mip" extension.
+    bool WriteTiled(const std::string &filename) const;
+
     template <typename T>
     T Filter(Point2f st, Vector2f dstdx, Vector2f dstdy) const;
 
     std::string ToString() const;
 
     Point2i LevelResolution(int level) const {
-        CHECK(level >= 0 && level < pyramid.size());
-        return pyramid[level].Resolution();
+        CHECK(level >= 0 && level < levelResolutions.size());
+        return levelResolutions[level];
     }
-    int Levels() const { return int(pyramid.size()); }
+    int Levels() const { return int(levelResolutions.size()); }
     const RGBColorSpace *GetRGBColorSpace() const { return colorSpace; }
-    const Image &GetLevel(int level) const { return pyramid[level]; }
+    WrapMode GetWrapMode() const { return wrapMode; }
+    const MIPMapFilterOptions &GetFilterOptions() const { return options; }
+    const Image &GetLevel(int level) const {
+        CHECK(!paged && !compressed && !blocked);
+        return pyramid[level];
+    }
+
+    // Returns whether the MIP map's levels are kept on disk, with their tiles
+    // loaded on demand into the global texture tile cache, or are read from
+    // a memory-mapped tiled MIP map file.
+    bool IsPaged() const { return paged != nullptr; }
+    // Returns whether the MIP map's levels are stored block-compressed.
+    bool IsCompressed() const { return compressed != nullptr; }
+    // Returns whether the MIP map's resident levels are stored in square
+    // blocks of texels rather than scanlines, so that filter footprints
+    // touch fewer cache lines and pages.
+    bool IsBlocked() const { return blocked; }
+
+    // Returns the RGB value that all filtered lookups return if every texel
+    // of the image is the same color
+    pstd::optional<RGB> ConstantRGB() const;
+    // Returns bounds on the values that Float lookups with zero-width filters
+    // return inside _st_, if they are found with at most _maxTexels_ texels.
+    pstd::optional<Interval> TexelRange(Bounds2f st, int64_t maxTexels) const;
 
   private:
+    // MIPMap Private Types
+    struct PagedPyramid;
+    struct CompressedPyramid;
+    static constexpr int BlockSize = 4;
+
     // MIPMap Private Methods
+    MIPMap(const RGBColorSpace *colorSpace, WrapMode wrapMode,
+           const MIPMapFilterOptions &options);
+    static MIPMap *ReadTiled(const std::string &filename,
+                             const MIPMapFilterOptions &options, WrapMode wrapMode,
+                             Allocator alloc);
+    std::unique_ptr<PagedPyramid> TileLayout() const;
+    void Page();
+    const uint8_t *PagedTexel(int level, Point2i st) const;
+    void Compress(Allocator alloc);
+    bool CompressedTexel(int level, Point2i st, Float rgb[3]) const;
+    Float GetChannel(int level, Point2i st, int c) const;
+    Float BilerpChannel(int level, Point2f st, int c) const;
+
     template <typename T>
     T Texel(int level, Point2i st) const;
     template <typename T>
     T Bilerp(int level, Point2f st) const;
     template <typename T>
     T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
+    template <typename T>
+    T WeightedTexelSum(int level, Point2i st, int n, const Float *weights) const;
+
+    void InitResidentLookups(bool block, Allocator alloc);
+    template <typename Pixel>
+    void SetResidentLookups(bool block, Allocator alloc);
+    template <typename Pixel, int NC, bool Blocked>
+    void SetResidentLookups();
+    // Returns the index of texel _st_ of a level stored in blocks of
+    // _BlockSize_x_BlockSize_ texels that are each contiguous in memory
+    static int64_t BlockedOffset(Point2i res, Point2i st) {
+        int blocksX = (res.x + BlockSize - 1) / BlockSize;
+        int64_t block = int64_t(st.y / BlockSize) * blocksX + st.x / BlockSize;
+        return block * (BlockSize * BlockSize) + (st.y % BlockSize) * BlockSize +
+               st.x % BlockSize;
+    }
+    template <typename Pixel>
+    Float TexelValue(Pixel v) const;
+    template <typename Pixel, int NC, bool Blocked, int C0, int N>
+    pstd::array<Float, N> ResidentTexel(int level, Point2i st) const;
+    template <typename Pixel, int NC, bool Blocked, int C0, int N>
+    pstd::array<Float, N> ResidentBilerp(int level, Point2f st) const;
+    template <typename Pixel, int NC, bool Blocked>
+    Float ResidentTexelFloat(int level, Point2i st) const;
+    template <typename Pixel, int NC, bool Blocked>
+    RGB ResidentTexelRGB(int level, Point2i st) const;
+    template <typename Pixel, int NC, bool Blocked>
+    Float ResidentBilerpFloat(int level, Point2f st) const;
+    template <typename Pixel, int NC, bool Blocked>
+    RGB ResidentBilerpRGB(int level, Point2f st) const;
 
     // MIPMap Private Members
     pstd::vector<Image> pyramid;
+    std::vector<Point2i> levelResolutions;
+    int nChannels;
+    std::unique_ptr<PagedPyramid> paged;
+    std::unique_ptr<CompressedPyramid> compressed;
     const RGBColorSpace *colorSpace;
     WrapMode wrapMode;
     MIPMapFilterOptions options;
+    // Linear values of the 8-bit texels of resident levels
+    std::vector<Float> u256ToLinear;
+    // Lookups specialized to the resident levels' pixel format and channel
+    // count, so that they don't switch on them for each texel; they are
+    // unset for paged and compressed MIP maps.
+    std::vector<const void *> levelTexels;
+    // All levels' texels in blocks, if the levels are stored that way
+    pstd::vector<uint8_t> blockedTexels;
+    bool blocked = false;
+    Float (MIPMap::*texelFloat)(int, Point2i) const = nullptr;
+    RGB (MIPMap::*texelRGB)(int, Point2i) const = nullptr;
+    Float (MIPMap::*bilerpFloat)(int, Point2f) const = nullptr;
+    RGB (MIPMap::*bilerpRGB)(int, Point2f) const = nullptr;
 };
 
 }  // namespace pbrt
@@ -0,0 +1,91 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/options.h>
+#include <pbrt/util/color.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/mipmap.h>
+#include <pbrt/util/rng.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace pbrt;
+
+// Filters lookups with random footprints, from less than a texel to
+// anisotropic ones that span many texels, in a MIP map of a 512x512 RGB image.
+static void MIPMap_Filter(benchmark::State &state, FilterFunction filter) {
+    Point2i res(512, 512);
+    Image image(PixelFormat::Half, res, {"R", "G", "B"});
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            image.SetChannels({x, y}, {Float(x & 31) / 31, Float(y & 63) / 63,
+                                       Float((x ^ y) & 15) / 15});
+    MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Repeat, Allocator(),
+                  MIPMapFilterOptions{filter});
+
+    struct Lookup {
+        Point2f st;
+        Vector2f dst0, dst1;
+    };
+    RNG rng;
+    std::vector<Lookup> lookups(1024);
+    for (Lookup &l : lookups) {
+        l.st = Point2f(rng.Uniform<Float>(), rng.Uniform<Float>());
+        Float width = std::pow(2.f, -12 + 10 * rng.Uniform<Float>());
+        l.dst0 = width * Vector2f(1, rng.Uniform<Float>());
+        l.dst1 = width * Vector2f(rng.Uniform<Float>() - 0.5f, 0.25f);
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const Lookup &l = lookups[i];
+        benchmark::DoNotOptimize(mipmap.Filter<RGB>(l.st, l.dst0, l.dst1));
+        i = (i + 1) % lookups.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_CAPTURE(MIPMap_Filter, Point, FilterFunction::Point);
+BENCHMARK_CAPTURE(MIPMap_Filter, Bilinear, FilterFunction::Bilinear);
+BENCHMARK_CAPTURE(MIPMap_Filter, Trilinear, FilterFunction::Trilinear);
+BENCHMARK_CAPTURE(MIPMap_Filter, EWA, FilterFunction::EWA);
+
+// Bilinearly filters lookups at random points of a 4096x4096 8-bit RGB
+// texture, as incoherent secondary rays do, with the levels stored in
+// scanlines or in blocks of texels.
+static void MIPMap_IncoherentBilerp(benchmark::State &state, bool blocked) {
+    Point2i res(4096, 4096);
+    Image image(PixelFormat::U256, res, {"R", "G", "B"}, ColorEncoding::sRGB);
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            image.SetChannels({x, y}, {rng.Uniform<Float>(), rng.Uniform<Float>(),
+                                       rng.Uniform<Float>()});
+    Options->blockTextures = blocked;
+    MIPMap mipmap(image, RGBColorSpace::sRGB, WrapMode::Repeat, Allocator(),
+                  MIPMapFilterOptions{FilterFunction::Bilinear});
+    Options->blockTextures = false;
+
+    std::vector<Point2f> st(1 << 16);
+    for (Point2f &p : st)
+        p = Point2f(rng.Uniform<Float>(), rng.Uniform<Float>());
+    // A small footprint at the finest level, spanning about two texels
+    Vector2f dst0(1.f / 4096, 0), dst1(0, 1.f / 4096);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mipmap.Filter<RGB>(st[i], dst0, dst1));
+        i = (i + 1) % st.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_CAPTURE(MIPMap_IncoherentBilerp, Scanlines, false);
+BENCHMARK_CAPTURE(MIPMap_IncoherentBilerp, Blocked, true);
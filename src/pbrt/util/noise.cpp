@@ -4,6 +4,7 @@
 
 #include <pbrt/util/noise.h>
 
+#include <pbrt/util/check.h>
 #include <pbrt/util/vecmath.h>
 
 #include <algorithm>
@@ -14,6 +15,8 @@ namespace pbrt {
 PBRT_CPU_GPU
 inline Float Grad(int x, int y, int z, Float dx, Float dy, Float dz);
 PBRT_CPU_GPU
+inline Float GradFromHash(int h, Float dx, Float dy, Float dz);
+PBRT_CPU_GPU
 inline Float NoiseWeight(Float t);
 
 // Perlin Noise Data
@@ -91,11 +94,118 @@ Float Noise(Point3f p) {
     return Noise(p.x, p.y, p.z);
 }
 
+// Noise is evaluated at this many points at a time on the CPU; everything
+// other than the permutation table lookups is written as loops over the
+// points so that the compiler can vectorize it.
+static constexpr int NoiseBatchSize = 8;
+
+#ifndef PBRT_IS_GPU_CODE
+// Evaluates Noise() at _NoiseBatchSize_ points, computing each value with
+// the same operations as the scalar version
+static void NoiseBatch(const Point3f *p, Float *result) {
+    constexpr int n = NoiseBatchSize;
+    // Compute noise cell coordinates and offsets
+    Float x[n], y[n], z[n];
+    bool wrap = false;
+    for (int i = 0; i < n; ++i) {
+        x[i] = p[i].x;
+        y[i] = p[i].y;
+        z[i] = p[i].z;
+        wrap |= !(std::abs(x[i]) < Float(1 << 30)) | !(std::abs(y[i]) < Float(1 << 30)) |
+                !(std::abs(z[i]) < Float(1 << 30));
+    }
+    // fmod() returns smaller coordinates unchanged, so it is only called
+    // when some coordinate may be too large to store in an int32
+    if (wrap)
+        for (int i = 0; i < n; ++i) {
+            x[i] = pstd::fmod(x[i], Float(1 << 30));
+            y[i] = pstd::fmod(y[i], Float(1 << 30));
+            z[i] = pstd::fmod(z[i], Float(1 << 30));
+        }
+    int ix[n], iy[n], iz[n];
+    Float dx[n], dy[n], dz[n];
+    for (int i = 0; i < n; ++i) {
+        ix[i] = pstd::floor(x[i]);
+        iy[i] = pstd::floor(y[i]);
+        iz[i] = pstd::floor(z[i]);
+        dx[i] = x[i] - ix[i];
+        dy[i] = y[i] - iy[i];
+        dz[i] = z[i] - iz[i];
+        ix[i] &= NoisePermSize - 1;
+        iy[i] &= NoisePermSize - 1;
+        iz[i] &= NoisePermSize - 1;
+    }
+
+    // Look up hash values for cell corners, sharing the partial lookups
+    int h000[n], h100[n], h010[n], h110[n], h001[n], h101[n], h011[n], h111[n];
+    for (int i = 0; i < n; ++i) {
+        int a = NoisePerm[ix[i]] + iy[i], b = NoisePerm[ix[i] + 1] + iy[i];
+        int aa = NoisePerm[a] + iz[i], ab = NoisePerm[a + 1] + iz[i];
+        int ba = NoisePerm[b] + iz[i], bb = NoisePerm[b + 1] + iz[i];
+        h000[i] = NoisePerm[aa];
+        h100[i] = NoisePerm[ba];
+        h010[i] = NoisePerm[ab];
+        h110[i] = NoisePerm[bb];
+        h001[i] = NoisePerm[aa + 1];
+        h101[i] = NoisePerm[ba + 1];
+        h011[i] = NoisePerm[ab + 1];
+        h111[i] = NoisePerm[bb + 1];
+    }
+
+    // Compute gradient weights and their trilinear interpolation
+    for (int i = 0; i < n; ++i) {
+        Float w000 = GradFromHash(h000[i], dx[i], dy[i], dz[i]);
+        Float w100 = GradFromHash(h100[i], dx[i] - 1, dy[i], dz[i]);
+        Float w010 = GradFromHash(h010[i], dx[i], dy[i] - 1, dz[i]);
+        Float w110 = GradFromHash(h110[i], dx[i] - 1, dy[i] - 1, dz[i]);
+        Float w001 = GradFromHash(h001[i], dx[i], dy[i], dz[i] - 1);
+        Float w101 = GradFromHash(h101[i], dx[i] - 1, dy[i], dz[i] - 1);
+        Float w011 = GradFromHash(h011[i], dx[i], dy[i] - 1, dz[i] - 1);
+        Float w111 = GradFromHash(h111[i], dx[i] - 1, dy[i] - 1, dz[i] - 1);
+
+        Float wx = NoiseWeight(dx[i]), wy = NoiseWeight(dy[i]), wz = NoiseWeight(dz[i]);
+        Float x00 = Lerp(wx, w000, w100);
+        Float x10 = Lerp(wx, w010, w110);
+        Float x01 = Lerp(wx, w001, w101);
+        Float x11 = Lerp(wx, w011, w111);
+        Float y0 = Lerp(wy, x00, x10);
+        Float y1 = Lerp(wy, x01, x11);
+        result[i] = Lerp(wz, y0, y1);
+    }
+}
+#endif  // PBRT_IS_GPU_CODE
+
+void Noise(pstd::span<const Point3f> p, pstd::span<Float> result) {
+    DCHECK_EQ(p.size(), result.size());
+#ifdef PBRT_IS_GPU_CODE
+    for (size_t i = 0; i < p.size(); ++i)
+        result[i] = Noise(p[i]);
+#else
+    for (size_t start = 0; start < p.size(); start += NoiseBatchSize) {
+        // Evaluate a full batch of points, padding the last one if needed
+        size_t count = std::min<size_t>(NoiseBatchSize, p.size() - start);
+        Point3f pBatch[NoiseBatchSize] = {};
+        Float noise[NoiseBatchSize];
+        for (size_t i = 0; i < count; ++i)
+            pBatch[i] = p[start + i];
+        NoiseBatch(pBatch, noise);
+        for (size_t i = 0; i < count; ++i)
+            result[start + i] = noise[i];
+    }
+#endif
+}
+
 inline Float Grad(int x, int y, int z, Float dx, Float dy, Float dz) {
-    int h = NoisePerm[NoisePerm[NoisePerm[x] + y] + z];
+    return GradFromHash(NoisePerm[NoisePerm[NoisePerm[x] + y] + z], dx, dy, dz);
+}
+
+inline Float GradFromHash(int h, Float dx, Float dy, Float dz) {
     h &= 15;
-    Float u = h < 8 || h == 12 || h == 13 ? dx : dy;
-    Float v = h < 4 || h == 12 || h == 13 ? dy : dz;
+    // The conditions are combined without short-circuiting so that this is
+    // branch-free, which lets the batched evaluation vectorize it
+    bool h12or13 = (h & 14) == 12;
+    Float u = (h < 8) | h12or13 ? dx : dy;
+    Float v = (h < 4) | h12or13 ? dy : dz;
     return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
 }
 
@@ -105,12 +215,40 @@ inline Float NoiseWeight(Float t) {
 
 Vector3f DNoise(Point3f p) {
     Float delta = .01f;
-    Float n = Noise(p);
-    Point3f noiseDelta(Noise(p + Vector3f(delta, 0, 0)), Noise(p + Vector3f(0, delta, 0)),
-                       Noise(p + Vector3f(0, 0, delta)));
+    Point3f pts[4] = {p, p + Vector3f(delta, 0, 0), p + Vector3f(0, delta, 0),
+                      p + Vector3f(0, 0, delta)};
+    Float noise[4];
+    Noise(pts, noise);
+    Float n = noise[0];
+    Point3f noiseDelta(noise[1], noise[2], noise[3]);
     return (noiseDelta - Point3f(n, n, n)) / delta;
 }
 
+// Calls _f_ with the index and value of each of the first _nOctaves_ octaves
+// of noise at _p_, in order; on the CPU, the noise values are computed in
+// batches.
+template <typename F>
+PBRT_CPU_GPU static void ForEachOctave(Point3f p, int nOctaves, F f) {
+    Float lambda = 1;
+    for (int start = 0; start < nOctaves; start += NoiseBatchSize) {
+        int count = std::min(NoiseBatchSize, nOctaves - start);
+        Point3f pOctave[NoiseBatchSize] = {};
+        Float noise[NoiseBatchSize];
+        for (int i = 0; i < count; ++i) {
+            pOctave[i] = lambda * p;
+            lambda *= 1.99f;
+        }
+#ifdef PBRT_IS_GPU_CODE
+        for (int i = 0; i < count; ++i)
+            noise[i] = Noise(pOctave[i]);
+#else
+        NoiseBatch(pOctave, noise);
+#endif
+        for (int i = 0; i < count; ++i)
+            f(start + i, noise[i]);
+    }
+}
+
 Float FBm(Point3f p, Vector3f dpdx, Vector3f dpdy, Float omega, int maxOctaves) {
     // Compute number of octaves for antialiased FBm
     Float len2 = std::max(LengthSquared(dpdx), LengthSquared(dpdy));
@@ -118,14 +256,15 @@ Float FBm(Point3f p, Vector3f dpdx, Vector3f dpdy, Float omega, int maxOctaves)
     int nInt = pstd::floor(n);
 
     // Compute sum of octaves of noise for FBm
-    Float sum = 0, lambda = 1, o = 1;
-    for (int i = 0; i < nInt; ++i) {
-        sum += o * Noise(lambda * p);
-        lambda *= 1.99f;
-        o *= omega;
-    }
+    Float sum = 0, o = 1;
     Float nPartial = n - nInt;
-    sum += o * SmoothStep(nPartial, .3f, .7f) * Noise(lambda * p);
+    ForEachOctave(p, nInt + 1, [&](int i, Float noise) {
+        if (i < nInt) {
+            sum += o * noise;
+            o *= omega;
+        } else
+            sum += o * SmoothStep(nPartial, .3f, .7f) * noise;
+    });
 
     return sum;
 }
@@ -137,16 +276,17 @@ Float Turbulence(Point3f p, Vector3f dpdx, Vector3f dpdy, Float omega, int maxOc
     int nInt = pstd::floor(n);
 
     // Compute sum of octaves of noise for turbulence
-    Float sum = 0, lambda = 1, o = 1;
-    for (int i = 0; i < nInt; ++i) {
-        sum += o * std::abs(Noise(lambda * p));
-        lambda *= 1.99f;
-        o *= omega;
-    }
-
-    // Account for contributions of clamped octaves in turbulence
+    Float sum = 0, o = 1;
     Float nPartial = n - nInt;
-    sum += o * Lerp(SmoothStep(nPartial, .3f, .7f), 0.2, std::abs(Noise(lambda * p)));
+    ForEachOctave(p, nInt + 1, [&](int i, Float noise) {
+        if (i < nInt) {
+            sum += o * std::abs(noise);
+            o *= omega;
+        } else {
+            // Account for contributions of clamped octaves in turbulence
+            sum += o * Lerp(SmoothStep(nPartial, .3f, .7f), 0.2, std::abs(noise));
+        }
+    });
     for (int i = nInt; i < maxOctaves; ++i) {
         sum += o * 0.2f;
         o *= omega;
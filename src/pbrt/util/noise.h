@@ -7,12 +7,18 @@
 
 #include <pbrt/pbrt.h>
 
+#include <pbrt/util/pstd.h>
+
 namespace pbrt {
 
 PBRT_CPU_GPU
 Float Noise(Float x, Float y = .5f, Float z = .5f);
 PBRT_CPU_GPU
 Float Noise(Point3f p);
+// Evaluates Noise() at each of the points _p_, giving the same values as
+// evaluating them one at a time; on the CPU they are processed in batches.
+PBRT_CPU_GPU
+void Noise(pstd::span<const Point3f> p, pstd::span<Float> result);
 PBRT_CPU_GPU
 Vector3f DNoise(Point3f p);
 PBRT_CPU_GPU
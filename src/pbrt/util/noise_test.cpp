@@ -0,0 +1,73 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/math.h>
+#include <pbrt/util/noise.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/vecmath.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace pbrt;
+
+TEST(Noise, BatchMatchesScalar) {
+    RNG rng;
+    // Include points that are too large to be stored in int32s
+    std::vector<Point3f> p;
+    for (int i = 0; i < 1000; ++i) {
+        Float scale = (i % 100 == 0) ? 3e9f : 100.f;
+        p.push_back(Point3f(Lerp(rng.Uniform<Float>(), -scale, scale),
+                            Lerp(rng.Uniform<Float>(), -scale, scale),
+                            Lerp(rng.Uniform<Float>(), -scale, scale)));
+    }
+
+    // Check a range of counts, including ones that don't fill a batch
+    for (size_t n : {1, 3, 8, 13, 1000}) {
+        std::vector<Float> noise(n);
+        Noise(pstd::span<const Point3f>(p.data(), n), pstd::span<Float>(noise));
+        for (size_t i = 0; i < n; ++i)
+            EXPECT_EQ(Noise(p[i]), noise[i]) << p[i];
+    }
+}
+
+TEST(Noise, FBmTurbulenceMatchOctaveSums) {
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Point3f p(Lerp(rng.Uniform<Float>(), -50, 50),
+                  Lerp(rng.Uniform<Float>(), -50, 50),
+                  Lerp(rng.Uniform<Float>(), -50, 50));
+        Vector3f dpdx(Lerp(rng.Uniform<Float>(), 0, 0.01f), 0, 0);
+        Vector3f dpdy(0, Lerp(rng.Uniform<Float>(), 0, 0.001f), 0);
+        Float omega = rng.Uniform<Float>();
+        int maxOctaves = 1 + i % 12;
+
+        // Compute FBm and turbulence, one octave of noise at a time
+        Float len2 = std::max(LengthSquared(dpdx), LengthSquared(dpdy));
+        Float n = Clamp(-1 - Log2(len2) / 2, 0, maxOctaves);
+        int nInt = pstd::floor(n);
+        Float fbm = 0, turb = 0, lambda = 1, o = 1;
+        for (int j = 0; j < nInt; ++j) {
+            fbm += o * Noise(lambda * p);
+            turb += o * std::abs(Noise(lambda * p));
+            lambda *= 1.99f;
+            o *= omega;
+        }
+        Float nPartial = n - nInt;
+        fbm += o * SmoothStep(nPartial, .3f, .7f) * Noise(lambda * p);
+        turb +=
+            o * Lerp(SmoothStep(nPartial, .3f, .7f), 0.2, std::abs(Noise(lambda * p)));
+        for (int j = nInt; j < maxOctaves; ++j) {
+            turb += o * 0.2f;
+            o *= omega;
+        }
+
+        EXPECT_EQ(fbm, FBm(p, dpdx, dpdy, omega, maxOctaves));
+        EXPECT_EQ(turb, Turbulence(p, dpdx, dpdy, omega, maxOctaves));
+    }
+}
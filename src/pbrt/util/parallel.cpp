@@ -5,15 +5,35 @@
 #include <pbrt/util/parallel.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/math.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/stats.h>
+#include <pbrt/util/string.h>
 #ifdef PBRT_BUILD_GPU_RENDERER
 #include <pbrt/gpu/util.h>
 #endif  // PBRT_BUILD_GPU_RENDERER
 
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif  // __GNUG__
+#ifdef PBRT_IS_LINUX
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // PBRT_IS_LINUX
+
 #include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iterator>
 #include <list>
+#include <map>
+#include <memory>
 #include <thread>
+#include <typeindex>
 #include <vector>
 
 namespace pbrt {
@@ -26,6 +46,10 @@ std::string AtomicDouble::ToString() const {
     return StringPrintf("%f", double(*this));
 }
 
+std::string AtomicInt::ToString() const {
+    return StringPrintf("%d", int(*this));
+}
+
 // Barrier Method Definitions
 bool Barrier::Block() {
     std::unique_lock<std::mutex> lock(mutex);
@@ -41,122 +65,432 @@ bool Barrier::Block() {
     return --numToExit == 0;
 }
 
+STAT_COUNTER("Parallel/Tasks run", nTasksRun);
+STAT_COUNTER("Parallel/Tasks stolen", nTasksStolen);
+STAT_COUNTER("Parallel/Thread-affine tasks run by other threads", nAffineTasksMoved);
+
 ThreadPool *ParallelJob::threadPool;
 
+thread_local int SerialLoopScope::depth;
+
+// Index of the current thread's deque in the thread pool, or -1 for threads
+// that are not part of it
+static thread_local int threadPoolIndex = -1;
+
+// Thread Placement Local Definitions
+// CPUs of each NUMA node; empty unless NUMA placement is enabled
+static std::vector<std::vector<int>> numaNodeCPUs;
+// CPUs and NUMA node for each thread of the thread pool; a thread with an
+// empty CPU set may run anywhere
+static std::vector<std::vector<int>> threadCPUs;
+static std::vector<int> threadNumaNodes;
+static thread_local int threadNumaNode = 0;
+
+// Parses CPU lists of the form "0-3,8,10-11"
+static bool ParseCPUList(std::string_view str, std::vector<int> *cpus) {
+    for (const std::string &range : SplitString(str, ',')) {
+        std::vector<std::string> ends = SplitString(range, '-');
+        int first, last;
+        if (ends.empty() || ends.size() > 2 || !Atoi(ends.front(), &first) ||
+            !Atoi(ends.back(), &last) || first < 0 || last < first)
+            return false;
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus->push_back(cpu);
+    }
+    return true;
+}
+
+static bool ReadSysfsCPUList(const std::string &filename, std::vector<int> *cpus) {
+    std::ifstream in(filename);
+    std::string line;
+    return std::getline(in, line) && ParseCPUList(line, cpus);
+}
+
+static std::vector<std::vector<int>> DetectNumaNodes() {
+    std::vector<std::vector<int>> nodes;
+#ifdef PBRT_IS_LINUX
+    std::vector<int> cpus;
+    while (ReadSysfsCPUList(StringPrintf("/sys/devices/system/node/node%d/cpulist",
+                                         int(nodes.size())),
+                            &cpus)) {
+        nodes.push_back(std::move(cpus));
+        cpus.clear();
+    }
+#endif  // PBRT_IS_LINUX
+    return nodes;
+}
+
+// Returns the CPUs that the process is allowed to run on
+static std::vector<int> AllowedCPUs() {
+    std::vector<int> cpus;
+#ifdef PBRT_IS_LINUX
+    cpu_set_t cpuSet;
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &cpuSet))
+                cpus.push_back(cpu);
+#endif  // PBRT_IS_LINUX
+    if (cpus.empty())
+        for (int cpu = 0; cpu < AvailableCores(); ++cpu)
+            cpus.push_back(cpu);
+    return cpus;
+}
+
+// Returns true if _cpu_ is not the first hardware thread of its core
+static bool IsSMTSibling(int cpu) {
+    std::string filename =
+        StringPrintf("/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    std::vector<int> siblings;
+    return ReadSysfsCPUList(filename, &siblings) && !siblings.empty() &&
+           *std::min_element(siblings.begin(), siblings.end()) != cpu;
+}
+
+// Computes _threadCPUs_ and _threadNumaNodes_ and returns the number of
+// threads to launch, which defaults to the number of usable CPUs.
+static int PlaceThreads(int nThreads, const ThreadPlacement &placement) {
+    threadCPUs.clear();
+    threadNumaNodes.clear();
+    numaNodeCPUs.clear();
+    if (!placement.numa && !placement.pinThreads && !placement.skipSMTSiblings &&
+        placement.cpus.empty() && placement.reservedCores == 0)
+        return nThreads > 0 ? nThreads : AvailableCores();
+#ifndef PBRT_IS_LINUX
+    Warning("Thread placement options are only supported on Linux; ignoring.");
+    return nThreads > 0 ? nThreads : AvailableCores();
+#endif
+
+    // Find the CPUs that threads may use
+    std::vector<int> cpus = AllowedCPUs();
+    if (!placement.cpus.empty()) {
+        std::vector<int> requested;
+        if (!ParseCPUList(placement.cpus, &requested))
+            ErrorExit("%s: invalid CPU list.", placement.cpus);
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                  [&](int cpu) {
+                                      return std::find(requested.begin(), requested.end(),
+                                                       cpu) == requested.end();
+                                  }),
+                   cpus.end());
+    }
+    if (placement.skipSMTSiblings)
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(), IsSMTSibling), cpus.end());
+    if (placement.reservedCores > 0) {
+        // Leave the last CPUs free for I/O and display threads
+        if (placement.reservedCores >= int(cpus.size()))
+            ErrorExit("Can't reserve %d cores with only %d available.",
+                      placement.reservedCores, int(cpus.size()));
+        cpus.resize(cpus.size() - placement.reservedCores);
+    }
+    if (cpus.empty())
+        ErrorExit("No CPUs are available for rendering threads.");
+
+    if (placement.numa) {
+        numaNodeCPUs = DetectNumaNodes();
+        if (numaNodeCPUs.size() < 2) {
+            Warning("NUMA placement requested but only %d NUMA node%s found; ignoring.",
+                    int(numaNodeCPUs.size()), numaNodeCPUs.size() == 1 ? "" : "s");
+            numaNodeCPUs.clear();
+        } else
+            LOG_VERBOSE("Placing %d threads on %d NUMA nodes", nThreads,
+                        int(numaNodeCPUs.size()));
+    }
+    auto nodeForCPU = [&](int cpu) {
+        for (size_t node = 0; node < numaNodeCPUs.size(); ++node)
+            if (std::find(numaNodeCPUs[node].begin(), numaNodeCPUs[node].end(), cpu) !=
+                numaNodeCPUs[node].end())
+                return int(node);
+        return 0;
+    };
+
+    if (nThreads <= 0)
+        nThreads = cpus.size();
+    threadCPUs.resize(nThreads);
+    threadNumaNodes.resize(nThreads);
+    for (int i = 0; i < nThreads; ++i) {
+        if (placement.pinThreads) {
+            // Give each thread its own CPU, wrapping around if there are more
+            // threads than CPUs
+            int cpu = cpus[i % cpus.size()];
+            threadCPUs[i] = {cpu};
+            threadNumaNodes[i] = nodeForCPU(cpu);
+        } else if (!numaNodeCPUs.empty()) {
+            // Assign contiguous ranges of thread indices to successive nodes
+            threadNumaNodes[i] = int(int64_t(i) * numaNodeCPUs.size() / nThreads);
+            for (int cpu : cpus)
+                if (nodeForCPU(cpu) == threadNumaNodes[i])
+                    threadCPUs[i].push_back(cpu);
+            if (threadCPUs[i].empty())
+                threadCPUs[i] = cpus;
+        } else
+            threadCPUs[i] = cpus;
+    }
+    return nThreads;
+}
+
+static void PlaceCurrentThread(int index) {
+    threadNumaNode = threadNumaNodes[index];
+    if (threadCPUs[index].empty())
+        return;
+#ifdef PBRT_IS_LINUX
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : threadCPUs[index])
+        CPU_SET(cpu, &cpuSet);
+    if (int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet))
+        LOG_ERROR("Unable to set affinity of thread %d: %s", index, ErrorString(err));
+#endif  // PBRT_IS_LINUX
+}
+
 // ThreadPool Method Definitions
 ThreadPool::ThreadPool(int nThreads) {
+    for (int i = 0; i < nThreads; ++i) {
+        deques.push_back(std::make_unique<WorkStealingDeque<ParallelTask *>>());
+        dequeNumaNodes.push_back(threadNumaNodes.empty() ? 0 : threadNumaNodes[i]);
+    }
+    affineTasks.resize(nThreads);
+    threadPoolIndex = 0;
+    if (!threadNumaNodes.empty())
+        PlaceCurrentThread(0);
     for (int i = 0; i < nThreads - 1; ++i)
-        threads.push_back(std::thread(&ThreadPool::Worker, this));
+        threads.push_back(std::thread(&ThreadPool::Worker, this, i + 1));
 }
 
-void ThreadPool::Worker() {
+void ThreadPool::Worker(int index) {
     LOG_VERBOSE("Started execution in worker thread");
+    threadPoolIndex = index;
+    if (!threadNumaNodes.empty())
+        PlaceCurrentThread(index);
 
 #ifdef PBRT_BUILD_GPU_RENDERER
     GPUThreadInit();
 #endif  // PBRT_BUILD_GPU_RENDERER
 
-    std::unique_lock<std::mutex> lock(mutex);
-    while (!shutdownThreads)
-        WorkOrWait(&lock, false);
+    while (true) {
+        if (ParallelTask *task = FindTask(true)) {
+            RunTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (shutdownThreads)
+            break;
+        // Register as waiting, then look once more so that a task pushed
+        // concurrently either is found here or wakes this thread up
+        uint64_t epoch = workEpoch;
+        ++nWaiting;
+        if (ParallelTask *task = FindTask(true)) {
+            --nWaiting;
+            lock.unlock();
+            RunTask(task);
+            continue;
+        }
+        workCondition.wait(lock,
+                           [&]() { return shutdownThreads || workEpoch != epoch; });
+        --nWaiting;
+    }
 
     LOG_VERBOSE("Exiting worker thread");
 }
 
-std::unique_lock<std::mutex> ThreadPool::AddToJobList(ParallelJob *job) {
-    std::unique_lock<std::mutex> lock(mutex);
-    // Add _job_ to head of _jobList_
-    if (jobList)
-        jobList->prev = job;
-    job->next = jobList;
-    jobList = job;
-
-    jobListCondition.notify_all();
-    return lock;
+void ThreadPool::Push(ParallelTask *task) {
+    if (threadPoolIndex >= 0)
+        deques[threadPoolIndex]->Push(task);
+    else {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        injectedTasks.push_back(task);
+        ++nInjectedTasks;
+    }
+    NotifyWaiters();
 }
 
-void ThreadPool::WorkOrWait(std::unique_lock<std::mutex> *lock, bool isEnqueuingThread) {
-    DCHECK(lock->owns_lock());
-    // Return if this is a worker thread and the thread pool is disabled
-    if (!isEnqueuingThread && disabled) {
-        jobListCondition.wait(*lock);
+void ThreadPool::NotifyWaiters() {
+    // Pairs with the increment of _nWaiting_ before a waiting thread's final
+    // check for work
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (nWaiting.load() == 0)
         return;
+    std::lock_guard<std::mutex> lock(mutex);
+    ++workEpoch;
+    workCondition.notify_all();
+}
+
+ParallelTask *ThreadPool::FindTask(bool isWorker) {
+    // Worker threads don't look for work while the thread pool is disabled
+    if (isWorker && disabled)
+        return nullptr;
+
+    // Take the most recently pushed task from this thread's own deque
+    if (threadPoolIndex >= 0)
+        if (ParallelTask *task = deques[threadPoolIndex]->Pop())
+            return task;
+
+    // Take a task that was assigned to this thread
+    if (threadPoolIndex >= 0 && nAffineTasks.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(affineMutex);
+        if (!affineTasks[threadPoolIndex].empty()) {
+            ParallelTask *task = affineTasks[threadPoolIndex].back();
+            affineTasks[threadPoolIndex].pop_back();
+            --nAffineTasks;
+            return task;
+        }
+    }
+
+    // Take a task pushed by a thread outside of the pool
+    if (nInjectedTasks.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        if (!injectedTasks.empty()) {
+            ParallelTask *task = injectedTasks.back();
+            injectedTasks.pop_back();
+            --nInjectedTasks;
+            return task;
+        }
     }
 
-    ParallelJob *job = jobList;
-    while (job && !job->HaveWork())
-        job = job->next;
-    if (job) {
-        // Execute work for _job_
-        job->activeWorkers++;
-        job->RunStep(lock);
-        // Handle post-job-execution details
-        DCHECK(!lock->owns_lock());
-        lock->lock();
-        job->activeWorkers--;
-        if (job->Finished())
-            jobListCondition.notify_all();
+    // Steal the oldest task from another thread, starting at a random deque
+    // and trying threads on the same NUMA node first
+    thread_local uint64_t state =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    size_t start = state % deques.size();
+    int nPasses = numaNodeCPUs.size() > 1 ? 2 : 1;
+    for (int pass = 0; pass < nPasses; ++pass)
+        for (size_t i = 0; i < deques.size(); ++i) {
+            size_t victim = (start + i) % deques.size();
+            if (int(victim) == threadPoolIndex || deques[victim]->Empty() ||
+                (pass + 1 < nPasses && dequeNumaNodes[victim] != threadNumaNode))
+                continue;
+            if (ParallelTask *task = deques[victim]->Steal()) {
+                ++nTasksStolen;
+                return task;
+            }
+        }
 
-    } else
-        // Wait for new work to arrive or the job to finish
-        jobListCondition.wait(*lock);
+    // Finally, take a task assigned to a thread that hasn't gotten to it
+    if (nAffineTasks.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(affineMutex);
+        for (size_t i = 0; i < affineTasks.size(); ++i) {
+            std::vector<ParallelTask *> &tasks =
+                affineTasks[(start + i) % affineTasks.size()];
+            if (!tasks.empty()) {
+                ParallelTask *task = tasks.back();
+                tasks.pop_back();
+                --nAffineTasks;
+                ++nAffineTasksMoved;
+                return task;
+            }
+        }
+    }
+    return nullptr;
 }
 
-void ThreadPool::RemoveFromJobList(ParallelJob *job) {
-    DCHECK(!job->removed);
+void ThreadPool::RunTask(ParallelTask *task) {
+    ParallelJob *job = task->job;
+    int64_t begin = task->begin, end = task->end;
+    // Split off the upper half of the task's steps for other threads until
+    // a single step remains
+    while (end - begin > 1) {
+        int64_t mid = begin + (end - begin) / 2;
+        ParallelTask *rest = &job->tasks[mid];
+        *rest = ParallelTask{job, mid, end};
+        Push(rest);
+        end = mid;
+    }
 
-    if (job->prev)
-        job->prev->next = job->next;
-    else {
-        DCHECK(jobList == job);
-        jobList = job->next;
+    ++nTasksRun;
+    {
+        ScopedMemoryCategory category(job->memoryCategory);
+        job->RunSteps(begin, end);
     }
-    if (job->next)
-        job->next->prev = job->prev;
 
-    job->removed = true;
+    // _job_ may be freed by the thread that is waiting for it as soon as
+    // its last step is done, so it must not be accessed after this
+    if (job->stepsRemaining.fetch_sub(end - begin) == end - begin)
+        NotifyWaiters();
 }
 
-bool ThreadPool::WorkOrReturn() {
-    std::unique_lock<std::mutex> lock(mutex);
-
-    ParallelJob *job = jobList;
-    while (job && !job->HaveWork())
-        job = job->next;
-    if (!job)
-        return false;
+void ThreadPool::Run(ParallelJob *job, bool affinity) {
+    int64_t nSteps = job->NumSteps();
+    if (nSteps == 0)
+        return;
+    int nParts = deques.size();
+    if (affinity && nParts > 1 && nSteps >= nParts) {
+        // Assign a contiguous share of the steps to each thread; the
+        // calling thread starts on its own share immediately
+        ParallelTask *ownTask = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(affineMutex);
+            for (int i = 0; i < nParts; ++i) {
+                int64_t begin = nSteps * i / nParts, end = nSteps * (i + 1) / nParts;
+                ParallelTask *task = &job->tasks[begin];
+                *task = ParallelTask{job, begin, end};
+                if (i == threadPoolIndex)
+                    ownTask = task;
+                else {
+                    affineTasks[i].push_back(task);
+                    ++nAffineTasks;
+                }
+            }
+        }
+        NotifyWaiters();
+        if (ownTask)
+            RunTask(ownTask);
+    } else {
+        ParallelTask *root = &job->tasks[0];
+        *root = ParallelTask{job, 0, nSteps};
+        RunTask(root);
+    }
 
-    // Execute work for _job_
-    job->activeWorkers++;
-    job->RunStep(&lock);
-    DCHECK(!lock.owns_lock());
-    lock.lock();
-    job->activeWorkers--;
-    if (job->Finished())
-        jobListCondition.notify_all();
+    // Help out with other tasks until all of _job_'s steps have completed
+    while (!job->Finished()) {
+        if (ParallelTask *task = FindTask(false)) {
+            RunTask(task);
+            continue;
+        }
 
-    return true;
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t epoch = workEpoch;
+        ++nWaiting;
+        if (job->Finished()) {
+            --nWaiting;
+            break;
+        }
+        if (ParallelTask *task = FindTask(false)) {
+            --nWaiting;
+            lock.unlock();
+            RunTask(task);
+            continue;
+        }
+        workCondition.wait(lock,
+                           [&]() { return job->Finished() || workEpoch != epoch; });
+        --nWaiting;
+    }
 }
 
-void ThreadPool::ForEachThread(std::function<void(void)> func) {
-    Barrier *barrier = new Barrier(threads.size() + 1);
+void ThreadPool::Enqueue(ParallelJob *job) {
+    ParallelTask *root = &job->tasks[0];
+    *root = ParallelTask{job, 0, job->NumSteps()};
+    Push(root);
+}
 
-    ParallelFor(0, threads.size() + 1, [barrier, &func](int64_t) {
-        func();
-        if (barrier->Block())
-            delete barrier;
-    });
+bool ThreadPool::WorkOrReturn() {
+    ParallelTask *task = FindTask(false);
+    if (!task)
+        return false;
+    RunTask(task);
+    return true;
 }
 
 void ThreadPool::Disable() {
     CHECK(!disabled);
     disabled = true;
-    CHECK(jobList == nullptr);  // Nothing should be running when Disable() is called.
 }
 
 void ThreadPool::Reenable() {
     CHECK(disabled);
     disabled = false;
+    NotifyWaiters();
 }
 
 ThreadPool::~ThreadPool() {
@@ -166,7 +500,7 @@ ThreadPool::~ThreadPool() {
     {
         std::lock_guard<std::mutex> lock(mutex);
         shutdownThreads = true;
-        jobListCondition.notify_all();
+        workCondition.notify_all();
     }
 
     for (std::thread &thread : threads)
@@ -174,159 +508,390 @@ ThreadPool::~ThreadPool() {
 }
 
 std::string ThreadPool::ToString() const {
-    std::string s = StringPrintf("[ ThreadPool threads.size(): %d shutdownThreads: %s ",
-                                 threads.size(), shutdownThreads);
-    if (mutex.try_lock()) {
-        s += "jobList: [ ";
-        ParallelJob *job = jobList;
-        while (job) {
-            s += job->ToString() + " ";
-            job = job->next;
-        }
-        s += "] ";
-        mutex.unlock();
-    } else
-        s += "(job list mutex locked) ";
-    return s + "]";
+    std::string s = StringPrintf("[ ThreadPool threads.size(): %d shutdownThreads: %s "
+                                 "disabled: %s nWaiting: %d ",
+                                 threads.size(), shutdownThreads, disabled.load(),
+                                 nWaiting.load());
+    s += "deques empty: [ ";
+    for (const auto &deque : deques)
+        s += deque->Empty() ? "true " : "false ";
+    return s + "] ]";
 }
 
 bool DoParallelWork() {
     CHECK(ParallelJob::threadPool);
-    // lock should be held when this is called...
     return ParallelJob::threadPool->WorkOrReturn();
 }
 
+// ParallelLoopSite Definition
+// Measurements for the loops run by one ParallelFor() call site, which is
+// identified by the type of its loop body.
+struct ParallelLoopSite {
+    explicit ParallelLoopSite(std::string name) : name(std::move(name)) {}
+
+    std::string name;
+    // Estimated cost of a single loop iteration, in seconds; zero until the
+    // first loop has finished
+    std::atomic<double> secondsPerIteration{0};
+    // Load imbalance of each loop; protected by _loopSitesMutex_
+    double imbalanceSum = 0, imbalanceMin = Infinity, imbalanceMax = 0;
+    int64_t nLoops = 0;
+};
+
+static std::mutex loopSitesMutex;
+static std::map<std::type_index, ParallelLoopSite *> loopSites;
+static std::atomic<bool> loopStatisticsEnabled{false};
+static TileOrder tileSchedulingOrder = TileOrder::Hilbert;
+static bool tileSchedulingAffinity = false;
+
+static ParallelLoopSite *GetLoopSite(const std::type_info &type) {
+    std::lock_guard<std::mutex> lock(loopSitesMutex);
+    ParallelLoopSite *&site = loopSites[std::type_index(type)];
+    if (!site) {
+        std::string name = type.name();
+#ifdef __GNUG__
+        int status;
+        char *demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+        if (demangled) {
+            name = demangled;
+            free(demangled);
+        }
+#endif  // __GNUG__
+        site = new ParallelLoopSite(name);
+    }
+    return site;
+}
+
+static StatRegisterer loopStatsRegisterer([](StatsAccumulator &accum) {
+    // This is called for every thread; the first one reports and clears the
+    // measurements for all of them
+    std::lock_guard<std::mutex> lock(loopSitesMutex);
+    for (auto &entry : loopSites) {
+        ParallelLoopSite *site = entry.second;
+        if (site->nLoops == 0)
+            continue;
+        std::string title = "Parallel/Loop imbalance (max/mean busy time): " + site->name;
+        accum.ReportFloatDistribution(title.c_str(), site->imbalanceSum, site->nLoops,
+                                      site->imbalanceMin, site->imbalanceMax);
+        site->imbalanceSum = site->imbalanceMax = 0;
+        site->imbalanceMin = Infinity;
+        site->nLoops = 0;
+    }
+});
+
+// Returns the number of loop iterations to run in each step of a loop, given
+// the measured cost of an iteration.
+static int64_t AdaptiveChunkSize(int64_t nIterations, double secondsPerIteration) {
+    // Chunks should take long enough to amortize the cost of scheduling them
+    // but not so long that threads sit idle at the end of the loop while the
+    // last few run. Within those bounds, make at least 8 chunks per thread.
+    constexpr double minChunkSeconds = 20e-6, maxChunkSeconds = 2e-3;
+    int64_t balanced = std::max<int64_t>(1, nIterations / (8 * RunningThreads()));
+    int64_t minChunk = std::ceil(minChunkSeconds / secondsPerIteration);
+    int64_t maxChunk = std::max<int64_t>(1, maxChunkSeconds / secondsPerIteration);
+    int64_t chunkSize = std::max(minChunk, std::min(balanced, maxChunk));
+    return Clamp(chunkSize, 1, nIterations);
+}
+
+// ParallelForLoop Definition
+class ParallelForLoop : public ParallelJob {
+  public:
+    // ParallelForLoop Public Methods
+    ParallelForLoop(int64_t nSteps, ParallelLoopSite *site)
+        : ParallelJob(nSteps), site(site) {
+        if (loopStatisticsEnabled) {
+            // Allow for one thread from outside of the thread pool
+            threadBusyNanoseconds.reset(new std::atomic<int64_t>[RunningThreads() + 1]);
+            for (int i = 0; i <= RunningThreads(); ++i)
+                threadBusyNanoseconds[i] = 0;
+        }
+    }
+
+    // Updates the call site's measurements once the loop has finished
+    void UpdateSite(int64_t nIterations) {
+        int64_t busy = busyNanoseconds.load();
+        if (!site || busy == 0)
+            return;
+        double cost = 1e-9 * busy / nIterations;
+        double prevCost = site->secondsPerIteration.load();
+        site->secondsPerIteration = prevCost == 0 ? cost : (prevCost + cost) / 2;
+
+        if (threadBusyNanoseconds) {
+            int64_t maxBusy = 0;
+            for (int i = 0; i <= RunningThreads(); ++i)
+                maxBusy = std::max<int64_t>(maxBusy, threadBusyNanoseconds[i]);
+            double imbalance = double(maxBusy) / (double(busy) / RunningThreads());
+            std::lock_guard<std::mutex> lock(loopSitesMutex);
+            site->imbalanceSum += imbalance;
+            site->imbalanceMin = std::min(site->imbalanceMin, imbalance);
+            site->imbalanceMax = std::max(site->imbalanceMax, imbalance);
+            ++site->nLoops;
+        }
+    }
+
+  protected:
+    // ParallelForLoop Protected Methods
+    std::string_view SiteName() const {
+        return site ? std::string_view(site->name) : "ForEachThread";
+    }
+
+    template <typename F>
+    void RunTimed(F func) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+        busyNanoseconds += ns;
+        if (threadBusyNanoseconds)
+            threadBusyNanoseconds[threadPoolIndex >= 0 ? threadPoolIndex
+                                                       : RunningThreads()] += ns;
+    }
+
+  private:
+    // ParallelForLoop Private Members
+    ParallelLoopSite *site;
+    std::atomic<int64_t> busyNanoseconds{0};
+    std::unique_ptr<std::atomic<int64_t>[]> threadBusyNanoseconds;
+};
+
 // ParallelForLoop1D Definition
-class ParallelForLoop1D : public ParallelJob {
+class ParallelForLoop1D : public ParallelForLoop {
   public:
     // ParallelForLoop1D Public Methods
-    ParallelForLoop1D(int64_t startIndex, int64_t endIndex, int chunkSize,
-                      std::function<void(int64_t, int64_t)> func)
-        : func(std::move(func)),
-          nextIndex(startIndex),
+    ParallelForLoop1D(int64_t startIndex, int64_t endIndex, int64_t chunkSize,
+                      std::function<void(int64_t, int64_t)> func, ParallelLoopSite *site)
+        : ParallelForLoop((endIndex - startIndex + chunkSize - 1) / chunkSize, site),
+          func(std::move(func)),
+          startIndex(startIndex),
           endIndex(endIndex),
           chunkSize(chunkSize) {}
 
-    bool HaveWork() const { return nextIndex < endIndex; }
-
-    void RunStep(std::unique_lock<std::mutex> *lock);
+    void RunSteps(int64_t begin, int64_t end) {
+        // Execute loop iterations for chunks _[begin, end)_
+        int64_t indexStart = startIndex + begin * chunkSize;
+        int64_t indexEnd = std::min(startIndex + end * chunkSize, endIndex);
+        TraceScope trace("ParallelFor", SiteName());
+        if (traceEnabled)
+            trace.SetArgs(
+                StringPrintf("\"start\": %d, \"end\": %d", indexStart, indexEnd));
+        RunTimed([&]() { func(indexStart, indexEnd); });
+    }
 
     std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop1D nextIndex: %d endIndex: %d "
-                            "chunkSize: %d ]",
-                            nextIndex, endIndex, chunkSize);
+        return StringPrintf("[ ParallelForLoop1D startIndex: %d endIndex: %d "
+                            "chunkSize: %d %s ]",
+                            startIndex, endIndex, chunkSize, BaseToString());
     }
 
   private:
     // ParallelForLoop1D Private Members
     std::function<void(int64_t, int64_t)> func;
-    int64_t nextIndex, endIndex;
-    int chunkSize;
+    int64_t startIndex, endIndex;
+    int64_t chunkSize;
 };
 
-class ParallelForLoop2D : public ParallelJob {
+// ParallelForLoop2D Definition
+class ParallelForLoop2D : public ParallelForLoop {
   public:
+    // ParallelForLoop2D Public Methods
     ParallelForLoop2D(const Bounds2i &extent, int chunkSize,
-                      std::function<void(Bounds2i)> func)
-        : func(std::move(func)),
+                      std::function<void(Bounds2i, int)> func, ParallelLoopSite *site,
+                      TileOrder order, int nWaves = 1)
+        : ParallelForLoop(int64_t(NumTiles(extent.pMax.x - extent.pMin.x, chunkSize)) *
+                              NumTiles(extent.pMax.y - extent.pMin.y, chunkSize) *
+                              nWaves,
+                          site),
+          func(std::move(func)),
           extent(extent),
-          nextStart(extent.pMin),
-          chunkSize(chunkSize) {}
+          nTilesX(NumTiles(extent.pMax.x - extent.pMin.x, chunkSize)),
+          nTiles(NumSteps() / nWaves),
+          chunkSize(chunkSize) {
+        if (nWaves > 1) {
+            pendingWaves.reset(new std::atomic<int>[nTiles]);
+            nextWave.reset(new int[nTiles]);
+            for (int tile = 0; tile < nTiles; ++tile) {
+                pendingWaves[tile] = 0;
+                nextWave[tile] = 0;
+            }
+        }
+        if (order == TileOrder::Scanline || nTiles <= 2)
+            return;
+        // Sort tiles by their position along the space-filling curve
+        int nTilesY = NumTiles(extent.pMax.y - extent.pMin.y, chunkSize);
+        int nBits = Log2Int(RoundUpPow2(std::max(nTilesX, nTilesY)));
+        std::vector<std::pair<uint64_t, int>> keys(nTiles);
+        for (int tile = 0; tile < int(keys.size()); ++tile) {
+            uint32_t x = tile % nTilesX, y = tile / nTilesX;
+            keys[tile] = {order == TileOrder::Hilbert ? EncodeHilbert2(x, y, nBits)
+                                                      : EncodeMorton2(x, y),
+                          tile};
+        }
+        std::sort(keys.begin(), keys.end());
+        tileOrder.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+            tileOrder[i] = keys[i].second;
+    }
 
-    bool HaveWork() const { return nextStart.y < extent.pMax.y; }
-    void RunStep(std::unique_lock<std::mutex> *lock);
+    void RunSteps(int64_t begin, int64_t end) {
+        for (int64_t step = begin; step < end; ++step) {
+            // Compute extent for this tile and run the loop iterations
+            int index = step % nTiles;
+            int64_t tile = tileOrder.empty() ? index : tileOrder[index];
+            Point2i start = extent.pMin + Vector2i(int(tile % nTilesX) * chunkSize,
+                                                   int(tile / nTilesX) * chunkSize);
+            Bounds2i b = Intersect(
+                Bounds2i(start, start + Vector2i(chunkSize, chunkSize)), extent);
+            CHECK(!b.IsEmpty());
+            if (!pendingWaves) {
+                runTile(b, 0);
+                continue;
+            }
+            // Each of a tile's steps adds a pending wave; the step that finds
+            // none pending runs the tile's waves until none remain, so that
+            // steps for a tile that is already running return immediately
+            // rather than waiting for it.
+            std::atomic<int> &pending = pendingWaves[index];
+            if (pending.fetch_add(1, std::memory_order_acq_rel) == 0) {
+                do {
+                    runTile(b, nextWave[index]++);
+                } while (pending.fetch_sub(1, std::memory_order_acq_rel) > 1);
+            }
+        }
+    }
 
     std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop2D extent: %s nextStart: %s "
-                            "chunkSize: %d ]",
-                            extent, nextStart, chunkSize);
+        return StringPrintf("[ ParallelForLoop2D extent: %s chunkSize: %d %s ]", extent,
+                            chunkSize, BaseToString());
     }
 
   private:
-    std::function<void(Bounds2i)> func;
-    const Bounds2i extent;
-    Point2i nextStart;
-    int chunkSize;
-};
-
-// ParallelForLoop1D Method Definitions
-void ParallelForLoop1D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Determine the range of loop iterations to run in this step
-    int64_t indexStart = nextIndex;
-    int64_t indexEnd = std::min(indexStart + chunkSize, endIndex);
-    nextIndex = indexEnd;
-
-    // Remove job from list if all work has been started
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
-
-    // Release lock and execute loop iterations in _[indexStart, indexEnd)_
-    lock->unlock();
-    func(indexStart, indexEnd);
-}
-
-void ParallelForLoop2D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Compute extent for this step
-    Point2i end = nextStart + Vector2i(chunkSize, chunkSize);
-    Bounds2i b = Intersect(Bounds2i(nextStart, end), extent);
-    CHECK(!b.IsEmpty());
+    // ParallelForLoop2D Private Methods
+    static int NumTiles(int length, int chunkSize) {
+        return (length + chunkSize - 1) / chunkSize;
+    }
 
-    // Advance to be ready for the next extent.
-    nextStart.x += chunkSize;
-    if (nextStart.x >= extent.pMax.x) {
-        nextStart.x = extent.pMin.x;
-        nextStart.y += chunkSize;
+    void runTile(Bounds2i b, int wave) {
+        TraceScope trace("ParallelFor2D", SiteName());
+        if (traceEnabled)
+            trace.SetArgs(pendingWaves
+                              ? StringPrintf("\"tile\": \"%s\", \"wave\": %d", b, wave)
+                              : StringPrintf("\"tile\": \"%s\"", b));
+        RunTimed([&]() { func(b, wave); });
     }
 
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
+    // ParallelForLoop2D Private Members
+    std::function<void(Bounds2i, int)> func;
+    const Bounds2i extent;
+    int nTilesX, nTiles;
+    int chunkSize;
+    // Scanline index of the tile for each step, if not in scanline order
+    std::vector<int> tileOrder;
+    // With multiple waves, the number of each tile's steps that have started
+    // but whose wave hasn't been run and the index of its next wave to run
+    std::unique_ptr<std::atomic<int>[]> pendingWaves;
+    std::unique_ptr<int[]> nextWave;
+};
 
-    lock->unlock();
+void ThreadPool::ForEachThread(std::function<void(void)> func) {
+    Barrier *barrier = new Barrier(threads.size() + 1);
 
-    // Run the loop iteration
-    func(b);
+    // Each thread must run exactly one iteration, so the chunk size is
+    // always one rather than adapting to the measured cost
+    ParallelForLoop1D loop(
+        0, threads.size() + 1, 1,
+        [barrier, &func](int64_t, int64_t) {
+            func();
+            if (barrier->Block())
+                delete barrier;
+        },
+        nullptr);
+    Run(&loop);
 }
 
 // Parallel Function Definitions
-void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func) {
+void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func,
+                 const std::type_info *site) {
     CHECK(ParallelJob::threadPool);
     if (start == end)
         return;
-    // Compute chunk size for parallel loop
+    if (SerialLoopScope::Active()) {
+        func(start, end);
+        return;
+    }
+    ParallelLoopSite *loopSite = GetLoopSite(site ? *site : func.target_type());
+
+    // Compute chunk size for parallel loop, using the measured cost of
+    // iterations at this call site if available
     int64_t chunkSize = std::max<int64_t>(1, (end - start) / (8 * RunningThreads()));
+    if (double cost = loopSite->secondsPerIteration; cost > 0)
+        chunkSize = AdaptiveChunkSize(end - start, cost);
 
-    // Create and enqueue _ParallelForLoop1D_ for this loop
-    ParallelForLoop1D loop(start, end, chunkSize, std::move(func));
-    std::unique_lock<std::mutex> lock = ParallelJob::threadPool->AddToJobList(&loop);
+    // Run _ParallelForLoop1D_ for this loop, sharing its chunks with other threads
+    ParallelForLoop1D loop(start, end, chunkSize, std::move(func), loopSite);
+    ParallelJob::threadPool->Run(&loop);
+    loop.UpdateSite(end - start);
+}
 
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        ParallelJob::threadPool->WorkOrWait(&lock, true);
+// Returns the size of the square tiles that a 2D loop over _extent_ uses
+static int TileSize(const Bounds2i &extent, ParallelLoopSite *loopSite) {
+    // Want at least 8 tiles per thread, subject to not too big and not too
+    // small, unless the cost of each pixel has been measured.
+    // TODO: should we do non-square?
+    int tileSize = Clamp(int(std::sqrt(extent.Diagonal().x * extent.Diagonal().y /
+                                       (8 * RunningThreads()))),
+                         1, 32);
+    if (double cost = loopSite->secondsPerIteration; cost > 0)
+        tileSize = Clamp(int(std::sqrt(AdaptiveChunkSize(extent.Area(), cost))), 1, 256);
+    return tileSize;
 }
 
-void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func) {
+void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func,
+                   const std::type_info *site) {
     CHECK(ParallelJob::threadPool);
 
     if (extent.IsEmpty())
         return;
-    if (extent.Area() == 1) {
+    if (extent.Area() == 1 || SerialLoopScope::Active()) {
         func(extent);
         return;
     }
+    ParallelLoopSite *loopSite = GetLoopSite(site ? *site : func.target_type());
 
-    // Want at least 8 tiles per thread, subject to not too big and not too
-    // small.
-    // TODO: should we do non-square?
-    int tileSize = Clamp(int(std::sqrt(extent.Diagonal().x * extent.Diagonal().y /
-                                       (8 * RunningThreads()))),
-                         1, 32);
+    ParallelForLoop2D loop(
+        extent, TileSize(extent, loopSite), [&func](Bounds2i b, int) { func(b); },
+        loopSite, tileSchedulingOrder);
+    ParallelJob::threadPool->Run(&loop, tileSchedulingAffinity);
+    loop.UpdateSite(extent.Area());
+}
+
+void ParallelFor2DWaves(const Bounds2i &extent, int nWaves,
+                        std::function<void(Bounds2i, int)> func,
+                        const std::type_info *site) {
+    CHECK(ParallelJob::threadPool);
+    CHECK_GT(nWaves, 0);
+    if (extent.IsEmpty())
+        return;
+    if (SerialLoopScope::Active()) {
+        for (int wave = 0; wave < nWaves; ++wave)
+            func(extent, wave);
+        return;
+    }
+    ParallelLoopSite *loopSite = GetLoopSite(site ? *site : func.target_type());
+
+    ParallelForLoop2D loop(extent, TileSize(extent, loopSite), std::move(func),
+                           loopSite, tileSchedulingOrder, nWaves);
+    ParallelJob::threadPool->Run(&loop, tileSchedulingAffinity);
+    loop.UpdateSite(extent.Area() * nWaves);
+}
 
-    ParallelForLoop2D loop(extent, tileSize, std::move(func));
-    std::unique_lock<std::mutex> lock = ParallelJob::threadPool->AddToJobList(&loop);
+void EnableParallelLoopStatistics() {
+    loopStatisticsEnabled = true;
+}
 
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        ParallelJob::threadPool->WorkOrWait(&lock, true);
+void SetTileScheduling(TileOrder order, bool affinity) {
+    tileSchedulingOrder = order;
+    tileSchedulingAffinity = affinity;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -339,10 +904,9 @@ int RunningThreads() {
     return ParallelJob::threadPool ? (1 + ParallelJob::threadPool->size()) : 1;
 }
 
-void ParallelInit(int nThreads) {
+void ParallelInit(int nThreads, const ThreadPlacement &placement) {
     CHECK(!ParallelJob::threadPool);
-    if (nThreads <= 0)
-        nThreads = AvailableCores();
+    nThreads = PlaceThreads(nThreads, placement);
     ParallelJob::threadPool = new ThreadPool(nThreads);
 }
 
@@ -351,6 +915,36 @@ void ParallelCleanup() {
     ParallelJob::threadPool = nullptr;
 }
 
+int NumaNodeCount() {
+    return std::max<int>(1, numaNodeCPUs.size());
+}
+
+int CurrentNumaNode() {
+    return threadNumaNode;
+}
+
+void NumaInterleave(const void *ptr, size_t size) {
+#ifdef PBRT_IS_LINUX
+    // Only consider the pages that lie entirely inside the given memory so
+    // that the placement of neighboring allocations is not changed
+    static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    if (numaNodeCPUs.size() < 2 || size < 16 * pageSize)
+        return;
+    uintptr_t start = ((uintptr_t)ptr + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)ptr + size) & ~(pageSize - 1);
+
+    constexpr int bitsPerWord = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> nodeMask((numaNodeCPUs.size() + bitsPerWord - 1) /
+                                        bitsPerWord);
+    for (size_t node = 0; node < numaNodeCPUs.size(); ++node)
+        nodeMask[node / bitsPerWord] |= 1ul << (node % bitsPerWord);
+    // Pages that have already been touched are moved as well
+    if (syscall(SYS_mbind, start, end - start, MPOL_INTERLEAVE, nodeMask.data(),
+                nodeMask.size() * bitsPerWord, MPOL_MF_MOVE) != 0)
+        LOG_VERBOSE("mbind() failed: %s", ErrorString());
+#endif  // PBRT_IS_LINUX
+}
+
 void ForEachThread(std::function<void(void)> func) {
     if (ParallelJob::threadPool)
         ParallelJob::threadPool->ForEachThread(std::move(func));
@@ -8,8 +8,10 @@
 #include <pbrt/pbrt.h>
 
 #include <pbrt/util/float.h>
+#include <pbrt/util/memory.h>
 #include <pbrt/util/vecmath.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
@@ -17,22 +19,47 @@
 #include <functional>
 #include <future>
 #include <initializer_list>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <thread>
 #include <type_traits>
+#include <typeinfo>
 #include <vector>
 
 namespace pbrt {
 
+// ThreadPlacement Definition
+struct ThreadPlacement {
+    // Restrict threads to NUMA nodes
+    bool numa = false;
+    // Pin each thread to a single CPU
+    bool pinThreads = false;
+    // Only use the first hardware thread of each core
+    bool skipSMTSiblings = false;
+    // CPUs that threads may use, e.g. "0-7,16-23"; all of them, if empty
+    std::string cpus;
+    // Number of CPUs to leave unused for I/O and display threads
+    int reservedCores = 0;
+};
+
 // Parallel Function Declarations
-void ParallelInit(int nThreads = -1);
+void ParallelInit(int nThreads = -1, const ThreadPlacement &placement = {});
 void ParallelCleanup();
 
 int AvailableCores();
 int RunningThreads();
 
+// When NUMA placement is enabled in ParallelInit(), each thread is restricted
+// to the CPUs of one NUMA node; otherwise there is a single node.
+int NumaNodeCount();
+int CurrentNumaNode();
+// Spreads the pages of the given memory across all NUMA nodes; this is
+// worthwhile for large data that all threads read, such as BVH nodes and
+// textures. Does nothing unless NUMA placement is enabled.
+void NumaInterleave(const void *ptr, size_t size);
+
 // ThreadLocal Definition
 template <typename T>
 class ThreadLocal {
@@ -242,6 +269,50 @@ class AtomicDouble {
 #endif
 };
 
+// AtomicInt Definition
+class AtomicInt {
+  public:
+    // AtomicInt Public Methods
+    PBRT_CPU_GPU
+    explicit AtomicInt(int v = 0) : value(v) {}
+
+    PBRT_CPU_GPU
+    operator int() const { return value; }
+    PBRT_CPU_GPU
+    int operator=(int v) {
+        value = v;
+        return v;
+    }
+
+    // Both return the value from before the update.
+    PBRT_CPU_GPU
+    int Add(int v) {
+#ifdef PBRT_IS_GPU_CODE
+        return atomicAdd(&value, v);
+#else
+        return value.fetch_add(v, std::memory_order_relaxed);
+#endif
+    }
+    PBRT_CPU_GPU
+    int Exchange(int v) {
+#ifdef PBRT_IS_GPU_CODE
+        return atomicExch(&value, v);
+#else
+        return value.exchange(v, std::memory_order_relaxed);
+#endif
+    }
+
+    std::string ToString() const;
+
+  private:
+    // AtomicInt Private Members
+#ifdef PBRT_IS_GPU_CODE
+    int value;
+#else
+    std::atomic<int> value;
+#endif
+};
+
 // Barrier Definition
 class Barrier {
   public:
@@ -260,36 +331,196 @@ class Barrier {
     int numToBlock, numToExit;
 };
 
-void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func);
-void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func);
+// Loops are split into chunks based on the measured cost of earlier loops
+// run with the same _site_, which identifies the loop body. By default, it
+// is the type of _func_.
+void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func,
+                 const std::type_info *site = nullptr);
+void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func,
+                   const std::type_info *site = nullptr);
+// Runs _func_ over the tiles of _extent_ _nWaves_ times, passing it the index
+// of the wave. Each tile's waves run in order and never concurrently, but
+// there is no barrier between waves, so tiles from later waves are started
+// while the last tiles of earlier ones finish.
+void ParallelFor2DWaves(const Bounds2i &extent, int nWaves,
+                        std::function<void(Bounds2i, int)> func,
+                        const std::type_info *site = nullptr);
+
+// Records the load imbalance of each parallel loop for the statistics
+void EnableParallelLoopStatistics();
+
+// SerialLoopScope Definition
+// While a _SerialLoopScope_ is in scope, parallel loops started by the current
+// thread run all of their iterations on it, in order, rather than sharing them
+// with other threads. This is useful when a thread is already working on one
+// of many independent pieces of a larger computation.
+class SerialLoopScope {
+  public:
+    SerialLoopScope() { ++depth; }
+    ~SerialLoopScope() { --depth; }
+    SerialLoopScope(const SerialLoopScope &) = delete;
+    SerialLoopScope &operator=(const SerialLoopScope &) = delete;
+
+    static bool Active() { return depth > 0; }
+
+  private:
+    static thread_local int depth;
+};
+
+// Order in which ParallelFor2D hands out its tiles. Work is split into
+// contiguous ranges of tiles, so with a space-filling curve each thread works
+// on a compact region and nearby tiles share cached textures and geometry.
+enum class TileOrder { Scanline, Morton, Hilbert };
+
+// With _affinity_, each thread starts with the same share of the tiles every
+// time a ParallelFor2D loop over the same extent runs (e.g., in successive
+// sample waves), so that it revisits the same region of the image.
+void SetTileScheduling(TileOrder order, bool affinity);
 
 // Parallel Inline Functions
 inline void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t)> func) {
-    ParallelFor(start, end, [&func](int64_t start, int64_t end) {
-        for (int64_t i = start; i < end; ++i)
-            func(i);
-    });
+    ParallelFor(
+        start, end,
+        [&func](int64_t start, int64_t end) {
+            for (int64_t i = start; i < end; ++i)
+                func(i);
+        },
+        &func.target_type());
 }
 
 inline void ParallelFor2D(const Bounds2i &extent, std::function<void(Point2i)> func) {
-    ParallelFor2D(extent, [&func](Bounds2i b) {
-        for (Point2i p : b)
-            func(p);
-    });
+    ParallelFor2D(
+        extent,
+        [&func](Bounds2i b) {
+            for (Point2i p : b)
+                func(p);
+        },
+        &func.target_type());
 }
 
+// WorkStealingDeque Definition
+// A Chase-Lev deque: the thread that owns it pushes and pops items at the
+// bottom while any other thread may steal them from the top.
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_pointer_v<T>, "WorkStealingDeque only holds pointers");
+
+  public:
+    // WorkStealingDeque Public Methods
+    explicit WorkStealingDeque(int logCapacity = 8)
+        : buffer(new Buffer(int64_t(1) << logCapacity)) {}
+    ~WorkStealingDeque() {
+        delete buffer.load(std::memory_order_relaxed);
+        for (Buffer *b : retiredBuffers)
+            delete b;
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    void Push(T item) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer *buf = buffer.load(std::memory_order_relaxed);
+        if (b - t > buf->capacity - 1) {
+            // Grow the buffer; thieves may still be reading the old one, so
+            // it is kept around until the deque is destroyed
+            Buffer *newBuf = new Buffer(2 * buf->capacity);
+            for (int64_t i = t; i < b; ++i)
+                newBuf->Put(i, buf->Get(i));
+            retiredBuffers.push_back(buf);
+            buffer.store(newBuf, std::memory_order_release);
+            buf = newBuf;
+        }
+        buf->Put(b, item);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    T Pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer *buf = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            // Deque was empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T item = buf->Get(b);
+        if (t == b) {
+            // Race against thieves for the last item
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                item = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    T Steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        T item = buffer.load(std::memory_order_acquire)->Get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            // Another thread took the item first
+            return nullptr;
+        return item;
+    }
+
+    bool Empty() const {
+        return bottom.load(std::memory_order_relaxed) <=
+               top.load(std::memory_order_relaxed);
+    }
+
+  private:
+    // WorkStealingDeque Private Members
+    struct Buffer {
+        explicit Buffer(int64_t capacity)
+            : capacity(capacity), items(new std::atomic<T>[capacity]) {}
+        T Get(int64_t i) const {
+            return items[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        void Put(int64_t i, T item) {
+            items[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Buffer *> buffer;
+    std::vector<Buffer *> retiredBuffers;
+};
+
 class ThreadPool;
+class ParallelJob;
+
+// ParallelTask Definition
+// A contiguous range of a job's steps that is scheduled as a unit.
+struct ParallelTask {
+    ParallelJob *job;
+    int64_t begin, end;
+};
 
 // ParallelJob Definition
 class ParallelJob {
   public:
     // ParallelJob Public Methods
-    virtual ~ParallelJob() { DCHECK(removed); }
+    explicit ParallelJob(int64_t nSteps)
+        : tasks(nSteps),
+          stepsRemaining(nSteps),
+          memoryCategory(CurrentMemoryCategory()) {}
+    virtual ~ParallelJob() { DCHECK(Finished()); }
 
-    virtual bool HaveWork() const = 0;
-    virtual void RunStep(std::unique_lock<std::mutex> *lock) = 0;
+    virtual void RunSteps(int64_t begin, int64_t end) = 0;
 
-    bool Finished() const { return !HaveWork() && activeWorkers == 0; }
+    int64_t NumSteps() const { return tasks.size(); }
+    bool Finished() const { return stepsRemaining.load(std::memory_order_acquire) == 0; }
 
     virtual std::string ToString() const = 0;
 
@@ -298,15 +529,20 @@ class ParallelJob {
 
   protected:
     std::string BaseToString() const {
-        return StringPrintf("activeWorkers: %d removed: %s", activeWorkers, removed);
+        return StringPrintf("nSteps: %d stepsRemaining: %d", NumSteps(),
+                            stepsRemaining.load());
     }
 
   private:
     // ParallelJob Private Members
     friend class ThreadPool;
-    int activeWorkers = 0;
-    ParallelJob *prev = nullptr, *next = nullptr;
-    bool removed = false;
+    // A task that starts at step _i_ is stored in _tasks[i]_; the ranges of
+    // a job's tasks never overlap, so each entry is used at most once.
+    std::vector<ParallelTask> tasks;
+    std::atomic<int64_t> stepsRemaining;
+    // Allocations made by the job's steps take the category of the thread
+    // that created it
+    MemoryCategory memoryCategory;
 };
 
 // ThreadPool Definition
@@ -319,10 +555,13 @@ class ThreadPool {
 
     size_t size() const { return threads.size(); }
 
-    std::unique_lock<std::mutex> AddToJobList(ParallelJob *job);
-    void RemoveFromJobList(ParallelJob *job);
+    // Starts running _job_ in the calling thread and returns once all of its
+    // steps have completed, helping with other work while it waits. With
+    // _affinity_, the steps are first divided evenly among the threads.
+    void Run(ParallelJob *job, bool affinity = false);
+    // Makes _job_ available to other threads and returns immediately.
+    void Enqueue(ParallelJob *job);
 
-    void WorkOrWait(std::unique_lock<std::mutex> *lock, bool isEnqueuingThread);
     bool WorkOrReturn();
 
     void Disable();
@@ -334,42 +573,113 @@ class ThreadPool {
 
   private:
     // ThreadPool Private Methods
-    void Worker();
+    void Worker(int index);
+    void Push(ParallelTask *task);
+    ParallelTask *FindTask(bool isWorker);
+    void RunTask(ParallelTask *task);
+    void NotifyWaiters();
 
     // ThreadPool Private Members
     std::vector<std::thread> threads;
+    // _deques[0]_ belongs to the thread that created the pool and
+    // _deques[i]_ to _threads[i - 1]_.
+    std::vector<std::unique_ptr<WorkStealingDeque<ParallelTask *>>> deques;
+    // NUMA node that each deque's thread runs on
+    std::vector<int> dequeNumaNodes;
+    // Tasks pushed by threads that are not part of the pool
+    std::mutex injectedMutex;
+    std::vector<ParallelTask *> injectedTasks;
+    std::atomic<int> nInjectedTasks{0};
+    // Tasks assigned to each deque's thread by Run() with affinity
+    std::mutex affineMutex;
+    std::vector<std::vector<ParallelTask *>> affineTasks;
+    std::atomic<int> nAffineTasks{0};
+
     mutable std::mutex mutex;
     bool shutdownThreads = false;
-    bool disabled = false;
-    ParallelJob *jobList = nullptr;
-    std::condition_variable jobListCondition;
+    std::atomic<bool> disabled{false};
+    std::atomic<int> nWaiting{0};
+    uint64_t workEpoch = 0;
+    std::condition_variable workCondition;
 };
 
 bool DoParallelWork();
 
+// AsyncJobBase Definition
+class AsyncJobBase : public ParallelJob {
+  public:
+    // AsyncJobBase Public Methods
+    AsyncJobBase() : ParallelJob(1) {}
+
+    bool IsReady() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return ready;
+    }
+
+    void Wait() {
+        while (!IsReady() && DoParallelWork())
+            ;
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!ready)
+            cv.wait(lock, [this]() { return ready; });
+    }
+
+    // Calls _func_ once the job's result is available: immediately if it
+    // already is, and otherwise from the thread that finishes the job.
+    void OnReady(std::function<void(void)> func) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!ready) {
+            continuations.push_back(std::move(func));
+            return;
+        }
+        lock.unlock();
+        func();
+    }
+
+    // Starts the job on the thread pool, or runs it immediately if there
+    // are no other threads.
+    void Schedule() {
+        if (RunningThreads() == 1)
+            DoWork();
+        else
+            threadPool->Enqueue(this);
+    }
+
+    virtual void DoWork() = 0;
+
+  protected:
+    // AsyncJobBase Protected Methods
+    // Called with _mutex_ held once the job's result has been stored;
+    // releases the lock before running continuations.
+    void SetReady(std::unique_lock<std::mutex> &lock) {
+        ready = true;
+        cv.notify_all();
+        std::vector<std::function<void(void)>> funcs = std::move(continuations);
+        continuations.clear();
+        lock.unlock();
+        for (auto &func : funcs)
+            func();
+    }
+
+    // AsyncJobBase Protected Members
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+
+  private:
+    bool ready = false;
+    std::vector<std::function<void(void)>> continuations;
+};
+
 // AsyncJob Definition
 template <typename T>
-class AsyncJob : public ParallelJob {
+class AsyncJob : public AsyncJobBase {
   public:
     // AsyncJob Public Methods
     AsyncJob(std::function<T(void)> w) : func(std::move(w)) {}
 
-    bool HaveWork() const { return !started; }
-
-    void RunStep(std::unique_lock<std::mutex> *lock) {
-        threadPool->RemoveFromJobList(this);
+    void RunSteps(int64_t begin, int64_t end) {
         started = true;
-        lock->unlock();
-        // Execute asynchronous work and notify waiting threads of its completion
-        T r = func();
-        std::unique_lock<std::mutex> ul(mutex);
-        result = r;
-        cv.notify_all();
-    }
-
-    bool IsReady() const {
-        std::lock_guard<std::mutex> lock(mutex);
-        return result.has_value();
+        DoWork();
     }
 
     T GetResult() {
@@ -391,33 +701,35 @@ class AsyncJob : public ParallelJob {
         return {};
     }
 
-    void Wait() {
-        while (!IsReady() && DoParallelWork())
-            ;
-        std::unique_lock<std::mutex> lock(mutex);
-        if (!result.has_value())
-            cv.wait(lock, [this]() { return result.has_value(); });
-    }
-
     void DoWork() {
+        // Execute asynchronous work and notify waiting threads of its completion
         T r = func();
-        std::unique_lock<std::mutex> l(mutex);
+        std::unique_lock<std::mutex> lock(mutex);
         CHECK(!result.has_value());
         result = r;
-        cv.notify_all();
+        SetReady(lock);
+    }
+
+    // Returns a job that runs _f_ with this job's result once it is
+    // available, without blocking a thread until then.
+    template <typename F>
+    auto Then(F f) {
+        using R = typename std::invoke_result_t<F, T>;
+        AsyncJob<R> *job = new AsyncJob<R>([this, f]() { return f(GetResult()); });
+        OnReady([job]() { job->Schedule(); });
+        return job;
     }
 
     std::string ToString() const {
-        return StringPrintf("[ AsyncJob started: %s ]", started);
+        return StringPrintf("[ AsyncJob started: %s ready: %s %s ]", started.load(),
+                            IsReady(), BaseToString());
     }
 
   private:
     // AsyncJob Private Members
     std::function<T(void)> func;
-    bool started = false;
+    std::atomic<bool> started{false};
     pstd::optional<T> result;
-    mutable std::mutex mutex;
-    std::condition_variable cv;
 };
 
 void ForEachThread(std::function<void(void)> func);
@@ -434,15 +746,49 @@ inline auto RunAsync(F func, Args &&...args) {
     AsyncJob<R> *job = new AsyncJob<R>(std::move(fvoid));
 
     // Enqueue _job_ or run it immediately
-    std::unique_lock<std::mutex> lock;
-    if (RunningThreads() == 1)
-        job->DoWork();
-    else
-        lock = ParallelJob::threadPool->AddToJobList(job);
+    job->Schedule();
+
+    return job;
+}
+
+// Returns a job that runs _func_ once all of _dependencies_ have finished;
+// no thread is blocked waiting for them.
+template <typename F, typename... Args>
+inline auto RunAsyncAfter(std::vector<AsyncJobBase *> dependencies, F func,
+                          Args &&...args) {
+    auto fvoid = std::bind(func, std::forward<Args>(args)...);
+    using R = typename std::invoke_result_t<F, Args...>;
+    AsyncJob<R> *job = new AsyncJob<R>(std::move(fvoid));
+
+    // Schedule _job_ when the last of its dependencies is ready; the extra
+    // count keeps it from starting before all continuations are registered
+    dependencies.erase(std::remove(dependencies.begin(), dependencies.end(), nullptr),
+                       dependencies.end());
+    auto remaining = std::make_shared<std::atomic<int>>(int(dependencies.size()) + 1);
+    auto dependencyReady = [job, remaining]() {
+        if (--*remaining == 0)
+            job->Schedule();
+    };
+    for (AsyncJobBase *dependency : dependencies)
+        dependency->OnReady(dependencyReady);
+    dependencyReady();
 
     return job;
 }
 
+// Returns a job whose result is the results of all of the given jobs.
+template <typename T>
+inline AsyncJob<std::vector<T>> *WhenAll(std::vector<AsyncJob<T> *> jobs) {
+    std::vector<AsyncJobBase *> dependencies(jobs.begin(), jobs.end());
+    return RunAsyncAfter(std::move(dependencies), [jobs]() {
+        std::vector<T> results;
+        results.reserve(jobs.size());
+        for (AsyncJob<T> *job : jobs)
+            results.push_back(job->GetResult());
+        return results;
+    });
+}
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_PARALLEL_H
@@ -0,0 +1,29 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/parallel.h>
+
+#include <atomic>
+
+using namespace pbrt;
+
+// Measures the overhead of a ParallelFor() loop over the given number of
+// iterations with a trivial body, which is dominated by the cost of waking
+// the worker threads and handing out the work.
+static void ParallelFor_Overhead(benchmark::State &state) {
+    int64_t count = state.range(0);
+    std::atomic<int64_t> sum{0};
+    for (auto _ : state)
+        ParallelFor(0, count, [&](int64_t start, int64_t end) {
+            sum.fetch_add(end - start, std::memory_order_relaxed);
+        });
+    benchmark::DoNotOptimize(sum.load());
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+BENCHMARK(ParallelFor_Overhead)->RangeMultiplier(16)->Range(1, 1 << 16)->UseRealTime();
@@ -8,6 +8,9 @@
 
 #include <atomic>
 #include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace pbrt;
 
@@ -47,6 +50,171 @@ TEST(Parallel, ForEachThread) {
     EXPECT_EQ(0, count);
 }
 
+TEST(Parallel, Nested) {
+    std::atomic<int> counter{0};
+    ParallelFor(0, 50, [&](int64_t) {
+        ParallelFor(0, 100, [&](int64_t) { ++counter; });
+        ParallelFor2D(Bounds2i{{0, 0}, {7, 9}}, [&](Point2i p) { ++counter; });
+    });
+    EXPECT_EQ(50 * (100 + 7 * 9), counter);
+}
+
+TEST(Parallel, TileScheduling) {
+    // Every pixel must be visited exactly once with each tile order, with
+    // and without thread affinity
+    Bounds2i extent{{3, 5}, {131, 77}};
+    for (TileOrder order : {TileOrder::Scanline, TileOrder::Morton, TileOrder::Hilbert})
+        for (bool affinity : {false, true}) {
+            SetTileScheduling(order, affinity);
+            std::vector<std::atomic<int>> counts(extent.Area());
+            for (int i = 0; i < 3; ++i)
+                ParallelFor2D(extent, [&](Point2i p) {
+                    Point2i pp(p - extent.pMin);
+                    ++counts[pp.y * extent.Diagonal().x + pp.x];
+                });
+            for (const std::atomic<int> &count : counts)
+                EXPECT_EQ(3, count);
+        }
+    SetTileScheduling(TileOrder::Hilbert, false);
+}
+
+TEST(Parallel, Waves) {
+    // Each pixel's waves must run in order and never concurrently, including
+    // when the loops are nested in another one
+    constexpr int nWaves = 5;
+    std::atomic<int> outOfOrder{0};
+    ParallelFor(0, 4, [&](int64_t i) {
+        Bounds2i extent{{0, 0}, i == 0 ? Point2i(37, 23) : Point2i(i, 3)};
+        std::vector<std::atomic<int>> nextWave(extent.Area());
+        ParallelFor2DWaves(extent, nWaves, [&](Bounds2i tile, int wave) {
+            for (Point2i p : tile) {
+                std::atomic<int> &next = nextWave[p.y * extent.Diagonal().x + p.x];
+                int expected = wave;
+                if (!next.compare_exchange_strong(expected, -1))
+                    ++outOfOrder;
+                std::this_thread::yield();
+                next = wave + 1;
+            }
+        });
+        for (const std::atomic<int> &next : nextWave)
+            EXPECT_EQ(nWaves, next);
+    });
+    EXPECT_EQ(0, outOfOrder);
+}
+
+TEST(Parallel, SerialLoopScope) {
+    // Loops started inside the scope run in order on the calling thread,
+    // including from within a parallel loop
+    std::atomic<int> wrongThread{0}, outOfOrder{0};
+    ParallelFor(0, 8, [&](int64_t) {
+        SerialLoopScope serialLoops;
+        std::thread::id tid = std::this_thread::get_id();
+        int64_t next = 0;
+        ParallelFor(0, 1000, [&](int64_t i) {
+            if (std::this_thread::get_id() != tid)
+                ++wrongThread;
+            if (i != next++)
+                ++outOfOrder;
+        });
+        int count = 0;
+        ParallelFor2D(Bounds2i{{0, 0}, {15, 14}}, [&](Point2i p) {
+            if (std::this_thread::get_id() != tid)
+                ++wrongThread;
+            ++count;
+        });
+        EXPECT_EQ(15 * 14, count);
+    });
+    EXPECT_EQ(0, wrongThread);
+    EXPECT_EQ(0, outOfOrder);
+    EXPECT_FALSE(SerialLoopScope::Active());
+}
+
+TEST(AsyncJob, Continuations) {
+    AsyncJob<int> *a = RunAsync([]() { return 2; });
+    AsyncJob<int> *b = a->Then([](int v) { return v * 3; });
+    AsyncJob<std::string> *c = b->Then([](int v) { return std::to_string(v); });
+    EXPECT_EQ("6", c->GetResult());
+
+    // A continuation added after the job has finished runs immediately
+    EXPECT_EQ(7, a->Then([](int v) { return v + 5; })->GetResult());
+}
+
+TEST(AsyncJob, WhenAll) {
+    std::vector<AsyncJob<int> *> jobs;
+    for (int i = 0; i < 100; ++i)
+        jobs.push_back(RunAsync([i]() { return i * i; }));
+    std::vector<int> results = WhenAll(jobs)->GetResult();
+    ASSERT_EQ(100, results.size());
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(i * i, results[i]);
+
+    EXPECT_TRUE(WhenAll(std::vector<AsyncJob<int> *>())->GetResult().empty());
+}
+
+TEST(AsyncJob, RunAsyncAfter) {
+    std::atomic<int> counter{0};
+    AsyncJob<int> *a = RunAsync([&]() { return ++counter; });
+    AsyncJob<int> *b = RunAsync([&]() { return ++counter; });
+    AsyncJob<int> *after = RunAsyncAfter({a, b, nullptr}, [&]() {
+        // Both dependencies must have finished before this runs
+        EXPECT_TRUE(a->IsReady() && b->IsReady());
+        return counter.load();
+    });
+    EXPECT_EQ(2, after->GetResult());
+}
+
+TEST(WorkStealingDeque, Basics) {
+    WorkStealingDeque<int *> deque(1);
+    std::vector<int> values(100);
+    EXPECT_EQ(nullptr, deque.Pop());
+    EXPECT_EQ(nullptr, deque.Steal());
+
+    // The owner pops in LIFO order and thieves steal in FIFO order; the
+    // buffer has to grow several times along the way.
+    for (int &v : values)
+        deque.Push(&v);
+    EXPECT_EQ(&values[0], deque.Steal());
+    EXPECT_EQ(&values[99], deque.Pop());
+    EXPECT_EQ(&values[1], deque.Steal());
+    for (int i = 98; i >= 2; --i)
+        EXPECT_EQ(&values[i], deque.Pop());
+    EXPECT_TRUE(deque.Empty());
+    EXPECT_EQ(nullptr, deque.Pop());
+}
+
+TEST(WorkStealingDeque, ConcurrentSteals) {
+    constexpr int nItems = 100000;
+    std::vector<std::atomic<int>> taken(nItems);
+    std::vector<int> values(nItems);
+    WorkStealingDeque<int *> deque;
+    std::atomic<bool> done{false};
+
+    auto take = [&](int *v) { ++taken[v - values.data()]; };
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 3; ++i)
+        thieves.push_back(std::thread([&]() {
+            while (!done || !deque.Empty())
+                if (int *v = deque.Steal())
+                    take(v);
+        }));
+
+    for (int i = 0; i < nItems; ++i) {
+        deque.Push(&values[i]);
+        if (i % 3 == 0)
+            if (int *v = deque.Pop())
+                take(v);
+    }
+    while (int *v = deque.Pop())
+        take(v);
+    done = true;
+    for (std::thread &t : thieves)
+        t.join();
+
+    // Every item must have been taken exactly once
+    for (int i = 0; i < nItems; ++i)
+        EXPECT_EQ(1, taken[i]);
+}
+
 TEST(ThreadLocal, Consistency) {
     ThreadLocal<std::thread::id> tids([]() { return std::this_thread::get_id(); });
 
@@ -79,4 +79,338 @@ PBRT_CONST int Primes[PrimeTableSize] = {
     7691, 7699, 7703, 7717, 7723, 7727, 7741, 7753, 7757, 7759, 7789, 7793, 7817, 7823,
     7829, 7841, 7853, 7867, 7873, 7877, 7879, 7883, 7901, 7907, 7919};
 
+// Multipliers and shifts for division by each of the primes in _Primes_
+PBRT_CONST PrimeDivisor PrimeDivisors[PrimeTableSize] = {
+    {2, 0x00000001, 0}, {3, 0x55555556, 1}, {5, 0x9999999a, 2}, {7, 0x24924925, 2},
+    {11, 0x745d1746, 3}, {13, 0x3b13b13c, 3}, {17, 0xe1e1e1e2, 4}, {19, 0xaf286bcb, 4},
+    {23, 0x642c8591, 4}, {29, 0x1a7b9612, 4}, {31, 0x08421085, 4}, {37, 0xbacf914d, 5},
+    {41, 0x8f9c18fa, 5}, {43, 0x7d05f418, 5}, {47, 0x5c9882ba, 5}, {53, 0x3521cfb3, 5},
+    {59, 0x15b1e5f8, 5}, {61, 0x0c9714fc, 5}, {67, 0xe9131ac0, 6}, {71, 0xcd856891, 6},
+    {73, 0xc0e07039, 6}, {79, 0x9ec8e952, 6}, {83, 0x8acb90f7, 6}, {89, 0x702e05c1, 6},
+    {97, 0x51d07eaf, 6}, {101, 0x446f8657, 6}, {103, 0x3e22cbcf, 6}, {107, 0x323e34a3, 6},
+    {109, 0x2c9fb4d9, 6}, {113, 0x21fb7813, 6}, {127, 0x02040811, 6},
+    {131, 0xf44659e5, 7}, {137, 0xde5d6e40, 7}, {139, 0xd77b654c, 7},
+    {149, 0xb7d6c3de, 7}, {151, 0xb2036407, 7}, {157, 0xa16d3f98, 7},
+    {163, 0x920fb49e, 7}, {167, 0x886e5f0b, 7}, {173, 0x7ad2208f, 7},
+    {179, 0x6e1f76b5, 7}, {181, 0x6a13cd16, 7}, {191, 0x571ed3c6, 7},
+    {193, 0x53909490, 7}, {197, 0x4cab8873, 7}, {199, 0x49539e3c, 7},
+    {211, 0x3698df3e, 7}, {223, 0x25e22709, 7}, {227, 0x20b470c7, 7},
+    {229, 0x1e2ef3b4, 7}, {233, 0x19453809, 7}, {239, 0x12358e76, 7},
+    {241, 0x0fef0110, 7}, {251, 0x05197f7e, 7}, {257, 0xfe01fe02, 8},
+    {263, 0xf25f6443, 8}, {269, 0xe741aa5a, 8}, {271, 0xe3a9179e, 8},
+    {277, 0xd92f2232, 8}, {281, 0xd272ca40, 8}, {283, 0xcf26e5c5, 8},
+    {293, 0xbf583ee9, 8}, {307, 0xaaf1d2f9, 8}, {311, 0xa5741077, 8},
+    {313, 0xa2c2a87d, 8}, {317, 0x9d79f177, 8}, {331, 0x8bfce807, 8},
+    {337, 0x84f00c28, 8}, {347, 0x79baa6bc, 8}, {349, 0x7790811a, 8},
+    {353, 0x734f0c55, 8}, {359, 0x6d1a6269, 8}, {367, 0x6524f854, 8},
+    {373, 0x5f664343, 8}, {379, 0x59d61f13, 8}, {383, 0x56397ba8, 8},
+    {389, 0x50f22e12, 8}, {397, 0x4a27fad8, 8}, {401, 0x46dce346, 8},
+    {409, 0x40782d11, 8}, {419, 0x38d22d37, 8}, {421, 0x3755bd1d, 8},
+    {431, 0x301c82ad, 8}, {433, 0x2eb4ea20, 8}, {439, 0x2a91c930, 8},
+    {443, 0x27dfa38b, 8}, {449, 0x23eb7972, 8}, {457, 0x1ecf43c8, 8},
+    {461, 0x1c522fc2, 8}, {463, 0x1b17c680, 8}, {467, 0x18ab083a, 8},
+    {479, 0x11a3019b, 8}, {487, 0x0d244564, 8}, {491, 0x0af2f723, 8},
+    {499, 0x06ab59c8, 8}, {503, 0x04949cc2, 8}, {509, 0x01824366, 8},
+    {521, 0xf727cce6, 9}, {523, 0xf53b3a40, 9}, {541, 0xe48df597, 9},
+    {547, 0xdf3d4f18, 9}, {557, 0xd6a2b33f, 9}, {563, 0xd19eb156, 9},
+    {569, 0xccb5c3b7, 9}, {571, 0xcb18a894, 9}, {577, 0xc65285fe, 9},
+    {587, 0xbe9526d1, 9}, {593, 0xba10679c, 9}, {599, 0xb5a2d4d6, 9},
+    {601, 0xb42e00db, 9}, {607, 0xafde42a3, 9}, {613, 0xaba41fbe, 9},
+    {617, 0xa8de6469, 9}, {619, 0xa77ef751, 9}, {631, 0x9f713118, 9},
+    {641, 0x98f603ff, 9}, {643, 0x97b05f8e, 9}, {647, 0x952b20d8, 9},
+    {653, 0x9172152c, 9}, {659, 0x8dca643a, 9}, {661, 0x8c9644f1, 9},
+    {673, 0x8583fe7b, 9}, {677, 0x8336d484, 9}, {683, 0x7fd00600, 9},
+    {691, 0x7b5e78c7, 9}, {701, 0x75f50b53, 9}, {709, 0x71bcd733, 9},
+    {719, 0x6c9863b2, 9}, {727, 0x68954dd3, 9}, {733, 0x65a1b3de, 9},
+    {739, 0x62ba5eeb, 9}, {743, 0x60d17c62, 9}, {751, 0x5d0f56ed, 9},
+    {757, 0x5a4b1347, 9}, {761, 0x58791a94, 9}, {769, 0x54e3b41a, 9},
+    {773, 0x53201fcc, 9}, {787, 0x4d17bef2, 9}, {797, 0x48e9d63f, 9},
+    {809, 0x4408dc3f, 9}, {811, 0x433c4a7f, 9}, {821, 0x3f4c6508, 9},
+    {823, 0x3e85c12b, 9}, {827, 0x3cfb5b52, 9}, {829, 0x3c3795c6, 9},
+    {839, 0x3872ba21, 9}, {853, 0x3351ee98, 9}, {857, 0x31e2b9ce, 9},
+    {859, 0x312c67b7, 9}, {863, 0x2fc24c89, 9}, {877, 0x2ae8f088, 9},
+    {881, 0x298d830e, 9}, {883, 0x28e0fa7e, 9}, {887, 0x278a3eeb, 9},
+    {907, 0x2105ed60, 9}, {911, 0x1fc10dc5, 9}, {919, 0x1d3fca85, 9},
+    {929, 0x1a2dbe6b, 9}, {937, 0x17c4fc73, 9}, {941, 0x16948a34, 9},
+    {947, 0x14d0b156, 9}, {953, 0x13128900, 9}, {967, 0x0f170835, 9},
+    {971, 0x0df9252d, 9}, {977, 0x0c50b447, 9}, {983, 0x0aad71cf, 9},
+    {991, 0x08865437, 9}, {997, 0x06eecbe1, 9}, {1009, 0x03ce4585, 9},
+    {1013, 0x02c7a506, 9}, {1019, 0x014191f7, 9}, {1021, 0x00c0906d, 9},
+    {1031, 0xfc86155b, 10}, {1033, 0xfb8a096b, 10}, {1039, 0xf89bb80e, 10},
+    {1049, 0xf3cc435c, 10}, {1051, 0xf2d8c8b6, 10}, {1061, 0xee25284c, 10},
+    {1063, 0xed37264b, 10}, {1069, 0xea727838, 10}, {1087, 0xe2535eea, 10},
+    {1091, 0xe08eaa5b, 10}, {1093, 0xdfad8e2c, 10}, {1097, 0xddedcc32, 10},
+    {1103, 0xdb54400f, 10}, {1109, 0xd8c1e788, 10}, {1117, 0xd55f1ca6, 10},
+    {1123, 0xd2dd1f3c, 10}, {1129, 0xd061f4aa, 10}, {1151, 0xc781ab0a, 10},
+    {1153, 0xc6b76578, 10}, {1163, 0xc2ce7911, 10}, {1171, 0xbfba0aef, 10},
+    {1181, 0xbbef869d, 10}, {1187, 0xb9b1109c, 10}, {1193, 0xb77861da, 10},
+    {1201, 0xb48afa3f, 10}, {1213, 0xb03967a0, 10}, {1217, 0xaecdb9be, 10},
+    {1223, 0xacb0aacf, 10}, {1229, 0xaa98e44c, 10}, {1231, 0xa9e775ea, 10},
+    {1237, 0xa7d69c0b, 10}, {1249, 0xa3c42689, 10}, {1259, 0xa06e9d62, 10},
+    {1277, 0x9a8feff7, 10}, {1279, 0x99eb9585, 10}, {1283, 0x98a46a27, 10},
+    {1289, 0x96bd77c3, 10}, {1291, 0x961c2874, 10}, {1297, 0x943b36ad, 10},
+    {1301, 0x92fd0c66, 10}, {1303, 0x925eb2ca, 10}, {1307, 0x912373c3, 10},
+    {1319, 0x8d7d2f8e, 10}, {1321, 0x8ce31ffa, 10}, {1327, 0x8b17ba8d, 10},
+    {1361, 0x8138fe4f, 10}, {1367, 0x7f882575, 10}, {1373, 0x7ddb1512, 10},
+    {1381, 0x7ba4cbea, 10}, {1399, 0x76c25546, 10}, {1409, 0x74196fbe, 10},
+    {1423, 0x70704235, 10}, {1427, 0x6f67defe, 10}, {1429, 0x6ee43b7a, 10},
+    {1433, 0x6dde0ea7, 10}, {1439, 0x6c578707, 10}, {1447, 0x6a53dbe9, 10},
+    {1451, 0x6954283a, 10}, {1453, 0x68d4d58a, 10}, {1459, 0x6758f5a6, 10},
+    {1471, 0x646a81d4, 10}, {1481, 0x62026b85, 10}, {1483, 0x61883319, 10},
+    {1487, 0x6094bec1, 10}, {1489, 0x601b8227, 10}, {1493, 0x5f2a0267, 10},
+    {1499, 0x5dc22d6e, 10}, {1511, 0x5afb1632, 10}, {1523, 0x583f339b, 10},
+    {1531, 0x5672b4ed, 10}, {1543, 0x53c8eaee, 10}, {1549, 0x5277fc09, 10},
+    {1553, 0x5198cf0b, 10}, {1559, 0x504c3144, 10}, {1567, 0x4e94aa8f, 10},
+    {1571, 0x4dba94f1, 10}, {1579, 0x4c09ba49, 10}, {1583, 0x4b32f0f6, 10},
+    {1597, 0x484ba971, 10}, {1601, 0x4779af18, 10}, {1607, 0x4640ad53, 10},
+    {1609, 0x45d8dc34, 10}, {1613, 0x4509ffaf, 10}, {1619, 0x43d59f8c, 10},
+    {1621, 0x436f56b4, 10}, {1627, 0x423dfe6e, 10}, {1637, 0x40460f54, 10},
+    {1657, 0x3c68707a, 10}, {1663, 0x3b4431e1, 10}, {1667, 0x3a8288ae, 10},
+    {1669, 0x3a220d31, 10}, {1693, 0x35ae0b31, 10}, {1697, 0x34f32d69, 10},
+    {1699, 0x349612fd, 10}, {1709, 0x32c7d3aa, 10}, {1721, 0x30a43887, 10},
+    {1723, 0x3049b1da, 10}, {1733, 0x2e8832d1, 10}, {1741, 0x2d2451c2, 10},
+    {1747, 0x2c1b8c88, 10}, {1753, 0x2b14974b, 10}, {1759, 0x2a0f6d4d, 10},
+    {1777, 0x270a8440, 10}, {1783, 0x260c5905, 10}, {1787, 0x2563d99c, 10},
+    {1789, 0x250fe23d, 10}, {1801, 0x231c0092, 10}, {1811, 0x21807ea9, 10},
+    {1823, 0x1f98a525, 10}, {1831, 0x1e56f6ea, 10}, {1847, 0x1bdbf694, 10},
+    {1861, 0x19b94b3f, 10}, {1867, 0x18d18452, 10}, {1871, 0x1837d320, 10},
+    {1873, 0x17eb398b, 10}, {1877, 0x175283c1, 10}, {1879, 0x17066746, 10},
+    {1889, 0x158c43c3, 10}, {1901, 0x13cbbfe7, 10}, {1907, 0x12ed9bdb, 10},
+    {1913, 0x1210dc8a, 10}, {1931, 0x0f82d9b0, 10}, {1933, 0x0f3aef2f, 10},
+    {1949, 0x0d00eb61, 10}, {1951, 0x0cba5331, 10}, {1973, 0x09bb3b4c, 10},
+    {1979, 0x08ecfbfe, 10}, {1987, 0x07dbecef, 10}, {1993, 0x071091ec, 10},
+    {1997, 0x0689adb4, 10}, {1999, 0x06466f6b, 10}, {2003, 0x05c059fb, 10},
+    {2011, 0x04b5c8c1, 10}, {2017, 0x03ef3f15, 10}, {2027, 0x02a6f647, 10},
+    {2029, 0x0265b186, 10}, {2039, 0x0121456f, 10}, {2053, 0xfec0c784, 11},
+    {2063, 0xfc46faea, 11}, {2069, 0xfacda431, 11}, {2081, 0xf7e17dd9, 11},
+    {2083, 0xf765a356, 11}, {2087, 0xf66ea49e, 11}, {2089, 0xf5f38010, 11},
+    {2099, 0xf38f4e6d, 11}, {2111, 0xf0b85468, 11}, {2113, 0xf03ff840, 11},
+    {2129, 0xec853b0b, 11}, {2131, 0xec0ee574, 11}, {2137, 0xeaad38e7, 11},
+    {2141, 0xe9c28a77, 11}, {2143, 0xe94d8759, 11}, {2153, 0xe707ba90, 11},
+    {2161, 0xe53a2a69, 11}, {2179, 0xe1380a57, 11}, {2203, 0xdbf9f514, 11},
+    {2207, 0xdb1d1d59, 11}, {2213, 0xd9d358f6, 11}, {2221, 0xd81e6df7, 11},
+    {2237, 0xd4bdf7fe, 11}, {2239, 0xd452c7a2, 11}, {2243, 0xd37cf9ba, 11},
+    {2251, 0xd1d3a57a, 11}, {2267, 0xce89fe6c, 11}, {2269, 0xce219f33, 11},
+    {2273, 0xcd516dd0, 11}, {2281, 0xcbb33bd2, 11}, {2287, 0xca7e7d26, 11},
+    {2293, 0xc94b5c1c, 11}, {2297, 0xc87f7f9d, 11}, {2309, 0xc6202707, 11},
+    {2311, 0xc5bb8a95, 11}, {2333, 0xc174343c, 11}, {2339, 0xc04d0d3f, 11},
+    {2341, 0xbfeb00fc, 11}, {2347, 0xbec5dce1, 11}, {2351, 0xbe034447, 11},
+    {2357, 0xbce09c67, 11}, {2371, 0xba40228e, 11}, {2377, 0xb9225b1d, 11},
+    {2381, 0xb864a300, 11}, {2383, 0xb8060416, 11}, {2389, 0xb6eb1aaf, 11},
+    {2393, 0xb62f48db, 11}, {2399, 0xb516babf, 11}, {2411, 0xb2e9cef2, 11},
+    {2417, 0xb1d56bee, 11}, {2423, 0xb0c26755, 11}, {2437, 0xae45f621, 11},
+    {2441, 0xad917632, 11}, {2447, 0xac83d18d, 11}, {2459, 0xaa6c7ad9, 11},
+    {2467, 0xa90a7b13, 11}, {2473, 0xa8027c04, 11}, {2477, 0xa753328a, 11},
+    {2503, 0xa2ed7ce2, 11}, {2521, 0x9fefc0a3, 11}, {2531, 0x9e4b0cd9, 11},
+    {2539, 0x9cfcdfd7, 11}, {2543, 0x9c56932e, 11}, {2549, 0x9b5e1ab7, 11},
+    {2551, 0x9b0b8a63, 11}, {2557, 0x9a149fca, 11}, {2579, 0x969517ed, 11},
+    {2591, 0x94b30834, 11}, {2593, 0x94631f4c, 11}, {2609, 0x91e84128, 11},
+    {2617, 0x90adbb55, 11}, {2621, 0x901130be, 11}, {2633, 0x8e3e6b89, 11},
+    {2647, 0x8c233421, 11}, {2657, 0x8aa5872e, 11}, {2659, 0x8a598995, 11},
+    {2663, 0x89c1e60c, 11}, {2671, 0x8893fbc9, 11}, {2677, 0x87b2bb3f, 11},
+    {2683, 0x86d27c9d, 11}, {2687, 0x863d8bf5, 11}, {2689, 0x85f33e2b, 11},
+    {2693, 0x855ef75a, 11}, {2699, 0x84816016, 11}, {2707, 0x835b72e7, 11},
+    {2711, 0x82c922d9, 11}, {2713, 0x8280243d, 11}, {2719, 0x81a5cd59, 11},
+    {2729, 0x803c0962, 11}, {2731, 0x7ff40060, 11}, {2741, 0x7e8d6705, 11},
+    {2749, 0x7d7066d0, 11}, {2753, 0x7ce285b9, 11}, {2767, 0x7af52ce0, 11},
+    {2777, 0x7997d47e, 11}, {2789, 0x77f7ec2d, 11}, {2791, 0x77b2f3ce, 11},
+    {2797, 0x76e4a230, 11}, {2801, 0x765b9428, 11}, {2803, 0x761732b1, 11},
+    {2819, 0x73f7a531, 11}, {2833, 0x722112b5, 11}, {2837, 0x719b7a17, 11},
+    {2843, 0x70d3c99d, 11}, {2851, 0x6fcad7af, 11}, {2857, 0x6f051b83, 11},
+    {2861, 0x6e81beaf, 11}, {2879, 0x6c372159, 11}, {2887, 0x6b34c2bb, 11},
+    {2897, 0x69f3ce2a, 11}, {2903, 0x69344b23, 11}, {2909, 0x6875925a, 11},
+    {2917, 0x67787f15, 11}, {2927, 0x663e1904, 11}, {2939, 0x64c7a4b7, 11},
+    {2953, 0x6316a062, 11}, {2957, 0x629ba915, 11}, {2963, 0x61e3d57e, 11},
+    {2969, 0x612cc01c, 11}, {2971, 0x60efe30d, 11}, {2999, 0x5da4524a, 11},
+    {3001, 0x5d68ab4b, 11}, {3011, 0x5c3f989e, 11}, {3019, 0x5b535ad2, 11},
+    {3023, 0x5addb3f5, 11}, {3037, 0x59445cba, 11}, {3041, 0x58d01998, 11},
+    {3049, 0x57e87d9c, 11}, {3061, 0x568f58bd, 11}, {3067, 0x55e3c994, 11},
+    {3079, 0x548eacc6, 11}, {3083, 0x541d8f92, 11}, {3089, 0x53747061, 11},
+    {3109, 0x514569fa, 11}, {3119, 0x50309706, 11}, {3121, 0x4ff97021, 11},
+    {3137, 0x4e42c115, 11}, {3163, 0x4b835bdd, 11}, {3167, 0x4b182b54, 11},
+    {3169, 0x4ae2ad0a, 11}, {3181, 0x49a320eb, 11}, {3187, 0x490441df, 11},
+    {3191, 0x489aaccf, 11}, {3203, 0x475f82ae, 11}, {3209, 0x46c2cfe6, 11},
+    {3217, 0x45f2ca4a, 11}, {3221, 0x458b2aaf, 11}, {3229, 0x44bcb0a4, 11},
+    {3251, 0x428a1e66, 11}, {3253, 0x42575a6d, 11}, {3257, 0x41f2025c, 11},
+    {3259, 0x41bf6e36, 11}, {3271, 0x409141d2, 11}, {3299, 0x3dd8bc1a, 11},
+    {3301, 0x3da76f72, 11}, {3307, 0x3d13e510, 11}, {3313, 0x3c80e37d, 11},
+    {3319, 0x3bee69fb, 11}, {3323, 0x3b8d0edf, 11}, {3329, 0x3afb7681, 11},
+    {3331, 0x3acb0c39, 11}, {3343, 0x39a9c5f5, 11}, {3347, 0x3949cf34, 11},
+    {3359, 0x382b4a01, 11}, {3361, 0x37fbbc0f, 11}, {3371, 0x370ecf05, 11},
+    {3373, 0x36df9791, 11}, {3389, 0x3567dd8e, 11}, {3391, 0x35392620, 11},
+    {3407, 0x33c5642a, 11}, {3413, 0x333ae179, 11}, {3433, 0x3170ad01, 11},
+    {3449, 0x3005f01e, 11}, {3457, 0x2f51d404, 11}, {3461, 0x2ef815e5, 11},
+    {3463, 0x2ecb4abd, 11}, {3467, 0x2e71dc1e, 11}, {3469, 0x2e45389b, 11},
+    {3491, 0x2c5d9227, 11}, {3499, 0x2badc392, 11}, {3511, 0x2aa78e42, 11},
+    {3517, 0x2a251f60, 11}, {3527, 0x294cb85d, 11}, {3529, 0x2921963c, 11},
+    {3533, 0x28cb777d, 11}, {3539, 0x284aa6d0, 11}, {3541, 0x281fcf6b, 11},
+    {3547, 0x279f9374, 11}, {3557, 0x26cad049, 11}, {3559, 0x26a06795, 11},
+    {3571, 0x25a2f2bd, 11}, {3581, 0x24d10839, 11}, {3583, 0x24a73084, 11},
+    {3593, 0x23d6acdb, 11}, {3607, 0x22b4b292, 11}, {3613, 0x22391bfd, 11},
+    {3617, 0x21e6f1eb, 11}, {3623, 0x216c09e5, 11}, {3631, 0x20c8cb9e, 11},
+    {3637, 0x204ed58f, 11}, {3643, 0x1fd54658, 11}, {3659, 0x1e9310b9, 11},
+    {3671, 0x1da3405e, 11}, {3673, 0x1d7b6f4f, 11}, {3677, 0x1d2bee75, 11},
+    {3691, 0x1c1706de, 11}, {3697, 0x1ba0fed3, 11}, {3701, 0x1b528539, 11},
+    {3709, 0x1ab61405, 11}, {3719, 0x19f378cf, 11}, {3727, 0x195889ed, 11},
+    {3733, 0x18e4c654, 11}, {3739, 0x187161d8, 11}, {3761, 0x16cd6d1d, 11},
+    {3767, 0x165bbe7d, 11}, {3769, 0x1635ee35, 11}, {3779, 0x1579767c, 11},
+    {3793, 0x14734712, 11}, {3797, 0x1428b902, 11}, {3803, 0x13b92f31, 11},
+    {3821, 0x126cabc9, 11}, {3823, 0x1247eb1c, 11}, {3833, 0x1190bb02, 11},
+    {3847, 0x1091de10, 11}, {3851, 0x104963c8, 11}, {3853, 0x10253517, 11},
+    {3863, 0x0f70db7d, 11}, {3877, 0x0e75ee2c, 11}, {3881, 0x0e2e91c7, 11},
+    {3889, 0x0da049ba, 11}, {3907, 0x0c6248ff, 11}, {3911, 0x0c1c03ee, 11},
+    {3917, 0x0bb2e138, 11}, {3919, 0x0b8fe7f7, 11}, {3923, 0x0b4a10d7, 11},
+    {3929, 0x0ae19269, 11}, {3931, 0x0abecfbf, 11}, {3943, 0x09eefd57, 11},
+    {3947, 0x09a9ff18, 11}, {3967, 0x08531e23, 11}, {3989, 0x06ddec1b, 11},
+    {4001, 0x0614174b, 11}, {4003, 0x05f291f1, 11}, {4007, 0x05afa0f0, 11},
+    {4013, 0x054b777c, 11}, {4019, 0x04e79a98, 11}, {4021, 0x04c661eb, 11},
+    {4027, 0x0462ea94, 11}, {4049, 0x02f8baa5, 11}, {4051, 0x02d7ff7f, 11},
+    {4057, 0x0275ffa0, 11}, {4073, 0x017213fd, 11}, {4079, 0x01112235, 11},
+    {4091, 0x00501908, 11}, {4093, 0x00300902, 11}, {4099, 0xffa011fd, 12},
+    {4111, 0xfe21c05c, 12}, {4127, 0xfc277391, 12}, {4129, 0xfbe87098, 12},
+    {4133, 0xfb6a997e, 12}, {4139, 0xfaae4b95, 12}, {4153, 0xf8f908d1, 12},
+    {4157, 0xf87ca4cc, 12}, {4159, 0xf83e89c2, 12}, {4177, 0xf612438b, 12},
+    {4201, 0xf333fae2, 12}, {4211, 0xf2047fab, 12}, {4217, 0xf14f19cd, 12},
+    {4219, 0xf112bfde, 12}, {4229, 0xefe5d962, 12}, {4231, 0xefa9d6fb, 12},
+    {4241, 0xee7ea44f, 12}, {4243, 0xee42f8b4, 12}, {4253, 0xed197629, 12},
+    {4259, 0xec67a04f, 12}, {4261, 0xec2c7585, 12}, {4271, 0xeb057458, 12},
+    {4273, 0xeaca9e87, 12}, {4283, 0xe9a54471, 12}, {4289, 0xe8f5e9ae, 12},
+    {4297, 0xe80cde57, 12}, {4327, 0xe4aaa092, 12}, {4337, 0xe38c8b12, 12},
+    {4339, 0xe3537c14, 12}, {4349, 0xe236faa5, 12}, {4357, 0xe154509d, 12},
+    {4363, 0xe0aadcbd, 12}, {4373, 0xdf91797a, 12}, {4391, 0xdd9a34d3, 12},
+    {4397, 0xdcf35dae, 12}, {4409, 0xdba70c23, 12}, {4421, 0xda5c886d, 12},
+    {4423, 0xda259f1d, 12}, {4441, 0xd839a50a, 12}, {4447, 0xd7968996, 12},
+    {4451, 0xd72a0b29, 12}, {4457, 0xd687aafe, 12}, {4463, 0xd5e5ba99, 12},
+    {4481, 0xd4028384, 12}, {4483, 0xd3cd100c, 12}, {4493, 0xd2c28571, 12},
+    {4507, 0xd14f59b1, 12}, {4513, 0xd0b0fb68, 12}, {4517, 0xd047a30e, 12},
+    {4519, 0xd01308c8, 12}, {4523, 0xcfa9f7f7, 12}, {4547, 0xcd3774d4, 12},
+    {4549, 0xcd038b9f, 12}, {4561, 0xcbcd0927, 12}, {4567, 0xcb326490, 12},
+    {4583, 0xc997fdc5, 12}, {4591, 0xc8cbdcfc, 12}, {4597, 0xc8333bc1, 12},
+    {4603, 0xc79b0064, 12}, {4621, 0xc5d4ad83, 12}, {4637, 0xc443cbaa, 12},
+    {4639, 0xc411e136, 12}, {4643, 0xc3ae2d53, 12}, {4649, 0xc318f1da, 12},
+    {4651, 0xc2e74943, 12}, {4657, 0xc2529104, 12}, {4663, 0xc1be3abf, 12},
+    {4673, 0xc0c7d8ff, 12}, {4679, 0xc0348628, 12}, {4691, 0xbf0f01e9, 12},
+    {4703, 0xbdeafd1e, 12}, {4721, 0xbc37be7f, 12}, {4723, 0xbc0796a2, 12},
+    {4729, 0xbb775d9a, 12}, {4733, 0xbb176b95, 12}, {4751, 0xb969aa54, 12},
+    {4759, 0xb8abb4e8, 12}, {4783, 0xb675a4b1, 12}, {4787, 0xb617d9ed, 12},
+    {4789, 0xb5e90395, 12}, {4793, 0xb58b74eb, 12}, {4799, 0xb4ff69c9, 12},
+    {4801, 0xb4d0cf52, 12}, {4813, 0xb3ba00bf, 12}, {4817, 0xb35d603f, 12},
+    {4831, 0xb21a63bb, 12}, {4861, 0xaf6c8a67, 12}, {4871, 0xae89cd3c, 12},
+    {4877, 0xae023463, 12}, {4889, 0xacf4024e, 12}, {4903, 0xabba73cf, 12},
+    {4909, 0xab349e54, 12}, {4919, 0xaa564997, 12}, {4931, 0xa94cae3c, 12},
+    {4933, 0xa92089d6, 12}, {4937, 0xa8c85c82, 12}, {4943, 0xa8445d04, 12},
+    {4951, 0xa794dd1a, 12}, {4957, 0xa7119c54, 12}, {4967, 0xa6378f70, 12},
+    {4969, 0xa60c0e39, 12}, {4973, 0xa5b526a9, 12}, {4987, 0xa4861541, 12},
+    {4993, 0xa404b78e, 12}, {4999, 0xa383a95b, 12}, {5003, 0xa32dcbe9, 12},
+    {5009, 0xa2ad4193, 12}, {5011, 0xa2827a4e, 12}, {5021, 0xa1ad18d5, 12},
+    {5023, 0xa18285d6, 12}, {5039, 0xa02f2558, 12}, {5051, 0x9f32062f, 12},
+    {5059, 0x9e89f188, 12}, {5077, 0x9d11b2db, 12}, {5081, 0x9cbe7361, 12},
+    {5087, 0x9c41d303, 12}, {5099, 0x9b497387, 12}, {5101, 0x9b202b5d, 12},
+    {5107, 0x9aa4848a, 12}, {5113, 0x9a292802, 12}, {5119, 0x99ae1582, 12},
+    {5147, 0x97738a6c, 12}, {5153, 0x96fa168e, 12}, {5167, 0x95dfcbaf, 12},
+    {5171, 0x958f6be1, 12}, {5179, 0x94ef0b9e, 12}, {5189, 0x94274551, 12},
+    {5197, 0x9388012f, 12}, {5209, 0x929a05cd, 12}, {5227, 0x9137193a, 12},
+    {5231, 0x90e88ee7, 12}, {5233, 0x90c15545, 12}, {5237, 0x9072f903, 12},
+    {5261, 0x8e9f500c, 12}, {5273, 0x8db7143f, 12}, {5279, 0x8d435bb4, 12},
+    {5281, 0x8d1cd7d1, 12}, {5297, 0x8be9c4c0, 12}, {5303, 0x8b7717e6, 12},
+    {5309, 0x8b04ad67, 12}, {5323, 0x89fab5b3, 12}, {5333, 0x893d967e, 12},
+    {5347, 0x88360170, 12}, {5351, 0x87eaf322, 12}, {5381, 0x85bb9663, 12},
+    {5387, 0x854c766d, 12}, {5393, 0x84dd95c4, 12}, {5399, 0x846ef432, 12},
+    {5407, 0x83dbd3e0, 12}, {5413, 0x836dc4b2, 12}, {5417, 0x832487eb, 12},
+    {5419, 0x82fff3e9, 12}, {5431, 0x82250caf, 12}, {5437, 0x81b7f5d5, 12},
+    {5441, 0x816f5e26, 12}, {5443, 0x814b1c8d, 12}, {5449, 0x80de80a3, 12},
+    {5471, 0x7f524eb5, 12}, {5477, 0x7ee6ce81, 12}, {5479, 0x7ec3067f, 12},
+    {5483, 0x7e7b8a88, 12}, {5501, 0x7d3b2606, 12}, {5503, 0x7d17adc1, 12},
+    {5507, 0x7cd0d101, 12}, {5519, 0x7bfcd887, 12}, {5521, 0x7bd99b62, 12},
+    {5527, 0x7b700b1e, 12}, {5531, 0x7b29cb84, 12}, {5557, 0x7963a528, 12},
+    {5563, 0x78fb71b7, 12}, {5569, 0x789377c0, 12}, {5573, 0x784e4649, 12},
+    {5581, 0x77c42f86, 12}, {5591, 0x77182156, 12}, {5623, 0x74f5aa52, 12},
+    {5639, 0x73e6c237, 12}, {5641, 0x73c500dd, 12}, {5647, 0x735fe18a, 12},
+    {5651, 0x731c95dc, 12}, {5653, 0x72faf92a, 12}, {5657, 0x72b7d206, 12},
+    {5659, 0x72964791, 12}, {5669, 0x71eeee2a, 12}, {5683, 0x7105a17e, 12},
+    {5689, 0x70a1ff31, 12}, {5693, 0x705fb0dc, 12}, {5701, 0x6fdb5ba7, 12},
+    {5711, 0x6f36769c, 12}, {5717, 0x6ed3cdac, 12}, {5737, 0x6d8c6d6b, 12},
+    {5741, 0x6d4b39d6, 12}, {5743, 0x6d2aa8c4, 12}, {5749, 0x6cc9185c, 12},
+    {5779, 0x6ae45045, 12}, {5783, 0x6aa40e58, 12}, {5791, 0x6a23ceab, 12},
+    {5801, 0x6983fe6a, 12}, {5807, 0x69245eb2, 12}, {5813, 0x68c4f183, 12},
+    {5821, 0x6846039c, 12}, {5827, 0x67e70bbb, 12}, {5839, 0x6729b1e0, 12},
+    {5843, 0x66eac02b, 12}, {5849, 0x668c7eee, 12}, {5851, 0x666d1ed9, 12},
+    {5857, 0x660f1f84, 12}, {5861, 0x65d090aa, 12}, {5867, 0x6572e356, 12},
+    {5869, 0x6553b474, 12}, {5879, 0x64b81b86, 12}, {5881, 0x64990d31, 12},
+    {5897, 0x63a15cb0, 12}, {5903, 0x6344d31e, 12}, {5923, 0x6211b884, 12},
+    {5927, 0x61d48c77, 12}, {5939, 0x611d86e1, 12}, {5953, 0x6048ef1a, 12},
+    {5981, 0x5ea2bbe7, 12}, {5987, 0x5e48c6bf, 12}, {6007, 0x5d1e3726, 12},
+    {6011, 0x5ce2bddd, 12}, {6029, 0x5bd81615, 12}, {6037, 0x5b62154a, 12},
+    {6043, 0x5b09c92f, 12}, {6047, 0x5acf04b3, 12}, {6053, 0x5a770342, 12},
+    {6067, 0x59aa57da, 12}, {6073, 0x5952eaa1, 12}, {6079, 0x58fba996, 12},
+    {6089, 0x586a9f02, 12}, {6091, 0x584dab86, 12}, {6101, 0x57bd32fc, 12},
+    {6113, 0x57107543, 12}, {6121, 0x569dac70, 12}, {6131, 0x560e9d40, 12},
+    {6133, 0x55f20ef2, 12}, {6143, 0x55638ed1, 12}, {6151, 0x54f1e41e, 12},
+    {6163, 0x5447f1b6, 12}, {6173, 0x53bad396, 12}, {6197, 0x526a0095, 12},
+    {6199, 0x524e0d22, 12}, {6203, 0x52163416, 12}, {6211, 0x51a6b93b, 12},
+    {6217, 0x51534d4b, 12}, {6221, 0x511bc6e2, 12}, {6229, 0x50acf0d6, 12},
+    {6247, 0x4fb498f0, 12}, {6257, 0x4f2b3f0d, 12}, {6263, 0x4ed90bd1, 12},
+    {6269, 0x4e8700dc, 12}, {6271, 0x4e6bb0ce, 12}, {6277, 0x4e19db61, 12},
+    {6287, 0x4d91d086, 12}, {6299, 0x4cef2243, 12}, {6301, 0x4cd414a4, 12},
+    {6311, 0x4c4d1261, 12}, {6317, 0x4bfc458b, 12}, {6323, 0x4bab9ff7, 12},
+    {6329, 0x4b5b2189, 12}, {6337, 0x4af00afd, 12}, {6343, 0x4a9fe777, 12},
+    {6353, 0x4a1aad08, 12}, {6359, 0x49caf0aa, 12}, {6361, 0x49b06519, 12},
+    {6367, 0x4960dc04, 12}, {6373, 0x49117946, 12}, {6379, 0x48c23cc3, 12},
+    {6389, 0x483e81e8, 12}, {6397, 0x47d56b88, 12}, {6421, 0x469bbaa1, 12},
+    {6427, 0x464dac1e, 12}, {6449, 0x4530b504, 12}, {6451, 0x4516e5c5, 12},
+    {6469, 0x442f5469, 12}, {6473, 0x43fc0b8d, 12}, {6481, 0x4395aa72, 12},
+    {6491, 0x43160bea, 12}, {6521, 0x41998986, 12}, {6529, 0x4134a89b, 12},
+    {6547, 0x4052954b, 12}, {6551, 0x4020834e, 12}, {6553, 0x4007802e, 12},
+    {6563, 0x3f8aab16, 12}, {6569, 0x3f3ff388, 12}, {6571, 0x3f271371, 12},
+    {6577, 0x3edc8a6a, 12}, {6581, 0x3eaaed0f, 12}, {6599, 0x3dcc6781, 12},
+    {6607, 0x3d69e51d, 12}, {6619, 0x3cd693d3, 12}, {6637, 0x3bfa9998, 12},
+    {6653, 0x3b381051, 12}, {6659, 0x3aef5a8a, 12}, {6661, 0x3ad72566, 12},
+    {6673, 0x3a46348f, 12}, {6679, 0x39fdee24, 12}, {6689, 0x3985c28a, 12},
+    {6691, 0x396dc4da, 12}, {6701, 0x38f6076a, 12}, {6703, 0x38de1fb4, 12},
+    {6709, 0x38967e75, 12}, {6719, 0x381f6529, 12}, {6733, 0x3779404c, 12},
+    {6737, 0x3749e885, 12}, {6761, 0x362f0702, 12}, {6763, 0x36178b6a, 12},
+    {6779, 0x355c2e60, 12}, {6781, 0x3544d2a9, 12}, {6791, 0x34d03cec, 12},
+    {6793, 0x34b8f651, 12}, {6803, 0x3444c9da, 12}, {6823, 0x335d7674, 12},
+    {6827, 0x332f5c36, 12}, {6829, 0x33185446, 12}, {6833, 0x32ea4ec1, 12},
+    {6841, 0x328e6d0c, 12}, {6857, 0x31d74e4b, 12}, {6863, 0x3192db1c, 12},
+    {6869, 0x314e868b, 12}, {6871, 0x3137c67a, 12}, {6883, 0x30af8d26, 12},
+    {6899, 0x2ffaa819, 12}, {6907, 0x2fa08606, 12}, {6911, 0x2f738906, 12},
+    {6917, 0x2f30267e, 12}, {6947, 0x2de0f8d1, 12}, {6949, 0x2dcabac8, 12},
+    {6959, 0x2d5bb5b1, 12}, {6961, 0x2d458b46, 12}, {6967, 0x2d031f91, 12},
+    {6971, 0x2cd6e805, 12}, {6977, 0x2c94ad0b, 12}, {6983, 0x2c528f33, 12},
+    {6991, 0x2bfa949a, 12}, {6997, 0x2bb8ba73, 12}, {7001, 0x2b8ce3bc, 12},
+    {7013, 0x2b09ac69, 12}, {7019, 0x2ac83bd1, 12}, {7027, 0x2a712788, 12},
+    {7039, 0x29eee81c, 12}, {7043, 0x29c396e2, 12}, {7057, 0x292c5d98, 12},
+    {7069, 0x28ab38d3, 12}, {7079, 0x283fefcd, 12}, {7103, 0x273faf45, 12},
+    {7109, 0x26ffe459, 12}, {7121, 0x2680a10f, 12}, {7127, 0x2641288e, 12},
+    {7129, 0x262c0677, 12}, {7151, 0x25445735, 12}, {7159, 0x24f071dc, 12},
+    {7177, 0x24345ce3, 12}, {7187, 0x23cc47ab, 12}, {7193, 0x238df81a, 12},
+    {7207, 0x22fcfb11, 12}, {7211, 0x22d3a8ab, 12}, {7213, 0x22bf03df, 12},
+    {7219, 0x2281270c, 12}, {7229, 0x221a46c2, 12}, {7237, 0x21c82e21, 12},
+    {7243, 0x218aba20, 12}, {7247, 0x2161d099, 12}, {7253, 0x212487f6, 12},
+    {7283, 0x1ff3a089, 12}, {7297, 0x1f663250, 12}, {7307, 0x1f0181ab, 12},
+    {7309, 0x1eed66cd, 12}, {7321, 0x1e7500ab, 12}, {7331, 0x1e10f8a2, 12},
+    {7333, 0x1dfcff69, 12}, {7349, 0x1d5d99cc, 12}, {7351, 0x1d49b996, 12},
+    {7369, 0x1c9753f8, 12}, {7393, 0x1baad115, 12}, {7411, 0x1afa7044, 12},
+    {7417, 0x1abfd608, 12}, {7433, 0x1a24067a, 12}, {7451, 0x197589be, 12},
+    {7457, 0x193b9016, 12}, {7459, 0x1928422c, 12}, {7477, 0x187afbed, 12},
+    {7481, 0x18549787, 12}, {7487, 0x181b149f, 12}, {7489, 0x1807ee3a, 12},
+    {7499, 0x17a8557c, 12}, {7507, 0x175c0a3b, 12}, {7517, 0x16fce6a1, 12},
+    {7523, 0x16c3f059, 12}, {7529, 0x168b114f, 12}, {7537, 0x163f6150, 12},
+    {7541, 0x161998bc, 12}, {7547, 0x15e0ff16, 12}, {7549, 0x15ce2652, 12},
+    {7559, 0x157010cd, 12}, {7561, 0x155d4757, 12}, {7573, 0x14ecc3ef, 12},
+    {7577, 0x14c75712, 12}, {7583, 0x148f46bb, 12}, {7589, 0x14574d15, 12},
+    {7591, 0x1444a991, 12}, {7603, 0x13d50932, 12}, {7607, 0x13afe7c6, 12},
+    {7621, 0x132e415f, 12}, {7639, 0x128842c2, 12}, {7643, 0x12637ab1, 12},
+    {7649, 0x122c610f, 12}, {7669, 0x117555b1, 12}, {7673, 0x1150d722, 12},
+    {7681, 0x1107f734, 12}, {7687, 0x10d168bd, 12}, {7691, 0x10ad15df, 12},
+    {7699, 0x10648d1f, 12}, {7703, 0x10405735, 12}, {7717, 0x0fc1e631, 12},
+    {7723, 0x0f8bd9af, 12}, {7727, 0x0f67dd48, 12}, {7741, 0x0eea34d9, 12},
+    {7753, 0x0e7edc60, 12}, {7757, 0x0e5b271c, 12}, {7759, 0x0e495003, 12},
+    {7789, 0x0d3eceff, 12}, {7793, 0x0d1b6e04, 12}, {7817, 0x0c47eac8, 12},
+    {7823, 0x0c133de2, 12}, {7829, 0x0bdea5a8, 12}, {7841, 0x0b75b304, 12},
+    {7853, 0x0b0d127c, 12}, {7867, 0x0a936924, 12}, {7873, 0x0a5f670c, 12},
+    {7877, 0x0a3cc640, 12}, {7879, 0x0a2b793a, 12}, {7883, 0x0a08e5ed, 12},
+    {7901, 0x096dbdf8, 12}, {7907, 0x093a2e2c, 12}, {7919, 0x08d34a95, 12}};
+
 }  // namespace pbrt
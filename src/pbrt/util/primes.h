@@ -9,11 +9,32 @@
 
 #include <pbrt/util/pstd.h>
 
+#include <cstdint>
+
 namespace pbrt {
 
+// PrimeDivisor Definition
+// Divides by a prime using a multiplication and shifts in place of integer
+// division, following "Division by Invariant Integers using Multiplication"
+// (Granlund and Montgomery 1994); 64-bit dividends fall back to regular
+// division.
+struct PrimeDivisor {
+    PBRT_CPU_GPU
+    uint64_t Divide(uint64_t n) const {
+        if (n > 0xffffffffu)
+            return n / base;
+        uint32_t t = (n * multiplier) >> 32;
+        return (t + ((uint32_t(n) - t) >> 1)) >> shift;
+    }
+
+    uint32_t base, multiplier;
+    int shift;
+};
+
 // Prime Table Declarations
 static constexpr int PrimeTableSize = 1000;
 extern PBRT_CONST int Primes[PrimeTableSize];
+extern PBRT_CONST PrimeDivisor PrimeDivisors[PrimeTableSize];
 
 }  // namespace pbrt
 
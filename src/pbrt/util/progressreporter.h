@@ -53,6 +53,10 @@ class ProgressReporter {
     void Done();
     double ElapsedSeconds() const;
 
+    int64_t WorkDone() const;
+    int64_t TotalWork() const { return totalWork; }
+    const std::string &Title() const { return title; }
+
     std::string ToString() const;
 
   private:
@@ -60,11 +64,11 @@ class ProgressReporter {
     void printBar();
 
     // ProgressReporter Private Members
-    int64_t totalWork;
+    int64_t totalWork = 0;
     std::string title;
     bool quiet;
     Timer timer;
-    std::atomic<int64_t> workDone;
+    std::atomic<int64_t> workDone{0};
     std::atomic<bool> exitThread;
     std::thread updateThread;
     pstd::optional<float> finishTime;
@@ -93,11 +97,21 @@ inline void ProgressReporter::Update(int64_t num) {
         return;
     }
 #endif
-    if (num == 0 || quiet)
+    if (num == 0)
         return;
     workDone += num;
 }
 
+inline int64_t ProgressReporter::WorkDone() const {
+#ifdef PBRT_BUILD_GPU_RENDERER
+    // Without the progress bar's thread to wait for GPU work to finish, count
+    // it when it is launched
+    if (quiet && gpuEvents.size() > 0)
+        return gpuEventsLaunchedOffset;
+#endif
+    return workDone;
+}
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_PROGRESSREPORTER_H
@@ -4,9 +4,11 @@
 
 #include <gtest/gtest.h>
 
+#include <pbrt/util/memory.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/rng.h>
 
+#include <cstring>
 #include <map>
 #include <set>
 #include <string>
@@ -153,3 +155,89 @@ TEST(MonotonicBufferResource, NoOverlap) {
         spans.push_back(Span{p, size});
     }
 }
+
+TEST(HugePageMemoryResource, Basics) {
+    TrackingResource tr;
+    HugePageMemoryResource hugePages(&tr, 2 << 20);
+    TrackedMemoryResource tracked(&hugePages);
+    Allocator alloc(&tracked);
+
+    // Small allocations go to the source resource.
+    void *small = alloc.allocate_bytes(1024, 16);
+    EXPECT_EQ(1, tr.allocs.size());
+    EXPECT_EQ(0, tracked.HugePageBytes());
+
+    size_t bigSize = (3 << 20) + 17;
+    char *big = (char *)alloc.allocate_bytes(bigSize, 64);
+    if (tracked.HugePageBytes() > 0) {
+        EXPECT_EQ(bigSize, tracked.HugePageBytes());
+        EXPECT_EQ(1, tr.allocs.size());
+        EXPECT_EQ(0, uintptr_t(big) % (2 << 20));
+    } else
+        // Huge pages may not be available on the system.
+        EXPECT_EQ(2, tr.allocs.size());
+    std::memset(big, 1, bigSize);
+
+    alloc.deallocate_bytes(big, bigSize, 64);
+    EXPECT_EQ(0, tracked.HugePageBytes());
+    alloc.deallocate_bytes(small, 1024, 16);
+    EXPECT_EQ(0, tr.allocs.size());
+    EXPECT_EQ(0, tracked.CurrentAllocatedBytes());
+}
+
+TEST(TrackedMemoryResource, Categories) {
+    TrackedMemoryResource tracked;
+    Allocator alloc(&tracked);
+
+    void *other = alloc.allocate_bytes(100);
+    void *geometry, *textures;
+    {
+        ScopedMemoryCategory category(MemoryCategory::Geometry);
+        geometry = alloc.allocate_bytes(200);
+        {
+            ScopedMemoryCategory inner(MemoryCategory::Textures);
+            textures = alloc.allocate_bytes(300);
+        }
+    }
+    EXPECT_EQ(MemoryCategory::Other, CurrentMemoryCategory());
+    EXPECT_EQ(600, tracked.CurrentAllocatedBytes());
+    EXPECT_EQ(100, tracked.CurrentAllocatedBytes(MemoryCategory::Other));
+    EXPECT_EQ(200, tracked.CurrentAllocatedBytes(MemoryCategory::Geometry));
+    EXPECT_EQ(300, tracked.CurrentAllocatedBytes(MemoryCategory::Textures));
+
+    // Deallocations are attributed to the allocation's category, not the
+    // current one.
+    {
+        ScopedMemoryCategory category(MemoryCategory::Film);
+        alloc.deallocate_bytes(geometry, 200);
+    }
+    alloc.deallocate_bytes(textures, 300);
+    EXPECT_EQ(0, tracked.CurrentAllocatedBytes(MemoryCategory::Geometry));
+    EXPECT_EQ(200, tracked.MaxAllocatedBytes(MemoryCategory::Geometry));
+    EXPECT_EQ(0, tracked.CurrentAllocatedBytes(MemoryCategory::Textures));
+    EXPECT_EQ(0, tracked.MaxAllocatedBytes(MemoryCategory::Film));
+
+    tracked.AddExternalBytes(MemoryCategory::Textures, 1000);
+    tracked.AddExternalBytes(MemoryCategory::Textures, -1000);
+    EXPECT_EQ(1000, tracked.MaxAllocatedBytes(MemoryCategory::Textures));
+
+    alloc.deallocate_bytes(other, 100);
+    EXPECT_EQ(0, tracked.CurrentAllocatedBytes());
+    EXPECT_EQ(1100, tracked.MaxAllocatedBytes());
+}
+
+TEST(ScratchBuffer, GrowsToHighWaterMark) {
+    ScratchBuffer buffer(256);
+    for (int i = 0; i < 10; ++i)
+        buffer.Alloc(100, 16);
+    EXPECT_GT(buffer.Overflows(), 0);
+    EXPECT_GE(buffer.HighWaterMark(), 1000);
+    buffer.Reset();
+
+    // After Reset(), the same allocations fit without growing again.
+    int64_t overflows = buffer.Overflows();
+    for (int i = 0; i < 10; ++i)
+        buffer.Alloc(100, 16);
+    EXPECT_EQ(overflows, buffer.Overflows());
+    buffer.Reset();
+}
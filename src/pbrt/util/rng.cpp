@@ -14,4 +14,8 @@ std::string RNG::ToString() const {
     return StringPrintf("[ RNG state: %" PRIu64 " inc: %" PRIu64 " ]", state, inc);
 }
 
+std::string BatchRNG::ToString() const {
+    return StringPrintf("[ BatchRNG current: %s ]", Current());
+}
+
 }  // namespace pbrt
@@ -65,10 +65,120 @@ class RNG {
     std::string ToString() const;
 
   private:
+    friend class BatchRNG;
+
+    // RNG Private Methods
+    PBRT_CPU_GPU
+    static uint32_t Output(uint64_t oldstate) {
+        uint32_t xorshifted = (uint32_t)(((oldstate >> 18u) ^ oldstate) >> 27u);
+        uint32_t rot = (uint32_t)(oldstate >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+    }
+
     // RNG Private Members
     uint64_t state, inc;
 };
 
+// BatchRNG Definition
+// Generates the same sequence of values as an _RNG_ with the same parameters,
+// but does so _Width_ values at a time: each lane steps through every
+// _Width_th state of the sequence, so that the lanes' updates are independent
+// of each other and the loops over them can be vectorized. The first _Width_
+// values after the sequence is set or advanced are generated one at a time,
+// as _RNG_ does, which also initializes the lanes; generating in batches thus
+// only starts to pay off once more values than that are used.
+class BatchRNG {
+  public:
+    // BatchRNG Public Constants
+    static constexpr int Width = 8;
+
+    // BatchRNG Public Methods
+    PBRT_CPU_GPU
+    BatchRNG() { computeWidthStep(); }
+    PBRT_CPU_GPU
+    BatchRNG(uint64_t seqIndex, uint64_t offset) { SetSequence(seqIndex, offset); }
+    PBRT_CPU_GPU
+    BatchRNG(uint64_t seqIndex) { SetSequence(seqIndex); }
+
+    PBRT_CPU_GPU
+    void SetSequence(uint64_t sequenceIndex, uint64_t offset) {
+        rng.SetSequence(sequenceIndex, offset);
+        computeWidthStep();
+        n = 0;
+        filled = false;
+    }
+    PBRT_CPU_GPU
+    void SetSequence(uint64_t sequenceIndex) {
+        SetSequence(sequenceIndex, MixBits(sequenceIndex));
+    }
+
+    template <typename T>
+    PBRT_CPU_GPU T Uniform();
+
+    // Fills _u_ with the next _u.size()_ values of the sequence.
+    PBRT_CPU_GPU
+    void Uniform(pstd::span<uint32_t> u);
+    PBRT_CPU_GPU
+    void Uniform(pstd::span<float> u);
+
+    PBRT_CPU_GPU
+    void Advance(int64_t idelta) {
+        rng = Current();
+        rng.Advance(idelta);
+        n = 0;
+        filled = false;
+    }
+    PBRT_CPU_GPU
+    int64_t operator-(const BatchRNG &other) const { return Current() - other.Current(); }
+
+    // Returns an _RNG_ that generates the values that this one would next.
+    PBRT_CPU_GPU
+    RNG Current() const {
+        if (!filled)
+            return rng;
+        RNG r = rng;
+        r.state = n < Width ? state[n] : state[Width - 1] * PCG32_MULT + rng.inc;
+        return r;
+    }
+
+    std::string ToString() const;
+
+  private:
+    // BatchRNG Private Methods
+    PBRT_CPU_GPU
+    void computeWidthStep() {
+        multWidth = 1;
+        plusWidth = 0;
+        for (int i = 0; i < Width; ++i) {
+            multWidth *= PCG32_MULT;
+            plusWidth = plusWidth * PCG32_MULT + rng.inc;
+        }
+    }
+
+    PBRT_CPU_GPU
+    void refill() {
+        for (int i = 0; i < Width; ++i)
+            state[i] = state[i] * multWidth + plusWidth;
+        for (int i = 0; i < Width; ++i)
+            values[i] = RNG::Output(state[i]);
+        n = 0;
+    }
+
+    template <typename T, typename F>
+    PBRT_CPU_GPU void fill(pstd::span<T> u, F convert);
+
+    // BatchRNG Private Members
+    // Until _filled_ is set, values come from _rng_ and the _n_th value's
+    // state is recorded in _state[n]_. Afterward, _state_ holds the states
+    // of the values in _values_, of which _n_ have been returned.
+    RNG rng;
+    uint64_t multWidth, plusWidth;
+    uint64_t state[Width];
+    uint32_t values[Width];
+    int n = 0;
+    bool filled = false;
+};
+
 // RNG Inline Method Definitions
 template <typename T>
 PBRT_CPU_GPU inline T RNG::Uniform() {
@@ -82,9 +192,7 @@ template <>
 PBRT_CPU_GPU inline uint32_t RNG::Uniform<uint32_t>() {
     uint64_t oldstate = state;
     state = oldstate * PCG32_MULT + inc;
-    uint32_t xorshifted = (uint32_t)(((oldstate >> 18u) ^ oldstate) >> 27u);
-    uint32_t rot = (uint32_t)(oldstate >> 59u);
-    return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+    return Output(oldstate);
 }
 
 template <>
@@ -167,6 +275,65 @@ inline int64_t RNG::operator-(const RNG &other) const {
     return (int64_t)distance;
 }
 
+// BatchRNG Inline Method Definitions
+template <typename T>
+PBRT_CPU_GPU inline T BatchRNG::Uniform() {
+    return T::unimplemented;
+}
+
+template <>
+PBRT_CPU_GPU inline uint32_t BatchRNG::Uniform<uint32_t>() {
+    if (!filled) {
+        state[n] = rng.state;
+        if (++n == Width)
+            filled = true;
+        return rng.Uniform<uint32_t>();
+    }
+    if (n == Width)
+        refill();
+    return values[n++];
+}
+
+template <>
+PBRT_CPU_GPU inline uint64_t BatchRNG::Uniform<uint64_t>() {
+    uint64_t v0 = Uniform<uint32_t>(), v1 = Uniform<uint32_t>();
+    return (v0 << 32) | v1;
+}
+
+template <>
+PBRT_CPU_GPU inline float BatchRNG::Uniform<float>() {
+    return std::min<float>(OneMinusEpsilon, Uniform<uint32_t>() * 0x1p-32f);
+}
+
+template <>
+PBRT_CPU_GPU inline double BatchRNG::Uniform<double>() {
+    return std::min<double>(OneMinusEpsilon, Uniform<uint64_t>() * 0x1p-64);
+}
+
+template <typename T, typename F>
+PBRT_CPU_GPU inline void BatchRNG::fill(pstd::span<T> u, F convert) {
+    size_t i = 0;
+    while (i < u.size() && !filled)
+        u[i++] = convert(Uniform<uint32_t>());
+    while (i < u.size()) {
+        if (n == Width)
+            refill();
+        int count = std::min<size_t>(Width - n, u.size() - i);
+        for (int j = 0; j < count; ++j)
+            u[i + j] = convert(values[n + j]);
+        i += count;
+        n += count;
+    }
+}
+
+PBRT_CPU_GPU inline void BatchRNG::Uniform(pstd::span<uint32_t> u) {
+    fill(u, [](uint32_t v) { return v; });
+}
+
+PBRT_CPU_GPU inline void BatchRNG::Uniform(pstd::span<float> u) {
+    fill(u, [](uint32_t v) { return std::min<float>(OneMinusEpsilon, v * 0x1p-32f); });
+}
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_RNG_H
@@ -122,6 +122,32 @@ TEST(RNG, Double) {
     }
 }
 
+TEST(BatchRNG, MatchesRNG) {
+    for (int seq = 0; seq < 8; ++seq) {
+        RNG rng(seq, 6502);
+        BatchRNG batch(seq, 6502);
+        // Mix single values and batches of various sizes, including ones
+        // that start partway through the initial scalar values
+        for (int size : {1, 3, 8, 1, 17, 5, 64, 2}) {
+            std::vector<float> u(size);
+            batch.Uniform(pstd::span<float>(u));
+            for (float v : u)
+                EXPECT_EQ(rng.Uniform<float>(), v);
+            EXPECT_EQ(rng.Uniform<uint32_t>(), batch.Uniform<uint32_t>());
+            EXPECT_EQ(rng.Uniform<double>(), batch.Uniform<double>());
+            EXPECT_EQ(0, batch.Current() - rng);
+        }
+
+        // Advance both partway through a batch
+        rng.Advance(seq * 37 + 1);
+        batch.Advance(seq * 37 + 1);
+        std::vector<uint32_t> v(100);
+        batch.Uniform(pstd::span<uint32_t>(v));
+        for (uint32_t x : v)
+            EXPECT_EQ(rng.Uniform<uint32_t>(), x);
+    }
+}
+
 #if 0
 TEST(RNG, ImageVis) {
     constexpr int nseeds = 256, ndims = 512;
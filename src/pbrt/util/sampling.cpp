@@ -12,6 +12,7 @@
 #include <pbrt/util/float.h>
 #include <pbrt/util/lowdiscrepancy.h>
 #include <pbrt/util/math.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/scattering.h>
@@ -560,28 +561,67 @@ void PiecewiseConstant2D::TestCompareDistributions(const PiecewiseConstant2D &da
 }
 
 // AliasTable Method Definitions
+// Alias tables with at least this many entries are normalized and have their
+// work lists initialized in parallel, a block of weights at a time. The
+// blocks are the same regardless of the number of threads, so the resulting
+// table is too.
+static constexpr size_t aliasTableParallelBlockSize = 64 * 1024;
+
 AliasTable::AliasTable(pstd::span<const Float> weights, Allocator alloc)
     : bins(weights.size(), alloc) {
     // Normalize _weights_ to compute alias table PDF
-    Float sum = std::accumulate(weights.begin(), weights.end(), 0.);
+    size_t nBlocks = 1;
+    if (weights.size() >= 2 * aliasTableParallelBlockSize)
+        nBlocks = (weights.size() + aliasTableParallelBlockSize - 1) /
+                  aliasTableParallelBlockSize;
+    auto forEachBlock = [&](std::function<void(size_t, size_t, size_t)> func) {
+        if (nBlocks == 1) {
+            func(0, 0, weights.size());
+            return;
+        }
+        ParallelFor(0, nBlocks, [&](int64_t block) {
+            size_t start = block * aliasTableParallelBlockSize;
+            func(block, start,
+                 std::min(weights.size(), start + aliasTableParallelBlockSize));
+        });
+    };
+    std::vector<double> blockSums(nBlocks);
+    std::vector<size_t> blockUnder(nBlocks + 1, 0);
+    forEachBlock([&](size_t block, size_t start, size_t end) {
+        blockSums[block] =
+            std::accumulate(weights.begin() + start, weights.begin() + end, 0.);
+    });
+    Float sum = std::accumulate(blockSums.begin(), blockSums.end(), 0.);
     CHECK_GT(sum, 0);
-    for (size_t i = 0; i < weights.size(); ++i)
-        bins[i].p = weights[i] / sum;
+
+    forEachBlock([&](size_t block, size_t start, size_t end) {
+        for (size_t i = start; i < end; ++i) {
+            bins[i].p = weights[i] / sum;
+            // Count the outcomes that will go on the _under_ work list
+            if (bins[i].p * bins.size() < 1)
+                ++blockUnder[block + 1];
+        }
+    });
 
     // Create alias table work lists
     struct Outcome {
         Float pHat;
         size_t index;
     };
-    std::vector<Outcome> under, over;
-    for (size_t i = 0; i < bins.size(); ++i) {
-        // Add outcome _i_ to an alias table work list
-        Float pHat = bins[i].p * bins.size();
-        if (pHat < 1)
-            under.push_back(Outcome{pHat, i});
-        else
-            over.push_back(Outcome{pHat, i});
-    }
+    for (size_t block = 0; block < nBlocks; ++block)
+        blockUnder[block + 1] += blockUnder[block];
+    std::vector<Outcome> under(blockUnder[nBlocks]), over(bins.size() - under.size());
+    forEachBlock([&](size_t block, size_t start, size_t end) {
+        size_t nUnder = blockUnder[block], nOver = start - nUnder;
+        for (size_t i = start; i < end; ++i) {
+            // Add outcome _i_ to an alias table work list
+            Float pHat = bins[i].p * bins.size();
+            if (pHat < 1)
+                under[nUnder++] = Outcome{pHat, i};
+            else
+                over[nOver++] = Outcome{pHat, i};
+        }
+    });
 
     // Process under and over work item together
     while (!under.empty() && !over.empty()) {
@@ -520,7 +520,7 @@ class VarianceEstimator {
 };
 
 // WeightedReservoirSampler Definition
-template <typename T>
+template <typename T, typename Generator = RNG>
 class WeightedReservoirSampler {
   public:
     // WeightedReservoirSampler Public Methods
@@ -536,7 +536,7 @@ class WeightedReservoirSampler {
         weightSum += weight;
         // Randomly add _sample_ to reservoir
         Float p = weight / weightSum;
-        if (rng.Uniform<Float>() < p) {
+        if (rng.template Uniform<Float>() < p) {
             reservoir = sample;
             reservoirWeight = weight;
             return true;
@@ -550,7 +550,7 @@ class WeightedReservoirSampler {
         // Process weighted reservoir sample via callback
         weightSum += weight;
         Float p = weight / weightSum;
-        if (rng.Uniform<Float>() < p) {
+        if (rng.template Uniform<Float>() < p) {
             reservoir = func();
             reservoirWeight = weight;
             return true;
@@ -593,7 +593,7 @@ class WeightedReservoirSampler {
 
   private:
     // WeightedReservoirSampler Private Members
-    RNG rng;
+    Generator rng;
     Float weightSum = 0;
     Float reservoirWeight = 0;
     T reservoir{};
@@ -605,7 +605,8 @@ class PiecewiseConstant1D {
     // PiecewiseConstant1D Public Methods
     PBRT_CPU_GPU
     size_t BytesUsed() const {
-        return (func.capacity() + cdf.capacity()) * sizeof(Float);
+        return (func.capacity() + cdf.capacity()) * sizeof(Float) +
+               guide.capacity() * sizeof(int);
     }
 
     static void TestCompareDistributions(const PiecewiseConstant1D &da,
@@ -618,13 +619,17 @@ class PiecewiseConstant1D {
     }
 
     PiecewiseConstant1D() = default;
-    PiecewiseConstant1D(Allocator alloc) : func(alloc), cdf(alloc) {}
+    PiecewiseConstant1D(Allocator alloc) : func(alloc), cdf(alloc), guide(alloc) {}
     PiecewiseConstant1D(pstd::span<const Float> f, Allocator alloc = {})
         : PiecewiseConstant1D(f, 0., 1., alloc) {}
 
     PiecewiseConstant1D(pstd::span<const Float> f, Float min, Float max,
                         Allocator alloc = {})
-        : func(f.begin(), f.end(), alloc), cdf(f.size() + 1, alloc), min(min), max(max) {
+        : func(f.begin(), f.end(), alloc),
+          cdf(f.size() + 1, alloc),
+          guide(alloc),
+          min(min),
+          max(max) {
         CHECK_GT(max, min);
         // Take absolute value of _func_
         for (Float &f : func)
@@ -646,6 +651,20 @@ class PiecewiseConstant1D {
         else
             for (size_t i = 1; i < n + 1; ++i)
                 cdf[i] /= funcInt;
+
+        // Initialize the guide table for large distributions
+        if (n >= MinGuidedSize) {
+            // _guide[j]_ is the interval that $u=j/g$ is sampled in.
+            size_t g = n / GuideScale;
+            guide.resize(g + 1);
+            size_t o = 0;
+            for (size_t j = 0; j <= g; ++j) {
+                Float u = Float(j) / Float(g);
+                while (o + 1 < n && cdf[o + 1] <= u)
+                    ++o;
+                guide[j] = o;
+            }
+        }
     }
 
     PBRT_CPU_GPU
@@ -656,7 +675,21 @@ class PiecewiseConstant1D {
     PBRT_CPU_GPU
     Float Sample(Float u, Float *pdf = nullptr, int *offset = nullptr) const {
         // Find surrounding CDF segments and _offset_
-        int o = FindInterval((int)cdf.size(), [&](int index) { return cdf[index] <= u; });
+        int o = -1;
+        if (!guide.empty()) {
+            // Search the intervals between the guide table entries around _u_,
+            // which give the same result as searching the entire CDF as long
+            // as they are bracketed by it; that may not be the case due to
+            // round-off error in computing _j_.
+            int g = int(guide.size()) - 1;
+            int j = Clamp(int(u * g), 0, g - 1);
+            int lo = guide[j], hi = guide[j + 1];
+            if ((lo == 0 || cdf[lo] <= u) && (hi + 1 == int(size()) || cdf[hi + 1] > u))
+                o = lo + FindInterval(hi - lo + 2,
+                                      [&](int index) { return cdf[lo + index] <= u; });
+        }
+        if (o == -1)
+            o = FindInterval((int)cdf.size(), [&](int index) { return cdf[index] <= u; });
         if (offset)
             *offset = o;
 
@@ -690,6 +723,11 @@ class PiecewiseConstant1D {
 
     // PiecewiseConstant1D Public Members
     pstd::vector<Float> func, cdf;
+    // Sampling uses a guide table for distributions with at least
+    // _MinGuidedSize_ values; it has an entry for every _GuideScale_ of them
+    // that bounds the intervals that must be searched.
+    static constexpr int MinGuidedSize = 64, GuideScale = 4;
+    pstd::vector<int> guide;
     Float min, max;
     Float funcInt = 0;
 };
@@ -1311,7 +1349,8 @@ class PiecewiseLinear2D {
         : m_param_values(alloc),
           m_data(alloc),
           m_marginal_cdf(alloc),
-          m_conditional_cdf(alloc) {
+          m_conditional_cdf(alloc),
+          m_compactData(alloc) {
         for (int i = 0; i < ArraySize; ++i)
             m_param_values.emplace_back(alloc);
     }
@@ -1343,7 +1382,8 @@ class PiecewiseLinear2D {
           m_param_values(alloc),
           m_data(alloc),
           m_marginal_cdf(alloc),
-          m_conditional_cdf(alloc) {
+          m_conditional_cdf(alloc),
+          m_compactData(alloc) {
         if (build_cdf && !normalize)
             LOG_FATAL("PiecewiseLinear2D: build_cdf implies normalize=true");
 
@@ -1686,29 +1726,51 @@ class PiecewiseLinear2D {
         if (Dimension != 0)
             index += slice_offset * size;
 
-        Float v00 = lookup<Dimension>(m_data.data(), index, size, param_weight),
-              v10 = lookup<Dimension>(m_data.data() + 1, index, size, param_weight),
-              v01 =
-                  lookup<Dimension>(m_data.data() + m_size.x, index, size, param_weight),
-              v11 = lookup<Dimension>(m_data.data() + m_size.x + 1, index, size,
-                                      param_weight);
+        auto interpolate = [&](const auto *data) {
+            Float v00 = lookup<Dimension>(data, index, size, param_weight),
+                  v10 = lookup<Dimension>(data + 1, index, size, param_weight),
+                  v01 = lookup<Dimension>(data + m_size.x, index, size, param_weight),
+                  v11 = lookup<Dimension>(data + m_size.x + 1, index, size,
+                                          param_weight);
+            return FMA(w0.y, FMA(w0.x, v00, w1.x * v10),
+                       w1.y * FMA(w0.x, v01, w1.x * v11)) *
+                   HProd(m_inv_patch_size);
+        };
+        return m_compactData.empty() ? interpolate(m_data.data())
+                                     : interpolate(m_compactData.data());
+    }
 
-        return FMA(w0.y, FMA(w0.x, v00, w1.x * v10), w1.y * FMA(w0.x, v01, w1.x * v11)) *
-               HProd(m_inv_patch_size);
+    /**
+     * Store the density values in half precision, which halves the memory
+     * they use, if all of them can be represented as half floats. Only
+     * distributions that were constructed without a cdf can be compacted;
+     * \c Evaluate() is the only method that they support.
+     */
+    bool CompactData() {
+        CHECK(m_marginal_cdf.empty() && m_conditional_cdf.empty());
+        for (float v : m_data)
+            if (!IsFinite(v) || std::abs(v) > 65504.f)
+                return false;
+        m_compactData = pstd::vector<Half>(m_data.size());
+        for (size_t i = 0; i < m_data.size(); ++i)
+            m_compactData[i] = Half(m_data[i]);
+        m_data = FloatStorage();
+        return true;
     }
 
     PBRT_CPU_GPU
     size_t BytesUsed() const {
         size_t sum = 4 * (m_data.capacity() + m_marginal_cdf.capacity() +
-                          m_conditional_cdf.capacity());
+                          m_conditional_cdf.capacity()) +
+                     2 * m_compactData.capacity();
         for (int i = 0; i < ArraySize; ++i)
             sum += m_param_values[i].capacity();
         return sum;
     }
 
   private:
-    template <size_t Dim, std::enable_if_t<Dim != 0, int> = 0>
-    PBRT_CPU_GPU Float lookup(const float *data, uint32_t i0, uint32_t size,
+    template <size_t Dim, typename T, std::enable_if_t<Dim != 0, int> = 0>
+    PBRT_CPU_GPU Float lookup(const T *data, uint32_t i0, uint32_t size,
                               const float *param_weight) const {
         uint32_t i1 = i0 + m_param_strides[Dim - 1] * size;
 
@@ -1719,10 +1781,10 @@ class PiecewiseLinear2D {
         return FMA(v0, w0, v1 * w1);
     }
 
-    template <size_t Dim, std::enable_if_t<Dim == 0, int> = 0>
-    PBRT_CPU_GPU Float lookup(const float *data, uint32_t index, uint32_t,
+    template <size_t Dim, typename T, std::enable_if_t<Dim == 0, int> = 0>
+    PBRT_CPU_GPU Float lookup(const T *data, uint32_t index, uint32_t,
                               const float *) const {
-        return data[index];
+        return Float(data[index]);
     }
 
     /// Resolution of the discretized density function
@@ -1746,6 +1808,9 @@ class PiecewiseLinear2D {
     /// Marginal and conditional PDFs
     FloatStorage m_marginal_cdf;
     FloatStorage m_conditional_cdf;
+
+    /// Density values in half precision, if \c CompactData() was called
+    pstd::vector<Half> m_compactData;
 };
 
 }  // namespace pbrt
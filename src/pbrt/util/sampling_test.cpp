@@ -144,6 +144,23 @@ TEST(LowDiscrepancy, RadicalInverse) {
     }
 }
 
+TEST(LowDiscrepancy, PrimeDivisors) {
+    RNG rng;
+    for (int i = 0; i < PrimeTableSize; ++i) {
+        const PrimeDivisor &divisor = PrimeDivisors[i];
+        uint32_t base = Primes[i];
+        EXPECT_EQ(base, divisor.base);
+        uint64_t values[] = {0, 1, base - 1, base, base + 1, 0xffffffffu,
+                             0xffffffffu / base * base, 0x100000000ull};
+        for (uint64_t n : values)
+            EXPECT_EQ(n / base, divisor.Divide(n)) << n << " / " << base;
+        for (int j = 0; j < 1000; ++j) {
+            uint64_t n = rng.Uniform<uint32_t>();
+            EXPECT_EQ(n / base, divisor.Divide(n)) << n << " / " << base;
+        }
+    }
+}
+
 TEST(LowDiscrepancy, SobolFirstDimension) {
     // Make sure first dimension is the regular base 2 radical inverse
     for (int i = 0; i < 8192; ++i) {
@@ -235,6 +252,32 @@ TEST(PiecewiseConstant1D, Continuous) {
     EXPECT_FLOAT_EQ(1., dist.Sample(1., &pdf));
 }
 
+TEST(PiecewiseConstant1D, GuideTable) {
+    // Sampling with the guide table must match a search of the entire CDF,
+    // including for distributions with runs of zero values and spikes.
+    RNG rng;
+    for (int n : {64, 67, 100, 1000, 4099}) {
+        std::vector<Float> values(n);
+        for (int i = 0; i < n; ++i) {
+            Float v = rng.Uniform<Float>();
+            values[i] = v < .3f ? 0 : (v > .98f ? 1000 * v : v);
+        }
+        PiecewiseConstant1D dist(values);
+        ASSERT_FALSE(dist.guide.empty());
+
+        for (int i = 0; i < 10000; ++i) {
+            Float u = i < 3 ? Float(i) / 2 * OneMinusEpsilon : rng.Uniform<Float>();
+            int expectedOffset = FindInterval(
+                dist.cdf.size(), [&](int index) { return dist.cdf[index] <= u; });
+            Float pdf;
+            int offset;
+            dist.Sample(u, &pdf, &offset);
+            EXPECT_EQ(expectedOffset, offset) << n << " " << u;
+            EXPECT_EQ(dist.func[expectedOffset] / dist.Integral(), pdf);
+        }
+    }
+}
+
 TEST(PiecewiseConstant1D, Range) {
     auto values = Sample1DFunction([](Float x) { return 1 + x; }, 65536, 4, -1.f, 3.f);
     PiecewiseConstant1D dist(values, -1.f, 3.f);
@@ -1209,6 +1252,35 @@ TEST(AliasTable, Varying) {
     }
 }
 
+TEST(AliasTable, Large) {
+    // Enough values that the table is initialized in parallel
+    std::vector<Float> values;
+    int n = 200003;
+    for (int i = 0; i < n; ++i)
+        values.push_back(1 + (i % 4));
+    Float sum = std::accumulate(values.begin(), values.end(), Float(0));
+
+    AliasTable table(values);
+    EXPECT_EQ(n, table.size());
+
+    // Check the sampling probability of each group of equal values
+    int count[4] = {0};
+    int iters = 4000000;
+    for (Float u : Stratified1D(iters)) {
+        Float pdf;
+        int offset = table.Sample(u, &pdf);
+        ASSERT_TRUE(offset >= 0 && offset < n);
+        ++count[offset % 4];
+        EXPECT_FLOAT_EQ(values[offset] / sum, pdf);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        Float pdf = (1 + i) * ((n + 3 - i) / 4) / sum;
+        EXPECT_GT(Float(count[i]) / iters, .99f * pdf);
+        EXPECT_LT(Float(count[i]) / iters, 1.01f * pdf);
+    }
+}
+
 TEST(SummedArea, Constant) {
     Array2D<Float> v(4, 4);
 
@@ -1327,3 +1399,32 @@ TEST(Sampling, HGExtremes) {
         }
     }
 }
+
+TEST(PiecewiseLinear2D, CompactData) {
+    // Evaluating a distribution stored in half precision should match
+    // evaluating the original to half-float accuracy.
+    RNG rng;
+    int xSize = 8, ySize = 5;
+    float params[3] = {0, 0.5f, 1};
+    std::vector<float> data(3 * xSize * ySize);
+    for (float &v : data)
+        v = 10 * rng.Uniform<float>();
+    PiecewiseLinear2D<1> dist(Allocator(), data.data(), xSize, ySize, {3}, {params},
+                              false, false);
+    PiecewiseLinear2D<1> compact = dist;
+    EXPECT_TRUE(compact.CompactData());
+    EXPECT_LT(compact.BytesUsed(), dist.BytesUsed());
+
+    for (int i = 0; i < 100; ++i) {
+        Point2f p(rng.Uniform<Float>(), rng.Uniform<Float>());
+        Float param = rng.Uniform<Float>();
+        Float v = dist.Evaluate(p, param);
+        EXPECT_NEAR(v, compact.Evaluate(p, param), 1e-3f * v);
+    }
+
+    // Values that half floats can't represent are kept in single precision
+    data[0] = 1e7f;
+    PiecewiseLinear2D<1> large(Allocator(), data.data(), xSize, ySize, {3}, {params},
+                               false, false);
+    EXPECT_FALSE(large.CompactData());
+}
@@ -14,11 +14,14 @@
 #include <pbrt/bssrdf.h>
 #include <pbrt/interaction.h>
 #include <pbrt/ray.h>
+#include <pbrt/util/float.h>
 #include <pbrt/util/math.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/vecmath.h>
 
+#include <cstddef>
+
 namespace pbrt {
 
 struct alignas(16) Float4 {
@@ -220,6 +223,56 @@ struct SOA<SampledWavelengths> {
     Float *PBRT_RESTRICT pdf1 = nullptr;
 };
 
+// AoSoALayout Definition
+// Assigns the offsets of the members of an SOA type declared "aosoa" in a
+// block that stores _blockSize_ consecutive elements of each member.
+class AoSoALayout {
+  public:
+    // AoSoALayout Public Methods
+    AoSoALayout(int blockSize) : blockSize(blockSize) {}
+
+    template <typename T>
+    int Add() {
+        blockBytes = (blockBytes + alignof(T) - 1) / alignof(T) * alignof(T);
+        int offset = blockBytes;
+        blockBytes += blockSize * sizeof(T);
+        return offset;
+    }
+
+    int BlockBytes() const {
+        constexpr int align = alignof(std::max_align_t);
+        return (blockBytes + align - 1) / align * align;
+    }
+
+    char *Allocate(int n, Allocator alloc) const {
+        size_t nBlocks = std::max(1, (n + blockSize - 1) / blockSize);
+        return (char *)alloc.allocate_bytes(nBlocks * BlockBytes());
+    }
+
+  private:
+    int blockSize, blockBytes = 0;
+};
+
+// AoSoAArray Definition
+// Provides access to one member's values in an AoSoA allocation.
+template <typename T, int BlockSize>
+class AoSoAArray {
+  public:
+    // AoSoAArray Public Methods
+    AoSoAArray() = default;
+    AoSoAArray(char *blocks, int offset, int blockBytes)
+        : ptr(blocks + offset), blockBytes(blockBytes) {}
+
+    PBRT_CPU_GPU
+    T &operator[](int i) const {
+        return ((T *)(ptr + size_t(i / BlockSize) * blockBytes))[i % BlockSize];
+    }
+
+  private:
+    char *ptr = nullptr;
+    int blockBytes = 0;
+};
+
 #include "pbrt_soa.h"
 
 }  // namespace pbrt
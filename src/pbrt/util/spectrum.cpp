@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <cmath>
 #include <map>
+#include <mutex>
 
 // I don't know how this is happening (somehow via wingdi.h?), but not cool,
 // Windows, not cool...
@@ -2575,11 +2576,137 @@ DenselySampledSpectrum *x, *y, *z;
 
 namespace {
 
+// NamedSpectrumData Definition
+// The samples of a named spectrum, which is only created when it is first
+// looked up
+struct NamedSpectrumData {
+    const char *name;
+    pstd::span<const Float> interleaved;
+    bool normalize;
+};
+
+const NamedSpectrumData namedSpectrumData[] = {
+    {"glass-BK7", GlassBK7_eta, false},
+    {"glass-BAF10", GlassBAF10_eta, false},
+    {"glass-FK51A", GlassFK51A_eta, false},
+    {"glass-LASF9", GlassLASF9_eta, false},
+    {"glass-F5", GlassSF5_eta, false},
+    {"glass-F10", GlassSF10_eta, false},
+    {"glass-F11", GlassSF11_eta, false},
+
+    {"metal-Ag-eta", Ag_eta, false},
+    {"metal-Ag-k", Ag_k, false},
+    {"metal-Al-eta", Al_eta, false},
+    {"metal-Al-k", Al_k, false},
+    {"metal-Au-eta", Au_eta, false},
+    {"metal-Au-k", Au_k, false},
+    {"metal-Cu-eta", Cu_eta, false},
+    {"metal-Cu-k", Cu_k, false},
+    {"metal-CuZn-eta", CuZn_eta, false},
+    {"metal-CuZn-k", CuZn_k, false},
+    {"metal-MgO-eta", MgO_eta, false},
+    {"metal-MgO-k", MgO_k, false},
+    {"metal-TiO2-eta", TiO2_eta, false},
+    {"metal-TiO2-k", TiO2_k, false},
+
+    {"stdillum-A", CIE_Illum_A, true},
+    {"stdillum-D50", CIE_Illum_D5000, true},
+    {"stdillum-D65", CIE_Illum_D6500, true},
+    {"stdillum-F1", CIE_Illum_F1, true},
+    {"stdillum-F2", CIE_Illum_F2, true},
+    {"stdillum-F3", CIE_Illum_F3, true},
+    {"stdillum-F4", CIE_Illum_F4, true},
+    {"stdillum-F5", CIE_Illum_F5, true},
+    {"stdillum-F6", CIE_Illum_F6, true},
+    {"stdillum-F7", CIE_Illum_F7, true},
+    {"stdillum-F8", CIE_Illum_F8, true},
+    {"stdillum-F9", CIE_Illum_F9, true},
+    {"stdillum-F10", CIE_Illum_F10, true},
+    {"stdillum-F11", CIE_Illum_F11, true},
+    {"stdillum-F12", CIE_Illum_F12, true},
+
+    {"illum-acesD60", ACES_Illum_D60, true},
+
+    {"canon_eos_100d_r", canon_eos_100d_r, false},
+    {"canon_eos_100d_g", canon_eos_100d_g, false},
+    {"canon_eos_100d_b", canon_eos_100d_b, false},
+
+    {"canon_eos_1dx_mkii_r", canon_eos_1dx_mkii_r, false},
+    {"canon_eos_1dx_mkii_g", canon_eos_1dx_mkii_g, false},
+    {"canon_eos_1dx_mkii_b", canon_eos_1dx_mkii_b, false},
+
+    {"canon_eos_200d_r", canon_eos_200d_r, false},
+    {"canon_eos_200d_g", canon_eos_200d_g, false},
+    {"canon_eos_200d_b", canon_eos_200d_b, false},
+
+    {"canon_eos_200d_mkii_r", canon_eos_200d_mkii_r, false},
+    {"canon_eos_200d_mkii_g", canon_eos_200d_mkii_g, false},
+    {"canon_eos_200d_mkii_b", canon_eos_200d_mkii_b, false},
+
+    {"canon_eos_5d_r", canon_eos_5d_r, false},
+    {"canon_eos_5d_g", canon_eos_5d_g, false},
+    {"canon_eos_5d_b", canon_eos_5d_b, false},
+
+    {"canon_eos_5d_mkii_r", canon_eos_5d_mkii_r, false},
+    {"canon_eos_5d_mkii_g", canon_eos_5d_mkii_g, false},
+    {"canon_eos_5d_mkii_b", canon_eos_5d_mkii_b, false},
+
+    {"canon_eos_5d_mkiii_r", canon_eos_5d_mkiii_r, false},
+    {"canon_eos_5d_mkiii_g", canon_eos_5d_mkiii_g, false},
+    {"canon_eos_5d_mkiii_b", canon_eos_5d_mkiii_b, false},
+
+    {"canon_eos_5d_mkiv_r", canon_eos_5d_mkiv_r, false},
+    {"canon_eos_5d_mkiv_g", canon_eos_5d_mkiv_g, false},
+    {"canon_eos_5d_mkiv_b", canon_eos_5d_mkiv_b, false},
+
+    {"canon_eos_5ds_r", canon_eos_5ds_r, false},
+    {"canon_eos_5ds_g", canon_eos_5ds_g, false},
+    {"canon_eos_5ds_b", canon_eos_5ds_b, false},
+
+    {"canon_eos_m_r", canon_eos_m_r, false},
+    {"canon_eos_m_g", canon_eos_m_g, false},
+    {"canon_eos_m_b", canon_eos_m_b, false},
+
+    {"hasselblad_l1d_20c_r", hasselblad_l1d_20c_r, false},
+    {"hasselblad_l1d_20c_g", hasselblad_l1d_20c_g, false},
+    {"hasselblad_l1d_20c_b", hasselblad_l1d_20c_b, false},
+
+    {"nikon_d810_r", nikon_d810_r, false},
+    {"nikon_d810_g", nikon_d810_g, false},
+    {"nikon_d810_b", nikon_d810_b, false},
+
+    {"nikon_d850_r", nikon_d850_r, false},
+    {"nikon_d850_g", nikon_d850_g, false},
+    {"nikon_d850_b", nikon_d850_b, false},
+
+    {"sony_ilce_6400_r", sony_ilce_6400_r, false},
+    {"sony_ilce_6400_g", sony_ilce_6400_g, false},
+    {"sony_ilce_6400_b", sony_ilce_6400_b, false},
+
+    {"sony_ilce_7m3_r", sony_ilce_7m3_r, false},
+    {"sony_ilce_7m3_g", sony_ilce_7m3_g, false},
+    {"sony_ilce_7m3_b", sony_ilce_7m3_b, false},
+
+    {"sony_ilce_7rm3_r", sony_ilce_7rm3_r, false},
+    {"sony_ilce_7rm3_g", sony_ilce_7rm3_g, false},
+    {"sony_ilce_7rm3_b", sony_ilce_7rm3_b, false},
+
+    {"sony_ilce_9_r", sony_ilce_9_r, false},
+    {"sony_ilce_9_g", sony_ilce_9_g, false},
+    {"sony_ilce_9_b", sony_ilce_9_b, false},
+};
+
+std::mutex namedSpectraMutex;
 std::map<std::string, Spectrum> namedSpectra;
+pstd::pmr::memory_resource *namedSpectraMemory;
+std::mutex denseNamedSpectraMutex;
+std::map<std::string, Spectrum> denseNamedSpectra;
 
 }  // namespace
 
 void Init(Allocator alloc) {
+    // Named spectra are allocated from _alloc_ by GetNamedSpectrum()
+    namedSpectraMemory = alloc.resource();
     PiecewiseLinearSpectrum xpls(CIE_lambda, CIE_X);
     x = alloc.new_object<DenselySampledSpectrum>(&xpls, alloc);
 
@@ -2596,239 +2723,47 @@ void Init(Allocator alloc) {
         CUDA_CHECK(cudaMemcpyToSymbol(zGPU, &z, sizeof(z)));
     }
 #endif
-
-    Spectrum illuma = PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_A, true, alloc);
-    Spectrum illumd50 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_D5000, true, alloc);
-    Spectrum illumacesd60 =
-        PiecewiseLinearSpectrum::FromInterleaved(ACES_Illum_D60, true, alloc);
-    Spectrum illumd65 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_D6500, true, alloc);
-    Spectrum illumf1 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F1, true, alloc);
-    Spectrum illumf2 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F2, true, alloc);
-    Spectrum illumf3 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F3, true, alloc);
-    Spectrum illumf4 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F4, true, alloc);
-    Spectrum illumf5 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F5, true, alloc);
-    Spectrum illumf6 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F6, true, alloc);
-    Spectrum illumf7 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F7, true, alloc);
-    Spectrum illumf8 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F8, true, alloc);
-    Spectrum illumf9 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F9, true, alloc);
-    Spectrum illumf10 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F10, true, alloc);
-    Spectrum illumf11 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F11, true, alloc);
-    Spectrum illumf12 =
-        PiecewiseLinearSpectrum::FromInterleaved(CIE_Illum_F12, true, alloc);
-
-    Spectrum ageta = PiecewiseLinearSpectrum::FromInterleaved(Ag_eta, false, alloc);
-    Spectrum agk = PiecewiseLinearSpectrum::FromInterleaved(Ag_k, false, alloc);
-    Spectrum aleta = PiecewiseLinearSpectrum::FromInterleaved(Al_eta, false, alloc);
-    Spectrum alk = PiecewiseLinearSpectrum::FromInterleaved(Al_k, false, alloc);
-    Spectrum aueta = PiecewiseLinearSpectrum::FromInterleaved(Au_eta, false, alloc);
-    Spectrum auk = PiecewiseLinearSpectrum::FromInterleaved(Au_k, false, alloc);
-    Spectrum cueta = PiecewiseLinearSpectrum::FromInterleaved(Cu_eta, false, alloc);
-    Spectrum cuk = PiecewiseLinearSpectrum::FromInterleaved(Cu_k, false, alloc);
-    Spectrum cuzneta = PiecewiseLinearSpectrum::FromInterleaved(CuZn_eta, false, alloc);
-    Spectrum cuznk = PiecewiseLinearSpectrum::FromInterleaved(CuZn_k, false, alloc);
-    Spectrum mgoeta = PiecewiseLinearSpectrum::FromInterleaved(MgO_eta, false, alloc);
-    Spectrum mgok = PiecewiseLinearSpectrum::FromInterleaved(MgO_k, false, alloc);
-    Spectrum tio2eta = PiecewiseLinearSpectrum::FromInterleaved(TiO2_eta, false, alloc);
-    Spectrum tio2k = PiecewiseLinearSpectrum::FromInterleaved(TiO2_k, false, alloc);
-    Spectrum glassbk7eta =
-        PiecewiseLinearSpectrum::FromInterleaved(GlassBK7_eta, false, alloc);
-    Spectrum glassbaf10eta =
-        PiecewiseLinearSpectrum::FromInterleaved(GlassBAF10_eta, false, alloc);
-    Spectrum glassfk51aeta =
-        PiecewiseLinearSpectrum::FromInterleaved(GlassFK51A_eta, false, alloc);
-    Spectrum glasslasf9eta =
-        PiecewiseLinearSpectrum::FromInterleaved(GlassLASF9_eta, false, alloc);
-    Spectrum glasssf5eta =
-        PiecewiseLinearSpectrum::FromInterleaved(GlassSF5_eta, false, alloc);
-    Spectrum glasssf10eta =
-        PiecewiseLinearSpectrum::FromInterleaved(GlassSF10_eta, false, alloc);
-    Spectrum glasssf11eta =
-        PiecewiseLinearSpectrum::FromInterleaved(GlassSF11_eta, false, alloc);
-
-    namedSpectra = {
-        {"glass-BK7", glassbk7eta},
-        {"glass-BAF10", glassbaf10eta},
-        {"glass-FK51A", glassfk51aeta},
-        {"glass-LASF9", glasslasf9eta},
-        {"glass-F5", glasssf5eta},
-        {"glass-F10", glasssf10eta},
-        {"glass-F11", glasssf11eta},
-
-        {"metal-Ag-eta", ageta},
-        {"metal-Ag-k", agk},
-        {"metal-Al-eta", aleta},
-        {"metal-Al-k", alk},
-        {"metal-Au-eta", aueta},
-        {"metal-Au-k", auk},
-        {"metal-Cu-eta", cueta},
-        {"metal-Cu-k", cuk},
-        {"metal-CuZn-eta", cuzneta},
-        {"metal-CuZn-k", cuznk},
-        {"metal-MgO-eta", mgoeta},
-        {"metal-MgO-k", mgok},
-        {"metal-TiO2-eta", tio2eta},
-        {"metal-TiO2-k", tio2k},
-
-        {"stdillum-A", illuma},
-        {"stdillum-D50", illumd50},
-        {"stdillum-D65", illumd65},
-        {"stdillum-F1", illumf1},
-        {"stdillum-F2", illumf2},
-        {"stdillum-F3", illumf3},
-        {"stdillum-F4", illumf4},
-        {"stdillum-F5", illumf5},
-        {"stdillum-F6", illumf6},
-        {"stdillum-F7", illumf7},
-        {"stdillum-F8", illumf8},
-        {"stdillum-F9", illumf9},
-        {"stdillum-F10", illumf10},
-        {"stdillum-F11", illumf11},
-        {"stdillum-F12", illumf12},
-
-        {"illum-acesD60", illumacesd60},
-
-        {"canon_eos_100d_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_100d_r, false, alloc)},
-        {"canon_eos_100d_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_100d_g, false, alloc)},
-        {"canon_eos_100d_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_100d_b, false, alloc)},
-
-        {"canon_eos_1dx_mkii_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_1dx_mkii_r, false, alloc)},
-        {"canon_eos_1dx_mkii_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_1dx_mkii_g, false, alloc)},
-        {"canon_eos_1dx_mkii_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_1dx_mkii_b, false, alloc)},
-
-        {"canon_eos_200d_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_200d_r, false, alloc)},
-        {"canon_eos_200d_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_200d_g, false, alloc)},
-        {"canon_eos_200d_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_200d_b, false, alloc)},
-
-        {"canon_eos_200d_mkii_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_200d_mkii_r, false, alloc)},
-        {"canon_eos_200d_mkii_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_200d_mkii_g, false, alloc)},
-        {"canon_eos_200d_mkii_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_200d_mkii_b, false, alloc)},
-
-        {"canon_eos_5d_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_r, false, alloc)},
-        {"canon_eos_5d_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_g, false, alloc)},
-        {"canon_eos_5d_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_b, false, alloc)},
-
-        {"canon_eos_5d_mkii_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkii_r, false, alloc)},
-        {"canon_eos_5d_mkii_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkii_g, false, alloc)},
-        {"canon_eos_5d_mkii_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkii_b, false, alloc)},
-
-        {"canon_eos_5d_mkiii_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkiii_r, false, alloc)},
-        {"canon_eos_5d_mkiii_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkiii_g, false, alloc)},
-        {"canon_eos_5d_mkiii_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkiii_b, false, alloc)},
-
-        {"canon_eos_5d_mkiv_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkiv_r, false, alloc)},
-        {"canon_eos_5d_mkiv_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkiv_g, false, alloc)},
-        {"canon_eos_5d_mkiv_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5d_mkiv_b, false, alloc)},
-
-        {"canon_eos_5ds_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5ds_r, false, alloc)},
-        {"canon_eos_5ds_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5ds_g, false, alloc)},
-        {"canon_eos_5ds_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_5ds_b, false, alloc)},
-
-        {"canon_eos_m_r",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_m_r, false, alloc)},
-        {"canon_eos_m_g",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_m_g, false, alloc)},
-        {"canon_eos_m_b",
-         PiecewiseLinearSpectrum::FromInterleaved(canon_eos_m_b, false, alloc)},
-
-        {"hasselblad_l1d_20c_r",
-         PiecewiseLinearSpectrum::FromInterleaved(hasselblad_l1d_20c_r, false, alloc)},
-        {"hasselblad_l1d_20c_g",
-         PiecewiseLinearSpectrum::FromInterleaved(hasselblad_l1d_20c_g, false, alloc)},
-        {"hasselblad_l1d_20c_b",
-         PiecewiseLinearSpectrum::FromInterleaved(hasselblad_l1d_20c_b, false, alloc)},
-
-        {"nikon_d810_r",
-         PiecewiseLinearSpectrum::FromInterleaved(nikon_d810_r, false, alloc)},
-        {"nikon_d810_g",
-         PiecewiseLinearSpectrum::FromInterleaved(nikon_d810_g, false, alloc)},
-        {"nikon_d810_b",
-         PiecewiseLinearSpectrum::FromInterleaved(nikon_d810_b, false, alloc)},
-
-        {"nikon_d850_r",
-         PiecewiseLinearSpectrum::FromInterleaved(nikon_d850_r, false, alloc)},
-        {"nikon_d850_g",
-         PiecewiseLinearSpectrum::FromInterleaved(nikon_d850_g, false, alloc)},
-        {"nikon_d850_b",
-         PiecewiseLinearSpectrum::FromInterleaved(nikon_d850_b, false, alloc)},
-
-        {"sony_ilce_6400_r",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_6400_r, false, alloc)},
-        {"sony_ilce_6400_g",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_6400_g, false, alloc)},
-        {"sony_ilce_6400_b",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_6400_b, false, alloc)},
-
-        {"sony_ilce_7m3_r",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_7m3_r, false, alloc)},
-        {"sony_ilce_7m3_g",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_7m3_g, false, alloc)},
-        {"sony_ilce_7m3_b",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_7m3_b, false, alloc)},
-
-        {"sony_ilce_7rm3_r",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_7rm3_r, false, alloc)},
-        {"sony_ilce_7rm3_g",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_7rm3_g, false, alloc)},
-        {"sony_ilce_7rm3_b",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_7rm3_b, false, alloc)},
-
-        {"sony_ilce_9_r",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_9_r, false, alloc)},
-        {"sony_ilce_9_g",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_9_g, false, alloc)},
-        {"sony_ilce_9_b",
-         PiecewiseLinearSpectrum::FromInterleaved(sony_ilce_9_b, false, alloc)}};
 }
 
 }  // namespace Spectra
 
 Spectrum GetNamedSpectrum(std::string name) {
+    std::lock_guard<std::mutex> lock(Spectra::namedSpectraMutex);
     auto iter = Spectra::namedSpectra.find(name);
     if (iter != Spectra::namedSpectra.end())
         return iter->second;
+
+    for (const Spectra::NamedSpectrumData &data : Spectra::namedSpectrumData)
+        if (name == data.name) {
+            Allocator alloc(Spectra::namedSpectraMemory);
+            Spectrum s = PiecewiseLinearSpectrum::FromInterleaved(data.interleaved,
+                                                                  data.normalize, alloc);
+            Spectra::namedSpectra[name] = s;
+            return s;
+        }
     return nullptr;
 }
 
+STAT_MEMORY_COUNTER("Memory/Densely sampled spectra", denseSpectrumBytes);
+
+Spectrum GetDenselySampledNamedSpectrum(std::string name) {
+    std::lock_guard<std::mutex> lock(Spectra::denseNamedSpectraMutex);
+    auto iter = Spectra::denseNamedSpectra.find(name);
+    if (iter != Spectra::denseNamedSpectra.end())
+        return iter->second;
+
+    Spectrum s = GetNamedSpectrum(name);
+    if (s && s.Is<PiecewiseLinearSpectrum>()) {
+        Allocator alloc(Spectra::namedSpectraMemory);
+        s = alloc.new_object<DenselySampledSpectrum>(s, alloc);
+        denseSpectrumBytes += sizeof(DenselySampledSpectrum) +
+                              (Lambda_max - Lambda_min + 1) * sizeof(Float);
+    }
+    if (s)
+        Spectra::denseNamedSpectra[name] = s;
+    return s;
+}
+
 std::string FindMatchingNamedSpectrum(Spectrum s) {
     auto sampledLambdasMatch = [](Spectrum a, Spectrum b) {
         const Float wls[] = {306, 360.932007, 380, 402, 455, 503, 579,
@@ -2838,9 +2773,9 @@ std::string FindMatchingNamedSpectrum(Spectrum s) {
                 return false;
         return true;
     };
-    for (const auto &spd : Spectra::namedSpectra) {
-        if (sampledLambdasMatch(s, spd.second))
-            return spd.first;
+    for (const Spectra::NamedSpectrumData &data : Spectra::namedSpectrumData) {
+        if (sampledLambdasMatch(s, GetNamedSpectrum(data.name)))
+            return data.name;
     }
     return "";
 }
@@ -28,13 +28,35 @@
 #include <string>
 #include <vector>
 
+// Use vector instructions for SampledSpectrum arithmetic on the CPU when
+// the number of wavelength samples matches the vector width
+#ifndef PBRT_SPECTRUM_SAMPLES
+#define PBRT_SPECTRUM_SAMPLES 4
+#endif
+#if !defined(PBRT_IS_GPU_CODE) && !defined(PBRT_FLOAT_AS_DOUBLE)
+#if PBRT_SPECTRUM_SAMPLES == 8 && defined(__AVX2__)
+#define PBRT_SPECTRUM_AVX2
+#elif PBRT_SPECTRUM_SAMPLES == 4 && defined(__SSE2__)
+#define PBRT_SPECTRUM_SSE
+#elif PBRT_SPECTRUM_SAMPLES == 4 && defined(__ARM_NEON) && defined(__aarch64__)
+#define PBRT_SPECTRUM_NEON
+#endif
+#endif
+#if defined(PBRT_SPECTRUM_AVX2) || defined(PBRT_SPECTRUM_SSE)
+#define PBRT_SPECTRUM_SIMD
+#include <immintrin.h>
+#elif defined(PBRT_SPECTRUM_NEON)
+#define PBRT_SPECTRUM_SIMD
+#include <arm_neon.h>
+#endif
+
 namespace pbrt {
 
 // Spectrum Constants
 // 可见光波长范围
 constexpr Float Lambda_min = 360, Lambda_max = 830;
 // 要采样几个波长
-static constexpr int NSpectrumSamples = 4;
+static constexpr int NSpectrumSamples = PBRT_SPECTRUM_SAMPLES;
 // XYZ色彩空间里Y因子在可见光波长下的积分值，直接给出减少计算
 static constexpr Float CIE_Y_integral = 106.856895;
 
@@ -94,6 +116,192 @@ Float SpectrumToPhotometric(Spectrum s);
 
 XYZ SpectrumToXYZ(Spectrum s);
 
+#ifdef PBRT_SPECTRUM_SIMD
+namespace detail {
+
+// SpectrumLanes Definition
+// Holds all NSpectrumSamples values of a SampledSpectrum in one vector
+// register.
+struct SpectrumLanes {
+#if defined(PBRT_SPECTRUM_AVX2)
+    __m256 v;
+    SpectrumLanes(__m256 v) : v(v) {}
+    explicit SpectrumLanes(const Float *p) : v(_mm256_loadu_ps(p)) {}
+    explicit SpectrumLanes(Float f) : v(_mm256_set1_ps(f)) {}
+    void Store(Float *p) const { _mm256_storeu_ps(p, v); }
+
+    friend SpectrumLanes operator+(SpectrumLanes a, SpectrumLanes b) {
+        return _mm256_add_ps(a.v, b.v);
+    }
+    friend SpectrumLanes operator-(SpectrumLanes a, SpectrumLanes b) {
+        return _mm256_sub_ps(a.v, b.v);
+    }
+    friend SpectrumLanes operator*(SpectrumLanes a, SpectrumLanes b) {
+        return _mm256_mul_ps(a.v, b.v);
+    }
+    friend SpectrumLanes operator/(SpectrumLanes a, SpectrumLanes b) {
+        return _mm256_div_ps(a.v, b.v);
+    }
+    friend SpectrumLanes Min(SpectrumLanes a, SpectrumLanes b) {
+        return _mm256_min_ps(a.v, b.v);
+    }
+    friend SpectrumLanes Max(SpectrumLanes a, SpectrumLanes b) {
+        return _mm256_max_ps(a.v, b.v);
+    }
+    friend SpectrumLanes Sqrt(SpectrumLanes a) { return _mm256_sqrt_ps(a.v); }
+    friend SpectrumLanes Round(SpectrumLanes a) {
+        return _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+    // Returns 2^n for lanes holding integer values in [-126, 127]
+    friend SpectrumLanes Pow2(SpectrumLanes n) {
+        __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+    }
+    // Returns _a_ in lanes where _x_ < _y_ and _b_ elsewhere
+    friend SpectrumLanes SelectLess(SpectrumLanes x, SpectrumLanes y, SpectrumLanes a,
+                                    SpectrumLanes b) {
+        return _mm256_blendv_ps(b.v, a.v, _mm256_cmp_ps(x.v, y.v, _CMP_LT_OQ));
+    }
+    // Returns _a_ in lanes where _x_ is not zero and _b_ elsewhere
+    friend SpectrumLanes SelectNonZero(SpectrumLanes x, SpectrumLanes a,
+                                       SpectrumLanes b) {
+        __m256 zero = _mm256_cmp_ps(x.v, _mm256_setzero_ps(), _CMP_EQ_OQ);
+        return _mm256_blendv_ps(a.v, b.v, zero);
+    }
+    Float MinValue() const {
+        __m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+        return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(m, m, 1)));
+    }
+    Float MaxValue() const {
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+    }
+#elif defined(PBRT_SPECTRUM_SSE)
+    __m128 v;
+    SpectrumLanes(__m128 v) : v(v) {}
+    explicit SpectrumLanes(const Float *p) : v(_mm_loadu_ps(p)) {}
+    explicit SpectrumLanes(Float f) : v(_mm_set1_ps(f)) {}
+    void Store(Float *p) const { _mm_storeu_ps(p, v); }
+
+    friend SpectrumLanes operator+(SpectrumLanes a, SpectrumLanes b) {
+        return _mm_add_ps(a.v, b.v);
+    }
+    friend SpectrumLanes operator-(SpectrumLanes a, SpectrumLanes b) {
+        return _mm_sub_ps(a.v, b.v);
+    }
+    friend SpectrumLanes operator*(SpectrumLanes a, SpectrumLanes b) {
+        return _mm_mul_ps(a.v, b.v);
+    }
+    friend SpectrumLanes operator/(SpectrumLanes a, SpectrumLanes b) {
+        return _mm_div_ps(a.v, b.v);
+    }
+    friend SpectrumLanes Min(SpectrumLanes a, SpectrumLanes b) {
+        return _mm_min_ps(a.v, b.v);
+    }
+    friend SpectrumLanes Max(SpectrumLanes a, SpectrumLanes b) {
+        return _mm_max_ps(a.v, b.v);
+    }
+    friend SpectrumLanes Sqrt(SpectrumLanes a) { return _mm_sqrt_ps(a.v); }
+    friend SpectrumLanes Round(SpectrumLanes a) {
+        // Conversion to integers uses the default round-to-nearest mode
+        return _mm_cvtepi32_ps(_mm_cvtps_epi32(a.v));
+    }
+    friend SpectrumLanes Pow2(SpectrumLanes n) {
+        __m128i e = _mm_add_epi32(_mm_cvtps_epi32(n.v), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+    }
+    friend SpectrumLanes SelectLess(SpectrumLanes x, SpectrumLanes y, SpectrumLanes a,
+                                    SpectrumLanes b) {
+        __m128 mask = _mm_cmplt_ps(x.v, y.v);
+        return _mm_or_ps(_mm_and_ps(mask, a.v), _mm_andnot_ps(mask, b.v));
+    }
+    friend SpectrumLanes SelectNonZero(SpectrumLanes x, SpectrumLanes a,
+                                       SpectrumLanes b) {
+        __m128 zero = _mm_cmpeq_ps(x.v, _mm_setzero_ps());
+        return _mm_or_ps(_mm_and_ps(zero, b.v), _mm_andnot_ps(zero, a.v));
+    }
+    Float MinValue() const {
+        __m128 m = _mm_min_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(m, m, 1)));
+    }
+    Float MaxValue() const {
+        __m128 m = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+    }
+#else
+    float32x4_t v;
+    SpectrumLanes(float32x4_t v) : v(v) {}
+    explicit SpectrumLanes(const Float *p) : v(vld1q_f32(p)) {}
+    explicit SpectrumLanes(Float f) : v(vdupq_n_f32(f)) {}
+    void Store(Float *p) const { vst1q_f32(p, v); }
+
+    friend SpectrumLanes operator+(SpectrumLanes a, SpectrumLanes b) {
+        return vaddq_f32(a.v, b.v);
+    }
+    friend SpectrumLanes operator-(SpectrumLanes a, SpectrumLanes b) {
+        return vsubq_f32(a.v, b.v);
+    }
+    friend SpectrumLanes operator*(SpectrumLanes a, SpectrumLanes b) {
+        return vmulq_f32(a.v, b.v);
+    }
+    friend SpectrumLanes operator/(SpectrumLanes a, SpectrumLanes b) {
+        return vdivq_f32(a.v, b.v);
+    }
+    friend SpectrumLanes Min(SpectrumLanes a, SpectrumLanes b) {
+        return vminq_f32(a.v, b.v);
+    }
+    friend SpectrumLanes Max(SpectrumLanes a, SpectrumLanes b) {
+        return vmaxq_f32(a.v, b.v);
+    }
+    friend SpectrumLanes Sqrt(SpectrumLanes a) { return vsqrtq_f32(a.v); }
+    friend SpectrumLanes Round(SpectrumLanes a) { return vrndnq_f32(a.v); }
+    friend SpectrumLanes Pow2(SpectrumLanes n) {
+        int32x4_t e = vaddq_s32(vcvtq_s32_f32(n.v), vdupq_n_s32(127));
+        return vreinterpretq_f32_s32(vshlq_n_s32(e, 23));
+    }
+    friend SpectrumLanes SelectLess(SpectrumLanes x, SpectrumLanes y, SpectrumLanes a,
+                                    SpectrumLanes b) {
+        return vbslq_f32(vcltq_f32(x.v, y.v), a.v, b.v);
+    }
+    friend SpectrumLanes SelectNonZero(SpectrumLanes x, SpectrumLanes a,
+                                       SpectrumLanes b) {
+        return vbslq_f32(vceqq_f32(x.v, vdupq_n_f32(0)), b.v, a.v);
+    }
+    Float MinValue() const { return vminvq_f32(v); }
+    Float MaxValue() const { return vmaxvq_f32(v); }
+#endif
+};
+
+// Returns e^x in each lane, with an error of about one ulp, following
+// the Cephes library's expf(): x = n ln 2 + r for integer n, e^r is
+// evaluated with a polynomial, and the result is scaled by 2^n.
+inline SpectrumLanes Exp(SpectrumLanes x) {
+    const SpectrumLanes lo(-103.97208f), hi(88.72283f);
+    SpectrumLanes xc = Min(Max(x, lo), hi);
+    SpectrumLanes n = Round(xc * SpectrumLanes(1.44269504f));
+    SpectrumLanes r =
+        xc - n * SpectrumLanes(0.693359375f) - n * SpectrumLanes(-2.12194440e-4f);
+    SpectrumLanes p(1.9875691500e-4f);
+    p = p * r + SpectrumLanes(1.3981999507e-3f);
+    p = p * r + SpectrumLanes(8.3334519073e-3f);
+    p = p * r + SpectrumLanes(4.1665795894e-2f);
+    p = p * r + SpectrumLanes(1.6666665459e-1f);
+    p = p * r + SpectrumLanes(5.0000001201e-1f);
+    p = p * r * r + r + SpectrumLanes(1.f);
+    // 2^n isn't a normal float for the largest and smallest results, so
+    // scale in two steps
+    SpectrumLanes half = Round(n * SpectrumLanes(0.5f));
+    SpectrumLanes e = p * Pow2(half) * Pow2(n - half);
+    // Match std::exp() for values that underflow or overflow
+    e = SelectLess(x, lo, SpectrumLanes(0.f), e);
+    return SelectLess(hi, x, SpectrumLanes(Infinity), e);
+}
+
+}  // namespace detail
+#endif  // PBRT_SPECTRUM_SIMD
+
 // SampledSpectrum Definition
 /*
     采样后的光谱分布
@@ -111,8 +319,12 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum &operator-=(const SampledSpectrum &s) {
+#ifdef PBRT_SPECTRUM_SIMD
+        (Lanes() - s.Lanes()).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] -= s.values[i];
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -124,15 +336,23 @@ class SampledSpectrum {
     friend SampledSpectrum operator-(Float a, const SampledSpectrum &s) {
         DCHECK(!IsNaN(a));
         SampledSpectrum ret;
+#ifdef PBRT_SPECTRUM_SIMD
+        (detail::SpectrumLanes(a) - s.Lanes()).Store(ret.values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             ret.values[i] = a - s.values[i];
+#endif
         return ret;
     }
 
     PBRT_CPU_GPU
     SampledSpectrum &operator*=(const SampledSpectrum &s) {
+#ifdef PBRT_SPECTRUM_SIMD
+        (Lanes() * s.Lanes()).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] *= s.values[i];
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -144,15 +364,17 @@ class SampledSpectrum {
     SampledSpectrum operator*(Float a) const {
         DCHECK(!IsNaN(a));
         SampledSpectrum ret = *this;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            ret.values[i] *= a;
-        return ret;
+        return ret *= a;
     }
     PBRT_CPU_GPU
     SampledSpectrum &operator*=(Float a) {
         DCHECK(!IsNaN(a));
+#ifdef PBRT_SPECTRUM_SIMD
+        (Lanes() * detail::SpectrumLanes(a)).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] *= a;
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -160,10 +382,16 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum &operator/=(const SampledSpectrum &s) {
+#ifdef PBRT_SPECTRUM_SIMD
+        for (int i = 0; i < NSpectrumSamples; ++i)
+            DCHECK_NE(0, s.values[i]);
+        (Lanes() / s.Lanes()).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i) {
             DCHECK_NE(0, s.values[i]);
             values[i] /= s.values[i];
         }
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -175,8 +403,12 @@ class SampledSpectrum {
     SampledSpectrum &operator/=(Float a) {
         DCHECK_NE(a, 0);
         DCHECK(!IsNaN(a));
+#ifdef PBRT_SPECTRUM_SIMD
+        (Lanes() / detail::SpectrumLanes(a)).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] /= a;
+#endif
         return *this;
     }
     PBRT_CPU_GPU
@@ -188,8 +420,12 @@ class SampledSpectrum {
     PBRT_CPU_GPU
     SampledSpectrum operator-() const {
         SampledSpectrum ret;
+#ifdef PBRT_SPECTRUM_SIMD
+        (detail::SpectrumLanes(0.f) - Lanes()).Store(ret.values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             ret.values[i] = -values[i];
+#endif
         return ret;
     }
     PBRT_CPU_GPU
@@ -245,24 +481,36 @@ class SampledSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum &operator+=(const SampledSpectrum &s) {
+#ifdef PBRT_SPECTRUM_SIMD
+        (Lanes() + s.Lanes()).Store(values.data());
+#else
         for (int i = 0; i < NSpectrumSamples; ++i)
             values[i] += s.values[i];
+#endif
         return *this;
     }
 
     PBRT_CPU_GPU
     Float MinComponentValue() const {
+#ifdef PBRT_SPECTRUM_SIMD
+        return Lanes().MinValue();
+#else
         Float m = values[0];
         for (int i = 1; i < NSpectrumSamples; ++i)
             m = std::min(m, values[i]);
         return m;
+#endif
     }
     PBRT_CPU_GPU
     Float MaxComponentValue() const {
+#ifdef PBRT_SPECTRUM_SIMD
+        return Lanes().MaxValue();
+#else
         Float m = values[0];
         for (int i = 1; i < NSpectrumSamples; ++i)
             m = std::max(m, values[i]);
         return m;
+#endif
     }
     PBRT_CPU_GPU
     Float Average() const {
@@ -272,6 +520,11 @@ class SampledSpectrum {
         return sum / NSpectrumSamples;
     }
 
+#ifdef PBRT_SPECTRUM_SIMD
+    detail::SpectrumLanes Lanes() const { return detail::SpectrumLanes(values.data()); }
+    explicit SampledSpectrum(detail::SpectrumLanes l) { l.Store(values.data()); }
+#endif
+
   private:
     friend struct SOA<SampledSpectrum>;
     pstd::array<Float, NSpectrumSamples> values;
@@ -359,6 +612,10 @@ class SampledWavelengths {
         return swl;
     }
 
+#ifdef PBRT_SPECTRUM_SIMD
+    detail::SpectrumLanes Lanes() const { return detail::SpectrumLanes(lambda.data()); }
+#endif
+
   private:
     // SampledWavelengths Private Members
     friend struct SOA<SampledWavelengths>;
@@ -566,10 +823,7 @@ class RGBAlbedoSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum Sample(const SampledWavelengths &lambda) const {
-        SampledSpectrum s;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            s[i] = rsp(lambda[i]);
-        return s;
+        return rsp.Sample(lambda);
     }
 
     std::string ToString() const;
@@ -595,10 +849,7 @@ class RGBUnboundedSpectrum {
 
     PBRT_CPU_GPU
     SampledSpectrum Sample(const SampledWavelengths &lambda) const {
-        SampledSpectrum s;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            s[i] = scale * rsp(lambda[i]);
-        return s;
+        return scale * rsp.Sample(lambda);
     }
 
     std::string ToString() const;
@@ -637,10 +888,7 @@ class RGBIlluminantSpectrum {
     SampledSpectrum Sample(const SampledWavelengths &lambda) const {
         if (!illuminant)
             return SampledSpectrum(0);
-        SampledSpectrum s;
-        for (int i = 0; i < NSpectrumSamples; ++i)
-            s[i] = scale * rsp(lambda[i]);
-        return s * illuminant->Sample(lambda);
+        return scale * rsp.Sample(lambda) * illuminant->Sample(lambda);
     }
 
     std::string ToString() const;
@@ -652,12 +900,40 @@ class RGBIlluminantSpectrum {
     const DenselySampledSpectrum *illuminant;
 };
 
+// RGBSigmoidPolynomial Inline Methods
+PBRT_CPU_GPU inline SampledSpectrum RGBSigmoidPolynomial::Sample(
+    const SampledWavelengths &lambda) const {
+#ifdef PBRT_SPECTRUM_SIMD
+    using detail::SpectrumLanes;
+    SpectrumLanes l = lambda.Lanes();
+    SpectrumLanes x = SpectrumLanes(c2) + l * (SpectrumLanes(c1) + l * SpectrumLanes(c0));
+    // Clamping _x_ keeps 1 + x^2 finite, so that the sigmoid's limits at
+    // infinity, used for uniform RGB values, come out exactly
+    x = Min(Max(x, SpectrumLanes(-1e18f)), SpectrumLanes(1e18f));
+    SpectrumLanes half(0.5f);
+    return SampledSpectrum(
+        half + x / (SpectrumLanes(2.f) * Sqrt(SpectrumLanes(1.f) + x * x)));
+#else
+    SampledSpectrum s;
+    for (int i = 0; i < NSpectrumSamples; ++i)
+        s[i] = (*this)(lambda[i]);
+    return s;
+#endif
+}
+
 // SampledSpectrum Inline Functions
 PBRT_CPU_GPU inline SampledSpectrum SafeDiv(SampledSpectrum a, SampledSpectrum b) {
+#ifdef PBRT_SPECTRUM_SIMD
+    // Divide by one in zero lanes so that no spurious exceptions are raised
+    detail::SpectrumLanes bl = b.Lanes(), zero(0.f);
+    detail::SpectrumLanes d = SelectNonZero(bl, bl, detail::SpectrumLanes(1.f));
+    return SampledSpectrum(SelectNonZero(bl, a.Lanes() / d, zero));
+#else
     SampledSpectrum r;
     for (int i = 0; i < NSpectrumSamples; ++i)
         r[i] = (b[i] != 0) ? a[i] / b[i] : 0.;
     return r;
+#endif
 }
 
 template <typename U, typename V>
@@ -706,9 +982,13 @@ inline SampledSpectrum Pow(const SampledSpectrum &s, Float e) {
 
 PBRT_CPU_GPU
 inline SampledSpectrum Exp(const SampledSpectrum &s) {
+#ifdef PBRT_SPECTRUM_SIMD
+    SampledSpectrum ret(detail::Exp(s.Lanes()));
+#else
     SampledSpectrum ret;
     for (int i = 0; i < NSpectrumSamples; ++i)
         ret[i] = std::exp(s[i]);
+#endif
     DCHECK(!ret.HasNaNs());
     return ret;
 }
@@ -777,6 +1057,10 @@ inline const DenselySampledSpectrum &Z() {
 
 // Spectral Function Declarations
 Spectrum GetNamedSpectrum(std::string name);
+// Returns the named spectrum as a _DenselySampledSpectrum_ when it is
+// piecewise linear, so that evaluating it is a table lookup rather than a
+// binary search; each one is only converted once.
+Spectrum GetDenselySampledNamedSpectrum(std::string name);
 
 std::string FindMatchingNamedSpectrum(Spectrum s);
 
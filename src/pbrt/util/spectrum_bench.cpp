@@ -0,0 +1,68 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <benchmark/benchmark.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/util/rng.h>
+#include <pbrt/util/spectrum.h>
+
+#include <vector>
+
+using namespace pbrt;
+
+static std::vector<SampledSpectrum> RandomSpectra(int n, RNG &rng) {
+    std::vector<SampledSpectrum> s(n);
+    for (SampledSpectrum &v : s)
+        for (int i = 0; i < NSpectrumSamples; ++i)
+            v[i] = rng.Uniform<Float>();
+    return s;
+}
+
+// The path throughput update and radiance accumulation done at each vertex
+static void SampledSpectrum_MultiplyAdd(benchmark::State &state) {
+    RNG rng;
+    std::vector<SampledSpectrum> beta = RandomSpectra(1024, rng),
+                                 f = RandomSpectra(1024, rng);
+    SampledSpectrum L(0.f);
+    size_t i = 0;
+    for (auto _ : state) {
+        SampledSpectrum b = beta[i] * f[i] * 0.5f / 0.7f;
+        L += b * f[(i + 1) % f.size()];
+        benchmark::DoNotOptimize(L);
+        i = (i + 1) % beta.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Beer's law transmittance, as computed for homogeneous media
+static void SampledSpectrum_Exp(benchmark::State &state) {
+    RNG rng;
+    std::vector<SampledSpectrum> sigma_t = RandomSpectra(1024, rng);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Exp(-sigma_t[i] * 2.5f));
+        i = (i + 1) % sigma_t.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// The MIS weight computation with the wavelength-dependent PDFs
+static void SampledSpectrum_SafeDivAverage(benchmark::State &state) {
+    RNG rng;
+    std::vector<SampledSpectrum> r_u = RandomSpectra(1024, rng),
+                                 r_l = RandomSpectra(1024, rng);
+    size_t i = 0;
+    for (auto _ : state) {
+        SampledSpectrum w = SafeDiv(r_u[i], r_u[i] + r_l[i]);
+        benchmark::DoNotOptimize(w.Average());
+        i = (i + 1) % r_u.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(SampledSpectrum_MultiplyAdd);
+BENCHMARK(SampledSpectrum_Exp);
+BENCHMARK(SampledSpectrum_SafeDivAverage);
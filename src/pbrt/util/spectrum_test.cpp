@@ -120,6 +120,18 @@ TEST(Spectrum, MaxValue) {
     }
 }
 
+TEST(Spectrum, DenselySampledNamed) {
+    for (const char *name : {"metal-Cu-eta", "metal-Cu-k", "glass-BK7"}) {
+        Spectrum s = GetNamedSpectrum(name);
+        Spectrum dense = GetDenselySampledNamedSpectrum(name);
+        ASSERT_TRUE(dense.Is<DenselySampledSpectrum>()) << name;
+        EXPECT_EQ(dense, GetDenselySampledNamedSpectrum(name)) << name;
+        for (int lambda = Lambda_min; lambda <= Lambda_max; ++lambda)
+            EXPECT_FLOAT_EQ(s(lambda), dense(lambda)) << name << " " << lambda;
+    }
+    EXPECT_FALSE(GetDenselySampledNamedSpectrum("not-a-spectrum"));
+}
+
 TEST(Spectrum, SamplingPdfY) {
     // Make sure we can integrate the y matching curve correctly
     Float ysum = 0;
@@ -162,3 +174,55 @@ TEST(Spectrum, SamplingPdfXYZ) {
     EXPECT_LT(std::abs((impInt - unifInt) / unifInt), 1e-3)
         << impInt << " vs. " << unifInt;
 }
+
+TEST(SampledSpectrum, Arithmetic) {
+    RNG rng;
+    for (int iter = 0; iter < 1000; ++iter) {
+        SampledSpectrum a, b;
+        for (int i = 0; i < NSpectrumSamples; ++i) {
+            a[i] = -10 + 20 * rng.Uniform<Float>();
+            b[i] = (i == iter % NSpectrumSamples) ? 0 : 0.5f + rng.Uniform<Float>();
+        }
+
+        SampledSpectrum sum = a + b, diff = 2 - a, prod = a * b * 3, neg = -a;
+        SampledSpectrum quotient = SafeDiv(a, b), e = Exp(a);
+        Float maxValue = a[0], minValue = a[0];
+        for (int i = 0; i < NSpectrumSamples; ++i) {
+            EXPECT_EQ(a[i] + b[i], sum[i]);
+            EXPECT_EQ(2 - a[i], diff[i]);
+            EXPECT_EQ(a[i] * b[i] * 3, prod[i]);
+            EXPECT_EQ(-a[i], neg[i]);
+            EXPECT_EQ(b[i] != 0 ? a[i] / b[i] : 0, quotient[i]);
+            EXPECT_NEAR(std::exp(a[i]), e[i], 1e-6f * std::exp(a[i]));
+            maxValue = std::max(maxValue, a[i]);
+            minValue = std::min(minValue, a[i]);
+        }
+        EXPECT_EQ(maxValue, a.MaxComponentValue());
+        EXPECT_EQ(minValue, a.MinComponentValue());
+    }
+}
+
+TEST(SampledSpectrum, ExpLimits) {
+    for (Float x : {-Infinity, -200.f, -87.f, 0.f, 1.f, 88.f, 200.f, Infinity}) {
+        Float e = Exp(SampledSpectrum(x))[0];
+        if (IsInf(std::exp(x)))
+            EXPECT_TRUE(IsInf(e)) << x;
+        else
+            EXPECT_NEAR(std::exp(x), e, 1e-6f * std::exp(x)) << x;
+    }
+}
+
+TEST(RGBSigmoidPolynomial, Sample) {
+    RNG rng;
+    for (RGB rgb : {RGB(0, 0, 0), RGB(1, 1, 1), RGB(0.5, 0.5, 0.5), RGB(0.9, 0.2, 0.1),
+                    RGB(0.05, 0.6, 0.3), RGB(0.3, 0.3, 1)}) {
+        RGBSigmoidPolynomial rsp = RGBColorSpace::sRGB->ToRGBCoeffs(rgb);
+        for (int i = 0; i < 100; ++i) {
+            SampledWavelengths lambda =
+                SampledWavelengths::SampleVisible(rng.Uniform<Float>());
+            SampledSpectrum s = rsp.Sample(lambda);
+            for (int j = 0; j < NSpectrumSamples; ++j)
+                EXPECT_NEAR(rsp(lambda[j]), s[j], 1e-6f) << rgb;
+        }
+    }
+}
@@ -5,21 +5,36 @@
 #include <pbrt/util/stats.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/image.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/string.h>
 #include <pbrt/util/vecmath.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cinttypes>
+#include <condition_variable>
 #include <csignal>
+#include <cstring>
 #include <functional>
 #include <map>
 #include <mutex>
 #include <string>
+#include <thread>
+#ifndef PBRT_IS_WINDOWS
+#include <sys/time.h>
+#endif  // !PBRT_IS_WINDOWS
+#ifdef PBRT_IS_LINUX
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // PBRT_IS_LINUX
 
 namespace pbrt {
 
@@ -208,6 +223,11 @@ void StatsAccumulator::ReportCounter(const char *name, int64_t val) {
     stats->counters[name] += val;
 }
 
+int64_t StatsAccumulator::GetCounter(const std::string &name) const {
+    auto iter = stats->counters.find(name);
+    return iter == stats->counters.end() ? 0 : iter->second;
+}
+
 StatsAccumulator::StatsAccumulator() {
     stats = new Stats;
 }
@@ -333,6 +353,681 @@ void ClearStats() {
     statsAccumulator.Clear();
 }
 
+// Scene Load Profiling Local Variables
+bool loadProfileEnabled = false;
+
+// LoadProfileEvent Definition
+struct LoadProfileEvent {
+    const char *phase;
+    std::string entity;
+    int thread;
+    int64_t startMicroseconds, durationMicroseconds, bytes;
+};
+
+static TrackedMemoryResource *loadProfileMemory;
+static std::mutex loadProfileMutex;
+static std::vector<LoadProfileEvent> *loadProfileEvents;
+
+// Profiling Local Functions
+// Both scene load profiling and tracing measure times from program startup
+static std::chrono::steady_clock::time_point profileStart =
+    std::chrono::steady_clock::now();
+
+static int64_t profileMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - profileStart)
+        .count();
+}
+
+static int profileThread() {
+    static std::atomic<int> nextThread{0};
+    static thread_local int thread = nextThread++;
+    return thread;
+}
+
+// Tracing Local Variables
+bool traceEnabled = false;
+
+// TraceEvent Definition
+struct TraceEvent {
+    const char *category;
+    std::string name, args;
+    int64_t startMicroseconds, durationMicroseconds;
+};
+
+// Each thread appends to its own event list so that recording an event
+// doesn't need a lock; _traceMutex_ protects the list of them.
+static std::mutex traceMutex;
+static std::vector<std::pair<int, std::vector<TraceEvent> *>> *traceThreadEvents;
+static thread_local std::vector<TraceEvent> *threadTraceEvents;
+
+static void addTraceEvent(TraceEvent event) {
+    if (!threadTraceEvents) {
+        threadTraceEvents = new std::vector<TraceEvent>;
+        std::lock_guard<std::mutex> lock(traceMutex);
+        traceThreadEvents->push_back(std::make_pair(profileThread(), threadTraceEvents));
+    }
+    threadTraceEvents->push_back(std::move(event));
+}
+
+// Scene Load Profiling Function Definitions
+void StatsEnableLoadProfile() {
+    // Track all allocations from the default memory resource from here on
+    loadProfileMemory = EnableMemoryTracking();
+    loadProfileEvents = new std::vector<LoadProfileEvent>;
+    loadProfileEnabled = true;
+}
+
+void LoadProfileScope::start(const char *p, std::string_view e) {
+    active = true;
+    phase = p;
+    entity = std::string(e);
+    startBytes = loadProfileEnabled ? loadProfileMemory->CurrentAllocatedBytes() : 0;
+    startMicroseconds = profileMicroseconds();
+}
+
+void LoadProfileScope::start(const char *p, const FileLoc *loc) {
+    start(p, loc->ToString());
+}
+
+void LoadProfileScope::end() {
+    int64_t duration = profileMicroseconds() - startMicroseconds;
+    // Scene file and image reading are reported as I/O
+    if (traceEnabled)
+        addTraceEvent({strncmp(phase, "Read ", 5) == 0 ? "I/O" : "Scene",
+                       entity.empty() ? std::string(phase) : entity,
+                       StringPrintf("\"phase\": %s", QuoteJSONString(phase)),
+                       startMicroseconds, duration});
+    if (!loadProfileEnabled)
+        return;
+
+    int64_t bytes = int64_t(loadProfileMemory->CurrentAllocatedBytes()) - startBytes;
+    LoadProfileEvent event{phase, std::move(entity), profileThread(),
+                           startMicroseconds, duration, bytes};
+    std::lock_guard<std::mutex> lock(loadProfileMutex);
+    loadProfileEvents->push_back(std::move(event));
+}
+
+void StatsWriteLoadProfile(const std::string &filename) {
+    CHECK(loadProfileEnabled);
+    std::lock_guard<std::mutex> lock(loadProfileMutex);
+
+    // Summarize the events by phase and by entity
+    struct Total {
+        int64_t count = 0, microseconds = 0, bytes = 0;
+    };
+    std::map<std::string, Total> phaseTotals;
+    std::map<std::pair<std::string, std::string>, Total> entityTotals;
+    for (const LoadProfileEvent &event : *loadProfileEvents) {
+        for (Total *total : {&phaseTotals[event.phase],
+                             &entityTotals[std::make_pair(event.phase, event.entity)]}) {
+            ++total->count;
+            total->microseconds += event.durationMicroseconds;
+            total->bytes += event.bytes;
+        }
+    }
+
+    // Report the most expensive phases and entities first
+    auto sortByTime = [](auto &totals) {
+        std::vector<std::pair<typename std::decay_t<decltype(totals)>::key_type, Total>>
+            sorted(totals.begin(), totals.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+            return a.second.microseconds > b.second.microseconds;
+        });
+        return sorted;
+    };
+    auto totalJSON = [](const Total &total) {
+        return StringPrintf("\"count\": %d, \"seconds\": %f, \"bytes\": %d",
+                            total.count, total.microseconds / 1e6, total.bytes);
+    };
+
+    std::string report = "{\n  \"phases\": [";
+    bool first = true;
+    for (const auto &phase : sortByTime(phaseTotals)) {
+        report += StringPrintf("%s\n    { \"phase\": %s, %s }", first ? "" : ",",
+                               QuoteJSONString(phase.first), totalJSON(phase.second));
+        first = false;
+    }
+    report += "\n  ],\n  \"entities\": [";
+    first = true;
+    for (const auto &entity : sortByTime(entityTotals)) {
+        if (entity.first.second.empty())
+            continue;
+        report += StringPrintf("%s\n    { \"phase\": %s, \"entity\": %s, %s }",
+                               first ? "" : ",", QuoteJSONString(entity.first.first),
+                               QuoteJSONString(entity.first.second),
+                               totalJSON(entity.second));
+        first = false;
+    }
+    report += StringPrintf("\n  ],\n  \"hugePageBytes\": %d\n}\n",
+                           loadProfileMemory->HugePageBytes());
+    if (!WriteFileContents(filename, report))
+        Warning("%s: unable to write scene load profile.", filename);
+
+    // Write the events in the Chrome trace event format
+    std::string trace = "{ \"traceEvents\": [";
+    first = true;
+    for (const LoadProfileEvent &event : *loadProfileEvents) {
+        std::string name = event.entity.empty() ? std::string(event.phase) : event.entity;
+        trace += StringPrintf("%s\n  { \"name\": %s, \"cat\": %s, \"ph\": \"X\", "
+                              "\"ts\": %d, \"dur\": %d, \"pid\": 0, \"tid\": %d, "
+                              "\"args\": { \"bytes\": %d } }",
+                              first ? "" : ",", QuoteJSONString(name),
+                              QuoteJSONString(event.phase), event.startMicroseconds,
+                              event.durationMicroseconds, event.thread, event.bytes);
+        first = false;
+    }
+    trace += "\n] }\n";
+    std::string traceFilename = RemoveExtension(filename) + "-trace.json";
+    if (!WriteFileContents(traceFilename, trace))
+        Warning("%s: unable to write scene load trace.", traceFilename);
+}
+
+// Performance Counter Local Variables
+bool perfCountersEnabled = false;
+
+static constexpr int nPerfRegions = 4, nPerfEvents = 4;
+static const char *perfRegionNames[nPerfRegions] = {"BVH traversal", "Shading",
+                                                    "Texture filtering", "Film update"};
+enum PerfEvent { PerfCycles, PerfInstructions, PerfCacheMisses, PerfBranchMisses };
+static const char *perfEventNames[nPerfEvents] = {"cycles", "instructions",
+                                                  "cache misses", "branch misses"};
+
+// Counters are only read for one in _perfSampleRate_ executions of each
+// region, which amortizes the cost of the system calls that read them.
+static constexpr int perfSampleRate = 64;
+
+// PerfThreadCounters Definition
+struct PerfThreadCounters {
+    // File descriptor of the thread's counter group: -2 if it hasn't been
+    // opened yet and -1 if it couldn't be.
+    int groupFd = -2;
+    int64_t executions[nPerfRegions] = {}, sampled[nPerfRegions] = {};
+    uint64_t counts[nPerfRegions][nPerfEvents] = {};
+};
+
+static thread_local PerfThreadCounters perfThreadCounters;
+
+// Performance Counter Local Functions
+static int openPerfCounters() {
+#ifdef PBRT_IS_LINUX
+    // Open all of the counters in a single group so that one read() returns
+    // all of them
+    const uint64_t configs[nPerfEvents] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES};
+    int groupFd = -1;
+    for (int i = 0; i < nPerfEvents; ++i) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int fd = syscall(__NR_perf_event_open, &attr, 0 /* this thread */,
+                         -1 /* any CPU */, groupFd, 0);
+        if (fd == -1) {
+            if (groupFd != -1)
+                close(groupFd);
+            return -1;
+        }
+        if (groupFd == -1)
+            groupFd = fd;
+    }
+    return groupFd;
+#else
+    return -1;
+#endif  // PBRT_IS_LINUX
+}
+
+static bool readPerfCounters(int groupFd, uint64_t counts[nPerfEvents]) {
+#ifdef PBRT_IS_LINUX
+    // With PERF_FORMAT_GROUP, the number of counters precedes their values
+    uint64_t values[1 + nPerfEvents];
+    if (read(groupFd, values, sizeof(values)) != sizeof(values))
+        return false;
+    for (int i = 0; i < nPerfEvents; ++i)
+        counts[i] = values[1 + i];
+    return true;
+#else
+    return false;
+#endif  // PBRT_IS_LINUX
+}
+
+static StatRegisterer perfCounterRegisterer([](StatsAccumulator &accum) {
+    PerfThreadCounters &pc = perfThreadCounters;
+    for (int r = 0; r < nPerfRegions; ++r) {
+        if (pc.sampled[r] == 0)
+            continue;
+        // Scale the sampled counts up to estimate totals for all executions
+        double scale = double(pc.executions[r]) / double(pc.sampled[r]);
+        std::string prefix = StringPrintf("Perf counters/%s: ", perfRegionNames[r]);
+        accum.ReportCounter((prefix + "executions").c_str(), pc.executions[r]);
+        for (int e = 0; e < nPerfEvents; ++e)
+            accum.ReportCounter((prefix + perfEventNames[e] + " (estimated)").c_str(),
+                                int64_t(scale * pc.counts[r][e]));
+        accum.ReportRatio((prefix + "instructions per cycle").c_str(),
+                          pc.counts[r][PerfInstructions], pc.counts[r][PerfCycles]);
+        accum.ReportRatio((prefix + "cache misses per 1000 instructions").c_str(),
+                          1000 * pc.counts[r][PerfCacheMisses],
+                          pc.counts[r][PerfInstructions]);
+        pc.executions[r] = pc.sampled[r] = 0;
+        for (int e = 0; e < nPerfEvents; ++e)
+            pc.counts[r][e] = 0;
+    }
+});
+
+// Performance Counter Function Definitions
+bool StatsEnablePerfCounters() {
+    // Make sure that the counters can be opened before enabling them
+    int fd = openPerfCounters();
+    if (fd == -1)
+        return false;
+    perfThreadCounters.groupFd = fd;
+    perfCountersEnabled = true;
+    return true;
+}
+
+void PerfCounterScope::start(PerfRegion r) {
+    PerfThreadCounters &pc = perfThreadCounters;
+    region = r;
+    if (pc.executions[int(region)]++ % perfSampleRate != 0)
+        return;
+    if (pc.groupFd == -2)
+        pc.groupFd = openPerfCounters();
+    active = pc.groupFd != -1 && readPerfCounters(pc.groupFd, startCounts);
+}
+
+void PerfCounterScope::end() {
+    PerfThreadCounters &pc = perfThreadCounters;
+    uint64_t endCounts[nPerfEvents];
+    if (!readPerfCounters(pc.groupFd, endCounts))
+        return;
+    ++pc.sampled[int(region)];
+    for (int e = 0; e < nPerfEvents; ++e)
+        pc.counts[int(region)][e] += endCounts[e] - startCounts[e];
+}
+
+// Profiler Local Variables
+bool profilerEnabled = false;
+
+static constexpr int nProfilePhases = 6;
+static const char *profilePhaseNames[nProfilePhases] = {
+    "Intersection", "Shading",     "Texture filtering",
+    "Light sampling", "Film update", "Medium sampling"};
+// Samples are taken after each 1ms of CPU time used by all of the threads
+static constexpr int profileSampleMicroseconds = 1000;
+
+// The low bits of the state are a mask of the thread's active phases and the
+// bits above them hold one plus its innermost one, so that both are updated
+// with a single store that the signal handler never sees half done.
+static constexpr int profileInnermostShift = 8;
+static thread_local std::atomic<uint32_t> profilerState;
+
+// ProfilerThreadSamples Definition
+// A thread's samples are only updated by the signal handler while it is
+// interrupted, so there is no contention for them.
+struct ProfilerThreadSamples {
+    std::atomic<int64_t> total;
+    std::atomic<int64_t> inclusive[nProfilePhases], exclusive[nProfilePhases];
+};
+
+static thread_local ProfilerThreadSamples profilerThreadSamples;
+
+// Profiler Local Functions
+static void profilerSignalHandler(int) {
+    uint32_t state = profilerState.load(std::memory_order_relaxed);
+    ProfilerThreadSamples &samples = profilerThreadSamples;
+    samples.total.fetch_add(1, std::memory_order_relaxed);
+    for (int p = 0; p < nProfilePhases; ++p)
+        if (state & (1u << p))
+            samples.inclusive[p].fetch_add(1, std::memory_order_relaxed);
+    if (int innermost = state >> profileInnermostShift; innermost > 0)
+        samples.exclusive[innermost - 1].fetch_add(1, std::memory_order_relaxed);
+}
+
+static StatRegisterer profilerRegisterer([](StatsAccumulator &accum) {
+    ProfilerThreadSamples &samples = profilerThreadSamples;
+    int64_t total = samples.total.exchange(0);
+    if (total == 0)
+        return;
+    accum.ReportCounter("Profile/Samples", total);
+    int64_t inPhases = 0;
+    for (int p = 0; p < nProfilePhases; ++p) {
+        int64_t inclusive = samples.inclusive[p].exchange(0);
+        int64_t exclusive = samples.exclusive[p].exchange(0);
+        inPhases += exclusive;
+        std::string prefix = StringPrintf("Profile/%s", profilePhaseNames[p]);
+        accum.ReportPercentage((prefix + " (including nested phases)").c_str(),
+                               inclusive, total);
+        accum.ReportPercentage((prefix + " (excluding nested phases)").c_str(),
+                               exclusive, total);
+    }
+    accum.ReportPercentage("Profile/Other", total - inPhases, total);
+});
+
+// Profiler Function Definitions
+bool StatsEnableProfiler() {
+#ifndef PBRT_IS_WINDOWS
+    // Restart interrupted system calls so that the rest of the system
+    // needn't handle EINTR from the profiler's signals
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = profilerSignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) != 0)
+        return false;
+
+    profilerEnabled = true;
+    itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = profileSampleMicroseconds;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        profilerEnabled = false;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif  // !PBRT_IS_WINDOWS
+}
+
+void StatsStopProfiler() {
+    if (!profilerEnabled)
+        return;
+#ifndef PBRT_IS_WINDOWS
+    itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+#endif  // !PBRT_IS_WINDOWS
+    profilerEnabled = false;
+}
+
+void ProfilerScope::start(ProfilePhase phase) {
+    previousState = profilerState.load(std::memory_order_relaxed);
+    uint32_t mask = (previousState & ((1u << profileInnermostShift) - 1)) |
+                    (1u << int(phase));
+    profilerState.store(mask | ((uint32_t(phase) + 1) << profileInnermostShift),
+                        std::memory_order_relaxed);
+    active = true;
+}
+
+void ProfilerScope::end() {
+    profilerState.store(previousState, std::memory_order_relaxed);
+}
+
+// Benchmark Local Variables
+static double benchmarkSeconds[5];
+static pstd::optional<std::pair<int64_t, int64_t>> benchmarkRays;
+
+// Benchmark Function Definitions
+void StatsReportBenchmarkPhase(BenchmarkPhase phase, double seconds) {
+    benchmarkSeconds[int(phase)] += seconds;
+}
+
+void StatsReportBenchmarkRays(int64_t cameraRays, int64_t totalRays) {
+    benchmarkRays = std::make_pair(cameraRays, totalRays);
+}
+
+void StatsWriteBenchmark(const std::string &filename, int spp) {
+    // Find the number of rays traced, which is only correct once all threads
+    // have reported their statistics
+    int64_t cameraRays, totalRays;
+    if (benchmarkRays) {
+        cameraRays = benchmarkRays->first;
+        totalRays = benchmarkRays->second;
+    } else {
+        cameraRays = statsAccumulator.GetCounter("Integrator/Camera rays traced");
+        totalRays =
+            statsAccumulator.GetCounter("Intersections/Regular ray intersection tests") +
+            statsAccumulator.GetCounter("Intersections/Shadow ray intersection tests");
+    }
+
+    double renderSeconds = benchmarkSeconds[int(BenchmarkPhase::Render)];
+    auto perSecond = [&](int64_t n) {
+        return renderSeconds > 0 ? n / renderSeconds : 0.;
+    };
+    std::string report = StringPrintf(
+        "{\n  \"spp\": %d,\n  \"threads\": %d,\n  \"startupSeconds\": %f,\n"
+        "  \"parseSeconds\": %f,\n"
+        "  \"sceneCreationSeconds\": %f,\n  \"aggregateBuildSeconds\": %f,\n"
+        "  \"renderSeconds\": %f,\n  \"cameraRays\": %d,\n  \"totalRays\": %d,\n"
+        "  \"cameraRaysPerSecond\": %f,\n  \"raysPerSecond\": %f,\n"
+        "  \"peakMemoryBytes\": %d\n}\n",
+        spp, RunningThreads(), benchmarkSeconds[int(BenchmarkPhase::Startup)],
+        benchmarkSeconds[int(BenchmarkPhase::Parse)],
+        benchmarkSeconds[int(BenchmarkPhase::SceneCreation)],
+        benchmarkSeconds[int(BenchmarkPhase::AggregateBuild)], renderSeconds, cameraRays,
+        totalRays, perSecond(cameraRays), perSecond(totalRays), GetPeakRSS());
+    if (!WriteFileContents(filename, report))
+        Warning("%s: unable to write benchmark results.", filename);
+}
+
+// Tracing Function Definitions
+void StatsEnableTrace() {
+    traceThreadEvents = new std::vector<std::pair<int, std::vector<TraceEvent> *>>;
+    // Make sure that the main thread is the first one
+    (void)profileThread();
+    traceEnabled = true;
+}
+
+void TraceScope::start(const char *c, std::string_view n) {
+    active = true;
+    category = c;
+    name = std::string(n);
+    startMicroseconds = profileMicroseconds();
+}
+
+void TraceScope::end() {
+    int64_t duration = profileMicroseconds() - startMicroseconds;
+    addTraceEvent({category, std::move(name), std::move(args), startMicroseconds,
+                   duration});
+}
+
+void StatsWriteTrace(const std::string &filename) {
+    CHECK(traceEnabled);
+    // Other threads must be idle, so that their event lists aren't changing;
+    // stop recording so that writing the trace doesn't add to them.
+    traceEnabled = false;
+    std::lock_guard<std::mutex> lock(traceMutex);
+    std::vector<std::pair<int, std::vector<TraceEvent> *>> threads = *traceThreadEvents;
+    std::sort(threads.begin(), threads.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    std::string trace = "{ \"traceEvents\": [";
+    bool first = true;
+    for (const auto &thread : threads) {
+        // Name each thread's track, then add its events
+        trace += StringPrintf(
+            "%s\n  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, "
+            "\"args\": { \"name\": \"%s\" } }",
+            first ? "" : ",", thread.first,
+            thread.first == 0 ? std::string("Main thread")
+                              : StringPrintf("Thread %d", thread.first));
+        first = false;
+        for (const TraceEvent &event : *thread.second)
+            trace += StringPrintf(
+                ",\n  { \"name\": %s, \"cat\": %s, \"ph\": \"X\", \"ts\": %d, "
+                "\"dur\": %d, \"pid\": 0, \"tid\": %d, \"args\": { %s } }",
+                QuoteJSONString(event.name), QuoteJSONString(event.category),
+                event.startMicroseconds, event.durationMicroseconds, thread.first,
+                event.args);
+    }
+    trace += "\n] }\n";
+    if (!WriteFileContents(filename, trace))
+        Warning("%s: unable to write trace.", filename);
+}
+
+// Live Metrics Local Variables
+bool metricsEnabled = false;
+
+// Each thread counts its rays in its own counter, which only it writes, so
+// that counting them doesn't contend; _metricsMutex_ protects the list of
+// counters and the state shared with the thread that writes the metrics.
+static std::mutex metricsMutex;
+static std::condition_variable metricsCondition;
+static std::vector<std::atomic<int64_t> *> *metricsThreadRays;
+static thread_local std::atomic<int64_t> *threadMetricsRays;
+
+static std::string metricsFile;
+static std::function<size_t()> metricsTrackedBytes;
+static std::thread metricsThread;
+static bool metricsExit = false;
+
+static const ProgressReporter *metricsProgress;
+static std::string metricsProgressTitle;
+static int64_t metricsSamplesPerWorkUnit;
+static std::chrono::steady_clock::time_point metricsProgressStart;
+static bool metricsProgressFinished = false;
+
+// Live Metrics Local Functions
+// Must be called with _metricsMutex_ held.
+static void writeMetrics(bool done, double *lastSeconds, int64_t *lastRays) {
+    double seconds = profileMicroseconds() / 1e6;
+    int64_t rays = 0;
+    for (const std::atomic<int64_t> *threadRays : *metricsThreadRays)
+        rays += threadRays->load(std::memory_order_relaxed);
+    double raysPerSecond =
+        seconds > *lastSeconds ? (rays - *lastRays) / (seconds - *lastSeconds) : 0;
+    *lastSeconds = seconds;
+    *lastRays = rays;
+
+    // Estimate the time remaining from the average rate of progress so far
+    int64_t samplesDone = 0, samplesTotal = 0;
+    pstd::optional<double> etaSeconds;
+    if (metricsProgress) {
+        samplesDone = metricsProgress->WorkDone() * metricsSamplesPerWorkUnit;
+        samplesTotal = metricsProgress->TotalWork() * metricsSamplesPerWorkUnit;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                       metricsProgressStart)
+                             .count();
+        if (samplesDone > 0)
+            etaSeconds = std::max<double>(
+                0, elapsed * (samplesTotal - samplesDone) / samplesDone);
+    }
+    std::string phase = done                      ? "Done"
+                        : metricsProgress         ? metricsProgressTitle
+                        : metricsProgressFinished ? "Finishing"
+                                                  : "Loading";
+    double fractionDone = samplesTotal > 0 ? double(samplesDone) / samplesTotal : 0;
+    size_t trackedBytes = metricsTrackedBytes();
+
+    std::string metrics;
+    if (HasExtension(metricsFile, "prom")) {
+        auto gauge = [&metrics](const char *name, const char *help, auto value) {
+            metrics += StringPrintf("# HELP pbrt_%s %s\n# TYPE pbrt_%s gauge\n",
+                                    name, help, name);
+            metrics += StringPrintf("pbrt_%s %s\n", name, value);
+        };
+        gauge("done", "Whether the render has finished.", done ? 1 : 0);
+        gauge("elapsed_seconds", "Time since pbrt started.", seconds);
+        gauge("pixel_samples_done", "Pixel samples taken.", samplesDone);
+        gauge("pixel_samples_total", "Pixel samples to take.", samplesTotal);
+        gauge("fraction_done", "Fraction of the pixel samples taken.", fractionDone);
+        if (etaSeconds)
+            gauge("eta_seconds", "Estimated time until rendering finishes.",
+                  *etaSeconds);
+        metrics += StringPrintf("# HELP pbrt_rays_total Rays traced.\n"
+                                "# TYPE pbrt_rays_total counter\npbrt_rays_total %d\n",
+                                rays);
+        gauge("rays_per_second", "Rays traced per second since the last update.",
+              raysPerSecond);
+        gauge("tracked_memory_bytes", "Bytes allocated by pbrt's memory resources.",
+              trackedBytes);
+        gauge("rss_bytes", "Resident set size.", GetCurrentRSS());
+        gauge("peak_rss_bytes", "Peak resident set size.", GetPeakRSS());
+    } else
+        metrics = StringPrintf(
+            "{\n  \"phase\": %s,\n  \"done\": %s,\n  \"elapsedSeconds\": %f,\n"
+            "  \"pixelSamplesDone\": %d,\n  \"pixelSamplesTotal\": %d,\n"
+            "  \"fractionDone\": %f,\n  \"etaSeconds\": %s,\n  \"raysTraced\": %d,\n"
+            "  \"raysPerSecond\": %f,\n  \"trackedMemoryBytes\": %d,\n"
+            "  \"rssBytes\": %d,\n  \"peakRSSBytes\": %d\n}\n",
+            QuoteJSONString(phase), done, seconds, samplesDone, samplesTotal,
+            fractionDone, etaSeconds ? StringPrintf("%f", *etaSeconds) : "null", rays,
+            raysPerSecond, trackedBytes, GetCurrentRSS(), GetPeakRSS());
+
+    // Write to a temporary file and rename it so that readers never see a
+    // partially-written one
+    std::string tempFile = metricsFile + ".tmp";
+    if (!WriteFileContents(tempFile, metrics))
+        return;
+#ifdef PBRT_IS_WINDOWS
+    std::remove(metricsFile.c_str());
+#endif
+    if (std::rename(tempFile.c_str(), metricsFile.c_str()) != 0)
+        Warning("%s: unable to update metrics: %s", metricsFile, ErrorString());
+}
+
+// Live Metrics Function Definitions
+void StatsEnableMetrics(const std::string &filename, Float intervalSeconds,
+                        std::function<size_t()> trackedBytes) {
+    metricsFile = filename;
+    metricsThreadRays = new std::vector<std::atomic<int64_t> *>;
+    if (!trackedBytes) {
+        TrackedMemoryResource *memory = EnableMemoryTracking();
+        trackedBytes = [memory]() { return memory->CurrentAllocatedBytes(); };
+    }
+    metricsTrackedBytes = std::move(trackedBytes);
+    metricsEnabled = true;
+
+    metricsThread = std::thread([intervalSeconds]() {
+        double lastSeconds = 0;
+        int64_t lastRays = 0;
+        std::chrono::duration<double> interval(intervalSeconds);
+        std::unique_lock<std::mutex> lock(metricsMutex);
+        while (true) {
+            bool exit =
+                metricsCondition.wait_for(lock, interval, []() { return metricsExit; });
+            writeMetrics(exit, &lastSeconds, &lastRays);
+            if (exit)
+                break;
+        }
+    });
+}
+
+void StatsStopMetrics() {
+    CHECK(metricsEnabled);
+    {
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        metricsExit = true;
+    }
+    metricsCondition.notify_one();
+    metricsThread.join();
+}
+
+void StatsCountMetricsRays(int64_t n) {
+    if (!threadMetricsRays) {
+        threadMetricsRays = new std::atomic<int64_t>(0);
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        metricsThreadRays->push_back(threadMetricsRays);
+    }
+    // This thread is the only writer, so an atomic read-modify-write isn't
+    // necessary.
+    threadMetricsRays->store(threadMetricsRays->load(std::memory_order_relaxed) + n,
+                             std::memory_order_relaxed);
+}
+
+void MetricsProgressScope::start(const ProgressReporter &progress,
+                                 int64_t samplesPerWorkUnit) {
+    active = true;
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    metricsProgress = &progress;
+    metricsProgressTitle = progress.Title();
+    metricsSamplesPerWorkUnit = samplesPerWorkUnit;
+    metricsProgressStart = std::chrono::steady_clock::now();
+}
+
+void MetricsProgressScope::end() {
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    metricsProgress = nullptr;
+    metricsProgressFinished = true;
+}
+
 static void getCategoryAndTitle(const std::string &str, std::string *category,
                                 std::string *title) {
     std::vector<std::string> comps = SplitString(str, '/');
@@ -481,6 +1176,36 @@ void StatsAccumulator::WritePixelImages() const {
         if (!AllZero(stats->pixelRatioImages[i]))
             CHECK(stats->pixelRatioImages[i].Write(n));
     }
+
+    // Also write all of the per-pixel values as channels of a single image,
+    // with each statistic's category as its layer, so that they can be
+    // compared as heatmaps in an EXR viewer
+    auto channelName = [](const std::string &name) {
+        std::string n = name;
+        std::replace(n.begin(), n.end(), '/', '.');
+        return n;
+    };
+    std::vector<std::string> channels = {"Time.ms"};
+    std::vector<std::pair<const Image *, int>> sources = {{&stats->pixelTime, 0}};
+    for (size_t i = 0; i < stats->pixelCounterImages.size(); ++i)
+        if (stats->pixelCounterImages[i].Resolution() != Point2i(0, 0)) {
+            channels.push_back(channelName(stats->pixelCounterNames[i]));
+            sources.push_back({&stats->pixelCounterImages[i], 0});
+        }
+    for (size_t i = 0; i < stats->pixelRatioImages.size(); ++i)
+        if (stats->pixelRatioImages[i].Resolution() != Point2i(0, 0)) {
+            channels.push_back(channelName(stats->pixelRatioNames[i]) + " ratio");
+            sources.push_back({&stats->pixelRatioImages[i], 2});
+        }
+    Point2i res = stats->pixelTime.Resolution();
+    Image heatmaps(PixelFormat::Float, res, channels);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (size_t c = 0; c < sources.size(); ++c) {
+                auto [image, channel] = sources[c];
+                heatmaps.SetChannel({x, y}, c, image->GetChannel({x, y}, channel));
+            }
+    CHECK(heatmaps.Write(pixelStatsBaseName + "-heatmaps.exr"));
 }
 
 bool StatsAccumulator::PrintCheckRare(FILE *dest) {
@@ -8,13 +8,17 @@
 #include <pbrt/pbrt.h>
 
 #include <cstdio>
+#include <functional>
 #include <limits>
 #include <string>
+#include <string_view>
 
 namespace pbrt {
 
 class StatsAccumulator;
 class PixelStatsAccumulator;
+class ProgressReporter;
+struct FileLoc;
 // StatRegisterer Definition
 class StatRegisterer {
   public:
@@ -37,6 +41,226 @@ bool PrintCheckRare(FILE *dest);
 void ClearStats();
 void ReportThreadStats();
 
+// Scene load profiling records the wall-clock time and the bytes allocated
+// from the default memory resource for each LoadProfileScope. Allocations
+// made concurrently by other threads are included in a scope's bytes.
+void StatsEnableLoadProfile();
+void StatsWriteLoadProfile(const std::string &filename);
+
+extern bool loadProfileEnabled;
+
+// Benchmark mode (--bench) writes the wall-clock time of the main phases of a
+// run to a JSON file along with the rays traced, taken from the intersection
+// statistics, and the peak memory use. The startup phase is InitPBRT(), and
+// the scene creation phase includes the aggregate build.
+enum class BenchmarkPhase { Startup, Parse, SceneCreation, AggregateBuild, Render };
+
+void StatsReportBenchmarkPhase(BenchmarkPhase phase, double seconds);
+// Integrators that don't update the intersection statistics report their rays
+// directly.
+void StatsReportBenchmarkRays(int64_t cameraRays, int64_t totalRays);
+void StatsWriteBenchmark(const std::string &filename, int spp);
+
+// Tracing records the span of each TraceScope and LoadProfileScope on each
+// thread and writes them in the Chrome trace event format, which Perfetto and
+// chrome://tracing display as a timeline per thread.
+void StatsEnableTrace();
+void StatsWriteTrace(const std::string &filename);
+
+extern bool traceEnabled;
+
+// Hardware performance counters (on Linux, via perf_event) are read around a
+// sample of the executions of each PerfCounterScope and reported with the
+// statistics as estimated per-region totals, instructions per cycle, and
+// cache misses per thousand instructions. When regions nest, the outer
+// region's counts include the inner one's.
+enum class PerfRegion { BVHTraversal, Shading, TextureFiltering, FilmUpdate };
+
+// Returns false if the counters aren't available
+bool StatsEnablePerfCounters();
+
+extern bool perfCountersEnabled;
+
+// The sampling profiler periodically interrupts the threads that are using
+// the CPU (via SIGPROF, where it's available) and records the phases of the
+// interrupted thread's active ProfilerScopes. It reports the fraction of the
+// samples that were taken in each phase with the statistics, both including
+// and excluding the time spent in the other phases nested within it.
+enum class ProfilePhase {
+    Intersection,
+    Shading,
+    TextureFiltering,
+    LightSampling,
+    FilmUpdate,
+    MediumSampling
+};
+
+// Returns false if the profiler isn't available
+bool StatsEnableProfiler();
+void StatsStopProfiler();
+
+extern bool profilerEnabled;
+
+// Live metrics periodically rewrite a small file with the progress of the
+// current MetricsProgressScope, its estimated time remaining, the ray
+// throughput, and the memory in use, so that job schedulers can monitor
+// long renders. The file is JSON unless its name ends in ".prom", in which
+// case it uses the Prometheus text exposition format. Without
+// _trackedBytes_, allocations from the default memory resource are tracked.
+void StatsEnableMetrics(const std::string &filename, Float intervalSeconds,
+                        std::function<size_t()> trackedBytes = {});
+// Writes the final metrics and stops updating them
+void StatsStopMetrics();
+void StatsCountMetricsRays(int64_t n);
+
+extern bool metricsEnabled;
+
+// LoadProfileScope Definition
+class LoadProfileScope {
+  public:
+    // LoadProfileScope Public Methods
+    LoadProfileScope(const char *phase, std::string_view entity = {}) {
+        if (loadProfileEnabled || traceEnabled)
+            start(phase, entity);
+    }
+    LoadProfileScope(const char *phase, const FileLoc *loc) {
+        if (loadProfileEnabled || traceEnabled)
+            start(phase, loc);
+    }
+    ~LoadProfileScope() {
+        if (active)
+            end();
+    }
+
+    LoadProfileScope(const LoadProfileScope &) = delete;
+    LoadProfileScope &operator=(const LoadProfileScope &) = delete;
+
+  private:
+    // LoadProfileScope Private Methods
+    void start(const char *phase, std::string_view entity);
+    void start(const char *phase, const FileLoc *loc);
+    void end();
+
+    // LoadProfileScope Private Members
+    bool active = false;
+    const char *phase;
+    std::string entity;
+    int64_t startMicroseconds, startBytes;
+};
+
+// PerfCounterScope Definition
+class PerfCounterScope {
+  public:
+    // PerfCounterScope Public Methods
+    PerfCounterScope(PerfRegion region) {
+        if (perfCountersEnabled)
+            start(region);
+    }
+    ~PerfCounterScope() {
+        if (active)
+            end();
+    }
+
+    PerfCounterScope(const PerfCounterScope &) = delete;
+    PerfCounterScope &operator=(const PerfCounterScope &) = delete;
+
+  private:
+    // PerfCounterScope Private Methods
+    void start(PerfRegion region);
+    void end();
+
+    // PerfCounterScope Private Members
+    bool active = false;
+    PerfRegion region;
+    uint64_t startCounts[4];
+};
+
+// ProfilerScope Definition
+class ProfilerScope {
+  public:
+    // ProfilerScope Public Methods
+    ProfilerScope(ProfilePhase phase) {
+        if (profilerEnabled)
+            start(phase);
+    }
+    ~ProfilerScope() {
+        if (active)
+            end();
+    }
+
+    ProfilerScope(const ProfilerScope &) = delete;
+    ProfilerScope &operator=(const ProfilerScope &) = delete;
+
+  private:
+    // ProfilerScope Private Methods
+    void start(ProfilePhase phase);
+    void end();
+
+    // ProfilerScope Private Members
+    bool active = false;
+    uint32_t previousState;
+};
+
+// MetricsProgressScope Definition
+// Reports _progress_ with the live metrics while the scope is active; each
+// of its units of work is _samplesPerWorkUnit_ pixel samples.
+class MetricsProgressScope {
+  public:
+    // MetricsProgressScope Public Methods
+    MetricsProgressScope(const ProgressReporter &progress,
+                         int64_t samplesPerWorkUnit = 1) {
+        if (metricsEnabled)
+            start(progress, samplesPerWorkUnit);
+    }
+    ~MetricsProgressScope() {
+        if (active)
+            end();
+    }
+
+    MetricsProgressScope(const MetricsProgressScope &) = delete;
+    MetricsProgressScope &operator=(const MetricsProgressScope &) = delete;
+
+  private:
+    // MetricsProgressScope Private Methods
+    void start(const ProgressReporter &progress, int64_t samplesPerWorkUnit);
+    void end();
+
+    // MetricsProgressScope Private Members
+    bool active = false;
+};
+
+// TraceScope Definition
+class TraceScope {
+  public:
+    // TraceScope Public Methods
+    TraceScope(const char *category, std::string_view name) {
+        if (traceEnabled)
+            start(category, name);
+    }
+    ~TraceScope() {
+        if (active)
+            end();
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    // Sets the members of the event's "args" JSON object, e.g. "\"wave\": 3";
+    // callers should only format them when _traceEnabled_ is true.
+    void SetArgs(std::string a) { args = std::move(a); }
+
+  private:
+    // TraceScope Private Methods
+    void start(const char *category, std::string_view name);
+    void end();
+
+    // TraceScope Private Members
+    bool active = false;
+    const char *category;
+    std::string name, args;
+    int64_t startMicroseconds;
+};
+
 // StatsAccumulator Definition
 class StatsAccumulator {
   public:
@@ -55,6 +279,8 @@ class StatsAccumulator {
     void ReportFloatDistribution(const char *name, double sum, int64_t count, double min,
                                  double max);
 
+    int64_t GetCounter(const std::string &name) const;
+
     void AccumulatePixelStats(const PixelStatsAccumulator &accum);
     void WritePixelImages() const;
 
@@ -9,6 +9,7 @@
 #include <pbrt/util/string.h>
 
 #include <pbrt/util/check.h>
+#include <pbrt/util/containers.h>
 #include <pbrt/util/error.h>
 
 #define UTF8PROC_STATIC
@@ -189,6 +190,28 @@ std::u16string UTF16FromUTF8(std::string str) {
     return utf16;
 }
 
+InternedString InternString(std::string_view str) {
+    // Leaked so that interned strings remain valid during static destruction
+    static InternCache<std::string> *cache = new InternCache<std::string>(Allocator{});
+    return cache->Lookup(std::string(str));
+}
+
+std::string QuoteJSONString(std::string_view str) {
+    std::string result = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", int(c));
+            result += buf;
+        } else
+            result += c;
+    }
+    return result + "\"";
+}
+
 std::string NormalizeUTF8(std::string str) {
     utf8proc_option_t options = UTF8PROC_COMPOSE;
 
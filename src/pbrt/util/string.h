@@ -38,6 +38,10 @@ std::string UTF8FromWString(std::wstring str);
 
 std::string NormalizeUTF8(std::string str);
 
+// Returns |str| as a double-quoted JSON string, with quotes, backslashes,
+// and control characters escaped.
+std::string QuoteJSONString(std::string_view str);
+
 // InternedString Definition
 class InternedString {
   public:
@@ -46,6 +50,10 @@ class InternedString {
     InternedString(const std::string *str) : str(str) {}
     operator const std::string &() const { return *str; }
 
+    // All InternedStrings come from InternString(), so equal strings share
+    // a pointer.
+    bool operator==(const InternedString &s) const { return str == s.str; }
+    bool operator!=(const InternedString &s) const { return str != s.str; }
     bool operator==(const char *s) const { return *str == s; }
     bool operator==(const std::string &s) const { return *str == s; }
     bool operator!=(const char *s) const { return *str != s; }
@@ -53,12 +61,19 @@ class InternedString {
     bool operator<(const char *s) const { return *str < s; }
     bool operator<(const std::string &s) const { return *str < s; }
 
+    bool empty() const { return str->empty(); }
+    size_t size() const { return str->size(); }
+
     std::string ToString() const { return *str; }
 
   private:
     const std::string *str = nullptr;
 };
 
+// Returns the string from pbrt's table of interned strings that is equal to
+// _str_, adding it to the table if needed; safe to call concurrently.
+InternedString InternString(std::string_view str);
+
 // InternedStringHash Definition
 struct InternedStringHash {
     size_t operator()(const InternedString &s) const {
@@ -24,3 +24,24 @@ TEST(Unicode, BasicNormalization) {
     EXPECT_EQ(nfc8, NormalizeUTF8(nfc8));  // nfc is already normalized
     EXPECT_EQ(nfc8, NormalizeUTF8(nfd8));  // normalizing nfd should make it equal nfc
 }
+
+TEST(InternedString, Basics) {
+    std::string name = "float";
+    InternedString a = InternString(name);
+    InternedString b = InternString(std::string_view("floats", 5));
+    InternedString c = InternString("integer");
+
+    EXPECT_TRUE(a == b);
+    EXPECT_EQ(&(const std::string &)a, &(const std::string &)b);
+    EXPECT_TRUE(a != c);
+    EXPECT_TRUE(a == "float");
+    EXPECT_TRUE(c == std::string("integer"));
+    EXPECT_EQ(5, a.size());
+    EXPECT_FALSE(a.empty());
+}
+
+TEST(String, QuoteJSON) {
+    EXPECT_EQ("\"abc\"", QuoteJSONString("abc"));
+    EXPECT_EQ("\"a\\\"b\\\\c\"", QuoteJSONString("a\"b\\c"));
+    EXPECT_EQ("\"a\\u000ab\"", QuoteJSONString("a\nb"));
+}
@@ -0,0 +1,86 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/util/taggedptr.h>
+
+#ifdef PBRT_RECORD_DISPATCH
+
+#include <pbrt/util/file.h>
+#include <pbrt/util/log.h>
+#include <pbrt/util/print.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace pbrt {
+
+namespace detail {
+
+// Counters of threads that are still running and the merged counts of those
+// that have exited, by type name
+static std::mutex dispatchCountersMutex;
+static std::set<DispatchCounters *> *liveDispatchCounters;
+static std::map<std::string_view, int64_t> *exitedDispatchCounts;
+
+// DispatchCounters Method Definitions
+DispatchCounters::DispatchCounters(const std::string_view *names, int nTypes)
+    : names(names), counts(nTypes, 0) {
+    std::lock_guard<std::mutex> lock(dispatchCountersMutex);
+    if (!liveDispatchCounters) {
+        liveDispatchCounters = new std::set<DispatchCounters *>;
+        exitedDispatchCounts = new std::map<std::string_view, int64_t>;
+    }
+    liveDispatchCounters->insert(this);
+}
+
+DispatchCounters::~DispatchCounters() {
+    std::lock_guard<std::mutex> lock(dispatchCountersMutex);
+    for (size_t i = 0; i < counts.size(); ++i)
+        (*exitedDispatchCounts)[names[i]] += counts[i];
+    liveDispatchCounters->erase(this);
+}
+
+}  // namespace detail
+
+bool WriteDispatchTypes(const std::string &filename) {
+    // Sum the counts for each type over all threads; a type that is used in
+    // multiple TaggedPointers is ranked by its total
+    std::map<std::string_view, int64_t> counts;
+    {
+        std::lock_guard<std::mutex> lock(detail::dispatchCountersMutex);
+        if (detail::liveDispatchCounters) {
+            counts = *detail::exitedDispatchCounts;
+            for (const detail::DispatchCounters *counters :
+                 *detail::liveDispatchCounters)
+                for (size_t i = 0; i < counters->counts.size(); ++i)
+                    counts[counters->names[i]] += counters->counts[i];
+        }
+    }
+
+    std::vector<std::pair<std::string_view, int64_t>> sorted;
+    for (const auto &count : counts)
+        if (count.second > 0)
+            sorted.push_back(count);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto &a, const auto &b) { return a.second > b.second; });
+
+    std::string contents =
+        "// Types dispatched to by pbrt's TaggedPointers, most frequent first.\n"
+        "// Written by --write-dispatch-types; use with -DPBRT_DISPATCH_TYPES_HEADER.\n";
+    for (const auto &type : sorted)
+        contents += StringPrintf("PBRT_DISPATCH_TYPE(\"%s\")  // %d\n",
+                                 std::string(type.first), type.second);
+    if (!WriteFileContents(filename, contents))
+        return false;
+    LOG_VERBOSE("Wrote %d dispatch types to %s", int(sorted.size()), filename);
+    return true;
+}
+
+}  // namespace pbrt
+
+#endif  // PBRT_RECORD_DISPATCH
@@ -12,7 +12,9 @@
 
 #include <algorithm>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <vector>
 
 namespace pbrt {
 
@@ -736,6 +738,136 @@ struct ReturnTypeConst {
     using type = typename SameType<typename std::invoke_result_t<F, const Ts *>...>::type;
 };
 
+// Returns the fully-qualified name of _T_, e.g. "pbrt::Triangle", at compile time
+template <typename T>
+constexpr std::string_view TypeName() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    std::string_view name = __FUNCSIG__;
+    name.remove_prefix(name.find("TypeName<") + 9);
+    name.remove_suffix(name.size() - name.rfind(">(void)"));
+    for (std::string_view prefix : {"class ", "struct "})
+        if (name.substr(0, prefix.size()) == prefix)
+            name.remove_prefix(prefix.size());
+#else
+    std::string_view name = __PRETTY_FUNCTION__;
+    name.remove_prefix(name.find("T = ") + 4);
+    size_t end = name.find(';');
+    if (end == std::string_view::npos)
+        end = name.rfind(']');
+    name = name.substr(0, end);
+#endif
+    return name;
+}
+
+#ifdef PBRT_DISPATCH_TYPES_HEADER
+// Type-Ranked Dispatch
+// The header, as written by pbrt's --write-dispatch-types option, lists the
+// types that were dispatched to most often when rendering a representative
+// scene, most frequent first, as PBRT_DISPATCH_TYPE("name") entries.
+#define PBRT_DISPATCH_TYPE(name) name,
+inline constexpr std::string_view dispatchTypes[] = {
+#include PBRT_DISPATCH_TYPES_HEADER
+    ""};
+#undef PBRT_DISPATCH_TYPE
+
+// Number of the most frequent types of each TaggedPointer that are tested for
+// before the full switch over its types
+static constexpr int MaxRankedDispatchTypes = 3;
+
+// Returns _T_'s position in the dispatch types list or -1 if it isn't there
+template <typename T>
+constexpr int DispatchRank() {
+    for (int i = 0; !dispatchTypes[i].empty(); ++i)
+        if (dispatchTypes[i] == TypeName<T>())
+            return i;
+    return -1;
+}
+
+// Returns the index in _Ts_ of the type with the _order_th lowest rank, or -1
+template <typename... Ts>
+constexpr int RankedTypeIndex(int order) {
+    constexpr int ranks[] = {DispatchRank<Ts>()...};
+    for (int i = 0; i < int(sizeof...(Ts)); ++i) {
+        if (ranks[i] < 0)
+            continue;
+        int nHigher = 0;
+        for (int j = 0; j < int(sizeof...(Ts)); ++j)
+            nHigher += (ranks[j] >= 0 && ranks[j] < ranks[i]);
+        if (nHigher == order)
+            return i;
+    }
+    return -1;
+}
+
+template <int index, typename... Ts>
+using TypeAt =
+    typename GetFirst<typename RemoveFirstN<index, TypePack<Ts...>>::type>::type;
+
+// The full switch is kept out of line so that the ranked tests are all that
+// is inlined at the call site
+template <typename F, typename R, typename... Ts>
+PBRT_CPU_GPU PBRT_NOINLINE R DispatchUnranked(F &&func, const void *ptr, int index) {
+    return Dispatch<F, R, Ts...>(func, ptr, index);
+}
+
+template <typename F, typename R, typename... Ts>
+PBRT_CPU_GPU PBRT_NOINLINE R DispatchUnranked(F &&func, void *ptr, int index) {
+    return Dispatch<F, R, Ts...>(func, ptr, index);
+}
+
+template <typename F, typename R, int Order, typename... Ts>
+PBRT_CPU_GPU inline R DispatchRanked(F &&func, const void *ptr, int index) {
+    constexpr int i = RankedTypeIndex<Ts...>(Order);
+    if constexpr (i < 0 || Order == MaxRankedDispatchTypes)
+        return DispatchUnranked<F, R, Ts...>(func, ptr, index);
+    else {
+        if (index == i)
+            return func((const TypeAt<i, Ts...> *)ptr);
+        return DispatchRanked<F, R, Order + 1, Ts...>(func, ptr, index);
+    }
+}
+
+template <typename F, typename R, int Order, typename... Ts>
+PBRT_CPU_GPU inline R DispatchRanked(F &&func, void *ptr, int index) {
+    constexpr int i = RankedTypeIndex<Ts...>(Order);
+    if constexpr (i < 0 || Order == MaxRankedDispatchTypes)
+        return DispatchUnranked<F, R, Ts...>(func, ptr, index);
+    else {
+        if (index == i)
+            return func((TypeAt<i, Ts...> *)ptr);
+        return DispatchRanked<F, R, Order + 1, Ts...>(func, ptr, index);
+    }
+}
+#endif  // PBRT_DISPATCH_TYPES_HEADER
+
+#ifdef PBRT_RECORD_DISPATCH
+// DispatchCounters Definition
+// Per-thread counts of how often each of a TaggedPointer's types has been
+// dispatched to; counters register themselves so that
+// _WriteDispatchTypes()_ can sum them and merge their counts when their
+// thread exits.
+class DispatchCounters {
+  public:
+    DispatchCounters(const std::string_view *names, int nTypes);
+    ~DispatchCounters();
+
+    DispatchCounters(const DispatchCounters &) = delete;
+    DispatchCounters &operator=(const DispatchCounters &) = delete;
+
+    void Increment(int index) { ++counts[index]; }
+
+    const std::string_view *names;
+    std::vector<int64_t> counts;
+};
+
+template <typename... Ts>
+inline void RecordDispatch(int index) {
+    static constexpr std::string_view names[] = {TypeName<Ts>()...};
+    thread_local DispatchCounters counters(names, sizeof...(Ts));
+    counters.Increment(index);
+}
+#endif  // PBRT_RECORD_DISPATCH
+
 }  // namespace detail
 
 /*
@@ -857,14 +989,28 @@ class TaggedPointer {
     PBRT_CPU_GPU decltype(auto) Dispatch(F &&func) {
         DCHECK(ptr());
         using R = typename detail::ReturnType<F, Ts...>::type;
+#if defined(PBRT_RECORD_DISPATCH) && !defined(PBRT_IS_GPU_CODE)
+        detail::RecordDispatch<Ts...>(Tag() - 1);
+#endif
+#ifdef PBRT_DISPATCH_TYPES_HEADER
+        return detail::DispatchRanked<F, R, 0, Ts...>(func, ptr(), Tag() - 1);
+#else
         return detail::Dispatch<F, R, Ts...>(func, ptr(), Tag() - 1);
+#endif
     }
 
     template <typename F>
     PBRT_CPU_GPU decltype(auto) Dispatch(F &&func) const {
         DCHECK(ptr());
         using R = typename detail::ReturnType<F, Ts...>::type;
+#if defined(PBRT_RECORD_DISPATCH) && !defined(PBRT_IS_GPU_CODE)
+        detail::RecordDispatch<Ts...>(Tag() - 1);
+#endif
+#ifdef PBRT_DISPATCH_TYPES_HEADER
+        return detail::DispatchRanked<F, R, 0, Ts...>(func, ptr(), Tag() - 1);
+#else
         return detail::Dispatch<F, R, Ts...>(func, ptr(), Tag() - 1);
+#endif
     }
 
     template <typename F>
@@ -898,6 +1044,12 @@ class TaggedPointer {
     uint64_t bits = 0;
 };
 
+#ifdef PBRT_RECORD_DISPATCH
+// Writes the types dispatched to so far, most frequent first, in the form
+// expected by a build's PBRT_DISPATCH_TYPES_HEADER
+bool WriteDispatchTypes(const std::string &filename);
+#endif  // PBRT_RECORD_DISPATCH
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_TAGGEDPTR_H
@@ -269,3 +269,9 @@ TEST(TaggedPointer, Dispatch) {
     ASSERT_EQ(15, it15.cfunc());
     EXPECT_EQ(15, h15.cfunc());
 }
+
+TEST(TaggedPointer, TypeName) {
+    EXPECT_EQ("IntType<3>", detail::TypeName<IntType<3>>());
+    EXPECT_EQ("pbrt::TaggedPointer<int, float>",
+              (detail::TypeName<TaggedPointer<int, float>>()));
+}
@@ -141,9 +141,25 @@ SquareMatrix<4> persp(1, 0,           0,              0,
 
 // Transform Method Definitions
 PBRT_CPU_GPU Bounds3f Transform::operator()(const Bounds3f &b) const {
+    // Transform bounds corners individually for projective transformations
+    if (m[3][0] != 0 || m[3][1] != 0 || m[3][2] != 0 || m[3][3] != 1 ||
+        b.IsDegenerate()) {
+        Bounds3f bt;
+        for (int i = 0; i < 8; ++i)
+            bt = Union(bt, (*this)(b.Corner(i)));
+        return bt;
+    }
+
+    // Transform affine bounds by summing per-axis extents (Arvo 1990)
     Bounds3f bt;
-    for (int i = 0; i < 8; ++i)
-        bt = Union(bt, (*this)(b.Corner(i)));
+    for (int i = 0; i < 3; ++i) {
+        bt.pMin[i] = bt.pMax[i] = m[i][3];
+        for (int j = 0; j < 3; ++j) {
+            Float e0 = m[i][j] * b.pMin[j], e1 = m[i][j] * b.pMax[j];
+            bt.pMin[i] += std::min(e0, e1);
+            bt.pMax[i] += std::max(e0, e1);
+        }
+    }
     return bt;
 }
 
@@ -380,6 +396,39 @@ std::string Transform::ToString() const {
     return StringPrintf("[ m: %s mInv: %s ]", m, mInv);
 }
 
+// AnimatedTransform Helper Functions
+PBRT_CPU_GPU static SquareMatrix<3> RotationMatrix(Quaternion q) {
+    Float xx = q.v.x * q.v.x, yy = q.v.y * q.v.y, zz = q.v.z * q.v.z;
+    Float xy = q.v.x * q.v.y, xz = q.v.x * q.v.z, yz = q.v.y * q.v.z;
+    Float wx = q.v.x * q.w, wy = q.v.y * q.w, wz = q.v.z * q.w;
+    // Matches the _m_ member set by _Transform(Quaternion)_
+    return SquareMatrix<3>(1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy),
+                           2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx),
+                           2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy));
+}
+
+PBRT_CPU_GPU static SquareMatrix<3> UpperLeft3x3(const SquareMatrix<4> &m) {
+    return SquareMatrix<3>(m[0][0], m[0][1], m[0][2], m[1][0], m[1][1], m[1][2], m[2][0],
+                           m[2][1], m[2][2]);
+}
+
+// Returns the affine transformation with linear part _A_ followed by translation _t_
+// given _A_'s inverse, without any 4x4 matrix products or inversions.
+PBRT_CPU_GPU static Transform AffineTransform(const SquareMatrix<3> &A,
+                                              const SquareMatrix<3> &AInv, Vector3f t) {
+    SquareMatrix<4> m, mInv;
+    Vector3f tInv = -Mul<Vector3f>(AInv, t);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            m[i][j] = A[i][j];
+            mInv[i][j] = AInv[i][j];
+        }
+        m[i][3] = t[i];
+        mInv[i][3] = tInv[i];
+    }
+    return Transform(m, mInv);
+}
+
 // AnimatedTransform Method Definitions
 AnimatedTransform::AnimatedTransform(const Transform &startTransform, Float startTime,
                                      const Transform &endTransform, Float endTime)
@@ -401,6 +450,18 @@ AnimatedTransform::AnimatedTransform(const Transform &startTransform, Float star
         R[1] = -R[1];
 
     hasRotation = Dot(R[0], R[1]) < 0.9995f;
+    // Cache rotation and scale factors used by _Interpolate()_
+    rotationAnimated = R[0].v != R[1].v || R[0].w != R[1].w;
+    scaleAnimated = S[0] != S[1];
+    startRotation = RotationMatrix(R[0]);
+    pstd::optional<SquareMatrix<3>> scaleInv = Inverse(UpperLeft3x3(S[0]));
+    if (scaleInv)
+        startScaleInv = *scaleInv;
+    else
+        scaleAnimated = true;
+    startRS = startRotation * UpperLeft3x3(S[0]);
+    startRSInv = startScaleInv * Transpose(startRotation);
+
     // Compute terms of motion derivative function
     if (hasRotation) {
         Float cosTheta = Dot(R[0], R[1]);
@@ -1079,42 +1140,69 @@ PBRT_CPU_GPU Transform AnimatedTransform::Interpolate(Float time) const {
     // Interpolate translation at _dt_
     Vector3f trans = (1 - dt) * T[0] + dt * T[1];
 
-    // Interpolate rotation at _dt_
-    Quaternion rotate = Slerp(dt, R[0], R[1]);
+    // Handle translation-only motion using cached rotation and scale
+    if (!rotationAnimated && !scaleAnimated)
+        return AffineTransform(startRS, startRSInv, trans);
 
-    // Interpolate scale at _dt_
-    SquareMatrix<4> scale = (1 - dt) * S[0] + dt * S[1];
+    // Interpolate rotation at _dt_
+    SquareMatrix<3> rotate =
+        rotationAnimated ? RotationMatrix(Slerp(dt, R[0], R[1])) : startRotation;
+
+    // Interpolate scale at _dt_ and compute its inverse
+    SquareMatrix<3> scale = UpperLeft3x3(S[0]), scaleInv = startScaleInv;
+    if (scaleAnimated) {
+        scale = UpperLeft3x3((1 - dt) * S[0] + dt * S[1]);
+        pstd::optional<SquareMatrix<3>> inv = Inverse(scale);
+        if (!inv) {
+            // Return product of interpolated components for singular scale
+            SquareMatrix<4> scale4 = (1 - dt) * S[0] + dt * S[1];
+            return Translate(trans) * Transform(Slerp(dt, R[0], R[1])) *
+                   Transform(scale4);
+        }
+        scaleInv = *inv;
+    }
 
     // Return interpolated matrix as product of interpolated components
-    return Translate(trans) * Transform(rotate) * Transform(scale);
+    return AffineTransform(rotate * scale, scaleInv * Transpose(rotate), trans);
 }
 
-PBRT_CPU_GPU Bounds3f AnimatedTransform::MotionBounds(const Bounds3f &b) const {
+PBRT_CPU_GPU Bounds3f AnimatedTransform::MotionBounds(const Bounds3f &b, Float time0,
+                                                      Float time1) const {
     // Handle easy cases for _Bounds3f_ motion bounds
     if (!actuallyAnimated)
         return startTransform(b);
+    time0 = Clamp(time0, startTime, endTime);
+    time1 = Clamp(time1, startTime, endTime);
     if (!hasRotation)
-        return Union(startTransform(b), endTransform(b));
+        return Union(Interpolate(time0)(b), Interpolate(time1)(b));
 
     // Return motion bounds accounting for animated rotation
     Bounds3f bounds;
     for (int corner = 0; corner < 8; ++corner)
-        bounds = Union(bounds, BoundPointMotion(b.Corner(corner)));
+        bounds = Union(bounds, BoundPointMotion(b.Corner(corner), time0, time1));
     return bounds;
 }
 
-PBRT_CPU_GPU Bounds3f AnimatedTransform::BoundPointMotion(Point3f p) const {
+PBRT_CPU_GPU Bounds3f AnimatedTransform::BoundPointMotion(Point3f p, Float time0,
+                                                          Float time1) const {
     if (!actuallyAnimated)
         return Bounds3f(startTransform(p));
-    Bounds3f bounds(startTransform(p), endTransform(p));
+    time0 = Clamp(time0, startTime, endTime);
+    time1 = Clamp(time1, startTime, endTime);
+    Bounds3f bounds((*this)(p, time0), (*this)(p, time1));
     Float cosTheta = Dot(R[0], R[1]);
     Float theta = SafeACos(cosTheta);
+    // Motion derivative terms are parameterized over $[0,1]$ for the full time range
+    Interval tInterval(0., 1.);
+    if (endTime > startTime)
+        tInterval = Interval((time0 - startTime) / (endTime - startTime),
+                             (time1 - startTime) / (endTime - startTime));
     for (int c = 0; c < 3; ++c) {
         // Find any motion derivative zeros for the component _c_
         Float zeros[8];
         int nZeros = 0;
         FindZeros(c1[c].Eval(p), c2[c].Eval(p), c3[c].Eval(p), c4[c].Eval(p),
-                  c5[c].Eval(p), theta, Interval(0., 1.), zeros, &nZeros);
+                  c5[c].Eval(p), theta, tInterval, zeros, &nZeros);
         CHECK_LE(nZeros, PBRT_ARRAYSIZE(zeros));
 
         // Expand bounding box for any motion derivative zeros found
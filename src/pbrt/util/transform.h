@@ -246,7 +246,9 @@ PBRT_CPU_GPU inline Transform Rotate(Float theta, Vector3f axis) {
     return Rotate(sinTheta, cosTheta, axis);
 }
 
-PBRT_CPU_GPU inline Transform RotateFromTo(Vector3f from, Vector3f to) {
+// Returns the rotation matrix of _RotateFromTo()_, for callers that only
+// transform directions and can avoid building a _Transform_
+PBRT_CPU_GPU inline SquareMatrix<3> RotateFromToMatrix(Vector3f from, Vector3f to) {
     // Compute intermediate vector for vector reflection
     Vector3f refl;
     if (std::abs(from.x) < 0.72f && std::abs(to.x) < 0.72f)
@@ -258,14 +260,22 @@ PBRT_CPU_GPU inline Transform RotateFromTo(Vector3f from, Vector3f to) {
 
     // Initialize matrix _r_ for rotation
     Vector3f u = refl - from, v = refl - to;
-    SquareMatrix<4> r;
+    SquareMatrix<3> r;
     for (int i = 0; i < 3; ++i)
         for (int j = 0; j < 3; ++j)
             // Initialize matrix element _r[i][j]_
             r[i][j] = ((i == j) ? 1 : 0) - 2 / Dot(u, u) * u[i] * u[j] -
                       2 / Dot(v, v) * v[i] * v[j] +
                       4 * Dot(u, v) / (Dot(u, u) * Dot(v, v)) * v[i] * u[j];
+    return r;
+}
 
+PBRT_CPU_GPU inline Transform RotateFromTo(Vector3f from, Vector3f to) {
+    SquareMatrix<3> r3 = RotateFromToMatrix(from, to);
+    SquareMatrix<4> r;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            r[i][j] = r3[i][j];
     return Transform(r, Transpose(r));
 }
 
@@ -501,10 +511,20 @@ class AnimatedTransform {
     Vector3f operator()(Vector3f v, Float time) const;
 
     PBRT_CPU_GPU
-    Bounds3f MotionBounds(const Bounds3f &b) const;
+    Bounds3f MotionBounds(const Bounds3f &b) const {
+        return MotionBounds(b, startTime, endTime);
+    }
+    // Bounds the motion of _b_ between _time0_ and _time1_, which are clamped to
+    // the transformation's time range.
+    PBRT_CPU_GPU
+    Bounds3f MotionBounds(const Bounds3f &b, Float time0, Float time1) const;
 
     PBRT_CPU_GPU
-    Bounds3f BoundPointMotion(Point3f p) const;
+    Bounds3f BoundPointMotion(Point3f p) const {
+        return BoundPointMotion(p, startTime, endTime);
+    }
+    PBRT_CPU_GPU
+    Bounds3f BoundPointMotion(Point3f p, Float time0, Float time1) const;
 
     // AnimatedTransform Public Members
     Transform startTransform, endTransform;
@@ -523,6 +543,9 @@ class AnimatedTransform {
     Quaternion R[2];
     SquareMatrix<4> S[2];
     bool hasRotation;
+    // Cached factors for _Interpolate()_
+    bool rotationAnimated, scaleAnimated;
+    SquareMatrix<3> startRotation, startScaleInv, startRS, startRSInv;
     struct DerivativeTerm {
         PBRT_CPU_GPU
         DerivativeTerm() {}
@@ -71,6 +71,80 @@ TEST(AnimatedTransform, Randoms) {
     }
 }
 
+TEST(AnimatedTransform, InterpolateInverse) {
+    RNG rng;
+    for (int i = 0; i < 200; ++i) {
+        // Check that the interpolated inverse matches the interpolated matrix
+        // for general motion, rotation-only, and scale-only animation.
+        Transform t0 = RandomTransform(rng);
+        Transform t1;
+        switch (i % 3) {
+        case 0:
+            t1 = RandomTransform(rng);
+            break;
+        case 1:
+            t1 = t0 * Rotate(90 * rng.Uniform<Float>(), Vector3f(0, 0, 1));
+            break;
+        case 2:
+            t1 = t0 * Scale(1 + rng.Uniform<Float>(), 1, 2);
+            break;
+        }
+        AnimatedTransform at(t0, 0., t1, 1.);
+
+        for (Float t = 0.; t <= 1.; t += 0.1f) {
+            Transform tr = at.Interpolate(t);
+            SquareMatrix<4> m = tr.GetMatrix() * tr.GetInverseMatrix();
+            for (int r = 0; r < 4; ++r)
+                for (int c = 0; c < 4; ++c)
+                    EXPECT_NEAR(m[r][c], r == c ? 1 : 0, 1e-3f) << t;
+        }
+    }
+}
+
+TEST(AnimatedTransform, InterpolateTranslation) {
+    RNG rng;
+    auto r = [&rng]() { return -10. + 20. * rng.Uniform<Float>(); };
+
+    for (int i = 0; i < 100; ++i) {
+        // With only translation changing, interpolated points should move
+        // along the line between their start and end positions.
+        Transform t0 = RandomTransform(rng);
+        Transform t1 = Translate(Vector3f(r(), r(), r())) * t0;
+        AnimatedTransform at(t0, 0., t1, 1.);
+
+        Point3f p(r(), r(), r());
+        for (Float t = 0.; t <= 1.; t += 0.1f) {
+            Point3f pt = at.Interpolate(t)(p);
+            Point3f expected = (1 - t) * t0(p) + t * t1(p);
+            Float tol = 1e-3f * std::max<Float>(1, Distance(t0(p), Point3f(0, 0, 0)));
+            EXPECT_LT(Distance(pt, expected), tol) << pt << " vs " << expected;
+        }
+    }
+}
+
+TEST(Transform, AffineBounds) {
+    RNG rng;
+    auto r = [&rng]() { return -10. + 20. * rng.Uniform<Float>(); };
+
+    for (int i = 0; i < 200; ++i) {
+        // Compare the transformed bounds to the bounds of the transformed corners.
+        Transform t = RandomTransform(rng);
+        Bounds3f b(Point3f(r(), r(), r()), Point3f(r(), r(), r()));
+        Bounds3f tb = t(b);
+
+        Bounds3f cornerBounds;
+        for (int c = 0; c < 8; ++c)
+            cornerBounds = Union(cornerBounds, t(b.Corner(c)));
+
+        Float tol = 1e-4f * std::max<Float>({1, Length(Vector3f(cornerBounds.pMin)),
+                                             Length(Vector3f(cornerBounds.pMax))});
+        for (int c = 0; c < 3; ++c) {
+            EXPECT_NEAR(tb.pMin[c], cornerBounds.pMin[c], tol);
+            EXPECT_NEAR(tb.pMax[c], cornerBounds.pMax[c], tol);
+        }
+    }
+}
+
 TEST(RotateFromTo, Simple) {
     {
         // Same directions...
@@ -59,6 +59,12 @@ PBRT_CPU_GPU DirectionCone Union(const DirectionCone &a, const DirectionCone &b)
         return b;
     if (b.IsEmpty())
         return a;
+    // Handle the cases where one cone covers the entire sphere without
+    // computing its angle
+    if (a.cosTheta == -1)
+        return a;
+    if (b.cosTheta == -1)
+        return b;
 
     // Handle the cases where one cone is inside the other
     Float theta_a = SafeACos(a.cosTheta), theta_b = SafeACos(b.cosTheta);
@@ -13,23 +13,58 @@
 #include <pbrt/util/file.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/mesh.h>
+#include <pbrt/util/math.h>
 #include <pbrt/util/parallel.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/stats.h>
 #include <pbrt/wavefront/intersect.h>
 
+#include <algorithm>
+
 namespace pbrt {
 
+STAT_COUNTER("Wavefront/Rays sorted", raysSorted);
+STAT_COUNTER("Wavefront/Ray sorting time (us)", raySortTimeUS);
+STAT_COUNTER("Wavefront/Closest-hit tracing time (us)", closestHitTimeUS);
+
 CPUAggregate::CPUAggregate(
     BasicScene &scene, NamedTextures &textures,
     const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
     const std::map<std::string, Medium> &media,
     const std::map<std::string, pbrt::Material> &namedMaterials,
-    const std::vector<pbrt::Material> &materials) {
+    const std::vector<pbrt::Material> &materials, bool sortRays)
+    : sortRays(sortRays) {
     aggregate = scene.CreateAggregate(textures, shapeIndexToAreaLights, media,
                                       namedMaterials, materials);
 }
 
+std::vector<int> CPUAggregate::sortedRayOrder(const RayQueue *rayQueue) const {
+    // Compute sort keys from ray direction octants and origin Morton codes
+    int nRays = rayQueue->Size();
+    Bounds3f bounds = Bounds();
+    constexpr int mortonBits = 10, mortonScale = 1 << mortonBits;
+    std::vector<uint64_t> keys(nRays);
+    ParallelFor(0, nRays, [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i) {
+            Ray ray = rayQueue->ray[i];
+            Vector3f offset = bounds.Offset(ray.o);
+            uint32_t morton = EncodeMorton3(
+                Clamp(offset.x * mortonScale, 0, mortonScale - 1),
+                Clamp(offset.y * mortonScale, 0, mortonScale - 1),
+                Clamp(offset.z * mortonScale, 0, mortonScale - 1));
+            uint32_t octant =
+                int(ray.d.x < 0) | (int(ray.d.y < 0) << 1) | (int(ray.d.z < 0) << 2);
+            // Store the key in the upper bits and the ray's index in the lower 32
+            uint64_t key = (octant << (3 * mortonBits)) | morton;
+            keys[i] = (key << 32) | uint64_t(i);
+        }
+    });
+
+    // Radix sort keys, which have $3 \cdot \roman{mortonBits} + 3$ significant bits
+    return RadixSortedOrder(std::move(keys), 3 * mortonBits + 3);
+}
+
 // CPUAggregate Method Definitions
 void CPUAggregate::IntersectClosest(int maxRays, const RayQueue *rayQueue,
                                     EscapedRayQueue *escapedRayQueue,
@@ -39,8 +74,52 @@ void CPUAggregate::IntersectClosest(int maxRays, const RayQueue *rayQueue,
                                     MediumSampleQueue *mediumSampleQueue,
                                     RayQueue *nextRayQueue) const {
     // _CPUAggregate::IntersectClosest()_ method implementation
+    // Optionally sort rays so that nearby rays with similar directions are
+    // traced together
+    std::vector<int> order;
+    if (sortRays && aggregate) {
+        Timer timer;
+        order = sortedRayOrder(rayQueue);
+        raySortTimeUS += int64_t(1e6 * timer.ElapsedSeconds());
+        raysSorted += order.size();
+    }
+    const int *rayOrder = order.empty() ? nullptr : order.data();
+    Timer timer;
+
+    if (const BVHAggregate *bvh = aggregate.CastOrNullptr<BVHAggregate>()) {
+        // Trace consecutive rays from _rayQueue_ as packets through the BVH
+        constexpr int packetSize = BVHAggregate::MaxPacketSize;
+        int nRays = rayQueue->Size();
+        ParallelFor(0, (nRays + packetSize - 1) / packetSize, [=](int packetIndex) {
+            int start = packetIndex * packetSize;
+            int n = std::min(packetSize, nRays - start);
+            RayWorkItem items[packetSize];
+            Ray rays[packetSize];
+            Float tMax[packetSize];
+            pstd::optional<ShapeIntersection> si[packetSize];
+            for (int i = 0; i < n; ++i) {
+                items[i] = (*rayQueue)[rayOrder ? rayOrder[start + i] : (start + i)];
+                rays[i] = items[i].ray;
+                tMax[i] = Infinity;
+            }
+            bvh->IntersectPacket(n, rays, tMax, si);
+
+            for (int i = 0; i < n; ++i) {
+                if (!si[i])
+                    EnqueueWorkAfterMiss(items[i], mediumSampleQueue, escapedRayQueue);
+                else
+                    EnqueueWorkAfterIntersection(
+                        items[i], items[i].ray.medium, si[i]->tHit, si[i]->intr,
+                        mediumSampleQueue, nextRayQueue, hitAreaLightQueue,
+                        basicEvalMaterialQueue, universalEvalMaterialQueue);
+            }
+        });
+        closestHitTimeUS += int64_t(1e6 * timer.ElapsedSeconds());
+        return;
+    }
+
     ParallelFor(0, rayQueue->Size(), [=](int index) {
-        const RayWorkItem r = (*rayQueue)[index];
+        const RayWorkItem r = (*rayQueue)[rayOrder ? rayOrder[index] : index];
         // Intersect _r_'s ray with the scene and enqueue resulting work
         if (!aggregate) {
             EnqueueWorkAfterMiss(r, mediumSampleQueue, escapedRayQueue);
@@ -55,11 +134,34 @@ void CPUAggregate::IntersectClosest(int maxRays, const RayQueue *rayQueue,
                 r, r.ray.medium, si->tHit, si->intr, mediumSampleQueue, nextRayQueue,
                 hitAreaLightQueue, basicEvalMaterialQueue, universalEvalMaterialQueue);
     });
+    closestHitTimeUS += int64_t(1e6 * timer.ElapsedSeconds());
 }
 
 void CPUAggregate::IntersectShadow(int maxRays, ShadowRayQueue *shadowRayQueue,
                                    SOA<PixelSampleState> *pixelSampleState) const {
     // Intersect shadow rays from _shadowRayQueue_ in parallel
+    if (const BVHAggregate *bvh = aggregate.CastOrNullptr<BVHAggregate>()) {
+        constexpr int packetSize = BVHAggregate::MaxPacketSize;
+        int nRays = shadowRayQueue->Size();
+        ParallelFor(0, (nRays + packetSize - 1) / packetSize, [=](int packetIndex) {
+            int start = packetIndex * packetSize;
+            int n = std::min(packetSize, nRays - start);
+            ShadowRayWorkItem items[packetSize];
+            Ray rays[packetSize];
+            Float tMax[packetSize];
+            bool hit[packetSize];
+            for (int i = 0; i < n; ++i) {
+                items[i] = (*shadowRayQueue)[start + i];
+                rays[i] = items[i].ray;
+                tMax[i] = items[i].tMax;
+            }
+            bvh->IntersectPPacket(n, rays, tMax, hit);
+            for (int i = 0; i < n; ++i)
+                RecordShadowRayResult(items[i], pixelSampleState, hit[i]);
+        });
+        return;
+    }
+
     ParallelFor(0, shadowRayQueue->Size(), [=](int index) {
         const ShadowRayWorkItem w = (*shadowRayQueue)[index];
         bool hit = aggregate.IntersectP(w.ray, w.tMax);
@@ -93,7 +195,7 @@ void CPUAggregate::IntersectOneRandom(
         const SubsurfaceScatterWorkItem &w = (*subsurfaceScatterQueue)[index];
         uint64_t seed = Hash(w.p0, w.p1);
 
-        WeightedReservoirSampler<SubsurfaceInteraction> wrs(seed);
+        WeightedReservoirSampler<SubsurfaceInteraction, BatchRNG> wrs(seed);
         Interaction base(w.p0, 0.f /* FIXME time */, Medium());
         while (true) {
             Ray r = base.SpawnRayTo(w.p1);
@@ -19,6 +19,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 namespace pbrt {
 
@@ -28,7 +29,7 @@ class CPUAggregate : public WavefrontAggregate {
                  const std::map<int, pstd::vector<Light> *> &shapeIndexToAreaLights,
                  const std::map<std::string, Medium> &media,
                  const std::map<std::string, pbrt::Material> &namedMaterials,
-                 const std::vector<pbrt::Material> &materials);
+                 const std::vector<pbrt::Material> &materials, bool sortRays = false);
 
     Bounds3f Bounds() const { return aggregate ? aggregate.Bounds() : Bounds3f(); }
 
@@ -50,7 +51,12 @@ class CPUAggregate : public WavefrontAggregate {
                             SubsurfaceScatterQueue *subsurfaceScatterQueue) const;
 
   private:
+    // CPUAggregate Private Methods
+    std::vector<int> sortedRayOrder(const RayQueue *rayQueue) const;
+
+    // CPUAggregate Private Members
     Primitive aggregate;
+    bool sortRays;
 };
 
 }  // namespace pbrt
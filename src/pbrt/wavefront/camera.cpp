@@ -15,45 +15,59 @@
 namespace pbrt {
 
 // WavefrontPathIntegrator Camera Ray Methods
-void WavefrontPathIntegrator::GenerateCameraRays(int y0, Transform movingFromCamera,
+void WavefrontPathIntegrator::GenerateCameraRays(int y0, Bounds2i sampleBounds,
+                                                 int stride, Transform movingFromCamera,
                                                  int sampleIndex) {
     // Define _generateRays_ lambda function
     auto generateRays = [=](auto sampler) {
         using ConcreteSampler = std::remove_reference_t<decltype(*sampler)>;
         if constexpr (!std::is_same_v<ConcreteSampler, MLTSampler> &&
                       !std::is_same_v<ConcreteSampler, DebugMLTSampler>)
-            GenerateCameraRays<ConcreteSampler>(y0, movingFromCamera, sampleIndex);
+            GenerateCameraRays<ConcreteSampler>(y0, sampleBounds, stride,
+                                                movingFromCamera, sampleIndex);
     };
 
     sampler.DispatchCPU(generateRays);
 }
 
 template <typename ConcreteSampler>
-void WavefrontPathIntegrator::GenerateCameraRays(int y0, Transform movingFromCamera,
+void WavefrontPathIntegrator::GenerateCameraRays(int y0, Bounds2i sampleBounds,
+                                                 int stride, Transform movingFromCamera,
                                                  int sampleIndex) {
     RayQueue *rayQueue = CurrentRayQueue(0);
     ParallelFor(
         "Generate camera rays", maxQueueSize, PBRT_CPU_GPU_LAMBDA(int pixelIndex) {
             // Enqueue camera ray and set pixel state for sample
             // Compute pixel coordinates for _pixelIndex_
-            Bounds2i pixelBounds = film.PixelBounds();
-            int xResolution = pixelBounds.pMax.x - pixelBounds.pMin.x;
-            Point2i pPixel(pixelBounds.pMin.x + pixelIndex % xResolution,
-                           y0 + pixelIndex / xResolution);
-            pixelSampleState.pPixel[pixelIndex] = pPixel;
+            int xResolution =
+                (sampleBounds.pMax.x - sampleBounds.pMin.x + stride - 1) / stride;
+            Vector2i offset(pixelIndex % xResolution, y0 + pixelIndex / xResolution);
+            Point2i pPixel = sampleBounds.pMin + stride * offset;
 
-            // Test pixel coordinates against pixel bounds
-            if (!InsideExclusive(pPixel, pixelBounds))
+            // Test pixel coordinates against pixel bounds, also skipping the
+            // start of the next pass's first row if the queue only holds a
+            // partial one; skipped pixels are given a location outside of
+            // the film so that UpdateFilm() ignores them
+            int rowsPerPass = std::max(1, maxQueueSize / xResolution);
+            if (pixelIndex >= rowsPerPass * xResolution ||
+                !InsideExclusive(pPixel, sampleBounds)) {
+                pixelSampleState.pPixel[pixelIndex] = film.PixelBounds().pMax;
                 return;
+            }
+            pixelSampleState.pPixel[pixelIndex] = pPixel;
 
             // Initialize _Sampler_ for current pixel and sample
             ConcreteSampler pixelSampler = *sampler.Cast<ConcreteSampler>();
             pixelSampler.StartPixelSample(pPixel, sampleIndex, 0);
 
             // Sample wavelengths for ray path
+            // All of an iteration's paths with the "sppm" integrator use the
+            // same wavelengths, which its photons use as well
             Float lu = pixelSampler.Get1D();
             if (GetOptions().disableWavelengthJitter)
                 lu = 0.5f;
+            else if (sppmPixels)
+                lu = RadicalInverse(1, sampleIndex);
             SampledWavelengths lambda = film.SampleWavelengths(lu);
 
             // Generate _CameraSample_ and corresponding ray
@@ -68,7 +82,7 @@ void WavefrontPathIntegrator::GenerateCameraRays(int y0, Transform movingFromCam
             pixelSampleState.lambda[pixelIndex] = lambda;
             pixelSampleState.filterWeight[pixelIndex] = cameraSample.filterWeight;
             if (initializeVisibleSurface)
-                pixelSampleState.visibleSurface[pixelIndex] = VisibleSurface();
+                visibleSurfaces[pixelIndex] = VisibleSurface();
 
             // Enqueue camera ray for intersection tests
             if (cameraRay) {
@@ -29,8 +29,7 @@ void WavefrontPathIntegrator::UpdateFilm() {
             Float filterWeight = pixelSampleState.filterWeight[pixelIndex];
             if (initializeVisibleSurface) {
                 // Call _Film::AddSample()_ with _VisibleSurface_ for pixel sample
-                VisibleSurface visibleSurface =
-                    pixelSampleState.visibleSurface[pixelIndex];
+                VisibleSurface visibleSurface = visibleSurfaces[pixelIndex];
                 film.AddSample(pPixel, Lw, lambda, &visibleSurface, filterWeight);
 
             } else
@@ -10,10 +10,13 @@
 #include <pbrt/filters.h>
 #ifdef PBRT_BUILD_GPU_RENDERER
 #include <pbrt/gpu/optix/aggregate.h>
+#include <pbrt/gpu/optix/denoiser.h>
 #include <pbrt/gpu/memory.h>
 #endif  // PBRT_BUILD_GPU_RENDERER
 #include <pbrt/lights.h>
 #include <pbrt/lightsamplers.h>
+#include <pbrt/parser.h>
+#include <pbrt/scene.h>
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/display.h>
@@ -31,9 +34,14 @@
 #include <pbrt/wavefront/aggregate.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
 #ifdef PBRT_BUILD_GPU_RENDERER
 #include <cuda.h>
@@ -43,6 +51,9 @@
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/Wavefront integrator pixel state", pathIntegratorBytes);
+STAT_COUNTER("Wavefront/Display images denoised", nDisplayImagesDenoised);
+STAT_COUNTER("Wavefront/Display updates skipped while copying or denoising",
+             nDisplayUpdatesSkipped);
 
 static void updateMaterialNeeds(
     Material m, pstd::array<bool, Material::NumTags()> *haveBasicEvalMaterial,
@@ -77,9 +88,44 @@ static void updateMaterialNeeds(
         (*haveUniversalEvalMaterial)[m.Tag()] = true;
 }
 
+#ifdef PBRT_BUILD_GPU_RENDERER
+// WavefrontPathIntegrator::DisplayReadback Definition
+// State shared with the thread that copies |displayRGB| back to the host
+// for the display server. Each update of |displayRGB| records |readyEvent|
+// and signals the copy thread, which copies into the host buffer that
+// isn't currently being displayed and then makes it the front buffer.
+struct WavefrontPathIntegrator::DisplayReadback {
+    // Pinned host memory, so that the copies are DMA transfers
+    RGB *host[2] = {nullptr, nullptr};
+    std::atomic<int> front{0};
+    // Set when an update is signaled and cleared once it has been copied;
+    // further updates are skipped in the meantime so that |displayRGB|
+    // isn't overwritten while it's being read.
+    std::atomic<bool> copyPending{false};
+    cudaEvent_t readyEvent;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int64_t updates = 0;
+    bool exit = false;
+};
+#endif  // PBRT_BUILD_GPU_RENDERER
+
+// WavefrontPathIntegrator::ReloadState Definition
+struct WavefrontPathIntegrator::ReloadState {
+    std::vector<std::string> sceneFilenames;
+    std::map<std::string, int64_t> fileTimes;
+    std::map<std::string, Material> namedMaterials;
+    std::vector<Material> materials;
+    std::vector<Light> lights;
+    std::string lightSamplerName;
+    Timer timer;
+    double lastCheckTime = 0;
+};
+
 WavefrontPathIntegrator::WavefrontPathIntegrator(
     pstd::pmr::memory_resource *memoryResource, BasicScene &scene)
-    : memoryResource(memoryResource), exitCopyThread(new std::atomic<bool>(false)) {
+    : memoryResource(memoryResource) {
     ThreadLocal<Allocator> threadAllocators(
         [memoryResource]() { return Allocator(memoryResource); });
 
@@ -94,6 +140,9 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
     // launched... Thus, it will be true if there actually are no media,
     // but some "interface" materials are present in the scene.
     haveMedia = false;
+    haveMediumType.fill(false);
+    for (const auto &medium : media)
+        haveMediumType[medium.second.Tag()] = true;
     // Check the shapes and instance definitions...
     for (const auto &shape : scene.shapes)
         if (!shape.insideMedium.empty() || !shape.outsideMedium.empty())
@@ -150,10 +199,13 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
     // concurrently with the OptiX acceleration-structure construction work
     // that follows. (Verbotten on Windows.)
     camera = scene.GetCamera();
+    if (scene.NumViews() > 0)
+        Warning("Only the first camera's view is rendered by the wavefront integrator.");
     film = camera.GetFilm();
     filter = film.GetFilter();
     sampler = scene.GetSampler();
 
+    Timer aggregateTimer;
     if (Options->useGPU) {
 #ifdef PBRT_BUILD_GPU_RENDERER
         CUDATrackedMemoryResource *mr =
@@ -164,9 +216,13 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
 #else
         LOG_FATAL("Options->useGPU was set without PBRT_BUILD_GPU_RENDERER enabled");
 #endif
-    } else
+    } else {
+        bool sortRays = scene.integrator.parameters.GetOneBool("sortrays", false);
         aggregate = new CPUAggregate(scene, textures, shapeIndexToAreaLights, media,
-                                     namedMaterials, materials);
+                                     namedMaterials, materials, sortRays);
+    }
+    StatsReportBenchmarkPhase(BenchmarkPhase::AggregateBuild,
+                              aggregateTimer.ElapsedSeconds());
 
     // Preprocess the light sources
     for (Light light : allLights)
@@ -186,7 +242,20 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
     lightSampler = LightSampler::Create(lightSamplerName, allLights, alloc);
     LOG_VERBOSE("Finished creating light sampler");
 
-    if (scene.integrator.name != "path" && scene.integrator.name != "volpath")
+    if (Options->watchScene) {
+        // Hold on to what is needed to update materials and lights in place
+        reloadState = new ReloadState;
+        reloadState->sceneFilenames = scene.filenames;
+        for (const std::string &filename : scene.MaterialAndLightFilenames())
+            reloadState->fileTimes[filename] = FileModificationTime(filename);
+        reloadState->namedMaterials = namedMaterials;
+        reloadState->materials = materials;
+        reloadState->lights = std::vector<Light>(allLights.begin(), allLights.end());
+        reloadState->lightSamplerName = lightSamplerName;
+    }
+
+    bool sppm = scene.integrator.name == "sppm";
+    if (scene.integrator.name != "path" && scene.integrator.name != "volpath" && !sppm)
         Warning(&scene.integrator.loc,
                 "Ignoring specified integrator \"%s\": the wavefront integrator "
                 "always uses a \"volpath\" integrator.",
@@ -194,16 +263,67 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
 
     // Integrator parameters
     regularize = scene.integrator.parameters.GetOneBool("regularize", false);
+    // Material sorting is only supported on the CPU, like "sortrays"
+    sortMaterials = scene.integrator.parameters.GetOneBool("sortmaterials", false) &&
+                    !Options->useGPU;
     maxDepth = scene.integrator.parameters.GetOneInt("maxdepth", 5);
+    lightCandidates = scene.integrator.parameters.GetOneInt("lightcandidates", 1);
+    if (lightCandidates < 1)
+        ErrorExit("%d: \"lightcandidates\" must be at least one.", lightCandidates);
 
     initializeVisibleSurface = film.UsesVisibleSurface();
     samplesPerPixel = sampler.SamplesPerPixel();
 
+    if (sppm) {
+        // Check that the scene can be rendered with SPPM
+        if (!media.empty())
+            ErrorExit(&scene.integrator.loc,
+                      "The wavefront \"sppm\" integrator does not support "
+                      "participating media.");
+        if (film.Is<SpectralFilm>())
+            ErrorExit(&scene.integrator.loc,
+                      "The wavefront \"sppm\" integrator does not support the "
+                      "\"spectral\" film.");
+        if (Options->interactive)
+            ErrorExit("The wavefront \"sppm\" integrator does not support "
+                      "--interactive.");
+        if (Options->sampleRange)
+            ErrorExit("The wavefront \"sppm\" integrator does not support "
+                      "--sample-range.");
+
+        // Allocate the SPPM pixels and hash grid
+        int nPixels = film.PixelBounds().Area();
+        photonsPerIteration =
+            scene.integrator.parameters.GetOneInt("photonsperiteration", -1);
+        if (photonsPerIteration <= 0)
+            photonsPerIteration = nPixels;
+        Float radius = scene.integrator.parameters.GetOneFloat("radius", 1.f);
+        photonLightSampler = LightSampler::Create("power", allLights, alloc);
+
+        sppmPixels = alloc.allocate_object<SPPMPixel>(nPixels);
+        for (int i = 0; i < nPixels; ++i) {
+            alloc.construct(&sppmPixels[i]);
+            sppmPixels[i].radius = radius;
+        }
+        // Radii only shrink, so each visible point overlaps at most eight cells
+        sppmCellSize = 2 * radius;
+        sppmHashSize = NextPrime(nPixels);
+        sppmGridCells = alloc.allocate_object<AtomicInt>(sppmHashSize);
+        for (int h = 0; h < sppmHashSize; ++h)
+            alloc.construct(&sppmGridCells[h]);
+        sppmGridEntries = alloc.allocate_object<SPPMGridEntry>(8 * size_t(nPixels));
+        sppmGridEntryCount = alloc.new_object<AtomicInt>();
+    }
+
     // Warn about unsupported stuff...
     if (Options->forceDiffuse)
         ErrorExit("The wavefront integrator does not support --force-diffuse.");
     if (Options->writePartialImages)
         Warning("The wavefront integrator does not support --write-partial-images.");
+    if (Options->gpuDenoiseDisplay &&
+        (!Options->useGPU || Options->displayServer.empty()))
+        Warning("Ignoring --gpu-denoise-display, which requires --gpu and "
+                "--display-server.");
     if (Options->recordPixelStatistics)
         ErrorExit("The wavefront integrator does not support --pixelstats.");
     if (!Options->mseReferenceImage.empty())
@@ -222,12 +342,19 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
         CHECK(mr);
         startSize = mr->BytesAllocated();
     }
+    // The queues and pixel state are written by every pass; keep them in
+    // device memory even if the GPU's memory is oversubscribed.
+    std::unique_ptr<ScopedGPUResidency> deviceResidency;
+    if (Options->useGPU)
+        deviceResidency = std::make_unique<ScopedGPUResidency>(GPUResidency::Device);
 #endif  // PBRT_BUILD_GPU_RENDERER
 
     // Compute number of scanlines to render per pass
     Vector2i resolution = film.PixelBounds().Diagonal();
-    // TODO: make this configurable. Base it on the amount of GPU memory?
-    int maxSamples = 1024 * 1024;
+    // TODO: base the default on the amount of GPU memory?
+    int maxSamples = scene.integrator.parameters.GetOneInt("maxqueuesize", 1024 * 1024);
+    if (maxSamples < 1)
+        ErrorExit("%d: \"maxqueuesize\" must be at least one.", maxSamples);
     scanlinesPerPass = std::max(1, maxSamples / resolution.x);
     int nPasses = (resolution.y + scanlinesPerPass - 1) / scanlinesPerPass;
     scanlinesPerPass = (resolution.y + nPasses - 1) / nPasses;
@@ -235,7 +362,51 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
     LOG_VERBOSE("Will render in %d passes %d scanlines per pass\n", nPasses,
                 scanlinesPerPass);
 
+    // Find the size of the CPU's chunks, which are whole rows of the film
+    int chunkSize = scene.integrator.parameters.GetOneInt("chunksize", 4096);
+    if (chunkSize < 0)
+        ErrorExit("%d: \"chunksize\" must not be negative.", chunkSize);
+    // SPPM's photon passes use the integrator's own queues
+    if (!Options->useGPU && chunkSize > 0 && !sppmPixels)
+        chunkQueueSize = std::min(maxQueueSize,
+                                  resolution.x * std::max(1, chunkSize / resolution.x));
+
+    if (chunkQueueSize > 0) {
+        // Only the threads' copies of the integrator need queues
+        LOG_VERBOSE("Will render in chunks of %d scanlines",
+                    chunkQueueSize / resolution.x);
+        auto createChunkIntegrator = [this, alloc]() mutable {
+            WavefrontPathIntegrator *integrator =
+                alloc.new_object<WavefrontPathIntegrator>(*this);
+            integrator->AllocateQueues(chunkQueueSize, alloc);
+            integrator->stats = alloc.new_object<Stats>(maxDepth, chunkQueueSize, alloc);
+            return integrator;
+        };
+        chunkIntegrators =
+            new ThreadLocal<WavefrontPathIntegrator *>(std::move(createChunkIntegrator));
+        stats = alloc.new_object<Stats>(maxDepth, chunkQueueSize, alloc);
+    } else {
+        AllocateQueues(maxQueueSize, alloc);
+        stats = alloc.new_object<Stats>(maxDepth, maxQueueSize, alloc);
+    }
+
+#ifdef PBRT_BUILD_GPU_RENDERER
+    if (Options->useGPU) {
+        CUDATrackedMemoryResource *mr =
+            dynamic_cast<CUDATrackedMemoryResource *>(memoryResource);
+        CHECK(mr);
+        size_t endSize = mr->BytesAllocated();
+        pathIntegratorBytes += endSize - startSize;
+    }
+#endif  // PBRT_BUILD_GPU_RENDERER
+}
+
+// WavefrontPathIntegrator Method Definitions
+void WavefrontPathIntegrator::AllocateQueues(int queueSize, Allocator alloc) {
+    maxQueueSize = queueSize;
     pixelSampleState = SOA<PixelSampleState>(maxQueueSize, alloc);
+    if (initializeVisibleSurface)
+        visibleSurfaces = SOA<VisibleSurface>(maxQueueSize, alloc);
 
     rayQueues[0] = alloc.new_object<RayQueue>(maxQueueSize, alloc);
     rayQueues[1] = alloc.new_object<RayQueue>(maxQueueSize, alloc);
@@ -253,16 +424,23 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
         escapedRayQueue = alloc.new_object<EscapedRayQueue>(maxQueueSize, alloc);
     hitAreaLightQueue = alloc.new_object<HitAreaLightQueue>(maxQueueSize, alloc);
 
+    // Each ray enqueues at most one material evaluation work item
+    materialEvalItems =
+        alloc.new_object<WorkQueue<MaterialEvalWorkItem<void>>>(maxQueueSize, alloc);
     basicEvalMaterialQueue = alloc.new_object<MaterialEvalQueue>(
         maxQueueSize, alloc,
-        pstd::MakeConstSpan(&haveBasicEvalMaterial[1], haveBasicEvalMaterial.size() - 1));
+        pstd::MakeConstSpan(&haveBasicEvalMaterial[1], haveBasicEvalMaterial.size() - 1),
+        materialEvalItems);
     universalEvalMaterialQueue = alloc.new_object<MaterialEvalQueue>(
         maxQueueSize, alloc,
         pstd::MakeConstSpan(&haveUniversalEvalMaterial[1],
-                            haveUniversalEvalMaterial.size() - 1));
+                            haveUniversalEvalMaterial.size() - 1),
+        materialEvalItems);
 
     if (haveMedia) {
-        mediumSampleQueue = alloc.new_object<MediumSampleQueue>(maxQueueSize, alloc);
+        mediumSampleQueue = alloc.new_object<MediumSampleQueue>(
+            maxQueueSize, alloc,
+            pstd::MakeConstSpan(&haveMediumType[1], haveMediumType.size() - 1));
 
         // TODO: in the presence of multiple PhaseFunction implementations,
         // it could be worthwhile to see which are present in the scene and
@@ -272,21 +450,8 @@ WavefrontPathIntegrator::WavefrontPathIntegrator(
         mediumScatterQueue =
             alloc.new_object<MediumScatterQueue>(maxQueueSize, alloc, havePhase);
     }
-
-    stats = alloc.new_object<Stats>(maxDepth, alloc);
-
-#ifdef PBRT_BUILD_GPU_RENDERER
-    if (Options->useGPU) {
-        CUDATrackedMemoryResource *mr =
-            dynamic_cast<CUDATrackedMemoryResource *>(memoryResource);
-        CHECK(mr);
-        size_t endSize = mr->BytesAllocated();
-        pathIntegratorBytes += endSize - startSize;
-    }
-#endif  // PBRT_BUILD_GPU_RENDERER
 }
 
-// WavefrontPathIntegrator Method Definitions
 Float WavefrontPathIntegrator::Render() {
     Bounds2i pixelBounds = film.PixelBounds();
     Vector2i resolution = pixelBounds.Diagonal();
@@ -318,6 +483,13 @@ Float WavefrontPathIntegrator::Render() {
 
     // Loop over sample indices and evaluate pixel samples
     int firstSampleIndex = 0, lastSampleIndex = samplesPerPixel;
+    if (Options->sampleRange) {
+        firstSampleIndex = Options->sampleRange->x;
+        lastSampleIndex = Options->sampleRange->y;
+        if (lastSampleIndex > samplesPerPixel)
+            ErrorExit("--sample-range %d,%d extends past the %d samples per pixel.",
+                      firstSampleIndex, lastSampleIndex, samplesPerPixel);
+    }
     // Update sample index range based on debug start, if provided
     if (!Options->debugStart.empty()) {
         std::vector<int> values = SplitStringToInts(Options->debugStart, ',');
@@ -331,8 +503,24 @@ Float WavefrontPathIntegrator::Render() {
             lastSampleIndex = firstSampleIndex + 1;
     }
 
+#ifdef PBRT_BUILD_GPU_RENDERER
+    // Optionally capture each pass's kernel launches into a CUDA graph
+    std::unique_ptr<GPUGraph> passGraph;
+    if (Options->useGPU && Options->gpuGraphs) {
+#ifdef NDEBUG
+        passGraph = std::make_unique<GPUGraph>();
+#else
+        // Debug builds synchronize after each launch, which can't be captured
+        Warning("Ignoring --gpu-graphs in a debug build.");
+#endif  // NDEBUG
+    }
+#endif  // PBRT_BUILD_GPU_RENDERER
+
     ProgressReporter progress(lastSampleIndex - firstSampleIndex, "Rendering",
                               Options->quiet || Options->interactive, Options->useGPU);
+    MetricsProgressScope metricsProgress(progress, pixelBounds.Area());
+    uint64_t metricsRays = 0;
+    double renderStartSeconds = timer.ElapsedSeconds();
     for (int sampleIndex = firstSampleIndex; sampleIndex < lastSampleIndex || gui;
          ++sampleIndex) {
         // Attempt to work around issue #145.
@@ -345,105 +533,99 @@ Float WavefrontPathIntegrator::Render() {
         });
 #endif
 
+        // Find the pixels to sample, which may be limited to a coarse preview
+        // or a region of interest when the GUI is in use
+        Bounds2i sampleBounds = pixelBounds;
+        int stride = 1;
+        if (gui) {
+            Bounds2i roi = gui->RegionOfInterest();
+            sampleBounds = Bounds2i(pixelBounds.pMin + Vector2i(roi.pMin),
+                                    pixelBounds.pMin + Vector2i(roi.pMax));
+            stride = gui->PreviewStride();
+        }
+
         // Keep running the outer for loop but don't take more samples if
         // the GUI is being used so that the user can move the camera, etc.
         if (sampleIndex < lastSampleIndex) {
             // Render image for sample _sampleIndex_
             LOG_VERBOSE("Starting to submit work for sample %d", sampleIndex);
-            for (int y0 = pixelBounds.pMin.y; y0 < pixelBounds.pMax.y;
-                 y0 += scanlinesPerPass) {
-                // Generate camera rays for current scanline range
-                RayQueue *cameraRayQueue = CurrentRayQueue(0);
-                Do(
-                   "Reset ray queue", PBRT_CPU_GPU_LAMBDA() {
-                       PBRT_DBG("Starting scanlines at y0 = %d, sample %d / %d\n", y0,
-                                sampleIndex, samplesPerPixel);
-                       cameraRayQueue->Reset();
-                   });
-
-                Transform cameraMotion;
-                if (gui)
-                    cameraMotion =
-                        renderFromCamera * gui->GetCameraTransform() * cameraFromRender;
-                GenerateCameraRays(y0, cameraMotion, sampleIndex);
-                Do(
-                   "Update camera ray stats",
-                   PBRT_CPU_GPU_LAMBDA() { stats->cameraRays += cameraRayQueue->Size(); });
-
-                // Trace rays and estimate radiance up to maximum ray depth
-                for (int wavefrontDepth = 0; true; ++wavefrontDepth) {
-                    // Reset queues before tracing rays
-                    RayQueue *nextQueue = NextRayQueue(wavefrontDepth);
-                    Do(
-                       "Reset queues before tracing rays", PBRT_CPU_GPU_LAMBDA() {
-                           nextQueue->Reset();
-                           // Reset queues before tracing next batch of rays
-                           if (mediumSampleQueue)
-                               mediumSampleQueue->Reset();
-                           if (mediumScatterQueue)
-                               mediumScatterQueue->Reset();
-
-                           if (escapedRayQueue)
-                               escapedRayQueue->Reset();
-                           hitAreaLightQueue->Reset();
-
-                           basicEvalMaterialQueue->Reset();
-                           universalEvalMaterialQueue->Reset();
-
-                           if (bssrdfEvalQueue)
-                               bssrdfEvalQueue->Reset();
-                           if (subsurfaceScatterQueue)
-                               subsurfaceScatterQueue->Reset();
-                       });
-
-                    // Follow active ray paths and accumulate radiance estimates
-                    GenerateRaySamples(wavefrontDepth, sampleIndex);
-
-                    // Find closest intersections along active rays
-                    aggregate->IntersectClosest(
-                                                maxQueueSize, CurrentRayQueue(wavefrontDepth), escapedRayQueue,
-                                                hitAreaLightQueue, basicEvalMaterialQueue, universalEvalMaterialQueue,
-                                                mediumSampleQueue, NextRayQueue(wavefrontDepth));
-
-                    if (wavefrontDepth > 0) {
-                        // As above, with the indexing...
-                        RayQueue *statsQueue = CurrentRayQueue(wavefrontDepth);
-                        Do(
-                           "Update indirect ray stats", PBRT_CPU_GPU_LAMBDA() {
-                               stats->indirectRays[wavefrontDepth] += statsQueue->Size();
-                           });
-                    }
-
-                    SampleMediumInteraction(wavefrontDepth);
-
-                    HandleEscapedRays();
-
-                    HandleEmissiveIntersection();
-
-                    if (wavefrontDepth == maxDepth)
-                        break;
-
-                    EvaluateMaterialsAndBSDFs(wavefrontDepth, cameraMotion);
-
-                    // Do immediately so that we have space for shadow rays for subsurface..
-                    TraceShadowRays(wavefrontDepth);
-
-                    SampleSubsurface(wavefrontDepth);
+            TraceScope traceWave("Render", "Wave");
+            if (traceEnabled)
+                traceWave.SetArgs(StringPrintf("\"sampleIndex\": %d", sampleIndex));
+            Vector2i sampleResolution =
+                (sampleBounds.Diagonal() + Vector2i(stride - 1, stride - 1)) / stride;
+            Transform cameraMotion;
+            if (gui)
+                cameraMotion =
+                    renderFromCamera * gui->GetCameraTransform() * cameraFromRender;
+
+            if (chunkIntegrators) {
+                // Render chunks of rows in parallel, each using a single thread
+                int rowsPerChunk = std::max(1, chunkQueueSize / sampleResolution.x);
+                int nChunks = (sampleResolution.y + rowsPerChunk - 1) / rowsPerChunk;
+                pbrt::ParallelFor(0, nChunks, [&](int64_t chunk) {
+                    WavefrontPathIntegrator *integrator = chunkIntegrators->Get();
+                    SerialLoopScope serialLoops;
+                    integrator->RenderPass(chunk * rowsPerChunk, sampleBounds, stride,
+                                           cameraMotion, sampleIndex);
+                });
+                chunkIntegrators->ForAll([&](WavefrontPathIntegrator *integrator) {
+                    stats->Add(*integrator->stats);
+                    integrator->stats->Reset();
+                });
+            } else {
+                int rowsPerPass = std::max(1, maxQueueSize / sampleResolution.x);
+                for (int y0 = 0; y0 < sampleResolution.y; y0 += rowsPerPass) {
+#ifdef PBRT_BUILD_GPU_RENDERER
+                    if (passGraph)
+                        passGraph->BeginCapture();
+#endif  // PBRT_BUILD_GPU_RENDERER
+                    RenderPass(y0, sampleBounds, stride, cameraMotion, sampleIndex);
+#ifdef PBRT_BUILD_GPU_RENDERER
+                    if (passGraph)
+                        passGraph->EndCaptureAndLaunch("Render pass graph");
+#endif  // PBRT_BUILD_GPU_RENDERER
                 }
-
-                UpdateFilm();
             }
+            if (sppmPixels)
+                TracePhotons(sampleIndex);
 
             // Copy updated film pixels to buffer for the display server.
             if (Options->useGPU && !Options->displayServer.empty())
                 UpdateDisplayRGBFromFilm(pixelBounds);
 
             progress.Update();
+
+            // The ray counts are only read back from the GPU at the end
+            if (metricsEnabled && !Options->useGPU) {
+                uint64_t totalRays = stats->TotalRays();
+                StatsCountMetricsRays(totalRays - metricsRays);
+                metricsRays = totalRays;
+            }
+
+            // With --time-limit, stop once the average time per sample says
+            // that another one won't finish before the deadline
+            if (Options->timeLimit > 0 && !gui) {
+#ifdef PBRT_BUILD_GPU_RENDERER
+                if (Options->useGPU)
+                    GPUWait();
+#endif  // PBRT_BUILD_GPU_RENDERER
+                double elapsed = timer.ElapsedSeconds();
+                double secondsPerSample = (elapsed - renderStartSeconds) /
+                                          (sampleIndex + 1 - firstSampleIndex);
+                if (elapsed + secondsPerSample > Options->timeLimit &&
+                    sampleIndex + 1 < lastSampleIndex) {
+                    LOG_VERBOSE("Stopping after %d of %d samples per pixel",
+                                sampleIndex + 1 - firstSampleIndex,
+                                lastSampleIndex - firstSampleIndex);
+                    lastSampleIndex = sampleIndex + 1;
+                }
+            }
         }
 
         if (gui) {
             RGB *rgb = gui->MapFramebuffer();
-            UpdateFramebufferFromFilm(pixelBounds, gui->exposure, rgb);
+            UpdateFramebufferFromFilm(sampleBounds, stride, gui->exposure, rgb);
             gui->UnmapFramebuffer();
 
             if (gui->printCameraTransform) {
@@ -457,17 +639,28 @@ Float WavefrontPathIntegrator::Render() {
                 gui->printCameraTransform = false;
             }
 
+            auto resetPixels = [&](Bounds2i bounds) {
+                Vector2i res = bounds.Diagonal();
+                ParallelFor(
+                    "Reset pixels", res.x * res.y, PBRT_CPU_GPU_LAMBDA(int i) {
+                        int x = i % res.x, y = i / res.x;
+                        film.ResetPixel(bounds.pMin + Vector2i(x, y));
+                    });
+            };
             DisplayState state = gui->RefreshDisplay();
+            if (reloadState && SceneFilesChanged() && ReloadMaterialsAndLights())
+                state = DisplayState::RESET;
             if (state == DisplayState::EXIT)
                 break;
             else if (state == DisplayState::RESET) {
                 sampleIndex = firstSampleIndex - 1;
-                ParallelFor(
-                    "Reset pixels", resolution.x * resolution.y,
-                    PBRT_CPU_GPU_LAMBDA(int i) {
-                        int x = i % resolution.x, y = i / resolution.x;
-                        film.ResetPixel(pixelBounds.pMin + Vector2i(x, y));
-                    });
+                resetPixels(pixelBounds);
+            } else if (sampleIndex == firstSampleIndex && gui->AdvancePreview()) {
+                // Once a preview has been displayed, start over at the next
+                // finer level, discarding its samples so that the film's
+                // pixels all have the same sample indices
+                sampleIndex = firstSampleIndex - 1;
+                resetPixels(sampleBounds);
             }
         }
 
@@ -478,6 +671,7 @@ Float WavefrontPathIntegrator::Render() {
         gui = nullptr;
     }
 
+    samplesRendered = lastSampleIndex - firstSampleIndex;
     progress.Done();
 
 #ifdef PBRT_BUILD_GPU_RENDERER
@@ -492,6 +686,224 @@ Float WavefrontPathIntegrator::Render() {
     return seconds;
 }
 
+void WavefrontPathIntegrator::RenderPass(int y0, Bounds2i sampleBounds, int stride,
+                                         Transform movingFromCamera, int sampleIndex) {
+    // Generate camera rays for current scanline range
+    RayQueue *cameraRayQueue = CurrentRayQueue(0);
+    Do(
+        "Reset ray queue", PBRT_CPU_GPU_LAMBDA() {
+            PBRT_DBG("Starting scanlines at y0 = %d, sample %d / %d\n", y0,
+                     sampleIndex, samplesPerPixel);
+            cameraRayQueue->Reset();
+        });
+
+    GenerateCameraRays(y0, sampleBounds, stride, movingFromCamera, sampleIndex);
+    Do(
+        "Update camera ray stats", PBRT_CPU_GPU_LAMBDA() {
+            uint64_t nRays = cameraRayQueue->Size();
+            stats->cameraRays += nRays;
+            stats->peakRays[0] = std::max(stats->peakRays[0], nRays);
+            ++stats->passes;
+        });
+
+    // Trace rays and estimate radiance up to maximum ray depth
+    for (int wavefrontDepth = 0; true; ++wavefrontDepth) {
+        // Reset queues before tracing rays
+        RayQueue *nextQueue = NextRayQueue(wavefrontDepth);
+        Do(
+            "Reset queues before tracing rays", PBRT_CPU_GPU_LAMBDA() {
+                nextQueue->Reset();
+                // Reset queues before tracing next batch of rays
+                if (mediumSampleQueue)
+                    mediumSampleQueue->Reset();
+                if (mediumScatterQueue)
+                    mediumScatterQueue->Reset();
+
+                if (escapedRayQueue)
+                    escapedRayQueue->Reset();
+                hitAreaLightQueue->Reset();
+
+                materialEvalItems->Reset();
+                basicEvalMaterialQueue->Reset();
+                universalEvalMaterialQueue->Reset();
+
+                if (bssrdfEvalQueue)
+                    bssrdfEvalQueue->Reset();
+                if (subsurfaceScatterQueue)
+                    subsurfaceScatterQueue->Reset();
+            });
+
+        // Follow active ray paths and accumulate radiance estimates
+        GenerateRaySamples(wavefrontDepth, sampleIndex);
+
+        // Find closest intersections along active rays
+        aggregate->IntersectClosest(maxQueueSize, CurrentRayQueue(wavefrontDepth),
+                                    escapedRayQueue, hitAreaLightQueue,
+                                    basicEvalMaterialQueue, universalEvalMaterialQueue,
+                                    mediumSampleQueue, NextRayQueue(wavefrontDepth));
+
+        if (wavefrontDepth > 0) {
+            // As above, with the indexing...
+            RayQueue *statsQueue = CurrentRayQueue(wavefrontDepth);
+            Do(
+                "Update indirect ray stats", PBRT_CPU_GPU_LAMBDA() {
+                    uint64_t nRays = statsQueue->Size();
+                    stats->indirectRays[wavefrontDepth] += nRays;
+                    uint64_t &peak = stats->peakRays[wavefrontDepth];
+                    peak = std::max(peak, nRays);
+                });
+        }
+
+        SampleMediumInteraction(wavefrontDepth);
+
+        HandleEscapedRays();
+
+        HandleEmissiveIntersection();
+
+        if (wavefrontDepth == maxDepth)
+            break;
+
+        EvaluateMaterialsAndBSDFs(wavefrontDepth, movingFromCamera);
+
+        // Do immediately so that we have space for shadow rays for subsurface..
+        TraceShadowRays(wavefrontDepth);
+
+        SampleSubsurface(wavefrontDepth);
+    }
+
+    UpdateFilm();
+}
+
+bool WavefrontPathIntegrator::SceneFilesChanged() {
+    // Only stat the files about once a second
+    double now = reloadState->timer.ElapsedSeconds();
+    if (now - reloadState->lastCheckTime < 1)
+        return false;
+    reloadState->lastCheckTime = now;
+
+    bool changed = false;
+    for (auto &file : reloadState->fileTimes) {
+        int64_t time = FileModificationTime(file.first);
+        if (time != file.second) {
+            file.second = time;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Copies _src_ into the object that _dst_ points to if both have the same
+// type and that type can be assigned; only checks if _apply_ is false.
+template <typename TP>
+static bool assignInPlace(TP dst, TP src, bool apply) {
+    if (!dst || !src)
+        return dst == src;
+    if (dst.Tag() != src.Tag())
+        return false;
+    auto assign = [&](auto ptr) {
+        using T = std::remove_pointer_t<decltype(ptr)>;
+        if constexpr (std::is_copy_assignable_v<T>) {
+            if (apply)
+                *ptr = *src.template Cast<T>();
+            return true;
+        } else
+            return false;
+    };
+    return dst.DispatchCPU(assign);
+}
+
+bool WavefrontPathIntegrator::ReloadMaterialsAndLights() {
+    // Re-parse the scene and create its materials and lights; shapes and
+    // the acceleration structure are left as they are.
+    Timer timer;
+    BasicScene scene;
+    BasicSceneBuilder builder(&scene);
+    ParseFiles(&builder, reloadState->sceneFilenames);
+    scene.filenames = reloadState->sceneFilenames;
+
+    std::map<std::string, Medium> media = scene.CreateMedia();
+    NamedTextures textures = scene.CreateTextures();
+    std::map<int, pstd::vector<Light> *> shapeIndexToAreaLights;
+    std::vector<Light> lights = scene.CreateLights(textures, &shapeIndexToAreaLights);
+    std::map<std::string, Material> namedMaterials;
+    std::vector<Material> materials;
+    scene.CreateMaterials(textures, &namedMaterials, &materials);
+    // Make sure that no asynchronous work still refers to _scene_
+    (void)scene.GetSampler();
+
+    // Check that the new materials and lights can replace the current ones
+    auto fail = [](const char *why) {
+        Warning("Not reloading scene: %s. Restart pbrt to see this change.", why);
+        return false;
+    };
+    if (materials.size() != reloadState->materials.size() ||
+        namedMaterials.size() != reloadState->namedMaterials.size())
+        return fail("materials were added or removed");
+    if (lights.size() != reloadState->lights.size())
+        return fail("lights were added or removed");
+
+    pstd::array<bool, Material::NumTags()> newBasicEvalMaterial, newUniversalEvalMaterial;
+    newBasicEvalMaterial.fill(false);
+    newUniversalEvalMaterial.fill(false);
+    bool newSubsurface = false, newMedia = haveMedia;
+    for (Material m : materials)
+        updateMaterialNeeds(m, &newBasicEvalMaterial, &newUniversalEvalMaterial,
+                            &newSubsurface, &newMedia);
+    for (const auto &m : namedMaterials)
+        updateMaterialNeeds(m.second, &newBasicEvalMaterial, &newUniversalEvalMaterial,
+                            &newSubsurface, &newMedia);
+    // The wavefront queues were allocated for the original materials' needs.
+    bool needsMatch = (!newSubsurface || haveSubsurface) && newMedia == haveMedia;
+    for (size_t i = 0; i < newBasicEvalMaterial.size(); ++i)
+        needsMatch &= (!newBasicEvalMaterial[i] || haveBasicEvalMaterial[i]) &&
+                      (!newUniversalEvalMaterial[i] || haveUniversalEvalMaterial[i]);
+    if (!needsMatch)
+        return fail("the new materials need different wavefront queues");
+
+    for (bool apply : {false, true}) {
+        for (size_t i = 0; i < materials.size(); ++i)
+            if (!assignInPlace(reloadState->materials[i], materials[i], apply))
+                return fail("a material's type was changed");
+        for (const auto &m : namedMaterials) {
+            auto iter = reloadState->namedMaterials.find(m.first);
+            if (iter == reloadState->namedMaterials.end())
+                return fail("named materials were renamed");
+            if (!assignInPlace(iter->second, m.second, apply))
+                return fail("a material's type was changed");
+        }
+        for (size_t i = 0; i < lights.size(); ++i) {
+            // Area lights are tied to their shapes, which aren't reloaded.
+            if (reloadState->lights[i].Is<DiffuseAreaLight>() &&
+                lights[i].Is<DiffuseAreaLight>())
+                continue;
+            if (!assignInPlace(reloadState->lights[i], lights[i], apply))
+                return fail("a light's type was changed");
+        }
+
+        if (!apply) {
+            // Wait for in-flight work before modifying what it may be using
+#ifdef PBRT_BUILD_GPU_RENDERER
+            if (Options->useGPU)
+                GPUWait();
+#endif  // PBRT_BUILD_GPU_RENDERER
+        }
+    }
+
+    // Preprocess the updated lights and rebuild the light sampler
+    for (Light light : reloadState->lights)
+        if (!light.Is<DiffuseAreaLight>())
+            light.Preprocess(aggregate->Bounds());
+    lightSampler = LightSampler::Create(reloadState->lightSamplerName,
+                                        reloadState->lights, Allocator(memoryResource));
+    if (chunkIntegrators)
+        chunkIntegrators->ForAll([&](WavefrontPathIntegrator *integrator) {
+            integrator->lightSampler = lightSampler;
+        });
+
+    LOG_VERBOSE("Reloaded materials and lights in %s", timer);
+    return true;
+}
+
 void WavefrontPathIntegrator::HandleEscapedRays() {
     if (!escapedRayQueue)
         return;
@@ -585,10 +997,51 @@ void WavefrontPathIntegrator::TraceShadowRays(int wavefrontDepth) {
         });
 }
 
-WavefrontPathIntegrator::Stats::Stats(int maxDepth, Allocator alloc)
-    : indirectRays(maxDepth + 1, alloc), shadowRays(maxDepth, alloc) {}
+WavefrontPathIntegrator::Stats::Stats(int maxDepth, int queueCapacity, Allocator alloc)
+    : indirectRays(maxDepth + 1, alloc),
+      shadowRays(maxDepth, alloc),
+      peakRays(maxDepth + 1, alloc),
+      queueCapacity(queueCapacity) {}
+
+uint64_t WavefrontPathIntegrator::Stats::TotalRays() const {
+    uint64_t total = cameraRays;
+    for (uint64_t n : indirectRays)
+        total += n;
+    for (uint64_t n : shadowRays)
+        total += n;
+    return total;
+}
+
+void WavefrontPathIntegrator::Stats::Add(const Stats &s) {
+    cameraRays += s.cameraRays;
+    passes += s.passes;
+    for (size_t i = 0; i < indirectRays.size(); ++i) {
+        indirectRays[i] += s.indirectRays[i];
+        peakRays[i] = std::max(peakRays[i], s.peakRays[i]);
+    }
+    for (size_t i = 0; i < shadowRays.size(); ++i)
+        shadowRays[i] += s.shadowRays[i];
+}
+
+void WavefrontPathIntegrator::Stats::Reset() {
+    cameraRays = passes = 0;
+    std::fill(indirectRays.begin(), indirectRays.end(), 0);
+    std::fill(shadowRays.begin(), shadowRays.end(), 0);
+    std::fill(peakRays.begin(), peakRays.end(), 0);
+}
+
+Float WavefrontPathIntegrator::Stats::AverageOccupancy(int depth) const {
+    if (passes == 0)
+        return 0;
+    uint64_t nRays = depth == 0 ? cameraRays : indirectRays[depth];
+    return Float(nRays) / (Float(passes) * queueCapacity);
+}
 
-std::string WavefrontPathIntegrator::Stats::Print() const {
+Float WavefrontPathIntegrator::Stats::PeakOccupancy(int depth) const {
+    return Float(peakRays[depth]) / queueCapacity;
+}
+
+std::string WavefrontPathIntegrator::Stats::Print(Float seconds) const {
     std::string s;
     s += StringPrintf("    %-42s               %12" PRIu64 "\n", "Camera rays",
                       cameraRays);
@@ -598,9 +1051,32 @@ std::string WavefrontPathIntegrator::Stats::Print() const {
     for (int i = 0; i < shadowRays.size(); ++i)
         s += StringPrintf("    %-42s               %12" PRIu64 "\n",
                           StringPrintf("Shadow rays, depth %-3d", i), shadowRays[i]);
+    if (seconds > 0)
+        s += StringPrintf("    %-42s               %12.2f\n", "Million rays per second",
+                          TotalRays() / (1e6 * seconds));
+    for (int i = 0; i < peakRays.size(); ++i)
+        s += StringPrintf("    %-42s        %5.1f%s avg %5.1f%s peak\n",
+                          StringPrintf("Ray queue occupancy, depth %-3d", i),
+                          100 * AverageOccupancy(i), "%", 100 * PeakOccupancy(i), "%");
     return s;
 }
 
+std::string WavefrontPathIntegrator::Stats::ToJSON(Float seconds) const {
+    std::string json = StringPrintf(
+        "{ \"seconds\": %f, \"totalRays\": %d, \"raysPerSecond\": %f, "
+        "\"passes\": %d, \"queueCapacity\": %d, \"depths\": [",
+        seconds, TotalRays(), seconds > 0 ? TotalRays() / seconds : 0., passes,
+        queueCapacity);
+    for (int i = 0; i < peakRays.size(); ++i)
+        json += StringPrintf(
+            "%s\n    { \"depth\": %d, \"rays\": %d, \"shadowRays\": %d, "
+            "\"averageOccupancy\": %f, \"peakOccupancy\": %f }",
+            i == 0 ? "" : ",", i, i == 0 ? cameraRays : indirectRays[i],
+            i < shadowRays.size() ? shadowRays[i] : 0, AverageOccupancy(i),
+            PeakOccupancy(i));
+    return json + "\n  ] }";
+}
+
 #ifdef PBRT_BUILD_GPU_RENDERER
 void WavefrontPathIntegrator::PrefetchGPUAllocations() {
     int deviceIndex;
@@ -649,53 +1125,81 @@ void WavefrontPathIntegrator::StartDisplayThread() {
         CUDA_CHECK(cudaMalloc(&displayRGB, resolution.x * resolution.y * sizeof(RGB)));
         CUDA_CHECK(cudaMemset(displayRGB, 0, resolution.x * resolution.y * sizeof(RGB)));
 
-        // Host-side memory for the WIP Image.  We'll just let this leak so
-        // that the lambda passed to DisplayDynamic below doesn't access
-        // freed memory after Render() returns...
-        displayRGBHost = new RGB[resolution.x * resolution.y];
+        // Host-side double buffers for the WIP image.  We'll just let
+        // these leak so that the lambda passed to DisplayDynamic below
+        // doesn't access freed memory after Render() returns...
+        displayReadback = new DisplayReadback;
+        for (int i = 0; i < 2; ++i) {
+            CUDA_CHECK(cudaMallocHost(&displayReadback->host[i],
+                                      resolution.x * resolution.y * sizeof(RGB)));
+            std::memset(displayReadback->host[i], 0,
+                        resolution.x * resolution.y * sizeof(RGB));
+        }
+        CUDA_CHECK(cudaEventCreateWithFlags(&displayReadback->readyEvent,
+                                            cudaEventDisableTiming));
+
+        if (Options->gpuDenoiseDisplay) {
+            displayDenoiser = new Denoiser(resolution, false /* albedo and normal */);
+            CUDA_CHECK(cudaMalloc(&displaySnapshotRGB,
+                                  resolution.x * resolution.y * sizeof(RGB)));
+            // The denoiser's stream must not synchronize with the default
+            // stream that rendering kernels are launched on.
+            CUDA_CHECK(cudaStreamCreateWithFlags(&denoiseStream, cudaStreamNonBlocking));
+            GPUNameStream(denoiseStream, "DISPLAY_DENOISE_STREAM");
+            CUDA_CHECK(cudaEventCreateWithFlags(&displaySnapshotEvent,
+                                                cudaEventDisableTiming));
+        }
 
         // Note that we can't just capture |this| for the member variables
         // below because with managed memory on Windows, the CPU and GPU
         // can't be accessing the same memory concurrently...
-        copyThread = new std::thread([exitCopyThread = this->exitCopyThread,
-                                      displayRGBHost = this->displayRGBHost,
+        copyThread = new std::thread([readback = this->displayReadback,
                                       displayRGB = this->displayRGB, resolution]() {
             GPURegisterThread("DISPLAY_SERVER_COPY_THREAD");
 
-            // Copy back to the CPU using a separate stream so that we can
-            // periodically but asynchronously pick up the latest results
-            // from the GPU.
+            // Copy back to the CPU using a separate stream so that copies
+            // can overlap with the rendering kernels.
             cudaStream_t memcpyStream;
-            CUDA_CHECK(cudaStreamCreate(&memcpyStream));
+            CUDA_CHECK(cudaStreamCreateWithFlags(&memcpyStream, cudaStreamNonBlocking));
             GPUNameStream(memcpyStream, "DISPLAY_SERVER_COPY_STREAM");
 
-            // Copy back to the host from the GPU buffer, without any
-            // synthronization.
-            while (!*exitCopyThread) {
-                CUDA_CHECK(cudaMemcpyAsync(displayRGBHost, displayRGB,
+            int64_t copiedUpdates = 0;
+            while (true) {
+                // Wait until there's a new image or it's time to exit
+                std::unique_lock<std::mutex> lock(readback->mutex);
+                readback->cv.wait(lock, [&]() {
+                    return readback->exit || readback->updates != copiedUpdates;
+                });
+                if (readback->updates == copiedUpdates)
+                    break;
+                copiedUpdates = readback->updates;
+                lock.unlock();
+
+                // Copy the image into the back buffer once the GPU has
+                // finished writing it and then make that the front buffer.
+                int back = 1 - readback->front;
+                CUDA_CHECK(cudaStreamWaitEvent(memcpyStream, readback->readyEvent, 0));
+                CUDA_CHECK(cudaMemcpyAsync(readback->host[back], displayRGB,
                                            resolution.x * resolution.y * sizeof(RGB),
                                            cudaMemcpyDeviceToHost, memcpyStream));
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-
                 CUDA_CHECK(cudaStreamSynchronize(memcpyStream));
+                readback->front = back;
+                readback->copyPending = false;
             }
-
-            // Copy one more time to get the final image before exiting.
-            CUDA_CHECK(cudaMemcpy(displayRGBHost, displayRGB,
-                                  resolution.x * resolution.y * sizeof(RGB),
-                                  cudaMemcpyDeviceToHost));
-            CUDA_CHECK(cudaDeviceSynchronize());
+            CUDA_CHECK(cudaStreamDestroy(memcpyStream));
         });
 
         // Now on the CPU side, give the display system a lambda that
-        // copies values from |displayRGBHost| into its buffers used for
-        // sending messages to the display program (i.e., tev).
+        // copies values from the front host buffer into its buffers used
+        // for sending messages to the display program (i.e., tev).
         DisplayDynamic(
             film.GetFilename(), {resolution.x, resolution.y}, {"R", "G", "B"},
-            [resolution, this](Bounds2i b, pstd::span<pstd::span<float>> displayValue) {
+            [resolution, readback = this->displayReadback](
+                Bounds2i b, pstd::span<pstd::span<float>> displayValue) {
+                const RGB *rgbHost = readback->host[readback->front];
                 int index = 0;
                 for (Point2i p : b) {
-                    RGB rgb = displayRGBHost[p.x + p.y * resolution.x];
+                    RGB rgb = rgbHost[p.x + p.y * resolution.x];
                     displayValue[0][index] = rgb.r;
                     displayValue[1][index] = rgb.g;
                     displayValue[2][index] = rgb.b;
@@ -720,13 +1224,43 @@ void WavefrontPathIntegrator::StartDisplayThread() {
 
 void WavefrontPathIntegrator::UpdateDisplayRGBFromFilm(Bounds2i pixelBounds) {
 #ifdef PBRT_BUILD_GPU_RENDERER
+    // Don't wait for the previous update to be denoised and copied back to
+    // the host; skip this one instead so that rendering isn't stalled.
+    if (displayReadback->copyPending) {
+        ++nDisplayUpdatesSkipped;
+        return;
+    }
+
     Vector2i resolution = pixelBounds.Diagonal();
+    RGB *rgb = displayDenoiser ? displaySnapshotRGB : displayRGB;
     GPUParallelFor(
         "Update Display RGB Buffer", resolution.x * resolution.y,
         PBRT_CPU_GPU_LAMBDA(int index) {
             Point2i p(index % resolution.x, index / resolution.x);
-            displayRGB[index] = film.GetPixelRGB(p + pixelBounds.pMin);
+            rgb[index] = film.GetPixelRGB(p + pixelBounds.pMin);
         });
+
+    cudaStream_t readyStream = GPULaunchStream();
+    if (displayDenoiser) {
+        // Denoise the snapshot on the denoiser's stream once it has been
+        // written; rendering of the next sample proceeds concurrently.
+        CUDA_CHECK(cudaEventRecord(displaySnapshotEvent, GPULaunchStream()));
+        CUDA_CHECK(cudaStreamWaitEvent(denoiseStream, displaySnapshotEvent, 0));
+        displayDenoiser->Denoise(displaySnapshotRGB, nullptr, nullptr, displayRGB,
+                                 denoiseStream);
+        readyStream = denoiseStream;
+        ++nDisplayImagesDenoised;
+    }
+
+    // Let the copy thread know that |displayRGB| will be ready once the
+    // work issued above has finished.
+    CUDA_CHECK(cudaEventRecord(displayReadback->readyEvent, readyStream));
+    displayReadback->copyPending = true;
+    {
+        std::lock_guard<std::mutex> lock(displayReadback->mutex);
+        ++displayReadback->updates;
+    }
+    displayReadback->cv.notify_one();
 #endif  //  PBRT_BUILD_GPU_RENDERER
 }
 
@@ -736,7 +1270,16 @@ void WavefrontPathIntegrator::StopDisplayThread() {
         // Wait until rendering is all done before we start to shut down the
         // display stuff..
         if (!Options->displayServer.empty()) {
-            *exitCopyThread = true;
+            // Make sure that the final image is the one that's displayed.
+            while (displayReadback->copyPending)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            UpdateDisplayRGBFromFilm(film.PixelBounds());
+            {
+                std::lock_guard<std::mutex> lock(displayReadback->mutex);
+                displayReadback->exit = true;
+            }
+            displayReadback->cv.notify_one();
+
             copyThread->join();
             delete copyThread;
             copyThread = nullptr;
@@ -750,13 +1293,22 @@ void WavefrontPathIntegrator::StopDisplayThread() {
 }
 
 void WavefrontPathIntegrator::UpdateFramebufferFromFilm(Bounds2i pixelBounds,
-                                                        Float exposure, RGB *rgb) {
+                                                        int stride, Float exposure,
+                                                        RGB *rgb) {
+    // Only the pixels at multiples of _stride_ from the corner of
+    // _pixelBounds_ have been sampled; each one's value is used for the
+    // block of pixels that it covers.
     Vector2i resolution = pixelBounds.Diagonal();
     ParallelFor(
         "Update framebuffer", resolution.x * resolution.y,
         PBRT_CPU_GPU_LAMBDA(int index) {
-            Point2i p(index % resolution.x, index / resolution.x);
-            rgb[index] = exposure * film.GetPixelRGB(p + film.PixelBounds().pMin);
+            Vector2i offset(index % resolution.x, index / resolution.x);
+            Point2i pPixel = pixelBounds.pMin + offset;
+            Point2i pSampled = pixelBounds.pMin + stride * (offset / stride);
+            Bounds2i filmBounds = film.PixelBounds();
+            Vector2i fb = pPixel - filmBounds.pMin;
+            int width = filmBounds.pMax.x - filmBounds.pMin.x;
+            rgb[fb.y * width + fb.x] = exposure * film.GetPixelRGB(pSampled);
         });
 }
 
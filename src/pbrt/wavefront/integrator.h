@@ -27,6 +27,10 @@ namespace pbrt {
 
 class BasicScene;
 class GUI;
+struct ImageMetadata;
+#ifdef PBRT_BUILD_GPU_RENDERER
+class Denoiser;
+#endif  // PBRT_BUILD_GPU_RENDERER
 
 // WavefrontAggregate Definition
 class WavefrontAggregate {
@@ -59,9 +63,19 @@ class WavefrontPathIntegrator {
     // WavefrontPathIntegrator Public Methods
     Float Render();
 
-    void GenerateCameraRays(int y0, Transform movingFromcamera, int sampleIndex);
+    // Traces the paths of camera rays for the rows of _sampleBounds_ that
+    // fit in the queues, starting with the _y0_th one, and adds their
+    // radiance to the film.
+    void RenderPass(int y0, Bounds2i sampleBounds, int stride,
+                    Transform movingFromCamera, int sampleIndex);
+
+    // Camera rays are generated for the pixels of _sampleBounds_ at multiples
+    // of _stride_ from its corner, starting with the _y0_th row of them.
+    void GenerateCameraRays(int y0, Bounds2i sampleBounds, int stride,
+                            Transform movingFromcamera, int sampleIndex);
     template <typename Sampler>
-    void GenerateCameraRays(int y0, Transform movingFromCamera, int sampleIndex);
+    void GenerateCameraRays(int y0, Bounds2i sampleBounds, int stride,
+                            Transform movingFromCamera, int sampleIndex);
 
     void GenerateRaySamples(int wavefrontDepth, int sampleIndex);
     template <typename Sampler>
@@ -69,6 +83,9 @@ class WavefrontPathIntegrator {
 
     void TraceShadowRays(int wavefrontDepth);
     void SampleMediumInteraction(int wavefrontDepth);
+    template <typename ConcreteMedium>
+    void SampleMediumInteraction(int wavefrontDepth);
+    void HandleMediumTransmission(int wavefrontDepth);
     template <typename PhaseFunction>
     void SampleMediumScattering(int wavefrontDepth);
     void SampleSubsurface(int wavefrontDepth);
@@ -85,9 +102,38 @@ class WavefrontPathIntegrator {
 
     void UpdateFilm();
 
+    // "sppm" integrator methods
+    // Traces the _iteration_th set of photons from the lights and gathers
+    // them at the visible points of the camera paths just traced.
+    void TracePhotons(int iteration);
+    void GeneratePhotonRays(int firstPhoton, int iteration);
+    void ScatterPhotons(int wavefrontDepth, int iteration);
+    template <typename ConcreteMaterial>
+    void ScatterPhotons(int wavefrontDepth, int iteration);
+    template <typename ConcreteMaterial, typename TextureEvaluator>
+    void ScatterPhotons(MaterialEvalQueue *evalQueue, int wavefrontDepth,
+                        int iteration);
+    void BuildSPPMGrid();
+    void UpdateSPPMPixels();
+    void WriteSPPMImage(ImageMetadata metadata);
+
+    PBRT_CPU_GPU
+    int SPPMPixelIndex(Point2i pPixel) const {
+        Bounds2i pixelBounds = film.PixelBounds();
+        Vector2i p = pPixel - pixelBounds.pMin;
+        return p.y * (pixelBounds.pMax.x - pixelBounds.pMin.x) + p.x;
+    }
+    // Returns the index of the SPPM hash grid cell that contains _p_
+    PBRT_CPU_GPU
+    int SPPMGridCell(Point3i p) const { return Hash(p) % sppmHashSize; }
+
     WavefrontPathIntegrator(pstd::pmr::memory_resource *memoryResource,
                             BasicScene &scene);
 
+    // Allocates the pixel sample state and the work queues, sized for
+    // _queueSize_ rays, and sets _maxQueueSize_ accordingly.
+    void AllocateQueues(int queueSize, Allocator alloc);
+
     template <typename F>
     void ParallelFor(const char *description, int nItems, F &&func) {
         if (Options->useGPU)
@@ -96,8 +142,17 @@ class WavefrontPathIntegrator {
 #else
             LOG_FATAL("Options->useGPU was set without PBRT_BUILD_GPU_RENDERER enabled");
 #endif
-        else
-            pbrt::ParallelFor(0, nItems, func);
+        else {
+            int nGroups = (nItems + CPUWorkGroupSize - 1) / CPUWorkGroupSize;
+            pbrt::ParallelFor(
+                0, nGroups,
+                [&](int64_t startGroup, int64_t endGroup) {
+                    int end = std::min<int64_t>(nItems, endGroup * CPUWorkGroupSize);
+                    for (int i = startGroup * CPUWorkGroupSize; i < end; ++i)
+                        func(i);
+                },
+                &typeid(F));
+        }
     }
 
     template <typename F>
@@ -129,23 +184,42 @@ class WavefrontPathIntegrator {
     void StopDisplayThread();
 
     // --interactive support
-    void UpdateFramebufferFromFilm(Bounds2i pixelBounds, Float exposure, RGB *rgb);
+    void UpdateFramebufferFromFilm(Bounds2i pixelBounds, int stride, Float exposure,
+                                   RGB *rgb);
+
+    // --watch support
+    bool SceneFilesChanged();
+    bool ReloadMaterialsAndLights();
 
     // WavefrontPathIntegrator Member Variables
     bool initializeVisibleSurface;
     bool haveSubsurface;
     bool haveMedia;
+    pstd::array<bool, Medium::NumTags()> haveMediumType;
     pstd::array<bool, Material::NumTags()> haveBasicEvalMaterial;
     pstd::array<bool, Material::NumTags()> haveUniversalEvalMaterial;
 
     struct Stats {
-        Stats(int maxDepth, Allocator alloc);
-
-        std::string Print() const;
+        Stats(int maxDepth, int queueCapacity, Allocator alloc);
+
+        // |seconds| is the rendering time, used to report ray throughput
+        std::string Print(Float seconds) const;
+        std::string ToJSON(Float seconds) const;
+        uint64_t TotalRays() const;
+        // Adds the counts in |s| to these and takes the maximum of the peaks
+        void Add(const Stats &s);
+        void Reset();
+        // Average and peak fraction of the ray queue used at the given depth
+        Float AverageOccupancy(int depth) const;
+        Float PeakOccupancy(int depth) const;
 
         // Note: not atomics: tid 0 always updates them for everyone...
-        uint64_t cameraRays = 0;
+        uint64_t cameraRays = 0, passes = 0;
         pstd::vector<uint64_t> indirectRays, shadowRays;
+        // Largest number of rays in a single pass at each depth, where depth
+        // zero holds camera rays
+        pstd::vector<uint64_t> peakRays;
+        int queueCapacity;
     };
     Stats *stats;
 
@@ -159,11 +233,28 @@ class WavefrontPathIntegrator {
     LightSampler lightSampler;
 
     int maxDepth, samplesPerPixel;
+    // Samples per pixel taken by Render(), which may be fewer than
+    // _samplesPerPixel_ with --time-limit
+    int samplesRendered = 0;
     bool regularize;
+    // Sort material evaluation work by material and texture coordinates
+    bool sortMaterials;
+    // Number of light samples resampled to choose each shadow ray
+    int lightCandidates;
 
     int scanlinesPerPass, maxQueueSize;
 
+    // On the CPU, each wave of samples is split into chunks of whole rows
+    // that run all of their stages on a single thread, so that their queues
+    // stay in its cache, rather than running each stage across all threads
+    // for the whole pass. Each thread uses its own copy of the integrator
+    // with queues for _chunkQueueSize_ rays. Zero disables this.
+    int chunkQueueSize = 0;
+    ThreadLocal<WavefrontPathIntegrator *> *chunkIntegrators = nullptr;
+
     SOA<PixelSampleState> pixelSampleState;
+    // Only allocated if _initializeVisibleSurface_ is true
+    SOA<VisibleSurface> visibleSurfaces;
 
     RayQueue *rayQueues[2];
 
@@ -176,6 +267,8 @@ class WavefrontPathIntegrator {
 
     HitAreaLightQueue *hitAreaLightQueue = nullptr;
 
+    // Storage for the work items of both material evaluation queues
+    WorkQueue<MaterialEvalWorkItem<void>> *materialEvalItems = nullptr;
     MaterialEvalQueue *basicEvalMaterialQueue = nullptr;
     MaterialEvalQueue *universalEvalMaterialQueue = nullptr;
 
@@ -184,9 +277,39 @@ class WavefrontPathIntegrator {
     GetBSSRDFAndProbeRayQueue *bssrdfEvalQueue = nullptr;
     SubsurfaceScatterQueue *subsurfaceScatterQueue = nullptr;
 
-    RGB *displayRGB = nullptr, *displayRGBHost = nullptr;
-    std::atomic<bool> *exitCopyThread;
-    std::thread *copyThread;
+    // With the "sppm" integrator, camera paths end at their first diffuse
+    // vertex, which is recorded as the visible point of the film pixel in
+    // _sppmPixels_, and each sample index's camera paths are followed by
+    // _photonsPerIteration_ photon paths. Visible points are found from
+    // photons' vertices using a hash grid of cubic cells, which are as wide as
+    // the visible points' initial diameter; the entries in each cell form a
+    // linked list, starting with the entry in _sppmGridCells_.
+    SPPMPixel *sppmPixels = nullptr;
+    LightSampler photonLightSampler;
+    int photonsPerIteration = 0;
+    Float sppmCellSize = 0;
+    int sppmHashSize = 0;
+    AtomicInt *sppmGridCells = nullptr;
+    SPPMGridEntry *sppmGridEntries = nullptr;
+    AtomicInt *sppmGridEntryCount = nullptr;
+
+    RGB *displayRGB = nullptr;
+    std::thread *copyThread = nullptr;
+#ifdef PBRT_BUILD_GPU_RENDERER
+    // With --gpu-denoise-display, film snapshots are denoised into
+    // |displayRGB| on a separate stream while rendering continues.
+    Denoiser *displayDenoiser = nullptr;
+    RGB *displaySnapshotRGB = nullptr;
+    cudaStream_t denoiseStream;
+    cudaEvent_t displaySnapshotEvent;
+#endif  // PBRT_BUILD_GPU_RENDERER
+
+    // Held by pointer so that the integrator can still be captured by value
+    // in GPU kernels.
+    struct ReloadState;
+    ReloadState *reloadState = nullptr;
+    struct DisplayReadback;
+    DisplayReadback *displayReadback = nullptr;
 };
 
 }  // namespace pbrt
@@ -197,17 +197,20 @@ inline PBRT_CPU_GPU void TraceTransmittance(ShadowRayWorkItem sr,
             Float tEnd = !result.hit
                              ? tMax
                              : (Distance(ray.o, Point3f(result.pHit)) / Length(ray.d));
-            SampledSpectrum T_maj = SampleT_maj(
-                ray, tEnd, rng.Uniform<Float>(), rng, lambda,
+            SampledSpectrum T_rmaj;
+            SampledSpectrum T_maj = SampleResidualT_maj(
+                ray, tEnd, rng.Uniform<Float>(), rng, lambda, &T_rmaj,
                 [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
-                    SampledSpectrum T_maj) {
+                    SampledSpectrum sigma_rmaj, SampledSpectrum T_maj,
+                    SampledSpectrum T_rmaj) {
                     SampledSpectrum sigma_n =
                         ClampZero(sigma_maj - mp.sigma_a - mp.sigma_s);
 
-                    // ratio-tracking: only evaluate null scattering
-                    Float pr = T_maj[0] * sigma_maj[0];
+                    // residual ratio-tracking: only evaluate null scattering
+                    // with respect to the residual majorant
+                    Float pr = T_rmaj[0] * sigma_rmaj[0];
                     T_ray *= T_maj * sigma_n / pr;
-                    r_l *= T_maj * sigma_maj / pr;
+                    r_l *= T_rmaj * sigma_rmaj / pr;
                     r_u *= T_maj * sigma_n / pr;
 
                     // Possibly terminate transmittance computation using Russian roulette
@@ -235,9 +238,9 @@ inline PBRT_CPU_GPU void TraceTransmittance(ShadowRayWorkItem sr,
 
                     return true;
                 });
-            T_ray *= T_maj / T_maj[0];
-            r_l *= T_maj / T_maj[0];
-            r_u *= T_maj / T_maj[0];
+            T_ray *= T_maj / T_rmaj[0];
+            r_l *= T_rmaj / T_rmaj[0];
+            r_u *= T_maj / T_rmaj[0];
         }
 
         if (!result.hit || !T_ray)
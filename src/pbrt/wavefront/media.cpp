@@ -8,6 +8,16 @@
 
 namespace pbrt {
 
+// SampleMediumInteractionCallback Definition
+struct SampleMediumInteractionCallback {
+    int wavefrontDepth;
+    WavefrontPathIntegrator *integrator;
+    template <typename ConcreteMedium>
+    void operator()() {
+        integrator->SampleMediumInteraction<ConcreteMedium>(wavefrontDepth);
+    }
+};
+
 // SampleMediumScatteringCallback Definition
 struct SampleMediumScatteringCallback {
     int wavefrontDepth;
@@ -23,23 +33,45 @@ void WavefrontPathIntegrator::SampleMediumInteraction(int wavefrontDepth) {
     if (!haveMedia)
         return;
 
-    RayQueue *nextRayQueue = NextRayQueue(wavefrontDepth);
+    ForEachType(SampleMediumInteractionCallback{wavefrontDepth, this}, Medium::Types());
+    HandleMediumTransmission(wavefrontDepth);
+
+    if (wavefrontDepth == maxDepth)
+        return;
+
+    ForEachType(SampleMediumScatteringCallback{wavefrontDepth, this},
+                PhaseFunction::Types());
+}
+
+template <typename ConcreteMedium>
+void WavefrontPathIntegrator::SampleMediumInteraction(int wavefrontDepth) {
+    if (!haveMediumType[Medium::TypeIndex<ConcreteMedium>()])
+        return;
+
+    std::string desc =
+        std::string("Sample medium interaction - ") + ConcreteMedium::Name();
     ForAllQueued(
-        "Sample medium interaction", mediumSampleQueue, maxQueueSize,
-        PBRT_CPU_GPU_LAMBDA(MediumSampleWorkItem w) {
-            Ray ray = w.ray;
-            Float tMax = w.tMax;
+        desc.c_str(), mediumSampleQueue->Get<ConcreteMedium>(), maxQueueSize,
+        PBRT_CPU_GPU_LAMBDA(const MediumSampleIndex<ConcreteMedium> entry) {
+            // Read the ray's state; the surface it hit, if any, is only
+            // needed by _HandleMediumTransmission()_
+            int index = entry.index;
+            Ray ray = mediumSampleQueue->ray[index];
+            Float tMax = mediumSampleQueue->tMax[index];
+            int depth = mediumSampleQueue->depth[index];
+            int pixelIndex = mediumSampleQueue->pixelIndex[index];
+            Float etaScale = mediumSampleQueue->etaScale[index];
 
             PBRT_DBG("Sampling medium interaction pixel index %d depth %d ray %f %f %f d "
                      "%f %f "
                      "%f tMax %f\n",
-                     w.pixelIndex, w.depth, ray.o.x, ray.o.y, ray.o.z, ray.d.x, ray.d.y,
+                     pixelIndex, depth, ray.o.x, ray.o.y, ray.o.z, ray.d.x, ray.d.y,
                      ray.d.z, tMax);
 
-            SampledWavelengths lambda = w.lambda;
-            SampledSpectrum beta = w.beta;
-            SampledSpectrum r_u = w.r_u;
-            SampledSpectrum r_l = w.r_l;
+            SampledWavelengths lambda = mediumSampleQueue->lambda[index];
+            SampledSpectrum beta = mediumSampleQueue->beta[index];
+            SampledSpectrum r_u = mediumSampleQueue->r_u[index];
+            SampledSpectrum r_l = mediumSampleQueue->r_l[index];
             SampledSpectrum L(0.f);
             RNG rng(Hash(ray.o, tMax), Hash(ray.d));
 
@@ -54,11 +86,10 @@ void WavefrontPathIntegrator::SampleMediumInteraction(int wavefrontDepth) {
             // transmission function based on the majorant.
             bool scattered = false;
 
-            RaySamples raySamples = pixelSampleState.samples[w.pixelIndex];
             Float uDist = rng.Uniform<Float>();
             Float uMode = rng.Uniform<Float>();
 
-            SampledSpectrum T_maj = SampleT_maj(
+            SampledSpectrum T_maj = SampleT_maj<ConcreteMedium>(
                 ray, tMax, uDist, rng, lambda,
                 [&](Point3f p, MediumProperties mp, SampledSpectrum sigma_maj,
                     SampledSpectrum T_maj) {
@@ -72,7 +103,7 @@ void WavefrontPathIntegrator::SampleMediumInteraction(int wavefrontDepth) {
                     // Add emission, if present.  Always do this and scale
                     // by sigma_a/sigma_maj rather than only doing it
                     // (without scaling) at absorption events.
-                    if (w.depth < maxDepth && mp.Le) {
+                    if (depth < maxDepth && mp.Le) {
                         Float pr = sigma_maj[0] * T_maj[0];
                         SampledSpectrum r_e = r_u * sigma_maj * T_maj / pr;
 
@@ -110,8 +141,8 @@ void WavefrontPathIntegrator::SampleMediumInteraction(int wavefrontDepth) {
                             using PhaseFunction = typename std::remove_const_t<
                                 std::remove_reference_t<decltype(*ptr)>>;
                             mediumScatterQueue->Push(MediumScatterWorkItem<PhaseFunction>{
-                                p, w.depth, lambda, beta, r_u, ptr, -ray.d, ray.time,
-                                w.etaScale, ray.medium, w.pixelIndex});
+                                p, depth, lambda, beta, r_u, ptr, -ray.d, ray.time,
+                                etaScale, ray.medium, pixelIndex});
                         };
                         DCHECK_RARE(1e-6f, !beta);
                         if (beta && r_u)
@@ -152,18 +183,34 @@ void WavefrontPathIntegrator::SampleMediumInteraction(int wavefrontDepth) {
 
             // Add any emission found to its pixel sample's L value.
             if (L) {
-                SampledSpectrum Lp = pixelSampleState.L[w.pixelIndex];
-                pixelSampleState.L[w.pixelIndex] = Lp + L;
+                SampledSpectrum Lp = pixelSampleState.L[pixelIndex];
+                pixelSampleState.L[pixelIndex] = Lp + L;
                 PBRT_DBG("Added emitted radiance %f %f %f %f at pixel index %d\n", L[0],
-                         L[1], L[2], L[3], w.pixelIndex);
+                         L[1], L[2], L[3], pixelIndex);
             }
 
-            // There's no more work to do if there was a scattering event in
-            // the medium.
-            if (scattered || !beta || !r_u || w.depth == maxDepth)
+            // Rays that scattered, were absorbed, or reached the maximum depth
+            // are done; the rest continue at the surface that they hit.
+            if (scattered || !beta || !r_u || depth == maxDepth)
                 return;
 
-            // Otherwise, enqueue bump and medium stuff...
+            mediumSampleQueue->beta[index] = beta;
+            mediumSampleQueue->r_u[index] = r_u;
+            mediumSampleQueue->r_l[index] = r_l;
+            mediumSampleQueue->Transmitted()->Push(MediumSampleIndex<void>{index});
+        });
+}
+
+void WavefrontPathIntegrator::HandleMediumTransmission(int wavefrontDepth) {
+    RayQueue *nextRayQueue = NextRayQueue(wavefrontDepth);
+    ForAllQueued(
+        "Handle medium transmission", mediumSampleQueue->Transmitted(), maxQueueSize,
+        PBRT_CPU_GPU_LAMBDA(const MediumSampleIndex<void> entry) {
+            const MediumSampleWorkItem w = (*mediumSampleQueue)[entry.index];
+            Ray ray = w.ray;
+            SampledWavelengths lambda = w.lambda;
+            SampledSpectrum beta = w.beta, r_u = w.r_u, r_l = w.r_l;
+
             // FIXME: this is all basically duplicate code w/optix.cu
             if (w.tMax == Infinity) {
                 // no intersection
@@ -222,38 +269,31 @@ void WavefrontPathIntegrator::SampleMediumInteraction(int wavefrontDepth) {
 
             auto enqueue = [=](auto ptr) {
                 using Material = typename std::remove_reference_t<decltype(*ptr)>;
-                q->Push<MaterialEvalWorkItem<Material>>(
-                    MaterialEvalWorkItem<Material>{ptr,
-                                                   w.pi,
-                                                   w.n,
-                                                   w.dpdu,
-                                                   w.dpdv,
-                                                   ray.time,
-                                                   w.depth,
-                                                   w.ns,
-                                                   w.dpdus,
-                                                   w.dpdvs,
-                                                   w.dndus,
-                                                   w.dndvs,
-                                                   w.uv,
-                                                   w.faceIndex,
-                                                   lambda,
-                                                   w.pixelIndex,
-                                                   w.anyNonSpecularBounces,
-                                                   -ray.d,
-                                                   beta,
-                                                   r_u,
-                                                   w.etaScale,
-                                                   w.mediumInterface});
+                q->Push(MaterialEvalWorkItem<Material>{ptr,
+                                                       w.pi,
+                                                       w.n,
+                                                       w.dpdu,
+                                                       w.dpdv,
+                                                       ray.time,
+                                                       w.depth,
+                                                       w.ns,
+                                                       w.dpdus,
+                                                       w.dpdvs,
+                                                       w.dndus,
+                                                       w.dndvs,
+                                                       w.uv,
+                                                       w.faceIndex,
+                                                       lambda,
+                                                       w.pixelIndex,
+                                                       w.anyNonSpecularBounces,
+                                                       -ray.d,
+                                                       beta,
+                                                       r_u,
+                                                       w.etaScale,
+                                                       w.mediumInterface});
             };
             material.Dispatch(enqueue);
         });
-
-    if (wavefrontDepth == maxDepth)
-        return;
-
-    ForEachType(SampleMediumScatteringCallback{wavefrontDepth, this},
-                PhaseFunction::Types());
 }
 
 template <typename ConcretePhaseFunction>
@@ -0,0 +1,302 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/base/bxdf.h>
+#include <pbrt/bxdfs.h>
+#include <pbrt/cameras.h>
+#include <pbrt/film.h>
+#include <pbrt/interaction.h>
+#include <pbrt/lights.h>
+#include <pbrt/materials.h>
+#include <pbrt/options.h>
+#include <pbrt/textures.h>
+#include <pbrt/util/check.h>
+#include <pbrt/util/containers.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/lowdiscrepancy.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/spectrum.h>
+#include <pbrt/util/stats.h>
+#include <pbrt/util/vecmath.h>
+#include <pbrt/wavefront/integrator.h>
+
+#include <type_traits>
+
+namespace pbrt {
+
+STAT_COUNTER("Wavefront/Photon paths", nPhotonPaths);
+
+// ScatterPhotonsCallback Definition
+struct ScatterPhotonsCallback {
+    int wavefrontDepth, iteration;
+    WavefrontPathIntegrator *integrator;
+    // ScatterPhotonsCallback Public Methods
+    template <typename ConcreteMaterial>
+    void operator()() {
+        if constexpr (!std::is_same_v<ConcreteMaterial, MixMaterial>)
+            integrator->ScatterPhotons<ConcreteMaterial>(wavefrontDepth, iteration);
+    }
+};
+
+// WavefrontPathIntegrator SPPM Methods
+void WavefrontPathIntegrator::TracePhotons(int iteration) {
+    BuildSPPMGrid();
+
+    // Trace the photons in batches that fit in the ray queues
+    for (int firstPhoton = 0; firstPhoton < photonsPerIteration;
+         firstPhoton += maxQueueSize) {
+        GeneratePhotonRays(firstPhoton, iteration);
+
+        for (int wavefrontDepth = 0; wavefrontDepth < maxDepth; ++wavefrontDepth) {
+            RayQueue *nextQueue = NextRayQueue(wavefrontDepth);
+            Do(
+                "Reset queues before tracing photons", PBRT_CPU_GPU_LAMBDA() {
+                    nextQueue->Reset();
+                    hitAreaLightQueue->Reset();
+                    materialEvalItems->Reset();
+                    basicEvalMaterialQueue->Reset();
+                    universalEvalMaterialQueue->Reset();
+                });
+
+            // Photons that escape are dropped and emission at photons'
+            // intersections is ignored, so only the material queues are used
+            aggregate->IntersectClosest(maxQueueSize, CurrentRayQueue(wavefrontDepth),
+                                        nullptr, hitAreaLightQueue,
+                                        basicEvalMaterialQueue,
+                                        universalEvalMaterialQueue, nullptr, nextQueue);
+
+            ScatterPhotons(wavefrontDepth, iteration);
+        }
+    }
+    nPhotonPaths += photonsPerIteration;
+
+    UpdateSPPMPixels();
+}
+
+void WavefrontPathIntegrator::GeneratePhotonRays(int firstPhoton, int iteration) {
+    RayQueue *rayQueue = CurrentRayQueue(0);
+    Do(
+        "Reset photon ray queue", PBRT_CPU_GPU_LAMBDA() { rayQueue->Reset(); });
+
+    // Photons use the same wavelengths as the iteration's camera paths
+    Float uLambda =
+        Options->disableWavelengthJitter ? Float(0.5) : RadicalInverse(1, iteration);
+    int nPhotons = photonsPerIteration;
+    ParallelFor(
+        "Generate photon rays", maxQueueSize, PBRT_CPU_GPU_LAMBDA(int index) {
+            int photonIndex = firstPhoton + index;
+            if (photonIndex >= nPhotons)
+                return;
+            RNG rng(Hash(iteration, photonIndex, GetOptions().seed));
+
+            // Choose light to shoot photon from
+            pstd::optional<SampledLight> sampledLight =
+                photonLightSampler.Sample(rng.Uniform<Float>());
+            if (!sampledLight)
+                return;
+            Light light = sampledLight->light;
+
+            // Sample photon ray leaving light source and initialize its _beta_
+            SampledWavelengths lambda = film.SampleWavelengths(uLambda);
+            Point2f u0(rng.Uniform<Float>(), rng.Uniform<Float>());
+            Point2f u1(rng.Uniform<Float>(), rng.Uniform<Float>());
+            Float time = camera.SampleTime(rng.Uniform<Float>());
+            pstd::optional<LightLeSample> les = light.SampleLe(u0, u1, lambda, time);
+            if (!les || les->pdfPos == 0 || les->pdfDir == 0 || !les->L)
+                return;
+            SampledSpectrum beta = les->AbsCosTheta(les->ray.d) * les->L /
+                                   (sampledLight->p * les->pdfPos * les->pdfDir);
+            if (!beta)
+                return;
+
+            // Enqueue photon ray, using its pixel index for the photon's index
+            SampledSpectrum one(1.f);
+            rayQueue->PushIndirectRay(les->ray, 0, LightSampleContext(), beta, one, one,
+                                      lambda, 1.f, false, false, photonIndex);
+        });
+}
+
+void WavefrontPathIntegrator::ScatterPhotons(int wavefrontDepth, int iteration) {
+    ForEachType(ScatterPhotonsCallback{wavefrontDepth, iteration, this},
+                Material::Types());
+}
+
+template <typename ConcreteMaterial>
+void WavefrontPathIntegrator::ScatterPhotons(int wavefrontDepth, int iteration) {
+    int index = Material::TypeIndex<ConcreteMaterial>();
+    if (haveBasicEvalMaterial[index])
+        ScatterPhotons<ConcreteMaterial, BasicTextureEvaluator>(
+            basicEvalMaterialQueue, wavefrontDepth, iteration);
+    if (haveUniversalEvalMaterial[index])
+        ScatterPhotons<ConcreteMaterial, UniversalTextureEvaluator>(
+            universalEvalMaterialQueue, wavefrontDepth, iteration);
+}
+
+template <typename ConcreteMaterial, typename TextureEvaluator>
+void WavefrontPathIntegrator::ScatterPhotons(MaterialEvalQueue *evalQueue,
+                                             int wavefrontDepth, int iteration) {
+    // Add photons' contributions to visible points and sample their next rays
+    std::string desc = StringPrintf(
+        "%s photon scattering (%s tex)", ConcreteMaterial::Name(),
+        std::is_same_v<TextureEvaluator, BasicTextureEvaluator> ? "Basic" : "Universal");
+
+    RayQueue *nextRayQueue = NextRayQueue(wavefrontDepth);
+    ForAllQueued(
+        desc.c_str(), evalQueue->Get<ConcreteMaterial>(), maxQueueSize, nullptr,
+        PBRT_CPU_GPU_LAMBDA(const MaterialEvalIndex<ConcreteMaterial> entry) {
+            const MaterialEvalWorkItem<ConcreteMaterial> w = evalQueue->Item(entry);
+            Point3f p(w.pi);
+            if (w.depth > 0) {
+                // Add photon contribution to the visible points in its grid cell
+                int h = SPPMGridCell(Point3i(Floor(p / sppmCellSize)));
+                for (int e = sppmGridCells[h]; e != -1; e = sppmGridEntries[e].next) {
+                    const SPPMGridEntry &gridEntry = sppmGridEntries[e];
+                    if (DistanceSquared(gridEntry.p, p) > gridEntry.radiusSquared)
+                        continue;
+                    SPPMPixel &pixel = sppmPixels[gridEntry.pixelIndex];
+                    SampledSpectrum Phi = w.beta * pixel.bsdf.f(pixel.wo, w.wo);
+                    SampledWavelengths photonLambda = w.lambda;
+                    if (pixel.secondaryLambdaTerminated)
+                        photonLambda.TerminateSecondary();
+                    RGB Phi_i = film.ToOutputRGB(pixel.beta * Phi, photonLambda);
+                    for (int c = 0; c < 3; ++c)
+                        pixel.Phi_i[c].Add(Phi_i[c]);
+                    pixel.m.Add(1);
+                }
+            }
+
+            // Compute shading normal if bump or normal mapping is being used;
+            // photons don't have ray differentials, so textures aren't filtered
+            TextureEvaluator texEval;
+            Normal3f ns = w.ns;
+            Vector3f dpdus = w.dpdus;
+            FloatTexture displacement = w.material->GetDisplacement();
+            const Image *normalMap = w.material->GetNormalMap();
+            if (normalMap || displacement) {
+                NormalBumpEvalContext bctx = w.GetNormalBumpEvalContext(0, 0, 0, 0);
+                Vector3f dpdvs;
+                if (normalMap)
+                    NormalMap(*normalMap, bctx, &dpdus, &dpdvs);
+                else
+                    BumpMap(texEval, displacement, bctx, &dpdus, &dpdvs);
+                ns = FaceForward(Normal3f(Normalize(Cross(dpdus, dpdvs))), w.n);
+            }
+
+            // Get BSDF at photon intersection point
+            SampledWavelengths lambda = w.lambda;
+            MaterialEvalContext ctx = w.GetMaterialEvalContext(0, 0, 0, 0, ns, dpdus);
+            using ConcreteBxDF = typename ConcreteMaterial::BxDF;
+            ConcreteBxDF bxdf = w.material->GetBxDF(texEval, ctx, lambda);
+            BSDF bsdf(ctx.ns, ctx.dpdus, &bxdf);
+
+            // Sample BSDF for the photon's next direction
+            RNG rng(Hash(iteration, w.pixelIndex, w.depth, GetOptions().seed));
+            Float uc = rng.Uniform<Float>();
+            Point2f u(rng.Uniform<Float>(), rng.Uniform<Float>());
+            pstd::optional<BSDFSample> bs =
+                bsdf.Sample_f<ConcreteBxDF>(w.wo, uc, u, TransportMode::Importance);
+            if (!bs)
+                return;
+            SampledSpectrum beta = w.beta * bs->f * AbsDot(bs->wi, ns) / bs->pdf;
+
+            // Possibly terminate photon path with Russian roulette
+            Float betaRatio = beta.MaxComponentValue() / w.beta.MaxComponentValue();
+            Float q = std::max<Float>(0, 1 - betaRatio);
+            if (rng.Uniform<Float>() < q)
+                return;
+            beta /= 1 - q;
+
+            // Enqueue photon's next ray
+            Ray ray = SpawnRay(w.pi, w.n, w.time, bs->wi);
+            LightSampleContext prevIntrCtx(w.pi, w.n, ns);
+            nextRayQueue->PushIndirectRay(ray, w.depth + 1, prevIntrCtx, beta, w.r_u,
+                                          w.r_u, lambda, w.etaScale, bs->IsSpecular(),
+                                          true, w.pixelIndex);
+        });
+}
+
+void WavefrontPathIntegrator::BuildSPPMGrid() {
+    // Reset the grid's cells and entries
+    ParallelFor(
+        "Reset SPPM grid cells", sppmHashSize,
+        PBRT_CPU_GPU_LAMBDA(int h) { sppmGridCells[h] = -1; });
+    Do(
+        "Reset SPPM grid entries", PBRT_CPU_GPU_LAMBDA() { *sppmGridEntryCount = 0; });
+
+    // Add visible points to the lists of the grid cells that they overlap
+    int nPixels = film.PixelBounds().Area();
+    ParallelFor(
+        "Add visible points to SPPM grid", nPixels, PBRT_CPU_GPU_LAMBDA(int pixelIndex) {
+            const SPPMPixel &pixel = sppmPixels[pixelIndex];
+            if (!pixel.beta)
+                return;
+            Float r = pixel.radius;
+            Point3i pMin(Floor((pixel.p - Vector3f(r, r, r)) / sppmCellSize));
+            Point3i pMax(Floor((pixel.p + Vector3f(r, r, r)) / sppmCellSize));
+            for (int z = pMin.z; z <= pMax.z; ++z)
+                for (int y = pMin.y; y <= pMax.y; ++y)
+                    for (int x = pMin.x; x <= pMax.x; ++x) {
+                        int e = sppmGridEntryCount->Add(1);
+                        DCHECK_LT(e, 8 * nPixels);
+                        int h = SPPMGridCell(Point3i(x, y, z));
+                        sppmGridEntries[e] = SPPMGridEntry{
+                            pixel.p, Sqr(r), pixelIndex, sppmGridCells[h].Exchange(e)};
+                    }
+        });
+}
+
+void WavefrontPathIntegrator::UpdateSPPMPixels() {
+    int nPixels = film.PixelBounds().Area();
+    ParallelFor(
+        "Update SPPM pixels", nPixels, PBRT_CPU_GPU_LAMBDA(int pixelIndex) {
+            SPPMPixel &p = sppmPixels[pixelIndex];
+            if (int m = p.m; m > 0) {
+                // Compute new photon count and search radius given photons
+                Float gamma = (Float)2 / (Float)3;
+                Float nNew = p.n + gamma * m;
+                Float rNew = p.radius * std::sqrt(nNew / (p.n + m));
+
+                // Update $\tau$ for pixel
+                RGB Phi_i(p.Phi_i[0], p.Phi_i[1], p.Phi_i[2]);
+                p.tau = (p.tau + Phi_i) * Sqr(rNew) / Sqr(p.radius);
+
+                // Set remaining pixel values for next photon pass
+                p.n = nNew;
+                p.radius = rNew;
+                p.m = 0;
+                for (int c = 0; c < 3; ++c)
+                    p.Phi_i[c] = 0;
+            }
+            // Reset visible point in pixel
+            p.beta = SampledSpectrum(0.f);
+        });
+}
+
+void WavefrontPathIntegrator::WriteSPPMImage(ImageMetadata metadata) {
+    // Add the photons' estimates of indirect lighting to the film's image,
+    // which holds the camera paths' direct lighting
+    Image image = film.GetImage(&metadata);
+    ImageChannelDesc rgbDesc = image.GetChannelDesc({"R", "G", "B"});
+    CHECK(rgbDesc);
+    Bounds2i pixelBounds = film.PixelBounds();
+    uint64_t np = uint64_t(samplesRendered) * uint64_t(photonsPerIteration);
+    if (np > 0)
+        ParallelFor2D(pixelBounds, [&](Point2i pPixel) {
+            const SPPMPixel &pixel = sppmPixels[SPPMPixelIndex(pPixel)];
+            RGB L = pixel.tau / (np * Pi * Sqr(pixel.radius));
+
+            Point2i pImage = Point2i(pPixel - pixelBounds.pMin);
+            ImageChannelValues values = image.GetChannels(pImage, rgbDesc);
+            for (int c = 0; c < 3; ++c)
+                values[c] += L[c];
+            image.SetChannels(pImage, rgbDesc, values);
+        });
+    image.Write(film.GetFilename(), metadata);
+}
+
+}  // namespace pbrt
@@ -13,14 +13,28 @@
 #include <pbrt/textures.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/containers.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/math.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/sampling.h>
 #include <pbrt/util/spectrum.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/util/vecmath.h>
 #include <pbrt/wavefront/integrator.h>
 
+#include <cmath>
+#include <cstdint>
+#include <new>
 #include <type_traits>
+#include <vector>
 
 namespace pbrt {
 
+STAT_COUNTER("Wavefront/Material work items sorted", materialItemsSorted);
+STAT_COUNTER("Wavefront/Material sorting time (us)", materialSortTimeUS);
+STAT_COUNTER("Wavefront/Material evaluation time (us)", materialEvalTimeUS);
+
 // EvaluateMaterialCallback Definition
 struct EvaluateMaterialCallback {
     int wavefrontDepth;
@@ -65,10 +79,37 @@ void WavefrontPathIntegrator::EvaluateMaterialAndBSDF(MaterialEvalQueue *evalQue
         std::is_same_v<TextureEvaluator, BasicTextureEvaluator> ? "Basic" : "Universal");
 
     RayQueue *nextRayQueue = NextRayQueue(wavefrontDepth);
-    auto queue = evalQueue->Get<MaterialEvalWorkItem<ConcreteMaterial>>();
+    auto queue = evalQueue->Get<ConcreteMaterial>();
+    // Optionally sort work items by material and then texture coordinates so
+    // that threads evaluate the same textures at nearby lookups together
+    std::vector<int> order;
+    if (sortMaterials) {
+        Timer timer;
+        int nItems = queue->Size();
+        const WorkQueue<MaterialEvalWorkItem<void>> *items = evalQueue->Items();
+        std::vector<uint64_t> keys(nItems);
+        pbrt::ParallelFor(0, nItems, [&](int64_t start, int64_t end) {
+            for (int64_t i = start; i < end; ++i) {
+                // Hash the material pointer to 16 bits and follow it with the
+                // Morton code of the $(u,v)$ fraction quantized to 8 bits
+                int item = queue->index[i];
+                uint32_t materialKey = MixBits(uintptr_t(items->material[item])) >> 48;
+                Point2f uv = items->uv[item];
+                uint32_t u = Clamp(256 * (uv[0] - std::floor(uv[0])), 0, 255);
+                uint32_t v = Clamp(256 * (uv[1] - std::floor(uv[1])), 0, 255);
+                uint64_t key = (materialKey << 16) | EncodeMorton2(u, v);
+                keys[i] = (key << 32) | uint64_t(i);
+            }
+        });
+        order = RadixSortedOrder(std::move(keys), 32);
+        materialSortTimeUS += int64_t(1e6 * timer.ElapsedSeconds());
+        materialItemsSorted += nItems;
+    }
+    Timer timer;
     ForAllQueued(
-        desc.c_str(), queue, maxQueueSize,
-        PBRT_CPU_GPU_LAMBDA(const MaterialEvalWorkItem<ConcreteMaterial> w) {
+        desc.c_str(), queue, maxQueueSize, order.empty() ? nullptr : order.data(),
+        PBRT_CPU_GPU_LAMBDA(const MaterialEvalIndex<ConcreteMaterial> entry) {
+            const MaterialEvalWorkItem<ConcreteMaterial> w = evalQueue->Item(entry);
             // Evaluate material and BSDF for ray intersection
             TextureEvaluator texEval;
             // Compute differentials for position and $(u,v)$ at intersection point
@@ -175,15 +216,33 @@ void WavefrontPathIntegrator::EvaluateMaterialAndBSDF(MaterialEvalQueue *evalQue
 
                 SampledSpectrum albedo = bsdf.rho(isect.wo, ucRho, uRho);
 
-                pixelSampleState.visibleSurface[w.pixelIndex] =
-                    VisibleSurface(isect, albedo, lambda);
+                visibleSurfaces[w.pixelIndex] = VisibleSurface(isect, albedo, lambda);
+            }
+
+            // With the "sppm" integrator, record the visible point and end the
+            // path at diffuse vertices and glossy ones at the last bounce
+            BxDFFlags flags = bsdf.Flags();
+            bool visiblePoint =
+                sppmPixels && (IsDiffuse(flags) ||
+                               (IsGlossy(flags) && w.depth == maxDepth - 1));
+            if (visiblePoint) {
+                Point2i pPixel = pixelSampleState.pPixel[w.pixelIndex];
+                SPPMPixel &pixel = sppmPixels[SPPMPixelIndex(pPixel)];
+                pixel.p = Point3f(w.pi);
+                pixel.wo = w.wo;
+                pixel.bsdf = BSDF(ctx.ns, ctx.dpdus, new (pixel.bxdf) ConcreteBxDF(bxdf));
+                pixel.beta = w.beta * pixelSampleState.cameraRayWeight[w.pixelIndex] /
+                             w.r_u.Average();
+                pixel.secondaryLambdaTerminated = lambda.SecondaryTerminated();
             }
 
             // Sample BSDF and enqueue indirect ray at intersection point
             Vector3f wo = w.wo;
             RaySamples raySamples = pixelSampleState.samples[w.pixelIndex];
-            pstd::optional<BSDFSample> bsdfSample = bsdf.Sample_f<ConcreteBxDF>(
-                wo, raySamples.indirect.uc, raySamples.indirect.u);
+            pstd::optional<BSDFSample> bsdfSample;
+            if (!visiblePoint)
+                bsdfSample = bsdf.Sample_f<ConcreteBxDF>(wo, raySamples.indirect.uc,
+                                                         raySamples.indirect.u);
             if (bsdfSample) {
                 // Compute updated path throughput and PDFs and enqueue indirect ray
                 Vector3f wi = bsdfSample->wi;
@@ -260,7 +319,6 @@ void WavefrontPathIntegrator::EvaluateMaterialAndBSDF(MaterialEvalQueue *evalQue
             }
 
             // Sample light and enqueue shadow ray at intersection point
-            BxDFFlags flags = bsdf.Flags();
             if (IsNonSpecular(flags)) {
                 // Choose a light source using the _LightSampler_
                 LightSampleContext ctx(w.pi, w.n, ns);
@@ -268,63 +326,102 @@ void WavefrontPathIntegrator::EvaluateMaterialAndBSDF(MaterialEvalQueue *evalQue
                     ctx.pi = OffsetRayOrigin(ctx.pi, w.n, wo);
                 else if (IsTransmissive(flags) && IsReflective(flags))
                     ctx.pi = OffsetRayOrigin(ctx.pi, w.n, -wo);
-                pstd::optional<SampledLight> sampledLight =
-                    lightSampler.Sample(ctx, raySamples.direct.uc);
-                if (!sampledLight)
-                    return;
-                Light light = sampledLight->light;
-
-                // Sample light source and evaluate BSDF for direct lighting
-                pstd::optional<LightLiSample> ls =
-                    light.SampleLi(ctx, raySamples.direct.u, lambda, true);
-                if (!ls || !ls->L || ls->pdf == 0)
-                    return;
-                Vector3f wi = ls->wi;
-                SampledSpectrum f = bsdf.f<ConcreteBxDF>(wo, wi);
-                if (!f)
+                // Returns the shadow ray work item for a light sample, if any
+                auto sampleLight =
+                    [&](Float uc, Point2f u) -> pstd::optional<ShadowRayWorkItem> {
+                    pstd::optional<SampledLight> sampledLight =
+                        lightSampler.Sample(ctx, uc);
+                    if (!sampledLight)
+                        return {};
+                    Light light = sampledLight->light;
+
+                    // Sample light source and evaluate BSDF for direct lighting
+                    pstd::optional<LightLiSample> ls =
+                        light.SampleLi(ctx, u, lambda, true);
+                    if (!ls || !ls->L || ls->pdf == 0)
+                        return {};
+                    Vector3f wi = ls->wi;
+                    SampledSpectrum f = bsdf.f<ConcreteBxDF>(wo, wi);
+                    if (!f)
+                        return {};
+
+                    // Compute path throughput and path PDFs for light sample
+                    SampledSpectrum beta = w.beta * f * AbsDot(wi, ns);
+                    PBRT_DBG("w.beta %f %f %f %f f %f %f %f %f dot %f\n", w.beta[0],
+                             w.beta[1], w.beta[2], w.beta[3], f[0], f[1], f[2], f[3],
+                             AbsDot(wi, ns));
+
+                    PBRT_DBG("me index %d depth %d beta %f %f %f %f f %f %f %f %f ls.L "
+                             "%f %f %f %f ls.pdf %f\n",
+                             w.pixelIndex, w.depth, beta[0], beta[1], beta[2], beta[3],
+                             f[0], f[1], f[2], f[3], ls->L[0], ls->L[1], ls->L[2],
+                             ls->L[3], ls->pdf);
+
+                    Float lightPDF = ls->pdf * sampledLight->p;
+                    // This causes r_u to be zero for the shadow ray, so that
+                    // part of MIS just becomes a no-op. Visible points' paths
+                    // don't continue, so their direct lighting is only sampled
+                    // from the lights.
+                    Float bsdfPDF = (IsDeltaLight(light.Type()) || visiblePoint)
+                                        ? 0.f
+                                        : bsdf.PDF<ConcreteBxDF>(wo, wi);
+                    SampledSpectrum r_u = w.r_u * bsdfPDF;
+                    SampledSpectrum r_l = w.r_u * lightPDF;
+
+                    // Return shadow ray with tentative radiance contribution
+                    SampledSpectrum Ld = beta * ls->L;
+                    Ray ray = SpawnRayTo(w.pi, w.n, w.time, ls->pLight.pi, ls->pLight.n);
+                    // Initialize _ray_ medium if media are present
+                    if (haveMedia)
+                        ray.medium = Dot(ray.d, w.n) > 0 ? w.mediumInterface.outside
+                                                         : w.mediumInterface.inside;
+                    return ShadowRayWorkItem{ray, 1 - ShadowEpsilon, lambda, Ld,
+                                             r_u,  r_l,              w.pixelIndex};
+                };
+
+                pstd::optional<ShadowRayWorkItem> shadowRay;
+                if (lightCandidates == 1)
+                    shadowRay = sampleLight(raySamples.direct.uc, raySamples.direct.u);
+                else {
+                    // Resample light candidates according to their unshadowed
+                    // contributions; the first candidate uses the sampler's
+                    // samples and the rest use an _RNG_ seeded from them
+                    RNG rng(Hash(raySamples.direct.uc, raySamples.direct.u));
+                    WeightedReservoirSampler<ShadowRayWorkItem> candidateSampler(
+                        Hash(raySamples.direct.u, raySamples.direct.uc));
+                    for (int i = 0; i < lightCandidates; ++i) {
+                        Float uc = raySamples.direct.uc;
+                        Point2f u = raySamples.direct.u;
+                        if (i > 0) {
+                            uc = rng.Uniform<Float>();
+                            u = Point2f(rng.Uniform<Float>(), rng.Uniform<Float>());
+                        }
+                        pstd::optional<ShadowRayWorkItem> candidate = sampleLight(uc, u);
+                        if (!candidate)
+                            continue;
+                        SampledSpectrum r = candidate->r_u + candidate->r_l;
+                        Float weight = (candidate->Ld / r.Average()).Average();
+                        if (weight > 0)
+                            candidateSampler.Add(*candidate, weight);
+                    }
+                    if (candidateSampler.HasSample()) {
+                        shadowRay = candidateSampler.GetSample();
+                        shadowRay->Ld /=
+                            lightCandidates * candidateSampler.SampleProbability();
+                    }
+                }
+                if (!shadowRay)
                     return;
+                shadowRayQueue->Push(*shadowRay);
 
-                // Compute path throughput and path PDFs for light sample
-                SampledSpectrum beta = w.beta * f * AbsDot(wi, ns);
-                PBRT_DBG("w.beta %f %f %f %f f %f %f %f %f dot %f\n", w.beta[0],
-                         w.beta[1], w.beta[2], w.beta[3], f[0], f[1], f[2], f[3],
-                         AbsDot(wi, ns));
-
-                PBRT_DBG(
-                    "me index %d depth %d beta %f %f %f %f f %f %f %f %f ls.L %f %f %f "
-                    "%f ls.pdf %f\n",
-                    w.pixelIndex, w.depth, beta[0], beta[1], beta[2], beta[3], f[0], f[1],
-                    f[2], f[3], ls->L[0], ls->L[1], ls->L[2], ls->L[3], ls->pdf);
-
-                Float lightPDF = ls->pdf * sampledLight->p;
-                // This causes r_u to be zero for the shadow ray, so that
-                // part of MIS just becomes a no-op.
-                Float bsdfPDF =
-                    IsDeltaLight(light.Type()) ? 0.f : bsdf.PDF<ConcreteBxDF>(wo, wi);
-                SampledSpectrum r_u = w.r_u * bsdfPDF;
-                SampledSpectrum r_l = w.r_u * lightPDF;
-
-                // Enqueue shadow ray with tentative radiance contribution
-                SampledSpectrum Ld = beta * ls->L;
-                Ray ray = SpawnRayTo(w.pi, w.n, w.time, ls->pLight.pi, ls->pLight.n);
-                // Initialize _ray_ medium if media are present
-                if (haveMedia)
-                    ray.medium = Dot(ray.d, w.n) > 0 ? w.mediumInterface.outside
-                                                     : w.mediumInterface.inside;
-
-                shadowRayQueue->Push(ShadowRayWorkItem{ray, 1 - ShadowEpsilon, lambda, Ld,
-                                                       r_u, r_l, w.pixelIndex});
-
-                PBRT_DBG("w.index %d spawned shadow ray depth %d Ld %f %f %f %f "
-                         "new beta %f %f %f %f beta/uni %f %f %f %f Ld/uni %f %f %f %f\n",
-                         w.pixelIndex, w.depth, Ld[0], Ld[1], Ld[2], Ld[3], beta[0],
-                         beta[1], beta[2], beta[3], SafeDiv(beta, r_u)[0],
-                         SafeDiv(beta, r_u)[1], SafeDiv(beta, r_u)[2],
-                         SafeDiv(beta, r_u)[3], SafeDiv(Ld, r_u)[0],
-                         SafeDiv(Ld, r_u)[1], SafeDiv(Ld, r_u)[2],
-                         SafeDiv(Ld, r_u)[3]);
+                PBRT_DBG("w.index %d spawned shadow ray depth %d Ld %f %f %f %f\n",
+                         w.pixelIndex, w.depth, shadowRay->Ld[0], shadowRay->Ld[1],
+                         shadowRay->Ld[2], shadowRay->Ld[3]);
             }
         });
+    // GPU kernel times are reported with the other GPU kernel statistics
+    if (!Options->useGPU)
+        materialEvalTimeUS += int64_t(1e6 * timer.ElapsedSeconds());
 }
 
 }  // namespace pbrt
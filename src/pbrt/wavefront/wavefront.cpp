@@ -7,12 +7,18 @@
 #ifdef PBRT_BUILD_GPU_RENDERER
 #include <pbrt/gpu/memory.h>
 #endif  // PBRT_BUILD_GPU_RENDERER
+#include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
+#include <pbrt/util/stats.h>
 #include <pbrt/wavefront/integrator.h>
 
 namespace pbrt {
 
 void RenderWavefront(BasicScene &scene) {
     WavefrontPathIntegrator *integrator = nullptr;
+    Timer sceneTimer;
 
 #ifdef PBRT_BUILD_GPU_RENDERER
     if (Options->useGPU) {
@@ -38,9 +44,16 @@ void RenderWavefront(BasicScene &scene) {
         integrator =
             new WavefrontPathIntegrator(pstd::pmr::get_default_resource(), scene);
 
+    StatsReportBenchmarkPhase(BenchmarkPhase::SceneCreation, sceneTimer.ElapsedSeconds());
+    if (Options->sampleRange && !integrator->film.Is<RGBFilm>())
+        ErrorExit("--sample-range requires the \"rgb\" film.");
+
     ///////////////////////////////////////////////////////////////////////////
     // Render!
     Float seconds = integrator->Render();
+    StatsReportBenchmarkPhase(BenchmarkPhase::Render, seconds);
+    StatsReportBenchmarkRays(integrator->stats->cameraRays,
+                             integrator->stats->TotalRays());
 
     LOG_VERBOSE("Total rendering time: %.3f s", seconds);
 
@@ -51,7 +64,19 @@ void RenderWavefront(BasicScene &scene) {
 #endif  // PBRT_BUILD_GPU_RENDERER
 
         Printf("Wavefront integrator statistics:\n");
-        Printf("%s\n", integrator->stats->Print());
+        Printf("%s\n", integrator->stats->Print(seconds));
+    }
+
+    if (!Options->renderProfileFile.empty()) {
+        std::string kernels = "[]";
+#ifdef PBRT_BUILD_GPU_RENDERER
+        if (Options->useGPU)
+            kernels = KernelStatsJSON();
+#endif  // PBRT_BUILD_GPU_RENDERER
+        std::string profile = StringPrintf("{\n  \"rays\": %s,\n  \"kernels\": %s\n}\n",
+                                           integrator->stats->ToJSON(seconds), kernels);
+        if (!WriteFileContents(Options->renderProfileFile, profile))
+            Warning("%s: unable to write render profile.", Options->renderProfileFile);
     }
 
 #ifdef PBRT_BUILD_GPU_RENDERER
@@ -65,8 +90,21 @@ void RenderWavefront(BasicScene &scene) {
     ImageMetadata metadata;
     integrator->camera.InitMetadata(&metadata);
     metadata.renderTimeSeconds = seconds;
-    metadata.samplesPerPixel = integrator->sampler.SamplesPerPixel();
-    integrator->film.WriteImage(metadata);
+    metadata.samplesPerPixel = integrator->samplesRendered;
+    if (integrator->sppmPixels)
+        integrator->WriteSPPMImage(metadata);
+    else
+        integrator->film.WriteImage(metadata);
+
+    // With --sample-range, also write the raw sums for imgtool mergefilm
+    if (Options->sampleRange) {
+        std::string filename = RemoveExtension(integrator->film.GetFilename()) + ".film";
+        int sampleStart = Options->sampleRange->x;
+        RGBFilmDump dump = integrator->film.Cast<RGBFilm>()->GetDump(
+            sampleStart, sampleStart + integrator->samplesRendered);
+        if (!dump.Write(filename))
+            Warning("%s: unable to write film dump.", filename);
+    }
 }
 
 }  // namespace pbrt
@@ -46,8 +46,6 @@ struct SOA<RaySamples> {
         direct = alloc.allocate_object<Float4>(size);
         indirect = alloc.allocate_object<Float4>(size);
         subsurface = alloc.allocate_object<Float4>(size);
-        mediaDist = alloc.allocate_object<Float>(size);
-        mediaMode = alloc.allocate_object<Float>(size);
     }
 
     PBRT_CPU_GPU
@@ -100,7 +98,6 @@ struct SOA<RaySamples> {
     Float4 *PBRT_RESTRICT direct;
     Float4 *PBRT_RESTRICT indirect;
     Float4 *PBRT_RESTRICT subsurface;
-    Float *PBRT_RESTRICT mediaDist, *PBRT_RESTRICT mediaMode;
 };
 
 // PixelSampleState Definition
@@ -110,7 +107,6 @@ struct PixelSampleState {
     SampledSpectrum L;
     SampledWavelengths lambda;
     Float filterWeight;
-    VisibleSurface visibleSurface;
     SampledSpectrum cameraRayWeight;
     RaySamples samples;
 };
@@ -246,6 +242,14 @@ struct MediumSampleWorkItem {
     MediumInterface mediumInterface;
 };
 
+// MediumSampleIndex Definition
+// Index of a work item in a _MediumSampleQueue_ whose ray is in a medium of
+// type _ConcreteMedium_; _void_ is used for items of any type of medium
+template <typename ConcreteMedium>
+struct MediumSampleIndex {
+    int index;
+};
+
 // MediumScatterWorkItem Definition
 template <typename PhaseFunction>
 struct MediumScatterWorkItem {
@@ -303,6 +307,34 @@ struct MaterialEvalWorkItem {
         return ctx;
     }
 
+    // Returns the work item with its material pointer converted to point to
+    // a _Material_ of type _M_
+    template <typename M>
+    PBRT_CPU_GPU MaterialEvalWorkItem<M> CastMaterial() const {
+        return MaterialEvalWorkItem<M>{static_cast<const M *>(material),
+                                       pi,
+                                       n,
+                                       dpdu,
+                                       dpdv,
+                                       time,
+                                       depth,
+                                       ns,
+                                       dpdus,
+                                       dpdvs,
+                                       dndus,
+                                       dndvs,
+                                       uv,
+                                       faceIndex,
+                                       lambda,
+                                       pixelIndex,
+                                       anyNonSpecularBounces,
+                                       wo,
+                                       beta,
+                                       r_u,
+                                       etaScale,
+                                       mediumInterface};
+    }
+
     // MaterialEvalWorkItem Public Members
     const ConcreteMaterial *material;
     Point3fi pi;
@@ -324,6 +356,14 @@ struct MaterialEvalWorkItem {
     MediumInterface mediumInterface;
 };
 
+// MaterialEvalIndex Definition
+// Index of a work item in _MaterialEvalQueue::items_ that uses a material of
+// type _ConcreteMaterial_
+template <typename ConcreteMaterial>
+struct MaterialEvalIndex {
+    int index;
+};
+
 #include "wavefront_workitems_soa.h"
 
 // RayQueue Definition
@@ -458,11 +498,30 @@ class SubsurfaceScatterQueue : public WorkQueue<SubsurfaceScatterWorkItem> {
 };
 
 // MediumSampleQueue Definition
+// The work items are stored in the queue itself, and the index of each one is
+// also added to the queue for its ray's type of medium, so that each type can
+// be sampled by its own kernel. Rays that pass through the medium to the
+// surface they hit are then added to _Transmitted()_.
 class MediumSampleQueue : public WorkQueue<MediumSampleWorkItem> {
   public:
-    using WorkQueue::WorkQueue;
+    // MediumSampleQueue Public Methods
+    MediumSampleQueue(int n, Allocator alloc, pstd::span<const bool> haveType)
+        : WorkQueue(n, alloc), indices(n, alloc, haveType), transmitted(n, alloc) {}
 
-    using WorkQueue::Push;
+    template <typename ConcreteMedium>
+    PBRT_CPU_GPU WorkQueue<MediumSampleIndex<ConcreteMedium>> *Get() {
+        return indices.Get<MediumSampleIndex<ConcreteMedium>>();
+    }
+
+    PBRT_CPU_GPU
+    WorkQueue<MediumSampleIndex<void>> *Transmitted() { return &transmitted; }
+
+    PBRT_CPU_GPU
+    int Push(const MediumSampleWorkItem &w) {
+        int index = WorkQueue::Push(w);
+        PushIndex(w.ray.medium, index);
+        return index;
+    }
 
     PBRT_CPU_GPU
     int Push(Ray ray, Float tMax, SampledWavelengths lambda, SampledSpectrum beta,
@@ -481,6 +540,7 @@ class MediumSampleQueue : public WorkQueue<MediumSampleWorkItem> {
         this->specularBounce[index] = specularBounce;
         this->anyNonSpecularBounces[index] = anyNonSpecularBounces;
         this->etaScale[index] = etaScale;
+        PushIndex(ray.medium, index);
         return index;
     }
 
@@ -489,6 +549,29 @@ class MediumSampleQueue : public WorkQueue<MediumSampleWorkItem> {
         return Push(r.ray, tMax, r.lambda, r.beta, r.r_u, r.r_l, r.pixelIndex,
                     r.prevIntrCtx, r.specularBounce, r.anyNonSpecularBounces, r.etaScale);
     }
+
+    PBRT_CPU_GPU
+    void Reset() {
+        WorkQueue::Reset();
+        indices.Reset();
+        transmitted.Reset();
+    }
+
+  private:
+    // MediumSampleQueue Private Methods
+    PBRT_CPU_GPU
+    void PushIndex(Medium medium, int index) {
+        auto push = [&](auto ptr) {
+            using ConcreteMedium = typename std::remove_reference_t<decltype(*ptr)>;
+            indices.Push(MediumSampleIndex<ConcreteMedium>{index});
+        };
+        medium.Dispatch(push);
+    }
+
+    // MediumSampleQueue Private Members
+    MultiWorkQueue<typename MapType<MediumSampleIndex, typename Medium::Types>::type>
+        indices;
+    WorkQueue<MediumSampleIndex<void>> transmitted;
 };
 
 // MediumScatterQueue Definition
@@ -496,8 +579,79 @@ using MediumScatterQueue = MultiWorkQueue<
     typename MapType<MediumScatterWorkItem, typename PhaseFunction::Types>::type>;
 
 // MaterialEvalQueue Definition
-using MaterialEvalQueue = MultiWorkQueue<
-    typename MapType<MaterialEvalWorkItem, typename Material::Types>::type>;
+// Each ray enqueues at most one material evaluation work item, so the items
+// for all types of material are stored together in _items_, which may also be
+// shared between queues; each type's queue only stores the indices of its
+// items there.
+class MaterialEvalQueue {
+  public:
+    // MaterialEvalQueue Public Methods
+    MaterialEvalQueue(int n, Allocator alloc, pstd::span<const bool> haveType,
+                      WorkQueue<MaterialEvalWorkItem<void>> *items)
+        : indices(n, alloc, haveType), items(items) {}
+
+    template <typename ConcreteMaterial>
+    PBRT_CPU_GPU WorkQueue<MaterialEvalIndex<ConcreteMaterial>> *Get() {
+        return indices.Get<MaterialEvalIndex<ConcreteMaterial>>();
+    }
+
+    PBRT_CPU_GPU
+    const WorkQueue<MaterialEvalWorkItem<void>> *Items() const { return items; }
+
+    template <typename ConcreteMaterial>
+    PBRT_CPU_GPU MaterialEvalWorkItem<ConcreteMaterial> Item(
+        MaterialEvalIndex<ConcreteMaterial> entry) const {
+        MaterialEvalWorkItem<void> w = (*items)[entry.index];
+        return w.CastMaterial<ConcreteMaterial>();
+    }
+
+    template <typename ConcreteMaterial>
+    PBRT_CPU_GPU int Push(const MaterialEvalWorkItem<ConcreteMaterial> &w) {
+        int index = items->Push(w.template CastMaterial<void>());
+        return indices.Push(MaterialEvalIndex<ConcreteMaterial>{index});
+    }
+
+    // Note: _items_ must be reset separately, since it may be shared
+    PBRT_CPU_GPU
+    void Reset() { indices.Reset(); }
+
+  private:
+    // MaterialEvalQueue Private Members
+    MultiWorkQueue<typename MapType<MaterialEvalIndex, typename Material::Types>::type>
+        indices;
+    WorkQueue<MaterialEvalWorkItem<void>> *items;
+};
+
+// SPPMPixel Definition
+// A film pixel's state with the "sppm" integrator: the visible point where its
+// camera path ended, if any, and the photons gathered there. The visible
+// point's BxDF is copied into _bxdf_ so that its BSDF can be evaluated after
+// the camera pass.
+struct SPPMPixel {
+    // SPPMPixel Public Members
+    Float radius = 0;
+    Point3f p;
+    Vector3f wo;
+    BSDF bsdf;
+    SampledSpectrum beta = SampledSpectrum(0.f);
+    bool secondaryLambdaTerminated = false;
+    alignas(MaxAlignOf<BxDF::Types>::value) uint8_t bxdf[MaxSizeOf<BxDF::Types>::value];
+    // The current iteration's photon contributions and their count
+    AtomicFloat Phi_i[3];
+    AtomicInt m;
+    RGB tau;
+    Float n = 0;
+};
+
+// SPPMGridEntry Definition
+// A visible point in a cell of the SPPM hash grid, the entries of each of whose
+// cells are linked together through _next_, ending with -1.
+struct SPPMGridEntry {
+    Point3f p;
+    Float radiusSquared;
+    int pixelIndex;
+    int next;
+};
 
 }  // namespace pbrt
 
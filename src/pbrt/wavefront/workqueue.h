@@ -15,7 +15,9 @@
 #include <pbrt/util/pstd.h>
 
 #include <atomic>
+#include <cstdint>
 #include <utility>
+#include <vector>
 
 #ifdef __CUDACC__
 
@@ -114,28 +116,88 @@ class WorkQueue : public SOA<WorkItem> {
 #endif  // PBRT_IS_GPU_CODE
 };
 
+// Number of consecutive work items that each CPU thread processes together
+// in wavefront kernels. Threads are handed whole groups so that neighboring
+// SoA entries, which share cache lines, are read and written by one thread.
+static constexpr int CPUWorkGroupSize = 16;
+
 // WorkQueue Inline Functions
+// Returns the indices in the low 32 bits of _keys_ ordered by the
+// _nKeyBits_-bit keys stored above them, using a radix sort.
+inline std::vector<int> RadixSortedOrder(std::vector<uint64_t> keys, int nKeyBits) {
+    constexpr int bitsPerPass = 11, nBuckets = 1 << bitsPerPass;
+    int nPasses = (nKeyBits + bitsPerPass - 1) / bitsPerPass;
+    std::vector<uint64_t> temp(keys.size());
+    for (int pass = 0; pass < nPasses; ++pass) {
+        int lowBit = 32 + pass * bitsPerPass;
+        std::vector<uint64_t> &in = (pass & 1) ? temp : keys;
+        std::vector<uint64_t> &out = (pass & 1) ? keys : temp;
+        int outIndex[nBuckets] = {0};
+        for (uint64_t k : in)
+            ++outIndex[(k >> lowBit) & (nBuckets - 1)];
+        for (int i = 0, sum = 0; i < nBuckets; ++i) {
+            int count = outIndex[i];
+            outIndex[i] = sum;
+            sum += count;
+        }
+        for (uint64_t k : in)
+            out[outIndex[(k >> lowBit) & (nBuckets - 1)]++] = k;
+    }
+    const std::vector<uint64_t> &sorted = (nPasses & 1) ? temp : keys;
+
+    std::vector<int> order(sorted.size());
+    for (size_t i = 0; i < sorted.size(); ++i)
+        order[i] = uint32_t(sorted[i]);
+    return order;
+}
+
+// If _order_ is non-null, CPU threads process the items of _q_ in the order
+// of the indices that it gives.
 template <typename F, typename WorkItem>
 void ForAllQueued(const char *desc, const WorkQueue<WorkItem> *q, int maxQueued,
-                  F &&func) {
+                  const int *order, F &&func) {
     if (Options->useGPU) {
         // Launch GPU threads to process _q_ using _func_
 #ifdef PBRT_BUILD_GPU_RENDERER
-        GPUParallelFor(desc, maxQueued, [=] PBRT_GPU(int index) mutable {
-            if (index >= q->Size())
-                return;
-            func((*q)[index]);
-        });
+        if (Options->gpuPersistentThreads)
+            // Launch only resident threads, which loop over the queued items
+            GPUPersistentParallelFor(
+                desc, maxQueued, [=] PBRT_GPU() { return q->Size(); },
+                [=] PBRT_GPU(int index) mutable { func((*q)[index]); });
+        else
+            GPUParallelFor(desc, maxQueued, [=] PBRT_GPU(int index) mutable {
+                if (index >= q->Size())
+                    return;
+                func((*q)[index]);
+            });
 #else
         LOG_FATAL("Options->useGPU was set without PBRT_BUILD_GPU_RENDERER enabled");
 #endif
 
     } else {
         // Process _q_ using _func_ with CPU threads
-        ParallelFor(0, q->Size(), [&](int index) { func((*q)[index]); });
+        // Looping over each range here, rather than going through the
+        // per-item _std::function_ wrapper, lets the compiler inline and
+        // vectorize _func_ across the group's items.
+        int nItems = q->Size();
+        int nGroups = (nItems + CPUWorkGroupSize - 1) / CPUWorkGroupSize;
+        ParallelFor(
+            0, nGroups,
+            [&](int64_t startGroup, int64_t endGroup) {
+                int end = std::min<int64_t>(nItems, endGroup * CPUWorkGroupSize);
+                for (int index = startGroup * CPUWorkGroupSize; index < end; ++index)
+                    func((*q)[order ? order[index] : index]);
+            },
+            &typeid(F));
     }
 }
 
+template <typename F, typename WorkItem>
+void ForAllQueued(const char *desc, const WorkQueue<WorkItem> *q, int maxQueued,
+                  F &&func) {
+    ForAllQueued(desc, q, maxQueued, nullptr, std::forward<F>(func));
+}
+
 // MultiWorkQueue Definition
 template <typename T>
 class MultiWorkQueue;